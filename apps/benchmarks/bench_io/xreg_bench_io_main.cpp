@@ -0,0 +1,877 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <fstream>
+#include <functional>
+#include <random>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include <fmt/format.h>
+
+#include <itkImageFileWriter.h>
+#include <itkGDCMImageIO.h>
+#include <itkMetaDataObject.h>
+
+#include "xregProgOptUtils.h"
+#include "xregStringUtils.h"
+#include "xregFilesystemUtils.h"
+#include "xregBenchUtils.h"
+#include "xregITKBasicImageUtils.h"
+#include "xregHDF5.h"
+#include "xregMesh.h"
+#include "xregH5ProjDataIO.h"
+#include "xregH5MeshIO.h"
+#include "xregSTLMeshIO.h"
+#include "xregDICOMUtils.h"
+#include "xregStaRawVol.h"
+#include "xregRadRawProj.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+using size_type = std::size_t;
+
+struct BenchConfig
+{
+  std::string bench;
+
+  // number of pixels along each dimension of a projection or volume, or the
+  // approximate number of triangles of a mesh
+  size_type size;
+
+  // zero when the benchmark does not use projection data
+  size_type num_projs;
+
+  // only used by the HDF5 benchmarks
+  bool compress;
+};
+
+struct BenchResult
+{
+  BenchConfig cfg;
+
+  bool ok;
+
+  std::string err_msg;
+
+  BenchTiming timing;
+
+  // size of the file (or directory) read or written
+  size_type num_bytes;
+
+  double bytes_per_sec;
+
+  // resident memory before the timed runs, after the synthetic data was
+  // created, and the peak resident memory during the timed runs
+  size_type base_rss_bytes;
+  size_type peak_rss_bytes;
+};
+
+bool IsProjBench(const std::string& bench)
+{
+  return (bench == "proj-h5-write") || (bench == "proj-h5-read") ||
+         (bench == "proj-h5-deferred");
+}
+
+bool IsH5Bench(const std::string& bench)
+{
+  return IsProjBench(bench) || (bench == "vol-h5-write") || (bench == "vol-h5-read") ||
+         (bench == "mesh-h5-write") || (bench == "mesh-h5-read");
+}
+
+bool IsMeshBench(const std::string& bench)
+{
+  return (bench == "mesh-h5-write") || (bench == "mesh-h5-read") ||
+         (bench == "stl-write") || (bench == "stl-read");
+}
+
+#ifdef __linux__
+// Reads a memory field of /proc/self/status, which is reported in kB
+size_type ReadProcStatusBytes(const std::string& field)
+{
+  std::ifstream in("/proc/self/status");
+
+  const std::string prefix = field + ":";
+
+  std::string line;
+
+  while (std::getline(in, line))
+  {
+    if (line.compare(0, prefix.size(), prefix) == 0)
+    {
+      return StringCast<size_type>(StringSplit(line.substr(prefix.size()))[0]) * 1024;
+    }
+  }
+
+  return 0;
+}
+#endif
+
+// Resets the peak resident memory of this process to the current resident
+// memory. Returns false when this is not supported, in which case the peak
+// is over the lifetime of the process.
+bool ResetPeakRSS()
+{
+#ifdef __linux__
+  std::ofstream out("/proc/self/clear_refs");
+  out << "5";
+  out.flush();
+
+  return out.good();
+#else
+  return false;
+#endif
+}
+
+size_type CurRSSBytes()
+{
+#ifdef __linux__
+  return ReadProcStatusBytes("VmRSS");
+#else
+  return 0;
+#endif
+}
+
+size_type PeakRSSBytes()
+{
+#if defined(__linux__)
+  return ReadProcStatusBytes("VmHWM");
+#elif !defined(_WIN32)
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+#ifdef __APPLE__
+  return static_cast<size_type>(usage.ru_maxrss);
+#else
+  return static_cast<size_type>(usage.ru_maxrss) * 1024;
+#endif
+#else
+  return 0;
+#endif
+}
+
+// Smooth pattern with additive noise, so that the data compresses similarly
+// to real images
+template <class T>
+void FillSyntheticPixels(T* buf, const size_type num_pix, const size_type row_len,
+                         const double max_val, std::mt19937& rng_eng)
+{
+  std::normal_distribution<double> noise_dist(0, 0.02);
+
+  for (size_type i = 0; i < num_pix; ++i)
+  {
+    const size_type r = i / row_len;
+    const size_type c = i % row_len;
+
+    const double v = 0.5 + (0.2 * std::sin(c * 0.05)) + (0.2 * std::cos(r * 0.03)) +
+                     noise_dist(rng_eng);
+
+    buf[i] = static_cast<T>(max_val * std::min(1.0, std::max(0.0, v)));
+  }
+}
+
+ProjDataF32List MakeSyntheticProjs(const size_type dim, const size_type num_projs,
+                                   std::mt19937& rng_eng)
+{
+  ProjDataF32List projs(num_projs);
+
+  for (auto& pd : projs)
+  {
+    pd.cam.setup(1000, dim, dim, 0.2, 0.2);
+
+    pd.img = MakeITK2DVol<float>(dim, dim);
+
+    const std::array<double,2> spacing = { 0.2, 0.2 };
+    pd.img->SetSpacing(spacing.data());
+
+    FillSyntheticPixels(pd.img->GetBufferPointer(), dim * dim, dim, 5.0, rng_eng);
+  }
+
+  return projs;
+}
+
+itk::Image<float,3>::Pointer MakeSyntheticVol(const size_type dim, std::mt19937& rng_eng)
+{
+  auto vol = MakeITK3DVol<float>(dim, dim, dim);
+
+  FillSyntheticPixels(vol->GetBufferPointer(), dim * dim * dim, dim, 1000.0, rng_eng);
+
+  return vol;
+}
+
+// Triangulated height field over a square grid with approximately the
+// requested number of triangles
+TriMesh MakeSyntheticMesh(const size_type num_tris_req)
+{
+  const size_type n = std::max(size_type(2),
+          static_cast<size_type>(std::lround(std::sqrt(num_tris_req / 2.0))) + 1);
+
+  TriMesh mesh;
+
+  mesh.vertices.reserve(n * n);
+
+  for (size_type r = 0; r < n; ++r)
+  {
+    for (size_type c = 0; c < n; ++c)
+    {
+      mesh.vertices.push_back(Pt3(c * 0.5, r * 0.5, 10 * std::sin(c * 0.05) * std::cos(r * 0.05)));
+    }
+  }
+
+  mesh.faces.reserve(2 * (n - 1) * (n - 1));
+
+  for (size_type r = 0; (r + 1) < n; ++r)
+  {
+    for (size_type c = 0; (c + 1) < n; ++c)
+    {
+      const size_type v = (r * n) + c;
+
+      mesh.faces.push_back(TriMesh::Triangle{ { v, v + 1, v + n } });
+      mesh.faces.push_back(TriMesh::Triangle{ { v + 1, v + n + 1, v + n } });
+    }
+  }
+
+  return mesh;
+}
+
+void WriteRawBytes(const std::string& path, const void* buf, const size_type num_bytes)
+{
+  std::ofstream out(path, std::ios::binary);
+
+  out.write(static_cast<const char*>(buf), num_bytes);
+
+  if (!out.good())
+  {
+    xregThrow("failed to write raw file: %s", path.c_str());
+  }
+}
+
+void WriteIdentityTPosition(std::ostream& out)
+{
+  out << "TPosition\n"
+         "1 0 0 0\n"
+         "0 1 0 0\n"
+         "0 0 1 0\n"
+         "0 0 0 1\n";
+}
+
+// .sta metadata file and uint8 .raw voxels
+void WriteSyntheticStaRawVol(const std::string& sta_path, const size_type dim,
+                             std::mt19937& rng_eng)
+{
+  {
+    std::ofstream out(sta_path);
+
+    out << fmt::format("Size[pixels]: {} {} {}\n", dim, dim, dim)
+        << "Step[mm]: 1 1 1\n"
+        << "DataType: uint8\n";
+
+    WriteIdentityTPosition(out);
+  }
+
+  const size_type num_vox = dim * dim * dim;
+
+  std::vector<unsigned char> buf(num_vox);
+
+  FillSyntheticPixels(buf.data(), num_vox, dim, 255.0, rng_eng);
+
+  WriteRawBytes(fmt::format("{}.raw", std::get<0>(Path(sta_path).split_ext())),
+                buf.data(), num_vox);
+}
+
+// .rad metadata file and float .raw pixels
+void WriteSyntheticRadRawProj(const std::string& rad_path, const size_type dim,
+                              std::mt19937& rng_eng)
+{
+  {
+    std::ofstream out(rad_path);
+
+    out << fmt::format("Size[pixels]: {} {}\n", dim, dim)
+        << "Step[mm]: 0.2 0.2\n"
+        << "DataType: float\n"
+        << "SourcePosition[mm]: 0 0 1000\n";
+
+    WriteIdentityTPosition(out);
+  }
+
+  const size_type num_pix = dim * dim;
+
+  std::vector<float> buf(num_pix);
+
+  FillSyntheticPixels(buf.data(), num_pix, dim, 5.0, rng_eng);
+
+  WriteRawBytes(fmt::format("{}.raw", std::get<0>(Path(rad_path).split_ext())),
+                buf.data(), sizeof(float) * num_pix);
+}
+
+// A CT series of dim slices, each of dim x dim pixels, one slice per file
+void WriteSyntheticDICOMSeries(const std::string& dir_path, const size_type dim,
+                               std::mt19937& rng_eng)
+{
+  using Slice  = itk::Image<short,2>;
+  using Writer = itk::ImageFileWriter<Slice>;
+
+  const std::string uid_root = "1.2.826.0.1.3680043.2.1125.424242";
+
+  for (size_type z = 0; z < dim; ++z)
+  {
+    auto slice = MakeITK2DVol<short>(dim, dim);
+
+    FillSyntheticPixels(slice->GetBufferPointer(), dim * dim, dim, 2000.0, rng_eng);
+
+    itk::MetaDataDictionary& dict = slice->GetMetaDataDictionary();
+
+    itk::EncapsulateMetaData<std::string>(dict, "0010|0010", "XREG^BENCH");
+    itk::EncapsulateMetaData<std::string>(dict, "0010|0020", "XREGBENCH");
+    itk::EncapsulateMetaData<std::string>(dict, "0008|0030", "120000");
+    itk::EncapsulateMetaData<std::string>(dict, "0008|0060", "CT");
+    itk::EncapsulateMetaData<std::string>(dict, "0020|000d", uid_root + ".1");
+    itk::EncapsulateMetaData<std::string>(dict, "0020|000e", uid_root + ".2");
+    itk::EncapsulateMetaData<std::string>(dict, "0008|0018", fmt::format("{}.3.{}", uid_root, z + 1));
+    itk::EncapsulateMetaData<std::string>(dict, "0020|0013", fmt::format("{}", z + 1));
+    itk::EncapsulateMetaData<std::string>(dict, "0020|0032", fmt::format("0\\0\\{}", z));
+    itk::EncapsulateMetaData<std::string>(dict, "0020|0037", "1\\0\\0\\0\\1\\0");
+    itk::EncapsulateMetaData<std::string>(dict, "0028|0030", "1\\1");
+
+    itk::GDCMImageIO::Pointer gdcm_io = itk::GDCMImageIO::New();
+    gdcm_io->KeepOriginalUIDOn();
+
+    Writer::Pointer writer = Writer::New();
+    writer->SetImageIO(gdcm_io);
+    writer->SetInput(slice);
+    writer->SetFileName((Path(dir_path) + Path(fmt::format("slice_{:05d}.dcm", z))).string());
+    writer->Update();
+  }
+}
+
+size_type FileOrDirNumBytes(const std::string& path)
+{
+  const Path p(path);
+
+  size_type num_bytes = 0;
+
+  if (p.is_dir())
+  {
+    PathStringList file_paths;
+    GetFilePathsFromDir(p, &file_paths);
+
+    for (const auto& fp : file_paths)
+    {
+      num_bytes += Path(fp).file_size();
+    }
+  }
+  else
+  {
+    num_bytes = p.file_size();
+  }
+
+  return num_bytes;
+}
+
+struct IOSettings
+{
+  std::string work_dir;
+
+  bool keep_files;
+
+  size_type deferred_num_prefetch;
+};
+
+BenchResult RunBench(const BenchConfig& cfg, const IOSettings& io_settings,
+                     const size_type num_warmup, const size_type num_iters)
+{
+  BenchResult res;
+
+  res.cfg = cfg;
+  res.ok  = false;
+
+  res.num_bytes      = 0;
+  res.bytes_per_sec  = 0;
+  res.base_rss_bytes = 0;
+  res.peak_rss_bytes = 0;
+
+  try
+  {
+    std::mt19937 rng_eng(1234);
+
+    // every configuration uses a new directory, which is removed afterwards
+    // unless the files should be kept for inspection
+    CreateTempDir tmp_dir((Path(io_settings.work_dir) + Path("xreg_bench_io")).string());
+    tmp_dir.set_should_delete(!io_settings.keep_files);
+
+    const Path tmp_dir_path(tmp_dir.path());
+
+    // the synthetic data, which must outlive the benchmark function
+    ProjDataF32List projs;
+    itk::Image<float,3>::Pointer vol;
+    TriMesh mesh;
+
+    // the file, or directory, read or written by the benchmark
+    std::string io_path;
+
+    std::function<void()> bench_fn;
+
+    if (IsProjBench(cfg.bench))
+    {
+      projs = MakeSyntheticProjs(cfg.size, cfg.num_projs, rng_eng);
+
+      io_path = (tmp_dir_path + Path("projs.h5")).string();
+
+      const bool compress = cfg.compress;
+
+      if (cfg.bench == "proj-h5-write")
+      {
+        bench_fn = [&projs,io_path,compress] ()
+        {
+          WriteProjDataH5ToDisk(projs, io_path, compress);
+        };
+      }
+      else
+      {
+        WriteProjDataH5ToDisk(projs, io_path, compress);
+
+        // the images are only needed to create the file
+        projs.clear();
+
+        if (cfg.bench == "proj-h5-read")
+        {
+          bench_fn = [io_path] ()
+          {
+            ReadProjDataH5F32FromDisk(io_path);
+          };
+        }
+        else
+        {
+          const size_type num_prefetch = io_settings.deferred_num_prefetch;
+
+          bench_fn = [io_path,num_prefetch] ()
+          {
+            // prefetched images are stored in the cache
+            DeferredProjReader reader(io_path, num_prefetch > 0);
+
+            if (num_prefetch)
+            {
+              reader.set_num_prefetch(num_prefetch);
+            }
+
+            const size_type num_projs = reader.num_projs_on_disk();
+
+            for (size_type proj_idx = 0; proj_idx < num_projs; ++proj_idx)
+            {
+              reader.read_proj_F32(proj_idx);
+            }
+          };
+        }
+      }
+    }
+    else if ((cfg.bench == "vol-h5-write") || (cfg.bench == "vol-h5-read"))
+    {
+      vol = MakeSyntheticVol(cfg.size, rng_eng);
+
+      io_path = (tmp_dir_path + Path("vol.h5")).string();
+
+      const bool compress = cfg.compress;
+
+      auto write_fn = [&vol,io_path,compress] ()
+      {
+        H5::H5File h5(io_path, H5F_ACC_TRUNC);
+
+        WriteImageH5(vol.GetPointer(), &h5, compress);
+
+        h5.flush(H5F_SCOPE_GLOBAL);
+        h5.close();
+      };
+
+      if (cfg.bench == "vol-h5-write")
+      {
+        bench_fn = write_fn;
+      }
+      else
+      {
+        write_fn();
+
+        vol = itk::Image<float,3>::Pointer();
+
+        bench_fn = [io_path] ()
+        {
+          H5::H5File h5(io_path, H5F_ACC_RDONLY);
+
+          ReadITKImageH5Float3D(h5);
+        };
+      }
+    }
+    else if (IsMeshBench(cfg.bench))
+    {
+      mesh = MakeSyntheticMesh(cfg.size);
+
+      const bool is_stl = (cfg.bench == "stl-write") || (cfg.bench == "stl-read");
+
+      io_path = (tmp_dir_path + Path(is_stl ? "mesh.stl" : "mesh.h5")).string();
+
+      const bool compress = cfg.compress;
+
+      std::function<void()> write_fn;
+
+      if (is_stl)
+      {
+        write_fn = [&mesh,io_path] ()
+        {
+          WriteSTLMesh(io_path, mesh);
+        };
+      }
+      else
+      {
+        write_fn = [&mesh,io_path,compress] ()
+        {
+          WriteMeshH5File(mesh, io_path, compress);
+        };
+      }
+
+      if ((cfg.bench == "stl-write") || (cfg.bench == "mesh-h5-write"))
+      {
+        bench_fn = write_fn;
+      }
+      else
+      {
+        write_fn();
+
+        mesh = TriMesh();
+
+        if (is_stl)
+        {
+          bench_fn = [io_path] ()
+          {
+            ReadSTLMesh(io_path);
+          };
+        }
+        else
+        {
+          bench_fn = [io_path] ()
+          {
+            ReadMeshH5File(io_path);
+          };
+        }
+      }
+    }
+    else if (cfg.bench == "dicom-dir-scan")
+    {
+      io_path = (tmp_dir_path + Path("dicom")).string();
+
+      MakeDir(io_path);
+
+      WriteSyntheticDICOMSeries(io_path, cfg.size, rng_eng);
+
+      bench_fn = [io_path] ()
+      {
+        DICOMFIleBasicFieldsList dcm_infos;
+        ReadDICOMInfosFromDir(io_path, &dcm_infos);
+      };
+    }
+    else if (cfg.bench == "sta-raw-read")
+    {
+      const std::string sta_path = (tmp_dir_path + Path("vol.sta")).string();
+
+      WriteSyntheticStaRawVol(sta_path, cfg.size, rng_eng);
+
+      // the voxels dominate the size
+      io_path = (tmp_dir_path + Path("vol.raw")).string();
+
+      bench_fn = [sta_path] ()
+      {
+        ReadStaRawVol(sta_path);
+      };
+    }
+    else if (cfg.bench == "rad-raw-read")
+    {
+      const std::string rad_path = (tmp_dir_path + Path("proj.rad")).string();
+
+      WriteSyntheticRadRawProj(rad_path, cfg.size, rng_eng);
+
+      io_path = (tmp_dir_path + Path("proj.raw")).string();
+
+      bench_fn = [rad_path] ()
+      {
+        ReadRadRawProj(rad_path);
+      };
+    }
+    else
+    {
+      xregThrow("Unsupported benchmark: %s", cfg.bench.c_str());
+    }
+
+    for (size_type i = 0; i < num_warmup; ++i)
+    {
+      bench_fn();
+    }
+
+    ResetPeakRSS();
+
+    res.base_rss_bytes = CurRSSBytes();
+
+    // the warmup calls were made above so that the peak memory of the timed
+    // calls does not include them
+    res.timing = TimeBenchIters(bench_fn, 0, num_iters);
+
+    res.peak_rss_bytes = PeakRSSBytes();
+
+    res.num_bytes = FileOrDirNumBytes(io_path);
+
+    if (res.timing.mean_secs > 0)
+    {
+      res.bytes_per_sec = res.num_bytes / res.timing.mean_secs;
+    }
+
+    res.ok = true;
+  }
+  catch (const std::exception& e)
+  {
+    res.err_msg = e.what();
+  }
+
+  return res;
+}
+
+void PutResultJSON(const BenchResult& r, boost::property_tree::ptree* bench)
+{
+  bench->put("bench",     r.cfg.bench);
+  bench->put("size",      r.cfg.size);
+  bench->put("num-projs", r.cfg.num_projs);
+  bench->put("compress",  r.cfg.compress);
+
+  PutBenchStatus(r.ok, r.timing, r.err_msg, bench);
+
+  if (r.ok)
+  {
+    bench->put("num-bytes",      r.num_bytes);
+    bench->put("bytes-per-sec",  r.bytes_per_sec);
+    bench->put("base-rss-bytes", r.base_rss_bytes);
+    bench->put("peak-rss-bytes", r.peak_rss_bytes);
+  }
+}
+
+}  // un-named
+
+int main(int argc, char* argv[])
+{
+  constexpr int kEXIT_VAL_SUCCESS  = 0;
+  constexpr int kEXIT_VAL_BAD_USE  = 1;
+
+  using namespace xreg;
+
+  ProgOpts po;
+
+  xregPROG_OPTS_SET_COMPILE_DATE(po);
+
+  po.set_help("Benchmarks reading and writing the file formats used by xReg. Synthetic "
+              "datasets of each requested size are written to a temporary directory "
+              "created in the working directory, which may be on a network filesystem, "
+              "and removed after each configuration. The following benchmarks are "
+              "available: \"proj-h5-write\", \"proj-h5-read\" and \"proj-h5-deferred\" "
+              "(reading every projection with a DeferredProjReader) use HDF5 projection "
+              "data, \"vol-h5-write\" and \"vol-h5-read\" use HDF5 volumes, "
+              "\"mesh-h5-write\" and \"mesh-h5-read\" use HDF5 meshes, \"stl-write\" and "
+              "\"stl-read\" use binary STL meshes, \"dicom-dir-scan\" reads the basic fields "
+              "of every file in a directory containing a DICOM series, \"sta-raw-read\" "
+              "reads .sta/.raw volumes and \"rad-raw-read\" reads .rad/.raw projections. "
+              "The mean and minimum time of each configuration are reported along with "
+              "the size of the data on disk, the throughput, the resident memory before "
+              "the timed runs and the peak resident memory during the timed runs. The peak "
+              "is only reset between configurations on Linux, as indicated in the output. "
+              "Files which were just written are likely to be read from the operating "
+              "system cache, unless the cache is dropped or the filesystem does not cache. "
+              "Results are written in JSON format to the optional output path, or to "
+              "stdout when it is not provided.");
+  po.set_arg_usage("[<Output JSON File>]");
+  po.set_min_num_pos_args(0);
+
+  po.add("benches", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "benches",
+         "Comma separated list of benchmarks to run.")
+    << "proj-h5-write,proj-h5-read,proj-h5-deferred,vol-h5-write,vol-h5-read,"
+       "mesh-h5-write,mesh-h5-read,stl-write,stl-read,dicom-dir-scan,sta-raw-read,"
+       "rad-raw-read";
+
+  po.add("work-dir", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "work-dir",
+         "Directory in which the temporary files are written.")
+    << ".";
+
+  po.add("proj-dims", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "proj-dims",
+         "Comma separated list of the number of pixels along each dimension of the "
+         "synthetic square projections; used by the projection data and .rad/.raw "
+         "benchmarks.")
+    << "512,1536";
+
+  po.add("num-projs", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "num-projs",
+         "Comma separated list of the number of projections stored in each projection "
+         "data file.")
+    << "1,32";
+
+  po.add("vol-dims", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "vol-dims",
+         "Comma separated list of the number of voxels along each dimension of the "
+         "synthetic cubic volumes; used by the HDF5 volume, DICOM (one file per slice) "
+         "and .sta/.raw benchmarks.")
+    << "128,256";
+
+  po.add("mesh-tris", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "mesh-tris",
+         "Comma separated list of the approximate number of triangles in the synthetic "
+         "meshes.")
+    << "100000,1000000";
+
+  po.add("h5-compress", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "h5-compress",
+         "Comma separated list of compression settings (0 or 1) used when writing the "
+         "HDF5 files.")
+    << "0,1";
+
+  po.add("deferred-num-prefetch", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32,
+         "deferred-num-prefetch",
+         "Number of projections read ahead by the DeferredProjReader benchmark; 0 disables "
+         "reading ahead.")
+    << ProgOpts::uint32(0);
+
+  po.add("keep-files", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_TRUE, "keep-files",
+         "Do not remove the temporary files.")
+    << false;
+
+  po.add("num-iters", 'n', ProgOpts::kSTORE_UINT32, "num-iters",
+         "Number of timed runs for each configuration.")
+    << ProgOpts::uint32(3);
+
+  po.add("num-warmup", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32, "num-warmup",
+         "Number of un-timed runs made before the timed runs.")
+    << ProgOpts::uint32(1);
+
+  try
+  {
+    po.parse(argc, argv);
+  }
+  catch (const ProgOpts::Exception& e)
+  {
+    std::cerr << "Error parsing command line arguments: " << e.what() << std::endl;
+    po.print_usage(std::cerr);
+    return kEXIT_VAL_BAD_USE;
+  }
+
+  if (po.help_set())
+  {
+    po.print_usage(std::cout);
+    po.print_help(std::cout);
+    return kEXIT_VAL_SUCCESS;
+  }
+
+  std::ostream& vout = po.vout();
+
+  const auto benches     = StringSplit(po.get("benches").as_string(), ",");
+  const auto proj_dims   = ParseBenchList<size_type>(po.get("proj-dims"));
+  const auto num_projs   = ParseBenchList<size_type>(po.get("num-projs"));
+  const auto vol_dims    = ParseBenchList<size_type>(po.get("vol-dims"));
+  const auto mesh_tris   = ParseBenchList<size_type>(po.get("mesh-tris"));
+  const auto h5_compress = ParseBenchList<int>(po.get("h5-compress"));
+
+  IOSettings io_settings;
+  io_settings.work_dir              = po.get("work-dir").as_string();
+  io_settings.keep_files            = po.get("keep-files");
+  io_settings.deferred_num_prefetch = po.get("deferred-num-prefetch").as_uint32();
+
+  const size_type num_iters  = po.get("num-iters").as_uint32();
+  const size_type num_warmup = po.get("num-warmup").as_uint32();
+
+  if (!Path(io_settings.work_dir).is_dir())
+  {
+    std::cerr << "ERROR: working directory does not exist: " << io_settings.work_dir << std::endl;
+    return kEXIT_VAL_BAD_USE;
+  }
+
+  const bool peak_rss_per_bench = ResetPeakRSS();
+
+  BenchResultsJSON results_json;
+  results_json.info().put("work-dir", io_settings.work_dir);
+  results_json.info().put("peak-rss-per-bench", peak_rss_per_bench);
+
+  for (const auto& bench : benches)
+  {
+    const bool is_proj = IsProjBench(bench) || (bench == "rad-raw-read");
+
+    const std::vector<size_type>& sizes = is_proj ? proj_dims :
+                                            (IsMeshBench(bench) ? mesh_tris : vol_dims);
+
+    const std::vector<size_type> cur_num_projs = IsProjBench(bench) ? num_projs :
+                                                        std::vector<size_type>(1, 0);
+
+    const std::vector<int> cur_compress = IsH5Bench(bench) ? h5_compress :
+                                                        std::vector<int>(1, 0);
+
+    for (const size_type size : sizes)
+    {
+      for (const size_type cur_num_proj : cur_num_projs)
+      {
+        for (const int compress : cur_compress)
+        {
+          BenchConfig cfg;
+          cfg.bench     = bench;
+          cfg.size      = size;
+          cfg.num_projs = cur_num_proj;
+          cfg.compress  = compress != 0;
+
+          vout << fmt::format("  {:>16} size: {:8d} projs: {:3d} compress: {:d} ... ",
+                              bench, size, cur_num_proj, compress);
+          vout.flush();
+
+          const BenchResult r = RunBench(cfg, io_settings, num_warmup, num_iters);
+
+          PutResultJSON(r, &results_json.add_bench());
+
+          if (r.ok)
+          {
+            vout << fmt::format("{:10.3f} ms, {:10.3f} MB/s, peak RSS: {:8.1f} MB",
+                                r.timing.mean_secs * 1000.0, r.bytes_per_sec / 1.0e6,
+                                r.peak_rss_bytes / 1.0e6)
+                 << std::endl;
+          }
+          else
+          {
+            vout << "ERROR: " << r.err_msg << std::endl;
+          }
+        }
+      }
+    }
+  }
+
+  const std::string dst_path = po.pos_args().empty() ? std::string() : po.pos_args()[0];
+
+  if (!dst_path.empty())
+  {
+    vout << "writing results to: " << dst_path << std::endl;
+  }
+
+  results_json.write(dst_path);
+
+  vout << "exiting..." << std::endl;
+
+  return kEXIT_VAL_SUCCESS;
+}
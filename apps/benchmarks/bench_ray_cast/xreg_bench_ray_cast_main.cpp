@@ -0,0 +1,513 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <fmt/format.h>
+
+#include "xregProgOptUtils.h"
+#include "xregStringUtils.h"
+#include "xregBenchUtils.h"
+#include "xregITKBasicImageUtils.h"
+#include "xregPerspectiveXform.h"
+#include "xregRigidUtils.h"
+#include "xregRayCastLineIntCPU.h"
+#include "xregRayCastLineIntOCL.h"
+#include "xregRayCastDepthCPU.h"
+#include "xregRayCastDepthOCL.h"
+#include "xregRayCastSurRenderCPU.h"
+#include "xregRayCastSurRenderOCL.h"
+#include "xregRayCastOccContourCPU.h"
+#include "xregRayCastOccContourOCL.h"
+#include "xregSplatLineIntCPU.h"
+#include "xregSplatLineIntOCL.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+using size_type = std::size_t;
+
+using CtxQueue = std::tuple<boost::compute::context,boost::compute::command_queue>;
+
+// Value of voxels inside of the synthetic object, roughly the linear attenuation
+// of soft tissue in 1/mm
+constexpr RayCaster::PixelScalar3D kOBJ_VAL = 0.02;
+
+struct BenchConfig
+{
+  std::string caster;
+  std::string interp;
+
+  size_type vol_size;
+  size_type det_size;
+  size_type num_projs;
+};
+
+struct BenchResult
+{
+  BenchConfig cfg;
+
+  bool ok;
+
+  std::string err_msg;
+
+  BenchTiming timing;
+
+  double rays_per_sec;
+  double voxels_per_sec;
+};
+
+// Creates a cube volume, with a ellipsoid object of constant value, the
+// volume always has the same physical extent so that each size covers
+// the same footprint on the detector.
+RayCaster::VolPtr MakeSyntheticVol(const size_type vol_size, const CoordScalar vol_extent_mm)
+{
+  auto vol = MakeITK3DVol<RayCaster::PixelScalar3D>(vol_size, vol_size, vol_size);
+
+  const double sp = vol_extent_mm / vol_size;
+
+  RayCaster::Vol::SpacingType spacing;
+  spacing.Fill(sp);
+  vol->SetSpacing(spacing);
+
+  RayCaster::PixelScalar3D* buf = vol->GetBufferPointer();
+
+  const CoordScalar c = 0.5 * (vol_size - 1);
+
+  // semi-axes of the ellipsoid in voxels
+  const CoordScalar a = 0.45 * vol_size;
+  const CoordScalar b = 0.35 * vol_size;
+  const CoordScalar e = 0.25 * vol_size;
+
+  for (size_type z = 0; z < vol_size; ++z)
+  {
+    const CoordScalar dz = (z - c) / e;
+
+    for (size_type y = 0; y < vol_size; ++y)
+    {
+      const CoordScalar dy = (y - c) / b;
+
+      for (size_type x = 0; x < vol_size; ++x, ++buf)
+      {
+        const CoordScalar dx = (x - c) / a;
+
+        if (((dx * dx) + (dy * dy) + (dz * dz)) <= 1)
+        {
+          *buf = kOBJ_VAL;
+        }
+      }
+    }
+  }
+
+  return vol;
+}
+
+// Poses of the volume with respect to the camera, the volume is centered
+// half way between the source and detector and rotated about its center by
+// a few degrees for each projection.
+FrameTransformList MakeSyntheticPoses(const RayCaster::Vol* vol, const CoordScalar focal_len,
+                                      const size_type num_projs)
+{
+  const Pt3 vol_center = ITKVol3DCenterAsPhysPt(vol);
+
+  const FrameTransform cam_to_vol_center = EulerRotXYZTransXYZFrame(0, 0, 0,
+                                                                    0, 0, 0.5 * focal_len);
+
+  FrameTransform vol_center_to_vol = FrameTransform::Identity();
+  vol_center_to_vol.matrix().block(0,3,3,1) = vol_center;
+
+  FrameTransformList poses;
+  poses.reserve(num_projs);
+
+  for (size_type proj_idx = 0; proj_idx < num_projs; ++proj_idx)
+  {
+    const CoordScalar ang_rad = (proj_idx * 3.0) * kDEG2RAD;
+
+    poses.push_back(vol_center_to_vol * EulerRotXYZTransXYZFrame(0, ang_rad, 0, 0, 0, 0)
+                                      * cam_to_vol_center);
+  }
+
+  return poses;
+}
+
+RayCaster::InterpMethod InterpMethodFromStr(const std::string& s)
+{
+  RayCaster::InterpMethod m = RayCaster::kRAY_CAST_INTERP_LINEAR;
+
+  if (s == "linear")
+  {
+    m = RayCaster::kRAY_CAST_INTERP_LINEAR;
+  }
+  else if (s == "nn")
+  {
+    m = RayCaster::kRAY_CAST_INTERP_NN;
+  }
+  else if (s == "sinc")
+  {
+    m = RayCaster::kRAY_CAST_INTERP_SINC;
+  }
+  else if (s == "bspline")
+  {
+    m = RayCaster::kRAY_CAST_INTERP_BSPLINE;
+  }
+  else
+  {
+    xregThrow("Unsupported interpolation method: %s", s.c_str());
+  }
+
+  return m;
+}
+
+template <class tRayCasterCPU, class tRayCasterOCL>
+std::shared_ptr<RayCaster> MakeRayCaster(const bool use_ocl, const CtxQueue& ocl_ctx_queue)
+{
+  std::shared_ptr<RayCaster> rc;
+
+  if (use_ocl)
+  {
+    rc = std::make_shared<tRayCasterOCL>(std::get<0>(ocl_ctx_queue), std::get<1>(ocl_ctx_queue));
+  }
+  else
+  {
+    rc = std::make_shared<tRayCasterCPU>();
+  }
+
+  return rc;
+}
+
+std::shared_ptr<RayCaster> MakeRayCasterFromName(const std::string& caster,
+                                                 const bool use_ocl,
+                                                 const CtxQueue& ocl_ctx_queue)
+{
+  std::shared_ptr<RayCaster> rc;
+
+  if ((caster == "line-int-sum") || (caster == "line-int-max"))
+  {
+    rc = MakeRayCaster<RayCasterLineIntCPU,RayCasterLineIntOCL>(use_ocl, ocl_ctx_queue);
+
+    dynamic_cast<RayCastLineIntParamInterface*>(rc.get())->set_kernel_id(
+                  (caster == "line-int-sum") ? kRAY_CAST_LINE_INT_SUM_KERNEL :
+                                               kRAY_CAST_LINE_INT_MAX_KERNEL);
+  }
+  else if (caster == "depth")
+  {
+    rc = MakeRayCaster<RayCasterDepthCPU,RayCasterDepthOCL>(use_ocl, ocl_ctx_queue);
+  }
+  else if (caster == "sur-render")
+  {
+    rc = MakeRayCaster<RayCasterSurRenderCPU,RayCasterSurRenderOCL>(use_ocl, ocl_ctx_queue);
+  }
+  else if (caster == "occ-contour")
+  {
+    rc = MakeRayCaster<RayCasterOccludingContoursCPU,RayCasterOccludingContoursOCL>(
+                                                              use_ocl, ocl_ctx_queue);
+  }
+  else if (caster == "splat")
+  {
+    rc = MakeRayCaster<SplatLineIntCPU,SplatLineIntOCL>(use_ocl, ocl_ctx_queue);
+  }
+  else
+  {
+    xregThrow("Unsupported ray caster: %s", caster.c_str());
+  }
+
+  auto* coll_params = dynamic_cast<RayCasterCollisionParamInterface*>(rc.get());
+  if (coll_params)
+  {
+    // collide with the synthetic object
+    coll_params->set_render_thresh(0.5 * kOBJ_VAL);
+  }
+
+  return rc;
+}
+
+BenchResult RunBench(const BenchConfig& cfg, RayCaster::VolPtr vol,
+                     const CameraModel& cam, const bool use_ocl,
+                     const CtxQueue& ocl_ctx_queue, const double ray_step_size,
+                     const size_type num_warmup, const size_type num_iters)
+{
+  BenchResult res;
+
+  res.cfg = cfg;
+  res.ok  = false;
+
+  res.rays_per_sec   = 0;
+  res.voxels_per_sec = 0;
+
+  try
+  {
+    auto rc = MakeRayCasterFromName(cfg.caster, use_ocl, ocl_ctx_queue);
+
+    rc->set_volume(vol);
+    rc->set_camera_model(cam);
+    rc->set_num_projs(cfg.num_projs);
+    rc->set_ray_step_size(ray_step_size);
+    rc->set_interp_method(InterpMethodFromStr(cfg.interp));
+
+    rc->allocate_resources();
+
+    rc->distribute_xforms_among_cam_models(
+              MakeSyntheticPoses(vol.GetPointer(), cam.focal_len, cfg.num_projs));
+
+    res.timing = TimeBenchIters([&rc] () { rc->compute(0); }, num_warmup, num_iters);
+
+    const double mean_secs = res.timing.mean_secs;
+
+    const double num_rays   = static_cast<double>(cfg.det_size) * cfg.det_size * cfg.num_projs;
+    const double num_voxels = static_cast<double>(cfg.vol_size) * cfg.vol_size * cfg.vol_size
+                                                                               * cfg.num_projs;
+
+    if (mean_secs > 0)
+    {
+      res.rays_per_sec   = num_rays / mean_secs;
+      res.voxels_per_sec = num_voxels / mean_secs;
+    }
+
+    res.ok = true;
+  }
+  catch (const std::exception& e)
+  {
+    res.err_msg = e.what();
+  }
+
+  return res;
+}
+
+void PutResultJSON(const BenchResult& r, boost::property_tree::ptree* bench)
+{
+  bench->put("caster",    r.cfg.caster);
+  bench->put("interp",    r.cfg.interp);
+  bench->put("vol-size",  r.cfg.vol_size);
+  bench->put("det-size",  r.cfg.det_size);
+  bench->put("num-projs", r.cfg.num_projs);
+
+  PutBenchStatus(r.ok, r.timing, r.err_msg, bench);
+
+  if (r.ok)
+  {
+    bench->put("rays-per-sec",   r.rays_per_sec);
+    bench->put("voxels-per-sec", r.voxels_per_sec);
+  }
+}
+
+}  // un-named
+
+int main(int argc, char* argv[])
+{
+  constexpr int kEXIT_VAL_SUCCESS  = 0;
+  constexpr int kEXIT_VAL_BAD_USE  = 1;
+
+  using namespace xreg;
+
+  ProgOpts po;
+
+  xregPROG_OPTS_SET_COMPILE_DATE(po);
+
+  po.set_help("Micro-benchmarks the ray casters on synthetic volumes and detectors. "
+              "Every combination of ray caster, interpolation method, volume size, "
+              "detector size and number of projections is timed using the selected "
+              "backend. The mean and minimum time of each compute() call are reported "
+              "along with the number of rays (detector pixels) and volume voxels "
+              "processed per second; the voxel rate counts every voxel of the volume "
+              "once per projection. Resource allocation and transfer of the volume are "
+              "not timed. Results are written in JSON format to the optional output path, "
+              "or to stdout when it is not provided. Configurations not supported by a "
+              "ray caster are reported with an error message and do not stop the benchmark.");
+  po.set_arg_usage("[<Output JSON File>]");
+  po.set_min_num_pos_args(0);
+
+  po.add("casters", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "casters",
+         "Comma separated list of ray casters to benchmark. Valid values are: "
+         "\"line-int-sum\", \"line-int-max\", \"depth\", \"sur-render\", \"occ-contour\" "
+         "and \"splat\".")
+    << "line-int-sum,line-int-max,depth,sur-render,occ-contour,splat";
+
+  po.add("interps", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "interps",
+         "Comma separated list of interpolation methods to benchmark. Valid values are: "
+         "\"linear\", \"nn\", \"sinc\" and \"bspline\".")
+    << "linear,nn";
+
+  po.add("vol-sizes", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "vol-sizes",
+         "Comma separated list of the number of voxels along each dimension of the "
+         "synthetic cube volumes.")
+    << "128,256";
+
+  po.add("det-sizes", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "det-sizes",
+         "Comma separated list of the number of pixels along each dimension of the "
+         "synthetic square detectors.")
+    << "256,512";
+
+  po.add("num-projs", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "num-projs",
+         "Comma separated list of the number of projections computed by each call "
+         "to compute().")
+    << "1,16";
+
+  po.add("num-iters", 'n', ProgOpts::kSTORE_UINT32, "num-iters",
+         "Number of timed calls to compute() for each configuration.")
+    << ProgOpts::uint32(5);
+
+  po.add("num-warmup", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32, "num-warmup",
+         "Number of un-timed calls to compute() made before the timed calls.")
+    << ProgOpts::uint32(1);
+
+  po.add("vol-extent", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "vol-extent",
+         "The physical extent (mm) of each dimension of the synthetic volumes.")
+    << 200.0;
+
+  po.add("ray-step", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "ray-step",
+         "The ray casting step size (mm).")
+    << 1.0;
+
+  po.add("focal-len", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "focal-len",
+         "The source to detector distance (mm), the volume is placed half way between "
+         "the source and detector.")
+    << 1000.0;
+
+  po.add("det-extent", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "det-extent",
+         "The physical extent (mm) of each dimension of the synthetic detectors.")
+    << 400.0;
+
+  po.add_backend_flags();
+
+  try
+  {
+    po.parse(argc, argv);
+  }
+  catch (const ProgOpts::Exception& e)
+  {
+    std::cerr << "Error parsing command line arguments: " << e.what() << std::endl;
+    po.print_usage(std::cerr);
+    return kEXIT_VAL_BAD_USE;
+  }
+
+  if (po.help_set())
+  {
+    po.print_usage(std::cout);
+    po.print_help(std::cout);
+    return kEXIT_VAL_SUCCESS;
+  }
+
+  std::ostream& vout = po.vout();
+
+  const auto casters   = StringSplit(po.get("casters").as_string(), ",");
+  const auto interps   = StringSplit(po.get("interps").as_string(), ",");
+  const auto vol_sizes = ParseBenchList<size_type>(po.get("vol-sizes"));
+  const auto det_sizes = ParseBenchList<size_type>(po.get("det-sizes"));
+  const auto num_projs = ParseBenchList<size_type>(po.get("num-projs"));
+
+  const size_type num_iters  = po.get("num-iters").as_uint32();
+  const size_type num_warmup = po.get("num-warmup").as_uint32();
+
+  const CoordScalar vol_extent = po.get("vol-extent").as_double();
+  const double ray_step        = po.get("ray-step").as_double();
+  const CoordScalar focal_len  = po.get("focal-len").as_double();
+  const CoordScalar det_extent = po.get("det-extent").as_double();
+
+  const std::string backend_str = po.get("backend");
+
+  const bool use_ocl = backend_str == "ocl";
+
+  if (!use_ocl && (backend_str != "cpu"))
+  {
+    std::cerr << "ERROR: unsupported backend: " << backend_str << std::endl;
+    return kEXIT_VAL_BAD_USE;
+  }
+
+  CtxQueue ocl_ctx_queue;
+  if (use_ocl)
+  {
+    ocl_ctx_queue = po.selected_ocl_ctx_queue();
+  }
+
+  BenchResultsJSON results_json;
+
+  results_json.info().put("backend", backend_str);
+
+  for (const size_type vol_size : vol_sizes)
+  {
+    vout << "creating synthetic volume of size " << vol_size << "^3..." << std::endl;
+    auto vol = MakeSyntheticVol(vol_size, vol_extent);
+
+    for (const size_type det_size : det_sizes)
+    {
+      const CoordScalar det_sp = det_extent / det_size;
+
+      CameraModel cam;
+      cam.setup(focal_len, det_size, det_size, det_sp, det_sp);
+
+      for (const size_type cur_num_projs : num_projs)
+      {
+        for (const auto& caster : casters)
+        {
+          // splatting does not interpolate the volume
+          const std::vector<std::string> cur_interps = (caster == "splat") ?
+                                  std::vector<std::string>(1, "none") : interps;
+
+          for (const auto& interp : cur_interps)
+          {
+            BenchConfig cfg;
+            cfg.caster    = caster;
+            cfg.interp    = interp;
+            cfg.vol_size  = vol_size;
+            cfg.det_size  = det_size;
+            cfg.num_projs = cur_num_projs;
+
+            vout << fmt::format("  {:>12} {:>8} vol: {:4d} det: {:4d} projs: {:3d} ... ",
+                                caster, interp, vol_size, det_size, cur_num_projs);
+            vout.flush();
+
+            const BenchResult r = RunBench(cfg, vol, cam, use_ocl, ocl_ctx_queue,
+                                           ray_step, num_warmup, num_iters);
+
+            PutResultJSON(r, &results_json.add_bench());
+
+            if (r.ok)
+            {
+              vout << fmt::format("{:10.3f} ms, {:10.4g} rays/s, {:10.4g} voxels/s",
+                                  r.timing.mean_secs * 1000.0, r.rays_per_sec, r.voxels_per_sec)
+                   << std::endl;
+            }
+            else
+            {
+              vout << "ERROR: " << r.err_msg << std::endl;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  const std::string dst_path = po.pos_args().empty() ? std::string() : po.pos_args()[0];
+
+  if (!dst_path.empty())
+  {
+    vout << "writing results to: " << dst_path << std::endl;
+  }
+
+  results_json.write(dst_path);
+
+  vout << "exiting..." << std::endl;
+
+  return kEXIT_VAL_SUCCESS;
+}
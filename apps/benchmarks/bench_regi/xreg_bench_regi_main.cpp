@@ -0,0 +1,1003 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <numeric>
+#include <random>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include <fmt/format.h>
+
+#include "xregProgOptUtils.h"
+#include "xregStringUtils.h"
+#include "xregTimer.h"
+#include "xregBenchUtils.h"
+#include "xregMemTracking.h"
+#include "xregITKBasicImageUtils.h"
+#include "xregCIOSFusionDICOM.h"
+#include "xregRigidUtils.h"
+#include "xregRotUtils.h"
+#include "xregSampleUniformUnitVecs.h"
+#include "xregRayCastProgOpts.h"
+#include "xregRayCastInterface.h"
+#include "xregImageAddPoissonNoise.h"
+#include "xregProjPreProc.h"
+#include "xregImgSimMetric2DPatchCommon.h"
+#include "xregImgSimMetric2DGradImgParamInterface.h"
+#include "xregImgSimMetric2DProgOpts.h"
+#include "xregMultiObjMultiLevel2D3DRegi.h"
+#include "xregSE3OptVars.h"
+#include "xregIntensity2D3DRegiCMAES.h"
+#include "xregIntensity2D3DRegiBOBYQA.h"
+#include "xregRegi2D3DPenaltyFnSE3EulerDecomp.h"
+#include "xregRegi2D3DPenaltyFnSE3Mag.h"
+#include "xregNormDist.h"
+#include "xregFoldNormDist.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+using Vol    = RayCaster::Vol;
+using VolPtr = RayCaster::VolPtr;
+
+using UseCurEstForInit = MultiLevelMultiObjRegi::Level::SingleRegi::InitPosePrevPoseEst;
+
+constexpr RayCaster::PixelScalar3D kBONE_VAL = 0.05;
+
+// An ellipsoid in normalized volume coordinates (each dimension in [0,1]),
+// voxels inside of the ellipsoid have val added to them
+struct SynthEllipsoid
+{
+  Pt3 center;
+  Pt3 semi_axes;
+
+  RayCaster::PixelScalar3D val;
+};
+
+// Creates a cube volume covering vol_extent_mm in each dimension, which is the
+// sum of a collection of ellipsoids
+VolPtr MakeSyntheticObj(const size_type vol_size, const CoordScalar vol_extent_mm,
+                        const std::vector<SynthEllipsoid>& ellipsoids)
+{
+  auto vol = MakeITK3DVol<RayCaster::PixelScalar3D>(vol_size, vol_size, vol_size);
+
+  Vol::SpacingType spacing;
+  spacing.Fill(vol_extent_mm / vol_size);
+  vol->SetSpacing(spacing);
+
+  RayCaster::PixelScalar3D* buf = vol->GetBufferPointer();
+
+  for (size_type z = 0; z < vol_size; ++z)
+  {
+    for (size_type y = 0; y < vol_size; ++y)
+    {
+      for (size_type x = 0; x < vol_size; ++x, ++buf)
+      {
+        const Pt3 p(static_cast<CoordScalar>(x) / vol_size,
+                    static_cast<CoordScalar>(y) / vol_size,
+                    static_cast<CoordScalar>(z) / vol_size);
+
+        for (const auto& e : ellipsoids)
+        {
+          if ((p - e.center).cwiseQuotient(e.semi_axes).squaredNorm() <= 1)
+          {
+            *buf += e.val;
+          }
+        }
+      }
+    }
+  }
+
+  return vol;
+}
+
+// Three synthetic "bones" sharing a common volume frame, loosely arranged like
+// a hemi-pelvis, femur and fragment. Each has an outer dense cortical layer
+// (the positive ellipsoid) with a less dense interior (the negative ellipsoid)
+// and some interior structure, so that there are gradients at several scales.
+std::vector<VolPtr> MakeSyntheticObjs(const size_type vol_size, const CoordScalar vol_extent_mm)
+{
+  const RayCaster::PixelScalar3D b = kBONE_VAL;
+
+  std::vector<VolPtr> vols;
+
+  // "pelvis"
+  vols.push_back(MakeSyntheticObj(vol_size, vol_extent_mm,
+    { { Pt3(0.45, 0.45, 0.5), Pt3(0.32, 0.22, 0.12),  b },
+      { Pt3(0.45, 0.45, 0.5), Pt3(0.29, 0.19, 0.09), -0.7f * b },
+      { Pt3(0.30, 0.40, 0.5), Pt3(0.04, 0.12, 0.04),  0.5f * b },
+      { Pt3(0.55, 0.35, 0.5), Pt3(0.10, 0.03, 0.05),  0.5f * b } }));
+
+  // "femur"
+  vols.push_back(MakeSyntheticObj(vol_size, vol_extent_mm,
+    { { Pt3(0.72, 0.60, 0.5), Pt3(0.06, 0.06, 0.06),  b },
+      { Pt3(0.78, 0.80, 0.5), Pt3(0.05, 0.16, 0.05),  b },
+      { Pt3(0.78, 0.80, 0.5), Pt3(0.03, 0.14, 0.03), -0.6f * b } }));
+
+  // "fragment"
+  vols.push_back(MakeSyntheticObj(vol_size, vol_extent_mm,
+    { { Pt3(0.62, 0.52, 0.5), Pt3(0.08, 0.07, 0.08),  b },
+      { Pt3(0.62, 0.52, 0.5), Pt3(0.06, 0.05, 0.06), -0.5f * b } }));
+
+  return vols;
+}
+
+// Peak resident memory (bytes) of this process, -1 when unavailable
+double PeakHostMemBytes()
+{
+#ifndef _WIN32
+  struct rusage usage;
+
+  if (getrusage(RUSAGE_SELF, &usage) == 0)
+  {
+#ifdef __APPLE__
+    return static_cast<double>(usage.ru_maxrss);
+#else
+    return static_cast<double>(usage.ru_maxrss) * 1024.0;
+#endif
+  }
+#endif
+
+  return -1;
+}
+
+// Views are obtained by rotating the default C-arm about the point half way
+// between the source and detector
+std::vector<CameraModel> MakeSyntheticViews(const size_type num_views,
+                                            const CoordScalar view_sep_deg,
+                                            Pt3* iso_center_wrt_world)
+{
+  const CameraModel default_cam = NaiveCamModelFromCIOSFusion(MakeNaiveCIOSFusionMetaDR(), true);
+
+  const Pt3 det_center = default_cam.ind_pt_to_phys_det_pt(
+                            Pt2(0.5 * default_cam.num_det_cols, 0.5 * default_cam.num_det_rows));
+
+  *iso_center_wrt_world = 0.5 * (default_cam.pinhole_pt + det_center);
+
+  const Pt3 iso_center_wrt_cam = default_cam.extrins * *iso_center_wrt_world;
+
+  std::vector<CameraModel> cams;
+  cams.reserve(num_views);
+
+  for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
+  {
+    // 0, +sep, -sep, +2*sep, -2*sep, ...
+    const CoordScalar ang_deg = ((view_idx + 1) / 2) * view_sep_deg *
+                                                ((view_idx % 2) ? 1 : -1);
+
+    const FrameTransform orbit = EulerRotXYZTransXYZFrame(0, 0, 0, iso_center_wrt_cam[0],
+                                                          iso_center_wrt_cam[1],
+                                                          iso_center_wrt_cam[2])
+                                   * EulerRotXYZTransXYZFrame(0, ang_deg * kDEG2RAD, 0, 0, 0, 0)
+                                   * EulerRotXYZTransXYZFrame(0, 0, 0, -iso_center_wrt_cam[0],
+                                                              -iso_center_wrt_cam[1],
+                                                              -iso_center_wrt_cam[2]);
+
+    CameraModel cam;
+    cam.coord_frame_type = default_cam.coord_frame_type;
+
+    cam.setup(default_cam.intrins, (orbit * default_cam.extrins).matrix(),
+              default_cam.num_det_rows, default_cam.num_det_cols,
+              default_cam.det_row_spacing, default_cam.det_col_spacing);
+
+    cams.push_back(cam);
+  }
+
+  return cams;
+}
+
+// Random rigid perturbation with the specified rotation angle and translation
+// magnitude, about the point center
+FrameTransform SamplePerturbation(const CoordScalar rot_deg, const CoordScalar trans_mm,
+                                  const Pt3& center, std::mt19937& rng_eng)
+{
+  UniformOnUnitSphereDist unit_vec_dist(3);
+
+  FrameTransform delta = FrameTransform::Identity();
+
+  const Pt3 rot_axis = unit_vec_dist(rng_eng);
+
+  delta.matrix().block(0,0,3,3) = ExpSO3(Pt3(rot_axis * (rot_deg * kDEG2RAD)));
+
+  const Pt3 trans_dir = unit_vec_dist(rng_eng);
+
+  delta.matrix().block(0,3,3,1) = (center - (delta.matrix().block(0,0,3,3) * center))
+                                     + (trans_dir * trans_mm);
+
+  return delta;
+}
+
+struct PoseError
+{
+  double rot_deg;
+  double trans_mm;
+  double mean_corner_mm;
+};
+
+PoseError ComputePoseError(const FrameTransform& gt_cam_to_vol,
+                           const FrameTransform& est_cam_to_vol,
+                           const Vol* vol)
+{
+  const FrameTransform gt_vol_to_cam  = gt_cam_to_vol.inverse();
+  const FrameTransform est_vol_to_cam = est_cam_to_vol.inverse();
+
+  const FrameTransform delta = gt_cam_to_vol * est_vol_to_cam;
+
+  PoseError err;
+
+  const Mat3x3 delta_rot = delta.matrix().block(0,0,3,3);
+
+  err.rot_deg = std::acos(std::max(CoordScalar(-1), std::min(CoordScalar(1),
+                                   (delta_rot.trace() - 1) / 2))) / kDEG2RAD;
+
+  const Pt3 center = ITKVol3DCenterAsPhysPt(vol);
+
+  err.trans_mm = ((gt_vol_to_cam * center) - (est_vol_to_cam * center)).norm();
+
+  const auto vol_size  = vol->GetLargestPossibleRegion().GetSize();
+  const auto vol_sp    = vol->GetSpacing();
+  const auto vol_origin = vol->GetOrigin();
+
+  err.mean_corner_mm = 0;
+
+  for (int corner_idx = 0; corner_idx < 8; ++corner_idx)
+  {
+    Pt3 p;
+
+    for (int d = 0; d < 3; ++d)
+    {
+      p[d] = vol_origin[d] + (((corner_idx >> d) & 1) ? ((vol_size[d] - 1) * vol_sp[d]) : 0);
+    }
+
+    err.mean_corner_mm += ((gt_vol_to_cam * p) - (est_vol_to_cam * p)).norm();
+  }
+
+  err.mean_corner_mm /= 8;
+
+  return err;
+}
+
+// Projects the objects (summed) at their ground truth poses into each view,
+// adds Poisson noise and pre-processes the images as the standard pipelines do.
+// The noise is determined by the seed, so every run uses the same images.
+ProjDataF32List MakeSyntheticFluoro(ProgOpts& po, const std::vector<VolPtr>& vols,
+                                    const std::vector<CameraModel>& cams,
+                                    const FrameTransform& gt_cam_to_vol,
+                                    const unsigned long num_photons,
+                                    const std::uint32_t seed,
+                                    std::ostream& vout)
+{
+  const size_type num_views = cams.size();
+
+  auto rc = LineIntRayCasterFromProgOpts(po);
+
+  rc->set_volumes(vols);
+  rc->set_camera_models(cams);
+  rc->set_num_projs(num_views);
+  rc->allocate_resources();
+
+  rc->distribute_xform_among_cam_models(gt_cam_to_vol);
+
+  rc->use_proj_store_replace_method();
+
+  const size_type num_vols = vols.size();
+
+  for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
+  {
+    rc->compute(vol_idx);
+
+    rc->use_proj_store_accum_method();
+  }
+
+  ProjPreProc proj_preproc;
+  proj_preproc.params.no_log_remap = num_photons == 0;
+
+  proj_preproc.input_projs.resize(num_views);
+
+  for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
+  {
+    auto& pd = proj_preproc.input_projs[view_idx];
+
+    pd.cam = cams[view_idx];
+
+    if (num_photons)
+    {
+      auto counts = SamplePoissonProjFromAttProj(rc->proj(view_idx).GetPointer(), num_photons,
+                                                 seed, static_cast<std::uint32_t>(view_idx));
+
+      pd.img = CastITKImageIfNeeded<float>(counts.GetPointer());
+    }
+    else
+    {
+      pd.img = ITKImageDeepCopy(rc->proj(view_idx).GetPointer());
+    }
+  }
+
+  proj_preproc.set_debug_output_stream(vout);
+  proj_preproc();
+
+  return proj_preproc.output_projs;
+}
+
+std::shared_ptr<ImgSimMetric2D> MakeSimMetric(ProgOpts& po, const double ds_factor)
+{
+  auto sm = PatchGradNCCSimMetricFromProgOpts(po);
+
+  dynamic_cast<ImgSimMetric2DGradImgParamInterface*>(sm.get())->
+                                          set_smooth_img_before_sobel_kernel_radius(5);
+
+  auto* patch_sm = dynamic_cast<ImgSimMetric2DPatchCommon*>(sm.get());
+  xregASSERT(patch_sm);
+
+  patch_sm->set_patch_radius(std::lround(ds_factor * 41));
+  patch_sm->set_patch_stride(1);
+
+  return sm;
+}
+
+// Wall time of each level, measured from the start of its first registration
+// to the end of the last optimizer iteration of any of its registrations
+struct LevelTiming
+{
+  Timer* tmr = nullptr;
+
+  std::vector<double> begin_secs;
+  std::vector<double> end_secs;
+
+  void attach(MultiLevelMultiObjRegi* ml_regi)
+  {
+    const size_type num_levels = ml_regi->levels.size();
+
+    begin_secs.assign(num_levels, -1);
+    end_secs.assign(num_levels, -1);
+
+    for (size_type lvl_idx = 0; lvl_idx < num_levels; ++lvl_idx)
+    {
+      for (auto& regi : ml_regi->levels[lvl_idx].regis)
+      {
+        regi.fns_to_call_right_before_regi_run.push_back([this,lvl_idx] ()
+        {
+          if (begin_secs[lvl_idx] < 0)
+          {
+            begin_secs[lvl_idx] = tmr->elapsed_seconds_since_start();
+          }
+        });
+
+        Intensity2D3DRegi::CallbackFn end_of_iter_fn = [this,lvl_idx] (Intensity2D3DRegi*)
+        {
+          end_secs[lvl_idx] = tmr->elapsed_seconds_since_start();
+        };
+
+        regi.regi->add_end_of_iter_callback(end_of_iter_fn);
+      }
+    }
+  }
+};
+
+struct LevelResult
+{
+  double wall_secs;
+
+  size_type num_obj_fn_evals;
+
+  double obj_fn_evals_per_sec;
+};
+
+struct PipelineResult
+{
+  std::string name;
+
+  size_type num_views;
+
+  std::vector<std::string> obj_names;
+
+  bool ok;
+
+  std::string err_msg;
+
+  // a single timed run of the entire pipeline
+  BenchTiming timing;
+
+  std::vector<LevelResult> levels;
+
+  std::vector<PoseError> init_errs;
+  std::vector<PoseError> final_errs;
+};
+
+PipelineResult RunAndTime(const std::string& name, MultiLevelMultiObjRegi* ml_regi,
+                          const std::vector<FrameTransform>& gt_cam_to_vols)
+{
+  Timer tmr;
+
+  LevelTiming lvl_timing;
+  lvl_timing.tmr = &tmr;
+  lvl_timing.attach(ml_regi);
+
+  PipelineResult res;
+
+  res.name      = name;
+  res.num_views = ml_regi->fixed_proj_data.size();
+  res.obj_names = ml_regi->vol_names;
+  res.ok        = false;
+
+  const size_type num_objs = ml_regi->vols.size();
+
+  for (size_type obj_idx = 0; obj_idx < num_objs; ++obj_idx)
+  {
+    res.init_errs.push_back(ComputePoseError(gt_cam_to_vols[obj_idx],
+                                             ml_regi->init_cam_to_vols[obj_idx],
+                                             ml_regi->vols[obj_idx].GetPointer()));
+  }
+
+  try
+  {
+    // the level timing is relative to the start of the run
+    tmr.start();
+
+    // the registration state changes with each run, so there are no warmup runs
+    res.timing = TimeBenchIters([ml_regi] () { ml_regi->run(); }, 0, 1);
+
+    tmr.stop();
+
+    res.ok = true;
+  }
+  catch (const std::exception& e)
+  {
+    res.err_msg = e.what();
+
+    return res;
+  }
+
+  const size_type num_levels = ml_regi->levels.size();
+
+  for (size_type lvl_idx = 0; lvl_idx < num_levels; ++lvl_idx)
+  {
+    LevelResult lvl_res;
+
+    lvl_res.wall_secs = std::max(0.0, lvl_timing.end_secs[lvl_idx] -
+                                        lvl_timing.begin_secs[lvl_idx]);
+
+    lvl_res.num_obj_fn_evals = 0;
+
+    for (const auto& regi : ml_regi->levels[lvl_idx].regis)
+    {
+      lvl_res.num_obj_fn_evals += regi.regi->num_obj_fn_evals();
+    }
+
+    lvl_res.obj_fn_evals_per_sec = (lvl_res.wall_secs > 0) ?
+                       (lvl_res.num_obj_fn_evals / lvl_res.wall_secs) : 0;
+
+    res.levels.push_back(lvl_res);
+  }
+
+  for (size_type obj_idx = 0; obj_idx < num_objs; ++obj_idx)
+  {
+    res.final_errs.push_back(ComputePoseError(gt_cam_to_vols[obj_idx],
+                                              ml_regi->cur_cam_to_vols[obj_idx],
+                                              ml_regi->vols[obj_idx].GetPointer()));
+  }
+
+  return res;
+}
+
+// Same configuration as the single-view pelvis registration app: CMA-ES at
+// 8x downsampling, followed by BOBYQA at 4x downsampling.
+void SetupSingleViewRegi(ProgOpts& po, MultiLevelMultiObjRegi* ml_regi)
+{
+  auto cam_align_ref = std::make_shared<MultiLevelMultiObjRegi::CamAlignRefFrameWithCurPose>();
+  cam_align_ref->vol_idx = 0;
+  cam_align_ref->center_of_rot_wrt_vol = ITKVol3DCenterAsPhysPt(ml_regi->vols[0].GetPointer());
+  cam_align_ref->cam_extrins = ml_regi->fixed_proj_data[0].cam.extrins;
+
+  ml_regi->ref_frames = { cam_align_ref };
+
+  auto se3_vars = std::make_shared<SE3OptVarsLieAlg>();
+
+  ml_regi->levels.resize(2);
+
+  for (size_type lvl_idx = 0; lvl_idx < 2; ++lvl_idx)
+  {
+    auto& lvl = ml_regi->levels[lvl_idx];
+
+    lvl.fixed_imgs_to_use = { 0 };
+
+    lvl.ds_factor = (lvl_idx == 0) ? 0.125 : 0.25;
+
+    lvl.ray_caster = LineIntRayCasterFromProgOpts(po);
+
+    lvl.sim_metrics = { MakeSimMetric(po, lvl.ds_factor) };
+
+    lvl.regis.resize(1);
+
+    auto& regi = lvl.regis[0];
+
+    regi.mov_vols    = { 0 };
+    regi.ref_frames  = { 0 };
+    regi.static_vols = { };
+
+    auto init_guess_fn = std::make_shared<UseCurEstForInit>();
+    init_guess_fn->vol_idx = 0;
+    regi.init_mov_vol_poses = { init_guess_fn };
+
+    if (lvl_idx == 0)
+    {
+      auto cmaes_regi = std::make_shared<Intensity2D3DRegiCMAES>();
+      cmaes_regi->set_opt_vars(se3_vars);
+      cmaes_regi->set_opt_x_tol(0.01);
+      cmaes_regi->set_opt_obj_fn_tol(0.01);
+      cmaes_regi->set_pop_size(100);
+      cmaes_regi->set_sigma({ 15 * kDEG2RAD, 15 * kDEG2RAD, 30 * kDEG2RAD, 50, 50, 100 });
+
+      auto pen_fn = std::make_shared<Regi2D3DPenaltyFnSE3EulerDecomp>();
+      pen_fn->rot_x_pdf   = std::make_shared<NormalDist1D>(0, 15 * kDEG2RAD);
+      pen_fn->rot_y_pdf   = std::make_shared<NormalDist1D>(0, 15 * kDEG2RAD);
+      pen_fn->rot_z_pdf   = std::make_shared<NormalDist1D>(0, 10 * kDEG2RAD);
+      pen_fn->trans_x_pdf = std::make_shared<NormalDist1D>(0, 30);
+      pen_fn->trans_y_pdf = std::make_shared<NormalDist1D>(0, 30);
+      pen_fn->trans_z_pdf = std::make_shared<NormalDist1D>(0, 150);
+
+      cmaes_regi->set_penalty_fn(pen_fn);
+      cmaes_regi->set_img_sim_penalty_coefs(0.9, 0.1);
+
+      regi.regi = cmaes_regi;
+    }
+    else
+    {
+      auto bobyqa_regi = std::make_shared<Intensity2D3DRegiBOBYQA>();
+      bobyqa_regi->set_opt_vars(se3_vars);
+      bobyqa_regi->set_opt_x_tol(0.0001);
+      bobyqa_regi->set_opt_obj_fn_tol(0.0001);
+      bobyqa_regi->set_bounds({ 2.5 * kDEG2RAD, 2.5 * kDEG2RAD, 2.5 * kDEG2RAD, 5, 5, 10 });
+
+      regi.regi = bobyqa_regi;
+    }
+  }
+}
+
+// Same structure as the multiple-view fragment registration app: each object
+// is registered in turn by CMA-ES at 8x downsampling, with the previously
+// registered objects kept static, then each is refined by BOBYQA at 4x
+// downsampling with the other objects static, and finally all poses are
+// refined jointly.
+void SetupMultiViewRegi(ProgOpts& po, MultiLevelMultiObjRegi* ml_regi)
+{
+  const size_type num_views = ml_regi->fixed_proj_data.size();
+  const size_type num_objs  = ml_regi->vols.size();
+
+  // optimize in a frame at the center of the volumes, with axes aligned to
+  // the volume axes
+  FrameTransform ref_to_vol = FrameTransform::Identity();
+  ref_to_vol.matrix().block(0,3,3,1) = ITKVol3DCenterAsPhysPt(ml_regi->vols[0].GetPointer());
+
+  ml_regi->ref_frames = { MultiLevelMultiObjRegi::MakeStaticRefFrame(ref_to_vol.inverse(), true) };
+
+  auto se3_vars = std::make_shared<SE3OptVarsLieAlg>();
+
+  ml_regi->levels.resize(2);
+
+  for (size_type lvl_idx = 0; lvl_idx < 2; ++lvl_idx)
+  {
+    auto& lvl = ml_regi->levels[lvl_idx];
+
+    lvl.fixed_imgs_to_use.resize(num_views);
+    std::iota(lvl.fixed_imgs_to_use.begin(), lvl.fixed_imgs_to_use.end(), 0);
+
+    lvl.ds_factor = (lvl_idx == 0) ? 0.125 : 0.25;
+
+    lvl.ray_caster = LineIntRayCasterFromProgOpts(po);
+
+    for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
+    {
+      lvl.sim_metrics.push_back(MakeSimMetric(po, lvl.ds_factor));
+    }
+
+    lvl.regis.resize((lvl_idx == 0) ? num_objs : (num_objs + 1));
+
+    for (size_type obj_idx = 0; obj_idx < num_objs; ++obj_idx)
+    {
+      auto& regi = lvl.regis[obj_idx];
+
+      regi.mov_vols   = { obj_idx };
+      regi.ref_frames = { 0 };
+
+      for (size_type other_idx = 0; other_idx < num_objs; ++other_idx)
+      {
+        // the first level only uses objects which have already been registered
+        if ((other_idx != obj_idx) && ((lvl_idx > 0) || (other_idx < obj_idx)))
+        {
+          regi.static_vols.push_back(other_idx);
+
+          auto static_pose_fn = std::make_shared<UseCurEstForInit>();
+          static_pose_fn->vol_idx = other_idx;
+          regi.static_vol_poses.push_back(static_pose_fn);
+        }
+      }
+
+      auto init_guess_fn = std::make_shared<UseCurEstForInit>();
+      init_guess_fn->vol_idx = obj_idx;
+      regi.init_mov_vol_poses = { init_guess_fn };
+
+      if (lvl_idx == 0)
+      {
+        auto cmaes_regi = std::make_shared<Intensity2D3DRegiCMAES>();
+        cmaes_regi->set_opt_vars(se3_vars);
+        cmaes_regi->set_opt_x_tol(0.01);
+        cmaes_regi->set_opt_obj_fn_tol(0.01);
+        cmaes_regi->set_pop_size(100);
+        cmaes_regi->set_sigma({ 0.3, 0.3, 0.3, 5, 5, 5 });
+
+        auto pen_fn = std::make_shared<Regi2D3DPenaltyFnSE3Mag>();
+        pen_fn->rot_pdfs_per_obj   = { std::make_shared<FoldNormDist>(10 * kDEG2RAD, 10 * kDEG2RAD) };
+        pen_fn->trans_pdfs_per_obj = { std::make_shared<FoldNormDist>(50, 50) };
+
+        cmaes_regi->set_penalty_fn(pen_fn);
+        cmaes_regi->set_img_sim_penalty_coefs(0.9, 0.1);
+
+        regi.regi = cmaes_regi;
+      }
+      else
+      {
+        auto bobyqa_regi = std::make_shared<Intensity2D3DRegiBOBYQA>();
+        bobyqa_regi->set_opt_vars(se3_vars);
+        bobyqa_regi->set_opt_x_tol(0.0001);
+        bobyqa_regi->set_opt_obj_fn_tol(0.0001);
+        bobyqa_regi->set_bounds({ 5 * kDEG2RAD, 5 * kDEG2RAD, 5 * kDEG2RAD, 10, 10, 10 });
+
+        regi.regi = bobyqa_regi;
+      }
+    }
+
+    if (lvl_idx > 0)
+    {
+      // joint refinement of all objects
+      auto& regi = lvl.regis[num_objs];
+
+      regi.mov_vols.resize(num_objs);
+      std::iota(regi.mov_vols.begin(), regi.mov_vols.end(), 0);
+
+      regi.ref_frames.assign(num_objs, 0);
+
+      for (size_type obj_idx = 0; obj_idx < num_objs; ++obj_idx)
+      {
+        auto init_guess_fn = std::make_shared<UseCurEstForInit>();
+        init_guess_fn->vol_idx = obj_idx;
+        regi.init_mov_vol_poses.push_back(init_guess_fn);
+      }
+
+      auto bobyqa_regi = std::make_shared<Intensity2D3DRegiBOBYQA>();
+      bobyqa_regi->set_opt_vars(se3_vars);
+      bobyqa_regi->set_opt_x_tol(0.0001);
+      bobyqa_regi->set_opt_obj_fn_tol(0.0001);
+
+      Intensity2D3DRegiBOBYQA::ScalarList bounds;
+      for (size_type obj_idx = 0; obj_idx < num_objs; ++obj_idx)
+      {
+        bounds.insert(bounds.end(), { 2.5 * kDEG2RAD, 2.5 * kDEG2RAD, 2.5 * kDEG2RAD, 5, 5, 5 });
+      }
+      bobyqa_regi->set_bounds(bounds);
+
+      regi.regi = bobyqa_regi;
+    }
+  }
+}
+
+boost::property_tree::ptree PoseErrorJSON(const PoseError& err)
+{
+  boost::property_tree::ptree e;
+
+  e.put("rot-deg",        err.rot_deg);
+  e.put("trans-mm",       err.trans_mm);
+  e.put("mean-corner-mm", err.mean_corner_mm);
+
+  return e;
+}
+
+void PutResultJSON(const PipelineResult& r, boost::property_tree::ptree* bench)
+{
+  using ptree = boost::property_tree::ptree;
+
+  bench->put("name",      r.name);
+  bench->put("num-views", r.num_views);
+
+  PutBenchStatus(r.ok, r.timing, r.err_msg, bench);
+
+  if (r.ok)
+  {
+    // children with empty keys are written as the elements of a JSON array
+    ptree levels;
+
+    for (const auto& l : r.levels)
+    {
+      ptree lvl;
+
+      lvl.put("wall-secs",            l.wall_secs);
+      lvl.put("num-obj-fn-evals",     l.num_obj_fn_evals);
+      lvl.put("obj-fn-evals-per-sec", l.obj_fn_evals_per_sec);
+
+      levels.push_back(std::make_pair(std::string(), lvl));
+    }
+
+    bench->add_child("levels", levels);
+
+    ptree objs;
+
+    const size_type num_objs = r.obj_names.size();
+
+    for (size_type obj_idx = 0; obj_idx < num_objs; ++obj_idx)
+    {
+      ptree obj;
+
+      obj.put("name", r.obj_names[obj_idx]);
+      obj.add_child("init-err",  PoseErrorJSON(r.init_errs[obj_idx]));
+      obj.add_child("final-err", PoseErrorJSON(r.final_errs[obj_idx]));
+
+      objs.push_back(std::make_pair(std::string(), obj));
+    }
+
+    bench->add_child("objects", objs);
+  }
+}
+
+}  // un-named
+
+int main(int argc, char* argv[])
+{
+  constexpr int kEXIT_VAL_SUCCESS  = 0;
+  constexpr int kEXIT_VAL_BAD_USE  = 1;
+
+  using namespace xreg;
+
+  ProgOpts po;
+
+  xregPROG_OPTS_SET_COMPILE_DATE(po);
+
+  po.set_help("End-to-end 2D/3D registration benchmark using a reproducible synthetic case. "
+              "Three synthetic bone-like objects are created and projected at a known pose "
+              "into simulated C-arm views, with Poisson noise, in the same manner as the "
+              "synthetic fluoroscopy creation tool. The initial pose of each object is a "
+              "random perturbation of the ground truth, drawn from a seeded random number "
+              "generator. Two pipelines are then run: \"single-view\", which registers the "
+              "first object to one view with the configuration of the single-view pelvis "
+              "registration app, and \"multi-view\", which registers all three objects "
+              "to all views with the structure of the multiple-view fragment registration "
+              "app. The wall time of each registration level (from the start of its first "
+              "registration to the end of its last optimizer iteration), the number of "
+              "objective function evaluations per second, the total wall time of each "
+              "pipeline, the peak host memory of the process, the peak tracked device memory "
+              "(see xregMemTracking.h) and the initial and final pose errors of each object "
+              "are reported. Pose errors are the rotation angle, "
+              "the displacement of the volume center and the mean displacement of the volume "
+              "corners. Results are written in JSON format to the optional output path, or to "
+              "stdout when it is not provided.");
+  po.set_arg_usage("[<Output JSON File>]");
+  po.set_min_num_pos_args(0);
+
+  po.add("pipelines", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "pipelines",
+         "Comma separated list of the pipelines to run. Valid values are \"single-view\" "
+         "and \"multi-view\".")
+    << "single-view,multi-view";
+
+  po.add("vol-size", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32, "vol-size",
+         "The number of voxels along each dimension of the synthetic volumes.")
+    << ProgOpts::uint32(192);
+
+  po.add("vol-extent", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "vol-extent",
+         "The physical extent (mm) of each dimension of the synthetic volumes.")
+    << 250.0;
+
+  po.add("num-views", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32, "num-views",
+         "The number of views used by the multi-view pipeline.")
+    << ProgOpts::uint32(3);
+
+  po.add("view-sep", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "view-sep",
+         "The angular separation (degrees) between the views of the multi-view pipeline.")
+    << 25.0;
+
+  po.add("num-photons", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32, "num-photons",
+         "The number of photons per pixel used to simulate Poisson noise. 0 disables noise.")
+    << ProgOpts::uint32(5000);
+
+  po.add("init-rot", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "init-rot",
+         "The rotation (degrees) of the initial pose perturbation of each object.")
+    << 5.0;
+
+  po.add("init-trans", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "init-trans",
+         "The translation magnitude (mm) of the initial pose perturbation of each object.")
+    << 10.0;
+
+  po.add("seed", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32, "seed",
+         "Seed for the random initial pose perturbations and the Poisson noise.")
+    << ProgOpts::uint32(1234);
+
+  po.add_backend_flags();
+
+  try
+  {
+    po.parse(argc, argv);
+  }
+  catch (const ProgOpts::Exception& e)
+  {
+    std::cerr << "Error parsing command line arguments: " << e.what() << std::endl;
+    po.print_usage(std::cerr);
+    return kEXIT_VAL_BAD_USE;
+  }
+
+  if (po.help_set())
+  {
+    po.print_usage(std::cout);
+    po.print_help(std::cout);
+    return kEXIT_VAL_SUCCESS;
+  }
+
+  const bool verbose = po.get("verbose");
+  std::ostream& vout = po.vout();
+
+  const auto pipelines = StringSplit(po.get("pipelines").as_string(), ",");
+
+  const size_type vol_size       = po.get("vol-size").as_uint32();
+  const CoordScalar vol_extent   = po.get("vol-extent").as_double();
+  const size_type num_views      = po.get("num-views").as_uint32();
+  const CoordScalar view_sep_deg = po.get("view-sep").as_double();
+
+  const unsigned long num_photons = po.get("num-photons").as_uint32();
+
+  const CoordScalar init_rot_deg  = po.get("init-rot").as_double();
+  const CoordScalar init_trans_mm = po.get("init-trans").as_double();
+
+  const std::uint32_t seed = po.get("seed").as_uint32();
+
+  const std::string backend_str = po.get("backend");
+
+  for (const auto& p : pipelines)
+  {
+    if ((p != "single-view") && (p != "multi-view"))
+    {
+      std::cerr << "ERROR: unsupported pipeline: " << p << std::endl;
+      return kEXIT_VAL_BAD_USE;
+    }
+  }
+
+  vout << "creating synthetic objects..." << std::endl;
+  const auto vols = MakeSyntheticObjs(vol_size, vol_extent);
+
+  const std::vector<std::string> obj_names = { "Pelvis", "Femur", "Frag." };
+
+  const size_type num_objs = vols.size();
+
+  vout << "creating synthetic views..." << std::endl;
+  Pt3 iso_center_wrt_world;
+  const auto cams = MakeSyntheticViews(std::max(num_views, size_type(1)),
+                                       view_sep_deg, &iso_center_wrt_world);
+
+  const Pt3 vol_center = ITKVol3DCenterAsPhysPt(vols[0].GetPointer());
+
+  // all objects have the same ground truth pose, the volume center is placed at
+  // the iso-center
+  FrameTransform gt_cam_to_vol = FrameTransform::Identity();
+  gt_cam_to_vol.matrix().block(0,3,3,1) = vol_center - iso_center_wrt_world;
+
+  vout << "sampling initial poses..." << std::endl;
+  std::mt19937 rng_eng(seed);
+
+  std::vector<FrameTransform> init_cam_to_vols;
+
+  for (size_type obj_idx = 0; obj_idx < num_objs; ++obj_idx)
+  {
+    init_cam_to_vols.push_back(SamplePerturbation(init_rot_deg, init_trans_mm,
+                                                  vol_center, rng_eng) * gt_cam_to_vol);
+  }
+
+  BenchResultsJSON results_json;
+  results_json.info().put("backend",     backend_str);
+  results_json.info().put("vol-size",    vol_size);
+  results_json.info().put("num-photons", num_photons);
+  results_json.info().put("seed",        seed);
+
+  for (const auto& p : pipelines)
+  {
+    vout << "running pipeline: " << p << std::endl;
+
+    const bool single_view = p == "single-view";
+
+    MultiLevelMultiObjRegi ml_regi;
+    ml_regi.set_debug_output_stream(vout, verbose);
+
+    if (single_view)
+    {
+      vout << "  creating synthetic fluoro..." << std::endl;
+      ml_regi.fixed_proj_data = MakeSyntheticFluoro(po, { vols[0] }, { cams[0] }, gt_cam_to_vol,
+                                                     num_photons, seed, vout);
+
+      ml_regi.vol_names        = { obj_names[0] };
+      ml_regi.vols             = { vols[0] };
+      ml_regi.init_cam_to_vols = { init_cam_to_vols[0] };
+
+      SetupSingleViewRegi(po, &ml_regi);
+    }
+    else
+    {
+      vout << "  creating synthetic fluoro..." << std::endl;
+      ml_regi.fixed_proj_data = MakeSyntheticFluoro(po, vols, cams, gt_cam_to_vol,
+                                                     num_photons, seed, vout);
+
+      ml_regi.vol_names        = obj_names;
+      ml_regi.vols             = vols;
+      ml_regi.init_cam_to_vols = init_cam_to_vols;
+
+      SetupMultiViewRegi(po, &ml_regi);
+    }
+
+    vout << "  running regi..." << std::endl;
+    const PipelineResult r = RunAndTime(p, &ml_regi,
+                                        std::vector<FrameTransform>(ml_regi.vols.size(),
+                                                                    gt_cam_to_vol));
+
+    PutResultJSON(r, &results_json.add_bench());
+
+    if (!r.ok)
+    {
+      vout << "  ERROR: " << r.err_msg << std::endl;
+      continue;
+    }
+
+    vout << fmt::format("  total: {:.3f} s", r.timing.mean_secs) << std::endl;
+
+    for (size_type lvl_idx = 0; lvl_idx < r.levels.size(); ++lvl_idx)
+    {
+      vout << fmt::format("    level {}: {:.3f} s, {} obj. fn. evals, {:.2f} evals/s",
+                          lvl_idx, r.levels[lvl_idx].wall_secs,
+                          r.levels[lvl_idx].num_obj_fn_evals,
+                          r.levels[lvl_idx].obj_fn_evals_per_sec) << std::endl;
+    }
+
+    for (size_type obj_idx = 0; obj_idx < r.obj_names.size(); ++obj_idx)
+    {
+      vout << fmt::format("    {}: rot. err. {:.3f} -> {:.3f} deg, trans. err. {:.3f} -> {:.3f} mm",
+                          r.obj_names[obj_idx],
+                          r.init_errs[obj_idx].rot_deg, r.final_errs[obj_idx].rot_deg,
+                          r.init_errs[obj_idx].trans_mm, r.final_errs[obj_idx].trans_mm)
+           << std::endl;
+    }
+  }
+
+  results_json.info().put("peak-host-mem-bytes", PeakHostMemBytes());
+  results_json.info().put("peak-tracked-device-mem-bytes", DeviceMemUsage().peak_bytes);
+
+  const std::string dst_path = po.pos_args().empty() ? std::string() : po.pos_args()[0];
+
+  if (!dst_path.empty())
+  {
+    vout << "writing results to: " << dst_path << std::endl;
+  }
+
+  results_json.write(dst_path);
+
+  vout << "exiting..." << std::endl;
+
+  return kEXIT_VAL_SUCCESS;
+}
@@ -0,0 +1,564 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <random>
+
+#include <fmt/format.h>
+
+#include "xregProgOptUtils.h"
+#include "xregStringUtils.h"
+#include "xregBenchUtils.h"
+#include "xregITKBasicImageUtils.h"
+#include "xregRayCastInterface.h"
+#include "xregImgSimMetric2DSSDCPU.h"
+#include "xregImgSimMetric2DSSDOCL.h"
+#include "xregImgSimMetric2DNCCCPU.h"
+#include "xregImgSimMetric2DNCCOCL.h"
+#include "xregImgSimMetric2DGradNCCCPU.h"
+#include "xregImgSimMetric2DGradNCCOCL.h"
+#include "xregImgSimMetric2DGradDiffCPU.h"
+#include "xregImgSimMetric2DGradOrientCPU.h"
+#include "xregImgSimMetric2DPatchNCCCPU.h"
+#include "xregImgSimMetric2DPatchNCCOCL.h"
+#include "xregImgSimMetric2DPatchGradNCCCPU.h"
+#include "xregImgSimMetric2DPatchGradNCCOCL.h"
+#include "xregImgSimMetric2DMICPU.h"
+#include "xregImgSimMetric2DMIOCL.h"
+#include "xregImgSimMetric2DBoundaryEdgesCPU.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+using size_type = std::size_t;
+
+using Scalar       = ImgSimMetric2D::Scalar;
+using Image        = ImgSimMetric2D::Image;
+using ImagePtr     = ImgSimMetric2D::ImagePtr;
+using ImageMask    = ImgSimMetric2D::ImageMask;
+using ImageMaskPtr = ImgSimMetric2D::ImageMaskPtr;
+
+using CtxQueue = std::tuple<boost::compute::context,boost::compute::command_queue>;
+
+// Depth of the synthetic object in the depth images used by the boundary
+// edges metric
+constexpr Scalar kOBJ_DEPTH = 500;
+
+struct BenchConfig
+{
+  std::string metric;
+
+  size_type img_size;
+  size_type num_mov_imgs;
+
+  double mask_density;
+
+  // zero when the metric does not use patches
+  size_type patch_radius;
+  size_type patch_stride;
+};
+
+struct BenchResult
+{
+  BenchConfig cfg;
+
+  bool ok;
+
+  std::string err_msg;
+
+  BenchTiming timing;
+
+  double secs_per_img;
+  double imgs_per_sec;
+  double pix_per_sec;
+};
+
+bool IsPatchMetric(const std::string& metric)
+{
+  return (metric == "patch-ncc") || (metric == "patch-grad-ncc");
+}
+
+// Smooth synthetic intensity image consisting of a few Gaussian blobs, with
+// a shift in each dimension and additive noise.
+void FillSyntheticIntensities(Scalar* buf, const size_type img_size,
+                              const double shift, std::mt19937& rng_eng)
+{
+  std::normal_distribution<Scalar> noise_dist(0, 0.01);
+
+  const double s = static_cast<double>(img_size);
+
+  const std::array<double,3> blob_rows  = { 0.3 * s, 0.5 * s, 0.7 * s };
+  const std::array<double,3> blob_cols  = { 0.4 * s, 0.6 * s, 0.35 * s };
+  const std::array<double,3> blob_sigma = { 0.08 * s, 0.12 * s, 0.05 * s };
+
+  for (size_type r = 0; r < img_size; ++r)
+  {
+    for (size_type c = 0; c < img_size; ++c, ++buf)
+    {
+      double v = 0;
+
+      for (size_type blob_idx = 0; blob_idx < 3; ++blob_idx)
+      {
+        const double dr = (r - shift) - blob_rows[blob_idx];
+        const double dc = (c - shift) - blob_cols[blob_idx];
+
+        v += std::exp(-((dr * dr) + (dc * dc)) /
+                        (2 * blob_sigma[blob_idx] * blob_sigma[blob_idx]));
+      }
+
+      *buf = static_cast<Scalar>(v) + noise_dist(rng_eng);
+    }
+  }
+}
+
+// Synthetic depth image of a disc, background pixels are at the max. depth.
+void FillSyntheticDepths(Scalar* buf, const size_type img_size, const double shift)
+{
+  const double c0  = (0.5 * img_size) + shift;
+  const double rad = 0.3 * img_size;
+
+  for (size_type r = 0; r < img_size; ++r)
+  {
+    for (size_type c = 0; c < img_size; ++c, ++buf)
+    {
+      const double dr = r - c0;
+      const double dc = c - c0;
+
+      *buf = (((dr * dr) + (dc * dc)) <= (rad * rad)) ? kOBJ_DEPTH :
+                                      static_cast<Scalar>(kRAY_CAST_MAX_DEPTH);
+    }
+  }
+}
+
+ImageMaskPtr MakeRandomMask(const size_type img_size, const double density,
+                            std::mt19937& rng_eng)
+{
+  auto mask = MakeITK2DVol<ImgSimMetric2D::MaskScalar>(img_size, img_size);
+
+  std::bernoulli_distribution keep_dist(density);
+
+  ImgSimMetric2D::MaskScalar* buf = mask->GetBufferPointer();
+
+  const size_type num_pix = img_size * img_size;
+
+  for (size_type i = 0; i < num_pix; ++i)
+  {
+    buf[i] = keep_dist(rng_eng) ? 1 : 0;
+  }
+
+  return mask;
+}
+
+std::shared_ptr<ImgSimMetric2D> MakeSimMetric(const std::string& metric, const bool use_ocl,
+                                              const CtxQueue& ocl_ctx_queue)
+{
+  std::shared_ptr<ImgSimMetric2D> sm;
+
+  const auto& ctx   = std::get<0>(ocl_ctx_queue);
+  const auto& queue = std::get<1>(ocl_ctx_queue);
+
+  if (metric == "ssd")
+  {
+    sm = use_ocl ? std::shared_ptr<ImgSimMetric2D>(new ImgSimMetric2DSSDOCL(ctx, queue)) :
+                   std::shared_ptr<ImgSimMetric2D>(new ImgSimMetric2DSSDCPU);
+  }
+  else if (metric == "ncc")
+  {
+    sm = use_ocl ? std::shared_ptr<ImgSimMetric2D>(new ImgSimMetric2DNCCOCL(ctx, queue)) :
+                   std::shared_ptr<ImgSimMetric2D>(new ImgSimMetric2DNCCCPU);
+  }
+  else if (metric == "grad-ncc")
+  {
+    sm = use_ocl ? std::shared_ptr<ImgSimMetric2D>(new ImgSimMetric2DGradNCCOCL(ctx, queue)) :
+                   std::shared_ptr<ImgSimMetric2D>(new ImgSimMetric2DGradNCCCPU);
+  }
+  else if (metric == "patch-ncc")
+  {
+    sm = use_ocl ? std::shared_ptr<ImgSimMetric2D>(new ImgSimMetric2DPatchNCCOCL(ctx, queue)) :
+                   std::shared_ptr<ImgSimMetric2D>(new ImgSimMetric2DPatchNCCCPU);
+  }
+  else if (metric == "patch-grad-ncc")
+  {
+    sm = use_ocl ? std::shared_ptr<ImgSimMetric2D>(new ImgSimMetric2DPatchGradNCCOCL(ctx, queue)) :
+                   std::shared_ptr<ImgSimMetric2D>(new ImgSimMetric2DPatchGradNCCCPU);
+  }
+  else if (metric == "mi")
+  {
+    sm = use_ocl ? std::shared_ptr<ImgSimMetric2D>(new ImgSimMetric2DMIOCL(ctx, queue)) :
+                   std::shared_ptr<ImgSimMetric2D>(new ImgSimMetric2DMICPU);
+  }
+  else if ((metric == "grad-diff") || (metric == "grad-orient") || (metric == "boundary-edges"))
+  {
+    if (use_ocl)
+    {
+      xregThrow("No OpenCL implementation of similarity metric: %s", metric.c_str());
+    }
+
+    if (metric == "grad-diff")
+    {
+      sm = std::make_shared<ImgSimMetric2DGradDiffCPU>();
+    }
+    else if (metric == "grad-orient")
+    {
+      sm = std::make_shared<ImgSimMetric2DGradOrientCPU>();
+    }
+    else
+    {
+      sm = std::make_shared<ImgSimMetric2DBoundaryEdgesCPU>();
+    }
+  }
+  else
+  {
+    xregThrow("Unsupported similarity metric: %s", metric.c_str());
+  }
+
+  return sm;
+}
+
+BenchResult RunBench(const BenchConfig& cfg, const bool use_ocl,
+                     const CtxQueue& ocl_ctx_queue,
+                     const size_type num_warmup, const size_type num_iters)
+{
+  BenchResult res;
+
+  res.cfg = cfg;
+  res.ok  = false;
+
+  res.secs_per_img = 0;
+  res.imgs_per_sec = 0;
+  res.pix_per_sec  = 0;
+
+  try
+  {
+    std::mt19937 rng_eng(1234);
+
+    const size_type num_pix = cfg.img_size * cfg.img_size;
+
+    const bool is_edges = cfg.metric == "boundary-edges";
+
+    // the fixed image may be modified by the metric, so create a new one for
+    // every configuration
+    auto fixed_img = MakeITK2DVol<Scalar>(cfg.img_size, cfg.img_size);
+
+    std::vector<Scalar> mov_imgs_buf(num_pix * cfg.num_mov_imgs);
+
+    if (!is_edges)
+    {
+      FillSyntheticIntensities(fixed_img->GetBufferPointer(), cfg.img_size, 0, rng_eng);
+
+      for (size_type mov_idx = 0; mov_idx < cfg.num_mov_imgs; ++mov_idx)
+      {
+        FillSyntheticIntensities(&mov_imgs_buf[mov_idx * num_pix], cfg.img_size,
+                                 0.5 * (mov_idx % 8), rng_eng);
+      }
+    }
+    else
+    {
+      FillSyntheticDepths(fixed_img->GetBufferPointer(), cfg.img_size, 0);
+
+      for (size_type mov_idx = 0; mov_idx < cfg.num_mov_imgs; ++mov_idx)
+      {
+        FillSyntheticDepths(&mov_imgs_buf[mov_idx * num_pix], cfg.img_size,
+                            0.5 * (mov_idx % 8));
+      }
+    }
+
+    auto sm = MakeSimMetric(cfg.metric, use_ocl, ocl_ctx_queue);
+
+    if (is_edges)
+    {
+      // edges of the fixed disc
+      auto fixed_edges = MakeITK2DVol<ImgSimMetric2DBoundaryEdgesCPU::EdgePixelScalar>(
+                                                                cfg.img_size, cfg.img_size);
+
+      const Scalar* depth_buf = fixed_img->GetBufferPointer();
+
+      auto* edges_buf = fixed_edges->GetBufferPointer();
+
+      for (size_type r = 1; (r + 1) < cfg.img_size; ++r)
+      {
+        for (size_type c = 1; (c + 1) < cfg.img_size; ++c)
+        {
+          const size_type i = (r * cfg.img_size) + c;
+
+          const bool in_obj = depth_buf[i] < kRAY_CAST_MAX_DEPTH;
+
+          edges_buf[i] = (in_obj && (!(depth_buf[i - 1] < kRAY_CAST_MAX_DEPTH) ||
+                                     !(depth_buf[i + 1] < kRAY_CAST_MAX_DEPTH) ||
+                                     !(depth_buf[i - cfg.img_size] < kRAY_CAST_MAX_DEPTH) ||
+                                     !(depth_buf[i + cfg.img_size] < kRAY_CAST_MAX_DEPTH))) ? 1 : 0;
+        }
+      }
+
+      dynamic_cast<ImgSimMetric2DBoundaryEdgesCPU*>(sm.get())->set_fixed_image_edges(fixed_edges);
+    }
+
+    if (IsPatchMetric(cfg.metric))
+    {
+      auto* patch_params = dynamic_cast<ImgSimMetric2DPatchCommon*>(sm.get());
+
+      patch_params->set_patch_radius(cfg.patch_radius);
+      patch_params->set_patch_stride(cfg.patch_stride);
+    }
+
+    sm->set_fixed_image(fixed_img);
+
+    if (cfg.mask_density < 1)
+    {
+      sm->set_mask(MakeRandomMask(cfg.img_size, cfg.mask_density, rng_eng));
+    }
+
+    sm->set_num_moving_images(cfg.num_mov_imgs);
+    sm->set_mov_imgs_host_buf(&mov_imgs_buf[0]);
+
+    sm->allocate_resources();
+
+    res.timing = TimeBenchIters([&sm] () { sm->compute(); }, num_warmup, num_iters);
+
+    const double mean_secs = res.timing.mean_secs;
+
+    res.secs_per_img = mean_secs / cfg.num_mov_imgs;
+
+    if (mean_secs > 0)
+    {
+      res.imgs_per_sec = cfg.num_mov_imgs / mean_secs;
+      res.pix_per_sec  = (static_cast<double>(num_pix) * cfg.num_mov_imgs) / mean_secs;
+    }
+
+    res.ok = true;
+  }
+  catch (const std::exception& e)
+  {
+    res.err_msg = e.what();
+  }
+
+  return res;
+}
+
+void PutResultJSON(const BenchResult& r, boost::property_tree::ptree* bench)
+{
+  bench->put("metric",       r.cfg.metric);
+  bench->put("img-size",     r.cfg.img_size);
+  bench->put("num-mov-imgs", r.cfg.num_mov_imgs);
+  bench->put("mask-density", r.cfg.mask_density);
+  bench->put("patch-radius", r.cfg.patch_radius);
+  bench->put("patch-stride", r.cfg.patch_stride);
+
+  PutBenchStatus(r.ok, r.timing, r.err_msg, bench);
+
+  if (r.ok)
+  {
+    bench->put("secs-per-img",   r.secs_per_img);
+    bench->put("imgs-per-sec",   r.imgs_per_sec);
+    bench->put("pixels-per-sec", r.pix_per_sec);
+  }
+}
+
+}  // un-named
+
+int main(int argc, char* argv[])
+{
+  constexpr int kEXIT_VAL_SUCCESS  = 0;
+  constexpr int kEXIT_VAL_BAD_USE  = 1;
+
+  using namespace xreg;
+
+  ProgOpts po;
+
+  xregPROG_OPTS_SET_COMPILE_DATE(po);
+
+  po.set_help("Micro-benchmarks the 2D similarity metrics on synthetic images. "
+              "Every combination of metric, image size, number of moving images, mask "
+              "density and (for the patch based metrics) patch radius and stride is timed "
+              "using the selected backend. The mean and minimum time of each compute() "
+              "call are reported along with the latency per moving image and the number of "
+              "moving images and pixels processed per second. Allocation of resources and "
+              "transfer of the moving images to the device are not timed. The boundary "
+              "edges metric is given depth images of a disc. Results are written in JSON "
+              "format to the optional output path, or to stdout when it is not provided. "
+              "Metrics without an implementation for the selected backend are reported "
+              "with an error message and do not stop the benchmark.");
+  po.set_arg_usage("[<Output JSON File>]");
+  po.set_min_num_pos_args(0);
+
+  po.add("metrics", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "metrics",
+         "Comma separated list of similarity metrics to benchmark. Valid values are: "
+         "\"ssd\", \"ncc\", \"grad-ncc\", \"grad-diff\", \"grad-orient\", \"patch-ncc\", "
+         "\"patch-grad-ncc\", \"mi\" and \"boundary-edges\".")
+    << "ssd,ncc,grad-ncc,grad-diff,grad-orient,patch-ncc,patch-grad-ncc,mi,boundary-edges";
+
+  po.add("img-sizes", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "img-sizes",
+         "Comma separated list of the number of pixels along each dimension of the "
+         "synthetic square images.")
+    << "128,256,512";
+
+  po.add("num-mov-imgs", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "num-mov-imgs",
+         "Comma separated list of the number of moving images compared in each call "
+         "to compute().")
+    << "1,16,64";
+
+  po.add("mask-densities", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "mask-densities",
+         "Comma separated list of the fraction of pixels kept by random masks. 1 indicates "
+         "that no mask is used.")
+    << "1,0.5";
+
+  po.add("patch-radii", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "patch-radii",
+         "Comma separated list of patch radii used by the patch based metrics.")
+    << "5,11";
+
+  po.add("patch-strides", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "patch-strides",
+         "Comma separated list of patch strides used by the patch based metrics.")
+    << "1,4";
+
+  po.add("num-iters", 'n', ProgOpts::kSTORE_UINT32, "num-iters",
+         "Number of timed calls to compute() for each configuration.")
+    << ProgOpts::uint32(5);
+
+  po.add("num-warmup", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32, "num-warmup",
+         "Number of un-timed calls to compute() made before the timed calls.")
+    << ProgOpts::uint32(1);
+
+  po.add_backend_flags();
+
+  try
+  {
+    po.parse(argc, argv);
+  }
+  catch (const ProgOpts::Exception& e)
+  {
+    std::cerr << "Error parsing command line arguments: " << e.what() << std::endl;
+    po.print_usage(std::cerr);
+    return kEXIT_VAL_BAD_USE;
+  }
+
+  if (po.help_set())
+  {
+    po.print_usage(std::cout);
+    po.print_help(std::cout);
+    return kEXIT_VAL_SUCCESS;
+  }
+
+  std::ostream& vout = po.vout();
+
+  const auto metrics        = StringSplit(po.get("metrics").as_string(), ",");
+  const auto img_sizes      = ParseBenchList<size_type>(po.get("img-sizes"));
+  const auto num_mov_imgs   = ParseBenchList<size_type>(po.get("num-mov-imgs"));
+  const auto mask_densities = ParseBenchList<double>(po.get("mask-densities"));
+  const auto patch_radii    = ParseBenchList<size_type>(po.get("patch-radii"));
+  const auto patch_strides  = ParseBenchList<size_type>(po.get("patch-strides"));
+
+  const size_type num_iters  = po.get("num-iters").as_uint32();
+  const size_type num_warmup = po.get("num-warmup").as_uint32();
+
+  const std::string backend_str = po.get("backend");
+
+  const bool use_ocl = backend_str == "ocl";
+
+  if (!use_ocl && (backend_str != "cpu"))
+  {
+    std::cerr << "ERROR: unsupported backend: " << backend_str << std::endl;
+    return kEXIT_VAL_BAD_USE;
+  }
+
+  CtxQueue ocl_ctx_queue;
+  if (use_ocl)
+  {
+    ocl_ctx_queue = po.selected_ocl_ctx_queue();
+  }
+
+  BenchResultsJSON results_json;
+
+  results_json.info().put("backend", backend_str);
+
+  for (const auto& metric : metrics)
+  {
+    // non-patch metrics are only run once for each of the other settings
+    const bool is_patch = IsPatchMetric(metric);
+
+    const std::vector<size_type> cur_patch_radii   = is_patch ? patch_radii :
+                                                          std::vector<size_type>(1, 0);
+    const std::vector<size_type> cur_patch_strides = is_patch ? patch_strides :
+                                                          std::vector<size_type>(1, 0);
+
+    for (const size_type img_size : img_sizes)
+    {
+      for (const size_type cur_num_mov_imgs : num_mov_imgs)
+      {
+        for (const double mask_density : mask_densities)
+        {
+          for (const size_type patch_radius : cur_patch_radii)
+          {
+            for (const size_type patch_stride : cur_patch_strides)
+            {
+              BenchConfig cfg;
+              cfg.metric       = metric;
+              cfg.img_size     = img_size;
+              cfg.num_mov_imgs = cur_num_mov_imgs;
+              cfg.mask_density = mask_density;
+              cfg.patch_radius = patch_radius;
+              cfg.patch_stride = patch_stride;
+
+              vout << fmt::format("  {:>14} img: {:4d} mov: {:3d} mask: {:4.2f} "
+                                  "patch: {:2d}/{:d} ... ",
+                                  metric, img_size, cur_num_mov_imgs, mask_density,
+                                  patch_radius, patch_stride);
+              vout.flush();
+
+              const BenchResult r = RunBench(cfg, use_ocl, ocl_ctx_queue,
+                                             num_warmup, num_iters);
+
+              PutResultJSON(r, &results_json.add_bench());
+
+              if (r.ok)
+              {
+                vout << fmt::format("{:10.3f} ms, {:10.4f} ms/img, {:10.4g} imgs/s",
+                                    r.timing.mean_secs * 1000.0, r.secs_per_img * 1000.0,
+                                    r.imgs_per_sec)
+                     << std::endl;
+              }
+              else
+              {
+                vout << "ERROR: " << r.err_msg << std::endl;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  const std::string dst_path = po.pos_args().empty() ? std::string() : po.pos_args()[0];
+
+  if (!dst_path.empty())
+  {
+    vout << "writing results to: " << dst_path << std::endl;
+  }
+
+  results_json.write(dst_path);
+
+  vout << "exiting..." << std::endl;
+
+  return kEXIT_VAL_SUCCESS;
+}
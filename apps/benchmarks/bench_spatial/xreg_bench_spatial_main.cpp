@@ -0,0 +1,621 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <random>
+
+#include <fmt/format.h>
+
+#include "xregProgOptUtils.h"
+#include "xregStringUtils.h"
+#include "xregTimer.h"
+#include "xregBenchUtils.h"
+#include "xregMesh.h"
+#include "xregKDTree.h"
+#include "xregICP3D3D.h"
+#include "xregPointCloudUtils.h"
+#include "xregRigidUtils.h"
+#include "xregPerspectiveXform.h"
+#include "xregRANSACPnP.h"
+#include "xregPOSIT.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+using size_type = std::size_t;
+
+// Physical extent of the synthetic surface along X and Y (mm)
+constexpr CoordScalar kSUR_EXTENT = 300;
+
+// Amplitude and wavelength of the bumps along Z (mm)
+constexpr CoordScalar kSUR_BUMP_AMP    = 15;
+constexpr CoordScalar kSUR_BUMP_LAMBDA = 40;
+
+struct BenchConfig
+{
+  std::string bench;
+
+  // zero for benchmarks that do not use the surface
+  size_type num_tris;
+
+  // number of query points, ICP points or PnP landmarks; zero for the
+  // KD-Tree construction benchmark
+  size_type num_pts;
+};
+
+struct BenchResult
+{
+  BenchConfig cfg;
+
+  bool ok;
+
+  std::string err_msg;
+
+  BenchTiming timing;
+
+  // triangles/sec. for construction, points/sec. for queries and
+  // proposals/sec. for RANSAC PnP
+  double items_per_sec;
+
+  // ICP only; mean time of a single ICP iteration and the mean number of ICP
+  // iterations executed by each call to run()
+  double icp_secs_per_iter;
+  double icp_iters_per_run;
+};
+
+// Triangulated height field over a square grid with smooth bumps. The grid
+// dimensions are chosen so that the number of triangles is as close as
+// possible to the requested number.
+TriMesh MakeSyntheticSurface(const size_type num_tris_req)
+{
+  const size_type n = std::max(size_type(2),
+          static_cast<size_type>(std::lround(std::sqrt(num_tris_req / 2.0))) + 1);
+
+  const CoordScalar step = kSUR_EXTENT / (n - 1);
+
+  TriMesh mesh;
+
+  mesh.vertices.reserve(n * n);
+
+  for (size_type r = 0; r < n; ++r)
+  {
+    const CoordScalar y = (r * step) - (kSUR_EXTENT / 2);
+
+    for (size_type c = 0; c < n; ++c)
+    {
+      const CoordScalar x = (c * step) - (kSUR_EXTENT / 2);
+
+      mesh.vertices.push_back(Pt3(x, y, kSUR_BUMP_AMP *
+                                          std::sin(x / kSUR_BUMP_LAMBDA) *
+                                          std::cos(y / kSUR_BUMP_LAMBDA)));
+    }
+  }
+
+  mesh.faces.reserve(2 * (n - 1) * (n - 1));
+
+  for (size_type r = 0; (r + 1) < n; ++r)
+  {
+    for (size_type c = 0; (c + 1) < n; ++c)
+    {
+      const size_type v = (r * n) + c;
+
+      mesh.faces.push_back(TriMesh::Triangle{ { v, v + 1, v + n } });
+      mesh.faces.push_back(TriMesh::Triangle{ { v + 1, v + n + 1, v + n } });
+    }
+  }
+
+  return mesh;
+}
+
+// Points uniformly distributed in a slab about the surface
+Pt3List MakeQueryPts(const size_type num_pts, std::mt19937& rng_eng)
+{
+  std::uniform_real_distribution<CoordScalar> xy_dist(-kSUR_EXTENT / 2, kSUR_EXTENT / 2);
+  std::uniform_real_distribution<CoordScalar> z_dist(-2 * kSUR_BUMP_AMP, 2 * kSUR_BUMP_AMP);
+
+  Pt3List pts(num_pts);
+
+  for (auto& p : pts)
+  {
+    p = Pt3(xy_dist(rng_eng), xy_dist(rng_eng), z_dist(rng_eng));
+  }
+
+  return pts;
+}
+
+// Noisy samples of the surface vertices, mapped away from the surface by a
+// small rigid perturbation, so that ICP has some work to do
+Pt3List MakeICPPts(const TriMesh& mesh, const size_type num_pts, std::mt19937& rng_eng)
+{
+  std::uniform_int_distribution<size_type> vert_dist(0, mesh.vertices.size() - 1);
+  std::normal_distribution<CoordScalar> noise_dist(0, 0.5);
+
+  const FrameTransform perturb = EulerRotXYZTransXYZFrame(0.03, -0.02, 0.05, 2, -3, 1.5);
+
+  Pt3List pts(num_pts);
+
+  for (auto& p : pts)
+  {
+    const Pt3 noise(noise_dist(rng_eng), noise_dist(rng_eng), noise_dist(rng_eng));
+
+    p = perturb * Pt3(mesh.vertices[vert_dist(rng_eng)] + noise);
+  }
+
+  return pts;
+}
+
+struct PnPSettings
+{
+  double outlier_frac;
+
+  size_type num_proposals;
+
+  CoordScalar inlier_thresh_pixels;
+};
+
+BenchResult RunBench(const BenchConfig& cfg, const TriMesh* mesh,
+                     const size_type icp_max_its, const double max_exhaustive_pairs,
+                     const PnPSettings& pnp_settings,
+                     const size_type num_warmup, const size_type num_iters)
+{
+  BenchResult res;
+
+  res.cfg = cfg;
+  res.ok  = false;
+
+  res.items_per_sec     = 0;
+  res.icp_secs_per_iter = 0;
+  res.icp_iters_per_run = 0;
+
+  try
+  {
+    std::mt19937 rng_eng(1234);
+
+    // number of items processed by each timed call
+    double num_items = static_cast<double>(cfg.num_pts);
+
+    if (cfg.bench == "kdtree-build")
+    {
+      std::vector<KDTreeTri> tris;
+
+      KDTreeNode<KDTreeTri> kdt;
+
+      res.timing = TimeBenchIters([&tris,&kdt,mesh] ()
+                {
+                  tris = CreateTrisForKDTree(*mesh);
+                  kdt.init(tris.begin(), tris.end());
+                },
+                num_warmup, num_iters);
+
+      num_items = static_cast<double>(mesh->faces.size());
+    }
+    else if (cfg.bench == "kdtree-query")
+    {
+      auto tris = CreateTrisForKDTree(*mesh);
+
+      KDTreeNode<KDTreeTri> kdt(tris.begin(), tris.end());
+
+      const Pt3List query_pts = MakeQueryPts(cfg.num_pts, rng_eng);
+
+      Pt3List closest_pts(cfg.num_pts);
+      CoordScalarList dists(cfg.num_pts);
+
+      res.timing = TimeBenchIters([&kdt,&query_pts,&closest_pts,&dists] ()
+                {
+                  kdt.find_closest_points(query_pts, &closest_pts, &dists, nullptr);
+                },
+                num_warmup, num_iters);
+    }
+    else if (cfg.bench == "icp")
+    {
+      const Pt3List icp_pts = MakeICPPts(*mesh, cfg.num_pts, rng_eng);
+
+      Timer icp_iter_tmr;
+
+      double icp_iter_total_secs = 0;
+
+      size_type icp_total_iters = 0;
+
+      PointToSurRegiICP icp;
+
+      icp.pts = &icp_pts;
+      icp.sur = mesh;
+
+      icp.max_its = static_cast<int>(icp_max_its);
+
+      // the ratio of mean distances never exceeds 1 at termination, so this
+      // forces every run to execute the maximum number of iterations
+      icp.stop_ratio = 2;
+
+      icp.start_of_iteration_callback_fn =
+        [&icp_iter_tmr] (PointToSurRegiICP*, const size_type, const FrameTransform&)
+        {
+          icp_iter_tmr.reset();
+          icp_iter_tmr.start();
+        };
+
+      icp.end_of_iteration_callback_fn =
+        [&icp_iter_tmr,&icp_iter_total_secs,&icp_total_iters]
+        (PointToSurRegiICP*, const size_type, const FrameTransform&)
+        {
+          icp_iter_tmr.stop();
+
+          icp_iter_total_secs += icp_iter_tmr.elapsed_seconds();
+          ++icp_total_iters;
+        };
+
+      for (size_type i = 0; i < num_warmup; ++i)
+      {
+        icp.run();
+      }
+
+      icp_iter_total_secs = 0;
+      icp_total_iters     = 0;
+
+      res.timing = TimeBenchIters([&icp] () { icp.run(); }, 0, num_iters);
+
+      if (icp_total_iters)
+      {
+        res.icp_secs_per_iter = icp_iter_total_secs / icp_total_iters;
+        res.icp_iters_per_run = static_cast<double>(icp_total_iters) /
+                                          std::max(num_iters, size_type(1));
+      }
+
+      // points matched to the surface per second, not including the
+      // construction of the KD-Tree in each run
+      num_items = static_cast<double>(cfg.num_pts) * res.icp_iters_per_run;
+    }
+    else if (cfg.bench == "exhaustive-nn")
+    {
+      const double num_pairs = static_cast<double>(mesh->vertices.size()) * cfg.num_pts;
+
+      if (num_pairs > max_exhaustive_pairs)
+      {
+        xregThrow("skipped: %g point pairs exceeds the maximum of %g", num_pairs,
+                  max_exhaustive_pairs);
+      }
+
+      const Pt3List query_pts = MakeQueryPts(cfg.num_pts, rng_eng);
+
+      res.timing = TimeBenchIters([mesh,&query_pts] ()
+                {
+                  FindClosestPointsAndDistsToPointCloudExhaustive(mesh->vertices, query_pts);
+                },
+                num_warmup, num_iters);
+    }
+    else if (cfg.bench == "ransac-pnp")
+    {
+      CameraModel cam;
+      cam.setup(1000, 768, 768, 0.388, 0.388);
+
+      // landmarks are about the origin of the world frame, which is placed
+      // between the source and detector
+      const FrameTransform gt_world_to_cam = EulerRotXYZTransXYZFrame(0.1, -0.2, 0.3,
+                                                                      5, -10, -650);
+
+      std::uniform_real_distribution<CoordScalar> pt_dist(-60, 60);
+      std::uniform_real_distribution<CoordScalar> ind_dist(0, 767);
+      std::bernoulli_distribution outlier_dist(pnp_settings.outlier_frac);
+
+      Pt3List world_pts(cfg.num_pts);
+      Pt2List inds(cfg.num_pts);
+
+      for (size_type i = 0; i < cfg.num_pts; ++i)
+      {
+        world_pts[i] = Pt3(pt_dist(rng_eng), pt_dist(rng_eng), pt_dist(rng_eng));
+
+        if (!outlier_dist(rng_eng))
+        {
+          inds[i] = cam.phys_pt_to_ind_pt(gt_world_to_cam * world_pts[i]).head(2);
+        }
+        else
+        {
+          inds[i] = Pt2(ind_dist(rng_eng), ind_dist(rng_eng));
+        }
+      }
+
+      auto posit_factory = [] ()
+      {
+        return std::make_shared<POSIT>();
+      };
+
+      res.timing = TimeBenchIters([&cam,&world_pts,&inds,&pnp_settings,&posit_factory] ()
+                {
+                  RANSACPnP pnp;
+
+                  pnp.set_pnp_prop_factory(posit_factory);
+                  pnp.set_pnp_factory(posit_factory);
+
+                  pnp.set_seed(1234);
+                  pnp.set_num_proposals(static_cast<int>(pnp_settings.num_proposals));
+                  pnp.set_inlier_reproj_thresh_pixels(pnp_settings.inlier_thresh_pixels);
+
+                  pnp.set_cam(cam);
+                  pnp.set_inds_2d(inds);
+                  pnp.set_world_pts_3d(world_pts);
+
+                  pnp.run();
+                },
+                num_warmup, num_iters);
+
+      num_items = static_cast<double>(pnp_settings.num_proposals);
+    }
+    else
+    {
+      xregThrow("Unsupported benchmark: %s", cfg.bench.c_str());
+    }
+
+    if (res.timing.mean_secs > 0)
+    {
+      res.items_per_sec = num_items / res.timing.mean_secs;
+    }
+
+    res.ok = true;
+  }
+  catch (const std::exception& e)
+  {
+    res.err_msg = e.what();
+  }
+
+  return res;
+}
+
+void PutResultJSON(const BenchResult& r, boost::property_tree::ptree* bench)
+{
+  bench->put("bench",    r.cfg.bench);
+  bench->put("num-tris", r.cfg.num_tris);
+  bench->put("num-pts",  r.cfg.num_pts);
+
+  PutBenchStatus(r.ok, r.timing, r.err_msg, bench);
+
+  if (r.ok)
+  {
+    bench->put("items-per-sec", r.items_per_sec);
+
+    if (r.cfg.bench == "icp")
+    {
+      bench->put("icp-secs-per-iter", r.icp_secs_per_iter);
+      bench->put("icp-iters-per-run", r.icp_iters_per_run);
+    }
+  }
+}
+
+}  // un-named
+
+int main(int argc, char* argv[])
+{
+  constexpr int kEXIT_VAL_SUCCESS  = 0;
+  constexpr int kEXIT_VAL_BAD_USE  = 1;
+
+  using namespace xreg;
+
+  ProgOpts po;
+
+  xregPROG_OPTS_SET_COMPILE_DATE(po);
+
+  po.set_help("Micro-benchmarks the spatial search routines used for surface and "
+              "landmark based registrations. Synthetic triangulated surfaces (a bumpy "
+              "height field) are created with approximately each requested number of "
+              "triangles. The following benchmarks are available: \"kdtree-build\" times "
+              "the creation of a KD-Tree of the surface triangles, \"kdtree-query\" times "
+              "closest point lookups of random points against the KD-Tree, \"icp\" times "
+              "point to surface ICP runs of a fixed number of iterations (the time of each "
+              "ICP iteration, which excludes the KD-Tree construction, is also reported), "
+              "\"exhaustive-nn\" times exhaustive closest point searches against the "
+              "surface vertices and \"ransac-pnp\" times RANSAC PnP (with POSIT) using "
+              "random landmarks with outliers. The surface sizes are not used by the PnP "
+              "benchmark and the point counts are not used by the KD-Tree construction "
+              "benchmark. The mean and minimum time of each configuration are reported "
+              "along with the number of items processed per second. Results are written "
+              "in JSON format to the optional output path, or to stdout when it is not "
+              "provided.");
+  po.set_arg_usage("[<Output JSON File>]");
+  po.set_min_num_pos_args(0);
+
+  po.add("benches", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "benches",
+         "Comma separated list of benchmarks to run. Valid values are: \"kdtree-build\", "
+         "\"kdtree-query\", \"icp\", \"exhaustive-nn\" and \"ransac-pnp\".")
+    << "kdtree-build,kdtree-query,icp,exhaustive-nn,ransac-pnp";
+
+  po.add("num-tris", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "num-tris",
+         "Comma separated list of the approximate number of triangles in the synthetic "
+         "surfaces.")
+    << "10000,100000,1000000,5000000";
+
+  po.add("num-pts", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "num-pts",
+         "Comma separated list of the number of query points used by the KD-Tree query, "
+         "ICP and exhaustive search benchmarks.")
+    << "1000,10000,100000";
+
+  po.add("pnp-num-pts", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "pnp-num-pts",
+         "Comma separated list of the number of 2D/3D landmark correspondences used by "
+         "the RANSAC PnP benchmark.")
+    << "10,50,200";
+
+  po.add("pnp-outlier-frac", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "pnp-outlier-frac",
+         "Fraction of the 2D landmarks replaced with random detector locations in the "
+         "RANSAC PnP benchmark.")
+    << 0.3;
+
+  po.add("pnp-num-proposals", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32, "pnp-num-proposals",
+         "Number of RANSAC proposals used by the RANSAC PnP benchmark.")
+    << ProgOpts::uint32(500);
+
+  po.add("pnp-inlier-thresh", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "pnp-inlier-thresh",
+         "Re-projection distance threshold (pixels) used to identify inliers in the "
+         "RANSAC PnP benchmark.")
+    << 5.0;
+
+  po.add("icp-max-its", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32, "icp-max-its",
+         "Number of iterations executed by each ICP run.")
+    << ProgOpts::uint32(10);
+
+  po.add("max-exhaustive-pairs", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE,
+         "max-exhaustive-pairs",
+         "Exhaustive search configurations with more (surface vertex, query point) pairs "
+         "than this are skipped and reported with an error message.")
+    << 2.0e9;
+
+  po.add("num-iters", 'n', ProgOpts::kSTORE_UINT32, "num-iters",
+         "Number of timed runs for each configuration.")
+    << ProgOpts::uint32(3);
+
+  po.add("num-warmup", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32, "num-warmup",
+         "Number of un-timed runs made before the timed runs.")
+    << ProgOpts::uint32(1);
+
+  try
+  {
+    po.parse(argc, argv);
+  }
+  catch (const ProgOpts::Exception& e)
+  {
+    std::cerr << "Error parsing command line arguments: " << e.what() << std::endl;
+    po.print_usage(std::cerr);
+    return kEXIT_VAL_BAD_USE;
+  }
+
+  if (po.help_set())
+  {
+    po.print_usage(std::cout);
+    po.print_help(std::cout);
+    return kEXIT_VAL_SUCCESS;
+  }
+
+  std::ostream& vout = po.vout();
+
+  const auto benches      = StringSplit(po.get("benches").as_string(), ",");
+  const auto num_tris_lst = ParseBenchList<size_type>(po.get("num-tris"));
+  const auto num_pts_lst  = ParseBenchList<size_type>(po.get("num-pts"));
+  const auto pnp_num_pts  = ParseBenchList<size_type>(po.get("pnp-num-pts"));
+
+  PnPSettings pnp_settings;
+  pnp_settings.outlier_frac         = po.get("pnp-outlier-frac");
+  pnp_settings.num_proposals        = po.get("pnp-num-proposals").as_uint32();
+  pnp_settings.inlier_thresh_pixels = po.get("pnp-inlier-thresh").as_double();
+
+  const size_type icp_max_its = po.get("icp-max-its").as_uint32();
+
+  const double max_exhaustive_pairs = po.get("max-exhaustive-pairs");
+
+  const size_type num_iters  = po.get("num-iters").as_uint32();
+  const size_type num_warmup = po.get("num-warmup").as_uint32();
+
+  BenchResultsJSON results_json;
+
+  auto run_and_report = [&] (const BenchConfig& cfg, const TriMesh* mesh)
+  {
+    vout << fmt::format("  {:>14} tris: {:8d} pts: {:7d} ... ", cfg.bench, cfg.num_tris,
+                        cfg.num_pts);
+    vout.flush();
+
+    const BenchResult r = RunBench(cfg, mesh, icp_max_its, max_exhaustive_pairs, pnp_settings,
+                                   num_warmup, num_iters);
+
+    PutResultJSON(r, &results_json.add_bench());
+
+    if (r.ok)
+    {
+      vout << fmt::format("{:12.3f} ms, {:12.4g} items/s", r.timing.mean_secs * 1000.0,
+                          r.items_per_sec)
+           << std::endl;
+    }
+    else
+    {
+      vout << "ERROR: " << r.err_msg << std::endl;
+    }
+  };
+
+  bool any_sur_bench = false;
+  for (const auto& bench : benches)
+  {
+    any_sur_bench = any_sur_bench || (bench != "ransac-pnp");
+  }
+
+  // Each surface is created once and used by every benchmark
+  for (const size_type num_tris_req : (any_sur_bench ? num_tris_lst : std::vector<size_type>()))
+  {
+    vout << "creating surface with approx. " << num_tris_req << " triangles..." << std::endl;
+    const TriMesh mesh = MakeSyntheticSurface(num_tris_req);
+
+    for (const auto& bench : benches)
+    {
+      if (bench == "ransac-pnp")
+      {
+        continue;
+      }
+
+      BenchConfig cfg;
+      cfg.bench    = bench;
+      cfg.num_tris = mesh.faces.size();
+
+      if (bench == "kdtree-build")
+      {
+        cfg.num_pts = 0;
+
+        run_and_report(cfg, &mesh);
+      }
+      else
+      {
+        for (const size_type num_pts : num_pts_lst)
+        {
+          cfg.num_pts = num_pts;
+
+          run_and_report(cfg, &mesh);
+        }
+      }
+    }
+  }
+
+  for (const auto& bench : benches)
+  {
+    if (bench == "ransac-pnp")
+    {
+      for (const size_type num_pts : pnp_num_pts)
+      {
+        BenchConfig cfg;
+        cfg.bench    = bench;
+        cfg.num_tris = 0;
+        cfg.num_pts  = num_pts;
+
+        run_and_report(cfg, nullptr);
+      }
+    }
+  }
+
+  const std::string dst_path = po.pos_args().empty() ? std::string() : po.pos_args()[0];
+
+  if (!dst_path.empty())
+  {
+    vout << "writing results to: " << dst_path << std::endl;
+  }
+
+  results_json.write(dst_path);
+
+  vout << "exiting..." << std::endl;
+
+  return kEXIT_VAL_SUCCESS;
+}
@@ -138,6 +138,10 @@ int main(int argc, char* argv[])
          "Number of photons to use when adding Poisson noise.")
     << ProgOpts::uint32(2000);
 
+  po.add("seed", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32, "seed",
+         "Seed for sampling the views and the Poisson noise, so that the same datasets may be "
+         "recreated. When not provided, a random seed is used.");
+
   po.add_backend_flags();
 
   try
@@ -200,6 +204,8 @@ int main(int argc, char* argv[])
 
   const size_type num_photons = po.get("num-photons").as_uint32();
 
+  const bool has_seed = po.has("seed");
+
   //////////////////////////////////////////////////////////////////////////////
   // Read in input intensity volume
   
@@ -207,7 +213,7 @@ int main(int argc, char* argv[])
   auto src_intens = ReadITKImageFromDisk<RayCaster::Vol>(src_intens_path);
 
   vout << "converting HU --> Lin. Att." << std::endl;
-  src_intens = HUToLinAtt(src_intens.GetPointer(), -130);
+  HUToLinAttInPlace(src_intens.GetPointer(), -130);
 
   //////////////////////////////////////////////////////////////////////////////
   // Get the landmarks
@@ -258,7 +264,20 @@ int main(int argc, char* argv[])
   rc->allocate_resources();
 
   std::mt19937 rng_eng;
-  SeedRNGEngWithRandDev(&rng_eng);
+
+  if (has_seed)
+  {
+    rng_eng.seed(po.get("seed").as_uint32());
+  }
+  else
+  {
+    SeedRNGEngWithRandDev(&rng_eng);
+  }
+
+  // seeds the counter-based generator used for the noise
+  const std::uint64_t noise_seed = has_seed ? po.get("seed").as_uint32() :
+                                     static_cast<std::uint64_t>(rng_eng()) |
+                                       (static_cast<std::uint64_t>(rng_eng()) << 32);
 
   //std::uniform_real_distribution<CoordScalar> intersect_pt_dist(0.65,0.8);
 
@@ -372,7 +391,9 @@ int main(int argc, char* argv[])
       auto& dst_pd = proj_data[proj_idx];
       
       dst_pd.cam = cams[proj_idx];
-      dst_pd.img = SamplePoissonProjFromAttProj(rc->proj(proj_idx).GetPointer(), num_photons);
+      dst_pd.img = SamplePoissonProjFromAttProj(rc->proj(proj_idx).GetPointer(), num_photons,
+                                                noise_seed,
+                                                static_cast<std::uint32_t>((collect_idx * 3) + proj_idx));
       
       dst_pd.rot_to_pat_up = is_left ? ProjDataRotToPatUp::kZERO : ProjDataRotToPatUp::kONE_EIGHTY;
 
@@ -22,6 +22,8 @@
  * SOFTWARE.
  */
 
+#include <memory>
+
 #include <fmt/format.h>
 
 #include "xregProgOptUtils.h"
@@ -33,10 +35,14 @@
 #include "xregH5ProjDataIO.h"
 #include "xregRayCastProgOpts.h"
 #include "xregRayCastInterface.h"
+#include "xregRayCastMultiDevOCL.h"
+#include "xregOpenCLSys.h"
+#include "xregStringUtils.h"
 #include "xregImgSimMetric2DPatchCommon.h"
 #include "xregImgSimMetric2DGradImgParamInterface.h"
 #include "xregImgSimMetric2DProgOpts.h"
 #include "xregHUToLinAtt.h"
+#include "xregAttVolCache.h"
 #include "xregProjPreProc.h"
 #include "xregPnPUtils.h"
 #include "xregMultiObjMultiLevel2D3DRegi.h"
@@ -86,6 +92,28 @@ int main(int argc, char* argv[])
          "Read landmarks in RAS coordinates instead of LPS.")
     << false;
 
+  po.add("vol-cache-dir", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "vol-cache-dir",
+         "Directory used to cache the preprocessed (converted to linear attenuation, masked, "
+         "and cropped) volumes. The cache is keyed by the contents of the input volume and "
+         "label map files and the preprocessing parameters, so subsequent runs with the same "
+         "inputs skip the preprocessing. Empty -> no caching.")
+    << "";
+
+  po.add("vol-cache-half", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_TRUE, "vol-cache-half",
+         "Store volumes written to the cache using half precision, which reduces their size "
+         "and loading time at a loss of precision.")
+    << false;
+
+  po.add("ocl-dev-per-view", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "ocl-dev-per-view",
+         "Comma separated list of OpenCL device IDs, so that the DRRs of each view are computed "
+         "on a separate device, e.g. the first device computes the DRRs of the first view. "
+         "\"all-gpus\" uses every OpenCL GPU on this node. When fewer devices than views are "
+         "provided, contiguous groups of views are assigned to each device. All views are still "
+         "computed with a single call to the ray caster, with the devices running concurrently. "
+         "This overrides the backend used for ray casting, but not for the similarity metrics. "
+         "Empty -> the DRRs of all views are computed using the backend flags.")
+    << "";
+
   po.add_backend_flags();
 
   try
@@ -108,6 +136,46 @@ int main(int argc, char* argv[])
 
   const bool verbose = po.get("verbose");
   std::ostream& vout = po.vout();
+
+  const std::string ocl_dev_per_view_str = po.get("ocl-dev-per-view");
+
+  StrList ocl_dev_per_view_ids;
+  
+  if (ocl_dev_per_view_str == "all-gpus")
+  {
+    ocl_dev_per_view_ids = DevIDStrs(false);
+
+    if (ocl_dev_per_view_ids.empty())
+    {
+      std::cerr << "ERROR: no OpenCL GPUs found!" << std::endl;
+      return kEXIT_VAL_BAD_USE;
+    }
+  }
+  else if (!ocl_dev_per_view_str.empty())
+  {
+    ocl_dev_per_view_ids = StringSplit(ocl_dev_per_view_str, ",");
+  }
+
+  // All views are computed in a single batch by each level's ray caster; when
+  // requested, each view is assigned to a separate device.
+  auto make_ray_caster = [&po,&ocl_dev_per_view_ids] ()
+  {
+    std::shared_ptr<RayCaster> rc;
+
+    if (ocl_dev_per_view_ids.empty())
+    {
+      rc = LineIntRayCasterFromProgOpts(po);
+    }
+    else
+    {
+      auto multi_dev_rc = LineIntRayCasterMultiDevOCL(ocl_dev_per_view_ids);
+      multi_dev_rc->set_assign_devs_by_camera_model(true);
+
+      rc = multi_dev_rc;
+    }
+
+    return rc;
+  };
   
   const std::string ct_path                 = po.pos_args()[0];
   const std::string seg_path                = po.pos_args()[1];
@@ -127,6 +195,10 @@ int main(int argc, char* argv[])
 
   const bool lands_ras = po.get("lands-ras");
 
+  const std::string vol_cache_dir = po.get("vol-cache-dir");
+
+  const bool vol_cache_half = po.get("vol-cache-half");
+
   const size_type pnp_proj_idx = po.get("pnp-proj-idx").as_uint32();
 
   if ((side_str != "left") && (side_str != "right"))
@@ -158,12 +230,6 @@ int main(int argc, char* argv[])
   //////////////////////////////////////////////////////////////////////////////
   // Read in input intensity volume
   
-  vout << "reading in source intensity volume..." << std::endl;
-  auto ct_intens = ReadITKImageFromDisk<RayCaster::Vol>(ct_path);
-
-  vout << "converting HU --> Lin. Att." << std::endl;
-  ct_intens = HUToLinAtt(ct_intens.GetPointer());
-
   vout << "reading label map..." << std::endl;
   auto ct_labels = ReadITKImageFromDisk<itk::Image<unsigned char,3>>(seg_path);
  
@@ -182,8 +248,47 @@ int main(int argc, char* argv[])
        << "\n    Frag: " << static_cast<int>(frag_label)
        << std::endl;
 
-  auto ct_vols = MakeVolListFromVolAndLabels(ct_intens.GetPointer(), ct_labels.GetPointer(),
-                                             { pelvis_label, femur_label, frag_label }, 0);
+  AttVolCache::VolList ct_vols;
+
+  std::unique_ptr<AttVolCache> vol_cache;
+  std::string vol_cache_key;
+
+  if (!vol_cache_dir.empty())
+  {
+    vol_cache.reset(new AttVolCache(vol_cache_dir));
+    vol_cache->half_precision = vol_cache_half;
+
+    vout << "computing volume cache key..." << std::endl;
+    vol_cache_key = MakeAttVolCacheKey({ ct_path, seg_path },
+                                       fmt::format("hu-to-lin-att;labels={},{},{}",
+                                                   static_cast<int>(pelvis_label),
+                                                   static_cast<int>(femur_label),
+                                                   static_cast<int>(frag_label)));
+
+    if (vol_cache->read(vol_cache_key, &ct_vols))
+    {
+      vout << "  using cached volumes: " << vol_cache->entry_path(vol_cache_key) << std::endl;
+      xregASSERT(ct_vols.size() == 3);
+    }
+  }
+
+  if (ct_vols.empty())
+  {
+    vout << "reading in source intensity volume..." << std::endl;
+    auto ct_intens = ReadITKImageFromDisk<RayCaster::Vol>(ct_path);
+
+    vout << "converting HU --> Lin. Att." << std::endl;
+    HUToLinAttInPlace(ct_intens.GetPointer());
+
+    ct_vols = MakeVolListFromVolAndLabels(ct_intens.GetPointer(), ct_labels.GetPointer(),
+                                          { pelvis_label, femur_label, frag_label }, 0);
+
+    if (vol_cache)
+    {
+      vout << "writing preprocessed volumes to cache..." << std::endl;
+      vol_cache->write(vol_cache_key, ct_vols);
+    }
+  }
 
   ProjPreProc proj_preproc;
     
@@ -249,7 +354,7 @@ int main(int argc, char* argv[])
     lvl.ds_factor = 0.125;
     
     vout << "    setting up ray caster..." << std::endl;
-    lvl.ray_caster = LineIntRayCasterFromProgOpts(po);
+    lvl.ray_caster = make_ray_caster();
     
     vout << "    setting up sim metrics..." << std::endl;
     lvl.sim_metrics.reserve(num_projs);
@@ -396,7 +501,7 @@ int main(int argc, char* argv[])
     lvl.ds_factor = 0.25;
     
     vout << "    setting up ray caster..." << std::endl;
-    lvl.ray_caster = LineIntRayCasterFromProgOpts(po);
+    lvl.ray_caster = make_ray_caster();
     
     vout << "    setting up sim metrics..." << std::endl;
     lvl.sim_metrics.reserve(num_projs);
@@ -0,0 +1,1135 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020-2022 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <memory>
+
+#include <fmt/format.h>
+
+#include <boost/compute/algorithm/copy.hpp>
+
+// xreg
+#include "xregProgOptUtils.h"
+#include "xregLandmarkFiles.h"
+#include "xregITKIOUtils.h"
+#include "xregHipSegUtils.h"
+#include "xregLandmarkMapUtils.h"
+#include "xregAnatCoordFrames.h"
+#include "xregStringUtils.h"
+#include "xregLabelWarping.h"
+#include "xregPAOVolAfterRepo.h"
+#include "xregMetalObjSampling.h"
+#include "xregRayCastNaiveMetalObjs.h"
+#include "xregCIOSFusionDICOM.h"
+#include "xregSampleUtils.h"
+#include "xregSampleUniformUnitVecs.h"
+#include "xregRotUtils.h"
+#include "xregRigidUtils.h"
+#include "xregPerspectiveXform.h"
+#include "xregHDF5.h"
+#include "xregH5CamModelIO.h"
+#include "xregRayCastProgOpts.h"
+#include "xregRayCastInterface.h"
+#include "xregRayCastSyncBuf.h"
+#include "xregHUToLinAtt.h"
+#include "xregImageAddPoissonNoise.h"
+#include "xregImageAddPoissonNoiseOCL.h"
+#include "xregBackgroundTaskQueue.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+/// \brief The state of a single dataset element as it moves through the
+///        stages of the pipeline.
+struct FragMoveSample
+{
+  size_type sample_idx = 0;
+
+  // fragment (+ femur) and femur only movements, w.r.t. the APP
+  FrameTransform frag_xform;
+  FrameTransform femur_xform;
+
+  UpdateVolAfterRepos::VolScalar replace_val = 0;
+
+  Pt3List obj_starts;
+  Pt3List obj_ends;
+
+  // only used when the objects are ray cast analytically
+  NaiveMetalObjs metal_objs;
+
+  std::vector<CameraModel> cams;
+
+  FrameTransform gt_cam_wrt_vol;
+
+  // linear attenuation volume, released after ray casting
+  UpdateVolAfterRepos::VolPtr vol;
+
+  // noisy line integrals of each view, stored contiguously
+  std::vector<float> projs;
+};
+
+using FragMoveSamplePtr = std::shared_ptr<FragMoveSample>;
+
+void AppendRowMajorXform(const FrameTransform& xform, std::vector<float>* dst)
+{
+  const size_type off = dst->size();
+
+  dst->resize(off + 16);
+
+  Eigen::Map<Eigen::Matrix<float,4,4,Eigen::RowMajor>> dst_mat(&(*dst)[off]);
+
+  dst_mat = xform.matrix().cast<float>();
+}
+
+}  // un-named
+
+int main(int argc, char* argv[])
+{
+  using namespace xreg;
+
+  constexpr int kEXIT_VAL_SUCCESS = 0;
+  constexpr int kEXIT_VAL_BAD_USE = 1;
+
+  // First, set up the program options
+
+  ProgOpts po;
+
+  xregPROG_OPTS_SET_COMPILE_DATE(po);
+
+  po.set_help("Creates a dataset of simulated fluoroscopy after PAO fragment adjustments, "
+              "within a single process. This combines the processing of the tools for "
+              "sampling fragment movements, updating the CT volume after the movements, "
+              "inserting screws and K-wires, and creating synthetic fluoroscopy. "
+              "The input volume and segmentations are read, and the landmarks processed, once. "
+              "Each dataset element is passed through a pipeline of stages: the movements, "
+              "insertion points and views are sampled in the main thread, volumes are updated "
+              "by CPU worker threads, projections are ray cast and have Poisson noise added "
+              "by the selected ray casting backend (e.g. a GPU), and the results are written "
+              "in a background thread. The stages are connected using bounded queues, so that "
+              "only a limited number of volumes and projections are stored in memory. "
+              "Fragment and femur movements are sampled using normal distributions. "
+              "The views of each element consist of an approximate AP view and, optionally, "
+              "up to two additional views at orbital rotations. "
+              "All elements are streamed into a single, chunked, HDF5 file. The noisy line "
+              "integrals of each view are stored in a row of the \"projs\" dataset, e.g. "
+              "with num. rows * num. cols. columns, the poses of each view are stored in "
+              "\"cam-extrins\" and \"gt-cam-wrt-vol\", and the fragment and femur movements "
+              "are stored in \"frag-xforms\" and \"femur-xforms\" as row-major 4x4 matrices. "
+              "The element index of each row is stored in \"sample-inds\", since elements may "
+              "be completed out of order when multiple volume workers are used. The camera "
+              "model of the first view is stored in the \"cam\" group.");
+
+  po.set_arg_usage("<Input CT vol.> <Input PAO Segmentation> <APP Landmarks> <side> "
+                   "<insertion surf. labels> <num samples> <Output HDF5 Dataset>");
+  po.set_min_num_pos_args(7);
+
+  po.add("lands-ras", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_TRUE, "lands-ras",
+         "Read landmarks in RAS coordinates instead of LPS.")
+    << false;
+
+  po.add("pelvis-label", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32, "pelvis-label",
+         "The value used to indicate the pelvis in the input segmentation; if not "
+         "provided, then the smallest positive value in the segmentation is used.");
+
+  po.add("frag-label", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32, "frag-label",
+         "The value used to indicate the fragment in the input segmentation; if not "
+         "provided, then the second largest positive value in the segmentation is used.");
+
+  po.add("cut-label", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32, "cut-label",
+         "The value used to indicate the cut in the input segmentation; if not "
+         "provided, then the largest positive value in the input segmentation is used.");
+
+  po.add("femur-label", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32, "femur-label",
+         "The value used to indicate the ipsilateral femur in the input segmentation; if not "
+         "provided, then the value in the segmentation located at the femoral head landmark is used.");
+
+  po.add("contra-femur-label", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32, "contra-femur-label",
+         "The label of the the non-operative side (contra-lateral) femur. "
+         "If not provided, the contra-lateral femur will not be used for collision checking.");
+
+  po.add("no-collision-check", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_TRUE,
+         "no-collision-check",
+         "Indicates that no collision checking will be performed when sampling "
+         "repositioning.")
+    << false;
+
+  po.add("frag-rot-mean-x", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "frag-rot-mean-x",
+         "The mean rotation angle, in degrees, to be applied to the fragment/femur about the X axis in the APP (R->L).")
+    << 10.0;
+
+  po.add("frag-rot-std-x", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "frag-rot-std-x",
+         "The rotation angle standard deviation, in degrees, of the rotation applied to the fragment/femur about the X axis in the APP (R->L).")
+    << 5.0;
+
+  po.add("frag-rot-mean-y", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "frag-rot-mean-y",
+         "The mean rotation angle, in degrees, to be applied to the fragment/femur about the Y axis in the APP (I->S).")
+    << 0.0;
+
+  po.add("frag-rot-std-y", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "frag-rot-std-y",
+         "The rotation angle standard deviation, in degrees, of the rotation applied to the fragment/femur about the Y axis in the APP (I->S).")
+    << 5.0;
+
+  po.add("frag-rot-mean-z", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "frag-rot-mean-z",
+         "The mean rotation angle, in degrees, to be applied to the fragment/femur about the Z axis in the APP (P->A).")
+    << 10.0;
+
+  po.add("frag-rot-std-z", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "frag-rot-std-z",
+         "The rotation angle standard deviation, in degrees, of the rotation applied to the fragment/femur about the Z axis in the APP (P->A).")
+    << 5.0;
+
+  po.add("femur-rot-mean-x", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "femur-rot-mean-x",
+         "The mean rotation angle about the APP X axis (R->L), in degrees, to be applied to the femur after moving the fragment.")
+    << 0.0;
+
+  po.add("femur-rot-std-x", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "femur-rot-std-x",
+         "The rotation angle standard deviation about the APP X axis (R->L), in degrees, of the rotation applied to the femur after moving the fragment.")
+    << 10.0;
+
+  po.add("femur-rot-mean-y", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "femur-rot-mean-y",
+         "The mean rotation angle about the APP Y axis (I->S), in degrees, to be applied to the femur after moving the fragment.")
+    << 0.0;
+
+  po.add("femur-rot-std-y", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "femur-rot-std-y",
+         "The rotation angle standard deviation about the APP Y axis (I->S), in degrees, of the rotation applied to the femur after moving the fragment.")
+    << 5.0;
+
+  po.add("femur-rot-mean-z", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "femur-rot-mean-z",
+         "The mean rotation angle about the APP Z axis (P->A), in degrees, to be applied to the femur after moving the fragment.")
+    << 0.0;
+
+  po.add("femur-rot-std-z", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "femur-rot-std-z",
+         "The rotation angle standard deviation about the APP Z axis (P->A), in degrees, of the rotation applied to the femur after moving the fragment.")
+    << 1.0;
+
+  po.add("trans-mean-x", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "trans-mean-x",
+         "The mean amount of translation to be applied to the fragment/femur in the APP X-Axis (Right->Right), this "
+         "will be negated according to the side argument, so that the fragment is medialized.")
+    << 2.5;
+
+  po.add("trans-std-x", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "trans-std-x",
+         "The standard deviation of translation in the APP X-Axis (Left->Right).")
+    << 5.0;
+
+  po.add("trans-mean-y", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "trans-mean-y",
+         "The mean amount of translation to be applied to the fragment/femur in the APP Y-Axis (Inferior->Superior).")
+    << -2.0;
+
+  po.add("trans-std-y", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "trans-std-y",
+         "The standard deviation of translation in the APP Y-Axis (Inferior->Superior).")
+    << 2.0;
+
+  po.add("trans-mean-z", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "trans-mean-z",
+         "The mean amount of translation to be applied to the fragment/femur in the APP Z-Axis (Posterior->Anterior).")
+    << 2.0;
+
+  po.add("trans-std-z", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "trans-std-z",
+         "The standard deviation of translation in the APP Z-Axis (Posterior->Anterior).")
+    << 3.0;
+
+  po.add("frag-rot-for-femur", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_TRUE, "frag-rot-for-femur",
+         "Use the fragment\'s rotation and translation on the femur, otherwise a factor is included in the femur "
+         "transform to cancel out the fragment\'s rotational component; the translation component is retained.")
+    << false;
+
+  po.add("replace-val-mean-lower", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "replace-val-mean-lower",
+         "Lower bound of the uniform distribution used to sample the mean of the tissue replacement distribution.")
+    << 35.0;
+
+  po.add("replace-val-mean-upper", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "replace-val-mean-upper",
+         "Upper bound of the uniform distribution used to sample the mean of the tissue replacement distribution.")
+    << 55.0;
+
+  po.add("replace-val-std", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "replace-val-std",
+         "Standard deviation of the tissue replacement distribution. A value <= 0 indicates that "
+         "a constant value will be used.")
+    << 20.0;
+
+  po.add("p-wire", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "p-wire",
+         "The probability of inserting a k-wire; probability of screw is 1 minus this.")
+    << 1.0;
+
+  po.add("p-two", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "p-two",
+         "The probability of inserting two objects; probability of three is 1 minus this.")
+    << 1.0;
+
+  po.add("super-sample", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "super-sample",
+         "Up-sampling (super-sampling) factor used for inserting objects into volume. "
+         "This drastically affects the amount of runtime memory required, which is multiplied "
+         "by the number of volume worker threads. "
+         "A value of 1 indicates no up-sampling will be used.")
+    << 4.0;
+
+  po.add("analytic-metal", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_TRUE, "analytic-metal",
+         "Add the screws and K-wires to the line integrals by intersecting each ray with the "
+         "object models, instead of inserting them into each volume. This avoids the volume copy "
+         "and super-sampling of every object, and makes the object shapes and attenuations "
+         "reproducible with --seed. The attenuation of the tissue displaced by each object is "
+         "ignored.")
+    << false;
+
+  po.add("num-views", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32, "num-views",
+         "The number of views simulated for each element, in [1,3]. The first view is an "
+         "approximate AP view and the remaining views are at orbital rotations.")
+    << ProgOpts::uint32(3);
+
+  po.add("ds-factor", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "ds-factor",
+         "Downsampling factor applied to the detector of the simulated views, e.g. 0.25 "
+         "yields images with 1/4 of the number of rows and columns.")
+    << 1.0;
+
+  po.add("lr-off", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "lr-off",
+         "Absolute value of the left/right (medial) offset (in mm) applied to bring more of the pelvis "
+         "into the field of view.")
+    << 25.0;
+
+  po.add("is-off", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "is-off",
+         "Value of the inferior/superior offset (in mm) applied to bring more of the pelvis "
+         "into the field of view.")
+    << 35.0;
+
+  po.add("mean-orbit-rot-1", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "mean-orbit-rot-1",
+         "Mean orbital rotation angle applied from the first view in order to obtain the second view. Degrees.")
+    << -10.0;
+
+  po.add("std-orbit-rot-1", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "std-orbit-rot-1",
+         "Standard deviation of the orbital rotation angle applied from the first view "
+         "in order to obtain the second view. Degrees.")
+    << 3.0;
+
+  po.add("mean-orbit-rot-2", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "mean-orbit-rot-2",
+         "Mean orbital rotation angle applied from the first view in order to obtain the third view. Degrees.")
+    << 15.0;
+
+  po.add("std-orbit-rot-2", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "std-orbit-rot-2",
+         "Standard deviation of the orbital rotation angle applied from the first view "
+         "in order to obtain the third view. Degrees.")
+    << 3.0;
+
+  po.add("orbit-rot-perturb", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "orbit-rot-perturb",
+         "Controls the amount of non-orbital rotation applied to views 2 and 3. The rotation axis is "
+         "sampled uniformly and the angle is sampled uniformly from U(-X,+X), where X is the value "
+         "specified here. Degrees.")
+    << 2.0;
+
+  po.add("orbit-trans-perturb", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "orbit-trans-perturb",
+         "Controls the amount of translation perturbation applied to the orbital rotations of views 2 and 3. "
+         "The direction axis is sampled uniformly and the magnitude is sampled uniformly from U(-Y,+Y), "
+         "where Y is the value specified here (in mm).")
+    << 2.0;
+
+  po.add("ap-src-det-ratio", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "ap-src-det-ratio",
+         "The approximate positioning parameter of the ipsilateral femoral head along the source-to-detector "
+         "direction for the first (approximately) AP view. This should lie in [0,1], with 0 at the source "
+         "and 1 at the detector.")
+    << 0.8;
+
+  po.add("vol-rot", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "vol-rot",
+         "Controls the amount of rotation applied to the initial pose of the volume with respect to the "
+         "views. The rotation axis is sampled uniformly and the angle is uniformly sampled from "
+         "U(-Z,+Z), where Z is the value specified here. Degrees. This is applied in the APP frame.")
+    << 10.0;
+
+  po.add("vol-trans", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "vol-trans",
+         "Controls the amount of translation applied to the initial pose of the volume with respect to the "
+         "views. The direction is sampled uniformly and the magnitude is uniformly sampled from "
+         "U(0,W), where W is the value specified here (in mm). This is applied in the APP frame.")
+    << 10.0;
+
+  po.add("num-photons", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32, "num-photons",
+         "Number of photons to use when adding Poisson noise.")
+    << ProgOpts::uint32(2000);
+
+  po.add("seed", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32, "seed",
+         "Seed for sampling the movements, object insertion points, views and the Poisson noise. "
+         "When not provided, a random seed is used. The tissue replacement intensities and the "
+         "shapes of the inserted objects are always randomly seeded.");
+
+  po.add("batch-size", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32, "batch-size",
+         "The number of fragment and femur movements sampled at a time.")
+    << ProgOpts::uint32(64);
+
+  po.add("vol-workers", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32, "vol-workers",
+         "The number of threads used to concurrently update volumes and insert objects. "
+         "Each of these operations is also multi-threaded internally, so a small number "
+         "is typically sufficient to keep the ray caster busy.")
+    << ProgOpts::uint32(2);
+
+  po.add("queue-len", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32, "queue-len",
+         "The maximum number of elements waiting for each of the volume and ray casting stages. "
+         "This bounds the number of volumes stored in memory.")
+    << ProgOpts::uint32(2);
+
+  po.add("max-write-mb", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32, "max-write-mb",
+         "The maximum amount of projection data, in MB, waiting to be written to disk.")
+    << ProgOpts::uint32(1024);
+
+  po.add("compress", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_TRUE, "compress",
+         "Compress the projections written to disk. This reduces the file size, but may "
+         "cause the writing stage to limit throughput.")
+    << false;
+
+  po.add_backend_flags();
+
+  try
+  {
+    po.parse(argc, argv);
+  }
+  catch (const ProgOpts::Exception& e)
+  {
+    std::cerr << "Error parsing command line arguments: " << e.what() << std::endl;
+    po.print_usage(std::cerr);
+    return kEXIT_VAL_BAD_USE;
+  }
+
+  if (po.help_set())
+  {
+    po.print_usage(std::cout);
+    po.print_help(std::cout);
+    return kEXIT_VAL_SUCCESS;
+  }
+
+  std::ostream& vout = po.vout();
+
+  const std::string src_intens_path   = po.pos_args()[0];
+  const std::string src_label_path    = po.pos_args()[1];
+  const std::string app_fcsv_path     = po.pos_args()[2];
+  const std::string side_str          = po.pos_args()[3];
+  const std::string insert_label_path = po.pos_args()[4];
+  const size_type   num_samples       = StringCast<size_type>(po.pos_args()[5]);
+  const std::string dst_path          = po.pos_args()[6];
+
+  const bool is_left = side_str == "left";
+
+  if (!is_left && (side_str != "right"))
+  {
+    std::cerr << "ERROR: Invalid side string: " << side_str << std::endl;
+    return kEXIT_VAL_BAD_USE;
+  }
+
+  vout << "Ipsilateral side is the " << side_str << " side." << std::endl;
+
+  const bool lands_ras = po.get("lands-ras");
+
+  const bool no_check_collisions = po.get("no-collision-check");
+
+  const bool use_frag_rot_for_femur = po.get("frag-rot-for-femur");
+
+  const double replace_val_mean_lower = po.get("replace-val-mean-lower");
+  const double replace_val_mean_upper = po.get("replace-val-mean-upper");
+  const double replace_val_std_dev    = po.get("replace-val-std");
+
+  const bool replace_val_mean_const = std::abs(replace_val_mean_upper - replace_val_mean_lower) < 1.0e-8;
+
+  if (!replace_val_mean_const && ((replace_val_mean_upper - replace_val_mean_lower) < -1.0e-8))
+  {
+    std::cerr << "ERROR: empty range passed for replacement value mean distribution!" << std::endl;
+    return kEXIT_VAL_BAD_USE;
+  }
+
+  const double p_kwire = po.get("p-wire");
+  const double p_two   = po.get("p-two");
+
+  const double super_sample_factor = po.get("super-sample");
+
+  const bool analytic_metal = po.get("analytic-metal");
+
+  const size_type num_views = po.get("num-views").as_uint32();
+
+  if ((num_views < 1) || (num_views > 3))
+  {
+    std::cerr << "ERROR: number of views must be in [1,3]!" << std::endl;
+    return kEXIT_VAL_BAD_USE;
+  }
+
+  const double ds_factor = po.get("ds-factor");
+
+  const double lr_off = po.get("lr-off");
+  const double is_off = po.get("is-off");
+
+  const double mean_orbit_rot_1_deg = po.get("mean-orbit-rot-1");
+  const double std_orbit_rot_1_deg  = po.get("std-orbit-rot-1");
+  const double mean_orbit_rot_2_deg = po.get("mean-orbit-rot-2");
+  const double std_orbit_rot_2_deg  = po.get("std-orbit-rot-2");
+
+  const double orbit_rot_small_perturb_deg = po.get("orbit-rot-perturb");
+  const double orbit_trans_small_perturb = po.get("orbit-trans-perturb");
+
+  const double ap_src_det_ratio = po.get("ap-src-det-ratio");
+
+  const double vol_rot_deg = po.get("vol-rot");
+  const double vol_trans   = po.get("vol-trans");
+
+  const size_type num_photons = po.get("num-photons").as_uint32();
+
+  const bool has_seed = po.has("seed");
+
+  const size_type batch_size = std::max(size_type(1),
+                                        static_cast<size_type>(po.get("batch-size").as_uint32()));
+
+  const size_type num_vol_workers = std::max(size_type(1),
+                                             static_cast<size_type>(po.get("vol-workers").as_uint32()));
+
+  const size_type queue_len = std::max(size_type(1),
+                                       static_cast<size_type>(po.get("queue-len").as_uint32()));
+
+  const size_type max_write_bytes = static_cast<size_type>(po.get("max-write-mb").as_uint32()) * 1024 * 1024;
+
+  const bool compress = po.get("compress");
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Read in the inputs - this is only done once for all samples
+
+  vout << "reading in source intensity volume..." << std::endl;
+  auto src_intens = ReadITKImageFromDisk<UpdateVolAfterRepos::Vol>(src_intens_path);
+
+  vout << "reading in source labels/segmentation..." << std::endl;
+  auto cuts_seg = ReadITKImageFromDisk<UpdateVolAfterRepos::LabelVol>(src_label_path);
+
+  vout << "reading object insertion labels/segmentation..." << std::endl;
+  auto insert_labels = ReadITKImageFromDisk<PAOSampleScrewWireInsertionPts::LabelVol>(insert_label_path);
+
+  vout << "reading APP landmarks..." << std::endl;
+  const LandMap3 app_pts = ReadLandmarksFileNamePtMap(app_fcsv_path, !lands_ras);
+
+  vout << "APP Landmarks:\n";
+  PrintLandmarkMap(app_pts, vout);
+
+  const Pt3 femur_pt = app_pts.find(fmt::format("FH-{}", side_str[0]))->second;
+
+  // APP with origin at the ipsilateral femoral head, fragment movements are
+  // sampled in this frame
+  const FrameTransform app_to_vol = AnteriorPelvicPlaneFromLandmarksMap(app_pts,
+                                      is_left ? kAPP_ORIGIN_LEFT_FH : kAPP_ORIGIN_RIGHT_FH);
+
+  vout << "APP to Vol:\n" << app_to_vol.matrix() << std::endl;
+
+  const FrameTransform vol_to_app = app_to_vol.inverse();
+
+  // shift the origin medial to get more of the pelvis in the FOV (x)
+  // shift the origin down a little so we can fit more of the pelvis in the FOV (y)
+  const FrameTransform view_app_to_vol = app_to_vol * EulerRotXYZTransXYZFrame(0, 0, 0,
+                                                                (is_left ? -1 : 1) * lr_off, is_off, 0);
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Determine labels of pelvis, fragment, cut and femurs
+
+  using LabelScalar = UpdateVolAfterRepos::LabelScalar;
+
+  LabelScalar pelvis_label    = 0;
+  LabelScalar frag_label      = 0;
+  LabelScalar cut_label       = 0;
+  LabelScalar femur_label     = 0;
+  LabelScalar con_femur_label = 0;
+
+  const bool need_to_find_pelvis_label = !po.has("pelvis-label");
+  if (!need_to_find_pelvis_label)
+  {
+    pelvis_label = static_cast<unsigned char>(po.get("pelvis-label").as_uint32());
+  }
+
+  const bool need_to_find_frag_label = !po.has("frag-label");
+  if (!need_to_find_frag_label)
+  {
+    frag_label = static_cast<unsigned char>(po.get("frag-label").as_uint32());
+  }
+
+  const bool need_to_find_cut_label = !po.has("cut-label");
+  if (!need_to_find_cut_label)
+  {
+    cut_label = static_cast<unsigned char>(po.get("cut-label").as_uint32());
+  }
+
+  const bool need_to_find_femur_label = !po.has("femur-label");
+  if (!need_to_find_femur_label)
+  {
+    femur_label = static_cast<unsigned char>(po.get("femur-label").as_uint32());
+  }
+
+  const bool use_con_femur_label = po.has("contra-femur-label");
+  if (use_con_femur_label)
+  {
+    con_femur_label = static_cast<unsigned char>(po.get("contra-femur-label").as_uint32());
+  }
+
+  if (need_to_find_pelvis_label || need_to_find_frag_label ||
+      need_to_find_cut_label || need_to_find_femur_label)
+  {
+    vout << "attempting to find pelvis/femur/frag/cut labels automatically..." << std::endl;
+    const auto guessed_labels = GuessPelvisFemurPAOFragLabels(cuts_seg.GetPointer(), femur_pt,
+                                                              true, true);
+
+    if (need_to_find_pelvis_label)
+    {
+      pelvis_label = std::get<0>(guessed_labels);
+    }
+
+    if (need_to_find_femur_label)
+    {
+      femur_label = std::get<1>(guessed_labels);
+    }
+
+    if (need_to_find_frag_label)
+    {
+      frag_label = std::get<2>(guessed_labels);
+    }
+
+    if (need_to_find_cut_label)
+    {
+      cut_label = std::get<3>(guessed_labels);
+    }
+  }
+
+  vout << "Labels:\n   Pelvis: " << static_cast<int>(pelvis_label)
+       << "\n     Frag: " << static_cast<int>(frag_label)
+       << "\n      Cut: " << static_cast<int>(cut_label)
+       << "\n    Femur: " << static_cast<int>(femur_label)
+       << "\n  C-Femur: " << (use_con_femur_label ? fmt::format("{}", static_cast<int>(con_femur_label)) : std::string("N/A"))
+       << std::endl;
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Setup the random sampling of movements, insertion points and views
+
+  std::mt19937 rng_eng;
+
+  if (has_seed)
+  {
+    rng_eng.seed(po.get("seed").as_uint32());
+  }
+  else
+  {
+    SeedRNGEngWithRandDev(&rng_eng);
+  }
+
+  // seeds the counter-based generator used for the noise
+  const std::uint64_t noise_seed = has_seed ? po.get("seed").as_uint32() :
+                                     static_cast<std::uint64_t>(rng_eng()) |
+                                       (static_cast<std::uint64_t>(rng_eng()) << 32);
+
+  Pt3 frag_rot_means_rad;
+  frag_rot_means_rad(0) = po.get("frag-rot-mean-x").as_double() * kDEG2RAD;
+  frag_rot_means_rad(1) = po.get("frag-rot-mean-y").as_double() * kDEG2RAD;
+  frag_rot_means_rad(2) = po.get("frag-rot-mean-z").as_double() * kDEG2RAD;
+
+  // ensure the signs of the rotations are appropriate for the current side
+  frag_rot_means_rad(0) = std::abs(frag_rot_means_rad(0));
+  frag_rot_means_rad(1) = (is_left ?  1 : -1) * std::abs(frag_rot_means_rad(1));
+  frag_rot_means_rad(2) = (is_left ? -1 :  1) * std::abs(frag_rot_means_rad(2));
+
+  Pt3 frag_rot_std_devs_rad;
+  frag_rot_std_devs_rad(0) = po.get("frag-rot-std-x").as_double() * kDEG2RAD;
+  frag_rot_std_devs_rad(1) = po.get("frag-rot-std-y").as_double() * kDEG2RAD;
+  frag_rot_std_devs_rad(2) = po.get("frag-rot-std-z").as_double() * kDEG2RAD;
+
+  Pt3 femur_rot_means_rad;
+  femur_rot_means_rad(0) = -1 * std::abs(po.get("femur-rot-mean-x").as_double() * kDEG2RAD);
+  femur_rot_means_rad(1) = po.get("femur-rot-mean-y").as_double() * kDEG2RAD;
+  femur_rot_means_rad(2) = po.get("femur-rot-mean-z").as_double() * kDEG2RAD;
+
+  Pt3 femur_rot_std_devs_rad;
+  femur_rot_std_devs_rad(0) = po.get("femur-rot-std-x").as_double() * kDEG2RAD;
+  femur_rot_std_devs_rad(1) = po.get("femur-rot-std-y").as_double() * kDEG2RAD;
+  femur_rot_std_devs_rad(2) = po.get("femur-rot-std-z").as_double() * kDEG2RAD;
+
+  Pt3 trans_means;
+  trans_means[0] = po.get("trans-mean-x").as_double();
+  trans_means[1] = po.get("trans-mean-y").as_double();
+  trans_means[2] = po.get("trans-mean-z").as_double();
+
+  // medialize the fragment - e.g. tend to move it medially, not outwards
+  trans_means[0] = (is_left ? -1 : 1) * std::abs(trans_means[0]);
+
+  Pt3 trans_stds;
+  trans_stds[0] = po.get("trans-std-x").as_double();
+  trans_stds[1] = po.get("trans-std-y").as_double();
+  trans_stds[2] = po.get("trans-std-z").as_double();
+
+  SampleValidLabelWarpsFn sample_frag_warps;
+  sample_frag_warps.rng_eng.seed(rng_eng());
+  sample_frag_warps.labels = cuts_seg.GetPointer();
+  sample_frag_warps.inter_to_vol_xform = app_to_vol;
+  sample_frag_warps.check_for_collision = !no_check_collisions;
+
+  sample_frag_warps.mov_labels.insert(frag_label);
+  sample_frag_warps.mov_labels.insert(femur_label);
+
+  sample_frag_warps.fixed_labels.insert(pelvis_label);
+
+  {
+    auto* sample_params = new SampleValidLabelWarpsFn::SampleRepoParamsAllNormal;
+
+    sample_params->rot_mean    = frag_rot_means_rad;
+    sample_params->rot_std_dev = frag_rot_std_devs_rad;
+
+    sample_params->trans_mean    = trans_means;
+    sample_params->trans_std_dev = trans_stds;
+
+    sample_frag_warps.param_sampler.reset(sample_params);
+  }
+
+  // As in the fragment movement sampling tool, the femur is checked for
+  // collisions against the fragment in its original position.
+  SampleValidLabelWarpsFn sample_femur_warps;
+  sample_femur_warps.rng_eng.seed(rng_eng());
+  sample_femur_warps.labels = cuts_seg.GetPointer();
+  sample_femur_warps.inter_to_vol_xform = app_to_vol;
+  sample_femur_warps.check_for_collision = !no_check_collisions;
+
+  sample_femur_warps.mov_labels.insert(femur_label);
+
+  sample_femur_warps.fixed_labels.insert(frag_label);
+  sample_femur_warps.fixed_labels.insert(pelvis_label);
+
+  {
+    auto* sample_params = new SampleValidLabelWarpsFn::SampleRepoParamsAllNormal;
+
+    sample_params->rot_mean    = femur_rot_means_rad;
+    sample_params->rot_std_dev = femur_rot_std_devs_rad;
+
+    sample_params->trans_mean.setZero();
+    sample_params->trans_std_dev.setZero();
+
+    sample_femur_warps.param_sampler.reset(sample_params);
+  }
+
+  if (use_con_femur_label)
+  {
+    sample_frag_warps.fixed_labels.insert(con_femur_label);
+    sample_femur_warps.fixed_labels.insert(con_femur_label);
+  }
+
+  vout << "setting up object insertion start/end sampler..." << std::endl;
+  PAOSampleScrewWireInsertionPts sample_insertion_pts;
+  sample_insertion_pts.prob_two_objs = p_two;
+  sample_insertion_pts.cut_seg = cuts_seg;
+  sample_insertion_pts.insert_labels = insert_labels;
+  sample_insertion_pts.app_to_vol = app_to_vol;
+  sample_insertion_pts.femur_pt_wrt_vol = femur_pt;
+  sample_insertion_pts.init();
+  sample_insertion_pts.rng_eng.seed(rng_eng());
+
+  // only used when the objects are ray cast analytically, otherwise the
+  // objects are created by each volume worker
+  CreateRandScrew create_rand_screw;
+  create_rand_screw.rng_eng.seed(rng_eng());
+
+  CreateRandKWire create_rand_kwire;
+  create_rand_kwire.rng_eng.seed(rng_eng());
+
+  std::uniform_real_distribution<double> replace_val_dist(replace_val_mean_lower, replace_val_mean_upper);
+
+  // for sampling random rotation axes and random translation directions
+  UniformOnUnitSphereDist unit_vec_dist(3);
+
+  // for sampling random rotation angles (in APP w/ origin at FH)
+  std::uniform_real_distribution<CoordScalar> rot_ang_dist(-vol_rot_deg * kDEG2RAD,
+                                                            vol_rot_deg * kDEG2RAD);
+
+  // for sampling random translation magnitudes (in APP)
+  std::uniform_real_distribution<CoordScalar> trans_mag_dist(0,vol_trans);
+
+  // for sampling small perturbations of change in C-Arm view, so we do not have pure
+  // orbital rotation
+  std::uniform_real_distribution<CoordScalar> carm_small_rot_ang_dist(
+                                                -orbit_rot_small_perturb_deg * kDEG2RAD,
+                                                 orbit_rot_small_perturb_deg * kDEG2RAD);
+
+  std::uniform_real_distribution<CoordScalar> carm_small_trans_mag_dist(
+                                                -orbit_trans_small_perturb, orbit_trans_small_perturb);
+
+  // these are in degrees
+  const std::array<CoordScalar,2> mean_rot_angs    = { static_cast<CoordScalar>(mean_orbit_rot_1_deg),
+                                                       static_cast<CoordScalar>(mean_orbit_rot_2_deg) };
+  const std::array<CoordScalar,2> std_dev_rot_angs = { static_cast<CoordScalar>(std_orbit_rot_1_deg),
+                                                       static_cast<CoordScalar>(std_orbit_rot_2_deg) };
+
+  CameraModel default_cam = NaiveCamModelFromCIOSFusion(MakeNaiveCIOSFusionMetaDR(), true);
+
+  if (std::abs(ds_factor - 1.0) > 1.0e-6)
+  {
+    default_cam = DownsampleCameraModel(default_cam, ds_factor);
+  }
+
+  const size_type num_pix_per_proj = default_cam.num_det_rows * default_cam.num_det_cols;
+
+  vout << "projection dimensions: " << default_cam.num_det_rows << " x "
+       << default_cam.num_det_cols << std::endl;
+
+  const FrameTransform ap_view_cam_wrt_app = CreateAPViewOfAPP(default_cam,
+                                                static_cast<CoordScalar>(ap_src_det_ratio), true, is_left);
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Setup the ray caster, resources are allocated once the first volume is available
+
+  vout << "setting up ray caster..." << std::endl;
+  auto rc = LineIntRayCasterFromProgOpts(po);
+
+  bool rc_allocated = false;
+
+  // indicates that the ray caster projections are stored on the device, and
+  // noise may be added without copying the line integrals to the host
+  bool rc_has_dev_buf = false;
+
+  std::unique_ptr<ImageAddPoissonNoiseOCL> noise_ocl;
+
+  RayCastAddNaiveMetalObjs add_metal_objs;
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Setup the output file and the datasets which have rows appended
+
+  vout << "creating output file..." << std::endl;
+  H5::H5File h5(dst_path, H5F_ACC_TRUNC);
+
+  WriteSingleScalarH5("num-views", num_views, &h5);
+  WriteSingleScalarH5("num-photons", num_photons, &h5);
+  WriteSingleScalarH5("proj-num-rows", default_cam.num_det_rows, &h5);
+  WriteSingleScalarH5("proj-num-cols", default_cam.num_det_cols, &h5);
+  WriteStringH5("side", side_str, &h5);
+  WriteAffineTransform4x4("app-to-vol", app_to_vol, &h5);
+
+  {
+    H5::Group cam_g = h5.createGroup("cam");
+    WriteCamModelH5(default_cam, &cam_g);
+  }
+
+  // each projection has its own chunk
+  H5::DataSet projs_ds = CreateExtendibleMatrixH5Float("projs", num_pix_per_proj, 1, &h5, compress);
+
+  // ~64 KB chunks of transforms
+  constexpr unsigned long kXFORM_CHUNK_NUM_ROWS = 1024;
+
+  H5::DataSet cam_extrins_ds = CreateExtendibleMatrixH5Float("cam-extrins", 16,
+                                                             kXFORM_CHUNK_NUM_ROWS, &h5);
+  H5::DataSet gt_cam_wrt_vol_ds = CreateExtendibleMatrixH5Float("gt-cam-wrt-vol", 16,
+                                                                kXFORM_CHUNK_NUM_ROWS, &h5);
+  H5::DataSet frag_xforms_ds = CreateExtendibleMatrixH5Float("frag-xforms", 16,
+                                                             kXFORM_CHUNK_NUM_ROWS, &h5);
+  H5::DataSet femur_xforms_ds = CreateExtendibleMatrixH5Float("femur-xforms", 16,
+                                                              kXFORM_CHUNK_NUM_ROWS, &h5);
+  H5::DataSet replace_vals_ds = CreateExtendibleMatrixH5Float("replace-vals", 1,
+                                                              kXFORM_CHUNK_NUM_ROWS * 16, &h5);
+  H5::DataSet sample_inds_ds = CreateExtendibleMatrixH5ULong("sample-inds", 1,
+                                                             kXFORM_CHUNK_NUM_ROWS * 8, &h5);
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Setup the pipeline stages. The queues are declared after all of the
+  // objects used by their tasks, so that the destructors of the queues, which
+  // wait for pending tasks, are run first. The volume stage is destroyed first,
+  // since its tasks add to the ray casting stage, which adds to the writer.
+
+  // HDF5 calls must not be made concurrently
+  BackgroundTaskQueue write_queue(1);
+  write_queue.set_max_queued_cost(max_write_bytes);
+
+  // the ray caster is only used by this thread
+  BackgroundTaskQueue rc_queue(1);
+  rc_queue.set_max_num_queued_tasks(queue_len);
+
+  BackgroundTaskQueue vol_queue(num_vol_workers);
+  vol_queue.set_max_num_queued_tasks(queue_len);
+
+  // Writes the projections and parameters of an element, called by the writer thread
+  auto write_sample = [&] (const FragMoveSamplePtr& s)
+  {
+    AppendMatrixRowsH5(s->projs.data(), num_views, &projs_ds);
+
+    std::vector<float> xforms_buf;
+    xforms_buf.reserve(16 * num_views);
+
+    for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
+    {
+      AppendRowMajorXform(s->cams[view_idx].extrins, &xforms_buf);
+    }
+
+    AppendMatrixRowsH5(xforms_buf.data(), num_views, &cam_extrins_ds);
+
+    xforms_buf.clear();
+    AppendRowMajorXform(s->gt_cam_wrt_vol, &xforms_buf);
+    AppendMatrixRowsH5(xforms_buf.data(), 1, &gt_cam_wrt_vol_ds);
+
+    xforms_buf.clear();
+    AppendRowMajorXform(s->frag_xform, &xforms_buf);
+    AppendMatrixRowsH5(xforms_buf.data(), 1, &frag_xforms_ds);
+
+    xforms_buf.clear();
+    AppendRowMajorXform(s->femur_xform, &xforms_buf);
+    AppendMatrixRowsH5(xforms_buf.data(), 1, &femur_xforms_ds);
+
+    const float replace_val = s->replace_val;
+    AppendMatrixRowsH5(&replace_val, 1, &replace_vals_ds);
+
+    const unsigned long sample_idx = s->sample_idx;
+    AppendMatrixRowsH5(&sample_idx, 1, &sample_inds_ds);
+  };
+
+  // Ray casts the views of an element and adds noise, called by the ray casting thread
+  auto ray_cast_sample = [&] (const FragMoveSamplePtr& s)
+  {
+    if (!rc_allocated)
+    {
+      rc->set_camera_models(s->cams);
+      rc->set_num_projs(num_views);
+      rc->set_volume(s->vol);
+      rc->allocate_resources();
+
+      try
+      {
+        // CPU ray casters provide a synchronization object without a device buffer
+        RayCastSyncOCLBuf* dev_buf = rc->to_ocl_buf();
+
+        rc_has_dev_buf = dev_buf && dev_buf->ocl_buf_valid();
+      }
+      catch (const RayCaster::UnsupportedOperationException&)
+      {
+        rc_has_dev_buf = false;
+      }
+
+      rc_allocated = true;
+    }
+    else
+    {
+      rc->set_volume(s->vol);
+      rc->set_camera_models(s->cams);
+    }
+
+    rc->distribute_xform_among_cam_models(s->gt_cam_wrt_vol);
+
+    rc->compute();
+
+    // the volume is no longer needed
+    s->vol = nullptr;
+
+    if (analytic_metal)
+    {
+      add_metal_objs.objs = s->metal_objs;
+      add_metal_objs(rc.get());
+    }
+
+    const std::uint32_t first_img_idx = static_cast<std::uint32_t>(s->sample_idx * num_views);
+
+    s->projs.resize(num_views * num_pix_per_proj);
+
+    if (rc_has_dev_buf)
+    {
+      RayCastSyncOCLBuf* dev_buf = rc->to_ocl_buf();
+      dev_buf->sync();
+
+      if (!noise_ocl)
+      {
+        noise_ocl.reset(new ImageAddPoissonNoiseOCL(dev_buf->queue().get_context(), dev_buf->queue()));
+        noise_ocl->num_photons = num_photons;
+        noise_ocl->seed = noise_seed;
+        noise_ocl->allocate_resources();
+      }
+
+      // noise is added in-place to the ray caster's buffer, the line integrals
+      // are overwritten by the next computation anyway
+      noise_ocl->run(dev_buf->ocl_buf(), &dev_buf->ocl_buf(), num_pix_per_proj, num_views, first_img_idx);
+
+      boost::compute::copy(dev_buf->ocl_buf().begin(),
+                           dev_buf->ocl_buf().begin() + s->projs.size(),
+                           s->projs.begin(), dev_buf->queue());
+    }
+    else
+    {
+      for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
+      {
+        auto noisy_proj = AddPoissonNoiseToImage(rc->proj(view_idx).GetPointer(), num_photons,
+                                                 noise_seed,
+                                                 first_img_idx + static_cast<std::uint32_t>(view_idx));
+
+        std::copy(noisy_proj->GetBufferPointer(), noisy_proj->GetBufferPointer() + num_pix_per_proj,
+                  s->projs.begin() + (view_idx * num_pix_per_proj));
+      }
+    }
+
+    write_queue.add([s,&write_sample] () { write_sample(s); }, s->projs.size() * sizeof(float));
+  };
+
+  // Updates the volume for the movement and inserts objects, called by a volume worker
+  auto update_sample_vol = [&] (const FragMoveSamplePtr& s)
+  {
+    UpdateVolAfterRepos update_vol;
+    update_vol.src_vol = src_intens;
+    update_vol.labels_of_air = { cut_label };
+    update_vol.labels = cuts_seg;
+    update_vol.labels_dilate_rad = 0;
+    update_vol.labels_of_repo_objs = { frag_label, femur_label };
+    update_vol.repo_objs_xforms = { app_to_vol * s->frag_xform * vol_to_app,
+                                    app_to_vol * s->frag_xform * s->femur_xform * vol_to_app };
+    update_vol.default_val = s->replace_val;
+    update_vol.add_rand_to_default_val_std_dev = replace_val_std_dev;
+
+    update_vol();
+
+    if (analytic_metal)
+    {
+      // the objects are added by the ray casting stage
+      s->vol = update_vol.dst_vol;
+    }
+    else
+    {
+      AddPAOScrewKWireToVol add_objs;
+      add_objs.prob_screw = 1.0 - p_kwire;
+      add_objs.orig_vol = update_vol.dst_vol;
+      add_objs.obj_start_pts = s->obj_starts;
+      add_objs.obj_end_pts = s->obj_ends;
+      add_objs.super_sample_factor = super_sample_factor;
+
+      add_objs();
+
+      s->vol = add_objs.obj_vol;
+    }
+
+    HUToLinAttInPlace(s->vol.GetPointer(), -130);
+
+    rc_queue.add([s,&ray_cast_sample] () { ray_cast_sample(s); });
+  };
+
+  //////////////////////////////////////////////////////////////////////////////
+  // Sample the elements and feed them into the pipeline
+
+  for (size_type batch_start = 0; batch_start < num_samples; batch_start += batch_size)
+  {
+    const size_type cur_batch_size = std::min(batch_size, num_samples - batch_start);
+
+    vout << "sampling movements for elements " << batch_start << " to "
+         << (batch_start + cur_batch_size - 1) << "..." << std::endl;
+
+    sample_frag_warps.num_xforms = cur_batch_size;
+    sample_frag_warps();
+
+    sample_femur_warps.num_xforms = cur_batch_size;
+    sample_femur_warps();
+
+    vout << "  Frag+Femur Rejection Prob.: "
+         << fmt::format("{:.8f}", sample_frag_warps.rejection_prob())
+         << ", Femur Rejection Prob.: "
+         << fmt::format("{:.8f}", sample_femur_warps.rejection_prob())
+         << std::endl;
+
+    for (size_type i = 0; i < cur_batch_size; ++i)
+    {
+      auto s = std::make_shared<FragMoveSample>();
+
+      s->sample_idx = batch_start + i;
+
+      s->frag_xform = sample_frag_warps.delta_inter_xforms[i];
+
+      s->femur_xform = sample_femur_warps.delta_inter_xforms[i];
+
+      if (!use_frag_rot_for_femur)
+      {
+        // undo any rotation from the fragment
+        FrameTransform frag_trans = s->frag_xform;
+        frag_trans.matrix().block(0,0,3,3).setIdentity();
+
+        s->femur_xform = s->frag_xform.inverse() * frag_trans * s->femur_xform;
+      }
+
+      s->replace_val = static_cast<UpdateVolAfterRepos::VolScalar>(
+                            replace_val_mean_const ? replace_val_mean_upper : replace_val_dist(rng_eng));
+
+      sample_insertion_pts.run(s->frag_xform);
+
+      s->obj_starts = sample_insertion_pts.obj_starts;
+      s->obj_ends   = sample_insertion_pts.obj_ends;
+
+      if (analytic_metal)
+      {
+        // same HU lower bound as the conversion of the volumes
+        s->metal_objs = SampleNaiveMetalObjs(s->obj_starts, s->obj_ends, 1.0 - p_kwire,
+                                             &create_rand_screw, &create_rand_kwire, -130);
+      }
+
+      // sample the views
+      s->cams.resize(num_views);
+
+      s->cams[0] = default_cam;
+
+      for (size_type cam_idx = 1; cam_idx < num_views; ++cam_idx)
+      {
+        const CoordScalar cur_rot_ang_rad = std::normal_distribution<CoordScalar>(
+            mean_rot_angs[cam_idx-1], std_dev_rot_angs[cam_idx-1])(rng_eng) * kDEG2RAD;
+
+        FrameTransform carm_rand_perturb = FrameTransform::Identity();
+        {
+          Pt3 so3 = unit_vec_dist(rng_eng);
+          so3 *= carm_small_rot_ang_dist(rng_eng);
+
+          Pt3 trans = unit_vec_dist(rng_eng);
+          trans *= carm_small_trans_mag_dist(rng_eng);
+
+          carm_rand_perturb.matrix().block(0,0,3,3) = ExpSO3(so3);
+          carm_rand_perturb.matrix().block(0,3,3,1) = trans;
+        }
+
+        const FrameTransform new_extrins = default_cam.extrins
+                                              * EulerRotXFrame(cur_rot_ang_rad)
+                                              * carm_rand_perturb;
+
+        auto& cur_cam = s->cams[cam_idx];
+
+        cur_cam.coord_frame_type = default_cam.coord_frame_type;
+
+        cur_cam.setup(default_cam.intrins,
+                      new_extrins.matrix(),
+                      default_cam.num_det_rows, default_cam.num_det_cols,
+                      default_cam.det_row_spacing, default_cam.det_col_spacing);
+      }
+
+      // add some noise to the pose of the volume in the APP coordinate frame
+      FrameTransform delta_app = FrameTransform::Identity();
+      {
+        Pt3 so3 = unit_vec_dist(rng_eng);
+        so3 *= rot_ang_dist(rng_eng);
+
+        delta_app.matrix().block(0,0,3,3) = ExpSO3(so3);
+
+        Pt3 trans = unit_vec_dist(rng_eng);
+        trans *= trans_mag_dist(rng_eng);
+
+        delta_app.matrix().block(0,3,3,1) = trans;
+      }
+
+      s->gt_cam_wrt_vol = view_app_to_vol * delta_app * ap_view_cam_wrt_app;
+
+      // blocks when the volume stage is full
+      vol_queue.add([s,&update_sample_vol] () { update_sample_vol(s); });
+    }
+  }
+
+  vout << "waiting for the pipeline to finish..." << std::endl;
+
+  vol_queue.wait();
+  rc_queue.wait();
+  write_queue.wait();
+
+  h5.flush(H5F_SCOPE_GLOBAL);
+  h5.close();
+
+  vout << "exiting..." << std::endl;
+
+  return kEXIT_VAL_SUCCESS;
+}
@@ -22,7 +22,19 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+#include <future>
+#include <memory>
+#include <numeric>
+#include <sstream>
+
+#include <fmt/format.h>
+
 #include "xregProgOptUtils.h"
+#include "xregStringUtils.h"
+#include "xregLocalSocket.h"
+#include "xregTimer.h"
+#include "xregHDF5.h"
 #include "xregLandmarkFiles.h"
 #include "xregITKIOUtils.h"
 #include "xregITKLabelUtils.h"
@@ -35,16 +47,662 @@
 #include "xregImgSimMetric2DGradImgParamInterface.h"
 #include "xregImgSimMetric2DProgOpts.h"
 #include "xregHUToLinAtt.h"
+#include "xregAttVolCache.h"
 #include "xregProjPreProc.h"
 #include "xregPnPUtils.h"
 #include "xregMultiObjMultiLevel2D3DRegi.h"
 #include "xregMultiObjMultiLevel2D3DRegiDebug.h"
+#include "xregMultiObjMultiLevel2D3DRegiTrack.h"
 #include "xregSE3OptVars.h"
 #include "xregIntensity2D3DRegiCMAES.h"
 #include "xregIntensity2D3DRegiBOBYQA.h"
 #include "xregRegi2D3DPenaltyFnSE3EulerDecomp.h"
 #include "xregNormDist.h"
 
+namespace  // un-named
+{
+
+using namespace xreg;
+
+/// \brief Inputs of a single registration, either from the command line or
+///        from a request sent to the server.
+struct PelvisRegiInputs
+{
+  std::string proj_data_path;
+
+  size_type proj_idx = 0;
+
+  /// \brief Path to the initial pose estimate, empty -> PnP (or identity when
+  ///        no 3D landmarks are available)
+  std::string init_pose_path;
+
+  /// \brief Path to write the registered pose, empty -> not written
+  std::string dst_pose_path;
+
+  /// \brief Path to write debug info, empty -> debug info is not saved
+  std::string dst_debug_path;
+
+  /// \brief Levels of the pipeline to run, empty -> all levels
+  std::vector<size_type> levels_to_run;
+};
+
+using UseCurEstForInit = MultiLevelMultiObjRegi::Level::SingleRegi::InitPosePrevPoseEst;
+
+/// \brief Sets up the first (coarse) level of the registration pipeline.
+///
+/// The ray caster, similarity metric and registration object are created here,
+/// independent of the fixed image, so they may be reused for several
+/// registrations.
+void SetupPelvisRegiLevel1(ProgOpts& po, std::ostream& vout,
+                           std::shared_ptr<SE3OptVars> se3_vars,
+                           MultiLevelMultiObjRegi::Level* lvl_ptr)
+{
+  vout << "  setting regi level 1..." << std::endl;
+
+  auto& lvl = *lvl_ptr;
+
+  lvl.fixed_imgs_to_use = { 0 };
+
+  lvl.ds_factor = 0.125;
+  
+  vout << "    setting up ray caster..." << std::endl;
+  lvl.ray_caster = LineIntRayCasterFromProgOpts(po);
+  
+  vout << "    setting up sim metric..." << std::endl;
+  auto sm = PatchGradNCCSimMetricFromProgOpts(po);
+  {
+    auto* grad_sm = dynamic_cast<ImgSimMetric2DGradImgParamInterface*>(sm.get());
+
+    grad_sm->set_smooth_img_before_sobel_kernel_radius(5);
+  }
+ 
+  {
+    auto* patch_sm = dynamic_cast<ImgSimMetric2DPatchCommon*>(sm.get());
+    xregASSERT(patch_sm);
+
+    patch_sm->set_patch_radius(std::lround(lvl.ds_factor * 41));
+    patch_sm->set_patch_stride(1);
+  }
+
+  lvl.sim_metrics = { sm };
+
+  lvl.regis.resize(1);
+
+  auto& regi = lvl.regis[0];
+
+  regi.mov_vols    = { 0 };  // pelvis vol pose is optimized over
+  regi.ref_frames  = { 0 };  // use ref frame that is camera aligned
+  regi.static_vols = { };    // No other objects exist
+
+  // use the current estimate of the pelvis as the initialization at this phase
+  auto init_guess_fn = std::make_shared<UseCurEstForInit>();
+  init_guess_fn->vol_idx = 0;
+  regi.init_mov_vol_poses = { init_guess_fn };
+
+  auto cmaes_regi = std::make_shared<Intensity2D3DRegiCMAES>();
+  cmaes_regi->set_opt_vars(se3_vars);
+  cmaes_regi->set_opt_x_tol(0.01);
+  cmaes_regi->set_opt_obj_fn_tol(0.01);
+  cmaes_regi->set_pop_size(100);
+  cmaes_regi->set_sigma({ 15 * kDEG2RAD, 15 * kDEG2RAD, 30 * kDEG2RAD, 50, 50, 100 });
+  
+  auto pen_fn = std::make_shared<Regi2D3DPenaltyFnSE3EulerDecomp>();
+  pen_fn->rot_x_pdf   = std::make_shared<NormalDist1D>(0, 15 * kDEG2RAD);
+  pen_fn->rot_y_pdf   = std::make_shared<NormalDist1D>(0, 15 * kDEG2RAD);
+  pen_fn->rot_z_pdf   = std::make_shared<NormalDist1D>(0, 10 * kDEG2RAD);
+  pen_fn->trans_x_pdf = std::make_shared<NormalDist1D>(0, 30);
+  pen_fn->trans_y_pdf = std::make_shared<NormalDist1D>(0, 30);
+  pen_fn->trans_z_pdf = std::make_shared<NormalDist1D>(0, 150);
+
+  cmaes_regi->set_penalty_fn(pen_fn);
+  cmaes_regi->set_img_sim_penalty_coefs(0.9, 0.1);
+
+  regi.regi = cmaes_regi;
+}
+
+/// \brief Sets up the second (fine) level of the registration pipeline.
+///
+/// The bounds of the search about the current estimate are multiplied by
+/// search_scale, e.g. values less than one are used when tracking.
+void SetupPelvisRegiLevel2(ProgOpts& po, std::ostream& vout,
+                           std::shared_ptr<SE3OptVars> se3_vars,
+                           const double search_scale,
+                           MultiLevelMultiObjRegi::Level* lvl_ptr)
+{
+  vout << "  setting regi level 2..." << std::endl;
+
+  auto& lvl = *lvl_ptr;
+  
+  lvl.fixed_imgs_to_use = { 0 };
+
+  lvl.ds_factor = 0.25;
+  
+  vout << "    setting up ray caster..." << std::endl;
+  lvl.ray_caster = LineIntRayCasterFromProgOpts(po);
+  
+  vout << "    setting up sim metric..." << std::endl;
+  auto sm = PatchGradNCCSimMetricFromProgOpts(po);
+
+  {
+    auto* grad_sm = dynamic_cast<ImgSimMetric2DGradImgParamInterface*>(sm.get());
+
+    grad_sm->set_smooth_img_before_sobel_kernel_radius(5);
+  }
+ 
+  {
+    auto* patch_sm = dynamic_cast<ImgSimMetric2DPatchCommon*>(sm.get());
+    xregASSERT(patch_sm);
+
+    patch_sm->set_patch_radius(std::lround(lvl.ds_factor * 41));
+    patch_sm->set_patch_stride(1);
+  }
+
+  lvl.sim_metrics = { sm };
+
+  lvl.regis.resize(1);
+
+  auto& regi = lvl.regis[0];
+
+  regi.mov_vols    = { 0 };  // pelvis vol pose is optimized over
+  regi.ref_frames  = { 0 };  // use ref frame that is camera aligned
+  regi.static_vols = { };    // No other objects exist
+
+  // use the current estimate of the pelvis as the initialization at this phase
+  auto init_guess_fn = std::make_shared<UseCurEstForInit>();
+  init_guess_fn->vol_idx = 0;
+  regi.init_mov_vol_poses = { init_guess_fn };
+
+  auto bobyqa_regi = std::make_shared<Intensity2D3DRegiBOBYQA>();
+  bobyqa_regi->set_opt_vars(se3_vars);
+  bobyqa_regi->set_opt_x_tol(0.0001);
+  bobyqa_regi->set_opt_obj_fn_tol(0.0001);
+  bobyqa_regi->set_bounds({ search_scale * 2.5 * kDEG2RAD,
+                            search_scale * 2.5 * kDEG2RAD,
+                            search_scale * 2.5 * kDEG2RAD,
+                            search_scale * 5, search_scale * 5, search_scale * 10 });
+  
+  lvl.regis[0].regi = bobyqa_regi;
+}
+
+/// \brief Sets up each level of the registration pipeline.
+void SetupPelvisRegiLevels(ProgOpts& po, std::ostream& vout,
+                           std::shared_ptr<SE3OptVars> se3_vars,
+                           std::vector<MultiLevelMultiObjRegi::Level>* levels)
+{
+  levels->resize(2);
+
+  SetupPelvisRegiLevel1(po, vout, se3_vars, &levels->at(0));
+  
+  SetupPelvisRegiLevel2(po, vout, se3_vars, 1, &levels->at(1));
+}
+
+/// \brief Names of the registration performed at each level, used for debug info
+const std::vector<std::vector<std::string>> kREGI_NAMES_FOR_EACH_LEVEL = { { "CMA-ES" }, { "BOBYQA" } };
+
+/// \brief State that is loaded once and shared by every registration.
+struct PelvisRegiResources
+{
+  std::string ct_path;
+
+  std::string seg_path;
+
+  unsigned char pelvis_label;
+
+  bool use_identity_for_init_cam_to_vol;
+
+  LandMap3 lands_3d;
+
+  bool no_log_remap;
+
+  bool verbose;
+
+  MultiLevelMultiObjRegi ml_mo_regi;
+
+  /// \brief Every level of the pipeline, ml_mo_regi.levels is assigned the
+  ///        levels to run for each registration.
+  std::vector<MultiLevelMultiObjRegi::Level> all_levels;
+
+  std::shared_ptr<MultiLevelMultiObjRegi::CamAlignRefFrameWithCurPose> cam_align_ref;
+
+  /// \brief The camera models the ray casters have allocated resources for
+  std::vector<CameraModel> alloc_cams;
+
+  /// \brief Whether the ray caster of each level has allocated resources for alloc_cams
+  std::vector<bool> lvl_ray_caster_allocated;
+};
+
+/// \brief Reads a single projection and pre-processes it for registration.
+///
+/// The pre-processed projection is stored in proj_preproc->output_projs[0].
+void ReadAndPreprocProj(DeferredProjReader* proj_reader, const size_type proj_idx,
+                        const PelvisRegiResources& res, std::ostream& vout,
+                        ProjPreProc* proj_preproc)
+{
+  proj_preproc->params.no_log_remap = res.no_log_remap;
+
+  const auto& proj_metas = proj_reader->proj_data_F32();
+
+  if (proj_idx >= proj_metas.size())
+  {
+    xregThrow("projection index %lu out of range, the file has %lu projections!",
+              static_cast<unsigned long>(proj_idx),
+              static_cast<unsigned long>(proj_metas.size()));
+  }
+
+  proj_preproc->input_projs = { proj_metas[proj_idx] };
+
+  proj_preproc->input_projs[0].img = proj_reader->read_proj_F32(proj_idx);
+
+  proj_preproc->set_debug_output_stream(vout, res.verbose);
+  
+  vout << "preprocessing projection..." << std::endl;
+  (*proj_preproc)();
+
+  vout << "2D Landmarks:\n";
+  PrintLandmarkMap(proj_preproc->output_projs[0].landmarks, vout);
+}
+
+/// \brief The initial pose estimate of a registration.
+///
+/// The estimate is read from init_pose_path when provided, otherwise a PnP
+/// problem is solved using the landmarks of the projection (or the identity is
+/// used when 3D landmarks are not available).
+FrameTransform InitPelvisRegiEst(const std::string& init_pose_path, const ProjDataF32& proj,
+                                 const PelvisRegiResources& res, std::ostream& vout)
+{
+  FrameTransform init_cam_to_vol = FrameTransform::Identity();
+
+  if (!init_pose_path.empty())
+  {
+    vout << "reading initial regi estimate from disk..." << std::endl;
+    init_cam_to_vol = ReadITKAffineTransformFromFile(init_pose_path);
+  }
+  else if (!res.use_identity_for_init_cam_to_vol)
+  {
+    vout << "solving PnP problem for initial regi estimate..." << std::endl;
+    init_cam_to_vol = PnPPOSITAndReprojCMAES(proj.cam, res.lands_3d, proj.landmarks);
+  }
+  else
+  {
+    vout << "using identity for initial regi estimate" << std::endl;
+  }
+
+  return init_cam_to_vol;
+}
+
+/// \brief Registers the pelvis to a single view and returns the pose.
+///
+/// When called repeatedly, the ray casters, similarity metrics and registration
+/// objects of each level are reused. The ray casters are only reallocated when
+/// the camera model changes.
+FrameTransform RunPelvisRegi(const PelvisRegiInputs& inputs, PelvisRegiResources* res,
+                             std::ostream& vout)
+{
+  ProjPreProc proj_preproc;
+
+  {
+    vout << "reading projection data..." << std::endl;
+    DeferredProjReader proj_reader(inputs.proj_data_path);
+
+    ReadAndPreprocProj(&proj_reader, inputs.proj_idx, *res, vout, &proj_preproc);
+  }
+  
+  const FrameTransform init_cam_to_vol = InitPelvisRegiEst(inputs.init_pose_path,
+                                                           proj_preproc.output_projs[0], *res, vout);
+
+  MultiLevelMultiObjRegi& ml_mo_regi = res->ml_mo_regi;
+
+  const bool save_debug = !inputs.dst_debug_path.empty();
+
+  // calling this with save_debug==true will allocate the debug object
+  ml_mo_regi.set_save_debug_info(save_debug);
+
+  ml_mo_regi.fixed_proj_data = proj_preproc.output_projs;
+  
+  res->cam_align_ref->cam_extrins = ml_mo_regi.fixed_proj_data[0].cam.extrins;
+
+  ml_mo_regi.init_cam_to_vols = { init_cam_to_vol };
+
+  const size_type num_levels = res->all_levels.size();
+
+  std::vector<size_type> levels_to_run = inputs.levels_to_run;
+
+  if (levels_to_run.empty())
+  {
+    levels_to_run.resize(num_levels);
+    std::iota(levels_to_run.begin(), levels_to_run.end(), size_type(0));
+  }
+
+  ml_mo_regi.levels.clear();
+
+  for (const size_type lvl_idx : levels_to_run)
+  {
+    if (lvl_idx >= num_levels)
+    {
+      xregThrow("invalid level index %lu, the pipeline has %lu levels!",
+                static_cast<unsigned long>(lvl_idx), static_cast<unsigned long>(num_levels));
+    }
+
+    // the levels share the ray casters, sim metrics and regi objects
+    ml_mo_regi.levels.push_back(res->all_levels[lvl_idx]);
+  }
+
+  // The ray casters only need to allocate resources the first time a level is
+  // run, or when the camera model changes. The sim metrics are always
+  // reallocated, since the fixed image changes.
+  const std::vector<CameraModel> cams = { ml_mo_regi.fixed_proj_data[0].cam };
+
+  if (cams != res->alloc_cams)
+  {
+    res->alloc_cams = cams;
+    res->lvl_ray_caster_allocated.assign(num_levels, false);
+  }
+
+  ml_mo_regi.ray_caster_needs_resources_alloc = false;
+
+  for (const size_type lvl_idx : levels_to_run)
+  {
+    if (!res->lvl_ray_caster_allocated[lvl_idx])
+    {
+      ml_mo_regi.ray_caster_needs_resources_alloc = true;
+    }
+  }
+
+  if (save_debug)
+  {
+    vout << "  setting regi debug info..." << std::endl;
+
+    DebugRegiResultsMultiLevel::VolPathInfo debug_vol_path;
+    debug_vol_path.vol_path = res->ct_path;
+    
+    if (!res->seg_path.empty())
+    {
+      debug_vol_path.label_vol_path = res->seg_path;
+      debug_vol_path.labels_used    = { res->pelvis_label };
+    }
+    
+    ml_mo_regi.debug_info->vols = { debug_vol_path };
+
+    DebugRegiResultsMultiLevel::ProjDataPathInfo debug_proj_path;
+    debug_proj_path.path = inputs.proj_data_path;
+    debug_proj_path.projs_used = { inputs.proj_idx };
+
+    ml_mo_regi.debug_info->fixed_projs = debug_proj_path;
+    
+    ml_mo_regi.debug_info->proj_pre_proc_info = proj_preproc.params;
+
+    ml_mo_regi.debug_info->regi_names.clear();
+
+    for (const size_type lvl_idx : levels_to_run)
+    {
+      ml_mo_regi.debug_info->regi_names.push_back(kREGI_NAMES_FOR_EACH_LEVEL[lvl_idx]);
+    }
+  }
+
+  vout << "running regi..." << std::endl;
+  
+  // a failure part way through leaves the resources of the ray casters unknown
+  res->lvl_ray_caster_allocated.assign(num_levels, false);
+
+  ml_mo_regi.run();
+
+  for (const size_type lvl_idx : levels_to_run)
+  {
+    res->lvl_ray_caster_allocated[lvl_idx] = true;
+  }
+
+  if (!inputs.dst_pose_path.empty())
+  {
+    vout << "writing pose to disk..." << std::endl;
+    WriteITKAffineTransform(inputs.dst_pose_path, ml_mo_regi.cur_cam_to_vols[0]);
+  }
+
+  if (save_debug)
+  {
+    vout << "writing debug info to disk..." << std::endl;
+    WriteMultiLevel2D3DRegiDebugToDisk(*ml_mo_regi.debug_info, inputs.dst_debug_path);
+  }
+
+  return ml_mo_regi.cur_cam_to_vols[0];
+}
+
+/// \brief Tracks the pelvis through every projection of a sequence.
+///
+/// The first frame is registered with every level of the pipeline. Each
+/// subsequent frame only runs the fine level, with a search space scaled by
+/// search_scale, starting from the previous estimate (or a constant velocity
+/// prediction). The pose of every frame is written to an HDF5 file.
+void RunPelvisTracking(const std::string& proj_data_path, const std::string& dst_poses_path,
+                       const std::string& init_pose_path, const double search_scale,
+                       const bool const_vel, ProgOpts& po, std::shared_ptr<SE3OptVars> se3_vars,
+                       PelvisRegiResources* res, std::ostream& vout)
+{
+  MultiLevelMultiObjRegi& ml_mo_regi = res->ml_mo_regi;
+
+  MultiLevelMultiObjRegiTracker tracker(&ml_mo_regi);
+
+  tracker.init_levels = res->all_levels;
+
+  vout << "setting up tracking level..." << std::endl;
+  tracker.track_levels.resize(1);
+  SetupPelvisRegiLevel2(po, vout, se3_vars, search_scale, &tracker.track_levels[0]);
+
+  tracker.motion_model = const_vel ? MultiLevelMultiObjRegiTracker::kTRACK_MOTION_CONST_VEL :
+                                     MultiLevelMultiObjRegiTracker::kTRACK_MOTION_PREV_POSE;
+
+  vout << "opening projection data..." << std::endl;
+  DeferredProjReader proj_reader(proj_data_path);
+
+  const size_type num_frames = proj_reader.num_projs_on_disk();
+
+  vout << "number of frames: " << num_frames << std::endl;
+
+  vout << "creating output file..." << std::endl;
+  H5::H5File h5(dst_poses_path, H5F_ACC_TRUNC);
+
+  WriteSingleScalarH5("num-frames", num_frames, &h5);
+
+  H5::Group poses_g = h5.createGroup("cam-to-pelvis-vol");
+
+  Timer tmr;
+
+  for (size_type frame_idx = 0; frame_idx < num_frames; ++frame_idx)
+  {
+    tmr.start();
+
+    vout << "frame " << frame_idx << ":" << std::endl;
+
+    ProjPreProc proj_preproc;
+    ReadAndPreprocProj(&proj_reader, frame_idx, *res, vout, &proj_preproc);
+
+    // the camera is assumed to be fixed for the sequence
+    res->cam_align_ref->cam_extrins = proj_preproc.output_projs[0].cam.extrins;
+
+    if (!frame_idx)
+    {
+      ml_mo_regi.init_cam_to_vols = { InitPelvisRegiEst(init_pose_path, proj_preproc.output_projs[0],
+                                                        *res, vout) };
+    }
+
+    const FrameTransform& cam_to_vol = tracker.register_frame(proj_preproc.output_projs)[0];
+
+    WriteAffineTransform4x4(fmt::format("{}", frame_idx), cam_to_vol, &poses_g);
+
+    const double frame_secs = tmr.elapsed_seconds_since_start();
+    
+    tmr.stop();
+
+    vout << fmt::format("frame {} time: {:.3f} s (average: {:.2f} frames/s)",
+                        frame_idx, frame_secs,
+                        (frame_idx + 1) / tmr.elapsed_seconds()) << std::endl;
+  }
+
+  h5.flush(H5F_SCOPE_GLOBAL);
+  h5.close();
+}
+
+/// \brief Parses a registration request sent to the server.
+///
+/// A request is a single line of whitespace separated key=value tokens, see
+/// the Readme for the list of keys.
+PelvisRegiInputs ParseRegiRequest(const std::string& req)
+{
+  PelvisRegiInputs inputs;
+
+  for (const auto& tok : StringSplit(req))
+  {
+    const std::string::size_type eq_pos = tok.find('=');
+
+    if ((eq_pos == std::string::npos) || !eq_pos)
+    {
+      xregThrow("invalid request token (expected key=value): %s", tok.c_str());
+    }
+
+    const std::string key = tok.substr(0, eq_pos);
+    const std::string val = tok.substr(eq_pos + 1);
+
+    if (key == "proj")
+    {
+      inputs.proj_data_path = val;
+    }
+    else if (key == "proj-idx")
+    {
+      inputs.proj_idx = StringCast<size_type>(val);
+    }
+    else if (key == "init-pose")
+    {
+      inputs.init_pose_path = val;
+    }
+    else if (key == "out-pose")
+    {
+      inputs.dst_pose_path = val;
+    }
+    else if (key == "debug")
+    {
+      inputs.dst_debug_path = val;
+    }
+    else if (key == "levels")
+    {
+      for (const long lvl_idx : ParseCSVRangeOfInts(val))
+      {
+        if (lvl_idx < 0)
+        {
+          xregThrow("invalid level index: %ld", lvl_idx);
+        }
+
+        inputs.levels_to_run.push_back(static_cast<size_type>(lvl_idx));
+      }
+    }
+    else
+    {
+      xregThrow("unknown request key: %s", key.c_str());
+    }
+  }
+
+  if (inputs.proj_data_path.empty())
+  {
+    xregThrow("request is missing the projection data path (proj=<path>)!");
+  }
+
+  return inputs;
+}
+
+/// \brief Formats a pose as the 16 elements of its 4x4 matrix in row-major order.
+std::string PoseToString(const FrameTransform& xform)
+{
+  std::string s;
+
+  for (int r = 0; r < 4; ++r)
+  {
+    for (int c = 0; c < 4; ++c)
+    {
+      s += fmt::format("{}{:.9g}", s.empty() ? "" : " ", xform.matrix()(r,c));
+    }
+  }
+
+  return s;
+}
+
+/// \brief Serves registration requests on a local socket until a quit request
+///        is received.
+///
+/// Clients are handled one at a time and each client may send any number of
+/// requests over its connection. Each request receives a single line reply:
+/// "OK" followed by the pose or "ERROR" followed by a message.
+void RunPelvisRegiServer(const std::string& socket_path, PelvisRegiResources* res,
+                         std::ostream& vout)
+{
+  LocalSocketServer server(socket_path);
+
+  vout << "listening for registration requests on: " << socket_path << std::endl;
+
+  bool quit = false;
+
+  while (!quit)
+  {
+    auto conn = server.accept();
+
+    vout << "client connected." << std::endl;
+
+    try
+    {
+      std::string req;
+
+      while (!quit && conn->read_line(&req))
+      {
+        req = StringStrip(req);
+
+        if (req.empty())
+        {
+          continue;
+        }
+        else if (req == "ping")
+        {
+          conn->write_line("OK");
+        }
+        else if (req == "quit")
+        {
+          vout << "quit requested." << std::endl;
+          conn->write_line("OK");
+          quit = true;
+        }
+        else
+        {
+          vout << "request: " << req << std::endl;
+
+          std::string reply;
+
+          try
+          {
+            reply = "OK " + PoseToString(RunPelvisRegi(ParseRegiRequest(req), res, vout));
+          }
+          catch (const std::exception& e)
+          {
+            // a failed registration does not stop the server
+            reply = fmt::format("ERROR {}", e.what());
+          }
+
+          // replies are restricted to a single line
+          std::replace(reply.begin(), reply.end(), '\n', ' ');
+
+          vout << "reply: " << reply << std::endl;
+
+          conn->write_line(reply);
+        }
+      }
+    }
+    catch (const std::exception& e)
+    {
+      // e.g. the client disconnected before a reply was sent
+      vout << "connection error: " << e.what() << std::endl;
+    }
+
+    vout << "client disconnected." << std::endl;
+  }
+}
+
+}  // un-named
+
 int main(int argc, char* argv[])
 {
   using namespace xreg;
@@ -64,11 +722,22 @@ int main(int argc, char* argv[])
               "estimate is then used to initialize an intensity-based "
               "registration. "
               "This program may serve as a general template for performing "
-              "single-object 2D/3D registration to a single view.");
+              "single-object 2D/3D registration to a single view. "
+              "When --server is passed, the volume is loaded and the registration "
+              "objects (e.g. ray casters and GPU resources) are created once, and "
+              "registrations of views sent over a local socket are performed until "
+              "a quit request is received. Only the CT volume and 3D landmarks "
+              "positional arguments are used in this mode. "
+              "When --track is passed, every projection of the projection data file "
+              "is treated as a frame of a fluoroscopy sequence. The first frame is "
+              "registered with the full pipeline and each subsequent frame is "
+              "registered with only the fine level, starting from the previous "
+              "estimate. The output pose path is an HDF5 file storing the pose of "
+              "each frame in this mode.");
   
   po.set_arg_usage("<Input CT vol.> <3D Landmarks> <Proj. Data File> "
                    "<output pose> [<output debug data file>]");
-  po.set_min_num_pos_args(4);
+  po.set_min_num_pos_args(2);
 
   po.add("proj-idx", 'p', ProgOpts::kSTORE_UINT32, "proj-idx",
          "Index of the projection to register (the projection data file may store several projections)")
@@ -91,6 +760,45 @@ int main(int argc, char* argv[])
          "Do NOT perform log remapping of the projection intensities during pre-processing.")
     << false;
 
+  po.add("vol-cache-dir", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "vol-cache-dir",
+         "Directory used to cache the preprocessed (converted to linear attenuation, masked, "
+         "and cropped) volumes. The cache is keyed by the contents of the input volume and "
+         "label map files and the preprocessing parameters, so subsequent runs with the same "
+         "inputs skip the preprocessing. Empty -> no caching.")
+    << "";
+
+  po.add("vol-cache-half", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_TRUE, "vol-cache-half",
+         "Store volumes written to the cache using half precision, which reduces their size "
+         "and loading time at a loss of precision.")
+    << false;
+
+  po.add("server", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "server",
+         "Run as a server, accepting registration requests on a local socket created at "
+         "this path. The volume, ray casters and similarity metrics remain resident "
+         "between requests. Empty -> perform a single registration and exit.")
+    << "";
+
+  po.add("track", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_TRUE, "track",
+         "Track the pelvis through every projection (frame) of the projection data file, "
+         "using the estimate of each frame to initialize the next.")
+    << false;
+
+  po.add("track-const-vel", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_TRUE, "track-const-vel",
+         "When tracking, initialize each frame by applying the motion between the previous "
+         "two frames to the previous estimate (a constant velocity model).")
+    << false;
+
+  po.add("track-search-scale", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "track-search-scale",
+         "When tracking, the bounds of the fine level search space are multiplied by this "
+         "value for every frame after the first.")
+    << 0.5;
+
+  po.add("init-pose", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "init-pose",
+         "Path to an initial pose estimate (ITK transform file) used instead of the PnP "
+         "solution. When tracking, this initializes the first frame. "
+         "Empty -> use PnP (or identity when the 3D landmarks path is \"-\").")
+    << "";
+
   po.add_backend_flags();
 
   try
@@ -111,24 +819,37 @@ int main(int argc, char* argv[])
     return kEXIT_VAL_SUCCESS;
   }
 
+  const std::string server_socket_path = po.get("server");
+
+  const bool run_server = !server_socket_path.empty();
+
+  const bool track = po.get("track");
+
+  if (run_server && track)
+  {
+    std::cerr << "Error: --server and --track may not be used together!" << std::endl;
+    po.print_usage(std::cerr);
+    return kEXIT_VAL_BAD_USE;
+  }
+
+  if (!run_server && (po.pos_args().size() < 4))
+  {
+    std::cerr << "Error: a projection data file and output pose path are required "
+                 "when not running as a server!" << std::endl;
+    po.print_usage(std::cerr);
+    return kEXIT_VAL_BAD_USE;
+  }
+
   const bool verbose = po.get("verbose");
   std::ostream& vout = po.vout();
   
   const std::string ct_path        = po.pos_args()[0];
   const std::string fcsv_3d_path   = po.pos_args()[1];
-  const std::string proj_data_path = po.pos_args()[2];
-  const std::string dst_pose_path  = po.pos_args()[3];
 
   const bool use_identity_for_init_cam_to_vol = fcsv_3d_path == "-";
 
-  const bool save_debug = po.pos_args().size() > 4;
-
-  const std::string dst_debug_path = save_debug ? po.pos_args()[4] : std::string();
-
   const bool lands_ras = po.get("lands-ras");
 
-  const size_type proj_idx = po.get("proj-idx").as_uint32();
-
   const std::string seg_path = po.get("vol-seg");
 
   const bool use_seg = !seg_path.empty();
@@ -137,265 +858,160 @@ int main(int argc, char* argv[])
 
   const bool no_log_remap = po.get("no-log-remap");
 
-  //////////////////////////////////////////////////////////////////////////////
-  // Read in input intensity volume
-  
-  vout << "reading in source intensity volume..." << std::endl;
-  auto ct_intens = ReadITKImageFromDisk<RayCaster::Vol>(ct_path);
-
-  vout << "converting HU --> Lin. Att." << std::endl;
-  ct_intens = HUToLinAtt(ct_intens.GetPointer());
+  const std::string vol_cache_dir = po.get("vol-cache-dir");
 
-  if (use_seg)
-  {
-    vout << "reading label map..." << std::endl;
-    auto ct_labels = ReadITKImageFromDisk<itk::Image<unsigned char,3>>(seg_path);
-    
-    vout << "cropping intensity volume tightly around pelvis label ("
-         << static_cast<int>(pelvis_label) << ")..." << std::endl;
-
-    ct_intens = MakeVolListFromVolAndLabels(ct_intens.GetPointer(), ct_labels.GetPointer(),
-                                            { pelvis_label }, 0)[0];
-  }
+  const bool vol_cache_half = po.get("vol-cache-half");
 
   //////////////////////////////////////////////////////////////////////////////
-  // Get the landmarks
-
-  LandMap3 lands_3d;
+  // Create the ray casters and similarity metrics, and build their OpenCL
+  // programs, in the background while the inputs are read
 
-  if (!use_identity_for_init_cam_to_vol)
-  {
-    vout << "reading 3D landmarks..." << std::endl;
-    lands_3d = ReadLandmarksFileNamePtMap(fcsv_3d_path, !lands_ras);
-
-    vout << "3D Landmarks:\n";
-    PrintLandmarkMap(lands_3d, vout);
-  }
+  // se(3) lie algebra vector space for optimization
+  auto se3_vars = std::make_shared<SE3OptVarsLieAlg>();
 
-  ProjPreProc proj_preproc;
-  proj_preproc.params.no_log_remap = no_log_remap;
+  // messages from the background setup are printed once it has completed
+  std::stringstream setup_vout;
 
-  {
-    vout << "reading projection data..." << std::endl;
-    DeferredProjReader proj_reader(proj_data_path);
-    
-    const auto proj_metas = proj_reader.proj_data_F32();
+  std::vector<MultiLevelMultiObjRegi::Level> all_levels;
 
-    xregASSERT(proj_idx < proj_metas.size());
+  vout << "setting up regi levels and building device programs in the background..." << std::endl;
 
-    proj_preproc.input_projs = { proj_metas[proj_idx] };
+  auto setup_levels_fut = std::async(std::launch::async,
+                                     [&po, &setup_vout, &all_levels, se3_vars] ()
+                                     {
+                                       SetupPelvisRegiLevels(po, setup_vout, se3_vars, &all_levels);
 
-    proj_preproc.input_projs[0].img = proj_reader.read_proj_F32(proj_idx);
-  }
+                                       MultiLevelMultiObjRegi::PrebuildProgsAsync(all_levels).get();
+                                     });
 
-  proj_preproc.set_debug_output_stream(vout, verbose);
+  //////////////////////////////////////////////////////////////////////////////
+  // Read in input intensity volume
   
-  vout << "preprocessing projection..." << std::endl;
-  proj_preproc();
+  RayCaster::Vol::Pointer ct_intens;
 
-  vout << "2D Landmarks:\n";
-  PrintLandmarkMap(proj_preproc.output_projs[0].landmarks, vout);
-  
-  FrameTransform init_cam_to_vol = FrameTransform::Identity();
+  std::unique_ptr<AttVolCache> vol_cache;
+  std::string vol_cache_key;
 
-  if (!use_identity_for_init_cam_to_vol)
+  if (!vol_cache_dir.empty())
   {
-    vout << "solving PnP problem for initial regi estimate..." << std::endl;
-    init_cam_to_vol = PnPPOSITAndReprojCMAES(proj_preproc.output_projs[0].cam,
-                                              lands_3d, proj_preproc.output_projs[0].landmarks);
-  }
-  else
-  {
-    vout << "using identity for initial regi estimate" << std::endl;
+    vol_cache.reset(new AttVolCache(vol_cache_dir));
+    vol_cache->half_precision = vol_cache_half;
+
+    vout << "computing volume cache key..." << std::endl;
+    vol_cache_key = use_seg ?
+                      MakeAttVolCacheKey({ ct_path, seg_path },
+                                         fmt::format("hu-to-lin-att;labels={}",
+                                                     static_cast<int>(pelvis_label))) :
+                      MakeAttVolCacheKey({ ct_path }, "hu-to-lin-att");
+
+    AttVolCache::VolList cached_vols;
+    if (vol_cache->read(vol_cache_key, &cached_vols))
+    {
+      vout << "  using cached volume: " << vol_cache->entry_path(vol_cache_key) << std::endl;
+      xregASSERT(cached_vols.size() == 1);
+      ct_intens = cached_vols[0];
+    }
   }
 
-  vout << "setting up multi-level regi object.." << std::endl;
-
-  MultiLevelMultiObjRegi ml_mo_regi;
-  ml_mo_regi.set_debug_output_stream(vout, verbose);
-
-  // calling this with save_debug==true will allocate the debug object
-  ml_mo_regi.set_save_debug_info(save_debug);
-
-  ml_mo_regi.vol_names = { "Pelvis" };
-  
-  ml_mo_regi.vols = { ct_intens };
-
-  ml_mo_regi.fixed_proj_data = proj_preproc.output_projs;
-
-  // setup the camera reference frame which we optimize in
-  auto cam_align_ref = std::make_shared<MultiLevelMultiObjRegi::CamAlignRefFrameWithCurPose>();
-  cam_align_ref->vol_idx = 0;
-  cam_align_ref->center_of_rot_wrt_vol = ITKVol3DCenterAsPhysPt(ct_intens.GetPointer());
-  cam_align_ref->cam_extrins = ml_mo_regi.fixed_proj_data[0].cam.extrins;
-
-  ml_mo_regi.ref_frames = { cam_align_ref };
-
-  // se(3) lie algebra vector space for optimization
-  auto se3_vars = std::make_shared<SE3OptVarsLieAlg>();
-
-  ml_mo_regi.init_cam_to_vols = { init_cam_to_vol };
-
-  ml_mo_regi.levels.resize(2);
-
-  using UseCurEstForInit = MultiLevelMultiObjRegi::Level::SingleRegi::InitPosePrevPoseEst;
-
-  // Level 1
+  if (!ct_intens)
   {
-    vout << "  setting regi level 1..." << std::endl;
-    
-    auto& lvl = ml_mo_regi.levels[0];
+    vout << "reading in source intensity volume..." << std::endl;
+    ct_intens = ReadITKImageFromDisk<RayCaster::Vol>(ct_path);
 
-    lvl.fixed_imgs_to_use = { 0 };
+    vout << "converting HU --> Lin. Att." << std::endl;
+    HUToLinAttInPlace(ct_intens.GetPointer());
 
-    lvl.ds_factor = 0.125;
-    
-    vout << "    setting up ray caster..." << std::endl;
-    lvl.ray_caster = LineIntRayCasterFromProgOpts(po);
-    
-    vout << "    setting up sim metric..." << std::endl;
-    auto sm = PatchGradNCCSimMetricFromProgOpts(po);
+    if (use_seg)
     {
-      auto* grad_sm = dynamic_cast<ImgSimMetric2DGradImgParamInterface*>(sm.get());
-
-      grad_sm->set_smooth_img_before_sobel_kernel_radius(5);
+      vout << "reading label map..." << std::endl;
+      auto ct_labels = ReadITKImageFromDisk<itk::Image<unsigned char,3>>(seg_path);
+      
+      vout << "cropping intensity volume tightly around pelvis label ("
+           << static_cast<int>(pelvis_label) << ")..." << std::endl;
+
+      ct_intens = MakeVolListFromVolAndLabels(ct_intens.GetPointer(), ct_labels.GetPointer(),
+                                              { pelvis_label }, 0)[0];
     }
-   
-    {
-      auto* patch_sm = dynamic_cast<ImgSimMetric2DPatchCommon*>(sm.get());
-      xregASSERT(patch_sm);
 
-      patch_sm->set_patch_radius(std::lround(lvl.ds_factor * 41));
-      patch_sm->set_patch_stride(1);
+    if (vol_cache)
+    {
+      vout << "writing preprocessed volume to cache..." << std::endl;
+      vol_cache->write(vol_cache_key, { ct_intens });
     }
+  }
 
-    lvl.sim_metrics = { sm };
-
-    lvl.regis.resize(1);
-
-    auto& regi = lvl.regis[0];
-
-    regi.mov_vols    = { 0 };  // pelvis vol pose is optimized over
-    regi.ref_frames  = { 0 };  // use ref frame that is camera aligned
-    regi.static_vols = { };    // No other objects exist
+  PelvisRegiResources res;
 
-    // use the current estimate of the pelvis as the initialization at this phase
-    auto init_guess_fn = std::make_shared<UseCurEstForInit>();
-    init_guess_fn->vol_idx = 0;
-    regi.init_mov_vol_poses = { init_guess_fn };
+  res.ct_path      = ct_path;
+  res.seg_path     = seg_path;
+  res.pelvis_label = pelvis_label;
+  res.no_log_remap = no_log_remap;
+  res.verbose      = verbose;
 
-    auto cmaes_regi = std::make_shared<Intensity2D3DRegiCMAES>();
-    cmaes_regi->set_opt_vars(se3_vars);
-    cmaes_regi->set_opt_x_tol(0.01);
-    cmaes_regi->set_opt_obj_fn_tol(0.01);
-    cmaes_regi->set_pop_size(100);
-    cmaes_regi->set_sigma({ 15 * kDEG2RAD, 15 * kDEG2RAD, 30 * kDEG2RAD, 50, 50, 100 });
-    
-    auto pen_fn = std::make_shared<Regi2D3DPenaltyFnSE3EulerDecomp>();
-    pen_fn->rot_x_pdf   = std::make_shared<NormalDist1D>(0, 15 * kDEG2RAD);
-    pen_fn->rot_y_pdf   = std::make_shared<NormalDist1D>(0, 15 * kDEG2RAD);
-    pen_fn->rot_z_pdf   = std::make_shared<NormalDist1D>(0, 10 * kDEG2RAD);
-    pen_fn->trans_x_pdf = std::make_shared<NormalDist1D>(0, 30);
-    pen_fn->trans_y_pdf = std::make_shared<NormalDist1D>(0, 30);
-    pen_fn->trans_z_pdf = std::make_shared<NormalDist1D>(0, 150);
+  res.use_identity_for_init_cam_to_vol = use_identity_for_init_cam_to_vol;
 
-    cmaes_regi->set_penalty_fn(pen_fn);
-    cmaes_regi->set_img_sim_penalty_coefs(0.9, 0.1);
+  //////////////////////////////////////////////////////////////////////////////
+  // Get the landmarks
 
-    regi.regi = cmaes_regi;
-  }
-  
-  // Level 2
+  if (!use_identity_for_init_cam_to_vol)
   {
-    vout << "  setting regi level 2..." << std::endl;
-    
-    auto& lvl = ml_mo_regi.levels[1];
-    
-    lvl.fixed_imgs_to_use = { 0 };
+    vout << "reading 3D landmarks..." << std::endl;
+    res.lands_3d = ReadLandmarksFileNamePtMap(fcsv_3d_path, !lands_ras);
 
-    lvl.ds_factor = 0.25;
-    
-    vout << "    setting up ray caster..." << std::endl;
-    lvl.ray_caster = LineIntRayCasterFromProgOpts(po);
-    
-    vout << "    setting up sim metric..." << std::endl;
-    auto sm = PatchGradNCCSimMetricFromProgOpts(po);
+    vout << "3D Landmarks:\n";
+    PrintLandmarkMap(res.lands_3d, vout);
+  }
 
-    {
-      auto* grad_sm = dynamic_cast<ImgSimMetric2DGradImgParamInterface*>(sm.get());
+  vout << "setting up multi-level regi object.." << std::endl;
 
-      grad_sm->set_smooth_img_before_sobel_kernel_radius(5);
-    }
-   
-    {
-      auto* patch_sm = dynamic_cast<ImgSimMetric2DPatchCommon*>(sm.get());
-      xregASSERT(patch_sm);
+  MultiLevelMultiObjRegi& ml_mo_regi = res.ml_mo_regi;
+  ml_mo_regi.set_debug_output_stream(vout, verbose);
 
-      patch_sm->set_patch_radius(std::lround(lvl.ds_factor * 41));
-      patch_sm->set_patch_stride(1);
-    }
+  ml_mo_regi.vol_names = { "Pelvis" };
+  
+  ml_mo_regi.vols = { ct_intens };
 
-    lvl.sim_metrics = { sm };
+  // setup the camera reference frame which we optimize in, the extrinsics are
+  // set for each fixed image
+  res.cam_align_ref = std::make_shared<MultiLevelMultiObjRegi::CamAlignRefFrameWithCurPose>();
+  res.cam_align_ref->vol_idx = 0;
+  res.cam_align_ref->center_of_rot_wrt_vol = ITKVol3DCenterAsPhysPt(ct_intens.GetPointer());
 
-    lvl.regis.resize(1);
+  ml_mo_regi.ref_frames = { res.cam_align_ref };
 
-    auto& regi = lvl.regis[0];
+  vout << "waiting for the background setup of the regi levels..." << std::endl;
+  setup_levels_fut.get();
 
-    regi.mov_vols    = { 0 };  // pelvis vol pose is optimized over
-    regi.ref_frames  = { 0 };  // use ref frame that is camera aligned
-    regi.static_vols = { };    // No other objects exist
+  vout << setup_vout.str();
 
-    // use the current estimate of the pelvis as the initialization at this phase
-    auto init_guess_fn = std::make_shared<UseCurEstForInit>();
-    init_guess_fn->vol_idx = 0;
-    regi.init_mov_vol_poses = { init_guess_fn };
+  ml_mo_regi.levels = all_levels;
 
-    auto bobyqa_regi = std::make_shared<Intensity2D3DRegiBOBYQA>();
-    bobyqa_regi->set_opt_vars(se3_vars);
-    bobyqa_regi->set_opt_x_tol(0.0001);
-    bobyqa_regi->set_opt_obj_fn_tol(0.0001);
-    bobyqa_regi->set_bounds({ 2.5 * kDEG2RAD, 2.5 * kDEG2RAD, 2.5 * kDEG2RAD,
-                              5, 5, 10 });
-    
-    lvl.regis[0].regi = bobyqa_regi;
-  }
+  res.all_levels = all_levels;
 
-  if (save_debug)
+  if (run_server)
   {
-    vout << "  setting regi debug info..." << std::endl;
-
-    DebugRegiResultsMultiLevel::VolPathInfo debug_vol_path;
-    debug_vol_path.vol_path = ct_path;
-    
-    if (use_seg)
-    {
-      debug_vol_path.label_vol_path = seg_path;
-      debug_vol_path.labels_used    = { pelvis_label };
-    }
-    
-    ml_mo_regi.debug_info->vols = { debug_vol_path };
-
-    DebugRegiResultsMultiLevel::ProjDataPathInfo debug_proj_path;
-    debug_proj_path.path = proj_data_path;
-    debug_proj_path.projs_used = { proj_idx };
-
-    ml_mo_regi.debug_info->fixed_projs = debug_proj_path;
-    
-    ml_mo_regi.debug_info->proj_pre_proc_info = proj_preproc.params;
+    // keep the ray casters, sim metrics and regi objects for the next request
+    ml_mo_regi.dealloc_resources = false;
 
-    ml_mo_regi.debug_info->regi_names = { { "CMA-ES" }, { "BOBYQA" } };
+    RunPelvisRegiServer(server_socket_path, &res, vout);
   }
+  else if (track)
+  {
+    RunPelvisTracking(po.pos_args()[2], po.pos_args()[3], po.get("init-pose").as_string(),
+                      po.get("track-search-scale").as_double(), po.get("track-const-vel").as_bool(),
+                      po, se3_vars, &res, vout);
+  }
+  else
+  {
+    PelvisRegiInputs inputs;
 
-  vout << "running regi..." << std::endl;
-  ml_mo_regi.run();
-
-  vout << "writing pose to disk..." << std::endl;
-  WriteITKAffineTransform(dst_pose_path, ml_mo_regi.cur_cam_to_vols[0]);
+    inputs.proj_data_path = po.pos_args()[2];
+    inputs.proj_idx       = po.get("proj-idx").as_uint32();
+    inputs.init_pose_path = po.get("init-pose").as_string();
+    inputs.dst_pose_path  = po.pos_args()[3];
+    inputs.dst_debug_path = (po.pos_args().size() > 4) ? po.pos_args()[4] : std::string();
 
-  if (save_debug)
-  {
-    vout << "writing debug info to disk..." << std::endl;
-    WriteMultiLevel2D3DRegiDebugToDisk(*ml_mo_regi.debug_info, dst_debug_path);
+    RunPelvisRegi(inputs, &res, vout);
   }
 
   vout << "exiting..." << std::endl;
@@ -22,6 +22,8 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+
 #include <fmt/format.h>
 
 #include <opencv2/imgcodecs.hpp>
@@ -54,6 +56,7 @@
 #include "xregSampleUtils.h"
 #include "xregSE3OptVars.h"
 #include "xregStringUtils.h"
+#include "xregTBBUtils.h"
 
 using namespace xreg;
 
@@ -449,6 +452,12 @@ int main(int argc, char* argv[])
          "Downsampling factor of each 2D projection dimension. 0.25 --> 4x downsampling in width AND height.")
     << 0.25;
 
+  po.add("num-concurrent", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32, "num-concurrent",
+         "Number of samples processed concurrently. The DRRs and depth maps of these samples are "
+         "rendered in the same ray casting batches, using ray casters that are allocated once, and "
+         "their edges are extracted and written to disk in parallel.")
+    << ProgOpts::uint32(16);
+
   po.add("rng-seed", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32, "rng-seed",
          "A seed for the RNG engine. A random seed is drawn from random device when this is not provided.");
 
@@ -491,6 +500,8 @@ int main(int argc, char* argv[])
 
   const bool no_prior = po.get("no-prior");
 
+  const size_type num_concurrent = po.get("num-concurrent").as_uint32();
+
   bool prior_only_sampling = false;
 
   if (sampling_method_str == "prior")
@@ -521,6 +532,12 @@ int main(int argc, char* argv[])
     return kEXIT_VAL_BAD_USE;
   }
 
+  if (num_concurrent < 1)
+  {
+    std::cerr << "number of concurrent samples must be positive!" << std::endl;
+    return kEXIT_VAL_BAD_USE;
+  }
+
   const double prior_rot_x_std_dev_deg = po.get("prior-rot-x-std-dev-deg");
   const double prior_rot_y_std_dev_deg = po.get("prior-rot-y-std-dev-deg");
   const double prior_rot_z_std_dev_deg = po.get("prior-rot-z-std-dev-deg");
@@ -720,8 +737,6 @@ int main(int argc, char* argv[])
 
   for (size_type sample_idx = 0; sample_idx < num_samples; ++sample_idx)
   {
-    vout << "processing sample index: " << sample_idx << std::endl;
-
     // convert pose parameters into a rigid transformation that is an offset from
     // ground truth with respect to the camera projective frame with a center of
     // rotation at the ground truth location of the volume centroid.
@@ -770,52 +785,73 @@ int main(int argc, char* argv[])
       cam_extrins_to_center_of_rot_in_proj_frame;
 
     sampled_cam_to_pelvis_vol.push_back(cam_extrins_to_vol);
+  }
+
+  // the ray casters are allocated with the first batch and reused for the
+  // remaining batches, unless the final batch has a different size
+  edge_creator.reuse_ray_casters = true;
+
+  for (size_type batch_start = 0; batch_start < num_samples; batch_start += num_concurrent)
+  {
+    const size_type batch_size = std::min(num_concurrent, num_samples - batch_start);
 
-    edge_creator.cam_wrt_vols = { cam_extrins_to_vol };
+    vout << "processing sample indices: [" << batch_start << ", "
+         << (batch_start + batch_size) << ")" << std::endl;
+
+    edge_creator.cam_wrt_vols.assign(sampled_cam_to_pelvis_vol.begin() + batch_start,
+                                     sampled_cam_to_pelvis_vol.begin() + batch_start + batch_size);
 
     vout << "  creating edges..." << std::endl;
     edge_creator();
 
-    const std::string sample_idx_str = fmt::format("{:03d}", sample_idx);
-
-    auto drr_img = edge_creator.line_int_ray_caster->proj(0);
+    RayCaster::ProjList drr_imgs(batch_size);
 
-    if (need_to_rot_to_up)
+    for (size_type batch_idx = 0; batch_idx < batch_size; ++batch_idx)
     {
-      vout << "    rotating raw DRR to up..." << std::endl;
-      cv::Mat drr_orig = ShallowCopyItkToOpenCV(drr_img.GetPointer());
-      FlipImageColumns(&drr_orig);
-      FlipImageRows(&drr_orig);
+      drr_imgs[batch_idx] = edge_creator.line_int_ray_caster->proj(batch_idx);
     }
 
+    vout << "  saving DRRs and edges..." << std::endl;
+
+    auto write_sample_fn = [&] (const RangeType& r)
+    {
+      for (size_type batch_idx = r.begin(); batch_idx < r.end(); ++batch_idx)
+      {
+        const std::string sample_idx_str = fmt::format("{:03d}", batch_start + batch_idx);
+
+        auto& drr_img = drr_imgs[batch_idx];
+
+        if (need_to_rot_to_up)
+        {
+          cv::Mat drr_orig = ShallowCopyItkToOpenCV(drr_img.GetPointer());
+          FlipImageColumns(&drr_orig);
+          FlipImageRows(&drr_orig);
+        }
 
-    vout << "  saving raw DRR..." << std::endl;
-    WriteITKImageToDisk(drr_img.GetPointer(), fmt::format("{}/drr_raw_{}.nii.gz", dst_dir_path, sample_idx_str));
+        WriteITKImageToDisk(drr_img.GetPointer(), fmt::format("{}/drr_raw_{}.nii.gz", dst_dir_path, sample_idx_str));
 
-    vout << "  remapping DRR..." << std::endl;
-    cv::Mat drr_img_remap = ShallowCopyItkToOpenCV(ITKImageRemap8bpp(drr_img.GetPointer()).GetPointer()).clone();
+        cv::Mat drr_img_remap = ShallowCopyItkToOpenCV(ITKImageRemap8bpp(drr_img.GetPointer()).GetPointer()).clone();
 
-    vout << "  saving DRR remap..." << std::endl;
-    cv::imwrite(fmt::format("{}/drr_remap_{}.png", dst_dir_path, sample_idx_str), drr_img_remap);
+        cv::imwrite(fmt::format("{}/drr_remap_{}.png", dst_dir_path, sample_idx_str), drr_img_remap);
 
-    cv::Mat edges_ocv = ShallowCopyItkToOpenCV(edge_creator.final_edge_img.GetPointer());
-    edges_ocv *= 255;  // useful for verifying output png has edges
-    
-    if (need_to_rot_to_up)
-    {
-      vout << "    rotating edges to up..." << std::endl;
-      FlipImageColumns(&edges_ocv);
-      FlipImageRows(&edges_ocv);
-    }
+        cv::Mat edges_ocv = ShallowCopyItkToOpenCV(edge_creator.final_edge_imgs[batch_idx].GetPointer());
+        edges_ocv *= 255;  // useful for verifying output png has edges
+        
+        if (need_to_rot_to_up)
+        {
+          FlipImageColumns(&edges_ocv);
+          FlipImageRows(&edges_ocv);
+        }
 
-    vout << "  saving edges..." << std::endl;
-    cv::imwrite(fmt::format("{}/edges_{}.png", dst_dir_path, sample_idx_str), edges_ocv);
+        cv::imwrite(fmt::format("{}/edges_{}.png", dst_dir_path, sample_idx_str), edges_ocv);
 
-    vout << "  overlaying edges to projection..." << std::endl;
-    cv::Mat edge_overlay_img = OverlayEdges(proj_remap, edges_ocv, 1);
-    
-    vout << "  saving edges overlay..." << std::endl;
-    cv::imwrite(fmt::format("{}/edges_overlay_{}.png", dst_dir_path, sample_idx_str), edge_overlay_img);
+        cv::Mat edge_overlay_img = OverlayEdges(proj_remap, edges_ocv, 1);
+        
+        cv::imwrite(fmt::format("{}/edges_overlay_{}.png", dst_dir_path, sample_idx_str), edge_overlay_img);
+      }
+    };
+
+    ParallelFor(write_sample_fn, RangeType(0, batch_size));
   }
 
   vout << "writing offset CSV file..." << std::endl;
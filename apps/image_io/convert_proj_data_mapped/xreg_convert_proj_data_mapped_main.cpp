@@ -0,0 +1,101 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregProgOptUtils.h"
+#include "xregMappedProjData.h"
+
+int main(int argc, char* argv[])
+{
+  using namespace xreg;
+
+  constexpr int kEXIT_VAL_SUCCESS = 0;
+  constexpr int kEXIT_VAL_BAD_USE = 1;
+
+  ProgOpts po;
+
+  xregPROG_OPTS_SET_COMPILE_DATE(po);
+
+  po.set_help("Convert between an HDF5 projection data file and an uncompressed projection "
+              "data file which may be memory mapped. When mapped, the projection images "
+              "reference the file pixels directly, without copying, and multiple processes "
+              "on a single node share one copy of the pixels in the page cache. "
+              "Only the camera models and images are stored in a mapped file; landmarks "
+              "and other metadata are discarded. "
+              "By default, the input is HDF5 and the output is a mapped file; pass --to-h5 "
+              "to convert a mapped file to HDF5.");
+  po.set_arg_usage("<Input Proj. Data> <Output Proj. Data>");
+
+  po.set_min_num_pos_args(2);
+
+  po.add("to-h5", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_TRUE, "to-h5",
+         "Convert a mapped projection data file into HDF5.")
+    << false;
+
+  po.add("no-compress", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_TRUE, "no-compress",
+         "Do not compress the pixels when writing HDF5.")
+    << false;
+
+  try
+  {
+    po.parse(argc, argv);
+  }
+  catch (const xreg::ProgOpts::Exception& e)
+  {
+    std::cerr << "Error parsing command line arguments: " << e.what() << std::endl;
+    po.print_usage(std::cerr);
+    return kEXIT_VAL_BAD_USE;
+  }
+
+  if (po.help_set())
+  {
+    po.print_usage(std::cout);
+    po.print_help(std::cout);
+    return kEXIT_VAL_SUCCESS;
+  }
+
+  const std::string src_path = po.pos_args()[0];
+  const std::string dst_path = po.pos_args()[1];
+
+  const bool to_h5 = po.get("to-h5");
+
+  const bool compress = !po.get("no-compress").as_bool();
+
+  std::ostream& vout = po.vout();
+
+  if (to_h5)
+  {
+    vout << "converting mapped proj. data to HDF5..." << std::endl;
+    ConvertProjDataMappedToH5(src_path, dst_path, compress);
+  }
+  else
+  {
+    vout << "converting HDF5 proj. data to mapped..." << std::endl;
+    ConvertProjDataH5ToMapped(src_path, dst_path);
+  }
+
+  vout << "exiting..." << std::endl;
+
+  return kEXIT_VAL_SUCCESS;
+}
+
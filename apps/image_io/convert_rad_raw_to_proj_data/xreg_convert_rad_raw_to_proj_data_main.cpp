@@ -22,9 +22,11 @@
  * SOFTWARE.
  */
 
+#include "xregBackgroundTaskQueue.h"
 #include "xregProgOptUtils.h"
 #include "xregH5ProjDataIO.h"
 #include "xregRadRawProj.h"
+#include "xregTBBUtils.h"
 
 using namespace xreg;
 
@@ -70,20 +72,55 @@ int main(int argc, char* argv[])
 
   vout << "number of .rad files to read: " << num_rad_files << std::endl;
 
-  ProjDataF32List pd;
-  pd.reserve(num_rad_files);
+  ProjDataH5Writer writer(dst_pd_path);
 
-  for (size_type i = 0; i < num_rad_files; ++i)
   {
-    const std::string& cur_rad_path = po.pos_args()[i+1]; 
+    // Batches of .rad/.raw files are parsed and read concurrently, while a single
+    // background thread writes the previous projections to HDF5 (HDF5 calls
+    // are not made concurrently). At most two batches are held in memory.
+    constexpr size_type kNUM_PROJS_PER_BATCH = 16;
 
-    vout << "reading .rad file #" << (i + 1) << ": " << cur_rad_path << std::endl;
+    BackgroundTaskQueue write_queue(1);
+    write_queue.set_max_num_queued_tasks(kNUM_PROJS_PER_BATCH);
 
-    pd.push_back(ReadRawProjAsProjData(cur_rad_path));
+    ProjDataF32List batch_pd;
+
+    for (size_type batch_start = 0; batch_start < num_rad_files;
+         batch_start += kNUM_PROJS_PER_BATCH)
+    {
+      const size_type batch_len = std::min(kNUM_PROJS_PER_BATCH, num_rad_files - batch_start);
+
+      for (size_type i = 0; i < batch_len; ++i)
+      {
+        vout << "reading .rad file #" << (batch_start + i + 1) << ": "
+             << po.pos_args()[batch_start + i + 1] << std::endl;
+      }
+
+      batch_pd.assign(batch_len, ProjDataF32());
+
+      ParallelFor([&] (const RangeType& r)
+      {
+        for (size_type i = r.begin(); i < r.end(); ++i)
+        {
+          batch_pd[i] = ReadRawProjAsProjData(po.pos_args()[batch_start + i + 1]);
+        }
+      }, RangeType(0, batch_len));
+
+      vout << "streaming projections to proj data HDF5..." << std::endl;
+
+      for (auto& pd : batch_pd)
+      {
+        write_queue.add([&writer,pd] () { writer.write(pd); });
+      }
+
+      // the queued tasks hold the only references to the projections
+      batch_pd.clear();
+    }
+
+    write_queue.wait();
   }
-  
-  vout << "saving to proj data HDF5..." << std::endl;
-  WriteProjDataH5ToDisk(pd, dst_pd_path);
+
+  writer.close();
 
   vout << "exiting..." << std::endl;
   return kEXIT_VAL_SUCCESS;
@@ -22,11 +22,15 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+#include <cmath>
 #include <memory>
 
 #include <fmt/format.h>
 
 #include <itkImageFileReader.h>
+#include <itkImageFileWriter.h>
+#include <itkImageSource.h>
 #include <itkGDCMImageIO.h>
 #include <itkResampleImageFilter.h>
 #include <itkIdentityTransform.h>
@@ -45,9 +49,401 @@
 #include "xregStringUtils.h"
 #include "xregVariableSpacedSlices.h"
 #include "xregCSVUtils.h"
+#include "xregTBBUtils.h"
 
 using namespace xreg;
 
+// Computes the smoothing variances, in pixels, to apply prior to downsampling
+// in each dimension. Returns true when downsampling in at least one dimension.
+bool ComputeSmoothOnDSVariances(const double ds_factors[3],
+                                const double smooth_sigma_x,
+                                const double smooth_sigma_y,
+                                const double smooth_sigma_z,
+                                double sigma[3],
+                                std::ostream& vout)
+{
+  bool is_ds = false;
+
+  const char dim_names[3] = { 'X', 'Y', 'Z' };
+  const char lower_dim_names[3] = { 'x', 'y', 'z' };
+
+  const double user_sigmas[3] = { smooth_sigma_x, smooth_sigma_y, smooth_sigma_z };
+
+  for (size_type d = 0; d < 3; ++d)
+  {
+    sigma[d] = 0;
+
+    if ((ds_factors[d] - 1.0) < -1.0e-6)
+    {
+      vout << "downsampling in the " << dim_names[d] << " dimension, factor: "
+           << ds_factors[d] << std::endl;
+
+      is_ds = true;
+
+      if (user_sigmas[d] > 1.0e-6)
+      {
+        sigma[d] = user_sigmas[d];
+      }
+      else
+      {
+        sigma[d] = 0.5 / ds_factors[d];
+        vout << "auto sigma_" << lower_dim_names[d] << " = " << sigma[d] << std::endl;
+      }
+    }
+  }
+
+  if (is_ds)
+  {
+    // std. dev. -> variance
+    sigma[0] *= sigma[0];
+    sigma[1] *= sigma[1];
+    sigma[2] *= sigma[2];
+  }
+
+  return is_ds;
+}
+
+// Reads a DICOM slice into a buffer of a 3D volume
+template <class T>
+void ReadDICOMSliceIntoBuffer(const std::string& path, const size_type num_in_plane_pixels, T* dst_buf)
+{
+  using SliceType = itk::Image<T,2>;
+
+  using SliceReader = itk::ImageFileReader<SliceType>;
+  typename SliceReader::Pointer slice_reader = SliceReader::New();
+  slice_reader->SetFileName(path);
+
+  itk::GDCMImageIO::Pointer gdcm_io = itk::GDCMImageIO::New();
+  slice_reader->SetImageIO(gdcm_io);
+
+  slice_reader->Update();
+
+  memcpy(dst_buf, slice_reader->GetOutput()->GetBufferPointer(), sizeof(T) * num_in_plane_pixels);
+}
+
+/// \brief Pipeline source which reads, smooths and resamples a DICOM series with
+///        a constant slice spacing, one slab of output slices at a time.
+///
+/// Only the input slices needed by a slab are read, so when connected to a streaming
+/// writer, memory use is proportional to the slab size and the number of slabs
+/// processed concurrently, instead of the size of the entire series.
+template <class T>
+class DICOMSlabResampleSource : public itk::ImageSource<itk::Image<T,3>>
+{
+public:
+  using Self       = DICOMSlabResampleSource;
+  using Superclass = itk::ImageSource<itk::Image<T,3>>;
+  using Pointer    = itk::SmartPointer<Self>;
+
+  using VolumeType = itk::Image<T,3>;
+
+  itkNewMacro(Self);
+
+  itkTypeMacro(DICOMSlabResampleSource, itk::ImageSource);
+
+  const DICOMFIleBasicFieldsList* dcm_infos = nullptr;
+
+  Mat3x3 img_dir_mat;
+
+  CoordScalar src_slice_spacing = 1;
+
+  typename VolumeType::RegionType dst_region;
+
+  typename VolumeType::SpacingType dst_spacing;
+
+  std::string interp_name;
+
+  T default_pixel_val = 0;
+
+  // smoothing variances in pixels, no smoothing is performed when all are zero
+  double smooth_var[3] = { 0, 0, 0 };
+
+  size_type slab_num_slices = 16;
+
+  size_type num_par_slabs = 1;
+
+protected:
+  DICOMSlabResampleSource() { }
+
+  ~DICOMSlabResampleSource() { }
+
+  void GenerateOutputInformation() override
+  {
+    VolumeType* out = this->GetOutput();
+
+    out->SetLargestPossibleRegion(dst_region);
+    out->SetSpacing(dst_spacing);
+
+    SetITKOriginPoint(out, (*dcm_infos)[0].img_pos_wrt_pat);
+    SetITKDirectionMatrix(out, img_dir_mat);
+  }
+
+  void GenerateData() override
+  {
+    VolumeType* out = this->GetOutput();
+
+    const auto out_region = out->GetRequestedRegion();
+
+    out->SetBufferedRegion(out_region);
+    out->Allocate();
+
+    const size_type z_begin = out_region.GetIndex(2);
+    const size_type z_end   = z_begin + out_region.GetSize(2);
+
+    const size_type num_slabs = (z_end - z_begin + slab_num_slices - 1) / slab_num_slices;
+
+    // each batch of slabs is processed concurrently
+    for (size_type batch_begin = 0; batch_begin < num_slabs; batch_begin += num_par_slabs)
+    {
+      const size_type batch_end = std::min(batch_begin + num_par_slabs, num_slabs);
+
+      auto slab_fn = [this,out,z_begin,z_end] (const RangeType& r)
+      {
+        for (size_type slab_idx = r.begin(); slab_idx < r.end(); ++slab_idx)
+        {
+          const size_type slab_z_begin = z_begin + (slab_idx * slab_num_slices);
+
+          this->resample_slab(out, slab_z_begin,
+                              std::min(slab_z_begin + slab_num_slices, z_end));
+        }
+      };
+
+      ParallelFor(slab_fn, RangeType(batch_begin, batch_end));
+    }
+  }
+
+private:
+  DICOMSlabResampleSource(const Self&);
+  Self& operator=(const Self&);
+
+  void resample_slab(VolumeType* out, const size_type slab_z_begin, const size_type slab_z_end) const
+  {
+    using IdentityTransformType = itk::IdentityTransform<double, 3>;
+    using ResampleFilterType    = itk::ResampleImageFilter<VolumeType, VolumeType>;
+    using NNInterpFn            = itk::NearestNeighborInterpolateImageFunction<VolumeType>;
+    using LinearInterpFn        = itk::LinearInterpolateImageFunction<VolumeType>;
+    using BSplineInterpFn       = itk::BSplineInterpolateImageFunction<VolumeType>;
+    using SmoothFilter          = itk::DiscreteGaussianImageFilter<VolumeType,VolumeType>;
+
+    const auto& first_dcm = (*dcm_infos)[0];
+
+    const size_type src_num_slices = dcm_infos->size();
+    const size_type src_num_rows   = first_dcm.num_rows;
+    const size_type src_num_cols   = first_dcm.num_cols;
+
+    const size_type num_in_plane_pixels = src_num_rows * src_num_cols;
+
+    const bool do_smooth = (smooth_var[0] > 0) || (smooth_var[1] > 0) || (smooth_var[2] > 0);
+
+    typename SmoothFilter::Pointer smoother;
+
+    if (do_smooth)
+    {
+      smoother = SmoothFilter::New();
+      smoother->SetUseImageSpacing(false);
+      smoother->SetVariance(smooth_var);
+    }
+
+    // Number of extra input slices read on each side of the slab, these must cover
+    // the interpolation support and the smoothing kernel radius, so that pixels are
+    // identical to those computed from the entire volume. The B-spline coefficients
+    // are computed with a recursive filter over the entire input and are not strictly
+    // local, the additional slices make the truncation error negligible.
+    size_type pad_num_slices = (interp_name == "nn") ? 1 : ((interp_name == "linear") ? 1 : 10);
+
+    if (do_smooth)
+    {
+      pad_num_slices += smoother->GetMaximumKernelWidth() / 2;
+    }
+
+    const double dst_to_src_slice = dst_spacing[2] / src_slice_spacing;
+
+    const long src_first_needed = static_cast<long>(std::floor(slab_z_begin * dst_to_src_slice)) -
+                                    static_cast<long>(pad_num_slices);
+    const long src_last_needed  = static_cast<long>(std::ceil((slab_z_end - 1) * dst_to_src_slice)) +
+                                    static_cast<long>(pad_num_slices);
+
+    const size_type src_slice_begin = static_cast<size_type>(std::max(0l, src_first_needed));
+    const size_type src_slice_end   = std::min(static_cast<size_type>(std::max(0l, src_last_needed + 1)),
+                                               src_num_slices);
+
+    xregASSERT(src_slice_begin < src_slice_end);
+
+    const size_type src_slab_num_slices = src_slice_end - src_slice_begin;
+
+    typename VolumeType::Pointer src_vol = VolumeType::New();
+
+    typename VolumeType::RegionType src_region;
+    src_region.SetSize(0, src_num_cols);
+    src_region.SetSize(1, src_num_rows);
+    src_region.SetSize(2, src_slab_num_slices);
+    src_region.SetIndex(0, 0);
+    src_region.SetIndex(1, 0);
+    src_region.SetIndex(2, 0);
+    src_vol->SetRegions(src_region);
+
+    typename VolumeType::SpacingType src_spacing;
+    src_spacing[0] = first_dcm.col_spacing;
+    src_spacing[1] = first_dcm.row_spacing;
+    src_spacing[2] = src_slice_spacing;
+    src_vol->SetSpacing(src_spacing);
+
+    SetITKOriginPoint(src_vol.GetPointer(),
+                      Pt3(first_dcm.img_pos_wrt_pat +
+                          (img_dir_mat.col(2) * (src_slice_spacing * src_slice_begin))));
+
+    SetITKDirectionMatrix(src_vol.GetPointer(), img_dir_mat);
+
+    src_vol->Allocate();
+
+    T* src_buf = src_vol->GetBufferPointer();
+
+    auto read_fn = [this,src_buf,src_slice_begin,num_in_plane_pixels] (const RangeType& r)
+    {
+      for (size_type i = r.begin(); i < r.end(); ++i)
+      {
+        ReadDICOMSliceIntoBuffer((*dcm_infos)[src_slice_begin + i].file_path, num_in_plane_pixels,
+                                 src_buf + (num_in_plane_pixels * i));
+      }
+    };
+
+    ParallelFor(read_fn, RangeType(0, src_slab_num_slices));
+
+    if (do_smooth)
+    {
+      smoother->SetInput(src_vol);
+      smoother->Update();
+
+      src_vol = smoother->GetOutput();
+    }
+
+    const auto& out_region = out->GetBufferedRegion();
+
+    typename VolumeType::IndexType slab_start_idx = out_region.GetIndex();
+    slab_start_idx[2] = slab_z_begin;
+
+    typename VolumeType::PointType slab_origin;
+    out->TransformIndexToPhysicalPoint(slab_start_idx, slab_origin);
+
+    typename VolumeType::SizeType slab_size = out_region.GetSize();
+    slab_size[2] = slab_z_end - slab_z_begin;
+
+    IdentityTransformType::Pointer id_xform = IdentityTransformType::New();
+
+    typename ResampleFilterType::Pointer resampler = ResampleFilterType::New();
+    resampler->SetInput(src_vol);
+    resampler->SetTransform(id_xform);
+    resampler->SetOutputOrigin(slab_origin);
+    resampler->SetOutputSpacing(dst_spacing);
+    resampler->SetOutputDirection(src_vol->GetDirection());
+    resampler->SetSize(slab_size);
+    resampler->SetDefaultPixelValue(default_pixel_val);
+
+    if (interp_name == "nn")
+    {
+      typename NNInterpFn::Pointer nn_interp = NNInterpFn::New();
+      resampler->SetInterpolator(nn_interp);
+    }
+    else if (interp_name == "linear")
+    {
+      typename LinearInterpFn::Pointer linear_interp = LinearInterpFn::New();
+      resampler->SetInterpolator(linear_interp);
+    }
+    else
+    {
+      typename BSplineInterpFn::Pointer spline_interp = BSplineInterpFn::New();
+      spline_interp->SetSplineOrder(3);
+
+      resampler->SetInterpolator(spline_interp);
+    }
+
+    resampler->Update();
+
+    // the slab spans the entire in-plane extent of the buffered region, so it is
+    // contiguous in the output buffer
+    const size_type num_slab_slice_pixels = slab_size[0] * slab_size[1];
+
+    memcpy(out->GetBufferPointer() +
+              (num_slab_slice_pixels * (slab_z_begin - out_region.GetIndex(2))),
+           resampler->GetOutput()->GetBufferPointer(),
+           sizeof(T) * num_slab_slice_pixels * slab_size[2]);
+  }
+};
+
+// Resamples a series with constant slice spacing and writes it to disk, processing
+// slabs of output slices so that the entire series is never stored in memory.
+template <class T>
+void StreamDICOMPixelsResampleAndWriteVolume(const DICOMFIleBasicFieldsList& dcm_infos,
+                                             const Mat3x3& img_dir_mat,
+                                             const typename itk::Image<T,3>::RegionType& dst_region,
+                                             const typename itk::Image<T,3>::SpacingType& dst_spacing,
+                                             const CoordScalar src_slice_spacing,
+                                             const std::string& interp_name,
+                                             const T default_pixel_val,
+                                             const bool smooth_on_ds,
+                                             const double smooth_sigma_x,
+                                             const double smooth_sigma_y,
+                                             const double smooth_sigma_z,
+                                             const std::string& img_path,
+                                             const size_type slab_num_slices,
+                                             const size_type num_par_slabs,
+                                             std::ostream& vout)
+{
+  using VolumeType = itk::Image<T,3>;
+  using SlabSource = DICOMSlabResampleSource<T>;
+  using Writer     = itk::ImageFileWriter<VolumeType>;
+
+  vout << "setting up streaming slab resampling..." << std::endl;
+
+  typename SlabSource::Pointer slab_src = SlabSource::New();
+
+  slab_src->dcm_infos = &dcm_infos;
+
+  slab_src->img_dir_mat       = img_dir_mat;
+  slab_src->src_slice_spacing = src_slice_spacing;
+  slab_src->dst_region        = dst_region;
+  slab_src->dst_spacing       = dst_spacing;
+  slab_src->interp_name       = interp_name;
+  slab_src->default_pixel_val = default_pixel_val;
+  slab_src->slab_num_slices   = slab_num_slices;
+  slab_src->num_par_slabs     = std::max(size_type(1), num_par_slabs);
+
+  if (smooth_on_ds)
+  {
+    const auto& first_dcm = dcm_infos[0];
+
+    const double ds_factors[3] = { first_dcm.col_spacing / dst_spacing[0],
+                                   first_dcm.row_spacing / dst_spacing[1],
+                                   src_slice_spacing / dst_spacing[2] };
+
+    ComputeSmoothOnDSVariances(ds_factors, smooth_sigma_x, smooth_sigma_y, smooth_sigma_z,
+                               slab_src->smooth_var, vout);
+  }
+
+  const size_type dst_num_slices = dst_region.GetSize(2);
+
+  const size_type slices_per_div = slab_num_slices * slab_src->num_par_slabs;
+
+  const size_type num_stream_divs = (dst_num_slices + slices_per_div - 1) / slices_per_div;
+
+  vout << "number of output stream divisions: " << num_stream_divs << std::endl;
+
+  typename Writer::Pointer writer = Writer::New();
+  writer->SetInput(slab_src->GetOutput());
+  writer->SetFileName(img_path);
+  writer->SetNumberOfStreamDivisions(num_stream_divs);
+
+  // Compressed files cannot be written incrementally, so compression is not
+  // enabled for formats (e.g. MHD) where it is optional. Formats which are
+  // always compressed, or do not support streamed writing, are written after
+  // every slab has been resampled into memory, however, the input is still
+  // only read one slab at a time.
+  writer->UseCompressionOff();
+
+  vout << "resampling and writing slabs..." << std::endl;
+  writer->Update();
+}
+
 template <class T>
 void ReadDICOMPixelsResampleAndWriteVolume(const DICOMFIleBasicFieldsList& dcm_infos,
                                            const double dst_rs,
@@ -65,6 +461,8 @@ void ReadDICOMPixelsResampleAndWriteVolume(const DICOMFIleBasicFieldsList& dcm_i
                                            const double smooth_sigma_y,
                                            const double smooth_sigma_z,
                                            const bool force_no_compression,
+                                           const size_type stream_slab_num_slices,
+                                           const size_type stream_num_par_slabs,
                                            std::ostream& vout)
 {
   using VolumeType = itk::Image<T,3>;
@@ -88,6 +486,8 @@ void ReadDICOMPixelsResampleAndWriteVolume(const DICOMFIleBasicFieldsList& dcm_i
   const size_type src_num_rows = dcm_infos[0].num_rows;
   const size_type src_num_cols = dcm_infos[0].num_cols;
 
+  const size_type src_num_slices = dcm_infos.size();
+
   const size_type num_in_plane_pixels = src_num_rows * src_num_cols;
 
   Pt3 in_plane_col_dir = dcm_infos[0].col_dir;
@@ -232,12 +632,78 @@ void ReadDICOMPixelsResampleAndWriteVolume(const DICOMFIleBasicFieldsList& dcm_i
   img_dir_mat.block(0,1,3,1) = in_plane_row_dir;
   img_dir_mat.block(0,2,3,1) = out_of_plane_dir;
 
+  vout << "calculating destination image dimensions and geometry..." << std::endl;
+
+  const bool keep_src_row_spacing   = dst_rs < 1.0e-6;
+  const bool keep_src_col_spacing   = dst_cs < 1.0e-6;
+  const bool keep_src_slice_spacing = dst_ss < 1.0e-6;
+
+  const bool keep_src_all_spacing = keep_src_slice_spacing &&
+                                    keep_src_row_spacing   &&
+                                    keep_src_col_spacing;
+
+  const CoordScalar src_first_slice_spacing = 
+                              (dcm_infos[1].img_pos_wrt_pat[out_of_plane_axis_dim] -
+                               dcm_infos[0].img_pos_wrt_pat[out_of_plane_axis_dim]);
+
+  const CoordScalar dst_row_spacing   = keep_src_row_spacing ? src_row_spacing : dst_rs;
+  const CoordScalar dst_col_spacing   = keep_src_col_spacing ? src_col_spacing : dst_cs;
+  const CoordScalar dst_slice_spacing = keep_src_slice_spacing ?
+                                              src_first_slice_spacing : dst_ss;
+
+  const size_type dst_num_rows = static_cast<size_type>(
+                           (src_num_rows * src_row_spacing / dst_row_spacing) + 0.5);
+  
+  const size_type dst_num_cols = static_cast<size_type>(
+                           (src_num_cols * src_col_spacing / dst_col_spacing) + 0.5);
+  
+  const size_type dst_num_slices = 1 + static_cast<size_type>(
+((dcm_infos[src_num_slices - 1].img_pos_wrt_pat[out_of_plane_axis_dim] -
+  dcm_infos[0].img_pos_wrt_pat[out_of_plane_axis_dim]) / dst_slice_spacing) + 0.5);
+
+  vout << "Output Size:"
+       << "\n       Num Rows: " << dst_num_rows
+       << "\n       Num Cols: " << dst_num_cols
+       << "\n     Num Slices: " << dst_num_slices
+       << "\n    Row Spacing: " << dst_row_spacing
+       << "\n    Col Spacing: " << dst_col_spacing
+       << "\n  Slice Spacing: " << dst_slice_spacing
+       << std::endl;
+
+   // set the output size
+   typename VolumeType::RegionType itk_img_region;
+   itk_img_region.SetSize(0, dst_num_cols);
+   itk_img_region.SetSize(1, dst_num_rows);
+   itk_img_region.SetSize(2, dst_num_slices);
+   itk_img_region.SetIndex(0, 0);
+   itk_img_region.SetIndex(1, 0);
+   itk_img_region.SetIndex(2, 0);
+
+  // set the output spacing
+  typename VolumeType::SpacingType itk_img_spacing;
+  itk_img_spacing[0] = dst_col_spacing;
+  itk_img_spacing[1] = dst_row_spacing;
+  itk_img_spacing[2] = dst_slice_spacing;
+
+  if (const_out_of_plane_spacing && stream_slab_num_slices)
+  {
+    StreamDICOMPixelsResampleAndWriteVolume<T>(dcm_infos, img_dir_mat,
+                                               itk_img_region, itk_img_spacing,
+                                               src_first_slice_spacing,
+                                               keep_src_all_spacing ? std::string("nn") : interp_name,
+                                               default_pixel_val,
+                                               smooth_on_ds && !keep_src_all_spacing,
+                                               smooth_sigma_x, smooth_sigma_y, smooth_sigma_z,
+                                               img_path,
+                                               stream_slab_num_slices, stream_num_par_slabs,
+                                               vout);
+    return;
+  }
+
   VolumePointer src_vol;
 
   VolumePointer dst_vol;
 
-  const size_type src_num_slices = dcm_infos.size();
-
   std::vector<SlicePointer> slices;
   std::vector<CoordScalar> slice_pos(src_num_slices);
 
@@ -345,59 +811,6 @@ void ReadDICOMPixelsResampleAndWriteVolume(const DICOMFIleBasicFieldsList& dcm_i
     }
   }
 
-  vout << "calculating destination image dimensions and geometry..." << std::endl;
-
-  const bool keep_src_row_spacing   = dst_rs < 1.0e-6;
-  const bool keep_src_col_spacing   = dst_cs < 1.0e-6;
-  const bool keep_src_slice_spacing = dst_ss < 1.0e-6;
-
-  const bool keep_src_all_spacing = keep_src_slice_spacing &&
-                                    keep_src_row_spacing   &&
-                                    keep_src_col_spacing;
-
-  const CoordScalar src_first_slice_spacing = 
-                              (dcm_infos[1].img_pos_wrt_pat[out_of_plane_axis_dim] -
-                               dcm_infos[0].img_pos_wrt_pat[out_of_plane_axis_dim]);
-
-  const CoordScalar dst_row_spacing   = keep_src_row_spacing ? src_row_spacing : dst_rs;
-  const CoordScalar dst_col_spacing   = keep_src_col_spacing ? src_col_spacing : dst_cs;
-  const CoordScalar dst_slice_spacing = keep_src_slice_spacing ?
-                                              src_first_slice_spacing : dst_ss;
-
-  const size_type dst_num_rows = static_cast<size_type>(
-                           (src_num_rows * src_row_spacing / dst_row_spacing) + 0.5);
-  
-  const size_type dst_num_cols = static_cast<size_type>(
-                           (src_num_cols * src_col_spacing / dst_col_spacing) + 0.5);
-  
-  const size_type dst_num_slices = 1 + static_cast<size_type>(
-((dcm_infos[src_num_slices - 1].img_pos_wrt_pat[out_of_plane_axis_dim] -
-  dcm_infos[0].img_pos_wrt_pat[out_of_plane_axis_dim]) / dst_slice_spacing) + 0.5);
-
-  vout << "Output Size:"
-       << "\n       Num Rows: " << dst_num_rows
-       << "\n       Num Cols: " << dst_num_cols
-       << "\n     Num Slices: " << dst_num_slices
-       << "\n    Row Spacing: " << dst_row_spacing
-       << "\n    Col Spacing: " << dst_col_spacing
-       << "\n  Slice Spacing: " << dst_slice_spacing
-       << std::endl;
-
-   // set the output size
-   typename VolumeType::RegionType itk_img_region;
-   itk_img_region.SetSize(0, dst_num_cols);
-   itk_img_region.SetSize(1, dst_num_rows);
-   itk_img_region.SetSize(2, dst_num_slices);
-   itk_img_region.SetIndex(0, 0);
-   itk_img_region.SetIndex(1, 0);
-   itk_img_region.SetIndex(2, 0);
-
-  // set the output spacing
-  typename VolumeType::SpacingType itk_img_spacing;
-  itk_img_spacing[0] = dst_col_spacing;
-  itk_img_spacing[1] = dst_row_spacing;
-  itk_img_spacing[2] = dst_slice_spacing;
-
 
   if (const_out_of_plane_spacing)
   {
@@ -411,74 +824,15 @@ void ReadDICOMPixelsResampleAndWriteVolume(const DICOMFIleBasicFieldsList& dcm_i
     {
       if (smooth_on_ds)
       {
-        bool is_ds = false;
-
         double sigma[3] = { 0, 0, 0 };
 
         const double ds_factors[3] = { src_col_spacing / dst_col_spacing,
                                        src_row_spacing / dst_row_spacing,
-                               src_first_slice_spacing / dst_slice_spacing };                   
-        if ((ds_factors[0] - 1.0) < -1.0e-6)
-        {
-          vout << "downsampling in the X dimension, factor: " << ds_factors[0]
-               << std::endl;
-          
-          is_ds = true;
+                               src_first_slice_spacing / dst_slice_spacing };
 
-          if (smooth_sigma_x > 1.0e-6)
-          {
-            sigma[0] = smooth_sigma_x;
-          }
-          else
-          {
-            sigma[0] = 0.5 / ds_factors[0];
-            vout << "auto sigma_x = " << sigma[0] << std::endl;
-          }
-        }
-        
-        if ((ds_factors[1] - 1.0) < -1.0e-6)
-        {
-          vout << "downsampling in the Y dimension, factor: " << ds_factors[1]
-               << std::endl;
-          
-          is_ds = true;
-
-          if (smooth_sigma_y > 1.0e-6)
-          {
-            sigma[1] = smooth_sigma_y;
-          }
-          else
-          {
-            sigma[1] = 0.5 / ds_factors[1];
-            vout << "auto sigma_y = " << sigma[1] << std::endl;
-          }
-        }
-        
-        if ((ds_factors[2] - 1.0) < -1.0e-6)
+        if (ComputeSmoothOnDSVariances(ds_factors, smooth_sigma_x, smooth_sigma_y,
+                                       smooth_sigma_z, sigma, vout))
         {
-          vout << "downsampling in the Z dimension, factor: " << ds_factors[2]
-               << std::endl;
-          
-          is_ds = true;
-
-          if (smooth_sigma_z > 1.0e-6)
-          {
-            sigma[2] = smooth_sigma_z;
-          }
-          else
-          {
-            sigma[2] = 0.5 / ds_factors[2];
-            vout << "auto sigma_z = " << sigma[2] << std::endl;
-          }
-        }
-
-        if (is_ds)
-        {
-          // std. dev. -> variance
-          sigma[0] *= sigma[0];
-          sigma[1] *= sigma[1];
-          sigma[2] *= sigma[2];
-
           vout << "smoothing..." << std::endl;
 
           using SmoothFilter = itk::DiscreteGaussianImageFilter<VolumeType,VolumeType>;
@@ -717,6 +1071,22 @@ int main( int argc, char* argv[] )
          ".raw files to match with .mhd (the default is to write compressed .zraw).")
       << false;
 
+  po.add("stream-slab-slices", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32,
+         "stream-slab-slices",
+         "When non-zero, series with a constant slice spacing are resampled and written "
+         "in slabs of this many output slices, reading only the input slices needed for "
+         "each slab, instead of loading the entire series into memory. The output is "
+         "written uncompressed so that it may be streamed to disk; formats which do not "
+         "support streamed writing (e.g. NIFTI) still hold the entire output in memory. "
+         "Uncompressed MHD/MHA outputs are recommended. 0 -> disabled.")
+    << ProgOpts::uint32(0);
+
+  po.add("stream-par-slabs", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32,
+         "stream-par-slabs",
+         "The number of slabs resampled concurrently when streaming. Memory usage "
+         "is proportional to this value times the slab size.")
+    << ProgOpts::uint32(2);
+
   po.add("out-of-plane-upper", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE,
          "out-of-plane-upper",
          "Maximum physical value allowed in the out of plane direction; useful for "
@@ -799,6 +1169,13 @@ int main( int argc, char* argv[] )
          "and the second column are the new strings to be used.")
     << "";
 
+  po.add("dcm-index", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "dcm-index",
+         "Path to an HDF5 file storing an index of the DICOM files previously scanned. "
+         "Files with unchanged sizes and modification times are not parsed again and the "
+         "index is updated after scanning. The file is created when it does not exist. "
+         "An empty string (the default) disables the index.")
+    << "";
+
   try
   {
     po.parse(argc, argv);
@@ -897,6 +1274,9 @@ int main( int argc, char* argv[] )
 
   const bool force_no_compress = po.get("force-no-compress");
 
+  const size_type stream_slab_num_slices = po.get("stream-slab-slices").as_uint32();
+  const size_type stream_num_par_slabs   = po.get("stream-par-slabs").as_uint32();
+
   const bool has_out_of_plane_upper = po.has("out-of-plane-upper");
   const bool has_out_of_plane_lower = po.has("out-of-plane-lower");
 
@@ -931,6 +1311,8 @@ int main( int argc, char* argv[] )
 
   const std::string pat_id_lut_path = po.get("pat-lut");
 
+  const std::string dcm_index_path = po.get("dcm-index");
+
   const std::string modalities_to_consider_str = po.get("modalities");
 
   const auto modalities_to_consider = StringSplit(modalities_to_consider_str, ",");
@@ -1014,7 +1396,7 @@ int main( int argc, char* argv[] )
     GetOrgainizedDICOMInfos(input_root_dir, &org_dcm,
                             inc_localizers, inc_multiframe_files,
                             !exclude_secondary, !exclude_derived,
-                            modalities_to_consider);
+                            modalities_to_consider, dcm_index_path);
   }
   else
   {
@@ -1375,6 +1757,8 @@ int main( int argc, char* argv[] )
                                                             smooth_sigma_y,
                                                             smooth_sigma_z,
                                                             force_no_compress,
+                                                            stream_slab_num_slices,
+                                                            stream_num_par_slabs,
                                                             vout);
             }
             else
@@ -1395,6 +1779,8 @@ int main( int argc, char* argv[] )
                                                            smooth_sigma_y,
                                                            smooth_sigma_z,
                                                            force_no_compress,
+                                                           stream_slab_num_slices,
+                                                           stream_num_par_slabs,
                                                            vout);
             }
           }
@@ -24,11 +24,14 @@
 
 #include <fmt/format.h>
 
+#include "xregBackgroundTaskQueue.h"
 #include "xregFilesystemUtils.h"
 #include "xregH5ProjDataIO.h"
 #include "xregITKBasicImageUtils.h"
 #include "xregProgOptUtils.h"
+#include "xregRawFileReadUtils.h"
 #include "xregRTKGeom.h"
+#include "xregTBBUtils.h"
 
 using namespace xreg;
 
@@ -165,8 +168,6 @@ int main(int argc, char* argv[])
     return kEXIT_VAL_BAD_DATA;
   }
   
-  ProjDataF32List pd(num_projs);
-
   // The RTK geometry projects to physical points (e.g. in mm with origin at the center of the image),
   // this converts those into pixel indices (e.g. in pixels with origin at the corner pixel (0,0). 
   Mat3x3 intrins_phys_to_pixels = Mat3x3::Identity();
@@ -174,24 +175,35 @@ int main(int argc, char* argv[])
   intrins_phys_to_pixels(1,1) = CoordScalar(1) / ps;
   intrins_phys_to_pixels(0,2) = proj_num_cols / CoordScalar(2);
   intrins_phys_to_pixels(1,2) = proj_num_rows / CoordScalar(2);
-  
-  Mat3x3 K;
-  Mat4x4 H;
-  CoordScalar rho;
  
-  vout << "creating camera models for each proj..." << std::endl; 
-  for (size_type i = 0; i < num_projs; ++i)
+  auto proj_path = [&src_dir_path] (const size_type i)
   {
-    vout << fmt::format("  proj.: {:4d}", i) << std::endl;
+    return src_dir_path + fmt::format("Proj_{:05d}.bin", i+1);
+  };
 
-    std::tie(K,H,rho) = DecompProjMat(rtk_geom_info.proj_infos[i].cam_mat, true);
+  vout << "checking projection pixels files..." << std::endl;
+
+  for (size_type i = 0; i < num_projs; ++i)
+  {
+    const Path cur_proj_path = proj_path(i);
     
-    auto& cam = pd[i].cam;
+    if (!cur_proj_path.exists())
+    {
+      std::cerr << "ERROR: projection file does not exist: " << cur_proj_path.string()
+                << std::endl;
+      return kEXIT_VAL_BAD_DATA;
+    }
+
+    const size_type cur_file_size = RawFileNumBytes(cur_proj_path.string());
 
-    pd[i].cam.setup(intrins_phys_to_pixels * K, H, proj_num_rows, proj_num_cols, ps, ps);
-    xregASSERT(std::abs(pd[i].cam.focal_len - rtk_geom_info.src_to_det_dist_mm) < 1.0e-3f);
+    if (cur_file_size != proj_file_size)
+    {
+      std::cerr << "ERROR: proj. file size (" << cur_file_size
+                << ") does not match expected (" << proj_file_size  << "): "
+                << cur_proj_path.string() << std::endl;
+      return kEXIT_VAL_BAD_DATA;
+    }
   }
-  vout << "---------------------------------\n\n";
 
   const size_type tot_num_pix = proj_num_cols * proj_num_rows;
 
@@ -201,49 +213,87 @@ int main(int argc, char* argv[])
   using MatColMaj = Eigen::Matrix<float,Eigen::Dynamic,Eigen::Dynamic,Eigen::ColMajor|Eigen::DontAlign>;
   using MatRowMaj = Eigen::Matrix<float,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor|Eigen::DontAlign>;
 
-  MatColMaj tmp_proj_buf(proj_num_rows, proj_num_cols);
-
-  std::array<double,2> tmp_spacing = { static_cast<double>(ps), static_cast<double>(ps) };
-
-  vout << "reading projection pixels files..." << std::endl;
+  const std::array<double,2> tmp_spacing = { static_cast<double>(ps), static_cast<double>(ps) };
 
-  for (size_type i = 0; i < num_projs; ++i)
+  // Creates the camera model and reads the pixels of a single projection; this
+  // is called from worker threads.
+  auto read_proj = [&] (const size_type i)
   {
-    vout << fmt::format("  proj.: {:4d}", i) << std::endl;
+    ProjDataF32 pd;
+
+    Mat3x3 K;
+    Mat4x4 H;
+    CoordScalar rho;
 
-    const Path cur_proj_path = src_dir_path + fmt::format("Proj_{:05d}.bin", i+1);
+    std::tie(K,H,rho) = DecompProjMat(rtk_geom_info.proj_infos[i].cam_mat, true);
     
-    if (!cur_proj_path.exists())
-    {
-      std::cerr << "ERROR: projection file does not exist: " << cur_proj_path.string()
-                << std::endl;
-      return kEXIT_VAL_BAD_DATA;
-    }
+    pd.cam.setup(intrins_phys_to_pixels * K, H, proj_num_rows, proj_num_cols, ps, ps);
+    xregASSERT(std::abs(pd.cam.focal_len - rtk_geom_info.src_to_det_dist_mm) < 1.0e-3f);
 
-    FileInputStream fin(cur_proj_path.string());
+    MatColMaj tmp_proj_buf(proj_num_rows, proj_num_cols);
 
-    if (fin.num_bytes_left() != proj_file_size)
-    {
-      std::cerr << "ERROR: proj. file size (" << fin.num_bytes_left()
-                << ") does not match expected (" << proj_file_size  << "): "
-                << cur_proj_path.string() << std::endl;
-      return kEXIT_VAL_BAD_DATA;
-    }
+    ReadRawFileAsType<float>(proj_path(i).string(), &tmp_proj_buf(0,0), tot_num_pix);
     
     auto img = MakeITK2DVol<float>(proj_num_cols, proj_num_rows);
     
     img->SetSpacing(tmp_spacing.data());
 
-    fin.read(&tmp_proj_buf(0,0), tot_num_pix);
-    
     Eigen::Map<MatRowMaj> dst_proj_buf(img->GetBufferPointer(), proj_num_rows, proj_num_cols);
     dst_proj_buf = tmp_proj_buf;
 
-    pd[i].img = img;
+    pd.img = img;
+
+    return pd;
+  };
+
+  vout << "converting projections and streaming to proj data HDF5..." << std::endl;
+  
+  ProjDataH5Writer writer(dst_pd_path);
+
+  {
+    // Batches of projections are read and converted concurrently, while a single
+    // background thread writes the previous projections to HDF5 (HDF5 calls
+    // are not made concurrently). The number of bytes waiting to be written is
+    // bounded, so memory usage does not grow with the number of projections.
+    constexpr size_type kNUM_PROJS_PER_BATCH = 16;
+
+    const size_type proj_num_bytes = sizeof(float) * tot_num_pix;
+
+    BackgroundTaskQueue write_queue(1);
+    write_queue.set_max_queued_cost(2 * kNUM_PROJS_PER_BATCH * proj_num_bytes);
+
+    ProjDataF32List batch_pd;
+
+    for (size_type batch_start = 0; batch_start < num_projs; batch_start += kNUM_PROJS_PER_BATCH)
+    {
+      const size_type batch_len = std::min(kNUM_PROJS_PER_BATCH, num_projs - batch_start);
+
+      vout << fmt::format("  projs.: {:4d} - {:4d}", batch_start, batch_start + batch_len - 1)
+           << std::endl;
+
+      batch_pd.assign(batch_len, ProjDataF32());
+
+      ParallelFor([&] (const RangeType& r)
+      {
+        for (size_type i = r.begin(); i < r.end(); ++i)
+        {
+          batch_pd[i] = read_proj(batch_start + i);
+        }
+      }, RangeType(0, batch_len));
+
+      for (auto& pd : batch_pd)
+      {
+        write_queue.add([&writer,pd] () { writer.write(pd); }, proj_num_bytes);
+      }
+
+      // the queued tasks hold the only references to the projections
+      batch_pd.clear();
+    }
+
+    write_queue.wait();
   }
 
-  vout << "saving to proj data HDF5..." << std::endl;
-  WriteProjDataH5ToDisk(pd, dst_pd_path);
+  writer.close();
 
   vout << "exiting..." << std::endl;
   return kEXIT_VAL_SUCCESS;
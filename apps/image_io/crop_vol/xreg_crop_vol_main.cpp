@@ -27,11 +27,52 @@
 #include "xregITKIOUtils.h"
 #include "xregITKCropPadUtils.h"
 #include "xregACSVUtils.h"
+#include "xregHDF5.h"
   
 using namespace xreg;
 
+// Overloads for reading a region of a volume from HDF5 for each supported
+// pixel type; the last argument is only used to select the overload.
+
+itk::Image<unsigned char,3>::Pointer
+ReadH5VolRegion(const H5::Group& h5, const itk::ImageRegion<3>& reg, unsigned char)
+{
+  return ReadITKImageRegionH5UChar3D(h5, reg);
+}
+
+itk::Image<char,3>::Pointer
+ReadH5VolRegion(const H5::Group& h5, const itk::ImageRegion<3>& reg, char)
+{
+  return ReadITKImageRegionH5Char3D(h5, reg);
+}
+
+itk::Image<unsigned short,3>::Pointer
+ReadH5VolRegion(const H5::Group& h5, const itk::ImageRegion<3>& reg, unsigned short)
+{
+  return ReadITKImageRegionH5UShort3D(h5, reg);
+}
+
+itk::Image<short,3>::Pointer
+ReadH5VolRegion(const H5::Group& h5, const itk::ImageRegion<3>& reg, short)
+{
+  return ReadITKImageRegionH5Short3D(h5, reg);
+}
+
+itk::Image<float,3>::Pointer
+ReadH5VolRegion(const H5::Group& h5, const itk::ImageRegion<3>& reg, float)
+{
+  return ReadITKImageRegionH5Float3D(h5, reg);
+}
+
+itk::Image<double,3>::Pointer
+ReadH5VolRegion(const H5::Group& h5, const itk::ImageRegion<3>& reg, double)
+{
+  return ReadITKImageRegionH5Double3D(h5, reg);
+}
+
 template <class tPixelType>
 void ProcessHelper(const std::string& src_vol_path,
+                   const std::string& src_h5_group,
                    const Pt3& center_pt,
                    const Pt3& phys_dims,
                    const std::string& dst_vol_path,
@@ -39,11 +80,39 @@ void ProcessHelper(const std::string& src_vol_path,
 {
   using Vol = itk::Image<tPixelType,3>;
 
-  vout << "reading volume from disk..." << std::endl;
-  auto vol = ReadITKImageFromDisk<Vol>(src_vol_path);
+  typename Vol::Pointer vol;
 
-  vout << "cropping..." << std::endl;
-  vol = CropImageWithBoundBoxPhysPts(vol.GetPointer(), center_pt, phys_dims);
+  // Only the voxels inside of the crop box are read from disk, when possible,
+  // so that cropping a small ROI out of a large volume does not require
+  // reading, or storing, the entire volume.
+
+  if (src_h5_group.empty())
+  {
+    vout << "reading volume information from disk..." << std::endl;
+    const auto vol_info = ReadITKImageInfoFromDisk<Vol>(src_vol_path);
+
+    const auto roi = BoundBoxPhysPtsToRegion(vol_info.GetPointer(), center_pt, phys_dims);
+
+    vout << "reading slices intersecting ROI from disk..." << std::endl;
+    const auto src_vol = ReadITKImageRegionFromDisk<Vol>(src_vol_path, roi);
+
+    vout << "cropping..." << std::endl;
+    vol = CopyITKImageRegionView(MakeITKImageRegionView(src_vol.GetPointer(), roi));
+  }
+  else
+  {
+    H5::H5File h5(src_vol_path, H5F_ACC_RDONLY);
+
+    const H5::Group vol_g = h5.openGroup(src_h5_group);
+
+    vout << "reading volume information from HDF5..." << std::endl;
+    const auto vol_info = ReadITKImageInfoH53D(vol_g);
+
+    const auto roi = BoundBoxPhysPtsToRegion(vol_info.GetPointer(), center_pt, phys_dims);
+
+    vout << "reading ROI hyperslab from HDF5..." << std::endl;
+    vol = ReadH5VolRegion(vol_g, roi, tPixelType());
+  }
 
   vout << "writing cropped vol to disk..." << std::endl;
   WriteITKImageToDisk(vol.GetPointer(), dst_vol_path);
@@ -68,6 +137,13 @@ int main(int argc, char* argv[])
          "Do NOT convert RAS to LPS (or LPS to RAS); Do NOT negate the first and second components.")
     << false;
 
+  po.add("h5-group", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "h5-group",
+         "The input volume is stored in an HDF5 file, in this group (e.g. as written by "
+         "WriteImageH5). Only the hyperslab of voxels intersecting the ROI is read. "
+         "When empty, the input volume is read using ITK, streaming the slices "
+         "intersecting the ROI when the file format supports it.")
+    << "";
+
   try
   {
     po.parse(argc, argv);
@@ -92,6 +168,8 @@ int main(int argc, char* argv[])
 
   const bool no_ras2lps = po.get("no-ras2lps");
 
+  const std::string src_h5_group = po.get("h5-group");
+
   std::ostream& vout = po.vout();
 
   vout << "reading acsv file..." << std::endl;
@@ -101,53 +179,94 @@ int main(int argc, char* argv[])
 
   vout << "determining output pixel type based on input pixel type..." << std::endl;
 
-  itk::ImageIOBase::Pointer imageIO = itk::ImageIOFactory::CreateImageIO(
-                                              input_vol_path.c_str(),
-                                              itk::ImageIOFactory::ReadMode);
-  imageIO->SetFileName(input_vol_path);
-  imageIO->ReadImageInformation();
-
-  switch (imageIO->GetComponentType())
+  if (src_h5_group.empty())
   {
-  case itk::ImageIOBase::UCHAR:
-    process_fn = &ProcessHelper<unsigned char>;
-    break;
-  case itk::ImageIOBase::CHAR:
-    process_fn = &ProcessHelper<char>;
-    break;
-  case itk::ImageIOBase::USHORT:
-    process_fn = &ProcessHelper<unsigned short>;
-    break;
-  case itk::ImageIOBase::SHORT:
-    process_fn = &ProcessHelper<short>;
-    break;
+    itk::ImageIOBase::Pointer imageIO = itk::ImageIOFactory::CreateImageIO(
+                                                input_vol_path.c_str(),
+                                                itk::ImageIOFactory::ReadMode);
+    imageIO->SetFileName(input_vol_path);
+    imageIO->ReadImageInformation();
+
+    switch (imageIO->GetComponentType())
+    {
+    case itk::ImageIOBase::UCHAR:
+      process_fn = &ProcessHelper<unsigned char>;
+      break;
+    case itk::ImageIOBase::CHAR:
+      process_fn = &ProcessHelper<char>;
+      break;
+    case itk::ImageIOBase::USHORT:
+      process_fn = &ProcessHelper<unsigned short>;
+      break;
+    case itk::ImageIOBase::SHORT:
+      process_fn = &ProcessHelper<short>;
+      break;
 #if 0
-  case itk::ImageIOBase::UINT:
-    process_fn = &ProcessHelper<unsigned int>;
-    break;
-  case itk::ImageIOBase::INT:
-    process_fn = &ProcessHelper<int>;
-    break;
-  case itk::ImageIOBase::ULONG:
-    process_fn = &ProcessHelper<unsigned long>;
-    break;
-  case itk::ImageIOBase::LONG:
-    process_fn = &ProcessHelper<long>;
-    break;
+    case itk::ImageIOBase::UINT:
+      process_fn = &ProcessHelper<unsigned int>;
+      break;
+    case itk::ImageIOBase::INT:
+      process_fn = &ProcessHelper<int>;
+      break;
+    case itk::ImageIOBase::ULONG:
+      process_fn = &ProcessHelper<unsigned long>;
+      break;
+    case itk::ImageIOBase::LONG:
+      process_fn = &ProcessHelper<long>;
+      break;
 #endif
-  case itk::ImageIOBase::FLOAT:
-    process_fn = &ProcessHelper<float>;
-    break;
-  case itk::ImageIOBase::DOUBLE:
-    process_fn = &ProcessHelper<double>;
-    break;
-  case itk::ImageIOBase::UNKNOWNCOMPONENTTYPE:
-  default:
-    xregThrow("unknown pixel type!");
-    break;
+    case itk::ImageIOBase::FLOAT:
+      process_fn = &ProcessHelper<float>;
+      break;
+    case itk::ImageIOBase::DOUBLE:
+      process_fn = &ProcessHelper<double>;
+      break;
+    case itk::ImageIOBase::UNKNOWNCOMPONENTTYPE:
+    default:
+      xregThrow("unknown pixel type!");
+      break;
+    }
+  }
+  else
+  {
+    H5::DataType h5_pixel_type;
+
+    {
+      H5::H5File h5(input_vol_path, H5F_ACC_RDONLY);
+      ReadITKImageInfoH53D(h5.openGroup(src_h5_group), &h5_pixel_type);
+    }
+
+    if (h5_pixel_type == LookupH5DataType<unsigned char>())
+    {
+      process_fn = &ProcessHelper<unsigned char>;
+    }
+    else if (h5_pixel_type == LookupH5DataType<char>())
+    {
+      process_fn = &ProcessHelper<char>;
+    }
+    else if (h5_pixel_type == LookupH5DataType<unsigned short>())
+    {
+      process_fn = &ProcessHelper<unsigned short>;
+    }
+    else if (h5_pixel_type == LookupH5DataType<short>())
+    {
+      process_fn = &ProcessHelper<short>;
+    }
+    else if (h5_pixel_type == LookupH5DataType<float>())
+    {
+      process_fn = &ProcessHelper<float>;
+    }
+    else if (h5_pixel_type == LookupH5DataType<double>())
+    {
+      process_fn = &ProcessHelper<double>;
+    }
+    else
+    {
+      xregThrow("unsupported HDF5 pixel type!");
+    }
   }
 
-  process_fn(input_vol_path, std::get<0>(roi), std::get<1>(roi),
+  process_fn(input_vol_path, src_h5_group, std::get<0>(roi), std::get<1>(roi),
              output_vol_path, vout);
 
   vout << "exiting..." << std::endl;
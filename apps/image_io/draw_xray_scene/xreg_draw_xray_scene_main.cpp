@@ -263,6 +263,12 @@ int main(int argc, char* argv[])
     bg_color_arg.num_vals = 3;
   }
 
+  po.add("mesh-cache-dir", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "mesh-cache-dir",
+         "Directory used to cache surface meshes in a format which loads quickly. A cached "
+         "copy of each mesh is written when it does not exist or is older than the mesh file. "
+         "Empty -> no caching.")
+    << "";
+
   try
   {
     po.parse(argc, argv);
@@ -310,6 +316,8 @@ int main(int argc, char* argv[])
 
   const bool mesh_color_bone = po.get("mesh-color-bone");
 
+  const std::string mesh_cache_dir = po.get("mesh-cache-dir");
+
   const bool rand_mesh_color = po.get("rand-mesh-color");
   
   const std::string mesh_color_csv_path = po.get("mesh-colors-csv");
@@ -797,7 +805,7 @@ int main(int argc, char* argv[])
     if (!IsSupportedLandmarksFilePts(next_sur_or_pts_path))
     {
       vout << "reading surface " << sur_idx << "..." << std::endl;
-      auto m = ReadMeshFromDisk(next_sur_or_pts_path);
+      auto m = ReadMeshFromDiskWithCache(next_sur_or_pts_path, mesh_cache_dir);
 
       vout << "transforming surface..." << std::endl;
       ApplyTransform(xform_cam_wrt_ct.inverse(), m.vertices, &m.vertices);
@@ -51,6 +51,11 @@ int main(int argc, char* argv[])
          "The length of the output movie in seconds; this argument will "
          "take precedent over the fps argument.");
 
+  po.add("encoder", 'e', ProgOpts::kSTORE_STRING, "encoder",
+         "H.264 encoder used when ffmpeg is available to write movies: \"sw\" (software), "
+         "\"nvenc\" (NVIDIA GPU), \"vaapi\" (Intel/AMD GPU on Linux), or \"videotoolbox\" (macOS).")
+    << "sw";
+
   try
   {
     po.parse(argc, argv);
@@ -82,6 +87,8 @@ int main(int argc, char* argv[])
 
   const bool sort_paths = po.get("sort");
 
+  const FFMPEGVideoEncoder encoder = LookupFFMPEGVideoEncoder(po.get("encoder").as_string());
+
   const bool video_len_passed = po.has("len");
 
   double video_len_secs = video_len_passed ? po.get("len").as_double() : 0.0;
@@ -109,7 +116,7 @@ int main(int argc, char* argv[])
 
   vout << "processing directory contents and creating video..." << std::endl;
   WriteDirOfImagesToVideo(dst_mov, src_dir, sort_paths, img_exts, fps_or_len,
-                          !video_len_passed);
+                          !video_len_passed, encoder);
 
   return kEXIT_VAL_SUCCESS;
 }
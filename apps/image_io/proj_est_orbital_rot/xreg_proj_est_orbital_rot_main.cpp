@@ -72,6 +72,12 @@ int main(int argc, char* argv[])
          "reverse the order of projections when calculating the orbit rotation axis.")
     << false;;
 
+  po.add("orbit-inlier-thresh", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "orbit-inlier-thresh",
+         "When positive, the center of rotation is estimated robustly using RANSAC and source "
+         "positions further than this distance (mm) from a candidate orbit are treated as "
+         "outliers. Otherwise, every source position is used.")
+    << 0.0;
+
   po.add("debug", 'd', ProgOpts::kSTORE_TRUE, "debug",
          "Display a debug visualization of the newly computed coordinate frame.")
     << false;
@@ -104,6 +110,8 @@ int main(int argc, char* argv[])
 
   const bool debug_disp = po.get("debug");
 
+  const CoordScalar orbit_inlier_thresh = po.get("orbit-inlier-thresh").as_double();
+
   const std::string proj_path = po.pos_args()[0];
 
   vout << "opening H5 file for "
@@ -197,7 +205,19 @@ int main(int argc, char* argv[])
 
   Pt3 center_of_rot;
   CoordScalar orbit_radius = 0;
-  std::tie(center_of_rot, orbit_radius) = FitOrbitToPts(src_pts);
+
+  if (orbit_inlier_thresh > 0)
+  {
+    std::vector<size_type> orbit_inlier_inds;
+    std::tie(center_of_rot, orbit_radius, orbit_inlier_inds) =
+                                      FitOrbitToPtsRANSAC(src_pts, orbit_inlier_thresh);
+
+    vout << "  num. orbit inliers: " << orbit_inlier_inds.size() << " / " << num_projs << std::endl;
+  }
+  else
+  {
+    std::tie(center_of_rot, orbit_radius) = FitOrbitToPts(src_pts);
+  }
 
   if (debug_disp)
   {
@@ -35,6 +35,9 @@
 #include "xregITKOpenCVUtils.h"
 #include "xregITKRemapUtils.h"
 #include "xregWriteVideo.h"
+#include "xregAttVolCache.h"
+#include "xregDRRCache.h"
+#include "xregTBBUtils.h"
 #include "xregRayCastProgOpts.h"
 #include "xregSE3OptVars.h"
 #include "xregRegi2D3DPenaltyFnLandReproj.h"
@@ -64,34 +67,130 @@ using ListOfMatLists             = std::vector<MatList>;
 using ListOfListOfMatLists       = std::vector<ListOfMatLists>;
 using ListOfListOfListOfMatLists = std::vector<ListOfListOfMatLists>;
 
-void ComputeProjs(RayCaster& rc, const FrameTransformList& poses, const IndexList& vol_inds, ProjList& projs)
+// Computes the projections of every view at several frames, frame_poses[k] has
+// the poses of all volumes at frame k, and volumes vol_inds are combined into
+// each projection. Up to max_batch_size frames are computed with each call to
+// the ray caster. When a cache is provided, frames are read from the cache when
+// possible and computed frames are written to the cache.
+// (*view_projs)[v][k] is the projection of the vth view at the kth frame.
+void ComputeProjsBatched(RayCaster* rc,
+                         const std::vector<FrameTransformList>& frame_poses,
+                         const IndexList& vol_inds,
+                         const size_type num_views,
+                         const size_type max_batch_size,
+                         const std::string& cache_desc,
+                         const DRRCache* cache,
+                         ListOfProjLists* view_projs)
 {
-  const size_type num_views = projs.size();
+  const size_type num_frames = frame_poses.size();
 
   const size_type num_vols = vol_inds.size();
-  
-  const bool orig_ray_caster_use_bg_projs = rc.use_bg_projs();
+ 
+  view_projs->assign(num_views, ProjList(num_frames));
+
+  std::vector<size_type> frames_to_compute;
+  frames_to_compute.reserve(num_frames);
 
-  rc.use_proj_store_replace_method();
+  StrList frame_cache_keys;
 
-  for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
+  if (cache)
   {
-    const size_type cur_obj_idx = vol_inds[vol_idx];
-    xregASSERT(cur_obj_idx < poses.size());
+    frame_cache_keys.reserve(num_frames);
+  }
+
+  for (size_type frame_idx = 0; frame_idx < num_frames; ++frame_idx)
+  {
+    bool found_in_cache = false;
+
+    if (cache)
+    {
+      frame_cache_keys.push_back(MakeDRRCacheKey(cache_desc, vol_inds, frame_poses[frame_idx]));
 
-    rc.distribute_xform_among_cam_models(poses[cur_obj_idx]);
+      ProjList cached_projs;
+      
+      if (cache->read(frame_cache_keys.back(), &cached_projs) && (cached_projs.size() == num_views))
+      {
+        for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
+        {
+          (*view_projs)[view_idx][frame_idx] = cached_projs[view_idx];
+        }
 
-    rc.compute(cur_obj_idx);
+        found_in_cache = true;
+      }
+    }
 
-    rc.use_proj_store_accum_method();
-    rc.set_use_bg_projs(false);
+    if (!found_in_cache)
+    {
+      frames_to_compute.push_back(frame_idx);
+    }
   }
 
-  rc.set_use_bg_projs(orig_ray_caster_use_bg_projs);
+  const size_type num_frames_to_compute = frames_to_compute.size();
 
-  for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
+  rc->use_proj_store_replace_method();
+
+  std::vector<FrameTransformList> xforms_for_each_vol(num_vols);
+
+  // re-pointed at each computed projection before copying
+  RayCaster::ProjPtr proj_view;
+
+  for (size_type batch_begin = 0; batch_begin < num_frames_to_compute; batch_begin += max_batch_size)
   {
-    projs[view_idx] = ITKImageDeepCopy(rc.proj(view_idx).GetPointer());
+    const size_type batch_size = std::min(max_batch_size, num_frames_to_compute - batch_begin);
+
+    rc->set_num_projs(batch_size * num_views);
+
+    FrameTransformList batch_vol_poses(batch_size);
+
+    for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
+    {
+      const size_type cur_obj_idx = vol_inds[vol_idx];
+
+      for (size_type i = 0; i < batch_size; ++i)
+      {
+        const auto& cur_frame_poses = frame_poses[frames_to_compute[batch_begin + i]];
+        xregASSERT(cur_obj_idx < cur_frame_poses.size());
+        
+        batch_vol_poses[i] = cur_frame_poses[cur_obj_idx];
+      }
+
+      // projection (view_idx * batch_size) + i is frame i of the batch at view view_idx
+      rc->distribute_xforms_among_cam_models(batch_vol_poses);
+
+      xforms_for_each_vol[vol_idx] = rc->xforms_cam_to_itk_phys();
+    }
+
+    rc->compute_multi_vols(vol_inds, xforms_for_each_vol);
+
+    ProjList cur_frame_projs(num_views);
+
+    for (size_type i = 0; i < batch_size; ++i)
+    {
+      const size_type frame_idx = frames_to_compute[batch_begin + i];
+
+      for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
+      {
+        const size_type proj_idx = (view_idx * batch_size) + i;
+
+        if (proj_view)
+        {
+          rc->proj_view(proj_idx, proj_view.GetPointer());
+        }
+        else
+        {
+          proj_view = rc->make_proj_view(proj_idx);
+        }
+
+        cur_frame_projs[view_idx] = ITKImageDeepCopy(proj_view.GetPointer());
+
+        (*view_projs)[view_idx][frame_idx] = cur_frame_projs[view_idx];
+      }
+
+      if (cache)
+      {
+        cache->write(frame_cache_keys[frame_idx], cur_frame_projs);
+      }
+    }
   }
 }
 
@@ -187,6 +286,19 @@ int main(int argc, char* argv[])
          "1.0 -> no downsampling. 0.5 -> reduce by half in each dimension.")
     << 1.0;
 
+  po.add("drr-batch-size", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32, "drr-batch-size",
+         "The maximum number of replayed poses to compute DRRs for in a single call to the "
+         "ray caster. Each call computes this many DRRs for every view.")
+    << ProgOpts::uint32(32);
+
+  po.add("drr-cache-dir", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "drr-cache-dir",
+         "Directory used to cache the DRRs (and depth maps used for boundary edges) computed "
+         "at each replayed pose. Subsequent replays of the same registration, with the same "
+         "ray casting options and downsampling factor, read the DRRs from this directory instead "
+         "of recomputing them, e.g. when only changing edge or video options. "
+         "Empty -> no cache is used.")
+    << "";
+
   po.add("max-tile-cols", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_INT32, "max-tile-cols",
          "The maximum number of columns in the output tiling, once the maximum number of tiles "
          "is exceeded, a new row is made.")
@@ -209,6 +321,11 @@ int main(int argc, char* argv[])
       << "mp4";
   }
 
+  po.add("video-encoder", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "video-encoder",
+         "H.264 encoder used when ffmpeg is available to write movies: \"sw\" (software), "
+         "\"nvenc\" (NVIDIA GPU), \"vaapi\" (Intel/AMD GPU on Linux), or \"videotoolbox\" (macOS).")
+    << "sw";
+
   po.add_backend_flags();
 
   po.add("debug-img-prefix", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "debug-img-prefix",
@@ -280,6 +397,10 @@ int main(int argc, char* argv[])
 
   const int edge_dilate_width = po.get("edge-dilate-width").as_uint32();
 
+  const size_type drr_batch_size = std::max(ProgOpts::uint32(1), po.get("drr-batch-size").as_uint32());
+
+  const std::string drr_cache_dir = po.get("drr-cache-dir");
+
   if (!compute_canny_edges && !compute_boundary_edges)
   {
     std::cerr << "WARNING: NO EDGE OVERLAYS WILL BE ADDED!" << std::endl;
@@ -289,6 +410,8 @@ int main(int argc, char* argv[])
 
   const std::string mov_ext_str = po.get("mov-ext").as_string();
 
+  const FFMPEGVideoEncoder vid_encoder = LookupFFMPEGVideoEncoder(po.get("video-encoder").as_string());
+
   auto ext_to_cc_it = ext_to_cc.find(mov_ext_str);
   if (ext_to_cc_it == ext_to_cc.end())
   {
@@ -305,6 +428,21 @@ int main(int argc, char* argv[])
   const std::string debug_raw_final_drr_prefix = po.get("debug-raw-final-drr-prefix");
   const bool write_raw_final_drr = !debug_raw_final_drr_prefix.empty();
 
+  std::unique_ptr<DRRCache> drr_cache;
+  std::string drr_cache_scene_desc;
+
+  if (!drr_cache_dir.empty())
+  {
+    vout << "using DRR cache directory: " << drr_cache_dir << std::endl;
+    drr_cache.reset(new DRRCache(drr_cache_dir));
+
+    // the DRRs depend on the volumes and cameras stored in the debug file and
+    // any modifications made to the cameras here
+    drr_cache_scene_desc = fmt::format("regi={};pre-proc={};proj-ds={}",
+                                       ComputeFileContentHash(regi_results_path),
+                                       do_preproc, ds_factor);
+  }
+
   vout << "reading registration results from file..." << std::endl;
   auto regi_results = ReadMultiLevel2D3DRegiDebugFromDisk(regi_results_path);
 
@@ -520,7 +658,7 @@ int main(int argc, char* argv[])
     auto ray_caster = LineIntRayCasterFromProgOpts(po);
 
     vout << "setting up camera parameters for ray caster..." << std::endl;
-    ray_caster->set_num_projs(num_views);
+    ray_caster->set_num_projs(drr_batch_size * num_views);
 
     ray_caster->set_camera_models(ExtractCamModels(fixed_proj_data));
 
@@ -542,7 +680,7 @@ int main(int argc, char* argv[])
       depth_rend = DepthRayCasterFromProgOpts(po);
 
       vout << "setting depth ray caster params..." << std::endl;
-      depth_rend->set_num_projs(num_views);
+      depth_rend->set_num_projs(drr_batch_size * num_views);
       depth_rend->set_camera_models(ray_caster->camera_models());
       depth_rend->set_volumes(hu_vols);
       depth_rend->set_use_bg_projs(true);
@@ -558,6 +696,17 @@ int main(int argc, char* argv[])
       boundary_edge_maps.resize(num_views);
     }
 
+    const std::string rc_cache_desc = fmt::format("{};lvl={};backend={};step={};interp={}",
+                                                  drr_cache_scene_desc, lvl,
+                                                  po.get("backend").as_string(),
+                                                  ray_caster->ray_step_size(),
+                                                  static_cast<int>(ray_caster->interp_method()));
+
+    const std::string line_int_cache_desc = rc_cache_desc + ";line-int";
+
+    const std::string depth_cache_desc = fmt::format("{};depth;thresh={}", rc_cache_desc,
+                                                     boundary_edge_hu_thresh);
+
     vout << "remapping fixed images... (for later edge overlay)" << std::endl;
     MatList remapped_fixed_views_ocv(num_views);
     for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
@@ -664,29 +813,8 @@ int main(int argc, char* argv[])
       const size_type num_its = cur_regi.iter_vars[0].size();
       vout << "-------- number of iterations: " << num_its << std::endl;
 
-      for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
-      {
-        view_projs[view_idx][lvl][regi_idx].reserve(2 + num_its);
-      }
-
-      ProjList cur_bg_projs(num_views);
-
-      ProjList tmp_projs(num_views);
-
-      ProjList cur_bg_depth_rends;
-      ProjList tmp_depth_rends;
-      if (compute_boundary_edges)
-      {
-        cur_bg_depth_rends.resize(num_views);
-        tmp_depth_rends.resize(num_views);
-      }
-      
       // depth_rends_for_boundary_edges[i][j] jth depth render of the ith view for this regi
       ListOfProjLists depth_rends_for_boundary_edges;
-      if (compute_boundary_edges)
-      {
-        depth_rends_for_boundary_edges.resize(num_views);
-      }
 
       bool need_bg_projs = false;
         
@@ -719,6 +847,9 @@ int main(int argc, char* argv[])
                          (global_vol_inds_registered[0] == cur_regi.vols_used[0]));
       }
 
+      // the key of the background is included in the key of every frame
+      std::string bg_cache_desc = "none";
+
       if (!need_bg_projs)
       {
         vout << "-------- no background projection required..." << std::endl;
@@ -734,9 +865,22 @@ int main(int argc, char* argv[])
       else
       {
         vout << "-------- computing background projection..." << std::endl;
+
+        const std::vector<FrameTransformList> bg_poses(1, global_vol_last_poses);
+
+        ListOfProjLists tmp_bg_projs;
+
         ray_caster->set_use_bg_projs(false);
 
-        ComputeProjs(*ray_caster.get(), global_vol_last_poses, global_vol_inds_registered, cur_bg_projs);
+        ComputeProjsBatched(ray_caster.get(), bg_poses, global_vol_inds_registered,
+                            num_views, drr_batch_size, line_int_cache_desc + ";bg=none",
+                            drr_cache.get(), &tmp_bg_projs);
+
+        ProjList cur_bg_projs(num_views);
+        for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
+        {
+          cur_bg_projs[view_idx] = tmp_bg_projs[view_idx][0];
+        }
 
         ray_caster->set_bg_projs(cur_bg_projs);
         ray_caster->set_use_bg_projs(true);
@@ -745,46 +889,41 @@ int main(int argc, char* argv[])
         {
           depth_rend->set_use_bg_projs(false);
 
-          ComputeProjs(*depth_rend.get(), global_vol_last_poses, global_vol_inds_registered, cur_bg_depth_rends);
+          ComputeProjsBatched(depth_rend.get(), bg_poses, global_vol_inds_registered,
+                              num_views, drr_batch_size, depth_cache_desc + ";bg=none",
+                              drr_cache.get(), &tmp_bg_projs);
         
+          ProjList cur_bg_depth_rends(num_views);
+          for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
+          {
+            cur_bg_depth_rends[view_idx] = tmp_bg_projs[view_idx][0];
+          }
+
           depth_rend->set_bg_projs(cur_bg_depth_rends);
           depth_rend->set_use_bg_projs(true);
         }
+
+        bg_cache_desc = MakeDRRCacheKey("bg", global_vol_inds_registered, global_vol_last_poses);
       }
 
-      // Initial projections
-      vout << "-------- computing projections at initial poses..." << std::endl;
+      // Collect the poses of every frame (initial, iterations, final), so that
+      // they may be ray cast in large batches
+      std::vector<FrameTransformList> frame_poses;
+      frame_poses.reserve(2 + num_its);
+
+      // Initial poses
       for (size_type mov_obj_idx = 0; mov_obj_idx < num_mov_objs; ++mov_obj_idx)
       {
         const size_type global_vol_idx = cur_regi.vols_used[mov_obj_idx];
         global_vol_last_poses[global_vol_idx] = cur_regi.init_poses[mov_obj_idx];
       }
-      ComputeProjs(*ray_caster.get(), global_vol_last_poses, cur_regi.vols_used, tmp_projs);
-      for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
-      {
-        view_projs[view_idx][lvl][regi_idx].push_back(tmp_projs[view_idx]);
-      }
-
-      if (show_reproj_lands)
-      {
-        poses_for_land_reproj.push_back(global_vol_last_poses[land_debug_vol_idx]);
-      }
-
-      if (compute_boundary_edges)
-      {
-        ComputeProjs(*depth_rend.get(), global_vol_last_poses, cur_regi.vols_used, tmp_depth_rends);
-        for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
-        {
-          depth_rends_for_boundary_edges[view_idx].push_back(tmp_depth_rends[view_idx]);
-        }
-      }
+      frame_poses.push_back(global_vol_last_poses);
 
       const auto& se3 = *cur_regi.se3_params;
 
-      vout << "-------- computing projections at iteration poses..." << std::endl;
+      // poses at iterations
       for (size_type it = 0; it < num_its; ++it)
       {
-        // projections at iterations
         for (size_type mov_obj_idx = 0; mov_obj_idx < num_mov_objs; ++mov_obj_idx)
         {
           FrameTransform cur_pose = se3(cur_regi.iter_vars[mov_obj_idx][it]);
@@ -804,51 +943,47 @@ int main(int argc, char* argv[])
           const size_type global_vol_idx = cur_regi.vols_used[mov_obj_idx];
           global_vol_last_poses[global_vol_idx] = cur_pose;
         }
-        ComputeProjs(*ray_caster.get(), global_vol_last_poses, cur_regi.vols_used, tmp_projs);
-        for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
-        {
-          view_projs[view_idx][lvl][regi_idx].push_back(tmp_projs[view_idx]);
-        }
-        if (compute_boundary_edges)
-        {
-          ComputeProjs(*depth_rend.get(), global_vol_last_poses, cur_regi.vols_used, tmp_depth_rends);
-          for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
-          {
-            depth_rends_for_boundary_edges[view_idx].push_back(tmp_depth_rends[view_idx]);
-          }
-        }
-        
-        if (show_reproj_lands)
-        {
-          poses_for_land_reproj.push_back(global_vol_last_poses[land_debug_vol_idx]);
-        }
+        frame_poses.push_back(global_vol_last_poses);
       }
 
-      // Final projections
-      vout << "-------- computing projections at final poses..." << std::endl;
+      // Final poses
       for (size_type mov_obj_idx = 0; mov_obj_idx < num_mov_objs; ++mov_obj_idx)
       {
         const size_type global_vol_idx = cur_regi.vols_used[mov_obj_idx];
         global_vol_last_poses[global_vol_idx] = cur_regi.final_poses[mov_obj_idx];
       }
-      ComputeProjs(*ray_caster.get(), global_vol_last_poses, cur_regi.vols_used, tmp_projs);
-      for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
+      frame_poses.push_back(global_vol_last_poses);
+
+      if (show_reproj_lands)
       {
-        view_projs[view_idx][lvl][regi_idx].push_back(tmp_projs[view_idx]);
+        for (const auto& cur_frame_poses : frame_poses)
+        {
+          poses_for_land_reproj.push_back(cur_frame_poses[land_debug_vol_idx]);
+        }
       }
-      
-      if (compute_boundary_edges)
+
+      vout << "-------- computing projections at " << frame_poses.size() << " poses..." << std::endl;
+
       {
-        ComputeProjs(*depth_rend.get(), global_vol_last_poses, cur_regi.vols_used, tmp_depth_rends);
+        ListOfProjLists tmp_projs;
+
+        ComputeProjsBatched(ray_caster.get(), frame_poses, cur_regi.vols_used,
+                            num_views, drr_batch_size,
+                            fmt::format("{};bg={}", line_int_cache_desc, bg_cache_desc),
+                            drr_cache.get(), &tmp_projs);
+
         for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
         {
-          depth_rends_for_boundary_edges[view_idx].push_back(tmp_depth_rends[view_idx]);
+          view_projs[view_idx][lvl][regi_idx] = std::move(tmp_projs[view_idx]);
         }
       }
-      
-      if (show_reproj_lands)
+
+      if (compute_boundary_edges)
       {
-        poses_for_land_reproj.push_back(global_vol_last_poses[land_debug_vol_idx]);
+        ComputeProjsBatched(depth_rend.get(), frame_poses, cur_regi.vols_used,
+                            num_views, drr_batch_size,
+                            fmt::format("{};bg={}", depth_cache_desc, bg_cache_desc),
+                            drr_cache.get(), &depth_rends_for_boundary_edges);
       }
 
       if (num_mov_objs == 1)
@@ -865,16 +1000,24 @@ int main(int argc, char* argv[])
       }
 
       vout << "-------- remapping to 8bpp and computing edges" << std::endl;
+
+      const size_type num_cur_projs = view_projs[0][lvl][regi_idx].size();
+
       for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
       {
-        const size_type num_cur_projs = view_projs[view_idx][lvl][regi_idx].size();
-
         remapped_view_projs[view_idx][lvl][regi_idx].resize(num_cur_projs);
         view_cv_mats[view_idx][lvl][regi_idx].resize(num_cur_projs);
         edge_overlays_cv_mats[view_idx][lvl][regi_idx].resize(num_cur_projs);
+      }
 
-        for (size_type proj_idx = 0; proj_idx < num_cur_projs; ++proj_idx)
+      // each overlay frame of each view is independent of the others
+      auto overlay_fn = [&] (const RangeType& r)
+      {
+        for (size_type i = r.begin(); i < r.end(); ++i)
         {
+          const size_type view_idx = i / num_cur_projs;
+          const size_type proj_idx = i % num_cur_projs;
+
           remapped_view_projs[view_idx][lvl][regi_idx][proj_idx] =
                       ITKImageRemap8bpp(view_projs[view_idx][lvl][regi_idx][proj_idx].GetPointer());
 
@@ -994,7 +1137,9 @@ int main(int argc, char* argv[])
             edge_overlays_cv_mats[view_idx][lvl][regi_idx][proj_idx] = cur_overlay;
           }
         }
-      }
+      };
+
+      ParallelFor(overlay_fn, RangeType(0, num_views * num_cur_projs));
     }
   }
 
@@ -1012,19 +1157,19 @@ int main(int argc, char* argv[])
 
   vout << "tiling images..." << std::endl;
 
-  MatList mov_img_frames;
-  mov_img_frames.reserve(tot_num_projs);
-
-  MatList edge_img_frames;
-  edge_img_frames.reserve(tot_num_projs);
+  // The level, registration, and projection index of each movie frame
+  std::vector<size_type> frame_lvls;
+  std::vector<size_type> frame_regis;
+  std::vector<size_type> frame_proj_inds;
+  frame_lvls.reserve(tot_num_projs);
+  frame_regis.reserve(tot_num_projs);
+  frame_proj_inds.reserve(tot_num_projs);
 
   StrList frame_file_names;
   StrList frame_titles;
   frame_file_names.reserve(tot_num_projs);
   frame_titles.reserve(tot_num_projs);
         
-  const int tile_border_thickness = std::max(1, static_cast<int>(std::lround(10 * ds_factor)));
-
   for (size_type lvl = 0; lvl < num_levels; ++lvl)
   {
     const CoordScalar lvl_ds_factor = regi_results.multi_res_levels[lvl];
@@ -1037,71 +1182,90 @@ int main(int argc, char* argv[])
 
       for (size_type proj_idx = 0; proj_idx < num_cur_projs; ++proj_idx)
       {
-        MatList cur_proj_views(num_views);
-        for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
-        {
-          cur_proj_views[view_idx] = view_cv_mats[view_idx][lvl][regi_idx][proj_idx];
+        frame_lvls.push_back(lvl);
+        frame_regis.push_back(regi_idx);
+        frame_proj_inds.push_back(proj_idx);
 
-          if (flip_proj_rows[view_idx])
-          {
-            FlipImageRows(&cur_proj_views[view_idx]);
-          }
+        frame_file_names.push_back(fmt::format("mov_{:02d}_{:02d}_{:03d}.png", lvl, regi_idx, proj_idx));
+        frame_titles.push_back(fmt::format("Level {} ({:.3f}), {}, {:03d}",
+                                           lvl, lvl_ds_factor, regi_results.regi_names[lvl][regi_idx], proj_idx));
+      }
+    }
+  }
 
-          if (flip_proj_cols[view_idx])
-          {
-            FlipImageColumns(&cur_proj_views[view_idx]);
-          }
+  const size_type num_frames = frame_lvls.size();
+  xregASSERT(num_frames == tot_num_projs);
 
-          if (write_debug_img_frames)
-          {
-            cv::imwrite(fmt::format("{}_{:02d}_mov_{:03d}.png",
-                                    debug_frame_prefix, view_idx, mov_img_frames.size()),
-                        cur_proj_views[view_idx]);
-          }
-        }
+  MatList mov_img_frames(num_frames);
+  MatList edge_img_frames(num_frames);
 
-        auto tiled_img = CreateSummaryTiledImages(cur_proj_views, StrList(),
-                                                  num_tile_rows, num_tile_cols,
-                                                  tile_border_thickness);
+  const int tile_border_thickness = std::max(1, static_cast<int>(std::lround(10 * ds_factor)));
 
-        mov_img_frames.push_back(tiled_img[0]);
+  auto tile_fn = [&] (const RangeType& r)
+  {
+    MatList cur_proj_views(num_views);
 
-        for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
+    for (size_type frame_idx = r.begin(); frame_idx < r.end(); ++frame_idx)
+    {
+      const size_type lvl      = frame_lvls[frame_idx];
+      const size_type regi_idx = frame_regis[frame_idx];
+      const size_type proj_idx = frame_proj_inds[frame_idx];
+
+      for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
+      {
+        cur_proj_views[view_idx] = view_cv_mats[view_idx][lvl][regi_idx][proj_idx];
+
+        if (flip_proj_rows[view_idx])
         {
-          cur_proj_views[view_idx] = edge_overlays_cv_mats[view_idx][lvl][regi_idx][proj_idx];
+          FlipImageRows(&cur_proj_views[view_idx]);
+        }
 
-          if (flip_proj_rows[view_idx])
-          {
-            FlipImageRows(&cur_proj_views[view_idx]);
-          }
+        if (flip_proj_cols[view_idx])
+        {
+          FlipImageColumns(&cur_proj_views[view_idx]);
+        }
 
-          if (flip_proj_cols[view_idx])
-          {
-            FlipImageColumns(&cur_proj_views[view_idx]);
-          }
-          
-          if (write_debug_img_frames)
-          {
-            cv::imwrite(fmt::format("{}_{:02d}_edges_{:03d}.png",
-                                    debug_frame_prefix, view_idx, edge_img_frames.size()),
-                        cur_proj_views[view_idx]);
-          }
+        if (write_debug_img_frames)
+        {
+          cv::imwrite(fmt::format("{}_{:02d}_mov_{:03d}.png",
+                                  debug_frame_prefix, view_idx, frame_idx),
+                      cur_proj_views[view_idx]);
         }
+      }
 
-        tiled_img = CreateSummaryTiledImages(cur_proj_views, StrList(),
-                                             num_tile_rows, num_tile_cols,
-                                             tile_border_thickness);
-        edge_img_frames.push_back(tiled_img[0]);
+      mov_img_frames[frame_idx] = CreateSummaryTiledImages(cur_proj_views, StrList(),
+                                                           num_tile_rows, num_tile_cols,
+                                                           tile_border_thickness)[0];
 
-        frame_file_names.push_back(fmt::format("mov_{:02d}_{:02d}_{:03d}.png", lvl, regi_idx, proj_idx));
-        frame_titles.push_back(fmt::format("Level {} ({:.3f}), {}, {:03d}",
-                                           lvl, lvl_ds_factor, regi_results.regi_names[lvl][regi_idx], proj_idx));
+      for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
+      {
+        cur_proj_views[view_idx] = edge_overlays_cv_mats[view_idx][lvl][regi_idx][proj_idx];
+
+        if (flip_proj_rows[view_idx])
+        {
+          FlipImageRows(&cur_proj_views[view_idx]);
+        }
+
+        if (flip_proj_cols[view_idx])
+        {
+          FlipImageColumns(&cur_proj_views[view_idx]);
+        }
+        
+        if (write_debug_img_frames)
+        {
+          cv::imwrite(fmt::format("{}_{:02d}_edges_{:03d}.png",
+                                  debug_frame_prefix, view_idx, frame_idx),
+                      cur_proj_views[view_idx]);
+        }
       }
+
+      edge_img_frames[frame_idx] = CreateSummaryTiledImages(cur_proj_views, StrList(),
+                                                            num_tile_rows, num_tile_cols,
+                                                            tile_border_thickness)[0];
     }
-  }
+  };
 
-  const size_type num_frames = mov_img_frames.size();
-  xregASSERT(num_frames == tot_num_projs);
+  ParallelFor(tile_fn, RangeType(0, num_frames));
 
   vout << "writing movie frames..." << std::endl;
 
@@ -1110,12 +1274,12 @@ int main(int argc, char* argv[])
   const std::string mov_path   = fmt::format("{}.{}", drr_mov_prefix, mov_ext_str);
   const std::string edges_path = fmt::format("{}.{}", edges_mov_prefix, mov_ext_str);
 
-  auto mov_vid_writer = GetWriteImageFramesToVideo();
+  auto mov_vid_writer = GetWriteImageFramesToVideo(vid_encoder);
   mov_vid_writer->dst_vid_path = mov_path;
   mov_vid_writer->fps = video_fps;
   mov_vid_writer->open();
 
-  auto edge_vid_writer = GetWriteImageFramesToVideo();
+  auto edge_vid_writer = GetWriteImageFramesToVideo(vid_encoder);
   edge_vid_writer->dst_vid_path = edges_path;
   edge_vid_writer->fps = video_fps;
   edge_vid_writer->open();
@@ -1137,39 +1301,51 @@ int main(int argc, char* argv[])
   const cv::Point txt_off((fixed_proj_data[0].cam.num_det_cols * middle_view_idx) + 5.0,
                           mov_img_frames[0].rows - (font_scale * 15.0));
     
-  for (size_type frame_idx = 0; frame_idx < num_frames; ++frame_idx)
-  {
-    //cv::imwrite(frame_file_names[frame_idx], mov_img_frames[frame_idx]);
+  vout << "burning in text..." << std::endl;
 
-    auto write_cur_debug_tile_imgs = [&] ()
+  auto txt_fn = [&] (const RangeType& r)
+  {
+    for (size_type frame_idx = r.begin(); frame_idx < r.end(); ++frame_idx)
     {
-      if (write_debug_img_frames)
+      //cv::imwrite(frame_file_names[frame_idx], mov_img_frames[frame_idx]);
+
+      auto write_cur_debug_tile_imgs = [&] ()
+      {
+        if (write_debug_img_frames)
+        {
+          cv::imwrite(fmt::format("{}_tiled_mov_{:03d}.png",   debug_frame_prefix, frame_idx), mov_img_frames[frame_idx]);
+          cv::imwrite(fmt::format("{}_tiled_edges_{:03d}.png", debug_frame_prefix, frame_idx), edge_img_frames[frame_idx]);
+        }
+      };
+
+      if (!write_txt_in_debug_tiles)
       {
-        cv::imwrite(fmt::format("{}_tiled_mov_{:03d}.png",   debug_frame_prefix, frame_idx), mov_img_frames[frame_idx]);
-        cv::imwrite(fmt::format("{}_tiled_edges_{:03d}.png", debug_frame_prefix, frame_idx), edge_img_frames[frame_idx]);
+        write_cur_debug_tile_imgs();
       }
-    };
 
-    if (!write_txt_in_debug_tiles)
-    {
-      write_cur_debug_tile_imgs();
+      // burn in the text after writing the single image
+      
+      cv::putText(mov_img_frames[frame_idx], frame_titles[frame_idx], txt_off,
+                  cv::FONT_HERSHEY_SIMPLEX, font_scale,
+                  cv::Scalar(0, 255, 255), font_line_thickness);
+
+      cv::putText(edge_img_frames[frame_idx], frame_titles[frame_idx], txt_off,
+                  cv::FONT_HERSHEY_SIMPLEX, font_scale,
+                  cv::Scalar(0, 255, 255), font_line_thickness);
+      
+      if (write_txt_in_debug_tiles)
+      {
+        write_cur_debug_tile_imgs();
+      }
     }
+  };
 
-    // burn in the text after writing the single image
-    
-    cv::putText(mov_img_frames[frame_idx], frame_titles[frame_idx], txt_off,
-                cv::FONT_HERSHEY_SIMPLEX, font_scale,
-                cv::Scalar(0, 255, 255), font_line_thickness);
+  ParallelFor(txt_fn, RangeType(0, num_frames));
 
-    cv::putText(edge_img_frames[frame_idx], frame_titles[frame_idx], txt_off,
-                cv::FONT_HERSHEY_SIMPLEX, font_scale,
-                cv::Scalar(0, 255, 255), font_line_thickness);
-    
-    if (write_txt_in_debug_tiles)
-    {
-      write_cur_debug_tile_imgs();
-    }
+  vout << "encoding movie frames..." << std::endl;
 
+  for (size_type frame_idx = 0; frame_idx < num_frames; ++frame_idx)
+  {
     mov_vid_writer->write(mov_img_frames[frame_idx]);
 
     edge_vid_writer->write(edge_img_frames[frame_idx]);
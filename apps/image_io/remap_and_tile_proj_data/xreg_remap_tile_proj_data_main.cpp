@@ -35,6 +35,7 @@
 #include "xregCSVUtils.h"
 #include "xregITKResampleUtils.h"
 #include "xregLocalContrastNorm.h"
+#include "xregBackgroundTaskQueue.h"
 
 int main(int argc, char* argv[])
 {
@@ -367,119 +368,79 @@ int main(int argc, char* argv[])
   {
     OCVImgList ocv_imgs(num_projs);
 
-    std::vector<LandMap2> lands(num_projs);
-
     // this will also be used to store common metadata, such as rot flags
     // use an index according to the original file on disk
     const ProjDataF32List pd_f32_meta = pd_reader.proj_data_F32();
 
-    vout << "reading projection data..." << std::endl;
+    // The following functions remap, overlay and flip a single projection,
+    // storing the result in ocv_imgs[proj_idx]. They are run concurrently for
+    // different projections.
+    auto remap_f32_proj_fn = [&] (const size_type proj_idx, ProjDataF32 pd) -> LandMap2
     {
-      if (!do_seg_u8)
-      {
-        vout << "  will read intensities as float32..." << std::endl;
-      }
-      else
+      if (adjust_proj_intens)
       {
-        vout << "  will read intensities as uint8 label map..." << std::endl;
-      }
-    
-      for (size_type proj_idx = 0; proj_idx < num_projs; ++proj_idx)
-      {
-        vout << "    reading proj. " << proj_idx;
-
-        const size_type src_proj_idx = static_cast<size_type>(projs_to_use[proj_idx]);
-        xregASSERT(src_proj_idx < num_src_projs);
+        cv::Mat img_ocv = ShallowCopyItkToOpenCV(pd.img.GetPointer());
         
-        vout << " <-- " << src_proj_idx << " (from file)..." << std::endl;
-
-        if (!do_seg_u8)
+        if (do_grad_mag)
         {
-          ProjDataF32 pd;
-
-          pd.cam = pd_f32_meta[src_proj_idx].cam;
-          pd.landmarks = pd_f32_meta[src_proj_idx].landmarks;
-          pd.img = pd_reader.read_proj_F32(src_proj_idx);
-
-          if (adjust_proj_intens)
-          {
-            cv::Mat img_ocv = ShallowCopyItkToOpenCV(pd.img.GetPointer());
-            
-            if (do_grad_mag)
-            {
-              vout << "      grad. mag. calc. ..." << std::endl;
-              cv::Mat smooth_img(img_ocv.rows, img_ocv.cols, img_ocv.type());
-              cv::Mat tmp_img(img_ocv.rows, img_ocv.cols, img_ocv.type());
-              cv::Mat grad_img(img_ocv.rows, img_ocv.cols, img_ocv.type());
-              
-              SmoothAndGradMag(img_ocv, smooth_img, grad_img, tmp_img, 5);
-              grad_img.copyTo(img_ocv);
-            }
-
-            if (do_std_norm_lcn)
-            {
-              vout << "      local constrast normalization, std. normal..." << std::endl;
-              LocalContrastNormStdNorm(img_ocv, 5, 5, 0.0f).copyTo(img_ocv);
-            }
-            else if (do_jarrett_lcn)
-            {
-              vout << "      local contrast normalization, jarrett..." << std::endl;
-              LocalContrastNormJarrett(img_ocv, 5, 5, 0.0f).copyTo(img_ocv);
-            }
-          }
-
-          if (need_to_ds)
-          {
-            vout << "      downsampling..." << std::endl;
-            pd = DownsampleProjData(pd, proj_ds_factor);
-          }
+          cv::Mat smooth_img(img_ocv.rows, img_ocv.cols, img_ocv.type());
+          cv::Mat tmp_img(img_ocv.rows, img_ocv.cols, img_ocv.type());
+          cv::Mat grad_img(img_ocv.rows, img_ocv.cols, img_ocv.type());
           
-          vout << "      remapping " << src_proj_idx << " to 8bpp..." << std::endl;
-          ocv_imgs[proj_idx] = ShallowCopyItkToOpenCV(
-                                  ITKImageRemap8bpp(pd.img.GetPointer()).GetPointer()).clone();
+          SmoothAndGradMag(img_ocv, smooth_img, grad_img, tmp_img, 5);
+          grad_img.copyTo(img_ocv);
+        }
 
-          lands[proj_idx] = pd.landmarks;
+        if (do_std_norm_lcn)
+        {
+          LocalContrastNormStdNorm(img_ocv, 5, 5, 0.0f).copyTo(img_ocv);
         }
-        else
+        else if (do_jarrett_lcn)
         {
-          ProjDataU8 pd;
+          LocalContrastNormJarrett(img_ocv, 5, 5, 0.0f).copyTo(img_ocv);
+        }
+      }
 
-          pd.cam = pd_f32_meta[src_proj_idx].cam;
-          pd.landmarks = pd_f32_meta[src_proj_idx].landmarks;
-          pd.img = pd_reader.read_proj_U8(src_proj_idx);
-          
-          vout << "      remapping to RGB w/ LUT..." << std::endl;
-          auto img_rgb = RemapITKLabelMap(pd.img.GetPointer(), GenericAnatomyLUT());
+      if (need_to_ds)
+      {
+        pd = DownsampleProjData(pd, proj_ds_factor);
+      }
+      
+      ocv_imgs[proj_idx] = ShallowCopyItkToOpenCV(
+                              ITKImageRemap8bpp(pd.img.GetPointer()).GetPointer()).clone();
 
-          if (need_to_ds)
-          {
-            vout << "      downsampling..." << std::endl;
-            auto rgb_chans = ITKSplitRGB(img_rgb.GetPointer());
+      return pd.landmarks;
+    };
 
-            for (int i = 0; i < 3; ++i)
-            {
-              rgb_chans[i] = DownsampleImage(rgb_chans[i].GetPointer(), proj_ds_factor);
-            }
-            
-            img_rgb = ITKCombineIntoRGB(rgb_chans[0].GetPointer(),
-                                        rgb_chans[1].GetPointer(),
-                                        rgb_chans[2].GetPointer());
-            
-            vout << "        updating landmarks..." << std::endl;
-            for (auto& lkv : pd.landmarks)
-            {
-              lkv.second *= proj_ds_factor;
-            }
-          }
-         
-          ocv_imgs[proj_idx] = CopyITKRGBToOpenCVBGR(img_rgb.GetPointer());
+    auto remap_u8_proj_fn = [&] (const size_type proj_idx, ProjDataU8 pd) -> LandMap2
+    {
+      auto img_rgb = RemapITKLabelMap(pd.img.GetPointer(), GenericAnatomyLUT());
 
-          lands[proj_idx] = pd.landmarks;
+      if (need_to_ds)
+      {
+        auto rgb_chans = ITKSplitRGB(img_rgb.GetPointer());
+
+        for (int i = 0; i < 3; ++i)
+        {
+          rgb_chans[i] = DownsampleImage(rgb_chans[i].GetPointer(), proj_ds_factor);
+        }
+        
+        img_rgb = ITKCombineIntoRGB(rgb_chans[0].GetPointer(),
+                                    rgb_chans[1].GetPointer(),
+                                    rgb_chans[2].GetPointer());
+        
+        for (auto& lkv : pd.landmarks)
+        {
+          lkv.second *= proj_ds_factor;
         }
       }
-    }
+     
+      ocv_imgs[proj_idx] = CopyITKRGBToOpenCVBGR(img_rgb.GetPointer());
+
+      return pd.landmarks;
+    };
 
-    for (size_type proj_idx = 0; proj_idx < num_projs; ++proj_idx)
+    auto overlay_and_flip_fn = [&] (const size_type proj_idx, const LandMap2& lands)
     {
       if (overlay_lands)
       {
@@ -498,7 +459,7 @@ int main(int argc, char* argv[])
 
         const size_type lands_to_show_idx = lands_to_show.empty() ? 0 : (proj_idx % lands_to_show.size());
 
-        for (const auto& lkv : lands[proj_idx])
+        for (const auto& lkv : lands)
         {
           if (overlay_all_lands ||
               (lands_to_show[lands_to_show_idx].find(lkv.first) != lands_to_show[lands_to_show_idx].end()))
@@ -570,15 +531,84 @@ int main(int argc, char* argv[])
 
       if (flip_rows)
       {
-        vout << "  flipping rows..." << std::endl;
         FlipImageRows(&ocv_imgs[proj_idx]);
       }
 
       if (flip_cols)
       {
-        vout << "  flipping cols..." << std::endl;
         FlipImageColumns(&ocv_imgs[proj_idx]);
       }
+    };
+
+    // Projections are read serially, since the HDF5 library is not thread-safe,
+    // while previously read projections are processed by the worker threads. The
+    // number of queued projections is bounded so that only a few full precision
+    // images are held in memory at any time, the remaining memory is that of
+    // the 8bpp tiles.
+    BackgroundTaskQueue proc_queue(0);
+    proc_queue.set_max_num_queued_tasks(proc_queue.num_worker_threads());
+
+    {
+      std::vector<size_type> read_order(num_projs);
+      
+      for (size_type proj_idx = 0; proj_idx < num_projs; ++proj_idx)
+      {
+        read_order[proj_idx] = static_cast<size_type>(projs_to_use[proj_idx]);
+      }
+
+      pd_reader.set_prefetch_order(read_order);
+      pd_reader.set_num_prefetch(2);
+    }
+
+    vout << "reading and remapping projection data..." << std::endl;
+    {
+      if (!do_seg_u8)
+      {
+        vout << "  will read intensities as float32..." << std::endl;
+      }
+      else
+      {
+        vout << "  will read intensities as uint8 label map..." << std::endl;
+      }
+    
+      for (size_type proj_idx = 0; proj_idx < num_projs; ++proj_idx)
+      {
+        vout << "    reading proj. " << proj_idx;
+
+        const size_type src_proj_idx = static_cast<size_type>(projs_to_use[proj_idx]);
+        xregASSERT(src_proj_idx < num_src_projs);
+        
+        vout << " <-- " << src_proj_idx << " (from file)..." << std::endl;
+
+        if (!do_seg_u8)
+        {
+          ProjDataF32 pd;
+
+          pd.cam = pd_f32_meta[src_proj_idx].cam;
+          pd.landmarks = pd_f32_meta[src_proj_idx].landmarks;
+          pd.img = pd_reader.read_proj_F32(src_proj_idx);
+
+          proc_queue.add([&remap_f32_proj_fn,&overlay_and_flip_fn,proj_idx,pd] ()
+          {
+            overlay_and_flip_fn(proj_idx, remap_f32_proj_fn(proj_idx, pd));
+          });
+        }
+        else
+        {
+          ProjDataU8 pd;
+
+          pd.cam = pd_f32_meta[src_proj_idx].cam;
+          pd.landmarks = pd_f32_meta[src_proj_idx].landmarks;
+          pd.img = pd_reader.read_proj_U8(src_proj_idx);
+          
+          proc_queue.add([&remap_u8_proj_fn,&overlay_and_flip_fn,proj_idx,pd] ()
+          {
+            overlay_and_flip_fn(proj_idx, remap_u8_proj_fn(proj_idx, pd));
+          });
+        }
+      }
+
+      proc_queue.wait();
     }
 
     vout << "tiling..." << std::endl;
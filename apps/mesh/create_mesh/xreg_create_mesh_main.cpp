@@ -25,8 +25,11 @@
 #include <itkBinaryThresholdImageFilter.h>
 #include <itkFlipImageFilter.h>
 
+#include <fmt/format.h>
+
 // xreg
 #include "xregStringUtils.h"
+#include "xregFilesystemUtils.h"
 #include "xregMeshIO.h"
 #include "xregProgOptUtils.h"
 #include "xregVTKMeshUtils.h"
@@ -142,6 +145,23 @@ int main(int argc, char* argv[])
          "Output a mesh with vertices in continuous image indices - not physical coordinates associated with the image.")
       << false;
 
+  po.add("separate-labels", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_TRUE, "separate-labels",
+         "Create a separate mesh for each label, instead of a single mesh of all labels. "
+         "The meshes are created concurrently and the label value is appended to the "
+         "output path prior to the extension, e.g. \"bones.ply\" yields \"bones_1.ply\", "
+         "\"bones_2.ply\", etc.")
+    << false;
+  
+  po.add("no-crop", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_TRUE, "no-crop",
+         "Run marching cubes over the entire volume, instead of only the bounding box about "
+         "the labels. Does not change the output.")
+    << false;
+
+  po.add("flying-edges", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_TRUE, "flying-edges",
+         "Use the multi-threaded discrete flying edges isosurface filter instead of discrete "
+         "marching cubes. Requires VTK 9 or later, otherwise marching cubes is used.")
+    << false;
+
   po.add("ascii", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_TRUE, "ascii",
          "Write into an ASCII compatible format when possible/supported.")
     << false;
@@ -198,6 +218,11 @@ int main(int argc, char* argv[])
 
   create_mesh_fn.no_phys_coords = po.get("no-phys-coords");
 
+  create_mesh_fn.crop_to_labels   = !po.get("no-crop");
+  create_mesh_fn.use_flying_edges =  po.get("flying-edges");
+
+  const bool separate_labels = po.get("separate-labels");
+
   const std::string input_img_path = po.pos_args()[0];
 
   const size_type num_labels_cmd_line = po.pos_args().size() - 2;  // first 2 arguments are input image and output mesh
@@ -295,21 +320,51 @@ int main(int argc, char* argv[])
     cur_label_img = flipper->GetOutput();
   }
 
-  vout << "creating mesh..." << std::endl;
-  auto mesh = create_mesh_fn(cur_label_img.GetPointer());
+  const std::string& dst_mesh_path = po.pos_args()[1];
+
+  std::vector<TriMesh> meshes;
+  std::vector<std::string> mesh_paths;
 
-  if (swap_lps_ras)
+  if (!separate_labels)
   {
-    vout << "LPS -> RAS..." << std::endl;
-    FrameTransform lps2ras = FrameTransform::Identity();
-    lps2ras.matrix()(0,0) = -1;
-    lps2ras.matrix()(1,1) = -1;
-    mesh.transform(lps2ras);
+    vout << "creating mesh..." << std::endl;
+    meshes.push_back(create_mesh_fn(cur_label_img.GetPointer()));
+    mesh_paths.push_back(dst_mesh_path);
   }
+  else
+  {
+    vout << "creating a mesh for each label..." << std::endl;
+    meshes = create_mesh_fn.create_mesh_per_label(cur_label_img.GetPointer());
+
+    std::string dst_prefix;
+    std::string dst_ext;
+    std::tie(dst_prefix, dst_ext) = Path(dst_mesh_path).split_ext();
 
-  // Write mesh to disk
-  vout << "writing mesh to disk..." << std::endl;
-  WriteMeshToDisk(mesh, po.pos_args()[1], prefer_ascii);
+    for (const auto& l : create_mesh_fn.labels)
+    {
+      mesh_paths.push_back(fmt::format("{}_{}{}", dst_prefix, static_cast<int>(l), dst_ext));
+    }
+  }
+
+  const size_type num_meshes = meshes.size();
+
+  for (size_type mesh_idx = 0; mesh_idx < num_meshes; ++mesh_idx)
+  {
+    auto& mesh = meshes[mesh_idx];
+
+    if (swap_lps_ras)
+    {
+      vout << "LPS -> RAS..." << std::endl;
+      FrameTransform lps2ras = FrameTransform::Identity();
+      lps2ras.matrix()(0,0) = -1;
+      lps2ras.matrix()(1,1) = -1;
+      mesh.transform(lps2ras);
+    }
+
+    // Write mesh to disk
+    vout << "writing mesh to disk: " << mesh_paths[mesh_idx] << std::endl;
+    WriteMeshToDisk(mesh, mesh_paths[mesh_idx], prefer_ascii);
+  }
 
   return kEXIT_VAL_SUCCESS;
 }
@@ -22,6 +22,8 @@
  * SOFTWARE.
  */
 
+#include <random>
+
 #include "xregProgOptUtils.h"
 #include "xregMeshIO.h"
 #include "xregFilesystemUtils.h"
@@ -33,6 +35,9 @@
 #include "xregLandmarkMapUtils.h"
 #include "xregPairedPointRegi3D3D.h"
 #include "xregITKIOUtils.h"
+#include "xregPointCloudUtils.h"
+#include "xregRotUtils.h"
+#include "xregSampleUtils.h"
 
 int main(int argc, char* argv[])
 {
@@ -78,10 +83,40 @@ int main(int argc, char* argv[])
          "classifying outlier points. <= 0 indicates no outlier detection.")
     << icp.std_dev_outlier_coeff;
 
+  po.add("trim", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "trim",
+         "Fraction of points, with the smallest surface distances, used at each iteration "
+         "(trimmed ICP). 1 indicates that no trimming is performed.")
+    << icp.trim_frac;
+
+  po.add("num-starts", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32, "num-starts",
+         "Number of initial poses to run ICP from concurrently; the result with the smallest "
+         "final mean surface distance is used. The first start is always the initialization "
+         "(identity or computed from landmarks), the others randomly perturb it about the "
+         "point cloud centroid.")
+    << ProgOpts::uint32(1);
+
+  po.add("start-rot", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "start-rot",
+         "Maximum rotation angle (degrees) of the perturbations used for additional starts.")
+    << 15.0;
+
+  po.add("start-trans", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_DOUBLE, "start-trans",
+         "Maximum translation, in each dimension, of the perturbations used for additional starts.")
+    << 10.0;
+
+  po.add("seed", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32, "seed",
+         "Seed for sampling the perturbations used for additional starts. When not provided, "
+         "a random seed is used.");
+
   po.add("similarity", 's', ProgOpts::kSTORE_TRUE, "similarity",
          "Compute similarity transform - e.g. compute scale in addition to rigid pose.")
     << false;
 
+  po.add("mesh-cache-dir", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "mesh-cache-dir",
+         "Directory used to cache meshes in a format which loads quickly. A cached copy "
+         "of the mesh is written when it does not exist or is older than the mesh file. "
+         "Empty -> no caching.")
+    << "";
+
   po.set_arg_usage("<Mesh Path> <Point Cloud Path> <output transform>");
 
   po.set_min_num_pos_args(3);
@@ -121,10 +156,25 @@ int main(int argc, char* argv[])
 
   icp.std_dev_outlier_coeff = po.get("std-dev-outlier");
 
+  icp.trim_frac = po.get("trim");
+
+  if ((icp.trim_frac <= 0) || (icp.trim_frac > 1))
+  {
+    std::cerr << "ERROR: trim fraction must be in (0,1]!" << std::endl;
+    return kEXIT_VAL_BAD_USE;
+  }
+
   icp.allow_similarity = po.get("similarity");
 
+  const size_type num_starts = po.get("num-starts").as_uint32();
+
+  const CoordScalar start_rot_rad = po.get("start-rot").as_double() * kDEG2RAD;
+  const CoordScalar start_trans   = po.get("start-trans").as_double();
+
   const std::string mesh_lands_path = po.get("mesh-lands");
   const std::string pts_lands_path = po.get("pts-lands");
+
+  const std::string mesh_cache_dir = po.get("mesh-cache-dir");
   
   if (mesh_lands_path.empty() ^ pts_lands_path.empty())
   {
@@ -134,7 +184,7 @@ int main(int argc, char* argv[])
   }
 
   vout << "reading mesh from disk..." << std::endl;
-  const auto mesh = ReadMeshFromDisk(mesh_path);
+  const auto mesh = ReadMeshFromDiskWithCache(mesh_path, mesh_cache_dir);
   vout << "  complete." << std::endl;
 
   icp.sur = &mesh;
@@ -160,6 +210,50 @@ int main(int argc, char* argv[])
   
   icp.pts = &pt_cloud;
 
+  if (num_starts > 1)
+  {
+    vout << "sampling additional initial poses..." << std::endl;
+
+    std::mt19937 rng_eng;
+
+    if (po.has("seed"))
+    {
+      rng_eng.seed(po.get("seed").as_uint32());
+    }
+    else
+    {
+      SeedRNGEngWithRandDev(&rng_eng);
+    }
+
+    std::normal_distribution<CoordScalar> axis_dist(0, 1);
+    std::uniform_real_distribution<CoordScalar> ang_dist(0, start_rot_rad);
+    std::uniform_real_distribution<CoordScalar> trans_dist(-start_trans, start_trans);
+
+    // rotations are applied about the initially transformed point cloud centroid
+    const Pt3 init_centroid = icp.init_pts_to_sur_xform * ComputeCentroid(pt_cloud);
+
+    for (size_type i = 1; i < num_starts; ++i)
+    {
+      Pt3 rot_axis;
+      
+      do
+      {
+        rot_axis = { axis_dist(rng_eng), axis_dist(rng_eng), axis_dist(rng_eng) };
+      }
+      while (rot_axis.norm() < 1.0e-6);
+
+      rot_axis.normalize();
+
+      const Pt3 delta_trans = { trans_dist(rng_eng), trans_dist(rng_eng), trans_dist(rng_eng) };
+
+      FrameTransform delta = FrameTransform::Identity();
+      delta.linear() = ExpSO3(Pt3(rot_axis * ang_dist(rng_eng)));
+      delta.translation() = init_centroid - (delta.linear() * init_centroid) + delta_trans;
+
+      icp.multi_start_xforms.push_back(delta * icp.init_pts_to_sur_xform);
+    }
+  }
+
   vout << "running ICP..." << std::endl;
   const FrameTransform regi_xform = icp.run();
 
@@ -0,0 +1,434 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <thread>
+
+#define BOOST_ERROR_CODE_HEADER_ONLY
+#include <boost/process.hpp>
+#undef BOOST_ERROR_CODE_HEADER_ONLY
+
+#include <fmt/format.h>
+
+#include "xregProgOptUtils.h"
+#include "xregStringUtils.h"
+#include "xregFilesystemUtils.h"
+#include "xregOpenCLSys.h"
+#include "xregTimer.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+// A single registration case from the manifest
+struct BatchCase
+{
+  size_type line_num;
+
+  // executable followed by its arguments
+  StrList cmd;
+};
+
+using BatchCaseList = std::vector<BatchCase>;
+
+// Splits a line of the manifest into the tokens of a command, whitespace
+// separates tokens, except when enclosed by double quotes.
+StrList TokenizeCaseCmd(const std::string& line)
+{
+  StrList toks;
+
+  std::string cur_tok;
+  bool in_quotes = false;
+  bool have_tok  = false;
+
+  for (const char c : line)
+  {
+    if (c == '\"')
+    {
+      in_quotes = !in_quotes;
+      have_tok  = true;
+    }
+    else if (!in_quotes && ((c == ' ') || (c == '\t') || (c == '\r') || (c == '\n')))
+    {
+      if (have_tok)
+      {
+        toks.push_back(cur_tok);
+        cur_tok.clear();
+        have_tok = false;
+      }
+    }
+    else
+    {
+      cur_tok += c;
+      have_tok = true;
+    }
+  }
+
+  if (in_quotes)
+  {
+    xregThrow("unterminated quotes in manifest line: %s", line.c_str());
+  }
+
+  if (have_tok)
+  {
+    toks.push_back(cur_tok);
+  }
+
+  return toks;
+}
+
+// Each non-empty line of the manifest, not starting with '#', is a case.
+BatchCaseList ReadBatchManifest(const std::string& path)
+{
+  std::ifstream in(path);
+
+  if (!in.good())
+  {
+    xregThrow("failed to open batch manifest: %s", path.c_str());
+  }
+
+  BatchCaseList cases;
+
+  std::string line;
+  size_type line_num = 0;
+
+  while (std::getline(in, line))
+  {
+    ++line_num;
+
+    const std::string stripped_line = StringStrip(line);
+
+    if (!stripped_line.empty() && (stripped_line[0] != '#'))
+    {
+      cases.push_back(BatchCase{ line_num, TokenizeCaseCmd(stripped_line) });
+    }
+  }
+
+  return cases;
+}
+
+bool CmdHasArg(const StrList& cmd, const std::string& arg)
+{
+  return std::any_of(cmd.begin(), cmd.end(),
+                     [&arg] (const std::string& s)
+                     {
+                       return (s == arg) || StringStartsWith(s, arg + "=");
+                     });
+}
+
+// A case that has been launched and has not yet been reaped
+struct RunningCase
+{
+  size_type case_idx;
+
+  // index into the list of OpenCL devices, or the number of devices when
+  // no device was assigned
+  size_type dev_idx;
+
+  Timer timer;
+
+  std::unique_ptr<boost::process::child> proc;
+};
+
+}  // un-named
+
+int main(int argc, char* argv[])
+{
+  constexpr int kEXIT_VAL_SUCCESS     = 0;
+  constexpr int kEXIT_VAL_BAD_USE     = 1;
+  constexpr int kEXIT_VAL_CASE_FAILED = 2;
+
+  namespace bp = boost::process;
+
+  ProgOpts po;
+
+  xregPROG_OPTS_SET_COMPILE_DATE(po);
+
+  po.set_help("Runs a batch of registration cases, several at a time, sharing the OpenCL "
+              "devices and CPU cores of this node. Each non-empty line of the manifest file, "
+              "which does not start with \'#\', is a case: the command line of a registration "
+              "program (e.g. xreg-hip-surg-pelvis-single-view-regi-2d-3d) followed by its "
+              "arguments. Double quotes may be used to group arguments containing whitespace. "
+              "Each case is run as its own process and writes its usual output files. "
+              "Several cases are assigned to each OpenCL device, so that ray casting from one "
+              "case keeps a device busy while another case is performing CPU bound work, "
+              "such as reading and preprocessing its volumes. Unless present on a case's "
+              "command line, \"--ocl-id\" is appended to assign the case to the device with "
+              "the fewest running cases, and \"--tbb-arena-threads\" is appended to divide "
+              "the CPU cores among the concurrently running cases.");
+  po.set_arg_usage("<Manifest File>");
+  po.set_min_num_pos_args(1);
+
+  po.add("ocl-ids", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "ocl-ids",
+         "Comma separated list of OpenCL device IDs to distribute cases among. The "
+         "available device ID strings may be obtained from the help print-out of a "
+         "registration program. \"all-gpus\" uses every OpenCL GPU on this node. "
+         "Empty -> devices are not assigned to cases.")
+    << "all-gpus";
+
+  po.add("cases-per-dev", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32, "cases-per-dev",
+         "The number of cases run concurrently on each OpenCL device.")
+    << ProgOpts::uint32(2);
+
+  po.add("max-concurrent", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32, "max-concurrent",
+         "The maximum number of cases run concurrently. When not specified, this is the "
+         "number of devices multiplied by the number of cases per device, or the number of "
+         "cases per device when no devices are assigned.");
+
+  po.add("threads-per-case", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32, "threads-per-case",
+         "The maximum number of CPU threads used by each case. Zero -> the number of hardware "
+         "threads divided by the maximum number of concurrent cases.")
+    << ProgOpts::uint32(0);
+
+  po.add("log-dir", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING, "log-dir",
+         "Directory to write the standard output and error of each case, "
+         "e.g. <log-dir>/case_<manifest line>.txt. Empty -> the output of each case is discarded.")
+    << "";
+
+  try
+  {
+    po.parse(argc, argv);
+  }
+  catch (const ProgOpts::Exception& e)
+  {
+    std::cerr << "Error parsing command line arguments: " << e.what() << std::endl;
+    po.print_usage(std::cerr);
+    return kEXIT_VAL_BAD_USE;
+  }
+
+  if (po.help_set())
+  {
+    po.print_usage(std::cout);
+    po.print_help(std::cout);
+    return kEXIT_VAL_SUCCESS;
+  }
+
+  std::ostream& vout = po.vout();
+
+  const std::string manifest_path = po.pos_args()[0];
+
+  const std::string ocl_ids_str = po.get("ocl-ids");
+
+  const size_type cases_per_dev = std::max(ProgOpts::uint32(1), po.get("cases-per-dev").as_uint32());
+
+  const std::string log_dir = po.get("log-dir");
+
+  vout << "reading manifest..." << std::endl;
+  const BatchCaseList cases = ReadBatchManifest(manifest_path);
+
+  const size_type num_cases = cases.size();
+  vout << "  number of cases: " << num_cases << std::endl;
+
+  StrList ocl_ids;
+
+  if (ocl_ids_str == "all-gpus")
+  {
+    ocl_ids = DevIDStrs(false);
+  }
+  else if (!ocl_ids_str.empty())
+  {
+    ocl_ids = StringSplit(ocl_ids_str, ",");
+  }
+
+  const size_type num_devs = ocl_ids.size();
+
+  vout << "OpenCL devices used: " << num_devs << std::endl;
+  for (const auto& id : ocl_ids)
+  {
+    vout << "  " << id << std::endl;
+  }
+
+  const size_type max_concurrent = po.has("max-concurrent") ?
+                                      std::max(ProgOpts::uint32(1), po.get("max-concurrent").as_uint32()) :
+                                      (std::max(size_type(1), num_devs) * cases_per_dev);
+
+  size_type threads_per_case = po.get("threads-per-case").as_uint32();
+  if (!threads_per_case)
+  {
+    threads_per_case = std::max(size_type(1),
+                                static_cast<size_type>(std::thread::hardware_concurrency()) / max_concurrent);
+  }
+
+  vout << "max. concurrent cases: " << max_concurrent << std::endl;
+  vout << "threads per case: " << threads_per_case << std::endl;
+
+  if (!log_dir.empty() && !Path(log_dir).exists())
+  {
+    MakeDirRecursive(log_dir);
+  }
+
+  std::vector<size_type> num_running_on_dev(num_devs, 0);
+
+  std::vector<int> exit_codes(num_cases, -1);
+  std::vector<double> case_secs(num_cases, 0.0);
+
+  std::vector<std::unique_ptr<RunningCase>> running;
+
+  Timer tot_timer;
+  tot_timer.start();
+
+  size_type next_case_idx = 0;
+
+  while ((next_case_idx < num_cases) || !running.empty())
+  {
+    // launch as many cases as allowed
+    while ((next_case_idx < num_cases) && (running.size() < max_concurrent))
+    {
+      const size_type case_idx = next_case_idx;
+      ++next_case_idx;
+
+      const BatchCase& cur_case = cases[case_idx];
+
+      if (cur_case.cmd.empty())
+      {
+        continue;
+      }
+
+      std::unique_ptr<RunningCase> rc(new RunningCase);
+      rc->case_idx = case_idx;
+      rc->dev_idx  = num_devs;
+
+      StrList args(cur_case.cmd.begin() + 1, cur_case.cmd.end());
+
+      if (num_devs && !CmdHasArg(args, "--ocl-id"))
+      {
+        rc->dev_idx = std::min_element(num_running_on_dev.begin(), num_running_on_dev.end()) -
+                        num_running_on_dev.begin();
+
+        args.push_back("--ocl-id");
+        args.push_back(ocl_ids[rc->dev_idx]);
+
+        ++num_running_on_dev[rc->dev_idx];
+      }
+
+      if (!CmdHasArg(args, "--tbb-arena-threads"))
+      {
+        args.push_back("--tbb-arena-threads");
+        args.push_back(fmt::format("{}", threads_per_case));
+      }
+
+      std::string exe_path = cur_case.cmd[0];
+      if (!Path(exe_path).exists())
+      {
+        exe_path = FindExeOnSystemPath(exe_path);
+      }
+
+      vout << fmt::format("launching case {} (line {}): {} {}", case_idx, cur_case.line_num,
+                          exe_path, JoinTokens(args, " ")) << std::endl;
+
+      rc->timer.start();
+
+      try
+      {
+        if (log_dir.empty())
+        {
+          rc->proc.reset(new bp::child(exe_path, bp::args(args),
+                                       bp::std_out > bp::null, bp::std_err > bp::null));
+        }
+        else
+        {
+          const std::string log_path = (Path(log_dir) +
+                                          Path(fmt::format("case_{:04d}.txt", cur_case.line_num))).string();
+
+          rc->proc.reset(new bp::child(exe_path, bp::args(args),
+                                       (bp::std_out & bp::std_err) > log_path));
+        }
+      }
+      catch (const std::exception& e)
+      {
+        std::cerr << "ERROR: failed to launch case " << case_idx << ": " << e.what() << std::endl;
+
+        if (rc->dev_idx < num_devs)
+        {
+          --num_running_on_dev[rc->dev_idx];
+        }
+
+        continue;
+      }
+
+      running.push_back(std::move(rc));
+    }
+
+    // reap any finished cases
+    for (auto it = running.begin(); it != running.end();)
+    {
+      RunningCase& rc = **it;
+
+      if (!rc.proc->running())
+      {
+        rc.proc->wait();
+
+        rc.timer.stop();
+
+        exit_codes[rc.case_idx] = rc.proc->exit_code();
+        case_secs[rc.case_idx]  = rc.timer.elapsed_seconds();
+
+        if (rc.dev_idx < num_devs)
+        {
+          --num_running_on_dev[rc.dev_idx];
+        }
+
+        vout << fmt::format("case {} finished with exit code {} in {:.1f} seconds",
+                            rc.case_idx, exit_codes[rc.case_idx], case_secs[rc.case_idx]) << std::endl;
+
+        it = running.erase(it);
+      }
+      else
+      {
+        ++it;
+      }
+    }
+
+    if (!running.empty())
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+  }
+
+  tot_timer.stop();
+
+  size_type num_failed = 0;
+
+  for (size_type case_idx = 0; case_idx < num_cases; ++case_idx)
+  {
+    if (exit_codes[case_idx])
+    {
+      ++num_failed;
+
+      std::cerr << fmt::format("case {} (line {}) FAILED, exit code: {}", case_idx,
+                               cases[case_idx].line_num, exit_codes[case_idx]) << std::endl;
+    }
+  }
+
+  vout << fmt::format("{} of {} cases succeeded, total time: {:.1f} seconds",
+                      num_cases - num_failed, num_cases, tot_timer.elapsed_seconds()) << std::endl;
+
+  vout << "exiting..." << std::endl;
+
+  return num_failed ? kEXIT_VAL_CASE_FAILED : kEXIT_VAL_SUCCESS;
+}
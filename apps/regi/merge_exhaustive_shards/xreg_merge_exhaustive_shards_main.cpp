@@ -0,0 +1,88 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2021 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregProgOptUtils.h"
+#include "xregHDF5.h"
+#include "xregIntensity2D3DRegiExhaustive.h"
+
+int main(int argc, char* argv[])
+{
+  constexpr int kEXIT_VAL_SUCCESS  = 0;
+  constexpr int kEXIT_VAL_BAD_USE  = 1;
+
+  using namespace xreg;
+
+  ProgOpts po;
+
+  xregPROG_OPTS_SET_COMPILE_DATE(po);
+
+  po.set_help("Combines the partial result files written by each shard of a distributed "
+      "exhaustive 2D/3D search into a single HDF5 file with the standard exhaustive "
+      "search optimization aux. layout (an \"opt-aux\" group). The file of every shard "
+      "must be provided, in any order. The minimum similarity value, its index, all "
+      "similarity values (when saved by every shard) and the best candidates across "
+      "all shards are written.");
+  po.set_arg_usage("<Shard Result File #1> [... <Shard Result File #N>] <Output Merged File>");
+  po.set_min_num_pos_args(2);
+
+  try
+  {
+    po.parse(argc, argv);
+  }
+  catch (const ProgOpts::Exception& e)
+  {
+    std::cerr << "Error parsing command line arguments: " << e.what() << std::endl;
+    po.print_usage(std::cerr);
+    return kEXIT_VAL_BAD_USE;
+  }
+
+  if (po.help_set())
+  {
+    po.print_usage(std::cout);
+    po.print_help(std::cout);
+    return kEXIT_VAL_SUCCESS;
+  }
+
+  std::ostream& vout = po.vout();
+
+  const auto pos_args = po.pos_args();
+
+  const std::vector<std::string> shard_paths(pos_args.begin(), pos_args.end() - 1);
+
+  const std::string dst_path = pos_args.back();
+
+  vout << "opening H5 file for writing: " << dst_path << std::endl;
+  H5::H5File dst_h5(dst_path, H5F_ACC_TRUNC);
+
+  vout << "merging " << shard_paths.size() << " shard files..." << std::endl;
+  MergeExhaustiveShardResults(shard_paths, &dst_h5);
+
+  dst_h5.flush(H5F_SCOPE_GLOBAL);
+  dst_h5.close();
+
+  vout << "exiting..." << std::endl;
+
+  return kEXIT_VAL_SUCCESS;
+}
+
@@ -74,6 +74,25 @@ xreg::PtN xreg::Dist::log_densities(const PtNList& pts) const
   return out;
 }
 
+xreg::PtN xreg::Dist::log_densities(const MatMxN& pts) const
+{
+  const size_type num_pts = pts.cols();
+
+  PtN out(num_pts);
+
+  for (size_type i = 0; i < num_pts; ++i)
+  {
+    out[i] = this->log_density(pts.col(i));
+  }
+
+  return out;
+}
+
+xreg::PtN xreg::Dist::densities(const MatMxN& pts) const
+{
+  return log_densities(pts).array().exp().matrix();
+}
+
 xreg::PtN xreg::Dist::draw_sample(std::mt19937&) const
 {
   throw UnsupportedOperation();
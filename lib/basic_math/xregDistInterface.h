@@ -55,6 +55,18 @@ public:
 
   virtual PtN log_densities(const PtNList& pts) const;
 
+  /// \brief Log densities of each column of a matrix of points
+  ///
+  /// This is intended for evaluating an entire population of samples at once.
+  /// The default implementation calls log_density() on each column; derived
+  /// classes may override with a vectorized evaluation.
+  virtual PtN log_densities(const MatMxN& pts) const;
+
+  /// \brief Densities of each column of a matrix of points
+  ///
+  /// The default implementation exponentiates log_densities().
+  virtual PtN densities(const MatMxN& pts) const;
+
   virtual PtN draw_sample(std::mt19937& g) const;
 
   // The i,j entry of the output matrix stores the ith component of the jth sample.
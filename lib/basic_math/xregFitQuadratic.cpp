@@ -140,3 +140,62 @@ xreg::MatMxN xreg::FitQuadradicFormSymmetric(const MatMxN& params, const PtN& fn
 
   return H;
 }
+
+std::tuple<xreg::CoordScalar,xreg::PtN,xreg::MatMxN>
+xreg::FitQuadraticFn(const MatMxN& params, const PtN& fn_vals)
+{
+  const size_type num_obs = params.cols();
+  const size_type dim = params.rows();
+
+  xregASSERT(num_obs == static_cast<size_type>(fn_vals.size()));
+
+  // columns of A: constant, linear terms, then the upper triangle of H
+  const size_type num_sym_el = (dim * (dim + 1)) / 2;
+
+  MatMxN A(num_obs, 1 + dim + num_sym_el);
+
+  // populate A
+
+  for (size_type obs_idx = 0; obs_idx < num_obs; ++obs_idx)
+  {
+    auto x = params.col(obs_idx);
+
+    A(obs_idx,0) = 1;
+
+    A.block(obs_idx, 1, 1, dim) = x.transpose();
+
+    size_type flat_idx = 1 + dim;
+    for (size_type r = 0; r < dim; ++r)
+    {
+      A(obs_idx,flat_idx) = (x(r) * x(r)) / CoordScalar(2);
+      ++flat_idx;
+
+      // off-diagonal elements appear twice in x^T H x
+      for (size_type c = (r + 1); c < dim; ++c, ++flat_idx)
+      {
+        A(obs_idx,flat_idx) = x(r) * x(c);
+      }
+    }
+  }
+
+  Eigen::JacobiSVD<MatMxN> svd(A, Eigen::ComputeThinU | Eigen::ComputeThinV);
+
+  const PtN coeffs = svd.solve(fn_vals);
+
+  MatMxN H(dim, dim);
+
+  size_type flat_idx = 1 + dim;
+  for (size_type r = 0; r < dim; ++r)
+  {
+    H(r,r) = coeffs(flat_idx);
+    ++flat_idx;
+
+    for (size_type c = (r + 1); c < dim; ++c, ++flat_idx)
+    {
+      H(r,c) = coeffs(flat_idx);
+      H(c,r) = coeffs(flat_idx);
+    }
+  }
+
+  return std::make_tuple(coeffs(0), PtN(coeffs.segment(1, dim)), H);
+}
@@ -51,6 +51,16 @@ MatMxN FitQuadradicForm(const MatMxN& params, const PtN& fn_vals);
 // limited to having a symmetric matrix, H.
 MatMxN FitQuadradicFormSymmetric(const MatMxN& params, const PtN& fn_vals);
 
+// Fits a general quadratic function, h(x) = c + g^T x + 0.5 * x^T H x, with a
+// symmetric H, using a set of observations (x_1, f(x_1), ... (x_N, f(x_N)).
+//
+// params and fn_vals have the same layout as FitQuadradicForm. At least
+// 1 + M + (M * (M + 1) / 2) observations are needed for a unique solution.
+//
+// The tuple (c, g, H) is returned.
+std::tuple<CoordScalar,PtN,MatMxN>
+FitQuadraticFn(const MatMxN& params, const PtN& fn_vals);
+
 }  // xreg
 
  #endif
@@ -27,6 +27,8 @@
 #include <limits>
 #include <cmath>
 
+#include "xregAssert.h"
+
 xreg::FoldNormDist::FoldNormDist(const Scalar m_arg, const Scalar s_arg)
   : m_(m_arg), s_(s_arg), two_s_sq_(2 * s_ * s_),
     norm_const_(std::sqrt(two_s_sq_ * Scalar(3.141592653589793))),
@@ -68,6 +70,11 @@ xreg::FoldNormDist::Scalar xreg::FoldNormDist::exp_helper(const Scalar x) const
             std::exp((x_plus_m * x_plus_m) / -two_s_sq_);
 }
   
+xreg::FoldNormDist::RowArray xreg::FoldNormDist::exp_helper(const RowArray& x) const
+{
+  return ((x - m_).square() / -two_s_sq_).exp() + ((x + m_).square() / -two_s_sq_).exp();
+}
+
 xreg::FoldNormDist::Scalar xreg::FoldNormDist::density(const PtN& x) const
 {
   return operator()(x[0]);
@@ -78,6 +85,30 @@ xreg::FoldNormDist::Scalar xreg::FoldNormDist::log_density(const PtN& x) const
   return log_density(x[0]);
 }
 
+xreg::PtN xreg::FoldNormDist::log_densities(const MatMxN& pts) const
+{
+  xregASSERT(pts.rows() == 1);
+
+  const RowArray x = pts.row(0).array();
+
+  const RowArray un_norm_probs = exp_helper(x);
+
+  // same thresholds as the single sample evaluation
+  const RowArray log_probs = (un_norm_probs > Scalar(1.0e-14)).select(un_norm_probs.log() - log_norm_const_,
+                                                  std::numeric_limits<Scalar>::lowest());
+
+  return (x >= 0).select(log_probs, -std::numeric_limits<Scalar>::infinity()).matrix().transpose();
+}
+
+xreg::PtN xreg::FoldNormDist::densities(const MatMxN& pts) const
+{
+  xregASSERT(pts.rows() == 1);
+
+  const RowArray x = pts.row(0).array();
+
+  return (x >= 0).select(exp_helper(x) / norm_const_, Scalar(0)).matrix().transpose();
+}
+
 xreg::FoldNormDist::Scalar xreg::FoldNormDist::norm_const() const
 {
   return norm_const_;
@@ -43,6 +43,15 @@ public:
 
   Scalar log_density(const PtN& x) const override;
 
+  using Dist::log_densities;
+  using Dist::densities;
+
+  /// \brief Vectorized log densities of each column of a 1 x N matrix
+  PtN log_densities(const MatMxN& pts) const override;
+
+  /// \brief Vectorized densities of each column of a 1 x N matrix
+  PtN densities(const MatMxN& pts) const override;
+
   Scalar norm_const() const override;
 
   Scalar log_norm_const() const override;
@@ -54,6 +63,10 @@ public:
 private:
 
   Scalar exp_helper(const Scalar x) const;
+
+  using RowArray = Eigen::Array<Scalar,1,Eigen::Dynamic>;
+
+  RowArray exp_helper(const RowArray& x) const;
   
   Scalar m_;
   Scalar s_;
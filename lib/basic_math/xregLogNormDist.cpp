@@ -25,6 +25,8 @@
 #include "xregLogNormDist.h"
 
 #include <cmath>
+
+#include "xregAssert.h"
   
 xreg::LogNormDist::LogNormDist(const Scalar m_arg, const Scalar s_arg)
   : m_(m_arg), s_(s_arg), two_s_sq_(2 * s_ * s_),
@@ -55,6 +57,15 @@ xreg::LogNormDist::Scalar xreg::LogNormDist::log_density(const PtN& x) const
   return log_density(x[0]);
 }
 
+xreg::PtN xreg::LogNormDist::log_densities(const MatMxN& pts) const
+{
+  xregASSERT(pts.rows() == 1);
+
+  const auto log_x = pts.row(0).array().log();
+
+  return (((log_x - m_).square() / -two_s_sq_) - log_x - log_norm_const_).matrix().transpose();
+}
+
 xreg::LogNormDist::Scalar xreg::LogNormDist::norm_const() const
 {
   return norm_const_;
@@ -43,6 +43,11 @@ public:
 
   Scalar log_density(const PtN& x) const override;
 
+  using Dist::log_densities;
+
+  /// \brief Vectorized log densities of each column of a 1 x N matrix
+  PtN log_densities(const MatMxN& pts) const override;
+
   Scalar norm_const() const override;
 
   Scalar log_norm_const() const override;
@@ -48,6 +48,10 @@ xreg::MultivarNormalDist::MultivarNormalDist(const PtN& mean, const MatMxN& cov,
 
   mean_ = mean;
 
+  cov_chol_.compute(cov);
+
+  use_cov_chol_ = cov_chol_.info() == Eigen::Success;
+
   if (enable_sampling)
   {
     Eigen::SelfAdjointEigenSolver<MatMxN> eig(cov);
@@ -70,6 +74,28 @@ xreg::MultivarNormalDist::Scalar xreg::MultivarNormalDist::log_density(const PtN
   return (static_cast<Scalar>(-0.5) * (x - mean_).transpose() * cov_inv_ * (x - mean_)) - log_norm_const_;
 }
 
+xreg::PtN xreg::MultivarNormalDist::log_densities(const MatMxN& pts) const
+{
+  xregASSERT(pts.rows() == mean_.size());
+
+  const MatMxN diffs = pts.colwise() - mean_;
+
+  // squared Mahalanobis distances of every column at once:
+  // d^T C^-1 d = ||L^-1 d||^2, where C = L L^T
+  Eigen::Array<Scalar,1,Eigen::Dynamic> sq_dists;
+
+  if (use_cov_chol_)
+  {
+    sq_dists = cov_chol_.matrixL().solve(diffs).colwise().squaredNorm().array();
+  }
+  else
+  {
+    sq_dists = (diffs.array() * (cov_inv_ * diffs).array()).colwise().sum();
+  }
+
+  return ((static_cast<Scalar>(-0.5) * sq_dists) - log_norm_const_).matrix().transpose();
+}
+
 xreg::MultivarNormalDist::Scalar xreg::MultivarNormalDist::norm_const() const
 {
   return std::exp(log_norm_const_);
@@ -178,6 +204,15 @@ xreg::MultivarNormalDistZeroCov::Scalar xreg::MultivarNormalDistZeroCov::log_den
   return (static_cast<Scalar>(-0.5) * ((x - mean_).array().square() * vars_inv_).sum()) - log_norm_const_;
 }
 
+xreg::PtN xreg::MultivarNormalDistZeroCov::log_densities(const MatMxN& pts) const
+{
+  xregASSERT(pts.rows() == mean_.size());
+
+  return ((static_cast<Scalar>(-0.5) *
+            ((pts.colwise() - mean_).array().square().colwise() * vars_inv_).colwise().sum()) -
+                                                   log_norm_const_).matrix().transpose();
+}
+
 xreg::MultivarNormalDistZeroCov::Scalar xreg::MultivarNormalDistZeroCov::norm_const() const
 {
   return std::exp(log_norm_const_);
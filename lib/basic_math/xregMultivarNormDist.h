@@ -25,6 +25,8 @@
 #ifndef XREGMULTIVARNORMDIST_H_
 #define XREGMULTIVARNORMDIST_H_
 
+#include <Eigen/Cholesky>
+
 #include "xregDistInterface.h"
 
 namespace xreg
@@ -41,6 +43,14 @@ public:
 
   Scalar log_density(const PtN& x) const override;
 
+  using Dist::log_densities;
+
+  /// \brief Vectorized log densities of each column
+  ///
+  /// The squared Mahalanobis distances are computed using one triangular
+  /// solve with the Cholesky factor of the covariance for all columns.
+  PtN log_densities(const MatMxN& pts) const override;
+
   Scalar norm_const() const override;
 
   Scalar log_norm_const() const override;
@@ -60,6 +70,13 @@ private:
   
   MatMxN cov_inv_;
 
+  // Cholesky factor of the covariance, Mahalanobis distances of a batch of
+  // samples are computed with a single triangular solve; cov_inv_ is used
+  // when the factorization fails (e.g. a numerically indefinite covariance)
+  Eigen::LLT<MatMxN> cov_chol_;
+
+  bool use_cov_chol_ = false;
+
   Scalar log_norm_const_;
 
   // used for drawing samples
@@ -78,6 +95,11 @@ public:
 
   Scalar log_density(const PtN& x) const override;
 
+  using Dist::log_densities;
+
+  /// \brief Vectorized log densities of each column
+  PtN log_densities(const MatMxN& pts) const override;
+
   Scalar norm_const() const override;
 
   Scalar log_norm_const() const override;
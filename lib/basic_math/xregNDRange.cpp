@@ -24,6 +24,8 @@
 
 #include "xregNDRange.h"
 
+#include <algorithm>
+
 #include "xregAssert.h"
 
 xreg::size_type xreg::ConstSpacedRange::size() const
@@ -89,6 +91,16 @@ xreg::ConstSpacedMeshGrid::ConstSpacedMeshGrid(const Range1DList& ranges, const
   {
     dims_.push_back(r.size());
   }
+
+  strides_.assign(num_dims_, 1);
+
+  for (size_type d = 1; d < num_dims_; ++d)
+  {
+    const size_type cur_dim  = row_major_ ? (num_dims_ - 1 - d) : d;
+    const size_type prev_dim = row_major_ ? (cur_dim + 1) : (cur_dim - 1);
+
+    strides_[cur_dim] = strides_[prev_dim] * dims_[prev_dim];
+  }
 }
 
 xreg::size_type xreg::ConstSpacedMeshGrid::num_dims() const
@@ -123,32 +135,131 @@ xreg::ConstSpacedMeshGrid::range(const size_type dim) const
 xreg::ConstSpacedMeshGrid::Index
 xreg::ConstSpacedMeshGrid::basic_strides() const
 {
-  Index s(num_dims_, 1);
+  return strides_;
+}
 
-  for (size_type d = 1; d < num_dims_; ++d)
+xreg::ConstSpacedMeshGrid::PtND
+xreg::ConstSpacedMeshGrid::operator()(const Index& ind) const
+{
+  xregASSERT(ind.size() == num_dims_);
+
+  PtND p(num_dims_);
+
+  for (size_type i = 0; i < num_dims_; ++i)
   {
-    const size_type cur_dim  = row_major_ ? (num_dims_ - 1 - d) : d;
-    const size_type prev_dim = row_major_ ? (cur_dim + 1) : (cur_dim - 1);
+    p[i] = ranges_[i][ind[i]];
+  }
+
+  return p;
+}
+
+xreg::ConstSpacedMeshGrid::Index
+xreg::ConstSpacedMeshGrid::flat_index_to_index(const size_type flat_idx) const
+{
+  Index ind(num_dims_);
+
+  size_type rem_idx = flat_idx;
+
+  // visit the dimensions in order of decreasing significance, the most
+  // significant index is left out of bounds when flat_idx == size()
+  for (size_type i = 0; i < num_dims_; ++i)
+  {
+    const size_type d = row_major_ ? i : (num_dims_ - 1 - i);
 
-    s[cur_dim] = s[prev_dim] * range(prev_dim).size();
+    ind[d]   = rem_idx / strides_[d];
+    rem_idx %= strides_[d];
   }
 
-  return s;
+  return ind;
 }
 
-xreg::ConstSpacedMeshGrid::PtND
-xreg::ConstSpacedMeshGrid::operator()(const Index& ind) const
+xreg::size_type
+xreg::ConstSpacedMeshGrid::index_to_flat_index(const Index& ind) const
 {
   xregASSERT(ind.size() == num_dims_);
 
+  size_type flat_idx = 0;
+
+  for (size_type d = 0; d < num_dims_; ++d)
+  {
+    flat_idx += ind[d] * strides_[d];
+  }
+
+  return flat_idx;
+}
+
+xreg::ConstSpacedMeshGrid::PtND
+xreg::ConstSpacedMeshGrid::operator[](const size_type flat_idx) const
+{
   PtND p(num_dims_);
 
+  flat_index_to_pt(flat_idx, &p[0]);
+
+  return p;
+}
+
+void xreg::ConstSpacedMeshGrid::flat_index_to_pt(const size_type flat_idx, Scalar* pt) const
+{
+  xregASSERT(flat_idx < size());
+
+  size_type rem_idx = flat_idx;
+
   for (size_type i = 0; i < num_dims_; ++i)
   {
-    p[i] = ranges_[i][ind[i]];
+    const size_type d = row_major_ ? i : (num_dims_ - 1 - i);
+
+    pt[d]    = ranges_[d][rem_idx / strides_[d]];
+    rem_idx %= strides_[d];
   }
+}
 
-  return p;
+xreg::ConstSpacedMeshGrid::const_iterator
+xreg::ConstSpacedMeshGrid::iterator_at(const size_type flat_idx) const
+{
+  Iterator it = { this };
+
+  if (num_dims_)
+  {
+    const size_type num_pts = size();
+
+    xregASSERT(flat_idx <= num_pts);
+
+    it.cur_ind = flat_index_to_index(flat_idx);
+
+    // the point is not set for the end iterator, consistent with cend()
+    if (flat_idx < num_pts)
+    {
+      it.cur_pt = operator()(it.cur_ind);
+    }
+  }
+
+  return it;
+}
+
+std::pair<xreg::size_type,xreg::size_type>
+xreg::ConstSpacedMeshGrid::part_flat_range(const size_type part_idx,
+                                           const size_type num_parts) const
+{
+  xregASSERT(part_idx < num_parts);
+
+  const size_type num_pts = size();
+
+  // the first (tot % num_parts) parts get one extra point
+  const size_type num_per_part = num_pts / num_parts;
+  const size_type num_extra    = num_pts % num_parts;
+
+  const size_type part_begin = (part_idx * num_per_part) + std::min(part_idx, num_extra);
+
+  return std::make_pair(part_begin,
+                        part_begin + num_per_part + ((part_idx < num_extra) ? 1 : 0));
+}
+
+std::pair<xreg::ConstSpacedMeshGrid::const_iterator,xreg::ConstSpacedMeshGrid::const_iterator>
+xreg::ConstSpacedMeshGrid::part(const size_type part_idx, const size_type num_parts) const
+{
+  const auto r = part_flat_range(part_idx, num_parts);
+
+  return std::make_pair(iterator_at(r.first), iterator_at(r.second));
 }
   
 xreg::ConstSpacedMeshGrid::const_iterator
@@ -338,6 +449,62 @@ xreg::ConstSpacedMeshGrid::Iterator::operator--(int)
   return it;
 }
 
+xreg::ConstSpacedMeshGrid::Iterator&
+xreg::ConstSpacedMeshGrid::Iterator::operator+=(const difference_type n)
+{
+  *this = mesh_grid->iterator_at(static_cast<size_type>(
+                                    static_cast<difference_type>(flat_index()) + n));
+
+  return *this;
+}
+
+xreg::ConstSpacedMeshGrid::Iterator&
+xreg::ConstSpacedMeshGrid::Iterator::operator-=(const difference_type n)
+{
+  return operator+=(-n);
+}
+
+xreg::ConstSpacedMeshGrid::Iterator
+xreg::ConstSpacedMeshGrid::Iterator::operator+(const difference_type n) const
+{
+  Iterator it(*this);
+
+  it += n;
+
+  return it;
+}
+
+xreg::ConstSpacedMeshGrid::Iterator
+xreg::ConstSpacedMeshGrid::Iterator::operator-(const difference_type n) const
+{
+  Iterator it(*this);
+
+  it -= n;
+
+  return it;
+}
+
+xreg::ConstSpacedMeshGrid::Iterator::difference_type
+xreg::ConstSpacedMeshGrid::Iterator::operator-(const Iterator& it) const
+{
+  xregASSERT(mesh_grid == it.mesh_grid);
+
+  return static_cast<difference_type>(flat_index()) -
+         static_cast<difference_type>(it.flat_index());
+}
+
+xreg::ConstSpacedMeshGrid::PtND
+xreg::ConstSpacedMeshGrid::Iterator::operator[](const difference_type n) const
+{
+  return mesh_grid->operator[](static_cast<size_type>(
+                                  static_cast<difference_type>(flat_index()) + n));
+}
+
+xreg::size_type xreg::ConstSpacedMeshGrid::Iterator::flat_index() const
+{
+  return mesh_grid->num_dims_ ? mesh_grid->index_to_flat_index(cur_ind) : 0;
+}
+
 bool xreg::ConstSpacedMeshGrid::Iterator::operator==(const Iterator& it) const
 {
   bool eq = mesh_grid == it.mesh_grid;
@@ -359,3 +526,23 @@ bool xreg::ConstSpacedMeshGrid::Iterator::operator!=(const Iterator& it) const
 {
   return !(*this == it);
 }
+
+bool xreg::ConstSpacedMeshGrid::Iterator::operator<(const Iterator& it) const
+{
+  return (*this - it) < 0;
+}
+
+bool xreg::ConstSpacedMeshGrid::Iterator::operator>(const Iterator& it) const
+{
+  return it < *this;
+}
+
+bool xreg::ConstSpacedMeshGrid::Iterator::operator<=(const Iterator& it) const
+{
+  return !(it < *this);
+}
+
+bool xreg::ConstSpacedMeshGrid::Iterator::operator>=(const Iterator& it) const
+{
+  return !(*this < it);
+}
@@ -25,6 +25,10 @@
 #ifndef XREGNDRANGE_H_
 #define XREGNDRANGE_H_
 
+#include <cstddef>
+#include <iterator>
+#include <utility>
+
 #include "xregCommon.h"
 
 namespace xreg
@@ -55,8 +59,20 @@ public:
   using Index       = std::vector<size_type>;
   using PtND        = Eigen::Matrix<Scalar,Eigen::Dynamic,1>;
 
+  /// \brief Iterator over the points of the grid.
+  ///
+  /// Points are computed lazily from the current index, so the memory used is
+  /// proportional to the number of dimensions and not the number of points.
+  /// Random access is supported by converting to and from flat indices, which
+  /// requires O(num_dims) operations and is independent of the grid size.
   struct Iterator
   {
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type        = PtND;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = const PtND*;
+    using reference         = const PtND&;
+
     const ConstSpacedMeshGrid* mesh_grid;
     Index cur_ind;
 
@@ -78,9 +94,32 @@ public:
     // postfix
     Iterator operator--(int);
 
+    Iterator& operator+=(const difference_type n);
+
+    Iterator& operator-=(const difference_type n);
+
+    Iterator operator+(const difference_type n) const;
+
+    Iterator operator-(const difference_type n) const;
+
+    difference_type operator-(const Iterator& it) const;
+
+    PtND operator[](const difference_type n) const;
+
+    /// \brief The flat index of the current point; size() for the end iterator.
+    size_type flat_index() const;
+
     bool operator==(const Iterator& it) const;
     
     bool operator!=(const Iterator& it) const;
+
+    bool operator<(const Iterator& it) const;
+
+    bool operator>(const Iterator& it) const;
+
+    bool operator<=(const Iterator& it) const;
+
+    bool operator>=(const Iterator& it) const;
   };
   
   using iterator       = Iterator;
@@ -101,6 +140,42 @@ public:
 
   PtND operator()(const Index& ind) const;
 
+  /// \brief Convert a flat index, in [0,size()), into a multi-dimensional index.
+  ///
+  /// The ordering of the flat indices matches the ordering of iteration, e.g.
+  /// the last dimension varies fastest when row-major.
+  Index flat_index_to_index(const size_type flat_idx) const;
+
+  /// \brief Convert a multi-dimensional index into a flat index.
+  size_type index_to_flat_index(const Index& ind) const;
+
+  /// \brief The point at a flat index - equivalent to *(begin() + flat_idx),
+  ///        without the construction of an iterator.
+  PtND operator[](const size_type flat_idx) const;
+
+  /// \brief Write the point at a flat index into a buffer of num_dims() values.
+  ///
+  /// No memory is allocated, so this is suitable for filling the columns of a
+  /// pre-allocated matrix concurrently.
+  void flat_index_to_pt(const size_type flat_idx, Scalar* pt) const;
+
+  /// \brief An iterator pointing at a flat index; flat_idx == size() yields end().
+  const_iterator iterator_at(const size_type flat_idx) const;
+
+  /// \brief The flat indices [begin,end) of one part of the grid, when the
+  ///        grid is split into a number of balanced parts.
+  ///
+  /// The part sizes differ by at most one point, the first (size() % num_parts)
+  /// parts will contain the extra points. This is appropriate for distributing
+  /// the evaluation of a large grid across threads or processes.
+  std::pair<size_type,size_type> part_flat_range(const size_type part_idx,
+                                                 const size_type num_parts) const;
+
+  /// \brief Iterators [begin,end) of one part of the grid, when the grid is
+  ///        split into a number of balanced parts.
+  std::pair<const_iterator,const_iterator> part(const size_type part_idx,
+                                                const size_type num_parts) const;
+
   const_iterator cbegin() const;
 
   const_iterator cend() const;
@@ -119,6 +194,8 @@ private:
   
   Index dims_;
 
+  Index strides_;
+
   size_type num_dims_ = 0;
 
   bool row_major_ = true;
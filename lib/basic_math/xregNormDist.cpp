@@ -24,6 +24,8 @@
 
 #include "xregNormDist.h"
 
+#include "xregAssert.h"
+
 xreg::NormalDist1D::NormalDist1D()
   : mu_(0), sigma_(1), sigma_sq_(1), minus_one_over_two_sigma_sq_(-0.5),
     norm_const_(std::sqrt(Scalar(6.283185307179586))),
@@ -63,6 +65,14 @@ xreg::NormalDist1D::log_density(const Scalar x) const
   return (minus_one_over_two_sigma_sq_ * x_minus_mu * x_minus_mu) - log_norm_const_;
 }
   
+xreg::PtN xreg::NormalDist1D::log_densities(const MatMxN& pts) const
+{
+  xregASSERT(pts.rows() == 1);
+
+  return ((minus_one_over_two_sigma_sq_ * (pts.row(0).array() - mu_).square()) -
+                                                   log_norm_const_).matrix().transpose();
+}
+
 xreg::NormalDist1D::Scalar xreg::NormalDist1D::norm_const() const
 {
   return norm_const_;
@@ -143,6 +153,15 @@ xreg::NormalDist2DIndep::log_density(const PtN& x) const
   return log_density(x[0], x[1]);
 }
 
+xreg::PtN xreg::NormalDist2DIndep::log_densities(const MatMxN& pts) const
+{
+  xregASSERT(pts.rows() == 2);
+
+  return ((Scalar(-0.5) * (((pts.row(0).array() - mu_x_).square() * one_over_sigma_x_sq_) +
+                           ((pts.row(1).array() - mu_y_).square() * one_over_sigma_y_sq_))) -
+                                                   log_norm_const_).matrix().transpose();
+}
+
 xreg::NormalDist2DIndep::Scalar
 xreg::NormalDist2DIndep::norm_const() const
 {
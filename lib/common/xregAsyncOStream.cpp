@@ -0,0 +1,222 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregAsyncOStream.h"
+
+#include <atomic>
+#include <chrono>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "xregAssert.h"
+
+namespace xreg
+{
+namespace detail
+{
+
+class AsyncOStreamBuf : public std::streambuf
+{
+public:
+  using size_type = std::size_t;
+
+  AsyncOStreamBuf(std::ostream& dst, const size_type num_blocks, const size_type block_size)
+    : dst_(dst),
+      // one slot is always left empty to distinguish between full and empty
+      blocks_(num_blocks + 1),
+      cur_block_(block_size)
+  {
+    xregASSERT(num_blocks > 0);
+    xregASSERT(block_size > 0);
+
+    for (auto& b : blocks_)
+    {
+      b.reserve(block_size);
+    }
+
+    reset_put_area();
+
+    writer_thread_ = std::thread([this] () { this->write_loop(); });
+  }
+
+  ~AsyncOStreamBuf() override
+  {
+    sync();
+
+    stop_.store(true, std::memory_order_release);
+
+    writer_thread_.join();
+  }
+
+  void wait_until_written()
+  {
+    sync();
+
+    while (tail_.load(std::memory_order_acquire) != head_.load(std::memory_order_relaxed))
+    {
+      std::this_thread::yield();
+    }
+  }
+
+protected:
+  int_type overflow(int_type ch) override
+  {
+    push_pending();
+
+    if (!traits_type::eq_int_type(ch, traits_type::eof()))
+    {
+      *pptr() = traits_type::to_char_type(ch);
+      pbump(1);
+    }
+
+    return traits_type::not_eof(ch);
+  }
+
+  int sync() override
+  {
+    push_pending();
+    return 0;
+  }
+
+private:
+  void reset_put_area()
+  {
+    setp(&cur_block_[0], &cur_block_[0] + cur_block_.size());
+  }
+
+  /// \brief Pushes the characters written since the last push onto the ring
+  ///        (producer side).
+  void push_pending()
+  {
+    const size_type len = static_cast<size_type>(pptr() - pbase());
+
+    if (len)
+    {
+      const size_type num_slots = blocks_.size();
+
+      const size_type h = head_.load(std::memory_order_relaxed);
+
+      const size_type next_h = (h + 1) % num_slots;
+
+      while (next_h == tail_.load(std::memory_order_acquire))
+      {
+        // the ring is full, wait for the writer thread
+        std::this_thread::yield();
+      }
+
+      // the slot keeps its capacity, so this does not allocate
+      blocks_[h].assign(pbase(), len);
+
+      head_.store(next_h, std::memory_order_release);
+
+      reset_put_area();
+    }
+  }
+
+  /// \brief Writes blocks to the destination stream (consumer side).
+  void write_loop()
+  {
+    const size_type num_slots = blocks_.size();
+
+    while (true)
+    {
+      const size_type t = tail_.load(std::memory_order_relaxed);
+
+      if (t != head_.load(std::memory_order_acquire))
+      {
+        std::string& b = blocks_[t];
+
+        dst_.write(b.data(), b.size());
+        b.clear();
+
+        const size_type next_t = (t + 1) % num_slots;
+
+        if (next_t == head_.load(std::memory_order_acquire))
+        {
+          // caught up with the producer, flush before publishing the empty
+          // ring so that wait_until_written() also implies a flush
+          dst_.flush();
+        }
+
+        tail_.store(next_t, std::memory_order_release);
+      }
+      else if (stop_.load(std::memory_order_acquire))
+      {
+        // every block was pushed before the stop flag was set, so check once
+        // more before finishing
+        if (t == head_.load(std::memory_order_acquire))
+        {
+          break;
+        }
+      }
+      else
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+  }
+
+  std::ostream& dst_;
+
+  std::vector<std::string> blocks_;
+
+  std::vector<char> cur_block_;
+
+  // next slot to be written by the producer
+  std::atomic<size_type> head_ = { 0 };
+
+  // next slot to be read by the consumer
+  std::atomic<size_type> tail_ = { 0 };
+
+  std::atomic<bool> stop_ = { false };
+
+  std::thread writer_thread_;
+};
+
+}  // detail
+}  // xreg
+
+xreg::AsyncOStream::AsyncOStream(std::ostream& dst,
+                                 const size_type num_blocks,
+                                 const size_type block_size)
+  : std::ostream(nullptr),
+    buf_(new detail::AsyncOStreamBuf(dst, num_blocks, block_size))
+{
+  rdbuf(buf_.get());
+}
+
+xreg::AsyncOStream::~AsyncOStream()
+{
+  // writes any pending output and joins the writer thread
+  rdbuf(nullptr);
+  buf_.reset();
+}
+
+void xreg::AsyncOStream::wait_until_written()
+{
+  buf_->wait_until_written();
+}
+
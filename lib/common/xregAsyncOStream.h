@@ -0,0 +1,94 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGASYNCOSTREAM_H_
+#define XREGASYNCOSTREAM_H_
+
+#include <cstddef>
+#include <memory>
+#include <ostream>
+
+namespace xreg
+{
+
+namespace detail
+{
+
+class AsyncOStreamBuf;
+
+}  // detail
+
+/// \brief Output stream which writes to another stream from a background thread.
+///
+/// Characters are buffered into fixed size blocks. A full block, or a partial
+/// block on a flush, is handed off to a writer thread through a lock-free
+/// single producer/single consumer ring of blocks, so writing to
+/// this stream does not wait on the destination stream's I/O. This is meant
+/// for verbose/debug output in hot loops, e.g. an optimizer writing its
+/// objective function values and parameters every iteration. When the ring is
+/// full the writing thread waits for a block to become available; no output is
+/// dropped.
+///
+/// This stream may be written to by only one thread at a time. The destination
+/// stream is written to by the background thread until this object is
+/// destroyed or wait_until_written() returns, so it should not be written to
+/// by other code in the meantime.
+///
+/// Example usage:
+/// <code>
+///   AsyncOStream async_out(std::cout);
+///   regi.set_debug_output_stream(async_out, true);
+///   regi.set_debug_write_opt_vars_to_stream(true);
+/// </code>
+class AsyncOStream : public std::ostream
+{
+public:
+  using size_type = std::size_t;
+
+  /// \brief Constructor - starts the writer thread.
+  ///
+  /// At most num_blocks blocks of block_size characters are pending at any time.
+  explicit AsyncOStream(std::ostream& dst,
+                        const size_type num_blocks = 256,
+                        const size_type block_size = 4096);
+
+  /// \brief Destructor - writes all pending output and stops the writer thread.
+  ~AsyncOStream() override;
+
+  // no copying
+  AsyncOStream(const AsyncOStream&) = delete;
+  AsyncOStream& operator=(const AsyncOStream&) = delete;
+
+  /// \brief Flushes this stream and blocks until all output has been written
+  ///        to the destination stream.
+  void wait_until_written();
+
+private:
+  std::unique_ptr<detail::AsyncOStreamBuf> buf_;
+};
+
+}  // xreg
+
+#endif
+
@@ -0,0 +1,263 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGBACKGROUNDTASKQUEUE_H_
+#define XREGBACKGROUNDTASKQUEUE_H_
+
+#include <cstddef>
+#include <vector>
+#include <queue>
+#include <functional>
+#include <exception>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace xreg
+{
+
+/// \brief Bounded queue of tasks that are executed by background threads.
+///
+/// Tasks are run in the order they were added. When a single worker thread is
+/// used, each task runs with exclusive ownership of whatever resource it writes
+/// to (e.g. an HDF5 file, which is not safe to access from multiple threads).
+///
+/// Each task may be assigned a cost (e.g. a number of bytes held in memory until
+/// the task completes). Calls to add() block when adding a task would exceed
+/// the maximum number of queued tasks or the maximum total cost. A single task
+/// may always be added when no other tasks are queued or running, otherwise no
+/// work could be done.
+///
+/// The first exception thrown by a task is stored and re-thrown from the next
+/// call to add() or wait(); subsequent tasks continue to be run.
+class BackgroundTaskQueue
+{
+public:
+  using size_type = std::size_t;
+
+  using TaskFn = std::function<void()>;
+
+  /// \brief Constructor - starts up the worker threads
+  ///
+  /// If the number of worker threads passed is 0, then the number of threads
+  /// is determined by the number of virtual cores.
+  explicit BackgroundTaskQueue(const size_type num_worker_threads = 1)
+  {
+    size_type num_threads_to_use = num_worker_threads;
+
+    if (!num_threads_to_use)
+    {
+      num_threads_to_use = std::thread::hardware_concurrency();
+      
+      if (!num_threads_to_use)
+      {
+        num_threads_to_use = 1;
+      }
+    }
+
+    running_ = true;
+
+    worker_threads_.reserve(num_threads_to_use);
+    for (size_type thread_idx = 0; thread_idx < num_threads_to_use; ++thread_idx)
+    {
+      worker_threads_.emplace_back([this] () { this->worker_loop(); });
+    }
+  }
+
+  /// \brief Destructor - waits for all tasks to be run and stops threads
+  ///
+  /// Any exception stored from a task is discarded.
+  ~BackgroundTaskQueue()
+  {
+    {
+      std::unique_lock<std::mutex> lock(queue_mutex_);
+      state_changed_cv_.wait(lock, [this] () { return tasks_.empty() && !num_tasks_running_; });
+      
+      running_ = false;
+    }
+
+    state_changed_cv_.notify_all();
+
+    for (auto& t : worker_threads_)
+    {
+      t.join();
+    }
+  }
+  
+  // no copying
+  BackgroundTaskQueue(const BackgroundTaskQueue&) = delete;
+  BackgroundTaskQueue& operator=(const BackgroundTaskQueue&) = delete;
+
+  /// \brief Adds a task to the queue, blocking when the queue is full.
+  void add(TaskFn task, const size_type cost = 0)
+  {
+    {
+      std::unique_lock<std::mutex> lock(queue_mutex_);
+
+      state_changed_cv_.wait(lock, [this,cost] () { return this->can_add(cost); });
+
+      rethrow_task_exception();
+
+      tasks_.push(TaskCostPair{ std::move(task), cost });
+      cur_cost_ += cost;
+    }
+
+    state_changed_cv_.notify_all();
+  }
+
+  /// \brief Blocks until the queue is empty and all tasks have finished running.
+  void wait()
+  {
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+
+    state_changed_cv_.wait(lock, [this] () { return tasks_.empty() && !num_tasks_running_; });
+
+    rethrow_task_exception();
+  }
+
+  /// \brief The maximum number of tasks which may be waiting to run, 0 -> no limit.
+  void set_max_num_queued_tasks(const size_type max_num_tasks)
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    max_num_tasks_ = max_num_tasks;
+  }
+
+  /// \brief The maximum total cost of tasks queued or running, 0 -> no limit.
+  ///
+  /// For example, this may be used to ensure that system memory is not exhausted
+  /// by data waiting to be written to disk.
+  void set_max_queued_cost(const size_type max_cost)
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    max_cost_ = max_cost;
+  }
+
+  size_type num_worker_threads() const
+  {
+    return worker_threads_.size();
+  }
+
+private:
+
+  struct TaskCostPair
+  {
+    TaskFn task;
+    size_type cost;
+  };
+
+  // queue_mutex_ must be held
+  bool can_add(const size_type cost) const
+  {
+    return task_exception_ ||
+           (tasks_.empty() && !num_tasks_running_) ||
+           ((!max_num_tasks_ || (tasks_.size() < max_num_tasks_)) &&
+            (!max_cost_ || ((cur_cost_ + cost) <= max_cost_)));
+  }
+
+  // queue_mutex_ must be held
+  void rethrow_task_exception()
+  {
+    if (task_exception_)
+    {
+      std::exception_ptr e = task_exception_;
+      task_exception_ = nullptr;
+      std::rethrow_exception(e);
+    }
+  }
+
+  void worker_loop()
+  {
+    while (true)
+    {
+      TaskCostPair cur_task;
+
+      {
+        std::unique_lock<std::mutex> lock(queue_mutex_);
+
+        state_changed_cv_.wait(lock, [this] () { return !running_ || !tasks_.empty(); });
+
+        if (tasks_.empty())
+        {
+          // not running and no work left
+          break;
+        }
+
+        cur_task = std::move(tasks_.front());
+        tasks_.pop();
+        ++num_tasks_running_;
+      }
+      
+      std::exception_ptr cur_exception;
+
+      try
+      {
+        cur_task.task();
+      }
+      catch (...)
+      {
+        cur_exception = std::current_exception();
+      }
+
+      // release any resources held by the task before reporting completion
+      cur_task.task = nullptr;
+
+      {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        
+        cur_cost_ -= cur_task.cost;
+        --num_tasks_running_;
+
+        if (cur_exception && !task_exception_)
+        {
+          task_exception_ = cur_exception;
+        }
+      }
+
+      state_changed_cv_.notify_all();
+    }
+  }
+
+  std::mutex queue_mutex_;
+  std::condition_variable state_changed_cv_;
+
+  std::queue<TaskCostPair> tasks_;
+
+  std::vector<std::thread> worker_threads_;
+
+  bool running_ = false;
+
+  size_type cur_cost_ = 0;
+  size_type max_cost_ = 0;
+  
+  size_type max_num_tasks_ = 0;
+
+  size_type num_tasks_running_ = 0;
+
+  std::exception_ptr task_exception_;
+};
+
+}  // xreg
+
+#endif
+
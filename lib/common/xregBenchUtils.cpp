@@ -0,0 +1,122 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregBenchUtils.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+#include <boost/property_tree/json_parser.hpp>
+
+#include "xregTimer.h"
+
+xreg::BenchTiming xreg::TimeBenchIters(const std::function<void()>& fn,
+                                       const size_type num_warmup, const size_type num_iters)
+{
+  for (size_type i = 0; i < num_warmup; ++i)
+  {
+    fn();
+  }
+
+  BenchTiming timing;
+
+  timing.num_iters = num_iters;
+  timing.min_secs  = num_iters ? std::numeric_limits<double>::max() : 0.0;
+
+  Timer tmr;
+
+  double total_secs = 0;
+
+  for (size_type i = 0; i < num_iters; ++i)
+  {
+    tmr.reset();
+    tmr.start();
+
+    fn();
+
+    tmr.stop();
+
+    const double cur_secs = tmr.elapsed_seconds();
+
+    total_secs      += cur_secs;
+    timing.min_secs  = std::min(timing.min_secs, cur_secs);
+  }
+
+  timing.mean_secs = total_secs / std::max(num_iters, size_type(1));
+
+  return timing;
+}
+
+void xreg::PutBenchStatus(const bool ok, const BenchTiming& timing, const std::string& err_msg,
+                          boost::property_tree::ptree* bench)
+{
+  bench->put("ok", ok);
+
+  if (ok)
+  {
+    bench->put("num-iters", timing.num_iters);
+    bench->put("mean-secs", timing.mean_secs);
+    bench->put("min-secs",  timing.min_secs);
+  }
+  else
+  {
+    bench->put("error", err_msg);
+  }
+}
+
+xreg::BenchResultsJSON::ptree& xreg::BenchResultsJSON::info()
+{
+  return info_;
+}
+
+xreg::BenchResultsJSON::ptree& xreg::BenchResultsJSON::add_bench()
+{
+  // children with empty keys are written as the elements of a JSON array
+  return benches_.push_back(std::make_pair(std::string(), ptree()))->second;
+}
+
+void xreg::BenchResultsJSON::write(std::ostream& out) const
+{
+  ptree doc = info_;
+
+  doc.add_child("benchmarks", benches_);
+
+  boost::property_tree::write_json(out, doc);
+}
+
+void xreg::BenchResultsJSON::write(const std::string& path) const
+{
+  if (path.empty())
+  {
+    write(std::cout);
+  }
+  else
+  {
+    std::ofstream out(path);
+
+    write(out);
+  }
+}
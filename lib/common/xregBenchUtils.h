@@ -0,0 +1,106 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file
+ * @brief Utilities shared by the benchmark programs: parsing of parameter
+ *        sweeps, timing of repeated calls and writing of results as JSON.
+ **/
+
+#ifndef XREGBENCHUTILS_H_
+#define XREGBENCHUTILS_H_
+
+#include <functional>
+#include <iosfwd>
+
+#include <boost/property_tree/ptree.hpp>
+
+#include "xregCommon.h"
+#include "xregStringUtils.h"
+
+namespace xreg
+{
+
+/// \brief Parses a comma separated list of values, e.g. the sizes of a
+///        benchmark sweep provided on the command line.
+template <class T>
+std::vector<T> ParseBenchList(const std::string& s)
+{
+  return StringCast<T>(StringSplit(s, ","));
+}
+
+/// \brief Timing statistics of the repeated calls of a benchmark.
+struct BenchTiming
+{
+  size_type num_iters = 0;
+
+  double mean_secs = 0;
+  double min_secs  = 0;
+};
+
+/// \brief Calls a function num_warmup times without timing and then times
+///        each of num_iters calls.
+BenchTiming TimeBenchIters(const std::function<void()>& fn,
+                           const size_type num_warmup, const size_type num_iters);
+
+/// \brief Adds the status, and the timing or error message, of a benchmark
+///        configuration to its JSON entry.
+///
+/// The timing is only added when ok is true and the error message only when
+/// ok is false.
+void PutBenchStatus(const bool ok, const BenchTiming& timing, const std::string& err_msg,
+                    boost::property_tree::ptree* bench);
+
+/// \brief The results of a benchmark program, written as a JSON object.
+///
+/// The object contains the fields of info() (e.g. the backend used) and a
+/// "benchmarks" array with an entry for each configuration run. The entries
+/// are written by boost::property_tree, so every value is a JSON string.
+class BenchResultsJSON
+{
+public:
+  using ptree = boost::property_tree::ptree;
+
+  /// \brief The top-level fields describing every configuration.
+  ptree& info();
+
+  /// \brief Appends an empty entry for a configuration.
+  ///
+  /// The returned reference remains valid when other entries are added.
+  ptree& add_bench();
+
+  void write(std::ostream& out) const;
+
+  /// \brief Writes to a file, or to the standard output when path is empty.
+  void write(const std::string& path) const;
+
+private:
+  ptree info_;
+
+  ptree benches_;
+};
+
+}  // xreg
+
+#endif
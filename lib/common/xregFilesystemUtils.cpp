@@ -285,6 +285,28 @@ bool xreg::Path::is_exec() const
   return b;
 }
 
+unsigned long long xreg::Path::file_size() const
+{
+  stat_type s;
+  if (STAT_FN(path_str_.c_str(), &s) != 0)
+  {
+    throw FileSystemException(path_str_.c_str(), "xreg::Path::file_size: Failed to stat file path!");
+  }
+
+  return static_cast<unsigned long long>(s.st_size);
+}
+
+long long xreg::Path::mod_time() const
+{
+  stat_type s;
+  if (STAT_FN(path_str_.c_str(), &s) != 0)
+  {
+    throw FileSystemException(path_str_.c_str(), "xreg::Path::mod_time: Failed to stat file path!");
+  }
+
+  return static_cast<long long>(s.st_mtime);
+}
+
 bool xreg::Path::has_trailing_sep() const
 {
   bool found_trailing_sep = false;
@@ -1025,6 +1047,22 @@ xreg::Path xreg::operator+(const Path& p1, const Path& p2)
   return p;
 }
 
+std::string xreg::MakeUniqueTmpPath(const std::string& path)
+{
+  // one engine per thread, so that concurrent callers do not need to lock
+  thread_local std::mt19937 rng_eng;
+  thread_local bool rng_eng_seeded = false;
+
+  if (!rng_eng_seeded)
+  {
+    SeedRNGEngWithRandDev(&rng_eng);
+    rng_eng_seeded = true;
+  }
+
+  return fmt::sprintf("%s.%08X%08X.tmp", path, static_cast<unsigned long>(rng_eng()),
+                      static_cast<unsigned long>(rng_eng()));
+}
+
 xreg::CreateTempDir::CreateTempDir(const std::string& prefix)
 {
   std::mt19937 rng_eng;
@@ -222,6 +222,18 @@ public:
    **/
   bool is_exec() const;
 
+  /**
+   * @brief Retrieves the size, in bytes, of the file at this path.
+   **/
+  unsigned long long file_size() const;
+
+  /**
+   * @brief Retrieves the last modification time of the file at this path.
+   *
+   * Given in seconds since the UNIX epoch.
+   **/
+  long long mod_time() const;
+
   /**
    * @brief Appends a filesystem path to the back of this path.
    *
@@ -578,6 +590,14 @@ void MakeDirRecursive(const std::string& path);
 /// into the destination directory.
 void MoveFileSystemItem(const std::string& src_path, const std::string& dst_path);
 
+/// \brief A path for a temporary file in the same directory as path, which
+///        is unique among threads and processes.
+///
+/// A file written to this path and then moved to path with MoveFileSystemItem()
+/// atomically replaces any existing file, so that readers of path never see a
+/// partially written file and concurrent writers do not truncate each other.
+std::string MakeUniqueTmpPath(const std::string& path);
+
 /// \brief Recursively removes a directory and all of its contents
 void RemoveDirRecursive(const std::string& path);
 
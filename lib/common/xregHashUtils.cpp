@@ -0,0 +1,282 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "xregHashUtils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "xregExceptionUtils.h"
+#include "xregTBBUtils.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+constexpr std::uint64_t kPRIME64_1 = 0x9E3779B185EBCA87ULL;
+constexpr std::uint64_t kPRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr std::uint64_t kPRIME64_3 = 0x165667B19E3779F9ULL;
+constexpr std::uint64_t kPRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+constexpr std::uint64_t kPRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+// blocks of HashBytes64Parallel() and ComputeFileContentHash(), the size is
+// fixed so that the hash does not depend on the number of threads
+constexpr size_type kPARALLEL_BLOCK_NUM_BYTES = 1024 * 1024;
+
+inline std::uint64_t RotL64(const std::uint64_t x, const int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+inline std::uint64_t Read64(const unsigned char* p)
+{
+  std::uint64_t x;
+  std::memcpy(&x, p, sizeof(x));
+  return x;
+}
+
+inline std::uint32_t Read32(const unsigned char* p)
+{
+  std::uint32_t x;
+  std::memcpy(&x, p, sizeof(x));
+  return x;
+}
+
+inline std::uint64_t XXH64Round(std::uint64_t acc, const std::uint64_t input)
+{
+  acc += input * kPRIME64_2;
+  acc  = RotL64(acc, 31);
+  acc *= kPRIME64_1;
+  return acc;
+}
+
+inline std::uint64_t XXH64MergeRound(std::uint64_t acc, const std::uint64_t val)
+{
+  acc ^= XXH64Round(0, val);
+  acc  = (acc * kPRIME64_1) + kPRIME64_4;
+  return acc;
+}
+
+// Combines the hashes of the blocks of a buffer, in order
+std::uint64_t CombineBlockHashes(const std::vector<std::uint64_t>& block_hashes, std::uint64_t h)
+{
+  for (const std::uint64_t block_h : block_hashes)
+  {
+    h = HashBytes64(&block_h, sizeof(block_h), h);
+  }
+
+  return h;
+}
+
+// Hashes each block of a buffer concurrently
+void HashBlocks(const unsigned char* buf, const size_type num_bytes,
+                std::vector<std::uint64_t>* block_hashes)
+{
+  const size_type num_blocks = (num_bytes + kPARALLEL_BLOCK_NUM_BYTES - 1) /
+                                  kPARALLEL_BLOCK_NUM_BYTES;
+
+  block_hashes->resize(num_blocks);
+
+  auto hash_fn = [&] (const RangeType& r)
+  {
+    for (size_type i = r.begin(); i < r.end(); ++i)
+    {
+      const size_type off = i * kPARALLEL_BLOCK_NUM_BYTES;
+
+      (*block_hashes)[i] = HashBytes64(buf + off,
+                                       std::min(kPARALLEL_BLOCK_NUM_BYTES, num_bytes - off));
+    }
+  };
+
+  ParallelFor(hash_fn, RangeType(0, num_blocks));
+}
+
+}  // un-named
+
+std::uint64_t xreg::HashBytes64(const void* buf, const size_type num_bytes, const std::uint64_t seed)
+{
+  const unsigned char* p = static_cast<const unsigned char*>(buf);
+
+  const unsigned char* const end = p + num_bytes;
+
+  std::uint64_t h = 0;
+
+  if (num_bytes >= 32)
+  {
+    const unsigned char* const stripes_end = end - 32;
+
+    std::uint64_t v1 = seed + kPRIME64_1 + kPRIME64_2;
+    std::uint64_t v2 = seed + kPRIME64_2;
+    std::uint64_t v3 = seed;
+    std::uint64_t v4 = seed - kPRIME64_1;
+
+    do
+    {
+      v1 = XXH64Round(v1, Read64(p));
+      v2 = XXH64Round(v2, Read64(p + 8));
+      v3 = XXH64Round(v3, Read64(p + 16));
+      v4 = XXH64Round(v4, Read64(p + 24));
+      p += 32;
+    }
+    while (p <= stripes_end);
+
+    h = RotL64(v1, 1) + RotL64(v2, 7) + RotL64(v3, 12) + RotL64(v4, 18);
+
+    h = XXH64MergeRound(h, v1);
+    h = XXH64MergeRound(h, v2);
+    h = XXH64MergeRound(h, v3);
+    h = XXH64MergeRound(h, v4);
+  }
+  else
+  {
+    h = seed + kPRIME64_5;
+  }
+
+  h += static_cast<std::uint64_t>(num_bytes);
+
+  for (; (p + 8) <= end; p += 8)
+  {
+    h ^= XXH64Round(0, Read64(p));
+    h  = (RotL64(h, 27) * kPRIME64_1) + kPRIME64_4;
+  }
+
+  if ((p + 4) <= end)
+  {
+    h ^= static_cast<std::uint64_t>(Read32(p)) * kPRIME64_1;
+    h  = (RotL64(h, 23) * kPRIME64_2) + kPRIME64_3;
+    p += 4;
+  }
+
+  for (; p < end; ++p)
+  {
+    h ^= (*p) * kPRIME64_5;
+    h  = RotL64(h, 11) * kPRIME64_1;
+  }
+
+  // final avalanche
+  h ^= h >> 33;
+  h *= kPRIME64_2;
+  h ^= h >> 29;
+  h *= kPRIME64_3;
+  h ^= h >> 32;
+
+  return h;
+}
+
+std::uint64_t xreg::HashBytes64Parallel(const void* buf, const size_type num_bytes,
+                                        const std::uint64_t seed)
+{
+  std::vector<std::uint64_t> block_hashes;
+
+  HashBlocks(static_cast<const unsigned char*>(buf), num_bytes, &block_hashes);
+
+  return CombineBlockHashes(block_hashes, seed);
+}
+
+std::string xreg::HashToStr(const std::uint64_t h)
+{
+  return fmt::format("{:016x}", h);
+}
+
+xreg::Hasher64::Hasher64(const std::uint64_t seed)
+  : h_(seed)
+{ }
+
+void xreg::Hasher64::add_bytes(const void* buf, const size_type num_bytes)
+{
+  h_ = HashBytes64(buf, num_bytes, h_);
+}
+
+void xreg::Hasher64::add_bytes_parallel(const void* buf, const size_type num_bytes)
+{
+  add(num_bytes);
+
+  h_ = HashBytes64Parallel(buf, num_bytes, h_);
+}
+
+void xreg::Hasher64::add_str(const std::string& s)
+{
+  add(s.size());
+  add_bytes(s.data(), s.size());
+}
+
+std::uint64_t xreg::Hasher64::value() const
+{
+  return h_;
+}
+
+std::string xreg::Hasher64::str() const
+{
+  return HashToStr(h_);
+}
+
+std::string xreg::ComputeFileContentHash(const std::string& path)
+{
+  std::ifstream in(path, std::ios::binary);
+  
+  if (!in)
+  {
+    xregThrow("failed to open file for hashing: %s", path.c_str());
+  }
+
+  // chunks are read sequentially, the blocks of each chunk are hashed
+  // concurrently; the chunk size is a multiple of the block size so that the
+  // hash equals HashBytes64Parallel() of the entire file
+  constexpr size_type kCHUNK_NUM_BYTES = 32 * kPARALLEL_BLOCK_NUM_BYTES;
+
+  std::vector<unsigned char> chunk_buf(kCHUNK_NUM_BYTES);
+
+  std::vector<std::uint64_t> block_hashes;
+
+  std::uint64_t h = 0;
+
+  while (in)
+  {
+    in.read(reinterpret_cast<char*>(&chunk_buf[0]), kCHUNK_NUM_BYTES);
+
+    const size_type num_bytes_read = static_cast<size_type>(in.gcount());
+
+    if (!num_bytes_read)
+    {
+      break;
+    }
+
+    HashBlocks(&chunk_buf[0], num_bytes_read, &block_hashes);
+
+    h = CombineBlockHashes(block_hashes, h);
+  }
+
+  return HashToStr(h);
+}
+
+std::string xreg::ComputeStringHash(const std::string& s)
+{
+  return HashToStr(HashBytes64(s.data(), s.size()));
+}
@@ -0,0 +1,130 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file
+ * @brief Hashing of arbitrary data for persistent cache keys and fingerprints.
+ **/
+
+#ifndef XREGHASHUTILS_H_
+#define XREGHASHUTILS_H_
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+#include "xregCommon.h"
+
+namespace xreg
+{
+
+/// \brief Computes a 64-bit hash (XXH64) of a buffer.
+///
+/// The value only depends on the bytes and the seed, so it is stable across
+/// runs, processes and builds (on hosts with the same byte order) and may be
+/// used in keys which are persisted to disk. Unlike FNV, every bit of the
+/// input affects every bit of the output.
+std::uint64_t HashBytes64(const void* buf, const size_type num_bytes, const std::uint64_t seed = 0);
+
+/// \brief Computes a 64-bit hash of a large buffer using several threads.
+///
+/// The buffer is split into fixed size blocks which are hashed concurrently
+/// and then combined in order, so the value does not depend on the number of
+/// threads. The value differs from HashBytes64() of the same buffer.
+std::uint64_t HashBytes64Parallel(const void* buf, const size_type num_bytes,
+                                  const std::uint64_t seed = 0);
+
+/// \brief A hash as 16 hexadecimal characters, suitable for file names.
+std::string HashToStr(const std::uint64_t h);
+
+/// \brief Incrementally computes a 64-bit hash of a sequence of values.
+///
+/// Each value is hashed with HashBytes64() seeded by the hash of the
+/// preceding values. Variable length values are prefixed with their lengths,
+/// so that different splits of the same bytes do not yield the same hash.
+class Hasher64
+{
+public:
+  explicit Hasher64(const std::uint64_t seed = 0);
+
+  void add_bytes(const void* buf, const size_type num_bytes);
+
+  /// \brief Adds a large buffer, which is hashed with HashBytes64Parallel().
+  void add_bytes_parallel(const void* buf, const size_type num_bytes);
+
+  void add_str(const std::string& s);
+
+  /// \brief Adds an arithmetic or enumeration value.
+  ///
+  /// Integers are widened to 64 bits, so that the hash does not depend on
+  /// the sizes of the types on a platform (e.g. long or size_t).
+  template <class T>
+  void add(const T& x)
+  {
+    static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value,
+                  "only arithmetic and enumeration values may be added directly");
+
+    add_helper(x, std::is_floating_point<T>());
+  }
+
+  std::uint64_t value() const;
+
+  /// \brief The hash as 16 hexadecimal characters.
+  std::string str() const;
+
+private:
+  template <class T>
+  void add_helper(const T& x, std::true_type)
+  {
+    const double tmp = x;
+    add_bytes(&tmp, sizeof(tmp));
+  }
+
+  template <class T>
+  void add_helper(const T& x, std::false_type)
+  {
+    const std::uint64_t tmp = static_cast<std::uint64_t>(x);
+    add_bytes(&tmp, sizeof(tmp));
+  }
+
+  std::uint64_t h_;
+};
+
+/// \brief Computes a 64-bit hash of the contents of a file, returned as a
+///        hexadecimal string.
+///
+/// The file is hashed in parallel blocks, so this is normally limited by the
+/// speed of reading the file.
+std::string ComputeFileContentHash(const std::string& path);
+
+/// \brief Computes a 64-bit hash of the bytes of a string, returned as a
+///        hexadecimal string.
+///
+/// The string may contain arbitrary binary data, e.g. the raw bytes of poses.
+std::string ComputeStringHash(const std::string& s);
+
+}  // xreg
+
+#endif
@@ -0,0 +1,57 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregHugePages.h"
+
+#include <cstdint>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+bool xreg::AdviseHugePages(void* buf, const std::size_t num_bytes)
+{
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  constexpr std::uintptr_t kHUGE_PAGE_SIZE = std::uintptr_t(2) * 1024 * 1024;
+
+  const std::uintptr_t buf_begin = reinterpret_cast<std::uintptr_t>(buf);
+  const std::uintptr_t buf_end   = buf_begin + num_bytes;
+
+  // round the start up, and the end down, to the huge page boundaries
+  const std::uintptr_t adv_begin = (buf_begin + kHUGE_PAGE_SIZE - 1) & ~(kHUGE_PAGE_SIZE - 1);
+  const std::uintptr_t adv_end   = buf_end & ~(kHUGE_PAGE_SIZE - 1);
+
+  if (adv_end <= adv_begin)
+  {
+    return false;
+  }
+
+  return !madvise(reinterpret_cast<void*>(adv_begin), adv_end - adv_begin, MADV_HUGEPAGE);
+#else
+  (void) buf;
+  (void) num_bytes;
+
+  return false;
+#endif
+}
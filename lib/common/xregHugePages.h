@@ -0,0 +1,72 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGHUGEPAGES_H_
+#define XREGHUGEPAGES_H_
+
+#include <cstddef>
+#include <vector>
+
+namespace xreg
+{
+
+/// \brief Advises the operating system to back a host buffer with
+///        transparent huge pages.
+///
+/// Only the whole huge pages (2 MB) lying within the buffer are affected, so
+/// this has no effect on small buffers. Large buffers with many random
+/// accesses, such as volumes read by the CPU ray casters, incur far fewer TLB
+/// misses when backed by huge pages. This should be called before the buffer
+/// is first written, so that its pages are faulted in as huge pages;
+/// otherwise they may only be collapsed later by the kernel.
+/// Returns false when the advice is not supported, e.g. on non-Linux systems.
+bool AdviseHugePages(void* buf, const std::size_t num_bytes);
+
+/// \brief Reserves capacity in a vector, advising huge pages for any storage
+///        that is newly allocated.
+template <class T>
+void ReserveWithHugePages(std::vector<T>* v, const std::size_t n)
+{
+  if (n > v->capacity())
+  {
+    v->reserve(n);
+
+    AdviseHugePages(v->data(), v->capacity() * sizeof(T));
+  }
+}
+
+/// \brief Resizes a vector, advising huge pages for any storage that is
+///        newly allocated.
+template <class T>
+void ResizeWithHugePages(std::vector<T>* v, const std::size_t n)
+{
+  ReserveWithHugePages(v, n);
+
+  v->resize(n);
+}
+
+}  // xreg
+
+#endif
+
@@ -0,0 +1,223 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregLocalSocket.h"
+
+#include <cstring>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "xregExceptionUtils.h"
+
+xreg::LocalSocketConnection::LocalSocketConnection(const int fd)
+  : fd_(fd)
+{
+#if !defined(_WIN32) && defined(SO_NOSIGPIPE)
+  // report writes to a closed connection as errors instead of SIGPIPE
+  const int on = 1;
+  setsockopt(fd_, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+}
+
+xreg::LocalSocketConnection::~LocalSocketConnection()
+{
+#ifndef _WIN32
+  if (fd_ >= 0)
+  {
+    close(fd_);
+  }
+#endif
+}
+
+bool xreg::LocalSocketConnection::read_line(std::string* line)
+{
+#ifdef _WIN32
+  xregThrow("local sockets are not supported on Windows!");
+#else
+  char buf[4096];
+
+  std::string::size_type newline_pos = read_buf_.find('\n');
+
+  while (newline_pos == std::string::npos)
+  {
+    const ssize_t num_bytes_read = recv(fd_, buf, sizeof(buf), 0);
+
+    if (num_bytes_read < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      xregThrow("failed to read from local socket: %s", std::strerror(errno));
+    }
+    else if (num_bytes_read == 0)
+    {
+      // the client closed the connection, a partial line is discarded
+      read_buf_.clear();
+      return false;
+    }
+
+    const std::string::size_type prev_len = read_buf_.size();
+
+    read_buf_.append(buf, static_cast<std::string::size_type>(num_bytes_read));
+
+    newline_pos = read_buf_.find('\n', prev_len);
+  }
+
+  std::string::size_type line_len = newline_pos;
+
+  if (line_len && (read_buf_[line_len - 1] == '\r'))
+  {
+    --line_len;
+  }
+
+  line->assign(read_buf_, 0, line_len);
+
+  read_buf_.erase(0, newline_pos + 1);
+
+  return true;
+#endif
+}
+
+void xreg::LocalSocketConnection::write_line(const std::string& line)
+{
+#ifdef _WIN32
+  xregThrow("local sockets are not supported on Windows!");
+#else
+  const std::string msg = line + '\n';
+
+#ifdef MSG_NOSIGNAL
+  const int send_flags = MSG_NOSIGNAL;
+#else
+  const int send_flags = 0;
+#endif
+
+  std::string::size_type num_bytes_sent = 0;
+
+  while (num_bytes_sent < msg.size())
+  {
+    const ssize_t n = send(fd_, msg.data() + num_bytes_sent, msg.size() - num_bytes_sent,
+                           send_flags);
+
+    if (n < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      xregThrow("failed to write to local socket: %s", std::strerror(errno));
+    }
+
+    num_bytes_sent += static_cast<std::string::size_type>(n);
+  }
+#endif
+}
+
+xreg::LocalSocketServer::LocalSocketServer(const std::string& path)
+  : path_(path)
+{
+#ifdef _WIN32
+  xregThrow("local sockets are not supported on Windows!");
+#else
+  sockaddr_un addr;
+  std::memset(&addr, 0, sizeof(addr));
+
+  addr.sun_family = AF_UNIX;
+
+  if (path_.empty() || (path_.size() >= sizeof(addr.sun_path)))
+  {
+    xregThrow("invalid local socket path (empty or longer than %d characters): %s",
+              static_cast<int>(sizeof(addr.sun_path) - 1), path_.c_str());
+  }
+
+  std::memcpy(addr.sun_path, path_.c_str(), path_.size());
+
+  fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  if (fd_ < 0)
+  {
+    xregThrow("failed to create local socket: %s", std::strerror(errno));
+  }
+
+  // remove a socket file left behind by a previous server
+  unlink(path_.c_str());
+
+  if (bind(fd_, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) ||
+      listen(fd_, 8))
+  {
+    const int err = errno;
+
+    close(fd_);
+    fd_ = -1;
+
+    xregThrow("failed to listen on local socket %s: %s", path_.c_str(), std::strerror(err));
+  }
+#endif
+}
+
+xreg::LocalSocketServer::~LocalSocketServer()
+{
+#ifndef _WIN32
+  if (fd_ >= 0)
+  {
+    close(fd_);
+    unlink(path_.c_str());
+  }
+#endif
+}
+
+std::unique_ptr<xreg::LocalSocketConnection> xreg::LocalSocketServer::accept()
+{
+#ifdef _WIN32
+  xregThrow("local sockets are not supported on Windows!");
+#else
+  int client_fd = -1;
+
+  do
+  {
+    client_fd = ::accept(fd_, nullptr, nullptr);
+  }
+  while ((client_fd < 0) && (errno == EINTR));
+
+  if (client_fd < 0)
+  {
+    xregThrow("failed to accept connection on local socket %s: %s",
+              path_.c_str(), std::strerror(errno));
+  }
+
+  return std::unique_ptr<LocalSocketConnection>(new LocalSocketConnection(client_fd));
+#endif
+}
+
+const std::string& xreg::LocalSocketServer::path() const
+{
+  return path_;
+}
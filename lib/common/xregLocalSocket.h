@@ -0,0 +1,104 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGLOCALSOCKET_H_
+#define XREGLOCALSOCKET_H_
+
+#include <memory>
+#include <string>
+
+namespace xreg
+{
+
+/// \brief A connection to a client of a LocalSocketServer.
+///
+/// Messages are exchanged as lines of text terminated by a newline character.
+/// The connection is closed when this object is destroyed.
+class LocalSocketConnection
+{
+public:
+  explicit LocalSocketConnection(const int fd);
+
+  ~LocalSocketConnection();
+
+  // no copying
+  LocalSocketConnection(const LocalSocketConnection&) = delete;
+  LocalSocketConnection& operator=(const LocalSocketConnection&) = delete;
+
+  /// \brief Reads the next line sent by the client, without the trailing
+  ///        newline (or carriage return).
+  ///
+  /// Blocks until a complete line is available. Returns false when the client
+  /// has closed the connection and no complete line remains.
+  bool read_line(std::string* line);
+
+  /// \brief Sends a line to the client, a newline is appended.
+  ///
+  /// An exception is thrown when the client has closed the connection.
+  void write_line(const std::string& line);
+
+private:
+  int fd_;
+
+  /// \brief Bytes read from the client beyond the last line returned
+  std::string read_buf_;
+};
+
+/// \brief A server listening on a local (UNIX domain) socket.
+///
+/// Local sockets are only reachable by processes on the same host, with
+/// access governed by the permissions of the socket file. This is used by
+/// long running tools that keep expensive resources (e.g. volumes and GPU
+/// contexts) resident between requests. Not supported on Windows.
+class LocalSocketServer
+{
+public:
+  /// \brief Creates the socket file at path and begins listening.
+  ///
+  /// An existing socket file at path is replaced. An exception is thrown when
+  /// the socket cannot be created.
+  explicit LocalSocketServer(const std::string& path);
+
+  /// \brief Stops listening and removes the socket file.
+  ~LocalSocketServer();
+
+  // no copying
+  LocalSocketServer(const LocalSocketServer&) = delete;
+  LocalSocketServer& operator=(const LocalSocketServer&) = delete;
+
+  /// \brief Blocks until a client connects.
+  std::unique_ptr<LocalSocketConnection> accept();
+
+  const std::string& path() const;
+
+private:
+  std::string path_;
+
+  int fd_ = -1;
+};
+
+}  // xreg
+
+#endif
+
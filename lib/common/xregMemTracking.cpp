@@ -0,0 +1,231 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregMemTracking.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <utility>
+
+#include <fmt/format.h>
+
+#include "xregStdStreamUtils.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+using size_type = std::size_t;
+
+struct MemRegistry
+{
+  std::mutex m;
+
+  MemUsage locs[2];
+
+  std::map<std::pair<int,std::string>,MemUsage> cats;
+};
+
+MemRegistry& GetMemRegistry()
+{
+  // Intentionally leaked, so that tracked buffers owned by static objects may
+  // safely be released during static destruction.
+  static MemRegistry* reg = new MemRegistry;
+  return *reg;
+}
+
+void UpdateMemUsage(MemUsage* u, const size_type old_bytes, const size_type new_bytes)
+{
+  u->cur_bytes  = (u->cur_bytes - old_bytes) + new_bytes;
+  u->peak_bytes = std::max(u->peak_bytes, u->cur_bytes);
+}
+
+void RecordMemChange(const MemLocation loc, const char* category,
+                     const size_type old_bytes, const size_type new_bytes)
+{
+  if (old_bytes != new_bytes)
+  {
+    const int loc_idx = static_cast<int>(loc);
+
+    auto& reg = GetMemRegistry();
+
+    std::lock_guard<std::mutex> lock(reg.m);
+
+    UpdateMemUsage(&reg.locs[loc_idx], old_bytes, new_bytes);
+    UpdateMemUsage(&reg.cats[std::make_pair(loc_idx, std::string(category))],
+                   old_bytes, new_bytes);
+  }
+}
+
+std::string BytesToStr(const size_type num_bytes)
+{
+  return fmt::format("{:.2f} MB", num_bytes / (1024.0 * 1024.0));
+}
+
+}  // un-named
+
+xreg::MemUsage xreg::GetMemUsage(const MemLocation loc)
+{
+  auto& reg = GetMemRegistry();
+
+  std::lock_guard<std::mutex> lock(reg.m);
+
+  return reg.locs[static_cast<int>(loc)];
+}
+
+xreg::MemUsage xreg::HostMemUsage()
+{
+  return GetMemUsage(MemLocation::kHOST);
+}
+
+xreg::MemUsage xreg::DeviceMemUsage()
+{
+  return GetMemUsage(MemLocation::kDEVICE);
+}
+
+xreg::MemUsageResults xreg::CollectMemUsage()
+{
+  MemUsageResults results;
+
+  auto& reg = GetMemRegistry();
+
+  std::lock_guard<std::mutex> lock(reg.m);
+
+  results.host   = reg.locs[static_cast<int>(MemLocation::kHOST)];
+  results.device = reg.locs[static_cast<int>(MemLocation::kDEVICE)];
+
+  results.categories.reserve(reg.cats.size());
+
+  // the map is ordered by location, then name
+  for (const auto& kv : reg.cats)
+  {
+    results.categories.push_back(MemUsageResults::Category{ kv.first.second,
+                                                            static_cast<MemLocation>(kv.first.first),
+                                                            kv.second });
+  }
+
+  return results;
+}
+
+void xreg::ResetPeakMemUsage()
+{
+  auto& reg = GetMemRegistry();
+
+  std::lock_guard<std::mutex> lock(reg.m);
+
+  for (auto& u : reg.locs)
+  {
+    u.peak_bytes = u.cur_bytes;
+  }
+
+  for (auto& kv : reg.cats)
+  {
+    kv.second.peak_bytes = kv.second.cur_bytes;
+  }
+}
+
+void xreg::MemUsageResults::print(OutputStream& out, const std::string& indent) const
+{
+  out.write_ascii_line(fmt::format("{}{:40s} {:>14s} {:>14s}",
+                                   indent, "memory", "current", "peak"));
+
+  for (const int loc_idx : { 0, 1 })
+  {
+    const MemLocation loc = static_cast<MemLocation>(loc_idx);
+
+    const MemUsage& loc_usage = (loc == MemLocation::kHOST) ? host : device;
+
+    out.write_ascii_line(fmt::format("{}{:40s} {:>14s} {:>14s}",
+                                     indent, (loc == MemLocation::kHOST) ? "host" : "device",
+                                     BytesToStr(loc_usage.cur_bytes),
+                                     BytesToStr(loc_usage.peak_bytes)));
+
+    for (const auto& c : categories)
+    {
+      if (c.loc == loc)
+      {
+        out.write_ascii_line(fmt::format("{}{:40s} {:>14s} {:>14s}",
+                                         indent, "  " + c.name,
+                                         BytesToStr(c.usage.cur_bytes),
+                                         BytesToStr(c.usage.peak_bytes)));
+      }
+    }
+  }
+}
+
+void xreg::MemUsageResults::print(std::ostream& out, const std::string& indent) const
+{
+  StdOutputStream std_out(out);
+  print(std_out, indent);
+}
+
+xreg::TrackedMemAlloc::TrackedMemAlloc(const MemLocation loc, const char* category)
+  : loc_(loc), category_(category)
+{ }
+
+xreg::TrackedMemAlloc::~TrackedMemAlloc()
+{
+  set_bytes(0);
+}
+
+xreg::TrackedMemAlloc::TrackedMemAlloc(const TrackedMemAlloc& other)
+  : loc_(other.loc_), category_(other.category_)
+{
+  set_bytes(other.num_bytes_);
+}
+
+xreg::TrackedMemAlloc& xreg::TrackedMemAlloc::operator=(const TrackedMemAlloc& other)
+{
+  if (this != &other)
+  {
+    set_bytes(other.num_bytes_);
+  }
+
+  return *this;
+}
+
+void xreg::TrackedMemAlloc::set_bytes(const size_type num_bytes)
+{
+  RecordMemChange(loc_, category_, num_bytes_, num_bytes);
+  num_bytes_ = num_bytes;
+}
+
+xreg::TrackedMemAlloc::size_type xreg::TrackedMemAlloc::bytes() const
+{
+  return num_bytes_;
+}
+
+xreg::MemLocation xreg::TrackedMemAlloc::location() const
+{
+  return loc_;
+}
+
+const char* xreg::TrackedMemAlloc::category() const
+{
+  return category_;
+}
@@ -0,0 +1,148 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file
+ * @brief Accounting of the host and device memory held by large buffers.
+ *
+ * Objects which own large buffers (e.g. projection buffers, device textures
+ * and similarity metric working images) report the sizes of those buffers
+ * through TrackedMemAlloc members. The current and peak totals of each memory
+ * location, and of each named category, may be queried at any time. Only
+ * buffers which are explicitly tracked are counted, so this is not a
+ * replacement for a heap profiler.
+ **/
+
+#ifndef XREGMEMTRACKING_H_
+#define XREGMEMTRACKING_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <iosfwd>
+
+namespace xreg
+{
+
+// Forward Declarations
+class OutputStream;
+
+enum class MemLocation
+{
+  kHOST = 0,
+  kDEVICE
+};
+
+/// \brief Current and peak number of bytes held.
+struct MemUsage
+{
+  using size_type = std::size_t;
+
+  size_type cur_bytes  = 0;
+  size_type peak_bytes = 0;
+};
+
+/// \brief Usage of each memory location and of each tracked category.
+struct MemUsageResults
+{
+  struct Category
+  {
+    /// \brief Name of the category, e.g. "ray-cast-proj-pixels"
+    std::string name;
+
+    MemLocation loc;
+
+    MemUsage usage;
+  };
+
+  MemUsage host;
+
+  MemUsage device;
+
+  /// \brief Categories sorted by location, then name
+  std::vector<Category> categories;
+
+  void print(OutputStream& out, const std::string& indent = "") const;
+
+  void print(std::ostream& out, const std::string& indent = "") const;
+};
+
+/// \brief Current and peak usage of host memory by tracked buffers.
+MemUsage HostMemUsage();
+
+/// \brief Current and peak usage of device memory by tracked buffers.
+MemUsage DeviceMemUsage();
+
+MemUsage GetMemUsage(const MemLocation loc);
+
+MemUsageResults CollectMemUsage();
+
+/// \brief Sets the peak usage of each location and category to the current usage.
+///
+/// e.g. call before starting a registration level to obtain the peak usage
+/// of that level alone.
+void ResetPeakMemUsage();
+
+/// \brief Records the size of a buffer, at a memory location and in a named
+///        category, for the lifetime of this object.
+///
+/// Typically a member of the object owning the buffer; set_bytes() is called
+/// whenever the buffer is (re-)allocated or freed. Copies record the same
+/// size again, since the owning object's buffer is typically also copied.
+/// The category name must remain valid for the lifetime of the object, e.g.
+/// a string literal.
+class TrackedMemAlloc
+{
+public:
+  using size_type = std::size_t;
+
+  TrackedMemAlloc(const MemLocation loc, const char* category);
+
+  ~TrackedMemAlloc();
+
+  TrackedMemAlloc(const TrackedMemAlloc& other);
+
+  /// \brief Records the size of other, the location and category of this
+  ///        object are unchanged.
+  TrackedMemAlloc& operator=(const TrackedMemAlloc& other);
+
+  void set_bytes(const size_type num_bytes);
+
+  size_type bytes() const;
+
+  MemLocation location() const;
+
+  const char* category() const;
+
+private:
+  MemLocation loc_;
+
+  const char* category_;
+
+  size_type num_bytes_ = 0;
+};
+
+}  // xreg
+
+#endif
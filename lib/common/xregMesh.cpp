@@ -24,6 +24,7 @@
 
 #include "xregMesh.h"
 
+#include <algorithm>
 #include <queue>
 #include <unordered_set>
 
@@ -121,47 +122,59 @@ void xreg::TriMesh::compute_normals(const bool inward_facing)
 
   normals.resize(num_faces);
 
-  for (size_type i = 0; i < num_faces; ++i)
-  {
-    const Vertex& v1 = vertices[faces[i][0]];
-    const Vertex& v2 = vertices[faces[i][1]];
-    const Vertex& v3 = vertices[faces[i][2]];
-
-    normals[i] = (v2 - v1).cross(v3 - v1);
-    normals[i].normalize();
+  const CoordScalar sgn = inward_facing ? CoordScalar(1) : CoordScalar(-1);
 
-    if (!inward_facing)
+  auto face_normals_fn = [&] (const RangeType& r)
+  {
+    for (size_type i = r.begin(); i != r.end(); ++i)
     {
-      normals[i] *= -1;
+      const Vertex& v1 = vertices[faces[i][0]];
+      const Vertex& v2 = vertices[faces[i][1]];
+      const Vertex& v3 = vertices[faces[i][2]];
+
+      normals[i] = (v2 - v1).cross(v3 - v1);
+      normals[i].normalize();
+      normals[i] *= sgn;
     }
-  }
+  };
+
+  ParallelFor(face_normals_fn, RangeType(0, num_faces));
 
   normals_valid = true;
 }
 
 void xreg::TriMesh::compute_vertex_normals(const bool inward_facing)
 {
-	compute_normals(inward_facing);
-	const size_type num_vertices = vertices.size();
-
-	vertex_normals.resize(num_vertices);
-    
-  IndexList f;
-
-	for (size_type i = 0; i < num_vertices; ++i)
-	{
-		vertex_normals[i][0] = 0 ; vertex_normals[i][1] = 0 ; vertex_normals[i][2] = 0 ;
-		
-		find_faces(i, &f);
-		
-    for (size_type j = 0 ; j < f.size() ; j++)
-		{
-			vertex_normals[i] += normals[ f[j] ];
-		}
-		vertex_normals[i].normalize() ;
-	}
-
-	normals_valid = true;
+  compute_normals(inward_facing);
+
+  const size_type num_vertices = vertices.size();
+  const size_type num_faces    = faces.size();
+
+  vertex_normals.assign(num_vertices, Vertex::Zero());
+
+  // Scatter each face normal onto its vertices with a single pass over the
+  // faces; visiting faces in increasing order yields the same sums as a
+  // per-vertex search of the incident faces.
+  for (size_type face_idx = 0; face_idx < num_faces; ++face_idx)
+  {
+    const Vertex& n = normals[face_idx];
+
+    vertex_normals[faces[face_idx][0]] += n;
+    vertex_normals[faces[face_idx][1]] += n;
+    vertex_normals[faces[face_idx][2]] += n;
+  }
+
+  auto normalize_fn = [&] (const RangeType& r)
+  {
+    for (size_type i = r.begin(); i != r.end(); ++i)
+    {
+      vertex_normals[i].normalize();
+    }
+  };
+
+  ParallelFor(normalize_fn, RangeType(0, num_vertices));
+
+  normals_valid = true;
 }
 
 void xreg::TriMesh::find_faces(const size_type vert_index, IndexList* face_inds)
@@ -453,40 +466,83 @@ void xreg::TriMesh::remove_duplicate_vertices(VertexList* dst, IndexList* inds)
                                             FixedPtHash<Vertex>,
                                             PtEuclideanNormEqualTo<Vertex>>;
 
-  VertexIndexMap vert_map;
-
   const size_type num_src_verts = vertices.size();
 
-  if (inds)
+  // The vertices are partitioned into buckets using their hash values, so that
+  // equal vertices are always placed in the same bucket and each bucket may be
+  // processed independently. Vertices are visited in ascending order within each
+  // bucket, so the first occurrence of a vertex is always found first and the
+  // output is identical to visiting every vertex serially.
+  const size_type num_buckets = std::max(size_type(1),
+                                         std::min(size_type(256), num_src_verts / 4096));
+
+  IndexList vert_buckets(num_src_verts);
+
+  auto hash_fn = [&] (const RangeType& r)
   {
-    // set every value to one past the last valid index to indicate that it has
-    // not been mapped yet.
-    inds->assign(num_src_verts, num_src_verts);
-  }
+    const FixedPtHash<Vertex> vert_hash;
 
-  size_type dst_vert_index = 0;
-  dst->clear();
+    for (size_type i = r.begin(); i < r.end(); ++i)
+    {
+      vert_buckets[i] = vert_hash(vertices[i]) % num_buckets;
+    }
+  };
+
+  ParallelFor(hash_fn, RangeType(0, num_src_verts));
+
+  std::vector<IndexList> bucket_vert_inds(num_buckets);
 
   for (size_type i = 0; i < num_src_verts; ++i)
   {
-    auto map_ret = vert_map.emplace(vertices[i], dst_vert_index);
+    bucket_vert_inds[vert_buckets[i]].push_back(i);
+  }
+
+  // index of the first occurrence of each vertex
+  IndexList first_inds(num_src_verts);
 
-    if (inds)
+  auto weld_fn = [&] (const RangeType& r)
+  {
+    for (size_type bucket_idx = r.begin(); bucket_idx < r.end(); ++bucket_idx)
     {
-      // Note: map.insert does not update the mapped value when the key already
-      //       exists in the map
-      inds->operator[](i) = map_ret.first->second;
+      const IndexList& cur_vert_inds = bucket_vert_inds[bucket_idx];
+
+      VertexIndexMap vert_map;
+      vert_map.reserve(cur_vert_inds.size());
+
+      for (const size_type i : cur_vert_inds)
+      {
+        // Note: map.emplace does not update the mapped value when the key already
+        //       exists in the map
+        first_inds[i] = vert_map.emplace(vertices[i], i).first->second;
+      }
     }
+  };
+
+  ParallelFor(weld_fn, RangeType(0, num_buckets));
+
+  IndexList tmp_inds;
+
+  IndexList& dst_inds = inds ? *inds : tmp_inds;
+  dst_inds.resize(num_src_verts);
 
-    // If we've actually encountered a new vertex:
-    if (map_ret.second)
+  dst->clear();
+
+  for (size_type i = 0; i < num_src_verts; ++i)
+  {
+    const size_type first_idx = first_inds[i];
+
+    if (first_idx == i)
     {
+      // a new vertex, the first occurrence always has a lower index than any
+      // duplicates, so it has already been mapped when a duplicate is visited
+      dst_inds[i] = dst->size();
       dst->push_back(vertices[i]);
-      ++dst_vert_index;
+    }
+    else
+    {
+      dst_inds[i] = dst_inds[first_idx];
     }
   }
-
-  xregASSERT(dst->size() == dst_vert_index);
 }
 
 void xreg::TriMesh::remove_duplicate_vertices()
@@ -548,8 +604,8 @@ void xreg::TriMesh::transform(const FrameTransform& xform)
     no_trans_xform.matrix()(1,3) = 0;
     no_trans_xform.matrix()(2,3) = 0;
 
-    ApplyTransform(xform, normals, &normals);
-    ApplyTransform(xform, vertex_normals, &vertex_normals);
+    ApplyTransform(no_trans_xform, normals, &normals);
+    ApplyTransform(no_trans_xform, vertex_normals, &vertex_normals);
 
     // TODO: actually in this case, there could be more to do
     if (std::abs(std::abs(xform.matrix().determinant()) - 1) > 1.0e-6)
@@ -563,14 +619,20 @@ void xreg::TriMesh::transform(const FrameTransform& xform)
 
 xreg::Pt3List xreg::TriMesh::face_centroids() const
 {
-  Pt3List cents;
+  const size_type num_faces = faces.size();
 
-  cents.reserve(faces.size());
+  Pt3List cents(num_faces);
 
-  for (const auto& cur_face : faces)
+  auto cents_fn = [&] (const RangeType& r)
   {
-    cents.push_back((vertices[cur_face[0]] + vertices[cur_face[1]] + vertices[cur_face[2]]) / 3);
-  }
+    for (size_type i = r.begin(); i != r.end(); ++i)
+    {
+      const auto& cur_face = faces[i];
+      cents[i] = (vertices[cur_face[0]] + vertices[cur_face[1]] + vertices[cur_face[2]]) / 3;
+    }
+  };
+
+  ParallelFor(cents_fn, RangeType(0, num_faces));
 
   return cents;
 }
@@ -1035,31 +1097,33 @@ void xreg::RemoveUnusedVertices(const TriMesh& src, TriMesh* dst,
     }
   }
 
-  dst->faces = src.faces;
-  for (size_type tri_index = 0; tri_index < num_tris; ++tri_index)
+  dst->faces.resize(num_tris);
+
+  auto remap_faces_fn = [&] (const RangeType& r)
   {
-    dst->faces[tri_index][0] = forward_map[dst->faces[tri_index][0]];
-    dst->faces[tri_index][1] = forward_map[dst->faces[tri_index][1]];
-    dst->faces[tri_index][2] = forward_map[dst->faces[tri_index][2]];
-  }
+    for (size_type tri_index = r.begin(); tri_index != r.end(); ++tri_index)
+    {
+      dst->faces[tri_index][0] = forward_map[src.faces[tri_index][0]];
+      dst->faces[tri_index][1] = forward_map[src.faces[tri_index][1]];
+      dst->faces[tri_index][2] = forward_map[src.faces[tri_index][2]];
+    }
+  };
+
+  ParallelFor(remap_faces_fn, RangeType(0, num_tris));
 
   if (rev_map)
   {
-    rev_map->clear();
-    rev_map->reserve(dst_num_verts);
+    // the forward map is injective, so it may be inverted directly
+    rev_map->assign(dst_num_verts, kNOT_MAPPED);
 
-    for (size_type new_vert_index = 0; new_vert_index < dst_num_verts; ++new_vert_index)
+    for (size_type orig_vert_index = 0; orig_vert_index < orig_num_verts; ++orig_vert_index)
     {
-      for (size_type orig_vert_index = 0; orig_vert_index < orig_num_verts; ++orig_vert_index)
+      const size_type new_vert_index = forward_map[orig_vert_index];
+
+      if (new_vert_index != kNOT_MAPPED)
       {
-        if (forward_map[orig_vert_index] == new_vert_index)
-        {
-          rev_map->push_back(orig_vert_index);
-          break;
-        }
+        rev_map->operator[](new_vert_index) = orig_vert_index;
       }
-
-      xregASSERT(rev_map->size() == (new_vert_index + 1));
     }
   }
 }
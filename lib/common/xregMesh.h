@@ -266,7 +266,9 @@ struct TriMesh
     *        without the duplicates.
     *
     * A mapping from original vertex indices to new (non-duplicate) vertex
-    * indices is populated if the user provides an IndexList.
+    * indices is populated if the user provides an IndexList. Duplicates are
+    * found concurrently, but the output is the same as a serial search: the
+    * unique vertices are ordered by their first occurrence.
     * @param dst The user provided list of vertices to populate; it will be
     *            cleared before population.
     * @param inds (optional) The user provided index mapping from the original
@@ -483,6 +485,8 @@ void InvertVertexMask(const TriMesh::VertexMask& src_mask, TriMesh::VertexMask*
 void RemoveUnusedVertices(const TriMesh& src, TriMesh* dst,
                           TriMesh::VertexReorderMap* rev_map = nullptr);
 
+/// \brief Exhaustive closest point search; see FindClosestPtsToMesh() for an
+///        indexed equivalent.
 std::tuple<Pt3,CoordScalar>
 FindClosestPtToMeshExhaustive(const Pt3& x, const TriMesh& mesh);
 
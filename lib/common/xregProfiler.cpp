@@ -0,0 +1,307 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregProfiler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <ostream>
+
+#include <fmt/format.h>
+
+#include "xregStdStreamUtils.h"
+
+std::atomic<bool> xreg::detail::profiling_enabled(false);
+
+const xreg::ProfileScope::size_type xreg::ProfileScope::kNO_NODE;
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+using size_type = std::size_t;
+
+struct ProfileNode
+{
+  const char* name;
+
+  size_type parent;
+
+  std::vector<size_type> children;
+
+  size_type num_calls;
+
+  double total_secs;
+};
+
+// The counters of a single thread, node 0 is an unnamed root.
+struct ThreadProfileData
+{
+  std::vector<ProfileNode> nodes;
+
+  size_type cur_node_idx = 0;
+
+  ThreadProfileData()
+  {
+    reset();
+  }
+
+  void reset()
+  {
+    nodes.assign(1, ProfileNode{ nullptr, 0, { }, 0, 0 });
+    cur_node_idx = 0;
+  }
+};
+
+using ThreadProfileDataPtr = std::shared_ptr<ThreadProfileData>;
+
+// The counters of every thread which has entered a profiled region. The entries
+// are retained after a thread exits so that its timings are still reported.
+struct ProfileRegistry
+{
+  std::mutex m;
+
+  std::vector<ThreadProfileDataPtr> threads;
+};
+
+ProfileRegistry& GetProfileRegistry()
+{
+  static ProfileRegistry reg;
+  return reg;
+}
+
+ThreadProfileDataPtr MakeAndRegisterThreadProfileData()
+{
+  auto td = std::make_shared<ThreadProfileData>();
+
+  auto& reg = GetProfileRegistry();
+
+  std::lock_guard<std::mutex> lock(reg.m);
+  reg.threads.push_back(td);
+
+  return td;
+}
+
+ThreadProfileData& GetThreadProfileData()
+{
+  thread_local ThreadProfileDataPtr td = MakeAndRegisterThreadProfileData();
+  return *td;
+}
+
+struct MergedProfileNode
+{
+  std::string name;
+
+  std::vector<size_type> children;
+
+  size_type num_calls;
+
+  double total_secs;
+};
+
+void MergeProfileNodes(const ThreadProfileData& td, const size_type src_idx,
+                       std::vector<MergedProfileNode>* merged, const size_type dst_idx)
+{
+  for (const size_type src_child_idx : td.nodes[src_idx].children)
+  {
+    const ProfileNode& src_child = td.nodes[src_child_idx];
+    
+    size_type dst_child_idx = merged->size();
+
+    for (const size_type i : (*merged)[dst_idx].children)
+    {
+      if ((*merged)[i].name == src_child.name)
+      {
+        dst_child_idx = i;
+        break;
+      }
+    }
+
+    if (dst_child_idx == merged->size())
+    {
+      merged->push_back(MergedProfileNode{ src_child.name, { }, 0, 0 });
+      (*merged)[dst_idx].children.push_back(dst_child_idx);
+    }
+
+    (*merged)[dst_child_idx].num_calls  += src_child.num_calls;
+    (*merged)[dst_child_idx].total_secs += src_child.total_secs;
+
+    MergeProfileNodes(td, src_child_idx, merged, dst_child_idx);
+  }
+}
+
+void FlattenMergedProfileNodes(const std::vector<MergedProfileNode>& merged,
+                               const size_type node_idx,
+                               const std::string& parent_path,
+                               const size_type depth,
+                               ProfileResults* results)
+{
+  for (const size_type child_idx : merged[node_idx].children)
+  {
+    const MergedProfileNode& child = merged[child_idx];
+
+    ProfileResults::Region r;
+    r.name       = child.name;
+    r.path       = parent_path.empty() ? child.name : (parent_path + "/" + child.name);
+    r.depth      = depth;
+    r.num_calls  = child.num_calls;
+    r.total_secs = child.total_secs;
+    r.self_secs  = child.total_secs;
+
+    for (const size_type grandchild_idx : child.children)
+    {
+      r.self_secs -= merged[grandchild_idx].total_secs;
+    }
+
+    // child regions from other threads may overlap in time
+    r.self_secs = std::max(0.0, r.self_secs);
+
+    results->regions.push_back(r);
+
+    FlattenMergedProfileNodes(merged, child_idx, results->regions.back().path, depth + 1, results);
+  }
+}
+
+}  // un-named
+
+void xreg::ProfileScope::enter(const char* name)
+{
+  ThreadProfileData& td = GetThreadProfileData();
+
+  const size_type parent_idx = td.cur_node_idx;
+
+  node_idx_ = kNO_NODE;
+
+  for (const size_type child_idx : td.nodes[parent_idx].children)
+  {
+    const char* child_name = td.nodes[child_idx].name;
+
+    if ((child_name == name) || !std::strcmp(child_name, name))
+    {
+      node_idx_ = child_idx;
+      break;
+    }
+  }
+
+  if (node_idx_ == kNO_NODE)
+  {
+    node_idx_ = td.nodes.size();
+    td.nodes.push_back(ProfileNode{ name, parent_idx, { }, 0, 0 });
+    td.nodes[parent_idx].children.push_back(node_idx_);
+  }
+
+  td.cur_node_idx = node_idx_;
+
+  start_time_ = clock_type::now();
+}
+
+void xreg::ProfileScope::leave()
+{
+  const double elapsed_secs = std::chrono::duration<double>(clock_type::now() - start_time_).count();
+
+  ThreadProfileData& td = GetThreadProfileData();
+
+  // the counters may have been reset while this region was active
+  if (node_idx_ < td.nodes.size())
+  {
+    ProfileNode& node = td.nodes[node_idx_];
+
+    ++node.num_calls;
+    node.total_secs += elapsed_secs;
+
+    td.cur_node_idx = node.parent;
+  }
+}
+
+void xreg::SetProfilingEnabled(const bool enabled)
+{
+  detail::profiling_enabled.store(enabled);
+}
+
+void xreg::ResetProfiling()
+{
+  auto& reg = GetProfileRegistry();
+
+  std::lock_guard<std::mutex> lock(reg.m);
+
+  for (auto& td : reg.threads)
+  {
+    td->reset();
+  }
+}
+
+xreg::ProfileResults xreg::CollectProfileResults()
+{
+  std::vector<MergedProfileNode> merged(1, MergedProfileNode{ std::string(), { }, 0, 0 });
+
+  {
+    auto& reg = GetProfileRegistry();
+
+    std::lock_guard<std::mutex> lock(reg.m);
+
+    for (const auto& td : reg.threads)
+    {
+      MergeProfileNodes(*td, 0, &merged, 0);
+    }
+  }
+
+  ProfileResults results;
+
+  FlattenMergedProfileNodes(merged, 0, std::string(), 0, &results);
+
+  results.host_mem   = HostMemUsage();
+  results.device_mem = DeviceMemUsage();
+
+  return results;
+}
+
+void xreg::ProfileResults::print(OutputStream& out, const std::string& indent) const
+{
+  out.write_ascii_line(fmt::format("{}{:40s} {:>10s} {:>12s} {:>12s}",
+                                   indent, "region", "calls", "total (s)", "self (s)"));
+
+  for (const auto& r : regions)
+  {
+    out.write_ascii_line(fmt::format("{}{:40s} {:>10d} {:>12.4f} {:>12.4f}",
+                                     indent, std::string(2 * r.depth, ' ') + r.name,
+                                     r.num_calls, r.total_secs, r.self_secs));
+  }
+
+  out.write_ascii_line(fmt::format("{}host memory (MB):   current {:.2f}, peak {:.2f}", indent,
+                                   host_mem.cur_bytes / (1024.0 * 1024.0),
+                                   host_mem.peak_bytes / (1024.0 * 1024.0)));
+  out.write_ascii_line(fmt::format("{}device memory (MB): current {:.2f}, peak {:.2f}", indent,
+                                   device_mem.cur_bytes / (1024.0 * 1024.0),
+                                   device_mem.peak_bytes / (1024.0 * 1024.0)));
+}
+
+void xreg::ProfileResults::print(std::ostream& out, const std::string& indent) const
+{
+  StdOutputStream std_out(out);
+  print(std_out, indent);
+}
+
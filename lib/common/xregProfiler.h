@@ -0,0 +1,212 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file
+ * @brief Lightweight, scoped-region profiling of named, nested code regions.
+ *
+ * Each thread records the time spent within, and the number of entries into,
+ * named regions in its own tree of counters, so no synchronization is needed
+ * while profiling. Regions opened while another region is active on the same
+ * thread are recorded as children of that region. Regions entered on worker
+ * threads (e.g. within a ParallelFor) are recorded at the top-level of those
+ * threads.
+ *
+ * When tracing is enabled (see xregTrace.h), profiled scopes are also recorded
+ * as trace events.
+ *
+ * Profiling is disabled by default, in which case a profiled scope costs two
+ * relaxed atomic loads. Define XREG_NO_PROFILING to remove the profiled
+ * scopes entirely at compile time.
+ **/
+
+#ifndef XREGPROFILER_H_
+#define XREGPROFILER_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <iosfwd>
+#include <chrono>
+#include <atomic>
+
+#include "xregTrace.h"
+#include "xregMemTracking.h"
+
+// define this to remove all profiled scopes at compile time
+//#define XREG_NO_PROFILING
+
+namespace xreg
+{
+
+// Forward Declarations
+class OutputStream;
+
+/// \brief Accumulated timings of profiled regions, merged over all threads.
+struct ProfileResults
+{
+  using size_type = std::size_t;
+
+  struct Region
+  {
+    /// \brief Name of the region, e.g. "ray-cast"
+    std::string name;
+
+    /// \brief Names of the region and each of its parents, separated by "/",
+    ///        e.g. "regi/obj-fn/ray-cast"
+    std::string path;
+
+    /// \brief 0 for top-level regions
+    size_type depth = 0;
+
+    size_type num_calls = 0;
+
+    /// \brief Time spent within the region, including its children
+    double total_secs = 0;
+
+    /// \brief Time spent within the region, excluding its children
+    double self_secs = 0;
+  };
+
+  /// \brief Regions in depth-first order - each region is followed by its children.
+  std::vector<Region> regions;
+
+  /// \brief Usage of host memory by tracked buffers, the peak is since the
+  ///        last call to ResetPeakMemUsage()
+  MemUsage host_mem;
+
+  /// \brief Usage of device memory by tracked buffers, the peak is since the
+  ///        last call to ResetPeakMemUsage()
+  MemUsage device_mem;
+
+  /// \brief Prints an indented table of the regions, followed by the memory usage
+  void print(OutputStream& out, const std::string& indent = "") const;
+  
+  void print(std::ostream& out, const std::string& indent = "") const;
+};
+
+namespace detail
+{
+
+extern std::atomic<bool> profiling_enabled;
+
+}  // detail
+
+/// \brief Globally enables or disables profiling.
+///
+/// Regions which are active when profiling is toggled are not affected.
+void SetProfilingEnabled(const bool enabled);
+
+inline bool ProfilingEnabled()
+{
+  return detail::profiling_enabled.load(std::memory_order_relaxed);
+}
+
+/// \brief Clears the counters of every thread.
+///
+/// This should not be called while profiled regions are active.
+void ResetProfiling();
+
+/// \brief Merges the counters of every thread.
+///
+/// Regions of multiple threads are merged when they have the same path.
+/// The current memory usage of tracked buffers is also collected.
+/// This should not be called while profiled regions are active.
+ProfileResults CollectProfileResults();
+
+/// \brief Records the time spent between construction and destruction in a
+///        named region.
+///
+/// The name must remain valid until the next call to ResetProfiling(), e.g. 
+/// a string literal.
+/// Typically used through the xregPROFILE_SCOPE macro.
+class ProfileScope
+{
+public:
+  explicit ProfileScope(const char* name)
+  {
+    if (ProfilingEnabled())
+    {
+      enter(name);
+    }
+
+    if (TracingEnabled())
+    {
+      trace_name_     = name;
+      trace_start_us_ = TraceTimestampMicros();
+    }
+  }
+
+  ~ProfileScope()
+  {
+    if (node_idx_ != kNO_NODE)
+    {
+      leave();
+    }
+
+    if (trace_name_)
+    {
+      RecordTraceEvent(trace_name_, "xreg", trace_start_us_,
+                       TraceTimestampMicros() - trace_start_us_);
+    }
+  }
+
+  // no copying
+  ProfileScope(const ProfileScope&) = delete;
+  ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+  using size_type  = std::size_t;
+  using clock_type = std::chrono::steady_clock;
+
+  static const size_type kNO_NODE = ~size_type(0);
+
+  void enter(const char* name);
+
+  void leave();
+
+  size_type node_idx_ = kNO_NODE;
+
+  clock_type::time_point start_time_;
+
+  const char* trace_name_ = nullptr;
+
+  double trace_start_us_ = 0;
+};
+
+}  // xreg
+
+#define xregPROFILE_SCOPE_CONCAT_HELPER(x,y) x##y
+#define xregPROFILE_SCOPE_CONCAT(x,y) xregPROFILE_SCOPE_CONCAT_HELPER(x,y)
+
+#ifndef XREG_NO_PROFILING
+/// \brief Profiles the remainder of the enclosing scope as a named region
+#define xregPROFILE_SCOPE(name) \
+  xreg::ProfileScope xregPROFILE_SCOPE_CONCAT(xreg_profile_scope_, __LINE__)(name)
+#else
+#define xregPROFILE_SCOPE(name)
+#endif
+
+#endif
+
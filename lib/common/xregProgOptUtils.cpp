@@ -57,9 +57,12 @@
 #include <boost/compute/system.hpp>
 
 #include "xregAssert.h"
+#include "xregTBBUtils.h"
 
 #include "xregStringUtils.h"
 #include "xregFilesystemUtils.h"
+#include "xregOpenCLProfiling.h"
+#include "xregOpenCLSys.h"
 
 #include "xregVersionInfo.h"
 
@@ -238,6 +241,11 @@ void WritePrettyHelp(const xreg::ProgOpts::StringList& flag_strs,
 
 const std::string kTBB_MAX_NUM_THREADS_ARG_STR = "tbb-max-threads";
 
+const std::string kTBB_ARENA_THREADS_ARG_STR = "tbb-arena-threads";
+const std::string kTBB_GRAIN_SIZE_ARG_STR    = "tbb-grain-size";
+const std::string kTBB_PARTITIONER_ARG_STR   = "tbb-partitioner";
+const std::string kTBB_NUMA_NODE_ARG_STR     = "tbb-numa-node";
+
 /// \brief Global for storing TBB thread information.
 ///
 /// By default, this is a null instance, so TBB defaults are used.
@@ -1351,6 +1359,43 @@ void xreg::ProgOpts::parse(int argc, char* argv[])
         new tbb::task_scheduler_init(get(kTBB_MAX_NUM_THREADS_ARG_STR).as_uint32()));
   }
 
+  if (parallel_exec_ctx_opts_added_ &&
+      (has(kTBB_ARENA_THREADS_ARG_STR) || has(kTBB_GRAIN_SIZE_ARG_STR) ||
+       has(kTBB_PARTITIONER_ARG_STR)   || has(kTBB_NUMA_NODE_ARG_STR)))
+  {
+    const int max_concurrency = has(kTBB_ARENA_THREADS_ARG_STR) ?
+                                  static_cast<int>(get(kTBB_ARENA_THREADS_ARG_STR).as_uint32()) : 0;
+
+    const std::size_t grain_size = has(kTBB_GRAIN_SIZE_ARG_STR) ?
+                                    static_cast<std::size_t>(get(kTBB_GRAIN_SIZE_ARG_STR).as_uint64()) : 1;
+
+    const int numa_node = has(kTBB_NUMA_NODE_ARG_STR) ?
+                            get(kTBB_NUMA_NODE_ARG_STR).as_int32() : -1;
+
+    ParallelExecContext::Partitioner part = ParallelExecContext::kAUTO_PARTITIONER;
+
+    if (has(kTBB_PARTITIONER_ARG_STR))
+    {
+      const std::string part_str = get(kTBB_PARTITIONER_ARG_STR).as_string();
+
+      if (part_str == "simple")
+      {
+        part = ParallelExecContext::kSIMPLE_PARTITIONER;
+      }
+      else if (part_str == "static")
+      {
+        part = ParallelExecContext::kSTATIC_PARTITIONER;
+      }
+      else if (part_str != "auto")
+      {
+        xregThrow("Invalid TBB partitioner: %s", part_str.c_str());
+      }
+    }
+
+    DefaultParallelExecContext() = std::make_shared<ParallelExecContext>(
+                                          max_concurrency, grain_size, part, numa_node);
+  }
+
   if (print_help_backend_str_ && has("backend"))
   {
     // Backend specification is enabled, check that the passed string is valid.
@@ -1630,10 +1675,40 @@ void xreg::ProgOpts::add_tbb_max_num_threads_flag()
   tbb_max_num_threads_opt_added_ = true; 
 }
 
+void xreg::ProgOpts::add_parallel_exec_context_flags()
+{
+  add(kTBB_ARENA_THREADS_ARG_STR, ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32,
+      kTBB_ARENA_THREADS_ARG_STR,
+      "Execute all parallel CPU work of this process within a TBB task arena having at most "
+      "this many threads. Unlike --" + kTBB_MAX_NUM_THREADS_ARG_STR + ", this only limits "
+      "the work submitted by this process, so that several processes (or registrations) "
+      "may be run on a node without oversubscribing it. When not specified, and no other "
+      "arena option is specified, the global TBB scheduler is used.");
+
+  add(kTBB_GRAIN_SIZE_ARG_STR, ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT64,
+      kTBB_GRAIN_SIZE_ARG_STR,
+      "The grain size used when splitting parallel loops executed within the TBB task "
+      "arena, e.g. the minimum number of rays or pixels processed by a task. Defaults to 1.");
+
+  add(kTBB_PARTITIONER_ARG_STR, ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING,
+      kTBB_PARTITIONER_ARG_STR,
+      "The partitioner used by parallel loops executed within the TBB task arena. "
+      "Valid values are: \"auto\", \"simple\" and \"static\". Defaults to \"auto\".");
+
+  add(kTBB_NUMA_NODE_ARG_STR, ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_INT32,
+      kTBB_NUMA_NODE_ARG_STR,
+      "Constrain the threads of the TBB task arena to a NUMA node. This requires a "
+      "version of TBB supporting task arena constraints.");
+
+  parallel_exec_ctx_opts_added_ = true;
+}
+
 void xreg::ProgOpts::add_backend_flags()
 {
   add_ocl_select_flag();
 
+  add_parallel_exec_context_flags();
+
   const auto& valid_backends = ValidBackendNameAndDescs();
 
   std::stringstream ss;
@@ -1715,8 +1790,8 @@ xreg::ProgOpts::selected_ocl_ctx_queue()
   {
     boost::compute::device dev = selected_ocl();
 
-    selected_ocl_ctx_   = boost::compute::context(dev);
-    selected_ocl_queue_ = boost::compute::command_queue(selected_ocl_ctx_, dev);
+    selected_ocl_ctx_   = SharedOpenCLContext(dev);
+    selected_ocl_queue_ = MakeOpenCLCmdQueue(selected_ocl_ctx_, dev);
     
     selected_ocl_ctx_queue_set_ = true;
   }
@@ -481,6 +481,13 @@ public:
 
   void add_tbb_max_num_threads_flag();
 
+  /// \brief Adds flags configuring the process-wide parallel execution context.
+  ///
+  /// After parsing, when any of these flags are passed, a context is created
+  /// and set as DefaultParallelExecContext(). This is also called by
+  /// add_backend_flags().
+  void add_parallel_exec_context_flags();
+
   boost::compute::device selected_ocl();
 
   std::tuple<boost::compute::context,boost::compute::command_queue> selected_ocl_ctx_queue();
@@ -560,6 +567,8 @@ private:
   boost::compute::command_queue selected_ocl_queue_;
 
   bool tbb_max_num_threads_opt_added_ = false;
+
+  bool parallel_exec_ctx_opts_added_ = false;
 };
 
 }  // xreg
@@ -0,0 +1,177 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "xregRawFileReadUtils.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#include <fmt/format.h>
+
+#include "xregFilesystemUtils.h"
+#include "xregTBBUtils.h"
+
+namespace
+{
+
+using namespace xreg;
+
+void ThrowRawReadFailure(const std::string& path, const size_type off, const size_type n)
+{
+  throw FileSystemException(path.c_str(),
+                            fmt::format("failed to read {} bytes at offset {}", n, off).c_str());
+}
+
+#ifndef _WIN32
+
+// Closes a file descriptor on destruction
+struct ScopedFD
+{
+  int fd;
+
+  explicit ScopedFD(const std::string& path)
+    : fd(::open(path.c_str(), O_RDONLY))
+  {
+    if (fd < 0)
+    {
+      throw FileSystemException(path.c_str(), "failed to open for reading");
+    }
+  }
+
+  ~ScopedFD()
+  {
+    ::close(fd);
+  }
+};
+
+// pread() may return fewer bytes than requested, so loop until the entire
+// request is satisfied
+void PReadAll(const std::string& path, const int fd, unsigned char* buf,
+              const size_type off, const size_type n)
+{
+  size_type tot_num_read = 0;
+
+  while (tot_num_read < n)
+  {
+    const ssize_t num_read = ::pread(fd, buf + tot_num_read, n - tot_num_read,
+                                     static_cast<off_t>(off + tot_num_read));
+    if (num_read <= 0)
+    {
+      ThrowRawReadFailure(path, off, n);
+    }
+
+    tot_num_read += static_cast<size_type>(num_read);
+  }
+}
+
+#endif
+
+}  // un-named
+
+xreg::size_type xreg::RawFileNumBytes(const std::string& path)
+{
+#ifndef _WIN32
+  struct stat s;
+
+  if (::stat(path.c_str(), &s))
+  {
+    throw FileSystemException(path.c_str(), "failed to stat file");
+  }
+
+  return static_cast<size_type>(s.st_size);
+#else
+  ScopedCFile fp(path.c_str(), "rb");
+  _fseeki64(fp, 0, SEEK_END);
+  return static_cast<size_type>(_ftelli64(fp));
+#endif
+}
+
+void xreg::ReadRawFileBlocks(const std::string& path,
+                             const size_type byte_off,
+                             const size_type num_bytes,
+                             const RawFileBlockFn& block_fn,
+                             const size_type elem_num_bytes,
+                             const size_type block_num_bytes)
+{
+  if (!num_bytes)
+  {
+    return;
+  }
+
+  const size_type block_len = std::max(elem_num_bytes,
+                                       (block_num_bytes / elem_num_bytes) * elem_num_bytes);
+
+  const size_type num_blocks = (num_bytes + block_len - 1) / block_len;
+
+#ifndef _WIN32
+  ScopedFD f(path);
+
+  auto read_blocks_fn = [&] (const RangeType& r)
+  {
+    // one buffer per task, reused across the blocks of the task
+    std::vector<unsigned char> buf(block_len);
+
+    for (size_type block_idx = r.begin(); block_idx < r.end(); ++block_idx)
+    {
+      const size_type off = block_idx * block_len;
+      const size_type n   = std::min(block_len, num_bytes - off);
+
+      PReadAll(path, f.fd, buf.data(), byte_off + off, n);
+
+      block_fn(buf.data(), off, n);
+    }
+  };
+
+  ParallelFor(read_blocks_fn, RangeType(0, num_blocks));
+#else
+  ScopedCFile fp(path.c_str(), "rb");
+
+  if (_fseeki64(fp, static_cast<__int64>(byte_off), SEEK_SET))
+  {
+    ThrowRawReadFailure(path, byte_off, num_bytes);
+  }
+
+  std::vector<unsigned char> buf(block_len);
+
+  for (size_type block_idx = 0; block_idx < num_blocks; ++block_idx)
+  {
+    const size_type off = block_idx * block_len;
+    const size_type n   = std::min(block_len, num_bytes - off);
+
+    if (std::fread(buf.data(), n, 1, fp) != 1)
+    {
+      ThrowRawReadFailure(path, byte_off + off, n);
+    }
+
+    block_fn(buf.data(), off, n);
+  }
+#endif
+}
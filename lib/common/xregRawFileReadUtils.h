@@ -0,0 +1,125 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file
+ * @brief Parallel, block-based, reading of raw binary files directly into
+ *        destination buffers.
+ **/
+
+#ifndef XREGRAWFILEREADUTILS_H_
+#define XREGRAWFILEREADUTILS_H_
+
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "xregCommon.h"
+#include "xregEndianUtils.h"
+
+namespace xreg
+{
+
+/// \brief Callback invoked for each block read from a file.
+///
+/// Arguments are a pointer to the bytes of the block, the offset of the block
+/// relative to the start of the region read and the number of bytes in the
+/// block. Blocks are processed concurrently, so the callback must be safe to
+/// call from multiple threads when writing to disjoint outputs.
+using RawFileBlockFn = std::function<void(const unsigned char*,const size_type,const size_type)>;
+
+/// \brief Reads a region of a file in large blocks and passes each block to a
+///        callback as soon as it is available.
+///
+/// Blocks are read with positional reads from several threads, so that the
+/// processing of one block (e.g. byte swapping and type conversion) overlaps
+/// with reading of the other blocks. The block size is rounded down to a
+/// multiple of elem_num_bytes so that an element never straddles two blocks.
+/// When positional reads are not available, the blocks are read sequentially.
+/// A FileSystemException is thrown when the region cannot be read entirely.
+void ReadRawFileBlocks(const std::string& path,
+                       const size_type byte_off,
+                       const size_type num_bytes,
+                       const RawFileBlockFn& block_fn,
+                       const size_type elem_num_bytes = 1,
+                       const size_type block_num_bytes = 8 * 1024 * 1024);
+
+/// \brief The number of bytes in a file.
+size_type RawFileNumBytes(const std::string& path);
+
+/// \brief Reads elements of type SrcT stored in a file and writes them, after
+///        any needed byte swapping and conversion, into a buffer of DstT.
+///
+/// The swap and conversion of each block is fused and performed by the thread
+/// that read the block, directly into the destination buffer; no intermediate
+/// buffer of the entire file is allocated.
+template <class SrcT, class DstT>
+void ReadRawFileAsType(const std::string& path,
+                       DstT* dst,
+                       const size_type num_elems,
+                       const ByteOrder file_byte_order = kNATIVE_ENDIAN,
+                       const size_type byte_off = 0)
+{
+  static_assert(std::is_fundamental<SrcT>::value, "Raw files must store fundamental types!");
+
+  const bool need_swap = (sizeof(SrcT) > 1) &&
+              (GetBigOrLittleByteOrder(file_byte_order) != GetNativeByteOrder());
+
+  auto block_fn = [dst,need_swap] (const unsigned char* block_bytes,
+                                   const size_type block_off,
+                                   const size_type block_num_bytes)
+  {
+    const size_type num_block_elems = block_num_bytes / sizeof(SrcT);
+
+    DstT* block_dst = dst + (block_off / sizeof(SrcT));
+
+    if (!need_swap && std::is_same<SrcT,DstT>::value)
+    {
+      std::memcpy(block_dst, block_bytes, block_num_bytes);
+    }
+    else
+    {
+      for (size_type i = 0; i < num_block_elems; ++i)
+      {
+        SrcT x;
+        std::memcpy(&x, block_bytes + (i * sizeof(SrcT)), sizeof(SrcT));
+
+        if (need_swap)
+        {
+          SwapByteOrder(&x);
+        }
+
+        block_dst[i] = static_cast<DstT>(x);
+      }
+    }
+  };
+
+  ReadRawFileBlocks(path, byte_off, num_elems * sizeof(SrcT), block_fn, sizeof(SrcT));
+}
+
+}  // xreg
+
+#endif
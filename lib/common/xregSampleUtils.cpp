@@ -27,6 +27,7 @@
 #include <vector>
 #include <random>
 #include <algorithm>
+#include <cmath>
 
 #include "xregAssert.h"
 
@@ -113,6 +114,29 @@ xreg::SampleCombos(const size_type num_elem, const size_type combo_len,
   return combos;
 }
 
+std::vector<xreg::size_type>
+xreg::SampleSortedSubset(const size_type num_elem, const size_type num_to_sample, std::mt19937& rng)
+{
+  xregASSERT(num_to_sample <= num_elem);
+
+  std::vector<size_type> inds;
+  inds.reserve(num_to_sample);
+
+  // Selection sampling (Knuth's Algorithm S): a single pass that keeps each
+  // element with probability (number left to choose) / (number left to visit)
+  std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+  for (size_type i = 0; (i < num_elem) && (inds.size() < num_to_sample); ++i)
+  {
+    if (((num_elem - i) * dist(rng)) < (num_to_sample - inds.size()))
+    {
+      inds.push_back(i);
+    }
+  }
+
+  return inds;
+}
+
 std::vector<std::vector<xreg::size_type>>
 xreg::BruteForce3Combos(const size_type num_elem)
 {
@@ -180,3 +204,148 @@ xreg::BruteForce4Combos(const size_type num_elem)
   return combos;
 }
  
+
+xreg::PhiloxCtr xreg::Philox4x32(PhiloxCtr ctr, PhiloxKey key)
+{
+  constexpr std::uint64_t kMULT_0 = 0xD2511F53;
+  constexpr std::uint64_t kMULT_1 = 0xCD9E8D57;
+
+  constexpr std::uint32_t kWEYL_0 = 0x9E3779B9;
+  constexpr std::uint32_t kWEYL_1 = 0xBB67AE85;
+
+  for (int round_idx = 0; round_idx < 10; ++round_idx)
+  {
+    if (round_idx)
+    {
+      key[0] += kWEYL_0;
+      key[1] += kWEYL_1;
+    }
+
+    const std::uint64_t prod_0 = kMULT_0 * ctr[0];
+    const std::uint64_t prod_1 = kMULT_1 * ctr[2];
+
+    ctr = { static_cast<std::uint32_t>(prod_1 >> 32) ^ ctr[1] ^ key[0],
+            static_cast<std::uint32_t>(prod_1),
+            static_cast<std::uint32_t>(prod_0 >> 32) ^ ctr[3] ^ key[1],
+            static_cast<std::uint32_t>(prod_0) };
+  }
+
+  return ctr;
+}
+
+std::uint64_t xreg::SamplePoissonPhilox(const double lambda, const PhiloxCtr& ctr,
+                                        const PhiloxKey& key)
+{
+  if (lambda <= 0)
+  {
+    return 0;
+  }
+
+  PhiloxCtr cur_ctr = ctr;
+  cur_ctr[3] = 0;
+
+  if (lambda < 10)
+  {
+    // inversion by sequential search
+    double u = PhiloxToUniformOpen(Philox4x32(cur_ctr, key)[0]);
+
+    std::uint64_t k = 0;
+    double p = std::exp(-lambda);
+
+    while ((u > p) && (k < 1000))
+    {
+      u -= p;
+      ++k;
+      p *= lambda / k;
+    }
+
+    return k;
+  }
+
+  // PTRS
+  const double slam    = std::sqrt(lambda);
+  const double log_lam = std::log(lambda);
+
+  const double b = 0.931 + (2.53 * slam);
+  const double a = -0.059 + (0.02483 * b);
+
+  const double inv_alpha = 1.1239 + (1.1328 / (b - 3.4));
+  const double v_r       = 0.9277 - (3.6224 / (b - 2));
+
+  while (true)
+  {
+    const PhiloxCtr r = Philox4x32(cur_ctr, key);
+    ++cur_ctr[3];
+
+    // two candidates per call
+    for (int i = 0; i < 4; i += 2)
+    {
+      const double U  = PhiloxToUniformOpen(r[i]) - 0.5;
+      const double V  = PhiloxToUniformOpen(r[i + 1]);
+      const double us = 0.5 - std::abs(U);
+
+      const double k = std::floor((((2 * a) / us) + b) * U + lambda + 0.43);
+
+      if ((us >= 0.07) && (V <= v_r))
+      {
+        return static_cast<std::uint64_t>(k);
+      }
+
+      if ((k < 0) || ((us < 0.013) && (V > us)))
+      {
+        continue;
+      }
+
+      if ((std::log(V) + std::log(inv_alpha) - std::log((a / (us * us)) + b)) <=
+              (-lambda + (k * log_lam) - std::lgamma(k + 1)))
+      {
+        return static_cast<std::uint64_t>(k);
+      }
+    }
+  }
+}
+
+xreg::PhiloxKey xreg::MakePhiloxKey(const std::uint64_t seed)
+{
+  return { static_cast<std::uint32_t>(seed), static_cast<std::uint32_t>(seed >> 32) };
+}
+
+std::vector<xreg::size_type>
+xreg::SampleComboPhilox(const size_type num_elem, const size_type combo_len,
+                        const std::uint64_t stream_idx, const PhiloxKey& key)
+{
+  xregASSERT(combo_len <= num_elem);
+  xregASSERT(num_elem <= (size_type(1) << 32));
+
+  std::vector<size_type> combo;
+  combo.reserve(combo_len);
+
+  // the third counter word indexes the blocks of four values in a stream
+  PhiloxCtr ctr = { static_cast<std::uint32_t>(stream_idx),
+                    static_cast<std::uint32_t>(stream_idx >> 32), 0, 0 };
+
+  PhiloxCtr r = { 0, 0, 0, 0 };
+  size_type r_idx = 4;
+
+  while (combo.size() < combo_len)
+  {
+    if (r_idx == 4)
+    {
+      r = Philox4x32(ctr, key);
+      ++ctr[2];
+      r_idx = 0;
+    }
+
+    // maps the 32-bit value to [0, num_elem) with a multiply and shift
+    const size_type i = static_cast<size_type>(
+              (static_cast<std::uint64_t>(r[r_idx]) * static_cast<std::uint64_t>(num_elem)) >> 32);
+    ++r_idx;
+
+    if (std::find(combo.begin(), combo.end(), i) == combo.end())
+    {
+      combo.push_back(i);
+    }
+  }
+
+  return combo;
+}
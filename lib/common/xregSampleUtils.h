@@ -25,6 +25,8 @@
 #ifndef XREGSAMPLEUTILS_H_
 #define XREGSAMPLEUTILS_H_
 
+#include <array>
+#include <cstdint>
 #include <random>
 
 #include "xregCommon.h"
@@ -44,6 +46,12 @@ std::vector<std::vector<size_type>>
 SampleCombos(const size_type num_elem, const size_type combo_len,
              const size_type num_combos, std::mt19937& rng);
 
+// Sample a subset of indices in [0, num_elem) without replacement. The
+// indices are returned in ascending order and every subset of size
+// num_to_sample has equal probability of being chosen.
+std::vector<size_type>
+SampleSortedSubset(const size_type num_elem, const size_type num_to_sample, std::mt19937& rng);
+
 // Return an exhaustive list of combinations of 3 elements from a collection of
 // a specified list. Each combination is represented by a list of 3 indices.
 std::vector<std::vector<size_type>>
@@ -54,6 +62,48 @@ BruteForce3Combos(const size_type num_elem);
 std::vector<std::vector<size_type>>
 BruteForce4Combos(const size_type num_elem);
 
+// Counter-based random number generation using Philox4x32-10 from:
+// Parallel Random Numbers: As Easy as 1, 2, 3
+// Salmon, et al.
+// Each (counter, key) pair maps to four independent 32-bit random values, so
+// streams for individual pixels/elements may be generated independently of
+// one another (and of the number of threads used), with the seed as the key.
+using PhiloxCtr = std::array<std::uint32_t,4>;
+using PhiloxKey = std::array<std::uint32_t,2>;
+
+PhiloxCtr Philox4x32(PhiloxCtr ctr, PhiloxKey key);
+
+// Converts a 32-bit random value into a uniform sample on the open interval
+// (0,1). Only the upper 24 bits are used, so that the same values are exactly
+// representable in single precision (e.g. by an OpenCL implementation).
+inline double PhiloxToUniformOpen(const std::uint32_t x)
+{
+  return ((x >> 8) + 0.5) * (1.0 / 16777216.0);
+}
+
+// Draws a sample from a Poisson distribution with mean lambda using the
+// Philox stream identified by the (first three words of the) counter and the
+// key. The fourth counter word is used internally as an iteration index and
+// should be zero.
+// Inversion is used for small means and the transformed rejection method with
+// squeeze (PTRS) is used for larger means, see:
+// The transformed rejection method for generating Poisson random variables
+// Hormann
+std::uint64_t SamplePoissonPhilox(const double lambda, const PhiloxCtr& ctr,
+                                  const PhiloxKey& key);
+
+// Splits a 64-bit seed into a Philox key
+PhiloxKey MakePhiloxKey(const std::uint64_t seed);
+
+// Sample a combination of distinct indices in [0, num_elem) using the Philox
+// stream identified by stream_idx and the key. Each stream is independent of
+// the others, so that many combinations may be sampled concurrently (e.g. one
+// per RANSAC hypothesis) with results that do not depend on the number of
+// threads used.
+std::vector<size_type>
+SampleComboPhilox(const size_type num_elem, const size_type combo_len,
+                  const std::uint64_t stream_idx, const PhiloxKey& key);
+
 }  // xreg
 
 #endif
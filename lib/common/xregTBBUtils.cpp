@@ -0,0 +1,111 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregTBBUtils.h"
+
+#include "xregExceptionUtils.h"
+
+xreg::ParallelExecContext::ParallelExecContext(const int max_concurrency,
+                                               const std::size_t grain_size,
+                                               const Partitioner partitioner,
+                                               const int numa_node)
+  : max_concurrency_(max_concurrency), grain_size_(grain_size),
+    partitioner_(partitioner), numa_node_(numa_node)
+{
+  if (max_concurrency_ < 0)
+  {
+    xregThrow("invalid maximum concurrency: %d", max_concurrency_);
+  }
+
+  if (!grain_size_)
+  {
+    xregThrow("grain size must be positive!");
+  }
+
+#ifndef XREG_NO_TBB
+  const int arena_concurrency = max_concurrency_ ? max_concurrency_
+                                                 : int(tbb::task_arena::automatic);
+
+  if (numa_node_ < 0)
+  {
+    arena_.reset(new tbb::task_arena(arena_concurrency));
+  }
+  else
+  {
+#if TBB_INTERFACE_VERSION >= 12000
+    arena_.reset(new tbb::task_arena(
+                   tbb::task_arena::constraints(numa_node_, arena_concurrency)));
+#else
+    xregThrow("a NUMA node may not be specified with this version of TBB!");
+#endif
+  }
+#endif
+}
+
+int xreg::CurParallelMaxConcurrency()
+{
+#ifndef XREG_NO_TBB
+  const ParallelExecContext* ctx = CurParallelExecContext();
+
+  return (ctx && ctx->max_concurrency()) ? ctx->max_concurrency()
+                                         : tbb::this_task_arena::max_concurrency();
+#else
+  return 1;
+#endif
+}
+
+int xreg::ParallelExecContext::max_concurrency() const
+{
+  return max_concurrency_;
+}
+
+std::size_t xreg::ParallelExecContext::grain_size() const
+{
+  return grain_size_;
+}
+
+xreg::ParallelExecContext::Partitioner
+xreg::ParallelExecContext::partitioner() const
+{
+  return partitioner_;
+}
+
+int xreg::ParallelExecContext::numa_node() const
+{
+  return numa_node_;
+}
+
+xreg::ParallelExecContext*& xreg::ThreadParallelExecContext()
+{
+  thread_local ParallelExecContext* ctx = nullptr;
+
+  return ctx;
+}
+
+xreg::ParallelExecContextPtr& xreg::DefaultParallelExecContext()
+{
+  static ParallelExecContextPtr ctx;
+
+  return ctx;
+}
@@ -31,8 +31,10 @@
 #ifndef XREGTBBUTILS_H_
 #define XREGTBBUTILS_H_
 
+#include <algorithm>
 #include <cstddef>  // size_t
 #include <iterator>
+#include <memory>
 
 // define this to switch from the parallel TBB calls
 // to serial standard library calls
@@ -43,6 +45,7 @@
 #endif
 
 #include "xregAssert.h"
+#include "xregTrace.h"
 
 // Wrap an argument name with this when it is only used when TBB has been found
 // This avoids the unused argument compiler warning
@@ -83,6 +86,40 @@ struct RangeType
 };
 #endif
 
+#ifndef XREG_NO_TBB
+using Range2DType = tbb::blocked_range2d<size_t>;
+#else
+
+/**
+ * @brief Range type representing a 2D block of elements, e.g. a tile of image
+ *        rows and columns.
+ *
+ * This should have a similar interface to the blocked_range2d type in TBB.
+ * The grain sizes are ignored, since no splitting is performed.
+ **/
+struct Range2DType
+{
+  using size_type = std::size_t;
+
+  RangeType rows_;
+  RangeType cols_;
+
+  Range2DType(const size_type row_b, const size_type row_e,
+              const size_type col_b, const size_type col_e)
+    : rows_(row_b, row_e), cols_(col_b, col_e)
+  { }
+
+  Range2DType(const size_type row_b, const size_type row_e, const size_type,
+              const size_type col_b, const size_type col_e, const size_type)
+    : rows_(row_b, row_e), cols_(col_b, col_e)
+  { }
+
+  const RangeType& rows() const { return rows_; }
+
+  const RangeType& cols() const { return cols_; }
+};
+#endif
+
 #ifndef XREG_NO_TBB
 #define xregSplitMarker tbb::split
 #else
@@ -90,12 +127,490 @@ struct SplitMarkerType { };
 #define xregSplitMarker xreg::SplitMarkerType
 #endif
 
+/**
+ * @brief An execution context for the parallel calls in this file.
+ *
+ * A context carries a TBB task arena with a configurable concurrency, an
+ * optional NUMA node to constrain its threads to, and the grain size and
+ * partitioner used to split ranges. This allows several jobs in a single
+ * process (e.g. concurrent registrations) to each use a disjoint set of
+ * threads, rather than oversubscribing the global scheduler.
+ *
+ * A context is not passed to the parallel calls directly. Instead, a
+ * ParallelExecContextScope is used to make a context current on a thread, and
+ * every parallel call made on that thread, including nested calls made by
+ * the worker threads of the arena, is executed within the context. When no
+ * scope is active the process-wide default context is used, and when that is
+ * also null the global scheduler is used with its default partitioning.
+ **/
+class ParallelExecContext
+{
+public:
+  enum Partitioner
+  {
+    kAUTO_PARTITIONER = 0,
+    kSIMPLE_PARTITIONER,
+    kSTATIC_PARTITIONER
+  };
+
+  /// \brief Constructor
+  ///
+  /// max_concurrency of 0 uses the TBB default, grain_size must be positive and
+  /// a negative numa_node does not constrain the threads. The NUMA node is
+  /// only supported by TBB versions providing task arena constraints, an
+  /// exception is thrown otherwise.
+  explicit ParallelExecContext(const int max_concurrency = 0,
+                               const std::size_t grain_size = 1,
+                               const Partitioner partitioner = kAUTO_PARTITIONER,
+                               const int numa_node = -1);
+
+  int max_concurrency() const;
+
+  std::size_t grain_size() const;
+
+  Partitioner partitioner() const;
+
+  int numa_node() const;
+
+  /// \brief Calls a function within the task arena of this context and with
+  ///        this context current on the calling thread.
+  template <class _fn>
+  void execute(const _fn& fn);
+
+  template <class _fn>
+  void parallel_for(const _fn& fn_obj, const RangeType& r);
+
+  template <class _fn>
+  void parallel_for(const _fn& fn_obj, const Range2DType& r);
+  
+  template <class _value, class _fn, class _red>
+  _value parallel_reduce(const _value& id_val, const _fn& fn_obj, const _red& red_obj,
+                         const RangeType& r);
+
+  template <class _fn>
+  void parallel_reduce(_fn& fn_obj, const RangeType& r);
+
+private:
+  // Calls a TBB algorithm object within the arena with the partitioner of
+  // this context
+  template <class _alg>
+  void execute_with_partitioner(const _alg& alg);
+
+  int max_concurrency_;
+
+  std::size_t grain_size_;
+
+  Partitioner partitioner_;
+
+  int numa_node_;
+
+#ifndef XREG_NO_TBB
+  std::unique_ptr<tbb::task_arena> arena_;
+#endif
+};
+
+using ParallelExecContextPtr = std::shared_ptr<ParallelExecContext>;
+
+/// \brief The context made current on the calling thread by a scope, or
+///        null when no scope is active.
+ParallelExecContext*& ThreadParallelExecContext();
+
+/// \brief The process-wide context used when no scope is active on the
+///        calling thread; null by default.
+///
+/// This is intended to be set once, e.g. by ProgOpts from the command line,
+/// prior to any parallel work.
+ParallelExecContextPtr& DefaultParallelExecContext();
+
+/// \brief The context used by parallel calls made on the calling thread, or
+///        null to use the global scheduler.
+inline ParallelExecContext* CurParallelExecContext()
+{
+  ParallelExecContext* ctx = ThreadParallelExecContext();
+
+  return ctx ? ctx : DefaultParallelExecContext().get();
+}
+
+/// \brief The maximum number of threads used by parallel calls made on the
+///        calling thread.
+///
+/// This is the concurrency of the current context when it is limited, and of
+/// the task arena of the calling thread otherwise; it is one without TBB.
+/// Unlike std::thread::hardware_concurrency(), this accounts for arenas
+/// limited by the caller (e.g. with the --tbb-arena-threads option).
+int CurParallelMaxConcurrency();
+
+/// \brief Makes a context current on the calling thread for the lifetime of
+///        this object.
+///
+/// A null context leaves the current context unchanged, so objects without a
+/// context of their own use the context of their caller. Scopes may be nested
+/// and must be destroyed on the thread which created them.
+class ParallelExecContextScope
+{
+public:
+  explicit ParallelExecContextScope(ParallelExecContext* ctx)
+    : prev_ctx_(ThreadParallelExecContext())
+  {
+    if (ctx)
+    {
+      ThreadParallelExecContext() = ctx;
+    }
+  }
+
+  ~ParallelExecContextScope()
+  {
+    ThreadParallelExecContext() = prev_ctx_;
+  }
+
+  ParallelExecContextScope(const ParallelExecContextScope&) = delete;
+  ParallelExecContextScope& operator=(const ParallelExecContextScope&) = delete;
+
+private:
+  ParallelExecContext* prev_ctx_;
+};
+
+namespace detail
+{
+
+// Wraps the body of an imperative parallel reduction, so that each sub-range
+// processed is recorded as a trace event. The split bodies are owned by the
+// wrapper, the original body is updated by the joins as usual.
+template <class _fn>
+struct TracedReduceBody
+{
+  std::unique_ptr<_fn> owned_body;
+
+  _fn* body;
+
+  explicit TracedReduceBody(_fn* b)
+    : body(b)
+  { }
+
+  TracedReduceBody(TracedReduceBody& other, xregSplitMarker)
+    : owned_body(new _fn(*other.body, xregSplitMarker())), body(owned_body.get())
+  { }
+
+  void operator()(const RangeType& r)
+  {
+    TraceScope s("ParallelReduce", "tbb", "begin", r.begin(), "end", r.end());
+    (*body)(r);
+  }
+
+  void join(TracedReduceBody& rhs)
+  {
+    body->join(*rhs.body);
+  }
+};
+
+// Wraps the body of an imperative parallel reduction executed within a
+// context, so that the context is current while processing each sub-range.
+template <class _fn>
+struct ExecContextReduceBody
+{
+  std::unique_ptr<_fn> owned_body;
+
+  _fn* body;
+
+  ParallelExecContext* ctx;
+
+  ExecContextReduceBody(_fn* b, ParallelExecContext* c)
+    : body(b), ctx(c)
+  { }
+
+  ExecContextReduceBody(ExecContextReduceBody& other, xregSplitMarker)
+    : owned_body(new _fn(*other.body, xregSplitMarker())), body(owned_body.get()),
+      ctx(other.ctx)
+  { }
+
+  void operator()(const RangeType& r)
+  {
+    ParallelExecContextScope ctx_scope(ctx);
+    TraceScope s("ParallelReduce", "tbb", "begin", r.begin(), "end", r.end());
+    (*body)(r);
+  }
+
+  void join(ExecContextReduceBody& rhs)
+  {
+    body->join(*rhs.body);
+  }
+};
+
+#ifndef XREG_NO_TBB
+
+// Each algorithm object calls a TBB algorithm with a partitioner provided
+// by ParallelExecContext, which is only known at runtime.
+
+template <class _range, class _body>
+struct ParallelForAlg
+{
+  const _range& r;
+  const _body& body;
+
+  template <class _part>
+  void operator()(const _part& p) const
+  {
+    tbb::parallel_for(r, body, p);
+  }
+};
+
+template <class _value, class _body, class _red>
+struct ParallelReduceFnAlg
+{
+  const RangeType& r;
+  const _value& id_val;
+  const _body& body;
+  const _red& red_obj;
+  _value* result;
+
+  template <class _part>
+  void operator()(const _part& p) const
+  {
+    *result = tbb::parallel_reduce(r, id_val, body, red_obj, p);
+  }
+};
+
+template <class _body>
+struct ParallelReduceBodyAlg
+{
+  const RangeType& r;
+  _body* body;
+
+  template <class _part>
+  void operator()(const _part& p) const
+  {
+    tbb::parallel_reduce(r, *body, p);
+  }
+};
+
+template <class _alg>
+struct ExecuteWithPartitionerFn
+{
+  const _alg& alg;
+  ParallelExecContext::Partitioner part;
+
+  void operator()() const
+  {
+    switch (part)
+    {
+    case ParallelExecContext::kSIMPLE_PARTITIONER:
+      alg(tbb::simple_partitioner());
+      break;
+    case ParallelExecContext::kSTATIC_PARTITIONER:
+      alg(tbb::static_partitioner());
+      break;
+    case ParallelExecContext::kAUTO_PARTITIONER:
+    default:
+      alg(tbb::auto_partitioner());
+      break;
+    }
+  }
+};
+
+#endif
+
+// Makes a context current while calling a function object on a sub-range
+template <class _fn>
+struct ExecContextRangeFn
+{
+  _fn fn_obj;
+
+  ParallelExecContext* ctx;
+
+  void operator()(const RangeType& r) const
+  {
+    ParallelExecContextScope ctx_scope(ctx);
+    TraceScope s("ParallelFor", "tbb", "begin", r.begin(), "end", r.end());
+    fn_obj(r);
+  }
+
+  void operator()(const Range2DType& r) const
+  {
+    ParallelExecContextScope ctx_scope(ctx);
+    TraceScope s("ParallelFor2D", "tbb", "row-begin", r.rows().begin(),
+                 "row-end", r.rows().end());
+    fn_obj(r);
+  }
+};
+
+template <class _value, class _fn>
+struct ExecContextReduceFn
+{
+  _fn fn_obj;
+
+  ParallelExecContext* ctx;
+
+  _value operator()(const RangeType& r, const _value& v) const
+  {
+    ParallelExecContextScope ctx_scope(ctx);
+    TraceScope s("ParallelReduce", "tbb", "begin", r.begin(), "end", r.end());
+    return fn_obj(r, v);
+  }
+};
+
+template <class _fn>
+struct ExecContextInvokeFn
+{
+  const _fn& fn;
+
+  ParallelExecContext* ctx;
+
+  void operator()() const
+  {
+    ParallelExecContextScope ctx_scope(ctx);
+    fn();
+  }
+};
+
+}  // detail
+
+template <class _fn>
+void ParallelExecContext::execute(const _fn& fn)
+{
+  ParallelExecContextScope ctx_scope(this);
+
+#ifndef XREG_NO_TBB
+  arena_->execute(fn);
+#else
+  fn();
+#endif
+}
+
+template <class _alg>
+void ParallelExecContext::execute_with_partitioner(const _alg& alg)
+{
+#ifndef XREG_NO_TBB
+  const detail::ExecuteWithPartitionerFn<_alg> fn = { alg, partitioner_ };
+  execute(fn);
+#else
+  (void) alg;
+#endif
+}
+
+template <class _fn>
+void ParallelExecContext::parallel_for(const _fn& fn_obj, const RangeType& r)
+{
+  const detail::ExecContextRangeFn<_fn> body = { fn_obj, this };
+
+#ifndef XREG_NO_TBB
+  const RangeType grained_r(r.begin(), r.end(), grain_size_);
+
+  const detail::ParallelForAlg<RangeType,detail::ExecContextRangeFn<_fn>> alg = { grained_r, body };
+  execute_with_partitioner(alg);
+#else
+  body(r);
+#endif
+}
+
+template <class _fn>
+void ParallelExecContext::parallel_for(const _fn& fn_obj, const Range2DType& r)
+{
+  const detail::ExecContextRangeFn<_fn> body = { fn_obj, this };
+
+#ifndef XREG_NO_TBB
+  // the grain sizes of a 2D range are specified by the caller
+  const detail::ParallelForAlg<Range2DType,detail::ExecContextRangeFn<_fn>> alg = { r, body };
+  execute_with_partitioner(alg);
+#else
+  body(r);
+#endif
+}
+
+template <class _value, class _fn, class _red>
+_value ParallelExecContext::parallel_reduce(const _value& id_val, const _fn& fn_obj,
+                                            const _red& XREG_TBB_ARG(red_obj),
+                                            const RangeType& r)
+{
+  const detail::ExecContextReduceFn<_value,_fn> body = { fn_obj, this };
+
+#ifndef XREG_NO_TBB
+  const RangeType grained_r(r.begin(), r.end(), grain_size_);
+
+  _value result = id_val;
+
+  const detail::ParallelReduceFnAlg<_value,detail::ExecContextReduceFn<_value,_fn>,_red> alg =
+                                              { grained_r, id_val, body, red_obj, &result };
+  execute_with_partitioner(alg);
+
+  return result;
+#else
+  return body(r, id_val);
+#endif
+}
+
+template <class _fn>
+void ParallelExecContext::parallel_reduce(_fn& fn_obj, const RangeType& r)
+{
+  detail::ExecContextReduceBody<_fn> body(&fn_obj, this);
+
+#ifndef XREG_NO_TBB
+  const RangeType grained_r(r.begin(), r.end(), grain_size_);
+
+  const detail::ParallelReduceBodyAlg<detail::ExecContextReduceBody<_fn>> alg = { grained_r, &body };
+  execute_with_partitioner(alg);
+#else
+  body(r);
+#endif
+}
+
+/// \brief Calls fn_obj, possibly concurrently, over sub-ranges of r.
+///
+/// When tracing is enabled, each sub-range processed is recorded as a trace
+/// event on the thread which processed it. When a context is current (see
+/// CurParallelExecContext()), the call is executed within it.
 template <class _fn>
 void ParallelFor(_fn& fn_obj, const RangeType& r)
 {
 #ifndef XREG_NO_TBB
-  tbb::parallel_for(r, fn_obj);
+  ParallelExecContext* ctx = CurParallelExecContext();
+
+  if (ctx)
+  {
+    ctx->parallel_for(fn_obj, r);
+  }
+  else if (TracingEnabled())
+  {
+    tbb::parallel_for(r, [fn_obj] (const RangeType& sub_r)
+                         {
+                           TraceScope s("ParallelFor", "tbb", "begin", sub_r.begin(), "end", sub_r.end());
+                           fn_obj(sub_r);
+                         });
+  }
+  else
+  {
+    tbb::parallel_for(r, fn_obj);
+  }
 #else
+  TraceScope s("ParallelFor", "tbb", "begin", r.begin(), "end", r.end());
+  fn_obj(r);
+#endif
+}
+
+template <class _fn>
+void ParallelFor(_fn& fn_obj, const Range2DType& r)
+{
+#ifndef XREG_NO_TBB
+  ParallelExecContext* ctx = CurParallelExecContext();
+
+  if (ctx)
+  {
+    ctx->parallel_for(fn_obj, r);
+  }
+  else if (TracingEnabled())
+  {
+    tbb::parallel_for(r, [fn_obj] (const Range2DType& sub_r)
+                         {
+                           TraceScope s("ParallelFor2D", "tbb", "row-begin", sub_r.rows().begin(),
+                                        "row-end", sub_r.rows().end());
+                           fn_obj(sub_r);
+                         });
+  }
+  else
+  {
+    tbb::parallel_for(r, fn_obj);
+  }
+#else
+  TraceScope s("ParallelFor2D", "tbb", "row-begin", r.rows().begin(), "row-end", r.rows().end());
   fn_obj(r);
 #endif
 }
@@ -104,8 +619,29 @@ template <class _value, class _fn, class _red>
 _value ParallelReduce(const _value& id_val, _fn& fn_obj, _red XREG_TBB_ARG(red_obj), const RangeType& r)
 {
 #ifndef XREG_NO_TBB
-  return tbb::parallel_reduce(r, id_val, fn_obj, red_obj);
+  ParallelExecContext* ctx = CurParallelExecContext();
+
+  if (ctx)
+  {
+    return ctx->parallel_reduce(id_val, fn_obj, red_obj, r);
+  }
+  else if (TracingEnabled())
+  {
+    return tbb::parallel_reduce(r, id_val,
+                                [fn_obj] (const RangeType& sub_r, const _value& v) -> _value
+                                {
+                                  TraceScope s("ParallelReduce", "tbb", "begin", sub_r.begin(),
+                                               "end", sub_r.end());
+                                  return fn_obj(sub_r, v);
+                                },
+                                red_obj);
+  }
+  else
+  {
+    return tbb::parallel_reduce(r, id_val, fn_obj, red_obj);
+  }
 #else
+  TraceScope s("ParallelReduce", "tbb", "begin", r.begin(), "end", r.end());
   return fn_obj(r, id_val);
 #endif
 }
@@ -114,12 +650,56 @@ template <class _fn>
 void ParallelReduce(_fn& fn_obj, const RangeType& r)
 {
 #ifndef XREG_NO_TBB
-  tbb::parallel_reduce(r, fn_obj);
+  ParallelExecContext* ctx = CurParallelExecContext();
+
+  if (ctx)
+  {
+    ctx->parallel_reduce(fn_obj, r);
+  }
+  else if (TracingEnabled())
+  {
+    detail::TracedReduceBody<_fn> traced_body(&fn_obj);
+    tbb::parallel_reduce(r, traced_body);
+  }
+  else
+  {
+    tbb::parallel_reduce(r, fn_obj);
+  }
 #else
+  TraceScope s("ParallelReduce", "tbb", "begin", r.begin(), "end", r.end());
   fn_obj(r);
 #endif
 }
 
+/// \brief Calls two function objects, possibly concurrently.
+///
+/// This is intended for recursive, divide-and-conquer, algorithms.
+template <class _fn1, class _fn2>
+void ParallelInvoke(const _fn1& fn1, const _fn2& fn2)
+{
+#ifndef XREG_NO_TBB
+  ParallelExecContext* ctx = CurParallelExecContext();
+
+  if (ctx)
+  {
+    const detail::ExecContextInvokeFn<_fn1> ctx_fn1 = { fn1, ctx };
+    const detail::ExecContextInvokeFn<_fn2> ctx_fn2 = { fn2, ctx };
+
+    ctx->execute([&ctx_fn1,&ctx_fn2] ()
+                 {
+                   tbb::parallel_invoke(ctx_fn1, ctx_fn2);
+                 });
+  }
+  else
+  {
+    tbb::parallel_invoke(fn1, fn2);
+  }
+#else
+  fn1();
+  fn2();
+#endif
+}
+
 namespace detail
 {
 
@@ -179,6 +759,29 @@ OutputIt ParallelTransform(InputIt begin_in, InputIt end_in, OutputIt begin_out,
 #endif
 }
 
+/// \brief Sorts a random access range, possibly concurrently.
+template <class RandomIt, class Compare>
+void ParallelSort(RandomIt begin_it, RandomIt end_it, const Compare& comp)
+{
+#ifndef XREG_NO_TBB
+  ParallelExecContext* ctx = CurParallelExecContext();
+
+  if (ctx)
+  {
+    ctx->execute([&begin_it,&end_it,&comp] ()
+                 {
+                   tbb::parallel_sort(begin_it, end_it, comp);
+                 });
+  }
+  else
+  {
+    tbb::parallel_sort(begin_it, end_it, comp);
+  }
+#else
+  std::sort(begin_it, end_it, comp);
+#endif
+}
+
 }  // xreg
 
 #endif
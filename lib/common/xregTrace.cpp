@@ -0,0 +1,351 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregTrace.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "xregExceptionUtils.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+using size_type = std::size_t;
+
+using TraceClock = std::chrono::steady_clock;
+
+struct ThreadTraceEvent
+{
+  const char* name;
+  const char* cat;
+
+  double start_us;
+  double dur_us;
+
+  const char* arg0_name;
+  long long   arg0;
+  
+  const char* arg1_name;
+  long long   arg1;
+};
+
+struct TrackTraceEvent
+{
+  size_type track_idx;
+
+  std::string name;
+  std::string cat;
+
+  double start_us;
+  double dur_us;
+};
+
+using ThreadTraceEvents    = std::vector<ThreadTraceEvent>;
+using ThreadTraceEventsPtr = std::shared_ptr<ThreadTraceEvents>;
+
+// The events of every thread which has recorded an event, along with the
+// events of named tracks. The thread buffers are retained after a thread
+// exits so that its events are still written.
+struct TraceRegistry
+{
+  std::mutex m;
+
+  TraceClock::time_point epoch = TraceClock::now();
+
+  std::vector<ThreadTraceEventsPtr> threads;
+
+  std::vector<std::string> track_names;
+
+  std::vector<TrackTraceEvent> track_events;
+
+  std::string path_to_write_at_exit;
+};
+
+TraceRegistry& GetTraceRegistry()
+{
+  static TraceRegistry reg;
+  return reg;
+}
+
+ThreadTraceEventsPtr MakeAndRegisterThreadTraceEvents()
+{
+  auto events = std::make_shared<ThreadTraceEvents>();
+
+  auto& reg = GetTraceRegistry();
+
+  std::lock_guard<std::mutex> lock(reg.m);
+  reg.threads.push_back(events);
+
+  return events;
+}
+
+ThreadTraceEvents& GetThreadTraceEvents()
+{
+  thread_local ThreadTraceEventsPtr events = MakeAndRegisterThreadTraceEvents();
+  return *events;
+}
+
+void WriteTraceAtExit()
+{
+  try
+  {
+    WriteChromeTraceToDisk(GetTraceRegistry().path_to_write_at_exit);
+  }
+  catch (...)
+  {
+    // nothing may be done at this point
+  }
+}
+
+bool TracingEnabledFromEnv()
+{
+  const char* env_val = std::getenv("XREG_TRACE");
+
+  const bool enabled = env_val && *env_val;
+
+  if (enabled)
+  {
+    // the registry must be constructed before registering the exit handler,
+    // so that it is destroyed after the handler runs
+    GetTraceRegistry().path_to_write_at_exit = env_val;
+
+    std::atexit(WriteTraceAtExit);
+  }
+
+  return enabled;
+}
+
+std::string EscapeJSONString(const std::string& s)
+{
+  std::string escaped;
+  escaped.reserve(s.size());
+
+  for (const char c : s)
+  {
+    switch (c)
+    {
+    case '"':
+      escaped += "\\\"";
+      break;
+    case '\\':
+      escaped += "\\\\";
+      break;
+    case '\n':
+      escaped += "\\n";
+      break;
+    case '\t':
+      escaped += "\\t";
+      break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20)
+      {
+        escaped += fmt::format("\\u{:04x}", static_cast<int>(c));
+      }
+      else
+      {
+        escaped += c;
+      }
+    }
+  }
+
+  return escaped;
+}
+
+// Thread events are written with pid 1 and track events with pid 2, so that
+// CPU threads and device queues are grouped separately.
+constexpr int kTHREADS_PID = 1;
+constexpr int kTRACKS_PID  = 2;
+
+void WriteChromeTraceEvent(std::ostream& out, bool* first_event, const std::string& json_obj)
+{
+  if (!*first_event)
+  {
+    out << ",\n";
+  }
+
+  out << json_obj;
+
+  *first_event = false;
+}
+
+}  // un-named
+
+std::atomic<bool> xreg::detail::tracing_enabled(TracingEnabledFromEnv());
+
+void xreg::SetTracingEnabled(const bool enabled)
+{
+  detail::tracing_enabled.store(enabled);
+}
+
+double xreg::TraceTimestampMicros()
+{
+  return std::chrono::duration<double,std::micro>(TraceClock::now() -
+                                                  GetTraceRegistry().epoch).count();
+}
+
+void xreg::RecordTraceEvent(const char* name, const char* cat,
+                            const double start_us, const double dur_us,
+                            const char* arg0_name, const long long arg0,
+                            const char* arg1_name, const long long arg1)
+{
+  GetThreadTraceEvents().push_back(ThreadTraceEvent{ name, cat, start_us, dur_us,
+                                                     arg0_name, arg0, arg1_name, arg1 });
+}
+
+void xreg::RecordTraceTrackEvent(const std::string& track_name, const std::string& name,
+                                 const std::string& cat,
+                                 const double start_us, const double dur_us)
+{
+  auto& reg = GetTraceRegistry();
+
+  std::lock_guard<std::mutex> lock(reg.m);
+
+  size_type track_idx = 0;
+
+  while ((track_idx < reg.track_names.size()) && (reg.track_names[track_idx] != track_name))
+  {
+    ++track_idx;
+  }
+
+  if (track_idx == reg.track_names.size())
+  {
+    reg.track_names.push_back(track_name);
+  }
+
+  reg.track_events.push_back(TrackTraceEvent{ track_idx, name, cat, start_us, dur_us });
+}
+
+void xreg::ClearTrace()
+{
+  auto& reg = GetTraceRegistry();
+
+  std::lock_guard<std::mutex> lock(reg.m);
+
+  for (auto& events : reg.threads)
+  {
+    events->clear();
+  }
+
+  reg.track_events.clear();
+}
+
+void xreg::WriteChromeTrace(std::ostream& out)
+{
+  auto& reg = GetTraceRegistry();
+
+  std::lock_guard<std::mutex> lock(reg.m);
+
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+  bool first_event = true;
+
+  WriteChromeTraceEvent(out, &first_event,
+    fmt::format("{{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":{},\"args\":{{\"name\":\"xReg CPU\"}}}}",
+                kTHREADS_PID));
+
+  const size_type num_threads = reg.threads.size();
+
+  for (size_type thread_idx = 0; thread_idx < num_threads; ++thread_idx)
+  {
+    WriteChromeTraceEvent(out, &first_event,
+      fmt::format("{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":{},\"tid\":{},"
+                  "\"args\":{{\"name\":\"thread {}\"}}}}",
+                  kTHREADS_PID, thread_idx, thread_idx));
+
+    for (const auto& e : *reg.threads[thread_idx])
+    {
+      std::string args;
+
+      if (e.arg0_name)
+      {
+        args += fmt::format("\"{}\":{}", EscapeJSONString(e.arg0_name), e.arg0);
+      }
+
+      if (e.arg1_name)
+      {
+        args += fmt::format("{}\"{}\":{}", args.empty() ? "" : ",",
+                            EscapeJSONString(e.arg1_name), e.arg1);
+      }
+
+      WriteChromeTraceEvent(out, &first_event,
+        fmt::format("{{\"name\":\"{}\",\"cat\":\"{}\",\"ph\":\"X\",\"ts\":{:.3f},\"dur\":{:.3f},"
+                    "\"pid\":{},\"tid\":{},\"args\":{{{}}}}}",
+                    EscapeJSONString(e.name), EscapeJSONString(e.cat), e.start_us, e.dur_us,
+                    kTHREADS_PID, thread_idx, args));
+    }
+  }
+
+  if (!reg.track_names.empty())
+  {
+    WriteChromeTraceEvent(out, &first_event,
+      fmt::format("{{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":{},\"args\":{{\"name\":\"xReg Devices\"}}}}",
+                  kTRACKS_PID));
+
+    const size_type num_tracks = reg.track_names.size();
+
+    for (size_type track_idx = 0; track_idx < num_tracks; ++track_idx)
+    {
+      WriteChromeTraceEvent(out, &first_event,
+        fmt::format("{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":{},\"tid\":{},"
+                    "\"args\":{{\"name\":\"{}\"}}}}",
+                    kTRACKS_PID, track_idx, EscapeJSONString(reg.track_names[track_idx])));
+    }
+
+    for (const auto& e : reg.track_events)
+    {
+      WriteChromeTraceEvent(out, &first_event,
+        fmt::format("{{\"name\":\"{}\",\"cat\":\"{}\",\"ph\":\"X\",\"ts\":{:.3f},\"dur\":{:.3f},"
+                    "\"pid\":{},\"tid\":{}}}",
+                    EscapeJSONString(e.name), EscapeJSONString(e.cat), e.start_us, e.dur_us,
+                    kTRACKS_PID, e.track_idx));
+    }
+  }
+
+  out << "\n]}\n";
+
+  out.flush();
+}
+
+void xreg::WriteChromeTraceToDisk(const std::string& path)
+{
+  std::ofstream out(path);
+
+  if (!out)
+  {
+    xregThrow("failed to open trace file for writing: %s", path.c_str());
+  }
+
+  WriteChromeTrace(out);
+}
+
@@ -0,0 +1,167 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file
+ * @brief Opt-in recording of timeline events, which may be written to a
+ *        Chrome trace JSON file and viewed with Perfetto or chrome://tracing.
+ *
+ * Events recorded on a thread are stored in buffers local to that thread, so
+ * no synchronization is needed while recording CPU events. Events may also be
+ * recorded onto named tracks (e.g. OpenCL command queues), which need not be
+ * associated with a CPU thread.
+ *
+ * Tracing is disabled by default, in which case a traced scope costs a single
+ * relaxed atomic load. Tracing may also be enabled by setting the XREG_TRACE
+ * environment variable to the path of a JSON file, in which case the trace
+ * is written to that file at exit.
+ **/
+
+#ifndef XREGTRACE_H_
+#define XREGTRACE_H_
+
+#include <atomic>
+#include <iosfwd>
+#include <string>
+
+namespace xreg
+{
+
+namespace detail
+{
+
+extern std::atomic<bool> tracing_enabled;
+
+}  // detail
+
+/// \brief Globally enables or disables recording trace events.
+///
+/// Previously recorded events are kept, see ClearTrace().
+/// OpenCL command queues created while tracing is enabled have profiling
+/// enabled, so that the execution times of kernels and transfers enqueued
+/// onto them may be recorded.
+void SetTracingEnabled(const bool enabled);
+
+inline bool TracingEnabled()
+{
+  return detail::tracing_enabled.load(std::memory_order_relaxed);
+}
+
+/// \brief The number of microseconds elapsed since the trace epoch, which
+///        is the time that the trace was first used.
+double TraceTimestampMicros();
+
+/// \brief Records a complete event, with a start time and duration, onto the
+///        track of the calling thread.
+///
+/// The name, category and argument name strings must remain valid until the
+/// trace is cleared or written, e.g. string literals. Up to two integer
+/// arguments may be provided, an argument with a null name is not recorded.
+void RecordTraceEvent(const char* name, const char* cat,
+                      const double start_us, const double dur_us,
+                      const char* arg0_name = nullptr, const long long arg0 = 0,
+                      const char* arg1_name = nullptr, const long long arg1 = 0);
+
+/// \brief Records a complete event onto a named track, which does not
+///        correspond to a CPU thread, e.g. an OpenCL command queue.
+///
+/// Tracks with the same name are displayed as a single row. This acquires a
+/// lock and copies the strings, so it should not be called at a high rate.
+void RecordTraceTrackEvent(const std::string& track_name, const std::string& name,
+                           const std::string& cat,
+                           const double start_us, const double dur_us);
+
+/// \brief Discards all recorded events.
+///
+/// This should not be called while traced scopes are active.
+void ClearTrace();
+
+/// \brief Writes all recorded events in the Chrome trace JSON format.
+///
+/// This should not be called while traced scopes are active.
+void WriteChromeTrace(std::ostream& out);
+
+void WriteChromeTraceToDisk(const std::string& path);
+
+/// \brief Records a complete event spanning the lifetime of this object onto
+///        the track of the calling thread.
+///
+/// Typically used through the xregTRACE_SCOPE macro.
+class TraceScope
+{
+public:
+  explicit TraceScope(const char* name, const char* cat = "xreg",
+                      const char* arg0_name = nullptr, const long long arg0 = 0,
+                      const char* arg1_name = nullptr, const long long arg1 = 0)
+  {
+    if (TracingEnabled())
+    {
+      name_      = name;
+      cat_       = cat;
+      arg0_name_ = arg0_name;
+      arg0_      = arg0;
+      arg1_name_ = arg1_name;
+      arg1_      = arg1;
+
+      start_us_ = TraceTimestampMicros();
+    }
+  }
+
+  ~TraceScope()
+  {
+    if (name_)
+    {
+      RecordTraceEvent(name_, cat_, start_us_, TraceTimestampMicros() - start_us_,
+                       arg0_name_, arg0_, arg1_name_, arg1_);
+    }
+  }
+
+  // no copying
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+  const char* name_ = nullptr;
+  const char* cat_  = nullptr;
+
+  const char* arg0_name_ = nullptr;
+  long long   arg0_      = 0;
+  
+  const char* arg1_name_ = nullptr;
+  long long   arg1_      = 0;
+
+  double start_us_ = 0;
+};
+
+}  // xreg
+
+#define xregTRACE_SCOPE_CONCAT_HELPER(x,y) x##y
+#define xregTRACE_SCOPE_CONCAT(x,y) xregTRACE_SCOPE_CONCAT_HELPER(x,y)
+
+/// \brief Traces the remainder of the enclosing scope as a named event
+#define xregTRACE_SCOPE(name, cat) \
+  xreg::TraceScope xregTRACE_SCOPE_CONCAT(xreg_trace_scope_, __LINE__)(name, cat)
+
+#endif
+
@@ -0,0 +1,146 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregAttVolCache.h"
+
+#include <algorithm>
+#include <array>
+
+#include <fmt/format.h>
+
+#include "xregAssert.h"
+#include "xregHDF5.h"
+#include "xregHDF5Internal.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+// increment when the layout of cache entries changes, so that old entries are
+// not used
+constexpr unsigned long kATT_VOL_CACHE_VERSION = 1;
+
+H5::FloatType MakeHalfH5DataType()
+{
+  // IEEE 754 half precision, HDF5 converts to/from single precision on write/read
+  H5::FloatType half_type(H5::PredType::NATIVE_FLOAT);
+  half_type.setFields(15, 10, 5, 0, 10);
+  half_type.setNorm(H5T_NORM_IMPLIED);
+  half_type.setOffset(0);
+  half_type.setPrecision(16);
+  half_type.setSize(2);
+  half_type.setEbias(15);
+
+  return half_type;
+}
+
+}  // un-named
+
+std::string xreg::MakeAttVolCacheKey(const std::vector<std::string>& input_paths,
+                                     const std::string& preproc_desc)
+{
+  std::string key_src = fmt::format("v{};", kATT_VOL_CACHE_VERSION);
+
+  for (const auto& p : input_paths)
+  {
+    key_src += ComputeFileContentHash(p);
+    key_src += ';';
+  }
+
+  key_src += preproc_desc;
+
+  return ComputeStringHash(key_src);
+}
+
+xreg::AttVolCache::AttVolCache(const std::string& cache_dir)
+  : files_(cache_dir, "att-vol-cache", ".att-vols.h5")
+{ }
+
+std::string xreg::AttVolCache::entry_path(const std::string& key) const
+{
+  return files_.entry_path(key);
+}
+
+bool xreg::AttVolCache::read(const std::string& key, VolList* vols) const
+{
+  return files_.read(key, [vols] (const H5::Group& h5)
+  {
+    const size_type num_vols = ReadSingleScalarH5ULong("num-vols", h5);
+
+    VolList tmp_vols(num_vols);
+
+    for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
+    {
+      const H5::Group vol_g = h5.openGroup(fmt::format("vol-{:03d}", vol_idx));
+
+      H5::DataSet pixels_ds;
+
+      tmp_vols[vol_idx] = detail::ReadNDImageMetaAndAllocH5Helper<float,3>(vol_g, &pixels_ds);
+
+      // converted from half precision when necessary
+      pixels_ds.read(tmp_vols[vol_idx]->GetBufferPointer(), H5::PredType::NATIVE_FLOAT);
+    }
+
+    vols->swap(tmp_vols);
+  });
+}
+
+void xreg::AttVolCache::write(const std::string& key, const VolList& vols) const
+{
+  const bool half_prec = half_precision;
+
+  files_.write(key, [&vols,half_prec] (H5::Group* h5)
+  {
+    WriteSingleScalarH5("num-vols", static_cast<unsigned long>(vols.size()), h5);
+
+    WriteSingleScalarH5("half-precision", half_prec, h5);
+
+    const H5::DataType file_pixel_type = half_prec ?
+                                            H5::DataType(MakeHalfH5DataType()) :
+                                            H5::DataType(H5::PredType::NATIVE_FLOAT);
+
+    const size_type num_vols = vols.size();
+
+    for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
+    {
+      const Vol* vol = vols[vol_idx].GetPointer();
+
+      H5::Group vol_g = h5->createGroup(fmt::format("vol-{:03d}", vol_idx));
+
+      detail::WriteNDImageMetaH5Helper(vol, &vol_g);
+
+      const auto itk_size = vol->GetLargestPossibleRegion().GetSize();
+
+      // reversed order, see WriteNDImageH5Helper()
+      const std::array<hsize_t,3> dims = { itk_size[2], itk_size[1], itk_size[0] };
+
+      // uncompressed and contiguous, so that the entry reads as fast as possible
+      H5::DataSet pixels_ds = vol_g.createDataSet("pixels", file_pixel_type,
+                                                  H5::DataSpace(3, dims.data()));
+
+      pixels_ds.write(vol->GetBufferPointer(), H5::PredType::NATIVE_FLOAT);
+    }
+  });
+}
@@ -0,0 +1,94 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file
+ * @brief On-disk cache of preprocessed, ray-cast-ready, attenuation volumes.
+ **/
+
+#ifndef XREGATTVOLCACHE_H_
+#define XREGATTVOLCACHE_H_
+
+#include <string>
+#include <vector>
+
+#include <itkImage.h>
+
+#include "xregCommon.h"
+#include "xregHashUtils.h"
+#include "xregHDF5KeyedFileCache.h"
+
+namespace xreg
+{
+
+/// \brief Creates a key for the attenuation volume cache.
+///
+/// The key is derived from the contents of every input file (e.g. the CT and
+/// segmentation) and a description of the preprocessing steps and their
+/// parameters (e.g. "hu-to-lin-att;hu-lower=-1000;labels=1,2"). Any change to
+/// the inputs or parameters yields a different key.
+std::string MakeAttVolCacheKey(const std::vector<std::string>& input_paths,
+                               const std::string& preproc_desc);
+
+/// \brief Directory of preprocessed volumes, indexed by keys created with
+///        MakeAttVolCacheKey().
+///
+/// Each entry stores the final list of volumes passed to a ray caster, so that
+/// the conversion from HU, masking with labels, and cropping may be skipped
+/// when an application is run again with the same inputs.
+class AttVolCache
+{
+public:
+  using Vol     = itk::Image<float,3>;
+  using VolPtr  = Vol::Pointer;
+  using VolList = std::vector<VolPtr>;
+
+  /// \brief Constructor, cache_dir is created if it does not exist.
+  explicit AttVolCache(const std::string& cache_dir);
+
+  /// \brief Store the voxels using IEEE 754 half precision.
+  ///
+  /// This halves the size of each entry and the time needed to read it, at
+  /// a loss of precision. Entries are always read back as single precision.
+  bool half_precision = false;
+
+  /// \brief Reads the volumes of a cache entry.
+  ///
+  /// Returns false, and leaves vols unmodified, when no entry exists for key.
+  bool read(const std::string& key, VolList* vols) const;
+
+  /// \brief Writes the volumes of a cache entry, replacing any existing entry.
+  ///
+  /// See H5KeyedFileCache::write().
+  void write(const std::string& key, const VolList& vols) const;
+
+  std::string entry_path(const std::string& key) const;
+
+private:
+  H5KeyedFileCache files_;
+};
+
+}  // xreg
+
+#endif
@@ -25,10 +25,14 @@
 #include "xregDICOMUtils.h"
 
 #include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <set>
 
 #include <gdcmReader.h>
 #include <gdcmAttribute.h>
+#include <gdcmImageReader.h>
+#include <gdcmSequenceOfFragments.h>
 //#include <gdcmVersion.h>
 
 #include <fmt/printf.h>
@@ -36,9 +40,20 @@
 #include "xregAssert.h"
 #include "xregHDF5.h"
 #include "xregHDF5Internal.h"
+#include "xregITKBasicImageUtils.h"
 #include "xregStringUtils.h"
+#include "xregTBBUtils.h"
 
-xreg::DICOMFIleBasicFields xreg::ReadDICOMFileBasicFields(const std::string& dcm_path)
+namespace  // un-named
+{
+
+using namespace xreg;
+
+// Returns false when the file is not a DICOM, an exception is thrown when the
+// file appears to be a DICOM, but the fields cannot be parsed.
+// Only the selected tags are parsed, gdcm stops reading after the last selected
+// tag, therefore the pixel data is never read.
+bool ReadDICOMFileBasicFieldsHelper(const std::string& dcm_path, DICOMFIleBasicFields* dst_dcm_info)
 {
   gdcm::Reader dcm_reader;
   dcm_reader.SetFileName(dcm_path.c_str());
@@ -835,7 +850,9 @@ xreg::DICOMFIleBasicFields xreg::ReadDICOMFileBasicFields(const std::string& dcm
     
       dcm_info.file_path = dcm_path;
       
-      return dcm_info;
+      *dst_dcm_info = std::move(dcm_info);
+
+      return true;
     }
     else
     {
@@ -843,9 +860,136 @@ xreg::DICOMFIleBasicFields xreg::ReadDICOMFileBasicFields(const std::string& dcm
     }
   }
   else
+  {
+    return false;
+  }
+}
+
+// Paths of all non-directory items in a directory, these are candidate DICOM files.
+PathList GetFilePathsInDir(const std::string& dir)
+{
+  PathList file_paths;
+
+  Path dir_path(dir);
+
+  if (dir_path.is_dir())
+  {
+    PathList dir_elems;
+    dir_path.get_dir_contents(&dir_elems);
+
+    for (const auto& path : dir_elems)
+    {
+      if (!path.is_dir())  // only want to check files
+      {
+        file_paths.push_back(path);
+      }
+    }
+  }
+
+  return file_paths;
+}
+
+// Parses the basic fields of each candidate file concurrently, files which are not
+// DICOMs are skipped. Output order is consistent with the order of the input paths.
+// When a previous index is provided, files with unchanged size and modification
+// time are not parsed again. When an output index is provided, it is populated
+// with an entry for each input path and true is returned when it differs from
+// the previous index.
+bool ReadDICOMFileBasicFieldsOfCandidates(const PathList& paths,
+                                          DICOMFIleBasicFieldsList* dcm_infos,
+                                          const DICOMIndex* prev_index = nullptr,
+                                          DICOMIndex* new_index = nullptr)
+{
+  const size_type num_paths = paths.size();
+
+  std::vector<DICOMIndexEntry> entries(num_paths);
+
+  // not using std::vector<bool>, since different threads write to adjacent elements
+  std::vector<char> was_parsed(num_paths, 0);
+
+  const bool use_index = prev_index || new_index;
+
+  auto read_fn = [&paths,&entries,&was_parsed,prev_index,use_index] (const RangeType& r)
+  {
+    for (size_type i = r.begin(); i < r.end(); ++i)
+    {
+      const std::string path_str = paths[i].string();
+
+      auto& e = entries[i];
+
+      if (use_index)
+      {
+        e.file_size = static_cast<unsigned long>(paths[i].file_size());
+        e.mod_time  = static_cast<long>(paths[i].mod_time());
+
+        if (prev_index)
+        {
+          const auto prev_it = prev_index->find(path_str);
+
+          if ((prev_it != prev_index->end()) &&
+              (prev_it->second.file_size == e.file_size) &&
+              (prev_it->second.mod_time == e.mod_time))
+          {
+            e = prev_it->second;
+            continue;
+          }
+        }
+      }
+
+      e.is_dicom = ReadDICOMFileBasicFieldsHelper(path_str, &e.fields);
+
+      was_parsed[i] = 1;
+    }
+  };
+
+  ParallelFor(read_fn, RangeType(0, num_paths));
+
+  dcm_infos->clear();
+  dcm_infos->reserve(num_paths);
+
+  bool index_changed = false;
+
+  if (new_index)
+  {
+    new_index->clear();
+    new_index->reserve(num_paths);
+
+    // entries for files which no longer exist are dropped
+    index_changed = !prev_index || (prev_index->size() != num_paths);
+  }
+
+  for (size_type i = 0; i < num_paths; ++i)
+  {
+    auto& e = entries[i];
+
+    if (e.is_dicom)
+    {
+      dcm_infos->push_back(e.fields);
+    }
+
+    if (new_index)
+    {
+      index_changed = index_changed || was_parsed[i];
+
+      new_index->emplace(paths[i].string(), std::move(e));
+    }
+  }
+
+  return index_changed;
+}
+
+}  // un-named
+
+xreg::DICOMFIleBasicFields xreg::ReadDICOMFileBasicFields(const std::string& dcm_path)
+{
+  DICOMFIleBasicFields dcm_info;
+
+  if (!ReadDICOMFileBasicFieldsHelper(dcm_path, &dcm_info))
   {
     xregThrow("Invalid DICOM File!");
   }
+
+  return dcm_info;
 }
 
 void xreg::PrintDICOMFileBasicFields(const DICOMFIleBasicFields& dcm_info, std::ostream& out,
@@ -960,6 +1104,178 @@ bool xreg::IsDerivedDICOMFile(const DICOMFIleBasicFields& dcm_info)
                   != dcm_info.image_type->end());
 }
 
+namespace  // un-named
+{
+
+using namespace xreg;
+
+template <class tSrcScalar, class tDstScalar>
+void RescaleDecodedFrame(const char* raw_buf, const size_type num_pix,
+                         const double slope, const double intercept,
+                         tDstScalar* dst_buf)
+{
+  const tSrcScalar* src_buf = reinterpret_cast<const tSrcScalar*>(raw_buf);
+
+  if ((std::abs(slope - 1) < 1.0e-8) && (std::abs(intercept) < 1.0e-8))
+  {
+    std::transform(src_buf, src_buf + num_pix, dst_buf,
+                   [] (const tSrcScalar x) { return static_cast<tDstScalar>(x); });
+  }
+  else
+  {
+    std::transform(src_buf, src_buf + num_pix, dst_buf,
+                   [slope,intercept] (const tSrcScalar x)
+                   {
+                     return static_cast<tDstScalar>((x * slope) + intercept);
+                   });
+  }
+}
+
+template <class tPixelScalar>
+bool ReadDICOMCompressedFramesParallelHelper(const std::string& dcm_path,
+                                             std::vector<typename itk::Image<tPixelScalar,2>::Pointer>* frames)
+{
+  gdcm::ImageReader reader;
+  reader.SetFileName(dcm_path.c_str());
+
+  if (!reader.Read())
+  {
+    return false;
+  }
+
+  const gdcm::Image& img = reader.GetImage();
+
+  const gdcm::TransferSyntax& ts = img.GetTransferSyntax();
+
+  if (!ts.IsEncapsulated() || (img.GetNumberOfDimensions() != 3))
+  {
+    return false;
+  }
+
+  const gdcm::PixelFormat& pf = img.GetPixelFormat();
+
+  const auto scalar_type = pf.GetScalarType();
+
+  if ((pf.GetSamplesPerPixel() != 1) ||
+      !((scalar_type == gdcm::PixelFormat::UINT8) || (scalar_type == gdcm::PixelFormat::INT8) ||
+        (scalar_type == gdcm::PixelFormat::UINT16) || (scalar_type == gdcm::PixelFormat::INT16)))
+  {
+    return false;
+  }
+
+  const gdcm::SequenceOfFragments* src_frags = img.GetDataElement().GetSequenceOfFragments();
+
+  const size_type num_cols   = img.GetDimension(0);
+  const size_type num_rows   = img.GetDimension(1);
+  const size_type num_frames = img.GetDimension(2);
+
+  if (!src_frags || (src_frags->GetNumberOfFragments() != num_frames))
+  {
+    return false;
+  }
+
+  const size_type num_pix_per_frame = num_rows * num_cols;
+
+  const double* spacing = img.GetSpacing();
+  const double* origin  = img.GetOrigin();
+
+  const std::array<double,2> spacing_slice = { spacing[0], spacing[1] };
+  const std::array<double,2> origin_slice  = { origin[0], origin[1] };
+
+  const double slope     = img.GetSlope();
+  const double intercept = img.GetIntercept();
+
+  std::vector<typename itk::Image<tPixelScalar,2>::Pointer> dst_frames(num_frames);
+
+  std::atomic<bool> decode_failed(false);
+
+  // Each frame is decoded by a separate image object referencing only the
+  // frame's fragment, these do not share any decoder state
+  auto decode_frames_fn = [&] (const RangeType& r)
+  {
+    std::vector<char> raw_buf;
+
+    for (size_type frame_idx = r.begin(); (frame_idx < r.end()) && !decode_failed; ++frame_idx)
+    {
+      gdcm::Image frame_img;
+      frame_img.SetNumberOfDimensions(2);
+      frame_img.SetDimension(0, static_cast<unsigned int>(num_cols));
+      frame_img.SetDimension(1, static_cast<unsigned int>(num_rows));
+      frame_img.SetPixelFormat(pf);
+      frame_img.SetPhotometricInterpretation(img.GetPhotometricInterpretation());
+      frame_img.SetTransferSyntax(ts);
+
+      gdcm::SmartPointer<gdcm::SequenceOfFragments> frame_frags = new gdcm::SequenceOfFragments;
+      frame_frags->AddFragment(src_frags->GetFragment(static_cast<unsigned int>(frame_idx)));
+
+      gdcm::DataElement frame_de(gdcm::Tag(0x7FE0,0x0010));
+      frame_de.SetValue(*frame_frags);
+      frame_de.SetVLToUndefined();
+
+      frame_img.SetDataElement(frame_de);
+
+      raw_buf.resize(frame_img.GetBufferLength());
+
+      if ((raw_buf.size() < (num_pix_per_frame * pf.GetPixelSize())) ||
+          !frame_img.GetBuffer(raw_buf.data()))
+      {
+        decode_failed = true;
+        break;
+      }
+
+      auto dst_frame = MakeITK2DVol<tPixelScalar>(num_cols, num_rows);
+
+      dst_frame->SetSpacing(spacing_slice.data());
+      dst_frame->SetOrigin(origin_slice.data());
+
+      tPixelScalar* dst_buf = dst_frame->GetBufferPointer();
+
+      switch (scalar_type)
+      {
+      case gdcm::PixelFormat::UINT8:
+        RescaleDecodedFrame<unsigned char>(raw_buf.data(), num_pix_per_frame, slope, intercept, dst_buf);
+        break;
+      case gdcm::PixelFormat::INT8:
+        RescaleDecodedFrame<signed char>(raw_buf.data(), num_pix_per_frame, slope, intercept, dst_buf);
+        break;
+      case gdcm::PixelFormat::UINT16:
+        RescaleDecodedFrame<unsigned short>(raw_buf.data(), num_pix_per_frame, slope, intercept, dst_buf);
+        break;
+      default:
+        RescaleDecodedFrame<short>(raw_buf.data(), num_pix_per_frame, slope, intercept, dst_buf);
+        break;
+      }
+
+      dst_frames[frame_idx] = dst_frame;
+    }
+  };
+
+  ParallelFor(decode_frames_fn, RangeType(0, num_frames));
+
+  if (decode_failed)
+  {
+    return false;
+  }
+
+  frames->swap(dst_frames);
+
+  return true;
+}
+
+}  // un-named
+
+bool xreg::ReadDICOMCompressedFramesParallel(const std::string& dcm_path,
+                                             std::vector<itk::Image<float,2>::Pointer>* frames)
+{
+  return ReadDICOMCompressedFramesParallelHelper<float>(dcm_path, frames);
+}
+
+bool xreg::ReadDICOMCompressedFramesParallel(const std::string& dcm_path,
+                                             std::vector<itk::Image<unsigned short,2>::Pointer>* frames)
+{
+  return ReadDICOMCompressedFramesParallelHelper<unsigned short>(dcm_path, frames);
+}
+
 void xreg::GetDICOMDirs(const std::string& root_dir_path, PathStringList* dir_paths)
 {
   PathList paths_to_check;
@@ -1033,24 +1349,29 @@ void xreg::GetDICOMFilePathObjsInDir(const std::string& dir, PathList* dcm_paths
 {
   dcm_paths->clear();
 
-  Path dir_path(dir);
+  const PathList file_paths = GetFilePathsInDir(dir);
 
-  if (dir_path.is_dir())
+  const size_type num_files = file_paths.size();
+
+  std::vector<char> is_dcm(num_files, 0);
+
+  auto check_fn = [&file_paths,&is_dcm] (const RangeType& r)
   {
-    PathList dir_elems;
-    dir_path.get_dir_contents(&dir_elems);
+    for (size_type i = r.begin(); i < r.end(); ++i)
+    {
+      gdcm::Reader dcm_reader;
+      dcm_reader.SetFileName(file_paths[i].string().c_str());
+      is_dcm[i] = dcm_reader.CanRead();
+    }
+  };
 
-    for (const auto& path : dir_elems)
+  ParallelFor(check_fn, RangeType(0, num_files));
+
+  for (size_type i = 0; i < num_files; ++i)
+  {
+    if (is_dcm[i])
     {
-      if (!path.is_dir())  // only want to check files
-      {
-        gdcm::Reader dcm_reader;
-        dcm_reader.SetFileName(path.string().c_str());
-        if (dcm_reader.CanRead())
-        {
-          dcm_paths->push_back(path);
-        }
-      }
+      dcm_paths->push_back(file_paths[i]);
     }
   }
 }
@@ -1061,7 +1382,8 @@ void xreg::GetOrgainizedDICOMInfos(const std::string& root_dir_path,
                                    const bool inc_multi_frame_files,
                                    const bool inc_secondary,
                                    const bool inc_derived,
-                                   const std::vector<std::string>& modalities)
+                                   const std::vector<std::string>& modalities,
+                                   const std::string& index_path)
 {
   const bool check_modality = !modalities.empty();
 
@@ -1071,33 +1393,53 @@ void xreg::GetOrgainizedDICOMInfos(const std::string& root_dir_path,
   PathStringList dcm_dirs;
   GetDICOMDirs(root_dir_path, &dcm_dirs);
 
-  // temporary variables
-  PathList cur_dir_dcm_file_paths;
-  DICOMFIleBasicFields tmp_basic_fields;
+  // gather every candidate file first, so that all files are parsed concurrently,
+  // not only the files of a single directory
+  PathList file_paths;
 
   for (const auto& dcm_dir : dcm_dirs)
   {
-    cur_dir_dcm_file_paths.clear();
-    GetDICOMFilePathObjsInDir(dcm_dir, &cur_dir_dcm_file_paths);
+    const PathList cur_dir_file_paths = GetFilePathsInDir(dcm_dir);
 
-    for (const auto& dcm_file_path : cur_dir_dcm_file_paths)
-    {
-      const std::string cur_file_path = dcm_file_path.string();
+    file_paths.insert(file_paths.end(), cur_dir_file_paths.begin(), cur_dir_file_paths.end());
+  }
 
-      tmp_basic_fields = ReadDICOMFileBasicFields(cur_file_path);
+  DICOMFIleBasicFieldsList dcm_infos;
 
-      if ((inc_localizer  || !IsLocalizer(tmp_basic_fields)) &&
-          (inc_multi_frame_files || !IsMultiFrameDICOMFile(tmp_basic_fields)) &&
-          (inc_secondary || !IsSecondaryDICOMFile(tmp_basic_fields)) &&
-          (inc_derived || !IsDerivedDICOMFile(tmp_basic_fields)) &&
-          (!check_modality ||
-           (std::find(modalities.begin(), modalities.end(), tmp_basic_fields.modality)
-                                                                     != modalities.end())))
-      {
-        org_dcm->patient_infos[tmp_basic_fields.patient_id]
-                                [tmp_basic_fields.study_uid]
-                                  [tmp_basic_fields.series_uid].push_back(cur_file_path);
-      }
+  if (index_path.empty())
+  {
+    ReadDICOMFileBasicFieldsOfCandidates(file_paths, &dcm_infos);
+  }
+  else
+  {
+    const bool prev_index_exists = Path(index_path).exists();
+
+    const DICOMIndex prev_index = prev_index_exists ? ReadDICOMIndexFromDisk(index_path)
+                                                    : DICOMIndex();
+
+    DICOMIndex new_index;
+
+    if (ReadDICOMFileBasicFieldsOfCandidates(file_paths, &dcm_infos,
+                                             prev_index_exists ? &prev_index : nullptr,
+                                             &new_index))
+    {
+      WriteDICOMIndexToDisk(new_index, index_path);
+    }
+  }
+
+  for (const auto& basic_fields : dcm_infos)
+  {
+    if ((inc_localizer  || !IsLocalizer(basic_fields)) &&
+        (inc_multi_frame_files || !IsMultiFrameDICOMFile(basic_fields)) &&
+        (inc_secondary || !IsSecondaryDICOMFile(basic_fields)) &&
+        (inc_derived || !IsDerivedDICOMFile(basic_fields)) &&
+        (!check_modality ||
+         (std::find(modalities.begin(), modalities.end(), basic_fields.modality)
+                                                                   != modalities.end())))
+    {
+      org_dcm->patient_infos[basic_fields.patient_id]
+                              [basic_fields.study_uid]
+                                [basic_fields.series_uid].push_back(basic_fields.file_path);
     }
   }
 }
@@ -1177,21 +1519,7 @@ void xreg::PrintOrganizedDICOMFiles(const OrganizedDICOMFiles& org_dcm, std::ost
 
 void xreg::ReadDICOMInfosFromDir(const std::string& dir_path, DICOMFIleBasicFieldsList* dcm_infos)
 {
-  using size_type = PathStringList::size_type;
-
-  PathStringList dcm_paths;
-  GetDICOMFileNamesInDir(dir_path, &dcm_paths);
-
-  const size_type num_dcm = dcm_paths.size();
-
-  DICOMFIleBasicFieldsList& dcms = *dcm_infos;
-
-  dcms.resize(num_dcm);
-
-  for (size_type dcm_idx = 0; dcm_idx < num_dcm; ++dcm_idx)
-  {
-    dcms[dcm_idx] = ReadDICOMFileBasicFields(dcm_paths[dcm_idx]);
-  }
+  ReadDICOMFileBasicFieldsOfCandidates(GetFilePathsInDir(dir_path), dcm_infos);
 }
 
 bool xreg::ReorderAndCheckDICOMInfos::operator()(const DICOMFIleBasicFieldsList& src_infos,
@@ -1743,3 +2071,80 @@ xreg::DICOMFIleBasicFields xreg::ReadDICOMFieldsH5(const H5::Group& h5)
   return dcm_info;
 }
 
+void xreg::WriteDICOMIndexH5(const DICOMIndex& dcm_index, H5::Group* h5)
+{
+  SetStringAttr("xreg-type", "dicom-index", h5);
+
+  WriteSingleScalarH5("num-entries", static_cast<unsigned long>(dcm_index.size()), h5);
+
+  size_type entry_idx = 0;
+
+  for (const auto& path_and_entry : dcm_index)
+  {
+    const auto& e = path_and_entry.second;
+
+    H5::Group entry_g = h5->createGroup(fmt::format("entry-{:06d}", entry_idx));
+
+    WriteStringH5("path", path_and_entry.first, &entry_g);
+    WriteSingleScalarH5("file-size", e.file_size, &entry_g);
+    WriteSingleScalarH5("mod-time", e.mod_time, &entry_g);
+    WriteSingleScalarH5("is-dicom", e.is_dicom, &entry_g);
+
+    if (e.is_dicom)
+    {
+      H5::Group fields_g = entry_g.createGroup("fields");
+
+      WriteDICOMFieldsH5(e.fields, &fields_g);
+    }
+
+    ++entry_idx;
+  }
+}
+
+void xreg::WriteDICOMIndexToDisk(const DICOMIndex& dcm_index, const std::string& path)
+{
+  H5::H5File h5(path, H5F_ACC_TRUNC);
+
+  WriteDICOMIndexH5(dcm_index, &h5);
+
+  h5.flush(H5F_SCOPE_GLOBAL);
+  h5.close();
+}
+
+xreg::DICOMIndex xreg::ReadDICOMIndexH5(const H5::Group& h5)
+{
+  if (GetStringAttr("xreg-type", h5) != "dicom-index")
+  {
+    xregThrow("HDF5 group is not a DICOM index!");
+  }
+
+  const size_type num_entries = ReadSingleScalarH5ULong("num-entries", h5);
+
+  DICOMIndex dcm_index;
+  dcm_index.reserve(num_entries);
+
+  for (size_type entry_idx = 0; entry_idx < num_entries; ++entry_idx)
+  {
+    const H5::Group entry_g = h5.openGroup(fmt::format("entry-{:06d}", entry_idx));
+
+    DICOMIndexEntry e;
+
+    e.file_size = ReadSingleScalarH5ULong("file-size", entry_g);
+    e.mod_time  = ReadSingleScalarH5Long("mod-time", entry_g);
+    e.is_dicom  = ReadSingleScalarH5Bool("is-dicom", entry_g);
+
+    if (e.is_dicom)
+    {
+      e.fields = ReadDICOMFieldsH5(entry_g.openGroup("fields"));
+    }
+
+    dcm_index.emplace(ReadStringH5("path", entry_g), std::move(e));
+  }
+
+  return dcm_index;
+}
+
+xreg::DICOMIndex xreg::ReadDICOMIndexFromDisk(const std::string& path)
+{
+  return ReadDICOMIndexH5(H5::H5File(path, H5F_ACC_RDONLY));
+}
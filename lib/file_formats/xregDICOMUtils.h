@@ -186,6 +186,23 @@ bool IsSecondaryDICOMFile(const DICOMFIleBasicFields& dcm_info);
 
 bool IsDerivedDICOMFile(const DICOMFIleBasicFields& dcm_info);
 
+/// \brief Decodes the frames of a multi-frame DICOM file with compressed
+///        pixel data concurrently.
+///
+/// When each compressed frame (e.g. JPEG, JPEG-LS, JPEG 2000 or RLE) is stored
+/// in its own fragment of the encapsulated pixel data, the frames are decoded
+/// independently and the pixels are written directly into newly allocated 2D
+/// images, after applying the rescale slope and intercept as ITK does. The
+/// image spacings and origins are set from the in-plane DICOM values.
+/// false is returned, and frames is not modified, when the pixel data is not
+/// compressed, is not stored as one fragment per frame or has more than one
+/// sample per pixel; the frames should then be read with ReadDICOM3DFromDisk().
+bool ReadDICOMCompressedFramesParallel(const std::string& dcm_path,
+                                       std::vector<itk::Image<float,2>::Pointer>* frames);
+
+bool ReadDICOMCompressedFramesParallel(const std::string& dcm_path,
+                                       std::vector<itk::Image<unsigned short,2>::Pointer>* frames);
+
 /// \brief Stores paths to DICOM files organized by patient ID, study UID, and
 ///        series UID.
 struct OrganizedDICOMFiles
@@ -220,13 +237,17 @@ void GetDICOMFilePathObjsInDir(const std::string& dir, PathList* dcm_paths);
 /// Organized as Patient ID -> Studies for each Patient ID -> Series for each study
 /// When the modalities argument is non-empty, then only the specified modalities will
 /// be included in the output.
+/// When a non-empty index path is provided, the DICOM index stored at that path, if it
+/// exists, is used to avoid parsing files which have not changed since the previous scan.
+/// The index is updated with the results of this scan and written back to the path.
 void GetOrgainizedDICOMInfos(const std::string& root_dir_path,
                              OrganizedDICOMFiles* org_dcm,
                              const bool inc_localizer = false,
                              const bool inc_multi_frame_files = false,
                              const bool inc_secondary = true,
                              const bool inc_derived = true,
-                             const std::vector<std::string>& modalities = std::vector<std::string>());
+                             const std::vector<std::string>& modalities = std::vector<std::string>(),
+                             const std::string& index_path = std::string());
 
 /// \brief Get basic information structs for every DICOM file in a single directory
 ///
@@ -264,6 +285,35 @@ void WriteDICOMFieldsH5(const DICOMFIleBasicFields& dcm_info, H5::Group* h5);
 
 DICOMFIleBasicFields ReadDICOMFieldsH5(const H5::Group& h5);
 
+/// \brief The result of parsing a single file during a previous scan of a
+///        DICOM directory tree.
+///
+/// An entry is only reused when the file size and modification time
+/// are unchanged. Files which are not DICOMs are also recorded, so that they
+/// are not checked again.
+struct DICOMIndexEntry
+{
+  unsigned long file_size;
+
+  long mod_time;
+
+  bool is_dicom;
+
+  // only valid when is_dicom is true
+  DICOMFIleBasicFields fields;
+};
+
+/// \brief Persistent index of parsed DICOM files, keyed by file path
+using DICOMIndex = std::unordered_map<std::string,DICOMIndexEntry>;
+
+void WriteDICOMIndexH5(const DICOMIndex& dcm_index, H5::Group* h5);
+
+void WriteDICOMIndexToDisk(const DICOMIndex& dcm_index, const std::string& path);
+
+DICOMIndex ReadDICOMIndexH5(const H5::Group& h5);
+
+DICOMIndex ReadDICOMIndexFromDisk(const std::string& path);
+
 }  // xreg
 
 #endif
@@ -0,0 +1,95 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregDRRCache.h"
+
+#include <fmt/format.h>
+
+#include "xregAssert.h"
+#include "xregHDF5.h"
+#include "xregHashUtils.h"
+
+std::string xreg::MakeDRRCacheKey(const std::string& scene_desc,
+                                  const std::vector<size_type>& vol_inds,
+                                  const FrameTransformList& vol_poses)
+{
+  std::string key_src = scene_desc;
+
+  for (const auto& vol_idx : vol_inds)
+  {
+    xregASSERT(vol_idx < vol_poses.size());
+
+    key_src += fmt::format(";{}:", vol_idx);
+
+    const auto& m = vol_poses[vol_idx].matrix();
+
+    key_src.append(reinterpret_cast<const char*>(m.data()), sizeof(CoordScalar) * m.size());
+  }
+
+  return ComputeStringHash(key_src);
+}
+
+xreg::DRRCache::DRRCache(const std::string& cache_dir)
+  : files_(cache_dir, "drr-cache", ".drrs.h5")
+{ }
+
+std::string xreg::DRRCache::entry_path(const std::string& key) const
+{
+  return files_.entry_path(key);
+}
+
+bool xreg::DRRCache::read(const std::string& key, ProjList* projs) const
+{
+  return files_.read(key, [projs] (const H5::Group& h5)
+  {
+    const size_type num_projs = ReadSingleScalarH5ULong("num-projs", h5);
+
+    ProjList tmp_projs(num_projs);
+
+    for (size_type proj_idx = 0; proj_idx < num_projs; ++proj_idx)
+    {
+      tmp_projs[proj_idx] = ReadITKImageH5Float2D(h5.openGroup(fmt::format("proj-{:03d}", proj_idx)));
+    }
+
+    projs->swap(tmp_projs);
+  });
+}
+
+void xreg::DRRCache::write(const std::string& key, const ProjList& projs) const
+{
+  files_.write(key, [&projs] (H5::Group* h5)
+  {
+    const size_type num_projs = projs.size();
+
+    WriteSingleScalarH5("num-projs", static_cast<unsigned long>(num_projs), h5);
+
+    for (size_type proj_idx = 0; proj_idx < num_projs; ++proj_idx)
+    {
+      H5::Group proj_g = h5->createGroup(fmt::format("proj-{:03d}", proj_idx));
+
+      // uncompressed, so that the entry reads as fast as possible
+      WriteImageH5(projs[proj_idx].GetPointer(), &proj_g, false);
+    }
+  });
+}
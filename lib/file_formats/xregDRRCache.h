@@ -0,0 +1,86 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file
+ * @brief On-disk cache of rendered projections (DRRs).
+ **/
+
+#ifndef XREGDRRCACHE_H_
+#define XREGDRRCACHE_H_
+
+#include <string>
+#include <vector>
+
+#include <itkImage.h>
+
+#include "xregCommon.h"
+#include "xregHDF5KeyedFileCache.h"
+
+namespace xreg
+{
+
+/// \brief Creates a key for the DRR cache.
+///
+/// The key is derived from a description of the scene and renderer (e.g. a
+/// hash of the input volumes, camera models, ray caster type and parameters)
+/// and the poses of the volumes rendered. vol_inds selects the poses from
+/// vol_poses, i.e. vol_poses[vol_inds[i]] is the pose of volume vol_inds[i].
+/// The raw bytes of each pose are used, so any change to a pose yields a
+/// different key.
+std::string MakeDRRCacheKey(const std::string& scene_desc,
+                            const std::vector<size_type>& vol_inds,
+                            const FrameTransformList& vol_poses);
+
+/// \brief Directory of rendered projections, indexed by keys created with
+///        MakeDRRCacheKey().
+///
+/// Each entry stores the projections of every view at a single collection of
+/// poses, so that an application replaying the same poses (e.g. with
+/// different visualization options) does not need to ray cast them again.
+class DRRCache
+{
+public:
+  using Proj     = itk::Image<float,2>;
+  using ProjPtr  = Proj::Pointer;
+  using ProjList = std::vector<ProjPtr>;
+
+  explicit DRRCache(const std::string& cache_dir);
+
+  /// \brief Retrieves the projections rendered at the poses of key, returns
+  ///        false (leaving projs unmodified) when they were never stored.
+  bool read(const std::string& key, ProjList* projs) const;
+
+  /// \brief Stores the projections rendered at the poses of key.
+  void write(const std::string& key, const ProjList& projs) const;
+
+  std::string entry_path(const std::string& key) const;
+
+private:
+  H5KeyedFileCache files_;
+};
+
+}  // xreg
+
+#endif
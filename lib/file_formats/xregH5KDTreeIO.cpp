@@ -0,0 +1,216 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "xregH5KDTreeIO.h"
+
+#include "xregHDF5.h"
+#include "xregHDF5Internal.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+template <class tTree>
+void WriteFlatKDTreeH5Helper(const tTree& tree, const char* prim_type, H5::Group* h5)
+{
+  using Node     = typename tTree::Node;
+  using NodeList = typename tTree::NodeList;
+  using Scalar   = typename tTree::Scalar;
+
+  constexpr size_type kDIM = tTree::kDIM;
+
+  SetStringAttr("xreg-type", "flat-kd-tree", h5);
+  SetStringAttr("prim-type", prim_type, h5);
+
+  const NodeList& nodes = tree.nodes();
+
+  const size_type num_nodes = nodes.size();
+
+  // pack the node boxes and links into separate row-major buffers
+  std::vector<Scalar> bounds_buf(num_nodes * 2 * kDIM);
+  std::vector<std::uint32_t> links_buf(num_nodes * 2);
+
+  for (size_type i = 0; i < num_nodes; ++i)
+  {
+    const Node& n = nodes[i];
+
+    Scalar* cur_bounds = &bounds_buf[i * 2 * kDIM];
+
+    for (size_type d = 0; d < kDIM; ++d)
+    {
+      cur_bounds[d]        = n.lower[d];
+      cur_bounds[kDIM + d] = n.upper[d];
+    }
+
+    links_buf[2 * i]       = n.link;
+    links_buf[(2 * i) + 1] = n.num_prims;
+  }
+
+  H5::DataSet bounds_ds = detail::CreateMatrixH5Helper<Scalar>("node-bounds", num_nodes,
+                                                               2 * kDIM, h5, false);
+  H5::DataSet links_ds = detail::CreateMatrixH5Helper<std::uint32_t>("node-links", num_nodes,
+                                                                     2, h5, false);
+
+  if (num_nodes)
+  {
+    bounds_ds.write(bounds_buf.data(), LookupH5DataType<Scalar>());
+    links_ds.write(links_buf.data(), LookupH5DataType<std::uint32_t>());
+  }
+
+  WriteVectorH5("prim-inds", tree.prim_inds(), h5, false);
+}
+
+template <class T>
+std::vector<T> ReadMatrixBufH5(const std::string& field_name, const size_type num_cols,
+                               const H5::Group& h5, size_type* num_rows)
+{
+  const H5::DataSet data_set = h5.openDataSet(field_name);
+
+  const H5::DataSpace data_space = data_set.getSpace();
+
+  xregASSERT(data_space.getSimpleExtentNdims() == 2);
+
+  std::array<hsize_t,2> dims = { 0, 0 };
+  data_space.getSimpleExtentDims(dims.data());
+
+  if (dims[1] != num_cols)
+  {
+    xregThrow("unexpected number of columns in %s: %llu",
+              field_name.c_str(), static_cast<unsigned long long>(dims[1]));
+  }
+
+  *num_rows = dims[0];
+
+  std::vector<T> buf(dims[0] * dims[1]);
+
+  if (!buf.empty())
+  {
+    data_set.read(buf.data(), LookupH5DataType<T>());
+  }
+
+  return buf;
+}
+
+template <class tTree, class tPrimList>
+void ReadFlatKDTreeH5Helper(const H5::Group& h5, const char* prim_type,
+                            const tPrimList& prims, tTree* tree)
+{
+  using NodeList = typename tTree::NodeList;
+  using Scalar   = typename tTree::Scalar;
+
+  constexpr size_type kDIM = tTree::kDIM;
+
+  if (GetStringAttr("prim-type", h5) != prim_type)
+  {
+    xregThrow("KD-Tree primitive type mismatch, expected %s", prim_type);
+  }
+
+  size_type num_nodes = 0;
+  const std::vector<Scalar> bounds_buf = ReadMatrixBufH5<Scalar>("node-bounds", 2 * kDIM,
+                                                                 h5, &num_nodes);
+
+  size_type num_nodes_links = 0;
+  const std::vector<std::uint32_t> links_buf = ReadMatrixBufH5<std::uint32_t>("node-links", 2,
+                                                                              h5, &num_nodes_links);
+
+  if (num_nodes != num_nodes_links)
+  {
+    xregThrow("KD-Tree node bounds and links have different lengths!");
+  }
+
+  NodeList nodes(num_nodes);
+
+  for (size_type i = 0; i < num_nodes; ++i)
+  {
+    const Scalar* cur_bounds = &bounds_buf[i * 2 * kDIM];
+
+    for (size_type d = 0; d < kDIM; ++d)
+    {
+      nodes[i].lower[d] = cur_bounds[d];
+      nodes[i].upper[d] = cur_bounds[kDIM + d];
+    }
+
+    nodes[i].link      = links_buf[2 * i];
+    nodes[i].num_prims = links_buf[(2 * i) + 1];
+  }
+
+  // restore() validates the sizes and indices
+  tree->restore(nodes, ReadVectorH5UInt("prim-inds", h5), prims.begin(), prims.end());
+}
+
+}  // un-named
+
+void xreg::WriteFlatKDTreeH5(const FlatKDTree<KDTreeTri>& tree, H5::Group* h5)
+{
+  WriteFlatKDTreeH5Helper(tree, "tri", h5);
+}
+
+void xreg::WriteFlatKDTreeH5File(const FlatKDTree<KDTreeTri>& tree, const std::string& path)
+{
+  H5::H5File h5(path, H5F_ACC_TRUNC);
+
+  WriteFlatKDTreeH5(tree, &h5);
+
+  h5.flush(H5F_SCOPE_GLOBAL);
+  h5.close();
+}
+
+void xreg::WriteFlatKDTreeH5(const FlatKDTree<Pt3>& tree, H5::Group* h5)
+{
+  WriteFlatKDTreeH5Helper(tree, "pt3", h5);
+}
+
+void xreg::WriteFlatKDTreeH5File(const FlatKDTree<Pt3>& tree, const std::string& path)
+{
+  H5::H5File h5(path, H5F_ACC_TRUNC);
+
+  WriteFlatKDTreeH5(tree, &h5);
+
+  h5.flush(H5F_SCOPE_GLOBAL);
+  h5.close();
+}
+
+void xreg::ReadFlatKDTreeH5(const H5::Group& h5, const std::vector<KDTreeTri>& tris,
+                            FlatKDTree<KDTreeTri>* tree)
+{
+  ReadFlatKDTreeH5Helper(h5, "tri", tris, tree);
+}
+
+void xreg::ReadFlatKDTreeH5File(const std::string& path, const std::vector<KDTreeTri>& tris,
+                                FlatKDTree<KDTreeTri>* tree)
+{
+  ReadFlatKDTreeH5(H5::H5File(path, H5F_ACC_RDONLY), tris, tree);
+}
+
+void xreg::ReadFlatKDTreeH5(const H5::Group& h5, const Pt3List& pts, FlatKDTree<Pt3>* tree)
+{
+  ReadFlatKDTreeH5Helper(h5, "pt3", pts, tree);
+}
+
+void xreg::ReadFlatKDTreeH5File(const std::string& path, const Pt3List& pts, FlatKDTree<Pt3>* tree)
+{
+  ReadFlatKDTreeH5(H5::H5File(path, H5F_ACC_RDONLY), pts, tree);
+}
@@ -0,0 +1,73 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef XREGH5KDTREEIO_H_
+#define XREGH5KDTREEIO_H_
+
+#include "xregFlatKDTree.h"
+
+// Forward Declarations
+namespace H5
+{
+
+class Group;
+
+}  // H5
+
+namespace xreg
+{
+
+/// \brief Writes the nodes and primitive permutation of a flat KD-Tree.
+///
+/// The primitives themselves (e.g. the mesh) are not written and must be
+/// supplied when reading the tree back, so that a tree computed once for a
+/// fixed surface may be cached alongside it.
+void WriteFlatKDTreeH5(const FlatKDTree<KDTreeTri>& tree, H5::Group* h5);
+
+void WriteFlatKDTreeH5File(const FlatKDTree<KDTreeTri>& tree, const std::string& path);
+
+void WriteFlatKDTreeH5(const FlatKDTree<Pt3>& tree, H5::Group* h5);
+
+void WriteFlatKDTreeH5File(const FlatKDTree<Pt3>& tree, const std::string& path);
+
+/// \brief Restores a flat KD-Tree written by WriteFlatKDTreeH5().
+///
+/// tris must be the same list of triangles that was used to originally build
+/// the tree, e.g. from CreateTrisForKDTree() with the same mesh; an exception
+/// is thrown when the number of triangles differs from the tree.
+void ReadFlatKDTreeH5(const H5::Group& h5, const std::vector<KDTreeTri>& tris,
+                      FlatKDTree<KDTreeTri>* tree);
+
+void ReadFlatKDTreeH5File(const std::string& path, const std::vector<KDTreeTri>& tris,
+                          FlatKDTree<KDTreeTri>* tree);
+
+void ReadFlatKDTreeH5(const H5::Group& h5, const Pt3List& pts, FlatKDTree<Pt3>* tree);
+
+void ReadFlatKDTreeH5File(const std::string& path, const Pt3List& pts, FlatKDTree<Pt3>* tree);
+
+}  // xreg
+
+#endif
+
@@ -24,10 +24,95 @@
 
 #include "xregH5MeshIO.h"
 
+#include <limits>
+
 #include "xregHDF5.h"
+#include "xregHDF5Internal.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+// Writes a list of 3-element points or arrays as an N x 3 matrix, which has the
+// same layout as the list in memory, so that it may be read without any
+// intermediate buffers or transposes.
+template <class tFileScalar, class tElem>
+void WritePackedListH5(const std::string& field_name, const std::vector<tElem>& l, H5::Group* h5)
+{
+  using MemScalar = typename tElem::value_type;
+
+  static_assert(sizeof(tElem) == (3 * sizeof(MemScalar)), "list elements are not packed!");
+
+  H5::DataSet data_set = detail::CreateMatrixH5Helper<tFileScalar>(field_name, l.size(), 3,
+                                                                   h5, false);
+
+  if (!l.empty())
+  {
+    data_set.write(l[0].data(), LookupH5DataType<MemScalar>());
+  }
+}
+
+template <class tElem>
+std::vector<tElem> ReadPackedListH5(const std::string& field_name, const H5::Group& h5)
+{
+  using MemScalar = typename tElem::value_type;
+
+  static_assert(sizeof(tElem) == (3 * sizeof(MemScalar)), "list elements are not packed!");
+
+  const H5::DataSet data_set = h5.openDataSet(field_name);
+
+  const H5::DataSpace data_space = data_set.getSpace();
+
+  xregASSERT(data_space.getSimpleExtentNdims() == 2);
+
+  std::array<hsize_t,2> dims = { 0, 0 };
+  data_space.getSimpleExtentDims(dims.data());
+
+  xregASSERT(dims[1] == 3);
+
+  std::vector<tElem> l(dims[0]);
+
+  if (!l.empty())
+  {
+    // HDF5 converts from the file scalar type when necessary
+    data_set.read(l[0].data(), LookupH5DataType<MemScalar>());
+  }
+
+  return l;
+}
+
+TriMesh ReadMeshCacheH5(const H5::Group& h5)
+{
+  TriMesh mesh;
+
+  mesh.vertices = ReadPackedListH5<TriMesh::Vertex>("vertices-packed", h5);
+
+  mesh.faces = ReadPackedListH5<TriMesh::Triangle>("faces-packed", h5);
+
+  if (ObjectInGroupH5("face-normals-packed", h5))
+  {
+    mesh.normals = ReadPackedListH5<TriMesh::Vertex>("face-normals-packed", h5);
+    mesh.normals_valid = true;
+
+    if (ObjectInGroupH5("vertex-normals-packed", h5))
+    {
+      mesh.vertex_normals = ReadPackedListH5<TriMesh::Vertex>("vertex-normals-packed", h5);
+    }
+  }
+
+  return mesh;
+}
+
+}  // un-named
 
 xreg::TriMesh xreg::ReadMeshH5(const H5::Group& h5)
 {
+  if (ObjectInGroupH5("vertices-packed", h5))
+  {
+    return ReadMeshCacheH5(h5);
+  }
+
   TriMesh mesh;
 
   mesh.vertices = ReadListOfPointsFromMatrixH5Pt3("vertices", h5);
@@ -69,3 +154,40 @@ void xreg::WriteMeshH5File(const TriMesh& mesh, const std::string& path, const b
   h5.close();
 }
 
+
+void xreg::WriteMeshCacheH5(const TriMesh& mesh, H5::Group* h5)
+{
+  SetStringAttr("xreg-type", "tri-mesh-cache", h5);
+
+  WritePackedListH5<CoordScalar>("vertices-packed", mesh.vertices, h5);
+
+  // 32-bit indices are sufficient for nearly every mesh
+  if (mesh.vertices.size() <= std::numeric_limits<unsigned int>::max())
+  {
+    WritePackedListH5<unsigned int>("faces-packed", mesh.faces, h5);
+  }
+  else
+  {
+    WritePackedListH5<unsigned long>("faces-packed", mesh.faces, h5);
+  }
+
+  if (mesh.normals_valid)
+  {
+    WritePackedListH5<CoordScalar>("face-normals-packed", mesh.normals, h5);
+
+    if (!mesh.vertex_normals.empty())
+    {
+      WritePackedListH5<CoordScalar>("vertex-normals-packed", mesh.vertex_normals, h5);
+    }
+  }
+}
+
+void xreg::WriteMeshCacheH5File(const TriMesh& mesh, const std::string& path)
+{
+  H5::H5File h5(path, H5F_ACC_TRUNC);
+
+  WriteMeshCacheH5(mesh, &h5);
+
+  h5.flush(H5F_SCOPE_GLOBAL);
+  h5.close();
+}
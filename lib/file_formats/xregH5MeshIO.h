@@ -38,6 +38,7 @@ class Group;
 namespace xreg
 {
 
+/// \brief Reads a mesh written by either WriteMeshH5() or WriteMeshCacheH5().
 TriMesh ReadMeshH5(const H5::Group& h5);
 
 TriMesh ReadMeshH5File(const std::string& path);
@@ -46,6 +47,17 @@ void WriteMeshH5(const TriMesh& mesh, H5::Group* h5, const bool compress = true)
 
 void WriteMeshH5File(const TriMesh& mesh, const std::string& path, const bool compress = true);
 
+/// \brief Writes a mesh in a layout intended for fast loading.
+///
+/// Vertices, faces, and normals are stored uncompressed with the same layout
+/// as they are stored in memory, and face indices are stored using 32-bit
+/// integers when possible. The mesh is written as-is, e.g. duplicate vertices
+/// should have already been removed, so that no processing is needed when it
+/// is read back with ReadMeshH5().
+void WriteMeshCacheH5(const TriMesh& mesh, H5::Group* h5);
+
+void WriteMeshCacheH5File(const TriMesh& mesh, const std::string& path);
+
 }  // xreg
 
 #endif
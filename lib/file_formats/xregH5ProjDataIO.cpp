@@ -57,6 +57,56 @@ void AddProjDataLandsHelper(const LandMap2& lands, H5::Group* h5,
   }
 }
 
+template <class tPixelScalar>
+void WriteSingleProjDataH5Helper(const ProjData<tPixelScalar>& proj_data,
+                                 const size_type proj_idx,
+                                 H5::Group* h5,
+                                 const bool compress)
+{
+  H5::Group proj_g = h5->createGroup(fmt::format("proj-{:03d}", proj_idx));
+
+  // only add the image if it is non-null
+  if (proj_data.img)
+  {  
+    H5::Group img_g = proj_g.createGroup("img");
+
+    if (compress)
+    {
+      detail::WriteTiled2DImageH5Helper(proj_data.img.GetPointer(), &img_g);
+    }
+    else
+    {
+      WriteImageH5(proj_data.img.GetPointer(), &img_g, false);
+    }
+  }
+
+  H5::Group cam_g = proj_g.createGroup("cam");
+  WriteCamModelH5(proj_data.cam, &cam_g);
+
+  AddProjDataLandsHelper(proj_data.landmarks, &proj_g);
+
+  if (proj_data.rot_to_pat_up)
+  {
+    WriteSingleScalarH5("rot-to-pat-up",
+                        static_cast<int>(*proj_data.rot_to_pat_up), &proj_g);
+  }
+
+  if (proj_data.det_spacings_from_orig_meta)
+  {
+    WriteSingleScalarH5("det-spacings-from-orig-meta",
+                        *proj_data.det_spacings_from_orig_meta, &proj_g);
+  }
+
+  if (proj_data.orig_dcm_meta)
+  {
+    H5::Group orig_meta_g = proj_g.createGroup("orig-dcm-meta");
+    
+    SetStringAttr("meta-type", "dicom", &orig_meta_g);
+
+    WriteDICOMFieldsH5(*proj_data.orig_dcm_meta, &orig_meta_g);
+  }
+}
+
 template <class tPixelScalar>
 void WriteProjDataH5Helper(const std::vector<ProjData<tPixelScalar>>& proj_data,
                            H5::Group* h5,
@@ -70,40 +120,7 @@ void WriteProjDataH5Helper(const std::vector<ProjData<tPixelScalar>>& proj_data,
 
   for (size_type i = 0; i < num_projs; ++i)
   {
-    H5::Group proj_g = h5->createGroup(fmt::format("proj-{:03d}", i));
-
-    // only add the image if it is non-null
-    if (proj_data[i].img)
-    {  
-      H5::Group img_g = proj_g.createGroup("img");
-      WriteImageH5(proj_data[i].img.GetPointer(), &img_g, compress);
-    }
-
-    H5::Group cam_g = proj_g.createGroup("cam");
-    WriteCamModelH5(proj_data[i].cam, &cam_g);
-  
-    AddProjDataLandsHelper(proj_data[i].landmarks, &proj_g);
-
-    if (proj_data[i].rot_to_pat_up)
-    {
-      WriteSingleScalarH5("rot-to-pat-up",
-                          static_cast<int>(*proj_data[i].rot_to_pat_up), &proj_g);
-    }
-
-    if (proj_data[i].det_spacings_from_orig_meta)
-    {
-      WriteSingleScalarH5("det-spacings-from-orig-meta",
-                          *proj_data[i].det_spacings_from_orig_meta, &proj_g);
-    }
-
-    if (proj_data[i].orig_dcm_meta)
-    {
-      H5::Group orig_meta_g = proj_g.createGroup("orig-dcm-meta");
-      
-      SetStringAttr("meta-type", "dicom", &orig_meta_g);
-
-      WriteDICOMFieldsH5(*proj_data[i].orig_dcm_meta, &orig_meta_g);
-    }
+    WriteSingleProjDataH5Helper(proj_data[i], i, h5, compress);
   }
 }
 
@@ -238,6 +255,68 @@ void xreg::WriteProjDataH5(const CamImgPairU8& cam_img_pair,
   WriteProjDataH5Helper<unsigned char>(CamImgPairU8List(1, cam_img_pair), h5, compress);
 }
 
+xreg::ProjDataH5Writer::ProjDataH5Writer(const std::string& path, const bool compress)
+  : h5_(new H5::H5File(path, H5F_ACC_TRUNC)), compress_(compress)
+{
+  SetStringAttr("xreg-type", kXREG_PROJ_DATA_ATTR_STR, h5_.get());
+}
+
+xreg::ProjDataH5Writer::~ProjDataH5Writer()
+{
+  try
+  {
+    close();
+  }
+  catch (...)
+  {
+    // cannot throw from the destructor, close() should be called explicitly
+    // in order to observe any errors
+  }
+}
+
+void xreg::ProjDataH5Writer::write(const ProjDataF32& proj_data)
+{
+  xregASSERT(h5_);
+
+  WriteSingleProjDataH5Helper(proj_data, num_projs_, h5_.get(), compress_);
+  ++num_projs_;
+}
+
+void xreg::ProjDataH5Writer::write(const ProjDataU16& proj_data)
+{
+  xregASSERT(h5_);
+
+  WriteSingleProjDataH5Helper(proj_data, num_projs_, h5_.get(), compress_);
+  ++num_projs_;
+}
+
+void xreg::ProjDataH5Writer::write(const ProjDataU8& proj_data)
+{
+  xregASSERT(h5_);
+
+  WriteSingleProjDataH5Helper(proj_data, num_projs_, h5_.get(), compress_);
+  ++num_projs_;
+}
+
+xreg::size_type xreg::ProjDataH5Writer::num_projs() const
+{
+  return num_projs_;
+}
+
+void xreg::ProjDataH5Writer::close()
+{
+  if (h5_)
+  {
+    // the number of projections is only known once all have been written
+    WriteSingleScalarH5("num-projs", num_projs_, h5_.get());
+
+    h5_->flush(H5F_SCOPE_GLOBAL);
+    h5_->close();
+
+    h5_.reset();
+  }
+}
+
 namespace  // un-named
 {
 
@@ -355,6 +434,15 @@ ReadProjDataHelper(const H5::Group& h5, const bool read_pixels)
 
   ProjDataList projs(num_projs);
 
+  // the pixels of every projection are read together, so that decompression
+  // may be performed concurrently across all images
+  std::vector<H5DataSetReadDst> pixels_to_read;
+
+  if (read_pixels)
+  {
+    pixels_to_read.reserve(num_projs);
+  }
+
   for (size_type i = 0; i < num_projs; ++i)
   {
     const std::string proj_g_path = fmt::format("proj-{:03d}", i);
@@ -365,7 +453,13 @@ ReadProjDataHelper(const H5::Group& h5, const bool read_pixels)
 
     if (read_pixels)
     {
-      projs[i].img = detail::ReadNDImageH5Helper<PixelScalar,2>(proj_g.openGroup("img"));
+      H5::DataSet pixels_ds;
+
+      projs[i].img = detail::ReadNDImageMetaAndAllocH5Helper<PixelScalar,2>(
+                                                      proj_g.openGroup("img"), &pixels_ds);
+
+      pixels_to_read.push_back(H5DataSetReadDst{ pixels_ds, LookupH5DataType<PixelScalar>(),
+                                                 projs[i].img->GetBufferPointer() });
     }
 
     // Read landmarks if present
@@ -415,6 +509,8 @@ ReadProjDataHelper(const H5::Group& h5, const bool read_pixels)
     }
   }
 
+  ReadDataSetsH5(pixels_to_read);
+
   return projs;
 }
 
@@ -426,7 +522,16 @@ ReadSingleImgFromProjDataHelper(const H5::Group& h5, const size_type proj_idx)
 
   xregASSERT(proj_idx < num_projs);
   
-  return detail::ReadNDImageH5Helper<tPixelScalar,2>(h5.openGroup(fmt::format("proj-{:03d}/img", proj_idx)));
+  H5::DataSet pixels_ds;
+
+  auto img = detail::ReadNDImageMetaAndAllocH5Helper<tPixelScalar,2>(
+                              h5.openGroup(fmt::format("proj-{:03d}/img", proj_idx)), &pixels_ds);
+
+  // the tiles of the image are decompressed concurrently
+  ReadDataSetsH5({ H5DataSetReadDst{ pixels_ds, LookupH5DataType<tPixelScalar>(),
+                                     img->GetBufferPointer() } });
+
+  return img;
 }
 
 template <class tPixelScalar>
@@ -582,39 +687,41 @@ CastProjData(const std::vector<ProjData<tSrcScalar>>& src_pd)
 }
 
 template <class tScalar>
-typename ProjData<tScalar>::ProjPtr
-DeferredProjReaderHelpler(std::vector<ProjData<tScalar>>* pd_ptr,
-                          const size_type proj_idx,
-                          const std::string& pd_path_on_disk,
-                          const bool cache_imgs)
+struct ProjScalarTypeLookup;
+
+template <>
+struct ProjScalarTypeLookup<float>
 {
-  using Scalar  = tScalar;
-  using PD      = ProjData<Scalar>;
-  using ProjPtr = typename PD::ProjPtr;
+  static constexpr ProjDataScalarType value = kPROJ_DATA_TYPE_FLOAT32;
+};
 
-  auto& pd = *pd_ptr;
+template <>
+struct ProjScalarTypeLookup<unsigned short>
+{
+  static constexpr ProjDataScalarType value = kPROJ_DATA_TYPE_UINT16;
+};
 
-  xregASSERT(proj_idx < pd.size());
-  
-  ProjPtr to_ret;
-  
-  if (!cache_imgs || !pd[proj_idx].img)
-  {
-    to_ret = ReadSingleImgFromProjDataFromDiskHelper<Scalar>(pd_path_on_disk, proj_idx);
-  }
+template <>
+struct ProjScalarTypeLookup<unsigned char>
+{
+  static constexpr ProjDataScalarType value = kPROJ_DATA_TYPE_UINT8;
+};
 
-  if (cache_imgs)
-  {
-    pd[proj_idx].img = to_ret;
-  }
+template <class tPixelScalar>
+itk::DataObject::Pointer
+ImgForCache(const itk::SmartPointer<itk::Image<tPixelScalar,2>>& img, size_type* num_bytes)
+{
+  const auto itk_size = img->GetLargestPossibleRegion().GetSize();
 
-  return to_ret;
+  *num_bytes = itk_size[0] * itk_size[1] * sizeof(tPixelScalar);
+
+  return img.GetPointer();
 }
 
-}  // un-namd
+}  // un-named
 
 xreg::DeferredProjReader::DeferredProjReader(const std::string& path, const bool cache_imgs)
-  : orig_path_(path), cache_imgs_(cache_imgs)
+  : orig_path_(path), max_cache_bytes_(cache_imgs ? ~size_type(0) : size_type(0))
 {
   {
     H5::H5File h5(path, H5F_ACC_RDONLY);
@@ -629,6 +736,21 @@ xreg::DeferredProjReader::DeferredProjReader(const std::string& path, const bool
   proj_data_U8_  = CastProjData<unsigned char>(proj_data_F32_);
 }
 
+xreg::DeferredProjReader::~DeferredProjReader()
+{
+  if (prefetch_thread_.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_prefetch_ = true;
+    }
+
+    prefetch_queue_cv_.notify_all();
+
+    prefetch_thread_.join();
+  }
+}
+
 xreg::ProjDataScalarType xreg::DeferredProjReader::scalar_type_on_disk() const
 {
   return scalar_type_on_disk_;
@@ -660,19 +782,327 @@ xreg::DeferredProjReader::proj_data_U8()
 xreg::ProjDataF32::ProjPtr
 xreg::DeferredProjReader::read_proj_F32(const size_type proj_idx)
 {
-  return DeferredProjReaderHelpler<float>(&proj_data_F32_, proj_idx, orig_path_, cache_imgs_);
+  return read_proj<float>(proj_idx);
 }
 
 xreg::ProjDataU16::ProjPtr
 xreg::DeferredProjReader::read_proj_U16(const size_type proj_idx)
 {
-  return DeferredProjReaderHelpler<unsigned short>(&proj_data_U16_, proj_idx, orig_path_, cache_imgs_);
+  return read_proj<unsigned short>(proj_idx);
 }
 
 xreg::ProjDataU8::ProjPtr
 xreg::DeferredProjReader::read_proj_U8(const size_type proj_idx)
 {
-  return DeferredProjReaderHelpler<unsigned char>(&proj_data_U8_, proj_idx, orig_path_, cache_imgs_);
+  return read_proj<unsigned char>(proj_idx);
+}
+
+void xreg::DeferredProjReader::set_max_cache_bytes(const size_type max_bytes)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  max_cache_bytes_ = max_bytes;
+
+  evict_from_cache(0);
+}
+
+xreg::size_type xreg::DeferredProjReader::max_cache_bytes() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  return max_cache_bytes_;
+}
+
+xreg::size_type xreg::DeferredProjReader::cache_bytes() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  return cache_bytes_;
+}
+
+void xreg::DeferredProjReader::set_num_prefetch(const size_type num_prefetch)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    num_prefetch_ = num_prefetch;
+
+    if (!num_prefetch_)
+    {
+      prefetch_queue_.clear();
+    }
+  }
+
+  if (num_prefetch && !prefetch_thread_.joinable())
+  {
+    prefetch_thread_ = std::thread(&DeferredProjReader::prefetch_thread_fn, this);
+  }
+}
+
+xreg::size_type xreg::DeferredProjReader::num_prefetch() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  return num_prefetch_;
+}
+
+void xreg::DeferredProjReader::set_prefetch_order(const std::vector<size_type>& proj_order)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  prefetch_order_ = proj_order;
+
+  prefetch_order_pos_.clear();
+
+  const size_type num_in_order = prefetch_order_.size();
+
+  for (size_type i = 0; i < num_in_order; ++i)
+  {
+    xregASSERT(prefetch_order_[i] < num_projs_on_disk());
+
+    // the first occurrence is used for projections listed multiple times
+    prefetch_order_pos_.emplace(prefetch_order_[i], i);
+  }
+}
+
+template <class tScalar>
+typename itk::Image<tScalar,2>::Pointer
+xreg::DeferredProjReader::read_proj(const size_type proj_idx)
+{
+  using Img = itk::Image<tScalar,2>;
+
+  xregASSERT(proj_idx < num_projs_on_disk());
+
+  const CacheKey key(ProjScalarTypeLookup<tScalar>::value, proj_idx);
+
+  CachedImgPtr img;
+
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    // do not read a projection twice when it is being read ahead
+    prefetch_done_cv_.wait(lock, [this,&key] () { return !prefetch_in_progress_.count(key); });
+
+    img = find_in_cache(key);
+
+    update_prefetch_queue(key);
+  }
+
+  if (num_prefetch() || img)
+  {
+    prefetch_queue_cv_.notify_one();
+  }
+
+  if (!img)
+  {
+    const CacheEntry e = read_from_disk(key);
+
+    img = e.img;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    add_to_cache(e);
+  }
+
+  return static_cast<Img*>(img.GetPointer());
+}
+
+xreg::DeferredProjReader::CacheEntry
+xreg::DeferredProjReader::read_from_disk(const CacheKey& key)
+{
+  std::lock_guard<std::mutex> lock(read_mutex_);
+
+  CacheEntry e;
+  e.key = key;
+  e.num_bytes = 0;
+
+  switch (static_cast<ProjDataScalarType>(key.first))
+  {
+  case kPROJ_DATA_TYPE_FLOAT32:
+    e.img = ImgForCache<float>(
+              ReadSingleImgFromProjDataFromDiskHelper<float>(orig_path_, key.second),
+              &e.num_bytes);
+    break;
+  case kPROJ_DATA_TYPE_UINT16:
+    e.img = ImgForCache<unsigned short>(
+              ReadSingleImgFromProjDataFromDiskHelper<unsigned short>(orig_path_, key.second),
+              &e.num_bytes);
+    break;
+  case kPROJ_DATA_TYPE_UINT8:
+    e.img = ImgForCache<unsigned char>(
+              ReadSingleImgFromProjDataFromDiskHelper<unsigned char>(orig_path_, key.second),
+              &e.num_bytes);
+    break;
+  default:
+    xregThrow("unsupported proj data scalar type!");
+  }
+
+  return e;
+}
+
+xreg::DeferredProjReader::CachedImgPtr
+xreg::DeferredProjReader::find_in_cache(const CacheKey& key)
+{
+  CachedImgPtr img;
+
+  auto it = cache_map_.find(key);
+
+  if (it != cache_map_.end())
+  {
+    // move to the front - most recently used
+    cache_lru_.splice(cache_lru_.begin(), cache_lru_, it->second);
+
+    img = it->second->img;
+  }
+
+  return img;
+}
+
+void xreg::DeferredProjReader::add_to_cache(const CacheEntry& e)
+{
+  if (!cache_map_.count(e.key) && (e.num_bytes <= max_cache_bytes_))
+  {
+    evict_from_cache(e.num_bytes);
+
+    cache_lru_.push_front(e);
+
+    cache_map_.emplace(e.key, cache_lru_.begin());
+
+    cache_bytes_ += e.num_bytes;
+  }
+}
+
+void xreg::DeferredProjReader::evict_from_cache(const size_type num_bytes_needed)
+{
+  while (!cache_lru_.empty() && ((cache_bytes_ + num_bytes_needed) > max_cache_bytes_))
+  {
+    const CacheEntry& e = cache_lru_.back();
+
+    cache_bytes_ -= e.num_bytes;
+
+    cache_map_.erase(e.key);
+
+    cache_lru_.pop_back();
+  }
+}
+
+void xreg::DeferredProjReader::update_prefetch_queue(const CacheKey& key)
+{
+  const size_type proj_idx = key.second;
+
+  if (have_prev_request_ && (proj_idx != prev_request_idx_))
+  {
+    request_stride_ = static_cast<long>(proj_idx) - static_cast<long>(prev_request_idx_);
+  }
+
+  have_prev_request_ = true;
+  prev_request_idx_  = proj_idx;
+
+  // the most recent request determines what should be read next, anything
+  // queued by previous requests is no longer relevant
+  prefetch_queue_.clear();
+
+  if (!num_prefetch_)
+  {
+    return;
+  }
+
+  const long num_projs = static_cast<long>(num_projs_on_disk());
+
+  auto queue_if_needed = [this,&key] (const size_type next_idx)
+  {
+    const CacheKey next_key(key.first, next_idx);
+
+    if (!cache_map_.count(next_key) && !prefetch_in_progress_.count(next_key))
+    {
+      prefetch_queue_.push_back(next_key);
+    }
+  };
+
+  if (!prefetch_order_.empty())
+  {
+    auto pos_it = prefetch_order_pos_.find(proj_idx);
+
+    if (pos_it != prefetch_order_pos_.end())
+    {
+      const size_type num_in_order = prefetch_order_.size();
+
+      for (size_type i = pos_it->second + 1;
+           (i < num_in_order) && (i <= (pos_it->second + num_prefetch_)); ++i)
+      {
+        queue_if_needed(prefetch_order_[i]);
+      }
+    }
+  }
+  else
+  {
+    for (size_type i = 1; i <= num_prefetch_; ++i)
+    {
+      const long next_idx = static_cast<long>(proj_idx) + (static_cast<long>(i) * request_stride_);
+
+      if ((next_idx < 0) || (next_idx >= num_projs))
+      {
+        break;
+      }
+
+      queue_if_needed(static_cast<size_type>(next_idx));
+    }
+  }
+}
+
+void xreg::DeferredProjReader::prefetch_thread_fn()
+{
+  while (true)
+  {
+    CacheKey key;
+
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+
+      prefetch_queue_cv_.wait(lock, [this] () { return stop_prefetch_ || !prefetch_queue_.empty(); });
+
+      if (stop_prefetch_)
+      {
+        break;
+      }
+
+      key = prefetch_queue_.front();
+      prefetch_queue_.pop_front();
+
+      // the projection may have been read by a request since being queued
+      if (cache_map_.count(key) || !max_cache_bytes_)
+      {
+        continue;
+      }
+
+      prefetch_in_progress_.insert(key);
+    }
+
+    CacheEntry e;
+
+    try
+    {
+      e = read_from_disk(key);
+    }
+    catch (...)
+    {
+      // any error will be reported when the projection is requested and read
+      // by the requesting thread
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      prefetch_in_progress_.erase(key);
+
+      if (e.img)
+      {
+        add_to_cache(e);
+      }
+    }
+
+    prefetch_done_cv_.notify_all();
+  }
 }
 
 void xreg::AddLandsToProjDataH5(const LandMap2& lands, const size_type proj_idx,
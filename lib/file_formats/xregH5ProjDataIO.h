@@ -25,6 +25,15 @@
 #ifndef XREGH5PROJDATAIO_H_
 #define XREGH5PROJDATAIO_H_
 
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+
 #include "xregProjData.h"
 
 // forward declaration
@@ -32,6 +41,7 @@ namespace H5
 {
 
 class Group;
+class H5File;
 
 }  // H5
 
@@ -48,6 +58,11 @@ void ReadProjDataFromH5AndWriteToDisk(const H5::Group& h5, const std::string& ds
 // Write to HDF5 Data Structures
 //////////////////////////////////////////////////
 
+// When compression is enabled, the pixels of each projection are stored in
+// 2D tiles compressed with the standard HDF5 shuffle and deflate filters, see
+// WriteTiled2DH5(). The readers decompress the tiles of all projections
+// concurrently, see ReadDataSetsH5().
+
 void WriteProjDataH5(const ProjDataF32List& proj_data,
                      H5::Group* h5,
                      const bool compress = true);
@@ -148,6 +163,52 @@ void WriteProjDataH5ToDisk(const CamImgPairU8& cam_img_pair,
                            const std::string& path,
                            const bool compress = true);
 
+/// \brief Writes projections to an HDF5 file one at a time.
+///
+/// The file layout is identical to that written by WriteProjDataH5ToDisk(),
+/// however the projections do not need to be held in memory simultaneously;
+/// e.g. a converter may write each projection as soon as it has been read and
+/// release it. The number of projections is written when the file is closed.
+///
+/// NOTE: HDF5 calls are not made concurrently, so write() should not be
+///       called while other threads are making HDF5 calls.
+class ProjDataH5Writer
+{
+public:
+  /// \brief Creates the file, replacing any existing file.
+  explicit ProjDataH5Writer(const std::string& path, const bool compress = true);
+
+  /// \brief Closes the file if close() has not been called; any errors are
+  ///        ignored.
+  ~ProjDataH5Writer();
+
+  // no copying
+  ProjDataH5Writer(const ProjDataH5Writer&) = delete;
+  ProjDataH5Writer& operator=(const ProjDataH5Writer&) = delete;
+
+  /// \brief Appends a projection to the file.
+  void write(const ProjDataF32& proj_data);
+  
+  void write(const ProjDataU16& proj_data);
+  
+  void write(const ProjDataU8& proj_data);
+
+  /// \brief The number of projections written so far.
+  size_type num_projs() const;
+
+  /// \brief Writes the number of projections, flushes and closes the file.
+  ///
+  /// No projections may be written after calling this.
+  void close();
+
+private:
+  std::unique_ptr<H5::H5File> h5_;
+
+  bool compress_;
+
+  size_type num_projs_ = 0;
+};
+
 //////////////////////////////////////////////////
 // Read from HDF5 Data Structures
 //////////////////////////////////////////////////
@@ -201,11 +262,35 @@ ProjDataScalarType GetProjDataScalarTypeFromDisk(const std::string& path);
 // Reader that does not read all projections in simultaneously - they may be read in
 // sequentially as they need to be processed
 
+/// \brief Reads projection images from disk as they are requested.
+///
+/// Images which have been read are kept in a least recently used (LRU) cache,
+/// bounded by the total number of bytes of pixels cached.
+///
+/// A background thread may be used to read ahead of the requests, so that
+/// reading from disk overlaps with processing of the previous projections.
+/// The projections read ahead are either those following the most recent
+/// request in a specified order, or, when no order is specified, those
+/// continuing the stride between the two most recent requests (e.g. the next
+/// projections when reading sequentially). Projections read ahead are stored
+/// in the cache, so the cache size should allow for at least the number of
+/// projections read ahead.
+///
+/// NOTE: The HDF5 library is typically not built to be thread-safe, so
+///       while reading ahead is enabled, other threads should not be
+///       making HDF5 calls.
 class DeferredProjReader
 {
 public:
+  /// \brief Opens the projection data file and reads all metadata.
+  ///
+  /// When cache_imgs is true, the cache size is not bounded, otherwise no
+  /// images are cached.
   explicit DeferredProjReader(const std::string& path, const bool cache_imgs = false);
   
+  /// \brief Stops and waits for the thread reading ahead.
+  ~DeferredProjReader();
+
   DeferredProjReader(const DeferredProjReader&) = delete;
   DeferredProjReader& operator=(const DeferredProjReader&) = delete;
 
@@ -225,17 +310,117 @@ public:
   
   ProjDataU8::ProjPtr read_proj_U8(const size_type proj_idx);
 
+  /// \brief Sets the maximum number of bytes of pixels stored in the cache.
+  ///
+  /// Least recently used images are evicted from the cache when adding an
+  /// image would exceed this size. A size of 0 disables caching.
+  void set_max_cache_bytes(const size_type max_bytes);
+
+  size_type max_cache_bytes() const;
+
+  /// \brief The number of bytes of pixels currently stored in the cache.
+  size_type cache_bytes() const;
+
+  /// \brief Sets the number of projections to read ahead of each request.
+  ///
+  /// The background thread is started the first time this is set to a
+  /// non-zero value. A value of 0 disables reading ahead, which is the default.
+  void set_num_prefetch(const size_type num_prefetch);
+
+  size_type num_prefetch() const;
+
+  /// \brief Sets the order in which projections are expected to be requested.
+  ///
+  /// After a projection is requested, the next num_prefetch() projections in
+  /// this order are read ahead. An empty order, the default, indicates that
+  /// the stride between requests should be used.
+  void set_prefetch_order(const std::vector<size_type>& proj_order);
+
 private:
+  // (scalar type, projection index)
+  using CacheKey = std::pair<int,size_type>;
 
-  const std::string orig_path_;
+  using CachedImgPtr = itk::DataObject::Pointer;
+
+  struct CacheEntry
+  {
+    CacheKey key;
+
+    CachedImgPtr img;
+
+    size_type num_bytes;
+  };
 
-  bool cache_imgs_;
+  using CacheList = std::list<CacheEntry>;
+
+  template <class tScalar>
+  typename itk::Image<tScalar,2>::Pointer read_proj(const size_type proj_idx);
+
+  /// \brief Reads an image, the key and number of bytes of the returned
+  ///        entry are also populated.
+  CacheEntry read_from_disk(const CacheKey& key);
+
+  // the following require mutex_ to be locked
+
+  CachedImgPtr find_in_cache(const CacheKey& key);
+
+  void add_to_cache(const CacheEntry& e);
+
+  void evict_from_cache(const size_type num_bytes_needed);
+
+  void update_prefetch_queue(const CacheKey& key);
+
+  void prefetch_thread_fn();
+
+  const std::string orig_path_;
 
   ProjDataScalarType scalar_type_on_disk_;
 
   ProjDataF32List proj_data_F32_;
   ProjDataU16List proj_data_U16_;
   ProjDataU8List  proj_data_U8_;
+
+  /// \brief Protects the cache and the state of reading ahead
+  mutable std::mutex mutex_;
+
+  /// \brief Serializes reads of the file
+  std::mutex read_mutex_;
+
+  /// \brief Most recently used entries are at the front
+  CacheList cache_lru_;
+
+  std::map<CacheKey,CacheList::iterator> cache_map_;
+
+  size_type cache_bytes_ = 0;
+
+  size_type max_cache_bytes_ = 0;
+
+  size_type num_prefetch_ = 0;
+
+  std::vector<size_type> prefetch_order_;
+
+  /// \brief The position of each projection in prefetch_order_
+  std::map<size_type,size_type> prefetch_order_pos_;
+
+  /// \brief Projections to be read by the background thread, in order
+  std::deque<CacheKey> prefetch_queue_;
+
+  /// \brief Projections currently being read by the background thread
+  std::set<CacheKey> prefetch_in_progress_;
+
+  bool have_prev_request_ = false;
+
+  size_type prev_request_idx_ = 0;
+
+  long request_stride_ = 1;
+
+  bool stop_prefetch_ = false;
+
+  std::condition_variable prefetch_queue_cv_;
+
+  std::condition_variable prefetch_done_cv_;
+
+  std::thread prefetch_thread_;
 };
 
 void AddLandsToProjDataH5(const LandMap2& lands, const size_type proj_idx,
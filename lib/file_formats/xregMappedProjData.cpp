@@ -0,0 +1,654 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregMappedProjData.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <fmt/format.h>
+
+#include "xregAssert.h"
+#include "xregFilesystemUtils.h"
+#include "xregITKBasicImageUtils.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+constexpr char kMAPPED_PROJ_DATA_MAGIC[8] = { 'X', 'R', 'E', 'G', 'P', 'D', 'M', 'M' };
+
+constexpr Stream::uint32 kMAPPED_PROJ_DATA_VERSION = 1;
+
+// written as a native integer, so that files with foreign byte order are detected
+constexpr Stream::uint32 kMAPPED_PROJ_DATA_BYTE_ORDER_MARK = 0x01020304;
+
+// pixel arrays are aligned to this boundary, which is a multiple of the page
+// size on all supported platforms
+constexpr size_type kMAPPED_PROJ_DATA_PIXELS_ALIGN = 65536;
+
+constexpr size_type kMAPPED_PROJ_DATA_HEADER_NUM_BYTES = 64;
+
+// num rows, num cols, coord frame type and padding, row spacing, col spacing,
+// intrinsics, extrinsics, image spacing, image origin, image direction, pixel offset
+constexpr size_type kMAPPED_PROJ_DATA_PROJ_META_NUM_BYTES = (2 * 8) + (2 * 4) + (2 * 8) +
+                                                            (9 * 8) + (16 * 8) +
+                                                            (2 * 8) + (2 * 8) + (4 * 8) + 8;
+
+template <class tPixelScalar>
+struct MappedScalarTypeLookup;
+
+template <>
+struct MappedScalarTypeLookup<float>
+{
+  static constexpr ProjDataScalarType value = kPROJ_DATA_TYPE_FLOAT32;
+};
+
+template <>
+struct MappedScalarTypeLookup<unsigned short>
+{
+  static constexpr ProjDataScalarType value = kPROJ_DATA_TYPE_UINT16;
+};
+
+template <>
+struct MappedScalarTypeLookup<unsigned char>
+{
+  static constexpr ProjDataScalarType value = kPROJ_DATA_TYPE_UINT8;
+};
+
+size_type MappedPixelScalarNumBytes(const ProjDataScalarType scalar_type)
+{
+  size_type num_bytes = 0;
+
+  switch (scalar_type)
+  {
+  case kPROJ_DATA_TYPE_FLOAT32:
+    num_bytes = sizeof(float);
+    break;
+  case kPROJ_DATA_TYPE_UINT16:
+    num_bytes = sizeof(unsigned short);
+    break;
+  case kPROJ_DATA_TYPE_UINT8:
+    num_bytes = sizeof(unsigned char);
+    break;
+  default:
+    xregThrow("unsupported proj data scalar type!");
+  }
+
+  return num_bytes;
+}
+
+size_type AlignMappedOffset(const size_type off)
+{
+  return ((off + kMAPPED_PROJ_DATA_PIXELS_ALIGN - 1) / kMAPPED_PROJ_DATA_PIXELS_ALIGN) *
+                                                          kMAPPED_PROJ_DATA_PIXELS_ALIGN;
+}
+
+void WriteZeroPadding(const size_type num_bytes, OutputStream* out)
+{
+  if (num_bytes)
+  {
+    const std::vector<Stream::uint8> zeros(num_bytes, 0);
+
+    out->write(zeros.data(), num_bytes);
+  }
+}
+
+template <class tPixelScalar>
+void WriteProjDataMappedHelper(const std::vector<ProjData<tPixelScalar>>& proj_data,
+                               const std::string& path)
+{
+  using PixelScalar = tPixelScalar;
+
+  const size_type num_projs = proj_data.size();
+
+  // compute the location of each pixel array
+  std::vector<size_type> pixels_offsets(num_projs);
+
+  size_type cur_off = AlignMappedOffset(kMAPPED_PROJ_DATA_HEADER_NUM_BYTES +
+                                        (num_projs * kMAPPED_PROJ_DATA_PROJ_META_NUM_BYTES));
+
+  for (size_type proj_idx = 0; proj_idx < num_projs; ++proj_idx)
+  {
+    const auto& pd = proj_data[proj_idx];
+
+    xregASSERT(pd.img);
+
+    const auto itk_size = pd.img->GetLargestPossibleRegion().GetSize();
+
+    if ((itk_size[0] != pd.cam.num_det_cols) || (itk_size[1] != pd.cam.num_det_rows))
+    {
+      xregThrow("image dimensions of projection %lu do not match the camera model!",
+                static_cast<unsigned long>(proj_idx));
+    }
+
+    pixels_offsets[proj_idx] = cur_off;
+
+    cur_off = AlignMappedOffset(cur_off + (itk_size[0] * itk_size[1] * sizeof(PixelScalar)));
+  }
+
+  FileOutputStream out(path);
+
+  // header
+  out.write(reinterpret_cast<const Stream::int8*>(kMAPPED_PROJ_DATA_MAGIC), 8);
+  out.write(kMAPPED_PROJ_DATA_VERSION);
+  out.write(kMAPPED_PROJ_DATA_BYTE_ORDER_MARK);
+  out.write(static_cast<Stream::uint32>(MappedScalarTypeLookup<PixelScalar>::value));
+  out.write(static_cast<Stream::uint32>(sizeof(PixelScalar)));
+  out.write(static_cast<Stream::uint64>(num_projs));
+  out.write(static_cast<Stream::uint64>(kMAPPED_PROJ_DATA_PIXELS_ALIGN));
+
+  WriteZeroPadding(kMAPPED_PROJ_DATA_HEADER_NUM_BYTES - out.num_bytes_written(), &out);
+
+  // camera models and image metadata
+  for (size_type proj_idx = 0; proj_idx < num_projs; ++proj_idx)
+  {
+    const auto& cam = proj_data[proj_idx].cam;
+    const auto& img = proj_data[proj_idx].img;
+
+    out.write(static_cast<Stream::uint64>(cam.num_det_rows));
+    out.write(static_cast<Stream::uint64>(cam.num_det_cols));
+    out.write(static_cast<Stream::uint32>(cam.coord_frame_type));
+    out.write(static_cast<Stream::uint32>(0));
+    out.write(static_cast<Stream::float64>(cam.det_row_spacing));
+    out.write(static_cast<Stream::float64>(cam.det_col_spacing));
+
+    // intrinsics and extrinsics are both written in row-major order
+    for (size_type r = 0; r < 3; ++r)
+    {
+      for (size_type c = 0; c < 3; ++c)
+      {
+        out.write(static_cast<Stream::float64>(cam.intrins(r,c)));
+      }
+    }
+
+    for (size_type r = 0; r < 4; ++r)
+    {
+      for (size_type c = 0; c < 4; ++c)
+      {
+        out.write(static_cast<Stream::float64>(cam.extrins.matrix()(r,c)));
+      }
+    }
+
+    const auto& img_spacing = img->GetSpacing();
+    const auto& img_origin  = img->GetOrigin();
+    const auto& img_dir     = img->GetDirection();
+
+    out.write(static_cast<Stream::float64>(img_spacing[0]));
+    out.write(static_cast<Stream::float64>(img_spacing[1]));
+    out.write(static_cast<Stream::float64>(img_origin[0]));
+    out.write(static_cast<Stream::float64>(img_origin[1]));
+
+    for (size_type r = 0; r < 2; ++r)
+    {
+      for (size_type c = 0; c < 2; ++c)
+      {
+        out.write(static_cast<Stream::float64>(img_dir(r,c)));
+      }
+    }
+
+    out.write(static_cast<Stream::uint64>(pixels_offsets[proj_idx]));
+  }
+
+  xregASSERT(out.num_bytes_written() == (kMAPPED_PROJ_DATA_HEADER_NUM_BYTES +
+                                         (num_projs * kMAPPED_PROJ_DATA_PROJ_META_NUM_BYTES)));
+
+  // pixels
+  for (size_type proj_idx = 0; proj_idx < num_projs; ++proj_idx)
+  {
+    const auto& img = proj_data[proj_idx].img;
+
+    WriteZeroPadding(pixels_offsets[proj_idx] - out.num_bytes_written(), &out);
+
+    const auto itk_size = img->GetLargestPossibleRegion().GetSize();
+
+    out.write(img->GetBufferPointer(), itk_size[0] * itk_size[1]);
+  }
+
+  // pad the final array so that the file size is a multiple of the alignment,
+  // this keeps the entire last page of a mapping backed by the file
+  WriteZeroPadding(AlignMappedOffset(out.num_bytes_written()) - out.num_bytes_written(), &out);
+}
+
+// Sequentially reads values from the mapped header and metadata
+class MappedMetaCursor
+{
+public:
+  MappedMetaCursor(const void* buf, const size_type num_bytes)
+    : buf_(static_cast<const unsigned char*>(buf)), num_bytes_(num_bytes)
+  { }
+
+  template <class T>
+  T read()
+  {
+    if ((off_ + sizeof(T)) > num_bytes_)
+    {
+      xregThrow("mapped proj data file is truncated!");
+    }
+
+    T x;
+    std::memcpy(&x, buf_ + off_, sizeof(T));
+
+    off_ += sizeof(T);
+
+    return x;
+  }
+
+  void skip(const size_type num_bytes)
+  {
+    off_ += num_bytes;
+  }
+
+  void seek(const size_type off)
+  {
+    off_ = off;
+  }
+
+private:
+  const unsigned char* buf_;
+
+  size_type num_bytes_;
+
+  size_type off_ = 0;
+};
+
+}  // un-named
+
+void xreg::WriteProjDataMappedToDisk(const ProjDataF32List& proj_data, const std::string& path)
+{
+  WriteProjDataMappedHelper(proj_data, path);
+}
+
+void xreg::WriteProjDataMappedToDisk(const ProjDataU16List& proj_data, const std::string& path)
+{
+  WriteProjDataMappedHelper(proj_data, path);
+}
+
+void xreg::WriteProjDataMappedToDisk(const ProjDataU8List& proj_data, const std::string& path)
+{
+  WriteProjDataMappedHelper(proj_data, path);
+}
+
+void xreg::ConvertProjDataH5ToMapped(const std::string& src_h5_path, const std::string& dst_path)
+{
+  switch (GetProjDataScalarTypeFromDisk(src_h5_path))
+  {
+  case kPROJ_DATA_TYPE_FLOAT32:
+    WriteProjDataMappedToDisk(ReadProjDataH5F32FromDisk(src_h5_path), dst_path);
+    break;
+  case kPROJ_DATA_TYPE_UINT16:
+    WriteProjDataMappedToDisk(ReadProjDataH5U16FromDisk(src_h5_path), dst_path);
+    break;
+  case kPROJ_DATA_TYPE_UINT8:
+    WriteProjDataMappedToDisk(ReadProjDataH5U8FromDisk(src_h5_path), dst_path);
+    break;
+  default:
+    xregThrow("unsupported proj data scalar type!");
+  }
+}
+
+void xreg::ConvertProjDataMappedToH5(const std::string& src_path, const std::string& dst_h5_path,
+                                     const bool compress)
+{
+  const MappedProjData mapped_pd(src_path);
+
+  switch (mapped_pd.scalar_type())
+  {
+  case kPROJ_DATA_TYPE_FLOAT32:
+    WriteProjDataH5ToDisk(mapped_pd.proj_data_F32(), dst_h5_path, compress);
+    break;
+  case kPROJ_DATA_TYPE_UINT16:
+    WriteProjDataH5ToDisk(mapped_pd.proj_data_U16(), dst_h5_path, compress);
+    break;
+  case kPROJ_DATA_TYPE_UINT8:
+    WriteProjDataH5ToDisk(mapped_pd.proj_data_U8(), dst_h5_path, compress);
+    break;
+  default:
+    xregThrow("unsupported proj data scalar type!");
+  }
+}
+
+xreg::MappedProjData::MappedProjData(const std::string& path)
+{
+#ifdef _WIN32
+  file_handle_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                             OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file_handle_ == INVALID_HANDLE_VALUE)
+  {
+    file_handle_ = nullptr;
+    xregThrow("failed to open mapped proj data file: %s", path.c_str());
+  }
+
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file_handle_, &file_size))
+  {
+    CloseHandle(file_handle_);
+    xregThrow("failed to get size of mapped proj data file: %s", path.c_str());
+  }
+
+  map_num_bytes_ = static_cast<size_type>(file_size.QuadPart);
+
+  map_handle_ = CreateFileMappingA(file_handle_, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+  if (!map_handle_)
+  {
+    CloseHandle(file_handle_);
+    xregThrow("failed to create mapping of proj data file: %s", path.c_str());
+  }
+
+  map_ptr_ = MapViewOfFile(map_handle_, FILE_MAP_COPY, 0, 0, 0);
+  if (!map_ptr_)
+  {
+    CloseHandle(map_handle_);
+    CloseHandle(file_handle_);
+    xregThrow("failed to map proj data file: %s", path.c_str());
+  }
+#else
+  fd_ = open(path.c_str(), O_RDONLY);
+  if (fd_ < 0)
+  {
+    xregThrow("failed to open mapped proj data file: %s", path.c_str());
+  }
+
+  struct stat file_stat;
+  if (fstat(fd_, &file_stat))
+  {
+    close(fd_);
+    xregThrow("failed to get size of mapped proj data file: %s", path.c_str());
+  }
+
+  map_num_bytes_ = static_cast<size_type>(file_stat.st_size);
+
+  if (!map_num_bytes_)
+  {
+    close(fd_);
+    xregThrow("mapped proj data file is empty: %s", path.c_str());
+  }
+
+  // private, copy-on-write, mapping: pages are shared with other processes
+  // mapping the same file until they are written to
+  map_ptr_ = mmap(nullptr, map_num_bytes_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd_, 0);
+  if (map_ptr_ == MAP_FAILED)
+  {
+    map_ptr_ = nullptr;
+    close(fd_);
+    xregThrow("failed to map proj data file: %s", path.c_str());
+  }
+#endif
+
+  try
+  {
+    MappedMetaCursor cur(map_ptr_, map_num_bytes_);
+
+    char magic[8];
+    for (size_type i = 0; i < 8; ++i)
+    {
+      magic[i] = cur.read<char>();
+    }
+
+    if (std::memcmp(magic, kMAPPED_PROJ_DATA_MAGIC, 8))
+    {
+      xregThrow("not a mapped proj data file: %s", path.c_str());
+    }
+
+    const auto version = cur.read<Stream::uint32>();
+    if (version != kMAPPED_PROJ_DATA_VERSION)
+    {
+      xregThrow("unsupported mapped proj data version: %u", static_cast<unsigned>(version));
+    }
+
+    if (cur.read<Stream::uint32>() != kMAPPED_PROJ_DATA_BYTE_ORDER_MARK)
+    {
+      xregThrow("mapped proj data file was written with a different byte order!");
+    }
+
+    scalar_type_ = static_cast<ProjDataScalarType>(cur.read<Stream::uint32>());
+
+    const size_type scalar_num_bytes = cur.read<Stream::uint32>();
+
+    if (scalar_num_bytes != MappedPixelScalarNumBytes(scalar_type_))
+    {
+      xregThrow("inconsistent pixel scalar size in mapped proj data file!");
+    }
+
+    const size_type num_projs = cur.read<Stream::uint64>();
+
+    // the alignment is not needed for reading, since every pixel offset is stored
+    cur.read<Stream::uint64>();
+
+    cur.seek(kMAPPED_PROJ_DATA_HEADER_NUM_BYTES);
+
+    cams_.resize(num_projs);
+    proj_metas_.resize(num_projs);
+
+    for (size_type proj_idx = 0; proj_idx < num_projs; ++proj_idx)
+    {
+      auto& cam = cams_[proj_idx];
+      auto& pm  = proj_metas_[proj_idx];
+
+      const size_type num_rows = cur.read<Stream::uint64>();
+      const size_type num_cols = cur.read<Stream::uint64>();
+
+      cam.coord_frame_type = static_cast<CameraModel::CameraCoordFrame>(cur.read<Stream::uint32>());
+      cur.skip(4);
+
+      const CoordScalar row_spacing = cur.read<Stream::float64>();
+      const CoordScalar col_spacing = cur.read<Stream::float64>();
+
+      Mat3x3 intrins;
+      for (size_type r = 0; r < 3; ++r)
+      {
+        for (size_type c = 0; c < 3; ++c)
+        {
+          intrins(r,c) = cur.read<Stream::float64>();
+        }
+      }
+
+      Mat4x4 extrins;
+      for (size_type r = 0; r < 4; ++r)
+      {
+        for (size_type c = 0; c < 4; ++c)
+        {
+          extrins(r,c) = cur.read<Stream::float64>();
+        }
+      }
+
+      cam.setup(intrins, extrins, num_rows, num_cols, row_spacing, col_spacing);
+
+      pm.img_spacing[0] = cur.read<Stream::float64>();
+      pm.img_spacing[1] = cur.read<Stream::float64>();
+      pm.img_origin[0]  = cur.read<Stream::float64>();
+      pm.img_origin[1]  = cur.read<Stream::float64>();
+
+      for (size_type i = 0; i < 4; ++i)
+      {
+        pm.img_dir[i] = cur.read<Stream::float64>();
+      }
+
+      pm.pixels_offset = cur.read<Stream::uint64>();
+
+      if ((pm.pixels_offset + (num_rows * num_cols * scalar_num_bytes)) > map_num_bytes_)
+      {
+        xregThrow("pixels of projection %lu extend past the end of the mapped file!",
+                  static_cast<unsigned long>(proj_idx));
+      }
+
+      if (pm.pixels_offset % scalar_num_bytes)
+      {
+        xregThrow("pixels of projection %lu are not aligned!",
+                  static_cast<unsigned long>(proj_idx));
+      }
+    }
+  }
+  catch (...)
+  {
+#ifdef _WIN32
+    UnmapViewOfFile(map_ptr_);
+    CloseHandle(map_handle_);
+    CloseHandle(file_handle_);
+#else
+    munmap(map_ptr_, map_num_bytes_);
+    close(fd_);
+#endif
+    throw;
+  }
+}
+
+xreg::MappedProjData::~MappedProjData()
+{
+#ifdef _WIN32
+  UnmapViewOfFile(map_ptr_);
+  CloseHandle(map_handle_);
+  CloseHandle(file_handle_);
+#else
+  munmap(map_ptr_, map_num_bytes_);
+  close(fd_);
+#endif
+}
+
+xreg::size_type xreg::MappedProjData::num_projs() const
+{
+  return cams_.size();
+}
+
+xreg::ProjDataScalarType xreg::MappedProjData::scalar_type() const
+{
+  return scalar_type_;
+}
+
+const std::vector<xreg::CameraModel>& xreg::MappedProjData::cams() const
+{
+  return cams_;
+}
+
+xreg::ProjDataF32List xreg::MappedProjData::proj_data_F32() const
+{
+  return proj_data<float>();
+}
+
+xreg::ProjDataU16List xreg::MappedProjData::proj_data_U16() const
+{
+  return proj_data<unsigned short>();
+}
+
+xreg::ProjDataU8List xreg::MappedProjData::proj_data_U8() const
+{
+  return proj_data<unsigned char>();
+}
+
+xreg::ProjDataF32::ProjPtr xreg::MappedProjData::img_F32(const size_type proj_idx) const
+{
+  return img<float>(proj_idx);
+}
+
+xreg::ProjDataU16::ProjPtr xreg::MappedProjData::img_U16(const size_type proj_idx) const
+{
+  return img<unsigned short>(proj_idx);
+}
+
+xreg::ProjDataU8::ProjPtr xreg::MappedProjData::img_U8(const size_type proj_idx) const
+{
+  return img<unsigned char>(proj_idx);
+}
+
+xreg::size_type xreg::MappedProjData::num_bytes_mapped() const
+{
+  return map_num_bytes_;
+}
+
+template <class tPixelScalar>
+std::vector<xreg::ProjData<tPixelScalar>> xreg::MappedProjData::proj_data() const
+{
+  const size_type np = num_projs();
+
+  std::vector<ProjData<tPixelScalar>> pd(np);
+
+  for (size_type proj_idx = 0; proj_idx < np; ++proj_idx)
+  {
+    pd[proj_idx].cam = cams_[proj_idx];
+    pd[proj_idx].img = img<tPixelScalar>(proj_idx);
+  }
+
+  return pd;
+}
+
+template <class tPixelScalar>
+typename itk::Image<tPixelScalar,2>::Pointer
+xreg::MappedProjData::img(const size_type proj_idx) const
+{
+  using PixelScalar  = tPixelScalar;
+  using Img          = itk::Image<PixelScalar,2>;
+  using ImgPixelCont = typename Img::PixelContainer;
+
+  if (MappedScalarTypeLookup<PixelScalar>::value != scalar_type_)
+  {
+    xregThrow("requested pixel type does not match the type stored in the mapped file!");
+  }
+
+  xregASSERT(proj_idx < num_projs());
+
+  const auto& cam = cams_[proj_idx];
+  const auto& pm  = proj_metas_[proj_idx];
+
+  const size_type num_pix = cam.num_det_rows * cam.num_det_cols;
+
+  auto img = Img::New();
+
+  // the container does not own the buffer, it is released when the file is unmapped
+  auto img_pixel_container = ImgPixelCont::New();
+  img_pixel_container->SetImportPointer(reinterpret_cast<PixelScalar*>(
+                                          static_cast<unsigned char*>(map_ptr_) + pm.pixels_offset),
+                                        num_pix, false);
+
+  img->SetPixelContainer(img_pixel_container);
+
+  typename Img::RegionType img_region;
+  img_region.GetModifiableIndex().Fill(0);
+  img_region.GetModifiableSize()[0] = cam.num_det_cols;
+  img_region.GetModifiableSize()[1] = cam.num_det_rows;
+
+  img->SetRegions(img_region);
+
+  img->SetSpacing(pm.img_spacing.data());
+  img->SetOrigin(pm.img_origin.data());
+
+  typename Img::DirectionType img_dir;
+  img_dir(0,0) = pm.img_dir[0];
+  img_dir(0,1) = pm.img_dir[1];
+  img_dir(1,0) = pm.img_dir[2];
+  img_dir(1,1) = pm.img_dir[3];
+
+  img->SetDirection(img_dir);
+
+  return img;
+}
+
@@ -0,0 +1,138 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGMAPPEDPROJDATA_H_
+#define XREGMAPPEDPROJDATA_H_
+
+#include "xregH5ProjDataIO.h"
+
+namespace xreg
+{
+
+// A simple, uncompressed, container for projection data which may be memory
+// mapped. The file consists of a header, the camera model and image metadata
+// of each projection, followed by the pixels of each projection stored
+// contiguously in row-major order. Each pixel array begins on a page boundary.
+// Values are stored using the native byte order of the host that wrote the file.
+//
+// Projection images read from a mapped file alias the pixels of the mapping
+// without copying. When several processes on a single node open the same file,
+// they share a single copy of the pixels in the OS page cache.
+//
+// Landmarks, DICOM metadata and other optional projection fields are not stored.
+
+void WriteProjDataMappedToDisk(const ProjDataF32List& proj_data, const std::string& path);
+
+void WriteProjDataMappedToDisk(const ProjDataU16List& proj_data, const std::string& path);
+
+void WriteProjDataMappedToDisk(const ProjDataU8List& proj_data, const std::string& path);
+
+/// \brief Converts an HDF5 projection data file to a mappable file.
+void ConvertProjDataH5ToMapped(const std::string& src_h5_path, const std::string& dst_path);
+
+/// \brief Converts a mappable projection data file to an HDF5 file.
+void ConvertProjDataMappedToH5(const std::string& src_path, const std::string& dst_h5_path,
+                               const bool compress = true);
+
+/// \brief Read-only memory mapping of a projection data file written by
+///        WriteProjDataMappedToDisk().
+///
+/// The pixel buffers of images returned by this object are owned by the
+/// mapping, therefore this object must outlive every image that it returns.
+/// The mapping is copy-on-write: modifying the pixels of a returned image does
+/// not change the file and only copies the modified pages into private memory.
+class MappedProjData
+{
+public:
+  explicit MappedProjData(const std::string& path);
+
+  ~MappedProjData();
+
+  // no copying
+  MappedProjData(const MappedProjData&) = delete;
+  MappedProjData& operator=(const MappedProjData&) = delete;
+
+  size_type num_projs() const;
+
+  ProjDataScalarType scalar_type() const;
+
+  const std::vector<CameraModel>& cams() const;
+
+  /// \brief Projection data with images aliasing the mapping.
+  ///
+  /// The pixel scalar type must match the type stored in the file, an
+  /// exception is thrown otherwise.
+  ProjDataF32List proj_data_F32() const;
+
+  ProjDataU16List proj_data_U16() const;
+
+  ProjDataU8List proj_data_U8() const;
+
+  ProjDataF32::ProjPtr img_F32(const size_type proj_idx) const;
+
+  ProjDataU16::ProjPtr img_U16(const size_type proj_idx) const;
+
+  ProjDataU8::ProjPtr img_U8(const size_type proj_idx) const;
+
+  /// \brief Total number of bytes of the mapping
+  size_type num_bytes_mapped() const;
+
+private:
+  struct ProjMeta
+  {
+    std::array<double,2> img_spacing;
+    std::array<double,2> img_origin;
+    std::array<double,4> img_dir;
+
+    size_type pixels_offset;
+  };
+
+  template <class tPixelScalar>
+  std::vector<ProjData<tPixelScalar>> proj_data() const;
+
+  template <class tPixelScalar>
+  typename itk::Image<tPixelScalar,2>::Pointer img(const size_type proj_idx) const;
+
+  void* map_ptr_ = nullptr;
+
+  size_type map_num_bytes_ = 0;
+
+#ifdef _WIN32
+  void* file_handle_ = nullptr;
+  void* map_handle_  = nullptr;
+#else
+  int fd_ = -1;
+#endif
+
+  ProjDataScalarType scalar_type_;
+
+  std::vector<CameraModel> cams_;
+
+  std::vector<ProjMeta> proj_metas_;
+};
+
+}  // xreg
+
+#endif
+
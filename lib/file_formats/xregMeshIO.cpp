@@ -24,7 +24,13 @@
 
 #include "xregMeshIO.h"
 
+#include <cstdio>
+
+#include <fmt/format.h>
+
 #include "xregFilesystemUtils.h"
+#include "xregHashUtils.h"
+#include "xregHDF5.h"
 #include "xregStringUtils.h"
 #include "xregSTLMeshIO.h"
 #include "xregH5MeshIO.h"
@@ -60,6 +66,75 @@ xreg::TriMesh xreg::ReadMeshFromDisk(const std::string& path)
   return mesh;
 }
 
+xreg::TriMesh xreg::ReadMeshFromDiskWithCache(const std::string& path,
+                                               const std::string& cache_dir)
+{
+  if (cache_dir.empty())
+  {
+    return ReadMeshFromDisk(path);
+  }
+
+  // the absolute path identifies the source, e.g. meshes with the same name
+  // in different directories have separate entries, the size and time of the
+  // last modification identify its contents
+  const Path mesh_path = Path(path).absolute_path();
+
+  const std::string src_path = mesh_path.string();
+
+  Hasher64 h;
+  h.add_str(src_path);
+  h.add(mesh_path.file_size());
+  h.add(mesh_path.mod_time());
+
+  const Path cache_path = Path(cache_dir) +
+                          Path(fmt::format("{}-{}.mesh-cache.h5", mesh_path.filename().string(), h.str()));
+
+  if (cache_path.exists())
+  {
+    H5::H5File h5(cache_path.string(), H5F_ACC_RDONLY);
+
+    // guards against a collision of the key hash
+    if (GetStringAttr("src-path", h5) == src_path)
+    {
+      return ReadMeshH5(h5);
+    }
+  }
+
+  const TriMesh mesh = ReadMeshFromDisk(path);
+
+  if (!Path(cache_dir).exists())
+  {
+    MakeDirRecursive(cache_dir);
+  }
+
+  // written to a unique temporary file and then moved into place, so that
+  // concurrent readers and writers of the same entry are safe
+  const std::string tmp_path = MakeUniqueTmpPath(cache_path.string());
+
+  try
+  {
+    {
+      H5::H5File h5(tmp_path, H5F_ACC_TRUNC);
+
+      WriteMeshCacheH5(mesh, &h5);
+
+      SetStringAttr("src-path", src_path, &h5);
+
+      h5.flush(H5F_SCOPE_GLOBAL);
+      h5.close();
+    }
+
+    MoveFileSystemItem(tmp_path, cache_path.string());
+  }
+  catch (...)
+  {
+    std::remove(tmp_path.c_str());
+    throw;
+  }
+
+  return mesh;
+}
+
 void xreg::WriteMeshToDisk(const TriMesh& mesh, const std::string& path, const bool prefer_ascii)
 {
   const std::string file_ext = ToLowerCase(Path(path).file_extension());
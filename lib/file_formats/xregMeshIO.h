@@ -32,6 +32,16 @@ namespace xreg
 
 TriMesh ReadMeshFromDisk(const std::string& path);
 
+/// \brief Reads a mesh from disk, using a cached copy when it is available.
+///
+/// The cached copy is stored in cache_dir (see WriteMeshCacheH5()) under a
+/// name derived from a hash of the absolute path, size and modification time
+/// of the mesh file, and it records the absolute path, which is checked when
+/// it is loaded. When no cached copy of the current mesh file exists, the mesh
+/// is read with ReadMeshFromDisk() and the cached copy is written. When
+/// cache_dir is empty, no cache is used.
+TriMesh ReadMeshFromDiskWithCache(const std::string& path, const std::string& cache_dir);
+
 void WriteMeshToDisk(const TriMesh& mesh, const std::string& path, const bool prefer_ascii = false);
 
 }  // xreg
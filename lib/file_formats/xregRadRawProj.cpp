@@ -31,6 +31,7 @@
 #include "xregAssert.h"
 #include "xregFilesystemUtils.h"
 #include "xregITKBasicImageUtils.h"
+#include "xregRawFileReadUtils.h"
 #include "xregRigidUtils.h"
 #include "xregStringUtils.h"
 
@@ -186,11 +187,13 @@ xreg::ReadRadRawProj(const std::string& rad_file_path)
     img->SetSpacing(tmp_spacing.data());
   }
 
-  FileInputStream fin(fmt::format("{}.raw", std::get<0>(Path(rad_file_path).split_ext())));
+  const std::string raw_path = fmt::format("{}.raw", std::get<0>(Path(rad_file_path).split_ext()));
 
-  xregASSERT(fin.num_bytes_left() == (sizeof(float) * info.num_cols * info.num_rows));
+  const size_type num_pix = info.num_cols * info.num_rows;
 
-  fin.read_remaining_bytes(img->GetBufferPointer());
+  xregASSERT(RawFileNumBytes(raw_path) == (sizeof(float) * num_pix));
+
+  ReadRawFileAsType<float>(raw_path, img->GetBufferPointer(), num_pix);
 
   return std::make_tuple(info, img);
 }
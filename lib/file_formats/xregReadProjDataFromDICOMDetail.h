@@ -39,6 +39,7 @@
 #include "xregLandmarkMapUtils.h"
 #include "xregOpenCVUtils.h"
 #include "xregReadProjDataFromDICOM.h"
+#include "xregTBBUtils.h"
 
 namespace xreg
 {
@@ -305,12 +306,27 @@ ReadProjDataFromDICOMHelper(const std::string& dcm_path, const ReadProjDataFromD
   const size_type num_frames = dcm_info.num_frames ? * dcm_info.num_frames : 1;
   
   std::vector<ProjData<tPixelScalar>> pd(num_frames);
+
+  // multi-frame files with compressed pixel data are decoded one frame per
+  // task, directly into the projection images
+  std::vector<typename itk::Image<tPixelScalar,2>::Pointer> compressed_frames;
   
   if (num_frames == 1)
   {
     vout << "1 frame - reading 2D image pixel data from DICOM..." << std::endl;
     pd[0].img = ReadDICOM2DFromDisk<tPixelScalar>(dcm_path);
   }
+  else if (ReadDICOMCompressedFramesParallel(dcm_path, &compressed_frames))
+  {
+    vout << num_frames << " frames - decoded compressed frames concurrently..." << std::endl;
+
+    xregASSERT(compressed_frames.size() == num_frames);
+
+    for (size_type i = 0; i < num_frames; ++i)
+    {
+      pd[i].img = compressed_frames[i];
+    }
+  }
   else
   {
     vout << num_frames << " frames - reading 3D image pixel data from DICOM..." << std::endl;
@@ -330,17 +346,24 @@ ReadProjDataFromDICOMHelper(const std::string& dcm_path, const ReadProjDataFromD
 
     const size_type num_pix_per_frame = cam.num_det_cols * cam.num_det_rows;
     
-    for (size_type i = 0; i < num_frames; ++i, cur_frame_buf += num_pix_per_frame)
+    auto split_frames_fn = [&] (const RangeType& r)
     {
-      auto dst_frame = MakeITK2DVol<tPixelScalar>(cam.num_det_cols, cam.num_det_rows);
+      for (size_type i = r.begin(); i != r.end(); ++i)
+      {
+        auto dst_frame = MakeITK2DVol<tPixelScalar>(cam.num_det_cols, cam.num_det_rows);
 
-      dst_frame->SetSpacing(spacing_slice.data());
-      dst_frame->SetOrigin(origin_slice.data());
+        dst_frame->SetSpacing(spacing_slice.data());
+        dst_frame->SetOrigin(origin_slice.data());
 
-      std::copy(cur_frame_buf, cur_frame_buf + num_pix_per_frame, dst_frame->GetBufferPointer());
+        const auto* src_frame_buf = cur_frame_buf + (i * num_pix_per_frame);
 
-      pd[i].img = dst_frame;
-    }
+        std::copy(src_frame_buf, src_frame_buf + num_pix_per_frame, dst_frame->GetBufferPointer());
+
+        pd[i].img = dst_frame;
+      }
+    };
+
+    ParallelFor(split_frames_fn, RangeType(0, num_frames));
   }
 
   {
@@ -375,52 +398,59 @@ ReadProjDataFromDICOMHelper(const std::string& dcm_path, const ReadProjDataFromD
         
   const bool do_horiz_flip = dcm_info.fov_horizontal_flip && (*dcm_info.fov_horizontal_flip);
 
-  for (size_type i = 0; i < num_frames; ++i)
+  // the frames are processed independently, e.g. for large fluoroscopy
+  // sequences the flips/rotations are performed concurrently
+  auto proc_frames_fn = [&] (const RangeType& r)
   {
-    pd[i].cam = cam;
-    
-    // Always prefer the spacing obtained by interpreting DICOM fields
-    pd[i].img->SetSpacing(spacing_to_use.data());
-    
-    pd[i].det_spacings_from_orig_meta = spacing_in_meta;
-
-    pd[i].orig_dcm_meta = orig_dcm_meta;
-
-    if (!params.no_proc)
+    for (size_type i = r.begin(); i != r.end(); ++i)
     {
-      cv::Mat img_ocv = ShallowCopyItkToOpenCV(pd[i].img.GetPointer());
+      pd[i].cam = cam;
+  
+      // Always prefer the spacing obtained by interpreting DICOM fields
+      pd[i].img->SetSpacing(spacing_to_use.data());
+  
+      pd[i].det_spacings_from_orig_meta = spacing_in_meta;
+
+      pd[i].orig_dcm_meta = orig_dcm_meta;
 
-      if (dcm_rot != DICOMFIleBasicFields::kZERO)
+      if (!params.no_proc)
       {
-        if (dcm_rot == DICOMFIleBasicFields::kNINETY)
+        cv::Mat img_ocv = ShallowCopyItkToOpenCV(pd[i].img.GetPointer());
+
+        if (dcm_rot != DICOMFIleBasicFields::kZERO)
         {
-          xregASSERT(pd[i].cam.num_det_rows == pd[i].cam.num_det_cols);
+          if (dcm_rot == DICOMFIleBasicFields::kNINETY)
+          {
+            xregASSERT(pd[i].cam.num_det_rows == pd[i].cam.num_det_cols);
 
-          cv::Mat tmp = img_ocv.clone();
-          cv::transpose(tmp, img_ocv);
-          FlipImageColumns(&img_ocv);
+            cv::Mat tmp = img_ocv.clone();
+            cv::transpose(tmp, img_ocv);
+            FlipImageColumns(&img_ocv);
+          }
+          else if (dcm_rot == DICOMFIleBasicFields::kONE_EIGHTY)
+          {
+            FlipImageRows(&img_ocv);
+            FlipImageColumns(&img_ocv);
+          }
+          else if (dcm_rot == DICOMFIleBasicFields::kTWO_SEVENTY)
+          {
+            xregASSERT(pd[i].cam.num_det_rows == pd[i].cam.num_det_cols);
+        
+            cv::Mat tmp = img_ocv.clone();
+            cv::transpose(tmp, img_ocv);
+            FlipImageRows(&img_ocv);
+          }
         }
-        else if (dcm_rot == DICOMFIleBasicFields::kONE_EIGHTY)
+
+        if (do_horiz_flip)
         {
-          FlipImageRows(&img_ocv);
           FlipImageColumns(&img_ocv);
         }
-        else if (dcm_rot == DICOMFIleBasicFields::kTWO_SEVENTY)
-        {
-          xregASSERT(pd[i].cam.num_det_rows == pd[i].cam.num_det_cols);
-          
-          cv::Mat tmp = img_ocv.clone();
-          cv::transpose(tmp, img_ocv);
-          FlipImageRows(&img_ocv);
-        }
-      }
-
-      if (do_horiz_flip)
-      {
-        FlipImageColumns(&img_ocv);
       }
     }
-  }
+  };
+
+  ParallelFor(proc_frames_fn, RangeType(0, num_frames));
 
   return pd;
 }
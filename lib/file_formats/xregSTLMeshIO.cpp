@@ -24,13 +24,26 @@
 
 #include "xregSTLMeshIO.h"
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "xregExceptionUtils.h"
 #include "xregStdStreamUtils.h"
 #include "xregFilesystemUtils.h"
 #include "xregStringUtils.h"
 #include "xregAssert.h"
+#include "xregEndianUtils.h"
+#include "xregTBBUtils.h"
 
 namespace
 {
@@ -243,6 +256,235 @@ TriMesh ReadSTLMeshBinary(InputStream& in)
   return mesh;
 }
 
+// Read-only mapping of an entire file into memory, the mapping is released
+// when this object is destroyed.
+class ReadOnlyMappedFile
+{
+public:
+  explicit ReadOnlyMappedFile(const std::string& path)
+  {
+#ifdef _WIN32
+    file_handle_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                               OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_handle_ == INVALID_HANDLE_VALUE)
+    {
+      file_handle_ = nullptr;
+      xregThrow("Unable to open STL file for reading!");
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file_handle_, &file_size))
+    {
+      CloseHandle(file_handle_);
+      xregThrow("Unable to get size of STL file!");
+    }
+
+    num_bytes_ = static_cast<size_type>(file_size.QuadPart);
+
+    if (num_bytes_)
+    {
+      map_handle_ = CreateFileMappingA(file_handle_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      if (!map_handle_)
+      {
+        CloseHandle(file_handle_);
+        xregThrow("Unable to create mapping of STL file!");
+      }
+
+      map_ptr_ = MapViewOfFile(map_handle_, FILE_MAP_READ, 0, 0, 0);
+      if (!map_ptr_)
+      {
+        CloseHandle(map_handle_);
+        CloseHandle(file_handle_);
+        xregThrow("Unable to map STL file!");
+      }
+    }
+#else
+    fd_ = open(path.c_str(), O_RDONLY);
+    if (fd_ < 0)
+    {
+      xregThrow("Unable to open STL file for reading!");
+    }
+
+    struct stat file_stat;
+    if (fstat(fd_, &file_stat))
+    {
+      close(fd_);
+      xregThrow("Unable to get size of STL file!");
+    }
+
+    num_bytes_ = static_cast<size_type>(file_stat.st_size);
+
+    if (num_bytes_)
+    {
+      map_ptr_ = mmap(nullptr, num_bytes_, PROT_READ, MAP_SHARED, fd_, 0);
+      if (map_ptr_ == MAP_FAILED)
+      {
+        map_ptr_ = nullptr;
+        close(fd_);
+        xregThrow("Unable to map STL file!");
+      }
+
+      // the entire file is parsed in order (in chunks)
+      madvise(map_ptr_, num_bytes_, MADV_WILLNEED);
+    }
+#endif
+  }
+
+  ~ReadOnlyMappedFile()
+  {
+#ifdef _WIN32
+    if (map_ptr_)
+    {
+      UnmapViewOfFile(map_ptr_);
+      CloseHandle(map_handle_);
+    }
+
+    CloseHandle(file_handle_);
+#else
+    if (map_ptr_)
+    {
+      munmap(map_ptr_, num_bytes_);
+    }
+
+    close(fd_);
+#endif
+  }
+
+  ReadOnlyMappedFile(const ReadOnlyMappedFile&) = delete;
+  ReadOnlyMappedFile& operator=(const ReadOnlyMappedFile&) = delete;
+
+  const unsigned char* data() const
+  {
+    return static_cast<const unsigned char*>(map_ptr_);
+  }
+
+  size_type num_bytes() const
+  {
+    return num_bytes_;
+  }
+
+private:
+#ifdef _WIN32
+  HANDLE file_handle_ = nullptr;
+  HANDLE map_handle_ = nullptr;
+#else
+  int fd_ = -1;
+#endif
+
+  void* map_ptr_ = nullptr;
+
+  size_type num_bytes_ = 0;
+};
+
+// Number of bytes used by each triangle in a binary STL file: normal and three
+// vertices as floats, followed by a 16-bit attribute
+constexpr size_type kSTL_BINARY_TRI_NUM_BYTES = (12 * 4) + 2;
+
+// header and number of triangles
+constexpr size_type kSTL_BINARY_HEADER_NUM_BYTES = 80 + 4;
+
+// Parses binary STL triangles from an in-memory buffer, e.g. a mapped file.
+// Triangles are independent of each other, so they are parsed concurrently.
+TriMesh ReadSTLMeshBinaryFromBuffer(const unsigned char* buf, const size_type num_bytes)
+{
+  xregASSERT(num_bytes >= kSTL_BINARY_HEADER_NUM_BYTES);
+
+  const bool need_swap = GetNativeByteOrder() != kLITTLE_ENDIAN;
+
+  Stream::uint32 tmp_uint32 = 0;
+  std::memcpy(&tmp_uint32, buf + 80, 4);
+
+  if (need_swap)
+  {
+    SwapByteOrder32(&tmp_uint32);
+  }
+
+  const size_type num_tris = tmp_uint32;
+
+  if ((kSTL_BINARY_HEADER_NUM_BYTES + (num_tris * kSTL_BINARY_TRI_NUM_BYTES)) > num_bytes)
+  {
+    xregThrow("Binary STL file is truncated! Expected %lu triangles.", num_tris);
+  }
+
+  const unsigned char* tris_buf = buf + kSTL_BINARY_HEADER_NUM_BYTES;
+
+  TriMesh mesh;
+
+  mesh.vertices.resize(num_tris * 3);
+  mesh.faces.resize(num_tris);
+  mesh.normals.resize(num_tris);
+
+  std::vector<char> bad_normals(num_tris, 0);
+
+  auto parse_fn = [&] (const RangeType& r)
+  {
+    // floats are not aligned in the file, so copy before reading
+    float tmp_floats[12];
+
+    for (size_type i = r.begin(); i < r.end(); ++i)
+    {
+      std::memcpy(tmp_floats, tris_buf + (i * kSTL_BINARY_TRI_NUM_BYTES), 12 * 4);
+
+      if (need_swap)
+      {
+        for (size_type j = 0; j < 12; ++j)
+        {
+          SwapByteOrder32(tmp_floats + j);
+        }
+      }
+
+      const size_type vert_off = 3 * i;
+
+      // negate to switch from outward normals to inward normals
+      mesh.normals[i][0] = -tmp_floats[0];
+      mesh.normals[i][1] = -tmp_floats[1];
+      mesh.normals[i][2] = -tmp_floats[2];
+
+      bad_normals[i] = std::abs(mesh.normals[i].norm() - 1.0) > 1.0e-4;
+
+      mesh.vertices[vert_off + 2][0] = tmp_floats[3];
+      mesh.vertices[vert_off + 2][1] = tmp_floats[4];
+      mesh.vertices[vert_off + 2][2] = tmp_floats[5];
+
+      mesh.vertices[vert_off + 1][0] = tmp_floats[6];
+      mesh.vertices[vert_off + 1][1] = tmp_floats[7];
+      mesh.vertices[vert_off + 1][2] = tmp_floats[8];
+
+      mesh.vertices[vert_off][0] = tmp_floats[9];
+      mesh.vertices[vert_off][1] = tmp_floats[10];
+      mesh.vertices[vert_off][2] = tmp_floats[11];
+
+      mesh.faces[i][0] = vert_off;
+      mesh.faces[i][1] = vert_off + 1;
+      mesh.faces[i][2] = vert_off + 2;
+    }
+  };
+
+  ParallelFor(parse_fn, RangeType(0, num_tris));
+
+  const auto first_bad_it = std::find(bad_normals.begin(), bad_normals.end(), 1);
+
+  mesh.normals_valid = first_bad_it == bad_normals.end();
+
+  if (!mesh.normals_valid)
+  {
+    std::cerr << "Triangle #" << (first_bad_it - bad_normals.begin()) << " has an invalid normal "
+      "vector (suppressing this warning for future bad normals in this file)"
+                        << std::endl;
+  }
+
+  return mesh;
+}
+
+void RemoveSTLDuplicates(TriMesh* mesh)
+{
+  // First duplicate vertices need to be removed and the face indices updated
+  mesh->remove_duplicate_vertices();
+
+  // Now remove any duplicate faces
+  mesh->remove_duplicate_faces();
+}
+
 void WriteSTLMeshBinary(OutputStream& out, const TriMesh& mesh)
 {
   out.set_byte_order(kLITTLE_ENDIAN);
@@ -324,6 +566,27 @@ void WriteSTLMeshBinary(OutputStream& out, const TriMesh& mesh)
 
 xreg::TriMesh xreg::ReadSTLMesh(const std::string& path, const bool remove_dups)
 {
+  {
+    // Binary files are mapped into memory and parsed in parallel, ASCII files
+    // are parsed using the stream interface below.
+    const ReadOnlyMappedFile mapped_file(path);
+
+    const unsigned char* buf = mapped_file.data();
+
+    if ((mapped_file.num_bytes() >= kSTL_BINARY_HEADER_NUM_BYTES) &&
+        std::memcmp(buf, "solid", 5))
+    {
+      TriMesh mesh = ReadSTLMeshBinaryFromBuffer(buf, mapped_file.num_bytes());
+
+      if (remove_dups)
+      {
+        RemoveSTLDuplicates(&mesh);
+      }
+
+      return mesh;
+    }
+  }
+
   std::ifstream in(path.c_str(), std::ios::binary);
   if (in.is_open())
   {
@@ -369,11 +632,7 @@ xreg::TriMesh xreg::ReadSTLMesh(InputStream& in, const bool remove_dups)
 
   if (remove_dups)
   {
-    // First duplicate vertices need to be removed and the face indices updated
-    mesh.remove_duplicate_vertices();
-
-    // Now remove any duplicate faces
-    mesh.remove_duplicate_faces();
+    RemoveSTLDuplicates(&mesh);
   }
 
   return mesh;
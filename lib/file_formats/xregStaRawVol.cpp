@@ -31,6 +31,7 @@
 #include "xregAssert.h"
 #include "xregFilesystemUtils.h"
 #include "xregITKBasicImageUtils.h"
+#include "xregRawFileReadUtils.h"
 #include "xregStringUtils.h"
 
 xreg::StaVolInfo xreg::ReadStaVolInfo(const std::string& sta_file_path)
@@ -144,19 +145,15 @@ itk::Image<float,3>::Pointer xreg::ReadStaRawVol(const std::string& sta_file_pat
   SetITKDirectionMatrix(vol.GetPointer(), Mat3x3(sta_info.vol_to_world.matrix().block(0,0,3,3)));
  
   // read in the pixels from the .raw file, casting them from uint8 to float
+  // block by block, directly into the volume buffer
   {
-    FileInputStream fin(fmt::format("{}.raw", std::get<0>(Path(sta_file_path).split_ext())));
+    const std::string raw_path = fmt::format("{}.raw", std::get<0>(Path(sta_file_path).split_ext()));
 
     const size_type tot_num_voxels = sta_info.dims[0] * sta_info.dims[1] * sta_info.dims[2];
 
-    xregASSERT(fin.num_bytes_left() == tot_num_voxels);
+    xregASSERT(RawFileNumBytes(raw_path) == tot_num_voxels);
 
-    std::vector<FileInputStream::uint8> vol_buf_as_uint8(tot_num_voxels);
-
-    fin.read_remaining_bytes(vol_buf_as_uint8.data());
-
-    std::transform(vol_buf_as_uint8.begin(), vol_buf_as_uint8.end(), vol->GetBufferPointer(),
-                   [] (const FileInputStream::uint8& x) { return static_cast<float>(x); });
+    ReadRawFileAsType<unsigned char>(raw_path, vol->GetBufferPointer(), tot_num_voxels);
   }
 
   return vol;
@@ -34,16 +34,59 @@
 
 #endif
 
+#include <algorithm>
+#include <thread>
+
 #include <opencv2/videoio.hpp>
 #include <opencv2/imgcodecs.hpp>
 
 #include "xregAssert.h"
+#include "xregBackgroundTaskQueue.h"
 #include "xregFilesystemUtils.h"
+#include "xregStringUtils.h"
+#include "xregTBBUtils.h"
 
 #ifdef __APPLE__
 #include "xregAppleAVFoundation.h"
 #endif
 
+xreg::FFMPEGVideoEncoder xreg::LookupFFMPEGVideoEncoder(const std::string& enc_str)
+{
+  const std::string s = ToLowerCase(enc_str);
+
+  FFMPEGVideoEncoder enc = kFFMPEG_ENC_SOFTWARE;
+
+  if (s.empty() || (s == "sw"))
+  {
+    enc = kFFMPEG_ENC_SOFTWARE;
+  }
+  else if (s == "nvenc")
+  {
+    enc = kFFMPEG_ENC_NVENC;
+  }
+  else if (s == "vaapi")
+  {
+    enc = kFFMPEG_ENC_VAAPI;
+  }
+  else if (s == "videotoolbox")
+  {
+    enc = kFFMPEG_ENC_VIDEOTOOLBOX;
+  }
+  else
+  {
+    xregThrow("Unsupported video encoder: %s", enc_str.c_str());
+  }
+
+  return enc;
+}
+
+// The encoder argument is only used when the ffmpeg writer is available
+#ifndef _WIN32
+#define XREG_FFMPEG_ARG(x) x
+#else
+#define XREG_FFMPEG_ARG(x)
+#endif
+
 void xreg::WriteImageFramesToVideo::write(const std::vector<cv::Mat>& frames)
 {
   for (const cv::Mat& f : frames)
@@ -92,27 +135,90 @@ void xreg::WriteImageFramesToVideoWithFFMPEG::open()
   const std::string fps_str = fmt::format("{}", fps);
   const std::string q_str   = fmt::format("{}", quality);
 
+  std::vector<std::string> args = { "-y" };  // overwrite existing output files
+
+  if (encoder == kFFMPEG_ENC_VAAPI)
+  {
+    args.insert(args.end(), { "-vaapi_device", vaapi_device });
+  }
+
+  args.insert(args.end(), { "-f", "image2pipe",     // inputs are images piped in
+                            //"-vcodec", "png",     // input codec (not required)
+                            "-framerate", fps_str,  // fps
+                            "-i", "-" });           // read from stdin
+
+  switch (encoder)
+  {
+  case kFFMPEG_ENC_SOFTWARE:
+    args.insert(args.end(), { "-vcodec", "h264",      // output codec
+                              "-pix_fmt", "yuv420p",  // need this for compatibility
+                              "-crf", q_str,          // constant quality
+                              "-preset", "slow" });   // try for better compression, but slower
+    break;
+  case kFFMPEG_ENC_NVENC:
+    args.insert(args.end(), { "-vcodec", "h264_nvenc",
+                              "-pix_fmt", "yuv420p",
+                              "-rc", "vbr", "-cq", q_str, "-b:v", "0",  // constant quality
+                              "-preset", "slow" });
+    break;
+  case kFFMPEG_ENC_VAAPI:
+    args.insert(args.end(), { "-vf", "format=nv12,hwupload",  // upload frames to the GPU
+                              "-vcodec", "h264_vaapi",
+                              "-qp", q_str });
+    break;
+  case kFFMPEG_ENC_VIDEOTOOLBOX:
+    // the VideoToolbox quality is in [1,100], higher is better
+    args.insert(args.end(), { "-vcodec", "h264_videotoolbox",
+                              "-pix_fmt", "yuv420p",
+                              "-q:v", fmt::format("{}", std::max(1.0,
+                                                        std::min(100.0, 100.0 * (1.0 - (quality / 51.0))))) });
+    break;
+  default:
+    xregThrow("unsupported ffmpeg video encoder!");
+  }
+
+  args.insert(args.end(), { "-an",             // disable audio
+                            dst_vid_path });   // output file
+
   p->ffmpeg_p.reset(new bp::child(ffmpeg_path,
-                                  "-y",                   // overwrite existing output files
-                                  "-f", "image2pipe",     // inputs are images piped in
-                                  //"-vcodec", "png",     // input codec (not required)
-                                  "-framerate", fps_str,  // fps
-                                  "-i", "-",              // read from stdin
-                                  "-vcodec", "h264",      // output codec
-                                  "-pix_fmt", "yuv420p",  // need this for compatibility
-                                  "-an",                  // disable audio
-                                  "-crf", q_str,          // constant quality
-                                  "-preset", "slow",      // try for better compression, but slower
-                                  dst_vid_path,           // output file
+                                  bp::args(args),
                                   bp::std_in < p->ffmpeg_p_in,
                                   bp::std_out > bp::null,
                                   bp::std_err > bp::null)); 
+
+  if (max_num_queued_frames)
+  {
+    // a single thread so that frames are written in order
+    frame_queue = std::make_shared<BackgroundTaskQueue>(1);
+    frame_queue->set_max_num_queued_tasks(max_num_queued_frames);
+  }
 }
 
 void xreg::WriteImageFramesToVideoWithFFMPEG::close()
 {
   xregASSERT(p.get());
 
+  if (frame_queue)
+  {
+    // finish encoding any queued frames, the queue is destroyed before re-throwing
+    // any error so that a subsequent close (e.g. from the destructor) is safe
+    std::shared_ptr<BackgroundTaskQueue> q;
+    q.swap(frame_queue);
+
+    try
+    {
+      q->wait();
+    }
+    catch (...)
+    {
+      p->ffmpeg_p_in.close();
+      p->ffmpeg_p->wait();
+      p = nullptr;
+
+      throw;
+    }
+  }
+
   p->ffmpeg_p_in.close();
 
   p->ffmpeg_p->wait();
@@ -121,10 +227,27 @@ void xreg::WriteImageFramesToVideoWithFFMPEG::close()
 }
 
 void xreg::WriteImageFramesToVideoWithFFMPEG::write(const cv::Mat& frame)
+{
+  if (frame_queue)
+  {
+    // copy, since the caller is free to modify the frame after returning
+    const cv::Mat frame_copy = frame.clone();
+
+    frame_queue->add([this,frame_copy] () { this->encode_and_write(frame_copy); });
+  }
+  else
+  {
+    encode_and_write(frame);
+  }
+}
+
+void xreg::WriteImageFramesToVideoWithFFMPEG::encode_and_write(const cv::Mat& frame)
 {
   xregASSERT(p->ffmpeg_p->running());
   
-  cv::imencode(".png", frame, png_buf);
+  // the PNG is only used to transfer the lossless frame to ffmpeg, so prefer
+  // speed over compression
+  cv::imencode(".png", frame, png_buf, { cv::IMWRITE_PNG_COMPRESSION, 1 });
   
   p->ffmpeg_p_in.write(reinterpret_cast<char*>(&png_buf[0]), png_buf.size());
 }
@@ -167,7 +290,8 @@ void xreg::WriteImageFramesToVideoWithOpenCV::write(const cv::Mat& frame)
   *writer << frame;
 }
 
-std::unique_ptr<xreg::WriteImageFramesToVideo> xreg::GetWriteImageFramesToVideo()
+std::unique_ptr<xreg::WriteImageFramesToVideo>
+xreg::GetWriteImageFramesToVideo(const FFMPEGVideoEncoder XREG_FFMPEG_ARG(encoder))
 {
   std::unique_ptr<WriteImageFramesToVideo> writer;
 
@@ -176,7 +300,10 @@ std::unique_ptr<xreg::WriteImageFramesToVideo> xreg::GetWriteImageFramesToVideo(
 
   if (!ffmpeg_path.empty())
   {
-    writer.reset(new WriteImageFramesToVideoWithFFMPEG);
+    auto* ffmpeg_writer = new WriteImageFramesToVideoWithFFMPEG(ffmpeg_path);
+    ffmpeg_writer->encoder = encoder;
+
+    writer.reset(ffmpeg_writer);
   }
   else
 #endif
@@ -202,11 +329,12 @@ std::unique_ptr<xreg::WriteImageFramesToVideo> xreg::GetWriteImageFramesToVideo(
 void xreg::WriteAllImageFramesToVideo(const std::string& vid_path,
                                       const std::vector<cv::Mat>& frames,
                                       const double fps_or_len,
-                                      const bool is_fps)
+                                      const bool is_fps,
+                                      const FFMPEGVideoEncoder encoder)
 {
   if (!frames.empty())
   {
-    auto writer = GetWriteImageFramesToVideo();
+    auto writer = GetWriteImageFramesToVideo(encoder);
 
     writer->dst_vid_path = vid_path;
     writer->fps = is_fps ? fps_or_len : (frames.size() / fps_or_len);
@@ -226,20 +354,48 @@ void xreg::WriteAllImageFramesToVideo(const std::string& vid_path,
 void xreg::WriteImageFilesToVideo(const std::string& vid_path,
                                   const std::vector<std::string>& img_paths,
                                   const double fps_or_len,
-                                  const bool is_fps)
+                                  const bool is_fps,
+                                  const FFMPEGVideoEncoder encoder)
 {
-  std::vector<cv::Mat> frames;
-
   const size_type num_frames = img_paths.size();
 
-  frames.reserve(num_frames);
+  if (!num_frames)
+  {
+    xregThrow("No frames provided to create video!");
+  }
+
+  auto writer = GetWriteImageFramesToVideo(encoder);
+
+  writer->dst_vid_path = vid_path;
+  writer->fps = is_fps ? fps_or_len : (num_frames / fps_or_len);
+  
+  writer->open();
+
+  const size_type batch_size = std::max(size_type(8),
+                                        size_type(2 * std::thread::hardware_concurrency()));
 
-  for (size_type i = 0; i < num_frames; ++i)
+  std::vector<cv::Mat> frames;
+
+  for (size_type batch_begin = 0; batch_begin < num_frames; batch_begin += batch_size)
   {
-    frames.push_back(cv::imread(img_paths[i]));
+    const size_type cur_batch_size = std::min(batch_size, num_frames - batch_begin);
+
+    frames.assign(cur_batch_size, cv::Mat());
+
+    auto decode_fn = [&] (const RangeType& r)
+    {
+      for (size_type i = r.begin(); i < r.end(); ++i)
+      {
+        frames[i] = cv::imread(img_paths[batch_begin + i]);
+      }
+    };
+
+    ParallelFor(decode_fn, RangeType(0, cur_batch_size));
+
+    writer->write(frames);
   }
 
-  WriteAllImageFramesToVideo(vid_path, frames, fps_or_len, is_fps);
+  writer->close();
 }
 
 void xreg::WriteDirOfImagesToVideo(const std::string& vid_path,
@@ -247,7 +403,8 @@ void xreg::WriteDirOfImagesToVideo(const std::string& vid_path,
                                    const bool lex_sort,
                                    const std::vector<std::string>& img_exts,
                                    const double fps_or_len,
-                                   const bool is_fps)
+                                   const bool is_fps,
+                                   const FFMPEGVideoEncoder encoder)
 {
   FileExtensions file_exts;
   
@@ -265,6 +422,6 @@ void xreg::WriteDirOfImagesToVideo(const std::string& vid_path,
     std::sort(img_paths.begin(), img_paths.end());
   }
 
-  WriteImageFilesToVideo(vid_path, img_paths, fps_or_len, is_fps);
+  WriteImageFilesToVideo(vid_path, img_paths, fps_or_len, is_fps, encoder);
 }
 
@@ -27,9 +27,12 @@
 
 #include <vector>
 #include <memory>
+#include <string>
 
 #include <opencv2/core/mat.hpp>
 
+#include "xregCommon.h"
+
 // forward declaration
 namespace cv
 {
@@ -41,6 +44,22 @@ class VideoWriter;
 namespace xreg
 {
 
+// forward declaration
+class BackgroundTaskQueue;
+
+/// \brief H.264 encoders which may be used when writing videos with ffmpeg.
+enum FFMPEGVideoEncoder
+{
+  kFFMPEG_ENC_SOFTWARE,      ///< libx264
+  kFFMPEG_ENC_NVENC,         ///< NVIDIA GPUs
+  kFFMPEG_ENC_VAAPI,         ///< Intel/AMD GPUs on Linux
+  kFFMPEG_ENC_VIDEOTOOLBOX   ///< macOS
+};
+
+/// \brief Looks up an encoder from a string: "sw", "nvenc", "vaapi", or
+///        "videotoolbox". An empty string maps to the software encoder.
+FFMPEGVideoEncoder LookupFFMPEGVideoEncoder(const std::string& enc_str);
+
 class WriteImageFramesToVideo
 {
 public:
@@ -78,8 +97,19 @@ public:
   explicit WriteImageFramesToVideoWithFFMPEG(const std::string& ffmpeg_path_arg);
 
   // lower is higher quality, 0 is lossless, 17 should "appear" lossless
+  // this is approximately mapped to the quality setting of hardware encoders
   double quality = 17;
 
+  FFMPEGVideoEncoder encoder = kFFMPEG_ENC_SOFTWARE;
+
+  // device used by the VAAPI encoder
+  std::string vaapi_device = "/dev/dri/renderD128";
+
+  // The maximum number of frames waiting to be encoded and written to ffmpeg
+  // by a background thread; write() blocks when this many frames are waiting.
+  // 0 -> frames are encoded and written to ffmpeg by the thread calling write().
+  size_type max_num_queued_frames = 8;
+
   void open() override;
 
   void close() override;
@@ -89,6 +119,8 @@ public:
   ~WriteImageFramesToVideoWithFFMPEG();
   
 private:
+  void encode_and_write(const cv::Mat& frame);
+
   // shared_ptr can handle an incomplete type, unique cannot
   // using an incomplete type here, so I do not have to include
   // boost process in this header and define the few macros that
@@ -98,6 +130,8 @@ private:
   std::vector<unsigned char> png_buf;
 
   std::string ffmpeg_path;
+
+  std::shared_ptr<BackgroundTaskQueue> frame_queue;
 };
 
 #endif
@@ -116,7 +150,9 @@ private:
   std::shared_ptr<cv::VideoWriter> writer;
 };
 
-std::unique_ptr<WriteImageFramesToVideo> GetWriteImageFramesToVideo();
+// The encoder is only used when ffmpeg is available.
+std::unique_ptr<WriteImageFramesToVideo>
+GetWriteImageFramesToVideo(const FFMPEGVideoEncoder encoder = kFFMPEG_ENC_SOFTWARE);
 
 // The final two arguments are used to determine the speed or length of the video.
 // When is_fps == true, then fps_or_len represents the desired frames per second 
@@ -126,17 +162,21 @@ std::unique_ptr<WriteImageFramesToVideo> GetWriteImageFramesToVideo();
 void WriteAllImageFramesToVideo(const std::string& vid_path,
                                 const std::vector<cv::Mat>& frames,
                                 const double fps_or_len = 10.0,
-                                const bool is_fps = true);
+                                const bool is_fps = true,
+                                const FFMPEGVideoEncoder encoder = kFFMPEG_ENC_SOFTWARE);
 
 // The final two arguments are used to determine the speed or length of the video.
 // When is_fps == true, then fps_or_len represents the desired frames per second 
 // of the output video.
 // When is_fps == false, then fps_or_len represents the desired length of the output
 // video in seconds.
+// Images are decoded concurrently, in batches, while previous batches are
+// encoded, so that every image is never stored in memory at once.
 void WriteImageFilesToVideo(const std::string& vid_path,
                             const std::vector<std::string>& img_paths,
                             const double fps_or_len = 10.0,
-                            const bool is_fps = true);
+                            const bool is_fps = true,
+                            const FFMPEGVideoEncoder encoder = kFFMPEG_ENC_SOFTWARE);
 
 // The final two arguments are used to determine the speed or length of the video.
 // When is_fps == true, then fps_or_len represents the desired frames per second 
@@ -148,7 +188,8 @@ void WriteDirOfImagesToVideo(const std::string& vid_path,
                              const bool lex_sort = false,
                              const std::vector<std::string>& img_exts = { ".png" },
                              const double fps_or_len = 10.0,
-                             const bool is_fps = true);
+                             const bool is_fps = true,
+                             const FFMPEGVideoEncoder encoder = kFFMPEG_ENC_SOFTWARE);
 
 }  // xreg
 
@@ -24,8 +24,14 @@
 
 #include "xregHDF5.h"
 
+#include <cstdint>
+#include <cstring>
+
+#include <itk_zlib.h>
+
 #include "xregHDF5Internal.h"
 #include "xregITKBasicImageUtils.h"
+#include "xregTBBUtils.h"
 
 void xreg::SetScalarAttr(const std::string& key, const long val, H5::Group* h5)
 {
@@ -352,6 +358,14 @@ H5::DataSet xreg::WriteVectorH5(const std::string& field_name,
   return detail::WriteVectorH5Helper<long>(field_name, v, h5, compress);
 }
 
+H5::DataSet xreg::WriteVectorH5(const std::string& field_name,
+                                const std::vector<long long>& v,
+                                H5::Group* h5,
+                                const bool compress)
+{
+  return detail::WriteVectorH5Helper<long long>(field_name, v, h5, compress);
+}
+
 H5::DataSet xreg::WriteVectorH5(const std::string& field_name,
                                 const std::vector<float>& v,
                                 H5::Group* h5,
@@ -574,6 +588,51 @@ void xreg::WriteMatrixRowH5(const double* row_buf, const unsigned long row_idx,
   detail::WriteMatrixRowH5Helper(row_buf, row_idx, h5);
 }
 
+H5::DataSet xreg::CreateExtendibleMatrixH5Float(const std::string& field_name,
+                                                const unsigned long num_cols,
+                                                const unsigned long chunk_num_rows,
+                                                H5::Group* h5,
+                                                const bool compress)
+{
+  return detail::CreateExtendibleMatrixH5Helper<float>(field_name, num_cols, chunk_num_rows,
+                                                       h5, compress);
+}
+
+H5::DataSet xreg::CreateExtendibleMatrixH5Double(const std::string& field_name,
+                                                 const unsigned long num_cols,
+                                                 const unsigned long chunk_num_rows,
+                                                 H5::Group* h5,
+                                                 const bool compress)
+{
+  return detail::CreateExtendibleMatrixH5Helper<double>(field_name, num_cols, chunk_num_rows,
+                                                        h5, compress);
+}
+
+H5::DataSet xreg::CreateExtendibleMatrixH5ULong(const std::string& field_name,
+                                                const unsigned long num_cols,
+                                                const unsigned long chunk_num_rows,
+                                                H5::Group* h5,
+                                                const bool compress)
+{
+  return detail::CreateExtendibleMatrixH5Helper<unsigned long>(field_name, num_cols, chunk_num_rows,
+                                                               h5, compress);
+}
+
+void xreg::AppendMatrixRowsH5(const float* rows_buf, const unsigned long num_rows, H5::DataSet* h5)
+{
+  detail::AppendMatrixRowsH5Helper(rows_buf, num_rows, h5);
+}
+
+void xreg::AppendMatrixRowsH5(const double* rows_buf, const unsigned long num_rows, H5::DataSet* h5)
+{
+  detail::AppendMatrixRowsH5Helper(rows_buf, num_rows, h5);
+}
+
+void xreg::AppendMatrixRowsH5(const unsigned long* rows_buf, const unsigned long num_rows, H5::DataSet* h5)
+{
+  detail::AppendMatrixRowsH5Helper(rows_buf, num_rows, h5);
+}
+
 H5::DataSet xreg::WriteAffineTransform4x4(const std::string& field_name,
                                           const FrameTransform& xform,
                                           H5::Group* h5,
@@ -652,6 +711,310 @@ void xreg::WriteImageH5(const itk::Image<double,3>* img,
   detail::WriteNDImageH5Helper(img, h5, compress);
 }
 
+namespace  // un-named
+{
+
+using namespace xreg;
+
+// Direct chunk reads and writes were added in HDF5 1.10.3
+#if H5_VERSION_GE(1,10,3)
+#define XREG_H5_HAS_DIRECT_CHUNK_IO
+#endif
+
+// Reorders the bytes of each element so that the bytes of equal significance
+// are stored contiguously, identical to the HDF5 shuffle filter.
+void ShuffleBytes(const unsigned char* src, const size_type num_elems,
+                  const size_type elem_size, unsigned char* dst)
+{
+  for (size_type b = 0; b < elem_size; ++b)
+  {
+    unsigned char* cur_dst = dst + (b * num_elems);
+
+    for (size_type i = 0; i < num_elems; ++i)
+    {
+      cur_dst[i] = src[(i * elem_size) + b];
+    }
+  }
+}
+
+// Reverses ShuffleBytes()
+void UnshuffleBytes(const unsigned char* src, const size_type num_elems,
+                    const size_type elem_size, unsigned char* dst)
+{
+  for (size_type b = 0; b < elem_size; ++b)
+  {
+    const unsigned char* cur_src = src + (b * num_elems);
+
+    for (size_type i = 0; i < num_elems; ++i)
+    {
+      dst[(i * elem_size) + b] = cur_src[i];
+    }
+  }
+}
+
+// Layout and filters of a 2D chunked dataset whose raw chunks are decoded by
+// ReadDataSetsH5()
+struct Tiled2DLayout
+{
+  size_type elem_size = 0;
+
+  hsize_t dims[2] = { 0, 0 };
+
+  hsize_t chunk_dims[2] = { 0, 0 };
+
+  // the positions of the filters in the pipeline, -1 when not used
+  int shuffle_filter_idx = -1;
+  int deflate_filter_idx = -1;
+};
+
+struct RawChunk
+{
+  size_type dst_idx;
+
+  hsize_t offset[2];
+
+  std::uint32_t filter_mask;
+
+  std::vector<unsigned char> bytes;
+};
+
+#ifdef XREG_H5_HAS_DIRECT_CHUNK_IO
+
+// Reads the raw chunks of a dataset, returns false, without adding any chunks,
+// when the dataset cannot be decoded by ReadDataSetsH5().
+bool ReadRawChunksH5(const H5DataSetReadDst& dst, const size_type dst_idx,
+                     Tiled2DLayout* layout, std::vector<RawChunk>* chunks)
+{
+  const H5::DataSet& ds = dst.data_set;
+
+  const H5::DataSpace data_space = ds.getSpace();
+
+  if (data_space.getSimpleExtentNdims() != 2)
+  {
+    return false;
+  }
+
+  data_space.getSimpleExtentDims(layout->dims);
+
+  // the raw chunks are not converted between types
+  if (!(ds.getDataType() == dst.mem_data_type))
+  {
+    return false;
+  }
+
+  layout->elem_size = dst.mem_data_type.getSize();
+
+  const H5::DSetCreatPropList props = ds.getCreatePlist();
+
+  if (props.getLayout() != H5D_CHUNKED)
+  {
+    return false;
+  }
+
+  props.getChunk(2, layout->chunk_dims);
+
+  const int num_filters = props.getNfilters();
+
+  for (int filter_idx = 0; filter_idx < num_filters; ++filter_idx)
+  {
+    unsigned int flags = 0;
+    size_t num_cd_vals = 0;
+    unsigned int filter_config = 0;
+
+    const H5Z_filter_t f = H5Pget_filter2(props.getId(), filter_idx, &flags, &num_cd_vals,
+                                          nullptr, 0, nullptr, &filter_config);
+
+    if ((f == H5Z_FILTER_SHUFFLE) && (layout->shuffle_filter_idx < 0) &&
+        (layout->deflate_filter_idx < 0))
+    {
+      layout->shuffle_filter_idx = filter_idx;
+    }
+    else if ((f == H5Z_FILTER_DEFLATE) && (layout->deflate_filter_idx < 0))
+    {
+      layout->deflate_filter_idx = filter_idx;
+    }
+    else
+    {
+      return false;
+    }
+  }
+
+  const hsize_t num_chunk_rows = (layout->dims[0] + layout->chunk_dims[0] - 1) / layout->chunk_dims[0];
+  const hsize_t num_chunk_cols = (layout->dims[1] + layout->chunk_dims[1] - 1) / layout->chunk_dims[1];
+
+  const size_type orig_num_chunks = chunks->size();
+
+  for (hsize_t chunk_row = 0; chunk_row < num_chunk_rows; ++chunk_row)
+  {
+    for (hsize_t chunk_col = 0; chunk_col < num_chunk_cols; ++chunk_col)
+    {
+      RawChunk c;
+      c.dst_idx   = dst_idx;
+      c.offset[0] = chunk_row * layout->chunk_dims[0];
+      c.offset[1] = chunk_col * layout->chunk_dims[1];
+
+      hsize_t num_bytes = 0;
+
+      // unallocated chunks would need to be filled, let HDF5 handle that
+      if ((H5Dget_chunk_storage_size(ds.getId(), c.offset, &num_bytes) < 0) || !num_bytes)
+      {
+        chunks->resize(orig_num_chunks);
+        return false;
+      }
+
+      c.bytes.resize(num_bytes);
+
+      if (H5Dread_chunk(ds.getId(), H5P_DEFAULT, c.offset, &c.filter_mask, c.bytes.data()) < 0)
+      {
+        chunks->resize(orig_num_chunks);
+        return false;
+      }
+
+      chunks->push_back(std::move(c));
+    }
+  }
+
+  return true;
+}
+
+#endif
+
+}  // un-named
+
+H5::DataSet xreg::WriteTiled2DH5(const std::string& field_name,
+                                 const void* buf,
+                                 const H5::DataType& data_type,
+                                 const unsigned long num_rows,
+                                 const unsigned long num_cols,
+                                 H5::Group* h5,
+                                 const unsigned long tile_dim,
+                                 const int deflate_level)
+{
+  xregASSERT(tile_dim > 0);
+
+  const hsize_t dims[2] = { num_rows, num_cols };
+
+  H5::DataSpace data_space(2, dims);
+
+  if (!num_rows || !num_cols)
+  {
+    // nothing to chunk
+    return h5->createDataSet(field_name, data_type, data_space);
+  }
+
+  const size_type elem_size = data_type.getSize();
+
+  const hsize_t chunk_dims[2] = { std::min<hsize_t>(tile_dim, num_rows),
+                                  std::min<hsize_t>(tile_dim, num_cols) };
+
+  // shuffling single byte elements has no effect
+  const bool use_shuffle = elem_size > 1;
+
+  H5::DSetCreatPropList props;
+  props.copy(H5::DSetCreatPropList::DEFAULT);
+  props.setChunk(2, chunk_dims);
+
+  if (use_shuffle)
+  {
+    props.setShuffle();
+  }
+
+  props.setDeflate(deflate_level);
+
+  H5::DataSet data_set = h5->createDataSet(field_name, data_type, data_space, props);
+
+#ifdef XREG_H5_HAS_DIRECT_CHUNK_IO
+  const size_type num_chunk_rows = (num_rows + chunk_dims[0] - 1) / chunk_dims[0];
+  const size_type num_chunk_cols = (num_cols + chunk_dims[1] - 1) / chunk_dims[1];
+  const size_type num_chunks = num_chunk_rows * num_chunk_cols;
+
+  const size_type chunk_row_bytes = chunk_dims[1] * elem_size;
+  const size_type chunk_bytes     = chunk_dims[0] * chunk_row_bytes;
+
+  const size_type row_bytes = num_cols * elem_size;
+
+  const unsigned char* src_bytes = static_cast<const unsigned char*>(buf);
+
+  std::vector<std::vector<unsigned char>> encoded_chunks(num_chunks);
+  std::vector<std::uint32_t> filter_masks(num_chunks, 0);
+
+  auto encode_fn = [&] (const RangeType& r)
+  {
+    std::vector<unsigned char> chunk_buf(chunk_bytes);
+    std::vector<unsigned char> shuffled_buf(use_shuffle ? chunk_bytes : 0);
+
+    for (size_type chunk_idx = r.begin(); chunk_idx < r.end(); ++chunk_idx)
+    {
+      const size_type start_row = (chunk_idx / num_chunk_cols) * chunk_dims[0];
+      const size_type start_col = (chunk_idx % num_chunk_cols) * chunk_dims[1];
+
+      const size_type cur_num_rows = std::min<size_type>(chunk_dims[0], num_rows - start_row);
+      const size_type cur_num_cols = std::min<size_type>(chunk_dims[1], num_cols - start_col);
+
+      // edge chunks are padded to the full chunk size
+      if ((cur_num_rows != chunk_dims[0]) || (cur_num_cols != chunk_dims[1]))
+      {
+        std::fill(chunk_buf.begin(), chunk_buf.end(), 0);
+      }
+
+      for (size_type row = 0; row < cur_num_rows; ++row)
+      {
+        std::memcpy(&chunk_buf[row * chunk_row_bytes],
+                    src_bytes + ((start_row + row) * row_bytes) + (start_col * elem_size),
+                    cur_num_cols * elem_size);
+      }
+
+      const unsigned char* to_compress = chunk_buf.data();
+
+      if (use_shuffle)
+      {
+        ShuffleBytes(chunk_buf.data(), chunk_bytes / elem_size, elem_size, shuffled_buf.data());
+        to_compress = shuffled_buf.data();
+      }
+
+      auto& enc = encoded_chunks[chunk_idx];
+
+      uLongf enc_len = compressBound(chunk_bytes);
+      enc.resize(enc_len);
+
+      if ((compress2(enc.data(), &enc_len, to_compress, chunk_bytes, deflate_level) == Z_OK) &&
+          (enc_len < chunk_bytes))
+      {
+        enc.resize(enc_len);
+      }
+      else
+      {
+        // store the chunk without deflate, as done by the (optional) HDF5
+        // deflate filter when compression does not reduce the size
+        enc.assign(to_compress, to_compress + chunk_bytes);
+        filter_masks[chunk_idx] = 1u << (use_shuffle ? 1 : 0);
+      }
+    }
+  };
+
+  ParallelFor(encode_fn, RangeType(0, num_chunks));
+
+  for (size_type chunk_idx = 0; chunk_idx < num_chunks; ++chunk_idx)
+  {
+    const hsize_t offset[2] = { (chunk_idx / num_chunk_cols) * chunk_dims[0],
+                                (chunk_idx % num_chunk_cols) * chunk_dims[1] };
+
+    const auto& enc = encoded_chunks[chunk_idx];
+
+    if (H5Dwrite_chunk(data_set.getId(), H5P_DEFAULT, filter_masks[chunk_idx], offset,
+                       enc.size(), enc.data()) < 0)
+    {
+      xregThrow("failed to write chunk %lu of dataset: %s",
+                static_cast<unsigned long>(chunk_idx), field_name.c_str());
+    }
+  }
+#else
+  data_set.write(buf, data_type);
+#endif
+
+  return data_set;
+}
+
 void xreg::WriteLandmarksMapH5(const LandMap2& m, H5::Group* h5)
 {
   detail::WriteLandmarksMapH5Helper(m, h5);
@@ -843,6 +1206,12 @@ xreg::ReadVectorH5Long(const std::string& field_name, const H5::Group& h5)
   return detail::ReadVectorH5Helper<long>(field_name, h5);
 }
 
+std::vector<long long>
+xreg::ReadVectorH5LongLong(const std::string& field_name, const H5::Group& h5)
+{
+  return detail::ReadVectorH5Helper<long long>(field_name, h5);
+}
+
 std::vector<float>
 xreg::ReadVectorH5Float(const std::string& field_name, const H5::Group& h5)
 {
@@ -981,6 +1350,205 @@ xreg::ReadITKImageH5Double3D(const H5::Group& h5)
   return detail::ReadNDImageH5Helper<double,3>(h5);
 }
 
+itk::Image<unsigned char,2>::Pointer
+xreg::ReadITKImageRegionH5UChar2D(const H5::Group& h5, const itk::ImageRegion<2>& reg)
+{
+  return detail::ReadNDImageRegionH5Helper<unsigned char,2>(h5, reg);
+}
+
+itk::Image<char,2>::Pointer
+xreg::ReadITKImageRegionH5Char2D(const H5::Group& h5, const itk::ImageRegion<2>& reg)
+{
+  return detail::ReadNDImageRegionH5Helper<char,2>(h5, reg);
+}
+
+itk::Image<unsigned short,2>::Pointer
+xreg::ReadITKImageRegionH5UShort2D(const H5::Group& h5, const itk::ImageRegion<2>& reg)
+{
+  return detail::ReadNDImageRegionH5Helper<unsigned short,2>(h5, reg);
+}
+
+itk::Image<short,2>::Pointer
+xreg::ReadITKImageRegionH5Short2D(const H5::Group& h5, const itk::ImageRegion<2>& reg)
+{
+  return detail::ReadNDImageRegionH5Helper<short,2>(h5, reg);
+}
+
+itk::Image<float,2>::Pointer
+xreg::ReadITKImageRegionH5Float2D(const H5::Group& h5, const itk::ImageRegion<2>& reg)
+{
+  return detail::ReadNDImageRegionH5Helper<float,2>(h5, reg);
+}
+
+itk::Image<double,2>::Pointer
+xreg::ReadITKImageRegionH5Double2D(const H5::Group& h5, const itk::ImageRegion<2>& reg)
+{
+  return detail::ReadNDImageRegionH5Helper<double,2>(h5, reg);
+}
+
+itk::Image<unsigned char,3>::Pointer
+xreg::ReadITKImageRegionH5UChar3D(const H5::Group& h5, const itk::ImageRegion<3>& reg)
+{
+  return detail::ReadNDImageRegionH5Helper<unsigned char,3>(h5, reg);
+}
+
+itk::Image<char,3>::Pointer
+xreg::ReadITKImageRegionH5Char3D(const H5::Group& h5, const itk::ImageRegion<3>& reg)
+{
+  return detail::ReadNDImageRegionH5Helper<char,3>(h5, reg);
+}
+
+itk::Image<unsigned short,3>::Pointer
+xreg::ReadITKImageRegionH5UShort3D(const H5::Group& h5, const itk::ImageRegion<3>& reg)
+{
+  return detail::ReadNDImageRegionH5Helper<unsigned short,3>(h5, reg);
+}
+
+itk::Image<short,3>::Pointer
+xreg::ReadITKImageRegionH5Short3D(const H5::Group& h5, const itk::ImageRegion<3>& reg)
+{
+  return detail::ReadNDImageRegionH5Helper<short,3>(h5, reg);
+}
+
+itk::Image<float,3>::Pointer
+xreg::ReadITKImageRegionH5Float3D(const H5::Group& h5, const itk::ImageRegion<3>& reg)
+{
+  return detail::ReadNDImageRegionH5Helper<float,3>(h5, reg);
+}
+
+itk::Image<double,3>::Pointer
+xreg::ReadITKImageRegionH5Double3D(const H5::Group& h5, const itk::ImageRegion<3>& reg)
+{
+  return detail::ReadNDImageRegionH5Helper<double,3>(h5, reg);
+}
+
+namespace
+{
+
+template <unsigned int tN>
+typename itk::ImageBase<tN>::Pointer
+ReadITKImageInfoH5Helper(const H5::Group& h5, H5::DataType* pixel_type)
+{
+  H5::DataSet data_set;
+
+  // the pixel type of the image is only used as a container for the geometry,
+  // nothing is allocated
+  typename itk::ImageBase<tN>::Pointer img =
+                    xreg::detail::ReadNDImageMetaH5Helper<unsigned char,tN>(h5, &data_set).GetPointer();
+
+  if (pixel_type)
+  {
+    *pixel_type = data_set.getDataType();
+  }
+
+  return img;
+}
+
+}  // un-named
+
+itk::ImageBase<2>::Pointer
+xreg::ReadITKImageInfoH52D(const H5::Group& h5, H5::DataType* pixel_type)
+{
+  return ReadITKImageInfoH5Helper<2>(h5, pixel_type);
+}
+
+itk::ImageBase<3>::Pointer
+xreg::ReadITKImageInfoH53D(const H5::Group& h5, H5::DataType* pixel_type)
+{
+  return ReadITKImageInfoH5Helper<3>(h5, pixel_type);
+}
+
+void xreg::ReadDataSetsH5(const std::vector<H5DataSetReadDst>& dsts)
+{
+  const size_type num_dsts = dsts.size();
+
+  std::vector<Tiled2DLayout> layouts(num_dsts);
+
+  std::vector<RawChunk> chunks;
+
+  for (size_type dst_idx = 0; dst_idx < num_dsts; ++dst_idx)
+  {
+    const auto& dst = dsts[dst_idx];
+
+#ifdef XREG_H5_HAS_DIRECT_CHUNK_IO
+    if (!ReadRawChunksH5(dst, dst_idx, &layouts[dst_idx], &chunks))
+#endif
+    {
+      dst.data_set.read(dst.buf, dst.mem_data_type);
+    }
+  }
+
+  auto decode_fn = [&] (const RangeType& r)
+  {
+    std::vector<unsigned char> inflated_buf;
+    std::vector<unsigned char> unshuffled_buf;
+
+    for (size_type chunk_idx = r.begin(); chunk_idx < r.end(); ++chunk_idx)
+    {
+      const RawChunk& c = chunks[chunk_idx];
+
+      const Tiled2DLayout& layout = layouts[c.dst_idx];
+
+      const size_type elem_size = layout.elem_size;
+
+      const size_type chunk_row_bytes = layout.chunk_dims[1] * elem_size;
+      const size_type chunk_bytes     = layout.chunk_dims[0] * chunk_row_bytes;
+
+      const unsigned char* cur_bytes = c.bytes.data();
+
+      size_type cur_num_bytes = c.bytes.size();
+
+      // a set bit in the filter mask indicates that the filter was skipped
+      if ((layout.deflate_filter_idx >= 0) && !(c.filter_mask & (1u << layout.deflate_filter_idx)))
+      {
+        inflated_buf.resize(chunk_bytes);
+
+        uLongf inflated_len = chunk_bytes;
+
+        if (uncompress(inflated_buf.data(), &inflated_len, cur_bytes, cur_num_bytes) != Z_OK)
+        {
+          xregThrow("failed to decompress chunk of dataset!");
+        }
+
+        cur_bytes     = inflated_buf.data();
+        cur_num_bytes = inflated_len;
+      }
+
+      if (cur_num_bytes != chunk_bytes)
+      {
+        xregThrow("unexpected chunk size: %lu, expected: %lu",
+                  static_cast<unsigned long>(cur_num_bytes),
+                  static_cast<unsigned long>(chunk_bytes));
+      }
+
+      if ((layout.shuffle_filter_idx >= 0) && !(c.filter_mask & (1u << layout.shuffle_filter_idx)))
+      {
+        unshuffled_buf.resize(chunk_bytes);
+
+        UnshuffleBytes(cur_bytes, chunk_bytes / elem_size, elem_size, unshuffled_buf.data());
+
+        cur_bytes = unshuffled_buf.data();
+      }
+
+      // copy the chunk, excluding any padding, into the destination
+      const size_type row_bytes = layout.dims[1] * elem_size;
+
+      const size_type cur_num_rows = std::min(layout.chunk_dims[0], layout.dims[0] - c.offset[0]);
+      const size_type cur_num_cols = std::min(layout.chunk_dims[1], layout.dims[1] - c.offset[1]);
+
+      unsigned char* dst_bytes = static_cast<unsigned char*>(dsts[c.dst_idx].buf);
+
+      for (size_type row = 0; row < cur_num_rows; ++row)
+      {
+        std::memcpy(dst_bytes + ((c.offset[0] + row) * row_bytes) + (c.offset[1] * elem_size),
+                    cur_bytes + (row * chunk_row_bytes), cur_num_cols * elem_size);
+      }
+    }
+  };
+
+  ParallelFor(decode_fn, RangeType(0, chunks.size()));
+}
+
 xreg::LandMap2 xreg::ReadLandmarksMapH5Pt2(const H5::Group& h5)
 {
   return detail::ReadLandmarksMapH5Helper<Pt2>(h5);
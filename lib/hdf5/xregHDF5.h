@@ -73,6 +73,12 @@ inline H5::DataType LookupH5DataType<long>()
   return H5::PredType::NATIVE_LONG;
 }
 
+template <>
+inline H5::DataType LookupH5DataType<long long>()
+{
+  return H5::PredType::NATIVE_LLONG;
+}
+
 template <>
 inline H5::DataType LookupH5DataType<unsigned char>()
 {
@@ -292,6 +298,11 @@ H5::DataSet WriteVectorH5(const std::string& field_name,
                           H5::Group* h5,
                           const bool compress = true);
 
+H5::DataSet WriteVectorH5(const std::string& field_name,
+                          const std::vector<long long>& v,
+                          H5::Group* h5,
+                          const bool compress = true);
+
 H5::DataSet WriteVectorH5(const std::string& field_name,
                           const std::vector<float>& v,
                           H5::Group* h5,
@@ -409,6 +420,38 @@ void WriteMatrixRowH5(const float* row_buf, const unsigned long row_idx, H5::Dat
 
 void WriteMatrixRowH5(const double* row_buf, const unsigned long row_idx, H5::DataSet* h5);
 
+/// \brief Creates an empty, chunked, matrix dataset that may have rows appended
+///        using AppendMatrixRowsH5().
+///
+/// This is useful for writing results incrementally when the total number
+/// of rows is not known ahead of time, or when all rows cannot be held in
+/// memory. A vector is written by creating a matrix with a single column.
+H5::DataSet CreateExtendibleMatrixH5Float(const std::string& field_name,
+                                          const unsigned long num_cols,
+                                          const unsigned long chunk_num_rows,
+                                          H5::Group* h5,
+                                          const bool compress = true);
+
+H5::DataSet CreateExtendibleMatrixH5Double(const std::string& field_name,
+                                           const unsigned long num_cols,
+                                           const unsigned long chunk_num_rows,
+                                           H5::Group* h5,
+                                           const bool compress = true);
+
+H5::DataSet CreateExtendibleMatrixH5ULong(const std::string& field_name,
+                                          const unsigned long num_cols,
+                                          const unsigned long chunk_num_rows,
+                                          H5::Group* h5,
+                                          const bool compress = true);
+
+/// \brief Appends rows (stored contiguously in row-major order) to the end of
+///        a dataset created by one of the CreateExtendibleMatrixH5* functions.
+void AppendMatrixRowsH5(const float* rows_buf, const unsigned long num_rows, H5::DataSet* h5);
+
+void AppendMatrixRowsH5(const double* rows_buf, const unsigned long num_rows, H5::DataSet* h5);
+
+void AppendMatrixRowsH5(const unsigned long* rows_buf, const unsigned long num_rows, H5::DataSet* h5);
+
 H5::DataSet WriteAffineTransform4x4(const std::string& field_name,
                                     const FrameTransform& xform,
                                     H5::Group* h5,
@@ -454,6 +497,28 @@ void WriteImageH5(const itk::Image<double,3>* img,
                   H5::Group* h5,
                   const bool compress = true);
 
+/// \brief Default number of rows and columns of the tiles written by WriteTiled2DH5().
+constexpr unsigned long kH5_DEFAULT_TILE_DIM = 256;
+
+/// \brief Writes a 2D array, stored in row-major order, as a dataset of
+///        compressed 2D tiles.
+///
+/// Each tile is a chunk of the dataset and is stored using the standard HDF5
+/// shuffle (for multi-byte types) and deflate filters, so the dataset may be
+/// read by any HDF5 reader. When supported by the HDF5 library, the tiles are
+/// compressed concurrently and written directly, bypassing the (serial) HDF5
+/// filter pipeline. A deflate level of 1 is much faster than the maximum level
+/// used by the other compressed writes, while obtaining most of the size
+/// reduction for projection images.
+H5::DataSet WriteTiled2DH5(const std::string& field_name,
+                           const void* buf,
+                           const H5::DataType& data_type,
+                           const unsigned long num_rows,
+                           const unsigned long num_cols,
+                           H5::Group* h5,
+                           const unsigned long tile_dim = kH5_DEFAULT_TILE_DIM,
+                           const int deflate_level = 1);
+
 void WriteSegImageH5(const itk::Image<unsigned char,2>* img, 
                      H5::Group* h5,
                      const std::unordered_map<unsigned char,std::string>& seg_labels_def = std::unordered_map<unsigned char,std::string>(),
@@ -558,6 +623,9 @@ ReadVectorH5ULong(const std::string& field_name, const H5::Group& h5);
 std::vector<long>
 ReadVectorH5Long(const std::string& field_name, const H5::Group& h5);
 
+std::vector<long long>
+ReadVectorH5LongLong(const std::string& field_name, const H5::Group& h5);
+
 std::vector<float>
 ReadVectorH5Float(const std::string& field_name, const H5::Group& h5);
 
@@ -619,6 +687,82 @@ ReadITKImageH5Float3D(const H5::Group& h5);
 itk::Image<double,3>::Pointer
 ReadITKImageH5Double3D(const H5::Group& h5);
 
+/// \brief Reads a sub-region of an image written by WriteImageH5().
+///
+/// Only the pixels inside of the region are read from the file, directly into
+/// the returned image. The returned image has a zero start index and its origin
+/// is set to the physical location of the first voxel of the region. An
+/// exception is thrown when the region is not inside of the stored image.
+
+itk::Image<unsigned char,2>::Pointer
+ReadITKImageRegionH5UChar2D(const H5::Group& h5, const itk::ImageRegion<2>& reg);
+
+itk::Image<char,2>::Pointer
+ReadITKImageRegionH5Char2D(const H5::Group& h5, const itk::ImageRegion<2>& reg);
+
+itk::Image<unsigned short,2>::Pointer
+ReadITKImageRegionH5UShort2D(const H5::Group& h5, const itk::ImageRegion<2>& reg);
+
+itk::Image<short,2>::Pointer
+ReadITKImageRegionH5Short2D(const H5::Group& h5, const itk::ImageRegion<2>& reg);
+
+itk::Image<float,2>::Pointer
+ReadITKImageRegionH5Float2D(const H5::Group& h5, const itk::ImageRegion<2>& reg);
+
+itk::Image<double,2>::Pointer
+ReadITKImageRegionH5Double2D(const H5::Group& h5, const itk::ImageRegion<2>& reg);
+
+itk::Image<unsigned char,3>::Pointer
+ReadITKImageRegionH5UChar3D(const H5::Group& h5, const itk::ImageRegion<3>& reg);
+
+itk::Image<char,3>::Pointer
+ReadITKImageRegionH5Char3D(const H5::Group& h5, const itk::ImageRegion<3>& reg);
+
+itk::Image<unsigned short,3>::Pointer
+ReadITKImageRegionH5UShort3D(const H5::Group& h5, const itk::ImageRegion<3>& reg);
+
+itk::Image<short,3>::Pointer
+ReadITKImageRegionH5Short3D(const H5::Group& h5, const itk::ImageRegion<3>& reg);
+
+itk::Image<float,3>::Pointer
+ReadITKImageRegionH5Float3D(const H5::Group& h5, const itk::ImageRegion<3>& reg);
+
+itk::Image<double,3>::Pointer
+ReadITKImageRegionH5Double3D(const H5::Group& h5, const itk::ImageRegion<3>& reg);
+
+/// \brief Reads the geometry (size, spacing, origin, direction) of an image
+///        written by WriteImageH5(); the pixels are not read.
+///
+/// This may be used to determine the region of an image to read using one of
+/// the ReadITKImageRegionH5*() calls. The data type of the pixels is also
+/// returned, when pixel_type is not null.
+itk::ImageBase<2>::Pointer
+ReadITKImageInfoH52D(const H5::Group& h5, H5::DataType* pixel_type = nullptr);
+
+itk::ImageBase<3>::Pointer
+ReadITKImageInfoH53D(const H5::Group& h5, H5::DataType* pixel_type = nullptr);
+
+/// \brief The destination of a read of an entire dataset, see ReadDataSetsH5().
+struct H5DataSetReadDst
+{
+  H5::DataSet data_set;
+
+  H5::DataType mem_data_type;
+
+  /// \brief Must be large enough to store every element of the dataset
+  void* buf;
+};
+
+/// \brief Reads entire datasets, decompressing their chunks concurrently.
+///
+/// HDF5 calls may not be made concurrently, so the raw (compressed) chunks of
+/// 2D datasets stored with only the shuffle and/or deflate filters are read
+/// serially, after which the chunks of all datasets are decompressed
+/// concurrently. Any other datasets are read serially through the HDF5 filter
+/// pipeline, as are all datasets when direct chunk reads are not supported by
+/// the HDF5 library.
+void ReadDataSetsH5(const std::vector<H5DataSetReadDst>& dsts);
+
 LandMap2 ReadLandmarksMapH5Pt2(const H5::Group& h5);
 
 LandMap3 ReadLandmarksMapH5Pt3(const H5::Group& h5);
@@ -25,6 +25,9 @@
 #ifndef XREGHDF5INTERNAL_H_
 #define XREGHDF5INTERNAL_H_
 
+#include <array>
+#include <algorithm>
+
 #include "xregHDF5.h"
 
 namespace xreg
@@ -183,6 +186,66 @@ H5::DataSet WriteMatrixH5Helper(const std::string& field_name,
   return data_set; 
 }
 
+template <class tScalar>
+H5::DataSet CreateExtendibleMatrixH5Helper(const std::string& field_name,
+                                           const unsigned long num_cols,
+                                           const unsigned long chunk_num_rows,
+                                           H5::Group* h5,
+                                           const bool compress)
+{
+  using Scalar = tScalar;
+
+  H5::DSetCreatPropList props;
+  props.copy(H5::DSetCreatPropList::DEFAULT);
+
+  // extendible datasets must be chunked
+  const std::array<hsize_t,2> chunk_dims = { std::max(static_cast<hsize_t>(chunk_num_rows), hsize_t(1)),
+                                             static_cast<hsize_t>(num_cols) };
+  props.setChunk(2, chunk_dims.data());
+
+  if (compress)
+  {
+    props.setDeflate(9);
+  }
+
+  const std::array<hsize_t,2> init_dims = { 0, static_cast<hsize_t>(num_cols) };
+  const std::array<hsize_t,2> max_dims  = { H5S_UNLIMITED, static_cast<hsize_t>(num_cols) };
+
+  H5::DataSpace data_space(2, init_dims.data(), max_dims.data());
+
+  return h5->createDataSet(field_name, LookupH5DataType<Scalar>(), data_space, props);
+}
+
+template <class tScalar>
+void AppendMatrixRowsH5Helper(const tScalar* rows_buf, const unsigned long num_rows, H5::DataSet* h5)
+{
+  using Scalar = tScalar;
+
+  if (num_rows)
+  {
+    std::array<hsize_t,2> f_dims;
+    {
+      H5::DataSpace ds_f = h5->getSpace();
+      xregASSERT(ds_f.getSimpleExtentNdims() == 2);
+      ds_f.getSimpleExtentDims(f_dims.data());
+    }
+
+    const std::array<hsize_t,2> f_start = { f_dims[0], 0 };
+    const std::array<hsize_t,2> m_dims  = { static_cast<hsize_t>(num_rows), f_dims[1] };
+    
+    const std::array<hsize_t,2> new_f_dims = { f_dims[0] + num_rows, f_dims[1] };
+    h5->extend(new_f_dims.data());
+
+    // the data space must be retrieved again after extending
+    H5::DataSpace ds_f = h5->getSpace();
+    ds_f.selectHyperslab(H5S_SELECT_SET, m_dims.data(), f_start.data());
+
+    H5::DataSpace ds_m(2, m_dims.data());
+
+    h5->write(rows_buf, LookupH5DataType<Scalar>(), ds_m, ds_f);
+  }
+}
+
 template <class tScalar>
 void WriteMatrixRowH5Helper(const tScalar* row_buf, const unsigned long row_idx, H5::DataSet* h5)
 {
@@ -205,20 +268,15 @@ void WriteMatrixRowH5Helper(const tScalar* row_buf, const unsigned long row_idx,
   h5->write(row_buf, LookupH5DataType<Scalar>(), ds_m, ds_f);
 }
 
+/// \brief Writes the type attribute and metadata of an image, but not the pixels.
 template <class tScalar, unsigned int tN>
-void WriteNDImageH5Helper(const itk::Image<tScalar,tN>* img, 
-                          H5::Group* h5,
-                          const bool compress)
+void WriteNDImageMetaH5Helper(const itk::Image<tScalar,tN>* img, H5::Group* h5)
 {
-  using PixelScalar = tScalar;
-
   constexpr unsigned int kDIM = tN;
 
   // Set an attribute that indicates this is an N-D image
   SetStringAttr("xreg-type", fmt::format("image-{}D", kDIM), h5);
 
-  // first write the image metadata
-
   WriteMatrixH5("dir-mat", GetITKDirectionMatrix(img), h5, false);
 
   WriteMatrixH5("origin", GetITKOriginPoint(img), h5, false);
@@ -230,6 +288,19 @@ void WriteNDImageH5Helper(const itk::Image<tScalar,tN>* img,
     spacing[i] = itk_spacing[i];
   }
   WriteMatrixH5("spacing", spacing, h5, false);
+}
+
+template <class tScalar, unsigned int tN>
+void WriteNDImageH5Helper(const itk::Image<tScalar,tN>* img, 
+                          H5::Group* h5,
+                          const bool compress)
+{
+  using PixelScalar = tScalar;
+
+  constexpr unsigned int kDIM = tN;
+
+  // first write the image metadata
+  WriteNDImageMetaH5Helper(img, h5);
 
   // Now write the pixel data
 
@@ -300,6 +371,20 @@ void WriteNDImageH5Helper(const itk::Image<tScalar,tN>* img,
   data_set.write(img->GetBufferPointer(), data_type);
 }
 
+/// \brief Writes a 2D image with the same layout as WriteNDImageH5Helper(),
+///        but with the pixels stored in compressed tiles, see WriteTiled2DH5().
+template <class tScalar>
+void WriteTiled2DImageH5Helper(const itk::Image<tScalar,2>* img, H5::Group* h5)
+{
+  WriteNDImageMetaH5Helper(img, h5);
+
+  const auto itk_size = img->GetLargestPossibleRegion().GetSize();
+
+  // rows, then columns - see WriteNDImageH5Helper()
+  WriteTiled2DH5("pixels", img->GetBufferPointer(), LookupH5DataType<tScalar>(),
+                 itk_size[1], itk_size[0], h5);
+}
+
 template <class tMapIt>
 void WriteLandmarksMapH5Helper(tMapIt map_begin, tMapIt map_end, H5::Group* h5)
 {
@@ -502,9 +587,14 @@ ReadMatrixH5Helper(const std::string& field_name, const H5::Group& h5)
   return m;
 }
 
+/// \brief Reads the metadata of an image written by WriteNDImageH5Helper(),
+///        setting the geometry and largest region of the image, but does not
+///        allocate the pixel buffer.
+///
+/// The pixels dataset is also returned.
 template <class tScalar, unsigned int tN>
 typename itk::Image<tScalar,tN>::Pointer
-ReadNDImageH5Helper(const H5::Group& h5)
+ReadNDImageMetaH5Helper(const H5::Group& h5, H5::DataSet* pixels_data_set)
 {
   using PixelScalar = tScalar;
 
@@ -546,13 +636,148 @@ ReadNDImageH5Helper(const H5::Group& h5)
   }
   img->SetRegions(reg);
 
+  *pixels_data_set = data_set;
+
+  return img;
+}
+
+/// \brief Reads the metadata of an image written by WriteNDImageH5Helper() and
+///        allocates the image, but does not read the pixels.
+///
+/// The pixels dataset is returned so that it may be read later, e.g. along
+/// with the pixels of other images using ReadDataSetsH5().
+template <class tScalar, unsigned int tN>
+typename itk::Image<tScalar,tN>::Pointer
+ReadNDImageMetaAndAllocH5Helper(const H5::Group& h5, H5::DataSet* pixels_data_set)
+{
+  auto img = ReadNDImageMetaH5Helper<tScalar,tN>(h5, pixels_data_set);
+
+  img->Allocate();
+
+  return img;
+}
+
+template <class tScalar, unsigned int tN>
+typename itk::Image<tScalar,tN>::Pointer
+ReadNDImageH5Helper(const H5::Group& h5)
+{
+  H5::DataSet data_set;
+
+  auto img = ReadNDImageMetaAndAllocH5Helper<tScalar,tN>(h5, &data_set);
+
+  data_set.read(img->GetBufferPointer(), LookupH5DataType<tScalar>());
+
+  return img;
+}
+
+/// \brief Reads a sub-region of an image written by WriteNDImageH5Helper().
+///
+/// Only the requested hyperslab of the pixels dataset is read, directly into
+/// the buffer of the returned image; for chunked datasets only the chunks
+/// intersecting the region are decompressed. The returned image has a zero
+/// start index and its origin is moved to the first voxel of the region, so
+/// that physical coordinates are consistent with the full image.
+template <class tScalar, unsigned int tN>
+typename itk::Image<tScalar,tN>::Pointer
+ReadNDImageRegionH5Helper(const H5::Group& h5, const itk::ImageRegion<tN>& src_reg)
+{
+  constexpr unsigned int kDIM = tN;
+
+  using Img = itk::Image<tScalar,kDIM>;
+
+  H5::DataSet data_set;
+
+  auto img = ReadNDImageMetaH5Helper<tScalar,kDIM>(h5, &data_set);
+
+  const auto full_reg = img->GetLargestPossibleRegion();
+
+  if (!full_reg.IsInside(src_reg))
+  {
+    xregThrow("requested region is not inside of the image!");
+  }
+
+  typename Img::PointType new_origin;
+  img->TransformIndexToPhysicalPoint(src_reg.GetIndex(), new_origin);
+
+  img->SetOrigin(new_origin);
+
+  typename Img::RegionType dst_reg;
+  dst_reg.SetSize(src_reg.GetSize());
+
+  img->SetRegions(dst_reg);
   img->Allocate();
 
-  data_set.read(img->GetBufferPointer(), LookupH5DataType<PixelScalar>());
+  // the dataset dimensions are ordered slowest to fastest, which is reversed
+  // from ITK, see WriteITKImageH5
+  std::array<hsize_t,kDIM> file_start;
+  std::array<hsize_t,kDIM> count;
+
+  for (unsigned int i = 0; i < kDIM; ++i)
+  {
+    file_start[kDIM - 1 - i] = static_cast<hsize_t>(src_reg.GetIndex(i));
+    count[kDIM - 1 - i]      = static_cast<hsize_t>(src_reg.GetSize(i));
+  }
+
+  if (src_reg.GetNumberOfPixels())
+  {
+    H5::DataSpace file_space = data_set.getSpace();
+    file_space.selectHyperslab(H5S_SELECT_SET, count.data(), file_start.data());
+
+    const H5::DataSpace mem_space(kDIM, count.data());
+
+    data_set.read(img->GetBufferPointer(), LookupH5DataType<tScalar>(),
+                  mem_space, file_space);
+  }
 
   return img;
 }
 
+/// \brief Reads a 2D matrix dataset into an array of elements, where each
+///        column of the matrix is stored in a separate element.
+///
+/// Each row of the matrix is read directly into the destination with a strided
+/// memory selection, so that the columns do not need to be copied out of a
+/// temporary matrix. elem_stride is the number of scalars between the starts
+/// of consecutive elements in the destination buffer, which must have storage
+/// for the number of columns times elem_stride scalars.
+template <class tScalar>
+void ReadMatrixColsIntoStridedBufH5Helper(const H5::DataSet& data_set,
+                                          const hsize_t elem_stride,
+                                          tScalar* dst_buf)
+{
+  H5::DataSpace file_space = data_set.getSpace();
+
+  xregASSERT(file_space.getSimpleExtentNdims() == 2);
+
+  std::array<hsize_t,2> dims = { 0, 0 };
+  file_space.getSimpleExtentDims(dims.data());
+
+  const hsize_t num_rows = dims[0];
+  const hsize_t num_cols = dims[1];
+
+  xregASSERT(num_rows <= elem_stride);
+
+  if (num_cols)
+  {
+    const hsize_t mem_len = num_cols * elem_stride;
+
+    H5::DataSpace mem_space(1, &mem_len);
+
+    const std::array<hsize_t,2> file_count = { 1, num_cols };
+
+    for (hsize_t r = 0; r < num_rows; ++r)
+    {
+      const std::array<hsize_t,2> file_start = { r, 0 };
+
+      file_space.selectHyperslab(H5S_SELECT_SET, file_count.data(), file_start.data());
+
+      mem_space.selectHyperslab(H5S_SELECT_SET, &num_cols, &r, &elem_stride);
+
+      data_set.read(dst_buf, LookupH5DataType<tScalar>(), mem_space, file_space);
+    }
+  }
+}
+
 template <class tPt>
 std::unordered_map<std::string,tPt>
 ReadLandmarksMapH5Helper(const H5::Group& h5)
@@ -617,20 +842,44 @@ ReadListOfPointsFromMatrixH5Helper(const std::string& field_name, const H5::Grou
   
   using PtList = std::vector<Pt>;
 
-  const auto mat = ReadMatrixH5Helper<Scalar>(field_name, h5);
-  
-  const int dim = mat.rows();
+  PtList pts;
 
-  xregASSERT((kDIM == Eigen::Dynamic) || (kDIM == dim));
+  if (kDIM != Eigen::Dynamic)
+  {
+    // fixed size points are stored contiguously, read each coordinate of
+    // every point directly into the list
+    static_assert((kDIM == Eigen::Dynamic) || ((sizeof(Pt) % sizeof(Scalar)) == 0),
+                  "unexpected point padding");
 
-  const int num_pts = mat.cols();
+    const H5::DataSet data_set = h5.openDataSet(field_name);
 
-  PtList pts;
-  pts.reserve(num_pts);
+    std::array<hsize_t,2> dims = { 0, 0 };
+    data_set.getSpace().getSimpleExtentDims(dims.data());
 
-  for (int i = 0; i < num_pts; ++i)
+    xregASSERT(static_cast<int>(dims[0]) == kDIM);
+
+    pts.resize(dims[1]);
+
+    if (!pts.empty())
+    {
+      ReadMatrixColsIntoStridedBufH5Helper(data_set, sizeof(Pt) / sizeof(Scalar),
+                                           pts[0].data());
+    }
+  }
+  else
   {
-    pts.push_back(mat.block(0,i,dim,1));
+    const auto mat = ReadMatrixH5Helper<Scalar>(field_name, h5);
+    
+    const int dim = mat.rows();
+
+    const int num_pts = mat.cols();
+
+    pts.reserve(num_pts);
+
+    for (int i = 0; i < num_pts; ++i)
+    {
+      pts.push_back(mat.block(0,i,dim,1));
+    }
   }
 
   return pts;
@@ -647,28 +896,25 @@ ReadListOfArraysFromMatrixH5Helper(const std::string& field_name, const H5::Grou
   using Array        = std::array<Scalar,kDIM>;
   using ListOfArrays = std::vector<Array>;
 
-  const auto mat = ReadMatrixH5Helper<Scalar>(field_name, h5);
+  static_assert(sizeof(Array) == (kDIM * sizeof(Scalar)), "unexpected array padding");
 
-  xregASSERT(static_cast<unsigned long>(mat.rows() == kDIM));
+  const H5::DataSet data_set = h5.openDataSet(field_name);
 
-  const int num_arrays = mat.cols();
+  std::array<hsize_t,2> dims = { 0, 0 };
+  data_set.getSpace().getSimpleExtentDims(dims.data());
 
-  ListOfArrays arrays(num_arrays);
-  
-  for (int array_idx = 0; array_idx < num_arrays; ++array_idx)
-  {
-    auto& cur_array = arrays[array_idx];
+  xregASSERT(static_cast<unsigned long>(dims[0]) == kDIM);
 
-    for (unsigned long i = 0; i < kDIM; ++i)
-    {
-      cur_array[i] = mat(i,array_idx);
-    }
+  ListOfArrays arrays(dims[1]);
+
+  if (!arrays.empty())
+  {
+    ReadMatrixColsIntoStridedBufH5Helper(data_set, kDIM, arrays[0].data());
   }
 
   return arrays;
 }
 
-
 }  // detail
 }  // xreg
 
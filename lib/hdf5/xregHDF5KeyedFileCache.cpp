@@ -0,0 +1,99 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "xregHDF5KeyedFileCache.h"
+
+#include <cstdio>
+
+#include "xregFilesystemUtils.h"
+#include "xregHDF5.h"
+
+xreg::H5KeyedFileCache::H5KeyedFileCache(const std::string& cache_dir,
+                                         const std::string& entry_type,
+                                         const std::string& entry_ext)
+  : cache_dir_(cache_dir), entry_type_(entry_type), entry_ext_(entry_ext)
+{
+  if (!Path(cache_dir_).exists())
+  {
+    MakeDirRecursive(cache_dir_);
+  }
+}
+
+std::string xreg::H5KeyedFileCache::entry_path(const std::string& key) const
+{
+  return (Path(cache_dir_) + Path(key + entry_ext_)).string();
+}
+
+bool xreg::H5KeyedFileCache::read(const std::string& key, const ReadFn& read_fn) const
+{
+  const std::string path = entry_path(key);
+
+  if (!Path(path).exists())
+  {
+    return false;
+  }
+
+  H5::H5File h5(path, H5F_ACC_RDONLY);
+
+  if (GetStringAttr("xreg-type", h5) != entry_type_)
+  {
+    xregThrow("not a %s entry: %s", entry_type_.c_str(), path.c_str());
+  }
+
+  read_fn(h5);
+
+  return true;
+}
+
+void xreg::H5KeyedFileCache::write(const std::string& key, const WriteFn& write_fn) const
+{
+  const std::string path = entry_path(key);
+
+  const std::string tmp_path = MakeUniqueTmpPath(path);
+
+  try
+  {
+    {
+      H5::H5File h5(tmp_path, H5F_ACC_TRUNC);
+
+      SetStringAttr("xreg-type", entry_type_, &h5);
+
+      WriteStringH5("key", key, &h5, false);
+
+      write_fn(&h5);
+
+      h5.flush(H5F_SCOPE_GLOBAL);
+      h5.close();
+    }
+
+    // replaces any existing entry, also on Windows
+    MoveFileSystemItem(tmp_path, path);
+  }
+  catch (...)
+  {
+    std::remove(tmp_path.c_str());
+    throw;
+  }
+}
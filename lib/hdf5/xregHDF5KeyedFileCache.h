@@ -0,0 +1,92 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file
+ * @brief Directory of HDF5 files indexed by string keys, the storage shared
+ *        by the on-disk caches.
+ **/
+
+#ifndef XREGHDF5KEYEDFILECACHE_H_
+#define XREGHDF5KEYEDFILECACHE_H_
+
+#include <functional>
+#include <string>
+
+// Forward declarations
+namespace H5
+{
+
+class Group;
+
+}  // H5
+
+namespace xreg
+{
+
+/// \brief Directory of HDF5 files, one per key.
+///
+/// This handles locating, validating and atomically replacing the entries of
+/// an on-disk cache; the cache itself only (de)serializes the payload of an
+/// entry to/from the root group of the entry's file.
+class H5KeyedFileCache
+{
+public:
+  using ReadFn  = std::function<void(const H5::Group&)>;
+  using WriteFn = std::function<void(H5::Group*)>;
+
+  /// \brief Constructor, cache_dir is created if it does not exist.
+  ///
+  /// entry_type is stored in, and checked against, the "xreg-type" attribute
+  /// of each entry. entry_ext is the extension of each entry's file name, e.g.
+  /// ".drrs.h5".
+  H5KeyedFileCache(const std::string& cache_dir, const std::string& entry_type,
+                   const std::string& entry_ext);
+
+  /// \brief Calls read_fn with the root group of the entry for key.
+  ///
+  /// Returns false, without calling read_fn, when no entry exists for key.
+  bool read(const std::string& key, const ReadFn& read_fn) const;
+
+  /// \brief Creates the entry for key by calling write_fn with the root group
+  ///        of a new file, replacing any existing entry.
+  ///
+  /// The file is written to a uniquely named temporary file and then moved
+  /// into place, so that readers never see a partially written entry and
+  /// concurrent writers of the same key do not corrupt each other's files.
+  void write(const std::string& key, const WriteFn& write_fn) const;
+
+  /// \brief The path to the file storing the entry for key.
+  std::string entry_path(const std::string& key) const;
+
+private:
+  std::string cache_dir_;
+  std::string entry_type_;
+  std::string entry_ext_;
+};
+
+}  // xreg
+
+#endif
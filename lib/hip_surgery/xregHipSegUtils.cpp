@@ -31,10 +31,13 @@
 #include "xregITKLabelUtils.h"
 #include "xregSpatialPrimitives.h"
 #include "xregPAOCuts.h"
+#include "xregTBBUtils.h"
 
 namespace
 {
 
+using namespace xreg;
+
 template <class tLabelScalar>
 std::tuple<tLabelScalar,tLabelScalar,tLabelScalar>
 GuessPelvisLeftRightFemurLabelsHelper(const itk::Image<tLabelScalar,3>* label_img)
@@ -47,17 +50,15 @@ GuessPelvisLeftRightFemurLabelsHelper(const itk::Image<tLabelScalar,3>* label_im
   static_assert(!std::numeric_limits<LabelScalar>::is_signed,
                 "label type must be unsigned");
   
-  using LabelMap   = itk::Image<LabelScalar,3>;
-  using LabelMapIt = itk::ImageRegionConstIteratorWithIndex<LabelMap>;
-  
-  LabelHist label_hist(std::numeric_limits<LabelScalar>::max(), 0);
+  // the histogram and centroids of every label are computed in a single pass
+  const ITKLabelStatsList label_stats = ComputeITKLabelStats(label_img);
 
-  LabelMapIt it(label_img, label_img->GetLargestPossibleRegion());
+  // at least three entries, so that each of the labels may be found below
+  LabelHist label_hist(std::max(label_stats.size(), size_type(3)), 0);
 
-  // create the histogram
-  for (it.GoToBegin(); !it.IsAtEnd(); ++it)
+  for (size_type l = 0; l < label_stats.size(); ++l)
   {
-    ++label_hist[it.Value()];
+    label_hist[l] = label_stats[l].num_vox;
   }
 
   label_hist[0] = 0;  // make sure bg is ignored.
@@ -70,44 +71,28 @@ GuessPelvisLeftRightFemurLabelsHelper(const itk::Image<tLabelScalar,3>* label_im
   LabelScalar left_femur_label = static_cast<LabelScalar>(
       std::max_element(label_hist.begin(), label_hist.end()) - label_hist.begin());
  
-  const unsigned long num_left_femur_labels = label_hist[left_femur_label]; 
   label_hist[left_femur_label] = 0;
   
   LabelScalar right_femur_label = static_cast<LabelScalar>(
       std::max_element(label_hist.begin(), label_hist.end()) - label_hist.begin());
 
-  const unsigned long num_right_femur_labels = label_hist[right_femur_label];
+  // get the average X values of the left/right femur candidates, the mapping
+  // from indices to physical points is affine, so the average physical point
+  // is the mapping of the average index
 
-  // get the average X values of the left/right femur candidates
-  
-  double left_x_avg  = 0;
-  double right_x_avg = 0;
- 
-  itk::Point<double,3> cur_pt;
+  const FrameTransform itk_idx_to_phys = ITKImagePhysicalPointTransformsAsEigen(label_img);
 
-  for (it.GoToBegin(); !it.IsAtEnd(); ++it)
+  auto phys_x_avg = [&label_stats, &itk_idx_to_phys] (const size_type l)
   {
-    const LabelScalar& cur_label = it.Value();
+    return (l < label_stats.size()) ?
+              (itk_idx_to_phys * label_stats[l].centroid_idx().cast<CoordScalar>())[0] :
+              CoordScalar(0);
+  };
 
-    const bool is_left  = cur_label == left_femur_label;
-    const bool is_right = cur_label == right_femur_label;
+  const CoordScalar left_x_avg  = phys_x_avg(left_femur_label);
+  const CoordScalar right_x_avg = phys_x_avg(right_femur_label);
 
-    if (is_left || is_right)
-    {
-      label_img->TransformIndexToPhysicalPoint(it.GetIndex(), cur_pt);
-      
-      if (is_left)
-      {
-        left_x_avg += cur_pt[0];
-      }
-      else if (is_right)
-      {
-        right_x_avg += cur_pt[0];
-      }
-    }
-  }
-
-  if ((left_x_avg / num_left_femur_labels) < (right_x_avg / num_right_femur_labels))
+  if (left_x_avg < right_x_avg)
   {
     // The left femur has an average X coordinate less than the average X coordinate
     // of the right femur, but X increases from right to left, so they are flipped.
@@ -143,9 +128,21 @@ GuessPelvisPAOFragCutLabelsHelper(const itk::Image<tLabelType,3>* labels,
                                   const bool labels_has_frag,
                                   const bool labels_has_cut)
 {
-  const bool pelvis_label = GetITKImageMinPositive(labels);
+  // the minimum positive and maximum labels are found with a single pass
+  const ITKLabelStatsList label_stats = ComputeITKLabelStats(labels);
+
+  const tLabelType max_label = static_cast<tLabelType>(label_stats.empty() ? 0 : (label_stats.size() - 1));
 
-  const auto max_label = GetITKImageMax(labels);
+  tLabelType pelvis_label = 0;
+
+  for (size_type l = 1; l < label_stats.size(); ++l)
+  {
+    if (label_stats[l].num_vox)
+    {
+      pelvis_label = static_cast<tLabelType>(l);
+      break;
+    }
+  }
 
   return std::make_tuple(pelvis_label,
                          labels_has_frag ? 
@@ -260,8 +257,6 @@ void xreg::PAOExtract3DCutPointsForEachCut(const itk::Image<unsigned char,3>* la
   IndexList* cut_inds[4] =  { ilium_cut_inds, ischium_cut_inds,
                               pubis_cut_inds, post_cut_inds };
 
-  DstInd tmp_dst_idx;
-
   for (size_type cut_idx = 0; cut_idx < 4; ++cut_idx)
   {
     if (cut_pts[cut_idx])
@@ -274,71 +269,110 @@ void xreg::PAOExtract3DCutPointsForEachCut(const itk::Image<unsigned char,3>* la
       cut_inds[cut_idx]->clear();
     }
   }
-  
-  CoordScalar dists[4] = { 0, 0, 0, 0 };
 
-  LabelsIt it(labels, labels->GetLargestPossibleRegion());
+  // only the bounding box of the cut voxels needs to be visited
+  const auto cut_reg = ComputeITKLabelStats(labels, std::unordered_set<LabelType>{ cut_label }).bound_box();
+
+  const size_type num_slices = cut_reg.GetSize(2);
 
-  Pt3 tmp_idx;
-  Pt3 tmp_pt_wrt_vol;
-  Pt3 tmp_pt_wrt_app;
+  // Each slice is processed in parallel into separate lists, which are then
+  // concatenated, so that the output ordering matches a serial scan
+  std::vector<std::array<Pt3List,4>>   slice_cut_pts(num_slices);
+  std::vector<std::array<IndexList,4>> slice_cut_inds(num_slices);
 
   const FrameTransform itk_idx_to_phys = ITKImagePhysicalPointTransformsAsEigen(labels);
 
-  for (it.GoToBegin(); !it.IsAtEnd(); ++it)
+  auto extract_slices_fn = [&] (const RangeType& r)
   {
-    if (it.Value() == cut_label)
-    {
-      // map index to volume physical point
-      const auto& cur_idx = it.GetIndex();
-      tmp_idx[0] = cur_idx[0];
-      tmp_idx[1] = cur_idx[1];
-      tmp_idx[2] = cur_idx[2];
+    CoordScalar dists[4] = { 0, 0, 0, 0 };
 
-      tmp_pt_wrt_vol = itk_idx_to_phys * tmp_idx;
-    
-      // map volume physical point to APP where the cutting planes are defined
-      tmp_pt_wrt_app = vol_to_app * tmp_pt_wrt_vol;
+    Pt3 tmp_idx;
+    Pt3 tmp_pt_wrt_vol;
+    Pt3 tmp_pt_wrt_app;
 
-      // find the distances to each plane
+    DstInd tmp_dst_idx;
 
-      CoordScalar cur_min = std::numeric_limits<CoordScalar>::max();
+    for (size_type slice_idx = r.begin(); slice_idx < r.end(); ++slice_idx)
+    {
+      auto slice_reg = cut_reg;
+      slice_reg.SetIndex(2, cut_reg.GetIndex(2) + static_cast<itk::IndexValueType>(slice_idx));
+      slice_reg.SetSize(2, 1);
 
-      for (size_type cut_idx = 0; cut_idx < 4; ++cut_idx)
-      {
-        dists[cut_idx] = DistToPlane(tmp_pt_wrt_app, *cut_planes[cut_idx]);
-    
-        if (dists[cut_idx] < cur_min)
-        {
-          cur_min = dists[cut_idx];
-        }
-      }
+      LabelsIt it(labels, slice_reg);
 
-      // Assign volume point to a plane if the point is equal to the minimum distance
-      // (at the intersection of planes a point may belong to several planes)
-      for (size_type cut_idx = 0; cut_idx < 4; ++cut_idx)
+      for (it.GoToBegin(); !it.IsAtEnd(); ++it)
       {
-        if (std::abs(dists[cut_idx] - cur_min) < 1.0e-6)
+        if (it.Value() == cut_label)
         {
-          if (cut_pts[cut_idx])
+          // map index to volume physical point
+          const auto& cur_idx = it.GetIndex();
+          tmp_idx[0] = cur_idx[0];
+          tmp_idx[1] = cur_idx[1];
+          tmp_idx[2] = cur_idx[2];
+
+          tmp_pt_wrt_vol = itk_idx_to_phys * tmp_idx;
+        
+          // map volume physical point to APP where the cutting planes are defined
+          tmp_pt_wrt_app = vol_to_app * tmp_pt_wrt_vol;
+
+          // find the distances to each plane
+
+          CoordScalar cur_min = std::numeric_limits<CoordScalar>::max();
+
+          for (size_type cut_idx = 0; cut_idx < 4; ++cut_idx)
           {
-            cut_pts[cut_idx]->push_back(tmp_pt_wrt_vol);
+            dists[cut_idx] = DistToPlane(tmp_pt_wrt_app, *cut_planes[cut_idx]);
+        
+            if (dists[cut_idx] < cur_min)
+            {
+              cur_min = dists[cut_idx];
+            }
           }
 
-          if (cut_inds[cut_idx])
+          // Assign volume point to a plane if the point is equal to the minimum distance
+          // (at the intersection of planes a point may belong to several planes)
+          for (size_type cut_idx = 0; cut_idx < 4; ++cut_idx)
           {
-            // could do an optimization here if the label image index type
-            // is the same as this index.
-            
-            tmp_dst_idx[0] = cur_idx[0];
-            tmp_dst_idx[1] = cur_idx[1];
-            tmp_dst_idx[2] = cur_idx[2];
-
-            cut_inds[cut_idx]->push_back(tmp_dst_idx);
+            if (std::abs(dists[cut_idx] - cur_min) < 1.0e-6)
+            {
+              if (cut_pts[cut_idx])
+              {
+                slice_cut_pts[slice_idx][cut_idx].push_back(tmp_pt_wrt_vol);
+              }
+
+              if (cut_inds[cut_idx])
+              {
+                tmp_dst_idx[0] = cur_idx[0];
+                tmp_dst_idx[1] = cur_idx[1];
+                tmp_dst_idx[2] = cur_idx[2];
+
+                slice_cut_inds[slice_idx][cut_idx].push_back(tmp_dst_idx);
+              }
+            }
           }
         }
       }
     }
+  };
+
+  ParallelFor(extract_slices_fn, RangeType(0, num_slices));
+
+  for (size_type slice_idx = 0; slice_idx < num_slices; ++slice_idx)
+  {
+    for (size_type cut_idx = 0; cut_idx < 4; ++cut_idx)
+    {
+      if (cut_pts[cut_idx])
+      {
+        const Pt3List& src_pts = slice_cut_pts[slice_idx][cut_idx];
+        cut_pts[cut_idx]->insert(cut_pts[cut_idx]->end(), src_pts.begin(), src_pts.end());
+      }
+
+      if (cut_inds[cut_idx])
+      {
+        const IndexList& src_inds = slice_cut_inds[slice_idx][cut_idx];
+        cut_inds[cut_idx]->insert(cut_inds[cut_idx]->end(), src_inds.begin(), src_inds.end());
+      }
+    }
   }
 }
 
@@ -29,8 +29,10 @@
 #include "xregAssert.h"
 #include "xregSampleUtils.h"
 #include "xregHipSegUtils.h"
+#include "xregHUToLinAtt.h"
 #include "xregITKBasicImageUtils.h"
 #include "xregVTKMeshUtils.h"
+#include "xregTBBUtils.h"
 
 xreg::CreateRandScrew::CreateRandScrew()
 {
@@ -193,6 +195,60 @@ xreg::CreateRandKWire::operator()(const Pt3& iliac_entry_pt, const Pt3& stop_pt)
 
   return std::make_tuple(s, wire_to_world_xform);
 }
+
+xreg::NaiveMetalObjs
+xreg::SampleNaiveMetalObjs(const Pt3List& obj_start_pts,
+                           const Pt3List& obj_end_pts,
+                           const double prob_screw,
+                           CreateRandScrew* create_screw,
+                           CreateRandKWire* create_kwire,
+                           const float hu_lower)
+{
+  const size_type num_objs = obj_start_pts.size();
+  
+  xregASSERT(num_objs == obj_end_pts.size());
+
+  std::uniform_real_distribution<double> obj_dist(0,1);
+
+  std::uniform_real_distribution<float> screw_hu_dist(14000, 16000);
+  std::uniform_real_distribution<float> kwire_hu_dist(14000, 26000);
+
+  std::mt19937& rng_eng = create_screw->rng_eng;
+
+  NaiveMetalObjs objs;
+
+  for (size_type obj_idx = 0; obj_idx < num_objs; ++obj_idx)
+  {
+    if (obj_dist(rng_eng) < prob_screw)
+    {
+      objs.screw_lin_atts.push_back(HUToLinAtt(screw_hu_dist(rng_eng), hu_lower));
+
+      NaiveScrewModel s;
+      FrameTransform screw_to_vol_xform;
+
+      std::tie(s,screw_to_vol_xform) = (*create_screw)(obj_start_pts[obj_idx],
+                                                       obj_end_pts[obj_idx]);
+
+      objs.screw_models.push_back(s);
+      objs.screw_poses_wrt_vol.push_back(screw_to_vol_xform);
+    }
+    else
+    {
+      objs.kwire_lin_atts.push_back(HUToLinAtt(kwire_hu_dist(rng_eng), hu_lower));
+
+      NaiveKWireModel w;
+      FrameTransform kwire_to_vol_xform;
+
+      std::tie(w,kwire_to_vol_xform) = (*create_kwire)(obj_start_pts[obj_idx],
+                                                       obj_end_pts[obj_idx]);
+
+      objs.kwire_models.push_back(w);
+      objs.kwire_poses_wrt_vol.push_back(kwire_to_vol_xform);
+    }
+  }
+
+  return objs;
+}
   
 void xreg::PAOSampleScrewWireInsertionPts::init()
 {
@@ -321,45 +377,43 @@ void xreg::PAOSampleScrewWireInsertionPts::init()
 
   kdt_insertion.reset(new KDTree(kd_tris_insertion.begin(), kd_tris_insertion.end()));
 
-  SeedRNGEngWithRandDev(&rng_eng);
-}
-
-void xreg::PAOSampleScrewWireInsertionPts::run(const FrameTransform& frag_xform)
-{
-  const FrameTransform frag_xform_wrt_vol = app_to_vol * frag_xform * app_to_vol.inverse();
-  
-  const Pt3 xform_femur_pt_wrt_vol = frag_xform_wrt_vol * femur_pt_wrt_vol;
- 
-  TriMesh frag_mesh_xform = frag_mesh;
-
-  frag_mesh_xform.transform(frag_xform_wrt_vol);
-
   this->dout() << "creating fragment surface triangles for screw direction intersection..." << std::endl;
 
-  const size_type num_tris = frag_mesh_xform.faces.size();
+  const size_type num_frag_tris = frag_mesh.faces.size();
 
-  std::vector<Tri3ForRay3Intersect> tris;
-  tris.resize(num_tris);
+  frag_tris.resize(num_frag_tris);
 
-  for (size_type tri_idx = 0; tri_idx < num_tris; ++tri_idx)
+  for (size_type tri_idx = 0; tri_idx < num_frag_tris; ++tri_idx)
   {
-    auto& cur_tri = tris[tri_idx];
+    auto& cur_tri = frag_tris[tri_idx];
 
-    auto& cur_face = frag_mesh_xform.faces[tri_idx];
+    const auto& cur_face = frag_mesh.faces[tri_idx];
 
-    cur_tri.verts[0] = &frag_mesh_xform.vertices[cur_face[0]];
-    cur_tri.verts[1] = &frag_mesh_xform.vertices[cur_face[1]];
-    cur_tri.verts[2] = &frag_mesh_xform.vertices[cur_face[2]];
+    cur_tri.verts[0] = &frag_mesh.vertices[cur_face[0]];
+    cur_tri.verts[1] = &frag_mesh.vertices[cur_face[1]];
+    cur_tri.verts[2] = &frag_mesh.vertices[cur_face[2]];
   
     cur_tri.init();
   }
 
-  std::vector<KDTreeTri> kd_tris_frag;
+  this->dout() << "creating KD-Tree for closest point lookups on fragment mesh..." << std::endl;
+  kd_tris_frag = CreateTrisForKDTree(frag_mesh);
+
+  kdt_frag.reset(new KDTree(kd_tris_frag.begin(), kd_tris_frag.end()));
+
+  SeedRNGEngWithRandDev(&rng_eng);
+}
+
+void xreg::PAOSampleScrewWireInsertionPts::run(const FrameTransform& frag_xform)
+{
+  const FrameTransform frag_xform_wrt_vol = app_to_vol * frag_xform * app_to_vol.inverse();
   
-  this->dout() << "creating KD-Tree for closest point lookups on transformed fragment mesh..." << std::endl;
-  kd_tris_frag = CreateTrisForKDTree(frag_mesh_xform);
+  const Pt3 xform_femur_pt_wrt_vol = frag_xform_wrt_vol * femur_pt_wrt_vol;
 
-  KDTree kdt_frag(kd_tris_frag.begin(), kd_tris_frag.end());
+  // The fragment movement is rigid, so candidate rays and closest point
+  // queries are mapped into the frame of the fragment surface prior to
+  // movement and the results are mapped back.
+  const FrameTransform vol_to_orig_frag = frag_xform_wrt_vol.inverse();
 
   std::uniform_int_distribution<size_type> insertion_indices_dist(0, insertion_indices.size() - 1);
 
@@ -376,58 +430,41 @@ void xreg::PAOSampleScrewWireInsertionPts::run(const FrameTransform& frag_xform)
   CoordScalar cur_obj_min_sep_thresh = 20;
   size_type   num_obj_start_rejects  = 0;
 
-  for (size_type obj_idx = 0; obj_idx < num_objs;)
-  {
-    this->dout() << "chosing insertion point: " << obj_idx << std::endl;
-
-    const ITKIndex insert_idx = insertion_indices[insertion_indices_dist(rng_eng)];
-    
-    itk::Point<CoordScalar,3> itk_pt;
-    insert_labels_trim->TransformIndexToPhysicalPoint(insert_idx, itk_pt);
-
-    Pt3 obj_start = { itk_pt[0], itk_pt[1], itk_pt[2] };
-  
-    const KDTreeTri* closest_tri = nullptr;
-    
-    obj_start = std::get<0>(kdt_insertion->find_closest_point(obj_start, &closest_tri));
+  const size_type batch_size = std::max(size_type(1), num_cands_per_batch);
 
-    // make sure the candidate is sufficiently far away from the previously
-    // chosen start points
-    bool start_is_good = true;
+  std::vector<ITKIndex> cand_insert_inds(batch_size);
+  Pt3List cand_starts(batch_size);
+  Pt3List cand_ends(batch_size);
+  std::vector<char> cand_end_is_good(batch_size);
 
-    for (const Pt3& prev_pt : obj_starts)
+  // Finds the start point and end point of a candidate, this does not depend
+  // on the other candidates or the random number generator
+  auto find_cand_start_end_fn = [&] (const RangeType& r)
+  {
+    for (size_type cand_idx = r.begin(); cand_idx < r.end(); ++cand_idx)
     {
-      if ((prev_pt - obj_start).norm() < cur_obj_min_sep_thresh)
-      {
-        start_is_good = false;
-        
-        ++num_obj_start_rejects;
+      itk::Point<CoordScalar,3> itk_pt;
+      insert_labels_trim->TransformIndexToPhysicalPoint(cand_insert_inds[cand_idx], itk_pt);
 
-        if (num_obj_start_rejects >= 100000)
-        {
-          // we're having trouble sampling a starting point, make the minimum
-          // separating distance threshold less strict
+      Pt3 obj_start = { itk_pt[0], itk_pt[1], itk_pt[2] };
+    
+      const KDTreeTri* closest_tri = nullptr;
+      
+      obj_start = std::get<0>(kdt_insertion->find_closest_point(obj_start, &closest_tri));
 
-          num_obj_start_rejects = 0;
-          cur_obj_min_sep_thresh /= 1.5;
-        }
-        
-        break;
-      }
-    }
+      cand_starts[cand_idx] = obj_start;
 
-    if (start_is_good)
-    {
       Pt3 insert_normal = (*closest_tri->verts[1] - *closest_tri->verts[0]).cross(
                              *closest_tri->verts[2] - *closest_tri->verts[0]);
       insert_normal /= insert_normal.norm();
 
-      this->dout() << "finding object end for object: " << obj_idx << std::endl;
-
       Pt3 obj_start_to_fh = xform_femur_pt_wrt_vol - obj_start;
       obj_start_to_fh /= obj_start_to_fh.norm();
 
-      const Pt3 closest_pt_on_frag = std::get<0>(kdt_frag.find_closest_point(obj_start));
+      const Pt3 obj_start_wrt_orig_frag = vol_to_orig_frag * obj_start;
+
+      const Pt3 closest_pt_on_frag = frag_xform_wrt_vol *
+                    std::get<0>(kdt_frag->find_closest_point(obj_start_wrt_orig_frag));
       
       Pt3 obj_start_to_closest_frag_dir = closest_pt_on_frag - obj_start;
       obj_start_to_closest_frag_dir /= obj_start_to_closest_frag_dir.norm();
@@ -446,17 +483,17 @@ void xreg::PAOSampleScrewWireInsertionPts::run(const FrameTransform& frag_xform)
       for (size_type inter_trial_idx = 0; inter_trial_idx < 6;
            obj_start_to_fh_frac += 0.1, ++inter_trial_idx)
       {
-        this->dout() << obj_start_to_fh_frac << std::endl;
+        Pt3 dir = (obj_start_to_fh_frac * obj_start_to_fh) +
+                  ((1 - obj_start_to_fh_frac) * init_obj_dir_vec); 
+        dir /= dir.norm();
 
         Ray3 r;
-        r.pt  = obj_start;
-        r.dir = (obj_start_to_fh_frac * obj_start_to_fh) +
-                ((1 - obj_start_to_fh_frac) * init_obj_dir_vec); 
-        r.dir /= r.dir.norm();
+        r.pt  = obj_start_wrt_orig_frag;
+        r.dir = vol_to_orig_frag.linear() * dir;
 
-        std::tie(dist_to_inter, inter_info) = ExhaustiveRayTrisIntersect(r, tris);
+        std::tie(dist_to_inter, inter_info) = ExhaustiveRayTrisIntersect(r, frag_tris);
         
-        const CoordScalar obj_len = (obj_start - inter_info.inter_pt).norm();
+        const CoordScalar obj_len = (obj_start_wrt_orig_frag - inter_info.inter_pt).norm();
 
         // terminate this loop on intersection and reasonable object length
         if ((dist_to_inter > -1.0e-6) &&
@@ -466,13 +503,64 @@ void xreg::PAOSampleScrewWireInsertionPts::run(const FrameTransform& frag_xform)
           break;
         }
       }
-     
+
+      cand_end_is_good[cand_idx] = end_is_good;
+
       if (end_is_good)
+      {
+        cand_ends[cand_idx] = frag_xform_wrt_vol * inter_info.inter_pt;
+      }
+    }
+  };
+
+  for (size_type obj_idx = 0; obj_idx < num_objs;)
+  {
+    this->dout() << "evaluating a batch of candidate insertion points for object: " << obj_idx << std::endl;
+
+    // the insertion points are sampled serially, so that the same candidates
+    // are evaluated for a given seed
+    for (size_type cand_idx = 0; cand_idx < batch_size; ++cand_idx)
+    {
+      cand_insert_inds[cand_idx] = insertion_indices[insertion_indices_dist(rng_eng)];
+    }
+
+    ParallelFor(find_cand_start_end_fn, RangeType(0, batch_size));
+
+    for (size_type cand_idx = 0; (cand_idx < batch_size) && (obj_idx < num_objs); ++cand_idx)
+    {
+      const Pt3& obj_start = cand_starts[cand_idx];
+
+      // make sure the candidate is sufficiently far away from the previously
+      // chosen start points
+      bool start_is_good = true;
+
+      for (const Pt3& prev_pt : obj_starts)
+      {
+        if ((prev_pt - obj_start).norm() < cur_obj_min_sep_thresh)
+        {
+          start_is_good = false;
+          
+          ++num_obj_start_rejects;
+
+          if (num_obj_start_rejects >= 100000)
+          {
+            // we're having trouble sampling a starting point, make the minimum
+            // separating distance threshold less strict
+
+            num_obj_start_rejects = 0;
+            cur_obj_min_sep_thresh /= 1.5;
+          }
+          
+          break;
+        }
+      }
+
+      if (start_is_good && cand_end_is_good[cand_idx])
       {
         obj_starts.push_back(obj_start);
-        obj_ends.push_back(inter_info.inter_pt);
+        obj_ends.push_back(cand_ends[cand_idx]);
         ++obj_idx;
       }
-    }  // end if start_is_good
+    }
   }  // end for screw_idx
 }
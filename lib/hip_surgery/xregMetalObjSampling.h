@@ -30,7 +30,7 @@
 #include "xregMetalObjs.h"
 #include "xregObjWithOStream.h"
 #include "xregMesh.h"
-#include "xregKDTree.h"
+#include "xregFlatKDTree.h"
 
 namespace xreg
 {
@@ -53,13 +53,27 @@ struct CreateRandKWire : public ObjWithOStream
   std::tuple<NaiveKWireModel,FrameTransform> operator()(const Pt3& iliac_entry_pt, const Pt3& stop_pt);
 };
 
+/// \brief Creates random screws and K-wires between pairs of start and end
+///        points, without inserting them into a volume.
+///
+/// This uses the same distributions of shapes and HU values as
+/// AddPAOScrewKWireToVol. The HU values are converted into linear attenuations
+/// with HUToLinAtt(), using hu_lower. The rng engine of create_screw is used to
+/// choose between a screw and K-wire and to sample the HU values.
+NaiveMetalObjs SampleNaiveMetalObjs(const Pt3List& obj_start_pts,
+                                    const Pt3List& obj_end_pts,
+                                    const double prob_screw,
+                                    CreateRandScrew* create_screw,
+                                    CreateRandKWire* create_kwire,
+                                    const float hu_lower = -1000);
+
 struct PAOSampleScrewWireInsertionPts : public ObjWithOStream
 {
   using LabelScalar = unsigned char;
   using LabelVol    = itk::Image<LabelScalar,3>;
   using LabelVolPtr = LabelVol::Pointer;
   using ITKIndex    = LabelVol::IndexType;
-  using KDTree      = KDTreeNode<KDTreeTri>;
+  using KDTree      = FlatKDTree<KDTreeTri>;
 
   LabelVolPtr insert_labels;
 
@@ -73,6 +87,10 @@ struct PAOSampleScrewWireInsertionPts : public ObjWithOStream
   // probaility is the chance of inserting three objects
   double prob_two_objs = 0.5;
 
+  // number of candidate insertion points sampled and evaluated concurrently,
+  // candidates are accepted in the order they were sampled
+  size_type num_cands_per_batch = 64;
+
   void init();
 
   void run(const FrameTransform& frag_xform);
@@ -90,6 +108,15 @@ struct PAOSampleScrewWireInsertionPts : public ObjWithOStream
   std::vector<KDTreeTri> kd_tris_insertion;
   
   std::unique_ptr<KDTree> kdt_insertion;
+
+  // the fragment surface, prior to any movement, used to find object ends;
+  // queries are mapped into this frame so that no per-movement structures
+  // need to be built
+  std::vector<Tri3ForRay3Intersect> frag_tris;
+
+  std::vector<KDTreeTri> kd_tris_frag;
+
+  std::unique_ptr<KDTree> kdt_frag;
   
   std::mt19937 rng_eng;
 
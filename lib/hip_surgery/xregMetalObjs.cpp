@@ -76,6 +76,20 @@ xreg::BoundBox3 xreg::ComputeBoundingBox(const NaiveScrewModel& s)
                               ComputeBoundingBox(s.body)));
 }
 
+xreg::CoordScalar xreg::LineSegNaiveScrewIntersectLen(const Pt3& start_pt, const Pt3& end_pt,
+                                                      const NaiveScrewModel& s)
+{
+  // The cap, body, and tip are disjoint, except on their boundaries, so the
+  // length through the screw is the sum of the lengths through each part.
+
+  const auto body_to_cap = s.body_to_cap_xform();
+  const auto body_to_tip = s.body_to_tip_xform();
+
+  return LineSegCylIntersectLen(start_pt, end_pt, s.body) +
+         LineSegCylIntersectLen(body_to_cap * start_pt, body_to_cap * end_pt, s.cap) +
+         LineSegConeIntersectLen(body_to_tip * start_pt, body_to_tip * end_pt, s.tip);
+}
+
 xreg::FrameTransform xreg::NaiveKWireModel::tip_to_body_xform() const
 {
   FrameTransform xform = FrameTransform::Identity();
@@ -107,6 +121,15 @@ xreg::BoundBox3 xreg::ComputeBoundingBox(const NaiveKWireModel& s)
                            ComputeBoundingBox(s.body));
 }
 
+xreg::CoordScalar xreg::LineSegNaiveKWireIntersectLen(const Pt3& start_pt, const Pt3& end_pt,
+                                                      const NaiveKWireModel& s)
+{
+  const auto body_to_tip = s.body_to_tip_xform();
+
+  return LineSegCylIntersectLen(start_pt, end_pt, s.body) +
+         LineSegConeIntersectLen(body_to_tip * start_pt, body_to_tip * end_pt, s.tip);
+}
+
 std::tuple<xreg::CoordScalar,xreg::SurIntersectInfo>
 xreg::RayNaiveKWireIntersect(const Ray3& ray,
                              const NaiveKWireModel& kwire,
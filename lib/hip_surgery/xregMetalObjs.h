@@ -25,6 +25,8 @@
 #ifndef XREGMETALOBJS_H_
 #define XREGMETALOBJS_H_
 
+#include <vector>
+
 #include "xregSpatialPrimitives.h"
 
 namespace xreg
@@ -53,6 +55,12 @@ bool PointInNaiveScrew(const NaiveScrewModel& s, const Pt3& p);
 
 BoundBox3 ComputeBoundingBox(const NaiveScrewModel& s);
 
+/// \brief Length of the portion of a line segment lying inside a screw.
+///
+/// The segment end points are expressed in the screw's (body) frame.
+CoordScalar LineSegNaiveScrewIntersectLen(const Pt3& start_pt, const Pt3& end_pt,
+                                          const NaiveScrewModel& s);
+
 // Y-Axis is the k-wire cylinder axis with increasing values as
 // you move towards the pointed tip.
 // Origin is at the origin of the cylinder body (halfway along the cylinder height/y-axis).
@@ -70,11 +78,33 @@ bool PointInNaiveKWire(const NaiveKWireModel& s, const Pt3& p);
 
 BoundBox3 ComputeBoundingBox(const NaiveKWireModel& s);
 
+/// \brief Length of the portion of a line segment lying inside a K-wire.
+///
+/// The segment end points are expressed in the K-wire's (body) frame.
+CoordScalar LineSegNaiveKWireIntersectLen(const Pt3& start_pt, const Pt3& end_pt,
+                                          const NaiveKWireModel& s);
+
 std::tuple<CoordScalar,SurIntersectInfo>
 RayNaiveKWireIntersect(const Ray3& ray,
                        const NaiveKWireModel& kwire,
                        const CoordScalar max_dist_thresh = -1);
 
+/// \brief A collection of screws and K-wires with poses and attenuations.
+///
+/// The poses map points in each object's frame into the volume's physical
+/// frame. The attenuations are linear attenuation coefficients (1/mm) and are
+/// assumed uniform over each object.
+struct NaiveMetalObjs
+{
+  std::vector<NaiveScrewModel> screw_models;
+  FrameTransformList screw_poses_wrt_vol;
+  std::vector<CoordScalar> screw_lin_atts;
+
+  std::vector<NaiveKWireModel> kwire_models;
+  FrameTransformList kwire_poses_wrt_vol;
+  std::vector<CoordScalar> kwire_lin_atts;
+};
+
 }  // xreg
 
 #endif
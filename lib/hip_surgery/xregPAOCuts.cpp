@@ -39,6 +39,7 @@
 #include "xregITKBasicImageUtils.h"
 #include "xregITKLabelUtils.h"
 #include "xregRotUtils.h"
+#include "xregTBBUtils.h"
 
 void xreg::DrawPAOCutPlanes(const PAOCutPlanes& cut_defs,
                             const PAOCutDispInfo& disp_info,
@@ -675,6 +676,18 @@ xreg::PAOCheckInsideCutPlanesFn::PAOCheckInsideCutPlanesFn(
 
   vtk_planes->SetPoints(plane_pts.GetPointer());
   vtk_planes->SetNormals(plane_normals.GetPointer());
+
+  for (int plane_idx = 0; plane_idx < 6; ++plane_idx)
+  {
+    Eigen::Vector3d n;
+    plane_normals->GetTuple(plane_idx, n.data());
+
+    Eigen::Vector3d p;
+    plane_pts->GetPoint(plane_idx, p.data());
+
+    this->bounding_plane_normals[plane_idx] = n;
+    this->bounding_plane_offsets[plane_idx] = n.dot(p);
+  }
 }
 
 bool xreg::PAOCheckInsideCutPlanesFn::inside(const Pt3& x)
@@ -697,6 +710,93 @@ xreg::PAOCheckInsideCutPlanesFn::signed_dist(const Pt3& x)
   return static_cast<CoordScalar>(vtk_planes->FunctionValue(x[0], x[1], x[2]));
 }
 
+std::array<long,2>
+xreg::PAOCheckInsideCutPlanesFn::inside_range_along_line(const Pt3& start, const Pt3& step,
+                                                        const long num_pts) const
+{
+  // same tolerance used by inside()
+  constexpr double kTOL = 1.0e-6;
+
+  double lo = 0;
+  double hi = static_cast<double>(num_pts - 1);
+
+  bool empty = num_pts <= 0;
+
+  const Eigen::Vector3d start_d = start.cast<double>();
+  const Eigen::Vector3d step_d  = step.cast<double>();
+
+  for (int plane_idx = 0; (plane_idx < 6) && !empty; ++plane_idx)
+  {
+    // signed distance of point i is c + (i * g)
+    const double c = bounding_plane_normals[plane_idx].dot(start_d) - bounding_plane_offsets[plane_idx];
+    const double g = bounding_plane_normals[plane_idx].dot(step_d);
+
+    if (g > 0)
+    {
+      hi = std::min(hi, (kTOL - c) / g);
+    }
+    else if (g < 0)
+    {
+      lo = std::max(lo, (kTOL - c) / g);
+    }
+    else if (c >= kTOL)
+    {
+      empty = true;
+    }
+
+    empty = empty || (lo > hi);
+  }
+
+  std::array<long,2> r = { { 0, 0 } };
+
+  if (!empty)
+  {
+    // allow for round-off in the bounds
+    r[0] = std::max(0L, static_cast<long>(std::floor(lo)) - 1);
+    r[1] = std::min(num_pts, static_cast<long>(std::ceil(hi)) + 2);
+  }
+
+  return r;
+}
+
+void xreg::PAOCheckInsideCutPlanesFn::signed_dists_along_line(const Pt3& start, const Pt3& step,
+                                                              const long begin, const long end,
+                                                              double* dists) const
+{
+  const long num_pts = end - begin;
+
+  const Eigen::Vector3d start_d = start.cast<double>();
+  const Eigen::Vector3d step_d  = step.cast<double>();
+
+  std::array<double,6> c;
+  std::array<double,6> g;
+
+  for (int plane_idx = 0; plane_idx < 6; ++plane_idx)
+  {
+    g[plane_idx] = bounding_plane_normals[plane_idx].dot(step_d);
+    c[plane_idx] = bounding_plane_normals[plane_idx].dot(start_d) - bounding_plane_offsets[plane_idx] +
+                                                            (begin * g[plane_idx]);
+  }
+
+  // simple loops over contiguous memory, without branches, so that the
+  // compiler is able to vectorize
+  for (long i = 0; i < num_pts; ++i)
+  {
+    dists[i] = c[0] + (i * g[0]);
+  }
+
+  for (int plane_idx = 1; plane_idx < 6; ++plane_idx)
+  {
+    const double cur_c = c[plane_idx];
+    const double cur_g = g[plane_idx];
+
+    for (long i = 0; i < num_pts; ++i)
+    {
+      dists[i] = std::max(dists[i], cur_c + (i * cur_g));
+    }
+  }
+}
+
 void xreg::CreatePAOFragLabelMapFromCutPlanesFn::operator()()
 {
   using LabelImageIndex    = LabelVol::IndexType;
@@ -718,45 +818,85 @@ void xreg::CreatePAOFragLabelMapFromCutPlanesFn::operator()()
   const FrameTransform label_ind_to_app = app_to_vol.inverse()
                                             * label_inds_to_label_phys;
 
-  Pt3 cur_pt_app;
-  Pt3 cur_ind;
-
   LabelVolPtr init_frag_labels = ITKImageDeepCopy(src_labels);
 
-  LabelImageIterator label_it(init_frag_labels,
-                              init_frag_labels->GetLargestPossibleRegion());
+  const auto vol_itk_size = src_labels->GetLargestPossibleRegion().GetSize();
+
+  const long num_cols   = static_cast<long>(vol_itk_size[0]);
+  const long num_rows   = static_cast<long>(vol_itk_size[1]);
+  const long num_slices = static_cast<long>(vol_itk_size[2]);
+
+  const size_type num_vox = static_cast<size_type>(num_cols) * num_rows * num_slices;
 
-  frag_inserted = false;
+  LabelType* init_frag_buf = init_frag_labels->GetBufferPointer();
 
-  for (label_it.GoToBegin(); !label_it.IsAtEnd(); ++label_it)
+  LabelType* pot_cut_buf = create_labels_w_cuts ? pot_cut_labels->GetBufferPointer() : nullptr;
+
+  // moving along a row of voxels in APP coordinates
+  const Pt3 col_step_app = label_ind_to_app.matrix().block(0,0,3,1);
+
+  // set to one for each slice where a fragment voxel was found
+  std::vector<char> frag_in_slice(num_slices, 0);
+
+  auto insert_frag_fn = [&] (const RangeType& r)
   {
-    LabelType& cur_label = label_it.Value();
+    std::vector<double> row_dists(num_cols);
 
-    if (cur_label == pelvis_label)
+    Pt3 row_start_ind;
+    row_start_ind[0] = 0;
+
+    for (long k = static_cast<long>(r.begin()); k < static_cast<long>(r.end()); ++k)
     {
-      const LabelImageIndex& itk_idx = label_it.GetIndex();
+      row_start_ind[2] = k;
 
-      cur_ind[0] = itk_idx[0];
-      cur_ind[1] = itk_idx[1];
-      cur_ind[2] = itk_idx[2];
+      for (long j = 0; j < num_rows; ++j)
+      {
+        row_start_ind[1] = j;
 
-      cur_pt_app = label_ind_to_app * cur_ind;
+        const Pt3 row_start_app = label_ind_to_app * row_start_ind;
 
-      const CoordScalar d = check_cuts_convex_hull.signed_dist(cur_pt_app);
+        const auto inside_range = check_cuts_convex_hull.inside_range_along_line(
+                                                  row_start_app, col_step_app, num_cols);
 
-      if (d < 1.0e-6)
-      {
-        cur_label = frag_label;
-        frag_inserted = true;
-      
-        if (create_labels_w_cuts && ((d + cut_width) > 1.0e-6))
+        if (inside_range[0] >= inside_range[1])
         {
-          // mark as potential cut
-          pot_cut_labels->SetPixel(label_it.GetIndex(), 1);
+          continue;
+        }
+
+        check_cuts_convex_hull.signed_dists_along_line(row_start_app, col_step_app,
+                                                       inside_range[0], inside_range[1],
+                                                       row_dists.data());
+
+        const size_type row_off = ((static_cast<size_type>(k) * num_rows) + j) * num_cols;
+
+        LabelType* label_row = init_frag_buf + row_off;
+
+        for (long i = inside_range[0]; i < inside_range[1]; ++i)
+        {
+          LabelType& cur_label = label_row[i];
+
+          const double d = row_dists[i - inside_range[0]];
+
+          if ((cur_label == pelvis_label) && (d < 1.0e-6))
+          {
+            cur_label = frag_label;
+            frag_in_slice[k] = 1;
+
+            if (create_labels_w_cuts && ((d + cut_width) > 1.0e-6))
+            {
+              // mark as potential cut
+              pot_cut_buf[row_off + i] = 1;
+            }
+          }
         }
       }
     }
-  }
+  };
+
+  ParallelFor(insert_frag_fn, RangeType(0, num_slices));
+
+  frag_inserted = std::any_of(frag_in_slice.begin(), frag_in_slice.end(),
+                              [] (const char c) { return c != 0; });
 
   if (frag_inserted)
   {
@@ -767,21 +907,20 @@ void xreg::CreatePAOFragLabelMapFromCutPlanesFn::operator()()
     {
       xregASSERT(ImagesHaveSameCoords(init_frag_labels.GetPointer(), invalid_frag_locations.GetPointer()));
 
-      LabelImageIterator invalid_it(invalid_frag_locations,
-                                    invalid_frag_locations->GetLargestPossibleRegion());
+      const LabelType* invalid_buf = invalid_frag_locations->GetBufferPointer();
 
-      for (invalid_it.GoToBegin(); !invalid_it.IsAtEnd(); ++invalid_it)
+      auto invalid_fn = [&] (const RangeType& r)
       {
-        if (invalid_it.Value())
+        for (size_type i = r.begin(); i < r.end(); ++i)
         {
-          const auto cur_idx = invalid_it.GetIndex();
-
-          if (init_frag_labels->GetPixel(cur_idx) == frag_label)
+          if (invalid_buf[i] && (init_frag_buf[i] == frag_label))
           {
-            init_frag_labels->SetPixel(cur_idx, pelvis_label);
+            init_frag_buf[i] = pelvis_label;
           }
         }
-      }
+      };
+
+      ParallelFor(invalid_fn, RangeType(0, num_vox));
     }
 
     // disabling this path, as I think it is better to reject the cases were the pubis
@@ -895,17 +1034,23 @@ void xreg::CreatePAOFragLabelMapFromCutPlanesFn::operator()()
       // component mask
       frag_labels_no_cut = ITKImageDeepCopy(src_labels);
 
-      LabelImageIterator label_it(largest_cc_img,
-                                  largest_cc_img->GetLargestPossibleRegion());
+      const LabelType* largest_cc_buf = largest_cc_img->GetBufferPointer();
+
+      LabelType* no_cut_buf = frag_labels_no_cut->GetBufferPointer();
 
-      for (label_it.GoToBegin(); !label_it.IsAtEnd(); ++label_it)
+      auto copy_cc_fn = [&] (const RangeType& r)
       {
-        if (label_it.Value())
+        for (size_type i = r.begin(); i < r.end(); ++i)
         {
-          // non-zero indicates it was part of the largest connected component
-          frag_labels_no_cut->SetPixel(label_it.GetIndex(), frag_label);
+          if (largest_cc_buf[i])
+          {
+            // non-zero indicates it was part of the largest connected component
+            no_cut_buf[i] = frag_label;
+          }
         }
-      }
+      };
+
+      ParallelFor(copy_cc_fn, RangeType(0, num_vox));
     }
   }
   else
@@ -922,51 +1067,73 @@ void xreg::CreatePAOFragLabelMapFromCutPlanesFn::operator()()
       cut_pts_wrt_vol.clear();
     }
 
-    Pt3 cur_pt_vol;
+    LabelType* w_cut_buf = frag_labels_w_cut->GetBufferPointer();
 
-    LabelImageIterator pot_cut_it(pot_cut_labels,
-                                  pot_cut_labels->GetLargestPossibleRegion());
+    // cut points found in each slice, these are concatenated so the points are
+    // stored in the same order as the voxels
+    std::vector<Pt3List> cut_pts_in_slice(save_cut_pts ? num_slices : 0);
 
-    for (pot_cut_it.GoToBegin(); !pot_cut_it.IsAtEnd(); ++pot_cut_it)
+    // set to one for each slice where a fragment voxel remains
+    std::fill(frag_in_slice.begin(), frag_in_slice.end(), 0);
+
+    auto insert_cuts_fn = [&] (const RangeType& r)
     {
-      const LabelImageIndex& itk_idx = pot_cut_it.GetIndex();
-      
-      // If this is a potential cut, and it has not been changed from fragment
-      // then mark it as cut, otherwise leave as pelvis.
-      if (pot_cut_it.Value() &&
-          (frag_labels_w_cut->GetPixel(itk_idx) == frag_label))
+      Pt3 cur_ind_in_slice;
+
+      for (long k = static_cast<long>(r.begin()); k < static_cast<long>(r.end()); ++k)
       {
-        frag_labels_w_cut->SetPixel(itk_idx, cut_label);
+        const size_type slice_off = static_cast<size_type>(k) * num_rows * num_cols;
 
-        if (save_cut_pts)
+        for (long j = 0; j < num_rows; ++j)
         {
-          cur_ind[0] = itk_idx[0];
-          cur_ind[1] = itk_idx[1];
-          cur_ind[2] = itk_idx[2];
-          
-          cur_pt_vol = label_inds_to_label_phys * cur_ind;
+          const size_type row_off = slice_off + (static_cast<size_type>(j) * num_cols);
 
-          cut_pts_wrt_vol.push_back(cur_pt_vol);
+          for (long i = 0; i < num_cols; ++i)
+          {
+            LabelType& cur_label = w_cut_buf[row_off + i];
+
+            // If this is a potential cut, and it has not been changed from fragment
+            // then mark it as cut, otherwise leave as pelvis.
+            if (cur_label == frag_label)
+            {
+              if (pot_cut_buf[row_off + i])
+              {
+                cur_label = cut_label;
+
+                if (save_cut_pts)
+                {
+                  cur_ind_in_slice[0] = i;
+                  cur_ind_in_slice[1] = j;
+                  cur_ind_in_slice[2] = k;
+
+                  cut_pts_in_slice[k].push_back(label_inds_to_label_phys * cur_ind_in_slice);
+                }
+              }
+              else
+              {
+                frag_in_slice[k] = 1;
+              }
+            }
+          }
         }
       }
-    }
-  
-    // double check to see if there are any fragment labels left.
-    // This is a corner case where the cut is tangent to the bone and inserting
-    // cut labels removes all of the fragment labels
-    frag_inserted = false;
+    };
 
-    LabelImageIterator label_it(frag_labels_w_cut,
-                                frag_labels_w_cut->GetLargestPossibleRegion());
+    ParallelFor(insert_cuts_fn, RangeType(0, num_slices));
 
-    for (label_it.GoToBegin(); !label_it.IsAtEnd(); ++label_it)
+    if (save_cut_pts)
     {
-      if (label_it.Value() == frag_label)
+      for (const auto& pts : cut_pts_in_slice)
       {
-        frag_inserted = true;
-        break;
+        cut_pts_wrt_vol.insert(cut_pts_wrt_vol.end(), pts.begin(), pts.end());
       }
     }
+
+    // double check to see if there are any fragment labels left.
+    // This is a corner case where the cut is tangent to the bone and inserting
+    // cut labels removes all of the fragment labels
+    frag_inserted = std::any_of(frag_in_slice.begin(), frag_in_slice.end(),
+                                [] (const char c) { return c != 0; });
   }
 }
 
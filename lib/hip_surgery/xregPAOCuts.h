@@ -25,6 +25,7 @@
 #ifndef XREGPAOCUTS_H_
 #define XREGPAOCUTS_H_
 
+#include <array>
 #include <random>
 
 #include <vtkPlanes.h>
@@ -187,7 +188,35 @@ struct PAOCheckInsideCutPlanesFn
   /// boundary. The absolute value is the unsigned distance.
   CoordScalar signed_dist(const Pt3& x);
 
+  /// \brief Computes a range of indices along a line of points which contains
+  ///        every point inside the convex hull.
+  ///
+  /// The points are given by start + (i * step) for i in [0, num_pts). Since
+  /// the signed distance to each plane is linear along the line, the range is
+  /// found analytically. It is conservative by up to one point on each end,
+  /// so points in the range should still be tested. The range is returned as
+  /// [begin, end), and is empty when begin >= end.
+  std::array<long,2> inside_range_along_line(const Pt3& start, const Pt3& step,
+                                             const long num_pts) const;
+
+  /// \brief Computes the signed distances (see signed_dist()) of the points
+  ///        start + (i * step) for i in [begin, end).
+  ///
+  /// The distance of point i is written to dists[i - begin]. The planes are
+  /// evaluated for all points at once, which the compiler is able to
+  /// vectorize.
+  void signed_dists_along_line(const Pt3& start, const Pt3& step,
+                               const long begin, const long end,
+                               double* dists) const;
+
   vtkNew<vtkPlanes> vtk_planes;
+
+  /// \brief The bounding planes used by the line methods, for each plane the
+  ///        signed distance of a point x is normal.dot(x) - offset.
+  ///
+  /// These represent the same planes as vtk_planes.
+  std::array<Eigen::Vector3d,6> bounding_plane_normals;
+  std::array<double,6> bounding_plane_offsets;
 };
 
 /// \brief Given pre-determined cutting planes, create a label map replacing
@@ -229,6 +258,10 @@ struct CreatePAOFragLabelMapFromCutPlanesFn
   // may be cuts.
   LabelVolPtr pot_cut_labels;
 
+  /// \brief Updates the labels, each row of voxels is processed in parallel.
+  ///
+  /// The range of each row which may be inside the cut planes is computed
+  /// analytically and only the voxels in that range are tested.
   void operator()();
 };
 
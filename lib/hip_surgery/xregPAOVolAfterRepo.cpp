@@ -24,7 +24,9 @@
 
 #include "xregPAOVolAfterRepo.h"
 
-#include <itkNearestNeighborInterpolateImageFunction.h>
+#include <array>
+#include <limits>
+
 #include <itkBSplineInterpolateImageFunction.h>
 #include <itkImageRegionIteratorWithIndex.h>
 #include <itkBinaryBallStructuringElement.h>
@@ -37,71 +39,190 @@
 #include "xregMetalObjSampling.h"
 #include "xregITKCropPadUtils.h"
 #include "xregITKResampleUtils.h"
+#include "xregTBBUtils.h"
 
-void xreg::UpdateVolAfterRepos::operator()()
+namespace  // un-named
 {
-  using ITKIndex = Vol::IndexType;
-  using ContinuousIndexType = itk::ContinuousIndex<double,3>;
 
-  using NNInterp = itk::NearestNeighborInterpolateImageFunction<LabelVol>;
+using namespace xreg;
 
-  using VolInterp = itk::BSplineInterpolateImageFunction<Vol>;
+using RepoVol      = UpdateVolAfterRepos::Vol;
+using RepoLabelVol = UpdateVolAfterRepos::LabelVol;
+using RepoLabel    = UpdateVolAfterRepos::LabelScalar;
 
-  using VolIt = itk::ImageRegionIteratorWithIndex<Vol>;
-  using LabelVolIt = itk::ImageRegionIteratorWithIndex<LabelVol>;
+// An inclusive box of voxel indices
+struct VoxBox
+{
+  std::array<long,3> lo = { { std::numeric_limits<long>::max(),
+                              std::numeric_limits<long>::max(),
+                              std::numeric_limits<long>::max() } };
 
-  xregASSERT(ImagesHaveSameCoords(labels.GetPointer(), src_vol.GetPointer()));
+  std::array<long,3> hi = { { std::numeric_limits<long>::min(),
+                              std::numeric_limits<long>::min(),
+                              std::numeric_limits<long>::min() } };
 
-  std::mt19937 rng_eng;
-  std::normal_distribution<VolScalar> norm_dist(0,add_rand_to_default_val_std_dev);
+  bool empty() const
+  {
+    return lo[0] > hi[0];
+  }
 
-  const bool add_rand = add_rand_to_default_val_std_dev > 0;
-  if (add_rand)
+  void add(const long i, const long j, const long k)
   {
-    SeedRNGEngWithRandDev(&rng_eng);
+    lo[0] = std::min(lo[0], i);
+    lo[1] = std::min(lo[1], j);
+    lo[2] = std::min(lo[2], k);
+    hi[0] = std::max(hi[0], i);
+    hi[1] = std::max(hi[1], j);
+    hi[2] = std::max(hi[2], k);
   }
- 
-  const VolScalar tmp_default_val = default_val; 
-  auto replacement_intensity = [add_rand, &rng_eng,
-                                &norm_dist,
-                                tmp_default_val] ()
+
+  void merge(const VoxBox& other)
   {
-    return tmp_default_val + (add_rand ? norm_dist(rng_eng) :
-                                         VolScalar(0));
+    if (!other.empty())
+    {
+      add(other.lo[0], other.lo[1], other.lo[2]);
+      add(other.hi[0], other.hi[1], other.hi[2]);
+    }
+  }
+
+  void pad_and_clamp(const long pad, const std::array<long,3>& vol_size)
+  {
+    for (int d = 0; d < 3; ++d)
+    {
+      lo[d] = std::max(0L, lo[d] - pad);
+      hi[d] = std::min(vol_size[d] - 1, hi[d] + pad);
+    }
+  }
+
+  long len(const int d) const
+  {
+    return hi[d] - lo[d] + 1;
+  }
+};
+
+// Bounding box of all voxels with a specific label, computed in parallel
+// across slices
+VoxBox LabelBoundingBox(const RepoLabel* label_buf, const std::array<long,3>& vol_size,
+                        const RepoLabel label)
+{
+  auto box_fn = [label_buf,&vol_size,label] (const RangeType& r, const VoxBox& init_box)
+  {
+    VoxBox box = init_box;
+
+    for (long k = static_cast<long>(r.begin()); k < static_cast<long>(r.end()); ++k)
+    {
+      const RepoLabel* slice_buf = label_buf + (k * vol_size[0] * vol_size[1]);
+
+      for (long j = 0; j < vol_size[1]; ++j)
+      {
+        const RepoLabel* row_buf = slice_buf + (j * vol_size[0]);
+
+        for (long i = 0; i < vol_size[0]; ++i)
+        {
+          if (row_buf[i] == label)
+          {
+            box.add(i, j, k);
+          }
+        }
+      }
+    }
+
+    return box;
   };
 
-  std::normal_distribution<VolScalar> air_normal_dist(0,10);
-  auto air_intensity = [add_rand,&rng_eng,&air_normal_dist]()
+  auto merge_fn = [] (const VoxBox& a, const VoxBox& b)
   {
-    return -1000 + (add_rand ? air_normal_dist(rng_eng) : VolScalar(0));
+    VoxBox m = a;
+    m.merge(b);
+    return m;
   };
 
+  return ParallelReduce(VoxBox(), box_fn, merge_fn, RangeType(0, vol_size[2]));
+}
+
+// Zero mean, unit variance normal sample for a voxel, using the Philox stream
+// identified by the voxel index and a stream index (Box-Muller transform)
+float VoxelStdNormal(const size_type vox_idx, const std::uint32_t stream_idx,
+                     const PhiloxKey& key)
+{
+  const PhiloxCtr r = Philox4x32({ static_cast<std::uint32_t>(vox_idx),
+                                   static_cast<std::uint32_t>(static_cast<std::uint64_t>(vox_idx) >> 32),
+                                   stream_idx, 0 }, key);
+
+  return static_cast<float>(std::sqrt(-2 * std::log(PhiloxToUniformOpen(r[0]))) *
+                              std::cos(2 * 3.141592653589793 * PhiloxToUniformOpen(r[1])));
+}
+
+}  // un-named
+
+void xreg::UpdateVolAfterRepos::operator()()
+{
+  using MorphKernel  = itk::BinaryBallStructuringElement<LabelScalar,3>;
+  using DilateFilter = itk::GrayscaleDilateImageFilter<LabelVol,LabelVol,MorphKernel>;
+
+  using VolInterp = itk::BSplineInterpolateImageFunction<Vol>;
+
+  xregASSERT(ImagesHaveSameCoords(labels.GetPointer(), src_vol.GetPointer()));
+
+  const bool add_rand = add_rand_to_default_val_std_dev > 0;
+
+  // the noise of each voxel is determined by the key and the voxel index, so
+  // voxels may be written concurrently
+  PhiloxKey rng_key = { { 0, 0 } };
+
+  if (add_rand)
+  {
+    std::mt19937 rng_eng;
+    SeedRNGEngWithRandDev(&rng_eng);
+
+    rng_key = { { static_cast<std::uint32_t>(rng_eng()), static_cast<std::uint32_t>(rng_eng()) } };
+  }
+
+  const auto itk_vol_size = src_vol->GetLargestPossibleRegion().GetSize();
+
+  const std::array<long,3> vol_size = { { static_cast<long>(itk_vol_size[0]),
+                                          static_cast<long>(itk_vol_size[1]),
+                                          static_cast<long>(itk_vol_size[2]) } };
+
+  const size_type num_vox = static_cast<size_type>(vol_size[0]) * vol_size[1] * vol_size[2];
+
   const FrameTransform itk_idx_to_phys_pt = ITKImagePhysicalPointTransformsAsEigen(src_vol.GetPointer());
 
   const FrameTransform phys_pt_to_itk_idx = itk_idx_to_phys_pt.inverse();
 
   auto vol_interp_fn = VolInterp::New();
   vol_interp_fn->SetSplineOrder(3);
-    
+
   dst_vol = ITKImageDeepCopy(src_vol.GetPointer());
 
+  VolScalar* dst_buf = dst_vol->GetBufferPointer();
+
+  const LabelScalar* label_buf = labels->GetBufferPointer();
+
   if (!labels_of_air.empty())
   {
+    std::array<bool,std::numeric_limits<LabelScalar>::max() + 1> is_air_label;
+    is_air_label.fill(false);
+
     for (const auto l : labels_of_air)
     {
-      VolIt dst_it(dst_vol, dst_vol->GetLargestPossibleRegion());
-      LabelVolIt label_it(labels, labels->GetLargestPossibleRegion());
+      is_air_label[l] = true;
+    }
 
-      for (dst_it.GoToBegin(), label_it.GoToBegin(); !dst_it.IsAtEnd(); ++dst_it, ++label_it)
+    auto air_fn = [&] (const RangeType& r)
+    {
+      for (size_type i = r.begin(); i < r.end(); ++i)
       {
-        if (label_it.Value() == l)
+        if (is_air_label[label_buf[i]])
         {
-          dst_it.Value() = air_intensity();
+          dst_buf[i] = -1000 + (add_rand ? (10 * VoxelStdNormal(i, 0, rng_key)) : VolScalar(0));
         }
       }
-    }
-   
-    // we want to interpolate as if the cuts have already been made 
+    };
+
+    ParallelFor(air_fn, RangeType(0, num_vox));
+
+    // we want to interpolate as if the cuts have already been made
     vol_interp_fn->SetInputImage(ITKImageDeepCopy(dst_vol.GetPointer()));
   }
   else
@@ -110,20 +231,10 @@ void xreg::UpdateVolAfterRepos::operator()()
     vol_interp_fn->SetInputImage(src_vol);
   }
 
-  const bool do_dilate = labels_dilate_rad;
-  
-  auto label_interp = NNInterp::New();
-  
-  if (!do_dilate)
-  {
-    // we can look directly into the original labelmap if we are not
-    // dilating it
-    label_interp->SetInputImage(labels);
-  }
-
-  Pt3 tmp_idx;
+  const long dilate_rad = static_cast<long>(labels_dilate_rad);
 
-  ContinuousIndexType tmp_itk_idx;
+  const VolScalar tmp_default_val = default_val;
+  const VolScalar rand_std_dev    = add_rand_to_default_val_std_dev;
 
   const unsigned long num_repo_objs = labels_of_repo_objs.size();
   xregASSERT(num_repo_objs == repo_objs_xforms.size());
@@ -132,60 +243,169 @@ void xreg::UpdateVolAfterRepos::operator()()
   {
     const LabelScalar cur_label = labels_of_repo_objs[obj_idx];
 
-    if (do_dilate)
+    const VoxBox label_box = LabelBoundingBox(label_buf, vol_size, cur_label);
+
+    if (label_box.empty())
     {
-      using MorphKernel  = itk::BinaryBallStructuringElement<LabelScalar,3>;
-      using DilateFilter = itk::GrayscaleDilateImageFilter<LabelVol,LabelVol,MorphKernel>;
-   
-      LabelVolPtr cur_labels = ApplyMaskToITKImage(labels.GetPointer(), labels.GetPointer(),
-                                                   cur_label, LabelScalar(0));
+      // no voxels are moved into or out of the object
+      continue;
+    }
 
-      MorphKernel kern;
-      kern.SetRadius(labels_dilate_rad);
-      kern.CreateStructuringElement();
+    // Binary mask of the (possibly dilated) object, restricted to a box about
+    // the object
+    VoxBox mask_box = label_box;
+    mask_box.pad_and_clamp(dilate_rad, vol_size);
+
+    LabelVolPtr obj_mask;
+    {
+      LabelVol::SizeType mask_size;
+      mask_size[0] = mask_box.len(0);
+      mask_size[1] = mask_box.len(1);
+      mask_size[2] = mask_box.len(2);
 
-      auto dilate_fn = DilateFilter::New();
-      dilate_fn->SetInput(cur_labels);
-      dilate_fn->SetKernel(kern);
+      obj_mask = LabelVol::New();
+      obj_mask->SetRegions(mask_size);
+      obj_mask->Allocate();
 
-      dilate_fn->Update();
+      LabelScalar* mask_buf = obj_mask->GetBufferPointer();
 
-      label_interp->SetInputImage(dilate_fn->GetOutput());
+      auto mask_fn = [&] (const RangeType& r)
+      {
+        for (long k = static_cast<long>(r.begin()); k < static_cast<long>(r.end()); ++k)
+        {
+          for (long j = 0; j < mask_box.len(1); ++j)
+          {
+            const LabelScalar* src_row = label_buf +
+                              ((((k + mask_box.lo[2]) * vol_size[1]) + j + mask_box.lo[1]) * vol_size[0]) +
+                              mask_box.lo[0];
+
+            LabelScalar* dst_row = mask_buf + (((k * mask_box.len(1)) + j) * mask_box.len(0));
+
+            for (long i = 0; i < mask_box.len(0); ++i)
+            {
+              dst_row[i] = (src_row[i] == cur_label) ? 1 : 0;
+            }
+          }
+        }
+      };
+
+      ParallelFor(mask_fn, RangeType(0, mask_box.len(2)));
+
+      if (dilate_rad)
+      {
+        MorphKernel kern;
+        kern.SetRadius(labels_dilate_rad);
+        kern.CreateStructuringElement();
+
+        auto dilate_fn = DilateFilter::New();
+        dilate_fn->SetInput(obj_mask);
+        dilate_fn->SetKernel(kern);
+        dilate_fn->Update();
+
+        obj_mask = dilate_fn->GetOutput();
+      }
     }
 
-    const FrameTransform obj_warp = repo_objs_xforms[obj_idx].inverse();
+    const LabelScalar* mask_buf = obj_mask->GetBufferPointer();
 
-    VolIt dst_it(dst_vol, dst_vol->GetLargestPossibleRegion());
-    LabelVolIt label_it(labels, labels->GetLargestPossibleRegion());
+    // maps destination indices to indices before repositioning
+    const FrameTransform dst_idx_to_src_idx = phys_pt_to_itk_idx * repo_objs_xforms[obj_idx].inverse() *
+                                              itk_idx_to_phys_pt;
 
-    for (dst_it.GoToBegin(), label_it.GoToBegin(); !dst_it.IsAtEnd(); ++dst_it, ++label_it)
+    // Only voxels in the original object, or which map into the mask, are
+    // updated. The mask corresponds to the continuous index region extending a
+    // half voxel beyond the mask box, find the box of its repositioned
+    // corners.
+    VoxBox dst_box = label_box;
     {
-      // First find out if this location now belongs to the current repositioned object
-      const ITKIndex& cur_idx = dst_it.GetIndex();
-      tmp_idx[0] = cur_idx[0];
-      tmp_idx[1] = cur_idx[1];
-      tmp_idx[2] = cur_idx[2];
+      const FrameTransform src_idx_to_dst_idx = dst_idx_to_src_idx.inverse();
 
-      // continuous index before repositioning
-      tmp_idx = phys_pt_to_itk_idx * obj_warp * itk_idx_to_phys_pt * tmp_idx;
+      for (int corner_idx = 0; corner_idx < 8; ++corner_idx)
+      {
+        Pt3 corner;
+        for (int d = 0; d < 3; ++d)
+        {
+          corner[d] = ((corner_idx >> d) & 1) ? (mask_box.hi[d] + 0.5) : (mask_box.lo[d] - 0.5);
+        }
 
-      tmp_itk_idx[0] = tmp_idx[0];
-      tmp_itk_idx[1] = tmp_idx[1];
-      tmp_itk_idx[2] = tmp_idx[2];
+        const Pt3 dst_corner = src_idx_to_dst_idx * corner;
 
-      if (label_interp->IsInsideBuffer(tmp_itk_idx) &&
-          (label_interp->EvaluateAtContinuousIndex(tmp_itk_idx) == cur_label))
-      {
-        // this location should be set to an intensity value from the repositioned object
-        dst_it.Value() = vol_interp_fn->EvaluateAtContinuousIndex(tmp_itk_idx);
+        dst_box.add(static_cast<long>(std::floor(dst_corner[0])),
+                    static_cast<long>(std::floor(dst_corner[1])),
+                    static_cast<long>(std::floor(dst_corner[2])));
+        dst_box.add(static_cast<long>(std::ceil(dst_corner[0])),
+                    static_cast<long>(std::ceil(dst_corner[1])),
+                    static_cast<long>(std::ceil(dst_corner[2])));
       }
-      else if (label_it.Value() == cur_label)
+
+      dst_box.pad_and_clamp(1, vol_size);
+    }
+
+    const std::uint32_t noise_stream_idx = static_cast<std::uint32_t>(obj_idx + 1);
+
+    // Determine whether each destination location now belongs to the
+    // repositioned object and update the intensity in a single pass
+    auto resample_fn = [&] (const RangeType& r)
+    {
+      Pt3 tmp_idx;
+
+      itk::ContinuousIndex<double,3> tmp_itk_idx;
+
+      std::array<long,3> nn_idx;
+
+      for (long k = static_cast<long>(r.begin()); k < static_cast<long>(r.end()); ++k)
       {
-        // this location was, but no longer corresponds to the repositioned object,
-        // fill the intensity with a default value, e.g. air
-        dst_it.Value() = replacement_intensity();
+        for (long j = dst_box.lo[1]; j <= dst_box.hi[1]; ++j)
+        {
+          const size_type row_off = ((static_cast<size_type>(k) * vol_size[1]) + j) * vol_size[0];
+
+          for (long i = dst_box.lo[0]; i <= dst_box.hi[0]; ++i)
+          {
+            const size_type vox_idx = row_off + i;
+
+            tmp_idx[0] = i;
+            tmp_idx[1] = j;
+            tmp_idx[2] = k;
+
+            // continuous index before repositioning
+            tmp_idx = dst_idx_to_src_idx * tmp_idx;
+
+            bool in_obj = true;
+
+            for (int d = 0; d < 3; ++d)
+            {
+              // same rounding as the nearest neighbor interpolator
+              nn_idx[d] = static_cast<long>(std::floor(tmp_idx[d] + 0.5)) - mask_box.lo[d];
+
+              in_obj = in_obj && (nn_idx[d] >= 0) && (nn_idx[d] < mask_box.len(d));
+            }
+
+            in_obj = in_obj && mask_buf[(((nn_idx[2] * mask_box.len(1)) + nn_idx[1]) * mask_box.len(0)) +
+                                        nn_idx[0]];
+
+            if (in_obj)
+            {
+              // this location should be set to an intensity value from the repositioned object
+              tmp_itk_idx[0] = tmp_idx[0];
+              tmp_itk_idx[1] = tmp_idx[1];
+              tmp_itk_idx[2] = tmp_idx[2];
+
+              dst_buf[vox_idx] = vol_interp_fn->EvaluateAtContinuousIndex(tmp_itk_idx);
+            }
+            else if (label_buf[vox_idx] == cur_label)
+            {
+              // this location was, but no longer corresponds to the repositioned object,
+              // fill the intensity with a default value, e.g. air
+              dst_buf[vox_idx] = tmp_default_val +
+                    (add_rand ? (rand_std_dev * VoxelStdNormal(vox_idx, noise_stream_idx, rng_key)) :
+                                VolScalar(0));
+            }
+          }
+        }
       }
-    }
+    };
+
+    ParallelFor(resample_fn, RangeType(dst_box.lo[2], dst_box.hi[2] + 1));
   }
 }
 
@@ -0,0 +1,460 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "xregRayCastNaiveMetalObjs.h"
+
+#include <cstdint>
+#include <limits>
+
+#include <boost/compute/algorithm/copy.hpp>
+#include <boost/compute/container/vector.hpp>
+#include <boost/compute/utility/source.hpp>
+
+#include "xregAssert.h"
+#include "xregOpenCLProfiling.h"
+#include "xregOpenCLProgCache.h"
+#include "xregRayCastBaseOCL.h"
+#include "xregTBBUtils.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+const char* kADD_NAIVE_METAL_OBJS_OPENCL_SRC = BOOST_COMPUTE_STRINGIZE_SOURCE(
+
+// The segment parameter interval, [t0,t1], of a + t * d with y_lower <= y <= y_upper,
+// an empty interval has t0 > t1.
+float2 SlabInterval(const float a, const float d, const float y_lower, const float y_upper)
+{
+  float2 t = (float2) (1, 0);
+
+  if (fabs(d) < 1.0e-12f)
+  {
+    if ((y_lower <= a) && (a <= y_upper))
+    {
+      t = (float2) (-INFINITY, INFINITY);
+    }
+  }
+  else
+  {
+    const float t0 = (y_lower - a) / d;
+    const float t1 = (y_upper - a) / d;
+
+    t = (float2) (fmin(t0, t1), fmax(t0, t1));
+  }
+
+  return t;
+}
+
+float OverlapLen(const float t0, const float t1, const float s0, const float s1)
+{
+  return fmax(fmin(t1, s1) - fmax(t0, s0), 0.0f);
+}
+
+// matches xreg::LineSegCylIntersectLen(), the length is returned as a fraction of the segment
+float SegCylLen(const float3 a, const float3 d, const float radius, const float height)
+{
+  float len_t = 0;
+
+  if ((radius > 0) && (height > 0))
+  {
+    const float2 slab = SlabInterval(a.y, d.y, -0.5f * height, 0.5f * height);
+
+    const float s0 = fmax(slab.x, 0.0f);
+    const float s1 = fmin(slab.y, 1.0f);
+
+    if (s0 < s1)
+    {
+      const float A = (d.x * d.x) + (d.z * d.z);
+      const float B = 2 * ((a.x * d.x) + (a.z * d.z));
+      const float C = (a.x * a.x) + (a.z * a.z) - (radius * radius);
+
+      if (A < 1.0e-12f)
+      {
+        len_t = (C <= 0) ? (s1 - s0) : 0.0f;
+      }
+      else
+      {
+        const float disc = (B * B) - (4 * A * C);
+
+        if (disc > 0)
+        {
+          const float sqrt_disc = sqrt(disc);
+
+          len_t = OverlapLen((-B - sqrt_disc) / (2 * A), (-B + sqrt_disc) / (2 * A), s0, s1);
+        }
+      }
+    }
+  }
+
+  return len_t;
+}
+
+// matches xreg::LineSegConeIntersectLen(), the length is returned as a fraction of the segment
+float SegConeLen(const float3 a, const float3 d, const float radius, const float height)
+{
+  float len_t = 0;
+
+  if ((radius > 0) && (height > 0))
+  {
+    const float2 slab = SlabInterval(a.y, d.y, 0, height);
+
+    const float s0 = fmax(slab.x, 0.0f);
+    const float s1 = fmin(slab.y, 1.0f);
+
+    if (s0 < s1)
+    {
+      const float k = radius / height;
+
+      const float w  = radius - (k * a.y);
+      const float wd = -k * d.y;
+
+      const float A = (d.x * d.x) + (d.z * d.z) - (wd * wd);
+      const float B = 2 * ((a.x * d.x) + (a.z * d.z) - (w * wd));
+      const float C = (a.x * a.x) + (a.z * a.z) - (w * w);
+
+      if (fabs(A) < 1.0e-12f)
+      {
+        if (fabs(B) < 1.0e-12f)
+        {
+          len_t = (C <= 0) ? (s1 - s0) : 0.0f;
+        }
+        else if (B > 0)
+        {
+          len_t = OverlapLen(-INFINITY, -C / B, s0, s1);
+        }
+        else
+        {
+          len_t = OverlapLen(-C / B, INFINITY, s0, s1);
+        }
+      }
+      else
+      {
+        const float disc = (B * B) - (4 * A * C);
+
+        if (disc < 0)
+        {
+          len_t = (A < 0) ? (s1 - s0) : 0.0f;
+        }
+        else
+        {
+          const float sqrt_disc = sqrt(disc);
+
+          const float r0 = fmin((-B - sqrt_disc) / (2 * A), (-B + sqrt_disc) / (2 * A));
+          const float r1 = fmax((-B - sqrt_disc) / (2 * A), (-B + sqrt_disc) / (2 * A));
+
+          len_t = (A > 0) ? OverlapLen(r0, r1, s0, s1) :
+                            (OverlapLen(-INFINITY, r0, s0, s1) + OverlapLen(r1, INFINITY, s0, s1));
+        }
+      }
+    }
+  }
+
+  return len_t;
+}
+
+// Each object record is 6 consecutive float4 values:
+//   (cap radius, cap height, body radius, body height),
+//   (tip radius, tip height, linear attenuation, unused),
+//   source point, detector origin, column step, row step
+// The points and steps are in the object frame. K-Wires have zero cap heights.
+__kernel void AddNaiveMetalObjsKernel(__global const float4* obj_recs,
+                                      const uint num_objs,
+                                      const ulong num_pix_per_proj,
+                                      const ulong tot_num_pix,
+                                      const uint num_cols,
+                                      __global float* projs)
+{
+  const ulong idx = get_global_id(0);
+
+  if (idx < tot_num_pix)
+  {
+    const ulong proj_idx = idx / num_pix_per_proj;
+    const uint  pix_idx  = (uint) (idx - (proj_idx * num_pix_per_proj));
+
+    const float row = (float) (pix_idx / num_cols);
+    const float col = (float) (pix_idx % num_cols);
+
+    __global const float4* cur_rec = obj_recs + (proj_idx * num_objs * 6);
+
+    float line_int = 0;
+
+    for (uint obj_idx = 0; obj_idx < num_objs; ++obj_idx, cur_rec += 6)
+    {
+      const float4 geom_0 = cur_rec[0];
+      const float4 geom_1 = cur_rec[1];
+
+      const float3 a = cur_rec[2].xyz;
+      const float3 d = (cur_rec[3].xyz + (col * cur_rec[4].xyz) + (row * cur_rec[5].xyz)) - a;
+
+      const float3 cap_off = (float3) (0, 0.5f * (geom_0.w + geom_0.y), 0);
+      const float3 tip_off = (float3) (0, -0.5f * geom_0.w, 0);
+
+      const float len_t = SegCylLen(a, d, geom_0.z, geom_0.w) +
+                          SegCylLen(a + cap_off, d, geom_0.x, geom_0.y) +
+                          SegConeLen(a + tip_off, d, geom_1.x, geom_1.y);
+
+      line_int += geom_1.z * len_t * length(d);
+    }
+
+    projs[idx] += line_int;
+  }
+}
+
+);
+
+// The source, detector origin, and detector steps of a projection with respect
+// to an object frame.
+struct MetalObjRayParams
+{
+  Pt3 src;
+  Pt3 det_origin;
+  Pt3 col_step;
+  Pt3 row_step;
+};
+
+MetalObjRayParams MakeMetalObjRayParams(const CameraModel& cam, const FrameTransform& cam_to_obj)
+{
+  MetalObjRayParams p;
+  
+  p.src        = cam_to_obj * cam.pinhole_pt;
+  p.det_origin = cam_to_obj * cam.ind_pt_to_phys_det_pt(Pt2(0,0));
+  p.col_step   = (cam_to_obj * cam.ind_pt_to_phys_det_pt(Pt2(1,0))) - p.det_origin;
+  p.row_step   = (cam_to_obj * cam.ind_pt_to_phys_det_pt(Pt2(0,1))) - p.det_origin;
+
+  return p;
+}
+
+void AppendPt3AsFloat4(const Pt3& p, std::vector<float>* buf)
+{
+  buf->push_back(static_cast<float>(p(0)));
+  buf->push_back(static_cast<float>(p(1)));
+  buf->push_back(static_cast<float>(p(2)));
+  buf->push_back(0);
+}
+
+}  // un-named
+
+void xreg::RayCastAddNaiveMetalObjs::operator()(RayCaster* rc)
+{
+  namespace bc = boost::compute;
+
+  const size_type num_screws = objs.screw_models.size();
+  const size_type num_kwires = objs.kwire_models.size();
+
+  xregASSERT(num_screws == objs.screw_poses_wrt_vol.size());
+  xregASSERT(num_screws == objs.screw_lin_atts.size());
+  xregASSERT(num_kwires == objs.kwire_poses_wrt_vol.size());
+  xregASSERT(num_kwires == objs.kwire_lin_atts.size());
+
+  const size_type num_objs  = num_screws + num_kwires;
+  const size_type num_projs = rc->num_projs();
+
+  if (!num_objs || !num_projs)
+  {
+    return;
+  }
+
+  const auto& cams         = rc->camera_models();
+  const auto& cam_for_proj = rc->camera_model_proj_associations();
+
+  const size_type num_rows = cams[cam_for_proj[0]].num_det_rows;
+  const size_type num_cols = cams[cam_for_proj[0]].num_det_cols;
+
+  const size_type num_pix_per_proj = num_rows * num_cols;
+  const size_type tot_num_pix      = num_pix_per_proj * num_projs;
+
+  FrameTransformList vol_to_objs;
+  vol_to_objs.reserve(num_objs);
+
+  for (const auto& xform : objs.screw_poses_wrt_vol)
+  {
+    vol_to_objs.push_back(xform.inverse());
+  }
+
+  for (const auto& xform : objs.kwire_poses_wrt_vol)
+  {
+    vol_to_objs.push_back(xform.inverse());
+  }
+
+  std::vector<MetalObjRayParams> ray_params;
+  ray_params.reserve(num_projs * num_objs);
+
+  for (size_type proj_idx = 0; proj_idx < num_projs; ++proj_idx)
+  {
+    const CameraModel& cam = cams[cam_for_proj[proj_idx]];
+
+    xregASSERT((cam.num_det_rows == num_rows) && (cam.num_det_cols == num_cols));
+
+    const FrameTransform& cam_to_vol = rc->xform_cam_to_itk_phys(proj_idx);
+
+    for (size_type obj_idx = 0; obj_idx < num_objs; ++obj_idx)
+    {
+      ray_params.push_back(MakeMetalObjRayParams(cam, vol_to_objs[obj_idx] * cam_to_vol));
+    }
+  }
+
+  RayCasterOCL* rc_ocl = dynamic_cast<RayCasterOCL*>(rc);
+
+  if (rc_ocl)
+  {
+    xregASSERT(num_pix_per_proj <= std::numeric_limits<std::uint32_t>::max());
+
+    RayCastSyncOCLBuf* dev_sync = rc_ocl->to_ocl_buf();
+
+    bc::command_queue& queue = dev_sync->queue();
+    
+    const bc::context ctx = queue.get_context();
+
+    if (!krnl_.get() || (ctx_.get() != ctx.get()))
+    {
+      ctx_  = ctx;
+      krnl_ = BuildOpenCLProg(kADD_NAIVE_METAL_OBJS_OPENCL_SRC, ctx_).create_kernel("AddNaiveMetalObjsKernel");
+    }
+
+    std::vector<float> obj_recs;
+    obj_recs.reserve(num_projs * num_objs * 24);
+
+    for (size_type proj_idx = 0; proj_idx < num_projs; ++proj_idx)
+    {
+      for (size_type obj_idx = 0; obj_idx < num_objs; ++obj_idx)
+      {
+        if (obj_idx < num_screws)
+        {
+          const NaiveScrewModel& s = objs.screw_models[obj_idx];
+
+          obj_recs.push_back(static_cast<float>(s.cap.radius));
+          obj_recs.push_back(static_cast<float>(s.cap.height));
+          obj_recs.push_back(static_cast<float>(s.body.radius));
+          obj_recs.push_back(static_cast<float>(s.body.height));
+          obj_recs.push_back(static_cast<float>(s.tip.radius));
+          obj_recs.push_back(static_cast<float>(s.tip.height));
+          obj_recs.push_back(static_cast<float>(objs.screw_lin_atts[obj_idx]));
+        }
+        else
+        {
+          const NaiveKWireModel& w = objs.kwire_models[obj_idx - num_screws];
+
+          obj_recs.push_back(0);
+          obj_recs.push_back(0);
+          obj_recs.push_back(static_cast<float>(w.body.radius));
+          obj_recs.push_back(static_cast<float>(w.body.height));
+          obj_recs.push_back(static_cast<float>(w.tip.radius));
+          obj_recs.push_back(static_cast<float>(w.tip.height));
+          obj_recs.push_back(static_cast<float>(objs.kwire_lin_atts[obj_idx - num_screws]));
+        }
+
+        obj_recs.push_back(0);
+
+        const MetalObjRayParams& p = ray_params[(proj_idx * num_objs) + obj_idx];
+
+        AppendPt3AsFloat4(p.src, &obj_recs);
+        AppendPt3AsFloat4(p.det_origin, &obj_recs);
+        AppendPt3AsFloat4(p.col_step, &obj_recs);
+        AppendPt3AsFloat4(p.row_step, &obj_recs);
+      }
+    }
+
+    bc::vector<float> obj_recs_dev(obj_recs.size(), ctx_);
+    bc::copy(obj_recs.begin(), obj_recs.end(), obj_recs_dev.begin(), queue);
+
+    bc::vector<float>& projs_dev = dev_sync->ocl_buf();
+
+    xregASSERT(projs_dev.size() >= tot_num_pix);
+
+    krnl_.set_arg(0, obj_recs_dev);
+    krnl_.set_arg(1, bc::uint_(num_objs));
+    krnl_.set_arg(2, bc::ulong_(num_pix_per_proj));
+    krnl_.set_arg(3, bc::ulong_(tot_num_pix));
+    krnl_.set_arg(4, bc::uint_(num_cols));
+    krnl_.set_arg(5, projs_dev);
+
+    const std::size_t global_size = tot_num_pix;
+
+    RecordOpenCLKernelEvent("AddNaiveMetalObjsKernel",
+                            queue.enqueue_nd_range_kernel(krnl_, 1, nullptr,
+                                                          &global_size, nullptr));
+
+    // any host copy of the projections is now stale
+    rc_ocl->to_host_buf()->set_modified();
+  }
+  else
+  {
+    RayCaster::PixelScalar2D* projs = rc->raw_host_pixel_buf();
+
+    const NaiveMetalObjs& objs_ref = objs;
+
+    auto add_objs_fn = [&objs_ref, &ray_params, projs, num_screws, num_objs,
+                        num_pix_per_proj, num_cols] (const RangeType& r)
+    {
+      for (size_type idx = r.begin(); idx < r.end(); ++idx)
+      {
+        const size_type proj_idx = idx / num_pix_per_proj;
+        const size_type pix_idx  = idx - (proj_idx * num_pix_per_proj);
+
+        const CoordScalar row = static_cast<CoordScalar>(pix_idx / num_cols);
+        const CoordScalar col = static_cast<CoordScalar>(pix_idx % num_cols);
+
+        const MetalObjRayParams* cur_params = &ray_params[proj_idx * num_objs];
+
+        CoordScalar line_int = 0;
+
+        for (size_type obj_idx = 0; obj_idx < num_objs; ++obj_idx, ++cur_params)
+        {
+          const Pt3 det_pt = cur_params->det_origin + (col * cur_params->col_step) +
+                                                      (row * cur_params->row_step);
+
+          if (obj_idx < num_screws)
+          {
+            line_int += objs_ref.screw_lin_atts[obj_idx] *
+                          LineSegNaiveScrewIntersectLen(cur_params->src, det_pt,
+                                                        objs_ref.screw_models[obj_idx]);
+          }
+          else
+          {
+            const size_type kwire_idx = obj_idx - num_screws;
+
+            line_int += objs_ref.kwire_lin_atts[kwire_idx] *
+                          LineSegNaiveKWireIntersectLen(cur_params->src, det_pt,
+                                                        objs_ref.kwire_models[kwire_idx]);
+          }
+        }
+
+        projs[idx] += static_cast<RayCaster::PixelScalar2D>(line_int);
+      }
+    };
+
+    ParallelFor(add_objs_fn, RangeType(0, tot_num_pix));
+
+    // any device copy of the projections is now stale
+    try
+    {
+      rc->to_ocl_buf()->set_modified();
+    }
+    catch (const RayCaster::UnsupportedOperationException&)
+    { }
+  }
+}
@@ -0,0 +1,71 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef XREGRAYCASTNAIVEMETALOBJS_H_
+#define XREGRAYCASTNAIVEMETALOBJS_H_
+
+#include <boost/compute/context.hpp>
+#include <boost/compute/kernel.hpp>
+
+#include "xregMetalObjs.h"
+
+namespace xreg
+{
+
+// Forward declaration
+class RayCaster;
+
+/// \brief Adds the line integrals through screws and K-wires to the
+///        projections computed by a ray caster.
+///
+/// The rays are intersected analytically with the object models, so that
+/// different hardware placements may be simulated without modifying, or
+/// copying, the volume. The attenuation of each object is added to the line
+/// integrals of the volume, which ignores the tissue displaced by the object.
+/// This is a small error for metal objects, since the attenuation of the
+/// displaced tissue is typically about one percent of the metal's.
+///
+/// The objects are projected using the camera models and poses of the ray
+/// caster, e.g. after a call to RayCaster::compute(). OpenCL ray casters are
+/// updated on their device, otherwise the host buffer is updated. All camera
+/// models must have the same detector dimensions.
+class RayCastAddNaiveMetalObjs
+{
+public:
+  NaiveMetalObjs objs;
+
+  /// \brief Adds the objects to the first rc->num_projs() projections.
+  void operator()(RayCaster* rc);
+
+private:
+  boost::compute::context ctx_;
+
+  boost::compute::kernel krnl_;
+};
+
+}  // xreg
+
+#endif
+
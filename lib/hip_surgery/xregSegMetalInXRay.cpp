@@ -24,15 +24,132 @@
 
 #include "xregSegMetalInXRay.h"
 
+#include <algorithm>
+
 #include <fmt/format.h>
 
 #include <itkWatershedImageFilter.h>
 #include <itkGradientMagnitudeRecursiveGaussianImageFilter.h>
-#include <itkGrayscaleDilateImageFilter.h>
 #include <itkBinaryBallStructuringElement.h>
 
 #include "xregITKBasicImageUtils.h"
 #include "xregITKRemapUtils.h"
+#include "xregTBBUtils.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+using U16SegImg = itk::Image<unsigned short,2>;
+
+// Dilates a binary mask, with values of 0 and 1, using a ball structuring
+// element. This is equivalent to a grayscale dilation with the ball, however
+// each row of the ball is an interval, so the dilation is computed with
+// prefix sums of the mask rows and the output rows are computed in parallel.
+U16SegImg::Pointer DilateBinaryMaskWithBall(const U16SegImg* mask, const unsigned long radius)
+{
+  using MorphKernel = itk::BinaryBallStructuringElement<unsigned short,2>;
+
+  MorphKernel kern;
+  kern.SetRadius(radius);
+  kern.CreateStructuringElement();
+
+  const long r = static_cast<long>(radius);
+
+  // the column extent of each row of the ball
+  std::vector<long> row_min_off(2 * r + 1, 1);
+  std::vector<long> row_max_off(2 * r + 1, -1);
+
+  for (unsigned long i = 0; i < kern.Size(); ++i)
+  {
+    if (kern[i])
+    {
+      const auto off = kern.GetOffset(i);
+      
+      const long row_idx = off[1] + r;
+
+      row_min_off[row_idx] = std::min(row_min_off[row_idx], static_cast<long>(off[0]));
+      row_max_off[row_idx] = std::max(row_max_off[row_idx], static_cast<long>(off[0]));
+    }
+  }
+
+  const auto img_size = mask->GetLargestPossibleRegion().GetSize();
+
+  const long nc = static_cast<long>(img_size[0]);
+  const long nr = static_cast<long>(img_size[1]);
+
+  const unsigned short* mask_buf = mask->GetBufferPointer();
+
+  // prefix_sums[(row * (nc + 1)) + c] is the number of masked pixels in
+  // columns [0, c) of row
+  std::vector<unsigned long> prefix_sums(nr * (nc + 1));
+
+  auto prefix_sum_rows = [&] (const RangeType& range)
+  {
+    for (size_type row = range.begin(); row < range.end(); ++row)
+    {
+      const unsigned short* cur_mask_row = mask_buf + (static_cast<long>(row) * nc);
+
+      unsigned long* cur_sums = &prefix_sums[static_cast<long>(row) * (nc + 1)];
+
+      cur_sums[0] = 0;
+
+      for (long c = 0; c < nc; ++c)
+      {
+        cur_sums[c + 1] = cur_sums[c] + (cur_mask_row[c] ? 1 : 0);
+      }
+    }
+  };
+
+  ParallelFor(prefix_sum_rows, RangeType(0, nr));
+
+  auto dilated = MakeITK2DVol<unsigned short>(mask->GetLargestPossibleRegion());
+  dilated->SetOrigin(mask->GetOrigin());
+  dilated->SetSpacing(mask->GetSpacing());
+  dilated->SetDirection(mask->GetDirection());
+
+  unsigned short* dilated_buf = dilated->GetBufferPointer();
+
+  auto dilate_rows = [&] (const RangeType& range)
+  {
+    for (size_type row = range.begin(); row < range.end(); ++row)
+    {
+      unsigned short* cur_dst_row = dilated_buf + (static_cast<long>(row) * nc);
+
+      for (long c = 0; c < nc; ++c)
+      {
+        unsigned short v = 0;
+
+        for (long kern_row = 0; !v && (kern_row < (2 * r + 1)); ++kern_row)
+        {
+          const long src_row = static_cast<long>(row) + kern_row - r;
+
+          if ((src_row >= 0) && (src_row < nr) && (row_min_off[kern_row] <= row_max_off[kern_row]))
+          {
+            const long start_col = std::max(c + row_min_off[kern_row], long(0));
+            const long stop_col  = std::min(c + row_max_off[kern_row] + 1, nc);
+            
+            if (start_col < stop_col)
+            {
+              const unsigned long* cur_sums = &prefix_sums[src_row * (nc + 1)];
+
+              v = (cur_sums[stop_col] > cur_sums[start_col]) ? 1 : 0;
+            }
+          }
+        }
+
+        cur_dst_row[c] = v;
+      }
+    }
+  };
+
+  ParallelFor(dilate_rows, RangeType(0, nr));
+
+  return dilated;
+}
+
+}  // un-named
 
 void xreg::SegmentMetalInXRay::operator()()
 {
@@ -58,29 +175,28 @@ void xreg::SegmentMetalInXRay::operator()()
   const unsigned long min_num_pix_in_mask = static_cast<unsigned long>(
                                               std::floor(tot_num_pix * num_pix_in_mask_lower_thresh));
 
-  double cur_level = level;
+  // The same watershed filter is used for every level. The initial segmentation
+  // and the merge tree are computed by the first update, subsequent updates
+  // with only a new level relabel the segments using the existing merge tree.
+  using WatershedFilt = itk::WatershedImageFilter<IntensImg>;
 
-  bool should_stop = false;
+  auto watershed_filt = WatershedFilt::New();
+  watershed_filt->SetInput(grad_img);
+  watershed_filt->SetThreshold(thresh);
 
   unsigned long iter = 0;
   
   double frac_masked_pix = 0;
-  
-  while (!should_stop)
-  {
-    using WatershedFilt = itk::WatershedImageFilter<IntensImg>;
 
-    auto watershed_filt = WatershedFilt::New();
-    watershed_filt->SetInput(grad_img);
-    watershed_filt->SetThreshold(thresh);
+  // computes the mask at a level and returns the number of masked pixels
+  auto seg_at_level = [&] (const double cur_level)
+  {
     watershed_filt->SetLevel(cur_level);
 
     this->dout() << "performing filtering (segmentation) ..." << std::endl;
     watershed_filt->Update();
 
     // cast to u16 for more efficient lookups
-    using U16SegImg = itk::Image<unsigned short,2>;
-
     this->dout() << "casting to u16..." << std::endl;
     auto u16_seg = CastITKImageIfNeeded<unsigned short>(watershed_filt->GetOutput());
 
@@ -107,22 +223,9 @@ void xreg::SegmentMetalInXRay::operator()()
 
     if (binarize && dilation_radius)
     {
-      using MorphKernel  = itk::BinaryBallStructuringElement<unsigned short,2>;
-      using DilateFilter = itk::GrayscaleDilateImageFilter<U16SegImg,U16SegImg,MorphKernel>;
-
       this->dout() << "dilating binary labeling..." << std::endl;
 
-      MorphKernel kern;
-      kern.SetRadius(dilation_radius);
-      kern.CreateStructuringElement();
-
-      DilateFilter::Pointer dilate_filt = DilateFilter::New();
-      dilate_filt->SetInput(remap_seg);
-      dilate_filt->SetKernel(kern);
-
-      dilate_filt->Update();
-      
-      remap_seg = dilate_filt->GetOutput();
+      remap_seg = DilateBinaryMaskWithBall(remap_seg.GetPointer(), dilation_radius);
     }
 
     this->dout() << "casting -> s16..." << std::endl;
@@ -133,98 +236,133 @@ void xreg::SegmentMetalInXRay::operator()()
       
     const short* seg_buf = seg_img->GetBufferPointer();
 
-    unsigned long num_pix_in_mask = 0;
-    std::for_each(seg_buf, seg_buf + tot_num_pix,
-                  [&num_pix_in_mask] (const short& m)
-                  {
-                    if (m)
-                    {
-                      ++num_pix_in_mask;
-                    }
-                  });
+    const unsigned long num_pix_in_mask = static_cast<unsigned long>(
+                                            std::count_if(seg_buf, seg_buf + tot_num_pix,
+                                                          [] (const short& m) { return m != 0; }));
                                  
     frac_masked_pix = static_cast<double>(num_pix_in_mask) / tot_num_pix;
 
     this->dout() << fmt::format("{:2d}: {:.3f} ({:.4f})", iter, frac_masked_pix, cur_level) << std::endl;
 
+    ++iter;
+
+    return num_pix_in_mask;
+  };
+
+  // The number of masked pixels decreases as the level increases. The level is
+  // stepped, with a doubling step size, until a level with too many pixels and
+  // a level with too few pixels are found, and then the level is found by
+  // bisection.
+  
+  double cur_level = level;
+
+  double step = std::abs(level_inc);
+
+  bool too_many_level_found = false;
+  bool too_few_level_found  = false;
+
+  double too_many_level = 0;
+  double too_few_level  = 1;
+
+  bool last_seg_had_too_many = false;
+
+  bool should_stop = false;
+
+  while (!should_stop)
+  {
+    const unsigned long num_pix_in_mask = seg_at_level(cur_level);
+
+    last_seg_had_too_many = false;
+
     if (do_iter_adjust)
     {
-      this->dout() << "adjust iteration: " << iter << std::endl; 
+      this->dout() << "adjust iteration: " << (iter - 1) << std::endl; 
 
       if (num_pix_in_mask >= max_num_pix_in_mask)
       {
         this->dout() << "  too many pixels in mask" << std::endl;
-        
-        if ((iter > 0) && (level_inc < 0))
+
+        last_seg_had_too_many = true;
+
+        too_many_level_found = true;
+        too_many_level = cur_level;
+
+        if (too_few_level_found)
         {
-          // was previously lowering the threshold, we now want to increase it,
-          // but by half, so that we eventually converge
-          level_inc = std::abs(level_inc) / 2;
+          cur_level = (too_many_level + too_few_level) / 2;
         }
         else
         {
-          // either the first iteration, or we have not switched directions,
-          // so keep using the same positive increment
-          level_inc = std::abs(level_inc);
-        }
+          cur_level += step;
+          step *= 2;
 
-        cur_level += level_inc;
+          // the level is a fraction of the maximum depth
+          if (too_many_level >= 1)
+          {
+            should_stop = true;
+          }
+
+          cur_level = std::min(cur_level, 1.0);
+        }
       }
       else if (num_pix_in_mask <= min_num_pix_in_mask)
       {
         this->dout() << "  not enough pixels in mask" << std::endl;
         
-        if ((iter > 0) && (level_inc > 0))
-        {
-          // was previously increasing the threshold, we now want to decrease it,
-          // but by half, so that we eventually converge
-          level_inc = std::abs(level_inc) / -2;
+        too_few_level_found = true;
+        too_few_level = cur_level;
 
-          if (level_inc > -0.001)
-          {
-            // we have not found a threshold that works, and this method will most
-            // likely not work on the current inputs, terminate now, on a case that
-            // was decreasing the threshold, since it will not mask out the entire
-            // image, it may not mask any screws, but that is better than masking
-            // everything.
-            should_stop = true;
-          }
+        if (too_many_level_found)
+        {
+          cur_level = (too_many_level + too_few_level) / 2;
         }
         else
         {
-          // either the first iteration, or we have not switched directions,
-          // so keep using the same negative increment
-          level_inc = -std::abs(level_inc);
-        }
-
-        cur_level += level_inc;
+          cur_level -= step;
+          step *= 2;
 
-        // corner case of going to zero or negative... this has happened.
-        if (cur_level < 1.0e-3)
-        {
-          should_stop = true;
+          // corner case of going to zero or negative... this has happened.
+          if (cur_level < 1.0e-3)
+          {
+            should_stop = true;
+          }
         }
       }
       else
       {
         should_stop = true;
       }
+
+      if (too_many_level_found && too_few_level_found &&
+          ((too_few_level - too_many_level) < 0.001))
+      {
+        // we have not found a level that works, and this method will most
+        // likely not work on the current inputs
+        should_stop = true;
+      }
     }
     else
     {
       should_stop = true;
     }
 
-    ++iter;
-
     // check for maximum number of iterations
-    if (max_iters && (iter >= max_iters))
+    if (!should_stop && max_iters && (iter >= max_iters))
     {
       this->dout() << "max num iters reached..." << std::endl;
       should_stop = true;
     }
   }
 
+  if (last_seg_had_too_many && too_few_level_found)
+  {
+    // terminate on a level with too few pixels, since it will not mask out
+    // the entire image, it may not mask any screws, but that is better than
+    // masking everything.
+    this->dout() << "using level with too few pixels in mask..." << std::endl;
+    seg_at_level(too_few_level);
+  }
+
   // check to see if most of image is masked... if it is then mask nothing
   if (frac_masked_pix > 0.7)
   {
@@ -232,4 +370,3 @@ void xreg::SegmentMetalInXRay::operator()()
     seg_img->FillBuffer(0);
   }
 }
-
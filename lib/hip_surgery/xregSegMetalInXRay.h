@@ -51,8 +51,14 @@ struct SegmentMetalInXRay : ObjWithOStream
   
   double num_pix_in_mask_lower_thresh = 0.01;
 
+  // The initial step used to search for a level yielding a number of masked
+  // pixels between the lower and upper thresholds. The step doubles until the
+  // number of masked pixels crosses a threshold and then the level is found by
+  // bisection. The watershed merge tree is only computed once, so each step of
+  // the search only relabels the segments.
   double level_inc = 0.01;
 
+  // maximum number of levels evaluated
   unsigned long max_iters = 20;
 
   bool binarize = true;
@@ -24,8 +24,71 @@
 
 #include "xregHUToLinAtt.h"
 
-#include <itkImageRegionIterator.h>
-#include <itkImageRegionConstIterator.h>
+#include <algorithm>
+#include <vector>
+
+#include "xregAssert.h"
+#include "xregCommon.h"
+#include "xregTBBUtils.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+// Coefficients of the conversion: att = clamp((hu - hu_lower) * scale, 0, att_upper)
+struct HUToLinAttCoeffs
+{
+  float scale;
+  float hu_lower;
+  float att_upper;
+};
+
+HUToLinAttCoeffs MakeHUToLinAttCoeffs(const double mu_water, const double mu_air,
+                                      const double hu_lower, const double hu_upper)
+{
+  const double hu_scale = (mu_water - mu_air) * 1.0e-3;
+
+  HUToLinAttCoeffs c;
+  c.scale     = static_cast<float>(hu_scale);
+  c.hu_lower  = static_cast<float>(hu_lower);
+  c.att_upper = (hu_upper < std::numeric_limits<double>::infinity()) ?
+                  static_cast<float>(std::max((hu_upper - hu_lower) * hu_scale, 0.0)) :
+                  std::numeric_limits<float>::max();
+
+  return c;
+}
+
+// default coefficients of HUToLinAttFilter
+HUToLinAttCoeffs MakeDefaultHUToLinAttCoeffs(const double hu_lower)
+{
+  return MakeHUToLinAttCoeffs(0.02683 * 1.0, 0.02485 * 0.0001, hu_lower,
+                              std::numeric_limits<double>::infinity());
+}
+
+// src and dst may be equal for an in-place conversion
+void HUToLinAttBuf(const float* src, float* dst, const size_type num_vox,
+                   const HUToLinAttCoeffs& c)
+{
+  const float scale     = c.scale;
+  const float hu_lower  = c.hu_lower;
+  const float att_upper = c.att_upper;
+
+  auto conv_fn = [src,dst,scale,hu_lower,att_upper] (const RangeType& r)
+  {
+    // simple loop over contiguous buffers, which the compiler vectorizes
+    const size_type end_idx = r.end();
+
+    for (size_type i = r.begin(); i < end_idx; ++i)
+    {
+      dst[i] = std::min(std::max((src[i] - hu_lower) * scale, 0.0f), att_upper);
+    }
+  };
+
+  ParallelFor(conv_fn, RangeType(0, num_vox));
+}
+
+}  // un-named
   
 void xreg::HUToLinAttFilter::SetLinearAttWater(const double mu_water)
 {
@@ -42,30 +105,30 @@ void xreg::HUToLinAttFilter::SetHULower(const double hul)
   hu_lower_ = hul;
 }
 
+void xreg::HUToLinAttFilter::SetHUUpper(const double huu)
+{
+  hu_upper_ = huu;
+}
+
 void xreg::HUToLinAttFilter::GenerateData()
 {
+  // when running in-place, the output is grafted onto the input buffer
+  this->AllocateOutputs();
+
   const auto* hu_img = this->GetInput();
 
   auto* att_img = this->GetOutput();
-  att_img->SetRegions(hu_img->GetLargestPossibleRegion());
-  att_img->Allocate();
-
-  itk::ImageRegionConstIterator<Vol> hu_it(hu_img, hu_img->GetLargestPossibleRegion());
-  itk::ImageRegionIterator<Vol> att_it(att_img, att_img->GetLargestPossibleRegion());
 
-  const double hu_scale = (mu_water_ - mu_air_) * 1.0e-3;
+  const size_type num_vox = att_img->GetBufferedRegion().GetNumberOfPixels();
 
-  const double mu_lower = (hu_lower_ * hu_scale) + mu_water_;
+  xregASSERT(hu_img->GetBufferedRegion() == att_img->GetBufferedRegion());
 
-  for (hu_it.GoToBegin(), att_it.GoToBegin(); !hu_it.IsAtEnd(); ++hu_it, ++att_it)
-  {
-    // TODO: can increase efficiency by making hu_scale and a temporary hu_water_ of type float when PixelType is float
-    att_it.Set(static_cast<float>(std::max((hu_it.Get() * hu_scale) + mu_water_ - mu_lower, 0.0)));
+  HUToLinAttBuf(hu_img->GetBufferPointer(), att_img->GetBufferPointer(), num_vox,
+                MakeHUToLinAttCoeffs(mu_water_, mu_air_, hu_lower_, hu_upper_));
 
-    // these were experiments with a conversion that also implicitly thresholds the linear attenuation values
-    //att_it.Set(static_cast<float>(std::max((hu_it.Get() * hu_scale) + (-0.2 * mu_water_), 0.0)));
-    //att_it.Set(static_cast<float>(std::max((hu_it.Get() - 200) * (mu_water_ / 1000), 0.0)));
-  }
+  // these were experiments with a conversion that also implicitly thresholds the linear attenuation values
+  //att_it.Set(static_cast<float>(std::max((hu_it.Get() * hu_scale) + (-0.2 * mu_water_), 0.0)));
+  //att_it.Set(static_cast<float>(std::max((hu_it.Get() - 200) * (mu_water_ / 1000), 0.0)));
 }
 
 itk::Image<float,3>::Pointer xreg::HUToLinAtt(const itk::Image<float,3>* hu_vol,
@@ -79,3 +142,62 @@ itk::Image<float,3>::Pointer xreg::HUToLinAtt(const itk::Image<float,3>* hu_vol,
   return hu2att->GetOutput();
 }
 
+itk::Image<float,3>::Pointer xreg::HUToLinAtt(const itk::Image<short,3>* hu_vol,
+                                              const float hu_lower)
+{
+  using HUScalar = short;
+
+  constexpr long kMIN_HU = std::numeric_limits<HUScalar>::min();
+  constexpr long kMAX_HU = std::numeric_limits<HUScalar>::max();
+
+  const auto c = MakeDefaultHUToLinAttCoeffs(hu_lower);
+
+  std::vector<float> lut(kMAX_HU - kMIN_HU + 1);
+
+  for (long hu = kMIN_HU; hu <= kMAX_HU; ++hu)
+  {
+    const float hu_f = static_cast<float>(hu);
+
+    lut[hu - kMIN_HU] = std::min(std::max((hu_f - c.hu_lower) * c.scale, 0.0f), c.att_upper);
+  }
+
+  // every voxel is written below, so the buffer is not initialized
+  auto att_vol = itk::Image<float,3>::New();
+  att_vol->CopyInformation(hu_vol);
+  att_vol->SetRegions(hu_vol->GetLargestPossibleRegion());
+  att_vol->Allocate();
+
+  const HUScalar* src = hu_vol->GetBufferPointer();
+  float* dst = att_vol->GetBufferPointer();
+  
+  const float* lut_buf = &lut[0];
+
+  auto lut_fn = [src,dst,lut_buf] (const RangeType& r)
+  {
+    const size_type end_idx = r.end();
+
+    for (size_type i = r.begin(); i < end_idx; ++i)
+    {
+      dst[i] = lut_buf[static_cast<long>(src[i]) - kMIN_HU];
+    }
+  };
+
+  ParallelFor(lut_fn, RangeType(0, hu_vol->GetBufferedRegion().GetNumberOfPixels()));
+
+  return att_vol;
+}
+
+void xreg::HUToLinAttInPlace(itk::Image<float,3>* vol, const float hu_lower)
+{
+  float* buf = vol->GetBufferPointer();
+
+  HUToLinAttBuf(buf, buf, vol->GetBufferedRegion().GetNumberOfPixels(),
+                MakeDefaultHUToLinAttCoeffs(hu_lower));
+}
+
+float xreg::HUToLinAtt(const float hu, const float hu_lower)
+{
+  const HUToLinAttCoeffs c = MakeDefaultHUToLinAttCoeffs(hu_lower);
+
+  return std::min(std::max((hu - c.hu_lower) * c.scale, 0.0f), c.att_upper);
+}
@@ -25,24 +25,31 @@
 #ifndef XREGHUTOLINATT_H_
 #define XREGHUTOLINATT_H_
 
+#include <limits>
+
 #include <itkImage.h>
-#include <itkImageToImageFilter.h>
+#include <itkInPlaceImageFilter.h>
 
 namespace xreg
 {
 
+/// \brief Converts a volume of HU values into linear attenuation values.
+///
+/// Voxels are converted concurrently. The conversion may be performed in-place,
+/// e.g. SetInPlace(true), which avoids allocating a second volume when the input
+/// HU volume is no longer needed.
 class HUToLinAttFilter
-  : public itk::ImageToImageFilter<itk::Image<float,3>,itk::Image<float,3>>
+  : public itk::InPlaceImageFilter<itk::Image<float,3>,itk::Image<float,3>>
 {
 public:
   using Self       = HUToLinAttFilter;
   using Vol        = itk::Image<float,3>;
-  using Superclass = itk::ImageToImageFilter<Vol,Vol>;
+  using Superclass = itk::InPlaceImageFilter<Vol,Vol>;
   using Pointer    = itk::SmartPointer<Self>;
 
   itkNewMacro(Self);
 
-  itkTypeMacro(HUToLinAttFilter, itk::ImageToImageFilter);
+  itkTypeMacro(HUToLinAttFilter, itk::InPlaceImageFilter);
 
   /// \brief Sets the linear attenuation coefficient to use for water.
   ///
@@ -56,6 +63,11 @@ public:
 
   void SetHULower(const double hul);
 
+  /// \brief Clamps HU values above this value prior to conversion.
+  ///
+  /// This may be used to limit the effect of metal, etc. Defaults to no clamping.
+  void SetHUUpper(const double huu);
+
 protected:
 
   HUToLinAttFilter() = default;
@@ -74,11 +86,27 @@ private:
   double mu_air_   = 0.02485 * 0.0001;
 
   double hu_lower_ = -1000;
+
+  double hu_upper_ = std::numeric_limits<double>::infinity();
 };
 
 itk::Image<float,3>::Pointer HUToLinAtt(const itk::Image<float,3>* hu_vol,
                                         const float hu_lower = -1000);
 
+/// \brief Converts a volume of integer HU values into linear attenuation values.
+///
+/// A lookup table, with an entry for every possible HU value, is used so that
+/// the source volume never needs to be converted to floating point.
+itk::Image<float,3>::Pointer HUToLinAtt(const itk::Image<short,3>* hu_vol,
+                                        const float hu_lower = -1000);
+
+/// \brief Converts a volume of HU values into linear attenuation values in-place.
+void HUToLinAttInPlace(itk::Image<float,3>* vol, const float hu_lower = -1000);
+
+/// \brief Converts a single HU value into a linear attenuation value, using
+///        the same default coefficients as HUToLinAttInPlace().
+float HUToLinAtt(const float hu, const float hu_lower = -1000);
+
 }  // xreg
 
 #endif
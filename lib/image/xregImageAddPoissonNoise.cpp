@@ -29,6 +29,41 @@
 #include "xregTBBUtils.h"
 #include "xregImageIntensLogTrans.h"
 
+namespace  // un-named
+{
+
+using namespace xreg;
+
+// Samples counts for a block of pixels; the Philox counter for a pixel is
+// (pixel index, image index, 0, 0)
+struct SamplePoissonPhiloxFn
+{
+  const float* src_buf;
+  unsigned short* dst_buf;
+
+  double num_photons;
+
+  PhiloxKey key;
+  std::uint32_t img_idx;
+
+  void operator()(const RangeType& r) const
+  {
+    for (size_type i = r.begin(); i < r.end(); ++i)
+    {
+      const PhiloxCtr ctr = { static_cast<std::uint32_t>(i), img_idx, 0, 0 };
+
+      const std::uint64_t k = SamplePoissonPhilox(num_photons * std::exp(-src_buf[i]), ctr, key);
+
+      // more of a sanitity check to make sure the values are not saturating
+      xregASSERT(k < std::numeric_limits<unsigned short>::max());
+
+      dst_buf[i] = static_cast<unsigned short>(k);
+    }
+  }
+};
+
+}  // un-named
+
 itk::Image<unsigned short,2>::Pointer
 xreg::SamplePoissonProjFromAttProj(const itk::Image<float,2>* att_proj,
                                    const unsigned long num_photons)
@@ -82,3 +117,71 @@ xreg::AddPoissonNoiseToImage(const itk::Image<float,2>* src_img,
   return log_xform->GetOutput();
 }
 
+itk::Image<unsigned short,2>::Pointer
+xreg::SamplePoissonProjFromAttProj(const itk::Image<float,2>* att_proj,
+                                   const unsigned long num_photons,
+                                   const std::uint64_t seed,
+                                   const std::uint32_t img_idx)
+{
+  const auto sz = att_proj->GetLargestPossibleRegion().GetSize();
+
+  const size_type num_pix = sz[0] * sz[1];
+
+  xregASSERT(num_pix <= std::numeric_limits<std::uint32_t>::max());
+
+  auto dst_proj = MakeITKVolWithSameCoords<unsigned short>(att_proj);
+
+  SamplePoissonPhiloxFn sample_fn = { att_proj->GetBufferPointer(), dst_proj->GetBufferPointer(),
+                                      static_cast<double>(num_photons), MakePhiloxKey(seed),
+                                      img_idx };
+
+  ParallelFor(sample_fn, RangeType(0,num_pix));
+
+  return dst_proj;
+}
+
+std::vector<itk::Image<unsigned short,2>::Pointer>
+xreg::SamplePoissonProjsFromAttProjs(const std::vector<const itk::Image<float,2>*>& att_projs,
+                                     const unsigned long num_photons,
+                                     const std::uint64_t seed,
+                                     const std::uint32_t first_img_idx)
+{
+  const size_type num_projs = att_projs.size();
+
+  std::vector<itk::Image<unsigned short,2>::Pointer> dst_projs(num_projs);
+
+  // the pixels of each image are also sampled in parallel
+  auto sample_imgs_fn = [&] (const RangeType& r)
+  {
+    for (size_type i = r.begin(); i < r.end(); ++i)
+    {
+      dst_projs[i] = SamplePoissonProjFromAttProj(att_projs[i], num_photons, seed,
+                                                  first_img_idx + static_cast<std::uint32_t>(i));
+    }
+  };
+
+  ParallelFor(sample_imgs_fn, RangeType(0, num_projs));
+
+  return dst_projs;
+}
+
+itk::Image<float,2>::Pointer
+xreg::AddPoissonNoiseToImage(const itk::Image<float,2>* src_img,
+                             const unsigned long num_photons,
+                             const std::uint64_t seed,
+                             const std::uint32_t img_idx)
+{
+  auto counts = CastITKImageIfNeeded<float>(
+                    SamplePoissonProjFromAttProj(src_img, num_photons, seed, img_idx).GetPointer());
+
+  auto log_xform = ImageIntensLogTransFilter::New();
+
+  log_xform->SetNormalizeZeroOne(false);
+  log_xform->SetUseMaxIntensityAsI0(false);
+  log_xform->SetI0(num_photons);
+  log_xform->SetInput(counts);
+
+  log_xform->Update();
+
+  return log_xform->GetOutput();
+}
@@ -25,6 +25,9 @@
 #ifndef XREGIMAGEADDPOISSONNOISE_H_
 #define XREGIMAGEADDPOISSONNOISE_H_
 
+#include <cstdint>
+#include <vector>
+
 #include <itkImage.h>
 
 namespace xreg
@@ -38,6 +41,40 @@ itk::Image<float,2>::Pointer
 AddPoissonNoiseToImage(const itk::Image<float,2>* src_img,
                        const unsigned long num_photons);
 
+/// \brief Samples photon counts from a projection of line integrals using a
+///        counter-based random number generator.
+///
+/// The sample at each pixel is determined by the seed, the image index and
+/// the pixel index, so the output is reproducible for a given seed regardless
+/// of the number of threads used. Distinct image indices should be used for
+/// images in a collection which are sampled with the same seed.
+itk::Image<unsigned short,2>::Pointer
+SamplePoissonProjFromAttProj(const itk::Image<float,2>* att_proj,
+                             const unsigned long num_photons,
+                             const std::uint64_t seed,
+                             const std::uint32_t img_idx = 0);
+
+/// \brief Samples photon counts for a collection of projections, in parallel
+///        across images and pixels.
+///
+/// Image i has image index first_img_idx + i, so this produces the same
+/// output as calling the single projection variant on each image.
+std::vector<itk::Image<unsigned short,2>::Pointer>
+SamplePoissonProjsFromAttProjs(const std::vector<const itk::Image<float,2>*>& att_projs,
+                               const unsigned long num_photons,
+                               const std::uint64_t seed,
+                               const std::uint32_t first_img_idx = 0);
+
+/// \brief Adds Poisson noise to a projection of line integrals using a
+///        counter-based random number generator.
+///
+/// See SamplePoissonProjFromAttProj() for the seed and image index.
+itk::Image<float,2>::Pointer
+AddPoissonNoiseToImage(const itk::Image<float,2>* src_img,
+                       const unsigned long num_photons,
+                       const std::uint64_t seed,
+                       const std::uint32_t img_idx = 0);
+
 }  // xreg
 
 #endif
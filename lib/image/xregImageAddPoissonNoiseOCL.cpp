@@ -0,0 +1,206 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregImageAddPoissonNoiseOCL.h"
+
+#include <limits>
+
+#include <boost/compute/utility/source.hpp>
+
+#include "xregAssert.h"
+#include "xregOpenCLProfiling.h"
+#include "xregOpenCLProgCache.h"
+
+namespace  // un-named
+{
+
+const char* kPOISSON_NOISE_OPENCL_SRC = BOOST_COMPUTE_STRINGIZE_SOURCE(
+
+// Philox4x32-10, matches xreg::Philox4x32()
+uint4 Philox4x32(uint4 ctr, uint2 key)
+{
+  for (int round_idx = 0; round_idx < 10; ++round_idx)
+  {
+    if (round_idx)
+    {
+      key.x += 0x9E3779B9;
+      key.y += 0xBB67AE85;
+    }
+
+    const uint hi_0 = mul_hi((uint) 0xD2511F53, ctr.x);
+    const uint lo_0 = 0xD2511F53 * ctr.x;
+
+    const uint hi_1 = mul_hi((uint) 0xCD9E8D57, ctr.z);
+    const uint lo_1 = 0xCD9E8D57 * ctr.z;
+
+    ctr = (uint4) (hi_1 ^ ctr.y ^ key.x, lo_1, hi_0 ^ ctr.w ^ key.y, lo_0);
+  }
+
+  return ctr;
+}
+
+float PhiloxToUniformOpen(const uint x)
+{
+  return (((float) (x >> 8)) + 0.5f) * (1.0f / 16777216.0f);
+}
+
+// matches xreg::SamplePoissonPhilox()
+float SamplePoissonPhilox(const float lambda, uint4 ctr, const uint2 key)
+{
+  float k = 0;
+
+  if (lambda > 0)
+  {
+    ctr.w = 0;
+
+    if (lambda < 10)
+    {
+      float u = PhiloxToUniformOpen(Philox4x32(ctr, key).x);
+
+      float p = exp(-lambda);
+
+      while ((u > p) && (k < 1000))
+      {
+        u -= p;
+        k += 1;
+        p *= lambda / k;
+      }
+    }
+    else
+    {
+      const float slam    = sqrt(lambda);
+      const float log_lam = log(lambda);
+
+      const float b = 0.931f + (2.53f * slam);
+      const float a = -0.059f + (0.02483f * b);
+
+      const float inv_alpha = 1.1239f + (1.1328f / (b - 3.4f));
+      const float v_r       = 0.9277f - (3.6224f / (b - 2));
+
+      bool found = false;
+
+      while (!found)
+      {
+        const uint4 r = Philox4x32(ctr, key);
+        ++ctr.w;
+
+        const uint rs[4] = { r.x, r.y, r.z, r.w };
+
+        for (int i = 0; (i < 4) && !found; i += 2)
+        {
+          const float U  = PhiloxToUniformOpen(rs[i]) - 0.5f;
+          const float V  = PhiloxToUniformOpen(rs[i + 1]);
+          const float us = 0.5f - fabs(U);
+
+          k = floor((((2 * a) / us) + b) * U + lambda + 0.43f);
+
+          if ((us >= 0.07f) && (V <= v_r))
+          {
+            found = true;
+          }
+          else if ((k >= 0) && !((us < 0.013f) && (V > us)))
+          {
+            found = (log(V) + log(inv_alpha) - log((a / (us * us)) + b)) <=
+                        (-lambda + (k * log_lam) - lgamma(k + 1));
+          }
+        }
+      }
+    }
+  }
+
+  return k;
+}
+
+__kernel void PoissonNoiseKernel(__global const float* src_imgs,
+                                 __global float* dst_imgs,
+                                 const ulong num_pix_per_img,
+                                 const ulong tot_num_pix,
+                                 const uint first_img_idx,
+                                 const uint2 key,
+                                 const float num_photons,
+                                 const int log_remap)
+{
+  const ulong idx = get_global_id(0);
+
+  if (idx < tot_num_pix)
+  {
+    const ulong img_idx = idx / num_pix_per_img;
+    const uint pix_idx = (uint) (idx - (img_idx * num_pix_per_img));
+
+    const uint4 ctr = (uint4) (pix_idx, first_img_idx + (uint) img_idx, 0, 0);
+
+    const float k = SamplePoissonPhilox(num_photons * exp(-src_imgs[idx]), ctr, key);
+
+    dst_imgs[idx] = log_remap ? (log(num_photons) - log(fmax(k, 1.0f))) : k;
+  }
+}
+
+);
+
+}  // un-named
+
+xreg::ImageAddPoissonNoiseOCL::ImageAddPoissonNoiseOCL(const boost::compute::context& ctx,
+                                                       const boost::compute::command_queue& queue)
+  : ctx_(ctx), queue_(queue)
+{ }
+
+void xreg::ImageAddPoissonNoiseOCL::allocate_resources()
+{
+  noise_krnl_ = BuildOpenCLProg(kPOISSON_NOISE_OPENCL_SRC, ctx_).create_kernel("PoissonNoiseKernel");
+}
+
+void xreg::ImageAddPoissonNoiseOCL::run(const DevBuf& src, DevBuf* dst,
+                                        const size_type num_pix_per_img,
+                                        const size_type num_imgs,
+                                        const std::uint32_t first_img_idx)
+{
+  namespace bc = boost::compute;
+
+  xregASSERT(dst);
+  xregASSERT(num_pix_per_img <= std::numeric_limits<std::uint32_t>::max());
+
+  const size_type tot_num_pix = num_pix_per_img * num_imgs;
+
+  xregASSERT(src.size() >= tot_num_pix);
+  xregASSERT(dst->size() >= tot_num_pix);
+
+  bc::uint2_ key;
+  key[0] = static_cast<std::uint32_t>(seed);
+  key[1] = static_cast<std::uint32_t>(seed >> 32);
+
+  noise_krnl_.set_arg(0, src);
+  noise_krnl_.set_arg(1, *dst);
+  noise_krnl_.set_arg(2, bc::ulong_(num_pix_per_img));
+  noise_krnl_.set_arg(3, bc::ulong_(tot_num_pix));
+  noise_krnl_.set_arg(4, bc::uint_(first_img_idx));
+  noise_krnl_.set_arg(5, key);
+  noise_krnl_.set_arg(6, bc::float_(static_cast<float>(num_photons)));
+  noise_krnl_.set_arg(7, bc::int_(log_remap ? 1 : 0));
+
+  const std::size_t global_size = tot_num_pix;
+
+  RecordOpenCLKernelEvent("PoissonNoiseKernel",
+                          queue_.enqueue_nd_range_kernel(noise_krnl_, 1, nullptr,
+                                                         &global_size, nullptr));
+}
@@ -0,0 +1,89 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGIMAGEADDPOISSONNOISEOCL_H_
+#define XREGIMAGEADDPOISSONNOISEOCL_H_
+
+#include <cstdint>
+
+#include <boost/compute/command_queue.hpp>
+#include <boost/compute/container/vector.hpp>
+#include <boost/compute/context.hpp>
+#include <boost/compute/kernel.hpp>
+
+#include "xregCommon.h"
+
+namespace xreg
+{
+
+/// \brief Adds Poisson noise to a batch of line integral projections stored in
+///        an OpenCL buffer, e.g. DRRs computed by a ray caster.
+///
+/// This uses the same counter-based (Philox) random streams as the seeded
+/// variants of SamplePoissonProjFromAttProj() and AddPoissonNoiseToImage():
+/// pixel p of image i in a batch uses the counter (p, first_img_idx + i, 0, 0)
+/// and the key derived from the seed. The output is reproducible for a given
+/// seed and device. The device computes in single precision, so a small
+/// number of samples may differ from the host implementation.
+class ImageAddPoissonNoiseOCL
+{
+public:
+  using DevBuf = boost::compute::vector<float>;
+
+  unsigned long num_photons = 2000;
+
+  std::uint64_t seed = 0;
+
+  /// \brief When true, the noisy counts are converted back into line
+  ///        integrals, otherwise the counts are written.
+  ///
+  /// Zero counts are mapped to the line integral of a single photon. The
+  /// host implementation uses the minimum positive count of each image, which
+  /// is almost always one.
+  bool log_remap = true;
+
+  ImageAddPoissonNoiseOCL(const boost::compute::context& ctx,
+                          const boost::compute::command_queue& queue);
+
+  /// \brief Compiles the kernel.
+  void allocate_resources();
+
+  /// \brief Samples num_imgs images of num_pix_per_img pixels from src and
+  ///        writes them into dst.
+  ///
+  /// src and dst may be the same buffer. The kernel is enqueued and this does
+  /// not wait for it to finish.
+  void run(const DevBuf& src, DevBuf* dst, const size_type num_pix_per_img,
+           const size_type num_imgs, const std::uint32_t first_img_idx = 0);
+
+private:
+  boost::compute::context ctx_;
+  boost::compute::command_queue queue_;
+
+  boost::compute::kernel noise_krnl_;
+};
+
+}  // xreg
+
+#endif
@@ -24,11 +24,16 @@
 
 #include "xregLabelWarping.h"
 
+#include <array>
+#include <cmath>
+
 #include <itkImageRegionConstIteratorWithIndex.h>
 #include <itkImageRegionIteratorWithIndex.h>
 #include <itkNearestNeighborInterpolateImageFunction.h>
+#include <itkLinearInterpolateImageFunction.h>
 
 #include "xregRigidUtils.h"
+#include "xregTBBUtils.h"
 #include "xregITKBasicImageUtils.h"
 #include "xregAssert.h"
 
@@ -83,6 +88,231 @@ bool xreg::CheckCollisionBetweenLabelSets(const itk::Image<unsigned char,3>* lab
   return collides;
 }
 
+xreg::LabelSetCollisionChecker::LabelSetCollisionChecker(const LabelImage* labels,
+                                                         const LabelSet& mov_labels,
+                                                         const LabelSet& fixed_labels)
+  : labels_(labels), has_mov_(false)
+{
+  using ConstIt      = itk::ImageRegionConstIteratorWithIndex<LabelImage>;
+  using ITKPointType = LabelImage::PointType;
+
+  is_mov_label_.fill(false);
+  for (const auto& l : mov_labels)
+  {
+    is_mov_label_[l] = true;
+  }
+
+  std::array<bool,256> is_fixed_label;
+  is_fixed_label.fill(false);
+  for (const auto& l : fixed_labels)
+  {
+    is_fixed_label[l] = true;
+  }
+
+  const auto buf_region = labels->GetBufferedRegion();
+  const auto buf_start  = buf_region.GetIndex();
+  const auto buf_size   = buf_region.GetSize();
+
+  std::array<size_type,3> num_blocks;
+
+  for (size_type i = 0; i < 3; ++i)
+  {
+    buf_size_[i] = static_cast<long>(buf_size[i]);
+    num_blocks[i] = (buf_size[i] + kBLOCK_LEN - 1) / kBLOCK_LEN;
+  }
+
+  // indices into the buffer, not the image's index space, so pixel lookups
+  // reduce to an offset into the buffer pointer
+  FrameTransform buf_inds_to_phys = ITKImagePhysicalPointTransformsAsEigen(labels);
+  buf_inds_to_phys.matrix().block(0,3,3,1) += buf_inds_to_phys.matrix().block(0,0,3,3) *
+                                                Pt3(static_cast<CoordScalar>(buf_start[0]),
+                                                    static_cast<CoordScalar>(buf_start[1]),
+                                                    static_cast<CoordScalar>(buf_start[2]));
+  phys_to_buf_inds_ = buf_inds_to_phys.inverse();
+
+  std::vector<Pt3List> pts_per_block(num_blocks[0] * num_blocks[1] * num_blocks[2]);
+
+  ITKPointType tmp_itk_pt;
+  Pt3 tmp_pt;
+
+  ConstIt it(labels, buf_region);
+  for (it.GoToBegin(); !it.IsAtEnd(); ++it)
+  {
+    const LabelScalar l = it.Value();
+
+    if (is_mov_label_[l] || is_fixed_label[l])
+    {
+      const auto idx = it.GetIndex();
+
+      std::array<long,3> buf_idx;
+      for (size_type i = 0; i < 3; ++i)
+      {
+        buf_idx[i] = idx[i] - buf_start[i];
+      }
+
+      if (is_mov_label_[l])
+      {
+        if (has_mov_)
+        {
+          for (size_type i = 0; i < 3; ++i)
+          {
+            mov_min_idx_[i] = std::min(mov_min_idx_[i], buf_idx[i]);
+            mov_max_idx_[i] = std::max(mov_max_idx_[i], buf_idx[i]);
+          }
+        }
+        else
+        {
+          mov_min_idx_ = buf_idx;
+          mov_max_idx_ = buf_idx;
+          has_mov_ = true;
+        }
+      }
+
+      if (is_fixed_label[l])
+      {
+        labels->TransformIndexToPhysicalPoint(idx, tmp_itk_pt);
+        tmp_pt[0] = tmp_itk_pt[0];
+        tmp_pt[1] = tmp_itk_pt[1];
+        tmp_pt[2] = tmp_itk_pt[2];
+
+        const size_type block_idx = (buf_idx[0] / kBLOCK_LEN) +
+                                      (num_blocks[0] * ((buf_idx[1] / kBLOCK_LEN) +
+                                        (num_blocks[1] * (buf_idx[2] / kBLOCK_LEN))));
+
+        pts_per_block[block_idx].push_back(tmp_pt);
+      }
+    }
+  }
+
+  all_fixed_.pts_begin = 0;
+  all_fixed_.pts_end   = 0;
+
+  for (const auto& block_pts : pts_per_block)
+  {
+    if (!block_pts.empty())
+    {
+      FixedBlock b;
+      b.pts_begin = fixed_pts_.size();
+      b.pts_end   = b.pts_begin + block_pts.size();
+
+      b.bb_min = block_pts[0];
+      b.bb_max = block_pts[0];
+
+      for (const auto& p : block_pts)
+      {
+        b.bb_min = b.bb_min.cwiseMin(p);
+        b.bb_max = b.bb_max.cwiseMax(p);
+      }
+
+      if (fixed_blocks_.empty())
+      {
+        all_fixed_.bb_min = b.bb_min;
+        all_fixed_.bb_max = b.bb_max;
+      }
+      else
+      {
+        all_fixed_.bb_min = all_fixed_.bb_min.cwiseMin(b.bb_min);
+        all_fixed_.bb_max = all_fixed_.bb_max.cwiseMax(b.bb_max);
+      }
+
+      fixed_pts_.insert(fixed_pts_.end(), block_pts.begin(), block_pts.end());
+      fixed_blocks_.push_back(b);
+    }
+  }
+
+  all_fixed_.pts_end = fixed_pts_.size();
+}
+
+bool xreg::LabelSetCollisionChecker::block_may_collide(const FixedBlock& b,
+                                                       const FrameTransform& phys_to_mov_inds) const
+{
+  // a point maps to a moving voxel only when it rounds into the moving index
+  // extent, so compare the warped box against the extent grown by half a voxel
+  constexpr CoordScalar kTOL = 0.5 + 1.0e-3;
+
+  Pt3 corner;
+  Pt3 warped_min;
+  Pt3 warped_max;
+
+  for (size_type corner_idx = 0; corner_idx < 8; ++corner_idx)
+  {
+    corner[0] = (corner_idx & 1) ? b.bb_max[0] : b.bb_min[0];
+    corner[1] = (corner_idx & 2) ? b.bb_max[1] : b.bb_min[1];
+    corner[2] = (corner_idx & 4) ? b.bb_max[2] : b.bb_min[2];
+
+    const Pt3 warped_corner = phys_to_mov_inds * corner;
+
+    if (corner_idx)
+    {
+      warped_min = warped_min.cwiseMin(warped_corner);
+      warped_max = warped_max.cwiseMax(warped_corner);
+    }
+    else
+    {
+      warped_min = warped_corner;
+      warped_max = warped_corner;
+    }
+  }
+
+  for (size_type i = 0; i < 3; ++i)
+  {
+    if ((warped_max[i] < (mov_min_idx_[i] - kTOL)) || (warped_min[i] > (mov_max_idx_[i] + kTOL)))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool xreg::LabelSetCollisionChecker::collides(const FrameTransform& delta_xform_inv) const
+{
+  if (!has_mov_ || fixed_pts_.empty())
+  {
+    return false;
+  }
+  
+  const FrameTransform phys_to_mov_inds = phys_to_buf_inds_ * delta_xform_inv;
+
+  if (!block_may_collide(all_fixed_, phys_to_mov_inds))
+  {
+    return false;
+  }
+
+  const LabelScalar* buf = labels_->GetBufferPointer();
+
+  const long row_stride   = buf_size_[0];
+  const long slice_stride = buf_size_[0] * buf_size_[1];
+
+  for (const auto& b : fixed_blocks_)
+  {
+    if (block_may_collide(b, phys_to_mov_inds))
+    {
+      for (size_type pt_idx = b.pts_begin; pt_idx < b.pts_end; ++pt_idx)
+      {
+        const Pt3 cont_idx = phys_to_mov_inds * fixed_pts_[pt_idx];
+
+        // matches the rounding used by itk::Image::TransformPhysicalPointToIndex
+        const long i = static_cast<long>(std::floor(cont_idx[0] + 0.5));
+        const long j = static_cast<long>(std::floor(cont_idx[1] + 0.5));
+        const long k = static_cast<long>(std::floor(cont_idx[2] + 0.5));
+
+        // indices outside of the moving extent cannot be moving labels and
+        // this also guards against reading outside of the buffer
+        if ((i >= mov_min_idx_[0]) && (i <= mov_max_idx_[0]) &&
+            (j >= mov_min_idx_[1]) && (j <= mov_max_idx_[1]) &&
+            (k >= mov_min_idx_[2]) && (k <= mov_max_idx_[2]) &&
+            is_mov_label_[buf[i + (j * row_stride) + (k * slice_stride)]])
+        {
+          return true;
+        }
+      }
+    }
+  }
+
+  return false;
+}
+
 xreg::SampleValidLabelWarpsFn::SampleValidLabelWarpsFn()
 {
   labels = nullptr;
@@ -91,6 +321,8 @@ xreg::SampleValidLabelWarpsFn::SampleValidLabelWarpsFn()
 
   check_for_collision = true;
 
+  num_candidates_per_batch = 64;
+
   std::random_device rand_dev;
   rng_eng.seed(rand_dev());
 
@@ -109,63 +341,83 @@ void xreg::SampleValidLabelWarpsFn::operator()()
 
   num_samples = 0;
 
-  CoordScalar rot_x = 0;
-  CoordScalar rot_y = 0;
-  CoordScalar rot_z = 0;
+  std::unique_ptr<LabelSetCollisionChecker> collision_checker;
+
+  if (check_for_collision)
+  {
+    collision_checker.reset(new LabelSetCollisionChecker(labels, mov_labels, fixed_labels));
+  }
+
+  const size_type batch_size = std::max(size_type(1), num_candidates_per_batch);
 
-  CoordScalar trans_x = 0;
-  CoordScalar trans_y = 0;
-  CoordScalar trans_z = 0;
+  FrameTransformList cand_delta_inter(batch_size);
+  FrameTransformList cand_delta_vol_inv(batch_size);
 
-  for (size_type xform_idx = 0; xform_idx < num_xforms; ++xform_idx)
+  std::vector<CoordScalarList> cand_vals(batch_size, CoordScalarList(6,0));
+
+  std::vector<char> cand_collides(batch_size, 0);
+
+  auto check_cands_fn = [&collision_checker, &cand_delta_vol_inv, &cand_collides] (const RangeType& r)
   {
-    // for debugging/checking progress
-    //if (!(xform_idx % 100))
-    //{
-    //  std::cout << xform_idx << std::endl;
-    //}
+    for (size_type i = r.begin(); i != r.end(); ++i)
+    {
+      cand_collides[i] = collision_checker->collides(cand_delta_vol_inv[i]);
+    }
+  };
 
-    FrameTransform delta_inter;
-    FrameTransform delta_vol;
+  size_type xform_idx = 0;
 
-    do
+  while (xform_idx < num_xforms)
+  {
+    // the parameters are sampled serially so that the RNG produces the same
+    // sequence as when candidates are checked one at a time
+    for (size_type cand_idx = 0; cand_idx < batch_size; ++cand_idx)
     {
-      // sample delta_inter
-      delta_inter.setIdentity();
+      CoordScalarList& vals = cand_vals[cand_idx];
 
-      rot_x = param_sampler->rot_x();
-      rot_y = param_sampler->rot_y();
-      rot_z = param_sampler->rot_z();
+      vals[0] = param_sampler->rot_x();
+      vals[1] = param_sampler->rot_y();
+      vals[2] = param_sampler->rot_z();
 
-      trans_x = param_sampler->trans_x();
-      trans_y = param_sampler->trans_y();
-      trans_z = param_sampler->trans_z();
+      vals[3] = param_sampler->trans_x();
+      vals[4] = param_sampler->trans_y();
+      vals[5] = param_sampler->trans_z();
 
-      delta_inter.matrix() = EulerRotX4x4(rot_x)
-                             * EulerRotY4x4(rot_y)
-                             * EulerRotZ4x4(rot_z);
+      FrameTransform& delta_inter = cand_delta_inter[cand_idx];
 
-      delta_inter.matrix()(0,3) = trans_x;
-      delta_inter.matrix()(1,3) = trans_y;
-      delta_inter.matrix()(2,3) = trans_z;
+      delta_inter.setIdentity();
 
-      delta_vol = inter_to_vol_xform * delta_inter * vol_to_inter;
-    
-      ++num_samples;
+      delta_inter.matrix() = EulerRotX4x4(vals[0])
+                             * EulerRotY4x4(vals[1])
+                             * EulerRotZ4x4(vals[2]);
+
+      delta_inter.matrix()(0,3) = vals[3];
+      delta_inter.matrix()(1,3) = vals[4];
+      delta_inter.matrix()(2,3) = vals[5];
+
+      cand_delta_vol_inv[cand_idx] = (inter_to_vol_xform * delta_inter * vol_to_inter).inverse();
+    }
+
+    if (collision_checker)
+    {
+      ParallelFor(check_cands_fn, RangeType(0, batch_size));
     }
-    while (check_for_collision &&
-           CheckCollisionBetweenLabelSets(labels, mov_labels, fixed_labels,
-                                          delta_vol.inverse()));
 
-    xform_vals[xform_idx][0] = rot_x;
-    xform_vals[xform_idx][1] = rot_y;
-    xform_vals[xform_idx][2] = rot_z;
+    // accept valid candidates in the order they were sampled, candidates
+    // remaining after the final warp is accepted are not counted as samples
+    for (size_type cand_idx = 0; (cand_idx < batch_size) && (xform_idx < num_xforms); ++cand_idx)
+    {
+      ++num_samples;
 
-    xform_vals[xform_idx][3] = trans_x;
-    xform_vals[xform_idx][4] = trans_y;
-    xform_vals[xform_idx][5] = trans_z;
+      if (!collision_checker || !cand_collides[cand_idx])
+      {
+        xform_vals[xform_idx] = cand_vals[cand_idx];
 
-    delta_inter_xforms[xform_idx] = delta_inter;
+        delta_inter_xforms[xform_idx] = cand_delta_inter[cand_idx];
+        
+        ++xform_idx;
+      }
+    }
   }
 }
   
@@ -377,19 +629,11 @@ WarpImageLimitedToLabelHelper(const itk::Image<tLabelType,3>* labels,
   using LabelType = tLabelType;
   using PixelType = tPixelType;
 
-  using LabelImage     = itk::Image<LabelType,3>;
   using IntensityImage = itk::Image<PixelType,3>;
 
   using ContinuousIndexType = itk::ContinuousIndex<double,3>;
 
-  //using Interp = itk::InterpolateImageFunction<IntensityImage>;
-  using NNInterp = itk::NearestNeighborInterpolateImageFunction<LabelImage>;
-
-  //const bool pixel_type_is_lable_type = std::is_same<LabelType,PixelType>::val;
-  //using DefaultInterpToUse = typename std::conditional<pixel_type_is_lable_type,NNInterp,Interp>::type;
-  //const DefaultInterpToUse* interp_fn_to_use = interp_fn ? interp_fn :
-
-  using DstIt = itk::ImageRegionIteratorWithIndex<IntensityImage>;
+  using LinearInterp = itk::LinearInterpolateImageFunction<IntensityImage>;
 
   xregASSERT(ImagesHaveSameCoords(labels, img_to_warp));
 
@@ -397,41 +641,226 @@ WarpImageLimitedToLabelHelper(const itk::Image<tLabelType,3>* labels,
 
   const FrameTransform phys_pt_to_itk_idx = itk_idx_to_phys_pt.inverse();
 
-  // just do a deep copy to get all the metadata correct - TODO: change
-  auto dst_img = ITKImageDeepCopy(img_to_warp);
+  // maps a destination index to the source continuous index
+  const FrameTransform dst_idx_to_src_idx = phys_pt_to_itk_idx * warp_xform_inv * itk_idx_to_phys_pt;
+
+  // voxels outside of the warped label are not sampled, so the destination
+  // starts with every voxel set to the other value
+  auto dst_img = MakeITKVolWithSameCoords(img_to_warp, other_val);
+
+  const auto img_reg = labels->GetLargestPossibleRegion();
+
+  const auto img_start = img_reg.GetIndex();
+  const auto img_size  = img_reg.GetSize();
 
-  auto label_interp = NNInterp::New();
-  label_interp->SetInputImage(labels);
+  const long nx = static_cast<long>(img_size[0]);
+  const long ny = static_cast<long>(img_size[1]);
+  const long nz = static_cast<long>(img_size[2]);
 
-  Pt3 tmp_idx;
+  const LabelType* label_buf = labels->GetBufferPointer();
 
-  ContinuousIndexType tmp_itk_idx;
+  // Find the bounding box of the label to warp; each slice is scanned
+  // independently
+  std::vector<std::array<long,4>> slice_bounds(nz, std::array<long,4>{ nx, -1, ny, -1 });
 
-  DstIt dst_it(dst_img, dst_img->GetLargestPossibleRegion());
-  for (dst_it.GoToBegin(); !dst_it.IsAtEnd(); ++dst_it)
+  ParallelFor([&] (const RangeType& r)
   {
-    const auto& cur_idx = dst_it.GetIndex();
-    tmp_idx[0] = cur_idx[0];
-    tmp_idx[1] = cur_idx[1];
-    tmp_idx[2] = cur_idx[2];
+    for (long z = static_cast<long>(r.begin()); z < static_cast<long>(r.end()); ++z)
+    {
+      auto& b = slice_bounds[z];
+
+      const LabelType* cur_label = label_buf + (z * nx * ny);
+
+      for (long y = 0; y < ny; ++y)
+      {
+        for (long x = 0; x < nx; ++x, ++cur_label)
+        {
+          if (*cur_label == label_to_warp)
+          {
+            b[0] = std::min(b[0], x);
+            b[1] = std::max(b[1], x);
+            b[2] = std::min(b[2], y);
+            b[3] = std::max(b[3], y);
+          }
+        }
+      }
+    }
+  }, RangeType(0, nz));
 
-    tmp_idx = phys_pt_to_itk_idx * warp_xform_inv * itk_idx_to_phys_pt * tmp_idx;
+  std::array<long,6> label_bb = { nx, -1, ny, -1, nz, -1 };
 
-    tmp_itk_idx[0] = tmp_idx[0];
-    tmp_itk_idx[1] = tmp_idx[1];
-    tmp_itk_idx[2] = tmp_idx[2];
+  for (long z = 0; z < nz; ++z)
+  {
+    const auto& b = slice_bounds[z];
 
-    if (label_interp->IsInsideBuffer(tmp_itk_idx) &&
-        (label_interp->EvaluateAtContinuousIndex(tmp_itk_idx) == label_to_warp))
+    if (b[1] >= 0)
     {
-      dst_it.Value() = interp_fn->EvaluateAtContinuousIndex(tmp_itk_idx);
+      label_bb[0] = std::min(label_bb[0], b[0]);
+      label_bb[1] = std::max(label_bb[1], b[1]);
+      label_bb[2] = std::min(label_bb[2], b[2]);
+      label_bb[3] = std::max(label_bb[3], b[3]);
+      label_bb[4] = std::min(label_bb[4], z);
+      label_bb[5] = std::max(label_bb[5], z);
     }
-    else
+  }
+
+  if (label_bb[1] < 0)
+  {
+    // the label is not present, nothing is warped
+    return dst_img;
+  }
+
+  // The label voxels cover continuous indices within half of a voxel of their
+  // centers; map the corners of this box into the destination to find the
+  // destination voxels which may sample the label. An extra voxel is added to
+  // each side to account for round-off.
+  const FrameTransform src_idx_to_dst_idx = dst_idx_to_src_idx.inverse();
+
+  std::array<long,6> dst_bb = { nx, -1, ny, -1, nz, -1 };
+
+  for (int corner_idx = 0; corner_idx < 8; ++corner_idx)
+  {
+    Pt3 corner;
+
+    for (int d = 0; d < 3; ++d)
+    {
+      corner[d] = img_start[d] + ((corner_idx & (1 << d)) ? (label_bb[(2 * d) + 1] + 0.5)
+                                                          : (label_bb[2 * d] - 0.5));
+    }
+
+    const Pt3 dst_corner = src_idx_to_dst_idx * corner;
+
+    for (int d = 0; d < 3; ++d)
+    {
+      const CoordScalar c = dst_corner[d] - img_start[d];
+
+      dst_bb[2 * d]       = std::min(dst_bb[2 * d], static_cast<long>(std::floor(c)) - 1);
+      dst_bb[(2 * d) + 1] = std::max(dst_bb[(2 * d) + 1], static_cast<long>(std::ceil(c)) + 1);
+    }
+  }
+
+  const long img_len[3] = { nx, ny, nz };
+
+  for (int d = 0; d < 3; ++d)
+  {
+    dst_bb[2 * d]       = std::max(dst_bb[2 * d], 0l);
+    dst_bb[(2 * d) + 1] = std::min(dst_bb[(2 * d) + 1], img_len[d] - 1);
+
+    if (dst_bb[2 * d] > dst_bb[(2 * d) + 1])
     {
-      dst_it.Value() = other_val;
+      // the warped label lies outside of the image
+      return dst_img;
     }
   }
 
+  // The linear interpolator is evaluated inline, with the same boundary
+  // handling as itk::LinearInterpolateImageFunction, which avoids a virtual
+  // call per voxel and allows the slices to be processed concurrently. Other
+  // interpolators are not guaranteed to be thread-safe and are evaluated
+  // serially.
+  const LinearInterp* linear_interp = dynamic_cast<const LinearInterp*>(interp_fn);
+
+  const PixelType* interp_buf = linear_interp ? linear_interp->GetInputImage()->GetBufferPointer() : nullptr;
+
+  PixelType* dst_buf = dst_img->GetBufferPointer();
+
+  auto warp_slices = [&] (const RangeType& r)
+  {
+    Pt3 tmp_idx;
+
+    ContinuousIndexType tmp_itk_idx;
+
+    long nn_idx[3];
+
+    for (long z = static_cast<long>(r.begin()); z < static_cast<long>(r.end()); ++z)
+    {
+      for (long y = dst_bb[2]; y <= dst_bb[3]; ++y)
+      {
+        for (long x = dst_bb[0]; x <= dst_bb[1]; ++x)
+        {
+          tmp_idx[0] = img_start[0] + x;
+          tmp_idx[1] = img_start[1] + y;
+          tmp_idx[2] = img_start[2] + z;
+
+          tmp_idx = dst_idx_to_src_idx * tmp_idx;
+
+          // nearest neighbor lookup of the label, using the same bounds and
+          // rounding as itk::NearestNeighborInterpolateImageFunction
+          bool is_label = true;
+
+          for (int d = 0; is_label && (d < 3); ++d)
+          {
+            const double c = tmp_idx[d] - img_start[d];
+
+            is_label = (c >= -0.5) && (c < (img_len[d] - 0.5));
+
+            nn_idx[d] = static_cast<long>(std::floor(c + 0.5));
+          }
+
+          is_label = is_label &&
+                     (label_buf[(((nn_idx[2] * ny) + nn_idx[1]) * nx) + nn_idx[0]] == label_to_warp);
+
+          if (!is_label)
+          {
+            continue;
+          }
+
+          PixelType& dst_val = dst_buf[(((z * ny) + y) * nx) + x];
+
+          if (interp_buf)
+          {
+            long i0[3];
+            long i1[3];
+            double w[3];
+
+            for (int d = 0; d < 3; ++d)
+            {
+              const double c = tmp_idx[d] - img_start[d];
+
+              i0[d] = std::max(0l, static_cast<long>(std::floor(c)));
+              i1[d] = std::min(i0[d] + 1, img_len[d] - 1);
+              w[d]  = std::max(0.0, c - i0[d]);
+            }
+
+            auto v = [&] (const long xx, const long yy, const long zz)
+            {
+              return static_cast<double>(interp_buf[(((zz * ny) + yy) * nx) + xx]);
+            };
+
+            const double v00 = v(i0[0], i0[1], i0[2]) + (w[0] * (v(i1[0], i0[1], i0[2]) - v(i0[0], i0[1], i0[2])));
+            const double v10 = v(i0[0], i1[1], i0[2]) + (w[0] * (v(i1[0], i1[1], i0[2]) - v(i0[0], i1[1], i0[2])));
+            const double v01 = v(i0[0], i0[1], i1[2]) + (w[0] * (v(i1[0], i0[1], i1[2]) - v(i0[0], i0[1], i1[2])));
+            const double v11 = v(i0[0], i1[1], i1[2]) + (w[0] * (v(i1[0], i1[1], i1[2]) - v(i0[0], i1[1], i1[2])));
+
+            const double v0 = v00 + (w[1] * (v10 - v00));
+            const double v1 = v01 + (w[1] * (v11 - v01));
+
+            dst_val = static_cast<PixelType>(v0 + (w[2] * (v1 - v0)));
+          }
+          else
+          {
+            tmp_itk_idx[0] = tmp_idx[0];
+            tmp_itk_idx[1] = tmp_idx[1];
+            tmp_itk_idx[2] = tmp_idx[2];
+
+            dst_val = interp_fn->EvaluateAtContinuousIndex(tmp_itk_idx);
+          }
+        }
+      }
+    }
+  };
+
+  const RangeType slab_range(dst_bb[4], dst_bb[5] + 1);
+
+  if (interp_buf)
+  {
+    ParallelFor(warp_slices, slab_range);
+  }
+  else
+  {
+    warp_slices(slab_range);
+  }
+
   return dst_img;
 }
 
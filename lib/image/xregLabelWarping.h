@@ -25,6 +25,7 @@
 #ifndef XREGLABELWARPING_H_
 #define XREGLABELWARPING_H_
 
+#include <array>
 #include <random>
 
 #include <boost/container/flat_set.hpp>
@@ -41,11 +42,75 @@ namespace xreg
 ///
 /// delta_xform_inv is the inverse warp that would be used to "pull" the moving
 /// labels to their destination locations.
+/// Use LabelSetCollisionChecker when checking many warps of the same labels.
 bool CheckCollisionBetweenLabelSets(const itk::Image<unsigned char,3>* labels,
                                     const boost::container::flat_set<unsigned char>& mov_labels,
                                     const boost::container::flat_set<unsigned char>& fixed_labels,
                                     const FrameTransform& delta_xform_inv);
 
+/// \brief Checks many candidate warps of a set of labels for collisions with
+///        another set of labels.
+///
+/// Returns the same results as CheckCollisionBetweenLabelSets(), but the voxels
+/// of the fixed labels and the index extent of the moving labels are found once
+/// at construction. Fixed voxels are grouped into blocks and each block's
+/// bounding box is warped and tested against the moving extent before any of
+/// its voxels are, so most blocks far from the moving labels are never visited.
+/// collides() does not modify any state and may be called concurrently.
+class LabelSetCollisionChecker
+{
+public:
+  using LabelScalar = unsigned char;
+  using LabelImage  = itk::Image<LabelScalar,3>;
+
+  using LabelSet = boost::container::flat_set<LabelScalar>;
+
+  /// \brief Edge length, in voxels, of the blocks used to group fixed voxels.
+  static const size_type kBLOCK_LEN = 16;
+
+  LabelSetCollisionChecker(const LabelImage* labels,
+                           const LabelSet& mov_labels,
+                           const LabelSet& fixed_labels);
+
+  /// \brief Determine if the inverse warp would pull any moving label into
+  ///        the location of a fixed label.
+  bool collides(const FrameTransform& delta_xform_inv) const;
+
+private:
+  struct FixedBlock
+  {
+    Pt3 bb_min;
+    Pt3 bb_max;
+
+    size_type pts_begin;
+    size_type pts_end;
+  };
+
+  const LabelImage* labels_;
+
+  std::array<bool,256> is_mov_label_;
+
+  bool has_mov_;
+
+  std::array<long,3> mov_min_idx_;
+  std::array<long,3> mov_max_idx_;
+
+  // maps physical points to continuous indices of the buffered region
+  FrameTransform phys_to_buf_inds_;
+
+  std::array<long,3> buf_size_;
+
+  // physical points of the fixed voxels, stored contiguously per block
+  Pt3List fixed_pts_;
+
+  std::vector<FixedBlock> fixed_blocks_;
+
+  // the bounding box of all fixed points, used for an initial rejection test
+  FixedBlock all_fixed_;
+
+  bool block_may_collide(const FixedBlock& b, const FrameTransform& phys_to_mov_inds) const;
+};
+
 /// \brief Sample random rigid transformations that will warp some set of labels,
 ///        but check to make sure the warping will not cause a collision with
 ///        another set of labels.
@@ -67,6 +132,11 @@ struct SampleValidLabelWarpsFn
 
   bool check_for_collision;
 
+  // Number of candidate warps that are sampled and then checked for collisions
+  // concurrently. The accepted warps and num_samples match those obtained when
+  // sampling and checking one candidate at a time, given the same RNG seed.
+  size_type num_candidates_per_batch;
+
   // These are the output poses/warps
   FrameTransformList delta_inter_xforms;
 
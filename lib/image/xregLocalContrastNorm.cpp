@@ -24,9 +24,12 @@
 
 #include "xregLocalContrastNorm.h"
 
+#include <opencv2/imgproc/imgproc.hpp>
+
 #include "xregAssert.h"
 #include "xregOpenCVUtils.h"
 #include "xregNormDist.h"
+#include "xregTBBUtils.h"
 
 namespace
 {
@@ -162,6 +165,43 @@ std::tuple<cv::Mat,cv::Mat> LocalContrastNormJarrettHelper(const cv::Mat& input_
   return std::make_tuple(v_img, sigma_img);
 }
 
+// Sum of the elements in a window using a summed area table computed by
+// cv::integral with double precision sums.
+// The top left corner of the window is (r,c).
+inline double BoxSum(const cv::Mat& integral_img, const int r, const int c,
+                     const int win_len_rows, const int win_len_cols)
+{
+  const double* top_row = &integral_img.at<double>(r,0);
+  const double* bot_row = &integral_img.at<double>(r + win_len_rows,0);
+
+  return bot_row[c + win_len_cols] - bot_row[c] - top_row[c + win_len_cols] + top_row[c];
+}
+
+// Copies a valid region image into the center of an image with the input
+// dimensions and a constant border, when a border value is provided.
+cv::Mat InsertIntoBorderIfNeeded(const cv::Mat& valid_img, const cv::Mat& input_img,
+                                 const boost::optional<float>& border_val)
+{
+  cv::Mat out_img;
+
+  if (border_val)
+  {
+    out_img = cv::Mat(input_img.rows, input_img.cols, valid_img.type());
+
+    out_img.setTo(*border_val);
+
+    valid_img.copyTo(out_img(cv::Rect((input_img.cols - valid_img.cols) / 2,
+                                      (input_img.rows - valid_img.rows) / 2,
+                                      valid_img.cols, valid_img.rows)));
+  }
+  else
+  {
+    out_img = valid_img;
+  }
+
+  return out_img;
+}
+
 }   // un-named
 
 cv::Mat xreg::LocalContrastNormStdNorm(const cv::Mat& input_img, const int win_len_rows,
@@ -269,3 +309,161 @@ cv::Mat xreg::LocalContrastNormJarrett(const cv::Mat& input_img,
   return out_img;
 }
 
+
+cv::Mat xreg::LocalContrastNormStdNormBox(const cv::Mat& input_img, const int win_len_rows,
+                                          const int win_len_cols,
+                                          const boost::optional<float>& border_val)
+{
+  xregASSERT(input_img.channels() == 1);
+
+  xregASSERT((win_len_rows % 2) == 1);
+  xregASSERT((win_len_cols % 2) == 1);
+  xregASSERT(win_len_rows > 0);
+  xregASSERT(win_len_cols > 0);
+  xregASSERT(input_img.rows >= win_len_rows);
+  xregASSERT(input_img.cols >= win_len_cols);
+
+  const int win_half_len_rows = win_len_rows / 2;
+  const int win_half_len_cols = win_len_cols / 2;
+
+  cv::Mat src;
+  if (input_img.type() == CV_32FC1)
+  {
+    src = input_img;
+  }
+  else
+  {
+    input_img.convertTo(src, CV_32F);
+  }
+
+  cv::Mat sum_img;
+  cv::Mat sq_sum_img;
+  cv::integral(src, sum_img, sq_sum_img, CV_64F, CV_64F);
+
+  const int out_nr = src.rows - (win_len_rows - 1);
+  const int out_nc = src.cols - (win_len_cols - 1);
+
+  cv::Mat out(out_nr, out_nc, CV_32FC1);
+
+  const double num_win_pix = static_cast<double>(win_len_rows) * win_len_cols;
+
+  // the sample standard deviation is used, as in MeanStdDev()
+  const double var_denom = (num_win_pix > 1) ? (num_win_pix - 1) : 1;
+
+  auto norm_rows_fn = [&] (const RangeType& rows)
+  {
+    for (int r = static_cast<int>(rows.begin()); r < static_cast<int>(rows.end()); ++r)
+    {
+      const float* src_row = &src.at<float>(r + win_half_len_rows, win_half_len_cols);
+
+      float* out_row = &out.at<float>(r,0);
+
+      for (int c = 0; c < out_nc; ++c)
+      {
+        const double s  = BoxSum(sum_img, r, c, win_len_rows, win_len_cols);
+        const double s2 = BoxSum(sq_sum_img, r, c, win_len_rows, win_len_cols);
+
+        const double mean = s / num_win_pix;
+
+        // clamp small negative values due to round-off
+        const double std_dev = std::sqrt(std::max(0.0, (s2 - (s * mean)) / var_denom));
+
+        out_row[c] = static_cast<float>((src_row[c] - mean) / std::max(1.0e-6, std_dev));
+      }
+    }
+  };
+
+  ParallelFor(norm_rows_fn, RangeType(0, out_nr));
+
+  return InsertIntoBorderIfNeeded(out, src, border_val);
+}
+
+cv::Mat xreg::LocalContrastNormJarrettBox(const cv::Mat& input_img, const int win_len_rows,
+                                          const int win_len_cols,
+                                          const boost::optional<float>& border_val)
+{
+  constexpr float sigma_lower_bound = 1.0e-6f;
+
+  xregASSERT(input_img.channels() == 1);
+
+  xregASSERT((win_len_rows % 2) == 1);
+  xregASSERT((win_len_cols % 2) == 1);
+  xregASSERT(win_len_rows > 0);
+  xregASSERT(win_len_cols > 0);
+  xregASSERT(input_img.rows >= (2 * win_len_rows - 1));
+  xregASSERT(input_img.cols >= (2 * win_len_cols - 1));
+
+  const int win_half_len_rows = win_len_rows / 2;
+  const int win_half_len_cols = win_len_cols / 2;
+
+  const double num_win_pix = static_cast<double>(win_len_rows) * win_len_cols;
+
+  cv::Mat src;
+  if (input_img.type() == CV_32FC1)
+  {
+    src = input_img;
+  }
+  else
+  {
+    input_img.convertTo(src, CV_32F);
+  }
+
+  // subtract the local means
+  cv::Mat sum_img;
+  cv::integral(src, sum_img, CV_64F);
+
+  const int v_img_nr = src.rows - (win_len_rows - 1);
+  const int v_img_nc = src.cols - (win_len_cols - 1);
+
+  cv::Mat v_img(v_img_nr, v_img_nc, CV_32FC1);
+
+  auto subtr_rows_fn = [&] (const RangeType& rows)
+  {
+    for (int r = static_cast<int>(rows.begin()); r < static_cast<int>(rows.end()); ++r)
+    {
+      const float* src_row = &src.at<float>(r + win_half_len_rows, win_half_len_cols);
+
+      float* v_row = &v_img.at<float>(r,0);
+
+      for (int c = 0; c < v_img_nc; ++c)
+      {
+        v_row[c] = static_cast<float>(src_row[c] -
+                      (BoxSum(sum_img, r, c, win_len_rows, win_len_cols) / num_win_pix));
+      }
+    }
+  };
+
+  ParallelFor(subtr_rows_fn, RangeType(0, v_img_nr));
+
+  // divide by the local RMS of the mean subtracted values
+  cv::Mat v_sum_img;
+  cv::Mat v_sq_sum_img;
+  cv::integral(v_img, v_sum_img, v_sq_sum_img, CV_64F, CV_64F);
+
+  const int out_nr = v_img_nr - (win_len_rows - 1);
+  const int out_nc = v_img_nc - (win_len_cols - 1);
+
+  cv::Mat out(out_nr, out_nc, CV_32FC1);
+
+  auto div_rows_fn = [&] (const RangeType& rows)
+  {
+    for (int r = static_cast<int>(rows.begin()); r < static_cast<int>(rows.end()); ++r)
+    {
+      const float* v_row = &v_img.at<float>(r + win_half_len_rows, win_half_len_cols);
+
+      float* out_row = &out.at<float>(r,0);
+
+      for (int c = 0; c < out_nc; ++c)
+      {
+        const float sigma = static_cast<float>(std::sqrt(std::max(0.0,
+                               BoxSum(v_sq_sum_img, r, c, win_len_rows, win_len_cols) / num_win_pix)));
+
+        out_row[c] = v_row[c] / std::max(sigma_lower_bound, sigma);
+      }
+    }
+  };
+
+  ParallelFor(div_rows_fn, RangeType(0, out_nr));
+
+  return InsertIntoBorderIfNeeded(out, src, border_val);
+}
@@ -49,6 +49,23 @@ cv::Mat LocalContrastNormJarrett(const cv::Mat& input_img, const int win_len_row
                                  const boost::optional<float>& border_val =
                                    boost::optional<float>());
 
+// Same as LocalContrastNormStdNorm, except the windowed means and standard
+// deviations are computed using summed area tables, so the cost per pixel is
+// independent of the window size. Output rows are computed in parallel.
+cv::Mat LocalContrastNormStdNormBox(const cv::Mat& input_img, const int win_len_rows,
+                                    const int win_len_cols,
+                                    const boost::optional<float>& border_val =
+                                      boost::optional<float>());
+
+// Variant of LocalContrastNormJarrett which uses uniform (box) weights instead
+// of Gaussian weights, so that the weighted means may be computed using summed
+// area tables. The cost per pixel is independent of the window size and the
+// output dimensions are the same as LocalContrastNormJarrett. Output rows are
+// computed in parallel.
+cv::Mat LocalContrastNormJarrettBox(const cv::Mat& input_img, const int win_len_rows,
+                                    const int win_len_cols,
+                                    const boost::optional<float>& border_val =
+                                      boost::optional<float>());
 
 }  // xreg
 
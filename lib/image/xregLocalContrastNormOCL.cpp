@@ -0,0 +1,348 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregLocalContrastNormOCL.h"
+
+#include <algorithm>
+
+#include <boost/compute/utility/source.hpp>
+
+#include "xregAssert.h"
+#include "xregOpenCLProfiling.h"
+#include "xregOpenCLProgCache.h"
+
+namespace  // un-named
+{
+
+const char* kLCN_OPENCL_SRC = BOOST_COMPUTE_STRINGIZE_SOURCE(
+
+// Each work item computes the sums of the values, and their squares, in
+// windows centered about each pixel of a row. Only windows which fit in the
+// row are computed, the remaining sums are set to zero.
+__kernel void RowBoxSumsKernel(__global const float* src_imgs,
+                               __global float* row_sums,
+                               __global float* row_sq_sums,
+                               const ulong num_lines,
+                               const int num_cols,
+                               const int half_win_cols,
+                               const int first_col,
+                               const int end_col)
+{
+  const ulong line_idx = get_global_id(0);
+
+  if (line_idx < num_lines)
+  {
+    const ulong off = line_idx * num_cols;
+
+    __global const float* src_row = src_imgs + off;
+    __global float* sum_row       = row_sums + off;
+    __global float* sq_sum_row    = row_sq_sums + off;
+
+    for (int c = 0; c < first_col; ++c)
+    {
+      sum_row[c]    = 0;
+      sq_sum_row[c] = 0;
+    }
+
+    for (int c = end_col; c < num_cols; ++c)
+    {
+      sum_row[c]    = 0;
+      sq_sum_row[c] = 0;
+    }
+
+    if (first_col < end_col)
+    {
+      float s  = 0;
+      float s2 = 0;
+
+      for (int c = first_col - half_win_cols; c <= (first_col + half_win_cols); ++c)
+      {
+        const float x = src_row[c];
+        s  += x;
+        s2 += x * x;
+      }
+
+      sum_row[first_col]    = s;
+      sq_sum_row[first_col] = s2;
+
+      for (int c = first_col + 1; c < end_col; ++c)
+      {
+        const float x_add = src_row[c + half_win_cols];
+        const float x_rem = src_row[c - half_win_cols - 1];
+
+        s  += x_add - x_rem;
+        s2 += (x_add * x_add) - (x_rem * x_rem);
+
+        sum_row[c]    = s;
+        sq_sum_row[c] = s2;
+      }
+    }
+  }
+}
+
+// Each work item processes a column of an image, summing the row sums in a
+// window centered about each pixel. Pixels with windows outside of the valid
+// rows and columns are assigned the border value.
+// mode 0: standard deviation normalization
+//   dst = (src - mean) / std_dev
+// mode 1: first stage of the Jarrett method, subtract the mean
+//   dst = src - mean, zero at invalid pixels
+// mode 2: second stage of the Jarrett method, divide by the RMS
+//   dst = src / sqrt(mean of squares)
+__kernel void ColBoxNormKernel(__global const float* src_imgs,
+                               __global const float* row_sums,
+                               __global const float* row_sq_sums,
+                               __global float* dst_imgs,
+                               const ulong num_col_lines,
+                               const int num_rows,
+                               const int num_cols,
+                               const int half_win_rows,
+                               const int first_row,
+                               const int end_row,
+                               const int first_col,
+                               const int end_col,
+                               const float num_win_pix,
+                               const float border_val,
+                               const int mode)
+{
+  const ulong line_idx = get_global_id(0);
+
+  if (line_idx < num_col_lines)
+  {
+    const ulong img_idx = line_idx / num_cols;
+    const int c = (int) (line_idx - (img_idx * num_cols));
+
+    const ulong img_off = img_idx * num_rows * num_cols;
+
+    __global const float* src    = src_imgs + img_off + c;
+    __global const float* sums   = row_sums + img_off + c;
+    __global const float* sq_sums = row_sq_sums + img_off + c;
+    __global float* dst = dst_imgs + img_off + c;
+
+    const float invalid_val = (mode == 1) ? 0 : border_val;
+
+    const bool valid_col = (c >= first_col) && (c < end_col) && (first_row < end_row);
+
+    if (!valid_col)
+    {
+      for (int r = 0; r < num_rows; ++r)
+      {
+        dst[r * num_cols] = invalid_val;
+      }
+    }
+    else
+    {
+      for (int r = 0; r < first_row; ++r)
+      {
+        dst[r * num_cols] = invalid_val;
+      }
+
+      for (int r = end_row; r < num_rows; ++r)
+      {
+        dst[r * num_cols] = invalid_val;
+      }
+
+      float s  = 0;
+      float s2 = 0;
+
+      for (int r = first_row - half_win_rows; r < (first_row + half_win_rows); ++r)
+      {
+        s  += sums[r * num_cols];
+        s2 += sq_sums[r * num_cols];
+      }
+
+      const float var_denom = (num_win_pix > 1) ? (num_win_pix - 1) : 1;
+
+      for (int r = first_row; r < end_row; ++r)
+      {
+        const int r_add = (r + half_win_rows) * num_cols;
+
+        s  += sums[r_add];
+        s2 += sq_sums[r_add];
+
+        const float x = src[r * num_cols];
+
+        float y = 0;
+
+        if (mode == 0)
+        {
+          const float mean = s / num_win_pix;
+
+          const float std_dev = sqrt(fmax(0.0f, (s2 - (s * mean)) / var_denom));
+
+          y = (x - mean) / fmax(1.0e-6f, std_dev);
+        }
+        else if (mode == 1)
+        {
+          y = x - (s / num_win_pix);
+        }
+        else
+        {
+          y = x / fmax(1.0e-6f, sqrt(fmax(0.0f, s2 / num_win_pix)));
+        }
+
+        dst[r * num_cols] = y;
+
+        const int r_rem = (r - half_win_rows) * num_cols;
+
+        s  -= sums[r_rem];
+        s2 -= sq_sums[r_rem];
+      }
+    }
+  }
+}
+
+);
+
+}  // un-named
+
+xreg::LocalContrastNormOCL::LocalContrastNormOCL(const boost::compute::context& ctx,
+                                                 const boost::compute::command_queue& queue)
+  : ctx_(ctx), queue_(queue),
+    row_sums_(ctx), row_sq_sums_(ctx), mean_sub_(ctx)
+{ }
+
+void xreg::LocalContrastNormOCL::allocate_resources(const size_type max_num_imgs,
+                                                    const size_type num_rows,
+                                                    const size_type num_cols)
+{
+  namespace bc = boost::compute;
+
+  xregASSERT((win_len_rows % 2) == 1);
+  xregASSERT((win_len_cols % 2) == 1);
+  xregASSERT(win_len_rows > 0);
+  xregASSERT(win_len_cols > 0);
+
+  max_num_imgs_ = max_num_imgs;
+  num_rows_     = num_rows;
+  num_cols_     = num_cols;
+
+  bc::program prog = BuildOpenCLProg(kLCN_OPENCL_SRC, ctx_);
+
+  row_sums_krnl_ = prog.create_kernel("RowBoxSumsKernel");
+  col_norm_krnl_ = prog.create_kernel("ColBoxNormKernel");
+
+  const size_type buf_len = max_num_imgs * num_rows * num_cols;
+
+  row_sums_.resize(buf_len, queue_);
+  row_sq_sums_.resize(buf_len, queue_);
+
+  if (method == kJARRETT)
+  {
+    mean_sub_.resize(buf_len, queue_);
+  }
+  else
+  {
+    mean_sub_.clear();
+    mean_sub_.shrink_to_fit(queue_);
+  }
+}
+
+void xreg::LocalContrastNormOCL::enqueue_kernel(boost::compute::kernel& k,
+                                                const size_type num_lines)
+{
+  const std::size_t global_size = num_lines;
+
+  RecordOpenCLKernelEvent(k.name(),
+                          queue_.enqueue_nd_range_kernel(k, 1, nullptr, &global_size, nullptr));
+}
+
+void xreg::LocalContrastNormOCL::run_pass(const DevBuf& src, DevBuf* dst,
+                                          const size_type num_imgs,
+                                          const int half_win_rows, const int half_win_cols,
+                                          const int border_rows, const int border_cols,
+                                          const int mode)
+{
+  namespace bc = boost::compute;
+
+  const int nr = static_cast<int>(num_rows_);
+  const int nc = static_cast<int>(num_cols_);
+
+  const int first_col = border_cols;
+  const int end_col   = std::max(first_col, nc - border_cols);
+
+  const int first_row = border_rows;
+  const int end_row   = std::max(first_row, nr - border_rows);
+
+  row_sums_krnl_.set_arg(0, src);
+  row_sums_krnl_.set_arg(1, row_sums_);
+  row_sums_krnl_.set_arg(2, row_sq_sums_);
+  row_sums_krnl_.set_arg(3, bc::ulong_(num_imgs * num_rows_));
+  row_sums_krnl_.set_arg(4, bc::int_(nc));
+  row_sums_krnl_.set_arg(5, bc::int_(half_win_cols));
+  row_sums_krnl_.set_arg(6, bc::int_(first_col));
+  row_sums_krnl_.set_arg(7, bc::int_(end_col));
+
+  enqueue_kernel(row_sums_krnl_, num_imgs * num_rows_);
+
+  col_norm_krnl_.set_arg(0, src);
+  col_norm_krnl_.set_arg(1, row_sums_);
+  col_norm_krnl_.set_arg(2, row_sq_sums_);
+  col_norm_krnl_.set_arg(3, *dst);
+  col_norm_krnl_.set_arg(4, bc::ulong_(num_imgs * num_cols_));
+  col_norm_krnl_.set_arg(5, bc::int_(nr));
+  col_norm_krnl_.set_arg(6, bc::int_(nc));
+  col_norm_krnl_.set_arg(7, bc::int_(half_win_rows));
+  col_norm_krnl_.set_arg(8, bc::int_(first_row));
+  col_norm_krnl_.set_arg(9, bc::int_(end_row));
+  col_norm_krnl_.set_arg(10, bc::int_(first_col));
+  col_norm_krnl_.set_arg(11, bc::int_(end_col));
+  col_norm_krnl_.set_arg(12, bc::float_(static_cast<float>(win_len_rows * win_len_cols)));
+  col_norm_krnl_.set_arg(13, bc::float_(border_val));
+  col_norm_krnl_.set_arg(14, bc::int_(mode));
+
+  enqueue_kernel(col_norm_krnl_, num_imgs * num_cols_);
+}
+
+void xreg::LocalContrastNormOCL::run(const DevBuf& src, DevBuf* dst, const size_type num_imgs)
+{
+  xregASSERT(num_imgs <= max_num_imgs_);
+  xregASSERT(dst && (&src != dst));
+
+  const size_type num_pix = num_imgs * num_rows_ * num_cols_;
+  xregASSERT(src.size() >= num_pix);
+  xregASSERT(dst->size() >= num_pix);
+
+  const int half_win_rows = win_len_rows / 2;
+  const int half_win_cols = win_len_cols / 2;
+
+  if (method == kSTD_NORM)
+  {
+    run_pass(src, dst, num_imgs, half_win_rows, half_win_cols,
+             half_win_rows, half_win_cols, 0);
+  }
+  else
+  {
+    xregASSERT(method == kJARRETT);
+    xregASSERT(mean_sub_.size() >= num_pix);
+
+    run_pass(src, &mean_sub_, num_imgs, half_win_rows, half_win_cols,
+             half_win_rows, half_win_cols, 1);
+
+    // only windows consisting entirely of mean subtracted values are valid in
+    // the second stage
+    run_pass(mean_sub_, dst, num_imgs, half_win_rows, half_win_cols,
+             2 * half_win_rows, 2 * half_win_cols, 2);
+  }
+}
@@ -0,0 +1,113 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGLOCALCONTRASTNORMOCL_H_
+#define XREGLOCALCONTRASTNORMOCL_H_
+
+#include <boost/compute/command_queue.hpp>
+#include <boost/compute/container/vector.hpp>
+#include <boost/compute/context.hpp>
+#include <boost/compute/kernel.hpp>
+
+#include "xregCommon.h"
+
+namespace xreg
+{
+
+/// \brief Local contrast normalization of a batch of images stored in an
+///        OpenCL buffer, e.g. DRRs prior to computing a similarity metric.
+///
+/// This is the OpenCL equivalent of LocalContrastNormStdNormBox() and
+/// LocalContrastNormJarrettBox() with a border value. The window sums are
+/// computed with running sums along each row and then along each column, so
+/// the cost per pixel is independent of the window size.
+/// The images are stored contiguously in row-major order and the output images
+/// have the same dimensions as the inputs. Pixels whose windows do not fit in
+/// the image are set to the border value.
+class LocalContrastNormOCL
+{
+public:
+  using DevBuf = boost::compute::vector<float>;
+
+  enum Method
+  {
+    kSTD_NORM,
+    kJARRETT
+  };
+
+  Method method = kSTD_NORM;
+
+  /// \brief The window dimensions, these must be odd.
+  int win_len_rows = 5;
+  int win_len_cols = 5;
+
+  float border_val = 0;
+
+  LocalContrastNormOCL(const boost::compute::context& ctx,
+                       const boost::compute::command_queue& queue);
+
+  /// \brief Compiles the kernels and allocates temporary buffers for up to
+  ///        max_num_imgs images of the specified dimensions.
+  void allocate_resources(const size_type max_num_imgs, const size_type num_rows,
+                          const size_type num_cols);
+
+  /// \brief Normalizes the first num_imgs images in src and writes the
+  ///        results into dst.
+  ///
+  /// dst must have at least as many elements as the images in src being
+  /// processed and may not be the same buffer as src. The kernels are enqueued
+  /// and this does not wait for them to finish.
+  void run(const DevBuf& src, DevBuf* dst, const size_type num_imgs);
+
+private:
+  void enqueue_kernel(boost::compute::kernel& k, const size_type num_lines);
+
+  // Computes the window sums of src, excluding border_rows and border_cols
+  // from each side of the images, and applies one of the normalization modes
+  // of the column kernel.
+  void run_pass(const DevBuf& src, DevBuf* dst, const size_type num_imgs,
+                const int half_win_rows, const int half_win_cols,
+                const int border_rows, const int border_cols, const int mode);
+
+  boost::compute::context ctx_;
+  boost::compute::command_queue queue_;
+
+  size_type max_num_imgs_ = 0;
+  size_type num_rows_ = 0;
+  size_type num_cols_ = 0;
+
+  // running row sums of the values and their squares
+  DevBuf row_sums_;
+  DevBuf row_sq_sums_;
+
+  // mean subtracted values used by the Jarrett method
+  DevBuf mean_sub_;
+
+  boost::compute::kernel row_sums_krnl_;
+  boost::compute::kernel col_norm_krnl_;
+};
+
+}  // xreg
+
+#endif
@@ -25,6 +25,7 @@
 #include "xregProjData.h"
 
 #include "xregAssert.h"
+#include "xregITKBasicImageUtils.h"
 #include "xregITKResampleUtils.h"
 #include "xregITKCropPadUtils.h"
 #include "xregITKOpenCVUtils.h"
@@ -44,14 +45,22 @@ DownsampleProjDataHelper(const ProjData<tPixelScalar>& src_proj, const CoordScal
  
   dst_proj.cam = DownsampleCameraModel(src_proj.cam, ds_factor, force_even_dims); 
 
-  if (src_proj.img)
+  // No resampling is performed at full resolution, so the source pixels may
+  // be shared when no cropping to even dimensions is needed either
+  const bool no_resample = std::abs(ds_factor - 1) < 1.0e-6;
+  
+  if (src_proj.img && no_resample && (!force_even_dims ||
+        (!(src_proj.cam.num_det_cols % 2) && !(src_proj.cam.num_det_rows % 2))))
+  {
+    dst_proj.img = src_proj.img;
+  }
+  else if (src_proj.img)
   {
     dst_proj.img = DownsampleImage(src_proj.img.GetPointer(), ds_factor);
     
     if (force_even_dims)
     {
-      using ProjImg   = typename ProjData<tPixelScalar>::Proj;
-      using ROIFilter = itk::RegionOfInterestImageFilter<ProjImg,ProjImg>;
+      using ProjImg = typename ProjData<tPixelScalar>::Proj;
 
       auto ds_sz = dst_proj.img->GetLargestPossibleRegion().GetSize();
       
@@ -75,12 +84,10 @@ DownsampleProjDataHelper(const ProjData<tPixelScalar>& src_proj, const CoordScal
         roi.SetIndex(0,0);
         roi.SetIndex(1,0);
 
-        auto roi_filter = ROIFilter::New();
-        roi_filter->SetInput(dst_proj.img);
-        roi_filter->SetRegionOfInterest(roi);
-        roi_filter->Update();
-        
-        dst_proj.img = roi_filter->GetOutput();
+        // the downsampled image is not referenced elsewhere, so it may share
+        // pixels with the cropped image; no copy is made when only the last
+        // row is removed
+        dst_proj.img = ITKImageFromRegionView(MakeITKImageRegionView(dst_proj.img.GetPointer(), roi));
       }
     }
 
@@ -116,6 +123,31 @@ DownsampleProjDataHelper(const std::vector<ProjData<tPixelScalar>>& src_projs, c
   return dst_projs;
 }
 
+template <class tPixelScalar>
+void DownsampleProjDataInPlaceHelper(std::vector<ProjData<tPixelScalar>>* projs,
+                                     const CoordScalar ds_factor, const bool force_even_dims)
+{
+  for (auto& pd : *projs)
+  {
+    // the full resolution image is released by this assignment, before the
+    // next projection is resampled
+    pd = DownsampleProjDataHelper(pd, ds_factor, force_even_dims);
+  }
+}
+
+template <class tPixelScalar>
+typename ProjData<tPixelScalar>::Proj*
+MakeImgUniqueHelper(ProjData<tPixelScalar>* pd)
+{
+  // the smart pointer held by pd accounts for one reference
+  if (pd->img && (pd->img->GetReferenceCount() > 1))
+  {
+    pd->img = ITKImageDeepCopy(pd->img.GetPointer());
+  }
+
+  return pd->img.GetPointer();
+}
+
 template <class tPixelScalar>
 std::vector<CameraModel>
 ExtractCamModelsHelper(const std::vector<CamImgPair<tPixelScalar>>& cam_img_pairs)
@@ -354,6 +386,39 @@ xreg::DownsampleProjData(const ProjDataU8List& src_projs, const CoordScalar ds_f
   return DownsampleProjDataHelper(src_projs, ds_factor, force_even_dims);
 }
 
+void xreg::DownsampleProjDataInPlace(ProjDataF32List* projs, const CoordScalar ds_factor,
+                                     const bool force_even_dims)
+{
+  DownsampleProjDataInPlaceHelper(projs, ds_factor, force_even_dims);
+}
+
+void xreg::DownsampleProjDataInPlace(ProjDataU16List* projs, const CoordScalar ds_factor,
+                                     const bool force_even_dims)
+{
+  DownsampleProjDataInPlaceHelper(projs, ds_factor, force_even_dims);
+}
+
+void xreg::DownsampleProjDataInPlace(ProjDataU8List* projs, const CoordScalar ds_factor,
+                                     const bool force_even_dims)
+{
+  DownsampleProjDataInPlaceHelper(projs, ds_factor, force_even_dims);
+}
+
+xreg::ProjDataF32::Proj* xreg::MakeImgUnique(ProjDataF32* pd)
+{
+  return MakeImgUniqueHelper(pd);
+}
+
+xreg::ProjDataU16::Proj* xreg::MakeImgUnique(ProjDataU16* pd)
+{
+  return MakeImgUniqueHelper(pd);
+}
+
+xreg::ProjDataU8::Proj* xreg::MakeImgUnique(ProjDataU8* pd)
+{
+  return MakeImgUniqueHelper(pd);
+}
+
 std::vector<xreg::CameraModel>
 xreg::ExtractCamModels(const CamImgPairF32List& cam_img_pairs)
 {
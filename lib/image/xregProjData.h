@@ -103,6 +103,40 @@ ProjDataU16List DownsampleProjData(const ProjDataU16List& src_projs, const Coord
 ProjDataU8List DownsampleProjData(const ProjDataU8List& src_projs, const CoordScalar ds_factor,
                                   const bool force_even_dims = false);
 
+/// \brief Downsamples a list of projections, replacing each entry as it is processed.
+///
+/// Only one source image is released at a time, so when the list holds the
+/// last reference to its images the peak memory is roughly a single
+/// full-resolution projection beyond the downsampled list, instead of two
+/// complete copies of the sequence.
+void DownsampleProjDataInPlace(ProjDataF32List* projs, const CoordScalar ds_factor,
+                               const bool force_even_dims = false);
+
+/// \brief Downsamples a list of projections, replacing each entry as it is processed.
+void DownsampleProjDataInPlace(ProjDataU16List* projs, const CoordScalar ds_factor,
+                               const bool force_even_dims = false);
+
+/// \brief Downsamples a list of projections, replacing each entry as it is processed.
+void DownsampleProjDataInPlace(ProjDataU8List* projs, const CoordScalar ds_factor,
+                               const bool force_even_dims = false);
+
+/// \brief Ensures that a projection's image buffer is not shared with any other
+///        object before it is modified (copy-on-write).
+///
+/// Copies of ProjData objects, and the helpers converting to/from camera/image
+/// pairs, share the same reference-counted ITK image. This deep copies the
+/// image only when another reference to it exists and returns the image that
+/// may be safely written to.
+ProjDataF32::Proj* MakeImgUnique(ProjDataF32* pd);
+
+/// \brief Ensures that a projection's image buffer is not shared with any other
+///        object before it is modified (copy-on-write).
+ProjDataU16::Proj* MakeImgUnique(ProjDataU16* pd);
+
+/// \brief Ensures that a projection's image buffer is not shared with any other
+///        object before it is modified (copy-on-write).
+ProjDataU8::Proj* MakeImgUnique(ProjDataU8* pd);
+
 template <class tPixelScalar>
 using CamImgPair = std::tuple<CameraModel,typename itk::Image<tPixelScalar,2>::Pointer>;
 
@@ -131,28 +165,43 @@ ExtractCamModels(const CamImgPairU8List& cam_img_pairs);
 
 /// \brief Extracts a list of projection images from a list of camera
 ///        model/projection image pairs.
+///
+/// The returned images share pixel buffers with the inputs.
 std::vector<itk::Image<float,2>::Pointer>
 ExtractImgs(const CamImgPairF32List& cam_img_pairs);
 
 /// \brief Extracts a list of projection images from a list of camera
 ///        model/projection image pairs.
+///
+/// The returned images share pixel buffers with the inputs.
 std::vector<itk::Image<unsigned short,2>::Pointer>
 ExtractImgs(const CamImgPairU16List& cam_img_pairs);
 
 /// \brief Extracts a list of projection images from a list of camera
 ///        model/projection image pairs.
+///
+/// The returned images share pixel buffers with the inputs.
 std::vector<itk::Image<unsigned char,2>::Pointer>
 ExtractImgs(const CamImgPairU8List& cam_img_pairs);
 
 /// \brief Extract/copy a list of camera model/image pairs from a list of projection metadatas and images.
+///
+/// Camera models are copied, images are shared with the inputs.
 CamImgPairF32List ExtractCamImagePairs(const ProjDataF32List& proj_data);
 
 /// \brief Extract/copy a list of camera model/image pairs from a list of projection metadatas and images.
+///
+/// Camera models are copied, images are shared with the inputs.
 CamImgPairU16List ExtractCamImagePairs(const ProjDataU16List& proj_data);
 
 /// \brief Extract/copy a list of camera model/image pairs from a list of projection metadatas and images.
+///
+/// Camera models are copied, images are shared with the inputs.
 CamImgPairU8List ExtractCamImagePairs(const ProjDataU8List& proj_data);
 
+/// \brief Creates a list of projection data objects from camera model/image pairs.
+///
+/// Camera models are copied, images are shared with the inputs.
 ProjDataF32List CamImgPairsToProjData(const CamImgPairF32List& pairs);
 
 ProjDataU16List CamImgPairsToProjData(const CamImgPairU16List& pairs);
@@ -222,6 +271,10 @@ MakeImageU16FromCam(const CameraModel& cam);
 itk::Image<unsigned char,2>::Pointer
 MakeImageU8FromCam(const CameraModel& cam);
 
+/// \brief Rotates an image so that the patient is "up," in place.
+///
+/// The pixel buffer is modified directly; call MakeImgUnique() first when the
+/// image may be shared with other projection objects that should remain unchanged.
 void ModifyForPatUp(ProjDataF32::Proj* img, const ProjDataRotToPatUp rot_to_pat_up);
 
 void ModifyForPatUp(ProjDataU16::Proj* img, const ProjDataRotToPatUp rot_to_pat_up);
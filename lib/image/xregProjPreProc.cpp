@@ -21,123 +21,340 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
  * SOFTWARE.
  */
-
 #include "xregProjPreProc.h"
 
+#include <algorithm>
+#include <limits>
+
+#include <itkDiscreteGaussianImageFilter.h>
+
 #include "xregITKBasicImageUtils.h"
-#include "xregImageIntensLogTrans.h"
 #include "xregSegMetalInXRay.h"
+#include "xregTBBUtils.h"
 
-void xreg::ProjPreProc::operator()()
+namespace  // un-named
 {
-  const size_type num_projs = input_projs.size();
 
-  output_projs.clear();
-  output_mask_projs.clear();
+using namespace xreg;
 
-  output_projs.reserve(num_projs);
+using Proj = ProjDataF32::Proj;
 
-  if (params.auto_mask)
-  {
-    output_mask_projs.reserve(num_projs);
-  }
+// Same threshold used by ImageIntensLogTransFilter for identifying zero pixels
+constexpr float kLOG_REMAP_EPS = 1.0e-6f;
 
-  for (size_type proj_idx = 0; proj_idx < num_projs; ++proj_idx)
-  {
-    this->dout() << "proj: " << proj_idx << std::endl;
-    
-    const auto& input_proj_data = input_projs[proj_idx];
+// Copies the cropped pixels into the destination buffer, one block of rows at
+// a time, and tracks the minimum positive intensity of the copied pixels.
+struct CropCopyMinPosFn
+{
+  const float* src_buf;
+  size_type src_num_cols;
+
+  float* dst_buf;
+  size_type dst_num_cols;
 
-    auto output_proj = input_proj_data;
+  size_type crop_width;
 
-    auto& cam   = output_proj.cam; 
-    auto& img   = output_proj.img;
-    auto& lands = output_proj.landmarks;
+  bool find_min_pos;
+
+  float operator()(const RangeType& r, const float init_min_pos) const
+  {
+    float min_pos = init_min_pos;
 
-    if (img)
+    for (size_type dst_row = r.begin(); dst_row < r.end(); ++dst_row)
     {
-      this->dout() << "copying 2D intensity pixels..." << std::endl;
-      img = ITKImageDeepCopy(img.GetPointer());
+      const float* src_row_buf = src_buf + ((dst_row + crop_width) * src_num_cols) + crop_width;
+
+      float* dst_row_buf = dst_buf + (dst_row * dst_num_cols);
+
+      std::copy(src_row_buf, src_row_buf + dst_num_cols, dst_row_buf);
+
+      if (find_min_pos)
+      {
+        for (size_type c = 0; c < dst_num_cols; ++c)
+        {
+          const float x = dst_row_buf[c];
+
+          if ((x > kLOG_REMAP_EPS) && (x < min_pos))
+          {
+            min_pos = x;
+          }
+        }
+      }
     }
 
-    if (params.crop_width > 0)
+    return min_pos;
+  }
+};
+
+// Applies the -log remapping in place to tiles of the image
+struct LogRemapTileFn
+{
+  float* buf;
+  size_type num_cols;
+
+  float I0;
+  float zero_val;
+
+  void operator()(const Range2DType& r) const
+  {
+    const float log_I0 = std::log(I0);
+
+    for (size_type row = r.rows().begin(); row < r.rows().end(); ++row)
     {
-      this->dout() << "cropping intensity image and camera model..." << std::endl;
-      std::tie(cam, img) = CropBoundaryPixels(cam, img.GetPointer(), params.crop_width);
+      float* row_buf = buf + (row * num_cols);
 
-      this->dout() << "updating landmarks for cropping..." << std::endl;
-      for (auto& l : lands)
+      for (size_type c = r.cols().begin(); c < r.cols().end(); ++c)
       {
-        l.second[0] -= params.crop_width;
-        l.second[1] -= params.crop_width;
+        const float x = row_buf[c];
+
+        row_buf[c] = (x > kLOG_REMAP_EPS) ? (log_I0 - std::log(x)) : zero_val;
       }
     }
+  }
+};
+
+// Copies the non-boundary region of src into a new image and, when requested,
+// remaps the intensities using -log(I / I0), where I0 is the maximum of the
+// smoothed image. This matches the output of CropBoundaryPixels() followed by
+// ImageIntensLogTransFilter (with the maximum intensity used as I0), but
+// requires only two passes over the output pixels.
+Proj::Pointer CropAndLogRemap(const Proj* src, const size_type crop_width, const bool log_remap)
+{
+  const auto src_size = src->GetLargestPossibleRegion().GetSize();
+
+  const size_type src_num_cols = src_size[0];
+  const size_type src_num_rows = src_size[1];
+
+  xregASSERT((2 * crop_width) < std::min(src_num_cols, src_num_rows));
+
+  const size_type dst_num_cols = src_num_cols - (2 * crop_width);
+  const size_type dst_num_rows = src_num_rows - (2 * crop_width);
+
+  Proj::IndexType crop_start;
+  crop_start[0] = crop_width;
+  crop_start[1] = crop_width;
+
+  Proj::PointType dst_origin;
+  src->TransformIndexToPhysicalPoint(crop_start, dst_origin);
 
-    if (img && !params.no_log_remap)
+  Proj::SizeType dst_size;
+  dst_size[0] = dst_num_cols;
+  dst_size[1] = dst_num_rows;
+
+  auto dst = Proj::New();
+  dst->SetRegions(dst_size);
+  dst->SetOrigin(dst_origin);
+  dst->SetSpacing(src->GetSpacing());
+  dst->SetDirection(src->GetDirection());
+  dst->Allocate();
+
+  float* dst_buf = dst->GetBufferPointer();
+
+  CropCopyMinPosFn copy_fn = { src->GetBufferPointer(), src_num_cols,
+                               dst_buf, dst_num_cols,
+                               crop_width, log_remap };
+
+  auto min_fn = [] (const float a, const float b) { return std::min(a,b); };
+
+  float min_pos = ParallelReduce(std::numeric_limits<float>::max(), copy_fn,
+                                 min_fn, RangeType(0, dst_num_rows));
+
+  if (log_remap)
+  {
+    // no positive intensities, use the same value as the log filter
+    if (min_pos == std::numeric_limits<float>::max())
     {
-      this->dout() << "log remapping..." << std::endl;
-      
-      auto log_xform = ImageIntensLogTransFilter::New();
-      log_xform->SetInput(img);
-      log_xform->SetUseMaxIntensityAsI0(true);
-      log_xform->Update();
-      
-      img = log_xform->GetOutput();
+      min_pos = 0;
     }
 
-    output_projs.push_back(output_proj);
+    float I0 = 1;
+    {
+      auto smoother = itk::DiscreteGaussianImageFilter<Proj,Proj>::New();
+      smoother->SetInput(dst);
+      smoother->SetUseImageSpacing(false);
+      smoother->SetVariance(2);
+      smoother->Update();
+
+      const auto* smooth_buf = smoother->GetOutput()->GetBufferPointer();
+      I0 = *std::max_element(smooth_buf, smooth_buf + (dst_num_cols * dst_num_rows));
+    }
+
+    LogRemapTileFn log_fn = { dst_buf, dst_num_cols, I0, -std::log(min_pos / I0) };
+
+    ParallelFor(log_fn, Range2DType(0, dst_num_rows, 0, dst_num_cols));
+  }
+
+  return dst;
+}
+
+struct PreProcProjFn
+{
+  const ProjPreProc* pre_proc;
+
+  ProjDataF32List* output_projs;
+
+  ProjDataU8List* output_mask_projs;
+
+  // set to one when a mask was computed for a projection
+  std::vector<char>* mask_computed;
+
+  std::vector<ProjDataF32List>* output_pyramid_projs;
+
+  // debug output is only passed to the metal segmentation when a single
+  // projection is processed, otherwise the output would be interleaved
+  bool pass_debug_output;
+
+  void operator()(const RangeType& r) const
+  {
+    const auto& params = pre_proc->params;
 
-    if (img && params.auto_mask)
+    for (size_type proj_idx = r.begin(); proj_idx < r.end(); ++proj_idx)
     {
-      this->dout() << "auto masking metal (naively!)..." << std::endl;
-
-      SegmentMetalInXRay metal_seg;
-      metal_seg.set_debug_output_stream(*this);
-      
-      metal_seg.binarize = true;
-      metal_seg.dilation_radius = 3;
-      metal_seg.src_img = img;
-      
-      metal_seg.thresh = params.auto_mask_thresh;
-      metal_seg.level  = params.auto_mask_level;
-
-      if (!params.allow_iterative_thresh)
+      auto& output_proj = (*output_projs)[proj_idx];
+      output_proj = pre_proc->input_projs[proj_idx];
+
+      auto& cam   = output_proj.cam;
+      auto& img   = output_proj.img;
+      auto& lands = output_proj.landmarks;
+
+      const size_type crop_width = (params.crop_width > 0) ? params.crop_width : 0;
+
+      if (crop_width)
       {
-        metal_seg.num_pix_in_mask_upper_thresh = -1;
-        metal_seg.num_pix_in_mask_lower_thresh = -1;
-      }
+        cam = std::get<0>(CropBoundaryPixels(cam, static_cast<const Proj*>(nullptr), crop_width));
 
-      metal_seg();
+        for (auto& l : lands)
+        {
+          l.second[0] -= crop_width;
+          l.second[1] -= crop_width;
+        }
+      }
 
-      std::decay<decltype(output_mask_projs[0])>::type output_mask_proj;
+      if (img)
+      {
+        const auto img_size = img->GetLargestPossibleRegion().GetSize();
+        xregASSERT((img_size[0] == cam.num_det_cols + (2 * crop_width)) &&
+                   (img_size[1] == cam.num_det_rows + (2 * crop_width)));
 
-      // the segmentation is in signed short, cast to the type we need here (should be unsigned char)
-      output_mask_proj.img = CastITKImageIfNeeded<unsigned char>(metal_seg.seg_img.GetPointer());
+        // this also copies the pixels when no cropping is performed
+        img = CropAndLogRemap(img.GetPointer(), crop_width, !params.no_log_remap);
+      }
 
-      if (params.invert_mask)
+      if (img && params.auto_mask)
       {
-        auto& mask = output_mask_proj.img;
+        SegmentMetalInXRay metal_seg;
+
+        if (pass_debug_output)
+        {
+          metal_seg.set_debug_output_stream(*pre_proc);
+        }
+
+        metal_seg.binarize = true;
+        metal_seg.dilation_radius = 3;
+        metal_seg.src_img = img;
+
+        metal_seg.thresh = params.auto_mask_thresh;
+        metal_seg.level  = params.auto_mask_level;
+
+        if (!params.allow_iterative_thresh)
+        {
+          metal_seg.num_pix_in_mask_upper_thresh = -1;
+          metal_seg.num_pix_in_mask_lower_thresh = -1;
+        }
 
-        const auto img_size = mask->GetLargestPossibleRegion().GetSize();
-        
-        const unsigned long tot_num_pix = static_cast<unsigned long>(img_size[0]) *
-                                          static_cast<unsigned long>(img_size[1]);
+        metal_seg();
 
-        unsigned char* mask_buf = mask->GetBufferPointer();
+        auto& output_mask_proj = (*output_mask_projs)[proj_idx];
 
-        for (unsigned long i = 0; i < tot_num_pix; ++i)
+        // the segmentation is in signed short, cast to the type we need here (should be unsigned char)
+        output_mask_proj.img = CastITKImageIfNeeded<unsigned char>(metal_seg.seg_img.GetPointer());
+
+        if (params.invert_mask)
         {
-          mask_buf[i] = !mask_buf[i];
+          auto& mask = output_mask_proj.img;
+
+          const auto mask_size = mask->GetLargestPossibleRegion().GetSize();
+
+          unsigned char* mask_buf = mask->GetBufferPointer();
+
+          const size_type tot_num_pix = static_cast<size_type>(mask_size[0]) *
+                                        static_cast<size_type>(mask_size[1]);
+
+          for (size_type i = 0; i < tot_num_pix; ++i)
+          {
+            mask_buf[i] = !mask_buf[i];
+          }
         }
+
+        output_mask_proj.cam = cam;
+        output_mask_proj.landmarks = lands;
+
+        (*mask_computed)[proj_idx] = 1;
       }
 
-      output_mask_proj.cam = cam;
-      output_mask_proj.landmarks = lands;
-      
-      output_mask_projs.push_back(output_mask_proj);
+      const size_type num_levels = pre_proc->pyramid_ds_factors.size();
+
+      for (size_type lvl = 0; lvl < num_levels; ++lvl)
+      {
+        (*output_pyramid_projs)[lvl][proj_idx] =
+                    DownsampleProjData(output_proj, pre_proc->pyramid_ds_factors[lvl]);
+      }
+    }
+  }
+};
+
+}  // un-named
+
+void xreg::ProjPreProc::operator()()
+{
+  const size_type num_projs = input_projs.size();
+
+  output_projs.clear();
+  output_mask_projs.clear();
+  output_pyramid_projs.clear();
+
+  if (params.crop_width > 0)
+  {
+    this->dout() << "cropping " << params.crop_width << " boundary pixels..." << std::endl;
+  }
+
+  if (!params.no_log_remap)
+  {
+    this->dout() << "log remapping..." << std::endl;
+  }
+
+  if (params.auto_mask)
+  {
+    this->dout() << "auto masking metal (naively!)..." << std::endl;
+  }
+
+  this->dout() << "pre-processing " << num_projs << " projections..." << std::endl;
+
+  std::vector<char> mask_computed(num_projs, 0);
+
+  ProjDataU8List all_mask_projs(params.auto_mask ? num_projs : 0);
+
+  output_projs.resize(num_projs);
+  output_pyramid_projs.assign(pyramid_ds_factors.size(), ProjDataF32List(num_projs));
+
+  PreProcProjFn proc_fn = { this, &output_projs, &all_mask_projs, &mask_computed,
+                            &output_pyramid_projs, num_projs == 1 };
+
+  ParallelFor(proc_fn, RangeType(0, num_projs));
+
+  if (params.auto_mask)
+  {
+    // masks are only stored for projections with pixel data
+    output_mask_projs.reserve(num_projs);
+
+    for (size_type proj_idx = 0; proj_idx < num_projs; ++proj_idx)
+    {
+      if (mask_computed[proj_idx])
+      {
+        output_mask_projs.push_back(all_mask_projs[proj_idx]);
+      }
     }
   }
 
   this->dout() << "pre-processing complete..." << std::endl;
 }
-
@@ -47,16 +47,34 @@ struct ProjPreProcParams
   bool no_log_remap = false;
 };
 
+/// \brief Preprocesses a collection of fluoroscopy projections prior to
+///        2D/3D registration.
+///
+/// Each projection is cropped, log remapped and optionally auto-masked. The
+/// cropping and log remapping are fused into two tiled passes over the pixels
+/// (the first copies the cropped pixels and finds the minimum positive
+/// intensity, the second applies the log transform in place). Projections are
+/// processed concurrently, with the tiles of each image also processed in
+/// parallel.
 struct ProjPreProc : ObjWithOStream
 {
   ProjPreProcParams params;
 
   ProjDataF32List input_projs;
 
+  /// \brief Optional downsampling factors of pyramid levels to also compute
+  ///        from each preprocessed projection.
+  ///
+  /// When non-empty, output_pyramid_projs[l][i] is the preprocessed projection
+  /// i downsampled by pyramid_ds_factors[l].
+  std::vector<CoordScalar> pyramid_ds_factors;
+
   ProjDataF32List output_projs;
 
   ProjDataU8List output_mask_projs;
 
+  std::vector<ProjDataF32List> output_pyramid_projs;
+
   void operator()();
 };
 
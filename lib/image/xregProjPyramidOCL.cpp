@@ -0,0 +1,448 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "xregProjPyramidOCL.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <boost/compute/algorithm/copy.hpp>
+#include <boost/compute/utility/source.hpp>
+
+#include "xregAssert.h"
+#include "xregOpenCLProfiling.h"
+#include "xregOpenCLProgCache.h"
+
+namespace  // un-named
+{
+
+const char* kPROJ_PYRAMID_OPENCL_SRC = BOOST_COMPUTE_STRINGIZE_SOURCE(
+
+// Each work item computes a single pixel of a batch of images smoothed along
+// the rows with a truncated Gaussian kernel. Samples outside of the image are
+// replaced with the nearest pixel in the row.
+__kernel void RowSmoothKernel(__global const float* src_imgs,
+                              __global float* dst_imgs,
+                              const ulong num_pix,
+                              const int num_cols,
+                              const int rad,
+                              const float sigma)
+{
+  const ulong idx = get_global_id(0);
+
+  if (idx < num_pix)
+  {
+    const ulong line_idx = idx / num_cols;
+    const int c = (int) (idx - (line_idx * num_cols));
+
+    __global const float* src_row = src_imgs + (line_idx * num_cols);
+
+    const float inv_two_var = 1.0f / (2.0f * sigma * sigma);
+
+    float s  = 0;
+    float ws = 0;
+
+    for (int k = -rad; k <= rad; ++k)
+    {
+      const float w = exp(-(k * k) * inv_two_var);
+
+      s  += w * src_row[clamp(c + k, 0, num_cols - 1)];
+      ws += w;
+    }
+
+    dst_imgs[idx] = s / ws;
+  }
+}
+
+// Each work item computes a single pixel of a batch of images smoothed along
+// the columns with a truncated Gaussian kernel. Samples outside of the image
+// are replaced with the nearest pixel in the column.
+__kernel void ColSmoothKernel(__global const float* src_imgs,
+                              __global float* dst_imgs,
+                              const ulong num_pix,
+                              const int num_rows,
+                              const int num_cols,
+                              const int rad,
+                              const float sigma)
+{
+  const ulong idx = get_global_id(0);
+
+  if (idx < num_pix)
+  {
+    const ulong num_pix_per_img = ((ulong) num_rows) * num_cols;
+
+    const ulong img_idx = idx / num_pix_per_img;
+    const int pix_idx = (int) (idx - (img_idx * num_pix_per_img));
+
+    const int r = pix_idx / num_cols;
+    const int c = pix_idx - (r * num_cols);
+
+    __global const float* src_col = src_imgs + (img_idx * num_pix_per_img) + c;
+
+    const float inv_two_var = 1.0f / (2.0f * sigma * sigma);
+
+    float s  = 0;
+    float ws = 0;
+
+    for (int k = -rad; k <= rad; ++k)
+    {
+      const float w = exp(-(k * k) * inv_two_var);
+
+      s  += w * src_col[clamp(r + k, 0, num_rows - 1) * num_cols];
+      ws += w;
+    }
+
+    dst_imgs[idx] = s / ws;
+  }
+}
+
+// Each work item computes a single pixel of a batch of downsampled images
+// using linear interpolation. The downsampled image shares the origin of the
+// source image, so pixel (r,c) is located at continuous index
+// (r,c) / ds_factor of the source. Locations more than half of a pixel
+// outside of the source image are assigned zero, matching the ITK resampling
+// used by the host implementation.
+__kernel void ResampleKernel(__global const float* src_imgs,
+                             __global float* dst_imgs,
+                             const ulong num_dst_pix,
+                             const int src_num_rows,
+                             const int src_num_cols,
+                             const int dst_num_rows,
+                             const int dst_num_cols,
+                             const float inv_ds_factor)
+{
+  const ulong idx = get_global_id(0);
+
+  if (idx < num_dst_pix)
+  {
+    const ulong num_dst_pix_per_img = ((ulong) dst_num_rows) * dst_num_cols;
+
+    const ulong img_idx = idx / num_dst_pix_per_img;
+    const int pix_idx = (int) (idx - (img_idx * num_dst_pix_per_img));
+
+    const int r = pix_idx / dst_num_cols;
+    const int c = pix_idx - (r * dst_num_cols);
+
+    const float y = r * inv_ds_factor;
+    const float x = c * inv_ds_factor;
+
+    float val = 0;
+
+    if ((x < (src_num_cols - 0.5f)) && (y < (src_num_rows - 0.5f)))
+    {
+      __global const float* src = src_imgs + (img_idx * src_num_rows * src_num_cols);
+
+      const int x0 = min((int) x, src_num_cols - 1);
+      const int y0 = min((int) y, src_num_rows - 1);
+      const int x1 = min(x0 + 1, src_num_cols - 1);
+      const int y1 = min(y0 + 1, src_num_rows - 1);
+
+      const float fx = x - x0;
+      const float fy = y - y0;
+
+      const float v0 = mix(src[(y0 * src_num_cols) + x0], src[(y0 * src_num_cols) + x1], fx);
+      const float v1 = mix(src[(y1 * src_num_cols) + x0], src[(y1 * src_num_cols) + x1], fx);
+
+      val = mix(v0, v1, fy);
+    }
+
+    dst_imgs[idx] = val;
+  }
+}
+
+);
+
+// Matches the maximum kernel width used by itk::DiscreteGaussianImageFilter
+constexpr int kMAX_SMOOTH_RAD = 16;
+
+}  // un-named
+
+xreg::ProjPyramidOCL::ProjPyramidOCL(const boost::compute::context& ctx,
+                                     const boost::compute::command_queue& queue)
+  : ctx_(ctx), queue_(queue),
+    src_buf_(ctx), row_smooth_buf_(ctx), smooth_buf_(ctx)
+{ }
+
+void xreg::ProjPyramidOCL::allocate_resources(const size_type max_num_imgs, const CameraModel& cam)
+{
+  namespace bc = boost::compute;
+
+  xregASSERT(!ds_factors.empty());
+
+  max_num_imgs_ = max_num_imgs;
+  num_imgs_ = 0;
+
+  src_cam_ = cam;
+
+  bc::program prog = BuildOpenCLProg(kPROJ_PYRAMID_OPENCL_SRC, ctx_);
+
+  row_smooth_krnl_ = prog.create_kernel("RowSmoothKernel");
+  col_smooth_krnl_ = prog.create_kernel("ColSmoothKernel");
+  resample_krnl_   = prog.create_kernel("ResampleKernel");
+
+  const size_type src_buf_len = max_num_imgs * cam.num_det_rows * cam.num_det_cols;
+
+  src_buf_.resize(src_buf_len, queue_);
+
+  const bool need_smoothing = std::abs(smooth_sigma) > 1.0e-6;
+
+  const bool any_ds = std::any_of(ds_factors.begin(), ds_factors.end(),
+                                  [] (const CoordScalar f) { return f < 1; });
+
+  if (need_smoothing && any_ds)
+  {
+    row_smooth_buf_.resize(src_buf_len, queue_);
+    smooth_buf_.resize(src_buf_len, queue_);
+  }
+
+  const size_type num_lvls = ds_factors.size();
+
+  level_cams_.clear();
+  level_cams_.reserve(num_lvls);
+
+  level_bufs_.clear();
+  level_bufs_.reserve(num_lvls);
+
+  for (const CoordScalar ds_factor : ds_factors)
+  {
+    level_cams_.push_back(DownsampleCameraModel(cam, ds_factor, force_even_dims));
+
+    const auto& lvl_cam = level_cams_.back();
+
+    level_bufs_.emplace_back(max_num_imgs * lvl_cam.num_det_rows * lvl_cam.num_det_cols, ctx_);
+  }
+}
+
+void xreg::ProjPyramidOCL::run(const ProjDataF32List& projs)
+{
+  namespace bc = boost::compute;
+
+  const size_type num_imgs = projs.size();
+  xregASSERT(num_imgs <= max_num_imgs_);
+
+  const size_type num_pix_per_img = src_cam_.num_det_rows * src_cam_.num_det_cols;
+
+  for (size_type img_idx = 0; img_idx < num_imgs; ++img_idx)
+  {
+    const auto* img = projs[img_idx].img.GetPointer();
+    xregASSERT(img);
+
+    const auto img_size = img->GetLargestPossibleRegion().GetSize();
+    xregASSERT(img_size[0] == src_cam_.num_det_cols);
+    xregASSERT(img_size[1] == src_cam_.num_det_rows);
+
+    const float* host_buf = img->GetBufferPointer();
+
+    bc::copy(host_buf, host_buf + num_pix_per_img,
+             src_buf_.begin() + (img_idx * num_pix_per_img), queue_);
+  }
+
+  run(src_buf_, num_imgs);
+}
+
+void xreg::ProjPyramidOCL::run(const DevBuf& src, const size_type num_imgs)
+{
+  namespace bc = boost::compute;
+
+  xregASSERT(num_imgs <= max_num_imgs_);
+
+  num_imgs_ = num_imgs;
+
+  const int src_nr = static_cast<int>(src_cam_.num_det_rows);
+  const int src_nc = static_cast<int>(src_cam_.num_det_cols);
+
+  const size_type num_src_pix = num_imgs * src_cam_.num_det_rows * src_cam_.num_det_cols;
+  xregASSERT(src.size() >= num_src_pix);
+
+  const size_type num_lvls = ds_factors.size();
+
+  for (size_type lvl = 0; lvl < num_lvls; ++lvl)
+  {
+    const CoordScalar ds_factor = ds_factors[lvl];
+
+    const CameraModel& lvl_cam = level_cams_[lvl];
+
+    DevBuf& dst = level_bufs_[lvl];
+
+    const DevBuf* src_to_resample = &src;
+
+    if ((ds_factor < 1) && (std::abs(smooth_sigma) > 1.0e-6))
+    {
+      const float sigma = static_cast<float>((smooth_sigma < 0) ? (0.5 / ds_factor) : smooth_sigma);
+
+      const int rad = std::min(kMAX_SMOOTH_RAD, static_cast<int>(std::ceil(3 * sigma)));
+
+      row_smooth_krnl_.set_arg(0, src);
+      row_smooth_krnl_.set_arg(1, row_smooth_buf_);
+      row_smooth_krnl_.set_arg(2, bc::ulong_(num_src_pix));
+      row_smooth_krnl_.set_arg(3, bc::int_(src_nc));
+      row_smooth_krnl_.set_arg(4, bc::int_(rad));
+      row_smooth_krnl_.set_arg(5, bc::float_(sigma));
+
+      enqueue_kernel(row_smooth_krnl_, num_src_pix);
+
+      col_smooth_krnl_.set_arg(0, row_smooth_buf_);
+      col_smooth_krnl_.set_arg(1, smooth_buf_);
+      col_smooth_krnl_.set_arg(2, bc::ulong_(num_src_pix));
+      col_smooth_krnl_.set_arg(3, bc::int_(src_nr));
+      col_smooth_krnl_.set_arg(4, bc::int_(src_nc));
+      col_smooth_krnl_.set_arg(5, bc::int_(rad));
+      col_smooth_krnl_.set_arg(6, bc::float_(sigma));
+
+      enqueue_kernel(col_smooth_krnl_, num_src_pix);
+
+      src_to_resample = &smooth_buf_;
+    }
+
+    if ((lvl_cam.num_det_rows == src_cam_.num_det_rows) &&
+        (lvl_cam.num_det_cols == src_cam_.num_det_cols) &&
+        (std::abs(ds_factor - 1) < 1.0e-6))
+    {
+      // full resolution level, no resampling is needed
+      bc::copy_async(src_to_resample->begin(), src_to_resample->begin() + num_src_pix,
+                     dst.begin(), queue_);
+    }
+    else
+    {
+      const size_type num_dst_pix = num_imgs * lvl_cam.num_det_rows * lvl_cam.num_det_cols;
+
+      resample_krnl_.set_arg(0, *src_to_resample);
+      resample_krnl_.set_arg(1, dst);
+      resample_krnl_.set_arg(2, bc::ulong_(num_dst_pix));
+      resample_krnl_.set_arg(3, bc::int_(src_nr));
+      resample_krnl_.set_arg(4, bc::int_(src_nc));
+      resample_krnl_.set_arg(5, bc::int_(static_cast<int>(lvl_cam.num_det_rows)));
+      resample_krnl_.set_arg(6, bc::int_(static_cast<int>(lvl_cam.num_det_cols)));
+      resample_krnl_.set_arg(7, bc::float_(static_cast<float>(1.0 / ds_factor)));
+
+      enqueue_kernel(resample_krnl_, num_dst_pix);
+    }
+  }
+}
+
+xreg::size_type xreg::ProjPyramidOCL::num_levels() const
+{
+  return level_cams_.size();
+}
+
+const xreg::CameraModel& xreg::ProjPyramidOCL::level_cam(const size_type lvl) const
+{
+  return level_cams_[lvl];
+}
+
+const xreg::ProjPyramidOCL::DevBuf& xreg::ProjPyramidOCL::level_buf(const size_type lvl) const
+{
+  return level_bufs_[lvl];
+}
+
+xreg::ProjPyramidOCL::DevBufPtr
+xreg::ProjPyramidOCL::make_img_dev_buf(const size_type lvl, const size_type img_idx)
+{
+  namespace bc = boost::compute;
+
+  xregASSERT(img_idx < num_imgs_);
+
+  const auto& lvl_cam = level_cams_[lvl];
+
+  const size_type num_pix_per_img = lvl_cam.num_det_rows * lvl_cam.num_det_cols;
+
+  auto dst = std::make_shared<DevBuf>(num_pix_per_img, ctx_);
+
+  auto src_begin = level_bufs_[lvl].begin() + (img_idx * num_pix_per_img);
+
+  // the buffer may be used with a different queue, e.g. that of a similarity
+  // metric, so wait for the copy
+  bc::copy_async(src_begin, src_begin + num_pix_per_img, dst->begin(), queue_).wait();
+
+  return dst;
+}
+
+xreg::ProjDataF32List
+xreg::ProjPyramidOCL::read_level(const size_type lvl, const ProjDataF32List& src_projs)
+{
+  namespace bc = boost::compute;
+
+  xregASSERT(src_projs.size() == num_imgs_);
+
+  const CoordScalar ds_factor = ds_factors[lvl];
+
+  const auto& lvl_cam = level_cams_[lvl];
+
+  const size_type num_pix_per_img = lvl_cam.num_det_rows * lvl_cam.num_det_cols;
+
+  ProjDataF32List dst_projs;
+  dst_projs.reserve(num_imgs_);
+
+  for (size_type img_idx = 0; img_idx < num_imgs_; ++img_idx)
+  {
+    const auto& src_proj = src_projs[img_idx];
+
+    // downsample the camera model and landmarks only
+    ProjDataF32 tmp_proj;
+    tmp_proj.cam           = src_proj.cam;
+    tmp_proj.landmarks     = src_proj.landmarks;
+    tmp_proj.rot_to_pat_up = src_proj.rot_to_pat_up;
+
+    dst_projs.push_back(DownsampleProjData(tmp_proj, ds_factor, force_even_dims));
+
+    auto& dst_proj = dst_projs.back();
+
+    xregASSERT(dst_proj.cam.num_det_rows == lvl_cam.num_det_rows);
+    xregASSERT(dst_proj.cam.num_det_cols == lvl_cam.num_det_cols);
+
+    auto img = ProjDataF32::Proj::New();
+
+    ProjDataF32::Proj::SizeType img_size;
+    img_size[0] = lvl_cam.num_det_cols;
+    img_size[1] = lvl_cam.num_det_rows;
+
+    img->SetRegions(img_size);
+
+    auto spacing = src_proj.img->GetSpacing();
+    spacing[0] /= ds_factor;
+    spacing[1] /= ds_factor;
+
+    img->SetSpacing(spacing);
+    img->SetOrigin(src_proj.img->GetOrigin());
+    img->SetDirection(src_proj.img->GetDirection());
+    img->Allocate();
+
+    auto src_begin = level_bufs_[lvl].begin() + (img_idx * num_pix_per_img);
+
+    bc::copy(src_begin, src_begin + num_pix_per_img, img->GetBufferPointer(), queue_);
+
+    dst_proj.img = img;
+  }
+
+  return dst_projs;
+}
+
+void xreg::ProjPyramidOCL::enqueue_kernel(boost::compute::kernel& k, const std::size_t num_items)
+{
+  const std::size_t global_size = num_items;
+
+  RecordOpenCLKernelEvent(k.name(),
+                          queue_.enqueue_nd_range_kernel(k, 1, nullptr, &global_size, nullptr));
+}
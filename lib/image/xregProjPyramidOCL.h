@@ -0,0 +1,144 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef XREGPROJPYRAMIDOCL_H_
+#define XREGPROJPYRAMIDOCL_H_
+
+#include <boost/compute/command_queue.hpp>
+#include <boost/compute/container/vector.hpp>
+#include <boost/compute/context.hpp>
+#include <boost/compute/kernel.hpp>
+
+#include "xregProjData.h"
+
+namespace xreg
+{
+
+/// \brief Builds downsampled pyramids of a batch of projections on an OpenCL
+///        device.
+///
+/// This is the OpenCL equivalent of calling DownsampleProjData() on a list of
+/// projections for each pyramid level. Each level is computed from the full
+/// resolution images by Gaussian smoothing, with a standard deviation of
+/// 0.5 / ds_factor pixels unless otherwise specified, followed by linear
+/// interpolation at the downsampled pixel locations. Each stage of a level
+/// is a single kernel launch over every image in the batch. The host
+/// implementation uses B-spline interpolation, so the pixel values differ
+/// slightly.
+///
+/// The images of each level are stored contiguously on the device, in
+/// row-major order, and remain resident so that they may be used as fixed
+/// images of the OpenCL similarity metrics (see make_img_dev_buf()). They are
+/// only read back to the host with read_level().
+class ProjPyramidOCL
+{
+public:
+  using DevBuf    = boost::compute::vector<float>;
+  using DevBufPtr = std::shared_ptr<DevBuf>;
+
+  /// \brief The downsampling factor of each level, e.g. 0.25 for a level
+  ///        one quarter of the full resolution in each dimension.
+  CoordScalarList ds_factors;
+
+  /// \brief Crop each downsampled level to have even dimensions, see
+  ///        DownsampleProjData().
+  bool force_even_dims = false;
+
+  /// \brief The standard deviation of the smoothing kernel, in full
+  ///        resolution pixels.
+  ///
+  /// Negative values indicate 0.5 / ds_factor should be used and zero
+  /// disables smoothing; levels which are not downsampled are never smoothed.
+  CoordScalar smooth_sigma = -1;
+
+  ProjPyramidOCL(const boost::compute::context& ctx,
+                 const boost::compute::command_queue& queue);
+
+  /// \brief Compiles the kernels and allocates the device buffers for up to
+  ///        max_num_imgs images with the dimensions of the camera model.
+  void allocate_resources(const size_type max_num_imgs, const CameraModel& cam);
+
+  /// \brief Copies the images of the projections to the device and computes
+  ///        every level.
+  ///
+  /// Each image must have the dimensions passed to allocate_resources(). The
+  /// kernels are enqueued and this does not wait for them to finish.
+  void run(const ProjDataF32List& projs);
+
+  /// \brief Computes every level from num_imgs images already on the device.
+  ///
+  /// The kernels are enqueued and this does not wait for them to finish.
+  void run(const DevBuf& src, const size_type num_imgs);
+
+  size_type num_levels() const;
+
+  /// \brief The (downsampled) camera model of a level.
+  const CameraModel& level_cam(const size_type lvl) const;
+
+  /// \brief The device buffer storing the images of a level.
+  const DevBuf& level_buf(const size_type lvl) const;
+
+  /// \brief Copies a single image of a level into a new device buffer, e.g.
+  ///        to be passed to ImgSimMetric2DOCL::set_fixed_image_dev().
+  DevBufPtr make_img_dev_buf(const size_type lvl, const size_type img_idx);
+
+  /// \brief Reads the images of a level back to the host; blocks until the
+  ///        images are available.
+  ///
+  /// src_projs are the full resolution projections passed to run(), their
+  /// camera models and landmarks are downsampled as in DownsampleProjData().
+  ProjDataF32List read_level(const size_type lvl, const ProjDataF32List& src_projs);
+
+private:
+  void enqueue_kernel(boost::compute::kernel& k, const std::size_t num_items);
+
+  boost::compute::context ctx_;
+  boost::compute::command_queue queue_;
+
+  size_type max_num_imgs_ = 0;
+  size_type num_imgs_ = 0;
+
+  CameraModel src_cam_;
+
+  std::vector<CameraModel> level_cams_;
+
+  // full resolution images when uploaded from the host
+  DevBuf src_buf_;
+
+  // full resolution images after smoothing along the rows and then along
+  // the columns
+  DevBuf row_smooth_buf_;
+  DevBuf smooth_buf_;
+
+  std::vector<DevBuf> level_bufs_;
+
+  boost::compute::kernel row_smooth_krnl_;
+  boost::compute::kernel col_smooth_krnl_;
+  boost::compute::kernel resample_krnl_;
+};
+
+}  // xreg
+
+#endif
@@ -29,52 +29,12 @@ namespace
 
 using namespace xreg;
 
-template <class tPixelType, unsigned int tN>
-typename itk::Image<tPixelType,tN>::Pointer
-CropImageWithBoundBoxPhysPtsHelper(const itk::Image<tPixelType,tN>* src_img,
-                                   const Eigen::Matrix<CoordScalar,int(tN),1>& center_pt,
-                                   const Eigen::Matrix<CoordScalar,int(tN),1>& phys_dims)
+template <class tPixelType>
+typename itk::Image<tPixelType,3>::Pointer
+CropImageWithBoundBoxPhysPtsHelper(const itk::Image<tPixelType,3>* src_img,
+                                   const Pt3& center_pt, const Pt3& phys_dims)
 {
-  using ImageType  = itk::Image<tPixelType,tN>;
-  using Point      = itk::Point<double,tN>;
-  using ContInd    = itk::ContinuousIndex<double,tN>;
-  using RegionType = typename ImageType::RegionType;
-  using SizeType   = typename ImageType::SizeType;
-  using ROIFilter  = itk::RegionOfInterestImageFilter<ImageType,ImageType>;
-
-  const SizeType src_size = src_img->GetLargestPossibleRegion().GetSize();
-
-  Point pt1_itk;
-  Point pt2_itk;
-  for (unsigned int i = 0; i < tN; ++i)
-  {
-    pt1_itk[i] = center_pt[i] - (phys_dims[i]);
-    pt2_itk[i] = center_pt[i] + (phys_dims[i]);
-  }
-
-  ContInd ind1;
-  src_img->TransformPhysicalPointToContinuousIndex(pt1_itk, ind1);  
-  
-  ContInd ind2;
-  src_img->TransformPhysicalPointToContinuousIndex(pt2_itk, ind2);
-
-  RegionType roi;
-
-  for (unsigned int i = 0; i < tN; ++i)
-  {
-    const long start_ind = std::max(std::lround(std::min(ind1[i], ind2[i])), static_cast<long>(0));
-    const long stop_ind  = std::min(std::lround(std::max(ind1[i], ind2[i])), static_cast<long>(src_size[i]-1));
-  
-    roi.SetIndex(i, start_ind);
-    roi.SetSize(i, stop_ind - start_ind + 1);
-  }
-
-  auto roi_filt = ROIFilter::New();
-  roi_filt->SetInput(src_img);
-  roi_filt->SetRegionOfInterest(roi);
-  roi_filt->Update();
-
-  return roi_filt->GetOutput(); 
+  return CopyITKImageRegionView(CropImageWithBoundBoxPhysPtsView(src_img, center_pt, phys_dims));
 }
 
 }  // un-named
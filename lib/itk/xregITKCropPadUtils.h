@@ -25,21 +25,347 @@
 #ifndef XREGITKCROPPADUTILS_H_
 #define XREGITKCROPPADUTILS_H_
 
+#include <algorithm>
 #include <array>
+#include <cmath>
 
-#include <itkRegionOfInterestImageFilter.h>
-#include <itkImageRegionConstIterator.h>
-#include <itkImageRegionIterator.h>
+#include <itkImage.h>
+#include <itkImportImageContainer.h>
 
 #include "xregCommon.h"
+#include "xregAssert.h"
+#include "xregTBBUtils.h"
 
 namespace xreg
 {
 
+/// \brief A non-owning view of a rectangular region of an image's pixels.
+///
+/// No pixels are copied when creating a view; the view references the buffer
+/// of the parent image, which is kept alive by the view. The region is
+/// expressed in the index space of the parent image. When a copy is required,
+/// e.g. the caller needs to own or modify the pixels, use
+/// CopyITKImageRegionView(). ITKImageFromRegionView() provides an itk::Image
+/// that may be passed to the ray casters, similarity metrics and writers
+/// without copying, when the region is contiguous in memory.
+template <class tPixelScalar, unsigned int tN>
+struct ITKImageRegionView
+{
+  using PixelScalar = tPixelScalar;
+
+  using Img        = itk::Image<PixelScalar,tN>;
+  using RegionType = typename Img::RegionType;
+  using IndexType  = typename Img::IndexType;
+  using SizeType   = typename Img::SizeType;
+  using PointType  = typename Img::PointType;
+
+  /// \brief The image which owns the pixels; holding this reference keeps the
+  ///        pixel buffer alive.
+  typename Img::ConstPointer parent;
+
+  /// \brief The region of the view with respect to the parent's indices.
+  RegionType region;
+
+  /// \brief Pointer to the first pixel of the region in the parent buffer.
+  const PixelScalar* buf() const
+  {
+    return parent->GetBufferPointer() + parent->ComputeOffset(region.GetIndex());
+  }
+
+  /// \brief The number of pixels between adjacent elements along each
+  ///        dimension of the parent buffer.
+  const typename Img::OffsetValueType* strides() const
+  {
+    return parent->GetOffsetTable();
+  }
+
+  size_type num_pixels() const
+  {
+    return region.GetNumberOfPixels();
+  }
+
+  /// \brief The physical location of the first pixel in the region.
+  PointType origin() const
+  {
+    PointType o;
+    parent->TransformIndexToPhysicalPoint(region.GetIndex(), o);
+    return o;
+  }
+
+  /// \brief Indicates that the pixels of the region are stored as a single
+  ///        block of the parent buffer, e.g. a slab of whole slices.
+  bool is_contiguous() const
+  {
+    const auto& parent_size = parent->GetBufferedRegion().GetSize();
+
+    unsigned int d = 0;
+
+    // leading dimensions which are not cropped
+    while ((d < tN) && (region.GetSize(d) == parent_size[d]))
+    {
+      ++d;
+    }
+
+    // the first cropped dimension may have any extent, but all of the
+    // remaining dimensions must be a single element
+    for (++d; d < tN; ++d)
+    {
+      if (region.GetSize(d) > 1)
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  /// \brief The number of lines of pixels along the first dimension, e.g.
+  ///        the number of rows in a 2D view.
+  size_type num_lines() const
+  {
+    const size_type line_len = region.GetSize(0);
+
+    return line_len ? (num_pixels() / line_len) : 0;
+  }
+
+  /// \brief The index, with respect to the view, of the first pixel in a
+  ///        line; lines are numbered in the order they are stored.
+  IndexType line_index(const size_type line_num) const
+  {
+    IndexType idx;
+    idx[0] = 0;
+
+    size_type rem = line_num;
+
+    for (unsigned int d = 1; d < tN; ++d)
+    {
+      idx[d] = rem % region.GetSize(d);
+      rem /= region.GetSize(d);
+    }
+
+    return idx;
+  }
+
+  /// \brief Pointer to the first pixel of a line of pixels in the first
+  ///        dimension (e.g. a row).
+  ///
+  /// line_idx is the index, with respect to the view, of the first pixel in
+  /// the line.
+  const PixelScalar* line(const IndexType& line_idx) const
+  {
+    const auto* off_tbl = strides();
+
+    const PixelScalar* p = buf();
+
+    for (unsigned int d = 1; d < tN; ++d)
+    {
+      p += line_idx[d] * off_tbl[d];
+    }
+
+    return p;
+  }
+};
+
+/// \brief Creates a view of a region of an image; no pixels are copied.
+///
+/// The region must be contained in the buffered region of img.
+template <class tPixelScalar, unsigned int tN>
+ITKImageRegionView<tPixelScalar,tN>
+MakeITKImageRegionView(const itk::Image<tPixelScalar,tN>* img,
+                       const typename itk::Image<tPixelScalar,tN>::RegionType& region)
+{
+  xregASSERT(img->GetBufferedRegion().IsInside(region) || !region.GetNumberOfPixels());
+
+  ITKImageRegionView<tPixelScalar,tN> v;
+  v.parent = img;
+  v.region = region;
+
+  return v;
+}
+
+namespace detail
+{
+
+/// \brief Pixel container which references the buffer of another image,
+///        holding a reference to that image so that the buffer remains valid.
+template <class tPixelScalar>
+class ParentRefImportImageContainer
+  : public itk::ImportImageContainer<itk::SizeValueType,tPixelScalar>
+{
+public:
+  using Self       = ParentRefImportImageContainer;
+  using Superclass = itk::ImportImageContainer<itk::SizeValueType,tPixelScalar>;
+  using Pointer    = itk::SmartPointer<Self>;
+
+  itkNewMacro(Self);
+
+  itkTypeMacro(ParentRefImportImageContainer, itk::ImportImageContainer);
+
+  itk::LightObject::ConstPointer parent;
+
+protected:
+  ParentRefImportImageContainer() = default;
+
+  ~ParentRefImportImageContainer() override = default;
+};
+
+template <class tPixelScalar, unsigned int tN>
+typename itk::Image<tPixelScalar,tN>::Pointer
+MakeImageWithViewGeom(const ITKImageRegionView<tPixelScalar,tN>& v)
+{
+  using Img = itk::Image<tPixelScalar,tN>;
+
+  auto dst_img = Img::New();
+  dst_img->SetRegions(v.region.GetSize());
+  dst_img->SetOrigin(v.origin());
+  dst_img->SetSpacing(v.parent->GetSpacing());
+  dst_img->SetDirection(v.parent->GetDirection());
+
+  return dst_img;
+}
+
+/// \brief Copies the lines of pixels of a view into a buffer, in parallel.
+///
+/// dst_off_tbl is the offset table of the destination buffer, e.g. from
+/// itk::Image::GetOffsetTable(), and dst_buf points to the location of the
+/// first pixel of the view.
+template <class tPixelScalar, unsigned int tN>
+void CopyITKImageRegionViewToBuf(const ITKImageRegionView<tPixelScalar,tN>& v,
+                                 tPixelScalar* dst_buf,
+                                 const typename itk::Image<tPixelScalar,tN>::OffsetValueType* dst_off_tbl)
+{
+  const size_type line_len = v.region.GetSize(0);
+
+  auto copy_fn = [&] (const RangeType& r)
+  {
+    for (size_type l = r.begin(); l < r.end(); ++l)
+    {
+      const auto line_idx = v.line_index(l);
+
+      tPixelScalar* dst_line = dst_buf;
+
+      for (unsigned int d = 1; d < tN; ++d)
+      {
+        dst_line += line_idx[d] * dst_off_tbl[d];
+      }
+
+      const tPixelScalar* src_line = v.line(line_idx);
+
+      std::copy(src_line, src_line + line_len, dst_line);
+    }
+  };
+
+  ParallelFor(copy_fn, RangeType(0, v.num_lines()));
+}
+
+}  // detail
+
+/// \brief Creates a new image, owning its pixels, from a view.
+///
+/// Physical coordinates are unchanged, e.g. the origin of the new image is
+/// the location of the first pixel in the view.
+template <class tPixelScalar, unsigned int tN>
+typename itk::Image<tPixelScalar,tN>::Pointer
+CopyITKImageRegionView(const ITKImageRegionView<tPixelScalar,tN>& v)
+{
+  auto dst_img = detail::MakeImageWithViewGeom(v);
+  dst_img->Allocate();
+
+  detail::CopyITKImageRegionViewToBuf(v, dst_img->GetBufferPointer(), dst_img->GetOffsetTable());
+
+  return dst_img;
+}
+
+/// \brief Creates an image referencing the pixels of a view; pixels are only
+///        copied when the region is not contiguous in the parent buffer.
+///
+/// When no copy is made, the returned image shares pixels with the parent
+/// image, so any modifications are visible in both. Callers that need to
+/// modify the pixels without affecting the parent should use
+/// CopyITKImageRegionView().
+template <class tPixelScalar, unsigned int tN>
+typename itk::Image<tPixelScalar,tN>::Pointer
+ITKImageFromRegionView(const ITKImageRegionView<tPixelScalar,tN>& v)
+{
+  if (!v.is_contiguous())
+  {
+    return CopyITKImageRegionView(v);
+  }
+
+  auto dst_img = detail::MakeImageWithViewGeom(v);
+
+  auto pix_cont = detail::ParentRefImportImageContainer<tPixelScalar>::New();
+  pix_cont->SetImportPointer(const_cast<tPixelScalar*>(v.buf()), v.num_pixels(), false);
+  pix_cont->parent = v.parent.GetPointer();
+
+  dst_img->SetPixelContainer(pix_cont);
+
+  return dst_img;
+}
+
+/// \brief Computes the index region of a volume inside of a bounding box
+///        defined by a center point and dimensions in physical units.
+///
+/// The dimensions are "radius," e.g. half of the full dimensions. Only the
+/// geometry of the volume is used, so the pixels of src_img need not be
+/// allocated; e.g. the image information of a file may be used to determine
+/// the region to read from disk. The region is clamped to the largest possible
+/// region of the volume.
+inline itk::ImageRegion<3>
+BoundBoxPhysPtsToRegion(const itk::ImageBase<3>* src_img,
+                        const Pt3& center_pt, const Pt3& phys_dims)
+{
+  using Point   = itk::ImageBase<3>::PointType;
+  using ContInd = itk::ContinuousIndex<double,3>;
+
+  const auto src_size = src_img->GetLargestPossibleRegion().GetSize();
+
+  Point pt1_itk;
+  Point pt2_itk;
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    pt1_itk[i] = center_pt[i] - (phys_dims[i]);
+    pt2_itk[i] = center_pt[i] + (phys_dims[i]);
+  }
+
+  ContInd ind1;
+  src_img->TransformPhysicalPointToContinuousIndex(pt1_itk, ind1);
+
+  ContInd ind2;
+  src_img->TransformPhysicalPointToContinuousIndex(pt2_itk, ind2);
+
+  itk::ImageRegion<3> roi;
+
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    const long start_ind = std::max(std::lround(std::min(ind1[i], ind2[i])), static_cast<long>(0));
+    const long stop_ind  = std::min(std::lround(std::max(ind1[i], ind2[i])), static_cast<long>(src_size[i]-1));
+
+    roi.SetIndex(i, start_ind);
+    roi.SetSize(i, stop_ind - start_ind + 1);
+  }
+
+  return roi;
+}
+
+/// \brief Creates a view of a volume using a bounding box defined by a center
+///        point and dimensions in physical units; no pixels are copied.
+///
+/// The dimensions are "radius," e.g. half of the full dimensions.
+template <class tPixelScalar>
+ITKImageRegionView<tPixelScalar,3>
+CropImageWithBoundBoxPhysPtsView(const itk::Image<tPixelScalar,3>* src_img,
+                                 const Pt3& center_pt, const Pt3& phys_dims)
+{
+  return MakeITKImageRegionView(src_img, BoundBoxPhysPtsToRegion(src_img, center_pt, phys_dims));
+}
+
 /// \brief Crop a volume using a bounding box defined by a center point and dimensions
 ///        in physical units.
 ///
 /// The dimensions are "radius," e.g. half of the full dimensions.
+/// The pixels are copied; use CropImageWithBoundBoxPhysPtsView() when
+/// ownership is not required.
 itk::Image<char,3>::Pointer
 CropImageWithBoundBoxPhysPts(const itk::Image<char,3>* src_img,
                              const Pt3& center_pt, const Pt3& phys_dims);
@@ -84,13 +410,14 @@ itk::Image<double,3>::Pointer
 CropImageWithBoundBoxPhysPts(const itk::Image<double,3>* src_img,
                              const Pt3& center_pt, const Pt3& phys_dims);
 
+/// \brief Creates a view of a 2D image without a boundary of a specified
+///        width; no pixels are copied.
 template <class tPixelType>
-typename itk::Image<tPixelType,2>::Pointer
-CropImage2DBoundary(const itk::Image<tPixelType,2>* src_img, const unsigned long boundary_width)
+ITKImageRegionView<tPixelType,2>
+CropImage2DBoundaryView(const itk::Image<tPixelType,2>* src_img, const unsigned long boundary_width)
 {
-  using Img       = itk::Image<tPixelType,2>;
-  using ROIFilter = itk::RegionOfInterestImageFilter<Img,Img>;
-  
+  using Img = itk::Image<tPixelType,2>;
+
   const auto src_img_size = src_img->GetLargestPossibleRegion().GetSize();
 
   typename Img::SizeType roi_size;
@@ -105,12 +432,18 @@ CropImage2DBoundary(const itk::Image<tPixelType,2>* src_img, const unsigned long
   roi.SetSize(roi_size);
   roi.SetIndex(roi_start);
 
-  auto img_roi_filter = ROIFilter::New();
-  img_roi_filter->SetInput(src_img);
-  img_roi_filter->SetRegionOfInterest(roi);
-  img_roi_filter->Update();
-  
- return img_roi_filter->GetOutput();
+  return MakeITKImageRegionView(src_img, roi);
+}
+
+/// \brief Creates a new 2D image without a boundary of a specified width.
+///
+/// The pixels are copied; use CropImage2DBoundaryView() when ownership is
+/// not required.
+template <class tPixelType>
+typename itk::Image<tPixelType,2>::Pointer
+CropImage2DBoundary(const itk::Image<tPixelType,2>* src_img, const unsigned long boundary_width)
+{
+  return CopyITKImageRegionView(CropImage2DBoundaryView(src_img, boundary_width));
 }
 
 template <class tPixelScalar, unsigned int tN, class tSizeScalar>
@@ -162,25 +495,17 @@ ITKPadImage(const itk::Image<tPixelScalar,tN>* src_img,
   dst_img->Allocate();
   dst_img->FillBuffer(fill_val);
         
-  // copy pixels from src_img
-  itk::ImageRegionConstIterator<Img> src_img_it(src_img, src_img_reg);
-
-  ITKReg dst_reg_in_pad;
-  dst_reg_in_pad.SetIndex(0, start_pad[0]);
-  dst_reg_in_pad.SetIndex(1, start_pad[1]);
-  dst_reg_in_pad.SetIndex(2, start_pad[2]);
-  dst_reg_in_pad.SetSize(src_img_size);
-  
-  itk::ImageRegionIterator<Img> pad_img_it(dst_img, dst_reg_in_pad);
-
-  while (!src_img_it.IsAtEnd())
+  // copy pixels from src_img, one line of pixels at a time
+  typename Img::IndexType dst_start_idx;
+  for (unsigned int i = 0; i < kDIM; ++i)
   {
-    pad_img_it.Set(src_img_it.Get());
-
-    ++pad_img_it;
-    ++src_img_it;
+    dst_start_idx[i] = start_pad[i];
   }
 
+  detail::CopyITKImageRegionViewToBuf(MakeITKImageRegionView(src_img, src_img_reg),
+                                      dst_img->GetBufferPointer() + dst_img->ComputeOffset(dst_start_idx),
+                                      dst_img->GetOffsetTable());
+
   return dst_img;
 }
 
@@ -34,6 +34,7 @@
 #include "xregCommon.h"
 #include "xregITKRemapUtils.h"
 #include "xregAssert.h"
+#include "xregExceptionUtils.h"
 
 namespace xreg
 {
@@ -121,6 +122,53 @@ typename tImage::Pointer ReadITKImageFromDisk(const std::string& path)
   return reader->GetOutput();
 }
 
+/// \brief Reads the image information (size, spacing, origin, direction) from
+///        a file on disk; the pixels are not read and are not allocated.
+template <class tImage>
+typename tImage::Pointer ReadITKImageInfoFromDisk(const std::string& path)
+{
+  using ImageReader = itk::ImageFileReader<tImage>;
+
+  typename ImageReader::Pointer reader = ImageReader::New();
+  reader->SetFileName(path);
+  reader->UpdateOutputInformation();
+
+  return reader->GetOutput();
+}
+
+/// \brief Reads a region of an image from disk into an ITK image object.
+///
+/// When the file format supports streaming (e.g. NIfTI, uncompressed MHA/NRRD)
+/// only the slices intersecting the region are read; otherwise the entire image
+/// is read. In either case the buffered region of the returned image contains
+/// the requested region, and is in the index space of the full image, so a
+/// view created with MakeITKImageRegionView() may be used to extract the exact
+/// region.
+template <class tImage>
+typename tImage::Pointer ReadITKImageRegionFromDisk(const std::string& path,
+                                                    const typename tImage::RegionType& reg)
+{
+  using ImageReader = itk::ImageFileReader<tImage>;
+
+  typename ImageReader::Pointer reader = ImageReader::New();
+  reader->SetFileName(path);
+  reader->UpdateOutputInformation();
+
+  auto img = reader->GetOutput();
+
+  if (!img->GetLargestPossibleRegion().IsInside(reg))
+  {
+    xregThrow("requested region is not inside of the image!");
+  }
+
+  img->SetRequestedRegion(reg);
+  img->Update();
+
+  xregASSERT(img->GetBufferedRegion().IsInside(reg));
+
+  return img;
+}
+
 template <class tPixelType, unsigned int tN>
 typename itk::Image<tPixelType,tN>::Pointer
 ReadDICOMNDFromDisk(const std::string& path)
@@ -0,0 +1,150 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "xregITKLabelStats.h"
+
+#include <algorithm>
+
+void xreg::ITKLabelStats::add_row_run(const itk::IndexValueType i_start,
+                                      const itk::IndexValueType i_end,
+                                      const itk::IndexValueType j,
+                                      const itk::IndexValueType k)
+{
+  if (!num_vox)
+  {
+    min_idx[0] = i_start;
+    min_idx[1] = j;
+    min_idx[2] = k;
+    
+    max_idx[0] = i_end;
+    max_idx[1] = j;
+    max_idx[2] = k;
+  }
+  else
+  {
+    min_idx[0] = std::min(min_idx[0], i_start);
+    min_idx[1] = std::min(min_idx[1], j);
+    min_idx[2] = std::min(min_idx[2], k);
+    
+    max_idx[0] = std::max(max_idx[0], i_end);
+    max_idx[1] = std::max(max_idx[1], j);
+    max_idx[2] = std::max(max_idx[2], k);
+  }
+
+  const double n = static_cast<double>(i_end - i_start + 1);
+
+  const double i0 = static_cast<double>(i_start);
+  const double i1 = static_cast<double>(i_end);
+
+  const double jj = static_cast<double>(j);
+  const double kk = static_cast<double>(k);
+
+  // closed forms of the sums of i and i^2 over [i_start, i_end]
+  const double sum_i    = (n * (i0 + i1)) / 2;
+  const double sum_i_sq = ((i1 * (i1 + 1) * ((2 * i1) + 1)) - ((i0 - 1) * i0 * ((2 * i0) - 1))) / 6;
+
+  num_vox += static_cast<size_type>(i_end - i_start + 1);
+
+  idx_sum[0] += sum_i;
+  idx_sum[1] += n * jj;
+  idx_sum[2] += n * kk;
+
+  idx_outer_sum(0,0) += sum_i_sq;
+  idx_outer_sum(1,1) += n * jj * jj;
+  idx_outer_sum(2,2) += n * kk * kk;
+  idx_outer_sum(0,1) += sum_i * jj;
+  idx_outer_sum(0,2) += sum_i * kk;
+  idx_outer_sum(1,2) += n * jj * kk;
+
+  idx_outer_sum(1,0) = idx_outer_sum(0,1);
+  idx_outer_sum(2,0) = idx_outer_sum(0,2);
+  idx_outer_sum(2,1) = idx_outer_sum(1,2);
+}
+
+void xreg::ITKLabelStats::merge(const ITKLabelStats& other)
+{
+  if (other.num_vox)
+  {
+    if (!num_vox)
+    {
+      min_idx = other.min_idx;
+      max_idx = other.max_idx;
+    }
+    else
+    {
+      for (unsigned d = 0; d < 3; ++d)
+      {
+        min_idx[d] = std::min(min_idx[d], other.min_idx[d]);
+        max_idx[d] = std::max(max_idx[d], other.max_idx[d]);
+      }
+    }
+
+    num_vox += other.num_vox;
+
+    idx_sum       += other.idx_sum;
+    idx_outer_sum += other.idx_outer_sum;
+  }
+}
+
+xreg::Pt3_d xreg::ITKLabelStats::centroid_idx() const
+{
+  return idx_sum / static_cast<double>(num_vox);
+}
+
+xreg::Mat3x3_d xreg::ITKLabelStats::cov_idx() const
+{
+  const Pt3_d c = centroid_idx();
+
+  return (idx_outer_sum / static_cast<double>(num_vox)) - (c * c.transpose());
+}
+
+itk::ImageRegion<3> xreg::ITKLabelStats::bound_box() const
+{
+  itk::ImageRegion<3> bb;
+
+  if (num_vox)
+  {
+    bb.SetIndex(min_idx);
+
+    for (unsigned d = 0; d < 3; ++d)
+    {
+      bb.SetSize(d, static_cast<itk::SizeValueType>(max_idx[d] - min_idx[d] + 1));
+    }
+  }
+  else
+  {
+    Index zero_idx;
+    zero_idx.Fill(0);
+
+    bb.SetIndex(zero_idx);
+
+    for (unsigned d = 0; d < 3; ++d)
+    {
+      bb.SetSize(d, 0);
+    }
+  }
+
+  return bb;
+}
@@ -0,0 +1,249 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef XREGITKLABELSTATS_H_
+#define XREGITKLABELSTATS_H_
+
+#include <limits>
+#include <type_traits>
+#include <unordered_set>
+#include <vector>
+
+#include <itkImage.h>
+
+#include "xregCommon.h"
+#include "xregTBBUtils.h"
+
+namespace xreg
+{
+
+/// \brief Statistics of the voxels in a 3D label map assigned to a label.
+///
+/// All quantities are with respect to (continuous) voxel index coordinates.
+/// Since the mapping from indices to physical points is affine, the physical
+/// centroid is the mapping of centroid_idx().
+struct ITKLabelStats
+{
+  using Index = itk::Index<3>;
+
+  size_type num_vox = 0;
+
+  /// \brief Inclusive bounds on the voxel indices, only valid when num_vox > 0
+  Index min_idx;
+  Index max_idx;
+
+  /// \brief Sum of the voxel indices
+  Pt3_d idx_sum = Pt3_d::Zero();
+
+  /// \brief Sum of the outer products of the voxel indices
+  Mat3x3_d idx_outer_sum = Mat3x3_d::Zero();
+
+  /// \brief Adds the voxels [i_start, i_end] of the row at (j,k).
+  void add_row_run(const itk::IndexValueType i_start, const itk::IndexValueType i_end,
+                   const itk::IndexValueType j, const itk::IndexValueType k);
+
+  /// \brief Combines the statistics of another collection of voxels.
+  void merge(const ITKLabelStats& other);
+
+  /// \brief The mean voxel index, NaN when there are no voxels
+  Pt3_d centroid_idx() const;
+
+  /// \brief The covariance of the voxel indices
+  Mat3x3_d cov_idx() const;
+
+  /// \brief The index-based bounding box, with zero size when there are no voxels
+  itk::ImageRegion<3> bound_box() const;
+};
+
+/// \brief Statistics for several labels, indexed by label value.
+using ITKLabelStatsList = std::vector<ITKLabelStats>;
+
+namespace detail
+{
+
+// Accumulates runs of equal labels along each row. The label to slot
+// function returns the index of the statistics entry which a label
+// contributes to, or a value >= max_slots when the label is ignored.
+template <class tLabelType, class tLabelToSlotFn>
+struct ITKLabelStatsAccFn
+{
+  using IndexValueType = itk::IndexValueType;
+
+  const tLabelType* buf;
+
+  size_type num_cols;
+  size_type num_rows;
+
+  ITKLabelStats::Index start_idx;
+
+  const tLabelToSlotFn& label_to_slot;
+
+  size_type max_slots;
+
+  ITKLabelStatsList stats;
+
+  ITKLabelStatsAccFn(const tLabelType* b, const size_type nc, const size_type nr,
+                     const ITKLabelStats::Index& s, const tLabelToSlotFn& fn,
+                     const size_type m)
+    : buf(b), num_cols(nc), num_rows(nr), start_idx(s), label_to_slot(fn),
+      max_slots(m)
+  { }
+
+  ITKLabelStatsAccFn(ITKLabelStatsAccFn& other, xregSplitMarker)
+    : buf(other.buf), num_cols(other.num_cols), num_rows(other.num_rows),
+      start_idx(other.start_idx), label_to_slot(other.label_to_slot),
+      max_slots(other.max_slots)
+  { }
+
+  // r is over all rows of the volume, e.g. [0, num_rows * num_slices)
+  void operator()(const RangeType& r)
+  {
+    for (size_type row_idx = r.begin(); row_idx < r.end(); ++row_idx)
+    {
+      const IndexValueType j = start_idx[1] + static_cast<IndexValueType>(row_idx % num_rows);
+      const IndexValueType k = start_idx[2] + static_cast<IndexValueType>(row_idx / num_rows);
+
+      const tLabelType* row_buf = buf + (row_idx * num_cols);
+
+      size_type i = 0;
+
+      while (i < num_cols)
+      {
+        const tLabelType l = row_buf[i];
+
+        const size_type run_start = i;
+
+        for (++i; (i < num_cols) && (row_buf[i] == l); ++i)
+        { }
+
+        const size_type slot = label_to_slot(l);
+
+        if (slot < max_slots)
+        {
+          if (slot >= stats.size())
+          {
+            stats.resize(slot + 1);
+          }
+
+          stats[slot].add_row_run(start_idx[0] + static_cast<IndexValueType>(run_start),
+                                  start_idx[0] + static_cast<IndexValueType>(i - 1), j, k);
+        }
+      }
+    }
+  }
+
+  void join(ITKLabelStatsAccFn& rhs)
+  {
+    if (rhs.stats.size() > stats.size())
+    {
+      stats.resize(rhs.stats.size());
+    }
+
+    for (size_type slot = 0; slot < rhs.stats.size(); ++slot)
+    {
+      stats[slot].merge(rhs.stats[slot]);
+    }
+  }
+};
+
+template <class tLabelType, class tLabelToSlotFn>
+ITKLabelStatsList ComputeITKLabelStatsHelper(const itk::Image<tLabelType,3>* img,
+                                             const tLabelToSlotFn& label_to_slot,
+                                             const size_type max_slots)
+{
+  const auto buf_reg = img->GetBufferedRegion();
+
+  const auto buf_size = buf_reg.GetSize();
+
+  ITKLabelStatsAccFn<tLabelType,tLabelToSlotFn> acc_fn(img->GetBufferPointer(),
+                                                       buf_size[0], buf_size[1],
+                                                       buf_reg.GetIndex(),
+                                                       label_to_slot, max_slots);
+
+  ParallelReduce(acc_fn, RangeType(0, buf_size[1] * buf_size[2]));
+
+  return acc_fn.stats;
+}
+
+template <class tLabelType>
+struct LabelValToSlot
+{
+  size_type operator()(const tLabelType l) const
+  {
+    return static_cast<size_type>(l);
+  }
+};
+
+template <class tLabelType>
+struct LabelInSetToSlot
+{
+  const std::unordered_set<tLabelType>& labels;
+
+  size_type operator()(const tLabelType l) const
+  {
+    return (labels.find(l) != labels.end()) ? 0 : 1;
+  }
+};
+
+}  // detail
+
+/// \brief Computes the statistics of every label in a single, parallel, pass
+///        over a label map.
+///
+/// The returned list is indexed by label value and its length is one greater
+/// than the maximum label present. Labels which are not present have zero
+/// voxels. Only small unsigned integer label types are supported, so that the
+/// list may be indexed directly. Each row of the label map is processed as
+/// runs of equal labels, so the cost of the statistics scales with the number
+/// of label boundaries, not the number of voxels.
+template <class tLabelType>
+ITKLabelStatsList ComputeITKLabelStats(const itk::Image<tLabelType,3>* img)
+{
+  static_assert(std::numeric_limits<tLabelType>::is_integer &&
+                  !std::numeric_limits<tLabelType>::is_signed &&
+                  (sizeof(tLabelType) <= 2),
+                "label type must be an unsigned 8 or 16 bit integer");
+
+  return detail::ComputeITKLabelStatsHelper(img, detail::LabelValToSlot<tLabelType>(),
+                                            ~size_type(0));
+}
+
+/// \brief Computes the combined statistics of all voxels with a label in a
+///        collection of labels.
+template <class tLabelType>
+ITKLabelStats ComputeITKLabelStats(const itk::Image<tLabelType,3>* img,
+                                   const std::unordered_set<tLabelType>& labels)
+{
+  const detail::LabelInSetToSlot<tLabelType> label_to_slot = { labels };
+
+  const ITKLabelStatsList stats = detail::ComputeITKLabelStatsHelper(img, label_to_slot, 1);
+
+  return stats.empty() ? ITKLabelStats() : stats[0];
+}
+
+}  // xreg
+
+#endif
+
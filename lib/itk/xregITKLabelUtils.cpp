@@ -25,31 +25,55 @@
 #include "xregITKLabelUtils.h"
 
 #include "xregCommon.h"
+#include "xregExceptionUtils.h"
 
 namespace  // un-named
 {
 
 using namespace xreg;
 
-template <class tPixelScalar, unsigned int tN, class tLabelScalar>
-std::vector<typename itk::Image<tPixelScalar,tN>::Pointer>
-MakeVolListFromVolAndLabelsHelper(const itk::Image<tPixelScalar,tN>* vol,
-                                  const itk::Image<tLabelScalar,tN>* labels,
+template <class tPixelScalar, class tLabelScalar>
+std::vector<typename itk::Image<tPixelScalar,3>::Pointer>
+MakeVolListFromVolAndLabelsHelper(const itk::Image<tPixelScalar,3>* vol,
+                                  const itk::Image<tLabelScalar,3>* labels,
                                   const std::vector<tLabelScalar>& labels_to_use,
-                                  const tPixelScalar masked_out_val)
+                                  const tPixelScalar masked_out_val,
+                                  const size_type crop_margin)
 {
-  using Img     = itk::Image<tPixelScalar,tN>;
+  using Img     = itk::Image<tPixelScalar,3>;
   using ImgPtr  = typename Img::Pointer;
   using ImgList = std::vector<ImgPtr>;
-  
+
+  using LabelScalar = tLabelScalar;
+
   const size_type num_vols = labels_to_use.size();
   
+  // the bounding boxes of every label are found in a single pass
+  const ITKLabelStatsList label_stats = ComputeITKLabelStats(labels);
+
+  const auto full_region = labels->GetLargestPossibleRegion();
+
   ImgList vols;
   vols.reserve(num_vols);
 
   for (const auto& l : labels_to_use)
   {
-    vols.push_back(ApplyMaskToITKImage(vol, labels, l, masked_out_val, true));
+    if ((l >= label_stats.size()) || !label_stats[l].num_vox)
+    {
+      xregThrow("label %d is not present in the label map!", static_cast<int>(l));
+    }
+
+    auto crop_region = label_stats[l].bound_box();
+    crop_region.PadByRadius(static_cast<itk::IndexValueType>(crop_margin));
+    crop_region.Crop(full_region);
+
+    // the views reference the pixels of the full volume and label map, so
+    // the only copy made is the masked output, which has an origin so that
+    // physical coordinates are unchanged by the crop
+    vols.push_back(MaskITKImageRegionView(MakeITKImageRegionView(vol, crop_region),
+                                          MakeITKImageRegionView(labels, crop_region),
+                                          [l] (const LabelScalar cur_l) { return cur_l == l; },
+                                          masked_out_val));
   }
 
   return vols;
@@ -61,18 +85,20 @@ std::vector<itk::Image<unsigned char,3>::Pointer>
 xreg::MakeVolListFromVolAndLabels(const itk::Image<unsigned char,3>* vol,
                                   const itk::Image<unsigned char,3>* labels,
                                   const std::vector<unsigned char>& labels_to_use,
-                                  const unsigned char masked_out_val)
+                                  const unsigned char masked_out_val,
+                                  const size_type crop_margin)
 {
-  return MakeVolListFromVolAndLabelsHelper(vol, labels, labels_to_use, masked_out_val);
+  return MakeVolListFromVolAndLabelsHelper(vol, labels, labels_to_use, masked_out_val, crop_margin);
 }
 
 std::vector<itk::Image<float,3>::Pointer>
 xreg::MakeVolListFromVolAndLabels(const itk::Image<float,3>* vol,
                                   const itk::Image<unsigned char,3>* labels,
                                   const std::vector<unsigned char>& labels_to_use,
-                                  const float masked_out_val)
+                                  const float masked_out_val,
+                                  const size_type crop_margin)
 {
-  return MakeVolListFromVolAndLabelsHelper(vol, labels, labels_to_use, masked_out_val);
+  return MakeVolListFromVolAndLabelsHelper(vol, labels, labels_to_use, masked_out_val, crop_margin);
 }
 
 
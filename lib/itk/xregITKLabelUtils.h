@@ -35,137 +35,81 @@
 #include <itkImageRegionIteratorWithIndex.h>
 #include <itkImageRegionConstIteratorWithIndex.h>
 
+#include "xregITKCropPadUtils.h"
+#include "xregITKLabelStats.h"
+
 namespace xreg
 {
 
-  /// \brief Finds the index-based bounding box about all locations with a certain label.
+/// \brief Finds the index-based bounding box about all locations with a certain label.
+///
+/// The label map is scanned once, in parallel. An empty region is returned
+/// when the label is not present.
 ///
 /// TODO: Handle dimensionality besides 3
 template <class tLabelType>
 typename itk::Image<tLabelType,3>::RegionType
 FindBoundBoxAboutLabel(const itk::Image<tLabelType,3>* img, const tLabelType label)
 {
-  using LabelType      = tLabelType;
-  using LabelImageType = itk::Image<LabelType,3>;
-  using SizeType       = typename LabelImageType::SizeType;
-  using SizeValueType  = typename LabelImageType::SizeValueType;
-  using RegionType     = typename LabelImageType::RegionType;
-
-  const SizeType img_size = img->GetLargestPossibleRegion().GetSize();
-
-  SizeType min_vals;
-  min_vals[0] = img_size[0] - 1;
-  min_vals[1] = img_size[1] - 1;
-  min_vals[2] = img_size[2] - 1;
-
-  SizeType max_vals;
-  max_vals.Fill(0);
-
-  const LabelType* label_ptr = img->GetBufferPointer();
-
-  for (SizeValueType k = 0; k < img_size[2]; ++k)
-  {
-    const bool k_is_min = k < min_vals[2];
-    const bool k_is_max = k > max_vals[2];
-
-    for (SizeValueType j = 0; j < img_size[1]; ++j)
-    {
-      const bool j_is_min = j < min_vals[1];
-      const bool j_is_max = j > max_vals[1];
-
-      for (SizeValueType i = 0; i < img_size[0]; ++i, ++label_ptr)
-      {
-        if (*label_ptr == label)
-        {
-          if (i < min_vals[0])
-          {
-            min_vals[0] = i;
-          }
-          if (i > max_vals[0])
-          {
-            max_vals[0] = i;
-          }
-
-          if (j_is_min)
-          {
-            min_vals[1] = j;
-          }
-          if (j_is_max)
-          {
-            max_vals[1] = j;
-          }
-
-          if (k_is_min)
-          {
-            min_vals[2] = k;
-          }
-          if (k_is_max)
-          {
-            max_vals[2] = k;
-          }
-        }
-      }
-    }
-  }
-
-  RegionType bb;
-  bb.SetIndex(0, min_vals[0]);
-  bb.SetIndex(1, min_vals[1]);
-  bb.SetIndex(2, min_vals[2]);
-  bb.SetSize(0, max_vals[0] - min_vals[0] + 1);
-  bb.SetSize(1, max_vals[1] - min_vals[1] + 1);
-  bb.SetSize(2, max_vals[2] - min_vals[2] + 1);
-
-  return bb;
+  return ComputeITKLabelStats(img, std::unordered_set<tLabelType>{ label }).bound_box();
 }
 
 /// \brief Finds the index-based bounding box about all locations equal to any certain labels in a collection.
 ///
+/// All labels are handled in a single, parallel, scan of the label map.
+///
 /// TODO: Handle dimensionality besides 3
 template <class tLabelType>
 typename itk::Image<tLabelType,3>::RegionType
 FindBoundBoxAboutLabels(const itk::Image<tLabelType,3>* img, const std::unordered_set<tLabelType>& labels)
 {
-  using LabelType      = tLabelType;
-  using LabelImageType = itk::Image<LabelType,3>;
-  using SizeType       = typename LabelImageType::SizeType;
-  using SizeValueType  = typename LabelImageType::SizeValueType;
-  using RegionType     = typename LabelImageType::RegionType;
-  using LabelSet       = typename std::decay<decltype(labels)>::type;
-
   xregASSERT(!labels.empty());
 
-  const SizeType img_size = img->GetLargestPossibleRegion().GetSize();
+  return ComputeITKLabelStats(img, labels).bound_box();
+}
+
+/// \brief Creates a new image from a region view, replacing each pixel whose
+///        corresponding label is not kept with a background value.
+///
+/// keep_fn is called with a label and returns true when the pixel should be
+/// kept. The image and label views must have regions of the same size. The
+/// pixels are copied and masked one line at a time, in parallel, so no
+/// intermediate cropped images are created.
+template <class tPixelType, class tLabelType, unsigned int tN, class tKeepFn>
+typename itk::Image<tPixelType,tN>::Pointer
+MaskITKImageRegionView(const ITKImageRegionView<tPixelType,tN>& img_view,
+                       const ITKImageRegionView<tLabelType,tN>& label_view,
+                       const tKeepFn& keep_fn, const tPixelType bg_val)
+{
+  xregASSERT(img_view.region.GetSize() == label_view.region.GetSize());
+
+  auto dst_img = CopyITKImageRegionView(img_view);
 
-  SizeType min_inds;
-  min_inds[0] = img_size[0] - 1;
-  min_inds[1] = img_size[1] - 1;
-  min_inds[2] = img_size[2] - 1;
+  tPixelType* dst_buf = dst_img->GetBufferPointer();
 
-  SizeType max_inds;
-  max_inds.Fill(0);
+  const size_type line_len = img_view.region.GetSize(0);
 
-  for (typename LabelSet::const_iterator lit = labels.begin(); lit != labels.end(); ++lit)
+  auto mask_fn = [&] (const RangeType& r)
   {
-    const RegionType cur_label_reg = FindBoundBoxAboutLabel(img, *lit);
-    min_inds[0] = std::min(min_inds[0], static_cast<SizeValueType>(cur_label_reg.GetIndex(0)));
-    min_inds[1] = std::min(min_inds[1], static_cast<SizeValueType>(cur_label_reg.GetIndex(1)));
-    min_inds[2] = std::min(min_inds[2], static_cast<SizeValueType>(cur_label_reg.GetIndex(2)));
-
-    max_inds[0] = std::max(max_inds[0], static_cast<SizeValueType>(cur_label_reg.GetIndex(0)) + cur_label_reg.GetSize(0) - 1);
-    max_inds[1] = std::max(max_inds[1], static_cast<SizeValueType>(cur_label_reg.GetIndex(1)) + cur_label_reg.GetSize(1) - 1);
-    max_inds[2] = std::max(max_inds[2], static_cast<SizeValueType>(cur_label_reg.GetIndex(2)) + cur_label_reg.GetSize(2) - 1);
-  }
+    for (size_type l = r.begin(); l < r.end(); ++l)
+    {
+      const tLabelType* label_line = label_view.line(label_view.line_index(l));
+
+      tPixelType* dst_line = dst_buf + (l * line_len);
+
+      for (size_type i = 0; i < line_len; ++i)
+      {
+        if (!keep_fn(label_line[i]))
+        {
+          dst_line[i] = bg_val;
+        }
+      }
+    }
+  };
 
-  RegionType bb;
-  bb.SetIndex(0, min_inds[0]);
-  bb.SetIndex(1, min_inds[1]);
-  bb.SetIndex(2, min_inds[2]);
-  bb.SetSize(0, max_inds[0] - min_inds[0] + 1);
-  bb.SetSize(1, max_inds[1] - min_inds[1] + 1);
-  bb.SetSize(2, max_inds[2] - min_inds[2] + 1);
+  ParallelFor(mask_fn, RangeType(0, img_view.num_lines()));
 
-  return bb;
+  return dst_img;
 }
 
 /// \brief Applies a masking operation to a volume using a specific label from
@@ -182,58 +126,15 @@ ApplyMaskToITKImage(const itk::Image<tPixelType,tN>* img, const itk::Image<tLabe
 {
   using PixelType = tPixelType;
   using LabelType = tLabelType;
-  
-  constexpr unsigned int kDIM = tN;
-  
-  using ImageType         = itk::Image<PixelType,kDIM>;
-  using ImagePointer      = typename ImageType::Pointer;
-  using LabelImageType    = itk::Image<LabelType,kDIM>;
-  using LabelImagePointer = typename LabelImageType::Pointer;
-
-  using LabelROIFilter = itk::RegionOfInterestImageFilter<LabelImageType,LabelImageType>;
-  using ImageROIFilter = itk::RegionOfInterestImageFilter<ImageType,ImageType>;
-
-  using LabelMapType   = itk::LabelMap<itk::LabelObject<LabelType,kDIM>>;
-  using LabelImageToLabelMapFilterType = itk::LabelImageToLabelMapFilter<LabelImageType,LabelMapType>;
-  using MaskFilterType = itk::LabelMapMaskImageFilter<LabelMapType,ImageType>;
-
-  const ImageType* src_img = img;
-  const LabelImageType* src_labels = label_img;
 
-  ImagePointer cropped_img;
-  LabelImagePointer cropped_labels;
+  // the crop and mask are performed with a single copy using views
+  const auto region = tight_crop ? FindBoundBoxAboutLabel(label_img, keep_label) :
+                                   img->GetLargestPossibleRegion();
 
-  if (tight_crop)
-  {
-    auto crop_region = FindBoundBoxAboutLabel(label_img, keep_label);
-
-    auto img_roi_filt = ImageROIFilter::New();
-    img_roi_filt->SetInput(img);
-    img_roi_filt->SetRegionOfInterest(crop_region);
-    img_roi_filt->Update();
-    cropped_img = img_roi_filt->GetOutput();
-    src_img = cropped_img.GetPointer();
-
-    auto label_roi_filt = LabelROIFilter::New();
-    label_roi_filt->SetInput(label_img);
-    label_roi_filt->SetRegionOfInterest(crop_region);
-    label_roi_filt->Update();
-    cropped_labels = label_roi_filt->GetOutput();
-    src_labels = cropped_labels.GetPointer();
-  }
-
-  auto label_img_to_map_filter = LabelImageToLabelMapFilterType::New();
-  label_img_to_map_filter->SetInput(src_labels);
-  label_img_to_map_filter->Update();
-
-  auto masker = MaskFilterType::New();
-  masker->SetBackgroundValue(bg_val);
-  masker->SetLabel(keep_label);
-  masker->SetInput(label_img_to_map_filter->GetOutput());
-  masker->SetFeatureImage(src_img);
-  masker->Update();
-
-  return masker->GetOutput();
+  return MaskITKImageRegionView(MakeITKImageRegionView(img, region),
+                                MakeITKImageRegionView(label_img, region),
+                                [keep_label] (const LabelType l) { return l == keep_label; },
+                                static_cast<PixelType>(bg_val));
 }
 
 /// \brief Applies a masking operation to a volume using a specific collection
@@ -250,51 +151,24 @@ ApplyMaskToITKImageKeepLabels(itk::Image<tPixelType,tN>* img, itk::Image<tLabelT
 {
   constexpr unsigned int kDIM = tN;
 
-  using PixelType    = tPixelType;
-  using ImageType    = itk::Image<PixelType,kDIM>;
-  using ImagePointer = typename ImageType::Pointer;
-
-  using ImageIt = itk::ImageRegionIteratorWithIndex<ImageType>;
-
-  using LabelType         = tLabelType;
-  using LabelImageType    = itk::Image<LabelType,kDIM>;
-  using LabelImagePointer = typename LabelImageType::Pointer;
-
-  using LabelROIFilter = itk::RegionOfInterestImageFilter<LabelImageType,LabelImageType>;
-  using ImageROIFilter = itk::RegionOfInterestImageFilter<ImageType,ImageType>;
-
-  ImagePointer src_img = img;
-  LabelImagePointer src_labels = label_img;
-
-  if (tight_crop)
-  {
-    auto crop_region = FindBoundBoxAboutLabels(label_img, keep_labels);
-
-    auto img_roi_filt = ImageROIFilter::New();
-    img_roi_filt->SetInput(img);
-    img_roi_filt->SetRegionOfInterest(crop_region);
-    img_roi_filt->Update();
-    src_img = img_roi_filt->GetOutput();
-
-    auto label_roi_filt = LabelROIFilter::New();
-    label_roi_filt->SetInput(src_labels);
-    label_roi_filt->SetRegionOfInterest(crop_region);
-    label_roi_filt->Update();
-    src_labels = label_roi_filt->GetOutput();
-  }
-
-  auto dst_img = ITKImageDeepCopy(src_img.GetPointer());
-
-  ImageIt img_it(dst_img, dst_img->GetLargestPossibleRegion());
-  for (img_it.GoToBegin(); !img_it.IsAtEnd(); ++img_it)
-  {
-    if (keep_labels.find(src_labels->GetPixel(img_it.GetIndex())) == keep_labels.end())
-    {
-      img_it.Value() = bg_val;
-    }
-  }
+  using PixelType = tPixelType;
+  using ImageType = itk::Image<PixelType,kDIM>;
 
-  return dst_img;
+  using LabelType      = tLabelType;
+  using LabelImageType = itk::Image<LabelType,kDIM>;
+
+  // the crop and mask are performed with a single copy using views
+  const typename ImageType::RegionType region = tight_crop ?
+                                                  FindBoundBoxAboutLabels(label_img, keep_labels) :
+                                                  img->GetLargestPossibleRegion();
+
+  return MaskITKImageRegionView(MakeITKImageRegionView(static_cast<const ImageType*>(img), region),
+                                MakeITKImageRegionView(static_cast<const LabelImageType*>(label_img), region),
+                                [&keep_labels] (const LabelType l)
+                                {
+                                  return keep_labels.find(l) != keep_labels.end();
+                                },
+                                bg_val);
 }
 
 /// \brief Replace the voxels in an image that correspond to a certain set of
@@ -350,17 +224,33 @@ GetIndsForSpecificLabel(const itk::Image<tLabelType,tN>* img, const tLabelType l
   return inds;
 }
 
+/// \brief Creates a masked volume for each label in a list.
+///
+/// Each output volume is cropped to the bounding box of its label, grown by
+/// crop_margin voxels on each side and limited to the extent of the input.
+/// Physical coordinates are consistent with the input volume, so poses need
+/// not be adjusted, and objects smaller than the input consume proportionally
+/// less memory when uploaded to a ray caster and shorter ray traversals.
+/// A margin of at least one voxel keeps masked out values at the boundary of
+/// the label, so that interpolation at the edge of the object uses them
+/// instead of the region outside the volume.
+/// The bounding boxes of all labels are found in one parallel pass.
 std::vector<itk::Image<unsigned char,3>::Pointer>
 MakeVolListFromVolAndLabels(const itk::Image<unsigned char,3>* vol,
                             const itk::Image<unsigned char,3>* labels,
                             const std::vector<unsigned char>& labels_to_use,
-                            const unsigned char masked_out_val);
+                            const unsigned char masked_out_val,
+                            const size_type crop_margin = 0);
 
+/// \brief Creates a masked volume for each label in a list.
+///
+/// See the unsigned char overload for details on cropping.
 std::vector<itk::Image<float,3>::Pointer>
 MakeVolListFromVolAndLabels(const itk::Image<float,3>* vol,
                             const itk::Image<unsigned char,3>* labels,
                             const std::vector<unsigned char>& labels_to_use,
-                            const float masked_out_val);
+                            const float masked_out_val,
+                            const size_type crop_margin = 0);
 
 }  // xreg
 
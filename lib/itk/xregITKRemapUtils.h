@@ -25,6 +25,9 @@
 #ifndef XREGITKREMAPUTILS_H_
 #define XREGITKREMAPUTILS_H_
 
+#include <algorithm>
+#include <limits>
+#include <tuple>
 #include <vector>
 
 #include <itkImage.h>
@@ -36,6 +39,7 @@
 #include <itkImageRegionConstIteratorWithIndex.h>
 
 #include "xregITKBasicImageUtils.h"
+#include "xregTBBUtils.h"
 
 namespace xreg
 {
@@ -64,20 +68,106 @@ ITKImageRemap8bpp(const itk::Image<T,tN>* img,
   return window_filter->GetOutput();
 }
  
-/// \brief Remaps the intensities of an image to fit in an 8-bpp image.
+namespace detail
+{
+
+/// \brief Windows a buffer of intensities into [0,255].
+///
+/// Matches the mapping of itk::IntensityWindowingImageFilter, but the loop
+/// body is branch-free, allowing it to be vectorized, and chunks of the buffer
+/// are processed concurrently.
+template <class T>
+void WindowBuf8bpp(const T* src, unsigned char* dst, const size_type num_pix,
+                   const T min_val, const T max_val)
+{
+  const double scale = (max_val > min_val) ?
+                          (255.0 / (static_cast<double>(max_val) - static_cast<double>(min_val))) : 0.0;
+
+  const double shift = -static_cast<double>(min_val) * scale;
+
+  auto window_fn = [&] (const RangeType& r)
+  {
+    const size_type end_idx = r.end();
+
+    for (size_type i = r.begin(); i < end_idx; ++i)
+    {
+      const T v = src[i];
+
+      const double x = (static_cast<double>(v) * scale) + shift;
+
+      dst[i] = (v < min_val) ? static_cast<unsigned char>(0) :
+                  ((v > max_val) ? static_cast<unsigned char>(255) : static_cast<unsigned char>(x));
+    }
+  };
+
+  ParallelFor(window_fn, RangeType(0, num_pix));
+}
+
+/// \brief Computes the minimum and maximum values of a buffer concurrently.
+template <class T>
+std::tuple<T,T> MinMaxBuf(const T* src, const size_type num_pix)
+{
+  using MinMax = std::tuple<T,T>;
+
+  auto min_max_fn = [src] (const RangeType& r, const MinMax& init)
+  {
+    T min_val = std::get<0>(init);
+    T max_val = std::get<1>(init);
+
+    const size_type end_idx = r.end();
+
+    for (size_type i = r.begin(); i < end_idx; ++i)
+    {
+      min_val = std::min(min_val, src[i]);
+      max_val = std::max(max_val, src[i]);
+    }
+
+    return MinMax(min_val, max_val);
+  };
+
+  auto red_fn = [] (const MinMax& a, const MinMax& b)
+  {
+    return MinMax(std::min(std::get<0>(a), std::get<0>(b)),
+                  std::max(std::get<1>(a), std::get<1>(b)));
+  };
+
+  return ParallelReduce(MinMax(std::numeric_limits<T>::max(), std::numeric_limits<T>::lowest()),
+                        min_max_fn, red_fn, RangeType(0, num_pix));
+}
+
 template <class T, unsigned int tN>
-typename itk::Image<unsigned char,tN>::Pointer ITKImageRemap8bpp(const itk::Image<T,tN>* img)
+typename itk::Image<unsigned char,tN>::Pointer
+ITKImageRemap8bppNoCheck(const itk::Image<T,tN>* img, const T min_val, const T max_val)
 {
-  using ImageType     = itk::Image<T,tN>;
   using Image8bppType = itk::Image<unsigned char,tN>;
 
-  using MinMaxCalcType   = itk::MinimumMaximumImageCalculator<ImageType>;
-  using WindowFilterType = itk::IntensityWindowingImageFilter<ImageType,Image8bppType>;
+  auto dst_img = Image8bppType::New();
+  dst_img->SetRegions(img->GetLargestPossibleRegion());
+  dst_img->SetDirection(img->GetDirection());
+  dst_img->SetSpacing(img->GetSpacing());
+  dst_img->SetOrigin(img->GetOrigin());
+  dst_img->Allocate();
 
-  auto min_max_calc  = MinMaxCalcType::New();
-  auto window_filter = WindowFilterType::New();
+  WindowBuf8bpp(img->GetBufferPointer(), dst_img->GetBufferPointer(),
+                img->GetBufferedRegion().GetNumberOfPixels(), min_val, max_val);
 
-  return ITKImageRemap8bpp(img, min_max_calc.GetPointer(), window_filter.GetPointer());
+  return dst_img;
+}
+
+}  // detail
+
+/// \brief Remaps the intensities of an image to fit in an 8-bpp image.
+///
+/// The minimum and maximum intensities are computed with a parallel reduction
+/// and the windowing is performed with a parallel, vectorizable, loop. The
+/// output is identical to that of itk::IntensityWindowingImageFilter.
+template <class T, unsigned int tN>
+typename itk::Image<unsigned char,tN>::Pointer ITKImageRemap8bpp(const itk::Image<T,tN>* img)
+{
+  const auto min_max = detail::MinMaxBuf(img->GetBufferPointer(),
+                                         img->GetBufferedRegion().GetNumberOfPixels());
+
+  return detail::ITKImageRemap8bppNoCheck(img, std::get<0>(min_max), std::get<1>(min_max));
 }
 
 /// \brief Remaps the intensities of an image to fit in an 8-bpp image (uses pre-computed min/max window values)
@@ -85,18 +175,34 @@ template <class T, unsigned int tN>
 typename itk::Image<unsigned char,tN>::Pointer
 ITKImageRemap8bpp(const itk::Image<T,tN>* img, const T min_val, const T max_val)
 {
-  using WindowFn = itk::IntensityWindowingImageFilter<itk::Image<T,tN>,itk::Image<unsigned char,tN>>;
-  
-  auto window_filter = WindowFn::New();
-  
-  window_filter->SetInput(img);
-  window_filter->SetWindowMinimum(min_val);
-  window_filter->SetWindowMaximum(max_val);
-  window_filter->SetOutputMinimum(0);
-  window_filter->SetOutputMaximum(255);
-  window_filter->Update();
+  return detail::ITKImageRemap8bppNoCheck(img, min_val, max_val);
+}
 
-  return window_filter->GetOutput();
+/// \brief Remaps the intensities of a collection of images to fit in 8-bpp
+///        images.
+///
+/// Each image uses its own minimum and maximum intensities. The images are
+/// remapped concurrently, which is useful for small images, such as a batch of
+/// DRRs, that do not individually provide enough work for every thread.
+template <class T, unsigned int tN>
+std::vector<typename itk::Image<unsigned char,tN>::Pointer>
+ITKImageRemap8bpp(const std::vector<itk::SmartPointer<itk::Image<T,tN>>>& imgs)
+{
+  const size_type num_imgs = imgs.size();
+
+  std::vector<typename itk::Image<unsigned char,tN>::Pointer> dst_imgs(num_imgs);
+
+  auto remap_fn = [&imgs,&dst_imgs] (const RangeType& r)
+  {
+    for (size_type i = r.begin(); i < r.end(); ++i)
+    {
+      dst_imgs[i] = ITKImageRemap8bpp(imgs[i].GetPointer());
+    }
+  };
+
+  ParallelFor(remap_fn, RangeType(0, num_imgs));
+
+  return dst_imgs;
 }
 
 template <class tLabelScalar, unsigned int tN, class tDstScalar>
@@ -124,11 +230,18 @@ RemapITKLabelMap(const itk::Image<tLabelScalar,tN>* labels,
 
   const LabelScalar* labels_buf = labels->GetBufferPointer();
 
-  std::transform(labels_buf, labels_buf + num_pix, dst_img->GetBufferPointer(),
-                 [&lut] (const LabelScalar& l)
-                 {
-                   return lut[l];
-                 });
+  DstScalar* dst_buf = dst_img->GetBufferPointer();
+
+  auto remap_fn = [&lut,labels_buf,dst_buf] (const RangeType& r)
+  {
+    std::transform(labels_buf + r.begin(), labels_buf + r.end(), dst_buf + r.begin(),
+                   [&lut] (const LabelScalar& l)
+                   {
+                     return lut[l];
+                   });
+  };
+
+  ParallelFor(remap_fn, RangeType(0, num_pix));
 
   return dst_img;
 }
@@ -0,0 +1,393 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregOpenCLAutoTune.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "xregAssert.h"
+#include "xregFilesystemUtils.h"
+#include "xregOpenCLProfiling.h"
+#include "xregOpenCLProgCache.h"
+
+namespace  // un-named
+{
+
+namespace bc = boost::compute;
+
+using LocalSize = std::array<std::size_t,3>;
+
+/// \brief Maps kernel keys to work-group sizes, a first size of zero
+///        indicates that the implementation should choose the size.
+using TuningProfile = std::unordered_map<std::string,LocalSize>;
+
+constexpr std::size_t kNUM_WARM_UP_LAUNCHES = 1;
+constexpr std::size_t kNUM_TIMED_LAUNCHES   = 3;
+
+std::mutex profiles_mutex;
+
+/// \brief Profiles of each device, keyed by the device ID
+std::unordered_map<std::string,TuningProfile> profiles;
+
+bool autotune_enabled_set = false;
+
+bool autotune_enabled = true;
+
+std::string ProfilePath(const std::string& dev_id)
+{
+  const std::string dir = xreg::OpenCLProgCacheDir();
+
+  if (dir.empty())
+  {
+    return std::string();
+  }
+
+  xreg::Path p(dir);
+  p += fmt::format("tuning-{}.txt", dev_id);
+
+  return p.string();
+}
+
+/// \brief Reads the entries of a profile file, each line has the form:
+///        <key> <local size 0> <local size 1> <local size 2>
+void ReadProfile(const std::string& path, TuningProfile* prof)
+{
+  std::ifstream in(path.c_str());
+
+  std::string line;
+
+  while (std::getline(in, line))
+  {
+    if (line.empty() || (line[0] == '#'))
+    {
+      continue;
+    }
+
+    std::istringstream iss(line);
+
+    std::string key;
+    LocalSize l;
+
+    if (iss >> key >> l[0] >> l[1] >> l[2])
+    {
+      // entries already present were tuned by this process
+      prof->emplace(key, l);
+    }
+  }
+}
+
+/// \brief Writes a profile, merging it with the entries written to the file
+///        by other processes.
+///
+/// A temporary file is moved into place, so that other processes do not
+/// read a partially written profile.
+void WriteProfile(const std::string& path, const std::string& dev_name, TuningProfile* prof)
+{
+  if (xreg::Path(path).exists())
+  {
+    ReadProfile(path, prof);
+  }
+
+  const std::string tmp_path = fmt::format("{}.{:x}.{:x}.tmp", path,
+            std::hash<std::thread::id>()(std::this_thread::get_id()),
+            std::chrono::steady_clock::now().time_since_epoch().count());
+
+  {
+    std::ofstream out(tmp_path.c_str());
+
+    out << "# xReg OpenCL work-group sizes for: " << dev_name << '\n';
+
+    for (const auto& kv : *prof)
+    {
+      out << kv.first << ' ' << kv.second[0] << ' ' << kv.second[1] << ' ' << kv.second[2] << '\n';
+    }
+
+    if (!out.good())
+    {
+      return;
+    }
+  }
+
+  xreg::MoveFileSystemItem(tmp_path, path);
+}
+
+/// \brief Retrieves the profile of a device, reading it from disk the first
+///        time it is requested.
+///
+/// profiles_mutex must be held by the caller.
+TuningProfile& DevProfile(const std::string& dev_id)
+{
+  auto it = profiles.find(dev_id);
+
+  if (it == profiles.end())
+  {
+    it = profiles.emplace(dev_id, TuningProfile()).first;
+
+    const std::string path = ProfilePath(dev_id);
+
+    if (!path.empty() && xreg::Path(path).exists())
+    {
+      ReadProfile(path, &it->second);
+    }
+  }
+
+  return it->second;
+}
+
+bool FindLocalSize(const std::string& dev_id, const std::string& key, LocalSize* l)
+{
+  std::lock_guard<std::mutex> lock(profiles_mutex);
+
+  const TuningProfile& prof = DevProfile(dev_id);
+
+  auto it = prof.find(key);
+
+  const bool found = it != prof.end();
+
+  if (found)
+  {
+    *l = it->second;
+  }
+
+  return found;
+}
+
+std::vector<LocalSize> CandidateLocalSizes(const bc::kernel& k, const bc::device& dev,
+                                           const std::size_t dim)
+{
+  const std::size_t max_wg_size = k.get_work_group_info<std::size_t>(dev, CL_KERNEL_WORK_GROUP_SIZE);
+
+  const std::vector<std::size_t> max_item_sizes =
+                      dev.get_info<std::vector<std::size_t>>(CL_DEVICE_MAX_WORK_ITEM_SIZES);
+
+  // let the implementation choose
+  std::vector<LocalSize> cands = { LocalSize{ { 0, 0, 0 } } };
+
+  std::vector<LocalSize> shapes;
+
+  if (dim == 1)
+  {
+    for (std::size_t l = 32; l <= 1024; l *= 2)
+    {
+      shapes.push_back(LocalSize{ { l, 1, 1 } });
+    }
+  }
+  else
+  {
+    shapes = { LocalSize{ {  8,  8, 1 } }, LocalSize{ { 16, 16, 1 } },
+               LocalSize{ { 16,  8, 1 } }, LocalSize{ {  8, 16, 1 } },
+               LocalSize{ { 32,  8, 1 } }, LocalSize{ {  8, 32, 1 } },
+               LocalSize{ { 32,  4, 1 } }, LocalSize{ {  4, 32, 1 } },
+               LocalSize{ { 32,  1, 1 } }, LocalSize{ { 64,  1, 1 } },
+               LocalSize{ {128,  1, 1 } }, LocalSize{ {256,  1, 1 } } };
+  }
+
+  for (const LocalSize& l : shapes)
+  {
+    bool valid = (l[0] * l[1] * l[2]) <= max_wg_size;
+
+    for (std::size_t i = 0; valid && (i < dim); ++i)
+    {
+      valid = (i < max_item_sizes.size()) && (l[i] <= max_item_sizes[i]);
+    }
+
+    if (valid)
+    {
+      cands.push_back(l);
+    }
+  }
+
+  return cands;
+}
+
+bc::event EnqueueWithLocalSize(bc::command_queue& queue, bc::kernel& k, const std::size_t dim,
+                               const std::size_t* global_size, const LocalSize& l)
+{
+  if (!l[0])
+  {
+    return queue.enqueue_nd_range_kernel(k, dim, 0, global_size, 0);
+  }
+
+  // round the global size up to a multiple of the work-group size
+  LocalSize padded_global_size = { { 1, 1, 1 } };
+
+  for (std::size_t i = 0; i < dim; ++i)
+  {
+    padded_global_size[i] = ((global_size[i] + l[i] - 1) / l[i]) * l[i];
+  }
+
+  return queue.enqueue_nd_range_kernel(k, dim, 0, padded_global_size.data(), l.data());
+}
+
+}  // un-named
+
+boost::compute::event
+xreg::EnqueueOpenCLKernelTuned(boost::compute::command_queue& queue,
+                               boost::compute::kernel& k,
+                               const std::string& key,
+                               const std::size_t dim,
+                               const std::size_t* global_size)
+{
+  xregASSERT((dim > 0) && (dim <= 3));
+
+  const std::string dev_id = OpenCLDeviceID(queue.get_device());
+
+  LocalSize l = { { 0, 0, 0 } };
+
+  if (!FindLocalSize(dev_id, key, &l) && OpenCLAutoTuneEnabled())
+  {
+    TuneOpenCLWorkGroupSize(queue, k, key, dim, global_size);
+
+    FindLocalSize(dev_id, key, &l);
+  }
+
+  const bc::event e = EnqueueWithLocalSize(queue, k, dim, global_size, l);
+
+  RecordOpenCLKernelEvent(key, e);
+
+  return e;
+}
+
+void xreg::TuneOpenCLWorkGroupSize(boost::compute::command_queue& queue,
+                                   boost::compute::kernel& k,
+                                   const std::string& key,
+                                   const std::size_t dim,
+                                   const std::size_t* global_size)
+{
+  using Clock = std::chrono::steady_clock;
+
+  xregASSERT((dim > 0) && (dim <= 3));
+
+  if (!OpenCLAutoTuneEnabled())
+  {
+    return;
+  }
+
+  const bc::device dev = queue.get_device();
+
+  LocalSize best_l = { { 0, 0, 0 } };
+
+  double best_secs = std::numeric_limits<double>::max();
+
+  for (const LocalSize& l : CandidateLocalSizes(k, dev, dim))
+  {
+    try
+    {
+      for (std::size_t i = 0; i < kNUM_WARM_UP_LAUNCHES; ++i)
+      {
+        EnqueueWithLocalSize(queue, k, dim, global_size, l).wait();
+      }
+
+      double min_secs = std::numeric_limits<double>::max();
+
+      for (std::size_t i = 0; i < kNUM_TIMED_LAUNCHES; ++i)
+      {
+        const Clock::time_point start_time = Clock::now();
+
+        EnqueueWithLocalSize(queue, k, dim, global_size, l).wait();
+
+        min_secs = std::min(min_secs,
+                     std::chrono::duration<double>(Clock::now() - start_time).count());
+      }
+
+      if (min_secs < best_secs)
+      {
+        best_secs = min_secs;
+        best_l    = l;
+      }
+    }
+    catch (bc::opencl_error&)
+    {
+      // the size is not supported by this launch, e.g. the kernel requires
+      // too many resources
+    }
+  }
+
+  const std::string dev_id = OpenCLDeviceID(dev);
+
+  std::lock_guard<std::mutex> lock(profiles_mutex);
+
+  TuningProfile& prof = DevProfile(dev_id);
+
+  prof[key] = best_l;
+
+  const std::string path = ProfilePath(dev_id);
+
+  if (!path.empty())
+  {
+    // failing to write the profile only results in tuning again next time
+    try
+    {
+      MakeDirRecursive(Path(path).parent().string());
+
+      WriteProfile(path, dev.name(), &prof);
+    }
+    catch (...)
+    { }
+  }
+}
+
+bool xreg::IsOpenCLWorkGroupSizeTuned(const boost::compute::device& dev, const std::string& key)
+{
+  LocalSize l;
+  
+  return !OpenCLAutoTuneEnabled() || FindLocalSize(OpenCLDeviceID(dev), key, &l);
+}
+
+void xreg::SetOpenCLAutoTuneEnabled(const bool enabled)
+{
+  std::lock_guard<std::mutex> lock(profiles_mutex);
+
+  autotune_enabled     = enabled;
+  autotune_enabled_set = true;
+}
+
+bool xreg::OpenCLAutoTuneEnabled()
+{
+  std::lock_guard<std::mutex> lock(profiles_mutex);
+
+  if (!autotune_enabled_set)
+  {
+    const char* env_val = std::getenv("XREG_OPENCL_AUTOTUNE");
+
+    autotune_enabled = !env_val || (std::string(env_val) != "0");
+
+    autotune_enabled_set = true;
+  }
+
+  return autotune_enabled;
+}
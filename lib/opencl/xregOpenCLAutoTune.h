@@ -0,0 +1,93 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGOPENCLAUTOTUNE_H_
+#define XREGOPENCLAUTOTUNE_H_
+
+#include <cstddef>
+#include <string>
+
+#include <boost/compute/command_queue.hpp>
+#include <boost/compute/event.hpp>
+#include <boost/compute/kernel.hpp>
+
+namespace xreg
+{
+
+/// \brief Launches a kernel using the work-group (local) size stored in the
+///        tuning profile of the queue's device.
+///
+/// The kernel is identified in the profile by key, which should not contain
+/// whitespace. When the profile has no entry for the key, the work-group
+/// size is first tuned using TuneOpenCLWorkGroupSize(), unless tuning is
+/// disabled, in which case the OpenCL implementation chooses the size.
+///
+/// The global size is rounded up to a multiple of the work-group size, so
+/// the kernel must ignore work items outside of the requested global size.
+/// Since tuning launches the kernel several times, the kernel must also
+/// produce the same outputs when launched repeatedly with the same arguments.
+/// The event of the final launch is returned and it has not been waited on.
+boost::compute::event EnqueueOpenCLKernelTuned(boost::compute::command_queue& queue,
+                                               boost::compute::kernel& k,
+                                               const std::string& key,
+                                               const std::size_t dim,
+                                               const std::size_t* global_size);
+
+/// \brief Benchmarks candidate work-group sizes of a kernel launch with its
+///        current arguments and stores the fastest in the device's profile.
+///
+/// Candidates are the implementation's choice of size, 1D sizes that are
+/// powers of two, and 2D tiles (with a depth of one for 3D launches). Sizes
+/// exceeding the limits of the kernel or device are not attempted. The
+/// profile is written to OpenCLProgCacheDir(), as tuning-<device ID>.txt,
+/// so that other processes may re-use it. Nothing is done when tuning is
+/// disabled.
+void TuneOpenCLWorkGroupSize(boost::compute::command_queue& queue,
+                             boost::compute::kernel& k,
+                             const std::string& key,
+                             const std::size_t dim,
+                             const std::size_t* global_size);
+
+/// \brief Indicates if the tuning profile of a device has a work-group size
+///        for a kernel key, or if tuning is disabled.
+///
+/// Callers of kernels that do not produce the same outputs when
+/// launched repeatedly may use this to temporarily point output arguments to
+/// scratch buffers before calling TuneOpenCLWorkGroupSize().
+bool IsOpenCLWorkGroupSizeTuned(const boost::compute::device& dev, const std::string& key);
+
+/// \brief Enables or disables the tuning of work-group sizes.
+///
+/// When disabled, sizes already stored in a profile are still used.
+void SetOpenCLAutoTuneEnabled(const bool enabled);
+
+/// \brief Indicates if the tuning of work-group sizes is enabled.
+///
+/// When not explicitly set, tuning is enabled unless the XREG_OPENCL_AUTOTUNE
+/// environment variable is defined as 0.
+bool OpenCLAutoTuneEnabled();
+
+}  // xreg
+
+#endif
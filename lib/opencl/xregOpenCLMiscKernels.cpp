@@ -43,3 +43,30 @@ __kernel void DivideBufElemsOutOfPlace(__global const float* src,
 );
 
 
+
+const char* xreg::WorkGroupSumFnSrc = BOOST_COMPUTE_STRINGIZE_SOURCE(
+float WorkGroupSum(const float x, __local float* scratch)
+{
+  const uint lid = get_local_id(0);
+
+  scratch[lid] = x;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for (uint s = get_local_size(0) / 2; s > 0; s >>= 1)
+  {
+    if (lid < s)
+    {
+      scratch[lid] += scratch[lid + s];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  const float sum = scratch[0];
+
+  // allows the scratch buffer to be reused by a subsequent call
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  return sum;
+}
+
+);
@@ -30,6 +30,15 @@ namespace xreg
 
 extern const char* DivideBufElemsOutOfPlaceKernelSrc;
 
+/// \brief Source of a device function, WorkGroupSum(x, scratch), summing a
+///        value over dimension 0 of a work-group and returning the sum to
+///        every work item.
+///
+/// The local size in dimension 0 must be a power of two and the local
+/// scratch buffer must have an element for each work item. Every work item
+/// must call the function, since it synchronizes the work-group.
+extern const char* WorkGroupSumFnSrc;
+
 }  // xreg
 
 #endif
@@ -0,0 +1,330 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregOpenCLProfiling.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "xregTrace.h"
+
+namespace  // un-named
+{
+
+namespace bc = boost::compute;
+
+/// \brief An event which has been recorded, but may not have finished
+struct NamedEvent
+{
+  std::string name;
+
+  bc::event e;
+
+  // "ocl-kernel" or "ocl-transfer"
+  const char* cat;
+
+  // add the execution time to the kernel profile
+  bool accum_time;
+
+  // record a trace event once finished
+  bool trace;
+
+  // the trace timestamp at the time this event was recorded, this is used
+  // to map the device timestamps onto the host timeline
+  double host_us;
+};
+
+/// \brief Execution times of a kernel in seconds
+struct KernelTimes
+{
+  std::size_t num_launches = 0;
+
+  double tot_secs = 0;
+
+  double min_secs = std::numeric_limits<double>::max();
+  double max_secs = 0;
+};
+
+/// \brief The number of un-finished events that are kept before checking
+///        which events have finished.
+constexpr std::size_t kMAX_NUM_PENDING_EVENTS = 64;
+
+std::mutex prof_mutex;
+
+bool prof_enabled_set = false;
+
+bool prof_enabled = false;
+
+bool prof_enabled_from_env = false;
+
+bool print_at_exit_registered = false;
+
+bool flush_trace_at_exit_registered = false;
+
+std::map<cl_command_queue,std::string> trace_track_names;
+
+std::vector<NamedEvent> pending_events;
+
+std::map<std::string,KernelTimes> kernel_times;
+
+/// \brief The name of the trace track of the command queue an event was
+///        enqueued on, prof_mutex must be held by the caller.
+const std::string& TraceTrackName(const bc::event& e)
+{
+  const cl_command_queue q = e.get_info<cl_command_queue>(CL_EVENT_COMMAND_QUEUE);
+
+  auto it = trace_track_names.find(q);
+
+  if (it == trace_track_names.end())
+  {
+    const std::string dev_name = bc::command_queue(q).get_device().name();
+
+    it = trace_track_names.insert(std::make_pair(q,
+            fmt::format("OpenCL queue {} ({})", trace_track_names.size(), dev_name))).first;
+  }
+
+  return it->second;
+}
+
+/// \brief Adds the execution time of a finished event, prof_mutex must
+///        be held by the caller.
+void AccumEvent(const NamedEvent& e)
+{
+  double secs = 0;
+
+  try
+  {
+    secs = e.e.duration<std::chrono::duration<double>>().count();
+
+    if (e.trace)
+    {
+      const cl_ulong queued_ns = e.e.get_profiling_info<cl_ulong>(CL_PROFILING_COMMAND_QUEUED);
+      const cl_ulong start_ns  = e.e.get_profiling_info<cl_ulong>(CL_PROFILING_COMMAND_START);
+
+      // device timestamps are relative to the time the command was queued,
+      // which is approximately the time it was recorded on the host
+      xreg::RecordTraceTrackEvent(TraceTrackName(e.e), e.name, e.cat,
+                            e.host_us + ((start_ns - queued_ns) * 1.0e-3), secs * 1.0e6);
+    }
+  }
+  catch (bc::opencl_error&)
+  {
+    // the queue does not have profiling enabled, or the kernel failed
+    return;
+  }
+
+  if (!e.accum_time)
+  {
+    return;
+  }
+
+  KernelTimes& t = kernel_times[e.name];
+
+  ++t.num_launches;
+
+  t.tot_secs += secs;
+  t.min_secs  = std::min(t.min_secs, secs);
+  t.max_secs  = std::max(t.max_secs, secs);
+}
+
+/// \brief Adds the execution times of finished events and removes them from
+///        the collection of pending events, prof_mutex must be held by
+///        the caller.
+void AccumFinishedEvents(const bool wait_for_all)
+{
+  auto pending_end = std::remove_if(pending_events.begin(), pending_events.end(),
+                       [wait_for_all] (const NamedEvent& e)
+                       {
+                         bool finished = true;
+
+                         if (wait_for_all)
+                         {
+                           e.e.wait();
+                         }
+                         else
+                         {
+                           // negative values indicate an error, which will
+                           // fail to report a time
+                           finished = e.e.status() <= CL_COMPLETE;
+                         }
+
+                         if (finished)
+                         {
+                           AccumEvent(e);
+                         }
+
+                         return finished;
+                       });
+
+  pending_events.erase(pending_end, pending_events.end());
+}
+
+void PrintProfileAtExit()
+{
+  xreg::PrintOpenCLKernelProfile(std::cerr);
+}
+
+void FlushTraceEventsAtExit()
+{
+  xreg::FlushOpenCLTraceEvents();
+}
+
+/// \brief Adds an event to the collection of pending events.
+void RecordEvent(const std::string& name, const bc::event& e, const char* cat,
+                 const bool accum_time)
+{
+  const bool trace = xreg::TracingEnabled();
+
+  if (!(accum_time || trace) || !e.get())
+  {
+    return;
+  }
+
+  const double host_us = trace ? xreg::TraceTimestampMicros() : 0.0;
+
+  std::lock_guard<std::mutex> lock(prof_mutex);
+
+  if (accum_time && prof_enabled_from_env && !print_at_exit_registered)
+  {
+    std::atexit(PrintProfileAtExit);
+
+    print_at_exit_registered = true;
+  }
+
+  if (trace && !flush_trace_at_exit_registered)
+  {
+    // registered after the trace is setup, so this is called before a
+    // trace specified by the environment is written at exit
+    std::atexit(FlushTraceEventsAtExit);
+
+    flush_trace_at_exit_registered = true;
+  }
+
+  pending_events.push_back(NamedEvent{ name, e, cat, accum_time, trace, host_us });
+
+  if (pending_events.size() > kMAX_NUM_PENDING_EVENTS)
+  {
+    AccumFinishedEvents(false);
+  }
+}
+
+}  // un-named
+
+bool xreg::OpenCLProfilingEnabled()
+{
+  std::lock_guard<std::mutex> lock(prof_mutex);
+
+  if (!prof_enabled_set)
+  {
+    const char* env_val = std::getenv("XREG_OPENCL_PROFILE");
+
+    prof_enabled = env_val && (std::string(env_val) != "0");
+
+    prof_enabled_from_env = prof_enabled;
+
+    prof_enabled_set = true;
+  }
+
+  return prof_enabled;
+}
+
+void xreg::SetOpenCLProfilingEnabled(const bool enabled)
+{
+  std::lock_guard<std::mutex> lock(prof_mutex);
+
+  prof_enabled     = enabled;
+  prof_enabled_set = true;
+
+  prof_enabled_from_env = false;
+}
+
+boost::compute::command_queue
+xreg::MakeOpenCLCmdQueue(const boost::compute::context& ctx,
+                         const boost::compute::device& dev)
+{
+  return bc::command_queue(ctx, dev, (OpenCLProfilingEnabled() || TracingEnabled()) ?
+                                       bc::command_queue::enable_profiling : 0);
+}
+
+void xreg::RecordOpenCLKernelEvent(const std::string& name, const boost::compute::event& e)
+{
+  RecordEvent(name, e, "ocl-kernel", OpenCLProfilingEnabled());
+}
+
+void xreg::RecordOpenCLTransferEvent(const std::string& name, const boost::compute::event& e)
+{
+  RecordEvent(name, e, "ocl-transfer", false);
+}
+
+void xreg::FlushOpenCLTraceEvents()
+{
+  std::lock_guard<std::mutex> lock(prof_mutex);
+
+  AccumFinishedEvents(true);
+}
+
+void xreg::PrintOpenCLKernelProfile(std::ostream& out)
+{
+  std::lock_guard<std::mutex> lock(prof_mutex);
+
+  AccumFinishedEvents(true);
+
+  if (kernel_times.empty())
+  {
+    return;
+  }
+
+  out << fmt::format("{:<48} {:>10} {:>12} {:>12} {:>12} {:>12}\n",
+                     "OpenCL Kernel", "Launches", "Total (ms)", "Mean (ms)",
+                     "Min (ms)", "Max (ms)");
+
+  for (const auto& kv : kernel_times)
+  {
+    const KernelTimes& t = kv.second;
+
+    out << fmt::format("{:<48} {:>10} {:>12.3f} {:>12.4f} {:>12.4f} {:>12.4f}\n",
+                       kv.first, t.num_launches, t.tot_secs * 1000.0,
+                       (t.tot_secs * 1000.0) / t.num_launches,
+                       t.min_secs * 1000.0, t.max_secs * 1000.0);
+  }
+
+  out.flush();
+}
+
+void xreg::ResetOpenCLKernelProfile()
+{
+  std::lock_guard<std::mutex> lock(prof_mutex);
+
+  pending_events.clear();
+  kernel_times.clear();
+}
@@ -0,0 +1,93 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGOPENCLPROFILING_H_
+#define XREGOPENCLPROFILING_H_
+
+#include <iosfwd>
+#include <string>
+
+#include <boost/compute/command_queue.hpp>
+#include <boost/compute/context.hpp>
+#include <boost/compute/device.hpp>
+#include <boost/compute/event.hpp>
+
+namespace xreg
+{
+
+/// \brief Indicates if the execution times of OpenCL kernels are recorded.
+///
+/// When not explicitly set, profiling is enabled when the XREG_OPENCL_PROFILE
+/// environment variable is defined and is not 0. The recorded times are
+/// printed to std::cerr at exit when profiling is enabled by the environment
+/// variable.
+bool OpenCLProfilingEnabled();
+
+/// \brief Enables or disables recording the execution times of OpenCL
+///        kernels.
+///
+/// Only command queues created after enabling profiling are able to record
+/// execution times.
+void SetOpenCLProfilingEnabled(const bool enabled);
+
+/// \brief Creates a command queue for a device, which may be used for
+///        profiling when profiling or tracing (see xregTrace.h) is enabled.
+boost::compute::command_queue MakeOpenCLCmdQueue(const boost::compute::context& ctx,
+                                                 const boost::compute::device& dev);
+
+/// \brief Records the execution time of a kernel launch, identified by name.
+///
+/// The time is retrieved once the kernel has finished, so this does not wait
+/// for the kernel. Nothing is recorded when profiling is disabled, or the
+/// kernel was enqueued on a queue without profiling enabled.
+/// When tracing is enabled, the kernel is also recorded as a trace event on a
+/// track corresponding to its command queue.
+void RecordOpenCLKernelEvent(const std::string& name, const boost::compute::event& e);
+
+/// \brief Records a transfer between the host and device as a trace event on
+///        a track corresponding to its command queue.
+///
+/// Nothing is recorded when tracing is disabled. Transfers are not included
+/// in the kernel execution times.
+void RecordOpenCLTransferEvent(const std::string& name, const boost::compute::event& e);
+
+/// \brief Waits for any recorded kernels and transfers which have not yet
+///        finished and adds them to the trace.
+///
+/// This should be called before writing a trace, a trace written at exit
+/// (via the XREG_TRACE environment variable) is flushed automatically.
+void FlushOpenCLTraceEvents();
+
+/// \brief Prints the number of launches along with the total, mean, minimum
+///        and maximum execution times of each kernel recorded.
+///
+/// This waits for any recorded kernels which have not yet finished.
+void PrintOpenCLKernelProfile(std::ostream& out);
+
+/// \brief Discards all recorded execution times.
+void ResetOpenCLKernelProfile();
+
+}  // xreg
+
+#endif
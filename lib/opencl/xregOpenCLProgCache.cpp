@@ -0,0 +1,383 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregOpenCLProgCache.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <future>
+#include <iterator>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/compute/platform.hpp>
+
+#include <fmt/format.h>
+
+#include "xregFilesystemUtils.h"
+#include "xregHashUtils.h"
+
+namespace  // un-named
+{
+
+std::mutex cache_dir_mutex;
+
+bool cache_dir_set = false;
+
+std::string cache_dir;
+
+/// \brief The maximum number of programs kept in memory, the least recently
+///        used programs are released first.
+constexpr std::size_t kMAX_NUM_MEM_CACHE_PROGS = 64;
+
+struct MemCacheEntry
+{
+  // retained by the entry, so that the handle in the key is not reused by
+  // another context while the entry exists
+  boost::compute::context ctx;
+
+  std::shared_future<boost::compute::program> prog;
+
+  std::list<std::string>::iterator lru_it;
+};
+
+std::mutex mem_cache_mutex;
+
+/// \brief Programs which are built, or being built, keyed by context, build
+///        options and source
+std::unordered_map<std::string,MemCacheEntry> mem_cache;
+
+/// \brief The keys of mem_cache, from least to most recently used
+std::list<std::string> mem_cache_lru;
+
+bool IsReady(const std::shared_future<boost::compute::program>& f)
+{
+  return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+/// \brief Releases the least recently used programs until the maximum number
+///        is not exceeded, programs still being built are not released.
+///
+/// mem_cache_mutex must be locked by the caller.
+void EvictMemCacheProgs()
+{
+  auto lru_it = mem_cache_lru.begin();
+
+  while ((mem_cache.size() > kMAX_NUM_MEM_CACHE_PROGS) && (lru_it != mem_cache_lru.end()))
+  {
+    auto it = mem_cache.find(*lru_it);
+
+    if (IsReady(it->second.prog))
+    {
+      mem_cache.erase(it);
+      lru_it = mem_cache_lru.erase(lru_it);
+    }
+    else
+    {
+      ++lru_it;
+    }
+  }
+}
+
+/// \brief Removes an entry of the memory cache.
+///
+/// mem_cache_mutex must be locked by the caller.
+void EraseMemCacheEntry(std::unordered_map<std::string,MemCacheEntry>::iterator it)
+{
+  mem_cache_lru.erase(it->second.lru_it);
+  mem_cache.erase(it);
+}
+
+/// \brief The path of the cached binary of a program for a device.
+std::string CachedProgPath(const std::string& dir, const std::string& src,
+                           const std::string& build_opts,
+                           const boost::compute::device& dev)
+{
+  xreg::Hasher64 h;
+
+  for (const std::string& s : { src, build_opts, xreg::OpenCLDeviceID(dev) })
+  {
+    h.add_str(s);
+  }
+
+  xreg::Path p(dir);
+  p += h.str() + ".bin";
+
+  return p.string();
+}
+
+bool ReadBinaryFile(const std::string& path, std::vector<unsigned char>* buf)
+{
+  std::ifstream in(path.c_str(), std::ifstream::binary);
+
+  if (in.good())
+  {
+    buf->assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+
+  return in.good() || in.eof();
+}
+
+/// \brief Writes to a temporary file which is then moved into place, so that
+///        other processes do not read a partially written binary.
+void WriteBinaryFile(const std::string& path, const std::vector<unsigned char>& buf)
+{
+  const std::string tmp_path = xreg::MakeUniqueTmpPath(path);
+
+  {
+    std::ofstream out(tmp_path.c_str(), std::ofstream::binary);
+    out.write(reinterpret_cast<const char*>(buf.data()), buf.size());
+
+    if (!out.good())
+    {
+      out.close();
+      std::remove(tmp_path.c_str());
+      return;
+    }
+  }
+
+  xreg::MoveFileSystemItem(tmp_path, path);
+}
+
+boost::compute::program BuildOpenCLProgNoMemCache(const std::string& src,
+                                                  const boost::compute::context& ctx,
+                                                  const std::string& build_opts)
+{
+  namespace bc = boost::compute;
+
+  using xreg::Path;
+  using xreg::OpenCLProgCacheDir;
+  using xreg::MakeDirRecursive;
+
+  const std::string dir = OpenCLProgCacheDir();
+
+  const bool use_cache = !dir.empty() && (ctx.get_devices().size() == 1);
+
+  std::string bin_path;
+
+  if (use_cache)
+  {
+    bin_path = CachedProgPath(dir, src, build_opts, ctx.get_device());
+
+    std::vector<unsigned char> bin;
+
+    if (Path(bin_path).exists() && ReadBinaryFile(bin_path, &bin) && !bin.empty())
+    {
+      try
+      {
+        bc::program prog = bc::program::create_with_binary(bin, ctx);
+        prog.build(build_opts);
+
+        return prog;
+      }
+      catch (bc::opencl_error&)
+      {
+        // the binary is invalid (e.g. corrupt), rebuild from source and replace it
+      }
+    }
+  }
+
+  bc::program prog = bc::program::create_with_source(src, ctx);
+
+  try
+  {
+    prog.build(build_opts);
+  }
+  catch (bc::opencl_error&)
+  {
+    std::cerr << "OpenCL Kernel Compile Error:\n" << prog.build_log() << std::endl;
+    throw;
+  }
+
+  if (use_cache)
+  {
+    // failing to write to the cache only results in rebuilding next time
+    try
+    {
+      MakeDirRecursive(dir);
+
+      WriteBinaryFile(bin_path, prog.binary());
+    }
+    catch (...)
+    { }
+  }
+
+  return prog;
+}
+
+}  // un-named
+
+boost::compute::program xreg::BuildOpenCLProg(const std::string& src,
+                                              const boost::compute::context& ctx,
+                                              const std::string& build_opts)
+{
+  // the entry retains the context, so the handle is not reused by another
+  // context while the entry exists
+  const std::string key = fmt::format("{}\n{}\n", static_cast<const void*>(ctx.get()), build_opts)
+                            + src;
+
+  std::promise<boost::compute::program> prom;
+
+  std::shared_future<boost::compute::program> fut;
+
+  {
+    std::lock_guard<std::mutex> lock(mem_cache_mutex);
+
+    auto it = mem_cache.find(key);
+
+    if (it != mem_cache.end())
+    {
+      fut = it->second.prog;
+
+      mem_cache_lru.splice(mem_cache_lru.end(), mem_cache_lru, it->second.lru_it);
+    }
+    else
+    {
+      MemCacheEntry& e = mem_cache[key];
+
+      e.ctx    = ctx;
+      e.prog   = prom.get_future().share();
+      e.lru_it = mem_cache_lru.insert(mem_cache_lru.end(), key);
+
+      EvictMemCacheProgs();
+    }
+  }
+
+  if (fut.valid())
+  {
+    // built, or being built by another thread
+    return fut.get();
+  }
+
+  try
+  {
+    boost::compute::program prog = BuildOpenCLProgNoMemCache(src, ctx, build_opts);
+
+    prom.set_value(prog);
+
+    return prog;
+  }
+  catch (...)
+  {
+    // the entry is removed before it is ready, so it cannot have been evicted,
+    // or cleared, and replaced by another build
+    {
+      std::lock_guard<std::mutex> lock(mem_cache_mutex);
+      EraseMemCacheEntry(mem_cache.find(key));
+    }
+
+    // waiting callers also receive the error, the next call attempts the build again
+    prom.set_exception(std::current_exception());
+
+    throw;
+  }
+}
+
+void xreg::ClearOpenCLProgMemCache()
+{
+  std::lock_guard<std::mutex> lock(mem_cache_mutex);
+
+  for (auto it = mem_cache.begin(); it != mem_cache.end(); )
+  {
+    auto cur_it = it++;
+
+    // a program still being built is kept, its entry is removed by the
+    // building thread when the build fails
+    if (IsReady(cur_it->second.prog))
+    {
+      EraseMemCacheEntry(cur_it);
+    }
+  }
+}
+
+void xreg::ClearOpenCLProgMemCache(const boost::compute::context& ctx)
+{
+  std::lock_guard<std::mutex> lock(mem_cache_mutex);
+
+  for (auto it = mem_cache.begin(); it != mem_cache.end(); )
+  {
+    auto cur_it = it++;
+
+    // a program still being built is kept, its entry is removed by the
+    // building thread when the build fails
+    if ((cur_it->second.ctx == ctx) && IsReady(cur_it->second.prog))
+    {
+      EraseMemCacheEntry(cur_it);
+    }
+  }
+}
+
+void xreg::SetOpenCLProgCacheDir(const std::string& dir)
+{
+  std::lock_guard<std::mutex> lock(cache_dir_mutex);
+
+  cache_dir     = dir;
+  cache_dir_set = true;
+}
+
+std::string xreg::OpenCLProgCacheDir()
+{
+  std::lock_guard<std::mutex> lock(cache_dir_mutex);
+
+  if (!cache_dir_set)
+  {
+    if (const char* env_dir = std::getenv("XREG_OPENCL_CACHE_DIR"))
+    {
+      cache_dir = env_dir;
+    }
+    else if (const char* home_dir = std::getenv("HOME"))
+    {
+      Path p(home_dir);
+      p += ".cache";
+      p += "xreg";
+      p += "opencl";
+
+      cache_dir = p.string();
+    }
+
+    cache_dir_set = true;
+  }
+
+  return cache_dir;
+}
+
+std::string xreg::OpenCLDeviceID(const boost::compute::device& dev)
+{
+  Hasher64 h;
+
+  for (const std::string& s : { dev.name(), dev.vendor(), dev.version(), dev.driver_version(),
+                                dev.platform().name(), dev.platform().version() })
+  {
+    h.add_str(s);
+  }
+
+  return h.str();
+}
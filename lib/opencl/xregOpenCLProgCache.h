@@ -0,0 +1,93 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGOPENCLPROGCACHE_H_
+#define XREGOPENCLPROGCACHE_H_
+
+#include <string>
+
+#include <boost/compute/context.hpp>
+#include <boost/compute/device.hpp>
+#include <boost/compute/program.hpp>
+
+namespace xreg
+{
+
+/// \brief Creates and builds an OpenCL program, reusing a compiled binary
+///        stored on disk when available.
+///
+/// Binaries are stored in the cache directory (see OpenCLProgCacheDir()),
+/// keyed by a hash of the source, build options, device and driver version.
+/// The program is built from source when there is no cached binary, the
+/// cached binary fails to build, the cache is disabled, or the context has
+/// more than one device. A program built from source is added to the cache.
+/// The build log is printed to std::cerr when compiling the source fails.
+///
+/// Programs are also kept in memory for each context, so that building the
+/// same program again (e.g. by another object, or after it was built ahead of
+/// time on a background thread) does not repeat any work. Concurrent calls
+/// building the same program wait for a single build. At most 64 programs are
+/// kept in memory, the least recently used are released first. This may be
+/// called from any thread.
+boost::compute::program BuildOpenCLProg(const std::string& src,
+                                        const boost::compute::context& ctx,
+                                        const std::string& build_opts = std::string());
+
+/// \brief Releases the programs kept in memory by BuildOpenCLProg().
+///
+/// The cache retains the contexts of the programs, so this allows the
+/// contexts to be released as well. Programs still being built are not
+/// released.
+void ClearOpenCLProgMemCache();
+
+/// \brief Releases the programs of a context kept in memory by
+///        BuildOpenCLProg().
+///
+/// This should be called when a context is no longer used, so that the cache
+/// does not keep it alive. Programs still being built are not released.
+void ClearOpenCLProgMemCache(const boost::compute::context& ctx);
+
+/// \brief Sets the directory used to store compiled OpenCL programs.
+///
+/// An empty path disables the cache.
+void SetOpenCLProgCacheDir(const std::string& dir);
+
+/// \brief The directory used to store compiled OpenCL programs.
+///
+/// When a directory has not been set, this is the value of the
+/// XREG_OPENCL_CACHE_DIR environment variable, when it is defined, or
+/// $HOME/.cache/xreg/opencl otherwise. An empty path indicates that the cache
+/// is disabled.
+std::string OpenCLProgCacheDir();
+
+/// \brief A string identifying a device and its driver, suitable for use in
+///        the file names of cached data specific to a device.
+///
+/// This is a hexadecimal hash of the device name, vendor, version, driver
+/// version and platform.
+std::string OpenCLDeviceID(const boost::compute::device& dev);
+
+}  // xreg
+
+#endif
@@ -24,6 +24,8 @@
 
 #include "xregOpenCLSys.h"
 
+#include <mutex>
+
 #include <boost/compute/system.hpp>
 
 #include "xregStringUtils.h"
@@ -82,3 +84,28 @@ std::vector<std::string> xreg::DevIDStrs(const bool use_cpu)
   return id_strs;
 }
 
+
+boost::compute::context xreg::SharedOpenCLContext(const boost::compute::device& dev)
+{
+  static std::mutex ctxs_mutex;
+
+  // never freed, so that the contexts are not released during static
+  // destruction, after the OpenCL implementation may have been unloaded
+  static auto* ctxs = new std::map<cl_device_id,boost::compute::context>;
+
+  std::lock_guard<std::mutex> lock(ctxs_mutex);
+
+  auto it = ctxs->find(dev.id());
+
+  if (it == ctxs->end())
+  {
+    it = ctxs->emplace(dev.id(), boost::compute::context(dev)).first;
+  }
+
+  return it->second;
+}
+
+boost::compute::context xreg::SharedOpenCLContext()
+{
+  return SharedOpenCLContext(boost::compute::system::default_device());
+}
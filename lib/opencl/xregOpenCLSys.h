@@ -34,6 +34,7 @@
 #include <CL/opencl.h>
 #endif
 
+#include <boost/compute/context.hpp>
 #include <boost/compute/device.hpp>
 
 namespace xreg
@@ -52,6 +53,19 @@ OpenCLNameDevMap BuildDevIDStrsToDevMap();
 /// \see BuildDevIDStrsToDevMap
 std::vector<std::string> DevIDStrs(const bool use_cpu);
 
+/// \brief Retrieves the OpenCL context shared by all objects using a device.
+///
+/// The context is created the first time a device is requested, and the same
+/// context is returned for every subsequent request. Ray casters, similarity
+/// metrics and ViennaCL operations that are created for the same device will
+/// therefore share a context, and may use each other's buffers without copies
+/// through the host. This is thread-safe.
+boost::compute::context SharedOpenCLContext(const boost::compute::device& dev);
+
+/// \brief Retrieves the OpenCL context shared by all objects using the
+///        default device.
+boost::compute::context SharedOpenCLContext();
+
 }  // xreg
 
 #endif
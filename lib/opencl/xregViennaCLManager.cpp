@@ -24,26 +24,69 @@
 
 #include "xregViennaCLManager.h"
 
+#include <map>
+#include <mutex>
 #include <tuple>
 
 #include <boost/container/flat_set.hpp>
 
 #include <viennacl/ocl/backend.hpp>
 
+namespace  // un-named
+{
+
+using VCLInitKey = std::tuple<long,cl_context,cl_command_queue>;
+
+std::mutex vcl_init_mutex;
+
+boost::container::flat_set<VCLInitKey> vcl_init_set;
+
+// must be called with vcl_init_mutex locked
+void SetupVCLCtxIfNeededNoLock(const long vcl_ctx,
+                               const boost::compute::context& ctx,
+                               const boost::compute::command_queue& queue)
+{
+  const VCLInitKey k(vcl_ctx,ctx.get(),queue.get());
+
+  if (vcl_init_set.find(k) == vcl_init_set.end())
+  {
+    viennacl::ocl::setup_context(vcl_ctx, ctx, queue.get_device().id(), queue);
+    vcl_init_set.insert(k);
+  }
+}
+
+}  // un-named
+
 void xreg::setup_vcl_ctx_if_needed(const long vcl_ctx,
                                    const boost::compute::context& ctx,
                                    const boost::compute::command_queue& queue)
 {
-  using Key = std::tuple<long,cl_context,cl_command_queue>;
+  std::lock_guard<std::mutex> lock(vcl_init_mutex);
 
-  static boost::container::flat_set<Key> init_set;
-  
-  Key k(vcl_ctx,ctx.get(),queue.get());
+  SetupVCLCtxIfNeededNoLock(vcl_ctx, ctx, queue);
+}
+
+long xreg::ViennaCLCtxIdx(const boost::compute::context& ctx,
+                          const boost::compute::command_queue& queue)
+{
+  using Key = std::tuple<cl_context,cl_command_queue>;
+
+  static std::map<Key,long> ctx_inds;
+
+  std::lock_guard<std::mutex> lock(vcl_init_mutex);
+
+  const Key k(ctx.get(), queue.get());
 
-  if (init_set.find(k) == init_set.end())
+  auto it = ctx_inds.find(k);
+
+  if (it == ctx_inds.end())
   {
-    viennacl::ocl::setup_context(vcl_ctx, ctx, ctx.get_device().id(), queue);
-    init_set.insert(k);
+    const long vcl_ctx = static_cast<long>(ctx_inds.size()) + 1;
+
+    SetupVCLCtxIfNeededNoLock(vcl_ctx, ctx, queue);
+
+    it = ctx_inds.emplace(k, vcl_ctx).first;
   }
-}
 
+  return it->second;
+}
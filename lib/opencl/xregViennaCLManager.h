@@ -31,10 +31,25 @@
 namespace xreg
 {
 
+/// \brief Sets up a ViennaCL context index to use an OpenCL context and
+///        command queue, if it has not already been setup to use them.
+///
+/// This is thread-safe.
 void setup_vcl_ctx_if_needed(const long vcl_ctx,
                              const boost::compute::context& ctx,
                              const boost::compute::command_queue& queue);
 
+/// \brief Retrieves the ViennaCL context index which operates on an OpenCL
+///        context and command queue, setting up a new index when needed.
+///
+/// Each pair of OpenCL context and command queue is assigned a single index,
+/// so ViennaCL operations are enqueued on the caller's queue and may use any
+/// buffer allocated in the OpenCL context (e.g. ray caster projections and
+/// similarity metric buffers) without copies. Indices are assigned starting
+/// at 1; index 0 is left for ViennaCL's default context. This is thread-safe.
+long ViennaCLCtxIdx(const boost::compute::context& ctx,
+                    const boost::compute::command_queue& queue);
+
 }  // xreg
 
 #endif
@@ -87,27 +87,59 @@ cv::Mat xreg::OverlayEdges(const cv::Mat& base_img, const cv::Mat& edge_img,
     cv::cvtColor(base_img, dst_img, XREG_CV_GRAY2BGR);
   }
 
-  for (int r = 0; r < nr; ++r)
-  {
-    unsigned char* dst_row = &dst_img.at<unsigned char>(r,0);
-    const unsigned char* edge_row = &edge_img.at<unsigned char>(r,0);
+  const unsigned char blue_val  = (edge_channel == 0) ? 255 : 0;
+  const unsigned char green_val = (edge_channel == 1) ? 255 : 0;
+  const unsigned char red_val   = (edge_channel == 2) ? 255 : 0;
 
-    for (int c = 0; c < nc; ++c)
+  auto overlay_rows_fn = [&] (const RangeType& rows)
+  {
+    for (int r = static_cast<int>(rows.begin()); r < static_cast<int>(rows.end()); ++r)
     {
-      if (edge_row[c])
+      unsigned char* dst_row = &dst_img.at<unsigned char>(r,0);
+      const unsigned char* edge_row = &edge_img.at<unsigned char>(r,0);
+
+      // select using masks instead of branching, so that the row may be vectorized
+      for (int c = 0; c < nc; ++c)
       {
+        const unsigned char m = edge_row[c] ? 0xFF : 0;
+
         const int off = 3 * c;
 
-        dst_row[off + 0] = (edge_channel == 0) ? 255 : 0;    // B
-        dst_row[off + 1] = (edge_channel == 1) ? 255 : 0;    // G
-        dst_row[off + 2] = (edge_channel == 2) ? 255 : 0;  // R
+        dst_row[off + 0] = (dst_row[off + 0] & ~m) | (blue_val  & m);  // B
+        dst_row[off + 1] = (dst_row[off + 1] & ~m) | (green_val & m);  // G
+        dst_row[off + 2] = (dst_row[off + 2] & ~m) | (red_val   & m);  // R
       }
     }
-  }
+  };
+
+  ParallelFor(overlay_rows_fn, RangeType(0, nr));
 
   return dst_img;
 }
 
+std::vector<cv::Mat> xreg::OverlayEdges(const std::vector<cv::Mat>& base_imgs,
+                                        const std::vector<cv::Mat>& edge_imgs,
+                                        const unsigned int edge_channel)
+{
+  const size_type num_imgs = base_imgs.size();
+
+  xregASSERT(num_imgs == edge_imgs.size());
+
+  std::vector<cv::Mat> dst_imgs(num_imgs);
+
+  auto overlay_fn = [&] (const RangeType& r)
+  {
+    for (size_type i = r.begin(); i < r.end(); ++i)
+    {
+      dst_imgs[i] = OverlayEdges(base_imgs[i], edge_imgs[i], edge_channel);
+    }
+  };
+
+  ParallelFor(overlay_fn, RangeType(0, num_imgs));
+
+  return dst_imgs;
+}
+
 cv::Mat xreg::OverlayRectBoundary(const cv::Mat& base_img, const cv::Rect& rect,
                                   const unsigned int edge_channel)
 {
@@ -219,67 +251,77 @@ std::vector<cv::Mat> xreg::CreateSummaryTiledImages(const std::vector<cv::Mat>&
 
   std::vector<cv::Mat> dst_imgs(num_summary_imgs);
 
-  size_type src_img_idx = 0;
-  for (size_type summary_img_idx = 0; summary_img_idx < num_summary_imgs; ++summary_img_idx)
+  const size_type num_tiles_per_summary_img = num_tile_rows * num_tile_cols;
+
+  // each summary image is independent of the others, so they are created
+  // concurrently
+  auto create_summary_fn = [&] (const RangeType& r)
   {
-    // this is BGR
-    cv::Mat sum_img(summary_img_num_rows, summary_img_num_cols, CV_8UC3);
+    for (size_type summary_img_idx = r.begin(); summary_img_idx < r.end(); ++summary_img_idx)
+    {
+      size_type src_img_idx = summary_img_idx * num_tiles_per_summary_img;
 
-    cv::Rect roi;
+      // this is BGR
+      cv::Mat sum_img(summary_img_num_rows, summary_img_num_cols, CV_8UC3);
 
-    sum_img.setTo(0);
+      cv::Rect roi;
 
-    for (size_type tile_row = 0; (tile_row < num_tile_rows) && (src_img_idx < num_src_imgs); ++tile_row)
-    {
-      roi.y = tile_row * roi_num_rows;
+      sum_img.setTo(0);
 
-      for (size_type tile_col = 0; (tile_col < num_tile_cols) && (src_img_idx < num_src_imgs); ++tile_col)
+      for (size_type tile_row = 0; (tile_row < num_tile_rows) && (src_img_idx < num_src_imgs); ++tile_row)
       {
-        roi.x = tile_col * roi_num_cols;
+        roi.y = tile_row * roi_num_rows;
 
-        cv::Mat cur_img;
+        for (size_type tile_col = 0; (tile_col < num_tile_cols) && (src_img_idx < num_src_imgs); ++tile_col)
+        {
+          roi.x = tile_col * roi_num_cols;
 
-        const size_type cur_img_nr = src_imgs[src_img_idx].rows;
-        const size_type cur_img_nc = src_imgs[src_img_idx].cols;
+          cv::Mat cur_img;
 
-        if (src_imgs[src_img_idx].type() == CV_8UC3)
-        {
-          cur_img = src_imgs[src_img_idx];
-        }
-        else  // Assuming everything else is grayscale!!!
-        {
-          cur_img = cv::Mat(cur_img_nr, cur_img_nc, CV_8UC3);
-          cv::cvtColor(src_imgs[src_img_idx], cur_img, XREG_CV_GRAY2BGR);
-        }
+          const size_type cur_img_nr = src_imgs[src_img_idx].rows;
+          const size_type cur_img_nc = src_imgs[src_img_idx].cols;
 
-        // it may be that the image is smaller than the tile
-        roi.width  = cur_img_nc;
-        roi.height = cur_img_nr;
-        cur_img.copyTo(sum_img(roi));
+          if (src_imgs[src_img_idx].type() == CV_8UC3)
+          {
+            cur_img = src_imgs[src_img_idx];
+          }
+          else  // Assuming everything else is grayscale!!!
+          {
+            cur_img = cv::Mat(cur_img_nr, cur_img_nc, CV_8UC3);
+            cv::cvtColor(src_imgs[src_img_idx], cur_img, XREG_CV_GRAY2BGR);
+          }
 
-        // to draw the yellow rectangle, we want to use the full tile size
-        roi.width  = roi_num_cols;
-        roi.height = roi_num_rows;
-        cv::Mat tile_roi_img = sum_img(roi);
+          // it may be that the image is smaller than the tile
+          roi.width  = cur_img_nc;
+          roi.height = cur_img_nr;
+          cur_img.copyTo(sum_img(roi));
 
-        if (border_thickness > 0)
-        {
-          cv::rectangle(tile_roi_img, cv::Rect(0, 0, roi_num_cols, roi_num_rows),
-                        cv::Scalar(0, 255, 255), border_thickness);
-        }
+          // to draw the yellow rectangle, we want to use the full tile size
+          roi.width  = roi_num_cols;
+          roi.height = roi_num_rows;
+          cv::Mat tile_roi_img = sum_img(roi);
 
-        if (has_strs)
-        {
-          cv::putText(tile_roi_img, src_names[src_img_idx], cv::Point(10, 50),
-                      cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(0, 255, 255), 2);
-        }
+          if (border_thickness > 0)
+          {
+            cv::rectangle(tile_roi_img, cv::Rect(0, 0, roi_num_cols, roi_num_rows),
+                          cv::Scalar(0, 255, 255), border_thickness);
+          }
+
+          if (has_strs)
+          {
+            cv::putText(tile_roi_img, src_names[src_img_idx], cv::Point(10, 50),
+                        cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(0, 255, 255), 2);
+          }
 
-        ++src_img_idx;
+          ++src_img_idx;
+        }
       }
+
+      dst_imgs[summary_img_idx] = sum_img;
     }
+  };
 
-    dst_imgs[summary_img_idx] = sum_img;
-  }
+  ParallelFor(create_summary_fn, RangeType(0, num_summary_imgs));
 
   return dst_imgs;
 }
@@ -295,27 +337,36 @@ cv::Mat xreg::Create2CMV(const cv::Mat& img_red, const cv::Mat& img_cyan)
   xregASSERT(nr == img_cyan.rows);
   xregASSERT(nc == img_cyan.cols);
 
-  // bgr image
-  cv::Mat cmv_img(img_red.size(), CV_8UC3);
+  // bgr image, the interleaving is performed by OpenCV's vectorized merge
+  cv::Mat cmv_img;
 
-  for (int r = 0; r < nr; ++r)
-  {
-    unsigned char* dst_row = &cmv_img.at<unsigned char>(r,0);
+  const cv::Mat chans[3] = { img_cyan, img_cyan, img_red };
 
-    const unsigned char* src_red  = &img_red.at<unsigned char>(r,0);
-    const unsigned char* src_cyan = &img_cyan.at<unsigned char>(r,0);
+  cv::merge(chans, 3, cmv_img);
 
-    for (int c = 0; c < nc; ++c)
-    {
-      unsigned char* cur_dst = dst_row + (3 * c);
+  return cmv_img;
+}
+
+std::vector<cv::Mat> xreg::Create2CMV(const std::vector<cv::Mat>& imgs_red,
+                                      const std::vector<cv::Mat>& imgs_cyan)
+{
+  const size_type num_imgs = imgs_red.size();
 
-      cur_dst[0] = src_cyan[c];
-      cur_dst[1] = src_cyan[c];
-      cur_dst[2] = src_red[c];
+  xregASSERT(num_imgs == imgs_cyan.size());
+
+  std::vector<cv::Mat> cmv_imgs(num_imgs);
+
+  auto cmv_fn = [&] (const RangeType& r)
+  {
+    for (size_type i = r.begin(); i < r.end(); ++i)
+    {
+      cmv_imgs[i] = Create2CMV(imgs_red[i], imgs_cyan[i]);
     }
-  }
+  };
 
-  return cmv_img;
+  ParallelFor(cmv_fn, RangeType(0, num_imgs));
+
+  return cmv_imgs;
 }
 
 cv::Mat xreg::AddFlowVecs(const cv::Mat& img_bgr, const cv::Mat& flow,
@@ -53,6 +53,14 @@ void WriteImageRemap8bpp(cv::Mat& img, const std::string& path);
 cv::Mat OverlayEdges(const cv::Mat& base_img, const cv::Mat& edge_img,
                      const unsigned int edge_channel = 2);
 
+/// \brief Overlays edges onto a collection of images.
+///
+/// The ith edge image is overlaid onto the ith base image; the images are
+/// processed concurrently.
+std::vector<cv::Mat> OverlayEdges(const std::vector<cv::Mat>& base_imgs,
+                                  const std::vector<cv::Mat>& edge_imgs,
+                                  const unsigned int edge_channel = 2);
+
 cv::Mat OverlayRectBoundary(const cv::Mat& base_img, const cv::Rect& r,
                             const unsigned int edge_channel = 2);
 
@@ -72,6 +80,11 @@ std::vector<cv::Mat> CreateSummaryTiledImages(const std::vector<cv::Mat>& src_im
 /// \brief Create a basic two-color-multiview image from two gray-level images.
 cv::Mat Create2CMV(const cv::Mat& img_red, const cv::Mat& img_cyan);
 
+/// \brief Create two-color-multiview images from pairs of gray-level images;
+///        the pairs are processed concurrently.
+std::vector<cv::Mat> Create2CMV(const std::vector<cv::Mat>& imgs_red,
+                                const std::vector<cv::Mat>& imgs_cyan);
+
 /// \brief Overlay optical flow vectors on an image.
 cv::Mat AddFlowVecs(const cv::Mat& img_bgr, const cv::Mat& flow,
                     const int flow_subsample = 1, const float vec_scale = 1,
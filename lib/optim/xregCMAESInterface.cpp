@@ -24,9 +24,12 @@
 
 #include "xregCMAESInterface.h"
 
+#include <random>
+
 #include <cmaes_interface.h>
 
 #include "xregAssert.h"
+#include "xregSampleUtils.h"
 
 xreg::CmaesOptimizer::CmaesOptimizer()
 {
@@ -169,16 +172,99 @@ void xreg::CmaesOptimizer::run()
   // call-back optionally implemented by sub-classes
   setup_optimization();
 
-  const size_type dim = init_guess_.size();
-
   num_its_ = 0;
+  num_restarts_ = 0;
+
+  if (restart_strategy_ == kNO_RESTARTS)
+  {
+    sol_ = run_single(init_guess_, init_sigma_, pop_size_, 0).sol;
+  }
+  else
+  {
+    std::mt19937 rng_eng;
+    SeedRNGEngWithRandDev(&rng_eng);
+    
+    // the CMA-ES library requires seeds in [1, 2e9]
+    std::uniform_int_distribution<long> seed_dist(1, 2000000000);
+    
+    std::uniform_real_distribution<double> uni_dist_01(0,1);
+    
+    SingleRunResult best_res = run_single(init_guess_, init_sigma_, pop_size_,
+                                          seed_dist(rng_eng));
+   
+    // BIPOP keeps track of the evaluations spent in each regime and always
+    // announces the next run in the regime that has used fewer evaluations.
+    // The first run counts as the first large population run.
+    size_type num_large_restarts = 0;
+    size_type large_pop_size     = pop_size_;
+
+    size_type large_regime_num_evals = best_res.num_obj_fn_evals;
+    size_type small_regime_num_evals = 0;
+
+    for (; num_restarts_ < max_num_restarts_; ++num_restarts_)
+    {
+      size_type cur_pop_size = pop_size_;
+      Pt cur_sigma = init_sigma_;
+      
+      bool use_large_regime = true;
+
+      if (restart_strategy_ == kBIPOP_RESTARTS)
+      {
+        use_large_regime = large_regime_num_evals <= small_regime_num_evals;
+      }
+
+      if (use_large_regime)
+      {
+        // IPOP: double the population size with each restart
+        ++num_large_restarts;
+        large_pop_size = pop_size_ << num_large_restarts;
+        cur_pop_size = large_pop_size;
+      }
+      else
+      {
+        // BIPOP small regime: a population size between the default and half of
+        // the most recent large population, with a smaller step size
+        const double u = uni_dist_01(rng_eng);
+        
+        cur_pop_size = std::max(size_type(2),
+                                static_cast<size_type>(std::floor(pop_size_ *
+                                      std::pow(0.5 * large_pop_size / pop_size_, u * u))));
+
+        cur_sigma *= std::pow(10.0, -2.0 * uni_dist_01(rng_eng));
+      }
+      
+      const SingleRunResult cur_res = run_single(init_guess_, cur_sigma, cur_pop_size,
+                                                 seed_dist(rng_eng));
+
+      (use_large_regime ? large_regime_num_evals : small_regime_num_evals) +=
+                                                              cur_res.num_obj_fn_evals;
 
-  sol_ = init_guess_;
+      if (cur_res.best_obj_fn_val < best_res.best_obj_fn_val)
+      {
+        best_res = cur_res;
+      }
+    }
+
+    sol_ = best_res.sol;
+  }
+
+  // call-back optionally implemented by sub-classes
+  end_optimization();
+}
+
+xreg::CmaesOptimizer::SingleRunResult
+xreg::CmaesOptimizer::run_single(const Pt& init_guess, const Pt& init_sigma,
+                                 const size_type pop_size, const long seed)
+{
+  const size_type dim = init_guess.size();
 
   // will hold population, but scaled out of optimization space
-  Mat pop_mat(dim, pop_size_);
+  Mat pop_mat(dim, pop_size);
+
+  // only used when an external population objective function is provided
+  PtNList pop_list(pop_obj_fn_ ? pop_size : 0);
 
-  Pt scaled_init_guess = scale_for_opt(init_guess_);
+  Pt scaled_init_guess = scale_for_opt(init_guess);
 
   Pt x_in_bounds;
   if (!run_unc_)
@@ -198,10 +284,10 @@ void xreg::CmaesOptimizer::run()
   memset(&evo, 0, sizeof(evo));
   
   PtN_d tmp_scaled_init_guess = scaled_init_guess.cast<double>();
-  PtN_d tmp_init_sigma        = init_sigma_.cast<double>();
+  PtN_d tmp_init_sigma        = init_sigma.cast<double>();
 
   double* obj_fn_vals = cmaes_init(&evo, static_cast<int>(dim), &tmp_scaled_init_guess(0),
-                                   &tmp_init_sigma(0), 0, static_cast<int>(pop_size_), "non");
+                                   &tmp_init_sigma(0), seed, static_cast<int>(pop_size), "non");
 
   while (!cmaes_TestForTermination(&evo))
   {
@@ -215,7 +301,7 @@ void xreg::CmaesOptimizer::run()
     if (run_unc_)
     {
       // rescale the data from optimization space
-      for (size_type pop_ind = 0; pop_ind < pop_size_; ++pop_ind)
+      for (size_type pop_ind = 0; pop_ind < pop_size; ++pop_ind)
       {
         pop_mat.col(pop_ind) = unscale_from_opt(PtN_d::Map(pop[pop_ind], dim).cast<Scalar>());
       }
@@ -223,7 +309,7 @@ void xreg::CmaesOptimizer::run()
     else
     {
       // rescale from optimization space, then enforce constraints
-      for (size_type pop_ind = 0; pop_ind < pop_size_; ++pop_ind)
+      for (size_type pop_ind = 0; pop_ind < pop_size; ++pop_ind)
       {
         x_in_bounds = unscale_from_opt(PtN_d::Map(pop[pop_ind], dim).cast<Scalar>());
 
@@ -241,26 +327,44 @@ void xreg::CmaesOptimizer::run()
     // for each of the population parameterizations, compute the objective function
     // These options allow an serial evaluation, a parallel for, or something
     // that takes all the parameterizations and does some very smart threading
-    switch (obj_fn_exec_type_)
+    if (pop_obj_fn_)
     {
-    case kENTIRE_POP_OBJ_FN_EVAL:
-    {
-      all_obj_fns(pop_mat, obj_fn_vals);
-      break;
+      for (size_type pop_ind = 0; pop_ind < pop_size; ++pop_ind)
+      {
+        pop_list[pop_ind] = pop_mat.col(pop_ind);
+      }
+
+      const Pt vals = pop_obj_fn_(pop_list);
+      xregASSERT(static_cast<size_type>(vals.size()) == pop_size);
+
+      for (size_type pop_ind = 0; pop_ind < pop_size; ++pop_ind)
+      {
+        obj_fn_vals[pop_ind] = vals[pop_ind];
+      }
     }
-    case kPARALLEL_OBJ_FN_EVAL:
+    else
     {
-      ParallelObjFnObj obj_fn_obj = { this, dim, pop_mat, obj_fn_vals };
-      ParallelFor(obj_fn_obj, xreg::RangeType(0, pop_size_));
-      break;
-    }
-    case kSERIAL_OBJ_FN_EVAL:
-    default:
-      for (size_type cur_pt = 0; cur_pt < pop_size_; ++cur_pt)
+      switch (obj_fn_exec_type_)
+      {
+      case kENTIRE_POP_OBJ_FN_EVAL:
+      {
+        all_obj_fns(pop_mat, obj_fn_vals);
+        break;
+      }
+      case kPARALLEL_OBJ_FN_EVAL:
       {
-        obj_fn_vals[cur_pt] = obj_fn(pop_mat.col(cur_pt));
+        ParallelObjFnObj obj_fn_obj = { this, dim, pop_mat, obj_fn_vals };
+        ParallelFor(obj_fn_obj, xreg::RangeType(0, pop_size));
+        break;
+      }
+      case kSERIAL_OBJ_FN_EVAL:
+      default:
+        for (size_type cur_pt = 0; cur_pt < pop_size; ++cur_pt)
+        {
+          obj_fn_vals[cur_pt] = obj_fn(pop_mat.col(cur_pt));
+        }
+        break;
       }
-      break;
     }
 
     // update the search distribution used for cmaes_SamplePopulation()
@@ -272,14 +376,19 @@ void xreg::CmaesOptimizer::run()
     ++num_its_;
   }
 
+  SingleRunResult res;
+
   // "xbestever" might be used as well
-  sol_ = unscale_from_opt(PtN_d::Map(cmaes_GetPtr(&evo, "xmean"), dim).cast<Scalar>());
+  res.sol = unscale_from_opt(PtN_d::Map(cmaes_GetPtr(&evo, "xmean"), dim).cast<Scalar>());
+
+  res.best_obj_fn_val = cmaes_Get(&evo, "fbestever");
+
+  res.num_obj_fn_evals = static_cast<size_type>(cmaes_Get(&evo, "eval"));
 
   // clean up any memory allocated interally to CMAES
   cmaes_exit(&evo);
 
-  // call-back optionally implemented by sub-classes
-  end_optimization();
+  return res;
 }
   
 const xreg::CmaesOptimizer::Pt& xreg::CmaesOptimizer::sol() const
@@ -319,6 +428,31 @@ void xreg::CmaesOptimizer::set_box_constraints(const Pt& lower, const Pt& upper)
   box_upper_bounds_ = upper;
 }
 
+void xreg::CmaesOptimizer::set_pop_obj_fn(const PopObjFn& pop_obj_fn)
+{
+  pop_obj_fn_ = pop_obj_fn;
+}
+
+void xreg::CmaesOptimizer::set_restart_strategy(const RestartStrategy restart_strategy)
+{
+  restart_strategy_ = restart_strategy;
+}
+
+xreg::CmaesOptimizer::RestartStrategy xreg::CmaesOptimizer::restart_strategy() const
+{
+  return restart_strategy_;
+}
+
+void xreg::CmaesOptimizer::set_max_num_restarts(const size_type max_num_restarts)
+{
+  max_num_restarts_ = max_num_restarts;
+}
+
+xreg::size_type xreg::CmaesOptimizer::num_restarts() const
+{
+  return num_restarts_;
+}
+
 double xreg::CmaesOptimizer::obj_fn(const Pt&)
 {
   throw UnsupportedObjFnException("obj_fn() not implemented!");
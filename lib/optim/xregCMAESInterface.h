@@ -28,6 +28,7 @@
 #include "xregCommon.h"
 #include "xregExceptionUtils.h"
 #include "xregTBBUtils.h"
+#include "xregPopObjFn.h"
 
 namespace xreg
 {
@@ -97,7 +98,54 @@ public:
   /// These are in the un-scaled space (that the user sees when setting guesses, etc.)
   void set_box_constraints(const Pt& lower, const Pt& upper);
 
+  /// \brief Use an objective function that is evaluated at every member of a
+  ///        generation in a single call.
+  ///
+  /// When set, this takes precedence over the objective function methods
+  /// implemented by a sub-class, which allows this class to be used directly
+  /// without sub-classing. Pass an empty function to revert to the sub-class
+  /// methods.
+  void set_pop_obj_fn(const PopObjFn& pop_obj_fn);
+
+  /// \brief Strategies for restarting the optimization after it terminates.
+  ///
+  /// IPOP restarts double the population size with each restart. BIPOP restarts
+  /// alternate between the IPOP regime and a regime using smaller populations
+  /// and step sizes, each restart uses the regime that has used the fewest
+  /// objective function evaluations. The solution with the best objective
+  /// function value over all runs is kept. See "Benchmarking a BI-Population
+  /// CMA-ES on the BBOB-2009 Function Testbed" - Hansen 2009.
+  enum RestartStrategy
+  {
+    kNO_RESTARTS = 0,
+    kIPOP_RESTARTS,
+    kBIPOP_RESTARTS
+  };
+
+  void set_restart_strategy(const RestartStrategy restart_strategy);
+
+  RestartStrategy restart_strategy() const;
+
+  /// \brief The number of restarts performed after the initial run; ignored when
+  ///        no restart strategy is used.
+  void set_max_num_restarts(const size_type max_num_restarts);
+
+  /// \brief The number of restarts performed by the most recent call to run().
+  size_type num_restarts() const;
+
 private:
+  struct SingleRunResult
+  {
+    Pt sol;
+
+    double best_obj_fn_val;
+
+    size_type num_obj_fn_evals;
+  };
+
+  SingleRunResult run_single(const Pt& init_guess, const Pt& init_sigma,
+                             const size_type pop_size, const long seed);
+
   struct ParallelObjFnObj
   {
     CmaesOptimizer* cmaes_opt;
@@ -154,6 +202,15 @@ protected:
   size_type pop_size_;
 
   ObjFnExecType obj_fn_exec_type_;
+
+private:
+  PopObjFn pop_obj_fn_;
+
+  RestartStrategy restart_strategy_ = kNO_RESTARTS;
+
+  size_type max_num_restarts_ = 9;
+
+  size_type num_restarts_ = 0;
 };
 
 }  // xreg
@@ -28,6 +28,92 @@
 
 #include "xregAssert.h"
 #include "xregSampleUtils.h"
+#include "xregTBBUtils.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+// Computes the candidate of population element i
+void MutateAndCrossOver(DifferentialEvolution& de, const size_type i, std::mt19937& rng_eng)
+{
+  const size_type pop_size = de.pop_size;
+  const size_type dim      = de.init_guess.size();
+
+  std::uniform_int_distribution<size_type> pop_idx_uni_dist(0, pop_size - 1);
+  std::uniform_int_distribution<size_type> dim_idx_uni_dist(0, dim - 1);
+  
+  std::uniform_real_distribution<CoordScalar> uni_dist_01(0,1);
+
+  std::uniform_real_distribution<CoordScalar> dither_dist(de.evo_rate, 1);
+
+  const PtN& x = de.cur_pop[i];
+
+  // get random agents from the population
+  size_type r0 = 0;
+  size_type r1 = 0;
+  size_type r2 = 0;
+  
+  // make sure the agents are unique from the current population element and
+  // each other
+  do
+  {
+    r0 = pop_idx_uni_dist(rng_eng);
+  }
+  while (r0 == i);
+  
+  do
+  {
+    r1 = pop_idx_uni_dist(rng_eng);
+  }
+  while ((r1 == i) || (r1 == r0));
+  
+  do
+  {
+    r2 = pop_idx_uni_dist(rng_eng);
+  }
+  while ((r2 == i) || (r2 == r0) || (r2 == r1));
+  
+  const PtN& x_r0 = de.cur_pop[r0];
+  const PtN& x_r1 = de.cur_pop[r1];
+  const PtN& x_r2 = de.cur_pop[r2];
+
+  PtN& y = de.cand_pop[i];
+
+  const size_type cross_over_dim = dim_idx_uni_dist(rng_eng);
+
+  const CoordScalar F = de.dither ? dither_dist(rng_eng) : de.evo_rate;
+
+  for (size_type d = 0; d < dim; ++d)
+  {
+    if ((d == cross_over_dim) || (uni_dist_01(rng_eng) < de.cross_over_prob))
+    {
+      y[d] = x_r0[d] + (F * (x_r1[d] - x_r2[d]));
+    }
+    else
+    {
+      y[d] = x[d];
+    }
+  }
+}
+
+struct MutateFn
+{
+  DifferentialEvolution& de;
+
+  std::vector<std::mt19937>& elem_rng_engs;
+
+  void operator()(const RangeType& r) const
+  {
+    for (size_type i = r.begin(); i < r.end(); ++i)
+    {
+      MutateAndCrossOver(de, i, elem_rng_engs[i]);
+    }
+  }
+};
+
+}  // un-named
 
 xreg::PtN xreg::DifferentialEvolution::best_param() const
 {
@@ -51,13 +137,6 @@ void xreg::DifferentialEvolution::run()
   std::mt19937 rng_eng;
   SeedRNGEngWithRandDev(&rng_eng);
 
-  std::uniform_int_distribution<size_type> pop_idx_uni_dist(0, pop_size - 1);
-  std::uniform_int_distribution<size_type> dim_idx_uni_dist(0, dim - 1);
-  
-  std::uniform_real_distribution<CoordScalar> uni_dist_01(0,1);
-
-  std::uniform_real_distribution<CoordScalar> dither_dist(evo_rate, 1);
-
   cand_pop.assign(pop_size, PtN(dim));
 
   cur_pop.assign(pop_size, PtN(dim));
@@ -93,6 +172,20 @@ void xreg::DifferentialEvolution::run()
     }
   }
 
+  // separate engines for each population element, seeded from the primary
+  // engine, allow the mutations to be computed concurrently
+  std::vector<std::mt19937> elem_rng_engs;
+
+  if (parallel_mutation)
+  {
+    elem_rng_engs.reserve(pop_size);
+
+    for (size_type i = 0; i < pop_size; ++i)
+    {
+      elem_rng_engs.emplace_back(rng_eng());
+    }
+  }
+
   if (after_init_callback)
   {
     after_init_callback(this);
@@ -105,56 +198,18 @@ void xreg::DifferentialEvolution::run()
       begin_of_iter_callback(this, iter);
     }
 
-    // for each population element
-    for (size_type i = 0; i < pop_size; ++i)
+    if (parallel_mutation)
     {
-      const PtN& x = cur_pop[i];
-
-      // get random agents from the population
-      size_type r0 = 0;
-      size_type r1 = 0;
-      size_type r2 = 0;
-      
-      // make sure the agents are unique from the current population element and
-      // each other
-      do
-      {
-        r0 = pop_idx_uni_dist(rng_eng);
-      }
-      while (r0 == i);
-      
-      do
-      {
-        r1 = pop_idx_uni_dist(rng_eng);
-      }
-      while ((r1 == i) || (r1 == r0));
-      
-      do
-      {
-        r2 = pop_idx_uni_dist(rng_eng);
-      }
-      while ((r2 == i) || (r2 == r0) || (r2 == r1));
-      
-      const PtN& x_r0 = cur_pop[r0];
-      const PtN& x_r1 = cur_pop[r1];
-      const PtN& x_r2 = cur_pop[r2];
-
-      PtN& y = cand_pop[i];
-    
-      const size_type cross_over_dim = dim_idx_uni_dist(rng_eng);
-
-      const CoordScalar F = dither ? dither_dist(rng_eng) : evo_rate;
+      MutateFn mutate_fn = { *this, elem_rng_engs };
 
-      for (size_type d = 0; d < dim; ++d)
+      ParallelFor(mutate_fn, RangeType(0, pop_size));
+    }
+    else
+    {
+      // for each population element
+      for (size_type i = 0; i < pop_size; ++i)
       {
-        if ((d == cross_over_dim) || (uni_dist_01(rng_eng) < cross_over_prob))
-        {
-          y[d] = x_r0[d] + (F * (x_r1[d] - x_r2[d]));
-        }
-        else
-        {
-          y[d] = x[d];
-        }
+        MutateAndCrossOver(*this, i, rng_eng);
       }
     }
 
@@ -184,6 +239,11 @@ void xreg::DifferentialEvolution::run()
     {
       end_of_iter_callback(this, iter);
     }
+
+    if (stop_callback && stop_callback(this, iter))
+    {
+      break;
+    }
   }
 
   if (after_final_iter_callback)
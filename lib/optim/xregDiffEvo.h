@@ -26,6 +26,7 @@
 #define XREGDIFFEVO_H_
 
 #include "xregCommon.h"
+#include "xregPopObjFn.h"
 
 namespace xreg
 {
@@ -34,8 +35,11 @@ struct DifferentialEvolution
 {
   using NonIterCallbackFn = std::function<void(DifferentialEvolution*)>;
   using IterCallbackFn    = std::function<void(DifferentialEvolution*,const size_type)>;
+  using StopCallbackFn    = std::function<bool(DifferentialEvolution*,const size_type)>;
 
-  using CostFn = std::function<PtN(const PtNList& pts_to_eval)>;
+  /// The entire population is passed in a single call, use MakeParallelPopObjFn()
+  /// for objectives which are only implemented on a single point.
+  using CostFn = PopObjFn;
 
   PtN init_guess;
 
@@ -57,6 +61,12 @@ struct DifferentialEvolution
 
   size_type max_num_its = 100;
 
+  // when true the mutation and cross over of the population elements are
+  // computed in parallel, each population element uses a separate random
+  // number engine; this is useful for high-dimensional problems, e.g. the
+  // poses of many objects
+  bool parallel_mutation = false;
+
   CostFn cost_fn;
   
   // Outputs/State Variables
@@ -78,6 +88,10 @@ struct DifferentialEvolution
   IterCallbackFn begin_of_iter_callback;
   IterCallbackFn end_of_iter_callback;
 
+  // called after end_of_iter_callback, the remaining iterations are skipped
+  // when this returns true
+  StopCallbackFn stop_callback;
+
   PtN best_param() const;
 
   void run();
@@ -346,3 +346,113 @@ xreg::MakeBacktrackingArmijoCallback(const LineSearchOptimization::Scalar alpha,
   };
 }
 
+
+std::tuple<xreg::LineSearchOptimization::Pt,
+           xreg::LineSearchOptimization::Scalar,
+           xreg::LineSearchOptimization::Pt,
+           xreg::LineSearchOptimization::Mat>
+xreg::BatchedBracketingStep(const LineSearchOptimization::ObjFn& obj_fn,
+                            const PopObjFn& batch_obj_fn,
+                            const LineSearchOptimization::Pt& p,
+                            const LineSearchOptimization::Pt& x,
+                            const LineSearchOptimization::Scalar F,
+                            const bool compute_hessian,
+                            const LineSearchOptimization::Scalar init_alpha,
+                            const LineSearchOptimization::Scalar tau,
+                            const size_type num_ladder_steps,
+                            const size_type num_refine_steps)
+{
+  using Pt     = LineSearchOptimization::Pt;
+  using Mat    = LineSearchOptimization::Mat;
+  using Scalar = LineSearchOptimization::Scalar;
+
+  xregASSERT(bool(batch_obj_fn));
+  xregASSERT((tau > 0) && (tau < 1));
+  xregASSERT(num_ladder_steps > 0);
+
+  // first batch: the geometric ladder of steps
+  PtN alphas(num_ladder_steps);
+
+  PtNList batch_pts(num_ladder_steps);
+
+  {
+    Scalar alpha = init_alpha;
+
+    for (size_type k = 0; k < num_ladder_steps; ++k, alpha *= tau)
+    {
+      alphas(k)    = alpha;
+      batch_pts[k] = x + (alpha * p);
+    }
+  }
+
+  PtN batch_Fs = batch_obj_fn(batch_pts);
+  xregASSERT(static_cast<size_type>(batch_Fs.size()) == num_ladder_steps);
+
+  size_type best_k = 0;
+  Scalar best_F = batch_Fs.minCoeff(&best_k);
+
+  Scalar best_alpha = alphas(best_k);
+
+  // second batch: refine within the bracket about the best ladder step
+  if (num_refine_steps)
+  {
+    const Scalar lower_alpha = ((best_k + 1) < num_ladder_steps) ? alphas(best_k + 1) : Scalar(0);
+    const Scalar upper_alpha = best_k ? alphas(best_k - 1) : (init_alpha / tau);
+
+    const Scalar refine_spacing = (upper_alpha - lower_alpha) / (num_refine_steps + 1);
+
+    alphas.resize(num_refine_steps);
+    batch_pts.resize(num_refine_steps);
+
+    for (size_type k = 0; k < num_refine_steps; ++k)
+    {
+      alphas(k)    = lower_alpha + ((k + 1) * refine_spacing);
+      batch_pts[k] = x + (alphas(k) * p);
+    }
+
+    batch_Fs = batch_obj_fn(batch_pts);
+    xregASSERT(static_cast<size_type>(batch_Fs.size()) == num_refine_steps);
+
+    size_type best_refine_k = 0;
+    const Scalar best_refine_F = batch_Fs.minCoeff(&best_refine_k);
+
+    if (best_refine_F < best_F)
+    {
+      best_F     = best_refine_F;
+      best_alpha = alphas(best_refine_k);
+    }
+  }
+
+  // do not move when none of the steps decrease the objective
+  Pt next_x = (best_F < F) ? Pt(x + (best_alpha * p)) : x;
+
+  Scalar next_F;
+
+  Pt next_g;
+
+  Mat next_H;
+
+  std::tie(next_F,next_g,next_H) = obj_fn(next_x, true, compute_hessian);
+
+  return std::make_tuple(next_x, next_F, next_g, next_H);
+}
+
+xreg::LineSearchOptimization::BacktrackFn
+xreg::MakeBatchedBracketingStepCallback(const PopObjFn& batch_obj_fn,
+                                        const LineSearchOptimization::Scalar alpha,
+                                        const LineSearchOptimization::Scalar tau,
+                                        const size_type num_ladder_steps,
+                                        const size_type num_refine_steps)
+{
+  return [batch_obj_fn,alpha,tau,num_ladder_steps,num_refine_steps] (
+                             const LineSearchOptimization::ObjFn& obj_fn,
+                             const LineSearchOptimization::Pt& p,
+                             const LineSearchOptimization::Pt& x,
+                             const LineSearchOptimization::Scalar F,
+                             const LineSearchOptimization::Pt& /*g*/,
+                             const bool compute_hessian)
+  {
+    return BatchedBracketingStep(obj_fn, batch_obj_fn, p, x, F, compute_hessian,
+                                 alpha, tau, num_ladder_steps, num_refine_steps);
+  };
+}
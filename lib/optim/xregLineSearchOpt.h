@@ -31,6 +31,7 @@
 
 #include "xregCommon.h"
 #include "xregObjWithOStream.h"
+#include "xregPopObjFn.h"
 
 namespace xreg
 {
@@ -184,6 +185,41 @@ MakeBacktrackingArmijoCallback(const LineSearchOptimization::Scalar alpha = 1,
                                const LineSearchOptimization::Scalar eta   = 0.001,
                                const LineSearchOptimization::Scalar tau   = 0.5);
 
+/// \brief Determine search length by evaluating a geometric ladder of step
+///        lengths in a single batch and then refining within the bracket of
+///        the best step with a second batch.
+///
+/// The ladder is alpha_k = init_alpha * tau^k, k = 0, ..., num_ladder_steps - 1.
+/// The bracket about the best ladder step is bounded by its neighboring
+/// ladder steps (zero is used below the smallest step and init_alpha / tau
+/// above the largest), and num_refine_steps equally spaced steps within it are
+/// evaluated. Only the final point is evaluated with obj_fn, to compute its
+/// gradient and (optionally) Hessian. When no evaluated step decreases the
+/// objective, the input point is returned.
+/// The objective values of each batch are computed by batch_obj_fn, e.g. a
+/// single ray casting call for all steps.
+std::tuple<LineSearchOptimization::Pt,
+           LineSearchOptimization::Scalar,
+           LineSearchOptimization::Pt,
+           LineSearchOptimization::Mat>
+BatchedBracketingStep(const LineSearchOptimization::ObjFn& obj_fn,
+                      const PopObjFn& batch_obj_fn,
+                      const LineSearchOptimization::Pt& p,
+                      const LineSearchOptimization::Pt& x,
+                      const LineSearchOptimization::Scalar F,
+                      const bool compute_hessian,
+                      const LineSearchOptimization::Scalar init_alpha,  ///< Largest fraction of step.
+                      const LineSearchOptimization::Scalar tau,         ///< Ratio of consecutive ladder steps
+                      const size_type num_ladder_steps,
+                      const size_type num_refine_steps);
+
+xreg::LineSearchOptimization::BacktrackFn
+MakeBatchedBracketingStepCallback(const PopObjFn& batch_obj_fn,
+                                  const LineSearchOptimization::Scalar alpha = 1,
+                                  const LineSearchOptimization::Scalar tau   = 0.5,
+                                  const size_type num_ladder_steps = 8,
+                                  const size_type num_refine_steps = 4);
+
 }  // xreg
 
 #endif
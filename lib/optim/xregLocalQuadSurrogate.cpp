@@ -0,0 +1,163 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregLocalQuadSurrogate.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "xregAssert.h"
+#include "xregFitQuadratic.h"
+
+void xreg::LocalQuadSurrogate::clear()
+{
+  archive_pts.clear();
+  archive_vals.clear();
+
+  best_idx = 0;
+
+  fit_valid = false;
+}
+
+void xreg::LocalQuadSurrogate::add(const PtN& x, const CoordScalar f)
+{
+  xregASSERT(max_archive_size > 0);
+  xregASSERT(archive_pts.empty() || (archive_pts[0].size() == x.size()));
+
+  const size_type num_archived = archive_pts.size();
+
+  if (num_archived < max_archive_size)
+  {
+    archive_pts.push_back(x);
+    archive_vals.push_back(f);
+
+    if (!num_archived || (f < archive_vals[best_idx]))
+    {
+      best_idx = num_archived;
+    }
+  }
+  else
+  {
+    const PtN& best_pt = (f < archive_vals[best_idx]) ? x : archive_pts[best_idx];
+
+    // the point farthest from the best point is least useful for a local model
+    size_type replace_idx = 0;
+    CoordScalar max_dist_sq = -1;
+
+    for (size_type i = 0; i < num_archived; ++i)
+    {
+      const CoordScalar dist_sq = (archive_pts[i] - best_pt).squaredNorm();
+
+      if ((i != best_idx) && (dist_sq > max_dist_sq))
+      {
+        max_dist_sq = dist_sq;
+        replace_idx = i;
+      }
+    }
+
+    if ((x - best_pt).squaredNorm() < max_dist_sq)
+    {
+      archive_pts[replace_idx]  = x;
+      archive_vals[replace_idx] = f;
+
+      if (f < archive_vals[best_idx])
+      {
+        best_idx = replace_idx;
+      }
+    }
+  }
+}
+
+xreg::size_type xreg::LocalQuadSurrogate::num_fit_pts(const size_type dim) const
+{
+  const size_type num_coeffs = 1 + dim + ((dim * (dim + 1)) / 2);
+
+  return std::max(num_coeffs,
+                  static_cast<size_type>(std::ceil(num_fit_pts_factor * num_coeffs)));
+}
+
+bool xreg::LocalQuadSurrogate::fit(const PtN& fit_center)
+{
+  const size_type dim = fit_center.size();
+
+  const size_type num_archived = archive_pts.size();
+
+  const size_type num_pts = num_fit_pts(dim);
+
+  fit_valid = num_archived >= num_pts;
+
+  if (fit_valid)
+  {
+    // find the archived points nearest to the center
+    CoordScalarList dists_sq(num_archived);
+
+    for (size_type i = 0; i < num_archived; ++i)
+    {
+      dists_sq[i] = (archive_pts[i] - fit_center).squaredNorm();
+    }
+
+    std::vector<size_type> inds(num_archived);
+    std::iota(inds.begin(), inds.end(), size_type(0));
+
+    std::nth_element(inds.begin(), inds.begin() + (num_pts - 1), inds.end(),
+                     [&dists_sq] (const size_type i, const size_type j)
+                     {
+                       return dists_sq[i] < dists_sq[j];
+                     });
+
+    MatMxN params(dim, num_pts);
+    PtN fn_vals(num_pts);
+
+    for (size_type k = 0; k < num_pts; ++k)
+    {
+      params.col(k) = archive_pts[inds[k]] - fit_center;
+      fn_vals(k)    = archive_vals[inds[k]];
+    }
+
+    center = fit_center;
+
+    std::tie(c,g,H) = FitQuadraticFn(params, fn_vals);
+
+    fit_valid = std::isfinite(c) && g.allFinite() && H.allFinite();
+  }
+
+  return fit_valid;
+}
+
+bool xreg::LocalQuadSurrogate::fit_about_best()
+{
+  fit_valid = false;
+
+  return !archive_pts.empty() && fit(PtN(archive_pts[best_idx]));
+}
+
+xreg::CoordScalar xreg::LocalQuadSurrogate::operator()(const PtN& x) const
+{
+  xregASSERT(fit_valid);
+
+  const PtN d = x - center;
+
+  return c + g.dot(d) + (0.5 * d.dot(H * d));
+}
@@ -0,0 +1,92 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGLOCALQUADSURROGATE_H_
+#define XREGLOCALQUADSURROGATE_H_
+
+#include "xregCommon.h"
+
+namespace xreg
+{
+
+/// \brief Archive of objective function evaluations with a local quadratic
+///        model of the objective.
+///
+/// The model, f(x) ~ c + g^T (x - x_0) + 0.5 (x - x_0)^T H (x - x_0), is fit
+/// about a center point, x_0, by least squares using the archived points
+/// nearest to the center. This is intended to cheaply pre-screen candidates
+/// of an expensive objective function, e.g. the poses of a population during
+/// the final (polishing) level of a registration, so that the expensive
+/// evaluations are only spent on promising candidates.
+struct LocalQuadSurrogate
+{
+  /// Maximum number of evaluations stored; the evaluation farthest from the
+  /// best archived point is replaced when the archive is full.
+  size_type max_archive_size = 2000;
+
+  /// The number of archived points used for a fit is this factor times the
+  /// number of model coefficients, 1 + N + N(N+1)/2.
+  CoordScalar num_fit_pts_factor = 1.5;
+
+  // Outputs/State Variables
+
+  PtNList         archive_pts;
+  CoordScalarList archive_vals;
+
+  /// Index of the archived point with the smallest objective value
+  size_type best_idx = 0;
+
+  /// Indicates that the most recent call to fit() produced a valid model
+  bool fit_valid = false;
+
+  PtN         center;
+  CoordScalar c = 0;
+  PtN         g;
+  MatMxN      H;
+
+  /// \brief Removes every archived evaluation and invalidates the model.
+  void clear();
+
+  /// \brief Adds an evaluation to the archive.
+  void add(const PtN& x, const CoordScalar f);
+
+  /// \brief The number of archived points required to fit a model of
+  ///        dimension dim.
+  size_type num_fit_pts(const size_type dim) const;
+
+  /// \brief Fits the model about a center point; returns false when there
+  ///        are not enough archived points.
+  bool fit(const PtN& fit_center);
+
+  /// \brief Fits the model about the best archived point.
+  bool fit_about_best();
+
+  /// \brief Evaluates the model at a point; requires a valid fit.
+  CoordScalar operator()(const PtN& x) const;
+};
+
+}  // xreg
+
+#endif
+
@@ -235,6 +235,11 @@ xreg::ParticleSwarmOpt::compute()
     update_best_param_and_val();
 
     end_iter();
+
+    if (stop_early())
+    {
+      break;
+    }
   }
   
   finish();
@@ -279,15 +284,43 @@ void xreg::ParticleSwarmOpt::start_iter()
 void xreg::ParticleSwarmOpt::end_iter()
 { }
 
+bool xreg::ParticleSwarmOpt::stop_early()
+{
+  return false;
+}
+
 void xreg::ParticleSwarmOpt::finish()
 { }
   
 void xreg::ParticleSwarmOpt::compute_obj_fns()
 {
-  if (obj_fn_type_ == kALL_OBJ_FN)
+  if (pop_obj_fn_)
+  {
+    const PtN vals = pop_obj_fn_(particles_cur_params_);
+    xregASSERT(static_cast<size_type>(vals.size()) == num_particles_);
+
+    for (size_type i = 0; i < num_particles_; ++i)
+    {
+      particles_cur_obj_fn_vals_[i] = vals[i];
+    }
+  }
+  else if (obj_fn_type_ == kALL_OBJ_FN)
   {
     all_obj_fn(particles_cur_params_, particles_cur_obj_fn_vals_);
   }
+  else if (obj_fn_type_ == kPARALLEL_SERIAL_OBJ_FN)
+  {
+    const PtN vals = EvalPopObjFnParallel([this] (const Vec& x)
+                                          {
+                                            return this->serial_obj_fn(x);
+                                          },
+                                          particles_cur_params_);
+    
+    for (size_type i = 0; i < num_particles_; ++i)
+    {
+      particles_cur_obj_fn_vals_[i] = vals[i];
+    }
+  }
   else
   {
     for (size_type i = 0; i < num_particles_; ++i)
@@ -297,6 +330,11 @@ void xreg::ParticleSwarmOpt::compute_obj_fns()
   }
 }
   
+void xreg::ParticleSwarmOpt::set_pop_obj_fn(const PopObjFn& pop_obj_fn)
+{
+  pop_obj_fn_ = pop_obj_fn;
+}
+
 void xreg::ParticleSwarmOpt::set_max_num_its(const size_type m)
 {
   max_num_its_ = m;
@@ -26,6 +26,7 @@
 #define XREGPSO_H_
 
 #include "xregCommon.h"
+#include "xregPopObjFn.h"
 
 namespace xreg
 {
@@ -70,6 +71,15 @@ public:
 
   size_type max_num_its() const;
 
+  /// \brief Use an objective function that is evaluated at all particles
+  ///        in a single call.
+  ///
+  /// When set, this takes precedence over the objective function methods
+  /// implemented by a sub-class, which allows this class to be used directly
+  /// without sub-classing. Pass an empty function to revert to the sub-class
+  /// methods.
+  void set_pop_obj_fn(const PopObjFn& pop_obj_fn);
+
 protected:
   
   using ScalarList = std::vector<Scalar>;
@@ -85,11 +95,12 @@ protected:
   enum ObjFnType
   {
     kSERIAL_OBJ_FN,
+    kPARALLEL_SERIAL_OBJ_FN,  // calls serial_obj_fn() concurrently for each particle
     kALL_OBJ_FN
   };
 
   // this should be set by the sub-class
-  ObjFnType obj_fn_type_;
+  ObjFnType obj_fn_type_ = kSERIAL_OBJ_FN;
 
   // Callback methods
 
@@ -101,6 +112,10 @@ protected:
 
   virtual void end_iter();
 
+  /// \brief Called after end_iter(), the remaining iterations are skipped when
+  ///        this returns true. The default implementation never stops early.
+  virtual bool stop_early();
+
   virtual void finish();
   
   // shared data with sub-class 
@@ -140,6 +155,8 @@ protected:
 
 private:
   void compute_obj_fns();
+
+  PopObjFn pop_obj_fn_;
 };
 
 }  // xreg
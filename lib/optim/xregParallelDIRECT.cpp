@@ -0,0 +1,364 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregParallelDIRECT.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "xregAssert.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+CoordScalar RectSize(const std::vector<size_type>& levels)
+{
+  CoordScalar s = 0;
+
+  for (const auto& l : levels)
+  {
+    s += std::pow(CoordScalar(3), -2 * static_cast<CoordScalar>(l));
+  }
+
+  return std::sqrt(s) / 2;
+}
+
+// Indices of the potentially optimal rectangles, ordered from largest to
+// smallest size. These are the rectangles on the lower right of the convex
+// hull of the (size, objective value) pairs that are expected to improve upon
+// the current minimum by at least eps.
+std::vector<size_type> FindPotOptRects(const ParallelDIRECT& direct)
+{
+  const auto& rects = direct.rects;
+
+  std::vector<size_type> inds;
+  inds.reserve(rects.size());
+
+  for (size_type i = 0; i < rects.size(); ++i)
+  {
+    const auto& levels = rects[i].levels;
+
+    if (*std::min_element(levels.begin(), levels.end()) < direct.max_level)
+    {
+      inds.push_back(i);
+    }
+  }
+
+  if (inds.empty())
+  {
+    return inds;
+  }
+
+  std::sort(inds.begin(), inds.end(),
+            [&rects] (const size_type i, const size_type j)
+            {
+              return (rects[i].size < rects[j].size) ||
+                     ((rects[i].size == rects[j].size) && (rects[i].fn_val < rects[j].fn_val));
+            });
+
+  // keep the rectangle with the smallest objective value of each size
+  std::vector<size_type> size_min_inds;
+  size_min_inds.reserve(inds.size());
+
+  for (const auto& i : inds)
+  {
+    if (size_min_inds.empty() || (rects[size_min_inds.back()].size < rects[i].size))
+    {
+      size_min_inds.push_back(i);
+    }
+  }
+
+  // the hull starts at the minimum value, using the largest rectangle for ties
+  size_type start = 0;
+
+  for (size_type k = 1; k < size_min_inds.size(); ++k)
+  {
+    if (rects[size_min_inds[k]].fn_val <= rects[size_min_inds[start]].fn_val)
+    {
+      start = k;
+    }
+  }
+
+  std::vector<size_type> hull;
+  hull.reserve(size_min_inds.size() - start);
+
+  for (size_type k = start; k < size_min_inds.size(); ++k)
+  {
+    const auto& c = rects[size_min_inds[k]];
+
+    while (hull.size() > 1)
+    {
+      const auto& a = rects[hull[hull.size() - 2]];
+      const auto& b = rects[hull.back()];
+
+      const CoordScalar cross = ((b.size - a.size) * (c.fn_val - a.fn_val)) -
+                                ((b.fn_val - a.fn_val) * (c.size - a.size));
+
+      if (cross <= 0)
+      {
+        hull.pop_back();
+      }
+      else
+      {
+        break;
+      }
+    }
+
+    hull.push_back(size_min_inds[k]);
+  }
+
+  const CoordScalar f_min = rects[hull.front()].fn_val;
+
+  const CoordScalar f_thresh = f_min - (direct.eps * std::abs(f_min));
+
+  std::vector<size_type> pot_opt_inds;
+  pot_opt_inds.reserve(hull.size());
+
+  // the largest rectangle is always potentially optimal
+  pot_opt_inds.push_back(hull.back());
+
+  for (size_type k = hull.size() - 1; k > 0; --k)
+  {
+    const auto& r      = rects[hull[k - 1]];
+    const auto& r_next = rects[hull[k]];
+
+    const CoordScalar K = (r_next.fn_val - r.fn_val) / (r_next.size - r.size);
+
+    if ((r.fn_val - (K * r.size)) <= f_thresh)
+    {
+      pot_opt_inds.push_back(hull[k - 1]);
+    }
+  }
+
+  return pot_opt_inds;
+}
+
+// Dimensions along which a rectangle is divided, e.g. the longest sides
+std::vector<size_type> DivDims(const ParallelDIRECT::Rect& r)
+{
+  const size_type min_level = *std::min_element(r.levels.begin(), r.levels.end());
+
+  std::vector<size_type> dims;
+
+  for (size_type k = 0; k < r.levels.size(); ++k)
+  {
+    if (r.levels[k] == min_level)
+    {
+      dims.push_back(k);
+    }
+  }
+
+  return dims;
+}
+
+}  // un-named
+
+xreg::PtN xreg::ParallelDIRECT::unnormalize(const PtN& x) const
+{
+  return lower_bounds.array() + (x.array() * (upper_bounds - lower_bounds).array());
+}
+
+xreg::PtN xreg::ParallelDIRECT::best_param() const
+{
+  return unnormalize(rects[best_rect_idx].center);
+}
+
+void xreg::ParallelDIRECT::run()
+{
+  const size_type dim = lower_bounds.size();
+
+  xregASSERT(dim > 0);
+  xregASSERT(static_cast<size_type>(upper_bounds.size()) == dim);
+  xregASSERT((upper_bounds.array() > lower_bounds.array()).all());
+
+  rects.clear();
+  pot_opt_rect_inds.clear();
+
+  // the initial rectangle is the entire box
+  {
+    Rect r;
+    r.center.setConstant(dim, 0.5);
+    r.levels.assign(dim, 0);
+    r.size = RectSize(r.levels);
+
+    const PtN init_fn_vals = cost_fn(PtNList(1, unnormalize(r.center)));
+    xregASSERT(init_fn_vals.size() == 1);
+
+    r.fn_val = init_fn_vals[0];
+
+    rects.push_back(r);
+  }
+
+  best_rect_idx = 0;
+  best_fn_val   = rects[0].fn_val;
+  num_fn_evals  = 1;
+
+  if (after_init_callback)
+  {
+    after_init_callback(this);
+  }
+
+  std::vector<std::vector<size_type>> div_dims;
+
+  PtNList pts_to_eval;
+
+  for (size_type iter = 0; iter < max_num_its; ++iter)
+  {
+    if (begin_of_iter_callback)
+    {
+      begin_of_iter_callback(this, iter);
+    }
+
+    pot_opt_rect_inds = FindPotOptRects(*this);
+
+    // the potentially optimal rectangles are ordered from largest to smallest,
+    // so the largest rectangles are divided when the evaluations are limited
+    div_dims.clear();
+    div_dims.reserve(pot_opt_rect_inds.size());
+
+    size_type num_pts_to_eval = 0;
+
+    for (size_type k = 0; k < pot_opt_rect_inds.size(); ++k)
+    {
+      auto dims = DivDims(rects[pot_opt_rect_inds[k]]);
+
+      const size_type num_pts = 2 * dims.size();
+
+      if (max_num_fn_evals && ((num_fn_evals + num_pts_to_eval + num_pts) > max_num_fn_evals))
+      {
+        pot_opt_rect_inds.resize(k);
+        break;
+      }
+
+      num_pts_to_eval += num_pts;
+
+      div_dims.push_back(std::move(dims));
+    }
+
+    if (pot_opt_rect_inds.empty())
+    {
+      break;
+    }
+
+    // collect the new centers of every division and evaluate them together
+    pts_to_eval.clear();
+    pts_to_eval.reserve(num_pts_to_eval);
+
+    for (size_type k = 0; k < pot_opt_rect_inds.size(); ++k)
+    {
+      const Rect& r = rects[pot_opt_rect_inds[k]];
+
+      const CoordScalar delta = std::pow(CoordScalar(3), -static_cast<CoordScalar>(r.levels[div_dims[k][0]] + 1));
+
+      for (const auto& d : div_dims[k])
+      {
+        PtN x = r.center;
+
+        x(d) += delta;
+        pts_to_eval.push_back(unnormalize(x));
+
+        x(d) -= 2 * delta;
+        pts_to_eval.push_back(unnormalize(x));
+      }
+    }
+
+    const PtN fn_vals = cost_fn(pts_to_eval);
+    xregASSERT(static_cast<size_type>(fn_vals.size()) == num_pts_to_eval);
+
+    num_fn_evals += num_pts_to_eval;
+
+    // divide each rectangle, starting with the dimension having the best value
+    size_type pt_off = 0;
+
+    for (size_type k = 0; k < pot_opt_rect_inds.size(); ++k)
+    {
+      const size_type rect_idx = pot_opt_rect_inds[k];
+
+      const auto& dims = div_dims[k];
+
+      const size_type num_dims = dims.size();
+
+      const CoordScalar delta = std::pow(CoordScalar(3), -static_cast<CoordScalar>(rects[rect_idx].levels[dims[0]] + 1));
+
+      std::vector<size_type> order(num_dims);
+      std::iota(order.begin(), order.end(), size_type(0));
+
+      std::sort(order.begin(), order.end(),
+                [&fn_vals,pt_off] (const size_type i, const size_type j)
+                {
+                  return std::min(fn_vals[pt_off + (2 * i)], fn_vals[pt_off + (2 * i) + 1]) <
+                         std::min(fn_vals[pt_off + (2 * j)], fn_vals[pt_off + (2 * j) + 1]);
+                });
+
+      for (const auto& i : order)
+      {
+        const size_type d = dims[i];
+
+        ++rects[rect_idx].levels[d];
+
+        for (size_type s = 0; s < 2; ++s)
+        {
+          Rect child;
+
+          child.center = rects[rect_idx].center;
+          child.center(d) += (s == 0) ? delta : -delta;
+
+          child.levels = rects[rect_idx].levels;
+          child.size   = RectSize(child.levels);
+          child.fn_val = fn_vals[pt_off + (2 * i) + s];
+
+          if (child.fn_val < best_fn_val)
+          {
+            best_fn_val   = child.fn_val;
+            best_rect_idx = rects.size();
+          }
+
+          rects.push_back(std::move(child));
+        }
+      }
+
+      rects[rect_idx].size = RectSize(rects[rect_idx].levels);
+
+      pt_off += 2 * num_dims;
+    }
+
+    if (end_of_iter_callback)
+    {
+      end_of_iter_callback(this, iter);
+    }
+
+    if (stop_callback && stop_callback(this, iter))
+    {
+      break;
+    }
+  }
+
+  if (after_final_iter_callback)
+  {
+    after_final_iter_callback(this);
+  }
+}
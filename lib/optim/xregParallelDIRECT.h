@@ -0,0 +1,128 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGPARALLELDIRECT_H_
+#define XREGPARALLELDIRECT_H_
+
+#include "xregCommon.h"
+#include "xregPopObjFn.h"
+
+namespace xreg
+{
+
+/// \brief Global optimization over a box using the DIviding RECTangles (DIRECT)
+///        method, with every potentially optimal rectangle of a round divided
+///        at once.
+///
+/// The original DIRECT algorithm (Jones et al. 1993) is used, however the
+/// centers of the new rectangles created from every potentially optimal
+/// rectangle of a round are evaluated in a single call to the cost function.
+/// The number of points evaluated in each round varies, so the cost function
+/// must accept populations of any size.
+struct ParallelDIRECT
+{
+  using NonIterCallbackFn = std::function<void(ParallelDIRECT*)>;
+  using IterCallbackFn    = std::function<void(ParallelDIRECT*,const size_type)>;
+  using StopCallbackFn    = std::function<bool(ParallelDIRECT*,const size_type)>;
+
+  /// Every new rectangle center of a round is passed in a single call, use
+  /// MakeParallelPopObjFn() for objectives which are only implemented on a
+  /// single point.
+  using CostFn = PopObjFn;
+
+  /// \brief A hyperrectangle of the search space, in coordinates normalized
+  ///        to the unit hypercube.
+  struct Rect
+  {
+    PtN center;
+
+    /// \brief The length of side k is 3^(-levels[k])
+    std::vector<size_type> levels;
+
+    CoordScalar fn_val;
+
+    /// \brief Half of the length of the rectangle's diagonal
+    CoordScalar size;
+  };
+
+  using RectList = std::vector<Rect>;
+
+  PtN lower_bounds;
+  PtN upper_bounds;
+
+  /// \brief Maximum number of rounds of dividing rectangles
+  size_type max_num_its = 100;
+
+  /// \brief Maximum number of cost function evaluations; 0 -> no limit
+  ///
+  /// When the next round would exceed this, only the larger potentially
+  /// optimal rectangles are divided.
+  size_type max_num_fn_evals = 0;
+
+  /// \brief The epsilon parameter in the literature, controls how much a
+  ///        rectangle must be expected to improve upon the current minimum in
+  ///        order to be considered potentially optimal.
+  CoordScalar eps = 1.0e-4;
+
+  /// \brief Rectangles with every side divided this many times are not
+  ///        divided further.
+  size_type max_level = 20;
+
+  CostFn cost_fn;
+
+  // Outputs/State Variables
+
+  RectList rects;
+
+  /// \brief Indices into rects of the rectangles divided in the current round
+  std::vector<size_type> pot_opt_rect_inds;
+
+  size_type   best_rect_idx;
+  CoordScalar best_fn_val;
+
+  size_type num_fn_evals;
+
+  // Callbacks
+
+  NonIterCallbackFn after_init_callback;
+  NonIterCallbackFn after_final_iter_callback;
+
+  IterCallbackFn begin_of_iter_callback;
+  IterCallbackFn end_of_iter_callback;
+
+  // called after end_of_iter_callback, the remaining iterations are skipped
+  // when this returns true
+  StopCallbackFn stop_callback;
+
+  /// \brief Maps a point normalized to the unit hypercube into the box.
+  PtN unnormalize(const PtN& x) const;
+
+  PtN best_param() const;
+
+  void run();
+};
+
+}  // xreg
+
+#endif
@@ -0,0 +1,95 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "xregPopObjFn.h"
+
+#include "xregTBBUtils.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+struct EvalPtObjFnsFn
+{
+  const PtObjFn& pt_obj_fn;
+  
+  const PtNList& pop;
+
+  PtN& obj_fn_vals;
+
+  void operator()(const RangeType& r) const
+  {
+    for (size_type i = r.begin(); i < r.end(); ++i)
+    {
+      obj_fn_vals[i] = pt_obj_fn(pop[i]);
+    }
+  }
+};
+
+}  // un-named
+
+xreg::PtN xreg::EvalPopObjFnParallel(const PtObjFn& pt_obj_fn, const PtNList& pop)
+{
+  const size_type pop_size = pop.size();
+
+  PtN obj_fn_vals(pop_size);
+
+  EvalPtObjFnsFn eval_fn = { pt_obj_fn, pop, obj_fn_vals };
+
+  ParallelFor(eval_fn, RangeType(0, pop_size));
+
+  return obj_fn_vals;
+}
+
+xreg::PtN xreg::EvalPopObjFnSerial(const PtObjFn& pt_obj_fn, const PtNList& pop)
+{
+  const size_type pop_size = pop.size();
+
+  PtN obj_fn_vals(pop_size);
+
+  for (size_type i = 0; i < pop_size; ++i)
+  {
+    obj_fn_vals[i] = pt_obj_fn(pop[i]);
+  }
+
+  return obj_fn_vals;
+}
+
+xreg::PopObjFn xreg::MakeParallelPopObjFn(const PtObjFn& pt_obj_fn)
+{
+  return [pt_obj_fn] (const PtNList& pop)
+  {
+    return EvalPopObjFnParallel(pt_obj_fn, pop);
+  };
+}
+
+xreg::PopObjFn xreg::MakeSerialPopObjFn(const PtObjFn& pt_obj_fn)
+{
+  return [pt_obj_fn] (const PtNList& pop)
+  {
+    return EvalPopObjFnSerial(pt_obj_fn, pop);
+  };
+}
@@ -0,0 +1,71 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef XREGPOPOBJFN_H_
+#define XREGPOPOBJFN_H_
+
+#include "xregCommon.h"
+
+namespace xreg
+{
+
+/// \brief Objective function evaluated at a single point.
+using PtObjFn = std::function<CoordScalar(const PtN&)>;
+
+/// \brief Objective function evaluated at every member of a population with
+///        a single call.
+///
+/// The i'th element of the returned vector is the objective function value
+/// of the i'th member of the population. Population based optimizers pass an
+/// entire generation to this, so an expensive objective may be evaluated in a
+/// batch (e.g. a single ray casting call for all candidate poses).
+using PopObjFn = std::function<PtN(const PtNList&)>;
+
+/// \brief Evaluates a point-wise objective function at each member of a
+///        population, in parallel.
+///
+/// The point-wise objective function must be safe to call concurrently.
+PtN EvalPopObjFnParallel(const PtObjFn& pt_obj_fn, const PtNList& pop);
+
+/// \brief Evaluates a point-wise objective function at each member of a
+///        population, in serial.
+PtN EvalPopObjFnSerial(const PtObjFn& pt_obj_fn, const PtNList& pop);
+
+/// \brief Creates a population objective function that evaluates a point-wise
+///        objective in parallel.
+///
+/// This is the default choice for inexpensive objective functions that do
+/// not benefit from a batched implementation.
+PopObjFn MakeParallelPopObjFn(const PtObjFn& pt_obj_fn);
+
+/// \brief Creates a population objective function that evaluates a point-wise
+///        objective in serial.
+///
+/// This should be used when the point-wise objective is not thread-safe.
+PopObjFn MakeSerialPopObjFn(const PtObjFn& pt_obj_fn);
+
+}  // xreg
+
+#endif
@@ -39,8 +39,20 @@ xreg::CoordScalar xreg::SimAnnLinearTempDecay(const CoordScalar init_temp,
   
 void xreg::SimulatedAnnealing::run()
 {
+  xregASSERT(num_props_per_iter > 0);
+  
+  xregASSERT(bool(energy_fn) || bool(pop_energy_fn));
+
+  if (num_chains > 1)
+  {
+    run_chains();
+    return;
+  }
+
+  const PopObjFn compute_energies = pop_energy_fn ? pop_energy_fn : MakeSerialPopObjFn(energy_fn);
+  
   best_energy_pt  = init_guess;
-  best_energy_val = energy_fn(init_guess);
+  best_energy_val = energy_fn ? energy_fn(init_guess) : compute_energies(PtNList(1, init_guess))[0];
 
   cur_pt     = init_guess;
   cur_energy = best_energy_val;
@@ -49,6 +61,8 @@ void xreg::SimulatedAnnealing::run()
 
   CoordScalar next_energy;
 
+  PtNList props(num_props_per_iter);
+
   CoordScalar cur_temp = init_temp;
 
   std::mt19937 uni_rng_eng;
@@ -64,8 +78,26 @@ void xreg::SimulatedAnnealing::run()
     }
 
     // get the next proposed point to visit and compute its energy
-    next_pt     = prop_fn(cur_pt);
-    next_energy = energy_fn(next_pt);
+    if ((num_props_per_iter == 1) && energy_fn)
+    {
+      next_pt     = prop_fn(cur_pt);
+      next_energy = energy_fn(next_pt);
+    }
+    else
+    {
+      for (auto& p : props)
+      {
+        p = prop_fn(cur_pt);
+      }
+
+      const PtN prop_energies = compute_energies(props);
+      xregASSERT(static_cast<size_type>(prop_energies.size()) == num_props_per_iter);
+
+      size_type best_prop_idx = 0;
+      next_energy = prop_energies.minCoeff(&best_prop_idx);
+      
+      next_pt = props[best_prop_idx];
+    }
   
     // Move to the proposed point with some propability proportional to the
     // difference in energy compared to the current point
@@ -93,6 +125,127 @@ void xreg::SimulatedAnnealing::run()
   }
 }
 
+void xreg::SimulatedAnnealing::run_chains()
+{
+  xregASSERT(chain_temp_ratio > 0);
+
+  const PopObjFn compute_energies = pop_energy_fn ? pop_energy_fn : MakeSerialPopObjFn(energy_fn);
+
+  best_energy_pt  = init_guess;
+  best_energy_val = energy_fn ? energy_fn(init_guess) : compute_energies(PtNList(1, init_guess))[0];
+
+  // every chain starts at the initial guess
+  chain_pts.assign(num_chains, init_guess);
+  chain_energies.setConstant(num_chains, best_energy_val);
+
+  cur_pt     = init_guess;
+  cur_energy = best_energy_val;
+
+  num_swaps_accepted = 0;
+
+  // the proposals of chain c are stored in [c * num_props_per_iter, (c + 1) * num_props_per_iter)
+  PtNList props(num_chains * num_props_per_iter);
+
+  PtN chain_temps(num_chains);
+
+  CoordScalar cur_temp = init_temp;
+
+  std::mt19937 uni_rng_eng;
+  std::uniform_real_distribution<CoordScalar> uni_rng_01(0, 1);
+
+  SeedRNGEngWithRandDev(&uni_rng_eng);
+
+  size_type num_swap_attempts = 0;
+
+  for (size_type iter = 0; iter < max_num_its; ++iter)
+  {
+    if (begin_of_iter_fn)
+    {
+      begin_of_iter_fn(this, iter, cur_pt, cur_energy, cur_temp, best_energy_pt, best_energy_val);
+    }
+
+    {
+      CoordScalar t = cur_temp;
+
+      for (size_type chain_idx = 0; chain_idx < num_chains; ++chain_idx, t *= chain_temp_ratio)
+      {
+        chain_temps(chain_idx) = t;
+      }
+    }
+
+    // propose from every chain and compute the energies as a single batch
+    {
+      size_type prop_idx = 0;
+
+      for (size_type chain_idx = 0; chain_idx < num_chains; ++chain_idx)
+      {
+        for (size_type i = 0; i < num_props_per_iter; ++i, ++prop_idx)
+        {
+          props[prop_idx] = prop_fn(chain_pts[chain_idx]);
+        }
+      }
+    }
+
+    const PtN prop_energies = compute_energies(props);
+    xregASSERT(static_cast<size_type>(prop_energies.size()) == (num_chains * num_props_per_iter));
+
+    for (size_type chain_idx = 0; chain_idx < num_chains; ++chain_idx)
+    {
+      size_type best_prop_idx = 0;
+      const CoordScalar next_energy = prop_energies.segment(chain_idx * num_props_per_iter,
+                                                            num_props_per_iter).minCoeff(&best_prop_idx);
+
+      // Metropolis acceptance at the temperature of this chain
+      if (uni_rng_01(uni_rng_eng) <
+            std::exp((next_energy - chain_energies(chain_idx)) / -chain_temps(chain_idx)))
+      {
+        chain_pts[chain_idx]      = props[(chain_idx * num_props_per_iter) + best_prop_idx];
+        chain_energies(chain_idx) = next_energy;
+
+        if (next_energy < best_energy_val)
+        {
+          best_energy_val = next_energy;
+          best_energy_pt  = chain_pts[chain_idx];
+        }
+      }
+    }
+
+    // attempt to exchange the points of adjacent chains
+    if (swap_freq && (((iter + 1) % swap_freq) == 0))
+    {
+      for (size_type chain_idx = num_swap_attempts % 2; (chain_idx + 1) < num_chains; chain_idx += 2)
+      {
+        const size_type next_chain_idx = chain_idx + 1;
+
+        const CoordScalar log_accept_prob =
+                      (chain_energies(chain_idx) - chain_energies(next_chain_idx)) *
+                        ((1 / chain_temps(chain_idx)) - (1 / chain_temps(next_chain_idx)));
+
+        if ((log_accept_prob >= 0) || (uni_rng_01(uni_rng_eng) < std::exp(log_accept_prob)))
+        {
+          std::swap(chain_pts[chain_idx], chain_pts[next_chain_idx]);
+          std::swap(chain_energies(chain_idx), chain_energies(next_chain_idx));
+
+          ++num_swaps_accepted;
+        }
+      }
+
+      ++num_swap_attempts;
+    }
+
+    cur_pt     = chain_pts[0];
+    cur_energy = chain_energies(0);
+
+    // update the temperature
+    cur_temp = temp_update_fn(init_temp, cur_temp, iter, max_num_its);
+  
+    if (end_of_iter_fn)
+    {
+      end_of_iter_fn(this, iter, cur_pt, cur_energy, cur_temp, best_energy_pt, best_energy_val);
+    }
+  }
+}
+
 xreg::MultivarUniformPropSimulatedAnnealing::MultivarUniformPropSimulatedAnnealing()
 {
   SeedRNGEngWithRandDev(&rng_eng);
@@ -28,6 +28,7 @@
 #include <random>
 
 #include "xregCommon.h"
+#include "xregPopObjFn.h"
 
 namespace xreg
 {
@@ -66,10 +67,39 @@ struct SimulatedAnnealing
   
   ComputeEnergyFn energy_fn;
 
+  /// Number of proposals drawn from the current point at each iteration.
+  /// When greater than one, the energies of all proposals are computed in a
+  /// single call to pop_energy_fn and the lowest energy proposal is used for
+  /// the acceptance test.
+  size_type num_props_per_iter = 1;
+
+  /// Optional energy function evaluating a collection of points with a single
+  /// call, e.g. a batch of ray casts. When this is empty, energy_fn is called
+  /// at each point in serial.
+  PopObjFn pop_energy_fn;
+
   ProposalFn prop_fn;
   
   TempUpdateFn temp_update_fn = &SimAnnLinearTempDecay;
 
+  /// Number of chains advanced in lockstep (parallel tempering). When greater
+  /// than one, the proposals of every chain are computed in a single call to
+  /// pop_energy_fn (or energy_fn in serial), with num_props_per_iter
+  /// proposals per chain. Chain c uses the temperature
+  /// cur_temp * (chain_temp_ratio ^ c), so chain 0 is the coldest and provides
+  /// the current point and energy passed to the iteration callbacks.
+  size_type num_chains = 1;
+
+  /// Ratio of the temperatures of adjacent chains; should be greater than one.
+  CoordScalar chain_temp_ratio = 2;
+
+  /// Number of iterations between attempts at swapping the points of
+  /// adjacent chains; a value of zero disables swaps. Each attempt
+  /// alternates between the even and odd pairs of adjacent chains and
+  /// each pair swaps with the Metropolis probability
+  /// min(1, exp((E_c - E_{c+1}) * (1/T_c - 1/T_{c+1}))).
+  size_type swap_freq = 1;
+
   BeginIterFn begin_of_iter_fn;
 
   EndIterFn end_of_iter_fn;
@@ -82,7 +112,18 @@ struct SimulatedAnnealing
   PtN         cur_pt;
   CoordScalar cur_energy;
 
+  /// The current point and energy of each chain, ordered from coldest to
+  /// hottest; only populated when num_chains is greater than one.
+  PtNList chain_pts;
+  PtN     chain_energies;
+
+  /// Number of accepted swaps between chains
+  size_type num_swaps_accepted = 0;
+
   void run();
+
+private:
+  void run_chains();
 };
 
 struct MultivarUniformPropSimulatedAnnealing
@@ -31,180 +31,260 @@
 #include "xregITKOpenCVUtils.h"
 #include "xregOpenCVUtils.h"
 #include "xregHUToLinAtt.h"
+#include "xregRayCastOccContourOCL.h"
+#include "xregTBBUtils.h"
 
 void xreg::EdgesFromRayCast::operator()()
 {
   xregASSERT(do_canny || do_boundary || do_occ);
 
-  auto common_init = [] (RayCaster* rc, std::vector<VolPtr>& vols, const CameraModel& cam)
-  {
-    if (rc)
-    {
-      rc->set_volumes(vols);
-      rc->set_num_projs(1); 
-      rc->set_ray_step_size(1);
-      rc->set_camera_model(cam);
-      rc->allocate_resources();
-    }
-  };
-  
-  std::vector<VolPtr> vols_to_use = { vol };
+  const size_type num_vols = label_vol ? obj_label_vals.size() : size_type(1);
+  xregASSERT(num_vols > 0);
 
-  if (label_vol)
-  {
-    xregASSERT(!obj_label_vals.empty());
+  xregASSERT(!cam_wrt_vols.empty() && ((cam_wrt_vols.size() % num_vols) == 0));
 
-    vols_to_use.clear();
-    vols_to_use.reserve(obj_label_vals.size());
+  const size_type num_pose_sets = cam_wrt_vols.size() / num_vols;
+
+  if (!reuse_ray_casters || (num_pose_sets != num_pose_sets_alloc_))
+  {
+    auto common_init = [num_pose_sets] (RayCaster* rc, std::vector<VolPtr>& vols, const CameraModel& cam)
+    {
+      if (rc)
+      {
+        rc->set_volumes(vols);
+        rc->set_num_projs(num_pose_sets); 
+        rc->set_ray_step_size(1);
+        rc->set_camera_model(cam);
+        rc->allocate_resources();
+      }
+    };
+    
+    std::vector<VolPtr> vols_to_use = { vol };
 
-    for (const LabelScalar l : obj_label_vals)
+    if (label_vol)
     {
-      this->dout() << "masking volume for object " << int(l) << "..." << std::endl;
-      vols_to_use.push_back(ApplyMaskToITKImage(vol.GetPointer(), label_vol.GetPointer(),
-                                                l, RayCaster::PixelScalar3D(-1000), true));
+      vols_to_use.clear();
+      vols_to_use.reserve(num_vols);
+
+      for (const LabelScalar l : obj_label_vals)
+      {
+        this->dout() << "masking volume for object " << int(l) << "..." << std::endl;
+        vols_to_use.push_back(ApplyMaskToITKImage(vol.GetPointer(), label_vol.GetPointer(),
+                                                  l, RayCaster::PixelScalar3D(-1000), true));
+      }
     }
-  }
-  
-  const size_type num_vols = vols_to_use.size();
+    
+    std::vector<VolPtr> att_vols;
 
-  xregASSERT(cam_wrt_vols.size() == num_vols);
+    if (do_canny)
+    {
+      this->dout() << "canny init..." << std::endl;
 
-  std::vector<VolPtr> att_vols;
+      this->dout() << "HU -> Att..." << std::endl;
 
-  if (do_canny)
-  {
-    this->dout() << "canny init..." << std::endl;
+      att_vols.reserve(num_vols);
 
-    this->dout() << "HU -> Att..." << std::endl;
+      for (const auto& v : vols_to_use)
+      {
+        auto hu2att = HUToLinAttFilter::New();
+        hu2att->SetInput(v);
+        hu2att->Update();
 
-    att_vols.reserve(num_vols);
+        att_vols.push_back(hu2att->GetOutput());
+      }
+    
+      this->dout() << "line integral ray caster init..." << std::endl; 
+      common_init(line_int_ray_caster.get(), att_vols, cam);
+    }
 
-    for (const auto& v : vols_to_use)
+    if (do_boundary)
     {
-      auto hu2att = HUToLinAttFilter::New();
-      hu2att->SetInput(v);
-      hu2att->Update();
+      this->dout() << "boundary ray caster init..." << std::endl;
+
+      common_init(boundary_ray_caster.get(), vols_to_use, cam);
+      
+      auto* coll_rc = dynamic_cast<RayCasterCollisionParamInterface*>(boundary_ray_caster.get());
+      xregASSERT(coll_rc);
 
-      att_vols.push_back(hu2att->GetOutput());
+      coll_rc->set_render_thresh(thresh);
     }
-  
-    this->dout() << "line integral ray caster init..." << std::endl; 
-    common_init(line_int_ray_caster.get(), att_vols, cam);
-  }
 
-  if (do_boundary)
-  {
-    this->dout() << "boundary ray caster init..." << std::endl;
+    if (do_occ)
+    {
+      this->dout() << "occluding contours ray caster init..." << std::endl;
 
-    common_init(boundary_ray_caster.get(), vols_to_use, cam);
-    
-    auto* coll_rc = dynamic_cast<RayCasterCollisionParamInterface*>(boundary_ray_caster.get());
-    xregASSERT(coll_rc);
+      common_init(occ_ray_caster.get(), vols_to_use, cam);
+      
+      auto* cont_rc = dynamic_cast<RayCasterOccludingContours*>(occ_ray_caster.get());
+      xregASSERT(cont_rc);
+
+      cont_rc->set_render_thresh(thresh);
+      cont_rc->set_occlusion_angle_thresh_deg(occ_ang_deg);
+
+      if (auto* cont_rc_ocl = dynamic_cast<RayCasterOccludingContoursOCL*>(occ_ray_caster.get()))
+      {
+        // only transfer the edge pixels from the device
+        cont_rc_ocl->set_compute_edge_pixel_lists(true);
+      }
+    }
 
-    coll_rc->set_render_thresh(thresh);
+    num_pose_sets_alloc_ = num_pose_sets;
   }
 
-  if (do_occ)
+  // renders every pose set in a single batch for each volume, accumulating
+  // the volumes into the same projections
+  auto render_all_pose_sets = [&] (RayCaster* rc)
   {
-    this->dout() << "occluding contours ray caster init..." << std::endl;
+    rc->use_proj_store_replace_method();
 
-    common_init(occ_ray_caster.get(), vols_to_use, cam);
+    FrameTransformList vol_poses(num_pose_sets);
     
-    auto* cont_rc = dynamic_cast<RayCasterOccludingContours*>(occ_ray_caster.get());
-    xregASSERT(cont_rc);
+    for (size_type v = 0; v < num_vols; ++v)
+    {
+      for (size_type p = 0; p < num_pose_sets; ++p)
+      {
+        vol_poses[p] = cam_wrt_vols[(p * num_vols) + v];
+      }
+
+      rc->set_xforms_cam_to_itk_phys(vol_poses);
+      rc->compute(v);
+      rc->use_proj_store_accum_method();
+    }
+  };
 
-    cont_rc->set_render_thresh(thresh);
-    cont_rc->set_occlusion_angle_thresh_deg(occ_ang_deg);
+  std::vector<cv::Mat> edge_imgs(num_pose_sets);
+
+  for (auto& edge_img : edge_imgs)
+  {
+    edge_img = cv::Mat::zeros(cam.num_det_rows, cam.num_det_cols, CV_8UC1);
   }
 
-  cv::Mat edge_img = cv::Mat::zeros(cam.num_det_rows,
-                                    cam.num_det_cols,
-                                    CV_8UC1);
-  
+  // the projections are retrieved serially, so that any device to host
+  // transfers are performed once, and then the edges of each pose set are
+  // extracted in parallel
+
   if (do_canny)
   {
-    this->dout() << "computing DRR for canny edges..." << std::endl;
+    this->dout() << "computing DRRs for canny edges..." << std::endl;
     
-    line_int_ray_caster->use_proj_store_replace_method();
+    render_all_pose_sets(line_int_ray_caster.get());
     
-    for (size_type v = 0; v < num_vols; ++v)
+    std::vector<RayCaster::ProjPtr> drrs(num_pose_sets);
+
+    for (size_type p = 0; p < num_pose_sets; ++p)
     {
-      line_int_ray_caster->distribute_xform_among_cam_models(cam_wrt_vols[v]);
-      line_int_ray_caster->compute(v);
-      line_int_ray_caster->use_proj_store_accum_method();
+      drrs[p] = line_int_ray_caster->make_proj_view(p);
     }
 
-    cv::Mat drr_8bpp = ShallowCopyItkToOpenCV(ITKImageRemap8bpp(
-          line_int_ray_caster->proj(0).GetPointer()).GetPointer()).clone();
-    
-    if (canny_smooth_width > 1)
+    auto canny_fn = [&] (const RangeType& r)
     {
-      cv::GaussianBlur(drr_8bpp.clone(), drr_8bpp,
-                       cv::Size(canny_smooth_width,canny_smooth_width), 0);
-    } 
-    
-    cv::Canny(drr_8bpp, drr_8bpp, canny_low_thresh, canny_high_thresh); 
-  
-    cv::bitwise_or(edge_img, drr_8bpp, edge_img);
+      for (size_type p = r.begin(); p < r.end(); ++p)
+      {
+        cv::Mat drr_8bpp = ShallowCopyItkToOpenCV(ITKImageRemap8bpp(
+              drrs[p].GetPointer()).GetPointer()).clone();
+        
+        if (canny_smooth_width > 1)
+        {
+          cv::GaussianBlur(drr_8bpp.clone(), drr_8bpp,
+                           cv::Size(canny_smooth_width,canny_smooth_width), 0);
+        } 
+        
+        cv::Canny(drr_8bpp, drr_8bpp, canny_low_thresh, canny_high_thresh); 
+      
+        cv::bitwise_or(edge_imgs[p], drr_8bpp, edge_imgs[p]);
+      }
+    };
+
+    ParallelFor(canny_fn, RangeType(0, num_pose_sets));
   }
   
   if (do_boundary)
   { 
-    this->dout() << "computing depth map for boundary edges..." << std::endl;
-    boundary_ray_caster->use_proj_store_replace_method();
+    this->dout() << "computing depth maps for boundary edges..." << std::endl;
+
+    render_all_pose_sets(boundary_ray_caster.get());
     
-    for (size_type v = 0; v < num_vols; ++v)
+    std::vector<cv::Mat> depth_maps(num_pose_sets);
+
+    for (size_type p = 0; p < num_pose_sets; ++p)
     {
-      boundary_ray_caster->distribute_xform_among_cam_models(cam_wrt_vols[v]);
-      boundary_ray_caster->compute(v);
-      boundary_ray_caster->use_proj_store_accum_method();
+      depth_maps[p] = boundary_ray_caster->proj_ocv_view(p);
     }
     
-    cv::Mat boundary_edges;
-    FindPixelsWithAdjacentIntensity(boundary_ray_caster->proj_ocv(0),
-                                    &boundary_edges, kRAY_CAST_MAX_DEPTH);
-    
-    cv::bitwise_or(edge_img, boundary_edges, edge_img);
+    auto boundary_fn = [&] (const RangeType& r)
+    {
+      for (size_type p = r.begin(); p < r.end(); ++p)
+      {
+        cv::Mat boundary_edges;
+        FindPixelsWithAdjacentIntensity(depth_maps[p], &boundary_edges, kRAY_CAST_MAX_DEPTH);
+        
+        cv::bitwise_or(edge_imgs[p], boundary_edges, edge_imgs[p]);
+      }
+    };
+
+    ParallelFor(boundary_fn, RangeType(0, num_pose_sets));
   }
 
   if (do_occ)
   {
     this->dout() << "computing occluding contours..." << std::endl;
-    occ_ray_caster->use_proj_store_replace_method();
-    
-    for (size_type v = 0; v < num_vols; ++v)
+
+    render_all_pose_sets(occ_ray_caster.get());
+  
+    auto* cont_rc_ocl = dynamic_cast<RayCasterOccludingContoursOCL*>(occ_ray_caster.get());
+
+    for (size_type p = 0; p < num_pose_sets; ++p)
     {
-      occ_ray_caster->distribute_xform_among_cam_models(cam_wrt_vols[v]);
-      occ_ray_caster->compute(v);
-      occ_ray_caster->use_proj_store_accum_method();
+      cv::Mat& edge_img = edge_imgs[p];
+
+      if (cont_rc_ocl && cont_rc_ocl->compute_edge_pixel_lists())
+      {
+        for (const auto& e : cont_rc_ocl->edge_pixels(p))
+        {
+          edge_img.at<unsigned char>(e.row, e.col) = 1;
+        }
+      }
+      else
+      {
+        cv::bitwise_or(edge_img, occ_ray_caster->proj_ocv_view(p), edge_img);
+      }
     }
-  
-    cv::bitwise_or(edge_img, occ_ray_caster->proj_ocv(0), edge_img);
   }
 
-  // change all non-zero values to 1
-  for (int r = 0; r < edge_img.rows; ++r)
-  {
-    unsigned char* row_buf = &edge_img.at<unsigned char>(r,0);
+  final_edge_imgs.assign(num_pose_sets, nullptr);
 
-    for (int c = 0; c < edge_img.cols; ++c)
+  auto finalize_fn = [&] (const RangeType& r)
+  {
+    for (size_type p = r.begin(); p < r.end(); ++p)
     {
-      if (row_buf[c] > 1)
+      cv::Mat& edge_img = edge_imgs[p];
+
+      // change all non-zero values to 1
+      for (int row = 0; row < edge_img.rows; ++row)
+      {
+        unsigned char* row_buf = &edge_img.at<unsigned char>(row,0);
+
+        for (int c = 0; c < edge_img.cols; ++c)
+        {
+          if (row_buf[c] > 1)
+          {
+            row_buf[c] = 1;
+          }
+        }
+      }
+
+      if (edge_dilate_width > 1)
       {
-        row_buf[c] = 1;
+        cv::dilate(edge_img.clone(), edge_img,
+                   cv::getStructuringElement(cv::MORPH_ELLIPSE,
+                                      cv::Size(edge_dilate_width,edge_dilate_width)));
       }
+      
+      final_edge_imgs[p] = ITKImageDeepCopy(ShallowCopyOpenCVToItk<unsigned char>(edge_img).GetPointer());
     }
-  }
+  };
 
-  if (edge_dilate_width > 1)
-  {
-    this->dout() << "dilating edges..." << std::endl;
+  ParallelFor(finalize_fn, RangeType(0, num_pose_sets));
 
-    cv::dilate(edge_img.clone(), edge_img,
-               cv::getStructuringElement(cv::MORPH_ELLIPSE,
-                                  cv::Size(edge_dilate_width,edge_dilate_width)));
-  }
-  
-  final_edge_img = ITKImageDeepCopy(ShallowCopyOpenCVToItk<unsigned char>(edge_img).GetPointer());
+  final_edge_img = final_edge_imgs[0];
 }
-
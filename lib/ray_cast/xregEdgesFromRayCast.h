@@ -74,13 +74,32 @@ struct EdgesFromRayCast : ObjWithOStream
   std::shared_ptr<RayCaster> boundary_ray_caster;
   std::shared_ptr<RayCaster> occ_ray_caster;
   
+  /// \brief The poses of each volume used to create edge images.
+  ///
+  /// An edge image is created for every set of volume poses; entry
+  /// (p * number of volumes) + v is the pose of volume v in the pth set. All
+  /// sets are rendered in the same ray casting batches.
   FrameTransformList cam_wrt_vols;
 
   std::vector<LabelScalar> obj_label_vals;
 
+  /// \brief The edge image of the first set of volume poses
   EdgeProjPtr final_edge_img;
 
+  /// \brief The edge images of each set of volume poses
+  std::vector<EdgeProjPtr> final_edge_imgs;
+
+  /// \brief Reuse the ray casters allocated by the previous call when the
+  ///        number of volume pose sets has not changed.
+  ///
+  /// The volumes are not re-masked and re-uploaded; the volumes, labels,
+  /// camera and ray casters must not have been changed since the previous call.
+  bool reuse_ray_casters = false;
+
   void operator()();
+
+private:
+  size_type num_pose_sets_alloc_ = 0;
 };
 
 }  // xreg
@@ -24,10 +24,14 @@
 
 #include "xregProj3DLabelsTo2D.h"
 
+#include <array>
+
 #include "xregAssert.h"
 #include "xregITKBasicImageUtils.h"
 #include "xregITKLabelUtils.h"
 #include "xregProjData.h"
+#include "xregSpatialPrimitives.h"
+#include "xregTBBUtils.h"
 
 namespace // un-named
 {
@@ -113,12 +117,139 @@ void IntersToBGMask(cv::Mat* inter_img)
   }
 }
 
+// Traverses the label volume once for each ray, using nearest neighbor
+// interpolation, and records the depth of the first voxel of each projected
+// label and the length of the ray passing through each projected label.
+// label_to_chan maps a label value to the index of its channel, or -1 when the
+// label is not projected. depths[i] and line_lens[i] are the outputs for
+// channel i and should be initialized to kRAY_CAST_MAX_DEPTH and 0.
+void ProjLabelsSinglePass(const itk::Image<unsigned char,3>* label_vol,
+                          const std::array<int,256>& label_to_chan,
+                          const CameraModel& cam,
+                          const FrameTransform& cam_to_itk_phys,
+                          const CoordScalar step_size,
+                          cv::Mat* depths,
+                          cv::Mat* line_lens)
+{
+  Pt3 img_aabb_min;
+  Pt3 img_aabb_max;
+  std::tie(img_aabb_min,img_aabb_max) = ITKImageIndexBoundsAsEigen(label_vol);
+
+  const FrameTransform xform_cam_to_itk_idx =
+          ITKImagePhysicalPointTransformsAsEigen(label_vol).inverse() * cam_to_itk_phys;
+
+  const Pt3 pinhole_wrt_itk_idx = xform_cam_to_itk_idx * cam.pinhole_pt;
+
+  const auto vol_size = label_vol->GetLargestPossibleRegion().GetSize();
+
+  const std::array<long,3> max_idx = { static_cast<long>(vol_size[0]) - 1,
+                                       static_cast<long>(vol_size[1]) - 1,
+                                       static_cast<long>(vol_size[2]) - 1 };
+
+  const auto& off_tbl = label_vol->GetOffsetTable();
+
+  const unsigned char* vol_buf = label_vol->GetBufferPointer();
+
+  const size_type nc = cam.num_det_cols;
+
+  auto cast_rays = [&] (const RangeType& r)
+  {
+    for (size_type pix_idx = r.begin(); pix_idx < r.end(); ++pix_idx)
+    {
+      const size_type row_idx = pix_idx / nc;
+      const size_type col_idx = pix_idx - (row_idx * nc);
+
+      const Pt3 cur_det_pt_wrt_cam = cam.ind_pt_to_phys_det_pt(Pt2{static_cast<CoordScalar>(col_idx),
+                                                                   static_cast<CoordScalar>(row_idx)});
+
+      const Pt3 pinhole_to_det_wrt_itk_idx = (xform_cam_to_itk_idx * cur_det_pt_wrt_cam) - pinhole_wrt_itk_idx;
+
+      CoordScalar t_start = 0;
+      CoordScalar t_stop  = 0;
+
+      bool inter_vol = false;
+
+      std::tie(inter_vol,t_start,t_stop) = RayRectIntersect(img_aabb_min, img_aabb_max,
+                                                            pinhole_wrt_itk_idx, pinhole_to_det_wrt_itk_idx,
+                                                            false);  // false -> do not limit to line segment
+
+      if (inter_vol && (t_stop > t_start))
+      {
+        // The line parameter is preserved by the affine map into index space,
+        // so the depth at a parameter t is t times the source to detector
+        // distance of this pixel in the camera frame.
+        const CoordScalar pinhole_to_det_len_wrt_cam = (cur_det_pt_wrt_cam - cam.pinhole_pt).norm();
+
+        const CoordScalar step_t = step_size / pinhole_to_det_len_wrt_cam;
+
+        const std::int64_t num_steps = static_cast<std::int64_t>((t_stop - t_start) / step_t);
+
+        for (std::int64_t step_idx = 0; step_idx <= num_steps; ++step_idx)
+        {
+          const CoordScalar t = t_start + (static_cast<CoordScalar>(step_idx) * step_t);
+
+          const Pt3 cur_cont_vol_idx = pinhole_wrt_itk_idx + (t * pinhole_to_det_wrt_itk_idx);
+
+          size_type vox_off = 0;
+          for (unsigned int d = 0; d < 3; ++d)
+          {
+            const long i = std::min(std::max(std::lround(cur_cont_vol_idx[d]), 0L), max_idx[d]);
+
+            vox_off += static_cast<size_type>(i) * static_cast<size_type>(off_tbl[d]);
+          }
+
+          const int chan = label_to_chan[vol_buf[vox_off]];
+
+          if (chan >= 0)
+          {
+            auto& cur_depth = depths[chan].at<DepthScalar>(row_idx,col_idx);
+
+            if (cur_depth >= kRAY_CAST_MAX_DEPTH)
+            {
+              cur_depth = static_cast<DepthScalar>(t * pinhole_to_det_len_wrt_cam);
+            }
+
+            line_lens[chan].at<DepthScalar>(row_idx,col_idx) += static_cast<DepthScalar>(step_size);
+          }
+        }
+      }
+    }
+  };
+
+  ParallelFor(cast_rays, RangeType(0, cam.num_det_rows * nc));
+}
+
 }  // un-named
 
 void xreg::Proj3DLabelsTo2D::init()
 {
   dout() << "initializing 3D label projector..." << std::endl;
 
+  if (single_pass)
+  {
+    dout() << "setting up single pass storage..." << std::endl;
+
+    seg_channels.resize(labels_to_proj.size() + 1);
+    label_line_lens.resize(labels_to_proj.size());
+
+    for (auto& m : seg_channels)
+    {
+      m = cv::Mat(cam.num_det_rows, cam.num_det_cols, cv::DataType<DepthScalar>::type);
+    }
+
+    for (auto& m : label_line_lens)
+    {
+      m = cv::Mat(cam.num_det_rows, cam.num_det_cols, cv::DataType<DepthScalar>::type);
+    }
+    
+    if (convert_to_single_chan_seg_fn)
+    {
+      single_chan_seg = MakeImageU8FromCam(cam);
+    }
+
+    return;
+  }
+
   dout() << "extracting sub-label vols..." << std::endl;
   auto label_vols = MakeVolListFromVolAndLabels(label_vol.GetPointer(), label_vol.GetPointer(),
                                                 labels_to_proj, 0);
@@ -166,16 +297,51 @@ void xreg::Proj3DLabelsTo2D::run()
   
   const size_type num_non_bg_labels = labels_to_proj.size();
 
-  for (size_type non_bg_label = 0; non_bg_label < num_non_bg_labels; ++non_bg_label)
+  if (single_pass)
   {
-    dout() << "  depth computation for object: " << non_bg_label << std::endl;
+    dout() << "  single pass depth computation for all objects..." << std::endl;
 
-    depth_ray_caster->xform_cam_to_itk_phys(0) = obj_poses[non_bg_label];
-    
-    depth_ray_caster->compute(non_bg_label);
+    xregASSERT(obj_poses.size() == num_non_bg_labels);
+
+    for (size_type non_bg_label = 1; non_bg_label < num_non_bg_labels; ++non_bg_label)
+    {
+      xregASSERT(obj_poses[non_bg_label].matrix() == obj_poses[0].matrix());
+    }
+
+    std::array<int,256> label_to_chan;
+    label_to_chan.fill(-1);
+
+    for (size_type non_bg_label = 0; non_bg_label < num_non_bg_labels; ++non_bg_label)
+    {
+      label_to_chan[labels_to_proj[non_bg_label]] = static_cast<int>(non_bg_label);
+    }
+
+    for (size_type non_bg_label = 0; non_bg_label < num_non_bg_labels; ++non_bg_label)
+    {
+      // +1 to skip bg channel  
+      seg_channels[non_bg_label+1].setTo(kRAY_CAST_MAX_DEPTH);
+      label_line_lens[non_bg_label].setTo(0);
+    }
 
-    // +1 to skip bg channel  
-    seg_channels[non_bg_label+1] = depth_ray_caster->proj_ocv(0).clone();
+    if (num_non_bg_labels)
+    {
+      ProjLabelsSinglePass(label_vol.GetPointer(), label_to_chan, cam, obj_poses[0],
+                           single_pass_step_size, &seg_channels[1], &label_line_lens[0]);
+    }
+  }
+  else
+  {
+    for (size_type non_bg_label = 0; non_bg_label < num_non_bg_labels; ++non_bg_label)
+    {
+      dout() << "  depth computation for object: " << non_bg_label << std::endl;
+
+      depth_ray_caster->xform_cam_to_itk_phys(0) = obj_poses[non_bg_label];
+      
+      depth_ray_caster->compute(non_bg_label);
+
+      // +1 to skip bg channel  
+      seg_channels[non_bg_label+1] = depth_ray_caster->proj_ocv_view(0).clone();
+    }
   }
 
   if (convert_to_single_chan_seg_fn)
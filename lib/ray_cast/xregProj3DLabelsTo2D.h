@@ -55,8 +55,21 @@ struct Proj3DLabelsTo2D : ObjWithOStream
   // single_chan_seg is passed into the second arg
   std::function<void(const std::vector<cv::Mat>&,LabelImg2D*)> convert_to_single_chan_seg_fn;
 
+  // When true, the label volume is traversed once per ray, recording the first
+  // hit depth and the length of the ray inside of every label in labels_to_proj,
+  // instead of ray casting a separate binary volume for each label with
+  // depth_ray_caster. The volume is sampled using nearest neighbor
+  // interpolation. This requires all entries of obj_poses to be equal, e.g.
+  // every label is at the pose of the label volume; depth_ray_caster is not used
+  // and may be null.
+  bool single_pass = false;
+
+  // The step size along each ray, in the units of the camera frame, used when
+  // single_pass is true
+  CoordScalar single_pass_step_size = 0.25;
+
   // The following members should be set before calling init()
-  //   * depth_ray_caster
+  //   * depth_ray_caster (unless single_pass is true)
   //   * label_vol
   //   * labels_to_proj
   //   * cam
@@ -77,6 +90,11 @@ struct Proj3DLabelsTo2D : ObjWithOStream
   std::vector<cv::Mat> seg_channels;
 
   LabelImg2DPtr single_chan_seg;
+
+  // Only populated when single_pass is true:
+  // label_line_lens[i](row,col) is the length of the ray, in the units of the
+  // camera frame, passing through voxels of label labels_to_proj[i]
+  std::vector<cv::Mat> label_line_lens;
 };
 
 }  // xreg
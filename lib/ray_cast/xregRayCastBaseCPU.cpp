@@ -24,8 +24,18 @@
 
 #include "xregRayCastBaseCPU.h"
 
+#include <algorithm>
+#include <random>
+
+#include <itkLinearInterpolateImageFunction.h>
+#include <itkNearestNeighborInterpolateImageFunction.h>
+#include <itkWindowedSincInterpolateImageFunction.h>
+#include <itkConstantBoundaryCondition.h>
+#include <itkBSplineResampleImageFunction.h>
+
 #include "xregExceptionUtils.h"
 #include "xregAssert.h"
+#include "xregHugePages.h"
 
 xreg::RayCasterCPU::RayCasterCPU()
 {
@@ -47,6 +57,13 @@ void xreg::RayCasterCPU::set_num_projs(const size_type num_projs)
   }
 }
 
+void xreg::RayCasterCPU::vols_changed()
+{
+  RayCaster::vols_changed();
+
+  thread_state_pool_.clear();
+}
+
 void xreg::RayCasterCPU::allocate_resources()
 {
   RayCaster::allocate_resources();
@@ -73,7 +90,22 @@ void xreg::RayCasterCPU::allocate_resources()
 
   if (!ext_pixel_buf_)
   {
+    // the capacity is kept when fewer pixels are needed than previously
+    const size_type num_pix_to_reserve = std::max(num_tot_pix, this->reserved_num_pix_);
+
+    if (this->use_huge_pages_)
+    {
+      ReserveWithHugePages(&pixel_buf_, num_pix_to_reserve);
+    }
+    else
+    {
+      pixel_buf_.reserve(num_pix_to_reserve);
+    }
+
     pixel_buf_.resize(num_tot_pix);
+
+    pixel_buf_mem_.set_bytes(pixel_buf_.capacity() * sizeof(PixelScalar2D));
+
     sync_to_ocl_.set_host(pixel_buf_);
     sync_to_host_.set_host(pixel_buf_);
   }
@@ -157,3 +189,136 @@ void xreg::RayCasterCPU::pre_compute()
   }
 }
 
+xreg::Pt2List xreg::RayCasterCPU::anti_alias_jitter_table() const
+{
+  Pt2List offsets;
+
+  if (aa_fact_)
+  {
+    switch (aa_sampler_)
+    {
+      case kRAY_CAST_AA_SAMPLER_STRATIFIED:
+        offsets = RayCastStratifiedPts2D(aa_fact_);
+        break;
+      case kRAY_CAST_AA_SAMPLER_SOBOL:
+        offsets = RayCastSobolPts2D(aa_fact_);
+        break;
+      case kRAY_CAST_AA_SAMPLER_RANDOM:
+      default:
+        break;
+    }
+
+    // center the offsets on the pixel
+    for (auto& off : offsets)
+    {
+      off.array() -= CoordScalar(0.5);
+    }
+  }
+
+  return offsets;
+}
+
+itk::InterpolateImageFunction<xreg::RayCaster::Vol,xreg::CoordScalar>::Pointer
+xreg::MakeRayCastITKInterp(const RayCaster::InterpMethod interp_method,
+                           const RayCaster::Vol* vol,
+                           const RayCaster::Vol* bspline_coefs)
+{
+  using Vol = RayCaster::Vol;
+
+  using VolInterpType       = itk::InterpolateImageFunction<Vol,CoordScalar>;
+  using VolLinearInterpType = itk::LinearInterpolateImageFunction<Vol,CoordScalar>;
+  using VolNNInterpType     = itk::NearestNeighborInterpolateImageFunction<Vol,CoordScalar>;
+  using VolSincInterpType   = itk::WindowedSincInterpolateImageFunction<
+                                      Vol,4,itk::Function::LanczosWindowFunction<4>,
+                                      itk::ConstantBoundaryCondition<Vol>,CoordScalar>;
+
+  // a B-spline interpolator whose input image is already the coefficients
+  using VolBSplineCoefInterpType = itk::BSplineResampleImageFunction<Vol,CoordScalar>;
+
+  VolInterpType::Pointer vol_interp;
+
+  switch (interp_method)
+  {
+    case RayCaster::kRAY_CAST_INTERP_NN:
+      vol_interp = VolNNInterpType::New();
+      vol_interp->SetInputImage(vol);
+      break;
+    case RayCaster::kRAY_CAST_INTERP_SINC:
+      // there is no prefiltering for the sinc interpolator
+      vol_interp = VolSincInterpType::New();
+      vol_interp->SetInputImage(vol);
+      break;
+    case RayCaster::kRAY_CAST_INTERP_BSPLINE:
+    {
+      xregASSERT(bspline_coefs);
+
+      auto bspline_interp = VolBSplineCoefInterpType::New();
+      bspline_interp->SetSplineOrder(3);
+      bspline_interp->SetInputImage(bspline_coefs);
+
+      vol_interp = bspline_interp;
+    }
+      break;
+    case RayCaster::kRAY_CAST_INTERP_LINEAR:
+    default:
+      vol_interp = VolLinearInterpType::New();
+      vol_interp->SetInputImage(vol);
+      break;
+  }
+
+  return vol_interp;
+}
+
+xreg::RayCastCPUThreadStatePool::VolInterpPtr
+xreg::RayCastCPUThreadStatePool::interp(const RayCaster::InterpMethod interp_method,
+                                        const RayCaster::Vol* vol,
+                                        const RayCaster::Vol* bspline_coefs)
+{
+  auto& interps = thread_states_.local().interps;
+
+  // the image actually sampled by the interpolator
+  const RayCaster::Vol* input_img = (interp_method == RayCaster::kRAY_CAST_INTERP_BSPLINE) ?
+                                                                      bspline_coefs : vol;
+  xregASSERT(input_img);
+
+  const itk::ModifiedTimeType input_mtime = input_img->GetMTime();
+
+  for (auto& e : interps)
+  {
+    if ((e.interp_method == interp_method) && (e.vol == vol) && (e.bspline_coefs == bspline_coefs))
+    {
+      if (e.input_mtime != input_mtime)
+      {
+        // the volume was modified in place, e.g. reallocated with a new region
+        e.interp->SetInputImage(input_img);
+        e.input_mtime = input_mtime;
+      }
+
+      return e.interp;
+    }
+  }
+
+  interps.push_back({ interp_method, vol, bspline_coefs, input_mtime,
+                      MakeRayCastITKInterp(interp_method, vol, bspline_coefs) });
+
+  return interps.back().interp;
+}
+
+xreg::RayCastCPUThreadStatePool::RNGEngine&
+xreg::RayCastCPUThreadStatePool::rng_eng()
+{
+  auto& eng = thread_states_.local().rng_eng;
+
+  if (!eng)
+  {
+    std::random_device rd;
+    eng.reset(new RNGEngine(rd()));
+  }
+
+  return *eng;
+}
+
+void xreg::RayCastCPUThreadStatePool::clear()
+{
+  thread_states_.clear();
+}
@@ -25,17 +25,114 @@
 #ifndef XREGRAYCASTBASECPU_H_
 #define XREGRAYCASTBASECPU_H_
 
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <tbb/enumerable_thread_specific.h>
+
+#include <itkInterpolateImageFunction.h>
+
 #include "xregRayCastInterface.h"
 #include "xregRayCastSyncBuf.h"
+#include "xregMemTracking.h"
 
 namespace xreg
 {
 
+/// \brief Creates an ITK interpolator of a volume for a CPU ray caster.
+///
+/// When using B-spline interpolation, bspline_coefs must be the coefficients
+/// of vol (see RayCaster::bspline_coefs()), which are sampled directly instead
+/// of prefiltering vol again. The coefficients are not modified, so they may
+/// be shared by interpolators on several threads; each thread still needs
+/// its own interpolator.
+itk::InterpolateImageFunction<RayCaster::Vol,CoordScalar>::Pointer
+MakeRayCastITKInterp(const RayCaster::InterpMethod interp_method,
+                     const RayCaster::Vol* vol,
+                     const RayCaster::Vol* bspline_coefs);
+
+/// \brief ITK interpolators and random number engines of each thread used by
+///        the CPU ray casters.
+///
+/// Tasks of the CPU ray casters may only consist of a small tile of rays,
+/// which makes creating an ITK interpolator and seeding a random engine in
+/// every task relatively expensive. Instead, each thread keeps an interpolator
+/// for every volume it casts rays through, and a single random engine, which
+/// persist across tasks and calls to compute(). A cached interpolator holds a
+/// reference to its volume, so an entry is never confused with another volume
+/// allocated at the same address, and is updated when its volume is modified.
+/// The cache should be cleared whenever the volumes of a ray caster change.
+class RayCastCPUThreadStatePool
+{
+public:
+  using VolInterp    = itk::InterpolateImageFunction<RayCaster::Vol,CoordScalar>;
+  using VolInterpPtr = VolInterp::Pointer;
+
+  using RNGEngine = std::mt19937;
+
+  /// \brief Retrieves the calling thread's interpolator of a volume, creating
+  ///        it on the first call by the thread.
+  ///
+  /// The arguments are the same as those of MakeRayCastITKInterp(). The
+  /// interpolator should only be used by the calling thread.
+  VolInterpPtr interp(const RayCaster::InterpMethod interp_method,
+                      const RayCaster::Vol* vol,
+                      const RayCaster::Vol* bspline_coefs);
+
+  /// \brief Retrieves the calling thread's random engine, which is seeded
+  ///        with a random device on the first call by the thread.
+  RNGEngine& rng_eng();
+
+  /// \brief Discards the interpolators and random engines of every thread.
+  ///
+  /// This must not be called while rays are being cast.
+  void clear();
+
+private:
+  struct InterpEntry
+  {
+    RayCaster::InterpMethod interp_method;
+
+    const RayCaster::Vol* vol;
+    const RayCaster::Vol* bspline_coefs;
+
+    /// \brief Modification time of the interpolator's input image when it was set
+    itk::ModifiedTimeType input_mtime;
+
+    VolInterpPtr interp;
+  };
+
+  struct ThreadState
+  {
+    std::vector<InterpEntry> interps;
+
+    std::unique_ptr<RNGEngine> rng_eng;
+  };
+
+  tbb::enumerable_thread_specific<ThreadState> thread_states_;
+};
+
 class RayCasterCPU : public RayCaster
 {
 public:
   constexpr static CoordScalar kVOL_BB_STEP_INC_TOL = 1.0e-3;
 
+  /// \brief Methods for choosing the sub-pixel jitter of anti-aliased rays.
+  enum AntiAliasSampler
+  {
+    /// \brief Random jitter drawn independently for every ray.
+    kRAY_CAST_AA_SAMPLER_RANDOM = 0,
+
+    /// \brief A fixed table of jitter offsets, stratified in each dimension
+    ///        (a Latin hypercube), used for every pixel.
+    kRAY_CAST_AA_SAMPLER_STRATIFIED,
+    
+    /// \brief A fixed table of jitter offsets, taken from the first points of
+    ///        the 2D Sobol sequence, used for every pixel.
+    kRAY_CAST_AA_SAMPLER_SOBOL
+  };
+
   /// \brief Trivial constructor - no work done
   RayCasterCPU();
 
@@ -129,6 +226,27 @@ public:
     return aa_fact_;
   }
 
+  /// \brief Sets the method used to jitter anti-aliased rays.
+  ///
+  /// The stratified and Sobol samplers use the same table of sub-pixel
+  /// offsets for every pixel, allowing the offsets to be precomputed and
+  /// shared by all threads. The projections computed with these samplers
+  /// are also reproducible between runs. Currently only the line integral
+  /// ray caster uses the tables.
+  /// Defaults to random jitter.
+  void set_anti_alias_sampler(const AntiAliasSampler aa_sampler)
+  {
+    aa_sampler_ = aa_sampler;
+  }
+
+  /// \brief Retrieves the method used to jitter anti-aliased rays.
+  ///
+  /// \see set_anti_alias_sampler
+  AntiAliasSampler anti_alias_sampler() const
+  {
+    return aa_sampler_;
+  }
+
 protected:
   using PixelBufferVec = std::vector<PixelScalar2D>;
 
@@ -144,6 +262,20 @@ protected:
   /// in a derived class.
   void pre_compute();
 
+  /// \brief The sub-pixel offsets of each anti-aliased ray, in units of
+  ///        detector indices and within [-0.5,0.5).
+  ///
+  /// There are anti_alias_factor() offsets, in the order the rays are cast.
+  /// This is empty when anti-aliasing is disabled or when random jitter is used.
+  Pt2List anti_alias_jitter_table() const;
+
+  /// \brief Clears the cached interpolators of the previous volumes.
+  void vols_changed() override;
+
+  /// \brief The ITK interpolators and random engines of each thread, shared by
+  ///        the tasks of every call to compute().
+  RayCastCPUThreadStatePool thread_state_pool_;
+
   PixelScalar2D* ext_pixel_buf_;
 
   /// \brief Host buffer used to store the line integral images.
@@ -153,10 +285,14 @@ protected:
   ///  Image 1 row 1 col 1, Image 1 row 1 col 2, ..., Image 1 row 1 col M, ..., Image 1 row N col M, Image 2 row 1 col 1, ... Image P row N col M
   PixelBufferVec pixel_buf_;
 
+  TrackedMemAlloc pixel_buf_mem_ = TrackedMemAlloc(MemLocation::kHOST, "ray-cast-proj-pixels");
+
   RayCastSyncHostBufFromHost sync_to_host_;
   RayCastSyncOCLBufFromHost  sync_to_ocl_;
 
   size_type aa_fact_ = 0;
+
+  AntiAliasSampler aa_sampler_ = kRAY_CAST_AA_SAMPLER_RANDOM;
 };
 
 }  // xreg
@@ -24,21 +24,461 @@
 
 #include "xregRayCastBaseOCL.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
 #include <boost/compute/types/struct.hpp>
+#include <boost/compute/utility/source.hpp>
 
 #include <fmt/format.h>
 
 #include "xregAssert.h"
 #include "xregExceptionUtils.h"
+#include "xregHashUtils.h"
 #include "xregITKBasicImageUtils.h"
+#include "xregOpenCLAutoTune.h"
 #include "xregOpenCLConvert.h"
 #include "xregOpenCLMath.h"
+#include "xregOpenCLProfiling.h"
 #include "xregOpenCLSpatial.h"
+#include "xregOpenCLSys.h"
+#include "xregTBBUtils.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+/// \brief Converts a single precision value to half precision (IEEE 754
+///        binary16), rounding to the nearest value with ties to even.
+std::uint16_t FloatToHalf(const float f)
+{
+  std::uint32_t x = 0;
+  std::memcpy(&x, &f, sizeof(x));
+
+  const std::uint32_t sign  = (x >> 16) & 0x8000u;
+  const std::uint32_t abs_x = x & 0x7FFFFFFFu;
+
+  std::uint32_t h = 0;
+
+  if (abs_x >= 0x7F800000u)
+  {
+    // infinity or NaN
+    h = 0x7C00u | ((abs_x > 0x7F800000u) ? 0x200u : 0u);
+  }
+  else if (abs_x >= 0x477FF000u)
+  {
+    // rounds to a magnitude of at least 65520, which overflows to infinity
+    h = 0x7C00u;
+  }
+  else if (abs_x >= 0x38800000u)
+  {
+    // normal half, re-bias the exponent and round the discarded mantissa bits
+    h = (abs_x - 0x38000000u) >> 13;
+
+    const std::uint32_t rem = abs_x & 0x1FFFu;
+
+    if ((rem > 0x1000u) || ((rem == 0x1000u) && (h & 1u)))
+    {
+      ++h;
+    }
+  }
+  else if (abs_x >= 0x33000000u)
+  {
+    // sub-normal half, the mantissa (with implicit one) is shifted
+    const std::uint32_t m = (abs_x & 0x7FFFFFu) | 0x800000u;
+
+    const std::uint32_t shift = 126u - (abs_x >> 23);
+
+    h = m >> shift;
+
+    const std::uint32_t rem      = m & ((1u << shift) - 1u);
+    const std::uint32_t half_way = 1u << (shift - 1u);
+
+    if ((rem > half_way) || ((rem == half_way) && (h & 1u)))
+    {
+      ++h;
+    }
+  }
+  // otherwise rounds to zero
+
+  return static_cast<std::uint16_t>(sign | h);
+}
+
+/// \brief Registry of device resources shared by all ray casters.
+///
+/// Only weak references are held, so a resource is released once the last ray
+/// caster using it is destroyed or stops using it.
+template <class tKey, class tRes>
+class SharedDevResRegistry
+{
+public:
+  using ResPtr = std::shared_ptr<tRes>;
+
+  template <class tCreateFn>
+  ResPtr find_or_create(const tKey& k, const tCreateFn& create_fn)
+  {
+    // creation is also performed with the lock held, so that concurrent
+    // requests for the same resource do not result in duplicate uploads
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // remove the entries of released resources
+    for (auto it = entries_.begin(); it != entries_.end(); )
+    {
+      if (it->second.expired())
+      {
+        it = entries_.erase(it);
+      }
+      else
+      {
+        ++it;
+      }
+    }
+
+    ResPtr res;
+
+    auto it = entries_.find(k);
+    if (it != entries_.end())
+    {
+      res = it->second.lock();
+    }
+
+    if (!res)
+    {
+      res = create_fn();
+      entries_[k] = res;
+    }
+
+    return res;
+  }
+
+private:
+  std::mutex mutex_;
+
+  std::map<tKey,std::weak_ptr<tRes>> entries_;
+};
+
+// context, volume, volume modified time, texture format
+using VolTexKey = std::tuple<cl_context,const void*,itk::ModifiedTimeType,int>;
+
+SharedDevResRegistry<VolTexKey,RayCastOCLVolTex>& VolTexRegistry()
+{
+  static SharedDevResRegistry<VolTexKey,RayCastOCLVolTex> reg;
+  return reg;
+}
+
+using DetPtsDev = boost::compute::vector<boost::compute::float4_>;
+
+// context, number of points, hash of the points
+using DetPtsKey = std::tuple<cl_context,size_type,std::uint64_t>;
+
+SharedDevResRegistry<DetPtsKey,DetPtsDev>& DetPtsRegistry()
+{
+  static SharedDevResRegistry<DetPtsKey,DetPtsDev> reg;
+  return reg;
+}
+
+/// \brief Creates a texture in device memory from a volume.
+std::shared_ptr<RayCastOCLVolTex> CreateVolTex(const boost::compute::context& ctx,
+                                               const RayCasterOCL::Vol* vol,
+                                               const RayCasterOCL::VolTexFormat vol_tex_fmt)
+{
+  namespace bc = boost::compute;
+
+  using PixelScalar3D = RayCasterOCL::PixelScalar3D;
+
+  auto vol_tex = std::make_shared<RayCastOCLVolTex>();
+
+  const auto vol_size = vol->GetLargestPossibleRegion().GetSize();
+
+  const PixelScalar3D* vol_buf = vol->GetBufferPointer();
+
+  if (vol_tex_fmt == RayCasterOCL::kRAY_CAST_VOL_TEX_FLOAT32)
+  {
+    // the volume buffer is not modified by the read only texture
+    vol_tex->tex = bc::image3d(ctx, vol_size[0], vol_size[1], vol_size[2],
+                               bc::image_format(bc::image_format::intensity,
+                                                bc::image_format::float32),
+                               bc::image3d::read_only | bc::image3d::use_host_ptr,
+                               const_cast<PixelScalar3D*>(vol_buf));
+
+    vol_tex->dev_mem.set_bytes(vol_size[0] * vol_size[1] * vol_size[2] * sizeof(PixelScalar3D));
+  }
+  else
+  {
+    const size_type num_vox = vol_size[0] * vol_size[1] * vol_size[2];
+
+    // temporary storage for converting into 16-bit formats, the texture is
+    // initialized with a copy of this
+    std::vector<std::uint16_t> tmp_vol_buf(num_vox);
+
+    bc::image_format::channel_data_type tex_data_type = bc::image_format::float16;
+
+    if (vol_tex_fmt == RayCasterOCL::kRAY_CAST_VOL_TEX_HALF)
+    {
+      auto to_half_fn = [&tmp_vol_buf,vol_buf] (const RangeType& r)
+      {
+        for (size_type i = r.begin(); i < r.end(); ++i)
+        {
+          tmp_vol_buf[i] = FloatToHalf(vol_buf[i]);
+        }
+      };
+
+      ParallelFor(to_half_fn, RangeType(0, num_vox));
+    }
+    else
+    {
+      xregASSERT(vol_tex_fmt == RayCasterOCL::kRAY_CAST_VOL_TEX_UNORM16);
+
+      tex_data_type = bc::image_format::unorm_int16;
+
+      const auto min_max_it = std::minmax_element(vol_buf, vol_buf + num_vox);
+
+      const float min_val = *min_max_it.first;
+      const float max_val = *min_max_it.second;
+
+      // a constant volume maps every voxel to zero, with the offset
+      // recovering the constant value
+      const float scale = (max_val > min_val) ? (max_val - min_val) : 1.0f;
+
+      vol_tex->scale  = scale;
+      vol_tex->offset = min_val;
+
+      const float one_over_scale = 1.0f / scale;
+
+      auto to_unorm_fn = [&tmp_vol_buf,vol_buf,min_val,one_over_scale] (const RangeType& r)
+      {
+        for (size_type i = r.begin(); i < r.end(); ++i)
+        {
+          const float v = std::round((vol_buf[i] - min_val) * one_over_scale * 65535.0f);
+
+          tmp_vol_buf[i] = static_cast<std::uint16_t>(std::min(std::max(v, 0.0f), 65535.0f));
+        }
+      };
+
+      ParallelFor(to_unorm_fn, RangeType(0, num_vox));
+    }
+
+    vol_tex->tex = bc::image3d(ctx, vol_size[0], vol_size[1], vol_size[2],
+                               bc::image_format(bc::image_format::intensity, tex_data_type),
+                               bc::image3d::read_only | bc::image3d::copy_host_ptr,
+                               tmp_vol_buf.data());
+
+    vol_tex->dev_mem.set_bytes(num_vox * sizeof(std::uint16_t));
+  }
+
+  return vol_tex;
+}
+
+/// \brief Creates a half precision RGBA texture in device memory from a
+///        packed gradient volume.
+std::shared_ptr<RayCastOCLVolTex> CreateGradVolTex(const boost::compute::context& ctx,
+                                                   const RayCastGradVol& grad_vol)
+{
+  namespace bc = boost::compute;
+
+  auto grad_tex = std::make_shared<RayCastOCLVolTex>();
+
+  const size_type num_vals = grad_vol.buf.size();
+
+  std::vector<std::uint16_t> tmp_buf(num_vals);
+
+  auto to_half_fn = [&tmp_buf,&grad_vol] (const RangeType& r)
+  {
+    for (size_type i = r.begin(); i < r.end(); ++i)
+    {
+      tmp_buf[i] = FloatToHalf(grad_vol.buf[i]);
+    }
+  };
+
+  ParallelFor(to_half_fn, RangeType(0, num_vals));
+
+  grad_tex->tex = bc::image3d(ctx, grad_vol.size_x, grad_vol.size_y, grad_vol.size_z,
+                              bc::image_format(bc::image_format::rgba, bc::image_format::float16),
+                              bc::image3d::read_only | bc::image3d::copy_host_ptr,
+                              tmp_buf.data());
+
+  grad_tex->dev_mem.set_bytes(num_vals * sizeof(std::uint16_t));
+
+  return grad_tex;
+}
+
+void WaitForEvent(const boost::compute::event& e)
+{
+  if (e.get())
+  {
+    e.wait();
+  }
+}
+
+/// \brief Copies the elements of a host buffer which differ from the elements
+///        most recently copied to a device buffer.
+///
+/// prev_host stores the elements most recently copied to the device and is
+/// updated to match cur_host. Every element is copied when the buffer sizes
+/// differ, e.g. after re-allocation. Runs of changed elements separated by
+/// only a few unchanged elements are copied together, and a single copy
+/// spanning all changes is used when there are many runs, since the cost of
+/// each transfer is dominated by its launch overhead for small buffers.
+///
+/// The copies of changed elements read from prev_host. When upload_event is
+/// non-null, they are enqueued without waiting and the event of the last copy
+/// is stored in upload_event, which is waited on before prev_host is modified
+/// by the next call. Otherwise, the copies are finished before returning.
+template <class T>
+void UploadChangedElems(const std::vector<T>& cur_host, std::vector<T>* prev_host,
+                        boost::compute::vector<T>* dev, boost::compute::command_queue& queue,
+                        boost::compute::event* upload_event)
+{
+  namespace bc = boost::compute;
+
+  if (upload_event)
+  {
+    WaitForEvent(*upload_event);
+
+    *upload_event = bc::event();
+  }
+
+  using size_type = xreg::size_type;
+  using ElemRange = std::pair<size_type,size_type>;
+
+  constexpr size_type kMAX_UNCHANGED_GAP = 4;
+  constexpr size_type kMAX_NUM_COPIES    = 8;
+
+  const size_type len = cur_host.size();
+
+  if ((prev_host->size() != len) || (dev->size() != len))
+  {
+    *prev_host = cur_host;
+
+    dev->assign(prev_host->begin(), prev_host->end(), queue);
+    return;
+  }
+
+  std::vector<ElemRange> changed;
+
+  for (size_type i = 0; i < len; ++i)
+  {
+    // the elements are OpenCL vectors and integers, compare their bits
+    if (std::memcmp(&cur_host[i], &(*prev_host)[i], sizeof(T)))
+    {
+      if (!changed.empty() && ((i - changed.back().second) <= kMAX_UNCHANGED_GAP))
+      {
+        changed.back().second = i + 1;
+      }
+      else
+      {
+        changed.push_back(ElemRange(i, i + 1));
+      }
+    }
+  }
+
+  if (changed.size() > kMAX_NUM_COPIES)
+  {
+    changed = { ElemRange(changed.front().first, changed.back().second) };
+  }
+
+  bc::event last_copy_event;
+
+  for (const auto& r : changed)
+  {
+    std::copy(cur_host.begin() + r.first, cur_host.begin() + r.second,
+              prev_host->begin() + r.first);
+
+    // the queue is in-order, so only the last copy needs to be tracked
+    last_copy_event = queue.enqueue_write_buffer_async(dev->get_buffer(),
+                                                       r.first * sizeof(T),
+                                                       (r.second - r.first) * sizeof(T),
+                                                       prev_host->data() + r.first);
+
+    RecordOpenCLTransferEvent("WriteChangedElems", last_copy_event);
+  }
+
+  if (upload_event)
+  {
+    // the queue is in-order, so the kernels enqueued next read the new elements
+    *upload_event = last_copy_event;
+  }
+  else
+  {
+    WaitForEvent(last_copy_event);
+  }
+}
+
+const char* kRAY_CAST_BASE_OPENCL_SRC = BOOST_COMPUTE_STRINGIZE_SOURCE(
+
+// Maps a value read from a volume texture to the volume intensity, this is the
+// identity for single precision textures.
+float4 xregVolTexVal(const float4 v, const float scale, const float offset)
+{
+  return (v * scale) + offset;
+}
+
+// Tricubic B-spline interpolation from a texture of B-spline coefficients,
+// using eight linearly filtered fetches (Sigg and Hadwiger, GPU Gems 2, Ch. 20).
+// The sampler must use linear filtering and the texture coordinates have the
+// same convention as read_imagef (e.g. voxel centers at integers + 0.5). The
+// fetch weights sum to one, so xregVolTexVal() may be applied to the result.
+// The precision is limited by the texture unit's interpolation weights.
+float4 xregReadBSplineTex(image3d_t tex, const sampler_t sampler, const float4 tex_coords)
+{
+  const float4 x = tex_coords - (float4) (0.5f, 0.5f, 0.5f, 0);
+
+  const float4 idx = floor(x);
+
+  const float4 f     = x - idx;
+  const float4 one_f = 1.0f - f;
+
+  const float4 f_sq     = f * f;
+  const float4 one_f_sq = one_f * one_f;
+
+  // cubic B-spline weights of the four neighboring coefficients in each dimension
+  const float4 w0 = (one_f_sq * one_f) / 6.0f;
+  const float4 w1 = (2.0f / 3.0f) - (0.5f * f_sq * (2.0f - f));
+  const float4 w2 = (2.0f / 3.0f) - (0.5f * one_f_sq * (2.0f - one_f));
+  const float4 w3 = (f_sq * f) / 6.0f;
+
+  // each pair of neighbors is combined by a single linear fetch between them
+  const float4 g0 = w0 + w1;
+  const float4 g1 = w2 + w3;
+
+  const float4 h0 = (idx - 0.5f) + (w1 / g0);
+  const float4 h1 = (idx + 1.5f) + (w3 / g1);
+
+  const float v000 = read_imagef(tex, sampler, (float4) (h0.x, h0.y, h0.z, 0)).x;
+  const float v100 = read_imagef(tex, sampler, (float4) (h1.x, h0.y, h0.z, 0)).x;
+  const float v010 = read_imagef(tex, sampler, (float4) (h0.x, h1.y, h0.z, 0)).x;
+  const float v110 = read_imagef(tex, sampler, (float4) (h1.x, h1.y, h0.z, 0)).x;
+  const float v001 = read_imagef(tex, sampler, (float4) (h0.x, h0.y, h1.z, 0)).x;
+  const float v101 = read_imagef(tex, sampler, (float4) (h1.x, h0.y, h1.z, 0)).x;
+  const float v011 = read_imagef(tex, sampler, (float4) (h0.x, h1.y, h1.z, 0)).x;
+  const float v111 = read_imagef(tex, sampler, (float4) (h1.x, h1.y, h1.z, 0)).x;
+
+  const float v = (g0.z * ((g0.y * ((g0.x * v000) + (g1.x * v100))) +
+                           (g1.y * ((g0.x * v010) + (g1.x * v110))))) +
+                  (g1.z * ((g0.y * ((g0.x * v001) + (g1.x * v101))) +
+                           (g1.y * ((g0.x * v011) + (g1.x * v111)))));
+
+  return (float4) (v, v, v, v);
+}
+
+);
+
+}  // un-named
+
+std::uint16_t xreg::RayCastFloatToHalf(const float f)
+{
+  return FloatToHalf(f);
+}
 
 xreg::RayCasterOCL::RayCasterOCL()
-  : ctx_(boost::compute::system::default_device()),
-    cmd_queue_(ctx_, ctx_.get_device()),
-    det_pts_dev_(ctx_),
+  : ctx_(SharedOpenCLContext()),
+    cmd_queue_(MakeOpenCLCmdQueue(ctx_, ctx_.get_device())),
     focal_pts_dev_(ctx_),
     proj_pixels_dev_(ctx_),
     proj_pixels_dev_to_use_(&proj_pixels_dev_),
@@ -50,9 +490,8 @@ xreg::RayCasterOCL::RayCasterOCL()
 }
 
 xreg::RayCasterOCL::RayCasterOCL(const boost::compute::device& dev)
-  : ctx_(dev),
-    cmd_queue_(ctx_, dev),
-    det_pts_dev_(ctx_),
+  : ctx_(SharedOpenCLContext(dev)),
+    cmd_queue_(MakeOpenCLCmdQueue(ctx_, dev)),
     focal_pts_dev_(ctx_),
     proj_pixels_dev_(ctx_),
     proj_pixels_dev_to_use_(&proj_pixels_dev_),
@@ -67,7 +506,6 @@ xreg::RayCasterOCL::RayCasterOCL(const boost::compute::context& ctx,
                                  const boost::compute::command_queue& queue)
   : ctx_(ctx),
     cmd_queue_(queue),
-    det_pts_dev_(ctx_),
     focal_pts_dev_(ctx_),
     proj_pixels_dev_(ctx_),
     proj_pixels_dev_to_use_(&proj_pixels_dev_),
@@ -78,6 +516,26 @@ xreg::RayCasterOCL::RayCasterOCL(const boost::compute::context& ctx,
   set_max_opencl_alloc_size_fraction_to_use(1.0);
 }
 
+xreg::RayCasterOCL::~RayCasterOCL()
+{
+  WaitForEvent(xforms_upload_event_);
+  WaitForEvent(cam_model_upload_event_);
+
+  for (const auto& slot : compute_slots_)
+  {
+    WaitForEvent(slot->xforms_upload_event);
+    WaitForEvent(slot->cam_model_upload_event);
+  }
+}
+
+xreg::RayCasterOCL::ComputeSlot::ComputeSlot(const boost::compute::context& ctx,
+                                             const boost::compute::command_queue& q)
+  : queue(q),
+    proj_pixels_dev(ctx),
+    cam_to_itk_phys_xforms_dev(ctx),
+    cam_model_for_proj_dev(ctx)
+{ }
+
 void xreg::RayCasterOCL::set_num_projs(const size_type num_projs)
 {
   RayCaster::set_num_projs(num_projs);
@@ -97,17 +555,33 @@ void xreg::RayCasterOCL::allocate_resources()
 {
   namespace bc = boost::compute;
 
-  RayCaster::allocate_resources();
-
   const size_type num_det_rows = this->camera_models_[0].num_det_rows;
   const size_type num_det_cols = this->camera_models_[0].num_det_cols;
   const size_type num_dets_per_proj = num_det_rows * num_det_cols;
 
-  if (!ext_pixel_buf_)
+  if (max_device_bytes_)
   {
-    pixel_buf_host_.resize(num_dets_per_proj * this->num_projs_);
+    const size_type max_num_projs_for_budget = max_num_projs_for_device_budget();
+
+    if (!max_num_projs_for_budget)
+    {
+      xregThrow("Device memory budget of %.2f MB is too small for a single projection! "
+                "(%.2f MB of tracked device memory is already in use)",
+                max_device_bytes_ / 1024.0 / 1024.0,
+                DeviceMemUsage().cur_bytes / 1024.0 / 1024.0);
+    }
+    else if (max_num_projs_for_budget < this->num_projs_)
+    {
+      std::cerr << "WARNING: reducing the number of projections from " << this->num_projs_
+                << " to " << max_num_projs_for_budget << " to fit within the device memory budget"
+                << std::endl;
+
+      set_num_projs(max_num_projs_for_budget);
+    }
   }
 
+  RayCaster::allocate_resources();
+
   if (max_num_projs_possible() < this->num_projs_)
   {
     const std::string msg = fmt::format(
@@ -127,15 +601,30 @@ void xreg::RayCasterOCL::allocate_resources()
   // NOTE: camera models should have already been initialized on the GPU when
   //       the set_camera_model(s) method(s) were called.
 
+  // pending transfers read from the host copies of the elements on the device,
+  // which are cleared below
+  WaitForEvent(xforms_upload_event_);
+  WaitForEvent(cam_model_upload_event_);
+
   // association of each projection to camera model - this is allowed to change
   // between calls to compute.
   cam_model_for_proj_host_.resize(this->num_projs_, 0);
   cam_model_for_proj_dev_.resize(this->num_projs_, cmd_queue_);
+  cam_model_for_proj_on_dev_.clear();
 
   const size_type tot_num_pix = this->num_projs_ * num_dets_per_proj;
 
+  // The device buffers are only reallocated when their capacity is exceeded,
+  // so a reservation avoids reallocations when allocating again for smaller
+  // detectors or fewer projections
+  const size_type num_pix_to_reserve = max_device_bytes_ ? tot_num_pix :
+                      std::max(tot_num_pix,
+                               std::min(this->reserved_num_pix_,
+                                        max_num_projs_possible() * num_dets_per_proj));
+
   if (proj_pixels_dev_to_use_ == &proj_pixels_dev_)
   {
+    proj_pixels_dev_.reserve(num_pix_to_reserve, cmd_queue_);
     proj_pixels_dev_.resize(tot_num_pix, cmd_queue_);
 
     sync_to_host_.set_ocl(&proj_pixels_dev_, cmd_queue_);
@@ -148,7 +637,40 @@ void xreg::RayCasterOCL::allocate_resources()
   }
   xregASSERT(proj_pixels_dev_to_use_->size() == tot_num_pix);
 
-  sync_to_host_.set_host(this->host_pixel_buf_to_use(), tot_num_pix);
+  // each additional compute slot has its own queue and copies of the buffers
+  // written by compute()
+  xregASSERT((num_compute_slots_ == 1) ||
+             (supports_compute_slots() && (proj_pixels_dev_to_use_ == &proj_pixels_dev_)));
+
+  for (const auto& slot : compute_slots_)
+  {
+    slot->queue.finish();
+  }
+
+  compute_slots_.clear();
+
+  for (size_type slot_idx = 1; slot_idx < num_compute_slots_; ++slot_idx)
+  {
+    auto slot = std::make_shared<ComputeSlot>(ctx_, MakeOpenCLCmdQueue(ctx_, cmd_queue_.get_device()));
+
+    slot->proj_pixels_dev.resize(tot_num_pix, slot->queue);
+    slot->cam_to_itk_phys_xforms_dev.resize(this->num_projs_, slot->queue);
+    slot->cam_model_for_proj_dev.resize(this->num_projs_, slot->queue);
+
+    compute_slots_.push_back(slot);
+  }
+
+  if (ext_pixel_buf_)
+  {
+    sync_to_host_.set_host(ext_pixel_buf_, tot_num_pix);
+  }
+  else if (!sync_to_host_.owns_host_buf())
+  {
+    // the host buffer is allocated (using pinned memory) by the sync object
+    sync_to_host_.set_host(nullptr, 0);
+  }
+
+  sync_to_host_.alloc();
 
   sync_to_host_.set_modified();
   sync_to_ocl_.set_modified();
@@ -161,6 +683,7 @@ void xreg::RayCasterOCL::allocate_resources()
 
   cam_to_itk_phys_xforms_host_.resize(this->num_projs_);
   cam_to_itk_phys_xforms_dev_.resize(this->num_projs_, cmd_queue_);
+  cam_to_itk_phys_xforms_on_dev_.clear();
 
   if (this->use_bg_projs_)
   {
@@ -173,6 +696,28 @@ void xreg::RayCasterOCL::allocate_resources()
       bg_projs_to_use_for_each_cam_dev_[cam_idx] = std::make_shared<PixelBufDev>(num_dets_per_proj, ctx_);
     }
   }
+
+  size_type alloc_dev_bytes = (cam_model_for_proj_dev_.size() * sizeof(bc::ulong_)) +
+                              (cam_to_itk_phys_xforms_dev_.size() * sizeof(bc::float16_));
+
+  if (proj_pixels_dev_to_use_ == &proj_pixels_dev_)
+  {
+    alloc_dev_bytes += proj_pixels_dev_.capacity() * sizeof(PixelScalar2D);
+  }
+
+  for (const auto& slot : compute_slots_)
+  {
+    alloc_dev_bytes += (slot->proj_pixels_dev.capacity() * sizeof(PixelScalar2D)) +
+                       (slot->cam_model_for_proj_dev.size() * sizeof(bc::ulong_)) +
+                       (slot->cam_to_itk_phys_xforms_dev.size() * sizeof(bc::float16_));
+  }
+
+  if (this->use_bg_projs_)
+  {
+    alloc_dev_bytes += this->camera_models_.size() * num_dets_per_proj * sizeof(PixelScalar2D);
+  }
+
+  alloc_dev_mem_.set_bytes(alloc_dev_bytes);
 }
 
 xreg::RayCasterOCL::ProjPtr
@@ -221,6 +766,23 @@ cv::Mat xreg::RayCasterOCL::proj_ocv(const size_type proj_idx)
                  host_pixel_buf_to_use() + (cam.num_det_rows * cam.num_det_cols * proj_idx));
 }
 
+xreg::RayCasterOCL::PixelScalar2D*
+xreg::RayCasterOCL::host_proj_pixels(const size_type proj_idx)
+{
+  xregASSERT(proj_idx < this->num_projs_);
+
+  sync_to_host_.alloc();
+
+  const size_type num_dets = this->camera_models_[0].num_det_rows *
+                             this->camera_models_[0].num_det_cols;
+
+  const size_type off = num_dets * proj_idx;
+
+  sync_to_host_.sync_range(off, off + num_dets);
+
+  return host_pixel_buf_to_use() + off;
+}
+
 xreg::RayCasterOCL::PixelScalar2D*
 xreg::RayCasterOCL::raw_host_pixel_buf()
 {
@@ -241,8 +803,58 @@ xreg::RayCasterOCL::max_num_projs_possible() const
  
   const size_type dev_max_mem_alloc = cmd_queue_.get_device().max_memory_alloc_size();
   
-  return static_cast<size_type>((max_opencl_alloc_size_fraction_to_use_ * dev_max_mem_alloc)
-                                    / num_bytes_per_drr);
+  const size_type max_num_projs_for_alloc =
+            static_cast<size_type>((max_opencl_alloc_size_fraction_to_use_ * dev_max_mem_alloc)
+                                        / num_bytes_per_drr);
+
+  return std::min(max_num_projs_for_alloc, max_num_projs_for_device_budget());
+}
+
+void xreg::RayCasterOCL::set_max_device_bytes(const size_type max_bytes)
+{
+  max_device_bytes_ = max_bytes;
+}
+
+xreg::size_type xreg::RayCasterOCL::max_device_bytes() const
+{
+  return max_device_bytes_;
+}
+
+xreg::size_type xreg::RayCasterOCL::max_num_projs_for_device_budget() const
+{
+  if (!max_device_bytes_)
+  {
+    return ~size_type(0);
+  }
+
+  const size_type num_dets_per_proj = this->camera_models_[0].num_det_rows *
+                                      this->camera_models_[0].num_det_cols;
+
+  // device memory held by everything other than the buffers sized by this
+  // object's allocate_resources()
+  size_type other_dev_bytes = DeviceMemUsage().cur_bytes - alloc_dev_mem_.bytes();
+
+  if (this->use_bg_projs_)
+  {
+    other_dev_bytes += this->camera_models_.size() * num_dets_per_proj * sizeof(PixelScalar2D);
+  }
+
+  if (other_dev_bytes >= max_device_bytes_)
+  {
+    return 0;
+  }
+
+  // camera model index and pose matrix, along with the pixels when this object
+  // owns the projection buffer(s)
+  size_type num_bytes_per_proj = sizeof(boost::compute::ulong_) + sizeof(boost::compute::float16_);
+
+  if (proj_pixels_dev_to_use_ == &proj_pixels_dev_)
+  {
+    num_bytes_per_proj += num_dets_per_proj * sizeof(PixelScalar2D);
+  }
+
+  // each compute slot holds its own copy of these buffers
+  return (max_device_bytes_ - other_dev_bytes) / (num_bytes_per_proj * num_compute_slots_);
 }
   
 void xreg::RayCasterOCL::set_max_opencl_alloc_size_fraction_to_use(const double s)
@@ -281,11 +893,13 @@ xreg::RayCastSyncHostBuf* xreg::RayCasterOCL::to_host_buf()
 xreg::RayCasterOCL::PixelScalar2D*
 xreg::RayCasterOCL::host_pixel_buf_to_use()
 {
-  return ext_pixel_buf_ ? ext_pixel_buf_ : &pixel_buf_host_[0];
+  return ext_pixel_buf_ ? ext_pixel_buf_ : sync_to_host_.host_buf().buf;
 }
 
 void xreg::RayCasterOCL::camera_models_changed()
 {
+  namespace bc = boost::compute;
+
   const size_type num_cams = this->camera_models_.size();
 
   const size_type num_det_rows = this->camera_models_[0].num_det_rows;
@@ -314,8 +928,19 @@ void xreg::RayCasterOCL::camera_models_changed()
     }
   }
 
-  // allocate device memory for detector points and initialize it with the contents of the host buffer
-  det_pts_dev_.assign(host_ocl_det_pts.begin(), host_ocl_det_pts.end(), cmd_queue_);
+  // allocate device memory for detector points and initialize it with the contents of the host buffer,
+  // unless another ray caster has already done so
+  const DetPtsKey det_pts_key(ctx_.get(), num_tot_dets,
+                              HashBytes64(host_ocl_det_pts.data(),
+                                          sizeof(bc::float4_) * num_tot_dets));
+
+  det_pts_dev_ = DetPtsRegistry().find_or_create(det_pts_key,
+                   [this,&host_ocl_det_pts] ()
+                   {
+                     return std::make_shared<Float4ListDev>(host_ocl_det_pts.begin(),
+                                                            host_ocl_det_pts.end(),
+                                                            this->cmd_queue_);
+                   });
 
   // convert focal points for each camera into open cl format.
   Float4ListHost host_ocl_focal_pts(num_cams);
@@ -331,11 +956,16 @@ void xreg::RayCasterOCL::camera_models_changed()
   focal_pts_dev_.assign(host_ocl_focal_pts.begin(), host_ocl_focal_pts.end(), cmd_queue_);
 }
 
+bool xreg::RayCasterOCL::supports_interp_method(const InterpMethod interp_method) const
+{
+  return interp_method == RayCaster::kRAY_CAST_INTERP_LINEAR;
+}
+
 void xreg::RayCasterOCL::compute_helper_pre_kernels(const size_type vol_idx)
 {
   namespace bc = boost::compute;
 
-  if (this->interp_method_ != RayCaster::kRAY_CAST_INTERP_LINEAR)
+  if (!supports_interp_method(this->interp_method_))
   {
     throw UnsupportedOperationException();
   }
@@ -361,16 +991,25 @@ void xreg::RayCasterOCL::compute_helper_pre_kernels(const size_type vol_idx)
 
   ray_cast_kernel_args_.num_projs = this->num_projs_;
 
-  // convert current projection poses
-  for (size_type proj_idx = 0; proj_idx < this->num_projs_; ++proj_idx)
+  if (use_dev_xforms_cam_to_itk_phys_)
   {
-    cam_to_itk_phys_xforms_host_[proj_idx] =
-              OpenCLFloat16ToBoostComp16(ConvertToOpenCL(this->xforms_cam_to_itk_phys_[proj_idx]));
+    // the poses have been written directly into device memory, so the device
+    // no longer matches the host poses most recently transferred
+    cam_to_itk_phys_xforms_on_dev_.clear();
   }
+  else
+  {
+    // convert current projection poses
+    for (size_type proj_idx = 0; proj_idx < this->num_projs_; ++proj_idx)
+    {
+      cam_to_itk_phys_xforms_host_[proj_idx] =
+                OpenCLFloat16ToBoostComp16(ConvertToOpenCL(this->xforms_cam_to_itk_phys_[proj_idx]));
+    }
 
-  cam_to_itk_phys_xforms_dev_.assign(cam_to_itk_phys_xforms_host_.begin(),
-                                     cam_to_itk_phys_xforms_host_.end(),
-                                     cmd_queue_);
+    // only poses that have changed since the previous call are transferred
+    upload_changed_elems(cam_to_itk_phys_xforms_host_, &cam_to_itk_phys_xforms_on_dev_,
+                         &cam_to_itk_phys_xforms_dev_, &xforms_upload_event_);
+  }
 
   // convert current camera associations
   for (size_type proj_idx = 0; proj_idx < this->num_projs_; ++proj_idx)
@@ -379,14 +1018,17 @@ void xreg::RayCasterOCL::compute_helper_pre_kernels(const size_type vol_idx)
   }
 
   // transfer current camera associations
-  cam_model_for_proj_dev_.assign(cam_model_for_proj_host_.begin(),
-                                 cam_model_for_proj_host_.end(), cmd_queue_);
+  upload_changed_elems(cam_model_for_proj_host_, &cam_model_for_proj_on_dev_,
+                       &cam_model_for_proj_dev_, &cam_model_upload_event_);
 
   ray_cast_kernel_args_.num_det_pts = this->camera_models_[0].num_det_rows *
                                       this->camera_models_[0].num_det_cols;
 
   ray_cast_kernel_args_.step_size = this->ray_step_size_;
 
+  ray_cast_kernel_args_.vol_tex_scale  = vol_tex_scales_[vol_idx];
+  ray_cast_kernel_args_.vol_tex_offset = vol_tex_offsets_[vol_idx];
+
   if (this->use_bg_projs_)
   {
     const size_type num_cams = this->camera_models_.size();
@@ -437,31 +1079,326 @@ void xreg::RayCasterOCL::compute_helper_pre_kernels(const size_type vol_idx)
   }
 }
 
+void xreg::RayCasterOCL::upload_changed_elems(const Float16ListHost& cur_host,
+                                              Float16ListHost* prev_host,
+                                              Float16ListDev* dev,
+                                              boost::compute::event* upload_event)
+{
+  UploadChangedElems(cur_host, prev_host, dev, cmd_queue_, upload_event);
+}
+
+void xreg::RayCasterOCL::upload_changed_elems(const ULongListHost& cur_host,
+                                              ULongListHost* prev_host,
+                                              ULongListDev* dev,
+                                              boost::compute::event* upload_event)
+{
+  UploadChangedElems(cur_host, prev_host, dev, cmd_queue_, upload_event);
+}
+
 void xreg::RayCasterOCL::compute_helper_post_kernels(const size_type)
 {
   sync_to_host_.set_modified();
   sync_to_ocl_.set_modified();
 }
 
-void xreg::RayCasterOCL::vols_changed()
+void xreg::RayCasterOCL::finish_kernel_launch(const boost::compute::event& e,
+                                              const std::string& prof_name)
+{
+  if (!prof_name.empty())
+  {
+    RecordOpenCLKernelEvent(prof_name, e);
+  }
+
+  compute_event_ = e;
+
+  if (!async_compute_)
+  {
+    compute_event_.wait();
+  }
+}
+
+void xreg::RayCasterOCL::launch_ray_cast_kernel(boost::compute::kernel& k,
+                                                const std::string& key,
+                                                const size_type dst_arg_idx,
+                                                const std::size_t num_rays)
 {
   namespace bc = boost::compute;
 
+  if (!IsOpenCLWorkGroupSizeTuned(cmd_queue_.get_device(), key))
+  {
+    PixelBufDev scratch_dev(proj_pixels_dev_to_use_->size(), ctx_);
+    bc::fill(scratch_dev.begin(), scratch_dev.end(), PixelScalar2D(0), cmd_queue_);
+
+    k.set_arg(dst_arg_idx, scratch_dev);
+
+    TuneOpenCLWorkGroupSize(cmd_queue_, k, key, 1, &num_rays);
+
+    k.set_arg(dst_arg_idx, *proj_pixels_dev_to_use_);
+  }
+
+  finish_kernel_launch(EnqueueOpenCLKernelTuned(cmd_queue_, k, key, 1, &num_rays));
+}
+
+boost::compute::event xreg::RayCasterOCL::compute_async(const size_type vol_idx,
+                                                        const size_type slot_idx)
+{
+  xregASSERT(this->resources_allocated_);
+  xregASSERT(slot_idx <= compute_slots_.size());
+
+  ComputeSlot* slot = slot_idx ? compute_slots_[slot_idx - 1].get() : nullptr;
+
+  if (slot)
+  {
+    // poses written on the device are only stored in the buffer of slot 0
+    xregASSERT(supports_compute_slots() && !use_dev_xforms_cam_to_itk_phys_);
+
+    swap_compute_slot(slot);
+  }
+
+  async_compute_ = true;
+
+  try
+  {
+    this->compute(vol_idx);
+  }
+  catch (...)
+  {
+    async_compute_ = false;
+
+    if (slot)
+    {
+      swap_compute_slot(slot);
+    }
+
+    throw;
+  }
+
+  async_compute_ = false;
+
+  if (slot)
+  {
+    swap_compute_slot(slot);
+
+    return slot->compute_event;
+  }
+
+  return compute_event_;
+}
+
+void xreg::RayCasterOCL::wait_for_compute(const size_type slot_idx)
+{
+  xregASSERT(slot_idx <= compute_slots_.size());
+
+  WaitForEvent(slot_idx ? compute_slots_[slot_idx - 1]->compute_event : compute_event_);
+}
+
+void xreg::RayCasterOCL::set_num_compute_slots(const size_type num_slots)
+{
+  xregASSERT(num_slots > 0);
+
+  num_compute_slots_ = num_slots;
+}
+
+xreg::size_type xreg::RayCasterOCL::num_compute_slots() const
+{
+  return num_compute_slots_;
+}
+
+bool xreg::RayCasterOCL::supports_compute_slots() const
+{
+  return false;
+}
+
+void xreg::RayCasterOCL::copy_compute_slot_projs(const size_type slot_idx)
+{
+  xregASSERT(slot_idx && (slot_idx <= compute_slots_.size()));
+
+  ComputeSlot& slot = *compute_slots_[slot_idx - 1];
+
+  // the slot's queue may also hold work after its final kernel, e.g. when no
+  // kernels were launched for a volume, so every command is waited on
+  slot.queue.finish();
+
+  const size_type num_pix = this->num_projs_ * this->camera_models_[0].num_det_rows *
+                            this->camera_models_[0].num_det_cols;
+
+  boost::compute::event e = cmd_queue_.enqueue_copy_buffer(slot.proj_pixels_dev.get_buffer(),
+                                                           proj_pixels_dev_.get_buffer(),
+                                                           0, 0, num_pix * sizeof(PixelScalar2D));
+
+  RecordOpenCLTransferEvent("CopyComputeSlotProjs", e);
+
+  e.wait();
+
+  sync_to_host_.set_modified();
+  sync_to_ocl_.set_modified();
+}
+
+void xreg::RayCasterOCL::swap_compute_slot(ComputeSlot* slot)
+{
+  std::swap(cmd_queue_, slot->queue);
+
+  cam_to_itk_phys_xforms_dev_.swap(slot->cam_to_itk_phys_xforms_dev);
+  cam_to_itk_phys_xforms_on_dev_.swap(slot->cam_to_itk_phys_xforms_on_dev);
+
+  cam_model_for_proj_dev_.swap(slot->cam_model_for_proj_dev);
+  cam_model_for_proj_on_dev_.swap(slot->cam_model_for_proj_on_dev);
+
+  std::swap(xforms_upload_event_, slot->xforms_upload_event);
+  std::swap(cam_model_upload_event_, slot->cam_model_upload_event);
+
+  std::swap(compute_event_, slot->compute_event);
+
+  proj_pixels_dev_to_use_ = (proj_pixels_dev_to_use_ == &proj_pixels_dev_) ?
+                                &slot->proj_pixels_dev : &proj_pixels_dev_;
+}
+
+boost::compute::vector<boost::compute::float16_>& xreg::RayCasterOCL::xforms_cam_to_itk_phys_dev()
+{
+  return cam_to_itk_phys_xforms_dev_;
+}
+
+const boost::compute::command_queue& xreg::RayCasterOCL::cmd_queue() const
+{
+  return cmd_queue_;
+}
+
+void xreg::RayCasterOCL::set_use_dev_xforms_cam_to_itk_phys(const bool use_dev_xforms)
+{
+  xregASSERT(!use_dev_xforms || supports_dev_xforms_cam_to_itk_phys());
+
+  use_dev_xforms_cam_to_itk_phys_ = use_dev_xforms;
+}
+
+bool xreg::RayCasterOCL::use_dev_xforms_cam_to_itk_phys() const
+{
+  return use_dev_xforms_cam_to_itk_phys_;
+}
+
+bool xreg::RayCasterOCL::supports_dev_xforms_cam_to_itk_phys() const
+{
+  return true;
+}
+
+void xreg::RayCasterOCL::vols_changed()
+{
   // initialize volume texture memory
   const size_type num_vols = this->vols_.size();
 
+  shared_vol_texs_.resize(num_vols);
   vol_texs_dev_.resize(num_vols);
 
+  vol_tex_scales_.resize(num_vols);
+  vol_tex_offsets_.resize(num_vols);
+
+  const bool use_full_texs = uses_full_vol_texs();
+
   for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
   {
-    const auto vol_size = this->vols_[vol_idx]->GetLargestPossibleRegion().GetSize();
+    if (!use_full_texs)
+    {
+      shared_vol_texs_[vol_idx].reset();
+      vol_texs_dev_[vol_idx]    = boost::compute::image3d();
+      vol_tex_scales_[vol_idx]  = 1;
+      vol_tex_offsets_[vol_idx] = 0;
+      continue;
+    }
 
-    vol_texs_dev_[vol_idx] = bc::image3d(ctx_, vol_size[0], vol_size[1], vol_size[2],
-                               bc::image_format(bc::image_format::intensity,
-                                                bc::image_format::float32),
-                               bc::image3d::read_only | bc::image3d::use_host_ptr,
-                               this->vols_[vol_idx]->GetBufferPointer());
+    const Vol* vol = this->vols_[vol_idx].GetPointer();
+
+    const VolTexKey vol_tex_key(ctx_.get(), vol, vol->GetMTime(), static_cast<int>(vol_tex_fmt_));
+
+    shared_vol_texs_[vol_idx] = VolTexRegistry().find_or_create(vol_tex_key,
+                                  [this,vol] ()
+                                  {
+                                    return CreateVolTex(this->ctx_, vol, this->vol_tex_fmt_);
+                                  });
+
+    vol_texs_dev_[vol_idx]    = shared_vol_texs_[vol_idx]->tex;
+    vol_tex_scales_[vol_idx]  = shared_vol_texs_[vol_idx]->scale;
+    vol_tex_offsets_[vol_idx] = shared_vol_texs_[vol_idx]->offset;
+  }
+
+  grad_texs_.assign(num_vols, nullptr);
+
+  if (this->use_precomputed_grad_vols() && use_full_texs)
+  {
+    for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
+    {
+      const RayCastGradVol& gv = this->grad_vol(vol_idx);
+
+      if (gv.valid())
+      {
+        grad_texs_[vol_idx] = CreateGradVolTex(this->ctx_, gv);
+      }
+    }
+  }
+
+  bspline_coef_texs_.assign(num_vols, nullptr);
+
+  if ((this->interp_method_ == kRAY_CAST_INTERP_BSPLINE) &&
+      supports_interp_method(kRAY_CAST_INTERP_BSPLINE))
+  {
+    for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
+    {
+      bspline_coef_tex(vol_idx);
+    }
+  }
+}
+
+bool xreg::RayCasterOCL::has_grad_tex(const size_type vol_idx) const
+{
+  return (vol_idx < grad_texs_.size()) && grad_texs_[vol_idx];
+}
+
+const boost::compute::image3d& xreg::RayCasterOCL::grad_tex(const size_type vol_idx) const
+{
+  return has_grad_tex(vol_idx) ? grad_texs_[vol_idx]->tex : vol_texs_dev_[vol_idx];
+}
+
+bool xreg::RayCasterOCL::uses_full_vol_texs() const
+{
+  return true;
+}
+
+const xreg::RayCastOCLVolTex& xreg::RayCasterOCL::bspline_coef_tex(const size_type vol_idx)
+{
+  std::shared_ptr<RayCastOCLVolTex>& coef_tex = bspline_coef_texs_[vol_idx];
+
+  if (!coef_tex)
+  {
+    const Vol* coefs = this->bspline_coefs(vol_idx);
+
+    xregASSERT(coefs);
+
+    const VolTexKey coef_tex_key(ctx_.get(), coefs, coefs->GetMTime(), static_cast<int>(vol_tex_fmt_));
+
+    coef_tex = VolTexRegistry().find_or_create(coef_tex_key,
+                 [this,coefs] ()
+                 {
+                   return CreateVolTex(this->ctx_, coefs, this->vol_tex_fmt_);
+                 });
   }
+
+  return *coef_tex;
+}
+
+void xreg::RayCasterOCL::set_vol_tex_format(const VolTexFormat fmt)
+{
+  if (fmt != vol_tex_fmt_)
+  {
+    vol_tex_fmt_ = fmt;
+
+    if (!this->vols_.empty())
+    {
+      vols_changed();
+    }
+  }
+}
+
+xreg::RayCasterOCL::VolTexFormat xreg::RayCasterOCL::vol_tex_format() const
+{
+  return vol_tex_fmt_;
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -471,6 +1408,8 @@ BOOST_COMPUTE_ADAPT_STRUCT(xreg::RayCasterOCL::RayCastArgs, RayCastArgs,
                             img_aabb_min,
                             img_aabb_max,
                             step_size,
+                            vol_tex_scale,
+                            vol_tex_offset,
                             pad,
                             num_det_pts,
                             num_projs))
@@ -482,7 +1421,8 @@ std::string xreg::RayCasterOCL::RayCastBaseOCLStr()
   std::stringstream ss;
   ss << boost::compute::type_definition<RayCastArgs>()
      << kOPENCL_MATH_UTILS_SRC
-     << kOPENCL_SPATIAL_SRC;
+     << kOPENCL_SPATIAL_SRC
+     << kRAY_CAST_BASE_OPENCL_SRC;
   
   return ss.str();
 }
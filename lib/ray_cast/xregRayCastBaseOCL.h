@@ -25,12 +25,34 @@
 #ifndef XREGRAYCASTBASEOCL_H_
 #define XREGRAYCASTBASEOCL_H_
 
+#include <cstdint>
+
 #include "xregRayCastInterface.h"
 #include "xregRayCastSyncBuf.h"
+#include "xregMemTracking.h"
 
 namespace xreg
 {
 
+/// \brief A volume texture in device memory along with the mapping from
+///        texture values to volume intensities.
+///
+/// These are shared by the ray casters using the same OpenCL context, volume
+/// and texture format.
+struct RayCastOCLVolTex
+{
+  boost::compute::image3d tex;
+
+  float scale  = 1;
+  float offset = 0;
+
+  TrackedMemAlloc dev_mem = TrackedMemAlloc(MemLocation::kDEVICE, "ray-cast-vol-tex");
+};
+
+/// \brief Converts a single precision value to half precision (IEEE 754
+///        binary16), rounding to the nearest value with ties to even.
+std::uint16_t RayCastFloatToHalf(const float f);
+
 /// \brief Common ray casting interface using OpenCL.
 ///
 /// All coordinate and volume interpolation computations are with
@@ -38,18 +60,24 @@ namespace xreg
 class RayCasterOCL : public RayCaster
 {
 public:
-  /// \brief Default constructor, chooses a default device, creates a new
-  ///        context and command queue.
+  /// \brief Default constructor, chooses a default device, uses the context
+  ///        shared by all objects using the device and creates a new command
+  ///        queue.
+  ///
+  /// \see SharedOpenCLContext
   RayCasterOCL();
 
-  /// \brief Constructor specifying a device to use, but creates a new context
-  ///        and command queue.
+  /// \brief Constructor specifying a device to use; uses the context shared
+  ///        by all objects using the device and creates a new command queue.
   explicit RayCasterOCL(const boost::compute::device& dev);
 
   /// \brief Constructor specifying a specific context and command queue to use
   RayCasterOCL(const boost::compute::context& ctx,
                const boost::compute::command_queue& queue);
 
+  /// \brief Waits for any pending transfers of the poses and camera
+  ///        associations, which read from host buffers owned by this object.
+  ~RayCasterOCL() override;
 
   /// \brief Calls parent, and additionally sets a range on the sync buffers
   /// (so the max allocated buffer is not transferred).
@@ -64,6 +92,11 @@ public:
   /// This will also allocate a buffer in host memory large enough to store the
   /// projections.
   /// The detector points and volume will be transferred to device memory.
+  ///
+  /// When a device memory budget has been set and the current number of
+  /// projections does not fit within it, the number of projections is reduced
+  /// (see set_num_projs()) to the largest number that fits and a warning is
+  /// printed. An exception is thrown when not even a single projection fits.
   void allocate_resources() override;
 
   /// \brief Retrieve a 2D line integral image.
@@ -80,6 +113,12 @@ public:
   /// pixel values.
   cv::Mat proj_ocv(const size_type proj_idx) override;
 
+  /// \brief Retrieve a pointer to the host pixels of a projection, reading
+  ///        back only this projection from the device.
+  ///
+  /// \see RayCaster::host_proj_pixels
+  PixelScalar2D* host_proj_pixels(const size_type proj_idx) override;
+
   /// \brief Retrieve the raw host pointer to the buffer used for storing computed
   ///        images.
   ///
@@ -101,8 +140,29 @@ public:
   /// the size of a DRR, and the fraction of the maximum buffer allocation
   /// size set. This is available after setting the camera information and
   /// initializing the GPU device.
+  /// When a device memory budget has been set, this is also limited by
+  /// max_num_projs_for_device_budget().
   size_type max_num_projs_possible() const override;
 
+  /// \brief Sets a budget, in bytes, for all tracked device memory.
+  ///
+  /// The buffers of this object whose sizes depend on the number of
+  /// projections are limited to the budget less the tracked device memory
+  /// held by everything else when allocate_resources() is called (e.g. volume
+  /// textures and similarity metrics allocated previously), see
+  /// xregMemTracking.h.
+  /// A value of 0 indicates no budget, which is the default.
+  void set_max_device_bytes(const size_type max_bytes);
+
+  size_type max_device_bytes() const;
+
+  /// \brief The largest number of projections whose buffers fit within the
+  ///        device memory budget.
+  ///
+  /// Returns the largest possible value of size_type when no budget has been
+  /// set. This is available after setting the camera information.
+  size_type max_num_projs_for_device_budget() const;
+
   /// \brief Sets the fraction of maximum allocation size to actually
   ///        be allocated for DRR computation.
   ///
@@ -134,6 +194,121 @@ public:
   RayCastSyncOCLBuf* to_ocl_buf() override;
 
   RayCastSyncHostBuf* to_host_buf() override;
+
+  /// \brief Enqueues the ray casting of a volume without waiting for the
+  ///        kernels to finish.
+  ///
+  /// The returned event completes once the projections have been computed,
+  /// after which they are valid; wait_for_compute() blocks until then. When no
+  /// kernels needed to be launched, the event of the previous launch is
+  /// returned, which is null when nothing has been launched.
+  /// The transfers of the poses and camera associations that changed are also
+  /// enqueued without waiting, so the host work that overlaps with the ray
+  /// casting is everything performed after this call and before waiting (e.g.
+  /// evaluating a penalty function, or the similarity metrics of another
+  /// compute slot).
+  ///
+  /// slot_idx selects the compute slot, see set_num_compute_slots(). The
+  /// projections of slot 0 are written into the primary projection buffer,
+  /// the projections of other slots are written into the slot's buffer and
+  /// are made available by copy_compute_slot_projs().
+  boost::compute::event compute_async(const size_type vol_idx = 0,
+                                      const size_type slot_idx = 0);
+
+  /// \brief Blocks until the kernels of the most recent call to compute() or
+  ///        compute_async() using a compute slot have finished.
+  void wait_for_compute(const size_type slot_idx = 0);
+
+  /// \brief Sets the number of compute slots, so that the ray casting of a
+  ///        batch of poses may be enqueued while the projections of another
+  ///        batch are still being computed or consumed.
+  ///
+  /// Slot 0 uses the primary command queue and buffers. Every other slot has
+  /// its own command queue, projection buffer, and buffers of the poses and
+  /// camera associations, so its transfers and kernels do not wait for those
+  /// of the other slots. Between the batches that are in flight, only the
+  /// poses, camera associations and number of projections may differ, all
+  /// other settings (e.g. the volumes, camera models and active pixels) are
+  /// shared.
+  /// This must be called before allocate_resources(). More than one slot
+  /// requires supports_compute_slots() and that this object owns its
+  /// projection buffer (see use_other_proj_buf()). Defaults to 1.
+  void set_num_compute_slots(const size_type num_slots);
+
+  size_type num_compute_slots() const;
+
+  /// \brief Indicates that compute() may be used with compute slots other
+  ///        than 0.
+  ///
+  /// The default implementation returns false.
+  virtual bool supports_compute_slots() const;
+
+  /// \brief Waits for the ray casting of a compute slot and copies its
+  ///        projections into the primary projection buffer.
+  ///
+  /// The copy overwrites the primary projection buffer, so any work reading
+  /// the previous projections (e.g. similarity metrics) must have finished.
+  /// The copy is finished when this returns, every object reading the primary
+  /// projection buffer, such as a similarity metric using to_ocl_buf(), then
+  /// reads the slot's projections. The current number of projections is
+  /// copied.
+  void copy_compute_slot_projs(const size_type slot_idx);
+
+  /// \brief The device buffer of the camera to volume poses of each
+  ///        projection.
+  ///
+  /// Each pose is stored as a row-major 4x4 matrix. Poses computed on the
+  /// device (e.g. candidates sampled by an optimizer) may be written directly
+  /// into this buffer, after allocate_resources(), in which case
+  /// set_use_dev_xforms_cam_to_itk_phys(true) must be called so that compute()
+  /// does not overwrite them with the host poses.
+  boost::compute::vector<boost::compute::float16_>& xforms_cam_to_itk_phys_dev();
+
+  /// \brief The command queue used to launch the ray casting kernels.
+  ///
+  /// Kernels writing into xforms_cam_to_itk_phys_dev() that are enqueued with
+  /// this queue are finished before the next ray casting begins.
+  const boost::compute::command_queue& cmd_queue() const;
+
+  /// \brief Indicates that the poses in xforms_cam_to_itk_phys_dev() are used
+  ///        by compute(), instead of transferring the host poses.
+  ///
+  /// The host poses (xforms_cam_to_itk_phys()) are not updated with the
+  /// device poses. Once set back to false, every host pose is transferred by
+  /// the next call to compute(). Defaults to false.
+  void set_use_dev_xforms_cam_to_itk_phys(const bool use_dev_xforms);
+
+  bool use_dev_xforms_cam_to_itk_phys() const;
+
+  /// \brief Indicates that the kernels read the poses from
+  ///        xforms_cam_to_itk_phys_dev(), e.g. so that poses written on the
+  ///        device may be used.
+  ///
+  /// Ray casters that derive other quantities from the host poses return
+  /// false. The default implementation returns true.
+  virtual bool supports_dev_xforms_cam_to_itk_phys() const;
+
+  /// \brief Storage formats of the volume textures in device memory.
+  ///
+  /// Half precision floating point and normalized 16-bit integer textures
+  /// use half of the memory and bandwidth of single precision textures, at
+  /// a loss of precision. Normalized 16-bit integer textures store each
+  /// volume's intensities linearly mapped from [min, max] onto [0, 1], the
+  /// mapping is inverted in the kernels using a scale and offset.
+  enum VolTexFormat
+  {
+    kRAY_CAST_VOL_TEX_FLOAT32 = 0,
+    kRAY_CAST_VOL_TEX_HALF,
+    kRAY_CAST_VOL_TEX_UNORM16
+  };
+
+  /// \brief Sets the storage format of the volume textures.
+  ///
+  /// Volumes that have already been set are re-uploaded using the new format.
+  /// Defaults to single precision floating point.
+  void set_vol_tex_format(const VolTexFormat fmt);
+
+  VolTexFormat vol_tex_format() const;
   
   /// \brief Arguments that will be passed to the GPU kernel
   ///
@@ -148,6 +323,12 @@ public:
     boost::compute::float4_ img_aabb_max;
 
     boost::compute::float_ step_size;
+
+    // maps a value read from the volume texture to the volume intensity:
+    // vol_tex_scale * v + vol_tex_offset
+    boost::compute::float_ vol_tex_scale;
+    boost::compute::float_ vol_tex_offset;
+
     boost::compute::float_ pad;  // un-used
 
     boost::compute::ulong_ num_det_pts;
@@ -159,7 +340,6 @@ private:
   constexpr static bool kENFORCE_OPENCL_MAX_ALLOC = true;
 
 protected:
-  using PixelBufHost = std::vector<PixelScalar2D>;
   using PixelBufDev  = boost::compute::vector<PixelScalar2D>;
 
   using PixelBufDevPtr  = std::shared_ptr<PixelBufDev>;
@@ -180,55 +360,222 @@ protected:
 
   void camera_models_changed() override;
 
+  /// \brief Indicates if an interpolation method is supported by the
+  ///        kernel(s) of a ray caster.
+  ///
+  /// The default implementation only supports linear interpolation.
+  virtual bool supports_interp_method(const InterpMethod interp_method) const;
+
   void compute_helper_pre_kernels(const size_type vol_idx);
 
   void compute_helper_post_kernels(const size_type vol_idx);
 
+  /// \brief Copies the elements of a host buffer that have changed since the
+  ///        previous copy to a device buffer.
+  ///
+  /// prev_host stores the elements most recently copied to dev and is
+  /// updated to match cur_host; it should be cleared whenever dev is
+  /// re-allocated, in which case every element is copied.
+  ///
+  /// When upload_event is non-null, the transfer is enqueued without waiting
+  /// and its event is stored in upload_event, which is waited on before
+  /// prev_host is next modified; prev_host must outlive the transfer. When
+  /// null, the transfer is finished before returning.
+  void upload_changed_elems(const Float16ListHost& cur_host, Float16ListHost* prev_host,
+                            Float16ListDev* dev,
+                            boost::compute::event* upload_event = nullptr);
+
+  void upload_changed_elems(const ULongListHost& cur_host, ULongListHost* prev_host,
+                            ULongListDev* dev,
+                            boost::compute::event* upload_event = nullptr);
+
+  /// \brief Records the event of a kernel launched by compute(), waiting for
+  ///        the kernel to finish unless called from compute_async().
+  ///
+  /// When a name is provided, the execution time of the kernel is recorded
+  /// under the name when OpenCL profiling is enabled.
+  void finish_kernel_launch(const boost::compute::event& e,
+                            const std::string& prof_name = std::string());
+
+  /// \brief Launches a 1D ray casting kernel, with a work item for each ray,
+  ///        using a work-group size tuned for the device.
+  ///
+  /// The ray casting kernels combine their results with the existing pixel
+  /// values, so the output argument is pointed to a scratch buffer while the
+  /// work-group size is tuned. The launch is finished with
+  /// finish_kernel_launch().
+  void launch_ray_cast_kernel(boost::compute::kernel& k, const std::string& key,
+                              const size_type dst_arg_idx, const std::size_t num_rays);
+
   /// \brief Called anytime volumes from the host are specified,
   ///        performs the work to move into texture memory.
+  ///
+  /// A texture is only created when no other ray caster using the same
+  /// context already holds a texture of the volume, with the same format and
+  /// modification time.
   void vols_changed() override;
 
+  /// \brief Indicates that vols_changed() creates a texture of each entire
+  ///        volume.
+  ///
+  /// Ray casters sampling the volumes from other device storage (e.g. paged
+  /// bricks) may return false, in which case the entries of vol_texs_dev_
+  /// are not created and the texture values are the volume intensities.
+  /// The default implementation returns true.
+  virtual bool uses_full_vol_texs() const;
+
+  /// \brief The texture of the cubic B-spline coefficients of a volume.
+  ///
+  /// The coefficients are prefiltered on the host (see
+  /// RayCaster::bspline_coefs()) and uploaded on the first call for a volume,
+  /// or by vols_changed() when B-spline interpolation is already selected.
+  /// Sampling this texture with xregReadBSplineTex() in a kernel performs
+  /// tricubic B-spline interpolation. The returned reference is valid until
+  /// the volumes change.
+  const RayCastOCLVolTex& bspline_coef_tex(const size_type vol_idx);
+
+  /// \brief Indicates that a precomputed gradient texture exists for a volume.
+  ///
+  /// Gradient textures are created by vols_changed() when precomputed
+  /// gradients are enabled (see RayCaster::set_use_precomputed_grad_vols())
+  /// and full volume textures are used.
+  bool has_grad_tex(const size_type vol_idx) const;
+
+  /// \brief The half precision RGBA texture of a volume's precomputed
+  ///        gradients, with the gradient stored in the xyz channels.
+  ///
+  /// When no gradient texture exists, the volume texture is returned so that
+  /// kernels always have a valid image argument; kernels should then compute
+  /// the gradient from the volume texture (see has_grad_tex()).
+  const boost::compute::image3d& grad_tex(const size_type vol_idx) const;
+
   boost::compute::context ctx_;
   boost::compute::command_queue cmd_queue_;
 
   PixelScalar2D* ext_pixel_buf_;
 
-  /// \brief Host buffer used to store the line integral images.
-  ///
-  /// This is addressed in row-major layout within each image, and each image
-  /// is stored contiguously:
-  ///  Image 1 row 1 col 1, Image 1 row 1 col 2, ..., Image 1 row 1 col M, ..., Image 1 row N col M, Image 2 row 1 col 1, ... Image P row N col M
-  PixelBufHost pixel_buf_host_;
 
-  Float4ListDev det_pts_dev_;
+  /// \brief The detector points of each camera model, shared with the other
+  ///        ray casters using the same context and detector points.
+  std::shared_ptr<Float4ListDev> det_pts_dev_;
 
   Float4ListDev focal_pts_dev_;
 
   PixelBufDev  proj_pixels_dev_;
   PixelBufDev* proj_pixels_dev_to_use_;
 
+  /// \brief Indicates that compute() is being called from compute_async()
+  bool async_compute_ = false;
+
+  /// \brief The event of the most recently launched kernel
+  boost::compute::event compute_event_;
+
+  /// \brief The events of the most recent transfers into
+  ///        cam_to_itk_phys_xforms_dev_ and cam_model_for_proj_dev_, the
+  ///        transfers read from the host buffers of the elements on the device.
+  boost::compute::event xforms_upload_event_;
+  boost::compute::event cam_model_upload_event_;
+
   ULongListHost cam_model_for_proj_host_;
 
   ULongListDev cam_model_for_proj_dev_;
 
+  /// \brief The camera associations stored in cam_model_for_proj_dev_
+  ULongListHost cam_model_for_proj_on_dev_;
+
   Float16ListHost cam_to_itk_phys_xforms_host_;
 
   Float16ListDev cam_to_itk_phys_xforms_dev_;
 
+  /// \brief The poses stored in cam_to_itk_phys_xforms_dev_, used to only
+  ///        transfer the poses that change between calls to compute()
+  Float16ListHost cam_to_itk_phys_xforms_on_dev_;
+
+  /// \brief Indicates the poses in cam_to_itk_phys_xforms_dev_ were written on
+  ///        the device and are not transferred from the host.
+  bool use_dev_xforms_cam_to_itk_phys_ = false;
+
   // NOTE: the default constructor for the texture objects should NOT
   //       create a default context, etc...
   VolumeTextureList vol_texs_dev_;
 
+  /// \brief The shared textures referenced by vol_texs_dev_, the textures are
+  ///        released once no ray caster holds a reference.
+  std::vector<std::shared_ptr<RayCastOCLVolTex>> shared_vol_texs_;
+
+  /// \brief The shared B-spline coefficient textures of each volume, null
+  ///        entries have not been created yet.
+  std::vector<std::shared_ptr<RayCastOCLVolTex>> bspline_coef_texs_;
+
+  /// \brief The precomputed gradient textures of each volume, null entries
+  ///        when precomputed gradients are not used.
+  std::vector<std::shared_ptr<RayCastOCLVolTex>> grad_texs_;
+
+  VolTexFormat vol_tex_fmt_ = kRAY_CAST_VOL_TEX_FLOAT32;
+
+  /// \brief The mapping from texture value to intensity for each volume
+  ///        texture, see RayCastArgs::vol_tex_scale
+  std::vector<float> vol_tex_scales_;
+  std::vector<float> vol_tex_offsets_;
+
   double max_opencl_alloc_size_fraction_to_use_;
 
   RayCastArgs ray_cast_kernel_args_;
 
+  /// \brief Copies the projections to the host, the host buffer is owned by
+  ///        this object (in pinned memory) unless an external buffer is used.
+  ///
+  /// This is addressed in row-major layout within each image, and each image
+  /// is stored contiguously:
+  ///  Image 1 row 1 col 1, Image 1 row 1 col 2, ..., Image 1 row 1 col M, ..., Image 1 row N col M, Image 2 row 1 col 1, ... Image P row N col M
   RayCastSyncHostBufFromOCL sync_to_host_;
 
   RayCastSyncOCLBufFromOCL sync_to_ocl_;
 
   PixelBufDevList bg_projs_to_use_for_each_cam_dev_;
 
+  /// \brief The command queue and buffers used by a compute slot other than
+  ///        slot 0, see set_num_compute_slots().
+  ///
+  /// While a slot is computed, its command queue, pose and camera association
+  /// buffers and events are swapped with those of this object, and
+  /// proj_pixels_dev_to_use_ points to its projection buffer.
+  struct ComputeSlot
+  {
+    ComputeSlot(const boost::compute::context& ctx,
+                const boost::compute::command_queue& q);
+
+    boost::compute::command_queue queue;
+
+    PixelBufDev proj_pixels_dev;
+
+    Float16ListDev  cam_to_itk_phys_xforms_dev;
+    Float16ListHost cam_to_itk_phys_xforms_on_dev;
+
+    ULongListDev  cam_model_for_proj_dev;
+    ULongListHost cam_model_for_proj_on_dev;
+
+    boost::compute::event xforms_upload_event;
+    boost::compute::event cam_model_upload_event;
+
+    boost::compute::event compute_event;
+  };
+
+  /// \brief Swaps the command queue and buffers used by compute() with those
+  ///        of a compute slot other than 0.
+  void swap_compute_slot(ComputeSlot* slot);
+
+  size_type num_compute_slots_ = 1;
+
+  /// \brief Compute slots 1, 2, ..., created by allocate_resources()
+  std::vector<std::shared_ptr<ComputeSlot>> compute_slots_;
+
+  size_type max_device_bytes_ = 0;
+
+  /// \brief Device memory of the buffers sized by allocate_resources(), the
+  ///        volume textures are tracked separately since they are shared.
+  TrackedMemAlloc alloc_dev_mem_ = TrackedMemAlloc(MemLocation::kDEVICE, "ray-cast-proj-bufs");
+
   // TODO: implement setters for the max alloc fraction to use
   //       that use all free memory or all memory for the device
   //       (retrieving the amount of free memory will probably
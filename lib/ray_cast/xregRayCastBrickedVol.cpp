@@ -0,0 +1,104 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregRayCastBrickedVol.h"
+
+#include <algorithm>
+
+#include "xregHugePages.h"
+#include "xregTBBUtils.h"
+
+constexpr std::int32_t xreg::RayCastBrickedVol::kBRICK_DIM_LOG2;
+constexpr std::int32_t xreg::RayCastBrickedVol::kBRICK_DIM;
+constexpr std::int32_t xreg::RayCastBrickedVol::kBRICK_IDX_MASK;
+
+xreg::RayCastBrickedVol xreg::MakeRayCastBrickedVol(const RayCastBrickedVol::Vol* vol,
+                                                    const bool use_huge_pages)
+{
+  using PixelScalar = RayCastBrickedVol::PixelScalar;
+
+  constexpr std::int32_t kBD = RayCastBrickedVol::kBRICK_DIM;
+
+  const auto vol_size = vol->GetLargestPossibleRegion().GetSize();
+
+  RayCastBrickedVol bv;
+
+  bv.size_x = static_cast<std::int32_t>(vol_size[0]);
+  bv.size_y = static_cast<std::int32_t>(vol_size[1]);
+  bv.size_z = static_cast<std::int32_t>(vol_size[2]);
+
+  bv.num_bricks_x = (bv.size_x + kBD - 1) / kBD;
+  bv.num_bricks_y = (bv.size_y + kBD - 1) / kBD;
+  bv.num_bricks_z = (bv.size_z + kBD - 1) / kBD;
+
+  const size_type num_bricks = static_cast<size_type>(bv.num_bricks_x) *
+                                  bv.num_bricks_y * bv.num_bricks_z;
+
+  if (use_huge_pages)
+  {
+    ResizeWithHugePages(&bv.buf, num_bricks * kBD * kBD * kBD);
+  }
+  else
+  {
+    bv.buf.resize(num_bricks * kBD * kBD * kBD);
+  }
+
+  const PixelScalar* src_buf = vol->GetBufferPointer();
+
+  const std::int64_t src_stride_y = bv.size_x;
+  const std::int64_t src_stride_z = src_stride_y * bv.size_y;
+
+  auto brick_fn = [&bv, src_buf, src_stride_y, src_stride_z] (const RangeType& r)
+  {
+    for (size_type brick_idx = r.begin(); brick_idx < r.end(); ++brick_idx)
+    {
+      const std::int32_t bz = static_cast<std::int32_t>(brick_idx / (bv.num_bricks_x * bv.num_bricks_y));
+      const std::int32_t by = static_cast<std::int32_t>((brick_idx / bv.num_bricks_x) % bv.num_bricks_y);
+      const std::int32_t bx = static_cast<std::int32_t>(brick_idx % bv.num_bricks_x);
+
+      PixelScalar* dst_buf = &bv.buf[brick_idx * kBD * kBD * kBD];
+
+      for (std::int32_t lz = 0; lz < kBD; ++lz)
+      {
+        const std::int32_t z = std::min((bz * kBD) + lz, bv.size_z - 1);
+
+        for (std::int32_t ly = 0; ly < kBD; ++ly)
+        {
+          const std::int32_t y = std::min((by * kBD) + ly, bv.size_y - 1);
+
+          const PixelScalar* src_row = src_buf + (y * src_stride_y) + (z * src_stride_z);
+
+          for (std::int32_t lx = 0; lx < kBD; ++lx, ++dst_buf)
+          {
+            *dst_buf = src_row[std::min((bx * kBD) + lx, bv.size_x - 1)];
+          }
+        }
+      }
+    }
+  };
+
+  ParallelFor(brick_fn, RangeType(0, num_bricks));
+
+  return bv;
+}
@@ -0,0 +1,100 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGRAYCASTBRICKEDVOL_H_
+#define XREGRAYCASTBRICKEDVOL_H_
+
+#include <cstdint>
+
+#include "xregCommon.h"
+
+namespace xreg
+{
+
+/// \brief Copy of a ray casting volume with voxels stored in cubic bricks.
+///
+/// The voxels of each brick are stored contiguously, with x varying fastest,
+/// and the bricks are stored in raster order. Rays that are oblique to the
+/// volume axes therefore touch far fewer cache lines than with the raster
+/// ordering of the itk::Image buffer, at the cost of an additional copy of the
+/// volume. The volume is padded to a whole number of bricks in each dimension;
+/// padded voxels replicate the last voxel of each dimension.
+struct RayCastBrickedVol
+{
+  using PixelScalar = RayCastPixelScalar;
+  using Vol         = itk::Image<PixelScalar,3>;
+
+  using PixelScalarList = std::vector<PixelScalar>;
+
+  /// \brief Base two logarithm of the brick side length (8 voxels, 2 KB per brick)
+  static constexpr std::int32_t kBRICK_DIM_LOG2 = 3;
+
+  static constexpr std::int32_t kBRICK_DIM = 1 << kBRICK_DIM_LOG2;
+
+  static constexpr std::int32_t kBRICK_IDX_MASK = kBRICK_DIM - 1;
+
+  PixelScalarList buf;
+
+  std::int32_t size_x = 0;  ///< Number of voxels in the original volume
+  std::int32_t size_y = 0;
+  std::int32_t size_z = 0;
+
+  std::int32_t num_bricks_x = 0;
+  std::int32_t num_bricks_y = 0;
+  std::int32_t num_bricks_z = 0;
+
+  bool valid() const
+  {
+    return !buf.empty();
+  }
+
+  /// \brief Offset into the buffer of a voxel.
+  ///
+  /// The index must lie within the (padded) volume.
+  std::int64_t offset(const std::int32_t i, const std::int32_t j, const std::int32_t k) const
+  {
+    const std::int64_t b = (i >> kBRICK_DIM_LOG2) +
+                  (num_bricks_x * ((j >> kBRICK_DIM_LOG2) +
+                      (static_cast<std::int64_t>(num_bricks_y) * (k >> kBRICK_DIM_LOG2))));
+
+    return (b << (3 * kBRICK_DIM_LOG2)) +
+              (i & kBRICK_IDX_MASK) +
+              ((j & kBRICK_IDX_MASK) << kBRICK_DIM_LOG2) +
+              ((k & kBRICK_IDX_MASK) << (2 * kBRICK_DIM_LOG2));
+  }
+};
+
+using RayCastBrickedVolList = std::vector<RayCastBrickedVol>;
+
+/// \brief Creates a bricked copy of a volume.
+///
+/// This is a multi-threaded copy over the bricks of the volume. When
+/// use_huge_pages is true, the buffer is backed by transparent huge pages
+/// (see AdviseHugePages()).
+RayCastBrickedVol MakeRayCastBrickedVol(const RayCastBrickedVol::Vol* vol,
+                                        const bool use_huge_pages = false);
+
+}  // xreg
+
+#endif
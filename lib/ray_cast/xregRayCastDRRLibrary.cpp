@@ -0,0 +1,626 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregRayCastDRRLibrary.h"
+
+#include <cmath>
+
+#include <Eigen/Geometry>
+
+#include "xregAssert.h"
+#include "xregExceptionUtils.h"
+#include "xregITKBasicImageUtils.h"
+#include "xregTBBUtils.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+constexpr CoordScalar kPI = 3.141592653589793;
+
+/// \brief The orientation of a volume, with respect to the world, in the
+///        canonical pose of a library viewing direction.
+Mat3x3 DRRLibViewRot(const Pt3& view_dir_wrt_vol, const Pt3& cam_axis)
+{
+  return Eigen::Quaternion<CoordScalar>::FromTwoVectors(view_dir_wrt_vol, cam_axis).toRotationMatrix();
+}
+
+/// \brief The pose (camera to volume) of a library DRR
+FrameTransform DRRLibPose(const CameraModel& cam, const Pt3& cam_axis,
+                          const Pt3& view_dir_wrt_vol, const CoordScalar depth,
+                          const Pt3& rot_center_wrt_vol)
+{
+  const Mat3x3 rot_vol_to_world = DRRLibViewRot(view_dir_wrt_vol, cam_axis);
+
+  FrameTransform vol_to_world = FrameTransform::Identity();
+  vol_to_world.matrix().block(0,0,3,3) = rot_vol_to_world;
+  vol_to_world.matrix().block(0,3,3,1) = cam.pinhole_pt + (depth * cam_axis)
+                                           - (rot_vol_to_world * rot_center_wrt_vol);
+
+  return vol_to_world.inverse();
+}
+
+}  // un-named
+
+xreg::Pt3 xreg::DRRLibCamAxis(const CameraModel& cam)
+{
+  const Pt2 det_center_ind(0.5 * (cam.num_det_cols - 1), 0.5 * (cam.num_det_rows - 1));
+
+  return (cam.ind_pt_to_phys_det_pt(det_center_ind) - cam.pinhole_pt).normalized();
+}
+
+xreg::DRRLibPoseParams
+xreg::ComputeDRRLibPoseParams(const CameraModel& cam,
+                              const FrameTransform& cam_to_itk_phys,
+                              const Pt3& rot_center_wrt_vol)
+{
+  using Quat      = Eigen::Quaternion<CoordScalar>;
+  using AngleAxis = Eigen::AngleAxis<CoordScalar>;
+
+  const Pt3 cam_axis = DRRLibCamAxis(cam);
+
+  const FrameTransform vol_to_world = cam_to_itk_phys.inverse();
+
+  const Pt3 rot_center_to_src = (vol_to_world * rot_center_wrt_vol) - cam.pinhole_pt;
+
+  DRRLibPoseParams params;
+
+  params.depth = rot_center_to_src.norm();
+
+  xregASSERT(params.depth > 1.0e-6);
+
+  // rotation about the source which moves the rotation center onto the camera axis
+  const Mat3x3 rot_to_center = Quat::FromTwoVectors(cam_axis, rot_center_to_src / params.depth).toRotationMatrix();
+
+  const Mat3x3 canon_rot = rot_to_center.transpose() * vol_to_world.matrix().block(0,0,3,3);
+
+  // swing-twist decomposition of the canonical rotation about the camera axis
+  const Quat canon_q(canon_rot);
+
+  const CoordScalar twist_ang = 2 * std::atan2(canon_q.vec().dot(cam_axis), canon_q.w());
+
+  params.view_dir_wrt_vol = canon_rot.transpose() * cam_axis;
+  
+  params.in_plane_rot = rot_to_center * AngleAxis(twist_ang, cam_axis).toRotationMatrix();
+
+  return params;
+}
+
+xreg::Pt3List xreg::MakeDRRLibViewDirsInCone(const Pt3& center_dir,
+                                             const CoordScalar max_angle_rad,
+                                             const CoordScalar angle_step_rad)
+{
+  xregASSERT(angle_step_rad > 0);
+
+  const Pt3 c = center_dir.normalized();
+
+  // any unit vector orthogonal to the center direction
+  const Pt3 ortho = c.unitOrthogonal();
+
+  Pt3List dirs = { c };
+
+  const size_type num_rings = static_cast<size_type>(std::floor((max_angle_rad / angle_step_rad) + 1.0e-6));
+
+  for (size_type ring_idx = 1; ring_idx <= num_rings; ++ring_idx)
+  {
+    const CoordScalar polar_ang = ring_idx * angle_step_rad;
+
+    const size_type num_dirs_in_ring = std::max(size_type(1),
+            static_cast<size_type>(std::ceil(2 * kPI * std::sin(polar_ang) / angle_step_rad)));
+
+    // tilt away from the center, then spin about the center
+    const Pt3 tilted = Eigen::AngleAxis<CoordScalar>(polar_ang, ortho) * c;
+
+    for (size_type dir_idx = 0; dir_idx < num_dirs_in_ring; ++dir_idx)
+    {
+      dirs.push_back(Eigen::AngleAxis<CoordScalar>((2 * kPI * dir_idx) / num_dirs_in_ring, c) * tilted);
+    }
+  }
+
+  return dirs;
+}
+
+void xreg::RayCasterDRRLibrary::set_lib_ray_caster(RayCasterPtr lib_ray_caster)
+{
+  lib_ray_caster_ = lib_ray_caster;
+
+  lib_needs_update_ = true;
+}
+
+void xreg::RayCasterDRRLibrary::set_exact_ray_caster(RayCasterPtr exact_ray_caster)
+{
+  exact_ray_caster_ = exact_ray_caster;
+}
+
+void xreg::RayCasterDRRLibrary::set_view_dirs(const Pt3List& view_dirs_wrt_vol)
+{
+  view_dirs_.clear();
+  view_dirs_.reserve(view_dirs_wrt_vol.size());
+
+  for (const auto& d : view_dirs_wrt_vol)
+  {
+    view_dirs_.push_back(d.normalized());
+  }
+
+  lib_needs_update_ = true;
+}
+
+const xreg::Pt3List& xreg::RayCasterDRRLibrary::view_dirs() const
+{
+  return view_dirs_;
+}
+
+void xreg::RayCasterDRRLibrary::set_depths(const CoordScalarList& depths)
+{
+  depths_ = depths;
+
+  lib_needs_update_ = true;
+}
+
+const xreg::CoordScalarList& xreg::RayCasterDRRLibrary::depths() const
+{
+  return depths_;
+}
+
+void xreg::RayCasterDRRLibrary::set_rot_centers(const Pt3List& rot_centers_wrt_vols)
+{
+  rot_centers_ = rot_centers_wrt_vols;
+
+  lib_needs_update_ = true;
+}
+
+void xreg::RayCasterDRRLibrary::set_lib_upsample_factor(const size_type upsample_factor)
+{
+  xregASSERT(upsample_factor > 0);
+
+  lib_upsample_factor_ = upsample_factor;
+
+  lib_needs_update_ = true;
+}
+
+xreg::size_type xreg::RayCasterDRRLibrary::lib_upsample_factor() const
+{
+  return lib_upsample_factor_;
+}
+
+void xreg::RayCasterDRRLibrary::set_lib_batch_size(const size_type batch_size)
+{
+  xregASSERT(batch_size > 0);
+
+  lib_batch_size_ = batch_size;
+}
+
+void xreg::RayCasterDRRLibrary::set_max_lib_view_angle(const CoordScalar max_angle_rad)
+{
+  max_lib_view_angle_ = max_angle_rad;
+}
+
+xreg::CoordScalar xreg::RayCasterDRRLibrary::max_lib_view_angle() const
+{
+  return max_lib_view_angle_;
+}
+
+void xreg::RayCasterDRRLibrary::set_use_exact_casts(const bool use_exact)
+{
+  use_exact_casts_ = use_exact;
+}
+
+bool xreg::RayCasterDRRLibrary::use_exact_casts() const
+{
+  return use_exact_casts_;
+}
+
+xreg::size_type xreg::RayCasterDRRLibrary::num_exact_casts() const
+{
+  return num_exact_casts_;
+}
+
+const xreg::RayCaster::CameraModelList&
+xreg::RayCasterDRRLibrary::lib_camera_models() const
+{
+  return lib_cams_;
+}
+
+xreg::RayCasterDRRLibrary::ProjPtr
+xreg::RayCasterDRRLibrary::lib_proj(const size_type vol_idx, const size_type cam_idx,
+                                    const size_type view_idx, const size_type depth_idx)
+{
+  const auto& cam = lib_cams_[cam_idx];
+
+  const size_type num_dets = cam.num_det_rows * cam.num_det_cols;
+
+  auto img_proj = Proj::New();
+
+  auto img_proj_pixel_container = Proj::PixelContainer::New();
+  img_proj_pixel_container->SetImportPointer(&lib_drrs_[vol_idx][cam_idx][0] +
+                                               (num_dets * ((view_idx * depths_.size()) + depth_idx)),
+                                             num_dets, false);
+
+  img_proj->SetPixelContainer(img_proj_pixel_container);
+
+  Proj::RegionType proj_region;
+  proj_region.SetIndex(0, 0);
+  proj_region.SetIndex(1, 0);
+  proj_region.SetSize(0, cam.num_det_cols);
+  proj_region.SetSize(1, cam.num_det_rows);
+
+  img_proj->SetRegions(proj_region);
+
+  const CoordScalar spacings[2] = { cam.det_col_spacing, cam.det_row_spacing };
+  img_proj->SetSpacing(spacings);
+
+  return img_proj;
+}
+
+void xreg::RayCasterDRRLibrary::vols_changed()
+{
+  RayCasterCPU::vols_changed();
+
+  lib_needs_update_ = true;
+
+  if (exact_ray_caster_)
+  {
+    exact_ray_caster_->set_volumes(this->vols_);
+  }
+}
+
+void xreg::RayCasterDRRLibrary::allocate_resources()
+{
+  RayCasterCPU::allocate_resources();
+
+  if (!lib_ray_caster_)
+  {
+    xregThrow("DRR library ray caster requires a ray caster for computing the library!");
+  }
+
+  if (view_dirs_.empty() || depths_.empty())
+  {
+    xregThrow("DRR library requires at least one viewing direction and depth!");
+  }
+
+  const CoordScalar f = static_cast<CoordScalar>(lib_upsample_factor_);
+
+  Mat3x3 upsample_mat = Mat3x3::Identity();
+  upsample_mat(0,0) = f;
+  upsample_mat(1,1) = f;
+  upsample_mat(0,2) = (f - 1) / 2;
+  upsample_mat(1,2) = (f - 1) / 2;
+
+  lib_cams_.clear();
+  lib_cams_.reserve(this->camera_models_.size());
+
+  for (const auto& cam : this->camera_models_)
+  {
+    CameraModel lib_cam;
+    lib_cam.setup(upsample_mat * cam.intrins, cam.extrins.matrix(),
+                  cam.num_det_rows * lib_upsample_factor_,
+                  cam.num_det_cols * lib_upsample_factor_,
+                  cam.det_row_spacing / f, cam.det_col_spacing / f);
+
+    lib_cams_.push_back(lib_cam);
+  }
+
+  build_lib();
+
+  if (exact_ray_caster_)
+  {
+    exact_ray_caster_->set_camera_models(this->camera_models_);
+    exact_ray_caster_->set_volumes(this->vols_);
+    exact_ray_caster_->set_ray_step_size(this->ray_step_size_);
+    exact_ray_caster_->set_interp_method(this->interp_method_);
+    exact_ray_caster_->set_proj_store_method(kRAY_CAST_PIXEL_REPLACE);
+    exact_ray_caster_->set_use_bg_projs(false);
+    exact_ray_caster_->set_num_projs(this->num_projs_);
+    exact_ray_caster_->allocate_resources();
+  }
+}
+
+void xreg::RayCasterDRRLibrary::build_lib()
+{
+  const size_type num_vols  = this->vols_.size();
+  const size_type num_cams  = lib_cams_.size();
+  const size_type num_views = view_dirs_.size();
+  const size_type num_depths = depths_.size();
+
+  const size_type num_lib_projs_per_cam = num_views * num_depths;
+
+  const size_type num_lib_pix = lib_cams_[0].num_det_rows * lib_cams_[0].num_det_cols;
+
+  if (rot_centers_.empty())
+  {
+    for (const auto& v : this->vols_)
+    {
+      rot_centers_.push_back(ITKVol3DCenterAsPhysPt(v.GetPointer()));
+    }
+  }
+  else if (rot_centers_.size() != num_vols)
+  {
+    xregThrow("Number of DRR library rotation centers (%lu) does not match number of volumes (%lu)!",
+              rot_centers_.size(), num_vols);
+  }
+
+  const size_type batch_size = std::min(lib_batch_size_, num_lib_projs_per_cam);
+
+  lib_ray_caster_->set_camera_models(lib_cams_);
+  lib_ray_caster_->set_volumes(this->vols_);
+  lib_ray_caster_->set_ray_step_size(this->ray_step_size_);
+  lib_ray_caster_->set_interp_method(this->interp_method_);
+  lib_ray_caster_->set_proj_store_method(kRAY_CAST_PIXEL_REPLACE);
+  lib_ray_caster_->set_use_bg_projs(false);
+  lib_ray_caster_->set_num_projs(batch_size);
+  lib_ray_caster_->allocate_resources();
+
+  lib_drrs_.assign(num_vols, std::vector<PixelBufferVec>(num_cams));
+
+  size_type num_lib_bytes = 0;
+
+  FrameTransformList batch_xforms;
+  batch_xforms.reserve(batch_size);
+
+  for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
+  {
+    for (size_type cam_idx = 0; cam_idx < num_cams; ++cam_idx)
+    {
+      const auto& cam = this->camera_models_[cam_idx];
+
+      const Pt3 cam_axis = DRRLibCamAxis(cam);
+
+      PixelBufferVec& drrs = lib_drrs_[vol_idx][cam_idx];
+      drrs.resize(num_lib_projs_per_cam * num_lib_pix);
+
+      num_lib_bytes += drrs.capacity() * sizeof(PixelScalar2D);
+
+      for (size_type batch_start = 0; batch_start < num_lib_projs_per_cam; batch_start += batch_size)
+      {
+        const size_type batch_end = std::min(batch_start + batch_size, num_lib_projs_per_cam);
+
+        batch_xforms.clear();
+
+        for (size_type lib_idx = batch_start; lib_idx < batch_end; ++lib_idx)
+        {
+          batch_xforms.push_back(DRRLibPose(cam, cam_axis, view_dirs_[lib_idx / num_depths],
+                                            depths_[lib_idx % num_depths], rot_centers_[vol_idx]));
+        }
+
+        lib_ray_caster_->set_xforms_cam_to_itk_phys(batch_xforms);
+
+        for (size_type i = 0; i < batch_xforms.size(); ++i)
+        {
+          lib_ray_caster_->set_proj_cam_model(i, cam_idx);
+        }
+
+        lib_ray_caster_->compute(vol_idx);
+
+        for (size_type i = 0; i < batch_xforms.size(); ++i)
+        {
+          const PixelScalar2D* src = lib_ray_caster_->host_proj_pixels(i);
+
+          std::copy(src, src + num_lib_pix, &drrs[0] + ((batch_start + i) * num_lib_pix));
+        }
+      }
+    }
+  }
+
+  lib_drrs_mem_.set_bytes(num_lib_bytes);
+
+  lib_needs_update_ = false;
+}
+
+void xreg::RayCasterDRRLibrary::compute(const size_type vol_idx)
+{
+  if (lib_needs_update_)
+  {
+    build_lib();
+  }
+
+  this->pre_compute();
+
+  const size_type num_rows = this->camera_models_[0].num_det_rows;
+  const size_type num_cols = this->camera_models_[0].num_det_cols;
+
+  const size_type num_pix_per_proj = num_rows * num_cols;
+
+  const long lib_num_rows = static_cast<long>(lib_cams_[0].num_det_rows);
+  const long lib_num_cols = static_cast<long>(lib_cams_[0].num_det_cols);
+
+  const size_type num_lib_pix = lib_cams_[0].num_det_rows * lib_cams_[0].num_det_cols;
+
+  const size_type num_depths = depths_.size();
+
+  const CoordScalar cos_max_ang = std::cos(std::min(max_lib_view_angle_, CoordScalar(kPI)));
+
+  const bool can_cast_exact = static_cast<bool>(exact_ray_caster_);
+
+  std::vector<size_type> exact_proj_inds;
+
+  // the homography from each projection's pixels to its library DRR pixels,
+  // and the library DRR used by each projection
+  std::vector<Mat3x3> proj_to_lib_homogs(this->num_projs_);
+  std::vector<const PixelScalar2D*> proj_lib_drrs(this->num_projs_, nullptr);
+
+  for (size_type proj_idx = 0; proj_idx < this->num_projs_; ++proj_idx)
+  {
+    if (can_cast_exact && use_exact_casts_)
+    {
+      exact_proj_inds.push_back(proj_idx);
+      continue;
+    }
+
+    const size_type cam_idx = this->cam_model_for_proj_[proj_idx];
+
+    const auto& cam = this->camera_models_[cam_idx];
+
+    const Pt3 cam_axis = DRRLibCamAxis(cam);
+
+    const DRRLibPoseParams params = ComputeDRRLibPoseParams(cam,
+                                        this->xforms_cam_to_itk_phys_[proj_idx],
+                                        rot_centers_[vol_idx]);
+
+    size_type best_view_idx = 0;
+    CoordScalar best_view_dot = -2;
+
+    for (size_type view_idx = 0; view_idx < view_dirs_.size(); ++view_idx)
+    {
+      const CoordScalar d = view_dirs_[view_idx].dot(params.view_dir_wrt_vol);
+
+      if (d > best_view_dot)
+      {
+        best_view_dot = d;
+        best_view_idx = view_idx;
+      }
+    }
+
+    if (can_cast_exact && (best_view_dot < cos_max_ang))
+    {
+      exact_proj_inds.push_back(proj_idx);
+      continue;
+    }
+
+    size_type best_depth_idx = 0;
+
+    for (size_type depth_idx = 1; depth_idx < num_depths; ++depth_idx)
+    {
+      if (std::abs(depths_[depth_idx] - params.depth) <
+            std::abs(depths_[best_depth_idx] - params.depth))
+      {
+        best_depth_idx = depth_idx;
+      }
+    }
+
+    const CoordScalar mag_ratio = params.depth / depths_[best_depth_idx];
+
+    // undo the change in magnification: scale directions orthogonal to the
+    // camera axis relative to the component along the axis
+    const Mat3x3 inv_mag = (mag_ratio * Mat3x3::Identity()) +
+                           ((1 - mag_ratio) * cam_axis * cam_axis.transpose());
+
+    const Mat3x3 proj_dir_to_ind = this->camera_models_[cam_idx].phys_to_ind_proj_mat().block(0,0,3,3);
+    const Mat3x3 lib_dir_to_ind  = lib_cams_[cam_idx].phys_to_ind_proj_mat().block(0,0,3,3);
+
+    proj_to_lib_homogs[proj_idx] = lib_dir_to_ind * inv_mag * params.in_plane_rot.transpose() *
+                                     proj_dir_to_ind.inverse();
+
+    proj_lib_drrs[proj_idx] = &lib_drrs_[vol_idx][cam_idx][0] +
+                                (num_lib_pix * ((best_view_idx * num_depths) + best_depth_idx));
+  }
+
+  num_exact_casts_ = exact_proj_inds.size();
+
+  PixelScalar2D* dst_buf = this->pixel_buf_to_use();
+
+  auto warp_fn = [&] (const RangeType& r)
+  {
+    for (size_type range_idx = r.begin(); range_idx < r.end(); ++range_idx)
+    {
+      const size_type proj_idx = range_idx / num_pix_per_proj;
+
+      const PixelScalar2D* lib_drr = proj_lib_drrs[proj_idx];
+
+      if (!lib_drr)
+      {
+        // computed exactly
+        continue;
+      }
+
+      const size_type pix_idx = range_idx - (proj_idx * num_pix_per_proj);
+
+      const size_type row_idx = pix_idx / num_cols;
+      const size_type col_idx = pix_idx - (row_idx * num_cols);
+
+      const Pt3 lib_ind_h = proj_to_lib_homogs[proj_idx] *
+                              Pt3(static_cast<CoordScalar>(col_idx), static_cast<CoordScalar>(row_idx), 1);
+
+      if (lib_ind_h[2] <= 0)
+      {
+        continue;
+      }
+
+      const CoordScalar lib_col = lib_ind_h[0] / lib_ind_h[2];
+      const CoordScalar lib_row = lib_ind_h[1] / lib_ind_h[2];
+
+      const CoordScalar lib_col_floor = std::floor(lib_col);
+      const CoordScalar lib_row_floor = std::floor(lib_row);
+
+      const long c0 = static_cast<long>(lib_col_floor);
+      const long r0 = static_cast<long>(lib_row_floor);
+
+      const CoordScalar wc = lib_col - lib_col_floor;
+      const CoordScalar wr = lib_row - lib_row_floor;
+
+      // bilinear interpolation, pixels outside of the library detector are zero
+      auto lib_pix = [&] (const long r, const long c)
+      {
+        return ((r >= 0) && (r < lib_num_rows) && (c >= 0) && (c < lib_num_cols)) ?
+                  lib_drr[(r * lib_num_cols) + c] : PixelScalar2D(0);
+      };
+
+      const CoordScalar val = ((1 - wr) * (((1 - wc) * lib_pix(r0, c0))     + (wc * lib_pix(r0, c0 + 1)))) +
+                              (wr       * (((1 - wc) * lib_pix(r0 + 1, c0)) + (wc * lib_pix(r0 + 1, c0 + 1))));
+
+      dst_buf[range_idx] += static_cast<PixelScalar2D>(val);
+    }
+  };
+
+  {
+    ParallelExecContextScope exec_scope(this->exec_ctx_.get());
+
+    ParallelFor(warp_fn, RangeType(0, num_pix_per_proj * this->num_projs_));
+  }
+
+  if (!exact_proj_inds.empty())
+  {
+    FrameTransformList exact_xforms;
+    exact_xforms.reserve(exact_proj_inds.size());
+
+    for (const size_type proj_idx : exact_proj_inds)
+    {
+      exact_xforms.push_back(this->xforms_cam_to_itk_phys_[proj_idx]);
+    }
+
+    exact_ray_caster_->set_xforms_cam_to_itk_phys(exact_xforms);
+
+    for (size_type i = 0; i < exact_proj_inds.size(); ++i)
+    {
+      exact_ray_caster_->set_proj_cam_model(i, this->cam_model_for_proj_[exact_proj_inds[i]]);
+    }
+
+    exact_ray_caster_->compute(vol_idx);
+
+    for (size_type i = 0; i < exact_proj_inds.size(); ++i)
+    {
+      const PixelScalar2D* src = exact_ray_caster_->host_proj_pixels(i);
+
+      PixelScalar2D* dst = dst_buf + (exact_proj_inds[i] * num_pix_per_proj);
+
+      for (size_type pix_idx = 0; pix_idx < num_pix_per_proj; ++pix_idx)
+      {
+        dst[pix_idx] += src[pix_idx];
+      }
+    }
+  }
+
+  this->sync_to_ocl_.set_modified();
+  this->sync_to_host_.set_modified();
+}
@@ -0,0 +1,230 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGRAYCASTDRRLIBRARY_H_
+#define XREGRAYCASTDRRLIBRARY_H_
+
+#include "xregRayCastBaseCPU.h"
+
+namespace xreg
+{
+
+/// \brief The decomposition of a pose into the out-of-plane components
+///        indexing a DRR library and the in-plane components applied by
+///        warping a library DRR.
+///
+/// The pose is expressed as a "canonical" pose, with the rotation center of
+/// the volume on the camera axis (the ray from the source through the center
+/// of the detector), followed by a rotation about the source. The canonical
+/// rotation is further split into a twist about the camera axis and a swing,
+/// which is uniquely determined by the viewing direction in the volume. The
+/// rotation about the source and the twist are exactly a homography of the
+/// projection, so only the viewing direction and the depth change the
+/// appearance of the projected volume.
+struct DRRLibPoseParams
+{
+  /// \brief Unit direction of the camera axis with respect to the volume
+  ///        in the canonical pose.
+  Pt3 view_dir_wrt_vol;
+
+  /// \brief Distance from the source to the rotation center
+  CoordScalar depth;
+
+  /// \brief The rotation, about the source, from the canonical pose to the
+  ///        pose (including the twist), with respect to the camera.
+  Mat3x3 in_plane_rot;
+};
+
+/// \brief Computes the DRR library parameters of a pose.
+///
+/// cam_to_itk_phys is the pose of the camera with respect to the volume and
+/// rot_center_wrt_vol is the rotation center in volume physical coordinates.
+DRRLibPoseParams ComputeDRRLibPoseParams(const CameraModel& cam,
+                                         const FrameTransform& cam_to_itk_phys,
+                                         const Pt3& rot_center_wrt_vol);
+
+/// \brief The unit direction of the camera axis, from the source through
+///        the center of the detector.
+Pt3 DRRLibCamAxis(const CameraModel& cam);
+
+/// \brief Creates a collection of viewing directions within a cone.
+///
+/// The center direction is included, followed by rings of directions at
+/// multiples of angle_step_rad from the center, up to max_angle_rad, with
+/// adjacent directions of each ring approximately angle_step_rad apart.
+Pt3List MakeDRRLibViewDirsInCone(const Pt3& center_dir,
+                                 const CoordScalar max_angle_rad,
+                                 const CoordScalar angle_step_rad);
+
+/// \brief Approximates DRRs by warping DRRs precomputed on a grid of
+///        out-of-plane rotations and depths.
+///
+/// A library of DRRs is computed by another ray caster, for each volume and
+/// camera model, at each viewing direction (see DRRLibPoseParams) and depth,
+/// when allocating resources. The library DRRs are computed with a detector
+/// upsampled by an integer factor to limit the blurring of the warps. Each
+/// projection is then approximated by the library DRR with the nearest
+/// viewing direction and depth, warped with the homography induced by the
+/// in-plane rotation and the change in magnification. This approximation is
+/// exact for in-plane rotations and translations along the projection of a
+/// ray, so is most accurate when only the in-plane components of the
+/// candidate poses vary, e.g. an exhaustive search or the early levels of a
+/// multi-resolution registration.
+///
+/// An exact ray caster may also be provided, which is used for projections
+/// whose viewing direction is farther than a tolerance from every library
+/// direction, or for every projection when exact casts are requested (e.g.
+/// near convergence).
+///
+/// The values are added to the existing pixels (e.g. the background
+/// projections), in the same way as the sum line integral ray casters.
+/// Library pixels outside of the library detector are treated as zero. The
+/// other ray casters are configured by this object and should not have
+/// their resources allocated.
+class RayCasterDRRLibrary : public RayCasterCPU
+{
+public:
+  using RayCasterPtr = std::shared_ptr<RayCaster>;
+
+  /// \brief Sets the ray caster used to compute the library DRRs.
+  ///
+  /// Any kernel specific parameters should be set on the ray caster prior
+  /// to allocating the resources of this object. The camera models,
+  /// volumes, step size and interpolation method are set by this object.
+  void set_lib_ray_caster(RayCasterPtr lib_ray_caster);
+
+  /// \brief Sets the ray caster used to compute projections exactly, a null
+  ///        pointer (the default) always uses the library.
+  ///
+  /// This is configured in the same way as the library ray caster.
+  void set_exact_ray_caster(RayCasterPtr exact_ray_caster);
+
+  /// \brief Sets the viewing directions of the library, with respect to the
+  ///        volume physical coordinates.
+  void set_view_dirs(const Pt3List& view_dirs_wrt_vol);
+
+  const Pt3List& view_dirs() const;
+
+  /// \brief Sets the depths of the library, each depth is the distance from
+  ///        the source to the rotation center.
+  void set_depths(const CoordScalarList& depths);
+
+  const CoordScalarList& depths() const;
+
+  /// \brief Sets the rotation center of each volume, in volume physical
+  ///        coordinates.
+  ///
+  /// The center of each volume is used by default.
+  void set_rot_centers(const Pt3List& rot_centers_wrt_vols);
+
+  /// \brief Sets the factor by which the rows and columns of the library
+  ///        detectors are upsampled, defaults to 2.
+  void set_lib_upsample_factor(const size_type upsample_factor);
+
+  size_type lib_upsample_factor() const;
+
+  /// \brief Sets the number of library DRRs computed in each call to the
+  ///        library ray caster, defaults to 32.
+  void set_lib_batch_size(const size_type batch_size);
+
+  /// \brief Sets the largest angle, in radians, between the viewing direction
+  ///        of a projection and the nearest library direction that is
+  ///        approximated with the library.
+  ///
+  /// Projections beyond this angle are cast with the exact ray caster, when
+  /// one is set. Defaults to infinity.
+  void set_max_lib_view_angle(const CoordScalar max_angle_rad);
+
+  CoordScalar max_lib_view_angle() const;
+
+  /// \brief Casts every projection with the exact ray caster, e.g. near
+  ///        convergence of a registration.
+  void set_use_exact_casts(const bool use_exact);
+
+  bool use_exact_casts() const;
+
+  /// \brief Allocates the projection buffers, computes the library and
+  ///        allocates the resources of the exact ray caster.
+  void allocate_resources() override;
+
+  void compute(const size_type vol_idx = 0) override;
+
+  /// \brief The number of projections cast with the exact ray caster during
+  ///        the most recent call to compute().
+  size_type num_exact_casts() const;
+
+  /// \brief The camera models of the library DRRs, with upsampled detectors.
+  const CameraModelList& lib_camera_models() const;
+
+  /// \brief Retrieves a library DRR.
+  ///
+  /// The returned image is a shallow reference into the library.
+  ProjPtr lib_proj(const size_type vol_idx, const size_type cam_idx,
+                   const size_type view_idx, const size_type depth_idx);
+
+protected:
+  /// \brief Flags the library for an update and forwards the volumes to the
+  ///        exact ray caster.
+  void vols_changed() override;
+
+private:
+  /// \brief Computes the DRRs of each volume, camera, view and depth with the
+  ///        library ray caster.
+  void build_lib();
+
+  RayCasterPtr lib_ray_caster_;
+
+  RayCasterPtr exact_ray_caster_;
+
+  Pt3List view_dirs_;
+
+  CoordScalarList depths_;
+
+  Pt3List rot_centers_;
+
+  size_type lib_upsample_factor_ = 2;
+
+  size_type lib_batch_size_ = 32;
+
+  CoordScalar max_lib_view_angle_ = std::numeric_limits<CoordScalar>::infinity();
+
+  bool use_exact_casts_ = false;
+
+  bool lib_needs_update_ = true;
+
+  size_type num_exact_casts_ = 0;
+
+  CameraModelList lib_cams_;
+
+  /// \brief The library DRRs of each volume and camera, lib_drrs_[v][c]
+  ///        stores the DRRs of volume v and camera c consecutively, with the
+  ///        depths of each view adjacent.
+  std::vector<std::vector<PixelBufferVec>> lib_drrs_;
+
+  TrackedMemAlloc lib_drrs_mem_ = TrackedMemAlloc(MemLocation::kHOST, "ray-cast-drr-lib");
+};
+
+}  // xreg
+
+#endif
@@ -24,16 +24,12 @@
 
 #include "xregRayCastDepthCPU.h"
 
-#include <itkLinearInterpolateImageFunction.h>
-#include <itkNearestNeighborInterpolateImageFunction.h>
-#include <itkWindowedSincInterpolateImageFunction.h>
-#include <itkConstantBoundaryCondition.h>
-#include <itkBSplineInterpolateImageFunction.h>
-
 #include "xregITKBasicImageUtils.h"
+#include "xregRayCastInterpCPU.h"
 #include "xregTBBUtils.h"
 #include "xregSpatialPrimitives.h"
 #include "xregExceptionUtils.h"
+#include "xregAssert.h"
 
 namespace  // un-named
 {
@@ -64,50 +60,68 @@ struct RayCastDepthFn
 
   const RayCaster::InterpMethod interp_method;  ///< The interpolation method used for fractional indices into the 3D volume
 
+  const Vol* bspline_coefs;  ///< Shared B-spline coefficients of img_vol, null when not using B-spline interpolation
+
+  RayCastCPUThreadStatePool* thread_states;  ///< The interpolators and random engines kept by each thread
+
   PixelScalar2D* proj_buf;  ///< The large buffer used for storing all projection results
 
   PixelScalar3D collision_thresh;
 
   size_type num_backtracking_steps;
 
+  const RayCastVolBrickGrid* brick_grid;  ///< Used for skipping bricks below the collision threshold, null when not skipping
+
   /// \brief Computation operator - executes a collection of rays cast
   ///
   /// The collection of line integrals is not necessarily restricted to a single projection
   void operator()(const RangeType& r) const
   {
-    using VolInterpType        = itk::InterpolateImageFunction<Vol,CoordScalar>;
-    using VolLinearInterpType  = itk::LinearInterpolateImageFunction<Vol,CoordScalar>;
-    using VolNNInterpType      = itk::NearestNeighborInterpolateImageFunction<Vol,CoordScalar>;
-    using VolBSplineInterpType = itk::BSplineInterpolateImageFunction<Vol,CoordScalar>;
-    using VolSincInterpType    = itk::WindowedSincInterpolateImageFunction<
-                                         Vol,4,itk::Function::LanczosWindowFunction<4>,
-                                         itk::ConstantBoundaryCondition<Vol>,CoordScalar>;
+    if (interp_method == RayCaster::kRAY_CAST_INTERP_NN)
+    {
+      const RayCastVolNNInterpCPU<RayCastVolBufCPU> interp = { MakeRayCastVolBufCPU(img_vol) };
+      cast_rays(r, interp);
+    }
+    else if (interp_method == RayCaster::kRAY_CAST_INTERP_LINEAR)
+    {
+      const RayCastVolLinearInterpCPU<RayCastVolBufCPU> interp = { MakeRayCastVolBufCPU(img_vol) };
+      cast_rays(r, interp);
+    }
+    else
+    {
+      RayCastITKInterpCPU::VolInterp::Pointer vol_interp =
+                              thread_states->interp(interp_method, img_vol, bspline_coefs);
 
-    VolInterpType::Pointer vol_interp;
+      const RayCastITKInterpCPU interp = { vol_interp.GetPointer() };
+      cast_rays(r, interp);
+    }
+  }
 
-    switch (interp_method)
+  /// \brief Executes a collection of rays cast using the direct nearest
+  ///        neighbor or linear interpolators on a bricked volume.
+  void operator()(const RangeType& r, const RayCastBrickedVol& bricked_vol) const
+  {
+    const RayCastBrickedVolBufCPU vol_buf = MakeRayCastVolBufCPU(bricked_vol);
+
+    if (interp_method == RayCaster::kRAY_CAST_INTERP_NN)
     {
-      case RayCaster::kRAY_CAST_INTERP_NN:
-        vol_interp = VolNNInterpType::New();
-        break;
-      case RayCaster::kRAY_CAST_INTERP_SINC:
-        vol_interp = VolSincInterpType::New();
-        break;
-      case RayCaster::kRAY_CAST_INTERP_BSPLINE:
-      {
-        auto bspline_interp = VolBSplineInterpType::New();
-        bspline_interp->SetSplineOrder(3);
-        vol_interp = bspline_interp;
-      }
-        break;
-      case RayCaster::kRAY_CAST_INTERP_LINEAR:
-      default:
-        vol_interp = VolLinearInterpType::New();
-        break;
+      const RayCastVolNNInterpCPU<RayCastBrickedVolBufCPU> interp = { vol_buf };
+      cast_rays(r, interp);
     }
+    else
+    {
+      xregASSERT(interp_method == RayCaster::kRAY_CAST_INTERP_LINEAR);
 
-    vol_interp->SetInputImage(img_vol);
-  
+      const RayCastVolLinearInterpCPU<RayCastBrickedVolBufCPU> interp = { vol_buf };
+      cast_rays(r, interp);
+    }
+  }
+
+  /// \brief Casts a collection of rays using an interpolation functor that
+  ///        takes the continuous index as three scalars.
+  template <class tInterp>
+  void cast_rays(const RangeType& r, const tInterp& vol_interp) const
+  {
     const size_type num_drr_px = camera_models[0].num_det_rows *
                                               camera_models[0].num_det_cols;
     
@@ -166,25 +180,57 @@ struct RayCastDepthFn
         // Rotate and scale the step vector to get it wrt ITK indices
         const CoordScalar step_len_wrt_itk_idx = (xform_cam_to_itk_idx.matrix().block(0,0,3,3) * ((cur_det_pt_wrt_cam - cam.pinhole_pt).normalized() * step_size)).norm();
 
-        const size_type num_steps = static_cast<size_type>(intersect_len_wrt_itk_idx / step_len_wrt_itk_idx);
+        std::int64_t num_steps = static_cast<std::int64_t>(intersect_len_wrt_itk_idx / step_len_wrt_itk_idx);
+
+        // Each step advances step_size along the ray in the camera frame, so a
+        // collision beyond the depth already stored for this pixel (e.g. from
+        // another volume) cannot change it. The extra step accounts for the
+        // backtracking.
+        const CoordScalar start_depth = ((xform_itk_idx_to_cam * start_pt_wrt_itk_idx) - cam.pinhole_pt).norm();
 
-        // We'll use the ITK objects now, since that is the easiest interface with itk::Image and itk interpolation
-        itk::ContinuousIndex<CoordScalar,3> cur_cont_vol_idx;
-        cur_cont_vol_idx[0] = start_pt_wrt_itk_idx[0];
-        cur_cont_vol_idx[1] = start_pt_wrt_itk_idx[1];
-        cur_cont_vol_idx[2] = start_pt_wrt_itk_idx[2];
+        const CoordScalar num_steps_to_cur_depth = (static_cast<CoordScalar>(proj_buf[range_idx]) - start_depth) / step_size;
+
+        if (num_steps_to_cur_depth < static_cast<CoordScalar>(num_steps))
+        {
+          num_steps = static_cast<std::int64_t>(std::floor(num_steps_to_cur_depth)) + 1;
+        }
+
+        Pt3 cur_cont_vol_idx = start_pt_wrt_itk_idx;
 
         const CoordScalar scale_to_step = step_len_wrt_itk_idx / pinhole_to_det_len_wrt_itk_idx;
-        itk::Vector<CoordScalar,3> tmp_step_vec_wrt_itk_idx;
-        tmp_step_vec_wrt_itk_idx[0] = pinhole_to_det_wrt_itk_idx[0] * scale_to_step;
-        tmp_step_vec_wrt_itk_idx[1] = pinhole_to_det_wrt_itk_idx[1] * scale_to_step;
-        tmp_step_vec_wrt_itk_idx[2] = pinhole_to_det_wrt_itk_idx[2] * scale_to_step;
+
+        const Pt3 step_vec_wrt_itk_idx = pinhole_to_det_wrt_itk_idx * scale_to_step;
+
+        Pt3 tmp_step_vec_wrt_itk_idx = step_vec_wrt_itk_idx;
 
         PixelScalar3D cur_vol_val = 0;
 
-        for (size_type step_idx = 0; step_idx <= num_steps; ++step_idx)
+        for (std::int64_t step_idx = 0; step_idx <= num_steps; ++step_idx)
         {
-          cur_vol_val = vol_interp->EvaluateAtContinuousIndex(cur_cont_vol_idx);
+          if (brick_grid)
+          {
+            // jump over bricks that are entirely below the collision threshold
+            const RayCastBrickIsBelowThresh below_thresh = { *brick_grid, collision_thresh };
+
+            const std::int64_t next_step_idx = RayCastSkipBricks(*brick_grid, below_thresh,
+                                                                 start_pt_wrt_itk_idx,
+                                                                 step_vec_wrt_itk_idx,
+                                                                 step_idx, num_steps);
+
+            if (next_step_idx > num_steps)
+            {
+              break;
+            }
+            else if (next_step_idx != step_idx)
+            {
+              step_idx = next_step_idx;
+
+              cur_cont_vol_idx = start_pt_wrt_itk_idx +
+                                   (static_cast<CoordScalar>(step_idx) * step_vec_wrt_itk_idx);
+            }
+          }
+
+          cur_vol_val = vol_interp(cur_cont_vol_idx[0], cur_cont_vol_idx[1], cur_cont_vol_idx[2]);
           if (cur_vol_val >= collision_thresh)
           {
             // perform some binary search/back-tracking
@@ -194,23 +240,18 @@ struct RayCastDepthFn
                  sur_bin_step_idx < num_backtracking_steps;
                  ++sur_bin_step_idx)
             {
-              tmp_step_vec_wrt_itk_idx *= 0.5;
+              tmp_step_vec_wrt_itk_idx *= CoordScalar(0.5);
               cur_cont_vol_idx -=
                 (cur_vol_val >= collision_thresh) ?
                                 tmp_step_vec_wrt_itk_idx : -tmp_step_vec_wrt_itk_idx;
 
-              cur_vol_val = vol_interp->EvaluateAtContinuousIndex(cur_cont_vol_idx);
+              cur_vol_val = vol_interp(cur_cont_vol_idx[0], cur_cont_vol_idx[1], cur_cont_vol_idx[2]);
             }
             // end backtracking
 
             // compute depth in the camera frame
-            Pt3 tmp_vol_idx;
-            tmp_vol_idx[0] = cur_cont_vol_idx[0];
-            tmp_vol_idx[1] = cur_cont_vol_idx[1];
-            tmp_vol_idx[2] = cur_cont_vol_idx[2];
-
             proj_buf[range_idx] = std::min(proj_buf[range_idx],
-                                     static_cast<PixelScalar2D>(((xform_itk_idx_to_cam * tmp_vol_idx) - cam.pinhole_pt).norm()));
+                                     static_cast<PixelScalar2D>(((xform_itk_idx_to_cam * cur_cont_vol_idx) - cam.pinhole_pt).norm()));
 
             break;
           }  // end if (cur_vol_val >= collision_thresh)
@@ -219,7 +260,6 @@ struct RayCastDepthFn
         }  // for step
       }  // if RayRectIntersect
     }  // for range_idx
-
   }
 };
 
@@ -234,6 +274,8 @@ xreg::RayCasterDepthCPU::RayCasterDepthCPU()
 void xreg::RayCasterDepthCPU::compute(const size_type vol_idx)
 {
   xregASSERT(this->resources_allocated_);
+
+  ParallelExecContextScope exec_scope(this->exec_ctx_.get());
   
   // Get the index bounding box (axis-aligned in the index space) of the volume
   Pt3 img_aabb_min;
@@ -247,6 +289,29 @@ void xreg::RayCasterDepthCPU::compute(const size_type vol_idx)
 
   this->pre_compute();
 
+  const RayCastVolBrickGrid* brick_grid = nullptr;
+
+  if (this->use_empty_space_skipping_)
+  {
+    brick_grid = &this->vol_brick_grids_[vol_idx];
+
+    // When empty voxels are always below the collision threshold, the rays
+    // can be clipped to the non-empty voxels
+    if (this->render_thresh() > this->empty_space_thresh_)
+    {
+      if (brick_grid->any_non_empty)
+      {
+        img_aabb_min = brick_grid->non_empty_idx_min;
+        img_aabb_max = brick_grid->non_empty_idx_max;
+      }
+      else
+      {
+        // make the bounds degenerate so that no intersections are found
+        img_aabb_max = img_aabb_min;
+      }
+    }
+  }
+
   RayCastDepthFn ray_cast_fn = { this->vols_[vol_idx],
                                  img_aabb_min,
                                  img_aabb_max,
@@ -257,14 +322,34 @@ void xreg::RayCasterDepthCPU::compute(const size_type vol_idx)
                                  this->cam_model_for_proj_,
                                  this->ray_step_size_,
                                  this->interp_method_,
+                                 this->bspline_coefs(vol_idx),
+                                 &this->thread_state_pool_,
                                  this->pixel_buf_to_use(),
                                  this->render_thresh(),
-                                 this->num_backtracking_steps()
+                                 this->num_backtracking_steps(),
+                                 brick_grid
                                };
 
+  const RangeType full_range(0, this->num_projs_ *
+        this->camera_models_[0].num_det_rows * this->camera_models_[0].num_det_cols);
+
   // For every single projection pixel
-  ParallelFor(ray_cast_fn, RangeType(0, this->num_projs_ *
-        this->camera_models_[0].num_det_rows * this->camera_models_[0].num_det_cols));
+  if (this->use_bricked_vol_layout_ &&
+      ((this->interp_method_ == kRAY_CAST_INTERP_LINEAR) || (this->interp_method_ == kRAY_CAST_INTERP_NN)))
+  {
+    const RayCastBrickedVol& bricked_vol = this->bricked_vols_[vol_idx];
+
+    auto bricked_ray_cast_fn = [&ray_cast_fn, &bricked_vol] (const RangeType& r)
+    {
+      ray_cast_fn(r, bricked_vol);
+    };
+
+    ParallelFor(bricked_ray_cast_fn, full_range);
+  }
+  else
+  {
+    ParallelFor(ray_cast_fn, full_range);
+  }
 
   this->sync_to_ocl_.set_modified();
   this->sync_to_host_.set_modified();
@@ -31,6 +31,7 @@
 #include "xregExceptionUtils.h"
 #include "xregITKBasicImageUtils.h"
 #include "xregOpenCLConvert.h"
+#include "xregOpenCLProgCache.h"
 
 namespace bc = boost::compute;
 
@@ -126,7 +127,8 @@ __kernel void xregDepthKernel(const RayCastArgs args,
 
     for (ulong step_idx = 0; step_idx <= num_steps; ++step_idx, cur_cont_vol_idx += step_vec_wrt_itk_idx)
     {
-      if (read_imagef(vol_tex, sampler, cur_cont_vol_idx + tex_coords_off).x >= sur_coll_args.sur_coll_thresh)
+      if (xregVolTexVal(read_imagef(vol_tex, sampler, cur_cont_vol_idx + tex_coords_off),
+                        args.vol_tex_scale, args.vol_tex_offset).x >= sur_coll_args.sur_coll_thresh)
       {
         const float3 coll_pt_wrt_cam = xregFrm4x4XformFloat3Pt(xform_itk_idx_to_cam,
                                                                xregFloat4HmgToFloat3(cur_cont_vol_idx));
@@ -183,7 +185,7 @@ void xreg::RayCasterDepthOCL::compute(const size_type vol_idx)
   
   dev_kernel_.set_arg(1, sizeof(coll_args), &coll_args);
 
-  dev_kernel_.set_arg(2, det_pts_dev_);
+  dev_kernel_.set_arg(2, *det_pts_dev_);
 
   dev_kernel_.set_arg(3, vol_texs_dev_[vol_idx]);
 
@@ -197,12 +199,7 @@ void xreg::RayCasterDepthOCL::compute(const size_type vol_idx)
 
   std::size_t global_work_size = ray_cast_kernel_args_.num_det_pts * this->num_projs_;
 
-  cmd_queue_.enqueue_nd_range_kernel(dev_kernel_,
-                                     1, // dim
-                                     0, // null offset -> start at 0
-                                     &global_work_size,
-                                     0  // passing null lets open CL pick a local size
-                                    ).wait();
+  launch_ray_cast_kernel(dev_kernel_, "xregDepthKernel", 5, global_work_size);
 
   compute_helper_post_kernels(vol_idx);
 }
@@ -222,18 +219,7 @@ void xreg::RayCasterDepthOCL::allocate_resources()
      << bc::type_definition<SurCollArgs>()
      << kRAY_CASTING_DEPTH_OPENCL_SRC;
 
-  bc::program prog = bc::program::create_with_source(ss.str(), ctx_);
-
-  try
-  {
-    prog.build();
-  }
-  catch (bc::opencl_error &)
-  {
-    std::cerr << "OpenCL Kernel Compile Error (RayCasterDepthOCL):\n"
-              << prog.build_log() << std::endl;
-    throw;
-  }
+  bc::program prog = BuildOpenCLProg(ss.str(), ctx_);
 
   dev_kernel_ = prog.create_kernel("xregDepthKernel");
 }
@@ -0,0 +1,365 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregRayCastEmptySpace.h"
+
+#include <cmath>
+#include <limits>
+
+#include "xregAssert.h"
+#include "xregTBBUtils.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+std::int32_t ClampBrickIdx(const std::int32_t i, const std::int32_t n)
+{
+  return (i < 0) ? 0 : ((i >= n) ? (n - 1) : i);
+}
+
+}  // un-named
+
+std::int64_t xreg::RayCastVolBrickGrid::brick_idx(const CoordScalar x,
+                                                  const CoordScalar y,
+                                                  const CoordScalar z) const
+{
+  const std::int32_t bx = ClampBrickIdx(static_cast<std::int32_t>(std::floor(x)) / brick_dim, num_bricks_x);
+  const std::int32_t by = ClampBrickIdx(static_cast<std::int32_t>(std::floor(y)) / brick_dim, num_bricks_y);
+  const std::int32_t bz = ClampBrickIdx(static_cast<std::int32_t>(std::floor(z)) / brick_dim, num_bricks_z);
+
+  return bx + (num_bricks_x * (by + (static_cast<std::int64_t>(num_bricks_y) * bz)));
+}
+
+xreg::RayCastVolBrickGrid
+xreg::ComputeRayCastVolBrickGrid(const RayCastVolBrickGrid::Vol* vol,
+                                 const size_type brick_dim,
+                                 const RayCastPixelScalar empty_thresh)
+{
+  using PixelScalar = RayCastVolBrickGrid::PixelScalar;
+
+  xregASSERT(brick_dim > 0);
+
+  const auto vol_size = vol->GetLargestPossibleRegion().GetSize();
+
+  const std::int32_t size_x = static_cast<std::int32_t>(vol_size[0]);
+  const std::int32_t size_y = static_cast<std::int32_t>(vol_size[1]);
+  const std::int32_t size_z = static_cast<std::int32_t>(vol_size[2]);
+
+  const std::int64_t stride_y = size_x;
+  const std::int64_t stride_z = stride_y * size_y;
+
+  const std::int32_t bd = static_cast<std::int32_t>(brick_dim);
+
+  RayCastVolBrickGrid grid;
+
+  grid.brick_dim = bd;
+
+  grid.num_bricks_x = (size_x + bd - 1) / bd;
+  grid.num_bricks_y = (size_y + bd - 1) / bd;
+  grid.num_bricks_z = (size_z + bd - 1) / bd;
+
+  const std::int64_t num_bricks = grid.num_bricks();
+
+  grid.brick_min.resize(num_bricks);
+  grid.brick_max.resize(num_bricks);
+  grid.brick_empty.resize(num_bricks);
+
+  // bounds of the non-empty voxels within each brick (excluding the overlap
+  // with the next brick), these are combined in serial after the parallel
+  // brick computations.
+  std::vector<std::int32_t> brick_non_empty_bounds(num_bricks * 6);
+
+  const PixelScalar* vol_buf = vol->GetBufferPointer();
+
+  auto brick_fn = [&] (const RangeType& r)
+  {
+    for (size_type brick_idx = r.begin(); brick_idx < r.end(); ++brick_idx)
+    {
+      const std::int32_t bz = static_cast<std::int32_t>(brick_idx / (grid.num_bricks_x * grid.num_bricks_y));
+      const std::int32_t by = static_cast<std::int32_t>((brick_idx / grid.num_bricks_x) % grid.num_bricks_y);
+      const std::int32_t bx = static_cast<std::int32_t>(brick_idx % grid.num_bricks_x);
+
+      const std::int32_t start_x = bx * bd;
+      const std::int32_t start_y = by * bd;
+      const std::int32_t start_z = bz * bd;
+
+      // inclusive of one voxel from the next brick
+      const std::int32_t stop_x = std::min(start_x + bd, size_x - 1);
+      const std::int32_t stop_y = std::min(start_y + bd, size_y - 1);
+      const std::int32_t stop_z = std::min(start_z + bd, size_z - 1);
+
+      PixelScalar min_val = std::numeric_limits<PixelScalar>::max();
+      PixelScalar max_val = std::numeric_limits<PixelScalar>::lowest();
+
+      std::int32_t* non_empty_bounds = &brick_non_empty_bounds[brick_idx * 6];
+
+      non_empty_bounds[0] = size_x;
+      non_empty_bounds[1] = size_y;
+      non_empty_bounds[2] = size_z;
+      non_empty_bounds[3] = -1;
+      non_empty_bounds[4] = -1;
+      non_empty_bounds[5] = -1;
+
+      for (std::int32_t z = start_z; z <= stop_z; ++z)
+      {
+        for (std::int32_t y = start_y; y <= stop_y; ++y)
+        {
+          const PixelScalar* row_buf = vol_buf + (y * stride_y) + (z * stride_z);
+          
+          for (std::int32_t x = start_x; x <= stop_x; ++x)
+          {
+            const PixelScalar v = row_buf[x];
+
+            min_val = std::min(min_val, v);
+            max_val = std::max(max_val, v);
+
+            if ((std::abs(v) > empty_thresh) &&
+                (x < (start_x + bd)) && (y < (start_y + bd)) && (z < (start_z + bd)))
+            {
+              non_empty_bounds[0] = std::min(non_empty_bounds[0], x);
+              non_empty_bounds[1] = std::min(non_empty_bounds[1], y);
+              non_empty_bounds[2] = std::min(non_empty_bounds[2], z);
+              non_empty_bounds[3] = std::max(non_empty_bounds[3], x);
+              non_empty_bounds[4] = std::max(non_empty_bounds[4], y);
+              non_empty_bounds[5] = std::max(non_empty_bounds[5], z);
+            }
+          }
+        }
+      }
+
+      grid.brick_min[brick_idx] = min_val;
+      grid.brick_max[brick_idx] = max_val;
+
+      grid.brick_empty[brick_idx] = ((max_val <= empty_thresh) && (min_val >= -empty_thresh)) ? 1 : 0;
+    }
+  };
+
+  ParallelFor(brick_fn, RangeType(0, num_bricks));
+
+  std::int32_t non_empty_bounds[6] = { size_x, size_y, size_z, -1, -1, -1 };
+
+  grid.max_val = std::numeric_limits<PixelScalar>::lowest();
+
+  for (std::int64_t brick_idx = 0; brick_idx < num_bricks; ++brick_idx)
+  {
+    grid.max_val = std::max(grid.max_val, grid.brick_max[brick_idx]);
+
+    const std::int32_t* b = &brick_non_empty_bounds[brick_idx * 6];
+
+    for (int i = 0; i < 3; ++i)
+    {
+      non_empty_bounds[i]     = std::min(non_empty_bounds[i], b[i]);
+      non_empty_bounds[i + 3] = std::max(non_empty_bounds[i + 3], b[i + 3]);
+    }
+  }
+
+  grid.any_non_empty = non_empty_bounds[3] >= 0;
+
+  if (grid.any_non_empty)
+  {
+    const std::int32_t max_inds[3] = { size_x - 1, size_y - 1, size_z - 1 };
+
+    for (int i = 0; i < 3; ++i)
+    {
+      grid.non_empty_idx_min[i] = std::max(non_empty_bounds[i] - 1, 0);
+      grid.non_empty_idx_max[i] = std::min(non_empty_bounds[i + 3] + 1, max_inds[i]);
+    }
+  }
+  else
+  {
+    grid.non_empty_idx_min.setZero();
+    grid.non_empty_idx_max.setZero();
+  }
+
+  return grid;
+}
+
+std::int64_t xreg::RayCastNumStepsToExitBrick(const RayCastVolBrickGrid& grid,
+                                              const Pt3& start_pt,
+                                              const Pt3& step_vec,
+                                              const std::int64_t step_idx)
+{
+  const Pt3 p = start_pt + (static_cast<CoordScalar>(step_idx) * step_vec);
+
+  const CoordScalar bd = static_cast<CoordScalar>(grid.brick_dim);
+
+  // a zero step vector never leaves the brick, so the entire ray may be skipped
+  std::int64_t num_steps = std::numeric_limits<std::int32_t>::max();
+
+  for (int a = 0; a < 3; ++a)
+  {
+    const CoordScalar s = step_vec[a];
+
+    if (s != 0)
+    {
+      const CoordScalar brick_start = std::floor(std::floor(p[a]) / bd) * bd;
+      
+      if (s > 0)
+      {
+        num_steps = std::min(num_steps,
+                             static_cast<std::int64_t>(std::ceil(((brick_start + bd) - p[a]) / s)));
+      }
+      else
+      {
+        num_steps = std::min(num_steps,
+                             static_cast<std::int64_t>(std::floor((brick_start - p[a]) / s)) + 1);
+      }
+    }
+  }
+
+  return std::max(num_steps, std::int64_t(1));
+}
+
+xreg::RayCastVolBrickOctree
+xreg::ComputeRayCastVolBrickOctree(const RayCastVolBrickGrid& grid)
+{
+  using Level       = RayCastVolBrickOctree::Level;
+  using PixelScalar = RayCastVolBrickOctree::PixelScalar;
+
+  xregASSERT(grid.valid());
+
+  RayCastVolBrickOctree tree;
+
+  tree.brick_dim = grid.brick_dim;
+
+  {
+    Level leaves;
+    leaves.num_nodes_x = grid.num_bricks_x;
+    leaves.num_nodes_y = grid.num_bricks_y;
+    leaves.num_nodes_z = grid.num_bricks_z;
+    leaves.node_min    = grid.brick_min;
+    leaves.node_max    = grid.brick_max;
+
+    tree.levels.push_back(std::move(leaves));
+  }
+
+  while ((tree.levels.back().num_nodes_x > 1) || (tree.levels.back().num_nodes_y > 1) ||
+         (tree.levels.back().num_nodes_z > 1))
+  {
+    const Level& children = tree.levels.back();
+
+    Level parents;
+    parents.num_nodes_x = (children.num_nodes_x + 1) / 2;
+    parents.num_nodes_y = (children.num_nodes_y + 1) / 2;
+    parents.num_nodes_z = (children.num_nodes_z + 1) / 2;
+
+    const std::int64_t num_parents = static_cast<std::int64_t>(parents.num_nodes_x) *
+                                        parents.num_nodes_y * parents.num_nodes_z;
+
+    parents.node_min.assign(num_parents, std::numeric_limits<PixelScalar>::max());
+    parents.node_max.assign(num_parents, std::numeric_limits<PixelScalar>::lowest());
+
+    for (std::int32_t z = 0; z < children.num_nodes_z; ++z)
+    {
+      for (std::int32_t y = 0; y < children.num_nodes_y; ++y)
+      {
+        for (std::int32_t x = 0; x < children.num_nodes_x; ++x)
+        {
+          const std::int64_t c = children.node_idx(x, y, z);
+          const std::int64_t p = parents.node_idx(x / 2, y / 2, z / 2);
+
+          parents.node_min[p] = std::min(parents.node_min[p], children.node_min[c]);
+          parents.node_max[p] = std::max(parents.node_max[p], children.node_max[c]);
+        }
+      }
+    }
+
+    tree.levels.push_back(std::move(parents));
+  }
+
+  return tree;
+}
+
+bool xreg::RayCastOctreeNodeStepRange(const RayCastVolBrickOctree& tree,
+                                      const std::size_t level,
+                                      const std::int32_t x, const std::int32_t y, const std::int32_t z,
+                                      const Pt3& start_pt,
+                                      const Pt3& step_vec,
+                                      const std::int64_t min_step_idx,
+                                      const std::int64_t max_step_idx,
+                                      std::int64_t* first_step_idx)
+{
+  // padding of the node bounds, in voxels, to account for round-off
+  constexpr CoordScalar kBOUNDS_TOL = 1.0e-2;
+
+  constexpr CoordScalar kINF = std::numeric_limits<CoordScalar>::infinity();
+
+  const auto& lvl = tree.levels[level];
+
+  const std::int32_t node_inds[3]  = { x, y, z };
+  const std::int32_t num_nodes[3]  = { lvl.num_nodes_x, lvl.num_nodes_y, lvl.num_nodes_z };
+
+  const CoordScalar node_len = static_cast<CoordScalar>(tree.brick_dim) *
+                                  static_cast<CoordScalar>(std::int64_t(1) << level);
+
+  CoordScalar s_min = static_cast<CoordScalar>(min_step_idx);
+  CoordScalar s_max = static_cast<CoordScalar>(max_step_idx);
+
+  for (int a = 0; a < 3; ++a)
+  {
+    // the border nodes extend to infinity, as the brick indices are clamped
+    const CoordScalar lo = node_inds[a] ? ((node_inds[a] * node_len) - kBOUNDS_TOL) : -kINF;
+    const CoordScalar hi = (node_inds[a] < (num_nodes[a] - 1)) ?
+                              (((node_inds[a] + 1) * node_len) + kBOUNDS_TOL) : kINF;
+
+    const CoordScalar p = start_pt[a];
+    const CoordScalar s = step_vec[a];
+
+    if (s != 0)
+    {
+      CoordScalar t0 = (lo - p) / s;
+      CoordScalar t1 = (hi - p) / s;
+
+      if (t0 > t1)
+      {
+        std::swap(t0, t1);
+      }
+
+      s_min = std::max(s_min, t0);
+      s_max = std::min(s_max, t1);
+    }
+    else if ((p < lo) || (p > hi))
+    {
+      return false;
+    }
+  }
+
+  if (s_min > s_max)
+  {
+    return false;
+  }
+
+  const std::int64_t first = static_cast<std::int64_t>(std::ceil(s_min));
+
+  if (first > static_cast<std::int64_t>(std::floor(s_max)))
+  {
+    return false;
+  }
+
+  *first_step_idx = first;
+
+  return true;
+}
@@ -0,0 +1,401 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGRAYCASTEMPTYSPACE_H_
+#define XREGRAYCASTEMPTYSPACE_H_
+
+#include <algorithm>
+#include <cstdint>
+
+#include "xregAssert.h"
+#include "xregCommon.h"
+
+namespace xreg
+{
+
+/// \brief Coarse grid of voxel "bricks" summarizing the intensities of a
+///        ray casting volume, used to skip over empty space.
+///
+/// Brick (i,j,k) corresponds to the continuous indices whose floor lies in
+/// [i*B, (i+1)*B) x [j*B, (j+1)*B) x [k*B, (k+1)*B), where B is the brick
+/// dimension. The minimum and maximum of each brick are computed over the
+/// voxels [i*B, (i+1)*B] (inclusive), so that they also bound any linear or
+/// nearest neighbor interpolation performed within the brick.
+struct RayCastVolBrickGrid
+{
+  using PixelScalar = RayCastPixelScalar;
+  using Vol         = itk::Image<PixelScalar,3>;
+  
+  using PixelScalarList = std::vector<PixelScalar>;
+  using EmptyFlagList   = std::vector<unsigned char>;
+
+  std::int32_t brick_dim = 0;  ///< Side length, in voxels, of each brick
+
+  std::int32_t num_bricks_x = 0;
+  std::int32_t num_bricks_y = 0;
+  std::int32_t num_bricks_z = 0;
+
+  PixelScalarList brick_min;  ///< Minimum intensity of each brick, x varies fastest
+  PixelScalarList brick_max;  ///< Maximum intensity of each brick, x varies fastest
+
+  /// \brief 1 when all voxels of a brick have magnitude less than or equal
+  ///        to the empty threshold, 0 otherwise.
+  EmptyFlagList brick_empty;
+
+  /// \brief The maximum intensity over all bricks (e.g. the entire volume)
+  PixelScalar max_val = 0;
+
+  /// \brief Indicates that at least one voxel is not empty
+  bool any_non_empty = false;
+
+  /// \brief Bounds of the non-empty voxels in index coordinates.
+  ///
+  /// This is padded by one voxel, so that interpolated values outside are
+  /// also empty, and is clamped to the image index bounds.
+  Pt3 non_empty_idx_min;
+  Pt3 non_empty_idx_max;
+
+  bool valid() const
+  {
+    return brick_dim > 0;
+  }
+
+  /// \brief The linear index of the brick containing a continuous index
+  std::int64_t brick_idx(const CoordScalar x, const CoordScalar y, const CoordScalar z) const;
+
+  std::int64_t num_bricks() const
+  {
+    return static_cast<std::int64_t>(num_bricks_x) * num_bricks_y * num_bricks_z;
+  }
+};
+
+using RayCastVolBrickGridList = std::vector<RayCastVolBrickGrid>;
+
+/// \brief Computes the brick grid of a volume.
+///
+/// This is a multi-threaded computation over every voxel of the volume.
+RayCastVolBrickGrid ComputeRayCastVolBrickGrid(const RayCastVolBrickGrid::Vol* vol,
+                                               const size_type brick_dim,
+                                               const RayCastPixelScalar empty_thresh);
+
+/// \brief The number of equally spaced ray samples required to leave the brick
+///        containing the start_pt + step_idx * step_vec.
+///
+/// The returned value is always at least one.
+std::int64_t RayCastNumStepsToExitBrick(const RayCastVolBrickGrid& grid,
+                                        const Pt3& start_pt,
+                                        const Pt3& step_vec,
+                                        const std::int64_t step_idx);
+
+/// \brief Advances a sample index along a ray until it lies in a brick that
+///        may not be skipped.
+///
+/// Samples are at start_pt + step_idx * step_vec and skip_brick is a predicate
+/// on a linear brick index. A value larger than max_step_idx is returned when
+/// the remainder of the ray may be skipped.
+template <class tSkipBrickFn>
+std::int64_t RayCastSkipBricks(const RayCastVolBrickGrid& grid,
+                               const tSkipBrickFn& skip_brick,
+                               const Pt3& start_pt,
+                               const Pt3& step_vec,
+                               std::int64_t step_idx,
+                               const std::int64_t max_step_idx)
+{
+  while (step_idx <= max_step_idx)
+  {
+    const Pt3 p = start_pt + (static_cast<CoordScalar>(step_idx) * step_vec);
+
+    if (!skip_brick(grid.brick_idx(p[0], p[1], p[2])))
+    {
+      break;
+    }
+
+    step_idx += RayCastNumStepsToExitBrick(grid, start_pt, step_vec, step_idx);
+  }
+
+  return step_idx;
+}
+
+/// \brief Predicate indicating when a brick is empty
+struct RayCastBrickIsEmpty
+{
+  const RayCastVolBrickGrid& grid;
+
+  bool operator()(const std::int64_t b) const
+  {
+    return grid.brick_empty[b] != 0;
+  }
+};
+
+/// \brief Predicate indicating when every value in a brick is below a threshold
+struct RayCastBrickIsBelowThresh
+{
+  const RayCastVolBrickGrid& grid;
+
+  const RayCastPixelScalar thresh;
+
+  bool operator()(const std::int64_t b) const
+  {
+    return grid.brick_max[b] < thresh;
+  }
+};
+
+/// \brief Predicate indicating when every value in a brick is at least a threshold
+struct RayCastBrickIsAboveThresh
+{
+  const RayCastVolBrickGrid& grid;
+
+  const RayCastPixelScalar thresh;
+
+  bool operator()(const std::int64_t b) const
+  {
+    return grid.brick_min[b] >= thresh;
+  }
+};
+
+/// \brief Predicate indicating when no value in a brick exceeds a bound
+///
+/// This is used to skip the bricks that cannot increase a running maximum.
+struct RayCastBrickIsAtMost
+{
+  const RayCastVolBrickGrid& grid;
+
+  const RayCastPixelScalar bound;
+
+  bool operator()(const std::int64_t b) const
+  {
+    return grid.brick_max[b] <= bound;
+  }
+};
+
+/// \brief Hierarchy of brick intensity ranges, used to find the bricks that
+///        may not be skipped along a ray in a logarithmic number of steps.
+///
+/// levels[0] contains the bricks of a RayCastVolBrickGrid and each node of
+/// levels[l] summarizes the (up to) 2x2x2 nodes of levels[l-1] with the same
+/// index divided by two. The last level contains a single node covering the
+/// entire volume. Node (i,j,k) of level l covers the bricks
+/// [i*2^l, (i+1)*2^l) x [j*2^l, (j+1)*2^l) x [k*2^l, (k+1)*2^l).
+struct RayCastVolBrickOctree
+{
+  using PixelScalar     = RayCastPixelScalar;
+  using PixelScalarList = std::vector<PixelScalar>;
+
+  /// \brief The nodes at a single depth of the tree
+  struct Level
+  {
+    std::int32_t num_nodes_x = 0;
+    std::int32_t num_nodes_y = 0;
+    std::int32_t num_nodes_z = 0;
+
+    PixelScalarList node_min;  ///< Minimum intensity of each node, x varies fastest
+    PixelScalarList node_max;  ///< Maximum intensity of each node, x varies fastest
+
+    std::int64_t node_idx(const std::int32_t x, const std::int32_t y, const std::int32_t z) const
+    {
+      return x + (num_nodes_x * (y + (static_cast<std::int64_t>(num_nodes_y) * z)));
+    }
+  };
+
+  std::int32_t brick_dim = 0;  ///< Side length, in voxels, of each brick
+
+  std::vector<Level> levels;
+
+  bool valid() const
+  {
+    return brick_dim > 0;
+  }
+};
+
+using RayCastVolBrickOctreeList = std::vector<RayCastVolBrickOctree>;
+
+/// \brief Computes the octree of a brick grid.
+RayCastVolBrickOctree ComputeRayCastVolBrickOctree(const RayCastVolBrickGrid& grid);
+
+/// \brief The maximum number of rays traversing an octree together.
+constexpr size_type kRAY_CAST_OCTREE_MAX_PACKET_SIZE = 4;
+
+/// \brief Computes the range of sample indices along a ray that may lie in an
+///        octree node.
+///
+/// Samples are at start_pt + step_idx * step_vec and only the indices in
+/// [min_step_idx, max_step_idx] are considered. The node bounds are padded
+/// slightly, and nodes on the border of the tree extend to infinity (matching
+/// the clamping of RayCastVolBrickGrid::brick_idx()), so the range never
+/// excludes a sample lying in the node. Returns false when no sample may lie
+/// in the node.
+bool RayCastOctreeNodeStepRange(const RayCastVolBrickOctree& tree,
+                                const std::size_t level,
+                                const std::int32_t x, const std::int32_t y, const std::int32_t z,
+                                const Pt3& start_pt,
+                                const Pt3& step_vec,
+                                const std::int64_t min_step_idx,
+                                const std::int64_t max_step_idx,
+                                std::int64_t* first_step_idx);
+
+/// \brief Advances the sample indices of a packet of rays to the first samples
+///        that may lie in bricks that may not be skipped, by traversing an
+///        octree.
+///
+/// This is the hierarchical equivalent of RayCastSkipBricks(). skip_node is a
+/// predicate on an octree level and linear node index. The rays are traversed
+/// together, so nodes are only visited once for the packet, and each ray is
+/// pruned from a node when it misses the node or has already found a sample
+/// before the node. A value larger than max_step_inds[k] is returned for rays
+/// whose remainder may be skipped.
+///
+/// The returned indices never exceed the indices returned by
+/// RayCastSkipBricks(), but, due to the padding of the nodes, may be a sample
+/// in a brick that could be skipped, so the result should be refined with
+/// RayCastSkipBricks() when the exact index is required.
+template <class tSkipNodeFn>
+void RayCastOctreeSkipBricks(const RayCastVolBrickOctree& tree,
+                             const tSkipNodeFn& skip_node,
+                             const size_type num_rays,
+                             const Pt3* start_pts,
+                             const Pt3* step_vecs,
+                             std::int64_t* step_inds,
+                             const std::int64_t* max_step_inds)
+{
+  xregASSERT(tree.valid() && (num_rays <= kRAY_CAST_OCTREE_MAX_PACKET_SIZE));
+
+  struct Node
+  {
+    std::int32_t level;
+    std::int32_t x;
+    std::int32_t y;
+    std::int32_t z;
+  };
+
+  // each visited node is replaced by at most 8 children on the stack
+  constexpr std::size_t kMAX_STACK_SIZE = (7 * 32) + 1;
+  Node stack[kMAX_STACK_SIZE];
+  std::size_t stack_size = 0;
+
+  std::int64_t best_step_inds[kRAY_CAST_OCTREE_MAX_PACKET_SIZE];
+
+  for (size_type k = 0; k < num_rays; ++k)
+  {
+    best_step_inds[k] = max_step_inds[k] + 1;
+  }
+
+  // visit the children in the order of the first ray's direction, the order
+  // only affects the effectiveness of pruning, not the result
+  const int child_order_mask = (num_rays ? ((step_vecs[0][0] < 0) ? 1 : 0) |
+                                           ((step_vecs[0][1] < 0) ? 2 : 0) |
+                                           ((step_vecs[0][2] < 0) ? 4 : 0) : 0);
+
+  stack[stack_size++] = Node{ static_cast<std::int32_t>(tree.levels.size() - 1), 0, 0, 0 };
+
+  while (stack_size)
+  {
+    const Node n = stack[--stack_size];
+
+    const auto& level = tree.levels[n.level];
+
+    if (skip_node(static_cast<std::size_t>(n.level), level.node_idx(n.x, n.y, n.z)))
+    {
+      continue;
+    }
+
+    bool any_ray_in_node = false;
+
+    for (size_type k = 0; k < num_rays; ++k)
+    {
+      std::int64_t first_step_idx = 0;
+
+      if ((step_inds[k] < best_step_inds[k]) &&
+          RayCastOctreeNodeStepRange(tree, n.level, n.x, n.y, n.z, start_pts[k], step_vecs[k],
+                                     step_inds[k], best_step_inds[k] - 1, &first_step_idx))
+      {
+        any_ray_in_node = true;
+
+        if (!n.level)
+        {
+          best_step_inds[k] = first_step_idx;
+        }
+      }
+    }
+
+    if (any_ray_in_node && n.level)
+    {
+      const auto& child_level = tree.levels[n.level - 1];
+
+      // push in reverse order, so that the first child is visited first
+      for (int c = 7; c >= 0; --c)
+      {
+        const int oc = c ^ child_order_mask;
+
+        const std::int32_t cx = (2 * n.x) + (oc & 1);
+        const std::int32_t cy = (2 * n.y) + ((oc >> 1) & 1);
+        const std::int32_t cz = (2 * n.z) + ((oc >> 2) & 1);
+
+        if ((cx < child_level.num_nodes_x) && (cy < child_level.num_nodes_y) &&
+            (cz < child_level.num_nodes_z))
+        {
+          xregASSERT(stack_size < kMAX_STACK_SIZE);
+
+          stack[stack_size++] = Node{ n.level - 1, cx, cy, cz };
+        }
+      }
+    }
+  }
+
+  for (size_type k = 0; k < num_rays; ++k)
+  {
+    step_inds[k] = best_step_inds[k];
+  }
+}
+
+/// \brief Predicate indicating when every value in an octree node is below a
+///        threshold
+struct RayCastOctreeNodeIsBelowThresh
+{
+  const RayCastVolBrickOctree& tree;
+
+  const RayCastPixelScalar thresh;
+
+  bool operator()(const std::size_t level, const std::int64_t n) const
+  {
+    return tree.levels[level].node_max[n] < thresh;
+  }
+};
+
+/// \brief Predicate indicating when every value in an octree node is at least
+///        a threshold
+struct RayCastOctreeNodeIsAboveThresh
+{
+  const RayCastVolBrickOctree& tree;
+
+  const RayCastPixelScalar thresh;
+
+  bool operator()(const std::size_t level, const std::int64_t n) const
+  {
+    return tree.levels[level].node_min[n] >= thresh;
+  }
+};
+
+}  // xreg
+
+#endif
@@ -0,0 +1,128 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregRayCastGradVol.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "xregTBBUtils.h"
+
+constexpr std::int32_t xreg::RayCastGradVol::kNUM_COMPS;
+
+xreg::RayCastGradVol xreg::MakeRayCastGradVol(const RayCastGradVol::Vol* vol)
+{
+  using PixelScalar = RayCastGradVol::PixelScalar;
+
+  constexpr std::int32_t kNC = RayCastGradVol::kNUM_COMPS;
+
+  const auto vol_size = vol->GetLargestPossibleRegion().GetSize();
+
+  RayCastGradVol gv;
+
+  gv.size_x = static_cast<std::int32_t>(vol_size[0]);
+  gv.size_y = static_cast<std::int32_t>(vol_size[1]);
+  gv.size_z = static_cast<std::int32_t>(vol_size[2]);
+
+  const std::int64_t stride_y = gv.size_x;
+  const std::int64_t stride_z = stride_y * gv.size_y;
+
+  gv.buf.assign(static_cast<size_type>(stride_z * gv.size_z * kNC), PixelScalar(0));
+
+  const PixelScalar* src_buf = vol->GetBufferPointer();
+
+  PixelScalar* dst_buf = gv.buf.data();
+
+  auto grad_fn = [&] (const RangeType& r)
+  {
+    PixelScalar max_mag_sq = 0;
+
+    for (size_type k_idx = r.begin(); k_idx < r.end(); ++k_idx)
+    {
+      const std::int32_t k = static_cast<std::int32_t>(k_idx);
+
+      const std::int32_t k_prev = std::max(k - 1, 0);
+      const std::int32_t k_next = std::min(k + 1, gv.size_z - 1);
+
+      for (std::int32_t j = 0; j < gv.size_y; ++j)
+      {
+        const std::int32_t j_prev = std::max(j - 1, 0);
+        const std::int32_t j_next = std::min(j + 1, gv.size_y - 1);
+
+        const PixelScalar* src_row = src_buf + (j * stride_y) + (k * stride_z);
+
+        const PixelScalar* src_row_prev_y = src_buf + (j_prev * stride_y) + (k * stride_z);
+        const PixelScalar* src_row_next_y = src_buf + (j_next * stride_y) + (k * stride_z);
+
+        const PixelScalar* src_row_prev_z = src_buf + (j * stride_y) + (k_prev * stride_z);
+        const PixelScalar* src_row_next_z = src_buf + (j * stride_y) + (k_next * stride_z);
+
+        PixelScalar* dst_row = dst_buf + gv.offset(0,j,k);
+
+        for (std::int32_t i = 0; i < gv.size_x; ++i)
+        {
+          PixelScalar* g = dst_row + (kNC * i);
+
+          g[0] = src_row[std::min(i + 1, gv.size_x - 1)] - src_row[std::max(i - 1, 0)];
+          g[1] = src_row_next_y[i] - src_row_prev_y[i];
+          g[2] = src_row_next_z[i] - src_row_prev_z[i];
+
+          max_mag_sq = std::max(max_mag_sq, (g[0] * g[0]) + (g[1] * g[1]) + (g[2] * g[2]));
+        }
+      }
+    }
+
+    return max_mag_sq;
+  };
+
+  auto reduce_fn = [&grad_fn] (const RangeType& r, const PixelScalar init)
+  {
+    return std::max(init, grad_fn(r));
+  };
+
+  auto max_fn = [] (const PixelScalar a, const PixelScalar b)
+  {
+    return std::max(a, b);
+  };
+
+  const PixelScalar max_mag_sq = ParallelReduce(PixelScalar(0), reduce_fn, max_fn,
+                                                RangeType(0, gv.size_z));
+
+  if (max_mag_sq > PixelScalar(0))
+  {
+    const PixelScalar scale = PixelScalar(1) / std::sqrt(max_mag_sq);
+
+    auto scale_fn = [&gv,scale] (const RangeType& r)
+    {
+      for (size_type i = r.begin(); i < r.end(); ++i)
+      {
+        gv.buf[i] *= scale;
+      }
+    };
+
+    ParallelFor(scale_fn, RangeType(0, gv.buf.size()));
+  }
+
+  return gv;
+}
@@ -0,0 +1,84 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGRAYCASTGRADVOL_H_
+#define XREGRAYCASTGRADVOL_H_
+
+#include <cstdint>
+
+#include "xregCommon.h"
+
+namespace xreg
+{
+
+/// \brief Precomputed gradients of a ray casting volume, packed with four
+///        components per voxel.
+///
+/// The first three components of each voxel are the central differences of the
+/// volume along the index axes, clamped at the boundaries, and the fourth is
+/// zero padding so that a voxel occupies one aligned 16 byte vector (or an RGBA
+/// texel on the GPU). The gradients are scaled so that the largest magnitude
+/// is one; ray casters only use the direction of the gradient (e.g. surface
+/// normals), and the scaling keeps the values representable with half
+/// precision. Voxels are stored with x varying fastest.
+///
+/// Ray casters estimating surface normals at a hit point fetch an interpolated
+/// gradient from this volume, instead of interpolating the volume six times.
+struct RayCastGradVol
+{
+  using PixelScalar = RayCastPixelScalar;
+  using Vol         = itk::Image<PixelScalar,3>;
+
+  using PixelScalarList = std::vector<PixelScalar>;
+
+  static constexpr std::int32_t kNUM_COMPS = 4;
+
+  PixelScalarList buf;
+
+  std::int32_t size_x = 0;
+  std::int32_t size_y = 0;
+  std::int32_t size_z = 0;
+
+  bool valid() const
+  {
+    return !buf.empty();
+  }
+
+  /// \brief Offset into the buffer of the first component of a voxel.
+  std::int64_t offset(const std::int32_t i, const std::int32_t j, const std::int32_t k) const
+  {
+    return kNUM_COMPS * (i + (size_x * (j + (static_cast<std::int64_t>(size_y) * k))));
+  }
+};
+
+using RayCastGradVolList = std::vector<RayCastGradVol>;
+
+/// \brief Computes the packed gradient volume of a volume.
+///
+/// This is multi-threaded over the slices of the volume.
+RayCastGradVol MakeRayCastGradVol(const RayCastGradVol::Vol* vol);
+
+}  // xreg
+
+#endif
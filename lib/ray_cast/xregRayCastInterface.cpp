@@ -24,13 +24,45 @@
 
 #include "xregRayCastInterface.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <random>
+
+#include <itkBSplineDecompositionImageFilter.h>
+
 #include "xregAssert.h"
 #include "xregTBBUtils.h"
+#include "xregITKBasicImageUtils.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+/// \brief Maps a 32-bit integer to [0,1).
+///
+/// Only the upper 24 bits are used, so that single precision values are never
+/// rounded up to one.
+CoordScalar UInt32ToUnitInterval(const std::uint32_t x)
+{
+  return static_cast<CoordScalar>(x >> 8) / CoordScalar(16777216);
+}
+
+}  // un-named
 
 void xreg::RayCaster::set_volume(VolPtr img_vol)
 {
   vols_ = { img_vol };
 
+  update_vol_brick_grids();
+
+  update_bricked_vols();
+
+  update_grad_vols();
+
+  bspline_coef_vols_.assign(vols_.size(), nullptr);
+
   vols_changed();
 }
 
@@ -38,6 +70,14 @@ void xreg::RayCaster::set_volumes(const VolList& vols)
 {
   vols_ = vols;
   
+  update_vol_brick_grids();
+
+  update_bricked_vols();
+
+  update_grad_vols();
+
+  bspline_coef_vols_.assign(vols_.size(), nullptr);
+
   vols_changed();
 }
 
@@ -54,13 +94,24 @@ xreg::size_type xreg::RayCaster::num_camera_models() const
 void xreg::RayCaster::set_camera_models(const CameraModelList& camera_models)
 {
   camera_models_ = camera_models;
+
+  // new camera models compute every pixel
+  active_pixels_for_each_cam_.resize(camera_models_.size());
+  cam_has_active_pixels_.resize(camera_models_.size(), false);
+
   camera_models_changed();
+  active_pixels_changed();
 }
 
 void xreg::RayCaster::set_camera_model(const CameraModel& camera_model)
 {
   camera_models_ = { camera_model };
+
+  active_pixels_for_each_cam_.resize(1);
+  cam_has_active_pixels_.resize(1, false);
+
   camera_models_changed();
+  active_pixels_changed();
 }
 
 const xreg::RayCaster::CameraModelList&
@@ -173,6 +224,11 @@ void xreg::RayCaster::use_bspline_interp()
   interp_method_ = kRAY_CAST_INTERP_BSPLINE;
 }
 
+void xreg::RayCaster::use_siddon_interp()
+{
+  interp_method_ = kRAY_CAST_INTERP_SIDDON;
+}
+
 void xreg::RayCaster::set_xforms_cam_to_itk_phys(const FrameTransformList& xforms)
 {
   set_num_projs(xforms.size());
@@ -276,6 +332,42 @@ void xreg::RayCaster::allocate_resources()
   resources_allocated_ = true;
 }
 
+void xreg::RayCaster::prebuild_progs()
+{ }
+
+void xreg::RayCaster::compute_multi_vols(const std::vector<size_type>& vol_inds,
+                                         const std::vector<FrameTransformList>& xforms_cam_to_itk_phys_for_each_vol)
+{
+  const size_type num_vols_to_comp = vol_inds.size();
+
+  xregASSERT(num_vols_to_comp == xforms_cam_to_itk_phys_for_each_vol.size());
+
+  const ProjPixelStoreMethod orig_store_meth = proj_store_meth_;
+  const bool orig_use_bg_projs = use_bg_projs_;
+
+  const FrameTransformList orig_xforms = xforms_cam_to_itk_phys_;
+
+  for (size_type i = 0; i < num_vols_to_comp; ++i)
+  {
+    xregASSERT(xforms_cam_to_itk_phys_for_each_vol[i].size() == num_projs_);
+
+    xforms_cam_to_itk_phys_ = xforms_cam_to_itk_phys_for_each_vol[i];
+
+    compute(vol_inds[i]);
+
+    if (!i)
+    {
+      // the remaining volumes are added to the first volume's projections
+      proj_store_meth_ = kRAY_CAST_PIXEL_ACCUM;
+      use_bg_projs_    = false;
+    }
+  }
+
+  proj_store_meth_        = orig_store_meth;
+  use_bg_projs_           = orig_use_bg_projs;
+  xforms_cam_to_itk_phys_ = orig_xforms;
+}
+
 void xreg::RayCaster::set_proj_store_method(const ProjPixelStoreMethod m)
 {
   proj_store_meth_ = m;
@@ -296,6 +388,63 @@ void xreg::RayCaster::use_proj_store_accum_method()
   proj_store_meth_ = kRAY_CAST_PIXEL_ACCUM;
 }
   
+xreg::RayCaster::PixelScalar2D*
+xreg::RayCaster::host_proj_pixels(const size_type proj_idx)
+{
+  xregASSERT(proj_idx < num_projs_);
+
+  return raw_host_pixel_buf() +
+            (camera_models_[0].num_det_rows * camera_models_[0].num_det_cols * proj_idx);
+}
+
+cv::Mat xreg::RayCaster::proj_ocv_view(const size_type proj_idx)
+{
+  const auto& cam = camera_models_[cam_model_for_proj_[proj_idx]];
+
+  return cv::Mat(cam.num_det_rows, cam.num_det_cols, cv::DataType<PixelScalar2D>::type,
+                 host_proj_pixels(proj_idx));
+}
+
+void xreg::RayCaster::proj_view(const size_type proj_idx, Proj* img)
+{
+  const auto& cam = camera_models_[cam_model_for_proj_[proj_idx]];
+
+  const size_type det_num_rows = cam.num_det_rows;
+  const size_type det_num_cols = cam.num_det_cols;
+
+  img->GetPixelContainer()->SetImportPointer(host_proj_pixels(proj_idx),
+                                             det_num_rows * det_num_cols, false);
+
+  const auto cur_size = img->GetLargestPossibleRegion().GetSize();
+
+  if ((cur_size[0] != det_num_cols) || (cur_size[1] != det_num_rows))
+  {
+    Proj::RegionType proj_region;
+    proj_region.SetIndex(0, 0);
+    proj_region.SetIndex(1, 0);
+    proj_region.SetSize(0, det_num_cols);
+    proj_region.SetSize(1, det_num_rows);
+
+    img->SetRegions(proj_region);
+  }
+
+  const CoordScalar spacings[2] = { cam.det_col_spacing, cam.det_row_spacing };
+  img->SetSpacing(spacings);
+
+  img->Modified();
+}
+
+xreg::RayCaster::ProjPtr xreg::RayCaster::make_proj_view(const size_type proj_idx)
+{
+  auto img = Proj::New();
+
+  img->SetPixelContainer(Proj::PixelContainer::New());
+
+  proj_view(proj_idx, img.GetPointer());
+
+  return img;
+}
+
 xreg::RayCastSyncOCLBuf* xreg::RayCaster::to_ocl_buf()
 {
   throw UnsupportedOperationException();
@@ -339,6 +488,16 @@ xreg::size_type xreg::RayCaster::max_num_projs() const
   return max_num_projs_;
 }
 
+void xreg::RayCaster::set_reserved_num_pixels(const size_type num_pix)
+{
+  reserved_num_pix_ = num_pix;
+}
+
+xreg::size_type xreg::RayCaster::reserved_num_pixels() const
+{
+  return reserved_num_pix_;
+}
+
 xreg::RayCaster::PixelScalar2D xreg::RayCaster::default_bg_pixel_val() const
 {
   return default_bg_pixel_val_;
@@ -348,6 +507,456 @@ void xreg::RayCaster::set_default_bg_pixel_val(const PixelScalar2D bg_val)
 {
   default_bg_pixel_val_ = bg_val;
 }
+
+void xreg::RayCaster::set_use_empty_space_skipping(const bool use_skip)
+{
+  if (use_skip != use_empty_space_skipping_)
+  {
+    use_empty_space_skipping_ = use_skip;
+
+    if (!vols_.empty())
+    {
+      update_vol_brick_grids();
+    
+      vols_changed();
+    }
+  }
+}
+
+bool xreg::RayCaster::use_empty_space_skipping() const
+{
+  return use_empty_space_skipping_;
+}
+
+void xreg::RayCaster::set_empty_space_brick_dim(const size_type brick_dim)
+{
+  xregASSERT(brick_dim > 0);
+
+  if (brick_dim != empty_space_brick_dim_)
+  {
+    empty_space_brick_dim_ = brick_dim;
+
+    if (use_empty_space_skipping_ && !vols_.empty())
+    {
+      update_vol_brick_grids();
+    
+      vols_changed();
+    }
+  }
+}
+
+xreg::size_type xreg::RayCaster::empty_space_brick_dim() const
+{
+  return empty_space_brick_dim_;
+}
+
+void xreg::RayCaster::set_empty_space_thresh(const PixelScalar3D thresh)
+{
+  if (thresh != empty_space_thresh_)
+  {
+    empty_space_thresh_ = thresh;
+
+    if (use_empty_space_skipping_ && !vols_.empty())
+    {
+      update_vol_brick_grids();
+    
+      vols_changed();
+    }
+  }
+}
+
+xreg::RayCaster::PixelScalar3D xreg::RayCaster::empty_space_thresh() const
+{
+  return empty_space_thresh_;
+}
+
+const xreg::RayCastVolBrickGrid&
+xreg::RayCaster::vol_brick_grid(const size_type vol_idx) const
+{
+  static const RayCastVolBrickGrid kINVALID_GRID;
+
+  return (vol_idx < vol_brick_grids_.size()) ? vol_brick_grids_[vol_idx] : kINVALID_GRID;
+}
+
+void xreg::RayCaster::update_vol_brick_grids()
+{
+  vol_brick_grids_.clear();
+
+  if (use_empty_space_skipping_)
+  {
+    const size_type nv = vols_.size();
+
+    vol_brick_grids_.reserve(nv);
+
+    for (size_type vol_idx = 0; vol_idx < nv; ++vol_idx)
+    {
+      vol_brick_grids_.push_back(ComputeRayCastVolBrickGrid(vols_[vol_idx].GetPointer(),
+                                                            empty_space_brick_dim_,
+                                                            empty_space_thresh_));
+    }
+  }
+}
+
+void xreg::RayCaster::set_use_bricked_vol_layout(const bool use_bricked)
+{
+  if (use_bricked != use_bricked_vol_layout_)
+  {
+    use_bricked_vol_layout_ = use_bricked;
+
+    update_bricked_vols();
+  }
+}
+
+bool xreg::RayCaster::use_bricked_vol_layout() const
+{
+  return use_bricked_vol_layout_;
+}
+
+void xreg::RayCaster::set_use_huge_pages(const bool use_huge_pages)
+{
+  use_huge_pages_ = use_huge_pages;
+}
+
+bool xreg::RayCaster::use_huge_pages() const
+{
+  return use_huge_pages_;
+}
+
+const xreg::RayCastBrickedVol& xreg::RayCaster::bricked_vol(const size_type vol_idx) const
+{
+  static const RayCastBrickedVol kINVALID_VOL;
+
+  return (vol_idx < bricked_vols_.size()) ? bricked_vols_[vol_idx] : kINVALID_VOL;
+}
+
+void xreg::RayCaster::set_use_precomputed_grad_vols(const bool use_grad_vols)
+{
+  if (use_grad_vols != use_precomputed_grad_vols_)
+  {
+    use_precomputed_grad_vols_ = use_grad_vols;
+
+    update_grad_vols();
+
+    if (!vols_.empty())
+    {
+      vols_changed();
+    }
+  }
+}
+
+bool xreg::RayCaster::use_precomputed_grad_vols() const
+{
+  return use_precomputed_grad_vols_;
+}
+
+const xreg::RayCastGradVol& xreg::RayCaster::grad_vol(const size_type vol_idx) const
+{
+  static const RayCastGradVol kINVALID_VOL;
+
+  return (vol_idx < grad_vols_.size()) ? grad_vols_[vol_idx] : kINVALID_VOL;
+}
+
+void xreg::RayCaster::set_use_proj_bbox_windows(const bool use_windows)
+{
+  use_proj_bbox_windows_ = use_windows;
+}
+
+bool xreg::RayCaster::use_proj_bbox_windows() const
+{
+  return use_proj_bbox_windows_;
+}
+
+void xreg::RayCaster::set_active_pixels(const size_type cam_idx, const PixelIndexList& pix_inds)
+{
+  xregASSERT(cam_idx < camera_models_.size());
+
+  active_pixels_for_each_cam_[cam_idx] = pix_inds;
+  cam_has_active_pixels_[cam_idx] = true;
+
+  active_pixels_changed();
+}
+
+void xreg::RayCaster::set_active_pixels_from_mask(const size_type cam_idx, const cv::Mat& mask)
+{
+  xregASSERT(cam_idx < camera_models_.size());
+  xregASSERT(mask.type() == CV_8UC1);
+  xregASSERT((static_cast<size_type>(mask.rows) == camera_models_[cam_idx].num_det_rows) &&
+             (static_cast<size_type>(mask.cols) == camera_models_[cam_idx].num_det_cols));
+
+  PixelIndexList& pix_inds = active_pixels_for_each_cam_[cam_idx];
+  pix_inds.clear();
+
+  const size_type num_cols = mask.cols;
+
+  for (int r = 0; r < mask.rows; ++r)
+  {
+    const unsigned char* mask_row = mask.ptr<unsigned char>(r);
+
+    for (int c = 0; c < mask.cols; ++c)
+    {
+      if (mask_row[c])
+      {
+        pix_inds.push_back((r * num_cols) + c);
+      }
+    }
+  }
+
+  cam_has_active_pixels_[cam_idx] = true;
+
+  active_pixels_changed();
+}
+
+void xreg::RayCaster::clear_active_pixels(const size_type cam_idx)
+{
+  xregASSERT(cam_idx < camera_models_.size());
+
+  if (cam_has_active_pixels_[cam_idx])
+  {
+    active_pixels_for_each_cam_[cam_idx].clear();
+    cam_has_active_pixels_[cam_idx] = false;
+
+    active_pixels_changed();
+  }
+}
+
+void xreg::RayCaster::clear_active_pixels()
+{
+  if (use_active_pixels())
+  {
+    for (auto& pix_inds : active_pixels_for_each_cam_)
+    {
+      pix_inds.clear();
+    }
+
+    cam_has_active_pixels_.assign(cam_has_active_pixels_.size(), false);
+
+    active_pixels_changed();
+  }
+}
+
+bool xreg::RayCaster::has_active_pixels(const size_type cam_idx) const
+{
+  return (cam_idx < cam_has_active_pixels_.size()) && cam_has_active_pixels_[cam_idx];
+}
+
+bool xreg::RayCaster::use_active_pixels() const
+{
+  return std::find(cam_has_active_pixels_.begin(), cam_has_active_pixels_.end(), true) !=
+                                                              cam_has_active_pixels_.end();
+}
+
+const xreg::RayCaster::PixelIndexList&
+xreg::RayCaster::active_pixels(const size_type cam_idx) const
+{
+  xregASSERT(has_active_pixels(cam_idx));
+
+  return active_pixels_for_each_cam_[cam_idx];
+}
+
+void xreg::RayCaster::set_static_vols(const std::vector<size_type>& vol_inds,
+                                      const FrameTransformList& xforms_cam_to_itk_phys)
+{
+  xregASSERT(vol_inds.size() == xforms_cam_to_itk_phys.size());
+
+  static_vol_inds_ = vol_inds;
+  static_vol_xforms_cam_to_itk_phys_ = xforms_cam_to_itk_phys;
+}
+
+void xreg::RayCaster::clear_static_vols()
+{
+  static_vol_inds_.clear();
+  static_vol_xforms_cam_to_itk_phys_.clear();
+
+  static_vols_cache_ = StaticVolsCache();
+}
+
+const std::vector<xreg::size_type>& xreg::RayCaster::static_vols() const
+{
+  return static_vol_inds_;
+}
+
+void xreg::RayCaster::invalidate_static_vols_bg_projs()
+{
+  static_vols_cache_.valid = false;
+}
+
+void xreg::RayCaster::set_exec_context(std::shared_ptr<ParallelExecContext> ctx)
+{
+  exec_ctx_ = ctx;
+}
+
+std::shared_ptr<xreg::ParallelExecContext> xreg::RayCaster::exec_context() const
+{
+  return exec_ctx_;
+}
+
+bool xreg::RayCaster::static_vols_cache_is_current() const
+{
+  const StaticVolsCache& c = static_vols_cache_;
+
+  bool is_cur = c.valid && (c.vol_inds == static_vol_inds_) &&
+                (c.camera_models == camera_models_) &&
+                (c.ray_step_size == ray_step_size_) &&
+                (c.interp_method == interp_method_) &&
+                (c.projs.size() == camera_models_.size());
+
+  const size_type num_static_vols = static_vol_inds_.size();
+
+  for (size_type i = 0; is_cur && (i < num_static_vols); ++i)
+  {
+    const Vol* v = vols_[static_vol_inds_[i]].GetPointer();
+
+    is_cur = (c.vols[i] == v) && (c.vol_mtimes[i] == v->GetMTime()) &&
+             (c.xforms_cam_to_itk_phys[i].matrix() ==
+                  static_vol_xforms_cam_to_itk_phys_[i].matrix());
+  }
+
+  return is_cur;
+}
+
+bool xreg::RayCaster::update_static_vols_bg_projs()
+{
+  const size_type num_static_vols = static_vol_inds_.size();
+
+  if (!num_static_vols)
+  {
+    return false;
+  }
+
+  StaticVolsCache& c = static_vols_cache_;
+
+  const bool need_to_cast = !static_vols_cache_is_current();
+
+  if (need_to_cast)
+  {
+    const size_type num_cams = num_camera_models();
+
+    xregASSERT(resources_allocated_ && (num_cams <= max_num_projs_));
+
+    const size_type orig_num_projs = num_projs_;
+    const FrameTransformList orig_xforms = xforms_cam_to_itk_phys_;
+    const CamModelAssocList orig_cam_assocs = cam_model_for_proj_;
+    const ProjPixelStoreMethod orig_store_meth = proj_store_meth_;
+    const bool orig_use_bg_projs = use_bg_projs_;
+
+    use_bg_projs_ = false;
+    proj_store_meth_ = kRAY_CAST_PIXEL_REPLACE;
+
+    set_num_projs(num_cams);
+
+    for (size_type i = 0; i < num_static_vols; ++i)
+    {
+      xregASSERT(static_vol_inds_[i] < vols_.size());
+
+      distribute_xform_among_cam_models(static_vol_xforms_cam_to_itk_phys_[i]);
+
+      compute(static_vol_inds_[i]);
+
+      // the remaining static volumes are added to the first volume's projections
+      proj_store_meth_ = kRAY_CAST_PIXEL_ACCUM;
+    }
+
+    // copy out of the ray caster's buffer, so they are not overwritten by
+    // subsequent calls to compute
+    c.projs.resize(num_cams);
+    for (size_type cam_idx = 0; cam_idx < num_cams; ++cam_idx)
+    {
+      c.projs[cam_idx] = ITKImageDeepCopy(proj(cam_idx).GetPointer());
+    }
+
+    set_num_projs(orig_num_projs);
+    xforms_cam_to_itk_phys_ = orig_xforms;
+    cam_model_for_proj_     = orig_cam_assocs;
+    proj_store_meth_        = orig_store_meth;
+    use_bg_projs_           = orig_use_bg_projs;
+
+    c.vol_inds               = static_vol_inds_;
+    c.xforms_cam_to_itk_phys = static_vol_xforms_cam_to_itk_phys_;
+    c.camera_models          = camera_models_;
+    c.ray_step_size          = ray_step_size_;
+    c.interp_method          = interp_method_;
+
+    c.vols.resize(num_static_vols);
+    c.vol_mtimes.resize(num_static_vols);
+    for (size_type i = 0; i < num_static_vols; ++i)
+    {
+      c.vols[i]       = vols_[static_vol_inds_[i]].GetPointer();
+      c.vol_mtimes[i] = c.vols[i]->GetMTime();
+    }
+
+    c.valid = true;
+  }
+
+  // avoid flagging the background projections as updated (and re-uploading
+  // them to a device) when the cached projections are already in use
+  if (need_to_cast || !use_bg_projs_ || (bg_projs_for_each_cam_ != c.projs))
+  {
+    set_bg_projs(c.projs, true);
+  }
+
+  return need_to_cast;
+}
+
+void xreg::RayCaster::update_bricked_vols()
+{
+  bricked_vols_.clear();
+
+  if (use_bricked_vol_layout_)
+  {
+    const size_type nv = vols_.size();
+
+    bricked_vols_.reserve(nv);
+
+    for (size_type vol_idx = 0; vol_idx < nv; ++vol_idx)
+    {
+      bricked_vols_.push_back(MakeRayCastBrickedVol(vols_[vol_idx].GetPointer(), use_huge_pages_));
+    }
+  }
+}
+
+void xreg::RayCaster::update_grad_vols()
+{
+  grad_vols_.clear();
+
+  if (use_precomputed_grad_vols_)
+  {
+    const size_type nv = vols_.size();
+
+    grad_vols_.reserve(nv);
+
+    for (size_type vol_idx = 0; vol_idx < nv; ++vol_idx)
+    {
+      grad_vols_.push_back(MakeRayCastGradVol(vols_[vol_idx].GetPointer()));
+    }
+  }
+}
+
+const xreg::RayCaster::Vol* xreg::RayCaster::bspline_coefs(const size_type vol_idx)
+{
+  const Vol* coefs = nullptr;
+
+  if (interp_method_ == kRAY_CAST_INTERP_BSPLINE)
+  {
+    VolPtr& coef_vol = bspline_coef_vols_[vol_idx];
+
+    if (!coef_vol)
+    {
+      // This is the same prefiltering performed by itk::BSplineInterpolateImageFunction
+      using DecompFilter = itk::BSplineDecompositionImageFilter<Vol,Vol>;
+
+      auto decomp = DecompFilter::New();
+      decomp->SetSplineOrder(3);
+      decomp->SetInput(vols_[vol_idx]);
+      decomp->Update();
+
+      coef_vol = decomp->GetOutput();
+    }
+
+    coefs = coef_vol.GetPointer();
+  }
+
+  return coefs;
+}
   
 void xreg::RayCasterCollisionParamInterface::set_render_thresh(const PixelScalar t)
 {
@@ -542,3 +1151,69 @@ void xreg::RayCastLineIntParamInterface::set_kernel_id(const RayCastLineIntKerne
   kernel_id_ = k;
 }
 
+xreg::Pt2List xreg::RayCastSobolPts2D(const size_type num_pts)
+{
+  std::uint32_t dir_nums_y[32];
+
+  std::uint32_t m = 1;
+
+  for (int i = 0; i < 32; ++i)
+  {
+    dir_nums_y[i] = m << (31 - i);
+    
+    m ^= m << 1;
+  }
+
+  Pt2List pts(num_pts);
+
+  for (size_type pt_idx = 0; pt_idx < num_pts; ++pt_idx)
+  {
+    std::uint32_t x = 0;
+    std::uint32_t y = 0;
+    
+    std::uint32_t k = static_cast<std::uint32_t>(pt_idx);
+
+    for (int i = 0; k; ++i, k >>= 1)
+    {
+      if (k & 1)
+      {
+        x ^= std::uint32_t(1) << (31 - i);
+        y ^= dir_nums_y[i];
+      }
+    }
+
+    pts[pt_idx](0) = UInt32ToUnitInterval(x);
+    pts[pt_idx](1) = UInt32ToUnitInterval(y);
+  }
+
+  return pts;
+}
+
+xreg::Pt2List xreg::RayCastStratifiedPts2D(const size_type num_pts)
+{
+  std::mt19937 rng_eng(0);
+  
+  // randomly permute the strata of the first dimension, Fisher-Yates
+  std::vector<size_type> x_strata(num_pts);
+  std::iota(x_strata.begin(), x_strata.end(), size_type(0));
+
+  for (size_type i = num_pts; i > 1; --i)
+  {
+    std::swap(x_strata[i - 1], x_strata[rng_eng() % i]);
+  }
+
+  const CoordScalar stratum_len = CoordScalar(1) / static_cast<CoordScalar>(num_pts);
+
+  Pt2List pts(num_pts);
+
+  for (size_type pt_idx = 0; pt_idx < num_pts; ++pt_idx)
+  {
+    const CoordScalar u_x = UInt32ToUnitInterval(static_cast<std::uint32_t>(rng_eng()));
+    const CoordScalar u_y = UInt32ToUnitInterval(static_cast<std::uint32_t>(rng_eng()));
+
+    pts[pt_idx](0) = (x_strata[pt_idx] + u_x) * stratum_len;
+    pts[pt_idx](1) = (pt_idx + u_y) * stratum_len;
+  }
+
+  return pts;
+}
@@ -28,12 +28,16 @@
 #include <opencv2/core/core.hpp>
 
 #include "xregPerspectiveXform.h"
+#include "xregRayCastEmptySpace.h"
+#include "xregRayCastBrickedVol.h"
+#include "xregRayCastGradVol.h"
 
 namespace xreg
 {
 
 // Forward Declarations
 class RayCastSyncHostBuf;
+class ParallelExecContext;
 class RayCastSyncOCLBuf;
 
 /// \brief Parent class for a perspective camera ray caster.
@@ -56,6 +60,9 @@ public:
 
   using CamModelAssocList = std::vector<size_type>;
 
+  /// \brief Pixel offsets into a (row-major) projection
+  using PixelIndexList = std::vector<size_type>;
+
   class UnsupportedOperationException { };
 
   enum InterpMethod
@@ -63,7 +70,14 @@ public:
     kRAY_CAST_INTERP_LINEAR = 0,
     kRAY_CAST_INTERP_NN,
     kRAY_CAST_INTERP_SINC,
-    kRAY_CAST_INTERP_BSPLINE
+    kRAY_CAST_INTERP_BSPLINE,
+    
+    /// \brief Exact voxel traversal (Siddon/Jacobs) instead of fixed step sampling.
+    ///
+    /// Each voxel intersected by a ray is visited exactly once and weighted by
+    /// the length of the intersection. The ray step size is ignored. Currently
+    /// only supported by the line integral ray casters.
+    kRAY_CAST_INTERP_SIDDON
   };
 
   /// \brief Used to indicate how ray casted values should be inserted into the
@@ -190,6 +204,12 @@ public:
   /// Trivial setter.
   void use_bspline_interp();
 
+  /// \brief Sets the volume "interpolation" method to an exact voxel
+  ///        traversal (Siddon/Jacobs).
+  ///
+  /// Trivial setter.
+  void use_siddon_interp();
+
   /// \brief Sets the poses to be used - this will update the number of
   ///        projections!
   ///
@@ -255,9 +275,33 @@ public:
   /// other work.
   virtual void allocate_resources();
 
+  /// \brief Builds any device programs used by this ray caster ahead of
+  ///        allocating resources.
+  ///
+  /// The programs are then reused by allocate_resources(), so this may be
+  /// called on a background thread (e.g. while volumes are loaded) to hide the
+  /// time spent compiling. Only settings which determine the programs need to
+  /// be set; no other method of this object may be called concurrently.
+  /// The default implementation does nothing.
+  virtual void prebuild_progs();
+
   /// \brief Perform the ray casting - needs to be implemented by the child class
   virtual void compute(const size_type vol_idx = 0) = 0;
 
+  /// \brief Perform the ray casting through several volumes, each with its
+  ///        own collection of camera poses, combining the values of all volumes.
+  ///
+  /// The poses in xforms_cam_to_itk_phys_for_each_vol[i] are used for volume
+  /// vol_inds[i] and each collection must have num_projs() poses. The result
+  /// is equivalent to calling compute() for the first volume, followed by
+  /// calls to compute() with the accumulate store method for the remaining
+  /// volumes. Background projections are only applied once and the current
+  /// poses (xforms_cam_to_itk_phys()) and store method are not modified.
+  /// The default implementation performs those calls; child classes may
+  /// override this to compute all volumes in a single pass over the rays.
+  virtual void compute_multi_vols(const std::vector<size_type>& vol_inds,
+                                  const std::vector<FrameTransformList>& xforms_cam_to_itk_phys_for_each_vol);
+
   /// \brief Retrieve a ray casting result - needs to be implemented by the child class
   ///
   /// The underlying buffer of the returned object may be modified by subsequent
@@ -270,6 +314,40 @@ public:
   /// \see proj for memory buffer details.
   virtual cv::Mat proj_ocv(const size_type proj_idx) = 0;
 
+  /// \brief Retrieve a pointer to the pixels of a projection in the HOST buffer.
+  ///
+  /// Only the pixels of this projection are made available on the host, e.g.
+  /// an OpenCL ray caster reads back this projection, and not the entire
+  /// buffer, from the device. No pixels are copied into a new buffer.
+  /// Lifetime: the pointer remains valid until resources are allocated again,
+  /// a different external host buffer is used, or this ray caster is
+  /// destroyed. The pixel values are overwritten by the next call to compute().
+  /// The default implementation offsets into raw_host_pixel_buf() and assumes
+  /// that all camera models have the same detector dimensions.
+  virtual PixelScalar2D* host_proj_pixels(const size_type proj_idx);
+
+  /// \brief Retrieve a non-owning OpenCV view of a projection's pixels in the
+  ///        HOST buffer.
+  ///
+  /// Only a matrix header is created, the pixels are neither copied nor
+  /// reference counted. The view is subject to the lifetime rules of
+  /// host_proj_pixels(); clone() the view to keep the values.
+  cv::Mat proj_ocv_view(const size_type proj_idx);
+
+  /// \brief Points an existing ITK image at a projection's pixels in the
+  ///        HOST buffer.
+  ///
+  /// The pixel container, region and spacing of img are updated in place, so
+  /// that a single image object may view many projections, one after another,
+  /// without any allocations. The image does not own the pixels and is
+  /// subject to the lifetime rules of host_proj_pixels().
+  void proj_view(const size_type proj_idx, Proj* img);
+
+  /// \brief Creates a non-owning ITK image view of a projection's pixels.
+  ///
+  /// \see proj_view
+  ProjPtr make_proj_view(const size_type proj_idx);
+
   /// \brief Retrieve the raw HOST buffer used to store projections.
   ///
   /// TODO: re-use this comment elsewhere... :)
@@ -351,15 +429,213 @@ public:
   /// \brief The maximum number of projections with the allocated resources.
   size_type max_num_projs() const;
 
+  /// \brief Sets the minimum capacity, in pixels over all projections, of
+  ///        the projection buffers allocated by allocate_resources().
+  ///
+  /// Projection buffers are only reallocated when their capacity is exceeded,
+  /// so reserving the largest number of pixels that will be required (e.g.
+  /// the largest detector and number of projections of all levels of a
+  /// multi-resolution registration) allows the ray caster to be reconfigured
+  /// and allocated again without freeing and reallocating host or device
+  /// memory. Ray casters with a device memory budget do not reserve beyond
+  /// the current number of projections. Defaults to 0.
+  void set_reserved_num_pixels(const size_type num_pix);
+
+  size_type reserved_num_pixels() const;
+
   PixelScalar2D default_bg_pixel_val() const;
 
   void set_default_bg_pixel_val(const PixelScalar2D bg_val);
 
+  /// \brief Enables/disables empty space skipping.
+  ///
+  /// When enabled, a coarse grid of bricks summarizing the minimum and maximum
+  /// intensities of each volume is computed when the volumes are set. Ray casters
+  /// that support empty space skipping use this to clip rays to the bounds of
+  /// the non-empty voxels and to jump over bricks that cannot contribute.
+  /// Interpolation methods which sample beyond the neighboring voxels (e.g.
+  /// B-spline and sinc) do not skip empty space. Disabled by default.
+  void set_use_empty_space_skipping(const bool use_skip);
+
+  bool use_empty_space_skipping() const;
+
+  /// \brief Sets the side length, in voxels, of the bricks used for empty
+  ///        space skipping.
+  ///
+  /// Defaults to 8.
+  void set_empty_space_brick_dim(const size_type brick_dim);
+
+  size_type empty_space_brick_dim() const;
+
+  /// \brief Sets the magnitude at or below which voxels are considered empty.
+  ///
+  /// Defaults to zero.
+  void set_empty_space_thresh(const PixelScalar3D thresh);
+
+  PixelScalar3D empty_space_thresh() const;
+
+  /// \brief Retrieves the brick grid of a volume used for empty space skipping.
+  ///
+  /// The returned grid is invalid (see RayCastVolBrickGrid::valid()) when
+  /// empty space skipping is disabled.
+  const RayCastVolBrickGrid& vol_brick_grid(const size_type vol_idx) const;
+
+  /// \brief Enables/disables a bricked copy of each volume for CPU ray casting.
+  ///
+  /// When enabled, a copy of each volume with voxels stored in small cubic
+  /// bricks is created when the volumes are set (see RayCastBrickedVol).
+  /// CPU ray casters that directly interpolate (nearest neighbor or linear)
+  /// fetch from this copy, which improves cache locality for rays that are
+  /// oblique to the volume axes, e.g. lateral views. This doubles the host
+  /// memory required by each volume. Disabled by default.
+  void set_use_bricked_vol_layout(const bool use_bricked);
+
+  bool use_bricked_vol_layout() const;
+
+  /// \brief Retrieves the bricked copy of a volume.
+  ///
+  /// The returned volume is invalid (see RayCastBrickedVol::valid()) when the
+  /// bricked layout is disabled.
+  const RayCastBrickedVol& bricked_vol(const size_type vol_idx) const;
+
+  /// \brief Enables/disables backing the large host buffers of CPU ray
+  ///        casting with transparent huge pages.
+  ///
+  /// This applies to the bricked copies of the volumes and the projection
+  /// buffers of the CPU ray casters, reducing the TLB misses of rays that
+  /// sample far apart voxels. Only buffers allocated after this is set are
+  /// affected, so it should be set before the volumes and before
+  /// allocate_resources(). This has no effect on systems without transparent
+  /// huge pages. Disabled by default.
+  void set_use_huge_pages(const bool use_huge_pages);
+
+  bool use_huge_pages() const;
+
+  /// \brief Enables/disables precomputing the gradient of each volume.
+  ///
+  /// When enabled, a packed gradient volume (see RayCastGradVol) is computed
+  /// for each volume when the volumes are set. Ray casters that estimate
+  /// surface normals at ray hit points (e.g. surface rendering and occluding
+  /// contours) fetch the interpolated gradient once per hit, instead of
+  /// computing central differences with six additional volume fetches. GPU
+  /// implementations store the gradients as a half precision RGBA texture.
+  /// This requires four times the memory of each volume on the host.
+  /// Disabled by default.
+  void set_use_precomputed_grad_vols(const bool use_grad_vols);
+
+  bool use_precomputed_grad_vols() const;
+
+  /// \brief Retrieves the precomputed gradient volume of a volume.
+  ///
+  /// The returned volume is invalid (see RayCastGradVol::valid()) when
+  /// precomputed gradients are disabled.
+  const RayCastGradVol& grad_vol(const size_type vol_idx) const;
+
+  /// \brief Enables/disables restricting the rays of each volume to the
+  ///        projection of its bounding box onto the detector.
+  ///
+  /// When enabled, the corners of each volume's bounding box are projected for
+  /// every pose and only the detector pixels in the 2D bounding box of those
+  /// projections are ray cast; the remaining pixels are left untouched, as if
+  /// no ray intersected the volume. This is useful when small objects (e.g.
+  /// fragments or screws) are ray cast separately. The full detector is used
+  /// for poses where a volume is not entirely in front of the source. Ray
+  /// casters that do not support windows compute every pixel. Disabled by
+  /// default.
+  void set_use_proj_bbox_windows(const bool use_windows);
+
+  bool use_proj_bbox_windows() const;
+
+  /// \brief Restricts the pixels that are computed for the projections of a
+  ///        camera model.
+  ///
+  /// Each index is a pixel offset into a (row-major) projection, e.g.
+  /// row * num_det_cols + col, and the list should be sorted in ascending
+  /// order for efficiency. Only these pixels are ray cast for projections
+  /// using this camera model; the remaining pixels are initialized and left
+  /// untouched, as if no ray intersected the volume. This is useful when a
+  /// similarity metric only uses a portion of each image (e.g. when masking or
+  /// randomly sampling patches). Ray casters that do not support sparse pixels
+  /// compute every pixel.
+  void set_active_pixels(const size_type cam_idx, const PixelIndexList& pix_inds);
+
+  /// \brief Restricts the pixels that are computed for the projections of a
+  ///        camera model to the non-zero pixels of a mask.
+  ///
+  /// The mask should be single channel, 8-bit with the same dimensions as
+  /// the camera model's detector.
+  void set_active_pixels_from_mask(const size_type cam_idx, const cv::Mat& mask);
+
+  /// \brief Computes every pixel of the projections of a camera model.
+  void clear_active_pixels(const size_type cam_idx);
+
+  /// \brief Computes every pixel of every projection.
+  void clear_active_pixels();
+
+  /// \brief Indicates that the computed pixels of a camera model have been
+  ///        restricted.
+  bool has_active_pixels(const size_type cam_idx) const;
+
+  /// \brief Indicates that the computed pixels of at least one camera model
+  ///        have been restricted.
+  bool use_active_pixels() const;
+
+  /// \brief The pixels computed for the projections of a camera model.
+  ///
+  /// This is only valid when has_active_pixels(cam_idx) is true.
+  const PixelIndexList& active_pixels(const size_type cam_idx) const;
+
+  /// \brief Declares volumes that do not move between computations, e.g.
+  ///        objects held fixed during a multiple object registration.
+  ///
+  /// Each static volume has a single pose that is distributed among every
+  /// camera model. The static volumes are not ray cast here; see
+  /// update_static_vols_bg_projs().
+  void set_static_vols(const std::vector<size_type>& vol_inds,
+                       const FrameTransformList& xforms_cam_to_itk_phys);
+
+  /// \brief Removes any static volumes and discards their cached projections.
+  ///
+  /// This does not disable the use of background projections.
+  void clear_static_vols();
+
+  const std::vector<size_type>& static_vols() const;
+
+  /// \brief Updates the background projections of each camera model with the
+  ///        projections of the static volumes.
+  ///
+  /// The static volumes are only ray cast when their poses, the volumes, the
+  /// camera models, the step size or interpolation method have changed since
+  /// the previous update; otherwise the cached projections are reused. After
+  /// this call, compute() only needs to be passed the moving volumes, which
+  /// are cast on top of a copy of the cached projections. The number of camera
+  /// models must not exceed max_num_projs() and set_use_bg_projs(true) should
+  /// have been called prior to allocating resources. Call
+  /// invalidate_static_vols_bg_projs() after changing other parameters that
+  /// affect the projections (e.g. active pixels or sub-class specific settings).
+  /// Returns true when the static volumes were ray cast.
+  bool update_static_vols_bg_projs();
+
+  /// \brief Forces the next update of the static volume background projections
+  ///        to ray cast the static volumes.
+  void invalidate_static_vols_bg_projs();
+
+  /// \brief Set the parallel execution context used by the CPU ray casting calls.
+  ///
+  /// e.g. the maximum number of threads used by compute().
+  /// A null context (the default) uses the context current on the calling
+  /// thread, see ParallelExecContextScope.
+  void set_exec_context(std::shared_ptr<ParallelExecContext> ctx);
+
+  std::shared_ptr<ParallelExecContext> exec_context() const;
+
 protected:
 
   /// \brief The 3D volumes that may be ray casted at/on/in.
   VolList vols_;
 
+  std::shared_ptr<ParallelExecContext> exec_ctx_;
+
   /// \brief The camera parameters used for computing projections (intrinsics)
   ///
   /// NOTE: The indices of this list to not correspond to projection indices.
@@ -380,6 +656,9 @@ protected:
   /// \brief The maximum number of projections that the allocated resources can hold
   size_type max_num_projs_ = 0;
 
+  /// \brief Minimum capacity, in pixels, of the projection buffers
+  size_type reserved_num_pix_ = 0;
+
   /// \brief The list of camera extrinsics for each ray casting to be computed.
   ///
   /// These are the poses of the camera with respect to the
@@ -416,6 +695,108 @@ protected:
   /// \brief Indicates that resources have been allocated successfully.
   bool resources_allocated_ = false;
 
+  bool use_empty_space_skipping_ = false;
+
+  size_type empty_space_brick_dim_ = 8;
+
+  PixelScalar3D empty_space_thresh_ = 0;
+
+  /// \brief Brick grids of each volume, used for empty space skipping.
+  ///
+  /// These are empty when empty space skipping is disabled.
+  RayCastVolBrickGridList vol_brick_grids_;
+
+  /// \brief Recomputes the brick grid of each volume when empty space skipping
+  ///        is enabled, or clears them otherwise.
+  void update_vol_brick_grids();
+
+  bool use_bricked_vol_layout_ = false;
+
+  /// \brief Bricked copies of each volume, empty when the bricked layout is
+  ///        disabled.
+  RayCastBrickedVolList bricked_vols_;
+
+  bool use_huge_pages_ = false;
+
+  bool use_precomputed_grad_vols_ = false;
+
+  /// \brief Gradients of each volume, empty when precomputed gradients are
+  ///        disabled.
+  RayCastGradVolList grad_vols_;
+
+  bool use_proj_bbox_windows_ = false;
+
+  /// \brief Indices of the volumes that do not move between computations.
+  std::vector<size_type> static_vol_inds_;
+
+  /// \brief The pose of each static volume, used for every camera model.
+  FrameTransformList static_vol_xforms_cam_to_itk_phys_;
+
+  /// \brief Cached projections of the static volumes and the state used to
+  ///        compute them.
+  struct StaticVolsCache
+  {
+    bool valid = false;
+
+    std::vector<size_type> vol_inds;
+
+    FrameTransformList xforms_cam_to_itk_phys;
+
+    std::vector<const Vol*> vols;
+
+    std::vector<unsigned long> vol_mtimes;
+
+    CameraModelList camera_models;
+
+    CoordScalar ray_step_size = 0;
+
+    InterpMethod interp_method = kRAY_CAST_INTERP_LINEAR;
+
+    ProjList projs;
+  };
+
+  StaticVolsCache static_vols_cache_;
+
+  /// \brief Indicates that the cached static volume projections were computed
+  ///        with the current static volumes, poses and ray caster settings.
+  bool static_vols_cache_is_current() const;
+
+  /// \brief Recreates the bricked copy of each volume when the bricked layout
+  ///        is enabled, or clears them otherwise.
+  void update_bricked_vols();
+
+  /// \brief Recomputes the gradient volume of each volume when precomputed
+  ///        gradients are enabled, or clears them otherwise.
+  void update_grad_vols();
+
+  /// \brief Cubic B-spline coefficients of each volume, used by the CPU
+  ///        B-spline interpolators.
+  ///
+  /// Null entries have not been computed yet, see bspline_coefs().
+  VolList bspline_coef_vols_;
+
+  /// \brief The cubic B-spline coefficients of a volume, or null when not
+  ///        using B-spline interpolation.
+  ///
+  /// The coefficients are computed on the first call for a volume and cached
+  /// until the volumes change. This should be called prior to dispatching work
+  /// to multiple threads, which may then share the coefficients read-only.
+  const Vol* bspline_coefs(const size_type vol_idx);
+
+  /// \brief The pixels to compute for each camera model.
+  ///
+  /// An empty list is ignored when the corresponding entry of
+  /// cam_has_active_pixels_ is false, which indicates every pixel is computed.
+  std::vector<PixelIndexList> active_pixels_for_each_cam_;
+
+  std::vector<bool> cam_has_active_pixels_;
+
+  /// \brief Called whenever the active pixels of a camera model are changed.
+  ///
+  /// The default implementation is a no-op, a GPU implementation may need to
+  /// move the pixel lists to device memory.
+  virtual void active_pixels_changed() { }
+
   /// \brief Called whenever the image volumes are changed
   ///
   /// e.g. when calling set_volume(), set_volumes()
@@ -590,6 +971,22 @@ protected:
   RayCastLineIntKernel kernel_id_ = kRAY_CAST_LINE_INT_SUM_KERNEL;
 };
 
+/// \brief The first num_pts points of the 2D Sobol sequence, in [0,1)^2.
+///
+/// The first dimension is the Van der Corput sequence in base 2 and the second
+/// uses the direction numbers of the primitive polynomial x + 1. These are
+/// used as sub-pixel ray offsets by the anti-aliasing ray casters.
+Pt2List RayCastSobolPts2D(const size_type num_pts);
+
+/// \brief num_pts points in [0,1)^2 with a single point in each of the
+///        num_pts strata of each dimension.
+///
+/// A fixed seed is used and only the raw outputs of the random engine are
+/// used (the distributions and std::shuffle are implementation defined), so
+/// that the same points are always generated. These are used as sub-pixel ray
+/// offsets by the anti-aliasing ray casters.
+Pt2List RayCastStratifiedPts2D(const size_type num_pts);
+
 // This is a large number which is too large to represent a valid depth, and
 // therefore indicates that no object intersection was found and the depth
 // is not defined. This is smaller than, and used in place of,
@@ -0,0 +1,318 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGRAYCASTINTERPCPU_H_
+#define XREGRAYCASTINTERPCPU_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include <itkInterpolateImageFunction.h>
+
+#include "xregRayCastInterface.h"
+
+namespace xreg
+{
+
+/// \brief Lightweight view into the raw buffer of a ray casting volume.
+///
+/// This is used by the CPU ray casters in order to avoid the virtual function
+/// call overhead of itk::InterpolateImageFunction::EvaluateAtContinuousIndex
+/// when performing interpolations that are simple enough to implement directly
+/// (e.g. nearest neighbor and tri-linear). The view does not own the buffer,
+/// so the volume must outlive any use of this object.
+struct RayCastVolBufCPU
+{
+  using PixelScalar = RayCaster::PixelScalar3D;
+
+  const PixelScalar* buf;
+
+  std::int32_t size_x;
+  std::int32_t size_y;
+  std::int32_t size_z;
+
+  std::int64_t stride_y;  ///< Number of voxels between consecutive rows (size_x)
+  std::int64_t stride_z;  ///< Number of voxels between consecutive slices (size_x * size_y)
+
+  PixelScalar at(const std::int32_t i, const std::int32_t j, const std::int32_t k) const
+  {
+    return buf[i + (j * stride_y) + (k * stride_z)];
+  }
+};
+
+/// \brief Creates a raw buffer view for a ray casting volume.
+inline RayCastVolBufCPU MakeRayCastVolBufCPU(const RayCaster::Vol* vol)
+{
+  const auto vol_size = vol->GetLargestPossibleRegion().GetSize();
+
+  RayCastVolBufCPU v;
+  
+  v.buf = vol->GetBufferPointer();
+
+  v.size_x = static_cast<std::int32_t>(vol_size[0]);
+  v.size_y = static_cast<std::int32_t>(vol_size[1]);
+  v.size_z = static_cast<std::int32_t>(vol_size[2]);
+
+  v.stride_y = v.size_x;
+  v.stride_z = v.stride_y * v.size_y;
+
+  return v;
+}
+
+/// \brief Lightweight view into a bricked copy of a ray casting volume.
+///
+/// This provides the same interface as RayCastVolBufCPU, so that either
+/// layout may be used by the direct interpolators below. The view does not own
+/// the buffer, so the bricked volume must outlive any use of this object.
+struct RayCastBrickedVolBufCPU
+{
+  using PixelScalar = RayCaster::PixelScalar3D;
+
+  const RayCastBrickedVol* vol;
+
+  std::int32_t size_x;
+  std::int32_t size_y;
+  std::int32_t size_z;
+
+  PixelScalar at(const std::int32_t i, const std::int32_t j, const std::int32_t k) const
+  {
+    return vol->buf[vol->offset(i,j,k)];
+  }
+};
+
+/// \brief Creates a buffer view for a bricked ray casting volume.
+inline RayCastBrickedVolBufCPU MakeRayCastVolBufCPU(const RayCastBrickedVol& bricked_vol)
+{
+  RayCastBrickedVolBufCPU v;
+
+  v.vol = &bricked_vol;
+
+  v.size_x = bricked_vol.size_x;
+  v.size_y = bricked_vol.size_y;
+  v.size_z = bricked_vol.size_z;
+
+  return v;
+}
+
+namespace detail
+{
+
+inline std::int32_t RayCastClampIdx(const std::int32_t i, const std::int32_t max_i)
+{
+  return (i < 0) ? 0 : ((i > max_i) ? max_i : i);
+}
+
+/// \brief Computes the neighbor indices and weight of a linear interpolation
+///        along one dimension.
+///
+/// The weight is computed from the continuous index clamped to the volume, so
+/// that a point slightly outside of the volume takes the value of the nearest
+/// face, instead of the weight wrapping around to the far neighbor.
+inline void RayCastLinearInterpIdx(const CoordScalar x, const std::int32_t max_i,
+                                   std::int32_t* i0, std::int32_t* i1, CoordScalar* d)
+{
+  const std::int32_t fx = static_cast<std::int32_t>(std::floor(x));
+
+  *i0 = RayCastClampIdx(fx, max_i);
+  *i1 = RayCastClampIdx(fx + 1, max_i);
+
+  *d = std::min(std::max(x, CoordScalar(0)), static_cast<CoordScalar>(max_i)) - *i0;
+}
+
+}  // detail
+
+/// \brief Nearest neighbor interpolation directly from a raw volume buffer.
+///
+/// Matches the rounding of itk::NearestNeighborInterpolateImageFunction
+/// (round half up) and clamps indices to the volume so that points slightly
+/// outside of the volume, due to accumulated stepping error, are still valid.
+/// tVolBuf is either RayCastVolBufCPU or RayCastBrickedVolBufCPU.
+template <class tVolBuf>
+struct RayCastVolNNInterpCPU
+{
+  using VolBuf      = tVolBuf;
+  using PixelScalar = typename VolBuf::PixelScalar;
+
+  const VolBuf vol;
+
+  PixelScalar operator()(const CoordScalar x, const CoordScalar y, const CoordScalar z) const
+  {
+    const std::int32_t i = detail::RayCastClampIdx(
+                              static_cast<std::int32_t>(std::floor(x + CoordScalar(0.5))), vol.size_x - 1);
+    const std::int32_t j = detail::RayCastClampIdx(
+                              static_cast<std::int32_t>(std::floor(y + CoordScalar(0.5))), vol.size_y - 1);
+    const std::int32_t k = detail::RayCastClampIdx(
+                              static_cast<std::int32_t>(std::floor(z + CoordScalar(0.5))), vol.size_z - 1);
+
+    return vol.at(i,j,k);
+  }
+};
+
+/// \brief Tri-linear interpolation directly from a raw volume buffer.
+///
+/// Neighbors that lie outside of the volume are clamped, which is consistent
+/// with itk::LinearInterpolateImageFunction for points up to the small
+/// stepping tolerance outside of the volume.
+/// tVolBuf is either RayCastVolBufCPU or RayCastBrickedVolBufCPU.
+template <class tVolBuf>
+struct RayCastVolLinearInterpCPU
+{
+  using VolBuf      = tVolBuf;
+  using PixelScalar = typename VolBuf::PixelScalar;
+
+  const VolBuf vol;
+
+  PixelScalar operator()(const CoordScalar x, const CoordScalar y, const CoordScalar z) const
+  {
+    std::int32_t i0, i1, j0, j1, k0, k1;
+    CoordScalar  dx, dy, dz;
+
+    detail::RayCastLinearInterpIdx(x, vol.size_x - 1, &i0, &i1, &dx);
+    detail::RayCastLinearInterpIdx(y, vol.size_y - 1, &j0, &j1, &dy);
+    detail::RayCastLinearInterpIdx(z, vol.size_z - 1, &k0, &k1, &dz);
+
+    const PixelScalar v000 = vol.at(i0,j0,k0);
+    const PixelScalar v100 = vol.at(i1,j0,k0);
+    const PixelScalar v010 = vol.at(i0,j1,k0);
+    const PixelScalar v110 = vol.at(i1,j1,k0);
+    const PixelScalar v001 = vol.at(i0,j0,k1);
+    const PixelScalar v101 = vol.at(i1,j0,k1);
+    const PixelScalar v011 = vol.at(i0,j1,k1);
+    const PixelScalar v111 = vol.at(i1,j1,k1);
+
+    const PixelScalar c00 = v000 + (dx * (v100 - v000));
+    const PixelScalar c10 = v010 + (dx * (v110 - v010));
+    const PixelScalar c01 = v001 + (dx * (v101 - v001));
+    const PixelScalar c11 = v011 + (dx * (v111 - v011));
+
+    const PixelScalar c0 = c00 + (dy * (c10 - c00));
+    const PixelScalar c1 = c01 + (dy * (c11 - c01));
+
+    return c0 + (dz * (c1 - c0));
+  }
+};
+
+/// \brief Adapts an ITK interpolator to the interface of the direct interpolators.
+///
+/// This allows the CPU ray casting loops to be written once as templates on
+/// the interpolation functor, with the ITK virtual call only paid for the
+/// interpolation methods that are not implemented directly (e.g. B-spline).
+/// The interpolator is not owned, so it must outlive any use of this object.
+struct RayCastITKInterpCPU
+{
+  using VolInterp   = itk::InterpolateImageFunction<RayCaster::Vol,CoordScalar>;
+  using PixelScalar = RayCaster::PixelScalar3D;
+
+  const VolInterp* interp;
+
+  PixelScalar operator()(const CoordScalar x, const CoordScalar y, const CoordScalar z) const
+  {
+    itk::ContinuousIndex<CoordScalar,3> cont_idx;
+    cont_idx[0] = x;
+    cont_idx[1] = y;
+    cont_idx[2] = z;
+
+    return interp->EvaluateAtContinuousIndex(cont_idx);
+  }
+};
+
+/// \brief Estimates the gradient of a volume using central differences of
+///        interpolated values at adjacent indices.
+///
+/// The gradient is with respect to the image (index) axes. The differences
+/// are not divided by two, since the callers only require the direction.
+/// tInterp is any of the interpolation functors above.
+template <class tInterp>
+Pt3 RayCastCentralDiffGradCPU(const tInterp& interp, const Pt3& idx)
+{
+  Pt3 g;
+
+  g[0] = interp(idx[0] + 1, idx[1], idx[2]) - interp(idx[0] - 1, idx[1], idx[2]);
+  g[1] = interp(idx[0], idx[1] + 1, idx[2]) - interp(idx[0], idx[1] - 1, idx[2]);
+  g[2] = interp(idx[0], idx[1], idx[2] + 1) - interp(idx[0], idx[1], idx[2] - 1);
+
+  return g;
+}
+
+/// \brief Tri-linear interpolation of a precomputed gradient volume.
+///
+/// The result is with respect to the image (index) axes and is scaled by an
+/// arbitrary positive factor (see RayCastGradVol), so only its direction
+/// should be used. Neighbors beyond the volume are clamped.
+inline Pt3 RayCastGradVolLinearInterpCPU(const RayCastGradVol& gv, const Pt3& idx)
+{
+  std::int32_t i0, i1, j0, j1, k0, k1;
+  CoordScalar  dx, dy, dz;
+
+  detail::RayCastLinearInterpIdx(idx[0], gv.size_x - 1, &i0, &i1, &dx);
+  detail::RayCastLinearInterpIdx(idx[1], gv.size_y - 1, &j0, &j1, &dy);
+  detail::RayCastLinearInterpIdx(idx[2], gv.size_z - 1, &k0, &k1, &dz);
+
+  const CoordScalar wx[2] = { CoordScalar(1) - dx, dx };
+  const CoordScalar wy[2] = { CoordScalar(1) - dy, dy };
+  const CoordScalar wz[2] = { CoordScalar(1) - dz, dz };
+
+  const std::int32_t is[2] = { i0, i1 };
+  const std::int32_t js[2] = { j0, j1 };
+  const std::int32_t ks[2] = { k0, k1 };
+
+  Pt3 g = Pt3::Zero();
+
+  for (int c = 0; c < 2; ++c)
+  {
+    for (int b = 0; b < 2; ++b)
+    {
+      for (int a = 0; a < 2; ++a)
+      {
+        const RayCastGradVol::PixelScalar* v = gv.buf.data() + gv.offset(is[a], js[b], ks[c]);
+
+        const CoordScalar w = wx[a] * wy[b] * wz[c];
+
+        g[0] += w * v[0];
+        g[1] += w * v[1];
+        g[2] += w * v[2];
+      }
+    }
+  }
+
+  return g;
+}
+
+/// \brief Estimates the gradient of a volume at a ray hit point, using the
+///        precomputed gradient volume when available.
+///
+/// When grad_vol is null, or invalid, this falls back to central differences
+/// of the interpolator. Only the direction of the result should be used.
+template <class tInterp>
+Pt3 RayCastSurGradCPU(const tInterp& interp, const RayCastGradVol* grad_vol, const Pt3& idx)
+{
+  return (grad_vol && grad_vol->valid()) ? RayCastGradVolLinearInterpCPU(*grad_vol, idx) :
+                                           RayCastCentralDiffGradCPU(interp, idx);
+}
+
+}  // xreg
+
+#endif
+
@@ -24,18 +24,16 @@
 
 #include "xregRayCastLineIntCPU.h"
 
+#include <algorithm>
+#include <future>
+#include <numeric>
 #include <random>
 
-#include <itkLinearInterpolateImageFunction.h>
-#include <itkNearestNeighborInterpolateImageFunction.h>
-#include <itkWindowedSincInterpolateImageFunction.h>
-#include <itkConstantBoundaryCondition.h>
-#include <itkBSplineInterpolateImageFunction.h>
-
 #include "xregITKBasicImageUtils.h"
 #include "xregTBBUtils.h"
 #include "xregSpatialPrimitives.h"
 #include "xregExceptionUtils.h"
+#include "xregRayCastInterpCPU.h"
 
 namespace
 {
@@ -46,6 +44,9 @@ struct AccumLineIntKernel
 {
   using PixelScalar = RayCaster::PixelScalar3D;
 
+  /// \brief Voxel values are weighted by intersection length during exact traversals
+  static constexpr bool kWEIGHT_BY_LEN = true;
+
   PixelScalar operator()(const PixelScalar& dst_pixel_val,
                          const PixelScalar& cur_voxel_val) const
   {
@@ -62,6 +63,9 @@ struct MaxLineIntKernel
 {
   using PixelScalar = RayCaster::PixelScalar3D;
 
+  /// \brief A maximum is taken over the raw voxel values during exact traversals
+  static constexpr bool kWEIGHT_BY_LEN = false;
+
   PixelScalar operator()(const PixelScalar& dst_pixel_val,
                          const PixelScalar& cur_voxel_val) const
   {
@@ -74,6 +78,108 @@ struct MaxLineIntKernel
   }
 };
  
+/// \brief Quantities that are constant for every ray of a projection.
+///
+/// These are computed once per call to compute(), rather than for every ray.
+struct LineIntProjSetup
+{
+  const CameraModel* cam;  ///< The camera model (intrinsics) of the projection
+
+  const Pt3List* det_pts_wrt_cam;  ///< The detector point of each pixel of cam, in row-major order
+
+  FrameTransform xform_cam_to_itk_idx;  ///< Transformation from camera coordinates to continuous indices
+
+  Pt3 pinhole_wrt_itk_idx;  ///< Position of the X-Ray source / pinhole point in continuous indices
+
+  const RayCaster::PixelIndexList* active_pix_inds;  ///< The pixels to compute, only used when computing a subset of pixels
+
+  /// \brief The detector window containing every ray that may intersect the
+  ///        volume, as half-open ranges of rows and columns.
+  ///
+  /// This is the entire detector unless projected bounding box windows are used.
+  size_type win_row_begin;
+  size_type win_row_end;
+  size_type win_col_begin;
+  size_type win_col_end;
+
+  /// \brief The offset of each anti-aliased ray from the detector point of a
+  ///        pixel, with respect to the camera.
+  ///
+  /// Null when rays are randomly jittered or anti-aliasing is disabled.
+  const Pt3List* aa_offsets_wrt_cam;
+};
+
+using LineIntProjSetupList = std::vector<LineIntProjSetup>;
+
+/// \brief Restricts the detector window of a projection to the bounding box
+///        of the projected corners of a box of (continuous) volume indices.
+///
+/// The box is enlarged by half of a voxel, so that it contains the extents of
+/// the boundary voxels, and the window is enlarged by a pixel to account for
+/// anti-aliased rays. The window is unchanged when any corner is not in front
+/// of the source, since the projected bounding box is not meaningful then.
+void UpdateLineIntProjWindow(const Pt3& img_aabb_min, const Pt3& img_aabb_max,
+                             LineIntProjSetup* proj_setup)
+{
+  const CameraModel& cam = *proj_setup->cam;
+
+  const FrameTransform xform_itk_idx_to_cam = proj_setup->xform_cam_to_itk_idx.inverse();
+
+  const Mat3x4 proj_mat = cam.phys_to_ind_proj_mat();
+
+  // the sign of the homogeneous coordinate for points on the same side of the
+  // source as the detector
+  const CoordScalar det_w = (proj_mat * cam.ind_pt_to_phys_det_pt(Pt2(0,0)).homogeneous())[2];
+
+  Pt3List corners_wrt_cam;
+  corners_wrt_cam.reserve(8);
+
+  for (int corner_idx = 0; corner_idx < 8; ++corner_idx)
+  {
+    Pt3 corner_wrt_itk_idx;
+
+    for (int d = 0; d < 3; ++d)
+    {
+      corner_wrt_itk_idx[d] = (corner_idx & (1 << d)) ? (img_aabb_max[d] + CoordScalar(0.5)) :
+                                                        (img_aabb_min[d] - CoordScalar(0.5));
+    }
+
+    corners_wrt_cam.push_back(xform_itk_idx_to_cam * corner_wrt_itk_idx);
+
+    if (((proj_mat * corners_wrt_cam.back().homogeneous())[2] / det_w) < CoordScalar(1.0e-6))
+    {
+      return;
+    }
+  }
+
+  Pt2 top_left;
+  Pt2 bot_right;
+
+  std::tie(top_left,bot_right) = GetBoundingBox2DProjPts(cam, corners_wrt_cam);
+
+  const CoordScalar min_c = std::floor(top_left[0])  - 1;
+  const CoordScalar min_r = std::floor(top_left[1])  - 1;
+  const CoordScalar max_c = std::ceil(bot_right[0])  + 1;
+  const CoordScalar max_r = std::ceil(bot_right[1])  + 1;
+
+  if ((max_c < 0) || (max_r < 0) ||
+      (min_c >= static_cast<CoordScalar>(cam.num_det_cols)) ||
+      (min_r >= static_cast<CoordScalar>(cam.num_det_rows)))
+  {
+    // the volume does not project onto the detector
+    proj_setup->win_row_end = proj_setup->win_row_begin;
+    proj_setup->win_col_end = proj_setup->win_col_begin;
+  }
+  else
+  {
+    proj_setup->win_col_begin = static_cast<size_type>(std::max(CoordScalar(0), min_c));
+    proj_setup->win_row_begin = static_cast<size_type>(std::max(CoordScalar(0), min_r));
+
+    proj_setup->win_col_end = std::min(cam.num_det_cols, static_cast<size_type>(max_c) + 1);
+    proj_setup->win_row_end = std::min(cam.num_det_rows, static_cast<size_type>(max_r) + 1);
+  }
+}
+
 /// \brief Params for evaluating a single line integral.
 struct LineIntParams
 {
@@ -97,254 +203,1625 @@ struct LineIntParams
   const CoordScalar step_size;  ///< The step size for each ray
 
   const RayCaster::InterpMethod interp_method;  ///< The interpolation method used for fractional indices into the 3D volume
+
+  const RayCastVolBrickGrid* brick_grid;  ///< Used for skipping empty space, null when not skipping
+
+  const RayCastVolBrickGrid* max_bound_grid;  ///< Brick maxima used to skip samples that cannot change a maximum, null when not skipping
+
+  const RayCastBrickedVol* bricked_vol;  ///< Bricked copy of img_vol used by the direct interpolators, null when not available
+
+  const RayCaster::Vol* bspline_coefs;  ///< Shared B-spline coefficients of img_vol, null when not using B-spline interpolation
+
+  RayCastCPUThreadStatePool* thread_states;  ///< The interpolators and random engines kept by each thread
+
+  const LineIntProjSetupList& proj_setups;  ///< The setup of each projection
+
+  /// \brief Offset of the first active ray of each projection, with the total
+  ///        number of active rays stored last.
+  ///
+  /// Null when every pixel is computed.
+  const std::vector<size_type>* active_ray_offsets;
 };
 
-/// \brief Computation task for evaluating a collection of line integrals.
+/// \brief The params of each volume computed in a single pass over the rays.
 ///
-/// The collection of line integrals is not necessarily restricted to a single projection
-template <class tKernel>
-void ComputeLineInts(const LineIntParams& params,
-                     RayCaster::PixelScalar2D* proj_buf,
-                     const RangeType& full_range)
+/// Every volume shares the same projections, camera models, and active pixels.
+using LineIntParamsList = std::vector<LineIntParams>;
+
+/// \brief Minimum number of detector rows in a tile of rays processed by a task
+constexpr size_type kLINE_INT_TILE_NUM_ROWS = 8;
+
+/// \brief Minimum number of detector columns in a tile of rays processed by a task
+constexpr size_type kLINE_INT_TILE_NUM_COLS = 32;
+
+/// \brief The portion of a single ray that intersects the volume, expressed
+///        in continuous indices.
+struct LineIntRaySeg
 {
-  using LineIntKernel = tKernel;
+  Pt3 start_pt_wrt_itk_idx;  ///< First sample point inside the volume
 
-  using PixelScalar2D = RayCaster::PixelScalar2D;
+  Pt3 step_vec_wrt_itk_idx;  ///< Offset between consecutive samples
 
-  using Vol = RayCaster::Vol;
+  /// \brief The index of the last sample; samples 0, 1, ..., num_steps are taken.
+  ///
+  /// This is negative when the ray does not intersect the volume.
+  std::int64_t num_steps;
+};
+
+/// \brief Computes the segment of a ray, from the source to a detector point,
+///        that lies within the volume.
+///
+/// The detector point is stored with respect to the camera's "world"
+/// coordinates.
+LineIntRaySeg SetupLineIntRaySeg(const LineIntParams& params,
+                                 const LineIntProjSetup& proj_setup,
+                                 const Pt3& cur_det_pt_wrt_cam)
+{
+  constexpr CoordScalar kVOL_BB_STEP_INC_TOL = RayCasterLineIntCPU::kVOL_BB_STEP_INC_TOL;
+  
+  LineIntRaySeg seg;
+  seg.num_steps = -1;
+
+  const CameraModel& cam = *proj_setup.cam;
+
+  const FrameTransform& xform_cam_to_itk_idx = proj_setup.xform_cam_to_itk_idx;
+
+  const Pt3& pinhole_wrt_itk_idx = proj_setup.pinhole_wrt_itk_idx;
 
-  using VolInterpType        = itk::InterpolateImageFunction<Vol,CoordScalar>;
-  using VolLinearInterpType  = itk::LinearInterpolateImageFunction<Vol,CoordScalar>;
-  using VolNNInterpType      = itk::NearestNeighborInterpolateImageFunction<Vol,CoordScalar>;
-  using VolBSplineInterpType = itk::BSplineInterpolateImageFunction<Vol,CoordScalar>;
-  using VolSincInterpType    = itk::WindowedSincInterpolateImageFunction<
-                                       Vol,4,itk::Function::LanczosWindowFunction<4>,
-                                       itk::ConstantBoundaryCondition<Vol>,CoordScalar>;
+  // Vector from the pinhole point to detector bin in ITK index coordinates
+  const Pt3 pinhole_to_det_wrt_itk_idx =
+                (xform_cam_to_itk_idx * cur_det_pt_wrt_cam) - pinhole_wrt_itk_idx;
 
-  auto line_int_fn = [&params, proj_buf] (const RangeType& r)
+  CoordScalar t_start = 0;
+  CoordScalar t_stop  = 0;
+
+  bool inter_vol = false;
+
+  std::tie(inter_vol,t_start,t_stop) = RayRectIntersect(params.img_aabb_min, params.img_aabb_max,
+                                                        pinhole_wrt_itk_idx, pinhole_to_det_wrt_itk_idx,
+                                                        true);  // true -> limit intersection to line segment
+
+  // Besides intersecting, need to be able to nudge inward a bit to avoid an
+  // ITK crash when interpolating on edge
+  if (inter_vol && ((t_stop - t_start) > CoordScalar(2 * kVOL_BB_STEP_INC_TOL)))
   {
-    VolInterpType::Pointer vol_interp;
+    t_start += kVOL_BB_STEP_INC_TOL;
+    t_stop  -= kVOL_BB_STEP_INC_TOL;
+    
+    // the first index on the line from source to detector that lies within
+    // the volume bounds
+    seg.start_pt_wrt_itk_idx = pinhole_wrt_itk_idx + (t_start * pinhole_to_det_wrt_itk_idx);
+
+    const CoordScalar pinhole_to_det_len_wrt_itk_idx = pinhole_to_det_wrt_itk_idx.norm();
+
+    const CoordScalar intersect_len_wrt_itk_idx =
+                              (t_stop - t_start) * pinhole_to_det_len_wrt_itk_idx;
+
+    // Rotate and scale the step vector to get it wrt ITK indices
+    const CoordScalar step_len_wrt_itk_idx =
+       (xform_cam_to_itk_idx.matrix().block(0,0,3,3) *
+        ((cur_det_pt_wrt_cam - cam.pinhole_pt).normalized() * params.step_size)).norm();
+
+    seg.num_steps = static_cast<std::int64_t>(intersect_len_wrt_itk_idx / step_len_wrt_itk_idx);
+
+    seg.step_vec_wrt_itk_idx = pinhole_to_det_wrt_itk_idx *
+                                  (step_len_wrt_itk_idx / pinhole_to_det_len_wrt_itk_idx);
 
-    switch (params.interp_method)
+    if (params.brick_grid)
     {
-      case RayCaster::kRAY_CAST_INTERP_NN:
-        vol_interp = VolNNInterpType::New();
-        break;
-      case RayCaster::kRAY_CAST_INTERP_SINC:
-        vol_interp = VolSincInterpType::New();
-        break;
-      case RayCaster::kRAY_CAST_INTERP_BSPLINE:
+      // trim the empty bricks at the start and end of the ray
+      const RayCastBrickIsEmpty is_empty = { *params.brick_grid };
+      
+      const std::int64_t num_lead_steps = RayCastSkipBricks(*params.brick_grid, is_empty,
+                                                            seg.start_pt_wrt_itk_idx,
+                                                            seg.step_vec_wrt_itk_idx,
+                                                            0, seg.num_steps);
+      if (num_lead_steps > seg.num_steps)
       {
-        auto bspline_interp = VolBSplineInterpType::New();
-        bspline_interp->SetSplineOrder(3);
-        vol_interp = bspline_interp;
+        seg.num_steps = -1;
+      }
+      else
+      {
+        const Pt3 end_pt_wrt_itk_idx = seg.start_pt_wrt_itk_idx +
+                          (static_cast<CoordScalar>(seg.num_steps) * seg.step_vec_wrt_itk_idx);
+
+        const std::int64_t num_trail_steps = RayCastSkipBricks(*params.brick_grid, is_empty,
+                                                               end_pt_wrt_itk_idx,
+                                                               -seg.step_vec_wrt_itk_idx,
+                                                               0, seg.num_steps - num_lead_steps);
+
+        seg.start_pt_wrt_itk_idx += static_cast<CoordScalar>(num_lead_steps) * seg.step_vec_wrt_itk_idx;
+
+        seg.num_steps -= num_lead_steps + num_trail_steps;
       }
-        break;
-      case RayCaster::kRAY_CAST_INTERP_LINEAR:
-      default:
-        vol_interp = VolLinearInterpType::New();
-        break;
     }
+  }
 
-    vol_interp->SetInputImage(params.img_vol);
+  return seg;
+}
 
-    const size_type num_drr_px = params.camera_models[0].num_det_rows *
-                                 params.camera_models[0].num_det_cols;
-   
-    const bool do_aa = params.aa_fact != 0;
-    const size_type num_rays_per_pixel = do_aa ? params.aa_fact : 1;
+/// \brief Jitter of detector indices used for anti-aliasing.
+///
+/// When a table of offsets is available for a projection, the offsets are
+/// added to the cached detector points, otherwise random jitter is used.
+struct LineIntAAJitter
+{
+  using RNGEngine   = std::mt19937;
+  using UniformDist = std::uniform_real_distribution<CoordScalar>; 
 
-    const PixelScalar2D one_over_num_rays_per_pixel = PixelScalar2D(1) /
-                                          static_cast<PixelScalar2D>(num_rays_per_pixel);
+  const bool do_aa;
 
-    using RNGEngine   = std::mt19937;
-    using NormalDist  = std::normal_distribution<CoordScalar>;
-    using UniformDist = std::uniform_real_distribution<CoordScalar>; 
+  /// \brief The random engine of the current thread, null when not using random jitter
+  RNGEngine* rng_eng;
 
-    LineIntKernel line_int_kernel;
+  UniformDist rng_dist;
 
-    RNGEngine rng_eng;
-    //NormalDist rng_dist(0,1); 
-    UniformDist rng_dist(-0.5, 0.5);
+  explicit LineIntAAJitter(const LineIntParams& params)
+    : do_aa(params.aa_fact != 0),
+      rng_eng((do_aa && !params.proj_setups[0].aa_offsets_wrt_cam) ?
+                  &params.thread_states->rng_eng() : nullptr),
+      rng_dist(-0.5, 0.5)
+  { }
 
+  Pt2 operator()(const size_type col_idx, const size_type row_idx)
+  {
+    Pt2 det_idx(static_cast<CoordScalar>(col_idx), static_cast<CoordScalar>(row_idx));
+    
     if (do_aa)
     {
-      std::random_device rd;
-      rng_eng.seed(rd());
+      det_idx(0) += rng_dist(*rng_eng);
+      det_idx(1) += rng_dist(*rng_eng);
     }
 
-    for (size_type range_idx = r.begin(); range_idx < r.end(); ++range_idx)
+    return det_idx;
+  }
+
+  /// \brief The detector point, with respect to the camera, of the
+  ///        aa_ray_idx'th ray cast through a pixel.
+  ///
+  /// The cached detector point of the pixel is used when not anti-aliasing.
+  Pt3 det_pt_wrt_cam(const LineIntProjSetup& proj_setup,
+                     const size_type col_idx, const size_type row_idx,
+                     const size_type aa_ray_idx)
+  {
+    const Pt3& pix_det_pt = (*proj_setup.det_pts_wrt_cam)[(row_idx * proj_setup.cam->num_det_cols) + col_idx];
+
+    if (!do_aa)
+    {
+      return pix_det_pt;
+    }
+    else if (proj_setup.aa_offsets_wrt_cam)
+    {
+      return pix_det_pt + (*proj_setup.aa_offsets_wrt_cam)[aa_ray_idx];
+    }
+    else
     {
-      // recover the original projection, row, column indices
-      const size_type proj_idx    = range_idx / num_drr_px;
-      const size_type off_in_proj = range_idx - (num_drr_px * proj_idx);
-      const size_type row_idx     = off_in_proj / params.camera_models[0].num_det_cols;
-      const size_type col_idx     = off_in_proj -
-                                            (params.camera_models[0].num_det_cols * row_idx);
+      return proj_setup.cam->ind_pt_to_phys_det_pt(operator()(col_idx, row_idx));
+    }
+  }
+};
 
-      const auto& cam = params.camera_models[params.cam_model_for_proj[proj_idx]];
-      
-      Pt2 tmp_aa_det_idx;
+/// \brief A run of pixels, within a single projection, that are processed
+///        consecutively by a task.
+///
+/// When pix_inds is null the run is contiguous, starting at pix_start,
+/// otherwise the run is given by the (row-major) pixel indices in pix_inds.
+struct LineIntPixRun
+{
+  const size_type* pix_inds;
 
-      PixelScalar2D aa_sum = 0;
+  size_type pix_start;
 
-      for (size_type aa_ray_idx = 0; aa_ray_idx < num_rays_per_pixel; ++aa_ray_idx)
+  size_type operator[](const size_type i) const
+  {
+    return pix_inds ? pix_inds[i] : (pix_start + i);
+  }
+};
+
+/// \brief Schedules the rays of every projection across tasks.
+///
+/// A tRunFn object is constructed from each context in ctxs, one for each
+/// volume, at the start of each task. Every run of pixels in the task is passed
+/// to the objects of all volumes as run_fn(proj_idx, pix_run, num_pix), so the
+/// pixels of a run are still in cache when each additional volume is added.
+/// The run functions use the interpolators and random engines kept by each
+/// thread, so constructing them for every task is inexpensive.
+/// When every pixel is computed, tiles of neighboring detector rows and columns
+/// are scheduled with the rows of all projections stacked, and each run is
+/// clipped to the detector window of each volume. Otherwise, the active pixels
+/// of all projections are compacted into a single contiguous range.
+template <class tRunFn>
+void ScheduleLineIntRays(const LineIntParams& params,
+                         const std::vector<typename tRunFn::Context>& ctxs)
+{
+  using RunFnList = std::vector<tRunFn>;
+
+  const size_type num_det_rows = params.camera_models[0].num_det_rows;
+  const size_type num_det_cols = params.camera_models[0].num_det_cols;
+
+  if (!params.active_ray_offsets)
+  {
+    auto tile_fn = [&ctxs,num_det_rows,num_det_cols] (const Range2DType& r)
+    {
+      RunFnList run_fns(ctxs.begin(), ctxs.end());
+
+      const size_type num_run_fns = run_fns.size();
+
+      for (size_type global_row_idx = r.rows().begin(); global_row_idx < r.rows().end(); ++global_row_idx)
       {
-        tmp_aa_det_idx(0) = col_idx;
-        tmp_aa_det_idx(1) = row_idx;
+        const size_type proj_idx = global_row_idx / num_det_rows;
+        const size_type row_idx  = global_row_idx - (num_det_rows * proj_idx);
 
-        if (do_aa)
+        for (size_type fn_idx = 0; fn_idx < num_run_fns; ++fn_idx)
         {
-          tmp_aa_det_idx(0) += rng_dist(rng_eng);
-          tmp_aa_det_idx(1) += rng_dist(rng_eng);
+          const LineIntProjSetup& proj_setup = ctxs[fn_idx].params.proj_setups[proj_idx];
+
+          const size_type col_begin = std::max(r.cols().begin(), proj_setup.win_col_begin);
+          const size_type col_end   = std::min(r.cols().end(), proj_setup.win_col_end);
+
+          if ((row_idx >= proj_setup.win_row_begin) && (row_idx < proj_setup.win_row_end) &&
+              (col_begin < col_end))
+          {
+            const LineIntPixRun pix_run = { nullptr, (row_idx * num_det_cols) + col_begin };
+
+            run_fns[fn_idx](proj_idx, pix_run, col_end - col_begin);
+          }
         }
-        
-        // This point is stored with respect to the camera's
-        // "world" coordinates
-        const Pt3 cur_det_pt_wrt_cam = cam.ind_pt_to_phys_det_pt(tmp_aa_det_idx);
+      }
+    };
+
+    ParallelFor(tile_fn, Range2DType(0, params.num_projs * num_det_rows, kLINE_INT_TILE_NUM_ROWS,
+                                     0, num_det_cols, kLINE_INT_TILE_NUM_COLS));
+  }
+  else
+  {
+    // offset of the first compacted ray of each projection, with the total
+    // number of rays stored last
+    const std::vector<size_type>& ray_offs = *params.active_ray_offsets;
+    
+    auto sparse_fn = [&ctxs,&params,&ray_offs] (const RangeType& r)
+    {
+      RunFnList run_fns(ctxs.begin(), ctxs.end());
+
+      // the last projection starting at or before the first ray of the range
+      size_type proj_idx = static_cast<size_type>(
+                              std::upper_bound(ray_offs.begin(), ray_offs.end(), r.begin()) -
+                                                                          ray_offs.begin()) - 1;
 
-        // The current transformation from detector coordinates to ITK indices
-        const FrameTransform xform_cam_to_itk_idx =
-                        params.itk_phys_pt_to_itk_idx_xform * params.xforms_cam_to_itk_phys[proj_idx];
+      size_type ray_idx = r.begin();
 
-        // Position of the X-Ray source / pinhole point in ITK indices
-        const Pt3 pinhole_wrt_itk_idx = xform_cam_to_itk_idx * cam.pinhole_pt;
-        //std::cout << "pinhole_wrt_itk_idx = " << pinhole_wrt_itk_idx << std::endl;
+      while (ray_idx < r.end())
+      {
+        // skip over projections without any active pixels
+        while (ray_offs[proj_idx + 1] <= ray_idx)
+        {
+          ++proj_idx;
+        }
+
+        const size_type run_end = std::min(r.end(), ray_offs[proj_idx + 1]);
+
+        const LineIntPixRun pix_run = {
+                  &(*params.proj_setups[proj_idx].active_pix_inds)[ray_idx - ray_offs[proj_idx]], 0 };
+
+        for (auto& run_fn : run_fns)
+        {
+          run_fn(proj_idx, pix_run, run_end - ray_idx);
+        }
+
+        ray_idx = run_end;
+      }
+    };
+
+    ParallelFor(sparse_fn, RangeType(0, ray_offs.back()));
+  }
+}
+
+/// \brief Computes the maximum along a ray, skipping the samples that cannot
+///        increase the running maximum.
+///
+/// The brick maxima bound the nearest neighbor and linear interpolations, so
+/// any brick with a maximum that does not exceed the running maximum is jumped
+/// over, as is the remainder of a brick once its maximum has been attained.
+/// The ray is terminated once the maximum of the entire volume is attained.
+/// This may only be used with kernels that compute a maximum. The result is
+/// scaled by the step size, consistent with MarchLineIntPacket.
+template <class tKernel, class tInterp>
+RayCaster::PixelScalar3D
+MarchLineIntMaxBounded(const tKernel& line_int_kernel,
+                       const tInterp& interp,
+                       const CoordScalar step_size,
+                       const LineIntRaySeg& seg,
+                       const RayCastVolBrickGrid& grid)
+{
+  using PixelScalar = RayCaster::PixelScalar3D;
+
+  PixelScalar acc = line_int_kernel.init_val();
+
+  std::int64_t step_idx = 0;
+
+  while ((step_idx <= seg.num_steps) && (acc < grid.max_val))
+  {
+    const RayCastBrickIsAtMost cannot_increase = { grid, acc };
+
+    step_idx = RayCastSkipBricks(grid, cannot_increase,
+                                 seg.start_pt_wrt_itk_idx, seg.step_vec_wrt_itk_idx,
+                                 step_idx, seg.num_steps);
+
+    if (step_idx <= seg.num_steps)
+    {
+      Pt3 cur_pt = seg.start_pt_wrt_itk_idx +
+                      (static_cast<CoordScalar>(step_idx) * seg.step_vec_wrt_itk_idx);
+
+      const PixelScalar brick_max = grid.brick_max[grid.brick_idx(cur_pt[0], cur_pt[1], cur_pt[2])];
+
+      // the last sample in the current brick
+      const std::int64_t stop_idx = std::min(seg.num_steps, step_idx - 1 +
+                                      RayCastNumStepsToExitBrick(grid, seg.start_pt_wrt_itk_idx,
+                                                                 seg.step_vec_wrt_itk_idx, step_idx));
+
+      for (; (step_idx <= stop_idx) && (acc < brick_max); ++step_idx)
+      {
+        acc = line_int_kernel(acc, interp(cur_pt[0], cur_pt[1], cur_pt[2]));
+
+        cur_pt += seg.step_vec_wrt_itk_idx;
+      }
+
+      step_idx = stop_idx + 1;
+    }
+  }
+
+  return (seg.num_steps >= 0) ? (acc * step_size) : acc;
+}
+
+/// \brief Computation task for evaluating a collection of line integrals.
+///
+/// The collection of line integrals is not necessarily restricted to a single projection.
+/// Each volume sample is computed using an ITK interpolator object, which
+/// supports all interpolation methods, but requires a virtual function call
+/// for every sample.
+template <class tKernel>
+struct LineIntITKRunFn
+{
+  using LineIntKernel = tKernel;
+
+  using PixelScalar2D = RayCaster::PixelScalar2D;
+
+  using Vol = RayCaster::Vol;
+
+  using VolInterpType = itk::InterpolateImageFunction<Vol,CoordScalar>;
+
+  struct Context
+  {
+    const LineIntParams& params;
+
+    PixelScalar2D* proj_buf;
+  };
+
+  const LineIntParams& params;
+
+  PixelScalar2D* proj_buf;
+
+  const size_type num_pix_per_proj;
+  const size_type num_det_cols;
+
+  const size_type num_rays_per_pixel;
+
+  const PixelScalar2D one_over_num_rays_per_pixel;
+
+  LineIntKernel line_int_kernel;
+
+  LineIntAAJitter aa_jitter;
+
+  typename VolInterpType::Pointer vol_interp;
+
+  explicit LineIntITKRunFn(const Context& ctx)
+    : params(ctx.params), proj_buf(ctx.proj_buf),
+      num_pix_per_proj(ctx.params.camera_models[0].num_det_rows *
+                       ctx.params.camera_models[0].num_det_cols),
+      num_det_cols(ctx.params.camera_models[0].num_det_cols),
+      num_rays_per_pixel(ctx.params.aa_fact ? ctx.params.aa_fact : 1),
+      one_over_num_rays_per_pixel(PixelScalar2D(1) / static_cast<PixelScalar2D>(num_rays_per_pixel)),
+      aa_jitter(ctx.params),
+      vol_interp(ctx.params.thread_states->interp(ctx.params.interp_method, ctx.params.img_vol,
+                                                  ctx.params.bspline_coefs))
+  { }
+
+  PixelScalar2D line_int(const LineIntRaySeg& seg)
+  {
+    if (params.max_bound_grid)
+    {
+      const VolInterpType* interp = vol_interp.GetPointer();
+
+      auto interp_fn = [interp] (const CoordScalar x, const CoordScalar y, const CoordScalar z)
+      {
+        itk::ContinuousIndex<CoordScalar,3> cont_idx;
+        cont_idx[0] = x;
+        cont_idx[1] = y;
+        cont_idx[2] = z;
 
-        // Vector from the pinhole point to detector bin in ITK index coordinates
-        const Pt3 pinhole_to_det_wrt_itk_idx =
-                      (xform_cam_to_itk_idx * cur_det_pt_wrt_cam) - pinhole_wrt_itk_idx;
+        return interp->EvaluateAtContinuousIndex(cont_idx);
+      };
 
-        CoordScalar t_start = 0;
-        CoordScalar t_stop  = 0;
+      return MarchLineIntMaxBounded(line_int_kernel, interp_fn, params.step_size,
+                                    seg, *params.max_bound_grid);
+    }
 
-        PixelScalar2D sum = line_int_kernel.init_val();
+    PixelScalar2D sum = line_int_kernel.init_val();
 
-        constexpr CoordScalar kVOL_BB_STEP_INC_TOL = RayCasterLineIntCPU::kVOL_BB_STEP_INC_TOL;
+    if (seg.num_steps >= 0)
+    {
+      // We'll use the ITK objects now, since that is the easiest interface
+      // with itk::Image and itk interpolation
+      itk::ContinuousIndex<CoordScalar,3> cur_cont_vol_idx;
+      cur_cont_vol_idx[0] = seg.start_pt_wrt_itk_idx[0];
+      cur_cont_vol_idx[1] = seg.start_pt_wrt_itk_idx[1];
+      cur_cont_vol_idx[2] = seg.start_pt_wrt_itk_idx[2];
+
+      itk::Vector<CoordScalar,3> tmp_step_vec_wrt_itk_idx;
+      tmp_step_vec_wrt_itk_idx[0] = seg.step_vec_wrt_itk_idx[0];
+      tmp_step_vec_wrt_itk_idx[1] = seg.step_vec_wrt_itk_idx[1];
+      tmp_step_vec_wrt_itk_idx[2] = seg.step_vec_wrt_itk_idx[2];
+
+      if (!params.brick_grid)
+      {
+        for (std::int64_t step_idx = 0; step_idx <= seg.num_steps; ++step_idx)
+        {
+          //xregASSERT(img_vol_interp->IsInsideBuffer(cur_cont_vol_idx));
+          sum = line_int_kernel(sum,
+                  vol_interp->EvaluateAtContinuousIndex(cur_cont_vol_idx));
 
-        bool inter_vol = false;
+          cur_cont_vol_idx += tmp_step_vec_wrt_itk_idx;
+        }
+      }
+      else
+      {
+        // jump over any empty bricks in the interior of the ray
+        const RayCastBrickIsEmpty is_empty = { *params.brick_grid };
 
-        std::tie(inter_vol,t_start,t_stop) = RayRectIntersect(params.img_aabb_min, params.img_aabb_max,
-                                                              pinhole_wrt_itk_idx, pinhole_to_det_wrt_itk_idx,
-                                                              true);  // true -> limit intersection to line segment
+        std::int64_t step_idx = 0;
 
-        // Besides intersecting, need to be able to nudge inward a bit to avoid an
-        // ITK crash when interpolating on edge
-        if (inter_vol && ((t_stop - t_start) > CoordScalar(2 * kVOL_BB_STEP_INC_TOL)))
+        while (step_idx <= seg.num_steps)
         {
-          t_start += kVOL_BB_STEP_INC_TOL;
-          t_stop  -= kVOL_BB_STEP_INC_TOL;
-          
-          // the first index on the line from source to detector that lies within
-          // the volume bounds
-          const Pt3 start_pt_wrt_itk_idx = pinhole_wrt_itk_idx +
-                                                (t_start * pinhole_to_det_wrt_itk_idx);
-
-          const CoordScalar pinhole_to_det_len_wrt_itk_idx =
-                                                pinhole_to_det_wrt_itk_idx.norm();
-          const CoordScalar intersect_len_wrt_itk_idx =
-                                    (t_stop - t_start) * pinhole_to_det_len_wrt_itk_idx;
-
-          // Rotate and scale the step vector to get it wrt ITK indices
-          const CoordScalar step_len_wrt_itk_idx =
-             (xform_cam_to_itk_idx.matrix().block(0,0,3,3) *
-              ((cur_det_pt_wrt_cam - cam.pinhole_pt).normalized() * params.step_size)).norm();
-
-          const size_type num_steps =
-              static_cast<size_type>(intersect_len_wrt_itk_idx / step_len_wrt_itk_idx);
-
-          // We'll use the ITK objects now, since that is the easiest interface
-          // with itk::Image and itk interpolation
-          itk::ContinuousIndex<CoordScalar,3> cur_cont_vol_idx;
-          cur_cont_vol_idx[0] = start_pt_wrt_itk_idx[0];
-          cur_cont_vol_idx[1] = start_pt_wrt_itk_idx[1];
-          cur_cont_vol_idx[2] = start_pt_wrt_itk_idx[2];
-
-          const CoordScalar scale_to_step = step_len_wrt_itk_idx /
-                                                    pinhole_to_det_len_wrt_itk_idx;
-          itk::Vector<CoordScalar,3> tmp_step_vec_wrt_itk_idx;
-          tmp_step_vec_wrt_itk_idx[0] = pinhole_to_det_wrt_itk_idx[0] * scale_to_step;
-          tmp_step_vec_wrt_itk_idx[1] = pinhole_to_det_wrt_itk_idx[1] * scale_to_step;
-          tmp_step_vec_wrt_itk_idx[2] = pinhole_to_det_wrt_itk_idx[2] * scale_to_step;
-
-          for (size_type step_idx = 0; step_idx <= num_steps; ++step_idx)
+          step_idx = RayCastSkipBricks(*params.brick_grid, is_empty,
+                                       seg.start_pt_wrt_itk_idx, seg.step_vec_wrt_itk_idx,
+                                       step_idx, seg.num_steps);
+
+          if (step_idx <= seg.num_steps)
           {
-            //xregASSERT(img_vol_interp->IsInsideBuffer(cur_cont_vol_idx));
+            const Pt3 cur_pt = seg.start_pt_wrt_itk_idx +
+                     (static_cast<CoordScalar>(step_idx) * seg.step_vec_wrt_itk_idx);
+
+            cur_cont_vol_idx[0] = cur_pt[0];
+            cur_cont_vol_idx[1] = cur_pt[1];
+            cur_cont_vol_idx[2] = cur_pt[2];
+
             sum = line_int_kernel(sum,
                     vol_interp->EvaluateAtContinuousIndex(cur_cont_vol_idx));
 
-            cur_cont_vol_idx += tmp_step_vec_wrt_itk_idx;
+            ++step_idx;
           }
-
-          sum *= params.step_size;
         }
-         
-        aa_sum += sum * one_over_num_rays_per_pixel;
       }
-      
-      proj_buf[range_idx] = line_int_kernel(proj_buf[range_idx], aa_sum);
-    }
-  };
 
-  ParallelFor(line_int_fn, full_range);
-}
+      sum *= params.step_size;
+    }
 
-}  // un-named
+    return sum;
+  }
 
-void xreg::RayCasterLineIntCPU::compute(const size_type vol_idx)
-{
-  xregASSERT(this->resources_allocated_);
-  
-  // Get the index bounding box (axis-aligned in the index space) of the volume
-  Pt3 img_aabb_min;
-  Pt3 img_aabb_max;
-  std::tie(img_aabb_min,img_aabb_max) = ITKImageIndexBoundsAsEigen(this->vols_[vol_idx].GetPointer());
+  void operator()(const size_type proj_idx, const LineIntPixRun& pix_run, const size_type num_pix)
+  {
+    const LineIntProjSetup& proj_setup = params.proj_setups[proj_idx];
 
-  //std::cout << "img_aabb_min: " << img_aabb_min << std::endl;
-  //std::cout << "img_aabb_max: " << img_aabb_max << std::endl;
+    PixelScalar2D* cur_proj_buf = proj_buf + (proj_idx * num_pix_per_proj);
 
-  // Compute the frame transform from ITK physical space to index space (sR + t)
-  const FrameTransform itk_idx_to_itk_phys_pt_xform = ITKImagePhysicalPointTransformsAsEigen(this->vols_[vol_idx].GetPointer());
+    for (size_type i = 0; i < num_pix; ++i)
+    {
+      const size_type pix_idx = pix_run[i];
+      const size_type row_idx = pix_idx / num_det_cols;
+      const size_type col_idx = pix_idx - (row_idx * num_det_cols);
 
-  const FrameTransform itk_phys_pt_to_itk_idx_xform = itk_idx_to_itk_phys_pt_xform.inverse();
+      PixelScalar2D aa_sum = 0;
 
-  //std::cout << "physical point to index xform:\n" << itk_phys_pt_to_itk_idx_xform.matrix() << std::endl;
+      for (size_type aa_ray_idx = 0; aa_ray_idx < num_rays_per_pixel; ++aa_ray_idx)
+      {
+        aa_sum += line_int(SetupLineIntRaySeg(params, proj_setup,
+                              aa_jitter.det_pt_wrt_cam(proj_setup, col_idx, row_idx, aa_ray_idx))) *
+                                                                  one_over_num_rays_per_pixel;
+      }
+    
+      cur_proj_buf[pix_idx] = line_int_kernel(cur_proj_buf[pix_idx], aa_sum);
+    }
+  }
+};
 
-  this->pre_compute();
+template <class tKernel>
+void ComputeLineInts(const LineIntParamsList& vol_params,
+                     RayCaster::PixelScalar2D* proj_buf)
+{
+  using RunFn = LineIntITKRunFn<tKernel>;
 
-  const LineIntParams line_int_params = { this->aa_fact_,
-                                          this->vols_[vol_idx],
-                                          img_aabb_min,
-                                          img_aabb_max,
-                                          itk_phys_pt_to_itk_idx_xform,
-                                          this->num_projs_,
-                                          this->camera_models_,
-                                          this->xforms_cam_to_itk_phys_,
-                                          this->cam_model_for_proj_,
-                                          this->ray_step_size_,
-                                          this->interp_method_
-                                        };
-  
-  auto* proj_buf = this->pixel_buf_to_use();
+  std::vector<typename RunFn::Context> ctxs;
+  ctxs.reserve(vol_params.size());
 
-  const RangeType full_range(0,
-                             this->num_projs_ *
-                             this->camera_models_[0].num_det_rows *
-                             this->camera_models_[0].num_det_cols);
-  
-  switch (this->kernel_id())
+  for (const auto& params : vol_params)
   {
-    case kRAY_CAST_LINE_INT_SUM_KERNEL:
-      ComputeLineInts<AccumLineIntKernel>(line_int_params, proj_buf, full_range);
-      break;
-    case kRAY_CAST_LINE_INT_MAX_KERNEL:
-      ComputeLineInts<MaxLineIntKernel>(line_int_params, proj_buf, full_range);
-      break;
-    default:
-      xregThrow("Unsupported Line Integral Kernel!");
+    ctxs.push_back({ params, proj_buf });
   }
 
-  this->sync_to_ocl_.set_modified();
-  this->sync_to_host_.set_modified();
+  ScheduleLineIntRays<RunFn>(vol_params[0], ctxs);
 }
 
+/// \brief Marches a packet of rays through the volume together.
+///
+/// The rays are stored in a "structure of arrays" layout and every lane
+/// performs the same number of interpolations, with the results of lanes that
+/// have already exited the volume being discarded. This allows the compiler to
+/// emit SIMD instructions (e.g. AVX2/AVX-512 gathers or NEON) for the
+/// interpolations and kernel updates when the appropriate architecture flags
+/// are provided (see XREG_ENABLE_NATIVE_ARCH).
+/// Lanes at index num_rays and beyond are unused.
+template <size_type tPacketSize, class tKernel, class tInterp>
+void MarchLineIntPacket(const tKernel& line_int_kernel,
+                        const tInterp& interp,
+                        const CoordScalar step_size,
+                        const LineIntRaySeg* segs,
+                        const size_type num_rays,
+                        RayCaster::PixelScalar2D* sums)
+{
+  using PixelScalar = RayCaster::PixelScalar3D;
+
+  CoordScalar x[tPacketSize];
+  CoordScalar y[tPacketSize];
+  CoordScalar z[tPacketSize];
+
+  CoordScalar step_x[tPacketSize];
+  CoordScalar step_y[tPacketSize];
+  CoordScalar step_z[tPacketSize];
+
+  std::int64_t num_steps[tPacketSize];
+
+  PixelScalar acc[tPacketSize];
+
+  std::int64_t max_num_steps = -1;
+
+  for (size_type lane = 0; lane < tPacketSize; ++lane)
+  {
+    acc[lane] = line_int_kernel.init_val();
+
+    if ((lane < num_rays) && (segs[lane].num_steps >= 0))
+    {
+      const LineIntRaySeg& seg = segs[lane];
+
+      x[lane] = seg.start_pt_wrt_itk_idx[0];
+      y[lane] = seg.start_pt_wrt_itk_idx[1];
+      z[lane] = seg.start_pt_wrt_itk_idx[2];
+
+      step_x[lane] = seg.step_vec_wrt_itk_idx[0];
+      step_y[lane] = seg.step_vec_wrt_itk_idx[1];
+      step_z[lane] = seg.step_vec_wrt_itk_idx[2];
+
+      num_steps[lane] = seg.num_steps;
+
+      max_num_steps = std::max(max_num_steps, seg.num_steps);
+    }
+    else
+    {
+      x[lane] = 0;
+      y[lane] = 0;
+      z[lane] = 0;
+
+      step_x[lane] = 0;
+      step_y[lane] = 0;
+      step_z[lane] = 0;
+
+      num_steps[lane] = -1;
+    }
+  }
+
+  for (std::int64_t step_idx = 0; step_idx <= max_num_steps; ++step_idx)
+  {
+    // no branching within this loop, so that it may be vectorized
+    for (size_type lane = 0; lane < tPacketSize; ++lane)
+    {
+      const PixelScalar v = interp(x[lane], y[lane], z[lane]);
+
+      acc[lane] = (step_idx <= num_steps[lane]) ? line_int_kernel(acc[lane], v) : acc[lane];
+
+      x[lane] += step_x[lane];
+      y[lane] += step_y[lane];
+      z[lane] += step_z[lane];
+    }
+  }
+
+  for (size_type lane = 0; lane < num_rays; ++lane)
+  {
+    sums[lane] = (num_steps[lane] >= 0) ? (acc[lane] * step_size) : acc[lane];
+  }
+}
+
+/// \brief Computation task for evaluating a collection of line integrals
+///        using packets of neighboring rays.
+///
+/// The volume is sampled directly from its raw buffer using tInterp, which
+/// avoids the virtual function call of the ITK interpolators.
+template <size_type tPacketSize, class tKernel, class tInterp>
+struct LineIntPacketRunFn
+{
+  using LineIntKernel = tKernel;
+
+  using PixelScalar2D = RayCaster::PixelScalar2D;
+
+  struct Context
+  {
+    const LineIntParams& params;
+
+    const tInterp& interp;
+
+    PixelScalar2D* proj_buf;
+  };
+
+  const Context& ctx;
+
+  const size_type num_pix_per_proj;
+  const size_type num_det_cols;
+
+  const size_type num_rays_per_pixel;
+
+  const PixelScalar2D one_over_num_rays_per_pixel;
+
+  LineIntKernel line_int_kernel;
+
+  LineIntAAJitter aa_jitter;
+
+  LineIntRaySeg segs[tPacketSize];
+  
+  PixelScalar2D packet_sums[tPacketSize];
+  PixelScalar2D aa_sums[tPacketSize];
+
+  explicit LineIntPacketRunFn(const Context& c)
+    : ctx(c),
+      num_pix_per_proj(c.params.camera_models[0].num_det_rows *
+                       c.params.camera_models[0].num_det_cols),
+      num_det_cols(c.params.camera_models[0].num_det_cols),
+      num_rays_per_pixel(c.params.aa_fact ? c.params.aa_fact : 1),
+      one_over_num_rays_per_pixel(PixelScalar2D(1) / static_cast<PixelScalar2D>(num_rays_per_pixel)),
+      aa_jitter(c.params)
+  { }
+
+  // a run is from a single projection, so each packet of consecutive pixels
+  // in the run is also from a single projection
+  void operator()(const size_type proj_idx, const LineIntPixRun& pix_run, const size_type num_pix)
+  {
+    const LineIntProjSetup& proj_setup = ctx.params.proj_setups[proj_idx];
+
+    PixelScalar2D* cur_proj_buf = ctx.proj_buf + (proj_idx * num_pix_per_proj);
+
+    for (size_type packet_start = 0; packet_start < num_pix; packet_start += tPacketSize)
+    {
+      const size_type num_rays_in_packet = std::min(tPacketSize, num_pix - packet_start);
+
+      std::fill(aa_sums, aa_sums + tPacketSize, PixelScalar2D(0));
+
+      for (size_type aa_ray_idx = 0; aa_ray_idx < num_rays_per_pixel; ++aa_ray_idx)
+      {
+        for (size_type lane = 0; lane < num_rays_in_packet; ++lane)
+        {
+          const size_type pix_idx = pix_run[packet_start + lane];
+          const size_type row_idx = pix_idx / num_det_cols;
+
+          segs[lane] = SetupLineIntRaySeg(ctx.params, proj_setup,
+                          aa_jitter.det_pt_wrt_cam(proj_setup,
+                                                   pix_idx - (row_idx * num_det_cols), row_idx,
+                                                   aa_ray_idx));
+        }
+
+        if (ctx.params.max_bound_grid)
+        {
+          // the lanes diverge when skipping bricks, so march each ray separately
+          for (size_type lane = 0; lane < num_rays_in_packet; ++lane)
+          {
+            packet_sums[lane] = MarchLineIntMaxBounded(line_int_kernel, ctx.interp,
+                                                       ctx.params.step_size, segs[lane],
+                                                       *ctx.params.max_bound_grid);
+          }
+        }
+        else
+        {
+          MarchLineIntPacket<tPacketSize>(line_int_kernel, ctx.interp, ctx.params.step_size,
+                                          segs, num_rays_in_packet, packet_sums);
+        }
+
+        for (size_type lane = 0; lane < num_rays_in_packet; ++lane)
+        {
+          aa_sums[lane] += packet_sums[lane] * one_over_num_rays_per_pixel;
+        }
+      }
+
+      for (size_type lane = 0; lane < num_rays_in_packet; ++lane)
+      {
+        PixelScalar2D& dst_pix = cur_proj_buf[pix_run[packet_start + lane]];
+        
+        dst_pix = line_int_kernel(dst_pix, aa_sums[lane]);
+      }
+    }
+  }
+};
+
+template <size_type tPacketSize, class tKernel, class tInterp>
+void ComputeLineIntsPacket(const LineIntParamsList& vol_params,
+                           const std::vector<tInterp>& interps,
+                           RayCaster::PixelScalar2D* proj_buf)
+{
+  using RunFn = LineIntPacketRunFn<tPacketSize,tKernel,tInterp>;
+
+  const size_type num_vols = vol_params.size();
+
+  std::vector<typename RunFn::Context> ctxs;
+  ctxs.reserve(num_vols);
+
+  for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
+  {
+    ctxs.push_back({ vol_params[vol_idx], interps[vol_idx], proj_buf });
+  }
+
+  ScheduleLineIntRays<RunFn>(vol_params[0], ctxs);
+}
+
+template <class tKernel, class tInterp>
+void ComputeLineIntsPacketDispatch(const size_type packet_size,
+                                   const LineIntParamsList& vol_params,
+                                   const std::vector<tInterp>& interps,
+                                   RayCaster::PixelScalar2D* proj_buf)
+{
+  switch (packet_size)
+  {
+    case 1:
+      ComputeLineIntsPacket<1,tKernel>(vol_params, interps, proj_buf);
+      break;
+    case 4:
+      ComputeLineIntsPacket<4,tKernel>(vol_params, interps, proj_buf);
+      break;
+    case 8:
+      ComputeLineIntsPacket<8,tKernel>(vol_params, interps, proj_buf);
+      break;
+    case 16:
+      ComputeLineIntsPacket<16,tKernel>(vol_params, interps, proj_buf);
+      break;
+    default:
+      xregThrow("Unsupported ray packet size: %lu", static_cast<unsigned long>(packet_size));
+  }
+}
+
+/// \brief Computes a line integral by visiting each voxel intersected by a ray
+///        exactly once.
+///
+/// This is Siddon's method using the incremental parameter updates of Jacobs
+/// et al. The ray is given by pinhole_wrt_itk_idx + t * pinhole_to_det_wrt_itk_idx,
+/// for t in [0,1], and voxel i is treated as occupying [i - 0.5, i + 0.5] in
+/// continuous index coordinates. Only the portion of the ray within the
+/// voxel bounds, vox_bounds_min and vox_bounds_max, is traversed.
+/// When the kernel weights by length, each voxel value is weighted by the
+/// physical length of its intersection with the ray (phys_len is the physical
+/// length of the entire ray). Otherwise the kernel is applied to the raw voxel
+/// values and the result is scaled by the step size, consistent with the
+/// sampled kernels.
+template <class tKernel>
+RayCaster::PixelScalar3D
+SiddonLineInt(const tKernel& line_int_kernel,
+              const RayCastVolBufCPU& vol,
+              const Pt3& vox_bounds_min,
+              const Pt3& vox_bounds_max,
+              const Pt3& pinhole_wrt_itk_idx,
+              const Pt3& pinhole_to_det_wrt_itk_idx,
+              const CoordScalar phys_len,
+              const CoordScalar step_size)
+{
+  using PixelScalar = RayCaster::PixelScalar3D;
+
+  const std::int32_t vol_size[3] = { vol.size_x, vol.size_y, vol.size_z };
+
+  const std::int64_t vol_strides[3] = { 1, vol.stride_y, vol.stride_z };
+
+  PixelScalar acc = line_int_kernel.init_val();
+
+  CoordScalar t_start = 0;
+  CoordScalar t_stop  = 0;
+
+  bool inter_vol = false;
+
+  std::tie(inter_vol,t_start,t_stop) = RayRectIntersect(vox_bounds_min, vox_bounds_max,
+                                                        pinhole_wrt_itk_idx, pinhole_to_det_wrt_itk_idx,
+                                                        true);  // true -> limit intersection to line segment
+
+  if (inter_vol && (t_stop > t_start))
+  {
+    // find the first voxel using a point that is just inside the volume, this
+    // avoids ambiguity when the entry point lies on a voxel boundary
+    const Pt3 entry_pt = pinhole_wrt_itk_idx +
+                            ((t_start + (CoordScalar(1.0e-4) * (t_stop - t_start))) *
+                                                          pinhole_to_det_wrt_itk_idx);
+
+    std::int32_t vox_idx[3];
+    std::int32_t vox_step[3];
+
+    CoordScalar t_next[3];
+    CoordScalar t_delta[3];
+
+    std::int64_t vox_off = 0;
+
+    for (int a = 0; a < 3; ++a)
+    {
+      vox_idx[a] = detail::RayCastClampIdx(
+                      static_cast<std::int32_t>(std::floor(entry_pt[a] + CoordScalar(0.5))),
+                      vol_size[a] - 1);
+
+      vox_off += vox_idx[a] * vol_strides[a];
+
+      const CoordScalar d = pinhole_to_det_wrt_itk_idx[a];
+      
+      if (d > 0)
+      {
+        vox_step[a] = 1;
+        t_delta[a]  = 1 / d;
+        t_next[a]   = ((vox_idx[a] + CoordScalar(0.5)) - pinhole_wrt_itk_idx[a]) / d;
+      }
+      else if (d < 0)
+      {
+        vox_step[a] = -1;
+        t_delta[a]  = -1 / d;
+        t_next[a]   = ((vox_idx[a] - CoordScalar(0.5)) - pinhole_wrt_itk_idx[a]) / d;
+      }
+      else
+      {
+        vox_step[a] = 0;
+        t_delta[a]  = std::numeric_limits<CoordScalar>::max();
+        t_next[a]   = std::numeric_limits<CoordScalar>::max();
+      }
+    }
+
+    CoordScalar t_cur = t_start;
+
+    while (t_cur < t_stop)
+    {
+      // the next voxel boundary crossed determines the axis to step along
+      const int a = (t_next[0] < t_next[1]) ? ((t_next[0] < t_next[2]) ? 0 : 2) :
+                                              ((t_next[1] < t_next[2]) ? 1 : 2);
+
+      const CoordScalar t_end = std::min(t_next[a], t_stop);
+
+      const PixelScalar v = vol.buf[vox_off];
+
+      acc = line_int_kernel(acc, tKernel::kWEIGHT_BY_LEN ? (v * (t_end - t_cur)) : v);
+
+      t_cur = t_end;
+
+      vox_idx[a] += vox_step[a];
+
+      if ((vox_idx[a] < 0) || (vox_idx[a] >= vol_size[a]))
+      {
+        break;
+      }
+
+      vox_off   += vox_step[a] * vol_strides[a];
+      t_next[a] += t_delta[a];
+    }
+
+    acc *= tKernel::kWEIGHT_BY_LEN ? phys_len : step_size;
+  }
+
+  return acc;
+}
+
+/// \brief Computation task for evaluating a collection of line integrals
+///        using exact voxel traversals.
+template <class tKernel>
+struct LineIntSiddonRunFn
+{
+  using LineIntKernel = tKernel;
+
+  using PixelScalar2D = RayCaster::PixelScalar2D;
+
+  struct Context
+  {
+    const LineIntParams& params;
+
+    const RayCastVolBufCPU& vol;
+
+    // the corners of the voxels on the boundary
+    const Pt3& vox_bounds_min;
+    const Pt3& vox_bounds_max;
+
+    PixelScalar2D* proj_buf;
+  };
+
+  const Context& ctx;
+
+  const size_type num_pix_per_proj;
+  const size_type num_det_cols;
+
+  const size_type num_rays_per_pixel;
+
+  const PixelScalar2D one_over_num_rays_per_pixel;
+
+  LineIntKernel line_int_kernel;
+
+  LineIntAAJitter aa_jitter;
+
+  explicit LineIntSiddonRunFn(const Context& c)
+    : ctx(c),
+      num_pix_per_proj(c.params.camera_models[0].num_det_rows *
+                       c.params.camera_models[0].num_det_cols),
+      num_det_cols(c.params.camera_models[0].num_det_cols),
+      num_rays_per_pixel(c.params.aa_fact ? c.params.aa_fact : 1),
+      one_over_num_rays_per_pixel(PixelScalar2D(1) / static_cast<PixelScalar2D>(num_rays_per_pixel)),
+      aa_jitter(c.params)
+  { }
+
+  void operator()(const size_type proj_idx, const LineIntPixRun& pix_run, const size_type num_pix)
+  {
+    const LineIntProjSetup& proj_setup = ctx.params.proj_setups[proj_idx];
+
+    const CameraModel& cam = *proj_setup.cam;
+
+    PixelScalar2D* cur_proj_buf = ctx.proj_buf + (proj_idx * num_pix_per_proj);
+
+    for (size_type i = 0; i < num_pix; ++i)
+    {
+      const size_type pix_idx = pix_run[i];
+      const size_type row_idx = pix_idx / num_det_cols;
+      const size_type col_idx = pix_idx - (row_idx * num_det_cols);
+
+      PixelScalar2D aa_sum = 0;
+
+      for (size_type aa_ray_idx = 0; aa_ray_idx < num_rays_per_pixel; ++aa_ray_idx)
+      {
+        const Pt3 cur_det_pt_wrt_cam = aa_jitter.det_pt_wrt_cam(proj_setup, col_idx, row_idx, aa_ray_idx);
+
+        aa_sum += SiddonLineInt(line_int_kernel, ctx.vol, ctx.vox_bounds_min, ctx.vox_bounds_max,
+                                proj_setup.pinhole_wrt_itk_idx,
+                                (proj_setup.xform_cam_to_itk_idx * cur_det_pt_wrt_cam) -
+                                                                proj_setup.pinhole_wrt_itk_idx,
+                                (cur_det_pt_wrt_cam - cam.pinhole_pt).norm(),
+                                ctx.params.step_size) * one_over_num_rays_per_pixel;
+      }
+      
+      cur_proj_buf[pix_idx] = line_int_kernel(cur_proj_buf[pix_idx], aa_sum);
+    }
+  }
+};
+
+template <class tKernel>
+void ComputeLineIntsSiddon(const LineIntParamsList& vol_params,
+                           RayCaster::PixelScalar2D* proj_buf)
+{
+  using RunFn = LineIntSiddonRunFn<tKernel>;
+
+  const size_type num_vols = vol_params.size();
+
+  // the contexts reference these, so they are not resized after being populated
+  std::vector<RayCastVolBufCPU> vols;
+  vols.reserve(num_vols);
+
+  Pt3List vox_bounds_mins;
+  vox_bounds_mins.reserve(num_vols);
+
+  Pt3List vox_bounds_maxs;
+  vox_bounds_maxs.reserve(num_vols);
+
+  std::vector<typename RunFn::Context> ctxs;
+  ctxs.reserve(num_vols);
+
+  for (const auto& params : vol_params)
+  {
+    vols.push_back(MakeRayCastVolBufCPU(params.img_vol));
+
+    // the corners of the voxels on the boundary, which are 0.5 beyond the
+    // voxel centers
+    vox_bounds_mins.push_back(params.img_aabb_min.array() - CoordScalar(0.5));
+    vox_bounds_maxs.push_back(params.img_aabb_max.array() + CoordScalar(0.5));
+
+    ctxs.push_back({ params, vols.back(), vox_bounds_mins.back(), vox_bounds_maxs.back(), proj_buf });
+  }
+
+  ScheduleLineIntRays<RunFn>(vol_params[0], ctxs);
+}
+
+/// \brief Creates a direct interpolator for the volume buffer view of each volume.
+template <class tInterp, class tVolBuf>
+std::vector<tInterp> MakeLineIntInterps(const std::vector<tVolBuf>& vol_bufs)
+{
+  std::vector<tInterp> interps;
+  interps.reserve(vol_bufs.size());
+
+  for (const auto& vol_buf : vol_bufs)
+  {
+    interps.push_back({ vol_buf });
+  }
+
+  return interps;
+}
+
+/// \brief Runs the packet ray marching with a direct interpolator on the
+///        volume buffer view (raster or bricked) of each volume.
+///
+/// Returns false when the interpolation method is not supported by the direct
+/// interpolators.
+template <class tKernel, class tVolBuf>
+bool ComputeLineIntsPacketInterpDispatch(const size_type packet_size,
+                                         const LineIntParamsList& vol_params,
+                                         const std::vector<tVolBuf>& vol_bufs,
+                                         RayCaster::PixelScalar2D* proj_buf)
+{
+  switch (vol_params[0].interp_method)
+  {
+    case RayCaster::kRAY_CAST_INTERP_LINEAR:
+    {
+      ComputeLineIntsPacketDispatch<tKernel>(packet_size, vol_params,
+                  MakeLineIntInterps<RayCastVolLinearInterpCPU<tVolBuf>>(vol_bufs), proj_buf);
+      return true;
+    }
+    case RayCaster::kRAY_CAST_INTERP_NN:
+    {
+      ComputeLineIntsPacketDispatch<tKernel>(packet_size, vol_params,
+                  MakeLineIntInterps<RayCastVolNNInterpCPU<tVolBuf>>(vol_bufs), proj_buf);
+      return true;
+    }
+    default:
+      break;
+  }
+
+  return false;
+}
+
+/// \brief Computes the line integrals through every volume.
+///
+/// Every volume uses the same interpolation method and volume layout.
+template <class tKernel>
+void ComputeLineIntsHelper(const size_type packet_size,
+                           const LineIntParamsList& vol_params,
+                           RayCaster::PixelScalar2D* proj_buf)
+{
+  if (vol_params[0].interp_method == RayCaster::kRAY_CAST_INTERP_SIDDON)
+  {
+    ComputeLineIntsSiddon<tKernel>(vol_params, proj_buf);
+    return;
+  }
+
+  if (packet_size)
+  {
+    if (vol_params[0].bricked_vol)
+    {
+      std::vector<RayCastBrickedVolBufCPU> vol_bufs;
+      vol_bufs.reserve(vol_params.size());
+
+      for (const auto& params : vol_params)
+      {
+        vol_bufs.push_back(MakeRayCastVolBufCPU(*params.bricked_vol));
+      }
+
+      if (ComputeLineIntsPacketInterpDispatch<tKernel>(packet_size, vol_params, vol_bufs, proj_buf))
+      {
+        return;
+      }
+    }
+    else
+    {
+      std::vector<RayCastVolBufCPU> vol_bufs;
+      vol_bufs.reserve(vol_params.size());
+
+      for (const auto& params : vol_params)
+      {
+        vol_bufs.push_back(MakeRayCastVolBufCPU(params.img_vol));
+      }
+
+      if (ComputeLineIntsPacketInterpDispatch<tKernel>(packet_size, vol_params, vol_bufs, proj_buf))
+      {
+        return;
+      }
+    }
+
+    // other interpolation methods fall back to the ITK interpolators
+  }
+
+  ComputeLineInts<tKernel>(vol_params, proj_buf);
+}
+
+}  // un-named
+
+void xreg::RayCasterLineIntCPU::set_ray_packet_size(const size_type packet_size)
+{
+  if ((packet_size != 0) && (packet_size != 1) && (packet_size != 4) &&
+      (packet_size != 8) && (packet_size != 16))
+  {
+    xregThrow("Unsupported ray packet size: %lu (must be 0, 1, 4, 8, or 16)",
+              static_cast<unsigned long>(packet_size));
+  }
+
+  ray_packet_size_ = packet_size;
+}
+
+xreg::size_type xreg::RayCasterLineIntCPU::ray_packet_size() const
+{
+  return ray_packet_size_;
+}
+
+void xreg::RayCasterLineIntCPU::set_numa_nodes(const std::vector<int>& numa_nodes)
+{
+  numa_nodes_ = numa_nodes;
+
+  numa_node_states_.clear();
+
+  if (numa_nodes_.size() > 1)
+  {
+    numa_node_states_.resize(numa_nodes_.size());
+
+    for (size_type i = 0; i < numa_nodes_.size(); ++i)
+    {
+      if (numa_nodes_[i] < 0)
+      {
+        xregThrow("invalid NUMA node: %d", numa_nodes_[i]);
+      }
+
+      numa_node_states_[i].exec_ctx = std::make_shared<ParallelExecContext>(
+                                          0, 1, ParallelExecContext::kAUTO_PARTITIONER,
+                                          numa_nodes_[i]);
+    }
+  }
+
+  numa_vols_valid_ = false;
+}
+
+const std::vector<int>& xreg::RayCasterLineIntCPU::numa_nodes() const
+{
+  return numa_nodes_;
+}
+
+void xreg::RayCasterLineIntCPU::vols_changed()
+{
+  RayCasterCPU::vols_changed();
+
+  numa_vols_valid_ = false;
+}
+
+void xreg::RayCasterLineIntCPU::update_numa_vols()
+{
+  if (!numa_vols_valid_)
+  {
+    const size_type nv = this->vols_.size();
+
+    for (auto& node_state : numa_node_states_)
+    {
+      node_state.vols.clear();
+      node_state.vols.reserve(nv);
+
+      // The copies are made by the threads of the node, so that their pages
+      // are first touched, and therefore allocated, on the node
+      node_state.exec_ctx->execute([this,&node_state,nv] ()
+      {
+        for (size_type vol_idx = 0; vol_idx < nv; ++vol_idx)
+        {
+          node_state.vols.push_back(MakeRayCastBrickedVol(this->vols_[vol_idx].GetPointer(),
+                                                          this->use_huge_pages_));
+        }
+      });
+    }
+
+    numa_vols_valid_ = true;
+  }
+}
+
+void xreg::RayCasterLineIntCPU::camera_models_changed()
+{
+  const size_type num_cams = this->camera_models_.size();
+
+  det_pts_wrt_cam_for_each_cam_.resize(num_cams);
+
+  for (size_type cam_idx = 0; cam_idx < num_cams; ++cam_idx)
+  {
+    const CameraModel& cam = this->camera_models_[cam_idx];
+
+    Pt3List& det_pts = det_pts_wrt_cam_for_each_cam_[cam_idx];
+
+    det_pts.resize(cam.num_det_rows * cam.num_det_cols);
+
+    size_type off = 0;
+
+    for (size_type row_idx = 0; row_idx < cam.num_det_rows; ++row_idx)
+    {
+      for (size_type col_idx = 0; col_idx < cam.num_det_cols; ++col_idx, ++off)
+      {
+        det_pts[off] = cam.ind_pt_to_phys_det_pt(Pt2(static_cast<CoordScalar>(col_idx),
+                                                     static_cast<CoordScalar>(row_idx)));
+      }
+    }
+  }
+}
+
+void xreg::RayCasterLineIntCPU::compute(const size_type vol_idx)
+{
+  compute_vols({ vol_idx }, { &this->xforms_cam_to_itk_phys_ });
+}
+
+void xreg::RayCasterLineIntCPU::compute_multi_vols(const std::vector<size_type>& vol_inds,
+                                                  const std::vector<FrameTransformList>& xforms_cam_to_itk_phys_for_each_vol)
+{
+  const size_type num_vols_to_comp = vol_inds.size();
+
+  xregASSERT(num_vols_to_comp == xforms_cam_to_itk_phys_for_each_vol.size());
+
+  if (num_vols_to_comp)
+  {
+    std::vector<const FrameTransformList*> xforms_for_each_vol(num_vols_to_comp);
+
+    for (size_type i = 0; i < num_vols_to_comp; ++i)
+    {
+      xregASSERT(xforms_cam_to_itk_phys_for_each_vol[i].size() == this->num_projs_);
+
+      xforms_for_each_vol[i] = &xforms_cam_to_itk_phys_for_each_vol[i];
+    }
+
+    compute_vols(vol_inds, xforms_for_each_vol);
+  }
+}
+
+void xreg::RayCasterLineIntCPU::compute_vols(const std::vector<size_type>& vol_inds,
+                                            const std::vector<const FrameTransformList*>& xforms_cam_to_itk_phys_for_each_vol)
+{
+  xregASSERT(this->resources_allocated_);
+
+  ParallelExecContextScope exec_scope(this->exec_ctx_.get());
+
+  const size_type num_vols_to_comp = vol_inds.size();
+
+  this->pre_compute();
+
+  // Empty space skipping is only possible with the sum kernel. The bricks are
+  // padded by one voxel, which only bounds the footprints of the nearest
+  // neighbor, linear and Siddon interpolations; the wider B-spline and sinc
+  // kernels sample voxels of bricks which appear empty.
+  const bool skip_empty_space = this->use_empty_space_skipping_ &&
+                                (this->kernel_id() == kRAY_CAST_LINE_INT_SUM_KERNEL) &&
+                                ((this->interp_method_ == kRAY_CAST_INTERP_LINEAR) ||
+                                 (this->interp_method_ == kRAY_CAST_INTERP_NN) ||
+                                 (this->interp_method_ == kRAY_CAST_INTERP_SIDDON));
+
+  // The brick maxima bound the nearest neighbor and linear interpolations, so
+  // the max kernel may skip the samples that cannot increase its result
+  const bool use_max_bound = this->use_empty_space_skipping_ &&
+                             (this->kernel_id() == kRAY_CAST_LINE_INT_MAX_KERNEL) &&
+                             ((this->interp_method_ == kRAY_CAST_INTERP_LINEAR) ||
+                              (this->interp_method_ == kRAY_CAST_INTERP_NN));
+
+  // When using a table of anti-aliasing jitter, convert the offsets into
+  // physical offsets on the detector of each camera, the mapping from
+  // detector indices to physical points is affine
+  const Pt2List aa_jitter_table = this->anti_alias_jitter_table();
+
+  const size_type num_cams = this->camera_models_.size();
+
+  std::vector<Pt3List> aa_offsets_wrt_cam_for_each_cam;
+
+  if (!aa_jitter_table.empty())
+  {
+    aa_offsets_wrt_cam_for_each_cam.resize(num_cams);
+
+    for (size_type cam_idx = 0; cam_idx < num_cams; ++cam_idx)
+    {
+      const CameraModel& cam = this->camera_models_[cam_idx];
+
+      const Pt3 det_origin_wrt_cam = cam.ind_pt_to_phys_det_pt(Pt2(0,0));
+
+      Pt3List& aa_offsets = aa_offsets_wrt_cam_for_each_cam[cam_idx];
+
+      aa_offsets.reserve(aa_jitter_table.size());
+
+      for (const auto& jitter : aa_jitter_table)
+      {
+        aa_offsets.push_back(cam.ind_pt_to_phys_det_pt(jitter) - det_origin_wrt_cam);
+      }
+    }
+  }
+
+  // The quantities that are shared by all rays of a projection, for each volume
+  std::vector<LineIntProjSetupList> proj_setups_for_each_vol(num_vols_to_comp);
+
+  LineIntParamsList vol_params;
+  vol_params.reserve(num_vols_to_comp);
+
+  // The index of the volume of each entry in vol_params
+  std::vector<size_type> vol_inds_of_params;
+  vol_inds_of_params.reserve(num_vols_to_comp);
+
+  for (size_type i = 0; i < num_vols_to_comp; ++i)
+  {
+    const size_type vol_idx = vol_inds[i];
+
+    const FrameTransformList& xforms_cam_to_itk_phys = *xforms_cam_to_itk_phys_for_each_vol[i];
+
+    // Get the index bounding box (axis-aligned in the index space) of the volume
+    Pt3 img_aabb_min;
+    Pt3 img_aabb_max;
+    std::tie(img_aabb_min,img_aabb_max) = ITKImageIndexBoundsAsEigen(this->vols_[vol_idx].GetPointer());
+
+    //std::cout << "img_aabb_min: " << img_aabb_min << std::endl;
+    //std::cout << "img_aabb_max: " << img_aabb_max << std::endl;
+
+    // Compute the frame transform from ITK physical space to index space (sR + t)
+    const FrameTransform itk_idx_to_itk_phys_pt_xform = ITKImagePhysicalPointTransformsAsEigen(this->vols_[vol_idx].GetPointer());
+
+    const FrameTransform itk_phys_pt_to_itk_idx_xform = itk_idx_to_itk_phys_pt_xform.inverse();
+
+    //std::cout << "physical point to index xform:\n" << itk_phys_pt_to_itk_idx_xform.matrix() << std::endl;
+
+    const RayCastVolBrickGrid* brick_grid = nullptr;
+
+    if (skip_empty_space)
+    {
+      brick_grid = &this->vol_brick_grids_[vol_idx];
+
+      if (!brick_grid->any_non_empty)
+      {
+        // all voxels are empty, so none of the line integrals will change
+        continue;
+      }
+
+      // clip rays to the non-empty voxels
+      img_aabb_min = brick_grid->non_empty_idx_min;
+      img_aabb_max = brick_grid->non_empty_idx_max;
+    }
+
+    LineIntProjSetupList& proj_setups = proj_setups_for_each_vol[i];
+
+    proj_setups.resize(this->num_projs_);
+
+    for (size_type proj_idx = 0; proj_idx < this->num_projs_; ++proj_idx)
+    {
+      const size_type cam_idx = this->cam_model_for_proj_[proj_idx];
+
+      LineIntProjSetup& proj_setup = proj_setups[proj_idx];
+
+      proj_setup.cam = &this->camera_models_[cam_idx];
+
+      proj_setup.det_pts_wrt_cam = &det_pts_wrt_cam_for_each_cam_[cam_idx];
+
+      // The current transformation from detector coordinates to ITK indices
+      proj_setup.xform_cam_to_itk_idx = itk_phys_pt_to_itk_idx_xform * xforms_cam_to_itk_phys[proj_idx];
+
+      proj_setup.pinhole_wrt_itk_idx = proj_setup.xform_cam_to_itk_idx * proj_setup.cam->pinhole_pt;
+
+      proj_setup.active_pix_inds = nullptr;
+
+      proj_setup.win_row_begin = 0;
+      proj_setup.win_row_end   = proj_setup.cam->num_det_rows;
+      proj_setup.win_col_begin = 0;
+      proj_setup.win_col_end   = proj_setup.cam->num_det_cols;
+
+      if (this->use_proj_bbox_windows_)
+      {
+        UpdateLineIntProjWindow(img_aabb_min, img_aabb_max, &proj_setup);
+      }
+
+      proj_setup.aa_offsets_wrt_cam = aa_offsets_wrt_cam_for_each_cam.empty() ? nullptr :
+                                          &aa_offsets_wrt_cam_for_each_cam[cam_idx];
+    }
+
+    vol_params.push_back({ this->aa_fact_,
+                           this->vols_[vol_idx],
+                           img_aabb_min,
+                           img_aabb_max,
+                           itk_phys_pt_to_itk_idx_xform,
+                           this->num_projs_,
+                           this->camera_models_,
+                           xforms_cam_to_itk_phys,
+                           this->cam_model_for_proj_,
+                           this->ray_step_size_,
+                           this->interp_method_,
+                           brick_grid,
+                           use_max_bound ? &this->vol_brick_grids_[vol_idx] : nullptr,
+                           this->use_bricked_vol_layout_ ?
+                               &this->bricked_vols_[vol_idx] : nullptr,
+                           this->bspline_coefs(vol_idx),
+                           &this->thread_state_pool_,
+                           proj_setups,
+                           nullptr
+                         });
+
+    vol_inds_of_params.push_back(vol_idx);
+  }
+
+  if (vol_params.empty())
+  {
+    this->sync_to_ocl_.set_modified();
+    this->sync_to_host_.set_modified();
+    return;
+  }
+
+  // When a subset of pixels is computed for any camera, the active pixels of
+  // all projections are compacted into a single range of rays. Projections
+  // using cameras that compute every pixel use a list of all pixels.
+  // The active pixels are the same for every volume.
+  PixelIndexList all_pix_inds;
+
+  std::vector<size_type> active_ray_offsets;
+
+  if (this->use_active_pixels())
+  {
+    active_ray_offsets.resize(this->num_projs_ + 1);
+
+    size_type num_active_rays = 0;
+
+    for (size_type proj_idx = 0; proj_idx < this->num_projs_; ++proj_idx)
+    {
+      const size_type cam_idx = this->cam_model_for_proj_[proj_idx];
+
+      const PixelIndexList* active_pix_inds = nullptr;
+
+      if (this->has_active_pixels(cam_idx))
+      {
+        active_pix_inds = &this->active_pixels(cam_idx);
+      }
+      else
+      {
+        if (all_pix_inds.empty())
+        {
+          all_pix_inds.resize(this->camera_models_[0].num_det_rows *
+                              this->camera_models_[0].num_det_cols);
+          std::iota(all_pix_inds.begin(), all_pix_inds.end(), size_type(0));
+        }
+
+        active_pix_inds = &all_pix_inds;
+      }
+
+      for (auto& proj_setups : proj_setups_for_each_vol)
+      {
+        if (!proj_setups.empty())
+        {
+          proj_setups[proj_idx].active_pix_inds = active_pix_inds;
+        }
+      }
+
+      active_ray_offsets[proj_idx] = num_active_rays;
+
+      num_active_rays += active_pix_inds->size();
+    }
+
+    active_ray_offsets[this->num_projs_] = num_active_rays;
+
+    for (auto& params : vol_params)
+    {
+      params.active_ray_offsets = &active_ray_offsets;
+    }
+  }
+  
+  auto* proj_buf = this->pixel_buf_to_use();
+
+  const RayCastLineIntKernel kernel_id = this->kernel_id();
+  const size_type packet_size = ray_packet_size_;
+
+  auto compute_line_ints = [kernel_id,packet_size] (const LineIntParamsList& params,
+                                                    PixelScalar2D* buf)
+  {
+    switch (kernel_id)
+    {
+      case kRAY_CAST_LINE_INT_SUM_KERNEL:
+        ComputeLineIntsHelper<AccumLineIntKernel>(packet_size, params, buf);
+        break;
+      case kRAY_CAST_LINE_INT_MAX_KERNEL:
+        ComputeLineIntsHelper<MaxLineIntKernel>(packet_size, params, buf);
+        break;
+      default:
+        xregThrow("Unsupported Line Integral Kernel!");
+    }
+  };
+
+  const size_type num_numa_groups = std::min(numa_node_states_.size(), this->num_projs_);
+
+  if ((num_numa_groups > 1) && !this->use_active_pixels())
+  {
+    update_numa_vols();
+
+    const size_type num_pix_per_proj = this->camera_models_[0].num_det_rows *
+                                       this->camera_models_[0].num_det_cols;
+
+    const size_type num_params = vol_params.size();
+
+    // The poses, camera associations and setups of the projections of a
+    // group, which are referenced by the params of the group
+    struct NUMAGroup
+    {
+      size_type proj_begin;
+
+      std::vector<FrameTransformList> xforms_for_each_param;
+
+      RayCaster::CamModelAssocList cam_model_for_proj;
+
+      std::vector<LineIntProjSetupList> proj_setups_for_each_param;
+
+      LineIntParamsList params;
+    };
+
+    std::vector<NUMAGroup> groups(num_numa_groups);
+
+    for (size_type g = 0; g < num_numa_groups; ++g)
+    {
+      NUMAGroup& group = groups[g];
+
+      group.proj_begin = (g * this->num_projs_) / num_numa_groups;
+
+      const size_type proj_end = ((g + 1) * this->num_projs_) / num_numa_groups;
+
+      group.cam_model_for_proj.assign(this->cam_model_for_proj_.begin() + group.proj_begin,
+                                      this->cam_model_for_proj_.begin() + proj_end);
+
+      group.xforms_for_each_param.resize(num_params);
+      group.proj_setups_for_each_param.resize(num_params);
+      group.params.reserve(num_params);
+
+      for (size_type i = 0; i < num_params; ++i)
+      {
+        const LineIntParams& p = vol_params[i];
+
+        group.xforms_for_each_param[i].assign(p.xforms_cam_to_itk_phys.begin() + group.proj_begin,
+                                              p.xforms_cam_to_itk_phys.begin() + proj_end);
+
+        group.proj_setups_for_each_param[i].assign(p.proj_setups.begin() + group.proj_begin,
+                                                   p.proj_setups.begin() + proj_end);
+
+        group.params.push_back({ p.aa_fact,
+                                 p.img_vol,
+                                 p.img_aabb_min,
+                                 p.img_aabb_max,
+                                 p.itk_phys_pt_to_itk_idx_xform,
+                                 proj_end - group.proj_begin,
+                                 p.camera_models,
+                                 group.xforms_for_each_param[i],
+                                 group.cam_model_for_proj,
+                                 p.step_size,
+                                 p.interp_method,
+                                 p.brick_grid,
+                                 p.max_bound_grid,
+                                 &numa_node_states_[g].vols[vol_inds_of_params[i]],
+                                 p.bspline_coefs,
+                                 p.thread_states,
+                                 group.proj_setups_for_each_param[i],
+                                 nullptr
+                               });
+      }
+    }
+
+    // Each group is cast by the threads of its node; the calling thread
+    // waits on the first group while the others are launched asynchronously
+    auto compute_group = [this,&groups,&compute_line_ints,proj_buf,num_pix_per_proj] (const size_type g)
+    {
+      const NUMAGroup& group = groups[g];
+
+      numa_node_states_[g].exec_ctx->execute([&] ()
+      {
+        compute_line_ints(group.params, proj_buf + (group.proj_begin * num_pix_per_proj));
+      });
+    };
+
+    std::vector<std::future<void>> group_futs;
+    group_futs.reserve(num_numa_groups - 1);
+
+    for (size_type g = 1; g < num_numa_groups; ++g)
+    {
+      group_futs.push_back(std::async(std::launch::async, compute_group, g));
+    }
+
+    compute_group(0);
+
+    for (auto& f : group_futs)
+    {
+      f.get();
+    }
+  }
+  else
+  {
+    compute_line_ints(vol_params, proj_buf);
+  }
+
+  this->sync_to_ocl_.set_modified();
+  this->sync_to_host_.set_modified();
+}
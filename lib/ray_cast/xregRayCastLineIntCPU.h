@@ -45,6 +45,91 @@ public:
   /// Each line integral represents a computation task, and collections of tasks
   /// are evaluated in separate threads.
   void compute(const size_type vol_idx = 0) override;
+
+  /// \brief Perform the ray casting through several volumes in a single pass
+  ///        over the rays.
+  ///
+  /// Each task adds the line integrals through every volume to its pixels
+  /// before moving on, rather than making a separate pass over all
+  /// projections for each volume.
+  void compute_multi_vols(const std::vector<size_type>& vol_inds,
+                          const std::vector<FrameTransformList>& xforms_cam_to_itk_phys_for_each_vol) override;
+
+  /// \brief Sets the number of neighboring rays that are marched together.
+  ///
+  /// When using nearest neighbor or linear interpolation, packets of rays are
+  /// marched through the volume together and samples are read directly from
+  /// the volume buffer, allowing the compiler to vectorize the interpolation
+  /// and line integral kernels. Valid sizes are 1, 4, 8, and 16.
+  /// A value of zero disables packets and uses the ITK interpolators for every
+  /// sample, which is always the case for sinc and B-spline interpolation.
+  /// Defaults to 8.
+  void set_ray_packet_size(const size_type packet_size);
+
+  /// \brief Retrieves the number of neighboring rays that are marched together.
+  ///
+  /// \see set_ray_packet_size
+  size_type ray_packet_size() const;
+
+  /// \brief Sets the NUMA nodes that the projections are distributed among.
+  ///
+  /// When more than one node is specified, a bricked copy of each volume
+  /// (see RayCastBrickedVol) is made in the memory of each node by threads of
+  /// that node, and every node is assigned a task arena constrained to its
+  /// threads. The projections of each computation are divided into contiguous
+  /// groups, one for each node, and the rays of a group are cast by the
+  /// threads of its node, reading only the node's copies of the volumes. This
+  /// avoids reading the volumes across the socket interconnect on multi-socket
+  /// systems, at the cost of one copy of each volume per node.
+  /// The copies are used by the packet ray marching with nearest neighbor or
+  /// linear interpolation; other interpolation methods read the shared
+  /// volumes. The projections are not distributed when active pixels are set
+  /// or when computing a single projection. This requires a version of TBB
+  /// supporting task arena constraints. An empty list, the default, does not
+  /// distribute the projections.
+  void set_numa_nodes(const std::vector<int>& numa_nodes);
+
+  const std::vector<int>& numa_nodes() const;
+
+protected:
+  /// \brief Caches the detector point of every pixel of each camera model.
+  void camera_models_changed() override;
+
+  /// \brief Invalidates the copies of the volumes on each NUMA node.
+  void vols_changed() override;
+
+private:
+  /// \brief Computes the line integrals through each volume, with the
+  ///        corresponding camera poses, in a single pass over the rays.
+  void compute_vols(const std::vector<size_type>& vol_inds,
+                    const std::vector<const FrameTransformList*>& xforms_cam_to_itk_phys_for_each_vol);
+
+  /// \brief Makes the copies of the volumes on each NUMA node, when they
+  ///        are out of date.
+  void update_numa_vols();
+
+  size_type ray_packet_size_ = 8;
+
+  std::vector<int> numa_nodes_;
+
+  /// \brief The task arena and copies of the volumes of a NUMA node
+  struct NUMANodeState
+  {
+    std::shared_ptr<ParallelExecContext> exec_ctx;
+
+    RayCastBrickedVolList vols;
+  };
+
+  std::vector<NUMANodeState> numa_node_states_;
+
+  bool numa_vols_valid_ = false;
+
+  /// \brief The detector points, with respect to each camera, of every
+  ///        detector pixel in row-major order.
+  ///
+  /// Rays cast without anti-aliasing look these up rather than computing
+  /// the points each time.
+  std::vector<Pt3List> det_pts_wrt_cam_for_each_cam_;
 };
 
 }  // xreg
@@ -0,0 +1,299 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregRayCastLineIntGradCPU.h"
+
+#include "xregITKBasicImageUtils.h"
+#include "xregTBBUtils.h"
+#include "xregSpatialPrimitives.h"
+#include "xregExceptionUtils.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+using PixelScalar = RayCaster::PixelScalar3D;
+
+/// \brief Trilinear interpolation of a volume buffer, which also computes the
+///        gradient of the interpolant with respect to continuous indices.
+///
+/// The point must lie within the index bounds of the volume.
+struct LinearInterpWithGrad
+{
+  const PixelScalar* buf;
+
+  long dims[3];
+
+  long stride_y;
+  long stride_z;
+
+  PixelScalar operator()(const Pt3& pt, Pt3* grad) const
+  {
+    // clamp so that the upper neighbor is always valid
+    const long i = std::min(std::max(static_cast<long>(pt[0]), 0L), std::max(dims[0] - 2, 0L));
+    const long j = std::min(std::max(static_cast<long>(pt[1]), 0L), std::max(dims[1] - 2, 0L));
+    const long k = std::min(std::max(static_cast<long>(pt[2]), 0L), std::max(dims[2] - 2, 0L));
+
+    const CoordScalar fx = pt[0] - i;
+    const CoordScalar fy = pt[1] - j;
+    const CoordScalar fz = pt[2] - k;
+
+    const long dx = (dims[0] > 1) ? 1 : 0;
+    const long dy = (dims[1] > 1) ? stride_y : 0;
+    const long dz = (dims[2] > 1) ? stride_z : 0;
+
+    const PixelScalar* v = buf + i + (j * stride_y) + (k * stride_z);
+
+    const CoordScalar v000 = v[0];
+    const CoordScalar v100 = v[dx];
+    const CoordScalar v010 = v[dy];
+    const CoordScalar v110 = v[dx + dy];
+    const CoordScalar v001 = v[dz];
+    const CoordScalar v101 = v[dx + dz];
+    const CoordScalar v011 = v[dy + dz];
+    const CoordScalar v111 = v[dx + dy + dz];
+
+    // interpolate along x
+    const CoordScalar v00 = v000 + (fx * (v100 - v000));
+    const CoordScalar v10 = v010 + (fx * (v110 - v010));
+    const CoordScalar v01 = v001 + (fx * (v101 - v001));
+    const CoordScalar v11 = v011 + (fx * (v111 - v011));
+
+    // interpolate along y
+    const CoordScalar v0 = v00 + (fy * (v10 - v00));
+    const CoordScalar v1 = v01 + (fy * (v11 - v01));
+
+    const CoordScalar gx0 = ((1 - fy) * (v100 - v000)) + (fy * (v110 - v010));
+    const CoordScalar gx1 = ((1 - fy) * (v101 - v001)) + (fy * (v111 - v011));
+
+    (*grad)[0] = ((1 - fz) * gx0) + (fz * gx1);
+    (*grad)[1] = ((1 - fz) * (v10 - v00)) + (fz * (v11 - v01));
+    (*grad)[2] = v1 - v0;
+
+    return static_cast<PixelScalar>(v0 + (fz * (v1 - v0)));
+  }
+};
+
+}  // un-named
+
+void xreg::RayCasterLineIntGradCPU::set_xform_derivs(const std::vector<Mat4x4List>& xform_derivs)
+{
+  xform_derivs_ = xform_derivs;
+
+  num_deriv_params_ = xform_derivs_.empty() ? 0 : xform_derivs_[0].size();
+
+  for (const auto& derivs : xform_derivs_)
+  {
+    xregASSERT(derivs.size() == num_deriv_params_);
+  }
+}
+
+void xreg::RayCasterLineIntGradCPU::clear_xform_derivs()
+{
+  xform_derivs_.clear();
+  num_deriv_params_ = 0;
+}
+
+xreg::size_type xreg::RayCasterLineIntGradCPU::num_deriv_params() const
+{
+  return num_deriv_params_;
+}
+
+const xreg::RayCaster::PixelScalar2D*
+xreg::RayCasterLineIntGradCPU::deriv_img_buf(const size_type proj_idx, const size_type param_idx) const
+{
+  const size_type num_pix = this->camera_models_[0].num_det_rows * this->camera_models_[0].num_det_cols;
+
+  return &deriv_buf_[((proj_idx * num_deriv_params_) + param_idx) * num_pix];
+}
+
+void xreg::RayCasterLineIntGradCPU::compute(const size_type vol_idx)
+{
+  xregASSERT(this->resources_allocated_);
+
+  ParallelExecContextScope exec_scope(this->exec_ctx_.get());
+
+  if (this->kernel_id() != kRAY_CAST_LINE_INT_SUM_KERNEL)
+  {
+    xregThrow("Only the sum kernel is supported when computing line integral derivatives!");
+  }
+
+  this->pre_compute();
+
+  const size_type num_projs = this->num_projs_;
+
+  const bool compute_derivs = num_deriv_params_ > 0;
+
+  xregASSERT(!compute_derivs || (xform_derivs_.size() == num_projs));
+
+  const size_type num_params = num_deriv_params_;
+
+  const size_type num_rows = this->camera_models_[0].num_det_rows;
+  const size_type num_cols = this->camera_models_[0].num_det_cols;
+  const size_type num_pix  = num_rows * num_cols;
+
+  if (compute_derivs)
+  {
+    const size_type deriv_buf_len = num_projs * num_params * num_pix;
+
+    if ((deriv_buf_.size() != deriv_buf_len) || (this->proj_store_meth_ == kRAY_CAST_PIXEL_REPLACE))
+    {
+      deriv_buf_.assign(deriv_buf_len, PixelScalar2D(0));
+    }
+  }
+
+  const Vol* vol = this->vols_[vol_idx].GetPointer();
+
+  Pt3 img_aabb_min;
+  Pt3 img_aabb_max;
+  std::tie(img_aabb_min,img_aabb_max) = ITKImageIndexBoundsAsEigen(vol);
+
+  const FrameTransform itk_phys_pt_to_itk_idx_xform =
+                    ITKImagePhysicalPointTransformsAsEigen(vol).inverse();
+
+  const Mat3x3 phys_to_idx_lin = itk_phys_pt_to_itk_idx_xform.matrix().block(0,0,3,3);
+
+  const auto vol_size = vol->GetLargestPossibleRegion().GetSize();
+
+  LinearInterpWithGrad interp;
+  interp.buf      = vol->GetBufferPointer();
+  interp.dims[0]  = static_cast<long>(vol_size[0]);
+  interp.dims[1]  = static_cast<long>(vol_size[1]);
+  interp.dims[2]  = static_cast<long>(vol_size[2]);
+  interp.stride_y = interp.dims[0];
+  interp.stride_z = interp.dims[0] * interp.dims[1];
+
+  const CoordScalar step_size = this->ray_step_size_;
+
+  PixelScalar2D* proj_buf = this->pixel_buf_to_use();
+
+  auto row_fn = [&] (const RangeType& r)
+  {
+    // derivative of each sample point, wrt continuous indices, for each parameter;
+    // these are affine functions of the sample index: a + (s * b)
+    std::vector<Pt3> deriv_pt_start(num_params);
+    std::vector<Pt3> deriv_pt_step(num_params);
+
+    std::vector<CoordScalar> deriv_acc(num_params);
+
+    Pt3 grad;
+
+    for (size_type global_row_idx = r.begin(); global_row_idx < r.end(); ++global_row_idx)
+    {
+      const size_type proj_idx = global_row_idx / num_rows;
+      const size_type row_idx  = global_row_idx - (proj_idx * num_rows);
+
+      const CameraModel& cam = this->camera_models_[this->cam_model_for_proj_[proj_idx]];
+
+      const FrameTransform& xform_cam_to_itk_phys = this->xforms_cam_to_itk_phys_[proj_idx];
+
+      const FrameTransform xform_cam_to_itk_idx = itk_phys_pt_to_itk_idx_xform * xform_cam_to_itk_phys;
+
+      const Pt3 pinhole_wrt_itk_idx = xform_cam_to_itk_idx * cam.pinhole_pt;
+
+      for (size_type col_idx = 0; col_idx < num_cols; ++col_idx)
+      {
+        const size_type pix_idx = (row_idx * num_cols) + col_idx;
+
+        const Pt3 det_pt_wrt_cam = cam.ind_pt_to_phys_det_pt(Pt2(static_cast<CoordScalar>(col_idx),
+                                                                 static_cast<CoordScalar>(row_idx)));
+
+        const Pt3 pinhole_to_det_wrt_itk_idx = (xform_cam_to_itk_idx * det_pt_wrt_cam) - pinhole_wrt_itk_idx;
+
+        CoordScalar t_start = 0;
+        CoordScalar t_stop  = 0;
+
+        bool inter_vol = false;
+
+        std::tie(inter_vol,t_start,t_stop) = RayRectIntersect(img_aabb_min, img_aabb_max,
+                                                              pinhole_wrt_itk_idx,
+                                                              pinhole_to_det_wrt_itk_idx, true);
+
+        if (!inter_vol || ((t_stop - t_start) <= CoordScalar(2 * kVOL_BB_STEP_INC_TOL)))
+        {
+          continue;
+        }
+
+        t_start += kVOL_BB_STEP_INC_TOL;
+        t_stop  -= kVOL_BB_STEP_INC_TOL;
+
+        // sample points are computed in camera coordinates, since the derivatives
+        // of the transform are applied to them
+        const Pt3 pinhole_to_det_wrt_cam = det_pt_wrt_cam - cam.pinhole_pt;
+
+        const CoordScalar pinhole_to_det_len = pinhole_to_det_wrt_cam.norm();
+
+        const Pt3 start_pt_wrt_cam = cam.pinhole_pt + (t_start * pinhole_to_det_wrt_cam);
+
+        const Pt3 step_vec_wrt_cam = pinhole_to_det_wrt_cam * (step_size / pinhole_to_det_len);
+
+        const long num_steps = static_cast<long>(((t_stop - t_start) * pinhole_to_det_len) / step_size);
+
+        const Pt3 start_pt_wrt_itk_idx = xform_cam_to_itk_idx * start_pt_wrt_cam;
+        const Pt3 step_vec_wrt_itk_idx = xform_cam_to_itk_idx.linear() * step_vec_wrt_cam;
+
+        for (size_type param_idx = 0; param_idx < num_params; ++param_idx)
+        {
+          const Mat4x4& d = xform_derivs_[proj_idx][param_idx];
+
+          deriv_pt_start[param_idx] = phys_to_idx_lin * ((d.block(0,0,3,3) * start_pt_wrt_cam) +
+                                                          d.block(0,3,3,1));
+          deriv_pt_step[param_idx]  = phys_to_idx_lin * (d.block(0,0,3,3) * step_vec_wrt_cam);
+        }
+
+        std::fill(deriv_acc.begin(), deriv_acc.end(), CoordScalar(0));
+
+        CoordScalar acc = 0;
+
+        Pt3 cur_pt = start_pt_wrt_itk_idx;
+
+        for (long step_idx = 0; step_idx <= num_steps; ++step_idx, cur_pt += step_vec_wrt_itk_idx)
+        {
+          acc += interp(cur_pt, &grad);
+
+          const CoordScalar s = static_cast<CoordScalar>(step_idx);
+
+          for (size_type param_idx = 0; param_idx < num_params; ++param_idx)
+          {
+            deriv_acc[param_idx] += grad.dot(deriv_pt_start[param_idx] + (s * deriv_pt_step[param_idx]));
+          }
+        }
+
+        proj_buf[(proj_idx * num_pix) + pix_idx] += acc * step_size;
+
+        for (size_type param_idx = 0; param_idx < num_params; ++param_idx)
+        {
+          deriv_buf_[(((proj_idx * num_params) + param_idx) * num_pix) + pix_idx] +=
+                                                              deriv_acc[param_idx] * step_size;
+        }
+      }
+    }
+  };
+
+  ParallelFor(row_fn, RangeType(0, num_projs * num_rows));
+
+  this->sync_to_ocl_.set_modified();
+  this->sync_to_host_.set_modified();
+}
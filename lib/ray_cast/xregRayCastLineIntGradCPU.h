@@ -0,0 +1,95 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGRAYCASTLINEINTGRADCPU_H_
+#define XREGRAYCASTLINEINTGRADCPU_H_
+
+#include "xregRayCastBaseCPU.h"
+
+namespace xreg
+{
+
+/// \brief Line integral ray caster which also computes the derivatives of
+///        each pixel with respect to the parameters of each projection's pose.
+///
+/// The derivatives of the camera to volume (ITK physical) transformation
+/// of each projection, with respect to a collection of parameters, are provided
+/// by set_xform_derivs(). The derivative of a line integral is computed
+/// alongside the line integral, by accumulating the dot product of the
+/// volume's (trilinear) gradient with the derivative of each sample point:
+///   d/dp sum_s f(T(p) x_s) = sum_s grad f(T(p) x_s)^T (dT/dp x_s)
+/// The motion of the ray's entry and exit points is ignored, which is exact
+/// when the volume is zero along its boundary.
+///
+/// Linear interpolation is always used, so that the line integrals and their
+/// derivatives are consistent, and only the sum kernel is supported. Every pixel
+/// is computed, active pixels and anti-aliasing are ignored.
+class RayCasterLineIntGradCPU : public RayCasterCPU, public RayCastLineIntParamInterface
+{
+public:
+  /// \brief Trivial constructor - no work done
+  RayCasterLineIntGradCPU()
+  { }
+
+  /// \brief Computes the line integrals and, when derivatives of the poses have
+  ///        been set, the derivatives of each pixel.
+  ///
+  /// The derivative images follow the projection store method, e.g. they are
+  /// replaced or accumulated along with the line integrals.
+  void compute(const size_type vol_idx = 0) override;
+
+  /// \brief Sets the derivatives of each projection's camera to volume
+  ///        (ITK physical) transform.
+  ///
+  /// xform_derivs[i][j] is the derivative of the 4x4 transform of projection i
+  /// with respect to parameter j; every projection must have the same number
+  /// of parameters. An empty list disables the derivative computations.
+  void set_xform_derivs(const std::vector<Mat4x4List>& xform_derivs);
+
+  /// \brief Disables the derivative computations.
+  void clear_xform_derivs();
+
+  /// \brief The number of parameters the derivatives are computed with
+  ///        respect to, zero when disabled.
+  size_type num_deriv_params() const;
+
+  /// \brief The derivative of projection proj_idx with respect to parameter
+  ///        param_idx, stored in row-major order.
+  ///
+  /// This is valid after compute() has been called with derivatives set.
+  const PixelScalar2D* deriv_img_buf(const size_type proj_idx, const size_type param_idx) const;
+
+private:
+  std::vector<Mat4x4List> xform_derivs_;
+
+  size_type num_deriv_params_ = 0;
+
+  /// \brief Derivative images, the derivatives of a projection are
+  ///        contiguous, e.g. proj. 0 param. 0, proj. 0 param. 1, ..., proj. 1 param. 0, ...
+  std::vector<PixelScalar2D> deriv_buf_;
+};
+
+}  // xreg
+
+#endif
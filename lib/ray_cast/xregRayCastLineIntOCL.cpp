@@ -24,10 +24,17 @@
 
 #include "xregRayCastLineIntOCL.h"
 
+#include <algorithm>
+
 #include <boost/compute/utility/source.hpp>
 
+#include <fmt/format.h>
+
 #include "xregExceptionUtils.h"
 #include "xregAssert.h"
+#include "xregITKBasicImageUtils.h"
+#include "xregOpenCLConvert.h"
+#include "xregOpenCLProgCache.h"
 
 namespace  // un-named
 {
@@ -36,30 +43,485 @@ namespace  // un-named
 
 const char* kRAY_CASTING_LINE_INT_OPENCL_SRC = BOOST_COMPUTE_STRINGIZE_SOURCE(
 
+// Advances a sample index along a ray until it lies in a brick that is not
+// empty. brick_grid stores the number of bricks in each dimension in x,y,z and
+// the brick dimension in w. Samples are at start_pt + step_idx * step_vec with
+// respect to the continuous index coordinates of the volume.
+ulong xregSkipEmptyBricks(__global const uchar* brick_empty,
+                          const int4 brick_grid,
+                          const float4 start_pt,
+                          const float4 step_vec,
+                          ulong step_idx,
+                          const ulong max_step_idx)
+{
+  const float step_arr[3] = { step_vec.x, step_vec.y, step_vec.z };
+
+  while (step_idx <= max_step_idx)
+  {
+    const float4 p = start_pt + (((float) step_idx) * step_vec);
+
+    const float p_arr[3] = { p.x, p.y, p.z };
+
+    const int b[3] = { clamp(((int) floor(p.x)) / brick_grid.w, 0, brick_grid.x - 1),
+                       clamp(((int) floor(p.y)) / brick_grid.w, 0, brick_grid.y - 1),
+                       clamp(((int) floor(p.z)) / brick_grid.w, 0, brick_grid.z - 1) };
+
+    if (!brick_empty[b[0] + (brick_grid.x * (b[1] + (brick_grid.y * b[2])))])
+    {
+      break;
+    }
+
+    // number of steps required to leave the brick
+    float min_t = FLT_MAX;
+
+    for (int a = 0; a < 3; ++a)
+    {
+      if (step_arr[a] > 0)
+      {
+        min_t = fmin(min_t, ((float) ((b[a] + 1) * brick_grid.w) - p_arr[a]) / step_arr[a]);
+      }
+      else if (step_arr[a] < 0)
+      {
+        min_t = fmin(min_t, ((float) (b[a] * brick_grid.w) - p_arr[a]) / step_arr[a]);
+      }
+    }
+
+    if (min_t >= (float) (max_step_idx - step_idx + 1))
+    {
+      step_idx = max_step_idx + 1;
+    }
+    else
+    {
+      step_idx += max((ulong) floor(min_t) + 1, (ulong) 1);
+    }
+  }
+
+  return step_idx;
+}
+
+// Computes the line integral through a single volume along the ray from the
+// focal point to a detector point, both with respect to the camera. The
+// volume's index bounds, physical point to index transform, and texture value
+// mapping are taken from args. The sampled values are combined starting with
+// XREG_LINE_INT_KERNEL_INIT. A brick dimension of zero (brick_grid.w)
+// indicates that empty space is not skipped. Samples are read with
+// XREG_LINE_INT_READ_VOL_TEX, so vol_tex holds B-spline coefficients when
+// using B-spline interpolation.
+float xregLineIntSampleVol(const RayCastArgs args,
+                           image3d_t vol_tex,
+                           const float16 cam_to_itk_phys_xform,
+                           const float4 focal_pt_wrt_cam,
+                           const float4 cur_det_pt_wrt_cam,
+                           __global const uchar* brick_empty,
+                           const int4 brick_grid)
+{
+  const sampler_t sampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP | CLK_FILTER_LINEAR;
+  
+  const float4 tex_coords_off = (float4) (0.5f, 0.5f, 0.5f, 0);
+
+  const float16 xform_cam_to_itk_idx = xregFrm4x4Composition(args.itk_phys_pt_to_itk_idx_xform,
+                                                             cam_to_itk_phys_xform);
+
+  const float4 pinhole_wrt_itk_idx = xregFrm4x4XformFloat4Pt(xform_cam_to_itk_idx, focal_pt_wrt_cam);
+
+  const float4 pinhole_to_det_wrt_itk_idx = xregFrm4x4XformFloat4Pt(xform_cam_to_itk_idx, cur_det_pt_wrt_cam)
+                                              - pinhole_wrt_itk_idx;
+
+  // check intersection
+  float2 t = xregLineSegmentRectIntersect(xregFloat4HmgToFloat3(args.img_aabb_min),
+                                          xregFloat4HmgToFloat3(args.img_aabb_max),
+                                          xregFloat4HmgToFloat3(pinhole_wrt_itk_idx),
+                                          xregFloat4HmgToFloat3(pinhole_to_det_wrt_itk_idx));
+  // t.x indicates the first intersection with the volume along the source to detector line,
+  // t.y indicates the exit of the volume along the source to detector line
+
+  // a float4 is returned from read_imagef, but for our image all components
+  // are equal
+  float4 dst_val = XREG_LINE_INT_KERNEL_INIT;
+
+  const float4 start_pt_wrt_itk_idx = pinhole_wrt_itk_idx + (t.x * pinhole_to_det_wrt_itk_idx);
+
+  const float pinhole_to_det_len_wrt_itk_idx  = xregFloat4HmgNorm(pinhole_to_det_wrt_itk_idx);
+  const float intersect_len_wrt_itk_idx = (t.y - t.x) * pinhole_to_det_len_wrt_itk_idx;
+
+  const float4 focal_pt_to_det_wrt_cam = cur_det_pt_wrt_cam - focal_pt_wrt_cam;
+  // NOTE: since we are transforming a vector with a scaling transform (points to indices),
+  //       the output vector may not have the same norm, thus we take the norm
+  const float step_len_wrt_itk_idx = xregFloat4HmgNorm(
+                xregFrm4x4XformFloat4Vec(xform_cam_to_itk_idx,
+                    (focal_pt_to_det_wrt_cam / xregFloat4HmgNorm(focal_pt_to_det_wrt_cam)) * args.step_size));
+
+  const ulong num_steps = (ulong)(intersect_len_wrt_itk_idx / step_len_wrt_itk_idx);
+
+  float4 cur_cont_vol_idx = (float4) (start_pt_wrt_itk_idx.x, start_pt_wrt_itk_idx.y, start_pt_wrt_itk_idx.z, 0);
+  
+  cur_cont_vol_idx += tex_coords_off;
+
+  // "/ pinhole_to_det_len_wrt_itk_idx" makes pinhole_to_det_wrt_itk_idx a unit vector
+  const float scale_to_step = step_len_wrt_itk_idx / pinhole_to_det_len_wrt_itk_idx;
+
+  const float4 step_vec_wrt_itk_idx = pinhole_to_det_wrt_itk_idx * scale_to_step;
+
+  ulong step_idx = 0;
+
+  while (step_idx <= num_steps)
+  {
+    // a brick dimension of zero indicates that empty space is not skipped
+    if (brick_grid.w > 0)
+    {
+      const ulong next_step_idx = xregSkipEmptyBricks(brick_empty, brick_grid,
+                                                      start_pt_wrt_itk_idx, step_vec_wrt_itk_idx,
+                                                      step_idx, num_steps);
+
+      if (next_step_idx > num_steps)
+      {
+        break;
+      }
+      else if (next_step_idx != step_idx)
+      {
+        step_idx = next_step_idx;
+
+        cur_cont_vol_idx = start_pt_wrt_itk_idx + (((float) step_idx) * step_vec_wrt_itk_idx);
+        cur_cont_vol_idx.w = 0;
+
+        cur_cont_vol_idx += tex_coords_off;
+      }
+    }
+
+    dst_val = XREG_LINE_INT_KERNEL_OP(dst_val, xregVolTexVal(XREG_LINE_INT_READ_VOL_TEX(vol_tex, sampler, cur_cont_vol_idx),
+                                                             args.vol_tex_scale, args.vol_tex_offset));
+
+    cur_cont_vol_idx += step_vec_wrt_itk_idx;
+
+    ++step_idx;
+  }
+
+  return dst_val.x;
+}
+
 __kernel void xregLineIntegralKernel(const RayCastArgs args,
                                      __global const float4* det_pts,
                                      image3d_t vol_tex,
                                      __global float* dst_line_integral_sums,
                                      __global const float16* cam_to_itk_phys_xforms,
                                      __global const ulong* cam_model_for_proj,
-                                     __global const float4* cam_focal_pts)
+                                     __global const float4* cam_focal_pts,
+                                     __global const uchar* brick_empty,
+                                     const int4 brick_grid,
+                                     __global const ulong* active_rays,
+                                     const ulong num_active_rays,
+                                     __global const float4* aa_offsets_wrt_cam,
+                                     const ulong num_aa_rays)
 {
-  const ulong idx = get_global_id(0);
+  const ulong ray_idx = get_global_id(0);
 
-  const ulong num_rays = args.num_projs * args.num_det_pts;
+  // the number of active rays is zero when every pixel is computed
+  const ulong num_rays = num_active_rays ? num_active_rays : (args.num_projs * args.num_det_pts);
 
-  if (idx < num_rays)
+  if (ray_idx < num_rays)
   {
+    const ulong idx = num_active_rays ? active_rays[ray_idx] : ray_idx;
+
     const ulong proj_idx   = idx / args.num_det_pts;
     const ulong det_pt_idx = idx - (proj_idx * args.num_det_pts);
     const ulong cam_idx    = cam_model_for_proj[proj_idx];
 
+    const float16 cam_to_itk_phys_xform = cam_to_itk_phys_xforms[proj_idx];
+
     const float4 focal_pt_wrt_cam = cam_focal_pts[cam_idx];
 
-    const sampler_t sampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP | CLK_FILTER_LINEAR;
-    
-    const float4 tex_coords_off = (float4) (0.5f, 0.5f, 0.5f, 0);
+    const float4 det_pt_wrt_cam = det_pts[(cam_idx * args.num_det_pts) + det_pt_idx];
+
+    float dst_val;
+
+    if (num_aa_rays)
+    {
+      // average the sub-pixel rays, only the binned value is written
+      __global const float4* cam_aa_offsets = aa_offsets_wrt_cam + (cam_idx * num_aa_rays);
 
+      dst_val = 0;
+
+      for (ulong aa_ray_idx = 0; aa_ray_idx < num_aa_rays; ++aa_ray_idx)
+      {
+        dst_val += xregLineIntSampleVol(args, vol_tex, cam_to_itk_phys_xform, focal_pt_wrt_cam,
+                                        det_pt_wrt_cam + cam_aa_offsets[aa_ray_idx],
+                                        brick_empty, brick_grid);
+      }
+
+      dst_val /= (float) num_aa_rays;
+    }
+    else
+    {
+      dst_val = xregLineIntSampleVol(args, vol_tex, cam_to_itk_phys_xform, focal_pt_wrt_cam,
+                                     det_pt_wrt_cam, brick_empty, brick_grid);
+    }
+
+    dst_line_integral_sums[idx] = XREG_LINE_INT_KERNEL_OP(dst_val, dst_line_integral_sums[idx]);
+  }
+}
+
+// Reads a linearly interpolated value of a paged volume at a continuous index
+// (without the texture coordinate offset). page_table stores the atlas slot of
+// each brick, or -1 when a brick is not resident, in which case zero is
+// returned. atlas_layout stores the number of slots in each dimension in x,y,z
+// and the side length of each slot in w. Each slot stores one more voxel than
+// a brick in each dimension, so that the samples in a brick only read its slot.
+float4 xregReadPagedVolTex(image3d_t atlas_tex,
+                           const sampler_t sampler,
+                           __global const int* page_table,
+                           const int4 brick_grid,
+                           const int4 atlas_layout,
+                           const float4 p)
+{
+  const int4 b = (int4) (clamp(((int) floor(p.x)) / brick_grid.w, 0, brick_grid.x - 1),
+                         clamp(((int) floor(p.y)) / brick_grid.w, 0, brick_grid.y - 1),
+                         clamp(((int) floor(p.z)) / brick_grid.w, 0, brick_grid.z - 1),
+                         0);
+
+  const int slot = page_table[b.x + (brick_grid.x * (b.y + (brick_grid.y * b.z)))];
+
+  float4 val = (float4) (0, 0, 0, 0);
+
+  if (slot >= 0)
+  {
+    const int4 slot_start = (int4) (slot % atlas_layout.x,
+                                    (slot / atlas_layout.x) % atlas_layout.y,
+                                    slot / (atlas_layout.x * atlas_layout.y),
+                                    0) * atlas_layout.w;
+
+    // clamped to the voxels stored in the slot
+    const float4 local_pt = clamp(p - convert_float4(b * brick_grid.w), 0.0f, (float) brick_grid.w);
+
+    val = read_imagef(atlas_tex, sampler,
+                      convert_float4(slot_start) + local_pt + (float4) (0.5f, 0.5f, 0.5f, 0));
+  }
+
+  return val;
+}
+
+// Computes the line integral through a single paged volume along the ray from
+// the focal point to a detector point, see xregLineIntSampleVol(). Bricks
+// flagged in brick_skip are either empty or are not resident and are not
+// intersected by this ray. Only linear interpolation is supported.
+float xregLineIntSampleVolPaged(const RayCastArgs args,
+                                image3d_t atlas_tex,
+                                const float16 cam_to_itk_phys_xform,
+                                const float4 focal_pt_wrt_cam,
+                                const float4 cur_det_pt_wrt_cam,
+                                __global const uchar* brick_skip,
+                                const int4 brick_grid,
+                                __global const int* page_table,
+                                const int4 atlas_layout)
+{
+  const sampler_t sampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_LINEAR;
+  
+  const float16 xform_cam_to_itk_idx = xregFrm4x4Composition(args.itk_phys_pt_to_itk_idx_xform,
+                                                             cam_to_itk_phys_xform);
+
+  const float4 pinhole_wrt_itk_idx = xregFrm4x4XformFloat4Pt(xform_cam_to_itk_idx, focal_pt_wrt_cam);
+
+  const float4 pinhole_to_det_wrt_itk_idx = xregFrm4x4XformFloat4Pt(xform_cam_to_itk_idx, cur_det_pt_wrt_cam)
+                                              - pinhole_wrt_itk_idx;
+
+  const float2 t = xregLineSegmentRectIntersect(xregFloat4HmgToFloat3(args.img_aabb_min),
+                                                xregFloat4HmgToFloat3(args.img_aabb_max),
+                                                xregFloat4HmgToFloat3(pinhole_wrt_itk_idx),
+                                                xregFloat4HmgToFloat3(pinhole_to_det_wrt_itk_idx));
+
+  float4 dst_val = XREG_LINE_INT_KERNEL_INIT;
+
+  float4 start_pt_wrt_itk_idx = pinhole_wrt_itk_idx + (t.x * pinhole_to_det_wrt_itk_idx);
+  start_pt_wrt_itk_idx.w = 0;
+
+  const float pinhole_to_det_len_wrt_itk_idx  = xregFloat4HmgNorm(pinhole_to_det_wrt_itk_idx);
+  const float intersect_len_wrt_itk_idx = (t.y - t.x) * pinhole_to_det_len_wrt_itk_idx;
+
+  const float4 focal_pt_to_det_wrt_cam = cur_det_pt_wrt_cam - focal_pt_wrt_cam;
+  
+  const float step_len_wrt_itk_idx = xregFloat4HmgNorm(
+                xregFrm4x4XformFloat4Vec(xform_cam_to_itk_idx,
+                    (focal_pt_to_det_wrt_cam / xregFloat4HmgNorm(focal_pt_to_det_wrt_cam)) * args.step_size));
+
+  const ulong num_steps = (ulong)(intersect_len_wrt_itk_idx / step_len_wrt_itk_idx);
+
+  const float4 step_vec_wrt_itk_idx = pinhole_to_det_wrt_itk_idx *
+                                        (step_len_wrt_itk_idx / pinhole_to_det_len_wrt_itk_idx);
+
+  ulong step_idx = 0;
+
+  while (step_idx <= num_steps)
+  {
+    step_idx = xregSkipEmptyBricks(brick_skip, brick_grid, start_pt_wrt_itk_idx, step_vec_wrt_itk_idx,
+                                   step_idx, num_steps);
+
+    if (step_idx > num_steps)
+    {
+      break;
+    }
+
+    const float4 cur_cont_vol_idx = start_pt_wrt_itk_idx + (((float) step_idx) * step_vec_wrt_itk_idx);
+
+    dst_val = XREG_LINE_INT_KERNEL_OP(dst_val,
+                                      xregVolTexVal(xregReadPagedVolTex(atlas_tex, sampler, page_table,
+                                                                        brick_grid, atlas_layout,
+                                                                        cur_cont_vol_idx),
+                                                    args.vol_tex_scale, args.vol_tex_offset));
+
+    ++step_idx;
+  }
+
+  return dst_val.x;
+}
+
+__kernel void xregLineIntegralPagedKernel(const RayCastArgs args,
+                                          __global const float4* det_pts,
+                                          image3d_t atlas_tex,
+                                          __global float* dst_line_integral_sums,
+                                          __global const float16* cam_to_itk_phys_xforms,
+                                          __global const ulong* cam_model_for_proj,
+                                          __global const float4* cam_focal_pts,
+                                          __global const uchar* brick_skip,
+                                          const int4 brick_grid,
+                                          __global const int* page_table,
+                                          const int4 atlas_layout,
+                                          __global const ulong* active_rays,
+                                          const ulong num_active_rays)
+{
+  const ulong ray_idx = get_global_id(0);
+
+  const ulong num_rays = num_active_rays ? num_active_rays : (args.num_projs * args.num_det_pts);
+
+  if (ray_idx < num_rays)
+  {
+    const ulong idx = num_active_rays ? active_rays[ray_idx] : ray_idx;
+
+    const ulong proj_idx   = idx / args.num_det_pts;
+    const ulong det_pt_idx = idx - (proj_idx * args.num_det_pts);
+    const ulong cam_idx    = cam_model_for_proj[proj_idx];
+
+    const float dst_val = xregLineIntSampleVolPaged(args, atlas_tex, cam_to_itk_phys_xforms[proj_idx],
+                                                    cam_focal_pts[cam_idx],
+                                                    det_pts[(cam_idx * args.num_det_pts) + det_pt_idx],
+                                                    brick_skip, brick_grid, page_table, atlas_layout);
+
+    dst_line_integral_sums[idx] = XREG_LINE_INT_KERNEL_OP(dst_val, dst_line_integral_sums[idx]);
+  }
+}
+
+// Computes the line integrals through up to four volumes in a single pass
+// over the rays. The values of each volume are combined in a register and
+// written once. The arguments (bounds, index transforms, etc.) of volume
+// vol_offset + i are stored at vol_args[vol_offset + i] and sampled from
+// vol_tex_i. The camera poses of each volume are stored consecutively
+// in cam_to_itk_phys_xforms, with the poses of volume 0 first. Empty space is
+// not skipped, but each volume's bounds may be clipped to its non-empty voxels.
+__kernel void xregLineIntegralMultiVolKernel(const RayCastArgs args,
+                                             __global const float4* det_pts,
+                                             image3d_t vol_tex_0,
+                                             image3d_t vol_tex_1,
+                                             image3d_t vol_tex_2,
+                                             image3d_t vol_tex_3,
+                                             __global float* dst_line_integral_sums,
+                                             __global const float16* cam_to_itk_phys_xforms,
+                                             __global const ulong* cam_model_for_proj,
+                                             __global const float4* cam_focal_pts,
+                                             __global const RayCastArgs* vol_args,
+                                             const ulong vol_offset,
+                                             const ulong num_vols,
+                                             __global const uchar* brick_empty,
+                                             __global const ulong* active_rays,
+                                             const ulong num_active_rays)
+{
+  const ulong ray_idx = get_global_id(0);
+
+  // the number of active rays is zero when every pixel is computed
+  const ulong num_rays = num_active_rays ? num_active_rays : (args.num_projs * args.num_det_pts);
+
+  if (ray_idx < num_rays)
+  {
+    const ulong idx = num_active_rays ? active_rays[ray_idx] : ray_idx;
+
+    const ulong proj_idx   = idx / args.num_det_pts;
+    const ulong det_pt_idx = idx - (proj_idx * args.num_det_pts);
+    const ulong cam_idx    = cam_model_for_proj[proj_idx];
+
+    const float4 focal_pt_wrt_cam = cam_focal_pts[cam_idx];
+
+    const float4 cur_det_pt_wrt_cam = det_pts[(cam_idx * args.num_det_pts) + det_pt_idx];
+
+    const int4 no_bricks = (int4) (0, 0, 0, 0);
+
+    float dst_val = XREG_LINE_INT_KERNEL_INIT;
+
+    // images may not be indexed, so each texture is sampled explicitly
+    if (num_vols > 0)
+    {
+      dst_val = XREG_LINE_INT_KERNEL_OP(dst_val,
+                    xregLineIntSampleVol(vol_args[vol_offset], vol_tex_0,
+                                         cam_to_itk_phys_xforms[(vol_offset * args.num_projs) + proj_idx],
+                                         focal_pt_wrt_cam, cur_det_pt_wrt_cam, brick_empty, no_bricks));
+    }
+
+    if (num_vols > 1)
+    {
+      dst_val = XREG_LINE_INT_KERNEL_OP(dst_val,
+                    xregLineIntSampleVol(vol_args[vol_offset + 1], vol_tex_1,
+                                         cam_to_itk_phys_xforms[((vol_offset + 1) * args.num_projs) + proj_idx],
+                                         focal_pt_wrt_cam, cur_det_pt_wrt_cam, brick_empty, no_bricks));
+    }
+
+    if (num_vols > 2)
+    {
+      dst_val = XREG_LINE_INT_KERNEL_OP(dst_val,
+                    xregLineIntSampleVol(vol_args[vol_offset + 2], vol_tex_2,
+                                         cam_to_itk_phys_xforms[((vol_offset + 2) * args.num_projs) + proj_idx],
+                                         focal_pt_wrt_cam, cur_det_pt_wrt_cam, brick_empty, no_bricks));
+    }
+
+    if (num_vols > 3)
+    {
+      dst_val = XREG_LINE_INT_KERNEL_OP(dst_val,
+                    xregLineIntSampleVol(vol_args[vol_offset + 3], vol_tex_3,
+                                         cam_to_itk_phys_xforms[((vol_offset + 3) * args.num_projs) + proj_idx],
+                                         focal_pt_wrt_cam, cur_det_pt_wrt_cam, brick_empty, no_bricks));
+    }
+
+    dst_line_integral_sums[idx] = XREG_LINE_INT_KERNEL_OP(dst_val, dst_line_integral_sums[idx]);
+  }
+}
+
+// Exact voxel traversal (Siddon's method w/ the incremental updates of Jacobs et al.).
+// The sampling kernel above accumulates samples without scaling by the step
+// size, so the length weighted sums are divided by the step size in order to
+// produce values of the same scale.
+__kernel void xregLineIntegralSiddonKernel(const RayCastArgs args,
+                                           __global const float4* det_pts,
+                                           image3d_t vol_tex,
+                                           __global float* dst_line_integral_sums,
+                                           __global const float16* cam_to_itk_phys_xforms,
+                                           __global const ulong* cam_model_for_proj,
+                                           __global const float4* cam_focal_pts,
+                                           __global const uchar* brick_empty,
+                                           const int4 brick_grid,
+                                           __global const ulong* active_rays,
+                                           const ulong num_active_rays)
+{
+  const ulong ray_idx = get_global_id(0);
+
+  const ulong num_rays = num_active_rays ? num_active_rays : (args.num_projs * args.num_det_pts);
+
+  if (ray_idx < num_rays)
+  {
+    const ulong idx = num_active_rays ? active_rays[ray_idx] : ray_idx;
+
+    const ulong proj_idx   = idx / args.num_det_pts;
+    const ulong det_pt_idx = idx - (proj_idx * args.num_det_pts);
+    const ulong cam_idx    = cam_model_for_proj[proj_idx];
+
+    const float4 focal_pt_wrt_cam = cam_focal_pts[cam_idx];
+
+    const sampler_t sampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+    
     const float16 xform_cam_to_itk_idx = xregFrm4x4Composition(args.itk_phys_pt_to_itk_idx_xform,
                                                                cam_to_itk_phys_xforms[proj_idx]);
 
@@ -67,52 +529,93 @@ __kernel void xregLineIntegralKernel(const RayCastArgs args,
 
     const float4 cur_det_pt_wrt_cam = det_pts[(cam_idx * args.num_det_pts) + det_pt_idx];
 
-    const float4 pinhole_to_det_wrt_itk_idx = xregFrm4x4XformFloat4Pt(xform_cam_to_itk_idx, cur_det_pt_wrt_cam)
-                                                - pinhole_wrt_itk_idx;
+    const float3 p0 = xregFloat4HmgToFloat3(pinhole_wrt_itk_idx);
+    
+    const float3 d = xregFloat4HmgToFloat3(xregFrm4x4XformFloat4Pt(xform_cam_to_itk_idx, cur_det_pt_wrt_cam)
+                                              - pinhole_wrt_itk_idx);
+
+    const int vol_size[3] = { get_image_width(vol_tex), get_image_height(vol_tex), get_image_depth(vol_tex) };
+
+    // voxel i occupies [i - 0.5, i + 0.5] in continuous index coordinates
+    const float2 t = xregLineSegmentRectIntersect((float3) (-0.5f, -0.5f, -0.5f),
+                                                  (float3) (vol_size[0] - 0.5f, vol_size[1] - 0.5f, vol_size[2] - 0.5f),
+                                                  p0, d);
+    
+    float dst_val = XREG_LINE_INT_KERNEL_INIT;
 
-    // check intersection
-    float2 t = xregLineSegmentRectIntersect(xregFloat4HmgToFloat3(args.img_aabb_min),
-                                            xregFloat4HmgToFloat3(args.img_aabb_max),
-                                            xregFloat4HmgToFloat3(pinhole_wrt_itk_idx),
-                                            xregFloat4HmgToFloat3(pinhole_to_det_wrt_itk_idx));
-    // t.x indicates the first intersection with the volume along the source to detector line,
-    // t.y indicates the exit of the volume along the source to detector line
+    if (t.y > t.x)
+    {
+      // find the first voxel using a point just inside the volume
+      const float3 entry_pt = p0 + ((t.x + (1.0e-4f * (t.y - t.x))) * d);
 
-    // a float4 is returned from read_imagef, but for our image all components
-    // are equal
-    float4 dst_val = XREG_LINE_INT_KERNEL_INIT;
+      const float p0_arr[3]    = { p0.x, p0.y, p0.z };
+      const float d_arr[3]     = { d.x, d.y, d.z };
+      const float entry_arr[3] = { entry_pt.x, entry_pt.y, entry_pt.z };
 
-    const float4 start_pt_wrt_itk_idx = pinhole_wrt_itk_idx + (t.x * pinhole_to_det_wrt_itk_idx);
+      int vox_idx[3];
+      int vox_step[3];
+      float t_next[3];
+      float t_delta[3];
 
-    const float pinhole_to_det_len_wrt_itk_idx  = xregFloat4HmgNorm(pinhole_to_det_wrt_itk_idx);
-    const float intersect_len_wrt_itk_idx = (t.y - t.x) * pinhole_to_det_len_wrt_itk_idx;
+      for (int a = 0; a < 3; ++a)
+      {
+        vox_idx[a] = clamp((int) floor(entry_arr[a] + 0.5f), 0, vol_size[a] - 1);
 
-    const float4 focal_pt_to_det_wrt_cam = cur_det_pt_wrt_cam - focal_pt_wrt_cam;
-    // NOTE: since we are transforming a vector with a scaling transform (points to indices),
-    //       the output vector may not have the same norm, thus we take the norm
-    const float step_len_wrt_itk_idx = xregFloat4HmgNorm(
-                  xregFrm4x4XformFloat4Vec(xform_cam_to_itk_idx,
-                      (focal_pt_to_det_wrt_cam / xregFloat4HmgNorm(focal_pt_to_det_wrt_cam)) * args.step_size));
+        if (d_arr[a] > 0)
+        {
+          vox_step[a] = 1;
+          t_delta[a]  = 1.0f / d_arr[a];
+          t_next[a]   = ((vox_idx[a] + 0.5f) - p0_arr[a]) / d_arr[a];
+        }
+        else if (d_arr[a] < 0)
+        {
+          vox_step[a] = -1;
+          t_delta[a]  = -1.0f / d_arr[a];
+          t_next[a]   = ((vox_idx[a] - 0.5f) - p0_arr[a]) / d_arr[a];
+        }
+        else
+        {
+          vox_step[a] = 0;
+          t_delta[a]  = FLT_MAX;
+          t_next[a]   = FLT_MAX;
+        }
+      }
 
-    const ulong num_steps = (ulong)(intersect_len_wrt_itk_idx / step_len_wrt_itk_idx);
+      float t_cur = t.x;
 
-    float4 cur_cont_vol_idx = (float4) (start_pt_wrt_itk_idx.x, start_pt_wrt_itk_idx.y, start_pt_wrt_itk_idx.z, 0);
-    
-    cur_cont_vol_idx += tex_coords_off;
+      while (t_cur < t.y)
+      {
+        const int a = (t_next[0] < t_next[1]) ? ((t_next[0] < t_next[2]) ? 0 : 2) :
+                                                ((t_next[1] < t_next[2]) ? 1 : 2);
 
-    // "/ pinhole_to_det_len_wrt_itk_idx" makes pinhole_to_det_wrt_itk_idx a unit vector
-    const float scale_to_step = step_len_wrt_itk_idx / pinhole_to_det_len_wrt_itk_idx;
+        const float t_end = fmin(t_next[a], t.y);
 
-    const float4 step_vec_wrt_itk_idx = pinhole_to_det_wrt_itk_idx * scale_to_step;
+        const float v = xregVolTexVal(read_imagef(vol_tex, sampler, (int4) (vox_idx[0], vox_idx[1], vox_idx[2], 0)),
+                                      args.vol_tex_scale, args.vol_tex_offset).x;
 
-    for (ulong step_idx = 0; step_idx <= num_steps; ++step_idx)
-    {
-      dst_val = XREG_LINE_INT_KERNEL_OP(dst_val, read_imagef(vol_tex, sampler, cur_cont_vol_idx));
+        dst_val = XREG_LINE_INT_KERNEL_OP(dst_val, XREG_LINE_INT_KERNEL_WEIGHT_BY_LEN ? (v * (t_end - t_cur)) : v);
+
+        t_cur = t_end;
+
+        vox_idx[a] += vox_step[a];
+
+        if ((vox_idx[a] < 0) || (vox_idx[a] >= vol_size[a]))
+        {
+          break;
+        }
+
+        t_next[a] += t_delta[a];
+      }
 
-      cur_cont_vol_idx += step_vec_wrt_itk_idx;
+      if (XREG_LINE_INT_KERNEL_WEIGHT_BY_LEN)
+      {
+        // convert the length along the ray, as a fraction of the ray, to
+        // physical units and then to units of step size
+        dst_val *= xregFloat4HmgNorm(cur_det_pt_wrt_cam - focal_pt_wrt_cam) / args.step_size;
+      }
     }
 
-    dst_line_integral_sums[idx] = XREG_LINE_INT_KERNEL_OP(dst_val.x, dst_line_integral_sums[idx]);
+    dst_line_integral_sums[idx] = XREG_LINE_INT_KERNEL_OP(dst_val, dst_line_integral_sums[idx]);
   }
 }
 
@@ -131,71 +634,723 @@ xreg::RayCasterLineIntOCL::RayCasterLineIntOCL(const boost::compute::context& ct
   : RayCasterOCL(ctx, queue)
 { }
 
+bool xreg::RayCasterLineIntOCL::supports_interp_method(const InterpMethod interp_method) const
+{
+  return (interp_method == kRAY_CAST_INTERP_LINEAR) || (interp_method == kRAY_CAST_INTERP_SIDDON) ||
+         (interp_method == kRAY_CAST_INTERP_BSPLINE);
+}
+
+void xreg::RayCasterLineIntOCL::vols_changed()
+{
+  namespace bc = boost::compute;
+
+  RayCasterOCL::vols_changed();
+
+  const size_type num_vols = this->vols_.size();
+
+  brick_empty_dev_.clear();
+
+  if (this->use_empty_space_skipping_)
+  {
+    brick_empty_dev_.reserve(num_vols);
+
+    for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
+    {
+      const auto& brick_empty = this->vol_brick_grids_[vol_idx].brick_empty;
+
+      brick_empty_dev_.emplace_back(brick_empty.size(), ctx_);
+
+      bc::copy(brick_empty.begin(), brick_empty.end(), brick_empty_dev_.back().begin(), cmd_queue_);
+    }
+  }
+
+  if (dummy_brick_empty_dev_.empty())
+  {
+    dummy_brick_empty_dev_ = BrickFlagListDev(1, ctx_);
+  }
+
+  paged_vols_.clear();
+
+  if (use_paged_vols_)
+  {
+    if (!this->use_empty_space_skipping_)
+    {
+      xregThrow("Paged volumes require the empty space brick grid!");
+    }
+
+    paged_vols_.reserve(num_vols);
+
+    for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
+    {
+      paged_vols_.emplace_back(new RayCastPagedVolOCL(ctx_, this->vols_[vol_idx].GetPointer(),
+                                                      &this->vol_brick_grids_[vol_idx],
+                                                      max_num_resident_bricks_,
+                                                      vol_tex_fmt_, cmd_queue_));
+    }
+  }
+}
+
+bool xreg::RayCasterLineIntOCL::uses_full_vol_texs() const
+{
+  return !use_paged_vols_;
+}
+
+void xreg::RayCasterLineIntOCL::set_use_paged_vols(const bool use_paged)
+{
+  if (use_paged != use_paged_vols_)
+  {
+    use_paged_vols_ = use_paged;
+
+    if (use_paged && !this->use_empty_space_skipping_)
+    {
+      // the bricks are defined by the empty space grid, this also calls
+      // vols_changed() when volumes are set
+      this->set_use_empty_space_skipping(true);
+    }
+    else if (!this->vols_.empty())
+    {
+      vols_changed();
+    }
+  }
+}
+
+bool xreg::RayCasterLineIntOCL::use_paged_vols() const
+{
+  return use_paged_vols_;
+}
+
+bool xreg::RayCasterLineIntOCL::supports_compute_slots() const
+{
+  return !use_paged_vols_;
+}
+
+void xreg::RayCasterLineIntOCL::set_max_num_resident_bricks(const size_type max_num_bricks)
+{
+  xregASSERT(max_num_bricks > 0);
+
+  if (max_num_bricks != max_num_resident_bricks_)
+  {
+    max_num_resident_bricks_ = max_num_bricks;
+
+    if (use_paged_vols_ && !this->vols_.empty())
+    {
+      vols_changed();
+    }
+  }
+}
+
+xreg::size_type xreg::RayCasterLineIntOCL::max_num_resident_bricks() const
+{
+  return max_num_resident_bricks_;
+}
+
+void xreg::RayCasterLineIntOCL::set_anti_alias_factor(const size_type aa_fact)
+{
+  set_anti_alias_offsets(RayCastStratifiedPts2D(aa_fact));
+
+  // center the offsets on the pixel
+  for (auto& off : aa_offsets_)
+  {
+    off.array() -= CoordScalar(0.5);
+  }
+}
+
+xreg::size_type xreg::RayCasterLineIntOCL::anti_alias_factor() const
+{
+  return aa_offsets_.size();
+}
+
+void xreg::RayCasterLineIntOCL::set_anti_alias_offsets(const Pt2List& offsets)
+{
+  aa_offsets_ = offsets;
+
+  aa_offsets_need_update_ = true;
+}
+
+const xreg::Pt2List& xreg::RayCasterLineIntOCL::anti_alias_offsets() const
+{
+  return aa_offsets_;
+}
+
+void xreg::RayCasterLineIntOCL::active_pixels_changed()
+{
+  active_rays_need_update_ = true;
+}
+
+void xreg::RayCasterLineIntOCL::camera_models_changed()
+{
+  RayCasterOCL::camera_models_changed();
+
+  aa_offsets_need_update_ = true;
+}
+
+void xreg::RayCasterLineIntOCL::update_anti_alias_offsets()
+{
+  namespace bc = boost::compute;
+
+  if (aa_offsets_need_update_)
+  {
+    // The mapping from detector indices to physical points is affine, so the
+    // physical offset of a sub-pixel ray is the same for every pixel
+    const size_type num_cams = this->camera_models_.size();
+
+    const size_type num_aa_rays = aa_offsets_.size();
+
+    Float4ListHost aa_offsets_wrt_cam(std::max(num_cams * num_aa_rays, size_type(1)),
+                                      bc::float4_(0,0,0,0));
+
+    for (size_type cam_idx = 0; cam_idx < num_cams; ++cam_idx)
+    {
+      const CameraModel& cam = this->camera_models_[cam_idx];
+
+      const Pt3 det_origin_wrt_cam = cam.ind_pt_to_phys_det_pt(Pt2(0,0));
+
+      for (size_type aa_ray_idx = 0; aa_ray_idx < num_aa_rays; ++aa_ray_idx)
+      {
+        aa_offsets_wrt_cam[(cam_idx * num_aa_rays) + aa_ray_idx] = OpenCLFloat3ToBoostComp4(
+              ConvertToOpenCL(Pt3(cam.ind_pt_to_phys_det_pt(aa_offsets_[aa_ray_idx]) - det_origin_wrt_cam)), 0);
+      }
+    }
+
+    aa_offsets_wrt_cam_dev_ = Float4ListDev(aa_offsets_wrt_cam.begin(), aa_offsets_wrt_cam.end(), cmd_queue_);
+
+    aa_offsets_need_update_ = false;
+  }
+}
+
+void xreg::RayCasterLineIntOCL::update_active_rays()
+{
+  namespace bc = boost::compute;
+
+  if (active_rays_need_update_ || (active_rays_cam_model_for_proj_ != this->cam_model_for_proj_))
+  {
+    // Compact the active pixels of every projection into a list of indices
+    // into the stacked projection buffer
+    const size_type num_pix_per_proj = ray_cast_kernel_args_.num_det_pts;
+
+    std::vector<bc::ulong_> active_rays;
+
+    for (size_type proj_idx = 0; proj_idx < this->num_projs_; ++proj_idx)
+    {
+      const size_type cam_idx = this->cam_model_for_proj_[proj_idx];
+
+      const size_type proj_off = proj_idx * num_pix_per_proj;
+
+      if (this->has_active_pixels(cam_idx))
+      {
+        for (const size_type pix_idx : this->active_pixels(cam_idx))
+        {
+          active_rays.push_back(proj_off + pix_idx);
+        }
+      }
+      else
+      {
+        for (size_type pix_idx = 0; pix_idx < num_pix_per_proj; ++pix_idx)
+        {
+          active_rays.push_back(proj_off + pix_idx);
+        }
+      }
+    }
+
+    num_active_rays_ = active_rays.size();
+
+    // always keep at least one element, so that a valid buffer may be passed
+    // to the kernel when no rays are active
+    active_rays_dev_ = ActiveRayListDev(std::max(num_active_rays_, size_type(1)), ctx_);
+    
+    bc::copy(active_rays.begin(), active_rays.end(), active_rays_dev_.begin(), cmd_queue_);
+
+    active_rays_cam_model_for_proj_ = this->cam_model_for_proj_;
+
+    active_rays_need_update_ = false;
+  }
+}
+
+xreg::size_type xreg::RayCasterLineIntOCL::prepare_rays_to_launch()
+{
+  if (this->use_active_pixels())
+  {
+    update_active_rays();
+
+    return num_active_rays_;
+  }
+  else if (active_rays_dev_.empty())
+  {
+    active_rays_dev_ = ActiveRayListDev(1, ctx_);
+  }
+
+  return ray_cast_kernel_args_.num_det_pts * this->num_projs_;
+}
+
 void xreg::RayCasterLineIntOCL::allocate_resources()
 {
   namespace bc = boost::compute;
 
   RayCasterOCL::allocate_resources();
-  
+
+  build_kernels();
+}
+
+void xreg::RayCasterLineIntOCL::prebuild_progs()
+{
+  BuildOpenCLProg(line_int_ocl_src(), ctx_);
+}
+
+void xreg::RayCasterLineIntOCL::build_kernels()
+{
+  namespace bc = boost::compute;
+
+  // Build the line integral ray casting program
+  bc::program prog = BuildOpenCLProg(line_int_ocl_src(), ctx_);
+
+  dev_kernel_ = prog.create_kernel("xregLineIntegralKernel");
+
+  dev_siddon_kernel_ = prog.create_kernel("xregLineIntegralSiddonKernel");
+
+  dev_multi_vol_kernel_ = prog.create_kernel("xregLineIntegralMultiVolKernel");
+
+  dev_paged_kernel_ = prog.create_kernel("xregLineIntegralPagedKernel");
+
+  kernels_use_bspline_ = this->interp_method_ == kRAY_CAST_INTERP_BSPLINE;
+}
+
+void xreg::RayCasterLineIntOCL::update_kernels_for_interp()
+{
+  if ((this->interp_method_ == kRAY_CAST_INTERP_BSPLINE) != kernels_use_bspline_)
+  {
+    build_kernels();
+  }
+}
+
+std::string xreg::RayCasterLineIntOCL::line_int_ocl_src() const
+{
   std::string kernel_op_ocl_src;
   
   switch (this->kernel_id())
   {
     case kRAY_CAST_LINE_INT_SUM_KERNEL:
       kernel_op_ocl_src = "\n\n#define XREG_LINE_INT_KERNEL_INIT 0\n"
-                          "#define XREG_LINE_INT_KERNEL_OP(X,Y) (X) + (Y)\n\n";
+                          "#define XREG_LINE_INT_KERNEL_OP(X,Y) (X) + (Y)\n"
+                          "#define XREG_LINE_INT_KERNEL_WEIGHT_BY_LEN 1\n\n";
       break;
     case kRAY_CAST_LINE_INT_MAX_KERNEL:
       kernel_op_ocl_src = "\n\n#define XREG_LINE_INT_KERNEL_INIT -FLT_MAX\n"
-                          "#define XREG_LINE_INT_KERNEL_OP(X,Y) max((X),(Y))\n\n";
+                          "#define XREG_LINE_INT_KERNEL_OP(X,Y) max((X),(Y))\n"
+                          "#define XREG_LINE_INT_KERNEL_WEIGHT_BY_LEN 0\n\n";
       break;
     default:
       xregThrow("Unsupported Line Integral Kernel!");
   }
 
-  // Build the line integral ray casting program
+  // B-spline interpolation samples a texture of coefficients
+  const char* read_vol_tex_ocl_src = (this->interp_method_ == kRAY_CAST_INTERP_BSPLINE) ?
+      "#define XREG_LINE_INT_READ_VOL_TEX(T,S,P) xregReadBSplineTex((T),(S),(P))\n\n" :
+      "#define XREG_LINE_INT_READ_VOL_TEX(T,S,P) read_imagef((T),(S),(P))\n\n";
+
   std::stringstream ss;
   ss << RayCastBaseOCLStr()
      << kernel_op_ocl_src
+     << read_vol_tex_ocl_src
      << kRAY_CASTING_LINE_INT_OPENCL_SRC;
 
-  bc::program prog = bc::program::create_with_source(ss.str(), ctx_);
-  prog.build();
+  return ss.str();
+}
 
-  dev_kernel_ = prog.create_kernel("xregLineIntegralKernel");
+std::string xreg::RayCasterLineIntOCL::line_int_tuning_key(const boost::compute::kernel& k) const
+{
+  return fmt::format("{}_op{}_interp{}", k.name(), static_cast<int>(this->kernel_id()),
+                     static_cast<int>(this->interp_method_));
+}
+
+bool xreg::RayCasterLineIntOCL::set_empty_space_kernel_args(boost::compute::kernel& k,
+                                                            const size_type brick_empty_arg_idx,
+                                                            const size_type vol_idx)
+{
+  namespace bc = boost::compute;
+
+  // Empty space skipping is only possible with the sum kernel. The support of
+  // the B-spline interpolation extends beyond the brick bounds.
+  const bool skip_empty = this->use_empty_space_skipping_ &&
+                          (this->kernel_id() == kRAY_CAST_LINE_INT_SUM_KERNEL) &&
+                          (this->interp_method_ != kRAY_CAST_INTERP_BSPLINE);
+
+  bc::int4_ brick_grid_arg(0,0,0,0);
+
+  if (skip_empty)
+  {
+    const RayCastVolBrickGrid& brick_grid = this->vol_brick_grids_[vol_idx];
+
+    if (!brick_grid.any_non_empty)
+    {
+      k.set_arg(brick_empty_arg_idx, dummy_brick_empty_dev_);
+
+      k.set_arg(brick_empty_arg_idx + 1, brick_grid_arg);
+
+      return false;
+    }
+
+    // clip rays to the non-empty voxels
+    ray_cast_kernel_args_.img_aabb_min = OpenCLFloat3ToBoostComp4(ConvertToOpenCL(brick_grid.non_empty_idx_min));
+    ray_cast_kernel_args_.img_aabb_max = OpenCLFloat3ToBoostComp4(ConvertToOpenCL(brick_grid.non_empty_idx_max));
+
+    brick_grid_arg = bc::int4_(brick_grid.num_bricks_x, brick_grid.num_bricks_y,
+                               brick_grid.num_bricks_z, brick_grid.brick_dim);
+  }
+
+  k.set_arg(brick_empty_arg_idx, skip_empty ? brick_empty_dev_[vol_idx] : dummy_brick_empty_dev_);
+
+  k.set_arg(brick_empty_arg_idx + 1, brick_grid_arg);
+
+  return true;
 }
 
 void xreg::RayCasterLineIntOCL::compute(const size_type vol_idx)
 {
+  namespace bc = boost::compute;
+
   xregASSERT(this->resources_allocated_);
 
   compute_helper_pre_kernels(vol_idx);
 
+  update_kernels_for_interp();
+
+  if (use_paged_vols_)
+  {
+    compute_paged(vol_idx);
+    return;
+  }
+
+  const bool use_siddon = this->interp_method_ == kRAY_CAST_INTERP_SIDDON;
+
+  if (use_siddon && !aa_offsets_.empty())
+  {
+    xregThrow("Anti-aliasing is not supported with exact voxel traversals!");
+  }
+
+  bc::kernel& k = use_siddon ? dev_siddon_kernel_ : dev_kernel_;
+
+  if (!set_empty_space_kernel_args(k, 7, vol_idx))
+  {
+    // all voxels are empty, so none of the line integrals will change
+    compute_helper_post_kernels(vol_idx);
+    return;
+  }
+
+  const bool use_active_rays = this->use_active_pixels();
+
+  // only the active rays are launched
+  std::size_t global_work_size = prepare_rays_to_launch();
+
+  if (!global_work_size)
+  {
+    // none of the line integrals will change
+    compute_helper_post_kernels(vol_idx);
+    return;
+  }
+
+  const bc::image3d* vol_tex = &vol_texs_dev_[vol_idx];
+
+  if (this->interp_method_ == kRAY_CAST_INTERP_BSPLINE)
+  {
+    const RayCastOCLVolTex& coef_tex = this->bspline_coef_tex(vol_idx);
+
+    vol_tex = &coef_tex.tex;
+
+    ray_cast_kernel_args_.vol_tex_scale  = coef_tex.scale;
+    ray_cast_kernel_args_.vol_tex_offset = coef_tex.offset;
+  }
+
   // setup kernel arguments and launch
 
-  dev_kernel_.set_arg(0, sizeof(ray_cast_kernel_args_), &ray_cast_kernel_args_);
+  k.set_arg(0, sizeof(ray_cast_kernel_args_), &ray_cast_kernel_args_);
 
-  dev_kernel_.set_arg(1, det_pts_dev_);
+  k.set_arg(1, *det_pts_dev_);
 
-  dev_kernel_.set_arg(2, vol_texs_dev_[vol_idx]);
+  k.set_arg(2, *vol_tex);
 
-  dev_kernel_.set_arg(3, *proj_pixels_dev_to_use_);
+  k.set_arg(3, *proj_pixels_dev_to_use_);
 
-  dev_kernel_.set_arg(4, cam_to_itk_phys_xforms_dev_);
+  k.set_arg(4, cam_to_itk_phys_xforms_dev_);
 
-  dev_kernel_.set_arg(5, cam_model_for_proj_dev_);
+  k.set_arg(5, cam_model_for_proj_dev_);
 
-  dev_kernel_.set_arg(6, focal_pts_dev_);
+  k.set_arg(6, focal_pts_dev_);
 
-  std::size_t global_work_size = ray_cast_kernel_args_.num_det_pts * this->num_projs_;
+  k.set_arg(9, active_rays_dev_);
 
-  cmd_queue_.enqueue_nd_range_kernel(dev_kernel_,
-                                     1, // dim
-                                     0, // null offset -> start at 0
-                                     &global_work_size,
-                                     0  // passing null lets open CL pick a local size
-                                    ).wait();
+  // zero indicates that every ray is computed
+  k.set_arg(10, bc::ulong_(use_active_rays ? num_active_rays_ : 0));
+
+  if (!use_siddon)
+  {
+    update_anti_alias_offsets();
+
+    k.set_arg(11, aa_offsets_wrt_cam_dev_);
+
+    // zero indicates that a single ray is cast through each pixel center
+    k.set_arg(12, bc::ulong_(aa_offsets_.size()));
+  }
+
+  launch_ray_cast_kernel(k, line_int_tuning_key(k), 3, global_work_size);
+
+  compute_helper_post_kernels(vol_idx);
+}
+
+void xreg::RayCasterLineIntOCL::compute_paged(const size_type vol_idx)
+{
+  namespace bc = boost::compute;
+
+  if ((this->kernel_id() != kRAY_CAST_LINE_INT_SUM_KERNEL) ||
+      (this->interp_method_ != kRAY_CAST_INTERP_LINEAR))
+  {
+    xregThrow("Paged volumes only support the sum kernel with linear interpolation!");
+  }
+
+  if (!aa_offsets_.empty())
+  {
+    xregThrow("Anti-aliasing is not supported with paged volumes!");
+  }
+
+  const RayCastVolBrickGrid& brick_grid = this->vol_brick_grids_[vol_idx];
+
+  // only the active rays are launched
+  const std::size_t global_work_size = brick_grid.any_non_empty ? prepare_rays_to_launch() : 0;
+
+  if (!global_work_size)
+  {
+    // none of the line integrals will change
+    compute_helper_post_kernels(vol_idx);
+    return;
+  }
+
+  RayCastPagedVolOCL& paged_vol = *paged_vols_[vol_idx];
+
+  paged_vol.update_resident_bricks(this->camera_models_, this->cam_model_for_proj_,
+                                   FrameTransformList(this->xforms_cam_to_itk_phys_.begin(),
+                                                      this->xforms_cam_to_itk_phys_.begin() + this->num_projs_),
+                                   ITKImagePhysicalPointTransformsAsEigen(this->vols_[vol_idx].GetPointer()).inverse(),
+                                   cmd_queue_);
+
+  // clip rays to the non-empty voxels
+  ray_cast_kernel_args_.img_aabb_min = OpenCLFloat3ToBoostComp4(ConvertToOpenCL(brick_grid.non_empty_idx_min));
+  ray_cast_kernel_args_.img_aabb_max = OpenCLFloat3ToBoostComp4(ConvertToOpenCL(brick_grid.non_empty_idx_max));
+
+  // setup kernel arguments and launch
+
+  bc::kernel& k = dev_paged_kernel_;
+
+  k.set_arg(0, sizeof(ray_cast_kernel_args_), &ray_cast_kernel_args_);
+
+  k.set_arg(1, *det_pts_dev_);
+
+  k.set_arg(2, paged_vol.atlas_tex());
+
+  k.set_arg(3, *proj_pixels_dev_to_use_);
+
+  k.set_arg(4, cam_to_itk_phys_xforms_dev_);
+
+  k.set_arg(5, cam_model_for_proj_dev_);
+
+  k.set_arg(6, focal_pts_dev_);
+
+  k.set_arg(7, paged_vol.brick_skip());
+
+  k.set_arg(8, bc::int4_(brick_grid.num_bricks_x, brick_grid.num_bricks_y,
+                         brick_grid.num_bricks_z, brick_grid.brick_dim));
+
+  k.set_arg(9, paged_vol.page_table());
+
+  k.set_arg(10, paged_vol.atlas_layout());
+
+  k.set_arg(11, active_rays_dev_);
+
+  // zero indicates that every ray is computed
+  k.set_arg(12, bc::ulong_(this->use_active_pixels() ? num_active_rays_ : 0));
+
+  launch_ray_cast_kernel(k, line_int_tuning_key(k), 3, global_work_size);
 
   compute_helper_post_kernels(vol_idx);
 }
 
+void xreg::RayCasterLineIntOCL::compute_multi_vols(const std::vector<size_type>& vol_inds,
+                                                  const std::vector<FrameTransformList>& xforms_cam_to_itk_phys_for_each_vol)
+{
+  namespace bc = boost::compute;
+
+  const size_type num_vols_to_comp = vol_inds.size();
+
+  xregASSERT(num_vols_to_comp == xforms_cam_to_itk_phys_for_each_vol.size());
+
+  if ((num_vols_to_comp < 2) || (this->interp_method_ == kRAY_CAST_INTERP_SIDDON) || use_paged_vols_ ||
+      !aa_offsets_.empty())
+  {
+    // exact traversals, paged volumes, and anti-aliased rays are computed one
+    // volume at a time
+    RayCaster::compute_multi_vols(vol_inds, xforms_cam_to_itk_phys_for_each_vol);
+    return;
+  }
+
+  xregASSERT(this->resources_allocated_);
+
+  for (const auto& xforms : xforms_cam_to_itk_phys_for_each_vol)
+  {
+    xregASSERT(xforms.size() == this->num_projs_);
+  }
+
+  // The common kernel arguments, and the initial values of the projections,
+  // are set using the first volume with its poses. The current poses are
+  // restored afterwards.
+  FrameTransformList xforms_to_restore = xforms_cam_to_itk_phys_for_each_vol[0];
+
+  this->xforms_cam_to_itk_phys_.swap(xforms_to_restore);
+
+  compute_helper_pre_kernels(vol_inds[0]);
+
+  this->xforms_cam_to_itk_phys_.swap(xforms_to_restore);
+
+  update_kernels_for_interp();
+
+  const bool use_bspline = this->interp_method_ == kRAY_CAST_INTERP_BSPLINE;
+
+  // Empty space skipping is only possible with the sum kernel, in which case
+  // the rays are clipped to the non-empty voxels of each volume. The support
+  // of the B-spline interpolation extends beyond the non-empty voxels.
+  const bool skip_empty = this->use_empty_space_skipping_ &&
+                          (this->kernel_id() == kRAY_CAST_LINE_INT_SUM_KERNEL) &&
+                          !use_bspline;
+
+  // the arguments, poses, and textures of the volumes that need to be computed
+  std::vector<RayCastArgs> vol_args;
+  vol_args.reserve(num_vols_to_comp);
+
+  std::vector<bc::float16_> xforms_host;
+  xforms_host.reserve(num_vols_to_comp * this->num_projs_);
+
+  std::vector<const bc::image3d*> vol_texs;
+  vol_texs.reserve(num_vols_to_comp);
+  
+  for (size_type i = 0; i < num_vols_to_comp; ++i)
+  {
+    const size_type vol_idx = vol_inds[i];
+
+    RayCastArgs cur_args = ray_cast_kernel_args_;
+
+    Pt3 img_aabb_min;
+    Pt3 img_aabb_max;
+    std::tie(img_aabb_min,img_aabb_max) = ITKImageIndexBoundsAsEigen(this->vols_[vol_idx].GetPointer());
+
+    if (skip_empty)
+    {
+      const RayCastVolBrickGrid& brick_grid = this->vol_brick_grids_[vol_idx];
+
+      if (!brick_grid.any_non_empty)
+      {
+        // all voxels are empty, so none of the line integrals will change
+        continue;
+      }
+
+      img_aabb_min = brick_grid.non_empty_idx_min;
+      img_aabb_max = brick_grid.non_empty_idx_max;
+    }
+
+    cur_args.img_aabb_min = OpenCLFloat3ToBoostComp4(ConvertToOpenCL(img_aabb_min));
+    cur_args.img_aabb_max = OpenCLFloat3ToBoostComp4(ConvertToOpenCL(img_aabb_max));
+
+    cur_args.itk_phys_pt_to_itk_idx_xform = OpenCLFloat16ToBoostComp16(ConvertToOpenCL(
+                  FrameTransform(ITKImagePhysicalPointTransformsAsEigen(this->vols_[vol_idx].GetPointer()).inverse())));
+
+    if (use_bspline)
+    {
+      const RayCastOCLVolTex& coef_tex = this->bspline_coef_tex(vol_idx);
+
+      cur_args.vol_tex_scale  = coef_tex.scale;
+      cur_args.vol_tex_offset = coef_tex.offset;
+
+      vol_texs.push_back(&coef_tex.tex);
+    }
+    else
+    {
+      cur_args.vol_tex_scale  = vol_tex_scales_[vol_idx];
+      cur_args.vol_tex_offset = vol_tex_offsets_[vol_idx];
+
+      vol_texs.push_back(&vol_texs_dev_[vol_idx]);
+    }
+
+    vol_args.push_back(cur_args);
+
+    for (const auto& xform : xforms_cam_to_itk_phys_for_each_vol[i])
+    {
+      xforms_host.push_back(OpenCLFloat16ToBoostComp16(ConvertToOpenCL(xform)));
+    }
+  }
+
+  const size_type num_vols_to_launch = vol_args.size();
+
+  std::size_t global_work_size = num_vols_to_launch ? prepare_rays_to_launch() : 0;
+
+  if (!global_work_size)
+  {
+    // none of the line integrals will change
+    compute_helper_post_kernels(vol_inds[0]);
+    return;
+  }
+
+  const std::size_t vol_args_nbytes = sizeof(RayCastArgs) * num_vols_to_launch;
+
+  if (multi_vol_args_dev_.size() < vol_args_nbytes)
+  {
+    multi_vol_args_dev_ = bc::buffer(ctx_, vol_args_nbytes, bc::buffer::read_only);
+  }
+
+  cmd_queue_.enqueue_write_buffer(multi_vol_args_dev_, 0, vol_args_nbytes, &vol_args[0]);
+
+  upload_changed_elems(xforms_host, &multi_vol_xforms_on_dev_, &multi_vol_xforms_dev_);
+
+  // setup kernel arguments and launch a pass for each collection of volumes
+
+  bc::kernel& k = dev_multi_vol_kernel_;
+
+  k.set_arg(0, sizeof(ray_cast_kernel_args_), &ray_cast_kernel_args_);
+
+  k.set_arg(1, *det_pts_dev_);
+
+  k.set_arg(6, *proj_pixels_dev_to_use_);
+
+  k.set_arg(7, multi_vol_xforms_dev_);
+
+  k.set_arg(8, cam_model_for_proj_dev_);
+
+  k.set_arg(9, focal_pts_dev_);
+
+  k.set_arg(10, multi_vol_args_dev_);
+
+  k.set_arg(13, dummy_brick_empty_dev_);
+
+  k.set_arg(14, active_rays_dev_);
+
+  // zero indicates that every ray is computed
+  k.set_arg(15, bc::ulong_(this->use_active_pixels() ? num_active_rays_ : 0));
+
+  const size_type max_num_vols_per_pass = kMAX_NUM_VOLS_PER_PASS;
+
+  for (size_type vol_offset = 0; vol_offset < num_vols_to_launch;
+       vol_offset += max_num_vols_per_pass)
+  {
+    const size_type num_vols_in_pass = std::min(max_num_vols_per_pass,
+                                                num_vols_to_launch - vol_offset);
+
+    // un-used textures are set to a valid texture, but are never read
+    for (size_type tex_idx = 0; tex_idx < max_num_vols_per_pass; ++tex_idx)
+    {
+      k.set_arg(2 + tex_idx, *vol_texs[vol_offset + std::min(tex_idx, num_vols_in_pass - 1)]);
+    }
+
+    k.set_arg(11, bc::ulong_(vol_offset));
+
+    k.set_arg(12, bc::ulong_(num_vols_in_pass));
+
+    launch_ray_cast_kernel(k, line_int_tuning_key(k), 6, global_work_size);
+  }
+
+  compute_helper_post_kernels(vol_inds[0]);
+}
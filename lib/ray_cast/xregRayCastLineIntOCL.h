@@ -25,7 +25,10 @@
 #ifndef XREGRAYCASTLINEINTOCL_H_
 #define XREGRAYCASTLINEINTOCL_H_
 
+#include <memory>
+
 #include "xregRayCastBaseOCL.h"
+#include "xregRayCastPagedVolOCL.h"
 
 namespace xreg
 {
@@ -53,13 +56,224 @@ public:
   /// needs to create the OpenCL kernel.
   void allocate_resources() override;
 
+  /// \brief Builds the line integral program for the current kernel and
+  ///        interpolation settings.
+  void prebuild_progs() override;
+
   /// \brief Perform each ray cast.
   ///
   /// TODO: info
   void compute(const size_type vol_idx = 0) override;
 
+  /// \brief Perform the ray casting through several volumes in a single pass
+  ///        over the rays.
+  ///
+  /// Each ray is marched through up to four volumes, using the pose of each
+  /// volume, by a single kernel, with the values combined in a register and
+  /// written once. Additional passes are made when there are more volumes.
+  /// Exact voxel traversals are computed one volume at a time.
+  void compute_multi_vols(const std::vector<size_type>& vol_inds,
+                          const std::vector<FrameTransformList>& xforms_cam_to_itk_phys_for_each_vol) override;
+
+  /// \brief Enables/disables paging the volumes into device memory, one
+  ///        brick at a time.
+  ///
+  /// When enabled, a texture of each entire volume is not created. Instead,
+  /// prior to each ray cast, the non-empty bricks of the empty space grid that
+  /// may be intersected by the rays of any projection are uploaded into an
+  /// atlas texture storing at most max_num_resident_bricks() bricks (see
+  /// RayCastPagedVolOCL). This allows ray casting volumes which exceed the
+  /// device memory, or the maximum texture dimensions, when each collection of
+  /// projections only observes a portion of the volume. Enabling this also
+  /// enables empty space skipping. Only the sum kernel with linear
+  /// interpolation is supported and volumes are computed one at a time.
+  /// Disabled by default.
+  void set_use_paged_vols(const bool use_paged);
+
+  bool use_paged_vols() const;
+
+  /// \brief Compute slots are supported unless volumes are paged, since the
+  ///        paged bricks are shared by every slot.
+  bool supports_compute_slots() const override;
+
+  /// \brief Sets the maximum number of bricks of each volume stored on the
+  ///        device when paging volumes.
+  ///
+  /// An exception is thrown by compute() when the projections require more
+  /// bricks. Defaults to 32768.
+  void set_max_num_resident_bricks(const size_type max_num_bricks);
+
+  size_type max_num_resident_bricks() const;
+
+  /// \brief Sets the number of rays cast per pixel for anti-aliasing.
+  ///
+  /// The rays of a pixel are offset within the pixel using a fixed table of
+  /// stratified offsets (see RayCastStratifiedPts2D()). Each pixel's rays are
+  /// cast by a single work item and only the average of their line integrals
+  /// is written. When used with a downsampled camera model (see
+  /// DownsampleCameraModel()), each coarse pixel integrates the rays that would
+  /// otherwise be cast at a finer resolution and then downsampled, without
+  /// storing the fine projections or making an extra pass over them.
+  /// This replaces any offsets set with set_anti_alias_offsets(). Anti-aliasing
+  /// is only supported by the sampling kernel; exact voxel traversals and paged
+  /// volumes throw, and multiple volumes are computed one at a time.
+  /// A value of zero (the default) disables anti-aliasing.
+  void set_anti_alias_factor(const size_type aa_fact);
+
+  /// \brief The number of rays cast per pixel for anti-aliasing, zero when
+  ///        anti-aliasing is disabled.
+  size_type anti_alias_factor() const;
+
+  /// \brief Sets a custom pattern of sub-pixel ray offsets used for
+  ///        anti-aliasing.
+  ///
+  /// Offsets are in units of detector indices (columns, rows), relative to the
+  /// center of each pixel, e.g. within [-0.5,0.5) to stay within a pixel. One
+  /// ray is cast per offset. An empty list disables anti-aliasing.
+  /// \see set_anti_alias_factor
+  void set_anti_alias_offsets(const Pt2List& offsets);
+
+  const Pt2List& anti_alias_offsets() const;
+
+protected:
+  /// \brief Linear interpolation, tricubic B-spline interpolation, and exact
+  ///        voxel traversals are supported.
+  ///
+  /// B-spline interpolation samples a texture of prefiltered coefficients
+  /// using eight linearly filtered fetches per sample.
+  bool supports_interp_method(const InterpMethod interp_method) const override;
+
+  /// \brief Creates the volume textures and copies the empty brick flags
+  ///        of each volume to the device, or creates the paged volumes.
+  void vols_changed() override;
+
+  /// \brief Full volume textures are not created when paging volumes.
+  bool uses_full_vol_texs() const override;
+
+  /// \brief Flags the compacted list of active rays for an update prior to
+  ///        the next call to compute().
+  void active_pixels_changed() override;
+
+  /// \brief Flags the anti-aliasing offsets for an update prior to the next
+  ///        call to compute(), since they depend on the detector geometry.
+  void camera_models_changed() override;
+
+  /// \brief The source of the line integral program, including the base
+  ///        ray casting source and the operations of the current kernel id.
+  std::string line_int_ocl_src() const;
+
+  /// \brief The key identifying a line integral kernel in the work-group size
+  ///        tuning profile, which includes the operation and interpolation.
+  std::string line_int_tuning_key(const boost::compute::kernel& k) const;
+
+  /// \brief Sets the empty space skipping arguments (brick flags followed by
+  ///        the brick grid) of a kernel for a volume.
+  ///
+  /// When empty space is skipped, the volume bounds stored in
+  /// ray_cast_kernel_args_ are also clipped to the non-empty voxels, so the
+  /// arguments structure should be passed to the kernel after this call.
+  /// Returns false when every voxel is empty and no rays need to be cast, the
+  /// arguments of a volume without empty space skipping are set in this case.
+  bool set_empty_space_kernel_args(boost::compute::kernel& k,
+                                   const size_type brick_empty_arg_idx,
+                                   const size_type vol_idx);
+
 private:
+  using BrickFlagListDev = boost::compute::vector<boost::compute::uchar_>;
+
+  /// \brief Builds the line integral program and creates the kernels.
+  ///
+  /// The program depends on the kernel id and on whether B-spline
+  /// interpolation is used.
+  void build_kernels();
+
+  /// \brief Rebuilds the kernels when the interpolation method has changed
+  ///        between B-spline and the others since they were built.
+  void update_kernels_for_interp();
+
+  using ActiveRayListDev = boost::compute::vector<boost::compute::ulong_>;
+
+  /// \brief The maximum number of volumes sampled by a single launch of
+  ///        the multiple volume kernel
+  constexpr static size_type kMAX_NUM_VOLS_PER_PASS = 4;
+
+  /// \brief Compacts the active pixels of every projection and copies them
+  ///        to the device, when they have changed.
+  void update_active_rays();
+
+  /// \brief Prepares the active rays, when used, and returns the number of
+  ///        rays to launch.
+  size_type prepare_rays_to_launch();
+
+  /// \brief Copies the anti-aliasing offsets, as physical offsets on the
+  ///        detector of each camera, to the device when they have changed.
+  void update_anti_alias_offsets();
+
+  /// \brief Performs the ray casting through a paged volume, called by
+  ///        compute() after compute_helper_pre_kernels().
+  void compute_paged(const size_type vol_idx);
+
   boost::compute::kernel dev_kernel_;
+
+  boost::compute::kernel dev_siddon_kernel_;
+
+  boost::compute::kernel dev_multi_vol_kernel_;
+
+  boost::compute::kernel dev_paged_kernel_;
+
+  /// \brief Indicates that the kernels were built to sample B-spline coefficients
+  bool kernels_use_bspline_ = false;
+
+  /// \brief The kernel arguments of each volume computed by the multiple
+  ///        volume kernel
+  boost::compute::buffer multi_vol_args_dev_;
+
+  /// \brief The camera poses of each volume computed by the multiple volume
+  ///        kernel, stored consecutively.
+  Float16ListDev multi_vol_xforms_dev_;
+
+  /// \brief The poses stored in multi_vol_xforms_dev_, so that only the poses
+  ///        of objects that have moved are transferred.
+  Float16ListHost multi_vol_xforms_on_dev_;
+
+  /// \brief Empty flags of each brick, for each volume. These are only
+  ///        populated when empty space skipping is enabled.
+  std::vector<BrickFlagListDev> brick_empty_dev_;
+
+  /// \brief Passed to the kernel when empty space skipping is not used.
+  BrickFlagListDev dummy_brick_empty_dev_;
+
+  bool use_paged_vols_ = false;
+
+  size_type max_num_resident_bricks_ = 32768;
+
+  /// \brief The paged storage of each volume, only populated when paging
+  ///        volumes.
+  std::vector<std::unique_ptr<RayCastPagedVolOCL>> paged_vols_;
+
+  /// \brief Indices into the stacked projection buffer of each ray to be
+  ///        computed, only used when a subset of pixels are active.
+  ActiveRayListDev active_rays_dev_;
+
+  size_type num_active_rays_ = 0;
+
+  bool active_rays_need_update_ = true;
+
+  /// \brief The projection to camera associations used when the active rays
+  ///        were last compacted
+  CamModelAssocList active_rays_cam_model_for_proj_;
+
+  /// \brief Sub-pixel offsets of each anti-aliased ray, in units of detector
+  ///        indices relative to the pixel center. Empty when not anti-aliasing.
+  Pt2List aa_offsets_;
+
+  /// \brief The offsets of each anti-aliased ray from a pixel's detector
+  ///        point, with respect to each camera, stored consecutively for each
+  ///        camera. A single element is stored when not anti-aliasing, so
+  ///        that a valid buffer is always passed to the kernel.
+  Float4ListDev aa_offsets_wrt_cam_dev_;
+
+  bool aa_offsets_need_update_ = true;
 };
 
 }  // xreg
@@ -0,0 +1,412 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregRayCastLineIntSimOCL.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <boost/compute/memory/local_buffer.hpp>
+#include <boost/compute/utility/source.hpp>
+
+#include "xregAssert.h"
+#include "xregExceptionUtils.h"
+#include "xregOpenCLProgCache.h"
+
+namespace  // un-named
+{
+
+const char* kRAY_CAST_LINE_INT_SIM_OPENCL_SRC = BOOST_COMPUTE_STRINGIZE_SOURCE(
+
+// Sums the elements of a work group's local buffer into the first element,
+// the work group size must be a power of two.
+void xregLineIntSimLocalSum(__local float4* local_sums)
+{
+  const size_t lid = get_local_id(0);
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for (size_t stride = get_local_size(0) / 2; stride > 0; stride /= 2)
+  {
+    if (lid < stride)
+    {
+      local_sums[lid] += local_sums[lid + stride];
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+}
+
+// Each work group casts the rays of consecutive pixels of a single projection
+// (get_global_id(1)) and writes the sums of the moving image values, moving
+// image values squared and fixed times moving image values of those pixels.
+// The initial value of each line integral is read from init_projs when
+// use_init_projs is non-zero and is init_val otherwise. No rays are cast when
+// cast_rays is zero, e.g. when every voxel is empty.
+__kernel void xregLineIntSimPartialSumsKernel(const RayCastArgs args,
+                                              __global const float4* det_pts,
+                                              image3d_t vol_tex,
+                                              __global const float* init_projs,
+                                              __global const float16* cam_to_itk_phys_xforms,
+                                              __global const ulong* cam_model_for_proj,
+                                              __global const float4* cam_focal_pts,
+                                              __global const uchar* brick_empty,
+                                              const int4 brick_grid,
+                                              const float init_val,
+                                              const int use_init_projs,
+                                              const int cast_rays,
+                                              __global const float* fixed_imgs,
+                                              __global const uchar* masks,
+                                              const int use_masks,
+                                              __global float4* partial_sums,
+                                              __local float4* local_sums)
+{
+  const ulong det_pt_idx = get_global_id(0);
+  const ulong proj_idx   = get_global_id(1);
+
+  const ulong cam_idx     = cam_model_for_proj[proj_idx];
+  const ulong cam_pix_idx = (cam_idx * args.num_det_pts) + det_pt_idx;
+
+  float4 s = (float4) (0, 0, 0, 0);
+
+  // rays are not cast through pixels that are masked out
+  if ((det_pt_idx < args.num_det_pts) && (!use_masks || masks[cam_pix_idx]))
+  {
+    float m = use_init_projs ? init_projs[(proj_idx * args.num_det_pts) + det_pt_idx] : init_val;
+
+    if (cast_rays)
+    {
+      m = XREG_LINE_INT_KERNEL_OP(xregLineIntSampleVol(args, vol_tex, cam_to_itk_phys_xforms[proj_idx],
+                                                       cam_focal_pts[cam_idx], det_pts[cam_pix_idx],
+                                                       brick_empty, brick_grid),
+                                  m);
+    }
+
+    const float f = fixed_imgs[cam_pix_idx];
+
+    s = (float4) (m, m * m, f * m, 0);
+  }
+
+  local_sums[get_local_id(0)] = s;
+
+  xregLineIntSimLocalSum(local_sums);
+
+  if (!get_local_id(0))
+  {
+    partial_sums[(proj_idx * get_num_groups(0)) + get_group_id(0)] = local_sums[0];
+  }
+}
+
+// Each work group reduces the partial sums of a single projection and
+// computes its score. The statistics of each fixed image are stored as:
+// (number of pixels, mean, standard deviation, sum of squares).
+// sim_metric is zero for NCC and one for SSD.
+__kernel void xregLineIntSimScoresKernel(__global const float4* partial_sums,
+                                         const ulong num_groups_per_proj,
+                                         __global const float4* fixed_stats,
+                                         __global const ulong* cam_model_for_proj,
+                                         const int sim_metric,
+                                         __global float* scores,
+                                         __local float4* local_sums)
+{
+  const ulong proj_idx = get_group_id(0);
+
+  __global const float4* cur_partial_sums = partial_sums + (proj_idx * num_groups_per_proj);
+
+  float4 s = (float4) (0, 0, 0, 0);
+
+  for (ulong i = get_local_id(0); i < num_groups_per_proj; i += get_local_size(0))
+  {
+    s += cur_partial_sums[i];
+  }
+
+  local_sums[get_local_id(0)] = s;
+
+  xregLineIntSimLocalSum(local_sums);
+
+  if (!get_local_id(0))
+  {
+    const float4 sums = local_sums[0];
+
+    const float4 fs = fixed_stats[cam_model_for_proj[proj_idx]];
+
+    const float n = fs.x;
+
+    if (!sim_metric)
+    {
+      const float mov_mean = sums.x / n;
+
+      const float mov_std_dev = max(1.0e-6f, sqrt(max(0.0f, sums.y - (n * mov_mean * mov_mean)) / (n - 1)));
+
+      const float ncc = (sums.z - (n * fs.y * mov_mean)) / (n * fs.z * mov_std_dev);
+
+      scores[proj_idx] = 0.5f * (1 - ncc);
+    }
+    else
+    {
+      scores[proj_idx] = (sums.y - (2 * sums.z) + fs.w) / n;
+    }
+  }
+}
+
+);
+
+}  // un-named
+
+xreg::RayCasterLineIntSimOCL::RayCasterLineIntSimOCL(const boost::compute::device& dev)
+  : RayCasterLineIntOCL(dev)
+{ }
+
+xreg::RayCasterLineIntSimOCL::RayCasterLineIntSimOCL(const boost::compute::context& ctx,
+                                                     const boost::compute::command_queue& queue)
+  : RayCasterLineIntOCL(ctx, queue)
+{ }
+
+void xreg::RayCasterLineIntSimOCL::prebuild_progs()
+{
+  RayCasterLineIntOCL::prebuild_progs();
+
+  BuildOpenCLProg(this->line_int_ocl_src() + kRAY_CAST_LINE_INT_SIM_OPENCL_SRC, ctx_);
+}
+
+void xreg::RayCasterLineIntSimOCL::allocate_resources()
+{
+  namespace bc = boost::compute;
+
+  RayCasterLineIntOCL::allocate_resources();
+
+  bc::program prog = BuildOpenCLProg(this->line_int_ocl_src() + kRAY_CAST_LINE_INT_SIM_OPENCL_SRC,
+                                     ctx_);
+
+  partial_sums_kernel_ = prog.create_kernel("xregLineIntSimPartialSumsKernel");
+  scores_kernel_       = prog.create_kernel("xregLineIntSimScoresKernel");
+
+  // the local reductions require a power of two work group size
+  const bc::device dev = cmd_queue_.get_device();
+
+  const size_type max_wg_size = std::min(
+            partial_sums_kernel_.get_work_group_info<std::size_t>(dev, CL_KERNEL_WORK_GROUP_SIZE),
+            scores_kernel_.get_work_group_info<std::size_t>(dev, CL_KERNEL_WORK_GROUP_SIZE));
+
+  work_group_size_ = 1;
+  while (((work_group_size_ * 2) <= max_wg_size) && ((work_group_size_ * 2) <= kMAX_WORK_GROUP_SIZE))
+  {
+    work_group_size_ *= 2;
+  }
+
+  const size_type num_det_pts = this->camera_models_[0].num_det_rows *
+                                this->camera_models_[0].num_det_cols;
+
+  const size_type num_groups_per_proj = (num_det_pts + work_group_size_ - 1) / work_group_size_;
+
+  partial_sums_dev_ = Float4ListDev(num_groups_per_proj * this->num_projs_, ctx_);
+
+  sim_vals_dev_ = PixelListDev(this->num_projs_, ctx_);
+
+  sim_vals_.assign(this->num_projs_, 0);
+
+  fixed_imgs_need_update_ = true;
+}
+
+void xreg::RayCasterLineIntSimOCL::set_fixed_imgs(const ProjList& fixed_imgs)
+{
+  fixed_imgs_ = fixed_imgs;
+
+  fixed_imgs_need_update_ = true;
+}
+
+void xreg::RayCasterLineIntSimOCL::set_fixed_img_masks(const FixedImgMaskList& masks)
+{
+  fixed_img_masks_ = masks;
+
+  fixed_imgs_need_update_ = true;
+}
+
+void xreg::RayCasterLineIntSimOCL::set_sim_metric(const SimMetric sim_metric)
+{
+  sim_metric_ = sim_metric;
+}
+
+xreg::RayCasterLineIntSimOCL::SimMetric
+xreg::RayCasterLineIntSimOCL::sim_metric() const
+{
+  return sim_metric_;
+}
+
+void xreg::RayCasterLineIntSimOCL::compute_sim_vals(const size_type vol_idx)
+{
+  namespace bc = boost::compute;
+
+  xregASSERT(this->resources_allocated_);
+
+  if (this->interp_method_ != kRAY_CAST_INTERP_LINEAR)
+  {
+    throw UnsupportedOperationException();
+  }
+
+  if (fixed_imgs_need_update_)
+  {
+    update_fixed_imgs_dev();
+  }
+
+  // the initial values are read directly by the kernel, so the projection
+  // buffer does not need to be filled with the default background value
+  const ProjPixelStoreMethod orig_store_meth = this->proj_store_meth_;
+  this->proj_store_meth_ = kRAY_CAST_PIXEL_ACCUM;
+
+  compute_helper_pre_kernels(vol_idx);
+
+  this->proj_store_meth_ = orig_store_meth;
+
+  const bool use_init_projs = this->use_bg_projs_ || (orig_store_meth == kRAY_CAST_PIXEL_ACCUM);
+
+  const size_type num_det_pts = ray_cast_kernel_args_.num_det_pts;
+
+  const size_type num_groups_per_proj = (num_det_pts + work_group_size_ - 1) / work_group_size_;
+
+  bc::kernel& k = partial_sums_kernel_;
+
+  const bool cast_rays = set_empty_space_kernel_args(k, 7, vol_idx);
+
+  k.set_arg(0, sizeof(ray_cast_kernel_args_), &ray_cast_kernel_args_);
+  k.set_arg(1, *det_pts_dev_);
+  k.set_arg(2, vol_texs_dev_[vol_idx]);
+  k.set_arg(3, *proj_pixels_dev_to_use_);
+  k.set_arg(4, cam_to_itk_phys_xforms_dev_);
+  k.set_arg(5, cam_model_for_proj_dev_);
+  k.set_arg(6, focal_pts_dev_);
+  k.set_arg(9, this->default_bg_pixel_val_);
+  k.set_arg(10, bc::int_(use_init_projs ? 1 : 0));
+  k.set_arg(11, bc::int_(cast_rays ? 1 : 0));
+  k.set_arg(12, fixed_imgs_dev_);
+  k.set_arg(13, masks_dev_);
+  k.set_arg(14, bc::int_(fixed_img_masks_.empty() ? 0 : 1));
+  k.set_arg(15, partial_sums_dev_);
+  k.set_arg(16, bc::local_buffer<bc::float4_>(work_group_size_));
+
+  const std::size_t partial_sums_global_size[2] = { num_groups_per_proj * work_group_size_,
+                                                    this->num_projs_ };
+  const std::size_t partial_sums_local_size[2] = { work_group_size_, 1 };
+
+  cmd_queue_.enqueue_nd_range_kernel(k, 2, 0, partial_sums_global_size, partial_sums_local_size);
+
+  scores_kernel_.set_arg(0, partial_sums_dev_);
+  scores_kernel_.set_arg(1, bc::ulong_(num_groups_per_proj));
+  scores_kernel_.set_arg(2, fixed_stats_dev_);
+  scores_kernel_.set_arg(3, cam_model_for_proj_dev_);
+  scores_kernel_.set_arg(4, bc::int_((sim_metric_ == kRAY_CAST_SIM_NCC) ? 0 : 1));
+  scores_kernel_.set_arg(5, sim_vals_dev_);
+  scores_kernel_.set_arg(6, bc::local_buffer<bc::float4_>(work_group_size_));
+
+  const std::size_t scores_global_size = work_group_size_ * this->num_projs_;
+  const std::size_t scores_local_size  = work_group_size_;
+
+  cmd_queue_.enqueue_nd_range_kernel(scores_kernel_, 1, 0, &scores_global_size, &scores_local_size);
+
+  // the kernels are ordered by the queue, and this waits for them to finish
+  bc::copy(sim_vals_dev_.begin(), sim_vals_dev_.begin() + this->num_projs_,
+           sim_vals_.begin(), cmd_queue_);
+}
+
+const xreg::RayCasterLineIntSimOCL::SimValList&
+xreg::RayCasterLineIntSimOCL::sim_vals() const
+{
+  return sim_vals_;
+}
+
+void xreg::RayCasterLineIntSimOCL::update_fixed_imgs_dev()
+{
+  namespace bc = boost::compute;
+
+  const size_type num_cams = this->num_camera_models();
+
+  xregASSERT(fixed_imgs_.size() == num_cams);
+
+  const bool use_masks = !fixed_img_masks_.empty();
+
+  xregASSERT(!use_masks || (fixed_img_masks_.size() == num_cams));
+
+  const size_type num_det_pts = this->camera_models_[0].num_det_rows *
+                                this->camera_models_[0].num_det_cols;
+
+  std::vector<PixelScalar2D> fixed_imgs_host(num_cams * num_det_pts);
+
+  std::vector<bc::uchar_> masks_host(use_masks ? (num_cams * num_det_pts) : 1, 1);
+
+  Float4ListHost fixed_stats_host(num_cams);
+
+  for (size_type cam_idx = 0; cam_idx < num_cams; ++cam_idx)
+  {
+    xregASSERT(fixed_imgs_[cam_idx]->GetLargestPossibleRegion().GetNumberOfPixels() == num_det_pts);
+
+    const PixelScalar2D* fixed_buf = fixed_imgs_[cam_idx]->GetBufferPointer();
+
+    const unsigned char* mask_buf = nullptr;
+
+    if (use_masks)
+    {
+      xregASSERT(fixed_img_masks_[cam_idx]->GetLargestPossibleRegion().GetNumberOfPixels() == num_det_pts);
+
+      mask_buf = fixed_img_masks_[cam_idx]->GetBufferPointer();
+
+      std::copy(mask_buf, mask_buf + num_det_pts, masks_host.begin() + (cam_idx * num_det_pts));
+    }
+
+    std::copy(fixed_buf, fixed_buf + num_det_pts, fixed_imgs_host.begin() + (cam_idx * num_det_pts));
+
+    // the statistics are computed in double precision on the host
+    double n = 0;
+    double sum = 0;
+    double sum_sq = 0;
+
+    for (size_type i = 0; i < num_det_pts; ++i)
+    {
+      if (!use_masks || mask_buf[i])
+      {
+        const double f = fixed_buf[i];
+
+        n      += 1;
+        sum    += f;
+        sum_sq += f * f;
+      }
+    }
+
+    xregASSERT(n > 1);
+
+    const double mean = sum / n;
+
+    const double std_dev = std::max(1.0e-6, std::sqrt(std::max(0.0, sum_sq - (n * mean * mean)) / (n - 1)));
+
+    fixed_stats_host[cam_idx] = bc::float4_(static_cast<float>(n), static_cast<float>(mean),
+                                            static_cast<float>(std_dev), static_cast<float>(sum_sq));
+  }
+
+  fixed_imgs_dev_ = PixelListDev(fixed_imgs_host.begin(), fixed_imgs_host.end(), cmd_queue_);
+
+  masks_dev_ = MaskListDev(masks_host.begin(), masks_host.end(), cmd_queue_);
+
+  fixed_stats_dev_ = Float4ListDev(fixed_stats_host.begin(), fixed_stats_host.end(), cmd_queue_);
+
+  fixed_imgs_need_update_ = false;
+}
@@ -0,0 +1,158 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGRAYCASTLINEINTSIMOCL_H_
+#define XREGRAYCASTLINEINTSIMOCL_H_
+
+#include "xregRayCastLineIntOCL.h"
+
+namespace xreg
+{
+
+/// \brief Ray casting line integrals using OpenCL, along with the similarity
+///        of each line integral image to a fixed image, computed by a single
+///        kernel.
+///
+/// The sums needed by the similarity metrics are accumulated in local memory
+/// during the ray casting, so that compute_sim_vals() only writes partial sums
+/// to global memory and returns a score for each projection. This avoids
+/// writing each projection to global memory and reading it back in a separate
+/// reduction, as is done by the OpenCL similarity metrics.
+///
+/// The scores match ImgSimMetric2DNCCOCL and ImgSimMetric2DSSDOCL. The sums
+/// are accumulated in single precision, so the scores are less accurate than
+/// those of the similarity metric objects, which subtract the mean of each
+/// image prior to computing the squares.
+///
+/// compute() may still be called to compute, and store, the line integral
+/// images.
+class RayCasterLineIntSimOCL : public RayCasterLineIntOCL
+{
+public:
+  using FixedImgMask     = itk::Image<unsigned char,2>;
+  using FixedImgMaskPtr  = FixedImgMask::Pointer;
+  using FixedImgMaskList = std::vector<FixedImgMaskPtr>;
+
+  using SimValList = std::vector<PixelScalar2D>;
+
+  enum SimMetric
+  {
+    kRAY_CAST_SIM_NCC = 0,
+    kRAY_CAST_SIM_SSD
+  };
+
+  /// \brief Default constructor, chooses a default device, creates a new
+  ///        context and command queue.
+  RayCasterLineIntSimOCL() = default;
+
+  /// \brief Constructor specifying a device to use, but creates a new context
+  ///        and command queue.
+  explicit RayCasterLineIntSimOCL(const boost::compute::device& dev);
+
+  /// \brief Constructor specifying a specific context and command queue to use
+  RayCasterLineIntSimOCL(const boost::compute::context& ctx, const boost::compute::command_queue& queue);
+
+  /// \brief Allocate resources required for computing each ray cast and the
+  ///        similarity scores.
+  void allocate_resources() override;
+
+  void prebuild_progs() override;
+
+  /// \brief Sets the fixed image of each camera model.
+  ///
+  /// Each projection is compared to the fixed image of its camera model.
+  void set_fixed_imgs(const ProjList& fixed_imgs);
+
+  /// \brief Sets the masks of the fixed images, an empty list disables masking.
+  ///
+  /// Pixels with a mask value of zero are ignored by the similarity metric,
+  /// and rays are not cast through them.
+  void set_fixed_img_masks(const FixedImgMaskList& masks);
+
+  void set_sim_metric(const SimMetric sim_metric);
+
+  SimMetric sim_metric() const;
+
+  /// \brief Ray casts a volume and computes the similarity score of each
+  ///        projection.
+  ///
+  /// The line integral images are not stored. When accumulating, or using
+  /// background projections, the line integrals are added to the values in
+  /// the projection buffer (e.g. from a previous call to compute()), otherwise
+  /// to the default background value. Linear interpolation must be used and
+  /// the active pixels are ignored (the masks should be used instead).
+  void compute_sim_vals(const size_type vol_idx = 0);
+
+  /// \brief The similarity scores of each projection computed by the most
+  ///        recent call to compute_sim_vals().
+  const SimValList& sim_vals() const;
+
+private:
+  using MaskListDev = boost::compute::vector<boost::compute::uchar_>;
+
+  using PixelListDev = boost::compute::vector<PixelScalar2D>;
+
+  /// \brief The largest number of pixels reduced by a work group.
+  constexpr static size_type kMAX_WORK_GROUP_SIZE = 256;
+
+  /// \brief Copies the fixed images, masks and fixed image statistics to the device.
+  void update_fixed_imgs_dev();
+
+  SimMetric sim_metric_ = kRAY_CAST_SIM_NCC;
+
+  ProjList fixed_imgs_;
+
+  FixedImgMaskList fixed_img_masks_;
+
+  bool fixed_imgs_need_update_ = true;
+
+  boost::compute::kernel partial_sums_kernel_;
+
+  boost::compute::kernel scores_kernel_;
+
+  size_type work_group_size_ = 0;
+
+  /// \brief Fixed image of each camera, stored consecutively.
+  PixelListDev fixed_imgs_dev_;
+
+  /// \brief Mask of each camera, stored consecutively, a single element when
+  ///        not masking.
+  MaskListDev masks_dev_;
+
+  /// \brief Number of pixels, mean, standard deviation and sum of squares of
+  ///        each fixed image.
+  Float4ListDev fixed_stats_dev_;
+
+  /// \brief Sums of the moving image, moving image squared and fixed times
+  ///        moving image, for each work group of each projection.
+  Float4ListDev partial_sums_dev_;
+
+  PixelListDev sim_vals_dev_;
+
+  SimValList sim_vals_;
+};
+
+}  // xreg
+
+#endif
@@ -0,0 +1,336 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregRayCastMeshLineIntCPU.h"
+
+#include <cmath>
+
+#include "xregAssert.h"
+#include "xregExceptionUtils.h"
+#include "xregTBBUtils.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+/// \brief Number of detector rows rasterized by each task
+constexpr size_type kMESH_RASTER_ROW_BLOCK_SIZE = 16;
+
+/// \brief A triangle transformed into the world frame and projected onto
+///        the detector.
+struct ProjTri
+{
+  /// \brief Projected vertices, in continuous detector indices, ordered
+  ///        counter-clockwise on the detector (positive signed area).
+  std::array<Pt2,3> inds;
+
+  /// \brief Projected bounding box, as inclusive pixel indices
+  long min_col;
+  long max_col;
+  long min_row;
+  long max_row;
+
+  /// \brief The outward normal in the world frame
+  Pt3 outward_normal;
+
+  /// \brief Dot product of the outward normal and a vertex, with respect to
+  ///        the source.
+  CoordScalar plane_dot;
+
+  bool valid;
+};
+
+/// \brief The top-left fill rule for an edge of a triangle with positive
+///        signed area, a pixel center on exactly one of two triangles sharing
+///        an edge in opposite directions is rasterized.
+bool IsTopLeftEdge(const Pt2& a, const Pt2& b)
+{
+  const CoordScalar dx = b[0] - a[0];
+  const CoordScalar dy = b[1] - a[1];
+
+  return (dy > 0) || ((dy == 0) && (dx < 0));
+}
+
+CoordScalar EdgeFn(const Pt2& a, const Pt2& b, const CoordScalar x, const CoordScalar y)
+{
+  return ((b[0] - a[0]) * (y - a[1])) - ((b[1] - a[1]) * (x - a[0]));
+}
+
+bool InsideEdge(const Pt2& a, const Pt2& b, const CoordScalar x, const CoordScalar y)
+{
+  const CoordScalar e = EdgeFn(a, b, x, y);
+
+  return (e > 0) || ((e == 0) && IsTopLeftEdge(a, b));
+}
+
+}  // un-named
+
+void xreg::RayCasterMeshLineIntCPU::set_mesh(const TriMesh& mesh)
+{
+  set_meshes({ mesh });
+}
+
+void xreg::RayCasterMeshLineIntCPU::set_meshes(const std::vector<TriMesh>& meshes)
+{
+  const size_type num_meshes = meshes.size();
+
+  meshes_.resize(num_meshes);
+
+  for (size_type mesh_idx = 0; mesh_idx < num_meshes; ++mesh_idx)
+  {
+    const TriMesh& src = meshes[mesh_idx];
+
+    MeshGeom& dst = meshes_[mesh_idx];
+
+    dst.vertices = src.vertices;
+    dst.faces    = src.faces;
+
+    // the sign of the enclosed volume determines the vertex ordering
+    CoordScalar six_times_vol = 0;
+
+    for (const auto& f : dst.faces)
+    {
+      six_times_vol += dst.vertices[f[0]].dot(dst.vertices[f[1]].cross(dst.vertices[f[2]]));
+    }
+
+    dst.ccw_from_outside = six_times_vol >= 0;
+  }
+}
+
+xreg::size_type xreg::RayCasterMeshLineIntCPU::num_meshes() const
+{
+  return meshes_.size();
+}
+
+void xreg::RayCasterMeshLineIntCPU::set_mesh_attenuation(const PixelScalar2D att)
+{
+  mesh_atts_.clear();
+
+  default_mesh_att_ = att;
+}
+
+void xreg::RayCasterMeshLineIntCPU::set_mesh_attenuations(const std::vector<PixelScalar2D>& atts)
+{
+  mesh_atts_ = atts;
+}
+
+const std::vector<xreg::RayCaster::PixelScalar2D>&
+xreg::RayCasterMeshLineIntCPU::mesh_attenuations() const
+{
+  return mesh_atts_;
+}
+
+void xreg::RayCasterMeshLineIntCPU::allocate_resources()
+{
+  if (meshes_.empty())
+  {
+    xregThrow("Mesh ray caster requires at least one mesh!");
+  }
+
+  if (!mesh_atts_.empty() && (mesh_atts_.size() != meshes_.size()))
+  {
+    xregThrow("Number of mesh attenuations (%lu) does not match number of meshes (%lu)!",
+              mesh_atts_.size(), meshes_.size());
+  }
+
+  RayCasterCPU::allocate_resources();
+}
+
+void xreg::RayCasterMeshLineIntCPU::compute(const size_type mesh_idx)
+{
+  xregASSERT(mesh_idx < meshes_.size());
+
+  this->pre_compute();
+
+  const MeshGeom& mesh = meshes_[mesh_idx];
+
+  const PixelScalar2D att = mesh_atts_.empty() ? default_mesh_att_ : mesh_atts_[mesh_idx];
+
+  const size_type num_tris = mesh.faces.size();
+
+  const size_type num_rows = this->camera_models_[0].num_det_rows;
+  const size_type num_cols = this->camera_models_[0].num_det_cols;
+
+  const size_type num_pix_per_proj = num_rows * num_cols;
+
+  const size_type num_row_blocks = (num_rows + kMESH_RASTER_ROW_BLOCK_SIZE - 1) / kMESH_RASTER_ROW_BLOCK_SIZE;
+
+  Pt3List world_verts(mesh.vertices.size());
+
+  std::vector<ProjTri> proj_tris(num_tris);
+
+  ParallelExecContextScope exec_scope(this->exec_ctx_.get());
+
+  for (size_type proj_idx = 0; proj_idx < this->num_projs_; ++proj_idx)
+  {
+    const CameraModel& cam = this->camera_models_[this->cam_model_for_proj_[proj_idx]];
+
+    const FrameTransform itk_phys_to_world = this->xforms_cam_to_itk_phys_[proj_idx].inverse();
+
+    const Mat3x4 proj_mat = cam.phys_to_ind_proj_mat();
+
+    const Pt3& src_pt = cam.pinhole_pt;
+
+    // detector points are affine in the detector indices
+    const Pt3 det_origin   = cam.ind_pt_to_phys_det_pt(Pt2(0,0));
+    const Pt3 det_col_step = cam.ind_pt_to_phys_det_pt(Pt2(1,0)) - det_origin;
+    const Pt3 det_row_step = cam.ind_pt_to_phys_det_pt(Pt2(0,1)) - det_origin;
+
+    const Pt3 cam_axis = (cam.ind_pt_to_phys_det_pt(Pt2(0.5 * (num_cols - 1), 0.5 * (num_rows - 1)))
+                                                                                  - src_pt).normalized();
+
+    auto xform_verts_fn = [&] (const RangeType& r)
+    {
+      for (size_type v = r.begin(); v < r.end(); ++v)
+      {
+        world_verts[v] = itk_phys_to_world * mesh.vertices[v];
+      }
+    };
+
+    ParallelFor(xform_verts_fn, RangeType(0, world_verts.size()));
+
+    auto proj_tris_fn = [&] (const RangeType& r)
+    {
+      for (size_type tri_idx = r.begin(); tri_idx < r.end(); ++tri_idx)
+      {
+        const auto& f = mesh.faces[tri_idx];
+
+        ProjTri& t = proj_tris[tri_idx];
+
+        t.valid = false;
+
+        const Pt3& v0 = world_verts[f[0]];
+        const Pt3& v1 = world_verts[f[1]];
+        const Pt3& v2 = world_verts[f[2]];
+
+        // triangles intersecting the plane of the source are not clipped,
+        // and are ignored
+        if (((v0 - src_pt).dot(cam_axis) <= 0) ||
+            ((v1 - src_pt).dot(cam_axis) <= 0) ||
+            ((v2 - src_pt).dot(cam_axis) <= 0))
+        {
+          continue;
+        }
+
+        const Pt3 n = (v1 - v0).cross(v2 - v0);
+
+        t.outward_normal = mesh.ccw_from_outside ? n : Pt3(-n);
+        t.plane_dot      = t.outward_normal.dot(v0 - src_pt);
+
+        for (size_type i = 0; i < 3; ++i)
+        {
+          const Pt3 p = proj_mat * world_verts[f[i]].homogeneous();
+
+          t.inds[i] = Pt2(p[0] / p[2], p[1] / p[2]);
+        }
+
+        const CoordScalar area2 = EdgeFn(t.inds[0], t.inds[1], t.inds[2][0], t.inds[2][1]);
+
+        if (area2 == 0)
+        {
+          // degenerate on the detector, e.g. parallel to the rays
+          continue;
+        }
+        else if (area2 < 0)
+        {
+          std::swap(t.inds[1], t.inds[2]);
+        }
+
+        const CoordScalar min_c = std::min(t.inds[0][0], std::min(t.inds[1][0], t.inds[2][0]));
+        const CoordScalar max_c = std::max(t.inds[0][0], std::max(t.inds[1][0], t.inds[2][0]));
+        const CoordScalar min_r = std::min(t.inds[0][1], std::min(t.inds[1][1], t.inds[2][1]));
+        const CoordScalar max_r = std::max(t.inds[0][1], std::max(t.inds[1][1], t.inds[2][1]));
+
+        t.min_col = std::max(0l, static_cast<long>(std::ceil(min_c)));
+        t.max_col = std::min(static_cast<long>(num_cols) - 1, static_cast<long>(std::floor(max_c)));
+        t.min_row = std::max(0l, static_cast<long>(std::ceil(min_r)));
+        t.max_row = std::min(static_cast<long>(num_rows) - 1, static_cast<long>(std::floor(max_r)));
+
+        t.valid = (t.min_col <= t.max_col) && (t.min_row <= t.max_row);
+      }
+    };
+
+    ParallelFor(proj_tris_fn, RangeType(0, num_tris));
+
+    PixelScalar2D* proj_buf = this->pixel_buf_to_use() + (proj_idx * num_pix_per_proj);
+
+    // Each task rasterizes every triangle into a block of rows, so that no
+    // two tasks write to the same pixels
+    auto raster_fn = [&] (const RangeType& r)
+    {
+      for (size_type block_idx = r.begin(); block_idx < r.end(); ++block_idx)
+      {
+        const long block_start_row = static_cast<long>(block_idx * kMESH_RASTER_ROW_BLOCK_SIZE);
+        const long block_end_row   = std::min(static_cast<long>(num_rows),
+                                              block_start_row + static_cast<long>(kMESH_RASTER_ROW_BLOCK_SIZE)) - 1;
+
+        for (const ProjTri& t : proj_tris)
+        {
+          if (!t.valid || (t.max_row < block_start_row) || (t.min_row > block_end_row))
+          {
+            continue;
+          }
+
+          const long start_row = std::max(t.min_row, block_start_row);
+          const long end_row   = std::min(t.max_row, block_end_row);
+
+          for (long row_idx = start_row; row_idx <= end_row; ++row_idx)
+          {
+            const CoordScalar y = static_cast<CoordScalar>(row_idx);
+
+            for (long col_idx = t.min_col; col_idx <= t.max_col; ++col_idx)
+            {
+              const CoordScalar x = static_cast<CoordScalar>(col_idx);
+
+              if (InsideEdge(t.inds[0], t.inds[1], x, y) &&
+                  InsideEdge(t.inds[1], t.inds[2], x, y) &&
+                  InsideEdge(t.inds[2], t.inds[0], x, y))
+              {
+                const Pt3 ray_dir = det_origin + (x * det_col_step) + (y * det_row_step) - src_pt;
+
+                const CoordScalar n_dot_dir = t.outward_normal.dot(ray_dir);
+
+                if (n_dot_dir != 0)
+                {
+                  // distance from the source to the plane of the triangle,
+                  // positive when exiting the mesh
+                  const CoordScalar dist = (t.plane_dot / n_dot_dir) * ray_dir.norm();
+
+                  proj_buf[(row_idx * num_cols) + col_idx] +=
+                          static_cast<PixelScalar2D>(((n_dot_dir > 0) ? dist : -dist) * att);
+                }
+              }
+            }
+          }
+        }
+      }
+    };
+
+    ParallelFor(raster_fn, RangeType(0, num_row_blocks));
+  }
+
+  this->sync_to_ocl_.set_modified();
+  this->sync_to_host_.set_modified();
+}
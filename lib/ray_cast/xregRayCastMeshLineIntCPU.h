@@ -0,0 +1,104 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGRAYCASTMESHLINEINTCPU_H_
+#define XREGRAYCASTMESHLINEINTCPU_H_
+
+#include "xregMesh.h"
+#include "xregRayCastBaseCPU.h"
+
+namespace xreg
+{
+
+/// \brief Computes approximate line integrals through closed triangular
+///        meshes by rasterizing their faces on the CPU.
+///
+/// Each mesh is treated as a homogeneous object, e.g. a bone surface, with a
+/// constant attenuation. The length of each ray inside a mesh is computed
+/// by rasterizing every triangle onto the detector and summing the signed
+/// distances from the source to the triangle along the ray: exiting
+/// (back-facing) triangles add their distance and entering (front-facing)
+/// triangles subtract their distance. This is equivalent to depth peeling
+/// the front and back faces, without sorting, and is exact for closed
+/// (water-tight) meshes. The orientation of the triangle vertex ordering is
+/// determined from the signed volume of each mesh, so either ordering may be
+/// used.
+///
+/// The meshes take the place of the volumes of the other ray casters: the
+/// vertices are in the same coordinates as the volume physical points, and
+/// compute(i) projects mesh i. Volumes do not need to be set, however may be
+/// for code that also queries them. The cost is proportional to the number of
+/// triangles and the projected area of the meshes, rather than the number of
+/// ray samples through a volume, which makes this suitable for coarse
+/// initializations. The stored values are the attenuation times the path
+/// length, and the stepsize does not affect the values.
+class RayCasterMeshLineIntCPU : public RayCasterCPU
+{
+public:
+  /// \brief Sets a single mesh
+  void set_mesh(const TriMesh& mesh);
+
+  /// \brief Sets the collection of meshes that may be projected.
+  ///
+  /// Only the vertices and faces of each mesh are copied.
+  void set_meshes(const std::vector<TriMesh>& meshes);
+
+  size_type num_meshes() const;
+
+  /// \brief Sets the attenuation of every mesh, defaults to 1.
+  void set_mesh_attenuation(const PixelScalar2D att);
+
+  /// \brief Sets the attenuation of each mesh.
+  void set_mesh_attenuations(const std::vector<PixelScalar2D>& atts);
+
+  const std::vector<PixelScalar2D>& mesh_attenuations() const;
+
+  void allocate_resources() override;
+
+  /// \brief Projects a mesh; mesh_idx is the index of the mesh.
+  void compute(const size_type mesh_idx = 0) override;
+
+private:
+  struct MeshGeom
+  {
+    TriMesh::VertexList vertices;
+
+    TriMesh::TriangleList faces;
+
+    /// \brief True when the vertex ordering of the faces is counter-clockwise
+    ///        as seen from the outside, e.g. the cross product of the edges
+    ///        points outwards.
+    bool ccw_from_outside;
+  };
+
+  std::vector<MeshGeom> meshes_;
+
+  std::vector<PixelScalar2D> mesh_atts_;
+
+  PixelScalar2D default_mesh_att_ = 1;
+};
+
+}  // xreg
+
+#endif
@@ -0,0 +1,674 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregRayCastMultiDevOCL.h"
+
+#include <algorithm>
+#include <functional>
+#include <numeric>
+
+#include <boost/compute/algorithm/copy.hpp>
+
+#include "xregAssert.h"
+#include "xregExceptionUtils.h"
+#include "xregOpenCLSys.h"
+#include "xregRayCastLineIntCPU.h"
+#include "xregRayCastLineIntOCL.h"
+#include "xregTBBUtils.h"
+#include "xregTimer.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+struct MultiDevComputeFn
+{
+  std::function<void(const size_type)> compute_dev_fn;
+
+  void operator()(const RangeType& r) const
+  {
+    for (size_type dev_idx = r.begin(); dev_idx < r.end(); ++dev_idx)
+    {
+      compute_dev_fn(dev_idx);
+    }
+  }
+};
+
+}  // un-named
+
+xreg::RayCasterMultiDevOCL::RayCasterMultiDevOCL(const RayCasterOCLList& dev_ray_casters)
+  : dev_ray_casters_(dev_ray_casters)
+{
+  xregASSERT(!dev_ray_casters_.empty());
+
+  for (const auto& rc : dev_ray_casters_)
+  {
+    xregASSERT(rc.get());
+
+    ray_casters_.push_back(rc.get());
+  }
+
+  projs_per_sec_for_each_dev_.assign(ray_casters_.size(), 0);
+  secs_for_each_dev_.assign(ray_casters_.size(), 0);
+}
+
+void xreg::RayCasterMultiDevOCL::set_num_projs(const size_type num_projs)
+{
+  RayCaster::set_num_projs(num_projs);
+
+  if (!this->camera_models_.empty())
+  {
+    const size_type tot_num_dets_xfer = this->camera_models_[0].num_det_rows *
+                                        this->camera_models_[0].num_det_cols *
+                                        num_projs;
+
+    sync_to_ocl_.set_range(0, tot_num_dets_xfer);
+    sync_to_host_.set_range(0, tot_num_dets_xfer);
+  }
+}
+
+void xreg::RayCasterMultiDevOCL::allocate_resources()
+{
+  RayCaster::allocate_resources();
+
+  update_dev_params();
+
+  const size_type num_tot_pix = this->camera_models_[0].num_det_rows *
+                                this->camera_models_[0].num_det_cols *
+                                this->num_projs_;
+
+  if (!ext_pixel_buf_)
+  {
+    pixel_buf_.resize(num_tot_pix);
+    sync_to_ocl_.set_host(pixel_buf_);
+    sync_to_host_.set_host(pixel_buf_);
+  }
+  else
+  {
+    sync_to_ocl_.set_host(ext_pixel_buf_, num_tot_pix);
+    sync_to_host_.set_host(ext_pixel_buf_, num_tot_pix);
+  }
+
+  sync_to_ocl_.set_modified();
+  sync_to_host_.set_modified();
+
+  if (host_ray_caster_)
+  {
+    // the host ray caster writes into the host buffer, so it does not need to
+    // allocate its own; the offset into the buffer is set before each computation
+    host_ray_caster_->use_external_host_pixel_buf(pixel_buf_to_use());
+  }
+
+  size_type tot_num_projs_alloc = 0;
+
+  for (auto* rc : ray_casters_)
+  {
+    if (this->use_bg_projs_)
+    {
+      rc->set_bg_projs(this->bg_projs_for_each_cam_, true);
+    }
+
+    rc->set_num_projs(std::min(this->num_projs_, rc->max_num_projs_possible()));
+    rc->allocate_resources();
+
+    tot_num_projs_alloc += rc->num_projs();
+  }
+
+  this->bg_projs_updated_ = false;
+
+  if (tot_num_projs_alloc < this->num_projs_)
+  {
+    xregThrow("Devices cannot store enough projections! (%lu < %lu)",
+              static_cast<unsigned long>(tot_num_projs_alloc),
+              static_cast<unsigned long>(this->num_projs_));
+  }
+
+  // force an assignment of projections on the next computation
+  num_projs_for_each_dev_.clear();
+}
+
+void xreg::RayCasterMultiDevOCL::compute(const size_type vol_idx)
+{
+  xregASSERT(this->resources_allocated_);
+
+  const size_type num_projs_assigned = std::accumulate(num_projs_for_each_dev_.begin(),
+                                                       num_projs_for_each_dev_.end(),
+                                                       size_type(0));
+
+  if (this->proj_store_meth_ == kRAY_CAST_PIXEL_REPLACE)
+  {
+    update_projs_for_each_dev();
+  }
+  else if (num_projs_assigned != this->num_projs_)
+  {
+    xregThrow("Cannot accumulate into a different number of projections!");
+  }
+
+  update_dev_params();
+
+  MultiDevComputeFn compute_fn;
+  compute_fn.compute_dev_fn = [this,vol_idx] (const size_type dev_idx)
+  {
+    this->compute_dev(dev_idx, vol_idx);
+  };
+
+  ParallelFor(compute_fn, RangeType(0, ray_casters_.size()));
+
+  // update the throughput estimates
+  const size_type nd = ray_casters_.size();
+
+  for (size_type dev_idx = 0; dev_idx < nd; ++dev_idx)
+  {
+    if (num_projs_for_each_dev_[dev_idx] && (secs_for_each_dev_[dev_idx] > 0))
+    {
+      const double cur_projs_per_sec = num_projs_for_each_dev_[dev_idx] / secs_for_each_dev_[dev_idx];
+
+      double& projs_per_sec = projs_per_sec_for_each_dev_[dev_idx];
+
+      projs_per_sec = (projs_per_sec > 0) ?
+                        (((1 - kPROJS_PER_SEC_SMOOTHING) * projs_per_sec) +
+                                  (kPROJS_PER_SEC_SMOOTHING * cur_projs_per_sec)) :
+                        cur_projs_per_sec;
+    }
+  }
+
+  sync_to_ocl_.set_modified();
+  sync_to_host_.set_modified();
+}
+
+void xreg::RayCasterMultiDevOCL::compute_dev(const size_type dev_idx, const size_type vol_idx)
+{
+  const size_type num_dev_projs = num_projs_for_each_dev_[dev_idx];
+
+  if (!num_dev_projs)
+  {
+    secs_for_each_dev_[dev_idx] = 0;
+    return;
+  }
+
+  Timer tmr;
+  tmr.start();
+
+  if (dev_idx == dev_ray_casters_.size())
+  {
+    compute_host(vol_idx);
+
+    tmr.stop();
+
+    secs_for_each_dev_[dev_idx] = tmr.elapsed_seconds();
+    return;
+  }
+
+  RayCasterOCL& rc = *dev_ray_casters_[dev_idx];
+
+  const size_type proj_off = proj_offset_for_each_dev_[dev_idx];
+
+  rc.set_xforms_cam_to_itk_phys(FrameTransformList(
+                          this->xforms_cam_to_itk_phys_.begin() + proj_off,
+                          this->xforms_cam_to_itk_phys_.begin() + proj_off + num_dev_projs));
+
+  rc.set_camera_model_proj_associations(CamModelAssocList(
+                          this->cam_model_for_proj_.begin() + proj_off,
+                          this->cam_model_for_proj_.begin() + proj_off + num_dev_projs));
+
+  rc.compute(vol_idx);
+
+  // gather into the host buffer
+  const size_type num_pix_per_proj = this->camera_models_[0].num_det_rows *
+                                     this->camera_models_[0].num_det_cols;
+
+  RayCastSyncOCLBuf* dev_sync = rc.to_ocl_buf();
+  dev_sync->sync();
+
+  boost::compute::copy(dev_sync->ocl_buf().begin(),
+                       dev_sync->ocl_buf().begin() + (num_dev_projs * num_pix_per_proj),
+                       pixel_buf_to_use() + (proj_off * num_pix_per_proj),
+                       dev_sync->queue());
+
+  tmr.stop();
+
+  secs_for_each_dev_[dev_idx] = tmr.elapsed_seconds();
+}
+
+void xreg::RayCasterMultiDevOCL::compute_host(const size_type vol_idx)
+{
+  const size_type host_idx = dev_ray_casters_.size();
+
+  const size_type num_host_projs = num_projs_for_each_dev_[host_idx];
+
+  const size_type proj_off = proj_offset_for_each_dev_[host_idx];
+
+  RayCasterCPU& rc = *host_ray_caster_;
+
+  const size_type num_pix_per_proj = this->camera_models_[0].num_det_rows *
+                                     this->camera_models_[0].num_det_cols;
+
+  rc.use_external_host_pixel_buf(pixel_buf_to_use() + (proj_off * num_pix_per_proj));
+
+  rc.set_xforms_cam_to_itk_phys(FrameTransformList(
+                          this->xforms_cam_to_itk_phys_.begin() + proj_off,
+                          this->xforms_cam_to_itk_phys_.begin() + proj_off + num_host_projs));
+
+  rc.set_camera_model_proj_associations(CamModelAssocList(
+                          this->cam_model_for_proj_.begin() + proj_off,
+                          this->cam_model_for_proj_.begin() + proj_off + num_host_projs));
+
+  rc.compute(vol_idx);
+}
+
+void xreg::RayCasterMultiDevOCL::update_projs_for_each_dev()
+{
+  if (assign_devs_by_cam_)
+  {
+    update_projs_for_each_dev_by_cam();
+    return;
+  }
+
+  const size_type nd = ray_casters_.size();
+
+  // devices that have not been measured are assumed to have the mean
+  // throughput of the measured devices
+  double tot_measured_projs_per_sec = 0;
+  size_type num_measured = 0;
+
+  for (const double projs_per_sec : projs_per_sec_for_each_dev_)
+  {
+    if (projs_per_sec > 0)
+    {
+      tot_measured_projs_per_sec += projs_per_sec;
+      ++num_measured;
+    }
+  }
+
+  const double default_projs_per_sec = num_measured ?
+                                          (tot_measured_projs_per_sec / num_measured) : 1.0;
+
+  std::vector<double> weights(nd);
+
+  for (size_type dev_idx = 0; dev_idx < nd; ++dev_idx)
+  {
+    weights[dev_idx] = (projs_per_sec_for_each_dev_[dev_idx] > 0) ?
+                          projs_per_sec_for_each_dev_[dev_idx] : default_projs_per_sec;
+  }
+
+  const double tot_weight = std::accumulate(weights.begin(), weights.end(), 0.0);
+
+  std::vector<double> ideal_num_projs(nd);
+
+  num_projs_for_each_dev_.assign(nd, 0);
+
+  size_type num_projs_left = this->num_projs_;
+
+  for (size_type dev_idx = 0; dev_idx < nd; ++dev_idx)
+  {
+    ideal_num_projs[dev_idx] = this->num_projs_ * (weights[dev_idx] / tot_weight);
+
+    num_projs_for_each_dev_[dev_idx] = std::min(static_cast<size_type>(ideal_num_projs[dev_idx]),
+                                                ray_casters_[dev_idx]->max_num_projs());
+
+    num_projs_left -= num_projs_for_each_dev_[dev_idx];
+  }
+
+  // distribute the remaining projections, one at a time, to the device
+  // furthest below its ideal number of projections that has capacity left
+  for (; num_projs_left; --num_projs_left)
+  {
+    size_type best_dev_idx = nd;
+    double best_deficit = 0;
+
+    for (size_type dev_idx = 0; dev_idx < nd; ++dev_idx)
+    {
+      if (num_projs_for_each_dev_[dev_idx] < ray_casters_[dev_idx]->max_num_projs())
+      {
+        const double deficit = ideal_num_projs[dev_idx] - num_projs_for_each_dev_[dev_idx];
+
+        if ((best_dev_idx == nd) || (deficit > best_deficit))
+        {
+          best_dev_idx = dev_idx;
+          best_deficit = deficit;
+        }
+      }
+    }
+
+    xregASSERT(best_dev_idx < nd);
+
+    ++num_projs_for_each_dev_[best_dev_idx];
+  }
+
+  update_proj_offsets_for_each_dev();
+}
+
+void xreg::RayCasterMultiDevOCL::update_projs_for_each_dev_by_cam()
+{
+  const size_type nd = ray_casters_.size();
+
+  const size_type num_cams = this->camera_models_.size();
+
+  num_projs_for_each_dev_.assign(nd, 0);
+
+  size_type prev_dev_idx = 0;
+
+  for (size_type proj_idx = 0; proj_idx < this->num_projs_; ++proj_idx)
+  {
+    const size_type dev_idx = (this->cam_model_for_proj_[proj_idx] * nd) / num_cams;
+
+    if (dev_idx < prev_dev_idx)
+    {
+      xregThrow("Projections must be ordered by camera model when assigning devices by camera model!");
+    }
+
+    prev_dev_idx = dev_idx;
+
+    ++num_projs_for_each_dev_[dev_idx];
+  }
+
+  for (size_type dev_idx = 0; dev_idx < nd; ++dev_idx)
+  {
+    if (num_projs_for_each_dev_[dev_idx] > ray_casters_[dev_idx]->max_num_projs())
+    {
+      xregThrow("Device %lu cannot store the projections of its camera models! (%lu > %lu)",
+                static_cast<unsigned long>(dev_idx),
+                static_cast<unsigned long>(num_projs_for_each_dev_[dev_idx]),
+                static_cast<unsigned long>(ray_casters_[dev_idx]->max_num_projs()));
+    }
+  }
+
+  update_proj_offsets_for_each_dev();
+}
+
+void xreg::RayCasterMultiDevOCL::update_proj_offsets_for_each_dev()
+{
+  const size_type nd = ray_casters_.size();
+
+  proj_offset_for_each_dev_.assign(nd, 0);
+
+  for (size_type dev_idx = 1; dev_idx < nd; ++dev_idx)
+  {
+    proj_offset_for_each_dev_[dev_idx] = proj_offset_for_each_dev_[dev_idx - 1] +
+                                            num_projs_for_each_dev_[dev_idx - 1];
+  }
+}
+
+void xreg::RayCasterMultiDevOCL::update_dev_params()
+{
+  for (auto* rc : ray_casters_)
+  {
+    rc->set_ray_step_size(this->ray_step_size_);
+    rc->set_interp_method(this->interp_method_);
+    rc->set_default_bg_pixel_val(this->default_bg_pixel_val_);
+    rc->set_proj_store_method(this->proj_store_meth_);
+
+    if (this->bg_projs_updated_)
+    {
+      rc->set_bg_projs(this->bg_projs_for_each_cam_, this->use_bg_projs_);
+    }
+    else
+    {
+      rc->set_use_bg_projs(this->use_bg_projs_);
+    }
+  }
+
+  this->bg_projs_updated_ = false;
+}
+
+xreg::RayCasterMultiDevOCL::ProjPtr
+xreg::RayCasterMultiDevOCL::proj(const size_type proj_idx)
+{
+  const auto& cam = this->camera_models_[this->cam_model_for_proj_[proj_idx]];
+
+  const size_type det_num_rows = cam.num_det_rows;
+  const size_type det_num_cols = cam.num_det_cols;
+  const size_type num_dets = det_num_rows * det_num_cols;
+
+  auto img_proj = Proj::New();
+
+  auto img_proj_pixel_container = Proj::PixelContainer::New();
+  img_proj_pixel_container->SetImportPointer(pixel_buf_to_use() + (num_dets * proj_idx), num_dets, false);
+
+  img_proj->SetPixelContainer(img_proj_pixel_container);
+
+  Proj::RegionType proj_region;
+  proj_region.SetIndex(0, 0);
+  proj_region.SetIndex(1, 0);
+  proj_region.SetSize(0, det_num_cols);
+  proj_region.SetSize(1, det_num_rows);
+
+  img_proj->SetRegions(proj_region);
+
+  const CoordScalar spacings[2] = { cam.det_col_spacing, cam.det_row_spacing };
+  img_proj->SetSpacing(spacings);
+
+  return img_proj;
+}
+
+cv::Mat xreg::RayCasterMultiDevOCL::proj_ocv(const size_type proj_idx)
+{
+  const auto& cam = this->camera_models_[this->cam_model_for_proj_[proj_idx]];
+
+  return cv::Mat(cam.num_det_rows, cam.num_det_cols, cv::DataType<PixelScalar2D>::type,
+                 pixel_buf_to_use() + (cam.num_det_rows * cam.num_det_cols * proj_idx));
+}
+
+xreg::RayCasterMultiDevOCL::PixelScalar2D*
+xreg::RayCasterMultiDevOCL::raw_host_pixel_buf()
+{
+  return pixel_buf_to_use();
+}
+
+void xreg::RayCasterMultiDevOCL::use_external_host_pixel_buf(void* buf)
+{
+  ext_pixel_buf_ = static_cast<PixelScalar2D*>(buf);
+}
+
+xreg::size_type xreg::RayCasterMultiDevOCL::max_num_projs_possible() const
+{
+  if (host_ray_caster_)
+  {
+    // the host is not limited by device memory
+    return host_ray_caster_->max_num_projs_possible();
+  }
+
+  size_type max_num_projs = 0;
+
+  for (const auto& rc : dev_ray_casters_)
+  {
+    max_num_projs += rc->max_num_projs_possible();
+  }
+
+  return max_num_projs;
+}
+
+void xreg::RayCasterMultiDevOCL::use_other_proj_buf(RayCaster*)
+{
+  throw UnsupportedOperationException();
+}
+
+xreg::RayCastSyncOCLBuf* xreg::RayCasterMultiDevOCL::to_ocl_buf()
+{
+  return &sync_to_ocl_;
+}
+
+xreg::RayCastSyncHostBuf* xreg::RayCasterMultiDevOCL::to_host_buf()
+{
+  return &sync_to_host_;
+}
+
+xreg::size_type xreg::RayCasterMultiDevOCL::num_devs() const
+{
+  return dev_ray_casters_.size();
+}
+
+void xreg::RayCasterMultiDevOCL::set_host_ray_caster(RayCasterCPUPtr host_ray_caster)
+{
+  host_ray_caster_ = host_ray_caster;
+
+  ray_casters_.clear();
+
+  for (const auto& rc : dev_ray_casters_)
+  {
+    ray_casters_.push_back(rc.get());
+  }
+
+  if (host_ray_caster_)
+  {
+    ray_casters_.push_back(host_ray_caster_.get());
+
+    // forward any parameters that have already been set
+    if (!this->vols_.empty())
+    {
+      host_ray_caster_->set_use_empty_space_skipping(this->use_empty_space_skipping_);
+      host_ray_caster_->set_empty_space_brick_dim(this->empty_space_brick_dim_);
+      host_ray_caster_->set_empty_space_thresh(this->empty_space_thresh_);
+
+      host_ray_caster_->set_volumes(this->vols_);
+    }
+
+    if (!this->camera_models_.empty())
+    {
+      host_ray_caster_->set_camera_models(this->camera_models_);
+    }
+  }
+
+  projs_per_sec_for_each_dev_.assign(ray_casters_.size(), 0);
+  secs_for_each_dev_.assign(ray_casters_.size(), 0);
+
+  // force an assignment of projections on the next computation
+  num_projs_for_each_dev_.clear();
+}
+
+xreg::RayCasterCPU* xreg::RayCasterMultiDevOCL::host_ray_caster()
+{
+  return host_ray_caster_.get();
+}
+
+void xreg::RayCasterMultiDevOCL::set_assign_devs_by_camera_model(const bool by_cam)
+{
+  assign_devs_by_cam_ = by_cam;
+  
+  // force an assignment of projections on the next computation
+  num_projs_for_each_dev_.clear();
+}
+
+bool xreg::RayCasterMultiDevOCL::assign_devs_by_camera_model() const
+{
+  return assign_devs_by_cam_;
+}
+
+xreg::RayCasterOCL& xreg::RayCasterMultiDevOCL::dev_ray_caster(const size_type dev_idx)
+{
+  return *dev_ray_casters_[dev_idx];
+}
+
+const std::vector<xreg::size_type>&
+xreg::RayCasterMultiDevOCL::num_projs_for_each_dev() const
+{
+  return num_projs_for_each_dev_;
+}
+
+const std::vector<double>&
+xreg::RayCasterMultiDevOCL::projs_per_sec_for_each_dev() const
+{
+  return projs_per_sec_for_each_dev_;
+}
+
+void xreg::RayCasterMultiDevOCL::vols_changed()
+{
+  for (auto* rc : ray_casters_)
+  {
+    // the empty space parameters are needed when the volumes are set
+    rc->set_use_empty_space_skipping(this->use_empty_space_skipping_);
+    rc->set_empty_space_brick_dim(this->empty_space_brick_dim_);
+    rc->set_empty_space_thresh(this->empty_space_thresh_);
+
+    rc->set_use_precomputed_grad_vols(this->use_precomputed_grad_vols_);
+
+    rc->set_volumes(this->vols_);
+  }
+}
+
+void xreg::RayCasterMultiDevOCL::camera_models_changed()
+{
+  for (auto* rc : ray_casters_)
+  {
+    rc->set_camera_models(this->camera_models_);
+  }
+}
+
+void xreg::RayCasterMultiDevOCL::active_pixels_changed()
+{
+  const size_type num_cams = this->camera_models_.size();
+
+  for (auto* rc : ray_casters_)
+  {
+    for (size_type cam_idx = 0; cam_idx < num_cams; ++cam_idx)
+    {
+      if (this->cam_has_active_pixels_[cam_idx])
+      {
+        rc->set_active_pixels(cam_idx, this->active_pixels_for_each_cam_[cam_idx]);
+      }
+      else
+      {
+        rc->clear_active_pixels(cam_idx);
+      }
+    }
+  }
+}
+
+xreg::RayCasterMultiDevOCL::PixelScalar2D*
+xreg::RayCasterMultiDevOCL::pixel_buf_to_use()
+{
+  return ext_pixel_buf_ ? ext_pixel_buf_ : &pixel_buf_[0];
+}
+
+std::shared_ptr<xreg::RayCasterMultiDevOCL>
+xreg::LineIntRayCasterMultiDevOCL(const std::vector<std::string>& dev_id_strs,
+                                  const bool use_host)
+{
+  const auto dev_map = BuildDevIDStrsToDevMap();
+
+  RayCasterMultiDevOCL::RayCasterOCLList dev_ray_casters;
+  dev_ray_casters.reserve(dev_id_strs.size());
+
+  for (const auto& dev_id : dev_id_strs)
+  {
+    auto dev_it = dev_map.find(dev_id);
+
+    if (dev_it == dev_map.end())
+    {
+      xregThrow("Unknown OpenCL device ID: %s", dev_id.c_str());
+    }
+
+    dev_ray_casters.push_back(std::make_shared<RayCasterLineIntOCL>(dev_it->second));
+  }
+
+  auto rc = std::make_shared<RayCasterMultiDevOCL>(dev_ray_casters);
+
+  if (use_host)
+  {
+    rc->set_host_ray_caster(std::make_shared<RayCasterLineIntCPU>());
+  }
+
+  return rc;
+}
@@ -0,0 +1,248 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGRAYCASTMULTIDEVOCL_H_
+#define XREGRAYCASTMULTIDEVOCL_H_
+
+#include "xregRayCastBaseOCL.h"
+#include "xregRayCastBaseCPU.h"
+
+namespace xreg
+{
+
+/// \brief Ray casting using several OpenCL devices, each with its own context.
+///
+/// Each device is driven by a separate OpenCL ray caster, which holds a copy
+/// of the volume textures, and is assigned a contiguous range of the
+/// projections. The range sizes are proportional to the throughput of each
+/// device (projections per second), which is measured during each call to
+/// compute() and smoothed over calls. The projections computed by each device
+/// are gathered into a single host buffer.
+///
+/// A CPU ray caster may also be added (see set_host_ray_caster()), so that
+/// the host cores compute a share of the projections while the devices are
+/// busy. It is treated as one more device, with its share also proportional
+/// to the measured throughput, and writes directly into the host buffer.
+///
+/// The common ray casting parameters (camera models, volumes, interpolation,
+/// step size, background, active pixels, etc.) are forwarded to each device's
+/// ray caster. Parameters specific to a type of ray caster (e.g. a line
+/// integral kernel) should be set using dev_ray_caster() or
+/// host_ray_caster() before calling allocate_resources().
+class RayCasterMultiDevOCL : public RayCaster
+{
+public:
+  using RayCasterOCLPtr  = std::shared_ptr<RayCasterOCL>;
+  using RayCasterOCLList = std::vector<RayCasterOCLPtr>;
+
+  using RayCasterCPUPtr = std::shared_ptr<RayCasterCPU>;
+
+  /// \brief Constructor specifying a ray caster for each device.
+  ///
+  /// Each ray caster should use a separate device.
+  explicit RayCasterMultiDevOCL(const RayCasterOCLList& dev_ray_casters);
+
+  /// \brief Calls parent, and additionally sets a range on the sync buffers
+  /// (so the max allocated buffer is not transferred).
+  void set_num_projs(const size_type num_projs) override;
+
+  /// \brief Allocate resources required for computing each ray cast.
+  ///
+  /// Resources are allocated on each device for as many of the projections
+  /// as the device supports, up to the total number of projections. A buffer
+  /// in host memory large enough to store all projections is also allocated.
+  void allocate_resources() override;
+
+  /// \brief Perform each ray cast.
+  ///
+  /// The devices are run concurrently. When projections are accumulated, the
+  /// previous assignment of projections to devices is kept, since each device
+  /// accumulates into its own buffer.
+  void compute(const size_type vol_idx = 0) override;
+
+  /// \brief Retrieve a 2D projection image.
+  ///
+  /// The returned image is a shallow reference into the host buffer used for
+  /// gathering the projections, therefore a subsequent call to compute() may
+  /// change the pixel values.
+  ProjPtr proj(const size_type proj_idx) override;
+
+  /// \brief Retrieve a 2D projection image in OpenCV format.
+  ///
+  /// The returned image is a shallow reference into the host buffer used for
+  /// gathering the projections, therefore a subsequent call to compute() may
+  /// change the pixel values.
+  cv::Mat proj_ocv(const size_type proj_idx) override;
+
+  /// \brief Retrieve the raw pointer to the host buffer used for storing
+  ///        computed images.
+  ///
+  /// Should only be called after allocate_resources() has been called.
+  PixelScalar2D* raw_host_pixel_buf() override;
+
+  /// \brief Use an external buffer for storing computed DRRs on the HOST
+  ///
+  /// The default behavior when this is not called, or a null pointer is provided,
+  /// is to use an internally allocated buffer.
+  /// The user is responsible for ensuring it has sufficient capacity and for
+  /// managing the memory properly (e.g. deallocating when appropriate).
+  void use_external_host_pixel_buf(void* buf) override;
+
+  /// \brief The maximum number of projections that is possible to allocate
+  ///        resources for, the sum of the maximum of each device.
+  size_type max_num_projs_possible() const override;
+
+  /// \brief Use another ray caster's projection buffer - NOT SUPPORTED
+  ///        with multiple devices - will throw an exception.
+  void use_other_proj_buf(RayCaster* other_ray_caster) override;
+
+  RayCastSyncOCLBuf* to_ocl_buf() override;
+
+  RayCastSyncHostBuf* to_host_buf() override;
+
+  /// \brief The number of OpenCL devices, which does not include the host.
+  size_type num_devs() const;
+
+  /// \brief Sets a CPU ray caster that computes a share of the projections on
+  ///        the host, concurrently with the devices.
+  ///
+  /// The ray caster should be of the same type as the device ray casters (e.g.
+  /// RayCasterLineIntCPU with RayCasterLineIntOCL). This should be called
+  /// before setting the volumes and camera models. A null pointer (the
+  /// default) only uses the devices.
+  void set_host_ray_caster(RayCasterCPUPtr host_ray_caster);
+
+  /// \brief The CPU ray caster computing projections on the host, null when
+  ///        only the devices are used.
+  RayCasterCPU* host_ray_caster();
+
+  /// \brief Assign the projections of each camera model to a single device,
+  ///        instead of balancing by the device throughputs.
+  ///
+  /// Contiguous groups of camera models are assigned to each device, e.g.
+  /// camera model i is computed by device i when the numbers of camera models
+  /// and devices are equal. This keeps each view of a multiple-view
+  /// registration on its own device. The projections must be ordered by
+  /// camera model, as done by distribute_xforms_among_cam_models().
+  /// The default is false.
+  void set_assign_devs_by_camera_model(const bool by_cam);
+
+  bool assign_devs_by_camera_model() const;
+
+  /// \brief The ray caster driving a device.
+  RayCasterOCL& dev_ray_caster(const size_type dev_idx);
+
+  /// \brief The number of projections computed by each device during the
+  ///        most recent call to compute().
+  ///
+  /// When a host ray caster is used, its number of projections is stored last.
+  const std::vector<size_type>& num_projs_for_each_dev() const;
+
+  /// \brief The current estimates of each device's throughput, in projections
+  ///        per second.
+  ///
+  /// The estimate of a device is zero until it has computed projections.
+  /// When a host ray caster is used, its estimate is stored last.
+  const std::vector<double>& projs_per_sec_for_each_dev() const;
+
+protected:
+  void vols_changed() override;
+
+  void camera_models_changed() override;
+
+  void active_pixels_changed() override;
+
+private:
+  /// \brief The weight of a new throughput measurement in the exponential
+  ///        moving average of each device.
+  constexpr static double kPROJS_PER_SEC_SMOOTHING = 0.5;
+
+  PixelScalar2D* pixel_buf_to_use();
+
+  /// \brief Assigns the projections to each device, proportionally to the
+  ///        estimated throughput and limited by the number of projections
+  ///        allocated on each device.
+  void update_projs_for_each_dev();
+
+  /// \brief Assigns the projections of each camera model to a device.
+  ///
+  /// \see set_assign_devs_by_camera_model
+  void update_projs_for_each_dev_by_cam();
+
+  /// \brief Sets the offset of each device's projections from the number of
+  ///        projections assigned to each device.
+  void update_proj_offsets_for_each_dev();
+
+  /// \brief Forwards the parameters that may change between calls to
+  ///        compute() to the ray caster of each device.
+  void update_dev_params();
+
+  /// \brief Computes and gathers the projections assigned to a device.
+  ///
+  /// The index one past the last device corresponds to the host ray caster.
+  void compute_dev(const size_type dev_idx, const size_type vol_idx);
+
+  /// \brief Computes the projections assigned to the host ray caster directly
+  ///        into the host buffer.
+  void compute_host(const size_type vol_idx);
+
+  RayCasterOCLList dev_ray_casters_;
+
+  RayCasterCPUPtr host_ray_caster_;
+
+  /// \brief The ray casters of each device, followed by the host ray caster
+  ///        when it is used.
+  std::vector<RayCaster*> ray_casters_;
+
+  std::vector<size_type> num_projs_for_each_dev_;
+  std::vector<size_type> proj_offset_for_each_dev_;
+
+  std::vector<double> projs_per_sec_for_each_dev_;
+
+  // the time (in seconds) spent by each device on the most recent call to compute()
+  std::vector<double> secs_for_each_dev_;
+
+  bool assign_devs_by_cam_ = false;
+
+  PixelScalar2D* ext_pixel_buf_ = nullptr;
+
+  std::vector<PixelScalar2D> pixel_buf_;
+
+  RayCastSyncHostBufFromHost sync_to_host_;
+  RayCastSyncOCLBufFromHost  sync_to_ocl_;
+};
+
+/// \brief Creates a ray caster computing line integrals using several
+///        OpenCL devices.
+///
+/// The devices are specified using their unique IDs. When use_host is true,
+/// a CPU line integral ray caster also computes projections on the host.
+/// \see DevIDStrs
+std::shared_ptr<RayCasterMultiDevOCL>
+LineIntRayCasterMultiDevOCL(const std::vector<std::string>& dev_id_strs,
+                            const bool use_host = false);
+
+}  // xreg
+
+#endif
@@ -24,13 +24,8 @@
 
 #include "xregRayCastOccContourCPU.h"
 
-#include <itkLinearInterpolateImageFunction.h>
-#include <itkNearestNeighborInterpolateImageFunction.h>
-#include <itkWindowedSincInterpolateImageFunction.h>
-#include <itkConstantBoundaryCondition.h>
-#include <itkBSplineInterpolateImageFunction.h>
-
 #include "xregITKBasicImageUtils.h"
+#include "xregRayCastInterpCPU.h"
 #include "xregTBBUtils.h"
 #include "xregSpatialPrimitives.h"
 #include "xregExceptionUtils.h"
@@ -66,6 +61,12 @@ struct ContourFn
 
   const RayCaster::InterpMethod interp_method;  ///< The interpolation method used for fractional indices into the 3D volume
 
+  const Vol* bspline_coefs;  ///< Shared B-spline coefficients of img_vol, null when not using B-spline interpolation
+
+  const RayCastGradVol* grad_vol;  ///< Precomputed gradients of img_vol used for surface normals, null when not used
+
+  RayCastCPUThreadStatePool* thread_states;  ///< The interpolators and random engines kept by each thread
+
   PixelScalar2D* proj_buf;  ///< The large buffer used for storing all projection results
 
   const PixelScalar3D collision_thresh;
@@ -81,39 +82,31 @@ struct ContourFn
   /// The collection of contours is not necessarily restricted to a single projection
   void operator()(const RangeType& r) const
   {
-    using VolInterpType        = itk::InterpolateImageFunction<Vol,CoordScalar>;
-    using VolLinearInterpType  = itk::LinearInterpolateImageFunction<Vol,CoordScalar>;
-    using VolNNInterpType      = itk::NearestNeighborInterpolateImageFunction<Vol,CoordScalar>;
-    using VolBSplineInterpType = itk::BSplineInterpolateImageFunction<Vol,CoordScalar>;
-    using VolSincInterpType    = itk::WindowedSincInterpolateImageFunction<
-                                         Vol,4,itk::Function::LanczosWindowFunction<4>,
-                                         itk::ConstantBoundaryCondition<Vol>,CoordScalar>;
-
-    VolInterpType::Pointer vol_interp;
-
-    switch (interp_method)
+    if (interp_method == RayCaster::kRAY_CAST_INTERP_NN)
     {
-      case RayCaster::kRAY_CAST_INTERP_NN:
-        vol_interp = VolNNInterpType::New();
-        break;
-      case RayCaster::kRAY_CAST_INTERP_SINC:
-        vol_interp = VolSincInterpType::New();
-        break;
-      case RayCaster::kRAY_CAST_INTERP_BSPLINE:
-      {
-        auto bspline_interp = VolBSplineInterpType::New();
-        bspline_interp->SetSplineOrder(3);
-        vol_interp = bspline_interp;
-      }
-        break;
-      case RayCaster::kRAY_CAST_INTERP_LINEAR:
-      default:
-        vol_interp = VolLinearInterpType::New();
-        break;
+      const RayCastVolNNInterpCPU<RayCastVolBufCPU> interp = { MakeRayCastVolBufCPU(img_vol) };
+      cast_rays(r, interp);
     }
+    else if (interp_method == RayCaster::kRAY_CAST_INTERP_LINEAR)
+    {
+      const RayCastVolLinearInterpCPU<RayCastVolBufCPU> interp = { MakeRayCastVolBufCPU(img_vol) };
+      cast_rays(r, interp);
+    }
+    else
+    {
+      RayCastITKInterpCPU::VolInterp::Pointer vol_interp =
+                              thread_states->interp(interp_method, img_vol, bspline_coefs);
 
-    vol_interp->SetInputImage(img_vol);
-    
+      const RayCastITKInterpCPU interp = { vol_interp.GetPointer() };
+      cast_rays(r, interp);
+    }
+  }
+
+  /// \brief Computes a collection of contour pixels using an interpolation
+  ///        functor that takes the continuous index as three scalars.
+  template <class tInterp>
+  void cast_rays(const RangeType& r, const tInterp& vol_interp) const
+  {
     const size_type num_drr_px = camera_models[0].num_det_rows *
                                               camera_models[0].num_det_cols;
     
@@ -172,23 +165,12 @@ struct ContourFn
 
         const size_type num_steps = static_cast<size_type>(intersect_len_wrt_itk_idx / step_len_wrt_itk_idx);
 
-        // We'll use the ITK objects now, since that is the easiest interface with itk::Image and itk interpolation
-        itk::ContinuousIndex<CoordScalar,3> cur_cont_vol_idx;
-        cur_cont_vol_idx[0] = start_pt_wrt_itk_idx[0];
-        cur_cont_vol_idx[1] = start_pt_wrt_itk_idx[1];
-        cur_cont_vol_idx[2] = start_pt_wrt_itk_idx[2];
-
-        // Index to be used for retrieving values to perform gradient computation
-        itk::ContinuousIndex<CoordScalar,3> tmp_cont_vol_idx_grad;
+        Pt3 cur_cont_vol_idx = start_pt_wrt_itk_idx;
 
         const CoordScalar scale_to_step = step_len_wrt_itk_idx / pinhole_to_det_len_wrt_itk_idx;
-        itk::Vector<CoordScalar,3> tmp_step_vec_wrt_itk_idx;
-        tmp_step_vec_wrt_itk_idx[0] = pinhole_to_det_wrt_itk_idx[0] * scale_to_step;
-        tmp_step_vec_wrt_itk_idx[1] = pinhole_to_det_wrt_itk_idx[1] * scale_to_step;
-        tmp_step_vec_wrt_itk_idx[2] = pinhole_to_det_wrt_itk_idx[2] * scale_to_step;
+        const Pt3 step_vec_wrt_itk_idx = pinhole_to_det_wrt_itk_idx * scale_to_step;
 
         PixelScalar3D cur_vol_val = 0;
-        PixelScalar3D cur_vol_val_for_grad[2] = { 0, 0 };
 
         // First, this will be used for gradient calcluation, of which the
         // negative estimates the surface normal. Next, it will be used to esetimate
@@ -200,7 +182,7 @@ struct ContourFn
         bool is_edge = false;
         for (size_type step_idx = 0; !is_edge && (step_idx <= num_steps); ++step_idx)
         {
-          cur_vol_val = vol_interp->EvaluateAtContinuousIndex(cur_cont_vol_idx);
+          cur_vol_val = vol_interp(cur_cont_vol_idx[0], cur_cont_vol_idx[1], cur_cont_vol_idx[2]);
           if (cur_vol_val >= collision_thresh)
           {
             if (t_start > 1.0e-6)
@@ -209,53 +191,32 @@ struct ContourFn
               // to determine a more accurate location of where the threshold is crossed
         
               // backtracking step vector - repeatedly cut in half
-              itk::Vector<CoordScalar,3> backtrack_step_vec_wrt_itk_idx = tmp_step_vec_wrt_itk_idx;
+              Pt3 backtrack_step_vec_wrt_itk_idx = step_vec_wrt_itk_idx;
 
               for (size_type sur_bin_step_idx = 0;
                    sur_bin_step_idx < num_backtracking_steps;
                    ++sur_bin_step_idx)
               {
                 backtrack_step_vec_wrt_itk_idx *= 0.5;
-                cur_cont_vol_idx -=
-                  (cur_vol_val >= collision_thresh) ?
-                                  backtrack_step_vec_wrt_itk_idx : -backtrack_step_vec_wrt_itk_idx;
-
-                cur_vol_val = vol_interp->EvaluateAtContinuousIndex(cur_cont_vol_idx);
+                if (cur_vol_val >= collision_thresh)
+                {
+                  cur_cont_vol_idx -= backtrack_step_vec_wrt_itk_idx;
+                }
+                else
+                {
+                  cur_cont_vol_idx += backtrack_step_vec_wrt_itk_idx;
+                }
+
+                cur_vol_val = vol_interp(cur_cont_vol_idx[0], cur_cont_vol_idx[1], cur_cont_vol_idx[2]);
               }
               // end backtracking
 
               // approximate the derivative at this point with finite differencing adjacent indices
               // NOTE: these are wrt image (index) axes.
 
-              // Gradient in X direction
-              tmp_cont_vol_idx_grad = cur_cont_vol_idx;
-              tmp_cont_vol_idx_grad[0] -= 1;
-
-              cur_vol_val_for_grad[0] = vol_interp->EvaluateAtContinuousIndex(tmp_cont_vol_idx_grad);
-              tmp_cont_vol_idx_grad[0] += 2;
-              cur_vol_val_for_grad[1] = vol_interp->EvaluateAtContinuousIndex(tmp_cont_vol_idx_grad);
-
-              sur_grad_vec[0] = cur_vol_val_for_grad[1] - cur_vol_val_for_grad[0];
+              const Pt3 grad_wrt_itk_idx = RayCastSurGradCPU(vol_interp, grad_vol, cur_cont_vol_idx);
 
-              // Gradient in Y direction
-              tmp_cont_vol_idx_grad[0] = cur_cont_vol_idx[0];
-              tmp_cont_vol_idx_grad[1] -= 1;
-
-              cur_vol_val_for_grad[0] = vol_interp->EvaluateAtContinuousIndex(tmp_cont_vol_idx_grad);
-              tmp_cont_vol_idx_grad[1] += 2;
-              cur_vol_val_for_grad[1] = vol_interp->EvaluateAtContinuousIndex(tmp_cont_vol_idx_grad);
-
-              sur_grad_vec[1] = cur_vol_val_for_grad[1] - cur_vol_val_for_grad[0];
-
-              // Gradient in Z direction
-              tmp_cont_vol_idx_grad[1] = cur_cont_vol_idx[1];
-              tmp_cont_vol_idx_grad[2] -= 1;
-
-              cur_vol_val_for_grad[0] = vol_interp->EvaluateAtContinuousIndex(tmp_cont_vol_idx_grad);
-              tmp_cont_vol_idx_grad[2] += 2;
-              cur_vol_val_for_grad[1] = vol_interp->EvaluateAtContinuousIndex(tmp_cont_vol_idx_grad);
-
-              sur_grad_vec[2] = cur_vol_val_for_grad[1] - cur_vol_val_for_grad[0];
+              sur_grad_vec = grad_wrt_itk_idx.cast<PixelScalar3D>();
 
               sur_grad_vec.normalize();
               
@@ -276,7 +237,7 @@ struct ContourFn
             }
           }  // if (cur_vol_val >= collision_thresh)
 
-          cur_cont_vol_idx += tmp_step_vec_wrt_itk_idx;
+          cur_cont_vol_idx += step_vec_wrt_itk_idx;
         }  // for step
 
         if (is_edge)
@@ -294,6 +255,8 @@ struct ContourFn
 void xreg::RayCasterOccludingContoursCPU::compute(const size_type vol_idx)
 {
   xregASSERT(this->resources_allocated_);
+
+  ParallelExecContextScope exec_scope(this->exec_ctx_.get());
   
   // Get the index bounding box (axis-aligned in the index space) of the volume
   Pt3 img_aabb_min;
@@ -317,6 +280,9 @@ void xreg::RayCasterOccludingContoursCPU::compute(const size_type vol_idx)
                            this->cam_model_for_proj_,
                            this->ray_step_size_,
                            this->interp_method_,
+                           this->bspline_coefs(vol_idx),
+                           this->use_precomputed_grad_vols() ? &this->grad_vol(vol_idx) : nullptr,
+                           &this->thread_state_pool_,
                            this->pixel_buf_to_use(),
                            this->render_thresh(),
                            this->num_backtracking_steps(),
@@ -26,9 +26,13 @@
 
 #include <boost/compute/utility/source.hpp>
 #include <boost/compute/types/struct.hpp>
+#include <boost/compute/algorithm/exclusive_scan.hpp>
+#include <boost/compute/algorithm/fill.hpp>
+#include <boost/compute/iterator/buffer_iterator.hpp>
 
 #include "xregAssert.h"
 #include "xregExceptionUtils.h"
+#include "xregOpenCLProgCache.h"
 
 //////////////////////////////////////////////////////////////////////
 
@@ -55,7 +59,11 @@ __kernel void xregOccludingContourKernel(const RayCastArgs args,
                                          __global const float16* cam_to_itk_phys_xforms,
                                          __global float* dst_contours_buf,
                                          __global const ulong* cam_model_for_proj,
-                                         __global const float4* cam_focal_pts)
+                                         __global const float4* cam_focal_pts,
+                                         __global float* dst_edge_depths,
+                                         const int write_edge_depths,
+                                         image3d_t grad_tex,
+                                         const int use_grad_tex)
 {
   const ulong idx = get_global_id(0);
 
@@ -116,26 +124,42 @@ __kernel void xregOccludingContourKernel(const RayCastArgs args,
 
     int is_edge = 0;
 
+    // distance from the focal point to the collision
+    float edge_depth = 0;
+
     for (ulong step_idx = 0; step_idx <= num_steps; ++step_idx, cur_cont_vol_idx += step_vec_wrt_itk_idx)
     {
-      if (read_imagef(vol_tex, sampler, cur_cont_vol_idx).x >= sur_coll_args.sur_coll_thresh)
+      if (xregVolTexVal(read_imagef(vol_tex, sampler, cur_cont_vol_idx),
+                        args.vol_tex_scale, args.vol_tex_offset).x >= sur_coll_args.sur_coll_thresh)
       {
         // approximate the derivative at this point with finite differencing adjacent indices
         // NOTE: these are wrt image (index) axes.
+        //       The texture values may be used directly, since the gradient
+        //       is normalized and the texture scale is positive.
 
         float3 grad_vec;
 
-        // Gradient in X Direction:
-        grad_vec.x = read_imagef(vol_tex, sampler, (float4) (cur_cont_vol_idx.x + 1, cur_cont_vol_idx.y, cur_cont_vol_idx.z, cur_cont_vol_idx.w)).x -
-                     read_imagef(vol_tex, sampler, (float4) (cur_cont_vol_idx.x - 1, cur_cont_vol_idx.y, cur_cont_vol_idx.z, cur_cont_vol_idx.w)).x;
+        if (use_grad_tex)
+        {
+          // precomputed central differences, interpolated with a single fetch
+          const float4 g = read_imagef(grad_tex, sampler, cur_cont_vol_idx);
+
+          grad_vec = (float3) (g.x, g.y, g.z);
+        }
+        else
+        {
+          // Gradient in X Direction:
+          grad_vec.x = read_imagef(vol_tex, sampler, (float4) (cur_cont_vol_idx.x + 1, cur_cont_vol_idx.y, cur_cont_vol_idx.z, cur_cont_vol_idx.w)).x -
+                       read_imagef(vol_tex, sampler, (float4) (cur_cont_vol_idx.x - 1, cur_cont_vol_idx.y, cur_cont_vol_idx.z, cur_cont_vol_idx.w)).x;
 
-        // Gradient in Y Direction:
-        grad_vec.y = read_imagef(vol_tex, sampler, (float4) (cur_cont_vol_idx.x, cur_cont_vol_idx.y + 1, cur_cont_vol_idx.z, cur_cont_vol_idx.w)).x -
-                     read_imagef(vol_tex, sampler, (float4) (cur_cont_vol_idx.x, cur_cont_vol_idx.y - 1, cur_cont_vol_idx.z, cur_cont_vol_idx.w)).x;
+          // Gradient in Y Direction:
+          grad_vec.y = read_imagef(vol_tex, sampler, (float4) (cur_cont_vol_idx.x, cur_cont_vol_idx.y + 1, cur_cont_vol_idx.z, cur_cont_vol_idx.w)).x -
+                       read_imagef(vol_tex, sampler, (float4) (cur_cont_vol_idx.x, cur_cont_vol_idx.y - 1, cur_cont_vol_idx.z, cur_cont_vol_idx.w)).x;
 
-        // Gradient in Z Direction:
-        grad_vec.z = read_imagef(vol_tex, sampler, (float4) (cur_cont_vol_idx.x, cur_cont_vol_idx.y, cur_cont_vol_idx.z + 1, cur_cont_vol_idx.w)).x -
-                     read_imagef(vol_tex, sampler, (float4) (cur_cont_vol_idx.x, cur_cont_vol_idx.y, cur_cont_vol_idx.z - 1, cur_cont_vol_idx.w)).x;
+          // Gradient in Z Direction:
+          grad_vec.z = read_imagef(vol_tex, sampler, (float4) (cur_cont_vol_idx.x, cur_cont_vol_idx.y, cur_cont_vol_idx.z + 1, cur_cont_vol_idx.w)).x -
+                       read_imagef(vol_tex, sampler, (float4) (cur_cont_vol_idx.x, cur_cont_vol_idx.y, cur_cont_vol_idx.z - 1, cur_cont_vol_idx.w)).x;
+        }
 
         grad_vec /= xregFloat3Norm(grad_vec);
 
@@ -144,18 +168,86 @@ __kernel void xregOccludingContourKernel(const RayCastArgs args,
                      xregFloat3Normalize(xregFloat4HmgToFloat3(pinhole_to_det_wrt_itk_idx))))
                                             - 1.5707963267948966f) < sur_coll_args.occluding_ang_thresh_rad;
 
+        // the collision is at this fraction of the focal point to detector
+        // ray, which is identical in the camera and index frames
+        edge_depth = (t.x + (step_idx * scale_to_step)) * xregFloat4HmgNorm(focal_pt_to_det_wrt_cam);
+
         break;
       }
     }
 
     dst_contours_buf[idx] += is_edge ? 1 : 0;
+
+    if (is_edge && write_edge_depths)
+    {
+      dst_edge_depths[idx] = min(dst_edge_depths[idx], edge_depth);
+    }
   }  // if (idx < num_rays)
 }
 
+// Flags each pixel of the contour images that is an edge, the flag of the
+// extra element following the last pixel is always zero.
+__kernel void xregOccContourEdgeFlagsKernel(__global const float* contours_buf,
+                                            const ulong num_rays,
+                                            __global uint* edge_flags)
+{
+  const ulong idx = get_global_id(0);
+
+  if (idx < num_rays)
+  {
+    edge_flags[idx] = (contours_buf[idx] > 0) ? 1 : 0;
+  }
+}
+
+// Writes the index, within its projection, and depth of each edge pixel to
+// consecutive elements using the exclusive prefix sum of the edge flags.
+// The offset of each projection's edges is written by the projection's first
+// pixel and the total number of edges is written by the extra work item.
+__kernel void xregOccContourCompactEdgesKernel(__global const float* contours_buf,
+                                               __global const float* edge_depths,
+                                               __global const uint* edge_offsets,
+                                               const ulong num_rays,
+                                               const ulong num_det_pts,
+                                               __global uint* dst_edge_pix_inds,
+                                               __global float* dst_edge_depths,
+                                               __global uint* dst_proj_edge_offsets)
+{
+  const ulong idx = get_global_id(0);
+
+  if (idx <= num_rays)
+  {
+    const ulong proj_idx   = idx / num_det_pts;
+    const ulong det_pt_idx = idx - (proj_idx * num_det_pts);
+
+    if (!det_pt_idx)
+    {
+      dst_proj_edge_offsets[proj_idx] = edge_offsets[idx];
+    }
+
+    if ((idx < num_rays) && (contours_buf[idx] > 0))
+    {
+      const uint off = edge_offsets[idx];
+
+      dst_edge_pix_inds[off] = (uint) det_pt_idx;
+      dst_edge_depths[off]   = edge_depths[idx];
+    }
+  }
+}
+
 );
 
 //////////////////////////////////////////////////////////////////////
 
+void FillEdgeDepths(boost::compute::buffer& depths, const std::size_t num_rays,
+                    boost::compute::command_queue& queue)
+{
+  namespace bc = boost::compute;
+
+  bc::fill(bc::make_buffer_iterator<float>(depths, 0),
+           bc::make_buffer_iterator<float>(depths, num_rays),
+           static_cast<float>(xreg::kRAY_CAST_MAX_DEPTH), queue);
+}
+
 }  // un-named
 
 xreg::RayCasterOccludingContoursOCL::RayCasterOccludingContoursOCL(const boost::compute::device& dev)
@@ -170,6 +262,8 @@ xreg::RayCasterOccludingContoursOCL::RayCasterOccludingContoursOCL(const boost::
 
 void xreg::RayCasterOccludingContoursOCL::compute(const size_type vol_idx)
 {
+  namespace bc = boost::compute;
+
   xregASSERT(this->resources_allocated_);
 
   compute_helper_pre_kernels(vol_idx);
@@ -181,7 +275,7 @@ void xreg::RayCasterOccludingContoursOCL::compute(const size_type vol_idx)
   
   dev_kernel_.set_arg(1, sizeof(coll_args), &coll_args);
 
-  dev_kernel_.set_arg(2, det_pts_dev_);
+  dev_kernel_.set_arg(2, *det_pts_dev_);
 
   dev_kernel_.set_arg(3, vol_texs_dev_[vol_idx]);
 
@@ -195,16 +289,174 @@ void xreg::RayCasterOccludingContoursOCL::compute(const size_type vol_idx)
 
   std::size_t global_work_size = ray_cast_kernel_args_.num_det_pts * this->num_projs_;
 
-  cmd_queue_.enqueue_nd_range_kernel(dev_kernel_,
-                                     1, // dim
-                                     0, // null offset -> start at 0
-                                     &global_work_size,
-                                     0  // passing null lets open CL pick a local size
-                                    ).wait();
+  if (compute_edge_pixel_lists_)
+  {
+    alloc_edge_pixel_bufs();
+
+    if (this->proj_store_meth_ == kRAY_CAST_PIXEL_REPLACE)
+    {
+      FillEdgeDepths(edge_depths_dev_, global_work_size, cmd_queue_);
+    }
+
+    dev_kernel_.set_arg(8, edge_depths_dev_);
+  }
+  else
+  {
+    dev_kernel_.set_arg(8, dummy_edge_depths_dev_);
+  }
+
+  dev_kernel_.set_arg(9, bc::int_(compute_edge_pixel_lists_ ? 1 : 0));
+
+  dev_kernel_.set_arg(10, grad_tex(vol_idx));
+
+  dev_kernel_.set_arg(11, bc::int_(has_grad_tex(vol_idx) ? 1 : 0));
+
+  launch_ray_cast_kernel(dev_kernel_, "xregOccludingContourKernel", 5, global_work_size);
+
+  if (compute_edge_pixel_lists_)
+  {
+    compact_edge_pixels();
+  }
 
   compute_helper_post_kernels(vol_idx);
 }
 
+void xreg::RayCasterOccludingContoursOCL::set_compute_edge_pixel_lists(const bool compute_lists)
+{
+  compute_edge_pixel_lists_ = compute_lists;
+}
+
+bool xreg::RayCasterOccludingContoursOCL::compute_edge_pixel_lists() const
+{
+  return compute_edge_pixel_lists_;
+}
+
+const xreg::RayCasterOccludingContoursOCL::EdgePixelListList&
+xreg::RayCasterOccludingContoursOCL::edge_pixel_lists()
+{
+  namespace bc = boost::compute;
+
+  xregASSERT(compute_edge_pixel_lists_);
+
+  if (!edge_pixel_lists_synced_)
+  {
+    // the number of edges of every projection is read first, so that only
+    // the edges need to be transferred
+    const size_type num_projs = this->num_projs_;
+
+    std::vector<bc::uint_> proj_offsets(num_projs + 1);
+
+    cmd_queue_.enqueue_read_buffer(proj_edge_offsets_dev_, 0,
+                                   sizeof(bc::uint_) * (num_projs + 1), proj_offsets.data());
+
+    const size_type num_edges = proj_offsets[num_projs];
+
+    std::vector<bc::uint_> pix_inds(num_edges);
+    std::vector<float>     depths(num_edges);
+
+    if (num_edges)
+    {
+      cmd_queue_.enqueue_read_buffer(edge_pix_inds_dev_, 0,
+                                     sizeof(bc::uint_) * num_edges, pix_inds.data());
+      cmd_queue_.enqueue_read_buffer(edge_pix_depths_dev_, 0,
+                                     sizeof(float) * num_edges, depths.data());
+    }
+
+    edge_pixel_lists_.resize(num_projs);
+
+    for (size_type proj_idx = 0; proj_idx < num_projs; ++proj_idx)
+    {
+      const size_type num_cols = this->camera_models_[this->cam_model_for_proj_[proj_idx]].num_det_cols;
+
+      EdgePixelList& edges = edge_pixel_lists_[proj_idx];
+      edges.clear();
+      edges.reserve(proj_offsets[proj_idx + 1] - proj_offsets[proj_idx]);
+
+      for (size_type i = proj_offsets[proj_idx]; i < proj_offsets[proj_idx + 1]; ++i)
+      {
+        EdgePixel e;
+        e.row   = pix_inds[i] / num_cols;
+        e.col   = pix_inds[i] - (e.row * num_cols);
+        e.depth = depths[i];
+
+        edges.push_back(e);
+      }
+    }
+
+    edge_pixel_lists_synced_ = true;
+  }
+
+  return edge_pixel_lists_;
+}
+
+const xreg::RayCasterOccludingContoursOCL::EdgePixelList&
+xreg::RayCasterOccludingContoursOCL::edge_pixels(const size_type proj_idx)
+{
+  return edge_pixel_lists().at(proj_idx);
+}
+
+void xreg::RayCasterOccludingContoursOCL::alloc_edge_pixel_bufs()
+{
+  namespace bc = boost::compute;
+
+  const size_type num_rays = ray_cast_kernel_args_.num_det_pts * this->num_projs_;
+
+  if (edge_pixel_bufs_num_rays_ != num_rays)
+  {
+    edge_depths_dev_      = bc::buffer(ctx_, sizeof(float) * num_rays);
+    edge_pix_inds_dev_    = bc::buffer(ctx_, sizeof(bc::uint_) * num_rays);
+    edge_pix_depths_dev_  = bc::buffer(ctx_, sizeof(float) * num_rays);
+    edge_offsets_dev_     = bc::buffer(ctx_, sizeof(bc::uint_) * (num_rays + 1));
+    proj_edge_offsets_dev_ = bc::buffer(ctx_, sizeof(bc::uint_) * (this->num_projs_ + 1));
+
+    // the flag of the extra element is never written, so that the prefix
+    // sum stores the total number of edges in its last element
+    edge_flags_dev_ = bc::buffer(ctx_, sizeof(bc::uint_) * (num_rays + 1));
+
+    bc::fill(bc::make_buffer_iterator<bc::uint_>(edge_flags_dev_, 0),
+             bc::make_buffer_iterator<bc::uint_>(edge_flags_dev_, num_rays + 1),
+             bc::uint_(0), cmd_queue_);
+
+    // depths are combined with the existing values when projections are
+    // accumulated
+    FillEdgeDepths(edge_depths_dev_, num_rays, cmd_queue_);
+
+    edge_pixel_bufs_num_rays_ = num_rays;
+  }
+}
+
+void xreg::RayCasterOccludingContoursOCL::compact_edge_pixels()
+{
+  namespace bc = boost::compute;
+
+  const std::size_t num_rays = edge_pixel_bufs_num_rays_;
+
+  edge_flags_kernel_.set_arg(0, *proj_pixels_dev_to_use_);
+  edge_flags_kernel_.set_arg(1, bc::ulong_(num_rays));
+  edge_flags_kernel_.set_arg(2, edge_flags_dev_);
+
+  cmd_queue_.enqueue_1d_range_kernel(edge_flags_kernel_, 0, num_rays, 0);
+
+  bc::exclusive_scan(bc::make_buffer_iterator<bc::uint_>(edge_flags_dev_, 0),
+                     bc::make_buffer_iterator<bc::uint_>(edge_flags_dev_, num_rays + 1),
+                     bc::make_buffer_iterator<bc::uint_>(edge_offsets_dev_, 0),
+                     cmd_queue_);
+
+  compact_edges_kernel_.set_arg(0, *proj_pixels_dev_to_use_);
+  compact_edges_kernel_.set_arg(1, edge_depths_dev_);
+  compact_edges_kernel_.set_arg(2, edge_offsets_dev_);
+  compact_edges_kernel_.set_arg(3, bc::ulong_(num_rays));
+  compact_edges_kernel_.set_arg(4, bc::ulong_(ray_cast_kernel_args_.num_det_pts));
+  compact_edges_kernel_.set_arg(5, edge_pix_inds_dev_);
+  compact_edges_kernel_.set_arg(6, edge_pix_depths_dev_);
+  compact_edges_kernel_.set_arg(7, proj_edge_offsets_dev_);
+
+  finish_kernel_launch(cmd_queue_.enqueue_1d_range_kernel(compact_edges_kernel_, 0, num_rays + 1, 0),
+                       "xregOccContourCompactEdgesKernel");
+
+  edge_pixel_lists_synced_ = false;
+}
+
 void xreg::RayCasterOccludingContoursOCL::allocate_resources()
 {
   namespace bc = boost::compute;
@@ -227,19 +479,18 @@ void xreg::RayCasterOccludingContoursOCL::allocate_resources()
      << boost::compute::type_definition<ContourSurCollArgs>()
      << kRAY_CASTING_OCCLUDING_CONTOUR_OPENCL_SRC;
 
-  bc::program prog = bc::program::create_with_source(ss.str(), ctx_);
-
-  try
-  {
-    prog.build();
-  }
-  catch (bc::opencl_error &)
-  {
-    std::cerr << "OpenCL Kernel Compile Error (RayCasterOccludingContoursOCL):\n"
-              << prog.build_log() << std::endl;
-    throw;
-  }
+  bc::program prog = BuildOpenCLProg(ss.str(), ctx_);
 
   dev_kernel_ = prog.create_kernel("xregOccludingContourKernel");
+
+  edge_flags_kernel_ = prog.create_kernel("xregOccContourEdgeFlagsKernel");
+
+  compact_edges_kernel_ = prog.create_kernel("xregOccContourCompactEdgesKernel");
+
+  // the kernel requires a valid buffer for the edge depths, even when they
+  // are not written
+  dummy_edge_depths_dev_ = bc::buffer(ctx_, sizeof(float));
+
+  edge_pixel_bufs_num_rays_ = 0;
 }
 
@@ -30,9 +30,28 @@
 namespace xreg
 {
 
+/// \brief Computes occluding contour images, an edge pixel has a non-zero
+///        value.
+///
+/// The edge pixels may also be compacted into lists of coordinates on the
+/// device, so that consumers only transfer and iterate over the edges.
 class RayCasterOccludingContoursOCL : public RayCasterOCL, public RayCasterOccludingContours
 {
 public:
+  /// \brief An edge pixel of an occluding contour image
+  struct EdgePixel
+  {
+    size_type row;
+    size_type col;
+
+    /// \brief Distance from the focal point to the surface collision,
+    ///        the minimum distance when several volumes are accumulated
+    CoordScalar depth;
+  };
+
+  using EdgePixelList     = std::vector<EdgePixel>;
+  using EdgePixelListList = std::vector<EdgePixelList>;
+
   /// \brief Default constructor, chooses a default device, creates a new
   ///        context and command queue.
   RayCasterOccludingContoursOCL() = default;
@@ -54,8 +73,60 @@ public:
   /// needs to create the device kernel.
   void allocate_resources();
 
+  /// \brief Indicates that each call to compute() should also compact the
+  ///        edge pixels of every projection into lists on the device.
+  ///
+  /// This is disabled by default.
+  void set_compute_edge_pixel_lists(const bool compute_lists);
+
+  bool compute_edge_pixel_lists() const;
+
+  /// \brief The edge pixels of every projection, in row-major order.
+  ///
+  /// Only the edge pixels are transferred from the device, the first time
+  /// this is called following compute().
+  const EdgePixelListList& edge_pixel_lists();
+
+  /// \brief The edge pixels of a single projection, see edge_pixel_lists().
+  const EdgePixelList& edge_pixels(const size_type proj_idx);
+
 private:
+  void alloc_edge_pixel_bufs();
+
+  /// \brief Computes the prefix sum of edge flags and writes the edges of
+  ///        each projection to consecutive elements.
+  void compact_edge_pixels();
+
   boost::compute::kernel dev_kernel_;
+
+  boost::compute::kernel edge_flags_kernel_;
+
+  boost::compute::kernel compact_edges_kernel_;
+
+  bool compute_edge_pixel_lists_ = false;
+
+  bool edge_pixel_lists_synced_ = false;
+
+  size_type edge_pixel_bufs_num_rays_ = 0;
+
+  /// \brief The depth of each edge pixel in the contour images
+  boost::compute::buffer edge_depths_dev_;
+
+  boost::compute::buffer dummy_edge_depths_dev_;
+
+  boost::compute::buffer edge_flags_dev_;
+
+  /// \brief Exclusive prefix sum of the edge flags, the destination of each
+  ///        edge in the compacted lists
+  boost::compute::buffer edge_offsets_dev_;
+
+  boost::compute::buffer edge_pix_inds_dev_;
+
+  boost::compute::buffer edge_pix_depths_dev_;
+
+  boost::compute::buffer proj_edge_offsets_dev_;
+
+  EdgePixelListList edge_pixel_lists_;
 };
 
 }  // xreg
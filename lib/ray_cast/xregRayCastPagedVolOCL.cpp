@@ -0,0 +1,464 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregRayCastPagedVolOCL.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "xregAssert.h"
+#include "xregExceptionUtils.h"
+#include "xregTBBUtils.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+/// \brief The projection of the continuous indices of a volume onto the
+///        detector of a single projection.
+struct PagedVolProjSetup
+{
+  Mat3x4 itk_idx_to_det_ind;
+
+  /// \brief The sign of the homogeneous coordinate for points on the same
+  ///        side of the source as the detector
+  CoordScalar det_w;
+
+  CoordScalar num_cols;
+  CoordScalar num_rows;
+};
+
+/// \brief Indicates that a region of continuous indices may be intersected
+///        by a ray of a projection.
+///
+/// The region is conservatively visible when it is not entirely in front of
+/// the source, otherwise the bounding box of the projected corners is tested
+/// for overlap with the detector, padded by one pixel.
+bool PagedVolRegionIsVisible(const Pt3& idx_min, const Pt3& idx_max, const PagedVolProjSetup& proj)
+{
+  CoordScalar min_c = std::numeric_limits<CoordScalar>::max();
+  CoordScalar min_r = std::numeric_limits<CoordScalar>::max();
+  CoordScalar max_c = std::numeric_limits<CoordScalar>::lowest();
+  CoordScalar max_r = std::numeric_limits<CoordScalar>::lowest();
+
+  for (int corner_idx = 0; corner_idx < 8; ++corner_idx)
+  {
+    Pt4 corner;
+    
+    for (int d = 0; d < 3; ++d)
+    {
+      corner[d] = (corner_idx & (1 << d)) ? idx_max[d] : idx_min[d];
+    }
+
+    corner[3] = 1;
+
+    const Pt3 h = proj.itk_idx_to_det_ind * corner;
+
+    if ((h[2] / proj.det_w) < CoordScalar(1.0e-6))
+    {
+      return true;
+    }
+
+    const CoordScalar c = h[0] / h[2];
+    const CoordScalar r = h[1] / h[2];
+
+    min_c = std::min(min_c, c);
+    max_c = std::max(max_c, c);
+    min_r = std::min(min_r, r);
+    max_r = std::max(max_r, r);
+  }
+
+  return (max_c >= -1) && (max_r >= -1) && (min_c <= proj.num_cols) && (min_r <= proj.num_rows);
+}
+
+}  // un-named
+
+xreg::RayCastPagedVolOCL::RayCastPagedVolOCL(const boost::compute::context& ctx,
+                                             const Vol* vol,
+                                             const RayCastVolBrickGrid* brick_grid,
+                                             const size_type max_num_resident_bricks,
+                                             const VolTexFormat vol_tex_fmt,
+                                             boost::compute::command_queue& queue)
+  : vol_(vol), brick_grid_(brick_grid), vol_tex_fmt_(vol_tex_fmt),
+    page_table_dev_(ctx), brick_skip_dev_(ctx)
+{
+  namespace bc = boost::compute;
+
+  xregASSERT(brick_grid_->valid());
+  xregASSERT(max_num_resident_bricks > 0);
+
+  if ((vol_tex_fmt_ != RayCasterOCL::kRAY_CAST_VOL_TEX_FLOAT32) &&
+      (vol_tex_fmt_ != RayCasterOCL::kRAY_CAST_VOL_TEX_HALF))
+  {
+    xregThrow("Paged volumes only support single and half precision textures!");
+  }
+
+  // each slot stores the voxels of a brick along with the first voxel of the
+  // next brick in each dimension
+  slot_dim_ = brick_grid_->brick_dim + 1;
+
+  const bc::device dev = ctx.get_device();
+
+  const std::int64_t max_slots_x = dev.get_info<std::size_t>(CL_DEVICE_IMAGE3D_MAX_WIDTH)  / slot_dim_;
+  const std::int64_t max_slots_y = dev.get_info<std::size_t>(CL_DEVICE_IMAGE3D_MAX_HEIGHT) / slot_dim_;
+  const std::int64_t max_slots_z = dev.get_info<std::size_t>(CL_DEVICE_IMAGE3D_MAX_DEPTH)  / slot_dim_;
+
+  // there is no use in storing more bricks than the volume has
+  const std::int64_t num_slots = std::min(static_cast<std::int64_t>(max_num_resident_bricks),
+                                          brick_grid_->num_bricks());
+
+  num_slots_x_ = static_cast<std::int32_t>(std::min(num_slots, max_slots_x));
+  
+  num_slots_y_ = static_cast<std::int32_t>(std::min((num_slots + num_slots_x_ - 1) / num_slots_x_,
+                                                    max_slots_y));
+
+  const std::int64_t num_slots_xy = static_cast<std::int64_t>(num_slots_x_) * num_slots_y_;
+
+  num_slots_z_ = static_cast<std::int32_t>((num_slots + num_slots_xy - 1) / num_slots_xy);
+
+  if (num_slots_z_ > max_slots_z)
+  {
+    xregThrow("Paged volume atlas of %lld bricks exceeds the device texture dimensions!",
+              static_cast<long long>(num_slots));
+  }
+
+  const bool use_half = vol_tex_fmt_ == RayCasterOCL::kRAY_CAST_VOL_TEX_HALF;
+
+  atlas_tex_ = bc::image3d(ctx, num_slots_x_ * slot_dim_, num_slots_y_ * slot_dim_,
+                           num_slots_z_ * slot_dim_,
+                           bc::image_format(bc::image_format::intensity,
+                                            use_half ? bc::image_format::float16 :
+                                                       bc::image_format::float32),
+                           bc::image3d::read_only);
+
+  const size_type tot_num_slots = this->max_num_resident_bricks();
+
+  const size_type slot_num_vox = static_cast<size_type>(slot_dim_) * slot_dim_ * slot_dim_;
+
+  dev_mem_.set_bytes(tot_num_slots * slot_num_vox * (use_half ? sizeof(std::uint16_t) : sizeof(float)));
+
+  const size_type num_bricks = static_cast<size_type>(brick_grid_->num_bricks());
+
+  brick_slots_.assign(num_bricks, -1);
+
+  slot_bricks_.assign(tot_num_slots, -1);
+  
+  slot_last_use_.assign(tot_num_slots, -1);
+
+  // no bricks are resident, so every brick is skipped
+  page_table_dev_ = PageTableDev(num_bricks, ctx);
+  bc::copy(brick_slots_.begin(), brick_slots_.end(), page_table_dev_.begin(), queue);
+
+  const BrickFlagList brick_skip(num_bricks, 1);
+
+  brick_skip_dev_ = BrickFlagListDev(num_bricks, ctx);
+  bc::copy(brick_skip.begin(), brick_skip.end(), brick_skip_dev_.begin(), queue);
+}
+
+xreg::size_type
+xreg::RayCastPagedVolOCL::update_resident_bricks(const CameraModelList& cams,
+                                                 const CamModelAssocList& cam_model_for_proj,
+                                                 const FrameTransformList& xforms_cam_to_itk_phys,
+                                                 const FrameTransform& itk_phys_pt_to_itk_idx_xform,
+                                                 boost::compute::command_queue& queue)
+{
+  namespace bc = boost::compute;
+
+  ++update_count_;
+
+  const size_type num_projs = xforms_cam_to_itk_phys.size();
+
+  xregASSERT(cam_model_for_proj.size() >= num_projs);
+
+  std::vector<PagedVolProjSetup> proj_setups;
+  proj_setups.reserve(num_projs);
+
+  for (size_type proj_idx = 0; proj_idx < num_projs; ++proj_idx)
+  {
+    const CameraModel& cam = cams[cam_model_for_proj[proj_idx]];
+
+    const Mat3x4 proj_mat = cam.phys_to_ind_proj_mat();
+
+    const FrameTransform xform_itk_idx_to_cam = (itk_phys_pt_to_itk_idx_xform *
+                                                 xforms_cam_to_itk_phys[proj_idx]).inverse();
+
+    proj_setups.push_back({ proj_mat * xform_itk_idx_to_cam.matrix(),
+                            (proj_mat * cam.ind_pt_to_phys_det_pt(Pt2(0,0)).homogeneous())[2],
+                            static_cast<CoordScalar>(cam.num_det_cols),
+                            static_cast<CoordScalar>(cam.num_det_rows) });
+  }
+
+  // find the non-empty bricks required by any projection
+
+  const RayCastVolBrickGrid& grid = *brick_grid_;
+
+  const size_type num_bricks = static_cast<size_type>(grid.num_bricks());
+
+  const auto vol_size = vol_->GetLargestPossibleRegion().GetSize();
+
+  BrickFlagList brick_required(num_bricks, 0);
+
+  auto required_fn = [&] (const RangeType& r)
+  {
+    for (size_type b = r.begin(); b < r.end(); ++b)
+    {
+      if (!grid.brick_empty[b])
+      {
+        const std::int64_t brick_inds[3] = { static_cast<std::int64_t>(b % grid.num_bricks_x),
+                                             static_cast<std::int64_t>((b / grid.num_bricks_x) % grid.num_bricks_y),
+                                             static_cast<std::int64_t>(b / (static_cast<size_type>(grid.num_bricks_x) *
+                                                                                               grid.num_bricks_y)) };
+
+        // the bounds of the voxels stored for this brick
+        Pt3 idx_min;
+        Pt3 idx_max;
+
+        for (int d = 0; d < 3; ++d)
+        {
+          const std::int64_t start_vox = brick_inds[d] * grid.brick_dim;
+          
+          idx_min[d] = static_cast<CoordScalar>(start_vox) - CoordScalar(0.5);
+          idx_max[d] = static_cast<CoordScalar>(std::min(start_vox + grid.brick_dim,
+                                                         static_cast<std::int64_t>(vol_size[d]) - 1))
+                                                                                      + CoordScalar(0.5);
+        }
+
+        for (const auto& proj_setup : proj_setups)
+        {
+          if (PagedVolRegionIsVisible(idx_min, idx_max, proj_setup))
+          {
+            brick_required[b] = 1;
+            break;
+          }
+        }
+      }
+    }
+  };
+
+  ParallelFor(required_fn, RangeType(0, num_bricks));
+
+  const size_type num_required = std::count(brick_required.begin(), brick_required.end(), 1);
+
+  const size_type tot_num_slots = max_num_resident_bricks();
+
+  if (num_required > tot_num_slots)
+  {
+    xregThrow("Paged volume requires %lu bricks, but only %lu may be resident!",
+              static_cast<unsigned long>(num_required), static_cast<unsigned long>(tot_num_slots));
+  }
+
+  // bricks already resident are kept, the others are uploaded
+
+  std::vector<std::int32_t> bricks_to_upload;
+
+  for (size_type b = 0; b < num_bricks; ++b)
+  {
+    if (brick_required[b])
+    {
+      const std::int32_t slot = brick_slots_[b];
+
+      if (slot >= 0)
+      {
+        slot_last_use_[slot] = update_count_;
+      }
+      else
+      {
+        bricks_to_upload.push_back(static_cast<std::int32_t>(b));
+      }
+    }
+  }
+
+  const size_type num_to_upload = bricks_to_upload.size();
+
+  if (num_to_upload)
+  {
+    // the slots that are free or store bricks which are not required, the
+    // least recently used first (free slots have a last use of -1)
+    std::vector<std::int32_t> avail_slots;
+    avail_slots.reserve(tot_num_slots);
+
+    for (size_type s = 0; s < tot_num_slots; ++s)
+    {
+      if (slot_last_use_[s] != update_count_)
+      {
+        avail_slots.push_back(static_cast<std::int32_t>(s));
+      }
+    }
+
+    xregASSERT(avail_slots.size() >= num_to_upload);
+
+    std::stable_sort(avail_slots.begin(), avail_slots.end(),
+                     [this] (const std::int32_t s1, const std::int32_t s2)
+                     {
+                       return slot_last_use_[s1] < slot_last_use_[s2];
+                     });
+
+    std::vector<std::int32_t> upload_slots(avail_slots.begin(), avail_slots.begin() + num_to_upload);
+
+    for (size_type i = 0; i < num_to_upload; ++i)
+    {
+      const std::int32_t slot  = upload_slots[i];
+      const std::int32_t brick = bricks_to_upload[i];
+
+      if (slot_bricks_[slot] >= 0)
+      {
+        // evict
+        brick_slots_[slot_bricks_[slot]] = -1;
+      }
+      else
+      {
+        ++num_resident_;
+      }
+
+      slot_bricks_[slot]   = brick;
+      brick_slots_[brick]  = slot;
+      slot_last_use_[slot] = update_count_;
+    }
+
+    // gather the voxels of each brick, with the voxels beyond the volume
+    // clamped to the edge
+
+    const size_type slot_num_vox = static_cast<size_type>(slot_dim_) * slot_dim_ * slot_dim_;
+
+    const bool use_half = vol_tex_fmt_ == RayCasterOCL::kRAY_CAST_VOL_TEX_HALF;
+
+    std::vector<float> staging_buf(use_half ? 0 : (num_to_upload * slot_num_vox));
+    std::vector<std::uint16_t> half_staging_buf(use_half ? (num_to_upload * slot_num_vox) : 0);
+
+    const RayCastPixelScalar* vol_buf = vol_->GetBufferPointer();
+
+    const std::int64_t slot_dim = slot_dim_;
+
+    auto gather_fn = [&] (const RangeType& r)
+    {
+      for (size_type i = r.begin(); i < r.end(); ++i)
+      {
+        const std::int64_t b = bricks_to_upload[i];
+
+        const std::int64_t start_vox[3] = { (b % grid.num_bricks_x) * grid.brick_dim,
+                                            ((b / grid.num_bricks_x) % grid.num_bricks_y) * grid.brick_dim,
+                                            (b / (static_cast<std::int64_t>(grid.num_bricks_x) *
+                                                                            grid.num_bricks_y)) * grid.brick_dim };
+
+        const size_type dst_off = i * slot_num_vox;
+
+        size_type dst_idx = 0;
+
+        for (std::int64_t z = 0; z < slot_dim; ++z)
+        {
+          const size_type src_z = std::min(static_cast<size_type>(start_vox[2] + z), vol_size[2] - 1);
+
+          for (std::int64_t y = 0; y < slot_dim; ++y)
+          {
+            const size_type src_y = std::min(static_cast<size_type>(start_vox[1] + y), vol_size[1] - 1);
+
+            const size_type src_row_off = vol_size[0] * (src_y + (vol_size[1] * src_z));
+
+            for (std::int64_t x = 0; x < slot_dim; ++x, ++dst_idx)
+            {
+              const size_type src_x = std::min(static_cast<size_type>(start_vox[0] + x), vol_size[0] - 1);
+
+              const float v = vol_buf[src_row_off + src_x];
+
+              if (use_half)
+              {
+                half_staging_buf[dst_off + dst_idx] = RayCastFloatToHalf(v);
+              }
+              else
+              {
+                staging_buf[dst_off + dst_idx] = v;
+              }
+            }
+          }
+        }
+      }
+    };
+
+    ParallelFor(gather_fn, RangeType(0, num_to_upload));
+
+    const std::size_t region[3] = { static_cast<std::size_t>(slot_dim_),
+                                    static_cast<std::size_t>(slot_dim_),
+                                    static_cast<std::size_t>(slot_dim_) };
+
+    for (size_type i = 0; i < num_to_upload; ++i)
+    {
+      const std::int32_t slot = upload_slots[i];
+
+      const std::size_t origin[3] = { static_cast<std::size_t>((slot % num_slots_x_) * slot_dim_),
+                                      static_cast<std::size_t>(((slot / num_slots_x_) % num_slots_y_) * slot_dim_),
+                                      static_cast<std::size_t>((slot / (num_slots_x_ * num_slots_y_)) * slot_dim_) };
+
+      const void* src = use_half ? static_cast<const void*>(&half_staging_buf[i * slot_num_vox]) :
+                                   static_cast<const void*>(&staging_buf[i * slot_num_vox]);
+
+      queue.enqueue_write_image(atlas_tex_, origin, region, src);
+    }
+  }
+
+  // update the page table and the bricks that rays skip
+
+  BrickFlagList brick_skip(num_bricks);
+
+  for (size_type b = 0; b < num_bricks; ++b)
+  {
+    brick_skip[b] = (grid.brick_empty[b] || (brick_slots_[b] < 0)) ? 1 : 0;
+  }
+
+  bc::copy(brick_slots_.begin(), brick_slots_.end(), page_table_dev_.begin(), queue);
+
+  bc::copy(brick_skip.begin(), brick_skip.end(), brick_skip_dev_.begin(), queue);
+
+  return num_to_upload;
+}
+
+const boost::compute::image3d& xreg::RayCastPagedVolOCL::atlas_tex() const
+{
+  return atlas_tex_;
+}
+
+const xreg::RayCastPagedVolOCL::PageTableDev& xreg::RayCastPagedVolOCL::page_table() const
+{
+  return page_table_dev_;
+}
+
+const xreg::RayCastPagedVolOCL::BrickFlagListDev& xreg::RayCastPagedVolOCL::brick_skip() const
+{
+  return brick_skip_dev_;
+}
+
+boost::compute::int4_ xreg::RayCastPagedVolOCL::atlas_layout() const
+{
+  return boost::compute::int4_(num_slots_x_, num_slots_y_, num_slots_z_, slot_dim_);
+}
+
+xreg::size_type xreg::RayCastPagedVolOCL::max_num_resident_bricks() const
+{
+  return static_cast<size_type>(num_slots_x_) * num_slots_y_ * num_slots_z_;
+}
+
+xreg::size_type xreg::RayCastPagedVolOCL::num_resident_bricks() const
+{
+  return num_resident_;
+}
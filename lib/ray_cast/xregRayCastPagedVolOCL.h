@@ -0,0 +1,145 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGRAYCASTPAGEDVOLOCL_H_
+#define XREGRAYCASTPAGEDVOLOCL_H_
+
+#include "xregRayCastBaseOCL.h"
+#include "xregRayCastEmptySpace.h"
+
+namespace xreg
+{
+
+/// \brief A volume resident on an OpenCL device as a subset of its bricks.
+///
+/// Volumes that are too large to store in a single device texture are paged
+/// into a fixed size "atlas" texture, one brick per slot, using the bricks of
+/// a RayCastVolBrickGrid. Each slot stores the voxels [i*B, (i+1)*B] of a brick
+/// (inclusive, edge clamped at the volume bounds), so that linear
+/// interpolation within a brick never requires a neighboring brick. A page
+/// table maps each brick to its slot, or to -1 when the brick is not resident.
+///
+/// Prior to ray casting, the bricks that may be intersected by the rays of
+/// each projection are made resident. Empty bricks are never uploaded. When
+/// the atlas is full, the least recently used bricks that are not required
+/// are evicted.
+class RayCastPagedVolOCL
+{
+public:
+  using Vol               = RayCasterOCL::Vol;
+  using VolTexFormat      = RayCasterOCL::VolTexFormat;
+  using CameraModelList   = RayCaster::CameraModelList;
+  using CamModelAssocList = RayCaster::CamModelAssocList;
+
+  using PageTableDev = boost::compute::vector<boost::compute::int_>;
+  using BrickFlagListDev = boost::compute::vector<boost::compute::uchar_>;
+
+  /// \brief Creates an (empty) atlas able to store up to max_num_resident_bricks
+  ///        bricks of a volume.
+  ///
+  /// The volume and brick grid must remain valid for the lifetime of this
+  /// object. Only single precision and half precision textures are supported.
+  /// The number of slots may be rounded up to fill the atlas layout, see
+  /// max_num_resident_bricks().
+  RayCastPagedVolOCL(const boost::compute::context& ctx,
+                     const Vol* vol,
+                     const RayCastVolBrickGrid* brick_grid,
+                     const size_type max_num_resident_bricks,
+                     const VolTexFormat vol_tex_fmt,
+                     boost::compute::command_queue& queue);
+
+  /// \brief Makes resident every non-empty brick that may be intersected by
+  ///        the rays of any projection.
+  ///
+  /// A brick is required when the projection of its bounds overlaps the
+  /// detector of a projection, or when it is not entirely in front of the
+  /// source. Throws when the required bricks exceed the capacity of the
+  /// atlas. Returns the number of bricks uploaded.
+  size_type update_resident_bricks(const CameraModelList& cams,
+                                   const CamModelAssocList& cam_model_for_proj,
+                                   const FrameTransformList& xforms_cam_to_itk_phys,
+                                   const FrameTransform& itk_phys_pt_to_itk_idx_xform,
+                                   boost::compute::command_queue& queue);
+
+  /// \brief The texture storing a resident brick in each slot
+  const boost::compute::image3d& atlas_tex() const;
+
+  /// \brief The slot of each brick, or -1 when a brick is not resident,
+  ///        x varies fastest.
+  const PageTableDev& page_table() const;
+
+  /// \brief 1 for each brick that is empty or not resident, so that rays may
+  ///        skip it, x varies fastest.
+  const BrickFlagListDev& brick_skip() const;
+
+  /// \brief The number of slots along each dimension of the atlas in x,y,z
+  ///        and the side length, in voxels, of each slot in w.
+  boost::compute::int4_ atlas_layout() const;
+
+  size_type max_num_resident_bricks() const;
+
+  size_type num_resident_bricks() const;
+
+private:
+  using BrickSlotList = std::vector<std::int32_t>;
+
+  using BrickFlagList = RayCastVolBrickGrid::EmptyFlagList;
+
+  const Vol* vol_;
+
+  const RayCastVolBrickGrid* brick_grid_;
+
+  VolTexFormat vol_tex_fmt_;
+
+  std::int32_t slot_dim_;
+
+  std::int32_t num_slots_x_;
+  std::int32_t num_slots_y_;
+  std::int32_t num_slots_z_;
+
+  boost::compute::image3d atlas_tex_;
+
+  /// \brief The slot of each brick, or -1 when not resident
+  BrickSlotList brick_slots_;
+
+  /// \brief The brick stored in each slot, or -1 when a slot is free
+  BrickSlotList slot_bricks_;
+
+  /// \brief The update in which each slot was last required
+  std::vector<std::int64_t> slot_last_use_;
+
+  std::int64_t update_count_ = 0;
+
+  size_type num_resident_ = 0;
+
+  PageTableDev page_table_dev_;
+
+  BrickFlagListDev brick_skip_dev_;
+
+  TrackedMemAlloc dev_mem_ = TrackedMemAlloc(MemLocation::kDEVICE, "ray-cast-paged-vol-atlas");
+};
+
+}  // xreg
+
+#endif
@@ -26,16 +26,114 @@
 
 #include "xregExceptionUtils.h"
 #include "xregProgOptUtils.h"
+#include "xregStringUtils.h"
 #include "xregRayCastLineIntCPU.h"
 #include "xregRayCastLineIntOCL.h"
 #include "xregRayCastDepthCPU.h"
 #include "xregRayCastDepthOCL.h"
+#include "xregRayCastMultiDevOCL.h"
 
 namespace  // un-named
 {
 
 using namespace xreg;
 
+/// \brief Sets the NUMA nodes that the CPU line integral ray caster
+///        distributes its projections among.
+void CPUNUMANodesFromProgOpts(RayCasterLineIntCPU* rc_cpu, ProgOpts& po)
+{
+  if (po.has("ray-cast-numa-nodes"))
+  {
+    const std::string nodes_str = po.get("ray-cast-numa-nodes");
+
+    if (!nodes_str.empty())
+    {
+      rc_cpu->set_numa_nodes(StringCast<int>(StringSplit(nodes_str, ",")));
+    }
+  }
+}
+
+/// \brief The other CPU ray casters do not distribute among NUMA nodes.
+void CPUNUMANodesFromProgOpts(RayCasterCPU*, ProgOpts&)
+{ }
+
+template <class tRayCasterCPU>
+std::shared_ptr<tRayCasterCPU>
+CPURayCasterFromProgOptsHelper(ProgOpts& po)
+{
+  auto rc_cpu = std::make_shared<tRayCasterCPU>();
+
+  if (po.has("ray-cast-huge-pages"))
+  {
+    rc_cpu->set_use_huge_pages(po.get("ray-cast-huge-pages").as_bool());
+  }
+
+  CPUNUMANodesFromProgOpts(rc_cpu.get(), po);
+
+  if (po.has("ray-cast-aa-fact"))
+  {
+    rc_cpu->set_anti_alias_factor(po.get("ray-cast-aa-fact").as_uint32());
+  }
+
+  if (po.has("ray-cast-aa-sampler"))
+  {
+    const std::string sampler_str = po.get("ray-cast-aa-sampler");
+
+    if (sampler_str == "random")
+    {
+      rc_cpu->set_anti_alias_sampler(RayCasterCPU::kRAY_CAST_AA_SAMPLER_RANDOM);
+    }
+    else if (sampler_str == "stratified")
+    {
+      rc_cpu->set_anti_alias_sampler(RayCasterCPU::kRAY_CAST_AA_SAMPLER_STRATIFIED);
+    }
+    else if (sampler_str == "sobol")
+    {
+      rc_cpu->set_anti_alias_sampler(RayCasterCPU::kRAY_CAST_AA_SAMPLER_SOBOL);
+    }
+    else
+    {
+      xregThrow("Unsupported anti-aliasing sampler: %s", sampler_str.c_str());
+    }
+  }
+
+  return rc_cpu;
+}
+
+/// \brief Sets the anti-aliased rays of the OpenCL line integral ray caster.
+///
+/// Fixed offsets are always used on the device, so stratified offsets are used
+/// in place of random jitter.
+void OCLAntiAliasFromProgOpts(RayCasterLineIntOCL* rc_ocl, ProgOpts& po)
+{
+  if (po.has("ray-cast-aa-fact"))
+  {
+    const size_type aa_fact = po.get("ray-cast-aa-fact").as_uint32();
+
+    if (po.has("ray-cast-aa-sampler") &&
+        (po.get("ray-cast-aa-sampler").as_string() == "sobol"))
+    {
+      Pt2List offsets = RayCastSobolPts2D(aa_fact);
+
+      // center the offsets on the pixel
+      for (auto& off : offsets)
+      {
+        off.array() -= CoordScalar(0.5);
+      }
+
+      rc_ocl->set_anti_alias_offsets(offsets);
+    }
+    else
+    {
+      rc_ocl->set_anti_alias_factor(aa_fact);
+    }
+  }
+}
+
+/// \brief The other OpenCL ray casters do not support anti-aliasing.
+void OCLAntiAliasFromProgOpts(RayCasterOCL*, ProgOpts&)
+{ }
+
 template <class tRayCasterCPU, class tRayCasterOCL>
 std::shared_ptr<RayCaster>
 RayCasterFromProgOptsHelper(ProgOpts& po)
@@ -46,12 +144,30 @@ RayCasterFromProgOptsHelper(ProgOpts& po)
 
   if (backend_str == "cpu")
   {
-    rc = std::make_shared<tRayCasterCPU>();
+    rc = CPURayCasterFromProgOptsHelper<tRayCasterCPU>(po);
   }
   else if (backend_str == "ocl")
   {
     auto ocl_ctx_queue = po.selected_ocl_ctx_queue();
-    rc = std::make_shared<tRayCasterOCL>(std::get<0>(ocl_ctx_queue), std::get<1>(ocl_ctx_queue));
+
+    auto rc_ocl = std::make_shared<tRayCasterOCL>(std::get<0>(ocl_ctx_queue), std::get<1>(ocl_ctx_queue));
+
+    OCLAntiAliasFromProgOpts(rc_ocl.get(), po);
+
+    if (po.has("ray-cast-use-host") && po.get("ray-cast-use-host").as_bool())
+    {
+      // split each batch of projections between the device and the host
+      auto rc_hybrid = std::make_shared<RayCasterMultiDevOCL>(
+                                    RayCasterMultiDevOCL::RayCasterOCLList(1, rc_ocl));
+
+      rc_hybrid->set_host_ray_caster(CPURayCasterFromProgOptsHelper<tRayCasterCPU>(po));
+
+      rc = rc_hybrid;
+    }
+    else
+    {
+      rc = rc_ocl;
+    }
   }
   else
   {
@@ -63,6 +179,52 @@ RayCasterFromProgOptsHelper(ProgOpts& po)
 
 }  // un-named
 
+void xreg::AddRayCastAntiAliasProgOpts(ProgOpts& po)
+{
+  po.add("ray-cast-aa-fact", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_UINT32,
+         "ray-cast-aa-fact",
+         "The number of rays cast per pixel for anti-aliasing by the CPU ray casters and "
+         "the OpenCL line integral ray caster. Zero disables anti-aliasing.")
+    << ProgOpts::uint32(0);
+
+  po.add("ray-cast-aa-sampler", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING,
+         "ray-cast-aa-sampler",
+         "The method used to jitter anti-aliased rays by the CPU ray casters. "
+         "\"random\" draws new jitter for every ray, while \"stratified\" and \"sobol\" "
+         "use a fixed table of stratified or Sobol offsets for every pixel, which is faster "
+         "and reproducible. The OpenCL line integral ray caster always uses a fixed table, "
+         "with stratified offsets in place of random jitter.")
+    << "random";
+}
+
+void xreg::AddRayCastUseHostProgOpts(ProgOpts& po)
+{
+  po.add("ray-cast-use-host", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_TRUE,
+         "ray-cast-use-host",
+         "When using the OpenCL backend, also compute a share of each batch of projections "
+         "on the host CPU, concurrently with the device. The share is proportional to the "
+         "measured throughput of the host and device.")
+    << false;
+}
+
+void xreg::AddRayCastHostMemProgOpts(ProgOpts& po)
+{
+  po.add("ray-cast-numa-nodes", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_STRING,
+         "ray-cast-numa-nodes",
+         "Comma separated list of NUMA nodes that the CPU line integral ray caster "
+         "distributes its projections among, e.g. \"0,1\". A copy of each volume is "
+         "made on every node and the projections assigned to a node are cast by its "
+         "threads. This requires a version of TBB supporting task arena constraints. "
+         "An empty list does not distribute the projections.")
+    << "";
+
+  po.add("ray-cast-huge-pages", ProgOpts::kNO_SHORT_FLAG, ProgOpts::kSTORE_TRUE,
+         "ray-cast-huge-pages",
+         "Back the volume copies and projection buffers of the CPU ray casters with "
+         "transparent huge pages, when supported by the system.")
+    << false;
+}
+
 std::shared_ptr<xreg::RayCaster>
 xreg::LineIntRayCasterFromProgOpts(ProgOpts& po)
 {
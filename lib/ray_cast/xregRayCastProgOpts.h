@@ -34,6 +34,32 @@ namespace xreg
 class ProgOpts;
 class RayCaster;
 
+/// \brief Adds flags for the anti-aliasing factor and sampler of the CPU
+///        ray casters and the OpenCL line integral ray caster.
+///
+/// These are used by LineIntRayCasterFromProgOpts() and
+/// DepthRayCasterFromProgOpts() when they have been added.
+void AddRayCastAntiAliasProgOpts(ProgOpts& po);
+
+/// \brief Adds a flag for computing a share of the projections on the host,
+///        concurrently with an OpenCL device.
+///
+/// This is used by LineIntRayCasterFromProgOpts() and
+/// DepthRayCasterFromProgOpts() when it has been added. The anti-aliasing
+/// flags apply to the host ray caster.
+/// \see RayCasterMultiDevOCL::set_host_ray_caster
+void AddRayCastUseHostProgOpts(ProgOpts& po);
+
+/// \brief Adds flags for the placement of the host memory used by the CPU
+///        ray casters: distribution among NUMA nodes and huge pages.
+///
+/// These are used by LineIntRayCasterFromProgOpts() and
+/// DepthRayCasterFromProgOpts() when they have been added, including for the
+/// host ray caster of a hybrid ray caster.
+/// \see RayCasterLineIntCPU::set_numa_nodes
+/// \see RayCaster::set_use_huge_pages
+void AddRayCastHostMemProgOpts(ProgOpts& po);
+
 std::shared_ptr<RayCaster> LineIntRayCasterFromProgOpts(ProgOpts& po);
 
 std::shared_ptr<RayCaster> DepthRayCasterFromProgOpts(ProgOpts& po);
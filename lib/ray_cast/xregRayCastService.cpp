@@ -0,0 +1,347 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "xregRayCastService.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "xregAssert.h"
+#include "xregExceptionUtils.h"
+
+xreg::RayCastService::Client::Client(RayCastService* service)
+  : service_(service)
+{ }
+
+void xreg::RayCastService::Client::compute(const size_type vol_idx,
+                                           const FrameTransformList& xforms_cam_to_itk_phys,
+                                           const CamModelAssocList& cam_model_for_proj)
+{
+  const size_type num_projs = xforms_cam_to_itk_phys.size();
+
+  if (cam_model_for_proj.empty())
+  {
+    cam_model_for_proj_.assign(num_projs, 0);
+  }
+  else
+  {
+    xregASSERT(cam_model_for_proj.size() == num_projs);
+
+    cam_model_for_proj_ = cam_model_for_proj;
+  }
+
+  const size_type num_cams = service_->ray_caster_->num_camera_models();
+
+  for (const auto& cam_idx : cam_model_for_proj_)
+  {
+    if (cam_idx >= num_cams)
+    {
+      xregThrow("invalid camera model index: %lu", static_cast<unsigned long>(cam_idx));
+    }
+  }
+
+  const size_type num_pix_per_proj = service_->num_pix_per_proj_;
+
+  pixel_buf_.resize(num_projs * num_pix_per_proj);
+
+  // split the request into pieces that fit into a single batch
+  const size_type max_batch_num_projs = service_->max_batch_num_projs_;
+
+  std::vector<Request> reqs;
+  reqs.reserve((num_projs + max_batch_num_projs - 1) / max_batch_num_projs);
+
+  for (size_type proj_begin = 0; proj_begin < num_projs; proj_begin += max_batch_num_projs)
+  {
+    Request req;
+    req.vol_idx = vol_idx;
+    req.xforms_cam_to_itk_phys = &xforms_cam_to_itk_phys[proj_begin];
+    req.cam_model_for_proj = &cam_model_for_proj_[proj_begin];
+    req.num_projs = std::min(max_batch_num_projs, num_projs - proj_begin);
+    req.dst_pixels = &pixel_buf_[proj_begin * num_pix_per_proj];
+
+    reqs.push_back(req);
+  }
+
+  service_->submit_and_wait(&reqs);
+}
+
+xreg::size_type xreg::RayCastService::Client::num_projs() const
+{
+  return cam_model_for_proj_.size();
+}
+
+const xreg::RayCastService::PixelScalar2D*
+xreg::RayCastService::Client::proj_pixels(const size_type proj_idx) const
+{
+  xregASSERT(proj_idx < num_projs());
+
+  return &pixel_buf_[proj_idx * service_->num_pix_per_proj_];
+}
+
+cv::Mat xreg::RayCastService::Client::proj_ocv_view(const size_type proj_idx)
+{
+  const auto& cam = service_->camera_models()[cam_model_for_proj_[proj_idx]];
+
+  return cv::Mat(cam.num_det_rows, cam.num_det_cols, cv::DataType<PixelScalar2D>::type,
+                 const_cast<PixelScalar2D*>(proj_pixels(proj_idx)));
+}
+
+xreg::RayCastService::ProjPtr
+xreg::RayCastService::Client::make_proj_view(const size_type proj_idx)
+{
+  const auto& cam = service_->camera_models()[cam_model_for_proj_[proj_idx]];
+
+  const size_type num_pix_per_proj = service_->num_pix_per_proj_;
+
+  auto img = Proj::New();
+
+  auto pix_container = Proj::PixelContainer::New();
+  pix_container->SetImportPointer(const_cast<PixelScalar2D*>(proj_pixels(proj_idx)),
+                                  num_pix_per_proj, false);
+
+  img->SetPixelContainer(pix_container);
+
+  Proj::RegionType reg;
+  reg.SetIndex(0, 0);
+  reg.SetIndex(1, 0);
+  reg.SetSize(0, cam.num_det_cols);
+  reg.SetSize(1, cam.num_det_rows);
+
+  img->SetRegions(reg);
+
+  const CoordScalar spacings[2] = { cam.det_col_spacing, cam.det_row_spacing };
+  img->SetSpacing(spacings);
+
+  return img;
+}
+
+xreg::RayCastService::RayCastService(std::shared_ptr<RayCaster> ray_caster)
+  : ray_caster_(ray_caster)
+{
+  xregASSERT(bool(ray_caster_));
+
+  max_batch_num_projs_ = ray_caster_->max_num_projs();
+
+  if (!max_batch_num_projs_)
+  {
+    xregThrow("resources must be allocated by the ray caster prior to creating a service!");
+  }
+
+  const auto& cams = ray_caster_->camera_models();
+  xregASSERT(!cams.empty());
+
+  num_pix_per_proj_ = cams[0].num_det_rows * cams[0].num_det_cols;
+
+  for (const auto& cam : cams)
+  {
+    if ((cam.num_det_rows * cam.num_det_cols) != num_pix_per_proj_)
+    {
+      xregThrow("camera models of a ray casting service must have the same detector dimensions!");
+    }
+  }
+
+  batch_xforms_.reserve(max_batch_num_projs_);
+  batch_cam_model_for_proj_.reserve(max_batch_num_projs_);
+
+  thread_ = std::thread(&RayCastService::run_batches, this);
+}
+
+xreg::RayCastService::~RayCastService()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+
+  pending_cv_.notify_all();
+
+  thread_.join();
+}
+
+xreg::RayCastService::ClientPtr xreg::RayCastService::make_client()
+{
+  return ClientPtr(new Client(this));
+}
+
+xreg::size_type xreg::RayCastService::max_batch_num_projs() const
+{
+  return max_batch_num_projs_;
+}
+
+xreg::size_type xreg::RayCastService::num_batches() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  return num_batches_;
+}
+
+xreg::size_type xreg::RayCastService::num_requests() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  return num_requests_;
+}
+
+const xreg::RayCaster::CameraModelList& xreg::RayCastService::camera_models() const
+{
+  return ray_caster_->camera_models();
+}
+
+void xreg::RayCastService::submit_and_wait(std::vector<Request>* reqs)
+{
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    for (auto& r : *reqs)
+    {
+      pending_.push_back(&r);
+    }
+
+    pending_cv_.notify_one();
+
+    done_cv_.wait(lock, [reqs] ()
+                        {
+                          return std::all_of(reqs->begin(), reqs->end(),
+                                             [] (const Request& r) { return r.done; });
+                        });
+  }
+
+  for (const auto& r : *reqs)
+  {
+    if (r.err)
+    {
+      std::rethrow_exception(r.err);
+    }
+  }
+}
+
+void xreg::RayCastService::run_batches()
+{
+  std::vector<Request*> batch;
+
+  while (true)
+  {
+    batch.clear();
+
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+
+      pending_cv_.wait(lock, [this] () { return stop_ || !pending_.empty(); });
+
+      if (pending_.empty())
+      {
+        // stop requested and nothing left to do
+        break;
+      }
+
+      // Coalesce the pending requests for the volume of the oldest request,
+      // in the order they were submitted, until the batch is full
+      const size_type vol_idx = pending_.front()->vol_idx;
+
+      size_type batch_num_projs = 0;
+
+      for (auto it = pending_.begin(); it != pending_.end(); )
+      {
+        Request* r = *it;
+
+        if ((r->vol_idx == vol_idx) &&
+            ((batch_num_projs + r->num_projs) <= max_batch_num_projs_))
+        {
+          batch.push_back(r);
+          batch_num_projs += r->num_projs;
+
+          it = pending_.erase(it);
+        }
+        else
+        {
+          ++it;
+        }
+      }
+    }
+
+    std::exception_ptr err;
+
+    try
+    {
+      compute_batch(batch);
+    }
+    catch (...)
+    {
+      err = std::current_exception();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      for (auto* r : batch)
+      {
+        r->err  = err;
+        r->done = true;
+      }
+
+      ++num_batches_;
+      num_requests_ += batch.size();
+    }
+
+    done_cv_.notify_all();
+  }
+}
+
+void xreg::RayCastService::compute_batch(const std::vector<Request*>& batch)
+{
+  batch_xforms_.clear();
+  batch_cam_model_for_proj_.clear();
+
+  for (const auto* r : batch)
+  {
+    batch_xforms_.insert(batch_xforms_.end(), r->xforms_cam_to_itk_phys,
+                         r->xforms_cam_to_itk_phys + r->num_projs);
+    
+    batch_cam_model_for_proj_.insert(batch_cam_model_for_proj_.end(), r->cam_model_for_proj,
+                                     r->cam_model_for_proj + r->num_projs);
+  }
+
+  RayCaster& rc = *ray_caster_;
+
+  rc.set_num_projs(batch_xforms_.size());
+  rc.set_camera_model_proj_associations(batch_cam_model_for_proj_);
+  rc.set_xforms_cam_to_itk_phys(batch_xforms_);
+  rc.use_proj_store_replace_method();
+
+  rc.compute(batch.front()->vol_idx);
+
+  const size_type num_bytes_per_proj = num_pix_per_proj_ * sizeof(PixelScalar2D);
+
+  size_type batch_proj_idx = 0;
+
+  for (auto* r : batch)
+  {
+    for (size_type i = 0; i < r->num_projs; ++i, ++batch_proj_idx)
+    {
+      std::memcpy(r->dst_pixels + (i * num_pix_per_proj_),
+                  rc.host_proj_pixels(batch_proj_idx), num_bytes_per_proj);
+    }
+  }
+}
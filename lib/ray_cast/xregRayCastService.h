@@ -0,0 +1,200 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef XREGRAYCASTSERVICE_H_
+#define XREGRAYCASTSERVICE_H_
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#include "xregRayCastInterface.h"
+
+namespace xreg
+{
+
+/// \brief Ray casting shared by several concurrent clients.
+///
+/// A RayCaster keeps the poses, number of projections, projection buffer and
+/// store method of a computation, so it may not be used by several threads at
+/// once. Concurrent pipelines (e.g. several registrations on a single node)
+/// would therefore each need a ray caster with its own copy of the volumes.
+///
+/// The service takes exclusive ownership of a single ray caster, whose
+/// volumes, camera models and parameters are fixed once the service is
+/// constructed. Each pipeline creates a lightweight Client, which owns the
+/// poses of its requests and the host buffer that its projections are written
+/// to. Requests may be made concurrently by different clients; a background
+/// thread coalesces all requests pending for the same volume into a single
+/// batch of projections, up to the number of projections the ray caster was
+/// allocated for, and copies the projections of each request into its client's
+/// buffer. Requests larger than a batch are split across several batches.
+///
+/// Projections are always computed with the replace store method and without
+/// static volumes; background projections set on the ray caster are applied to
+/// every request.
+class RayCastService
+{
+public:
+  using PixelScalar2D     = RayCaster::PixelScalar2D;
+  using Proj              = RayCaster::Proj;
+  using ProjPtr           = RayCaster::ProjPtr;
+  using CamModelAssocList = RayCaster::CamModelAssocList;
+
+  /// \brief The requests of a single client, e.g. a registration pipeline.
+  ///
+  /// A client may be used by one thread at a time, but different clients
+  /// may be used concurrently. A client must not outlive its service.
+  class Client
+  {
+  public:
+    /// \brief Computes projections through a volume; blocks until complete.
+    ///
+    /// cam_model_for_proj[i] is the camera model of projection i; when empty
+    /// the first camera model is used by every projection. Projections
+    /// computed by a previous call are overwritten.
+    void compute(const size_type vol_idx,
+                 const FrameTransformList& xforms_cam_to_itk_phys,
+                 const CamModelAssocList& cam_model_for_proj = CamModelAssocList());
+
+    /// \brief The number of projections computed by the last call to compute()
+    size_type num_projs() const;
+
+    /// \brief Pointer to the pixels of a projection in the client's buffer.
+    ///
+    /// The pixels are stored in row-major order and remain valid until the
+    /// next call to compute().
+    const PixelScalar2D* proj_pixels(const size_type proj_idx) const;
+
+    /// \brief Shallow reference to a projection in the client's buffer.
+    cv::Mat proj_ocv_view(const size_type proj_idx);
+
+    /// \brief Shallow reference to a projection in the client's buffer.
+    ProjPtr make_proj_view(const size_type proj_idx);
+
+  private:
+    friend class RayCastService;
+
+    explicit Client(RayCastService* service);
+
+    RayCastService* service_;
+
+    std::vector<PixelScalar2D> pixel_buf_;
+
+    CamModelAssocList cam_model_for_proj_;
+  };
+
+  using ClientPtr = std::unique_ptr<Client>;
+
+  /// \brief Constructor; starts the background ray casting thread.
+  ///
+  /// The volumes, camera models and ray casting parameters must be set, and
+  /// resources allocated, prior to constructing the service. The number of
+  /// projections allocated for is the maximum size of a batch. The ray caster
+  /// must not be used directly while the service exists.
+  explicit RayCastService(std::shared_ptr<RayCaster> ray_caster);
+
+  /// \brief Destructor; waits for the pending requests to complete and stops
+  ///        the background thread.
+  ~RayCastService();
+
+  RayCastService(const RayCastService&) = delete;
+  RayCastService& operator=(const RayCastService&) = delete;
+
+  /// \brief Creates a client of this service; this is thread safe.
+  ClientPtr make_client();
+
+  /// \brief The maximum number of projections computed in a single batch.
+  size_type max_batch_num_projs() const;
+
+  /// \brief The number of batches computed so far.
+  size_type num_batches() const;
+
+  /// \brief The number of requests computed so far; requests split across
+  ///        batches are counted once for each batch.
+  size_type num_requests() const;
+
+  /// \brief The camera models of the ray caster, which do not change.
+  const RayCaster::CameraModelList& camera_models() const;
+
+private:
+  /// \brief A contiguous range of the projections of a client's request.
+  struct Request
+  {
+    size_type vol_idx;
+
+    const FrameTransform* xforms_cam_to_itk_phys;
+
+    const size_type* cam_model_for_proj;
+
+    size_type num_projs;
+
+    PixelScalar2D* dst_pixels;
+
+    bool done = false;
+
+    std::exception_ptr err;
+  };
+
+  /// \brief Submits requests and blocks until each has completed.
+  void submit_and_wait(std::vector<Request>* reqs);
+
+  /// \brief The loop run by the background thread.
+  void run_batches();
+
+  /// \brief Computes a batch of requests for the same volume.
+  void compute_batch(const std::vector<Request*>& batch);
+
+  std::shared_ptr<RayCaster> ray_caster_;
+
+  size_type max_batch_num_projs_;
+
+  size_type num_pix_per_proj_;
+
+  mutable std::mutex mutex_;
+
+  std::condition_variable pending_cv_;
+  std::condition_variable done_cv_;
+
+  std::deque<Request*> pending_;
+
+  bool stop_ = false;
+
+  size_type num_batches_ = 0;
+
+  size_type num_requests_ = 0;
+
+  FrameTransformList batch_xforms_;
+
+  CamModelAssocList batch_cam_model_for_proj_;
+
+  std::thread thread_;
+};
+
+}  // xreg
+
+#endif
@@ -24,12 +24,6 @@
 
 #include "xregRayCastSparseCollCPU.h"
 
-#include <itkLinearInterpolateImageFunction.h>
-#include <itkNearestNeighborInterpolateImageFunction.h>
-#include <itkWindowedSincInterpolateImageFunction.h>
-#include <itkConstantBoundaryCondition.h>
-#include <itkBSplineInterpolateImageFunction.h>
-
 #include "xregITKBasicImageUtils.h"
 #include "xregTBBUtils.h"
 #include "xregSpatialPrimitives.h"
@@ -67,6 +61,8 @@ struct RayCastCollFn
 
   const RayCaster::InterpMethod interp_method;  ///< The interpolation method used for fractional indices into the 3D volume
 
+  const Vol* bspline_coefs;  ///< Shared B-spline coefficients of img_vol, null when not using B-spline interpolation
+
   PixelScalar3D collision_thresh;
 
   size_type num_backtracking_steps;
@@ -85,198 +81,376 @@ struct RayCastCollFn
 
   const RayCasterSparseCollisionCPU::RayIndLUT& ray_idx_lut;
 
-  /// \brief Computation operator - executes a collection of rays cast
-  ///
-  /// The collection of line integrals is not necessarily restricted to a single projection
-  void operator()(const RangeType& r) const
+  const RayCastVolBrickGrid* brick_grid;  ///< Used for skipping bricks below the collision threshold, null when not skipping
+
+  const RayCastVolBrickOctree* brick_octree;  ///< Used for finding bricks above the collision threshold in logarithmic time, null when not skipping
+
+  /// \brief The segment of a ray that lies within the volume, sampled at
+  ///        start_pt_wrt_itk_idx + step_idx * step_vec_wrt_itk_idx for step_idx
+  ///        in [first_step_idx, num_steps].
+  struct RaySeg
   {
-    using VolInterpType        = itk::InterpolateImageFunction<Vol,CoordScalar>;
-    using VolLinearInterpType  = itk::LinearInterpolateImageFunction<Vol,CoordScalar>;
-    using VolNNInterpType      = itk::NearestNeighborInterpolateImageFunction<Vol,CoordScalar>;
-    using VolBSplineInterpType = itk::BSplineInterpolateImageFunction<Vol,CoordScalar>;
-    using VolSincInterpType    = itk::WindowedSincInterpolateImageFunction<
-                                         Vol,4,itk::Function::LanczosWindowFunction<4>,
-                                         itk::ConstantBoundaryCondition<Vol>,CoordScalar>;
+    size_type view_idx;
+    size_type ray_idx;
 
-    VolInterpType::Pointer vol_interp;
+    bool inter_vol;
 
-    switch (interp_method)
-    {
-      case RayCaster::kRAY_CAST_INTERP_NN:
-        vol_interp = VolNNInterpType::New();
-        break;
-      case RayCaster::kRAY_CAST_INTERP_SINC:
-        vol_interp = VolSincInterpType::New();
-        break;
-      case RayCaster::kRAY_CAST_INTERP_BSPLINE:
-      {
-        auto bspline_interp = VolBSplineInterpType::New();
-        bspline_interp->SetSplineOrder(3);
-        vol_interp = bspline_interp;
-      }
-        break;
-      case RayCaster::kRAY_CAST_INTERP_LINEAR:
-      default:
-        vol_interp = VolLinearInterpType::New();
-        break;
-    }
+    Pt3 start_pt_wrt_itk_idx;
+    Pt3 step_vec_wrt_itk_idx;
+
+    size_type num_steps;
+
+    std::int64_t first_step_idx;
+
+    /// \brief Indicates that first_step_idx has already skipped the bricks
+    ///        below the collision threshold using the octree
+    bool first_step_from_octree;
+
+    FrameTransform xform_itk_idx_to_cam;
+  };
+
+  /// \brief Computes the segment of a ray within the volume and initializes
+  ///        its outputs.
+  void setup_ray(const size_type range_idx, RaySeg* seg) const
+  {
+    size_type view_idx = 0;
+    size_type ray_idx  = 0;
+    std::tie(view_idx,ray_idx) = ray_idx_lut[range_idx];  
+
+    seg->view_idx = view_idx;
+    seg->ray_idx  = ray_idx;
+
+    seg->inter_vol = false;
+
+    seg->first_step_idx = 0;
+
+    seg->first_step_from_octree = false;
+
+    entry_coll_intersect_dists_for_each_view[view_idx][ray_idx] = -1;
+
+    const auto& cam = camera_models[cam_model_for_proj[view_idx]];
+
+    // This point is stored with respect to the camera's
+    // "world" coordinates
+    const Pt3& cur_pt_wrt_cam = pts_wrt_each_cam_ext[view_idx][ray_idx];
+
+    // The current transformation from detector coordinates to ITK indices
+    const FrameTransform xform_cam_to_itk_idx = itk_phys_pt_to_itk_idx_xform * xforms_cam_to_itk_phys[view_idx];
+
+    seg->xform_itk_idx_to_cam = xform_cam_to_itk_idx.inverse();
+
+    const Pt3 cur_pt_wrt_itk_idx = xform_cam_to_itk_idx * cur_pt_wrt_cam;
+
+    // Position of the X-Ray source / pinhole point in ITK indices
+    const Pt3 pinhole_wrt_itk_idx = xform_cam_to_itk_idx * cam.pinhole_pt;
+
+    const Pt3 look_unit_vec_wrt_cam = (orient_towards_cam_pinhole ? CoordScalar(-1) : CoordScalar(1))
+                                               * (cur_pt_wrt_cam - cam.pinhole_pt).normalized();
+
+    const Pt3 look_vec_wrt_itk_idx = (orient_towards_cam_pinhole ? CoordScalar(-1) : CoordScalar(1))
+                                              * (cur_pt_wrt_itk_idx - pinhole_wrt_itk_idx);
+
+    Pt3 start_pt_wrt_itk_idx = orient_towards_cam_pinhole ? cur_pt_wrt_itk_idx : pinhole_wrt_itk_idx;
+
+    CoordScalar t_start = 0;
+    CoordScalar t_stop  = 0;
+    
+    constexpr CoordScalar kVOL_BB_STEP_INC_TOL = RayCasterCPU::kVOL_BB_STEP_INC_TOL;
+    
+    bool inter_vol = false;
 
-    vol_interp->SetInputImage(img_vol);
+    std::tie(inter_vol,t_start,t_stop) = RayRectIntersect(img_aabb_min, img_aabb_max,
+                                                          start_pt_wrt_itk_idx, look_vec_wrt_itk_idx,
+                                                          false);  // false -> do not limit to line segment
 
-    for (size_type range_idx = r.begin(); range_idx < r.end(); ++range_idx)
+    // Besides intersecting, need to be able to nudge inward a bit to avoid an
+    // ITK crash when interpolating on edge
+    if (inter_vol && ((t_stop - t_start) > CoordScalar(2 * kVOL_BB_STEP_INC_TOL)))
     {
-      size_type view_idx = 0;
-      size_type ray_idx  = 0;
-      std::tie(view_idx,ray_idx) = ray_idx_lut[range_idx];  
+      t_start += kVOL_BB_STEP_INC_TOL;
+      t_stop  -= kVOL_BB_STEP_INC_TOL;
+
+      // the first index on the line from source to detector that lies within the volume bounds
+      start_pt_wrt_itk_idx += t_start * look_vec_wrt_itk_idx;
+
+      const CoordScalar look_vec_len_wrt_itk_idx = look_vec_wrt_itk_idx.norm();
+      const CoordScalar intersect_len_wrt_itk_idx = (t_stop - t_start) * look_vec_len_wrt_itk_idx;
+
+      // Rotate and scale the step vector to get it wrt ITK indices
+      const CoordScalar step_len_wrt_itk_idx = (xform_cam_to_itk_idx.matrix().block(0,0,3,3) * (look_unit_vec_wrt_cam * step_size)).norm();
+
+      seg->inter_vol = true;
+
+      seg->start_pt_wrt_itk_idx = start_pt_wrt_itk_idx;
+
+      seg->step_vec_wrt_itk_idx = look_vec_wrt_itk_idx * (step_len_wrt_itk_idx / look_vec_len_wrt_itk_idx);
 
-      CoordScalar& cur_pt_dist = entry_coll_intersect_dists_for_each_view[view_idx][ray_idx];
-      cur_pt_dist = -1;
+      seg->num_steps = static_cast<size_type>(intersect_len_wrt_itk_idx / step_len_wrt_itk_idx);
+    }
+  }
 
-      const auto& cam = camera_models[cam_model_for_proj[view_idx]];
+  /// \brief Steps along a ray segment, searching for the entry (and exit)
+  ///        collisions.
+  void march_ray(const RaySeg& seg, itk::InterpolateImageFunction<Vol,CoordScalar>* vol_interp) const
+  {
+    const size_type view_idx = seg.view_idx;
+    const size_type ray_idx  = seg.ray_idx;
 
-      // This point is stored with respect to the camera's
-      // "world" coordinates
-      const Pt3& cur_pt_wrt_cam = pts_wrt_each_cam_ext[view_idx][ray_idx];
+    const size_type num_steps = seg.num_steps;
 
-      // The current transformation from detector coordinates to ITK indices
-      const FrameTransform xform_cam_to_itk_idx = itk_phys_pt_to_itk_idx_xform * xforms_cam_to_itk_phys[view_idx];
+    const Pt3& start_pt_wrt_itk_idx = seg.start_pt_wrt_itk_idx;
+    const Pt3& step_vec_wrt_itk_idx = seg.step_vec_wrt_itk_idx;
 
-      const FrameTransform xform_itk_idx_to_cam = xform_cam_to_itk_idx.inverse();
+    CoordScalar& cur_pt_dist = entry_coll_intersect_dists_for_each_view[view_idx][ray_idx];
 
-      const Pt3 cur_pt_wrt_itk_idx = xform_cam_to_itk_idx * cur_pt_wrt_cam;
+    const Pt3& cur_pt_wrt_cam = pts_wrt_each_cam_ext[view_idx][ray_idx];
 
-      // Position of the X-Ray source / pinhole point in ITK indices
-      const Pt3 pinhole_wrt_itk_idx = xform_cam_to_itk_idx * cam.pinhole_pt;
+    if (seg.first_step_idx > static_cast<std::int64_t>(num_steps))
+    {
+      // every brick along the ray is below the collision threshold
+      return;
+    }
 
-      const Pt3 look_unit_vec_wrt_cam = (orient_towards_cam_pinhole ? CoordScalar(-1) : CoordScalar(1))
-                                                 * (cur_pt_wrt_cam - cam.pinhole_pt).normalized();
+    // We'll use the ITK objects now, since that is the easiest interface with itk::Image and itk interpolation
+    size_type step_idx = static_cast<size_type>(seg.first_step_idx);
 
-      const Pt3 look_vec_wrt_itk_idx = (orient_towards_cam_pinhole ? CoordScalar(-1) : CoordScalar(1))
-                                                * (cur_pt_wrt_itk_idx - pinhole_wrt_itk_idx);
+    itk::ContinuousIndex<CoordScalar,3> cur_cont_vol_idx;
+    {
+      const Pt3 first_pt = start_pt_wrt_itk_idx +
+                              (static_cast<CoordScalar>(step_idx) * step_vec_wrt_itk_idx);
 
-      const Pt3 look_unit_vec_wrt_itk_idx = look_vec_wrt_itk_idx.normalized();
+      cur_cont_vol_idx[0] = first_pt[0];
+      cur_cont_vol_idx[1] = first_pt[1];
+      cur_cont_vol_idx[2] = first_pt[2];
+    }
 
-      Pt3 start_pt_wrt_itk_idx = orient_towards_cam_pinhole ? cur_pt_wrt_itk_idx : pinhole_wrt_itk_idx;
+    itk::Vector<CoordScalar,3> tmp_step_vec_wrt_itk_idx;
+    tmp_step_vec_wrt_itk_idx[0] = step_vec_wrt_itk_idx[0];
+    tmp_step_vec_wrt_itk_idx[1] = step_vec_wrt_itk_idx[1];
+    tmp_step_vec_wrt_itk_idx[2] = step_vec_wrt_itk_idx[2];
 
-      CoordScalar t_start = 0;
-      CoordScalar t_stop  = 0;
-      
-      constexpr CoordScalar kVOL_BB_STEP_INC_TOL = RayCasterCPU::kVOL_BB_STEP_INC_TOL;
-      
-      bool inter_vol = false;
+    PixelScalar3D cur_vol_val = 0;
 
-      std::tie(inter_vol,t_start,t_stop) = RayRectIntersect(img_aabb_min, img_aabb_max,
-                                                            start_pt_wrt_itk_idx, look_vec_wrt_itk_idx,
-                                                            false);  // false -> do not limit to line segment
+    bool looking_for_entry_pt = true;
 
-      // Besides intersecting, need to be able to nudge inward a bit to avoid an
-      // ITK crash when interpolating on edge
-      if (inter_vol && ((t_stop - t_start) > CoordScalar(2 * kVOL_BB_STEP_INC_TOL)))
+    for (; step_idx <= num_steps; ++step_idx)
+    {
+      if (brick_grid && (looking_for_entry_pt || find_exit_pts))
       {
-        t_start += kVOL_BB_STEP_INC_TOL;
-        t_stop  -= kVOL_BB_STEP_INC_TOL;
+        // jump over bricks that are entirely below the collision threshold
+        // when looking for an entry point, or entirely at or above the
+        // threshold when looking for an exit point
+        const RayCastBrickIsBelowThresh below_thresh = { *brick_grid, collision_thresh };
+        const RayCastBrickIsAboveThresh above_thresh = { *brick_grid, collision_thresh };
 
-        // the first index on the line from source to detector that lies within the volume bounds
-        start_pt_wrt_itk_idx += t_start * look_vec_wrt_itk_idx;
+        std::int64_t next_step_idx = static_cast<std::int64_t>(step_idx);
 
-        const CoordScalar look_vec_len_wrt_itk_idx = look_vec_wrt_itk_idx.norm();
-        const CoordScalar intersect_len_wrt_itk_idx = (t_stop - t_start) * look_vec_len_wrt_itk_idx;
+        if (brick_octree &&
+            !(looking_for_entry_pt && seg.first_step_from_octree &&
+              (next_step_idx == seg.first_step_idx)))
+        {
+          // descend the octree to the first brick that may not be skipped,
+          // the bricks are then checked individually
+          const std::int64_t max_step_idx = static_cast<std::int64_t>(num_steps);
+
+          if (looking_for_entry_pt)
+          {
+            const RayCastOctreeNodeIsBelowThresh node_below_thresh = { *brick_octree, collision_thresh };
+
+            RayCastOctreeSkipBricks(*brick_octree, node_below_thresh, 1, &start_pt_wrt_itk_idx,
+                                    &step_vec_wrt_itk_idx, &next_step_idx, &max_step_idx);
+          }
+          else
+          {
+            const RayCastOctreeNodeIsAboveThresh node_above_thresh = { *brick_octree, collision_thresh };
 
-        // Rotate and scale the step vector to get it wrt ITK indices
-        const CoordScalar step_len_wrt_itk_idx = (xform_cam_to_itk_idx.matrix().block(0,0,3,3) * (look_unit_vec_wrt_cam * step_size)).norm();
+            RayCastOctreeSkipBricks(*brick_octree, node_above_thresh, 1, &start_pt_wrt_itk_idx,
+                                    &step_vec_wrt_itk_idx, &next_step_idx, &max_step_idx);
+          }
+        }
 
-        const size_type num_steps = static_cast<size_type>(intersect_len_wrt_itk_idx / step_len_wrt_itk_idx);
+        if (next_step_idx <= static_cast<std::int64_t>(num_steps))
+        {
+          next_step_idx = looking_for_entry_pt ?
+                                RayCastSkipBricks(*brick_grid, below_thresh,
+                                                  start_pt_wrt_itk_idx,
+                                                  step_vec_wrt_itk_idx,
+                                                  next_step_idx,
+                                                  static_cast<std::int64_t>(num_steps)) :
+                                RayCastSkipBricks(*brick_grid, above_thresh,
+                                                  start_pt_wrt_itk_idx,
+                                                  step_vec_wrt_itk_idx,
+                                                  next_step_idx,
+                                                  static_cast<std::int64_t>(num_steps));
+        }
+
+        if (next_step_idx > static_cast<std::int64_t>(num_steps))
+        {
+          break;
+        }
+        else if (next_step_idx != static_cast<std::int64_t>(step_idx))
+        {
+          step_idx = static_cast<size_type>(next_step_idx);
 
-        // We'll use the ITK objects now, since that is the easiest interface with itk::Image and itk interpolation
-        itk::ContinuousIndex<CoordScalar,3> cur_cont_vol_idx;
-        cur_cont_vol_idx[0] = start_pt_wrt_itk_idx[0];
-        cur_cont_vol_idx[1] = start_pt_wrt_itk_idx[1];
-        cur_cont_vol_idx[2] = start_pt_wrt_itk_idx[2];
+          const Pt3 cur_pt = start_pt_wrt_itk_idx +
+                               (static_cast<CoordScalar>(step_idx) * step_vec_wrt_itk_idx);
 
-        const CoordScalar scale_to_step = step_len_wrt_itk_idx / look_vec_len_wrt_itk_idx;
-        itk::Vector<CoordScalar,3> tmp_step_vec_wrt_itk_idx;
-        tmp_step_vec_wrt_itk_idx[0] = look_vec_wrt_itk_idx[0] * scale_to_step;
-        tmp_step_vec_wrt_itk_idx[1] = look_vec_wrt_itk_idx[1] * scale_to_step;
-        tmp_step_vec_wrt_itk_idx[2] = look_vec_wrt_itk_idx[2] * scale_to_step;
+          cur_cont_vol_idx[0] = cur_pt[0];
+          cur_cont_vol_idx[1] = cur_pt[1];
+          cur_cont_vol_idx[2] = cur_pt[2];
+        }
+      }
 
-        PixelScalar3D cur_vol_val = 0;
+      //xregASSERT(vol_interp->IsInsideBuffer(cur_cont_vol_idx));
+      cur_vol_val = vol_interp->EvaluateAtContinuousIndex(cur_cont_vol_idx);
+       
+      if ((looking_for_entry_pt && (cur_vol_val >= collision_thresh)) ||
+          (!looking_for_entry_pt && find_exit_pts && (cur_vol_val < collision_thresh)))
+      {
+        // we have either collided with the surface/volume on entry -OR-
+        // left the surface volume
 
-        bool looking_for_entry_pt = true;
+        // perform some binary search/back-tracking
+        // to determine a more accurate location of where the threshold is crossed
+ 
+        itk::Vector<CoordScalar,3> tmp_back_track_step = tmp_step_vec_wrt_itk_idx;
 
-        for (size_type step_idx = 0; step_idx <= num_steps; ++step_idx)
+        for (size_type sur_bin_step_idx = 0;
+             sur_bin_step_idx < num_backtracking_steps;
+             ++sur_bin_step_idx)
         {
+          tmp_back_track_step *= 0.5;
+          
+          if (looking_for_entry_pt)
+          {
+            cur_cont_vol_idx -=
+              (cur_vol_val >= collision_thresh) ?
+                               tmp_back_track_step : -tmp_back_track_step;
+          }
+          else
+          {
+            cur_cont_vol_idx -=
+              (cur_vol_val <= collision_thresh) ?
+                               tmp_back_track_step : -tmp_back_track_step;
+          }
+
           //xregASSERT(vol_interp->IsInsideBuffer(cur_cont_vol_idx));
           cur_vol_val = vol_interp->EvaluateAtContinuousIndex(cur_cont_vol_idx);
-           
-          if ((looking_for_entry_pt && (cur_vol_val >= collision_thresh)) ||
-              (!looking_for_entry_pt && find_exit_pts && (cur_vol_val < collision_thresh)))
+        }
+        // end backtracking
+
+        // compute depth in the camera frame
+        Pt3 tmp_vol_idx;
+        tmp_vol_idx[0] = cur_cont_vol_idx[0];
+        tmp_vol_idx[1] = cur_cont_vol_idx[1];
+        tmp_vol_idx[2] = cur_cont_vol_idx[2];
+        
+        if (looking_for_entry_pt)
+        {
+          entry_coll_pts_wrt_vol_for_each_view[view_idx][ray_idx] = itk_idx_to_itk_phys_pt_xform * tmp_vol_idx;
+
+          cur_pt_dist = ((seg.xform_itk_idx_to_cam * tmp_vol_idx) - cur_pt_wrt_cam).norm();
+
+          if (find_exit_pts)
           {
-            // we have either collided with the surface/volume on entry -OR-
-            // left the surface volume
-
-            // perform some binary search/back-tracking
-            // to determine a more accurate location of where the threshold is crossed
-     
-            itk::Vector<CoordScalar,3> tmp_back_track_step = tmp_step_vec_wrt_itk_idx;
-
-            for (size_type sur_bin_step_idx = 0;
-                 sur_bin_step_idx < num_backtracking_steps;
-                 ++sur_bin_step_idx)
-            {
-              tmp_back_track_step *= 0.5;
-              
-              if (looking_for_entry_pt)
-              {
-                cur_cont_vol_idx -=
-                  (cur_vol_val >= collision_thresh) ?
-                                   tmp_back_track_step : -tmp_back_track_step;
-              }
-              else
-              {
-                cur_cont_vol_idx -=
-                  (cur_vol_val <= collision_thresh) ?
-                                   tmp_back_track_step : -tmp_back_track_step;
-              }
-
-              //xregASSERT(vol_interp->IsInsideBuffer(cur_cont_vol_idx));
-              cur_vol_val = vol_interp->EvaluateAtContinuousIndex(cur_cont_vol_idx);
-            }
-            // end backtracking
-
-            // compute depth in the camera frame
-            Pt3 tmp_vol_idx;
-            tmp_vol_idx[0] = cur_cont_vol_idx[0];
-            tmp_vol_idx[1] = cur_cont_vol_idx[1];
-            tmp_vol_idx[2] = cur_cont_vol_idx[2];
-            
-            if (looking_for_entry_pt)
-            {
-              entry_coll_pts_wrt_vol_for_each_view[view_idx][ray_idx] = itk_idx_to_itk_phys_pt_xform * tmp_vol_idx;
-
-              cur_pt_dist = ((xform_itk_idx_to_cam * tmp_vol_idx) - cur_pt_wrt_cam).norm();
-
-              if (find_exit_pts)
-              {
-                looking_for_entry_pt = false;
-              }
-              else
-              {
-                break;
-              }
-            }
-            else if (find_exit_pts)
-            {
-              exit_coll_pts_wrt_vol_for_each_view[view_idx][ray_idx] = itk_idx_to_itk_phys_pt_xform * tmp_vol_idx;
-            }
-          }  // end if (cur_vol_val >= collision_thresh)
-
-          cur_cont_vol_idx += tmp_step_vec_wrt_itk_idx;
-        }  // for step
-      }  // if RayRectIntersect
-    }  // for range_idx
+            looking_for_entry_pt = false;
+          }
+          else
+          {
+            break;
+          }
+        }
+        else if (find_exit_pts)
+        {
+          exit_coll_pts_wrt_vol_for_each_view[view_idx][ray_idx] = itk_idx_to_itk_phys_pt_xform * tmp_vol_idx;
+        }
+      }  // end if (cur_vol_val >= collision_thresh)
+
+      cur_cont_vol_idx += tmp_step_vec_wrt_itk_idx;
+    }  // for step
+  }
+
+  /// \brief Computation operator - executes a collection of rays cast
+  ///
+  /// The collection of line integrals is not necessarily restricted to a single projection.
+  /// Consecutive rays are grouped into packets, which descend the brick octree
+  /// together when searching for the first bricks that may contain a collision.
+  void operator()(const RangeType& r) const
+  {
+    using VolInterpType = itk::InterpolateImageFunction<Vol,CoordScalar>;
+
+    VolInterpType::Pointer vol_interp = MakeRayCastITKInterp(interp_method, img_vol, bspline_coefs);
+
+    constexpr size_type kPACKET_SIZE = kRAY_CAST_OCTREE_MAX_PACKET_SIZE;
+
+    RaySeg segs[kPACKET_SIZE];
+
+    Pt3 packet_start_pts[kPACKET_SIZE];
+    Pt3 packet_step_vecs[kPACKET_SIZE];
+
+    std::int64_t packet_step_inds[kPACKET_SIZE];
+    std::int64_t packet_max_step_inds[kPACKET_SIZE];
+
+    size_type packet_seg_inds[kPACKET_SIZE];
+
+    for (size_type packet_start = r.begin(); packet_start < r.end(); packet_start += kPACKET_SIZE)
+    {
+      const size_type num_segs = std::min(kPACKET_SIZE, r.end() - packet_start);
+
+      for (size_type k = 0; k < num_segs; ++k)
+      {
+        setup_ray(packet_start + k, &segs[k]);
+      }
+
+      if (brick_octree)
+      {
+        size_type num_packet_rays = 0;
+
+        for (size_type k = 0; k < num_segs; ++k)
+        {
+          if (segs[k].inter_vol)
+          {
+            packet_start_pts[num_packet_rays]     = segs[k].start_pt_wrt_itk_idx;
+            packet_step_vecs[num_packet_rays]     = segs[k].step_vec_wrt_itk_idx;
+            packet_step_inds[num_packet_rays]     = 0;
+            packet_max_step_inds[num_packet_rays] = static_cast<std::int64_t>(segs[k].num_steps);
+            packet_seg_inds[num_packet_rays]      = k;
+
+            ++num_packet_rays;
+          }
+        }
+
+        if (num_packet_rays)
+        {
+          const RayCastOctreeNodeIsBelowThresh node_below_thresh = { *brick_octree, collision_thresh };
+
+          RayCastOctreeSkipBricks(*brick_octree, node_below_thresh, num_packet_rays,
+                                  packet_start_pts, packet_step_vecs,
+                                  packet_step_inds, packet_max_step_inds);
+
+          for (size_type k = 0; k < num_packet_rays; ++k)
+          {
+            RaySeg& seg = segs[packet_seg_inds[k]];
+
+            seg.first_step_idx = packet_step_inds[k];
+
+            seg.first_step_from_octree = true;
+          }
+        }
+      }
+
+      for (size_type k = 0; k < num_segs; ++k)
+      {
+        if (segs[k].inter_vol)
+        {
+          march_ray(segs[k], vol_interp.GetPointer());
+        }
+      }
+    }  // for packet_start
   }  // end operator()(Range)
 };
 
+
 }  // un-named
 
 void xreg::RayCasterSparseCollisionCPU::allocate_resources()
@@ -297,6 +471,8 @@ void xreg::RayCasterSparseCollisionCPU::allocate_resources()
 void xreg::RayCasterSparseCollisionCPU::compute(const size_type vol_idx)
 {
   xregASSERT(this->resources_allocated_);
+
+  ParallelExecContextScope exec_scope(this->exec_ctx_.get());
   
   // Get the index bounding box (axis-aligned in the index space) of the volume
   Pt3 img_aabb_min;
@@ -341,6 +517,36 @@ void xreg::RayCasterSparseCollisionCPU::compute(const size_type vol_idx)
     }
   }
 
+  const RayCastVolBrickGrid* brick_grid = nullptr;
+
+  const RayCastVolBrickOctree* brick_octree = nullptr;
+
+  if (this->use_empty_space_skipping_)
+  {
+    brick_grid = &this->vol_brick_grids_[vol_idx];
+
+    if (vol_idx < vol_brick_octrees_.size())
+    {
+      brick_octree = &vol_brick_octrees_[vol_idx];
+    }
+
+    // When empty voxels are always below the collision threshold, the rays
+    // can be clipped to the non-empty voxels
+    if (this->render_thresh() > this->empty_space_thresh_)
+    {
+      if (brick_grid->any_non_empty)
+      {
+        img_aabb_min = brick_grid->non_empty_idx_min;
+        img_aabb_max = brick_grid->non_empty_idx_max;
+      }
+      else
+      {
+        // make the bounds degenerate so that no intersections are found
+        img_aabb_max = img_aabb_min;
+      }
+    }
+  }
+
   RayCastCollFn ray_cast_fn = { this->vols_[vol_idx],
                                 img_aabb_min,
                                 img_aabb_max,
@@ -352,6 +558,7 @@ void xreg::RayCasterSparseCollisionCPU::compute(const size_type vol_idx)
                                 this->cam_model_for_proj_,
                                 this->ray_step_size_,
                                 this->interp_method_,
+                                this->bspline_coefs(vol_idx),
                                 this->render_thresh(),
                                 this->num_backtracking_steps(),
                                 pts_wrt_each_cam_ext_,
@@ -360,7 +567,9 @@ void xreg::RayCasterSparseCollisionCPU::compute(const size_type vol_idx)
                                 entry_coll_intersect_dists_for_each_view_,
                                 orient_towards_cam_pinhole_,
                                 find_exit_pts_,
-                                ray_idx_lut_
+                                ray_idx_lut_,
+                                brick_grid,
+                                brick_octree
                               };
 
   // Cast the rays
@@ -454,3 +663,18 @@ xreg::RayCasterSparseCollisionCPU::intersect_dists(const size_type view_idx) con
 
   return entry_coll_intersect_dists_for_each_view_[view_idx];
 } 
+
+void xreg::RayCasterSparseCollisionCPU::vols_changed()
+{
+  RayCaster::vols_changed();
+
+  // the octrees are built once for each volume and used by every call to compute()
+  vol_brick_octrees_.clear();
+
+  vol_brick_octrees_.reserve(this->vol_brick_grids_.size());
+
+  for (const auto& grid : this->vol_brick_grids_)
+  {
+    vol_brick_octrees_.push_back(ComputeRayCastVolBrickOctree(grid));
+  }
+}
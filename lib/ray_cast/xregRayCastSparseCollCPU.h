@@ -25,6 +25,7 @@
 #ifndef XREGRAYCASTSPARSECOLLCPU_H_
 #define XREGRAYCASTSPARSECOLLCPU_H_
 
+#include "xregRayCastEmptySpace.h"
 #include "xregRayCastInterface.h"
 
 namespace xreg
@@ -100,6 +101,11 @@ public:
 
   const DistList& intersect_dists(const size_type view_idx = 0) const;
 
+protected:
+  /// \brief Builds the octree of the brick grid of each volume, when using
+  ///        empty space skipping.
+  void vols_changed() override;
+
 private:
   // global ray index -> (view index, view ray index)
   RayIndLUT ray_idx_lut_;
@@ -115,6 +121,10 @@ private:
   bool orient_towards_cam_pinhole_ = true;
 
   bool find_exit_pts_ = false;
+
+  /// \brief Octree of each volume's brick grid, empty when not using empty
+  ///        space skipping.
+  RayCastVolBrickOctreeList vol_brick_octrees_;
 };
 
 }  // xreg
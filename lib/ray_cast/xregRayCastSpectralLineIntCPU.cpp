@@ -0,0 +1,455 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregRayCastSpectralLineIntCPU.h"
+
+#include <array>
+#include <cmath>
+
+#include "xregAssert.h"
+#include "xregExceptionUtils.h"
+#include "xregITKBasicImageUtils.h"
+#include "xregRayCastInterpCPU.h"
+#include "xregSpatialPrimitives.h"
+#include "xregTBBUtils.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+struct RayCastSpectralLineIntFn
+{
+  using Vol           = RayCaster::Vol;
+  using PixelScalar3D = RayCaster::PixelScalar3D;
+
+  constexpr static size_type kMAX_NUM_BINS = RayCasterSpectralLineIntCPU::kMAX_NUM_BINS;
+
+  const Vol* img_vol;  ///< 3D volume we are ray casting through
+
+  const Pt3 img_aabb_min;  ///< Axis-Aligned minimum bounds on the image indices for each index dimension (should be zeros)
+  const Pt3 img_aabb_max;  ///< Axis-Aligned maximum bounds on the image indices for each index dimension
+
+  const FrameTransform itk_phys_pt_to_itk_idx_xform;  ///< Transformation from ITK physical points to continuous indices
+
+  const RayCaster::CameraModelList& camera_models;  ///< The camera models (intrinsics)
+
+  const FrameTransformList& xforms_cam_to_itk_phys;  ///< The collection of camera poses, each representing a projection
+
+  const RayCaster::CamModelAssocList& cam_model_for_proj;  ///< The association of projection to camera model
+
+  const CoordScalar step_size;  ///< The step size for each ray
+
+  const RayCaster::InterpMethod interp_method;  ///< The interpolation method used for fractional indices into the 3D volume
+
+  const Vol* bspline_coefs;  ///< Shared B-spline coefficients of img_vol, null when not using B-spline interpolation
+
+  RayCastCPUThreadStatePool* thread_states;  ///< The interpolators and random engines kept by each thread
+
+  const RayCastSpectralLUT& lut;  ///< Maps each sample to the attenuation of each bin
+
+  float* bin_line_ints;  ///< The line integrals of each bin, with the bins of each pixel stored consecutively
+
+  /// \brief Computation operator - executes a collection of rays cast
+  void operator()(const RangeType& r) const
+  {
+    if (interp_method == RayCaster::kRAY_CAST_INTERP_NN)
+    {
+      const RayCastVolNNInterpCPU<RayCastVolBufCPU> interp = { MakeRayCastVolBufCPU(img_vol) };
+      cast_rays(r, interp);
+    }
+    else if (interp_method == RayCaster::kRAY_CAST_INTERP_LINEAR)
+    {
+      const RayCastVolLinearInterpCPU<RayCastVolBufCPU> interp = { MakeRayCastVolBufCPU(img_vol) };
+      cast_rays(r, interp);
+    }
+    else
+    {
+      RayCastITKInterpCPU::VolInterp::Pointer vol_interp =
+                              thread_states->interp(interp_method, img_vol, bspline_coefs);
+
+      const RayCastITKInterpCPU interp = { vol_interp.GetPointer() };
+      cast_rays(r, interp);
+    }
+  }
+
+  /// \brief Casts a collection of rays using an interpolation functor that
+  ///        takes the continuous index as three scalars.
+  template <class tInterp>
+  void cast_rays(const RangeType& r, const tInterp& vol_interp) const
+  {
+    const size_type num_drr_px = camera_models[0].num_det_rows *
+                                              camera_models[0].num_det_cols;
+    
+    const size_type num_bins = lut.num_bins;
+
+    const size_type last_entry = lut.num_entries() - 1;
+
+    const float lut_min_val = lut.min_val;
+
+    const float one_over_lut_spacing = 1.0f / lut.val_spacing;
+
+    const float* lut_atts = &lut.atts[0];
+
+    // the sums of each bin for a single ray
+    std::array<float,kMAX_NUM_BINS> bin_sums;
+
+    for (size_type range_idx = r.begin(); range_idx < r.end(); ++range_idx)
+    {
+      // recover the original projection, row, column indices
+      const size_type proj_idx    = range_idx / num_drr_px;
+      const size_type off_in_proj = range_idx - (num_drr_px * proj_idx);
+      const size_type row_idx     = off_in_proj / camera_models[0].num_det_cols;
+      const size_type col_idx     = off_in_proj - (camera_models[0].num_det_cols * row_idx);
+
+      const auto& cam = camera_models[cam_model_for_proj[proj_idx]];
+
+      // This point is stored with respect to the camera's
+      // "world" coordinates
+      const Pt3 cur_det_pt_wrt_cam = cam.ind_pt_to_phys_det_pt(Pt2{static_cast<CoordScalar>(col_idx),
+                                                                   static_cast<CoordScalar>(row_idx)});
+
+      // The current transformation from detector coordinates to ITK indices
+      const FrameTransform xform_cam_to_itk_idx = itk_phys_pt_to_itk_idx_xform * xforms_cam_to_itk_phys[proj_idx];
+
+      // Position of the X-Ray source / pinhole point in ITK indices
+      const Pt3 pinhole_wrt_itk_idx = xform_cam_to_itk_idx * cam.pinhole_pt;
+
+      // Position of the current detector element in volume coordinates
+      const Pt3 pinhole_to_det_wrt_itk_idx = (xform_cam_to_itk_idx * cur_det_pt_wrt_cam) - pinhole_wrt_itk_idx;
+
+      CoordScalar t_start = 0;
+      CoordScalar t_stop  = 0;
+
+      constexpr CoordScalar kVOL_BB_STEP_INC_TOL = RayCasterSpectralLineIntCPU::kVOL_BB_STEP_INC_TOL;
+
+      bool inter_vol = false;
+
+      std::tie(inter_vol,t_start,t_stop) = RayRectIntersect(img_aabb_min, img_aabb_max,
+                                                            pinhole_wrt_itk_idx, pinhole_to_det_wrt_itk_idx,
+                                                            false);  // false -> do not limit to line segment
+
+      // Besides intersecting, need to be able to nudge inward a bit to avoid an
+      // ITK crash when interpolating on edge
+      if (inter_vol && ((t_stop - t_start) > CoordScalar(2 * kVOL_BB_STEP_INC_TOL)))
+      {
+        t_start += kVOL_BB_STEP_INC_TOL;
+        t_stop  -= kVOL_BB_STEP_INC_TOL;
+
+        // the first index on the line from source to detector that lies within the volume bounds
+        const Pt3 start_pt_wrt_itk_idx = pinhole_wrt_itk_idx + (t_start * pinhole_to_det_wrt_itk_idx);
+
+        const CoordScalar pinhole_to_det_len_wrt_itk_idx = pinhole_to_det_wrt_itk_idx.norm();
+        const CoordScalar intersect_len_wrt_itk_idx = (t_stop - t_start) * pinhole_to_det_len_wrt_itk_idx;
+
+        // Rotate and scale the step vector to get it wrt ITK indices
+        const CoordScalar step_len_wrt_itk_idx = (xform_cam_to_itk_idx.matrix().block(0,0,3,3) * ((cur_det_pt_wrt_cam - cam.pinhole_pt).normalized() * step_size)).norm();
+
+        const std::int64_t num_steps = static_cast<std::int64_t>(intersect_len_wrt_itk_idx / step_len_wrt_itk_idx);
+
+        const Pt3 step_vec_wrt_itk_idx = pinhole_to_det_wrt_itk_idx *
+                                            (step_len_wrt_itk_idx / pinhole_to_det_len_wrt_itk_idx);
+
+        Pt3 cur_cont_vol_idx = start_pt_wrt_itk_idx;
+
+        std::fill(bin_sums.begin(), bin_sums.begin() + num_bins, 0.0f);
+
+        for (std::int64_t step_idx = 0; step_idx <= num_steps; ++step_idx)
+        {
+          const float v = vol_interp(cur_cont_vol_idx[0], cur_cont_vol_idx[1], cur_cont_vol_idx[2]);
+
+          // the table entries on either side of the sample, the entry of a
+          // sample is computed once and shared by every bin
+          const float t = std::min(std::max((v - lut_min_val) * one_over_lut_spacing, 0.0f),
+                                   static_cast<float>(last_entry));
+
+          const size_type entry_idx = static_cast<size_type>(t);
+
+          const float frac = t - static_cast<float>(entry_idx);
+
+          const float* atts_0 = lut_atts + (entry_idx * num_bins);
+          const float* atts_1 = lut_atts + (std::min(entry_idx + 1, last_entry) * num_bins);
+
+          for (size_type bin_idx = 0; bin_idx < num_bins; ++bin_idx)
+          {
+            bin_sums[bin_idx] += atts_0[bin_idx] + (frac * (atts_1[bin_idx] - atts_0[bin_idx]));
+          }
+
+          cur_cont_vol_idx += step_vec_wrt_itk_idx;
+        }  // for step
+
+        float* dst_bins = bin_line_ints + (range_idx * num_bins);
+
+        for (size_type bin_idx = 0; bin_idx < num_bins; ++bin_idx)
+        {
+          dst_bins[bin_idx] += bin_sums[bin_idx] * step_size;
+        }
+      }  // if RayRectIntersect
+    }  // for range_idx
+  }
+};
+
+}  // un-named
+
+xreg::RayCastSpectralLUT
+xreg::MakeHUToLinAttSpectralLUT(const std::vector<double>& mu_water_for_each_bin,
+                                const std::vector<double>& mu_air_for_each_bin,
+                                const double hu_lower,
+                                const double hu_upper,
+                                const double hu_spacing)
+{
+  const size_type num_bins = mu_water_for_each_bin.size();
+
+  xregASSERT(num_bins == mu_air_for_each_bin.size());
+  xregASSERT(hu_upper > hu_lower);
+  xregASSERT(hu_spacing > 0);
+
+  const size_type num_entries = static_cast<size_type>(std::floor((hu_upper - hu_lower) / hu_spacing)) + 1;
+
+  RayCastSpectralLUT lut;
+
+  lut.min_val     = static_cast<RayCaster::PixelScalar3D>(hu_lower);
+  lut.val_spacing = static_cast<RayCaster::PixelScalar3D>(hu_spacing);
+  lut.num_bins    = num_bins;
+
+  lut.atts.resize(num_entries * num_bins);
+
+  for (size_type entry_idx = 0; entry_idx < num_entries; ++entry_idx)
+  {
+    const double hu_off = entry_idx * hu_spacing;
+
+    for (size_type bin_idx = 0; bin_idx < num_bins; ++bin_idx)
+    {
+      // same conversion as HUToLinAttFilter
+      const double hu_scale = (mu_water_for_each_bin[bin_idx] - mu_air_for_each_bin[bin_idx]) * 1.0e-3;
+
+      lut.atts[(entry_idx * num_bins) + bin_idx] = static_cast<float>(std::max(hu_off * hu_scale, 0.0));
+    }
+  }
+
+  return lut;
+}
+
+void xreg::RayCasterSpectralLineIntCPU::set_spectral_lut(const RayCastSpectralLUT& lut)
+{
+  xregASSERT(lut.num_bins > 0);
+  xregASSERT(lut.num_entries() > 0);
+  xregASSERT(lut.val_spacing > 0);
+
+  if (lut.num_bins > kMAX_NUM_BINS)
+  {
+    xregThrow("Spectral ray casting supports at most %lu bins, not %lu!",
+              static_cast<unsigned long>(kMAX_NUM_BINS), static_cast<unsigned long>(lut.num_bins));
+  }
+
+  if (lut.num_bins != bin_weights_.size())
+  {
+    bin_weights_.assign(lut.num_bins, 1.0f);
+  }
+
+  lut_ = lut;
+}
+
+const xreg::RayCastSpectralLUT& xreg::RayCasterSpectralLineIntCPU::spectral_lut() const
+{
+  return lut_;
+}
+
+void xreg::RayCasterSpectralLineIntCPU::set_bin_weights(const BinWeightList& bin_weights)
+{
+  xregASSERT(bin_weights.size() == lut_.num_bins);
+
+  bin_weights_ = bin_weights;
+}
+
+const xreg::RayCasterSpectralLineIntCPU::BinWeightList&
+xreg::RayCasterSpectralLineIntCPU::bin_weights() const
+{
+  return bin_weights_;
+}
+
+void xreg::RayCasterSpectralLineIntCPU::set_spectral_output(const SpectralOutput output)
+{
+  spectral_output_ = output;
+}
+
+xreg::RayCasterSpectralLineIntCPU::SpectralOutput
+xreg::RayCasterSpectralLineIntCPU::spectral_output() const
+{
+  return spectral_output_;
+}
+
+xreg::size_type xreg::RayCasterSpectralLineIntCPU::num_bins() const
+{
+  return lut_.num_bins;
+}
+
+const std::vector<float>& xreg::RayCasterSpectralLineIntCPU::bin_line_ints() const
+{
+  return bin_line_ints_;
+}
+
+xreg::RayCaster::ProjPtr
+xreg::RayCasterSpectralLineIntCPU::bin_line_int_proj(const size_type proj_idx,
+                                                     const size_type bin_idx) const
+{
+  const size_type num_bins = lut_.num_bins;
+
+  xregASSERT(bin_idx < num_bins);
+
+  const auto& cam = this->camera_models_[this->cam_model_for_proj_[proj_idx]];
+
+  const size_type num_dets = cam.num_det_rows * cam.num_det_cols;
+
+  xregASSERT(bin_line_ints_.size() >= ((proj_idx + 1) * num_dets * num_bins));
+
+  auto img_proj = Proj::New();
+
+  Proj::RegionType proj_region;
+  proj_region.SetIndex(0, 0);
+  proj_region.SetIndex(1, 0);
+  proj_region.SetSize(0, cam.num_det_cols);
+  proj_region.SetSize(1, cam.num_det_rows);
+
+  img_proj->SetRegions(proj_region);
+  img_proj->Allocate();
+
+  const CoordScalar spacings[2] = { cam.det_col_spacing, cam.det_row_spacing };
+  img_proj->SetSpacing(spacings);
+
+  const float* src_bins = &bin_line_ints_[(proj_idx * num_dets * num_bins) + bin_idx];
+
+  PixelScalar2D* dst_buf = img_proj->GetBufferPointer();
+
+  for (size_type pix_idx = 0; pix_idx < num_dets; ++pix_idx)
+  {
+    dst_buf[pix_idx] = src_bins[pix_idx * num_bins];
+  }
+
+  return img_proj;
+}
+
+void xreg::RayCasterSpectralLineIntCPU::compute(const size_type vol_idx)
+{
+  xregASSERT(this->resources_allocated_);
+
+  const size_type num_bins = lut_.num_bins;
+
+  if (!num_bins)
+  {
+    xregThrow("Spectral lookup table has not been set!");
+  }
+
+  if (this->use_bg_projs_)
+  {
+    xregThrow("Background projections are not supported by spectral ray casting!");
+  }
+
+  ParallelExecContextScope exec_scope(this->exec_ctx_.get());
+  
+  // Get the index bounding box (axis-aligned in the index space) of the volume
+  Pt3 img_aabb_min;
+  Pt3 img_aabb_max;
+  std::tie(img_aabb_min,img_aabb_max) = ITKImageIndexBoundsAsEigen(this->vols_[vol_idx].GetPointer());
+
+  // Compute the frame transform from ITK physical space to index space (sR + t)
+  FrameTransform itk_idx_to_itk_phys_pt_xform = ITKImagePhysicalPointTransformsAsEigen(this->vols_[vol_idx].GetPointer());
+
+  FrameTransform itk_phys_pt_to_itk_idx_xform = itk_idx_to_itk_phys_pt_xform.inverse();
+
+  const size_type num_tot_pix = this->num_projs_ *
+        this->camera_models_[0].num_det_rows * this->camera_models_[0].num_det_cols;
+
+  const size_type num_bin_vals = num_tot_pix * num_bins;
+
+  if (bin_line_ints_.size() != num_bin_vals)
+  {
+    // the previous line integrals cannot be accumulated with a different
+    // number of projections or bins
+    bin_line_ints_.assign(num_bin_vals, 0.0f);
+
+    bin_line_ints_mem_.set_bytes(bin_line_ints_.capacity() * sizeof(float));
+  }
+  else if (this->proj_store_meth_ == kRAY_CAST_PIXEL_REPLACE)
+  {
+    std::fill(bin_line_ints_.begin(), bin_line_ints_.end(), 0.0f);
+  }
+
+  RayCastSpectralLineIntFn ray_cast_fn = { this->vols_[vol_idx],
+                                           img_aabb_min,
+                                           img_aabb_max,
+                                           itk_phys_pt_to_itk_idx_xform,
+                                           this->camera_models_,
+                                           this->xforms_cam_to_itk_phys_,
+                                           this->cam_model_for_proj_,
+                                           this->ray_step_size_,
+                                           this->interp_method_,
+                                           this->bspline_coefs(vol_idx),
+                                           &this->thread_state_pool_,
+                                           lut_,
+                                           &bin_line_ints_[0]
+                                         };
+
+  // For every single projection pixel
+  ParallelFor(ray_cast_fn, RangeType(0, num_tot_pix));
+
+  // Combine the bins of each pixel into the projections
+
+  float weight_sum = 0;
+
+  for (const float w : bin_weights_)
+  {
+    weight_sum += w;
+  }
+
+  const bool neg_log = spectral_output_ == kRAY_CAST_SPECTRAL_NEG_LOG_INTENSITY;
+
+  const float* src_bins = &bin_line_ints_[0];
+
+  const float* weights = &bin_weights_[0];
+
+  PixelScalar2D* dst_buf = this->pixel_buf_to_use();
+
+  auto combine_bins_fn = [&] (const RangeType& r)
+  {
+    for (size_type pix_idx = r.begin(); pix_idx < r.end(); ++pix_idx)
+    {
+      const float* cur_bins = src_bins + (pix_idx * num_bins);
+
+      float intensity = 0;
+
+      for (size_type bin_idx = 0; bin_idx < num_bins; ++bin_idx)
+      {
+        intensity += weights[bin_idx] * std::exp(-cur_bins[bin_idx]);
+      }
+
+      dst_buf[pix_idx] = neg_log ? -std::log(intensity / weight_sum) : intensity;
+    }
+  };
+
+  ParallelFor(combine_bins_fn, RangeType(0, num_tot_pix));
+
+  this->sync_to_ocl_.set_modified();
+  this->sync_to_host_.set_modified();
+}
@@ -0,0 +1,153 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGRAYCASTSPECTRALLINEINTCPU_H_
+#define XREGRAYCASTSPECTRALLINEINTCPU_H_
+
+#include "xregRayCastBaseCPU.h"
+
+namespace xreg
+{
+
+/// \brief Lookup table mapping a volume intensity to the linear attenuation
+///        of each energy bin (or to the fraction of each material).
+///
+/// Entry i corresponds to the intensity min_val + i * val_spacing, intensities
+/// in between entries are linearly interpolated and intensities beyond the
+/// table are clamped to the first or last entry.
+struct RayCastSpectralLUT
+{
+  RayCaster::PixelScalar3D min_val     = 0;
+  RayCaster::PixelScalar3D val_spacing = 1;
+
+  size_type num_bins = 0;
+
+  /// \brief The attenuation of each bin for each entry, bins vary fastest
+  std::vector<float> atts;
+
+  size_type num_entries() const
+  {
+    return num_bins ? (atts.size() / num_bins) : 0;
+  }
+};
+
+/// \brief Creates a lookup table from HU to the linear attenuation of each
+///        energy bin.
+///
+/// The conversion of each bin matches HUToLinAttFilter, using the linear
+/// attenuation of water and air at the bin's energy. The table spans
+/// [hu_lower, hu_upper] with a spacing of hu_spacing, so HU values above
+/// hu_upper are clamped.
+RayCastSpectralLUT MakeHUToLinAttSpectralLUT(const std::vector<double>& mu_water_for_each_bin,
+                                             const std::vector<double>& mu_air_for_each_bin,
+                                             const double hu_lower = -1000,
+                                             const double hu_upper = 3000,
+                                             const double hu_spacing = 1);
+
+/// \brief Ray casting of spectral (multi-energy) line integrals on the CPU.
+///
+/// Each ray is marched through the volume (e.g. of HU values) once, mapping
+/// every sample through a RayCastSpectralLUT and accumulating the line
+/// integral of each energy bin. This replaces converting the volume at each
+/// energy and ray casting each converted volume separately.
+///
+/// The line integral of each bin includes the step size, e.g. it is in the
+/// units of the attenuation times mm. The projections store the detected
+/// intensity, sum_k w_k exp(-L_k), where w_k is the weight of bin k (e.g. the
+/// fraction of incident photons times the detector response) and L_k is the
+/// line integral of bin k, or -log of the intensity normalized by sum_k w_k,
+/// which is comparable to a monochromatic line integral. The line integrals
+/// of each bin may also be retrieved.
+///
+/// When accumulating, the line integrals of each bin are accumulated and the
+/// projections are recomputed from the totals, so several volumes may be
+/// combined. Background projections and anti-aliasing are not supported.
+class RayCasterSpectralLineIntCPU : public RayCasterCPU
+{
+public:
+  using BinWeightList = std::vector<float>;
+
+  /// \brief The largest number of bins accumulated by each ray
+  constexpr static size_type kMAX_NUM_BINS = 64;
+
+  enum SpectralOutput
+  {
+    /// \brief The detected intensity: sum_k w_k exp(-L_k)
+    kRAY_CAST_SPECTRAL_INTENSITY = 0,
+
+    /// \brief The negative log of the normalized intensity:
+    ///        -log(sum_k w_k exp(-L_k) / sum_k w_k)
+    kRAY_CAST_SPECTRAL_NEG_LOG_INTENSITY
+  };
+
+  void compute(const size_type vol_idx = 0) override;
+
+  /// \brief Sets the mapping from volume intensity to the attenuation of each
+  ///        bin.
+  ///
+  /// The bin weights are reset to one for each bin when the number of bins
+  /// changes.
+  void set_spectral_lut(const RayCastSpectralLUT& lut);
+
+  const RayCastSpectralLUT& spectral_lut() const;
+
+  /// \brief Sets the weight of each bin used to compute the projections.
+  void set_bin_weights(const BinWeightList& bin_weights);
+
+  const BinWeightList& bin_weights() const;
+
+  /// \brief Sets the quantity stored in the projections, defaults to the
+  ///        detected intensity.
+  void set_spectral_output(const SpectralOutput output);
+
+  SpectralOutput spectral_output() const;
+
+  size_type num_bins() const;
+
+  /// \brief The line integrals of each bin for each pixel, computed by the
+  ///        most recent call to compute().
+  ///
+  /// The pixels are in the same order as the projection buffer, with the
+  /// bins of each pixel stored consecutively.
+  const std::vector<float>& bin_line_ints() const;
+
+  /// \brief Retrieves a (deep) copy of the line integrals of a single bin for
+  ///        a projection.
+  ProjPtr bin_line_int_proj(const size_type proj_idx, const size_type bin_idx) const;
+
+private:
+  RayCastSpectralLUT lut_;
+
+  BinWeightList bin_weights_;
+
+  SpectralOutput spectral_output_ = kRAY_CAST_SPECTRAL_INTENSITY;
+
+  std::vector<float> bin_line_ints_;
+
+  TrackedMemAlloc bin_line_ints_mem_ = TrackedMemAlloc(MemLocation::kHOST, "ray-cast-spectral-bins");
+};
+
+}  // xreg
+
+#endif
@@ -26,13 +26,8 @@
 
 #include <random>
 
-#include <itkLinearInterpolateImageFunction.h>
-#include <itkNearestNeighborInterpolateImageFunction.h>
-#include <itkWindowedSincInterpolateImageFunction.h>
-#include <itkConstantBoundaryCondition.h>
-#include <itkBSplineInterpolateImageFunction.h>
-
 #include "xregITKBasicImageUtils.h"
+#include "xregRayCastInterpCPU.h"
 #include "xregTBBUtils.h"
 #include "xregSpatialPrimitives.h"
 #include "xregExceptionUtils.h"
@@ -71,6 +66,12 @@ struct SimpleSurfaceRayCastFn
 
   const RayCaster::InterpMethod interp_method;  ///< The interpolation method used for fractional indices into the 3D volume
 
+  const Vol* bspline_coefs;  ///< Shared B-spline coefficients of img_vol, null when not using B-spline interpolation
+
+  const RayCastGradVol* grad_vol;  ///< Precomputed gradients of img_vol used for surface normals, null when not used
+
+  RayCastCPUThreadStatePool* thread_states;  ///< The interpolators and random engines kept by each thread
+
   PixelScalar2D* proj_buf;  ///< The large buffer used for storing all projection results
 
   const RayCasterSurRenderShadingParams& sur_render_params;
@@ -79,64 +80,69 @@ struct SimpleSurfaceRayCastFn
 
   const RayCasterCollisionParams& collision_params;
 
+  const RayCastVolBrickGrid* brick_grid;  ///< Used for skipping bricks below the collision threshold, null when not skipping
+
   /// \brief Computation operator - executes a collection of rays cast
   ///
   /// The collection of line integrals is not necessarily restricted to a single projection
   void operator()(const RangeType& r) const
   {
-    using VolInterpType        = itk::InterpolateImageFunction<Vol,CoordScalar>;
-    using VolLinearInterpType  = itk::LinearInterpolateImageFunction<Vol,CoordScalar>;
-    using VolNNInterpType      = itk::NearestNeighborInterpolateImageFunction<Vol,CoordScalar>;
-    using VolBSplineInterpType = itk::BSplineInterpolateImageFunction<Vol,CoordScalar>;
-    using VolSincInterpType    = itk::WindowedSincInterpolateImageFunction<
-                                         Vol,4,itk::Function::LanczosWindowFunction<4>,
-                                         itk::ConstantBoundaryCondition<Vol>,CoordScalar>;
+    if (interp_method == RayCaster::kRAY_CAST_INTERP_NN)
+    {
+      const RayCastVolNNInterpCPU<RayCastVolBufCPU> interp = { MakeRayCastVolBufCPU(img_vol) };
+      cast_rays(r, interp);
+    }
+    else if (interp_method == RayCaster::kRAY_CAST_INTERP_LINEAR)
+    {
+      const RayCastVolLinearInterpCPU<RayCastVolBufCPU> interp = { MakeRayCastVolBufCPU(img_vol) };
+      cast_rays(r, interp);
+    }
+    else
+    {
+      RayCastITKInterpCPU::VolInterp::Pointer vol_interp =
+                              thread_states->interp(interp_method, img_vol, bspline_coefs);
 
-    VolInterpType::Pointer vol_interp;
+      const RayCastITKInterpCPU interp = { vol_interp.GetPointer() };
+      cast_rays(r, interp);
+    }
+  }
 
-    switch (interp_method)
+  /// \brief Selects the anti-aliasing specialization once for a collection of rays.
+  template <class tInterp>
+  void cast_rays(const RangeType& r, const tInterp& vol_interp) const
+  {
+    if (aa_fact != 0)
     {
-      case RayCaster::kRAY_CAST_INTERP_NN:
-        vol_interp = VolNNInterpType::New();
-        break;
-      case RayCaster::kRAY_CAST_INTERP_SINC:
-        vol_interp = VolSincInterpType::New();
-        break;
-      case RayCaster::kRAY_CAST_INTERP_BSPLINE:
-      {
-        auto bspline_interp = VolBSplineInterpType::New();
-        bspline_interp->SetSplineOrder(3);
-        vol_interp = bspline_interp;
-      }
-        break;
-      case RayCaster::kRAY_CAST_INTERP_LINEAR:
-      default:
-        vol_interp = VolLinearInterpType::New();
-        break;
+      cast_rays_impl<true>(r, vol_interp);
     }
+    else
+    {
+      cast_rays_impl<false>(r, vol_interp);
+    }
+  }
 
-    vol_interp->SetInputImage(img_vol);
-
+  /// \brief Casts a collection of rays using an interpolation functor that
+  ///        takes the continuous index as three scalars.
+  ///
+  /// Anti-aliasing is a template parameter so that the random jittering is
+  /// not evaluated per ray when it is disabled.
+  template <bool tDoAA, class tInterp>
+  void cast_rays_impl(const RangeType& r, const tInterp& vol_interp) const
+  {
     const size_type num_drr_px = camera_models[0].num_det_rows *
                                               camera_models[0].num_det_cols;
     
-    const bool do_aa = aa_fact != 0;
-    const size_type num_rays_per_pixel = do_aa ? aa_fact : 1;
+    const size_type num_rays_per_pixel = tDoAA ? aa_fact : 1;
 
-    using RNGEngine = std::mt19937;
+    using RNGEngine = RayCastCPUThreadStatePool::RNGEngine;
     using NormalDist = std::normal_distribution<CoordScalar>;
     using UniformDist = std::uniform_real_distribution<CoordScalar>; 
 
-    RNGEngine rng_eng;
+    // the engine of this thread is seeded once and shared by its tasks
+    RNGEngine* rng_eng = tDoAA ? &thread_states->rng_eng() : nullptr;
     //NormalDist rng_dist(0,1); 
     UniformDist rng_dist(-0.5, 0.5);
 
-    if (do_aa)
-    {
-      std::random_device rd;
-      rng_eng.seed(rd());
-    }
-
     for (size_type range_idx = r.begin(); range_idx < r.end(); ++range_idx)
     {
       // recover the original projection, row, column indices
@@ -148,7 +154,6 @@ struct SimpleSurfaceRayCastFn
       const auto& cam = camera_models[cam_model_for_proj[proj_idx]];
       
       Pt2 tmp_aa_det_idx;
-      tmp_aa_det_idx[2] = cam.focal_len;
 
       PixelScalar2D aa_sum = 0;
 
@@ -157,10 +162,10 @@ struct SimpleSurfaceRayCastFn
         tmp_aa_det_idx(0) = col_idx;
         tmp_aa_det_idx(1) = row_idx;
 
-        if (do_aa)
+        if (tDoAA)
         {
-          tmp_aa_det_idx(0) += rng_dist(rng_eng);
-          tmp_aa_det_idx(1) += rng_dist(rng_eng);
+          tmp_aa_det_idx(0) += rng_dist(*rng_eng);
+          tmp_aa_det_idx(1) += rng_dist(*rng_eng);
         }
         
         // This point is stored with respect to the camera's
@@ -207,25 +212,18 @@ struct SimpleSurfaceRayCastFn
           // Rotate and scale the step vector to get it wrt ITK indices
           const CoordScalar step_len_wrt_itk_idx = (xform_cam_to_itk_idx.matrix().block(0,0,3,3) * ((cur_det_pt_wrt_cam - cam.pinhole_pt).normalized() * step_size)).norm();
 
-          const size_type num_steps = static_cast<size_type>(intersect_len_wrt_itk_idx / step_len_wrt_itk_idx);
+          const std::int64_t num_steps = static_cast<std::int64_t>(intersect_len_wrt_itk_idx / step_len_wrt_itk_idx);
 
-          // We'll use the ITK objects now, since that is the easiest interface with itk::Image and itk interpolation
-          itk::ContinuousIndex<CoordScalar,3> cur_cont_vol_idx;
-          cur_cont_vol_idx[0] = start_pt_wrt_itk_idx[0];
-          cur_cont_vol_idx[1] = start_pt_wrt_itk_idx[1];
-          cur_cont_vol_idx[2] = start_pt_wrt_itk_idx[2];
-
-          // Index to be used for retrieving values to perform gradient computation
-          itk::ContinuousIndex<CoordScalar,3> tmp_cont_vol_idx_grad;
+          Pt3 cur_cont_vol_idx = start_pt_wrt_itk_idx;
 
           const CoordScalar scale_to_step = step_len_wrt_itk_idx / pinhole_to_det_len_wrt_itk_idx;
-          itk::Vector<CoordScalar,3> tmp_step_vec_wrt_itk_idx;
-          tmp_step_vec_wrt_itk_idx[0] = pinhole_to_det_wrt_itk_idx[0] * scale_to_step;
-          tmp_step_vec_wrt_itk_idx[1] = pinhole_to_det_wrt_itk_idx[1] * scale_to_step;
-          tmp_step_vec_wrt_itk_idx[2] = pinhole_to_det_wrt_itk_idx[2] * scale_to_step;
+
+          const Pt3 step_vec_wrt_itk_idx = pinhole_to_det_wrt_itk_idx * scale_to_step;
+
+          // step vector used for backtracking - repeatedly cut in half
+          Pt3 tmp_step_vec_wrt_itk_idx = step_vec_wrt_itk_idx;
 
           PixelScalar3D cur_vol_val = 0;
-          PixelScalar3D cur_vol_val_for_grad[2] = { 0, 0 };
 
           // First, this will be used for gradient calcluation, of which the
           // negative estimates the surface normal. Next, it will be used to estimate
@@ -238,10 +236,33 @@ struct SimpleSurfaceRayCastFn
           //CoordScalar trans_thickness_times_grad_norm = 0;
           //PixelScalar2D cur_vol_val_dist_from_thresh = 0;
 
-          for (size_type step_idx = 0; step_idx <= num_steps; ++step_idx)
+          for (std::int64_t step_idx = 0; step_idx <= num_steps; ++step_idx)
           {
+            if (brick_grid)
+            {
+              // jump over bricks that are entirely below the collision threshold
+              const RayCastBrickIsBelowThresh below_thresh = { *brick_grid, collision_params.thresh };
+
+              const std::int64_t next_step_idx = RayCastSkipBricks(*brick_grid, below_thresh,
+                                                                   start_pt_wrt_itk_idx,
+                                                                   step_vec_wrt_itk_idx,
+                                                                   step_idx, num_steps);
+
+              if (next_step_idx > num_steps)
+              {
+                break;
+              }
+              else if (next_step_idx != step_idx)
+              {
+                step_idx = next_step_idx;
+
+                cur_cont_vol_idx = start_pt_wrt_itk_idx +
+                                     (static_cast<CoordScalar>(step_idx) * step_vec_wrt_itk_idx);
+              }
+            }
+
             //xregASSERT(vol_interp->IsInsideBuffer(cur_cont_vol_idx));
-            cur_vol_val = vol_interp->EvaluateAtContinuousIndex(cur_cont_vol_idx);
+            cur_vol_val = vol_interp(cur_cont_vol_idx[0], cur_cont_vol_idx[1], cur_cont_vol_idx[2]);
             if (cur_vol_val >= collision_params.thresh)
             {
               // if we're not at the source, perform some binary search/back-tracking
@@ -254,45 +275,22 @@ struct SimpleSurfaceRayCastFn
                    ++sur_bin_step_idx)
               {
                 tmp_step_vec_wrt_itk_idx *= 0.5;
-                cur_cont_vol_idx -=
-                  (cur_vol_val >= collision_params.thresh) ?
-                                    tmp_step_vec_wrt_itk_idx : -tmp_step_vec_wrt_itk_idx;
+                if (cur_vol_val >= collision_params.thresh)
+                {
+                  cur_cont_vol_idx -= tmp_step_vec_wrt_itk_idx;
+                }
+                else
+                {
+                  cur_cont_vol_idx += tmp_step_vec_wrt_itk_idx;
+                }
 
-                cur_vol_val = vol_interp->EvaluateAtContinuousIndex(cur_cont_vol_idx);
+                cur_vol_val = vol_interp(cur_cont_vol_idx[0], cur_cont_vol_idx[1], cur_cont_vol_idx[2]);
               }
 
               // approximate the derivative at this point with finite differencing adjacent indices
               // NOTE: these are wrt image (index) axes.
 
-              // Gradient in X direction
-              tmp_cont_vol_idx_grad = cur_cont_vol_idx;
-              tmp_cont_vol_idx_grad[0] -= 1;
-
-              cur_vol_val_for_grad[0] = vol_interp->EvaluateAtContinuousIndex(tmp_cont_vol_idx_grad);
-              tmp_cont_vol_idx_grad[0] += 2;
-              cur_vol_val_for_grad[1] = vol_interp->EvaluateAtContinuousIndex(tmp_cont_vol_idx_grad);
-
-              tmp_vec[0] = cur_vol_val_for_grad[1] - cur_vol_val_for_grad[0];
-
-              // Gradient in Y direction
-              tmp_cont_vol_idx_grad[0] = cur_cont_vol_idx[0];
-              tmp_cont_vol_idx_grad[1] -= 1;
-
-              cur_vol_val_for_grad[0] = vol_interp->EvaluateAtContinuousIndex(tmp_cont_vol_idx_grad);
-              tmp_cont_vol_idx_grad[1] += 2;
-              cur_vol_val_for_grad[1] = vol_interp->EvaluateAtContinuousIndex(tmp_cont_vol_idx_grad);
-
-              tmp_vec[1] = cur_vol_val_for_grad[1] - cur_vol_val_for_grad[0];
-
-              // Gradient in Z direction
-              tmp_cont_vol_idx_grad[1] = cur_cont_vol_idx[1];
-              tmp_cont_vol_idx_grad[2] -= 1;
-
-              cur_vol_val_for_grad[0] = vol_interp->EvaluateAtContinuousIndex(tmp_cont_vol_idx_grad);
-              tmp_cont_vol_idx_grad[2] += 2;
-              cur_vol_val_for_grad[1] = vol_interp->EvaluateAtContinuousIndex(tmp_cont_vol_idx_grad);
-
-              tmp_vec[2] = cur_vol_val_for_grad[1] - cur_vol_val_for_grad[0];
+              tmp_vec = RayCastSurGradCPU(vol_interp, grad_vol, cur_cont_vol_idx);
 
               tmp_vec *= -0.5;
               tmp_vec.normalize();
@@ -332,7 +330,7 @@ struct SimpleSurfaceRayCastFn
               break;
             }
 
-            cur_cont_vol_idx += tmp_step_vec_wrt_itk_idx;
+            cur_cont_vol_idx += step_vec_wrt_itk_idx;
           }  // for step
         }  // if RayRectIntersect
         aa_sum += val / num_rays_per_pixel;
@@ -348,11 +346,13 @@ struct SimpleSurfaceRayCastFn
 void xreg::RayCasterSurRenderCPU::compute(const size_type vol_idx)
 {
   xregASSERT(this->resources_allocated_);
+
+  ParallelExecContextScope exec_scope(this->exec_ctx_.get());
   
   // Get the index bounding box (axis-aligned in the index space) of the volume
   Pt3 img_aabb_min;
   Pt3 img_aabb_max;
-  std::tie(img_aabb_min,img_aabb_min) = ITKImageIndexBoundsAsEigen(this->vols_[vol_idx].GetPointer());
+  std::tie(img_aabb_min,img_aabb_max) = ITKImageIndexBoundsAsEigen(this->vols_[vol_idx].GetPointer());
 
   // Compute the frame transform from ITK physical space to index space (sR + t)
   const FrameTransform itk_idx_to_itk_phys_pt_xform =
@@ -362,6 +362,29 @@ void xreg::RayCasterSurRenderCPU::compute(const size_type vol_idx)
 
   this->pre_compute();
 
+  const RayCastVolBrickGrid* brick_grid = nullptr;
+
+  if (this->use_empty_space_skipping_)
+  {
+    brick_grid = &this->vol_brick_grids_[vol_idx];
+
+    // When empty voxels are always below the collision threshold, the rays
+    // can be clipped to the non-empty voxels
+    if (this->collision_params().thresh > this->empty_space_thresh_)
+    {
+      if (brick_grid->any_non_empty)
+      {
+        img_aabb_min = brick_grid->non_empty_idx_min;
+        img_aabb_max = brick_grid->non_empty_idx_max;
+      }
+      else
+      {
+        // make the bounds degenerate so that no intersections are found
+        img_aabb_max = img_aabb_min;
+      }
+    }
+  }
+
   SimpleSurfaceRayCastFn ray_cast_fn = { this->aa_fact_,
                                          this->vols_[vol_idx],
                                          img_aabb_min,
@@ -373,10 +396,14 @@ void xreg::RayCasterSurRenderCPU::compute(const size_type vol_idx)
                                          this->cam_model_for_proj_,
                                          this->ray_step_size_,
                                          this->interp_method_,
+                                         this->bspline_coefs(vol_idx),
+                                         this->use_precomputed_grad_vols() ? &this->grad_vol(vol_idx) : nullptr,
+                                         &this->thread_state_pool_,
                                          this->pixel_buf_to_use(),
                                          this->surface_render_params(),
                                          this->default_bg_pixel_val_,
-                                         this->collision_params()
+                                         this->collision_params(),
+                                         brick_grid
                                        };
 
   // For every single projection pixel
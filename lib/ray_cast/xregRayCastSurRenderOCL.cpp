@@ -28,6 +28,7 @@
 #include <boost/compute/types/struct.hpp>
 
 #include "xregAssert.h"
+#include "xregOpenCLProgCache.h"
 
 //////////////////////////////////////////////////////////////////////
 
@@ -123,7 +124,8 @@ __kernel void xregSurRenderKernel1(const RayCastArgs args,
 
     for (ulong step_idx = 0; step_idx <= num_steps; ++step_idx, cur_cont_vol_idx += step_vec_wrt_itk_idx)
     {
-      if (read_imagef(vol_tex, sampler, cur_cont_vol_idx + tex_coords_off).x >= sur_render_args.thresh)
+      if (xregVolTexVal(read_imagef(vol_tex, sampler, cur_cont_vol_idx + tex_coords_off),
+                        args.vol_tex_scale, args.vol_tex_offset).x >= sur_render_args.thresh)
       {
         // The 5th, 6th, and 7th elements will store the initial point of intersection, before any backtracking
         dst_step_vecs_and_intersect_pts_wrt_itk_idx[idx].s4 = cur_cont_vol_idx.x;
@@ -141,6 +143,8 @@ __kernel void xregSurRenderKernel1(const RayCastArgs args,
 __kernel void xregSurRenderKernel2(const RayCastArgs args,
                                    const RayCastSurRenderArgs sur_render_args,
                                    image3d_t vol_tex,
+                                   image3d_t grad_tex,
+                                   const int use_grad_tex,
                                    __global const float8* dst_step_vecs_and_intersect_pts_wrt_itk_idx,
                                    __global float* dst_intensities)
 {
@@ -177,7 +181,8 @@ __kernel void xregSurRenderKernel2(const RayCastArgs args,
       {
         step_vec_wrt_itk_idx *= 0.5f;
 
-        cur_cont_vol_idx += (read_imagef(vol_tex, sampler, cur_cont_vol_idx).x >= sur_render_args.thresh) ?
+        cur_cont_vol_idx += (xregVolTexVal(read_imagef(vol_tex, sampler, cur_cont_vol_idx),
+                                           args.vol_tex_scale, args.vol_tex_offset).x >= sur_render_args.thresh) ?
                                   step_vec_wrt_itk_idx : -step_vec_wrt_itk_idx;
       }
 
@@ -185,20 +190,32 @@ __kernel void xregSurRenderKernel2(const RayCastArgs args,
 
       // approximate the derivative at this point with finite differencing adjacent indices
       // NOTE: these are wrt image (index) axes.
+      //       The texture values may be used directly, since the gradient
+      //       is normalized and the texture scale is positive.
 
       float3 tmp_vec;
 
-      // Gradient in X Direction:
-      tmp_vec.x = read_imagef(vol_tex, sampler, (float4) (cur_cont_vol_idx.x + 1, cur_cont_vol_idx.y, cur_cont_vol_idx.z, cur_cont_vol_idx.w)).x -
-                  read_imagef(vol_tex, sampler, (float4) (cur_cont_vol_idx.x - 1, cur_cont_vol_idx.y, cur_cont_vol_idx.z, cur_cont_vol_idx.w)).x;
+      if (use_grad_tex)
+      {
+        // precomputed central differences, interpolated with a single fetch
+        const float4 g = read_imagef(grad_tex, sampler, cur_cont_vol_idx);
 
-      // Gradient in Y Direction:
-      tmp_vec.y = read_imagef(vol_tex, sampler, (float4) (cur_cont_vol_idx.x, cur_cont_vol_idx.y + 1, cur_cont_vol_idx.z, cur_cont_vol_idx.w)).x -
-                  read_imagef(vol_tex, sampler, (float4) (cur_cont_vol_idx.x, cur_cont_vol_idx.y - 1, cur_cont_vol_idx.z, cur_cont_vol_idx.w)).x;
+        tmp_vec = (float3) (g.x, g.y, g.z);
+      }
+      else
+      {
+        // Gradient in X Direction:
+        tmp_vec.x = read_imagef(vol_tex, sampler, (float4) (cur_cont_vol_idx.x + 1, cur_cont_vol_idx.y, cur_cont_vol_idx.z, cur_cont_vol_idx.w)).x -
+                    read_imagef(vol_tex, sampler, (float4) (cur_cont_vol_idx.x - 1, cur_cont_vol_idx.y, cur_cont_vol_idx.z, cur_cont_vol_idx.w)).x;
 
-      // Gradient in Z Direction:
-      tmp_vec.z = read_imagef(vol_tex, sampler, (float4) (cur_cont_vol_idx.x, cur_cont_vol_idx.y, cur_cont_vol_idx.z + 1, cur_cont_vol_idx.w)).x -
-                  read_imagef(vol_tex, sampler, (float4) (cur_cont_vol_idx.x, cur_cont_vol_idx.y, cur_cont_vol_idx.z - 1, cur_cont_vol_idx.w)).x;
+        // Gradient in Y Direction:
+        tmp_vec.y = read_imagef(vol_tex, sampler, (float4) (cur_cont_vol_idx.x, cur_cont_vol_idx.y + 1, cur_cont_vol_idx.z, cur_cont_vol_idx.w)).x -
+                    read_imagef(vol_tex, sampler, (float4) (cur_cont_vol_idx.x, cur_cont_vol_idx.y - 1, cur_cont_vol_idx.z, cur_cont_vol_idx.w)).x;
+
+        // Gradient in Z Direction:
+        tmp_vec.z = read_imagef(vol_tex, sampler, (float4) (cur_cont_vol_idx.x, cur_cont_vol_idx.y, cur_cont_vol_idx.z + 1, cur_cont_vol_idx.w)).x -
+                    read_imagef(vol_tex, sampler, (float4) (cur_cont_vol_idx.x, cur_cont_vol_idx.y, cur_cont_vol_idx.z - 1, cur_cont_vol_idx.w)).x;
+      }
 
       tmp_vec /= (-0.5f * xregFloat3Norm(tmp_vec));
 
@@ -255,8 +272,7 @@ void xreg::RayCasterSurRenderOCL::allocate_resources()
      << boost::compute::type_definition<RayCasterSurRenderOCL::RayCastSurRenderArgs>()
      << kRAY_CASTING_SUR_RENDER_OPENCL_SRC;
 
-  bc::program prog = bc::program::create_with_source(ss.str(), ctx_);
-  prog.build();
+  bc::program prog = BuildOpenCLProg(ss.str(), ctx_);
 
   dev_kernel1_ = prog.create_kernel("xregSurRenderKernel1");
 
@@ -297,7 +313,7 @@ void xreg::RayCasterSurRenderOCL::compute(const size_type vol_idx)
 
   dev_kernel1_.set_arg(1, sizeof(sur_args), &sur_args);
 
-  dev_kernel1_.set_arg(2, det_pts_dev_);
+  dev_kernel1_.set_arg(2, *det_pts_dev_);
 
   dev_kernel1_.set_arg(3, vol_texs_dev_[vol_idx]);
 
@@ -312,12 +328,13 @@ void xreg::RayCasterSurRenderOCL::compute(const size_type vol_idx)
   std::size_t global_work_size = ray_cast_kernel_args_.num_det_pts * this->num_projs_;
   //std::size_t local_work_size = 512;  passing null lets open CL pick a local size
 
-  cmd_queue_.enqueue_nd_range_kernel(dev_kernel1_,
-                                     1, // dim
-                                     0, // null offset -> start at 0
-                                     &global_work_size,
-                                     0  // passing null lets open CL pick a local size
-                                    ).wait();
+  finish_kernel_launch(cmd_queue_.enqueue_nd_range_kernel(dev_kernel1_,
+                                                          1, // dim
+                                                          0, // null offset -> start at 0
+                                                          &global_work_size,
+                                                          0  // passing null lets open CL pick a local size
+                                                         ),
+                       "xregSurRenderKernel1");
 
 
   dev_kernel2_.set_arg(0, sizeof(ray_cast_kernel_args_), &ray_cast_kernel_args_);
@@ -326,16 +343,21 @@ void xreg::RayCasterSurRenderOCL::compute(const size_type vol_idx)
 
   dev_kernel2_.set_arg(2, vol_texs_dev_[vol_idx]);
 
-  dev_kernel2_.set_arg(3, step_vecs_and_intersect_pts_wrt_itk_idx_dev_);
+  dev_kernel2_.set_arg(3, grad_tex(vol_idx));
+
+  dev_kernel2_.set_arg(4, boost::compute::int_(has_grad_tex(vol_idx) ? 1 : 0));
+
+  dev_kernel2_.set_arg(5, step_vecs_and_intersect_pts_wrt_itk_idx_dev_);
 
-  dev_kernel2_.set_arg(4, *proj_pixels_dev_to_use_);
+  dev_kernel2_.set_arg(6, *proj_pixels_dev_to_use_);
 
-  cmd_queue_.enqueue_nd_range_kernel(dev_kernel2_,
-                                     1, // dim
-                                     0, // null offset -> start at 0
-                                     &global_work_size,
-                                     0  // passing null lets open CL pick a local size
-                                    ).wait();
+  finish_kernel_launch(cmd_queue_.enqueue_nd_range_kernel(dev_kernel2_,
+                                                          1, // dim
+                                                          0, // null offset -> start at 0
+                                                          &global_work_size,
+                                                          0  // passing null lets open CL pick a local size
+                                                         ),
+                       "xregSurRenderKernel2");
 
   compute_helper_post_kernels(vol_idx);
 }
@@ -24,6 +24,10 @@
 
 #include "xregRayCastSyncBuf.h"
 
+#include <algorithm>
+
+#include "xregOpenCLProfiling.h"
+
 xreg::RayCastSyncBuf::HostBuf::HostBuf(BufElem* b, const size_type l)
   : buf(b), len(l)
 { }
@@ -47,6 +51,11 @@ void xreg::RayCastSyncBuf::set_range(const size_type start, const size_type end)
 }
 
 
+void xreg::RayCastSyncHostBuf::sync_range(const size_type, const size_type)
+{
+  sync();
+}
+
 void xreg::RayCastSyncHostBufFromHost::set_host(HostVec& h)
 {
   host_buf_.buf = &h[0];
@@ -75,46 +84,140 @@ xreg::RayCastSyncHostBufFromOCL::RayCastSyncHostBufFromOCL(OCLBuf& ocl_buf, OCLQ
   : ocl_buf_(&ocl_buf), ocl_queue_(ocl_queue)
 { }
 
+xreg::RayCastSyncHostBufFromOCL::~RayCastSyncHostBufFromOCL()
+{
+  free_owned_host();
+}
+
 void xreg::RayCastSyncHostBufFromOCL::set_host(HostVec& h)
 {
-  host_buf_.buf = &h[0];
-  host_buf_.len = h.size();
+  set_host(h.empty() ? nullptr : &h[0], h.size());
 }
 
 void xreg::RayCastSyncHostBufFromOCL::set_host(BufElem* host_buf, const size_type len)
 {
+  free_owned_host();
+
   host_buf_.buf = host_buf;
   host_buf_.len = len;
+
+  this->modified_ = true;
 }
 
 void xreg::RayCastSyncHostBufFromOCL::set_ocl(OCLBuf* ocl_buf, OCLQueue& ocl_queue)
 {
+  if (pinned_ptr_ && (ocl_queue.get_context() != ocl_queue_.get_context()))
+  {
+    // the pinned buffer belongs to the previous context, it will be
+    // re-allocated by the next call to alloc()
+    free_owned_host();
+  }
+
   ocl_buf_   = ocl_buf;
   ocl_queue_ = ocl_queue;
+
+  this->modified_ = true;
 }
 
 void xreg::RayCastSyncHostBufFromOCL::sync()
 {
-  // TODO: MAKE THREAD SAFE
+  const size_type ocl_buf_len = ocl_buf_->size();
+
+  sync_range(this->range_start_,
+             (this->range_end_ == this->kRANGE_AT_BUF_END) ? ocl_buf_len : this->range_end_);
+}
+
+void xreg::RayCastSyncHostBufFromOCL::sync_range(const size_type start, const size_type end)
+{
+  std::lock_guard<std::mutex> lock(sync_mutex_);
+
   if (this->modified_)
   {
-    auto ocl_buf_end = (this->range_end_ == this->kRANGE_AT_BUF_END) ?
-                            ocl_buf_->end() : (ocl_buf_->begin() + this->range_end_);
-
-    boost::compute::copy(ocl_buf_->begin() + this->range_start_, ocl_buf_end,
-                         host_buf_.buf + this->range_start_,
-                         ocl_queue_);
+    synced_ranges_.clear();
     this->modified_ = false;
   }
+
+  // only elements in the range set on this object are read
+  const size_type range_end = (this->range_end_ == this->kRANGE_AT_BUF_END) ?
+                                    ocl_buf_->size() : this->range_end_;
+
+  const size_type s = std::max(start, this->range_start_);
+  const size_type e = std::min(end, range_end);
+
+  if (s < e)
+  {
+    for (const auto& r : synced_ranges_)
+    {
+      if ((r.first <= s) && (e <= r.second))
+      {
+        // already up to date
+        return;
+      }
+    }
+
+    RecordOpenCLTransferEvent("SyncHostBuf",
+                              ocl_queue_.enqueue_read_buffer(ocl_buf_->get_buffer(),
+                                                             s * sizeof(BufElem),
+                                                             (e - s) * sizeof(BufElem),
+                                                             host_buf_.buf + s));
+
+    synced_ranges_.push_back(SyncedRange(s, e));
+  }
 }
 
 void xreg::RayCastSyncHostBufFromOCL::alloc()
 {
-  if (!host_buf_.buf)
+  const size_type len = ocl_buf_->size();
+
+  if (owns_host_buf_ && (host_buf_.len < len))
   {
-    host_vec_.resize(ocl_buf_->size());
-    host_buf_.buf = &host_vec_[0];
-    host_buf_.len = ocl_buf_->size();
+    free_owned_host();
+  }
+
+  if (!host_buf_.buf && len)
+  {
+    // The host buffer matches the capacity of the device buffer, so that it
+    // is not reallocated when the device buffer is resized within its capacity
+    const size_type alloc_len = std::max(len, static_cast<size_type>(ocl_buf_->capacity()));
+
+    if (use_pinned_host_)
+    {
+      namespace bc = boost::compute;
+
+      const size_type nbytes = alloc_len * sizeof(BufElem);
+
+      try
+      {
+        pinned_buf_ = bc::buffer(ocl_queue_.get_context(), nbytes,
+                                 bc::buffer::read_write | bc::buffer::alloc_host_ptr);
+
+        pinned_ptr_ = ocl_queue_.enqueue_map_buffer(pinned_buf_, bc::command_queue::map_read |
+                                                                 bc::command_queue::map_write,
+                                                    0, nbytes);
+
+        host_buf_.buf = static_cast<BufElem*>(pinned_ptr_);
+      }
+      catch (bc::opencl_error&)
+      {
+        // fall back to pageable memory
+        pinned_buf_ = bc::buffer();
+        pinned_ptr_ = nullptr;
+      }
+    }
+
+    if (!host_buf_.buf)
+    {
+      host_vec_.resize(alloc_len);
+      host_buf_.buf = &host_vec_[0];
+    }
+
+    host_buf_.len = alloc_len;
+
+    owns_host_buf_ = true;
+
+    owned_host_mem_.set_bytes(alloc_len * sizeof(BufElem));
+
+    this->modified_ = true;
   }
 }
 
@@ -122,6 +225,39 @@ xreg::RayCastSyncHostBufFromOCL::HostBuf& xreg::RayCastSyncHostBufFromOCL::host_
 {
   return host_buf_;
 }
+
+bool xreg::RayCastSyncHostBufFromOCL::owns_host_buf() const
+{
+  return owns_host_buf_;
+}
+
+void xreg::RayCastSyncHostBufFromOCL::set_use_pinned_host(const bool use_pinned)
+{
+  use_pinned_host_ = use_pinned;
+}
+
+void xreg::RayCastSyncHostBufFromOCL::free_owned_host()
+{
+  if (pinned_ptr_)
+  {
+    ocl_queue_.enqueue_unmap_buffer(pinned_buf_, pinned_ptr_).wait();
+
+    pinned_ptr_ = nullptr;
+  }
+
+  pinned_buf_ = boost::compute::buffer();
+
+  HostVec().swap(host_vec_);
+
+  if (owns_host_buf_)
+  {
+    host_buf_ = HostBuf();
+
+    owns_host_buf_ = false;
+
+    owned_host_mem_.set_bytes(0);
+  }
+}
   
 xreg::RayCastSyncOCLBuf::RayCastSyncOCLBuf(OCLBuf& ocl_buf)
   : ocl_buf_(&ocl_buf) // TODO: what about queue?
@@ -190,5 +326,7 @@ void xreg::RayCastSyncOCLBufFromHost::sync()
 void xreg::RayCastSyncOCLBufFromHost::alloc()
 {
   this->ocl_buf_->resize(host_buf_.len);
+
+  ocl_mem_.set_bytes(host_buf_.len * sizeof(BufElem));
 }
 
@@ -25,9 +25,15 @@
 #ifndef XREGRAYCASTSYNCBUF_H_
 #define XREGRAYCASTSYNCBUF_H_
 
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <boost/compute/buffer.hpp>
 #include <boost/compute/container/vector.hpp>
 
 #include "xregCommon.h"
+#include "xregMemTracking.h"
 
 namespace xreg
 {
@@ -81,6 +87,13 @@ class RayCastSyncHostBuf : public RayCastSyncBuf
 {
 public:
   virtual HostBuf& host_buf() = 0;
+
+  /// \brief Synchronizes only the elements in [start, end) onto the host.
+  ///
+  /// This is useful when a consumer only requires a subset of the buffer,
+  /// e.g. a similarity metric using some of the projections. The default
+  /// implementation synchronizes the entire range.
+  virtual void sync_range(const size_type start, const size_type end);
 };
 
 /// This should be created by an object working with data on the host and a
@@ -106,6 +119,13 @@ private:
 /// This should be created by an object working with data on the open CL device and a
 /// reference/pointer will be passed to an object that needs this data, but will
 /// process it on the host.
+///
+/// When a host buffer is not provided, alloc() creates one that is owned by
+/// this object. The owned buffer is page-locked (pinned) memory, allocated by
+/// the OpenCL implementation and mapped for the lifetime of this object, so
+/// that reading from the device does not require staging through an
+/// intermediate buffer. Pageable memory is used when pinned memory is
+/// disabled or cannot be allocated.
 class RayCastSyncHostBufFromOCL : public RayCastSyncHostBuf
 {
 public:
@@ -113,24 +133,66 @@ public:
 
   RayCastSyncHostBufFromOCL(OCLBuf& ocl_buf, OCLQueue& ocl_queue);
 
+  ~RayCastSyncHostBufFromOCL();
+
+  /// \brief Use an external host buffer, a null pointer indicates that a
+  ///        buffer should be allocated by alloc().
   void set_host(HostVec& h);
 
+  /// \brief Use an external host buffer, a null pointer indicates that a
+  ///        buffer should be allocated by alloc().
   void set_host(BufElem* host_buf, const size_type len);
 
   void set_ocl(OCLBuf* ocl_buf, OCLQueue& ocl_queue);
 
   void sync();
 
+  /// \brief Reads the elements in [start, end) from the device, unless they
+  ///        have already been read since the last modification.
+  void sync_range(const size_type start, const size_type end) override;
+
+  /// \brief Allocates the host buffer when an external buffer has not been
+  ///        provided, or when the owned buffer is smaller than the device
+  ///        buffer.
   void alloc();
 
   HostBuf& host_buf();
 
+  /// \brief Indicates if the host buffer was allocated by this object.
+  bool owns_host_buf() const;
+
+  /// \brief Indicates if host buffers allocated by this object should use
+  ///        pinned memory, the default is true.
+  void set_use_pinned_host(const bool use_pinned);
+
 private:
+  using SyncedRange = std::pair<size_type,size_type>;
+
+  void free_owned_host();
+
   OCLBuf*  ocl_buf_ = nullptr;
   OCLQueue ocl_queue_;
 
   HostBuf host_buf_;
   HostVec host_vec_;
+
+  bool owns_host_buf_ = false;
+
+  bool use_pinned_host_ = true;
+
+  boost::compute::buffer pinned_buf_;
+
+  void* pinned_ptr_ = nullptr;
+
+  TrackedMemAlloc owned_host_mem_ = TrackedMemAlloc(MemLocation::kHOST, "ray-cast-sync-host-buf");
+
+  /// \brief Ranges of elements read from the device since the last
+  ///        modification.
+  std::vector<SyncedRange> synced_ranges_;
+
+  /// \brief Serializes sync_range() calls, e.g. made by several similarity
+  ///        metrics computed concurrently.
+  std::mutex sync_mutex_;
 };
 
 /// \brief Base class for synchronizing data to be processed on a device.
@@ -185,10 +247,16 @@ public:
 
   void sync();
 
+  /// \brief Resizes the device buffer to the length of the host buffer.
+  ///
+  /// The device buffer's memory is recorded as tracked device memory by this
+  /// object, since it exists to hold the copy of the host buffer.
   void alloc();
 
 private:
   HostBuf host_buf_;
+
+  TrackedMemAlloc ocl_mem_ = TrackedMemAlloc(MemLocation::kDEVICE, "ray-cast-sync-dev-buf");
 };
 
 }  // xreg
@@ -0,0 +1,552 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregRayCastTetraMeshCPU.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+
+#include "xregAssert.h"
+#include "xregExceptionUtils.h"
+#include "xregTBBUtils.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+/// \brief Indicates a boundary face, without an adjacent tetrahedron
+constexpr size_type kNO_NEIGHBOR = ~size_type(0);
+
+/// \brief Number of detector rows rasterized by each task
+constexpr size_type kTETRA_RASTER_ROW_BLOCK_SIZE = 16;
+
+/// \brief A boundary face facing the source, projected onto the detector.
+struct ProjEntryFace
+{
+  /// \brief Projected vertices, in continuous detector indices, ordered
+  ///        counter-clockwise on the detector (positive signed area).
+  std::array<Pt2,3> inds;
+
+  long min_col;
+  long max_col;
+  long min_row;
+  long max_row;
+
+  bool valid;
+};
+
+/// \brief The top-left fill rule for an edge of a triangle with positive
+///        signed area.
+bool IsTopLeftEdge(const Pt2& a, const Pt2& b)
+{
+  const CoordScalar dx = b[0] - a[0];
+  const CoordScalar dy = b[1] - a[1];
+
+  return (dy > 0) || ((dy == 0) && (dx < 0));
+}
+
+CoordScalar EdgeFn(const Pt2& a, const Pt2& b, const CoordScalar x, const CoordScalar y)
+{
+  return ((b[0] - a[0]) * (y - a[1])) - ((b[1] - a[1]) * (x - a[0]));
+}
+
+bool InsideEdge(const Pt2& a, const Pt2& b, const CoordScalar x, const CoordScalar y)
+{
+  const CoordScalar e = EdgeFn(a, b, x, y);
+
+  return (e > 0) || ((e == 0) && IsTopLeftEdge(a, b));
+}
+
+/// \brief The vertices of face i of a tetrahedron, which is opposite of vertex i
+const size_type kTET_FACE_VERTS[4][3] = { { 1, 2, 3 }, { 0, 2, 3 }, { 0, 1, 3 }, { 0, 1, 2 } };
+
+}  // un-named
+
+void xreg::RayCasterTetraMeshCPU::set_tetra_mesh(const TetraMesh& mesh, const AttList& atts,
+                                                const TetraAttType att_type)
+{
+  set_tetra_meshes({ mesh }, { atts }, att_type);
+}
+
+void xreg::RayCasterTetraMeshCPU::set_tetra_meshes(const std::vector<TetraMesh>& meshes,
+                                                  const std::vector<AttList>& atts,
+                                                  const TetraAttType att_type)
+{
+  const size_type num_meshes = meshes.size();
+
+  if (num_meshes != atts.size())
+  {
+    xregThrow("Number of attenuation lists (%lu) does not match number of tetra meshes (%lu)!",
+              atts.size(), num_meshes);
+  }
+
+  att_type_ = att_type;
+
+  meshes_.clear();
+  meshes_.resize(num_meshes);
+
+  for (size_type mesh_idx = 0; mesh_idx < num_meshes; ++mesh_idx)
+  {
+    TetraMeshData& m = meshes_[mesh_idx];
+
+    m.mesh = meshes[mesh_idx];
+
+    compute_connectivity(&m);
+
+    set_attenuations(mesh_idx, atts[mesh_idx]);
+  }
+}
+
+xreg::size_type xreg::RayCasterTetraMeshCPU::num_tetra_meshes() const
+{
+  return meshes_.size();
+}
+
+xreg::RayCasterTetraMeshCPU::TetraAttType
+xreg::RayCasterTetraMeshCPU::att_type() const
+{
+  return att_type_;
+}
+
+void xreg::RayCasterTetraMeshCPU::set_vertices(const size_type mesh_idx,
+                                              const TetraMesh::VertexList& vertices)
+{
+  TetraMeshData& m = meshes_[mesh_idx];
+
+  if (vertices.size() != m.mesh.vertices.size())
+  {
+    xregThrow("Number of vertices (%lu) does not match tetra mesh (%lu)!",
+              vertices.size(), m.mesh.vertices.size());
+  }
+
+  m.mesh.vertices = vertices;
+
+  update_geoms(&m);
+}
+
+void xreg::RayCasterTetraMeshCPU::set_attenuations(const size_type mesh_idx, const AttList& atts)
+{
+  TetraMeshData& m = meshes_[mesh_idx];
+
+  const size_type num_expected = (att_type_ == kTETRA_ATT_PER_VERTEX) ?
+                                    m.mesh.vertices.size() : m.mesh.tetrahedra.size();
+
+  if (atts.size() != num_expected)
+  {
+    xregThrow("Number of attenuations (%lu) does not match tetra mesh (%lu)!",
+              atts.size(), num_expected);
+  }
+
+  m.atts = atts;
+
+  update_geoms(&m);
+}
+
+void xreg::RayCasterTetraMeshCPU::compute_connectivity(TetraMeshData* m) const
+{
+  using FaceKey = std::array<size_type,3>;
+
+  const size_type num_tets = m->mesh.tetrahedra.size();
+
+  const std::array<size_type,4> no_neighbors = { kNO_NEIGHBOR, kNO_NEIGHBOR, kNO_NEIGHBOR, kNO_NEIGHBOR };
+  const std::array<unsigned char,4> no_neighbor_faces = { 0, 0, 0, 0 };
+
+  m->neighbors.assign(num_tets, no_neighbors);
+  m->neighbor_faces.assign(num_tets, no_neighbor_faces);
+
+  m->boundary_faces.clear();
+
+  std::map<FaceKey,TetFaceRef> unmatched_faces;
+
+  for (size_type tet_idx = 0; tet_idx < num_tets; ++tet_idx)
+  {
+    const auto& tet = m->mesh.tetrahedra[tet_idx];
+
+    for (size_type face_idx = 0; face_idx < 4; ++face_idx)
+    {
+      FaceKey key = { tet[kTET_FACE_VERTS[face_idx][0]],
+                      tet[kTET_FACE_VERTS[face_idx][1]],
+                      tet[kTET_FACE_VERTS[face_idx][2]] };
+      std::sort(key.begin(), key.end());
+
+      auto it = unmatched_faces.find(key);
+
+      if (it == unmatched_faces.end())
+      {
+        unmatched_faces.emplace(key, TetFaceRef{ tet_idx, face_idx });
+      }
+      else
+      {
+        const TetFaceRef& other = it->second;
+
+        m->neighbors[tet_idx][face_idx]            = other.tet_idx;
+        m->neighbor_faces[tet_idx][face_idx]       = static_cast<unsigned char>(other.face_idx);
+        m->neighbors[other.tet_idx][other.face_idx] = tet_idx;
+        m->neighbor_faces[other.tet_idx][other.face_idx] = static_cast<unsigned char>(face_idx);
+
+        unmatched_faces.erase(it);
+      }
+    }
+  }
+
+  m->boundary_faces.reserve(unmatched_faces.size());
+
+  for (const auto& kv : unmatched_faces)
+  {
+    m->boundary_faces.push_back(kv.second);
+  }
+}
+
+void xreg::RayCasterTetraMeshCPU::update_geoms(TetraMeshData* m) const
+{
+  const size_type num_tets = m->mesh.tetrahedra.size();
+
+  if (m->atts.empty())
+  {
+    // attenuations have not been set yet
+    return;
+  }
+
+  m->geoms.resize(num_tets);
+
+  const bool per_vertex = att_type_ == kTETRA_ATT_PER_VERTEX;
+
+  auto geom_fn = [&] (const RangeType& r)
+  {
+    for (size_type tet_idx = r.begin(); tet_idx < r.end(); ++tet_idx)
+    {
+      const auto& tet = m->mesh.tetrahedra[tet_idx];
+
+      TetGeom& g = m->geoms[tet_idx];
+
+      const Pt3* v[4] = { &m->mesh.vertices[tet[0]], &m->mesh.vertices[tet[1]],
+                          &m->mesh.vertices[tet[2]], &m->mesh.vertices[tet[3]] };
+
+      for (size_type face_idx = 0; face_idx < 4; ++face_idx)
+      {
+        const Pt3& a = *v[kTET_FACE_VERTS[face_idx][0]];
+        const Pt3& b = *v[kTET_FACE_VERTS[face_idx][1]];
+        const Pt3& c = *v[kTET_FACE_VERTS[face_idx][2]];
+
+        Pt3 n = (b - a).cross(c - a);
+
+        // point away from the opposite vertex
+        if (n.dot(*v[face_idx] - a) > 0)
+        {
+          n = -n;
+        }
+
+        g.normals[face_idx]    = n;
+        g.plane_dots[face_idx] = n.dot(a);
+      }
+
+      if (per_vertex)
+      {
+        Mat3x3 edges;
+        edges.col(0) = *v[1] - *v[0];
+        edges.col(1) = *v[2] - *v[0];
+        edges.col(2) = *v[3] - *v[0];
+
+        const CoordScalar f0 = m->atts[tet[0]];
+
+        const Pt3 df(m->atts[tet[1]] - f0, m->atts[tet[2]] - f0, m->atts[tet[3]] - f0);
+
+        if (std::abs(edges.determinant()) > 1.0e-12)
+        {
+          // f(p) = f0 + df^T edges^-1 (p - v0)
+          g.atts_grad   = edges.transpose().inverse() * df;
+          g.atts_offset = f0 - g.atts_grad.dot(*v[0]);
+        }
+        else
+        {
+          // degenerate tetrahedron, use the mean
+          g.atts_grad.setZero();
+          g.atts_offset = f0 + ((df[0] + df[1] + df[2]) / 4);
+        }
+      }
+      else
+      {
+        g.atts_grad.setZero();
+        g.atts_offset = m->atts[tet_idx];
+      }
+    }
+  };
+
+  ParallelFor(geom_fn, RangeType(0, num_tets));
+}
+
+void xreg::RayCasterTetraMeshCPU::allocate_resources()
+{
+  if (meshes_.empty())
+  {
+    xregThrow("Tetra mesh ray caster requires at least one mesh!");
+  }
+
+  RayCasterCPU::allocate_resources();
+}
+
+void xreg::RayCasterTetraMeshCPU::compute(const size_type mesh_idx)
+{
+  xregASSERT(mesh_idx < meshes_.size());
+
+  this->pre_compute();
+
+  const TetraMeshData& m = meshes_[mesh_idx];
+
+  const size_type num_tets = m.mesh.tetrahedra.size();
+
+  const size_type num_bound_faces = m.boundary_faces.size();
+
+  const size_type num_rows = this->camera_models_[0].num_det_rows;
+  const size_type num_cols = this->camera_models_[0].num_det_cols;
+
+  const size_type num_pix_per_proj = num_rows * num_cols;
+
+  const size_type num_row_blocks = (num_rows + kTETRA_RASTER_ROW_BLOCK_SIZE - 1) / kTETRA_RASTER_ROW_BLOCK_SIZE;
+
+  std::vector<ProjEntryFace> proj_faces(num_bound_faces);
+
+  ParallelExecContextScope exec_scope(this->exec_ctx_.get());
+
+  for (size_type proj_idx = 0; proj_idx < this->num_projs_; ++proj_idx)
+  {
+    const CameraModel& cam = this->camera_models_[this->cam_model_for_proj_[proj_idx]];
+
+    // Everything is traversed in the mesh coordinate frame
+    const FrameTransform& world_to_mesh = this->xforms_cam_to_itk_phys_[proj_idx];
+
+    const Mat3x4 mesh_to_ind_proj_mat = cam.phys_to_ind_proj_mat() * world_to_mesh.inverse().matrix();
+
+    const Pt3 src_pt = world_to_mesh * cam.pinhole_pt;
+
+    // detector points are affine in the detector indices
+    const Pt3 det_origin   = world_to_mesh * cam.ind_pt_to_phys_det_pt(Pt2(0,0));
+    const Pt3 det_col_step = (world_to_mesh * cam.ind_pt_to_phys_det_pt(Pt2(1,0))) - det_origin;
+    const Pt3 det_row_step = (world_to_mesh * cam.ind_pt_to_phys_det_pt(Pt2(0,1))) - det_origin;
+
+    const Pt3 cam_axis = ((world_to_mesh * cam.ind_pt_to_phys_det_pt(
+                              Pt2(0.5 * (num_cols - 1), 0.5 * (num_rows - 1)))) - src_pt).normalized();
+
+    auto proj_faces_fn = [&] (const RangeType& r)
+    {
+      for (size_type bf_idx = r.begin(); bf_idx < r.end(); ++bf_idx)
+      {
+        const TetFaceRef& bf = m.boundary_faces[bf_idx];
+
+        ProjEntryFace& pf = proj_faces[bf_idx];
+
+        pf.valid = false;
+
+        const auto& tet = m.mesh.tetrahedra[bf.tet_idx];
+
+        const TetGeom& g = m.geoms[bf.tet_idx];
+
+        // only faces where rays enter the mesh, e.g. the source is on the
+        // outside of the face
+        if ((g.normals[bf.face_idx].dot(src_pt) - g.plane_dots[bf.face_idx]) <= 0)
+        {
+          continue;
+        }
+
+        bool in_front = true;
+
+        for (size_type i = 0; i < 3; ++i)
+        {
+          const Pt3& v = m.mesh.vertices[tet[kTET_FACE_VERTS[bf.face_idx][i]]];
+
+          // faces intersecting the plane of the source are not clipped, and
+          // are ignored
+          if ((v - src_pt).dot(cam_axis) <= 0)
+          {
+            in_front = false;
+            break;
+          }
+
+          const Pt3 p = mesh_to_ind_proj_mat * v.homogeneous();
+
+          pf.inds[i] = Pt2(p[0] / p[2], p[1] / p[2]);
+        }
+
+        if (!in_front)
+        {
+          continue;
+        }
+
+        const CoordScalar area2 = EdgeFn(pf.inds[0], pf.inds[1], pf.inds[2][0], pf.inds[2][1]);
+
+        if (area2 == 0)
+        {
+          continue;
+        }
+        else if (area2 < 0)
+        {
+          std::swap(pf.inds[1], pf.inds[2]);
+        }
+
+        const CoordScalar min_c = std::min(pf.inds[0][0], std::min(pf.inds[1][0], pf.inds[2][0]));
+        const CoordScalar max_c = std::max(pf.inds[0][0], std::max(pf.inds[1][0], pf.inds[2][0]));
+        const CoordScalar min_r = std::min(pf.inds[0][1], std::min(pf.inds[1][1], pf.inds[2][1]));
+        const CoordScalar max_r = std::max(pf.inds[0][1], std::max(pf.inds[1][1], pf.inds[2][1]));
+
+        pf.min_col = std::max(0l, static_cast<long>(std::ceil(min_c)));
+        pf.max_col = std::min(static_cast<long>(num_cols) - 1, static_cast<long>(std::floor(max_c)));
+        pf.min_row = std::max(0l, static_cast<long>(std::ceil(min_r)));
+        pf.max_row = std::min(static_cast<long>(num_rows) - 1, static_cast<long>(std::floor(max_r)));
+
+        pf.valid = (pf.min_col <= pf.max_col) && (pf.min_row <= pf.max_row);
+      }
+    };
+
+    ParallelFor(proj_faces_fn, RangeType(0, num_bound_faces));
+
+    PixelScalar2D* proj_buf = this->pixel_buf_to_use() + (proj_idx * num_pix_per_proj);
+
+    // Integrates the attenuation along a ray entering the mesh through a
+    // boundary face until the ray exits the mesh
+    auto traverse = [&] (const TetFaceRef& entry, const Pt3& ray_dir)
+    {
+      size_type tet_idx  = entry.tet_idx;
+      size_type face_idx = entry.face_idx;
+
+      const TetGeom& entry_g = m.geoms[tet_idx];
+
+      CoordScalar t_in = (entry_g.plane_dots[face_idx] - entry_g.normals[face_idx].dot(src_pt)) /
+                            entry_g.normals[face_idx].dot(ray_dir);
+
+      CoordScalar sum = 0;
+
+      // guard against cycles caused by numerical issues
+      for (size_type num_visited = 0; num_visited < num_tets; ++num_visited)
+      {
+        const TetGeom& g = m.geoms[tet_idx];
+
+        // the exit face is the nearest face plane the ray exits through
+        size_type exit_face_idx = 4;
+        CoordScalar t_out = std::numeric_limits<CoordScalar>::max();
+
+        for (size_type f = 0; f < 4; ++f)
+        {
+          if (f != face_idx)
+          {
+            const CoordScalar n_dot_dir = g.normals[f].dot(ray_dir);
+
+            if (n_dot_dir > 0)
+            {
+              const CoordScalar t = (g.plane_dots[f] - g.normals[f].dot(src_pt)) / n_dot_dir;
+
+              if (t < t_out)
+              {
+                t_out = t;
+                exit_face_idx = f;
+              }
+            }
+          }
+        }
+
+        if (exit_face_idx == 4)
+        {
+          break;
+        }
+
+        t_out = std::max(t_out, t_in);
+
+        // the attenuation is linear along the segment, so the trapezoid rule
+        // is exact
+        const CoordScalar g_dot_dir = g.atts_grad.dot(ray_dir);
+        const CoordScalar g_dot_src = g.atts_grad.dot(src_pt);
+
+        const CoordScalar att_in  = g.atts_offset + g_dot_src + (t_in  * g_dot_dir);
+        const CoordScalar att_out = g.atts_offset + g_dot_src + (t_out * g_dot_dir);
+
+        sum += (t_out - t_in) * 0.5 * (att_in + att_out);
+
+        const size_type next_tet_idx = m.neighbors[tet_idx][exit_face_idx];
+
+        if (next_tet_idx == kNO_NEIGHBOR)
+        {
+          break;
+        }
+
+        face_idx = m.neighbor_faces[tet_idx][exit_face_idx];
+        tet_idx  = next_tet_idx;
+        t_in     = t_out;
+      }
+
+      return sum * ray_dir.norm();
+    };
+
+    // Each task rasterizes every entry face into a block of rows, so that no
+    // two tasks write to the same pixels
+    auto raster_fn = [&] (const RangeType& r)
+    {
+      for (size_type block_idx = r.begin(); block_idx < r.end(); ++block_idx)
+      {
+        const long block_start_row = static_cast<long>(block_idx * kTETRA_RASTER_ROW_BLOCK_SIZE);
+        const long block_end_row   = std::min(static_cast<long>(num_rows),
+                                              block_start_row + static_cast<long>(kTETRA_RASTER_ROW_BLOCK_SIZE)) - 1;
+
+        for (size_type bf_idx = 0; bf_idx < num_bound_faces; ++bf_idx)
+        {
+          const ProjEntryFace& pf = proj_faces[bf_idx];
+
+          if (!pf.valid || (pf.max_row < block_start_row) || (pf.min_row > block_end_row))
+          {
+            continue;
+          }
+
+          const long start_row = std::max(pf.min_row, block_start_row);
+          const long end_row   = std::min(pf.max_row, block_end_row);
+
+          for (long row_idx = start_row; row_idx <= end_row; ++row_idx)
+          {
+            const CoordScalar y = static_cast<CoordScalar>(row_idx);
+
+            for (long col_idx = pf.min_col; col_idx <= pf.max_col; ++col_idx)
+            {
+              const CoordScalar x = static_cast<CoordScalar>(col_idx);
+
+              if (InsideEdge(pf.inds[0], pf.inds[1], x, y) &&
+                  InsideEdge(pf.inds[1], pf.inds[2], x, y) &&
+                  InsideEdge(pf.inds[2], pf.inds[0], x, y))
+              {
+                const Pt3 ray_dir = det_origin + (x * det_col_step) + (y * det_row_step) - src_pt;
+
+                proj_buf[(row_idx * num_cols) + col_idx] +=
+                            static_cast<PixelScalar2D>(traverse(m.boundary_faces[bf_idx], ray_dir));
+              }
+            }
+          }
+        }
+      }
+    };
+
+    ParallelFor(raster_fn, RangeType(0, num_row_blocks));
+  }
+
+  this->sync_to_ocl_.set_modified();
+  this->sync_to_host_.set_modified();
+}
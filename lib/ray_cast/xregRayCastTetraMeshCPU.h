@@ -0,0 +1,144 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGRAYCASTTETRAMESHCPU_H_
+#define XREGRAYCASTTETRAMESHCPU_H_
+
+#include "xregMesh.h"
+#include "xregRayCastBaseCPU.h"
+
+namespace xreg
+{
+
+/// \brief Projects the attenuation of tetrahedral meshes, e.g. statistical
+///        shape and intensity models, on the CPU.
+///
+/// The attenuation is either constant in each tetrahedron, or defined at each
+/// vertex and linearly interpolated in each tetrahedron. The ray through each
+/// pixel enters a mesh through a boundary face, found by rasterizing the
+/// boundary faces that face the source, and is traversed through the
+/// adjacent tetrahedra until it exits through a boundary face. The integral
+/// of each segment through a tetrahedron is computed exactly, so the result
+/// does not depend on a step size. Rays entering a non-convex mesh several
+/// times sum the integrals of every entry.
+///
+/// The meshes take the place of the volumes of the other ray casters: the
+/// vertices are in the same coordinates as the volume physical points, and
+/// compute(i) projects mesh i. Volumes do not need to be set. The
+/// connectivity of each mesh is computed once, and the vertices and
+/// attenuations may be updated afterwards, e.g. for each instance of a
+/// deformable model, without rebuilding it.
+class RayCasterTetraMeshCPU : public RayCasterCPU
+{
+public:
+  enum TetraAttType
+  {
+    kTETRA_ATT_PER_VERTEX = 0,
+    kTETRA_ATT_PER_CELL
+  };
+
+  using AttList = std::vector<PixelScalar2D>;
+
+  /// \brief Sets a single mesh
+  void set_tetra_mesh(const TetraMesh& mesh, const AttList& atts,
+                      const TetraAttType att_type);
+
+  /// \brief Sets the collection of meshes that may be projected, and the
+  ///        attenuations of each mesh.
+  ///
+  /// atts[i] has an attenuation for each vertex, or each tetrahedron,
+  /// of mesh i.
+  void set_tetra_meshes(const std::vector<TetraMesh>& meshes,
+                        const std::vector<AttList>& atts,
+                        const TetraAttType att_type);
+
+  size_type num_tetra_meshes() const;
+
+  TetraAttType att_type() const;
+
+  /// \brief Updates the vertices of a mesh, the connectivity is unchanged.
+  void set_vertices(const size_type mesh_idx, const TetraMesh::VertexList& vertices);
+
+  /// \brief Updates the attenuations of a mesh.
+  void set_attenuations(const size_type mesh_idx, const AttList& atts);
+
+  void allocate_resources() override;
+
+  /// \brief Projects a mesh; mesh_idx is the index of the mesh.
+  void compute(const size_type mesh_idx = 0) override;
+
+private:
+  /// \brief A face of a tetrahedron, e.g. a boundary face
+  struct TetFaceRef
+  {
+    size_type tet_idx;
+    size_type face_idx;
+  };
+
+  struct TetGeom
+  {
+    /// \brief The outward normal of each face, face i is opposite vertex i
+    std::array<Pt3,4> normals;
+
+    /// \brief The dot product of each normal with a point on its face
+    std::array<CoordScalar,4> plane_dots;
+
+    /// \brief The attenuation at a point p is atts_offset + atts_grad.dot(p)
+    Pt3 atts_grad;
+
+    CoordScalar atts_offset;
+  };
+
+  struct TetraMeshData
+  {
+    TetraMesh mesh;
+
+    AttList atts;
+
+    /// \brief The tetrahedron adjacent to each face, all ones on the boundary
+    std::vector<std::array<size_type,4>> neighbors;
+
+    /// \brief The face of the adjacent tetrahedron shared with each face
+    std::vector<std::array<unsigned char,4>> neighbor_faces;
+
+    std::vector<TetFaceRef> boundary_faces;
+
+    std::vector<TetGeom> geoms;
+  };
+
+  /// \brief Computes the adjacency of the tetrahedra and the boundary faces
+  void compute_connectivity(TetraMeshData* m) const;
+
+  /// \brief Computes the face planes and attenuation functions of each
+  ///        tetrahedron
+  void update_geoms(TetraMeshData* m) const;
+
+  std::vector<TetraMeshData> meshes_;
+
+  TetraAttType att_type_ = kTETRA_ATT_PER_CELL;
+};
+
+}  // xreg
+
+#endif
@@ -31,6 +31,241 @@
 #include "xregAssert.h"
 #include "xregExceptionUtils.h"
 #include "xregITKBasicImageUtils.h"
+#include "xregTBBUtils.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+/// \brief Splats a range of voxels into a detector image.
+///
+/// Each split body accumulates into its own detector tile, which is added
+/// into the tile of the body it is joined with, so the threads never write
+/// to the same pixels. The original body accumulates directly into the
+/// projection buffer.
+struct SplatVoxelsAccFn
+{
+  using PixelScalar2D = RayCaster::PixelScalar2D;
+  using VolIndList    = SplatLineIntCPU::VolIndList;
+  using VolInterp     = itk::LinearInterpolateImageFunction<RayCaster::Vol,CoordScalar>;
+  using RNGEngine     = std::mt19937;
+  using NormalDist    = std::normal_distribution<CoordScalar>;
+
+  const VolIndList& vol_inds;
+
+  const RayCaster::Vol* vol;
+
+  const VolInterp* vol_interp;
+
+  const CameraModel& cam;
+
+  const FrameTransform& vol_idx_to_cam_world;
+
+  RayCaster::Vol::SizeType max_vol_inds;
+
+  size_type num_wobbles;
+
+  bool bilinear_in_2d;
+
+  RNGEngine::result_type seed;
+
+  std::vector<PixelScalar2D> tile;
+
+  PixelScalar2D* dst_buf;
+
+  CoordScalar num_inds;
+
+  SplatVoxelsAccFn(const VolIndList& vol_inds_arg, const RayCaster::Vol* vol_arg,
+                   const VolInterp* vol_interp_arg, const CameraModel& cam_arg,
+                   const FrameTransform& vol_idx_to_cam_world_arg,
+                   const size_type num_wobbles_arg, const bool bilinear_in_2d_arg,
+                   const RNGEngine::result_type seed_arg, PixelScalar2D* dst_buf_arg)
+    : vol_inds(vol_inds_arg), vol(vol_arg), vol_interp(vol_interp_arg), cam(cam_arg),
+      vol_idx_to_cam_world(vol_idx_to_cam_world_arg),
+      max_vol_inds(vol_arg->GetLargestPossibleRegion().GetSize()),
+      num_wobbles(num_wobbles_arg), bilinear_in_2d(bilinear_in_2d_arg),
+      seed(seed_arg), dst_buf(dst_buf_arg), num_inds(0)
+  {
+    --max_vol_inds[0];
+    --max_vol_inds[1];
+    --max_vol_inds[2];
+  }
+
+  SplatVoxelsAccFn(SplatVoxelsAccFn& other, xregSplitMarker)
+    : vol_inds(other.vol_inds), vol(other.vol), vol_interp(other.vol_interp),
+      cam(other.cam), vol_idx_to_cam_world(other.vol_idx_to_cam_world),
+      max_vol_inds(other.max_vol_inds), num_wobbles(other.num_wobbles),
+      bilinear_in_2d(other.bilinear_in_2d), seed(other.seed),
+      tile(other.cam.num_det_rows * other.cam.num_det_cols, PixelScalar2D(0)),
+      dst_buf(&tile[0]), num_inds(0)
+  { }
+
+  void operator()(const RangeType& r)
+  {
+    namespace ba = boost::algorithm;
+
+    // seeding with the start of the range makes the wobbles independent of
+    // the thread that processes the range
+    std::seed_seq seeds = { seed, static_cast<RNGEngine::result_type>(r.begin()) };
+    RNGEngine rng_eng(seeds);
+
+    NormalDist voxel_off_dist(0, 0.5);
+
+    Pt3 tmp_vol_idx;
+
+    for (size_type i = r.begin(); i < r.end(); ++i)
+    {
+      const auto& src_itk_idx = vol_inds[i];
+
+      if (num_wobbles)
+      {
+        for (size_type wobble_idx = 0; wobble_idx < num_wobbles; ++wobble_idx)
+        {
+          const CoordScalar x_off = voxel_off_dist(rng_eng);
+          const CoordScalar y_off = voxel_off_dist(rng_eng);
+          const CoordScalar z_off = voxel_off_dist(rng_eng);
+  
+          itk::ContinuousIndex<CoordScalar,3> cur_itk_idx = src_itk_idx;
+          cur_itk_idx[0] += x_off;
+          cur_itk_idx[1] += y_off;
+          cur_itk_idx[2] += z_off;
+          
+          // clamp these to be in volume bounds
+          cur_itk_idx[0] = ba::clamp(cur_itk_idx[0], CoordScalar(0),
+                                     CoordScalar(max_vol_inds[0]));
+          cur_itk_idx[1] = ba::clamp(cur_itk_idx[1], CoordScalar(0),
+                                     CoordScalar(max_vol_inds[1]));
+          cur_itk_idx[2] = ba::clamp(cur_itk_idx[2], CoordScalar(0),
+                                     CoordScalar(max_vol_inds[2]));
+
+          tmp_vol_idx[0] = cur_itk_idx[0];
+          tmp_vol_idx[1] = cur_itk_idx[1];
+          tmp_vol_idx[2] = cur_itk_idx[2];
+
+          splat(tmp_vol_idx, [&] ()
+          {
+            return static_cast<PixelScalar2D>(vol_interp->EvaluateAtContinuousIndex(cur_itk_idx));
+          });
+        }
+      }
+      else
+      {
+        tmp_vol_idx[0] = src_itk_idx[0];
+        tmp_vol_idx[1] = src_itk_idx[1];
+        tmp_vol_idx[2] = src_itk_idx[2];
+
+        splat(tmp_vol_idx, [&] ()
+        {
+          return vol->GetPixel(src_itk_idx);
+        });
+      }
+    }
+  }
+
+  void join(SplatVoxelsAccFn& rhs)
+  {
+    const size_type num_pix = cam.num_det_rows * cam.num_det_cols;
+
+    for (size_type i = 0; i < num_pix; ++i)
+    {
+      dst_buf[i] += rhs.dst_buf[i];
+    }
+
+    num_inds += rhs.num_inds;
+  }
+
+  /// \brief Adds the intensity of a volume point to the pixel(s) it projects
+  ///        onto, the intensity is only evaluated when the point projects
+  ///        onto the detector.
+  template <class tValFn>
+  void splat(const Pt3& vol_idx_pt, const tValFn& val_fn)
+  {
+    const size_type proj_num_rows = cam.num_det_rows;
+    const size_type proj_num_cols = cam.num_det_cols;
+
+    const Pt3 proj_img_idx_pt = cam.phys_pt_to_ind_pt(vol_idx_to_cam_world * vol_idx_pt);
+     
+    if (bilinear_in_2d)
+    {
+      const int cf = static_cast<int>(std::floor(proj_img_idx_pt[0]));
+      const int rf = static_cast<int>(std::floor(proj_img_idx_pt[1]));
+      const int c1 = std::max(0,cf);
+      const int r1 = std::max(0,rf);
+      const int c2 = std::min(static_cast<int>(proj_num_cols-1), cf + 1);
+      const int r2 = std::min(static_cast<int>(proj_num_rows-1), rf + 1);
+
+      const int nr = r2 - r1 + 1;
+      const int nc = c2 - c1 + 1;
+
+      if (nr && nc)
+      {
+        ++num_inds;
+
+        const PixelScalar2D v = val_fn();
+       
+        const bool two_rows = nr == 2;
+        const bool two_cols = nc == 2;
+        const bool one_row  = nr == 1;
+        const bool one_col  = nc == 1;
+        
+        if (two_rows && two_cols)
+        {
+          // standard case, all 4 neighbors available
+          
+          PixelScalar2D* row1_buf = &dst_buf[r1 * proj_num_cols];
+          PixelScalar2D* row2_buf = &dst_buf[r2 * proj_num_cols];
+
+          const PixelScalar2D wgt_r = static_cast<PixelScalar2D>(proj_img_idx_pt[1] - r1);
+          const PixelScalar2D wgt_c = static_cast<PixelScalar2D>(proj_img_idx_pt[0] - c1);
+          const PixelScalar2D one_minus_wgt_r = 1 - wgt_r;
+          const PixelScalar2D one_minus_wgt_c = 1 - wgt_c;
+
+          row1_buf[c1] += v * wgt_r * wgt_c;
+          row1_buf[c2] += v * wgt_r * one_minus_wgt_c;
+          row2_buf[c1] += v * one_minus_wgt_r * wgt_c;
+          row2_buf[c2] += v * one_minus_wgt_r * one_minus_wgt_c;
+        }
+        else if (two_rows && one_col)
+        {
+          // single column, two row neighbors available
+          const PixelScalar2D wgt = static_cast<PixelScalar2D>(proj_img_idx_pt[1] - r1);
+          
+          dst_buf[(r1 * proj_num_cols) + c1] += v * wgt;
+          dst_buf[(r2 * proj_num_cols) + c1] += v * (1 - wgt);
+        }
+        else if (two_cols && one_row)
+        {
+          // single row, two column neighbors available
+          const PixelScalar2D wgt = static_cast<PixelScalar2D>(proj_img_idx_pt[0] - c1);
+
+          PixelScalar2D* row_buf = &dst_buf[r1 * proj_num_cols];
+
+          row_buf[c1] += v * wgt;
+          row_buf[c2] += v * (1 - wgt);
+        }
+        // else single pixel, which would imply a single pixel image... this
+        // is an extreme case - not handling.
+      }
+    }
+    else
+    {
+      // do NN
+      const long proj_col = std::lround(proj_img_idx_pt[0]);
+      const long proj_row = std::lround(proj_img_idx_pt[1]);
+      
+      if ((proj_col >= 0) && (proj_col < static_cast<long>(proj_num_cols)) &&
+          (proj_row >= 0) && (proj_row < static_cast<long>(proj_num_rows)))
+      {
+        ++num_inds;
+
+        dst_buf[(proj_row * proj_num_cols) + proj_col] += val_fn();
+      }
+    }
+  }
+};
+
+}  // un-named
 
 xreg::SplatLineIntCPU::SplatLineIntCPU()
 {
@@ -89,9 +324,9 @@ void xreg::SplatLineIntCPU::allocate_resources()
 
 void xreg::SplatLineIntCPU::compute(const size_type vol_idx)
 {
-  namespace ba = boost::algorithm;
-
   xregASSERT(this->resources_allocated_);
+
+  ParallelExecContextScope exec_scope(this->exec_ctx_.get());
   
   this->pre_compute();
 
@@ -113,16 +348,9 @@ void xreg::SplatLineIntCPU::compute(const size_type vol_idx)
 
   const auto* vol = this->vols_[vol_idx].GetPointer();
 
-  auto max_vol_inds = vol->GetLargestPossibleRegion().GetSize();
-  --max_vol_inds[0];
-  --max_vol_inds[1];
-  --max_vol_inds[2];
-
   // Compute the frame transform from ITK physical space to index space (sR + t)
   const FrameTransform itk_idx_to_itk_phys_pt_xform = ITKImagePhysicalPointTransformsAsEigen(vol);
   
-  Pt3 tmp_vol_idx;
-  
   const size_type proj_num_rows = this->camera_models_[0].num_det_rows;
   const size_type proj_num_cols = this->camera_models_[0].num_det_cols;
   const size_type proj_num_pix  = proj_num_rows * proj_num_cols;
@@ -132,8 +360,6 @@ void xreg::SplatLineIntCPU::compute(const size_type vol_idx)
 
   auto* vol_interp = vol_interp_fns_[vol_idx].GetPointer();
 
-  NormalDistForRNG voxel_off_dist(0, 0.5);
-
   if (post_splat_2D_smooth_)
   {
     // This could probably be made a little more robust by also using the 3D
@@ -180,203 +406,12 @@ void xreg::SplatLineIntCPU::compute(const size_type vol_idx)
                           this->xforms_cam_to_itk_phys_[proj_idx].inverse() *
                                                       itk_idx_to_itk_phys_pt_xform;
 
-    for (const auto& src_itk_idx : vol_inds)
-    {
-      if (perform_wobble)
-      {
-        for (size_type wobble_idx = 0; wobble_idx < num_wobbles_; ++wobble_idx)
-        {
-          const CoordScalar x_off = voxel_off_dist(rng_eng_);
-          const CoordScalar y_off = voxel_off_dist(rng_eng_);
-          const CoordScalar z_off = voxel_off_dist(rng_eng_);
-  
-          itk::ContinuousIndex<CoordScalar,3> cur_itk_idx = src_itk_idx;
-          cur_itk_idx[0] += x_off;
-          cur_itk_idx[1] += y_off;
-          cur_itk_idx[2] += z_off;
-          
-          // clamp these to be in volume bounds
-          cur_itk_idx[0] = ba::clamp(cur_itk_idx[0], CoordScalar(0),
-                                     CoordScalar(max_vol_inds[0]));
-          cur_itk_idx[1] = ba::clamp(cur_itk_idx[1], CoordScalar(0),
-                                     CoordScalar(max_vol_inds[1]));
-          cur_itk_idx[2] = ba::clamp(cur_itk_idx[2], CoordScalar(0),
-                                     CoordScalar(max_vol_inds[2]));
-
-          tmp_vol_idx[0] = cur_itk_idx[0];
-          tmp_vol_idx[1] = cur_itk_idx[1];
-          tmp_vol_idx[2] = cur_itk_idx[2];
-         
-          const Pt3 proj_img_idx_pt =
-                          cam.phys_pt_to_ind_pt(vol_idx_to_cam_world * tmp_vol_idx);
-           
-          if (bilinear_in_2d_)
-          {
-            const int cf = static_cast<int>(std::floor(proj_img_idx_pt[0]));
-            const int rf = static_cast<int>(std::floor(proj_img_idx_pt[1]));
-            const int c1 = std::max(0,cf);
-            const int r1 = std::max(0,rf);
-            const int c2 = std::min(static_cast<int>(proj_num_cols-1), cf + 1);
-            const int r2 = std::min(static_cast<int>(proj_num_rows-1), rf + 1);
-
-            const int nr = r2 - r1 + 1;
-            const int nc = c2 - c1 + 1;
-
-            if (nr && nc)
-            {
-              ++num_inds_in_cur_proj;
-
-              const PixelScalar2D v = vol_interp->EvaluateAtContinuousIndex(cur_itk_idx);
-             
-              const bool two_rows = nr == 2;
-              const bool two_cols = nc == 2;
-              const bool one_row  = nr == 1;
-              const bool one_col  = nc == 1;
-              
-              if (two_rows && two_cols)
-              {
-                // standard case, all 4 neighbors available
-                
-                PixelScalar2D* row1_buf = &cur_proj_buf[r1 * proj_num_cols];
-                PixelScalar2D* row2_buf = &cur_proj_buf[r2 * proj_num_cols];
-
-                const PixelScalar2D wgt_r = static_cast<PixelScalar2D>(proj_img_idx_pt[1] - r1);
-                const PixelScalar2D wgt_c = static_cast<PixelScalar2D>(proj_img_idx_pt[0] - c1);
-                const PixelScalar2D one_minus_wgt_r = 1 - wgt_r;
-                const PixelScalar2D one_minus_wgt_c = 1 - wgt_c;
-
-                row1_buf[c1] += v * wgt_r * wgt_c;
-                row1_buf[c2] += v * wgt_r * one_minus_wgt_c;
-                row2_buf[c1] += v * one_minus_wgt_r * wgt_c;
-                row2_buf[c2] += v * one_minus_wgt_r * one_minus_wgt_c;
-              }
-              else if (two_rows && one_col)
-              {
-                // single column, two row neighbors available
-                const PixelScalar2D wgt = static_cast<PixelScalar2D>(proj_img_idx_pt[1] - r1);
-                
-                cur_proj_buf[(r1 * proj_num_cols) + c1] += v * wgt;
-                cur_proj_buf[(r2 * proj_num_cols) + c1] += v * (1 - wgt);
-              }
-              else if (two_cols && one_row)
-              {
-                // single row, two column neighbors available
-                const PixelScalar2D wgt = static_cast<PixelScalar2D>(proj_img_idx_pt[0] - c1);
-
-                PixelScalar2D* row_buf = &cur_proj_buf[r1 * proj_num_cols];
-
-                row_buf[c1] += v * wgt;
-                row_buf[c2] += v * (1 - wgt);
-              }
-              // else single pixel, which would imply a single pixel image... this
-              // is an extreme case - not handling.
-            }
-          }
-          else
-          {
-            // do NN
-            const long proj_col = std::lround(proj_img_idx_pt[0]);
-            const long proj_row = std::lround(proj_img_idx_pt[1]);
-            
-            if ((proj_col >= 0) && (proj_col < static_cast<long>(proj_num_cols)) &&
-                (proj_row >= 0) && (proj_row < static_cast<long>(proj_num_rows)))
-            {
-              ++num_inds_in_cur_proj;
-
-              const PixelScalar2D v = vol_interp->EvaluateAtContinuousIndex(cur_itk_idx);
-              cur_proj_buf[(proj_row * proj_num_cols) + proj_col] += v;
-            }
-          }
-        }  // for num wobbles
-      }
-      else  // no wobble
-      {
-        tmp_vol_idx[0] = src_itk_idx[0];
-        tmp_vol_idx[1] = src_itk_idx[1];
-        tmp_vol_idx[2] = src_itk_idx[2];
-       
-        const Pt3 proj_img_idx_pt =
-                            cam.phys_pt_to_ind_pt(vol_idx_to_cam_world * tmp_vol_idx);
-
-        if (bilinear_in_2d_)
-        {
-          const int cf = static_cast<int>(std::floor(proj_img_idx_pt[0]));
-          const int rf = static_cast<int>(std::floor(proj_img_idx_pt[1]));
-          const int c1 = std::max(0,cf);
-          const int r1 = std::max(0,rf);
-          const int c2 = std::min(static_cast<int>(proj_num_cols-1), cf + 1);
-          const int r2 = std::min(static_cast<int>(proj_num_rows-1), rf + 1);
+    SplatVoxelsAccFn splat_fn(vol_inds, vol, vol_interp, cam, vol_idx_to_cam_world,
+                              num_wobbles_, bilinear_in_2d_, rng_eng_(), cur_proj_buf);
 
-          const int nr = r2 - r1 + 1;
-          const int nc = c2 - c1 + 1;
+    ParallelReduce(splat_fn, RangeType(0, vol_inds.size()));
 
-          if (nr && nc)
-          {
-            ++num_inds_in_cur_proj;
-
-            const PixelScalar2D& v = vol->GetPixel(src_itk_idx);
-           
-            const bool two_rows = nr == 2;
-            const bool two_cols = nc == 2;
-            const bool one_row  = nr == 1;
-            const bool one_col  = nc == 1;
-            
-            if (two_rows && two_cols)
-            {
-              // standard case, all 4 neighbors available
-              
-              PixelScalar2D* row1_buf = &cur_proj_buf[r1 * proj_num_cols];
-              PixelScalar2D* row2_buf = &cur_proj_buf[r2 * proj_num_cols];
-
-              const PixelScalar2D wgt_r = static_cast<PixelScalar2D>(proj_img_idx_pt[1] - r1);
-              const PixelScalar2D wgt_c = static_cast<PixelScalar2D>(proj_img_idx_pt[0] - c1);
-              const PixelScalar2D one_minus_wgt_r = 1 - wgt_r;
-              const PixelScalar2D one_minus_wgt_c = 1 - wgt_c;
-
-              row1_buf[c1] += v * wgt_r * wgt_c;
-              row1_buf[c2] += v * wgt_r * one_minus_wgt_c;
-              row2_buf[c1] += v * one_minus_wgt_r * wgt_c;
-              row2_buf[c2] += v * one_minus_wgt_r * one_minus_wgt_c;
-            }
-            else if (two_rows && one_col)
-            {
-              // single column, two row neighbors available
-              const PixelScalar2D wgt = static_cast<PixelScalar2D>(proj_img_idx_pt[1] - r1);
-              
-              cur_proj_buf[(r1 * proj_num_cols) + c1] += v * wgt;
-              cur_proj_buf[(r2 * proj_num_cols) + c1] += v * (1 - wgt);
-            }
-            else if (two_cols && one_row)
-            {
-              // single row, two column neighbors available
-              const PixelScalar2D wgt = static_cast<PixelScalar2D>(proj_img_idx_pt[0] - c1);
-
-              PixelScalar2D* row_buf = &cur_proj_buf[r1 * proj_num_cols];
-
-              row_buf[c1] += v * wgt;
-              row_buf[c2] += v * (1 - wgt);
-            }
-            // else single pixel, which would imply a single pixel image... this
-            // is an extreme case - not handling.
-          }
-        }
-        else
-        {
-          // just do NN
-          const long proj_col = std::lround(proj_img_idx_pt[0]);
-          const long proj_row = std::lround(proj_img_idx_pt[1]);
-          
-          if ((proj_col >= 0) && (proj_col < static_cast<long>(proj_num_cols)) &&
-              (proj_row >= 0) && (proj_row < static_cast<long>(proj_num_rows)))
-          {
-            ++num_inds_in_cur_proj;
-            
-            cur_proj_buf[(proj_row * proj_num_cols) + proj_col] +=
-                                                          vol->GetPixel(src_itk_idx);
-          }
-        }
-      }
-    }
+    num_inds_in_cur_proj = splat_fn.num_inds;
 
     if (perform_wobble)
     {
@@ -54,6 +54,9 @@ public:
   void allocate_resources() override;
 
   /// \brief Perform the splatting.
+  ///
+  /// The voxels are split among threads, each thread splats into its own
+  /// detector image and the images are summed once the threads finish.
   void compute(const size_type vol_idx = 0) override;
 
   /// \brief Retrieve a 2D line integral image.
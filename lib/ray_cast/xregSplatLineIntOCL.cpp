@@ -0,0 +1,873 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregSplatLineIntOCL.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <boost/compute/algorithm/copy.hpp>
+#include <boost/compute/algorithm/fill.hpp>
+#include <boost/compute/utility/source.hpp>
+#include <boost/compute/types/struct.hpp>
+
+#include <opencv2/imgproc.hpp>
+
+#include "xregAssert.h"
+#include "xregExceptionUtils.h"
+#include "xregITKBasicImageUtils.h"
+#include "xregOpenCLConvert.h"
+#include "xregOpenCLProgCache.h"
+
+namespace bc = boost::compute;
+
+BOOST_COMPUTE_ADAPT_STRUCT(xreg::SplatLineIntOCL::SplatArgs, SplatArgs,
+                           (vol_size,
+                            num_bricks,
+                            num_det_cols,
+                            num_det_rows,
+                            num_wobbles,
+                            bilinear_in_2d,
+                            seed,
+                            pad1,
+                            pad2,
+                            pad3))
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+/// \brief The number of voxels along each dimension of the brick splatted
+///        by a work group.
+constexpr size_type kSPLAT_BRICK_DIM = 8;
+
+/// \brief The number of pixels along each dimension of the largest brick
+///        footprint that is accumulated in local memory.
+constexpr size_type kSPLAT_TILE_DIM = 32;
+
+const char* kSPLAT_LINE_INT_OPENCL_SRC = BOOST_COMPUTE_STRINGIZE_SOURCE(
+
+// bit flags returned by xregSplatFootprint()
+__constant int kSPLAT_COUNTED = 1;
+__constant int kSPLAT_WRITES  = 2;
+
+// Integer hash used to generate the wobbles (lowbias32 by C. Wellons)
+uint xregSplatHash(uint x)
+{
+  x ^= x >> 16;
+  x *= 0x7feb352dU;
+  x ^= x >> 15;
+  x *= 0x846ca68bU;
+  x ^= x >> 16;
+  return x;
+}
+
+// Uniformly distributed in (0,1) and advances the hash state
+float xregSplatUniform(uint* h)
+{
+  *h = xregSplatHash(*h);
+  return (convert_float(*h >> 8) + 0.5f) * (1.0f / 16777216.0f);
+}
+
+void xregSplatAtomicAddGlobal(volatile __global float* addr, const float v)
+{
+  uint old_val = as_uint(*addr);
+  uint prev_val;
+
+  while ((prev_val = atomic_cmpxchg((volatile __global uint*) addr, old_val,
+                                    as_uint(as_float(old_val) + v))) != old_val)
+  {
+    old_val = prev_val;
+  }
+}
+
+void xregSplatAtomicAddLocal(volatile __local float* addr, const float v)
+{
+  uint old_val = as_uint(*addr);
+  uint prev_val;
+
+  while ((prev_val = atomic_cmpxchg((volatile __local uint*) addr, old_val,
+                                    as_uint(as_float(old_val) + v))) != old_val)
+  {
+    old_val = prev_val;
+  }
+}
+
+// Computes the index of a voxel within a brick, returns zero when the voxel
+// lies outside of the volume.
+int xregSplatBrickVoxel(const uint4 brick_start, const uint voxel_in_brick,
+                        const uint4 vol_size, uint4* vox)
+{
+  *vox = brick_start + (uint4) (voxel_in_brick % XREG_SPLAT_BRICK_DIM,
+                                (voxel_in_brick / XREG_SPLAT_BRICK_DIM) % XREG_SPLAT_BRICK_DIM,
+                                voxel_in_brick / (XREG_SPLAT_BRICK_DIM * XREG_SPLAT_BRICK_DIM),
+                                0);
+
+  return ((*vox).x < vol_size.x) && ((*vox).y < vol_size.y) && ((*vox).z < vol_size.z);
+}
+
+// The (continuous) volume index of a splatted sample, which is randomly
+// offset from the voxel when wobbling. The offsets are a function of the
+// seed, projection, voxel and sample, so they are identical between the passes
+// of the splatting kernel.
+float4 xregSplatSamplePt(const uint4 vox, const uint sample_idx,
+                         const SplatArgs splat_args, const uint proj_seed)
+{
+  float4 pt = convert_float4(vox);
+
+  if (splat_args.num_wobbles)
+  {
+    uint h = xregSplatHash(proj_seed ^ xregSplatHash(vox.x + (splat_args.vol_size.x *
+                                                       (vox.y + (splat_args.vol_size.y * vox.z)))));
+    h = xregSplatHash(h + sample_idx);
+
+    // normal samples with a standard deviation of 0.5 voxels (Box-Muller)
+    const float r1 = 0.5f * sqrt(-2.0f * log(xregSplatUniform(&h)));
+    const float a1 = 2.0f * M_PI_F * xregSplatUniform(&h);
+    const float r2 = 0.5f * sqrt(-2.0f * log(xregSplatUniform(&h)));
+    const float a2 = 2.0f * M_PI_F * xregSplatUniform(&h);
+
+    pt.x += r1 * cos(a1);
+    pt.y += r1 * sin(a1);
+    pt.z += r2 * cos(a2);
+
+    // clamp to be in volume bounds
+    pt.x = clamp(pt.x, 0.0f, convert_float(splat_args.vol_size.x - 1));
+    pt.y = clamp(pt.y, 0.0f, convert_float(splat_args.vol_size.y - 1));
+    pt.z = clamp(pt.z, 0.0f, convert_float(splat_args.vol_size.z - 1));
+  }
+
+  return pt;
+}
+
+// Projects a volume index to a continuous projection index (column, row)
+float2 xregSplatProjPt(const float16 vol_idx_to_proj_idx, const float4 pt)
+{
+  const float4 p = (float4) (pt.x, pt.y, pt.z, 1);
+
+  return (float2) (dot(vol_idx_to_proj_idx.s0123, p), dot(vol_idx_to_proj_idx.s4567, p)) /
+                                                          dot(vol_idx_to_proj_idx.s89ab, p);
+}
+
+// Determines the pixels written by a sample, matching SplatLineIntCPU.
+// rect stores the columns and rows of the pixels as (c1, r1, c2, r2) and wgts
+// stores the weights of pixels (r1,c1), (r1,c2), (r2,c1), (r2,c2). Returns a
+// combination of kSPLAT_COUNTED and kSPLAT_WRITES.
+int xregSplatFootprint(const float2 proj_ind, const SplatArgs splat_args, int4* rect, float4* wgts)
+{
+  const int num_cols = convert_int(splat_args.num_det_cols);
+  const int num_rows = convert_int(splat_args.num_det_rows);
+
+  if (splat_args.bilinear_in_2d)
+  {
+    // clamping prior to the conversion does not change which samples are counted
+    const int cf = convert_int(clamp(floor(proj_ind.x), -3.0f, convert_float(num_cols + 1)));
+    const int rf = convert_int(clamp(floor(proj_ind.y), -3.0f, convert_float(num_rows + 1)));
+    const int c1 = max(0, cf);
+    const int r1 = max(0, rf);
+    const int c2 = min(num_cols - 1, cf + 1);
+    const int r2 = min(num_rows - 1, rf + 1);
+
+    const int nr = r2 - r1 + 1;
+    const int nc = c2 - c1 + 1;
+
+    if (!nr || !nc)
+    {
+      return 0;
+    }
+
+    const float wgt_r = proj_ind.y - r1;
+    const float wgt_c = proj_ind.x - c1;
+
+    *rect = (int4) (c1, r1, c2, r2);
+
+    if ((nr == 2) && (nc == 2))
+    {
+      *wgts = (float4) (wgt_r * wgt_c, wgt_r * (1 - wgt_c),
+                        (1 - wgt_r) * wgt_c, (1 - wgt_r) * (1 - wgt_c));
+    }
+    else if ((nr == 2) && (nc == 1))
+    {
+      *wgts = (float4) (wgt_r, 0, 1 - wgt_r, 0);
+    }
+    else if ((nr == 1) && (nc == 2))
+    {
+      *wgts = (float4) (wgt_c, 1 - wgt_c, 0, 0);
+    }
+    else
+    {
+      // single pixel images are not handled
+      return kSPLAT_COUNTED;
+    }
+
+    return kSPLAT_COUNTED | kSPLAT_WRITES;
+  }
+  else
+  {
+    // do NN
+    const float col = round(proj_ind.x);
+    const float row = round(proj_ind.y);
+
+    if ((col >= 0) && (col < num_cols) && (row >= 0) && (row < num_rows))
+    {
+      *rect = (int4) (convert_int(col), convert_int(row), convert_int(col), convert_int(row));
+      *wgts = (float4) (1, 0, 0, 0);
+
+      return kSPLAT_COUNTED | kSPLAT_WRITES;
+    }
+
+    return 0;
+  }
+}
+
+// Each work group splats a brick of voxels onto a single projection.
+// The footprint of the brick is computed in a first pass, when it fits into a
+// local tile, the samples are accumulated in local memory and the tile is
+// added to the projection. Otherwise the samples are added to the projection
+// directly.
+__kernel void xregSplatLineIntKernel(const RayCastArgs args,
+                                     const SplatArgs splat_args,
+                                     image3d_t vol_tex,
+                                     __global const float16* vol_idx_to_proj_idx_xforms,
+                                     __global float* dst_buf,
+                                     __global uint* num_inds_in_proj)
+{
+  __local float tile[XREG_SPLAT_TILE_DIM * XREG_SPLAT_TILE_DIM];
+
+  // min col, min row, max col, max row
+  __local int tile_bounds[4];
+
+  __local uint num_inds_in_group;
+
+  const sampler_t nn_sampler  = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+  const sampler_t lin_sampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_LINEAR;
+
+  const float4 tex_coords_off = (float4) (0.5f, 0.5f, 0.5f, 0);
+
+  const uint lid   = get_local_id(0);
+  const uint lsize = get_local_size(0);
+
+  const uint num_bricks = splat_args.num_bricks.w;
+
+  const uint proj_idx  = get_group_id(0) / num_bricks;
+  const uint brick_idx = get_group_id(0) - (proj_idx * num_bricks);
+
+  const uint4 brick_start = (uint4) (brick_idx % splat_args.num_bricks.x,
+                                     (brick_idx / splat_args.num_bricks.x) % splat_args.num_bricks.y,
+                                     brick_idx / (splat_args.num_bricks.x * splat_args.num_bricks.y),
+                                     0) * XREG_SPLAT_BRICK_DIM;
+
+  const float16 vol_idx_to_proj_idx = vol_idx_to_proj_idx_xforms[proj_idx];
+
+  const uint num_samples = max(splat_args.num_wobbles, 1u);
+
+  const uint proj_seed = xregSplatHash(splat_args.seed + (proj_idx * 0x9e3779b9U));
+
+  __global float* dst_proj_buf = dst_buf + (proj_idx * args.num_det_pts);
+
+  const int num_det_cols = convert_int(splat_args.num_det_cols);
+
+  if (lid == 0)
+  {
+    tile_bounds[0] = INT_MAX;
+    tile_bounds[1] = INT_MAX;
+    tile_bounds[2] = INT_MIN;
+    tile_bounds[3] = INT_MIN;
+
+    num_inds_in_group = 0;
+  }
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  uint4 vox;
+  int4 rect;
+  float4 wgts;
+
+  // first pass: compute the footprint of the brick
+  int4 item_bounds = (int4) (INT_MAX, INT_MAX, INT_MIN, INT_MIN);
+
+  for (uint v = lid; v < (XREG_SPLAT_BRICK_DIM * XREG_SPLAT_BRICK_DIM * XREG_SPLAT_BRICK_DIM); v += lsize)
+  {
+    if (xregSplatBrickVoxel(brick_start, v, splat_args.vol_size, &vox))
+    {
+      for (uint sample_idx = 0; sample_idx < num_samples; ++sample_idx)
+      {
+        if (xregSplatFootprint(xregSplatProjPt(vol_idx_to_proj_idx,
+                                               xregSplatSamplePt(vox, sample_idx, splat_args, proj_seed)),
+                               splat_args, &rect, &wgts) & kSPLAT_WRITES)
+        {
+          item_bounds.xy = min(item_bounds.xy, rect.xy);
+          item_bounds.zw = max(item_bounds.zw, rect.zw);
+        }
+      }
+    }
+  }
+
+  if (item_bounds.x <= item_bounds.z)
+  {
+    atomic_min(&tile_bounds[0], item_bounds.x);
+    atomic_min(&tile_bounds[1], item_bounds.y);
+    atomic_max(&tile_bounds[2], item_bounds.z);
+    atomic_max(&tile_bounds[3], item_bounds.w);
+  }
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  const int4 bounds = (int4) (tile_bounds[0], tile_bounds[1], tile_bounds[2], tile_bounds[3]);
+
+  const int tile_num_cols = bounds.z - bounds.x + 1;
+  const int tile_num_rows = bounds.w - bounds.y + 1;
+
+  // the same for every work item of the group
+  const int use_tile = (tile_num_cols > 0) && (tile_num_cols <= XREG_SPLAT_TILE_DIM) &&
+                       (tile_num_rows <= XREG_SPLAT_TILE_DIM);
+
+  const int tile_num_pix = use_tile ? (tile_num_cols * tile_num_rows) : 0;
+
+  for (int i = lid; i < tile_num_pix; i += lsize)
+  {
+    tile[i] = 0;
+  }
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  // second pass: splat
+  uint num_inds_in_item = 0;
+
+  for (uint v = lid; v < (XREG_SPLAT_BRICK_DIM * XREG_SPLAT_BRICK_DIM * XREG_SPLAT_BRICK_DIM); v += lsize)
+  {
+    if (xregSplatBrickVoxel(brick_start, v, splat_args.vol_size, &vox))
+    {
+      for (uint sample_idx = 0; sample_idx < num_samples; ++sample_idx)
+      {
+        const float4 pt = xregSplatSamplePt(vox, sample_idx, splat_args, proj_seed);
+
+        const int flags = xregSplatFootprint(xregSplatProjPt(vol_idx_to_proj_idx, pt),
+                                             splat_args, &rect, &wgts);
+
+        if (flags & kSPLAT_COUNTED)
+        {
+          ++num_inds_in_item;
+        }
+
+        if (flags & kSPLAT_WRITES)
+        {
+          // wobbled samples are linearly interpolated
+          const float4 tex_val = splat_args.num_wobbles ?
+                                    read_imagef(vol_tex, lin_sampler, pt + tex_coords_off) :
+                                    read_imagef(vol_tex, nn_sampler, pt + tex_coords_off);
+
+          const float4 vals = wgts * xregVolTexVal(tex_val, args.vol_tex_scale, args.vol_tex_offset).x;
+
+          if (use_tile)
+          {
+            const int4 tile_rect = rect - bounds.xyxy;
+
+            if (vals.x != 0)
+            {
+              xregSplatAtomicAddLocal(tile + (tile_rect.y * tile_num_cols) + tile_rect.x, vals.x);
+            }
+            if (vals.y != 0)
+            {
+              xregSplatAtomicAddLocal(tile + (tile_rect.y * tile_num_cols) + tile_rect.z, vals.y);
+            }
+            if (vals.z != 0)
+            {
+              xregSplatAtomicAddLocal(tile + (tile_rect.w * tile_num_cols) + tile_rect.x, vals.z);
+            }
+            if (vals.w != 0)
+            {
+              xregSplatAtomicAddLocal(tile + (tile_rect.w * tile_num_cols) + tile_rect.z, vals.w);
+            }
+          }
+          else
+          {
+            if (vals.x != 0)
+            {
+              xregSplatAtomicAddGlobal(dst_proj_buf + (rect.y * num_det_cols) + rect.x, vals.x);
+            }
+            if (vals.y != 0)
+            {
+              xregSplatAtomicAddGlobal(dst_proj_buf + (rect.y * num_det_cols) + rect.z, vals.y);
+            }
+            if (vals.z != 0)
+            {
+              xregSplatAtomicAddGlobal(dst_proj_buf + (rect.w * num_det_cols) + rect.x, vals.z);
+            }
+            if (vals.w != 0)
+            {
+              xregSplatAtomicAddGlobal(dst_proj_buf + (rect.w * num_det_cols) + rect.z, vals.w);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  if (num_inds_in_item)
+  {
+    atomic_add(&num_inds_in_group, num_inds_in_item);
+  }
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  // add the tile to the projection, other work groups may be splatting bricks
+  // onto the same pixels
+  for (int i = lid; i < tile_num_pix; i += lsize)
+  {
+    const float tile_val = tile[i];
+
+    if (tile_val != 0)
+    {
+      const int tile_row = i / tile_num_cols;
+
+      xregSplatAtomicAddGlobal(dst_proj_buf + ((bounds.y + tile_row) * num_det_cols) +
+                                                  bounds.x + (i - (tile_row * tile_num_cols)),
+                               tile_val);
+    }
+  }
+
+  if ((lid == 0) && num_inds_in_group)
+  {
+    atomic_add(num_inds_in_proj + proj_idx, num_inds_in_group);
+  }
+}
+
+// Reflects an index into [0, n) without repeating the border element,
+// consistent with the default border mode of cv::GaussianBlur.
+int xregSplatReflect101(int i, const int n)
+{
+  if (n == 1)
+  {
+    return 0;
+  }
+
+  while ((i < 0) || (i >= n))
+  {
+    i = (i < 0) ? -i : ((2 * n) - 2 - i);
+  }
+
+  return i;
+}
+
+// Smooths each row of the splatted images
+__kernel void xregSplatSmoothRowsKernel(__global const float* src_buf,
+                                        __global float* dst_buf,
+                                        __global const float* wgts,
+                                        const int radius,
+                                        const int num_cols,
+                                        const ulong num_pix)
+{
+  const ulong idx = get_global_id(0);
+
+  if (idx < num_pix)
+  {
+    const int col = convert_int(idx % num_cols);
+
+    __global const float* src_row = src_buf + (idx - col);
+
+    float s = 0;
+
+    for (int k = -radius; k <= radius; ++k)
+    {
+      s += wgts[k + radius] * src_row[xregSplatReflect101(col + k, num_cols)];
+    }
+
+    dst_buf[idx] = s;
+  }
+}
+
+// Smooths each column of the row smoothed images and adds the result to the
+// projections
+__kernel void xregSplatSmoothColsKernel(__global const float* src_buf,
+                                        __global float* dst_buf,
+                                        __global const float* wgts,
+                                        const int radius,
+                                        const int num_cols,
+                                        const int num_rows,
+                                        const ulong num_pix)
+{
+  const ulong idx = get_global_id(0);
+
+  if (idx < num_pix)
+  {
+    const ulong num_pix_per_proj = convert_ulong(num_cols) * num_rows;
+
+    const ulong proj_idx = idx / num_pix_per_proj;
+
+    const int pix_idx = convert_int(idx - (proj_idx * num_pix_per_proj));
+    const int row     = pix_idx / num_cols;
+    const int col     = pix_idx - (row * num_cols);
+
+    __global const float* src_proj = src_buf + (proj_idx * num_pix_per_proj);
+
+    float s = 0;
+
+    for (int k = -radius; k <= radius; ++k)
+    {
+      s += wgts[k + radius] * src_proj[(xregSplatReflect101(row + k, num_rows) * num_cols) + col];
+    }
+
+    dst_buf[idx] += s;
+  }
+}
+
+);
+
+/// \brief Computes the mapping from volume indices to homogeneous projection
+///        indices, packed as the first three rows of a row-major 4x4 matrix.
+///
+/// This is equivalent to cam.phys_pt_to_ind_pt(vol_idx_to_cam_world * p),
+/// prior to the normalization of the homogeneous coordinate.
+Pt16 VolIdxToProjIdxXform(const CameraModel& cam, const FrameTransform& vol_idx_to_cam_world)
+{
+  FrameTransform vol_idx_to_cam = cam.extrins * vol_idx_to_cam_world;
+
+  if ((cam.coord_frame_type != CameraModel::kORIGIN_AT_FOCAL_PT_DET_POS_Z) &&
+      (cam.coord_frame_type != CameraModel::kORIGIN_AT_FOCAL_PT_DET_NEG_Z))
+  {
+    // z --> focal_len - z
+    FrameTransform flip_z = FrameTransform::Identity();
+    flip_z.matrix()(2,2) = -1;
+    flip_z.matrix()(2,3) = cam.focal_len;
+
+    vol_idx_to_cam = flip_z * vol_idx_to_cam;
+  }
+
+  const Mat3x4 proj_mat = cam.intrins * vol_idx_to_cam.matrix().topRows<3>();
+
+  Pt16 packed_mat = Pt16::Zero();
+
+  for (size_type r = 0; r < 3; ++r)
+  {
+    for (size_type c = 0; c < 4; ++c)
+    {
+      packed_mat(r * 4 + c) = proj_mat(r,c);
+    }
+  }
+
+  packed_mat(15) = 1;
+
+  return packed_mat;
+}
+
+/// \brief Computes the weights of cv::GaussianBlur() along a single dimension
+///        with an automatically selected standard deviation.
+std::vector<RayCaster::PixelScalar2D> SmoothingWeights(const size_type win_size)
+{
+  const cv::Mat wgts = cv::getGaussianKernel(static_cast<int>(win_size), 0, CV_32F);
+
+  return std::vector<RayCaster::PixelScalar2D>(wgts.ptr<float>(), wgts.ptr<float>() + win_size);
+}
+
+}  // un-named
+
+xreg::SplatLineIntOCL::SplatLineIntOCL()
+  : RayCasterOCL(),
+    vol_idx_to_proj_idx_xforms_dev_(ctx_),
+    num_inds_in_proj_dev_(ctx_),
+    splat_pixels_dev_(ctx_),
+    smooth_tmp_pixels_dev_(ctx_),
+    smooth_wgts_x_dev_(ctx_),
+    smooth_wgts_y_dev_(ctx_)
+{ }
+
+xreg::SplatLineIntOCL::SplatLineIntOCL(const boost::compute::device& dev)
+  : RayCasterOCL(dev),
+    vol_idx_to_proj_idx_xforms_dev_(ctx_),
+    num_inds_in_proj_dev_(ctx_),
+    splat_pixels_dev_(ctx_),
+    smooth_tmp_pixels_dev_(ctx_),
+    smooth_wgts_x_dev_(ctx_),
+    smooth_wgts_y_dev_(ctx_)
+{ }
+
+xreg::SplatLineIntOCL::SplatLineIntOCL(const boost::compute::context& ctx,
+                                       const boost::compute::command_queue& queue)
+  : RayCasterOCL(ctx, queue),
+    vol_idx_to_proj_idx_xforms_dev_(ctx_),
+    num_inds_in_proj_dev_(ctx_),
+    splat_pixels_dev_(ctx_),
+    smooth_tmp_pixels_dev_(ctx_),
+    smooth_wgts_x_dev_(ctx_),
+    smooth_wgts_y_dev_(ctx_)
+{ }
+
+void xreg::SplatLineIntOCL::allocate_resources()
+{
+  RayCasterOCL::allocate_resources();
+
+  std::stringstream ss;
+  ss << RayCastBaseOCLStr()
+     << bc::type_definition<SplatArgs>()
+     << "\n\n#define XREG_SPLAT_BRICK_DIM " << kSPLAT_BRICK_DIM << "\n"
+     << "#define XREG_SPLAT_TILE_DIM " << kSPLAT_TILE_DIM << "\n\n"
+     << kSPLAT_LINE_INT_OPENCL_SRC;
+
+  bc::program prog = BuildOpenCLProg(ss.str(), ctx_);
+
+  splat_kernel_       = prog.create_kernel("xregSplatLineIntKernel");
+  smooth_rows_kernel_ = prog.create_kernel("xregSplatSmoothRowsKernel");
+  smooth_cols_kernel_ = prog.create_kernel("xregSplatSmoothColsKernel");
+
+  const size_type max_wg_size = splat_kernel_.get_work_group_info<std::size_t>(
+                                            cmd_queue_.get_device(), CL_KERNEL_WORK_GROUP_SIZE);
+
+  work_group_size_ = std::min(max_wg_size, kMAX_WORK_GROUP_SIZE);
+
+  vol_idx_to_proj_idx_xforms_host_.resize(this->num_projs_);
+  vol_idx_to_proj_idx_xforms_dev_.resize(this->num_projs_, cmd_queue_);
+  vol_idx_to_proj_idx_xforms_on_dev_.clear();
+
+  num_inds_in_proj_dev_.resize(this->num_projs_, cmd_queue_);
+
+  num_inds_in_proj_.assign(this->num_projs_, 0);
+
+  std::random_device rand_dev;
+  rng_eng_.seed(rand_dev());
+
+  // the smoothing buffers are allocated by compute() when needed
+  splat_pixels_dev_.clear();
+  smooth_tmp_pixels_dev_.clear();
+}
+
+void xreg::SplatLineIntOCL::compute(const size_type vol_idx)
+{
+  xregASSERT(this->resources_allocated_);
+
+  compute_helper_pre_kernels(vol_idx);
+
+  const auto* vol = this->vols_[vol_idx].GetPointer();
+
+  const FrameTransform itk_idx_to_itk_phys_pt_xform = ITKImagePhysicalPointTransformsAsEigen(vol);
+
+  for (size_type proj_idx = 0; proj_idx < this->num_projs_; ++proj_idx)
+  {
+    const auto& cam = this->camera_models_[this->cam_model_for_proj_[proj_idx]];
+
+    const FrameTransform vol_idx_to_cam_world =
+                          this->xforms_cam_to_itk_phys_[proj_idx].inverse() *
+                                                      itk_idx_to_itk_phys_pt_xform;
+
+    vol_idx_to_proj_idx_xforms_host_[proj_idx] = OpenCLFloat16ToBoostComp16(
+                              ConvertToOpenCL(VolIdxToProjIdxXform(cam, vol_idx_to_cam_world)));
+  }
+
+  upload_changed_elems(vol_idx_to_proj_idx_xforms_host_, &vol_idx_to_proj_idx_xforms_on_dev_,
+                       &vol_idx_to_proj_idx_xforms_dev_);
+
+  const auto vol_size = vol->GetLargestPossibleRegion().GetSize();
+
+  SplatArgs splat_args;
+  
+  splat_args.vol_size = bc::uint4_(vol_size[0], vol_size[1], vol_size[2], 0);
+
+  const bc::uint_ num_bricks_x = (vol_size[0] + kSPLAT_BRICK_DIM - 1) / kSPLAT_BRICK_DIM;
+  const bc::uint_ num_bricks_y = (vol_size[1] + kSPLAT_BRICK_DIM - 1) / kSPLAT_BRICK_DIM;
+  const bc::uint_ num_bricks_z = (vol_size[2] + kSPLAT_BRICK_DIM - 1) / kSPLAT_BRICK_DIM;
+
+  splat_args.num_bricks = bc::uint4_(num_bricks_x, num_bricks_y, num_bricks_z,
+                                     num_bricks_x * num_bricks_y * num_bricks_z);
+
+  splat_args.num_det_cols   = this->camera_models_[0].num_det_cols;
+  splat_args.num_det_rows   = this->camera_models_[0].num_det_rows;
+  splat_args.num_wobbles    = num_wobbles_;
+  splat_args.bilinear_in_2d = bilinear_in_2d_ ? 1 : 0;
+  splat_args.seed           = rng_eng_();
+  splat_args.pad1           = 0;
+  splat_args.pad2           = 0;
+  splat_args.pad3           = 0;
+
+  // when smoothing, the voxels are splatted into a scratch buffer
+  PixelBufDev* splat_dst_dev = proj_pixels_dev_to_use_;
+
+  if (post_splat_2D_smooth_)
+  {
+    const size_type tot_num_pix = proj_pixels_dev_to_use_->size();
+
+    if (splat_pixels_dev_.size() != tot_num_pix)
+    {
+      splat_pixels_dev_.resize(tot_num_pix, cmd_queue_);
+      smooth_tmp_pixels_dev_.resize(tot_num_pix, cmd_queue_);
+    }
+
+    bc::fill(splat_pixels_dev_.begin(), splat_pixels_dev_.end(), PixelScalar2D(0), cmd_queue_);
+
+    splat_dst_dev = &splat_pixels_dev_;
+  }
+
+  bc::fill(num_inds_in_proj_dev_.begin(), num_inds_in_proj_dev_.end(), bc::uint_(0), cmd_queue_);
+
+  splat_kernel_.set_arg(0, sizeof(ray_cast_kernel_args_), &ray_cast_kernel_args_);
+  splat_kernel_.set_arg(1, sizeof(splat_args), &splat_args);
+  splat_kernel_.set_arg(2, vol_texs_dev_[vol_idx]);
+  splat_kernel_.set_arg(3, vol_idx_to_proj_idx_xforms_dev_);
+  splat_kernel_.set_arg(4, *splat_dst_dev);
+  splat_kernel_.set_arg(5, num_inds_in_proj_dev_);
+
+  const std::size_t global_size = splat_args.num_bricks.w * this->num_projs_ * work_group_size_;
+  const std::size_t local_size  = work_group_size_;
+
+  finish_kernel_launch(cmd_queue_.enqueue_nd_range_kernel(splat_kernel_, 1, 0,
+                                                          &global_size, &local_size),
+                       "xregSplatLineIntKernel");
+
+  if (post_splat_2D_smooth_)
+  {
+    smooth_and_add_to_projs();
+  }
+
+  compute_helper_post_kernels(vol_idx);
+}
+
+const xreg::CoordScalarList& xreg::SplatLineIntOCL::num_inds_in_proj()
+{
+  wait_for_compute();
+
+  std::vector<bc::uint_> num_inds_host(this->num_projs_);
+
+  bc::copy(num_inds_in_proj_dev_.begin(), num_inds_in_proj_dev_.begin() + this->num_projs_,
+           num_inds_host.begin(), cmd_queue_);
+
+  const CoordScalar num_samples = static_cast<CoordScalar>(std::max(num_wobbles_, size_type(1)));
+
+  for (size_type proj_idx = 0; proj_idx < this->num_projs_; ++proj_idx)
+  {
+    // average number of indices projecting in
+    num_inds_in_proj_[proj_idx] = num_inds_host[proj_idx] / num_samples;
+  }
+
+  return num_inds_in_proj_;
+}
+
+void xreg::SplatLineIntOCL::set_num_wobbles(const size_type num_wobbles)
+{
+  num_wobbles_ = num_wobbles;
+}
+
+void xreg::SplatLineIntOCL::set_do_post_splat_2D_smooth(const bool do_smooth)
+{
+  post_splat_2D_smooth_ = do_smooth;
+}
+
+void xreg::SplatLineIntOCL::set_post_splat_2D_smooth_y_radius(const size_type smooth_radius)
+{
+  post_splat_2D_smooth_win_size_y_ = smooth_radius;
+}
+
+void xreg::SplatLineIntOCL::set_post_splat_2D_smooth_x_radius(const size_type smooth_radius)
+{
+  post_splat_2D_smooth_win_size_x_ = smooth_radius;
+}
+  
+bool xreg::SplatLineIntOCL::bilinear_in_2d() const
+{
+  return bilinear_in_2d_;
+}
+
+void xreg::SplatLineIntOCL::set_bilinear_in_2d(const bool b)
+{
+  bilinear_in_2d_ = b;
+}
+
+bool xreg::SplatLineIntOCL::supports_dev_xforms_cam_to_itk_phys() const
+{
+  return false;
+}
+
+bool xreg::SplatLineIntOCL::supports_interp_method(const InterpMethod) const
+{
+  // the interpolation method is not used when splatting
+  return true;
+}
+
+void xreg::SplatLineIntOCL::smooth_and_add_to_projs()
+{
+  const auto& cam = this->camera_models_[0];
+
+  // same window sizes as SplatLineIntCPU
+  if (!post_splat_2D_smooth_win_size_x_)
+  {
+    post_splat_2D_smooth_win_size_x_ = std::max(3l, std::lround(3.0 / cam.det_col_spacing));
+    
+    // make it odd
+    if (!(post_splat_2D_smooth_win_size_x_ & 1))
+    {
+      ++post_splat_2D_smooth_win_size_x_;
+    }
+  }
+
+  if (!post_splat_2D_smooth_win_size_y_)
+  {
+    post_splat_2D_smooth_win_size_y_ = std::max(3l, std::lround(3.0 / cam.det_row_spacing));
+    
+    // make it odd
+    if (!(post_splat_2D_smooth_win_size_y_ & 1))
+    {
+      ++post_splat_2D_smooth_win_size_y_;
+    }
+  }
+
+  if (smooth_wgts_x_.size() != post_splat_2D_smooth_win_size_x_)
+  {
+    smooth_wgts_x_ = SmoothingWeights(post_splat_2D_smooth_win_size_x_);
+    
+    smooth_wgts_x_dev_.assign(smooth_wgts_x_.begin(), smooth_wgts_x_.end(), cmd_queue_);
+  }
+
+  if (smooth_wgts_y_.size() != post_splat_2D_smooth_win_size_y_)
+  {
+    smooth_wgts_y_ = SmoothingWeights(post_splat_2D_smooth_win_size_y_);
+    
+    smooth_wgts_y_dev_.assign(smooth_wgts_y_.begin(), smooth_wgts_y_.end(), cmd_queue_);
+  }
+
+  const bc::ulong_ num_pix = ray_cast_kernel_args_.num_det_pts * this->num_projs_;
+
+  const std::size_t global_size = num_pix;
+
+  smooth_rows_kernel_.set_arg(0, splat_pixels_dev_);
+  smooth_rows_kernel_.set_arg(1, smooth_tmp_pixels_dev_);
+  smooth_rows_kernel_.set_arg(2, smooth_wgts_x_dev_);
+  smooth_rows_kernel_.set_arg(3, bc::int_(post_splat_2D_smooth_win_size_x_ / 2));
+  smooth_rows_kernel_.set_arg(4, bc::int_(cam.num_det_cols));
+  smooth_rows_kernel_.set_arg(5, num_pix);
+
+  finish_kernel_launch(cmd_queue_.enqueue_nd_range_kernel(smooth_rows_kernel_, 1, 0,
+                                                          &global_size, 0),
+                       "xregSplatSmoothRowsKernel");
+
+  smooth_cols_kernel_.set_arg(0, smooth_tmp_pixels_dev_);
+  smooth_cols_kernel_.set_arg(1, *proj_pixels_dev_to_use_);
+  smooth_cols_kernel_.set_arg(2, smooth_wgts_y_dev_);
+  smooth_cols_kernel_.set_arg(3, bc::int_(post_splat_2D_smooth_win_size_y_ / 2));
+  smooth_cols_kernel_.set_arg(4, bc::int_(cam.num_det_cols));
+  smooth_cols_kernel_.set_arg(5, bc::int_(cam.num_det_rows));
+  smooth_cols_kernel_.set_arg(6, num_pix);
+
+  finish_kernel_launch(cmd_queue_.enqueue_nd_range_kernel(smooth_cols_kernel_, 1, 0,
+                                                          &global_size, 0),
+                       "xregSplatSmoothColsKernel");
+}
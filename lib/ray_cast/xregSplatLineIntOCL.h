@@ -0,0 +1,191 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGSPLATLINEINTOCL_H_
+#define XREGSPLATLINEINTOCL_H_
+
+#include <random>
+
+#include "xregRayCastBaseOCL.h"
+
+namespace xreg
+{
+
+/// \brief Computes line integral images by splatting each voxel onto the
+///        detector using OpenCL.
+///
+/// This is the OpenCL counterpart of SplatLineIntCPU and produces the same
+/// images, up to the random wobbles and single precision arithmetic. Every
+/// voxel of the volume is splatted.
+///
+/// Each work group splats a brick of voxels into a single projection. The
+/// projected footprint of a brick is typically a small number of pixels, so
+/// the work group accumulates into a tile of local memory, which is added to
+/// the projection once the brick has been splatted. This replaces an atomic
+/// update of global memory for every voxel with one for each pixel of the
+/// tile. Bricks with footprints larger than a tile, e.g. for highly
+/// magnified geometries, are splatted directly into global memory.
+///
+/// When the post-splat smoothing is enabled, the voxels are splatted into a
+/// scratch buffer that is smoothed and then added to the projections, so the
+/// background projections, or accumulated values, are not smoothed.
+class SplatLineIntOCL : public RayCasterOCL
+{
+public:
+  /// \brief Default constructor, chooses a default device, creates a new
+  ///        context and command queue.
+  SplatLineIntOCL();
+
+  /// \brief Constructor specifying a device to use, but creates a new context
+  ///        and command queue.
+  explicit SplatLineIntOCL(const boost::compute::device& dev);
+
+  /// \brief Constructor specifying a specific context and command queue to use
+  SplatLineIntOCL(const boost::compute::context& ctx,
+                  const boost::compute::command_queue& queue);
+
+  /// \brief Allocate resources required for computing each projection.
+  ///
+  /// The memory buffers are allocated by the parent class, this class
+  /// creates the device kernels and the buffers used for the projection
+  /// matrices and smoothing.
+  void allocate_resources() override;
+
+  /// \brief Perform the splatting.
+  void compute(const size_type vol_idx = 0) override;
+
+  /// \brief Returns false, since the projection matrices are computed from
+  ///        the host poses.
+  bool supports_dev_xforms_cam_to_itk_phys() const override;
+
+  /// \brief The number of voxels splatted onto each projection by the most
+  ///        recent call to compute(), averaged over the wobbles.
+  ///
+  /// The counts are read from the device, waiting for the computation to
+  /// finish.
+  const CoordScalarList& num_inds_in_proj();
+
+  void set_num_wobbles(const size_type num_wobbles);
+
+  void set_do_post_splat_2D_smooth(const bool do_smooth);
+
+  void set_post_splat_2D_smooth_y_radius(const size_type smooth_radius);
+  
+  void set_post_splat_2D_smooth_x_radius(const size_type smooth_radius);
+
+  bool bilinear_in_2d() const;
+
+  void set_bilinear_in_2d(const bool b);
+
+  /// \brief Arguments that will be passed to the splatting kernel
+  ///
+  /// This has public visibility in order to use the 
+  /// BOOST_COMPUTE_ADAPT_STRUCT functionality.
+  struct SplatArgs
+  {
+    // x, y, z used
+    boost::compute::uint4_ vol_size;
+
+    // the number of bricks along x, y, z and the total number in w
+    boost::compute::uint4_ num_bricks;
+
+    boost::compute::uint_ num_det_cols;
+    boost::compute::uint_ num_det_rows;
+
+    // 0 --> no wobble
+    boost::compute::uint_ num_wobbles;
+
+    boost::compute::uint_ bilinear_in_2d;
+
+    boost::compute::uint_ seed;
+
+    boost::compute::uint_ pad1;  // un-used
+    boost::compute::uint_ pad2;  // un-used
+    boost::compute::uint_ pad3;  // un-used
+  };
+
+protected:
+  bool supports_interp_method(const InterpMethod interp_method) const override;
+
+private:
+  using UIntListDev = boost::compute::vector<boost::compute::uint_>;
+
+  /// \brief The largest number of voxels splatted concurrently by a work group.
+  constexpr static size_type kMAX_WORK_GROUP_SIZE = 256;
+
+  /// \brief Smooths the splatted images in splat_pixels_dev_ and adds them to
+  ///        the projections.
+  void smooth_and_add_to_projs();
+
+  boost::compute::kernel splat_kernel_;
+
+  boost::compute::kernel smooth_rows_kernel_;
+
+  boost::compute::kernel smooth_cols_kernel_;
+
+  size_type work_group_size_ = 0;
+
+  /// \brief The projective mapping from volume indices to (homogeneous)
+  ///        projection indices for each projection, the fourth row is un-used.
+  Float16ListHost vol_idx_to_proj_idx_xforms_host_;
+
+  Float16ListDev vol_idx_to_proj_idx_xforms_dev_;
+
+  /// \brief The mappings stored in vol_idx_to_proj_idx_xforms_dev_
+  Float16ListHost vol_idx_to_proj_idx_xforms_on_dev_;
+
+  /// \brief The number of voxels (including wobbles) splatted onto each
+  ///        projection.
+  UIntListDev num_inds_in_proj_dev_;
+
+  CoordScalarList num_inds_in_proj_;
+
+  /// \brief Splatted images prior to smoothing and the images smoothed along
+  ///        the rows, only allocated when smoothing.
+  PixelBufDev splat_pixels_dev_;
+  PixelBufDev smooth_tmp_pixels_dev_;
+
+  std::vector<PixelScalar2D> smooth_wgts_x_;
+  std::vector<PixelScalar2D> smooth_wgts_y_;
+
+  PixelBufDev smooth_wgts_x_dev_;
+  PixelBufDev smooth_wgts_y_dev_;
+
+  std::mt19937 rng_eng_;
+
+  // 0 --> no wobble
+  size_type num_wobbles_ = 8;
+
+  bool post_splat_2D_smooth_ = true;
+
+  // 0 -> auto-compute
+  size_type post_splat_2D_smooth_win_size_x_ = 0;
+  size_type post_splat_2D_smooth_win_size_y_ = 0;
+
+  bool bilinear_in_2d_ = false;
+};
+
+}  // xreg
+
+#endif
@@ -0,0 +1,335 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregCMAESPopSamplerOCL.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <boost/compute/utility/source.hpp>
+
+#include <fmt/format.h>
+
+#include "xregAssert.h"
+#include "xregOpenCLConvert.h"
+#include "xregOpenCLMath.h"
+#include "xregOpenCLProgCache.h"
+
+namespace  // un-named
+{
+
+// The number of parameters of each candidate is passed with the define
+// XREG_CMAES_NUM_PARAMS and the length of each run's parameters with
+// XREG_CMAES_RUN_PARAMS_LEN
+
+const char* kCMAES_POP_SAMPLER_OPENCL_SRC = BOOST_COMPUTE_STRINGIZE_SOURCE(
+
+// "lowbias32" integer hash
+uint xregCMAESHash32(uint x)
+{
+  x ^= x >> 16;
+  x *= 0x7FEB352Du;
+  x ^= x >> 15;
+  x *= 0x846CA68Bu;
+  x ^= x >> 16;
+  return x;
+}
+
+// uniform in (0,1), using 24 bits so that the value is exactly representable
+float xregCMAESUniform(const uint seed, const uint counter)
+{
+  return ((xregCMAESHash32(xregCMAESHash32(counter) ^ seed) >> 8) + 0.5f) * (1.0f / 16777216.0f);
+}
+
+// standard normal variate using the Box-Muller transform of two uniforms
+float xregCMAESStdNormal(const uint seed, const uint counter)
+{
+  const float u1 = xregCMAESUniform(seed, 2 * counter);
+  const float u2 = xregCMAESUniform(seed, (2 * counter) + 1);
+
+  return sqrt(-2.0f * log(u1)) * cos(6.28318530718f * u2);
+}
+
+// one work item per candidate
+__kernel void CMAESSamplePosesKernel(__global const float* run_params,
+                                     const uint pop_size,
+                                     const uint tot_pop_size,
+                                     const uint num_cams,
+                                     const uint seed,
+                                     const uint gen,
+                                     const float16 pre_xform,
+                                     const float16 post_xform,
+                                     __global float16* dst_xforms)
+{
+  const uint cand_idx = get_global_id(0);
+
+  if (cand_idx < tot_pop_size)
+  {
+    __global const float* cur_run_params = run_params + ((cand_idx / pop_size) * XREG_CMAES_RUN_PARAMS_LEN);
+
+    __global const float* mean       = cur_run_params;
+    __global const float* cov_factor = cur_run_params + XREG_CMAES_NUM_PARAMS;
+
+    const float sigma = cur_run_params[XREG_CMAES_RUN_PARAMS_LEN - 1];
+
+    const uint counter_off = ((gen * tot_pop_size) + cand_idx) * XREG_CMAES_NUM_PARAMS;
+
+    float z[XREG_CMAES_NUM_PARAMS];
+
+    for (uint i = 0; i < XREG_CMAES_NUM_PARAMS; ++i)
+    {
+      z[i] = xregCMAESStdNormal(seed, counter_off + i);
+    }
+
+    float x[XREG_CMAES_NUM_PARAMS];
+
+    for (uint i = 0; i < XREG_CMAES_NUM_PARAMS; ++i)
+    {
+      float s = 0;
+
+      for (uint j = 0; j < XREG_CMAES_NUM_PARAMS; ++j)
+      {
+        s += cov_factor[(i * XREG_CMAES_NUM_PARAMS) + j] * z[j];
+      }
+
+      x[i] = mean[i] + (sigma * s);
+    }
+
+    // exponential of the se(3) element, rotation params first
+    const float wx = x[0];
+    const float wy = x[1];
+    const float wz = x[2];
+
+    const float theta_sq = (wx * wx) + (wy * wy) + (wz * wz);
+
+    float a = 0;
+    float b = 0;
+    float d = 0;
+
+    if (theta_sq < 1.0e-6f)
+    {
+      // Taylor expansions about zero
+      a = 1.0f - (theta_sq / 6.0f);
+      b = 0.5f - (theta_sq / 24.0f);
+      d = (1.0f / 6.0f) - (theta_sq / 120.0f);
+    }
+    else
+    {
+      const float theta = sqrt(theta_sq);
+
+      a = sin(theta) / theta;
+      b = (1.0f - cos(theta)) / theta_sq;
+      d = (1.0f - a) / theta_sq;
+    }
+
+    float16 delta;
+
+    // R = I + a W + b W^2, W^2 = w w^T - theta^2 I
+    delta.s0 = 1.0f + (b * ((wx * wx) - theta_sq));
+    delta.s1 = (b * wx * wy) - (a * wz);
+    delta.s2 = (b * wx * wz) + (a * wy);
+    delta.s4 = (b * wx * wy) + (a * wz);
+    delta.s5 = 1.0f + (b * ((wy * wy) - theta_sq));
+    delta.s6 = (b * wy * wz) - (a * wx);
+    delta.s8 = (b * wx * wz) - (a * wy);
+    delta.s9 = (b * wy * wz) + (a * wx);
+    delta.sa = 1.0f + (b * ((wz * wz) - theta_sq));
+
+    // translation = (I + b W + d W^2) v
+    const float3 w = (float3) (wx, wy, wz);
+    const float3 v = (float3) (x[3], x[4], x[5]);
+
+    const float3 w_cross_v = cross(w, v);
+
+    const float3 t = v + (b * w_cross_v) + (d * cross(w, w_cross_v));
+
+    delta.s3 = t.x;
+    delta.s7 = t.y;
+    delta.sb = t.z;
+
+    delta.sc = 0;
+    delta.sd = 0;
+    delta.se = 0;
+    delta.sf = 1;
+
+    const float16 xform = xregFrm4x4Composition(xregFrm4x4Composition(pre_xform, delta), post_xform);
+
+    for (uint cam_idx = 0; cam_idx < num_cams; ++cam_idx)
+    {
+      dst_xforms[(cam_idx * tot_pop_size) + cand_idx] = xform;
+    }
+  }
+}
+
+);
+
+// These match the device functions above; the uniforms are identical and
+// the normal variates are computed in double precision
+
+std::uint32_t CMAESHash32(std::uint32_t x)
+{
+  x ^= x >> 16;
+  x *= 0x7FEB352Du;
+  x ^= x >> 15;
+  x *= 0x846CA68Bu;
+  x ^= x >> 16;
+  return x;
+}
+
+double CMAESUniform(const std::uint32_t seed, const std::uint32_t counter)
+{
+  return ((CMAESHash32(CMAESHash32(counter) ^ seed) >> 8) + 0.5) * (1.0 / 16777216.0);
+}
+
+double CMAESStdNormal(const std::uint32_t seed, const std::uint32_t counter)
+{
+  const double u1 = CMAESUniform(seed, 2 * counter);
+  const double u2 = CMAESUniform(seed, (2 * counter) + 1);
+
+  return std::sqrt(-2.0 * std::log(u1)) * std::cos(6.28318530717958647692 * u2);
+}
+
+}  // un-named
+
+constexpr xreg::size_type xreg::CMAESSE3PopSamplerOCL::kNUM_PARAMS;
+
+xreg::CMAESSE3PopSamplerOCL::CMAESSE3PopSamplerOCL(const boost::compute::command_queue& queue)
+  : queue_(queue),
+    run_dists_dev_(queue.get_context())
+{
+  boost::compute::program prog = BuildOpenCLProg(
+                          fmt::format("#define XREG_CMAES_NUM_PARAMS {}\n"
+                                      "#define XREG_CMAES_RUN_PARAMS_LEN {}\n",
+                                      kNUM_PARAMS, std::tuple_size<RunDistParams>::value) +
+                          kOPENCL_MATH_UTILS_SRC + kCMAES_POP_SAMPLER_OPENCL_SRC,
+                          queue_.get_context());
+
+  sample_krnl_ = prog.create_kernel("CMAESSamplePosesKernel");
+
+  set_pre_post_xforms(FrameTransform::Identity(), FrameTransform::Identity());
+
+  set_num_runs_and_pop_size(1, 1);
+}
+
+void xreg::CMAESSE3PopSamplerOCL::set_num_runs_and_pop_size(const size_type num_runs,
+                                                            const size_type pop_size)
+{
+  xregASSERT(num_runs && pop_size);
+
+  num_runs_ = num_runs;
+  pop_size_ = pop_size;
+
+  run_dists_.resize(num_runs_);
+}
+
+void xreg::CMAESSE3PopSamplerOCL::set_seed(const std::uint32_t seed)
+{
+  seed_ = seed;
+}
+
+void xreg::CMAESSE3PopSamplerOCL::set_pre_post_xforms(const FrameTransform& pre_xform,
+                                                      const FrameTransform& post_xform)
+{
+  pre_xform_  = OpenCLFloat16ToBoostComp16(ConvertToOpenCL(pre_xform));
+  post_xform_ = OpenCLFloat16ToBoostComp16(ConvertToOpenCL(post_xform));
+}
+
+void xreg::CMAESSE3PopSamplerOCL::set_run_dist(const size_type run_idx, const double* mean,
+                                               const double* cov_factor, const double sigma)
+{
+  RunDistParams& p = run_dists_[run_idx];
+
+  std::copy(mean, mean + kNUM_PARAMS, p.begin());
+  std::copy(cov_factor, cov_factor + (kNUM_PARAMS * kNUM_PARAMS), p.begin() + kNUM_PARAMS);
+
+  p.back() = sigma;
+}
+
+void xreg::CMAESSE3PopSamplerOCL::sample_poses(const size_type gen, const size_type num_cams,
+                                               Float16ListDev* dst_xforms)
+{
+  namespace bc = boost::compute;
+
+  const size_type tot_pop_size = num_runs_ * pop_size_;
+
+  xregASSERT(dst_xforms->size() >= (num_cams * tot_pop_size));
+
+  last_gen_ = gen;
+
+  run_dists_host_.clear();
+
+  for (const auto& p : run_dists_)
+  {
+    run_dists_host_.insert(run_dists_host_.end(), p.begin(), p.end());
+  }
+
+  run_dists_dev_.assign(run_dists_host_.begin(), run_dists_host_.end(), queue_);
+
+  sample_krnl_.set_arg(0, run_dists_dev_);
+  sample_krnl_.set_arg(1, bc::uint_(pop_size_));
+  sample_krnl_.set_arg(2, bc::uint_(tot_pop_size));
+  sample_krnl_.set_arg(3, bc::uint_(num_cams));
+  sample_krnl_.set_arg(4, bc::uint_(seed_));
+  sample_krnl_.set_arg(5, bc::uint_(gen));
+  sample_krnl_.set_arg(6, pre_xform_);
+  sample_krnl_.set_arg(7, post_xform_);
+  sample_krnl_.set_arg(8, *dst_xforms);
+
+  queue_.enqueue_1d_range_kernel(sample_krnl_, 0, tot_pop_size, 0);
+}
+
+void xreg::CMAESSE3PopSamplerOCL::host_candidate(const size_type run_idx, const size_type pop_idx,
+                                                 double* x) const
+{
+  const RunDistParams& p = run_dists_[run_idx];
+
+  const std::uint32_t tot_pop_size = static_cast<std::uint32_t>(num_runs_ * pop_size_);
+
+  const std::uint32_t cand_idx = static_cast<std::uint32_t>((run_idx * pop_size_) + pop_idx);
+
+  // unsigned arithmetic wraps in the same way as the device
+  const std::uint32_t counter_off = ((static_cast<std::uint32_t>(last_gen_) * tot_pop_size) + cand_idx) *
+                                       static_cast<std::uint32_t>(kNUM_PARAMS);
+
+  std::array<double,kNUM_PARAMS> z;
+
+  for (size_type i = 0; i < kNUM_PARAMS; ++i)
+  {
+    z[i] = CMAESStdNormal(seed_, counter_off + static_cast<std::uint32_t>(i));
+  }
+
+  const double sigma = p.back();
+
+  for (size_type i = 0; i < kNUM_PARAMS; ++i)
+  {
+    double s = 0;
+
+    for (size_type j = 0; j < kNUM_PARAMS; ++j)
+    {
+      s += p[kNUM_PARAMS + (i * kNUM_PARAMS) + j] * z[j];
+    }
+
+    x[i] = p[i] + (sigma * s);
+  }
+}
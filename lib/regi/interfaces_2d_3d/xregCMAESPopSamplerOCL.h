@@ -0,0 +1,128 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGCMAESPOPSAMPLEROCL_H_
+#define XREGCMAESPOPSAMPLEROCL_H_
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <boost/compute/command_queue.hpp>
+#include <boost/compute/container/vector.hpp>
+#include <boost/compute/kernel.hpp>
+
+#include "xregCommon.h"
+
+namespace xreg
+{
+
+/// \brief Samples CMA-ES populations of se(3) Lie algebra parameters on a
+///        device and writes the corresponding poses directly into a device
+///        buffer, e.g. the poses of an OpenCL ray caster.
+///
+/// Each candidate is x = mean + sigma * A * z, where C = A * A^T is the
+/// covariance of a run and z is a standard normal vector. The exponential of
+/// x is composed with pre and post transforms, pre * exp(x) * post, and the
+/// pose is written for every camera model.
+/// The normal variates are drawn using a counter based generator, keyed on
+/// the seed, generation and candidate, so that host_candidate() reproduces
+/// the candidates without reading them back from the device; e.g. for the
+/// CMA-ES distribution update. Only the means, covariance factors and step
+/// sizes are transferred to the device for each generation.
+class CMAESSE3PopSamplerOCL
+{
+public:
+  /// \brief The number of se(3) parameters of each candidate.
+  static constexpr size_type kNUM_PARAMS = 6;
+
+  using Float16ListDev = boost::compute::vector<boost::compute::float16_>;
+
+  /// \brief Creates the sampling kernel using the context of the queue.
+  ///
+  /// The population is sampled using this queue; when it is the ray
+  /// casting queue, the poses are written before the next ray casting.
+  explicit CMAESSE3PopSamplerOCL(const boost::compute::command_queue& queue);
+
+  /// \brief Sets the number of concurrent runs and the number of candidates
+  ///        of each run.
+  ///
+  /// The candidates of each run are stored contiguously.
+  void set_num_runs_and_pop_size(const size_type num_runs, const size_type pop_size);
+
+  void set_seed(const std::uint32_t seed);
+
+  /// \brief Sets the transforms applied before and after each sampled
+  ///        delta transform.
+  void set_pre_post_xforms(const FrameTransform& pre_xform, const FrameTransform& post_xform);
+
+  /// \brief Sets the search distribution of a run for the next generation.
+  ///
+  /// cov_factor is a row-major kNUM_PARAMS x kNUM_PARAMS matrix, A, with the
+  /// covariance equal to A * A^T.
+  void set_run_dist(const size_type run_idx, const double* mean,
+                    const double* cov_factor, const double sigma);
+
+  /// \brief Enqueues the sampling of every run's candidates and the
+  ///        computation of their poses.
+  ///
+  /// The pose of candidate i for camera model c is written to
+  /// dst_xforms[(c * total population size) + i].
+  void sample_poses(const size_type gen, const size_type num_cams, Float16ListDev* dst_xforms);
+
+  /// \brief Computes a candidate of the most recent call to sample_poses() on
+  ///        the host, in double precision.
+  ///
+  /// x must have room for kNUM_PARAMS values. The normal variates match those
+  /// used by the device, so the candidate only differs by the rounding of the
+  /// device's single precision computations.
+  void host_candidate(const size_type run_idx, const size_type pop_idx, double* x) const;
+
+private:
+  using RunDistParams = std::array<double, kNUM_PARAMS + (kNUM_PARAMS * kNUM_PARAMS) + 1>;
+
+  boost::compute::command_queue queue_;
+
+  boost::compute::kernel sample_krnl_;
+
+  size_type num_runs_ = 1;
+  size_type pop_size_ = 1;
+
+  std::uint32_t seed_ = 1;
+
+  size_type last_gen_ = 0;
+
+  std::vector<RunDistParams> run_dists_;
+
+  std::vector<float> run_dists_host_;
+
+  boost::compute::vector<float> run_dists_dev_;
+
+  boost::compute::float16_ pre_xform_;
+  boost::compute::float16_ post_xform_;
+};
+
+}  // xreg
+
+#endif
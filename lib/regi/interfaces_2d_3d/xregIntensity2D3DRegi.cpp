@@ -24,6 +24,8 @@
 
 #include "xregIntensity2D3DRegi.h"
 
+#include <numeric>
+
 #include <fmt/format.h>
 
 #include <opencv2/imgcodecs.hpp>
@@ -31,14 +33,20 @@
 #include "xregAssert.h"
 #include "xregImgSimMetric2D.h"
 #include "xregSE3OptVars.h"
-#include "xregImgSimMetric2DCombine.h"
+#include "xregImgSimMetric2DCombineOCL.h"
 #include "xregRegi2D3DPenaltyFn.h"
+#include "xregLocalQuadSurrogate.h"
+#include "xregIntensity2D3DRegiObjFnCache.h"
 #include "xregIntensity2D3DRegiDebug.h"
+#include "xregRayCastBaseOCL.h"
 #include "xregFilesystemUtils.h"
+#include "xregHashUtils.h"
 #include "xregITKIOUtils.h"
 #include "xregITKOpenCVUtils.h"
 #include "xregOpenCVUtils.h"
 #include "xregTBBUtils.h"
+#include "xregProfiler.h"
+#include "xregTrace.h"
 
 void xreg::Intensity2D3DRegi::setup()
 {
@@ -52,6 +60,7 @@ void xreg::Intensity2D3DRegi::setup()
              (src_and_obj_pose_opt_vars_ && (num_views == 1) && (num_vols() == 1)));
 
   const size_type num_cams = ray_caster_->num_camera_models();
+
   const size_type tot_num_projs = num_projs_per_view_ * num_views;
 
   // Assert that we are not optimizing over camera models and the number of cameras is equal to the number of views
@@ -64,12 +73,49 @@ void xreg::Intensity2D3DRegi::setup()
 
   if (need_to_alloc_ray_caster_)
   {
+    // a second compute slot allows half of a population to be ray cast while
+    // the similarity metrics of the other half are computed
+    RayCasterOCL* ray_caster_ocl = dynamic_cast<RayCasterOCL*>(ray_caster_.get());
+
+    if (pipeline_pop_obj_fn_ && ray_caster_ocl && ray_caster_ocl->supports_compute_slots())
+    {
+      ray_caster_ocl->set_num_compute_slots(2);
+    }
+
     // all other parameters should have already been set.
     ray_caster_->allocate_resources();
 
     need_to_alloc_ray_caster_ = false;
   }
 
+  // The ray caster may have been allocated with fewer projections than required,
+  // e.g. to fit within a device memory budget
+  const size_type max_num_projs_ray_caster = ray_caster_->max_num_projs();
+
+  if (tot_num_projs > max_num_projs_ray_caster)
+  {
+    const size_type max_num_projs_per_view = max_num_projs_ray_caster / num_views;
+
+    if (supports_smaller_batches() && max_num_projs_per_view && !src_and_obj_pose_opt_vars_)
+    {
+      this->dout() << "reducing number of projections per view from " << num_projs_per_view_
+                   << " to " << max_num_projs_per_view << " to fit the ray caster" << std::endl;
+
+      num_projs_per_view_ = max_num_projs_per_view;
+
+      ray_caster_->set_num_projs(num_projs_per_view_ * num_views);
+    }
+    else
+    {
+      xregThrow("Ray caster can only compute %lu projections, but %lu projections per view "
+                "(%lu views) are required by the optimizer! Try increasing the device memory "
+                "budget or reducing the number of projections per iteration.",
+                static_cast<unsigned long>(max_num_projs_ray_caster),
+                static_cast<unsigned long>(num_projs_per_view_),
+                static_cast<unsigned long>(num_views));
+    }
+  }
+
   for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
   {
     sim_metrics_[view_idx]->set_save_aux_info(this->sim_metric_debug_save_info_ &&
@@ -95,9 +141,18 @@ void xreg::Intensity2D3DRegi::setup()
 
   if (need_to_setup_sim_combiner_)
   {
-    sim_metric_combiner_ = std::make_shared<ImgSimMetric2DCombineMean>();
+    if (combine_sim_vals_on_dev_)
+    {
+      sim_metric_combiner_ = std::make_shared<ImgSimMetric2DCombineMeanOCL>();
+    }
+    else
+    {
+      sim_metric_combiner_ = std::make_shared<ImgSimMetric2DCombineMean>();
+    }
+
     sim_metric_combiner_->set_num_sim_metrics(num_views);
     sim_metric_combiner_->set_num_projs_per_sim_metric(num_projs_per_view_);
+    sim_metric_combiner_->set_compute_sim_metrics_concurrently(compute_sim_metrics_concurrently_);
     sim_metric_combiner_->allocate_resources();
 
     for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
@@ -108,6 +163,58 @@ void xreg::Intensity2D3DRegi::setup()
     need_to_setup_sim_combiner_ = false;
   }
 
+  xregASSERT(ray_cast_stages_.empty() || !src_and_obj_pose_opt_vars_);
+
+  for (auto& stage : ray_cast_stages_)
+  {
+    xregASSERT(stage.sim_metrics.size() == num_views);
+
+    stage.ray_caster->set_num_projs(num_projs_per_view_ * num_views);
+
+    if (stage.need_to_alloc_ray_caster)
+    {
+      stage.ray_caster->allocate_resources();
+
+      stage.need_to_alloc_ray_caster = false;
+    }
+
+    if (stage.ray_caster->max_num_projs() < (num_projs_per_view_ * num_views))
+    {
+      xregThrow("Ray caster of stage can only compute %lu projections, but %lu are required!",
+                static_cast<unsigned long>(stage.ray_caster->max_num_projs()),
+                static_cast<unsigned long>(num_projs_per_view_ * num_views));
+    }
+
+    for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
+    {
+      stage.sim_metrics[view_idx]->set_num_moving_images(num_projs_per_view_);
+
+      stage.sim_metrics[view_idx]->set_mov_imgs_buf_from_ray_caster(stage.ray_caster.get(),
+                                                                    num_projs_per_view_ * view_idx);
+    }
+
+    if (stage.need_to_alloc_sim_metrics)
+    {
+      for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
+      {
+        stage.sim_metrics[view_idx]->allocate_resources();
+      }
+
+      stage.need_to_alloc_sim_metrics = false;
+    }
+
+    stage.sim_metric_combiner = std::make_shared<ImgSimMetric2DCombineMean>();
+    stage.sim_metric_combiner->set_num_sim_metrics(num_views);
+    stage.sim_metric_combiner->set_num_projs_per_sim_metric(num_projs_per_view_);
+    stage.sim_metric_combiner->set_compute_sim_metrics_concurrently(compute_sim_metrics_concurrently_);
+    stage.sim_metric_combiner->allocate_resources();
+
+    for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
+    {
+      stage.sim_metric_combiner->set_sim_metric(view_idx, stage.sim_metrics[view_idx].get());
+    }
+  }
+
   if (need_to_init_opt_)
   {
     init_opt();
@@ -130,6 +237,18 @@ void xreg::Intensity2D3DRegi::setup()
   {
     tmp_cam_models_.resize(num_cams);
   }
+
+  if (screen_regi_)
+  {
+    xregASSERT(!src_and_obj_pose_opt_vars_);
+    xregASSERT(screen_regi_->num_vols() == num_vols());
+
+    // only the objective function of the screening object is used, so the
+    // setup of its optimizer is bypassed
+    screen_regi_->set_opt_vars(opt_vars_);
+    screen_regi_->num_projs_per_view_ = num_projs_per_view_;
+    screen_regi_->Intensity2D3DRegi::setup();
+  }
 }
   
 xreg::size_type xreg::Intensity2D3DRegi::num_vols() const
@@ -308,6 +427,34 @@ void xreg::Intensity2D3DRegi::use_ray_caster_and_sim_metrics_from_other_regi(Int
   need_to_setup_sim_combiner_ = true;
 }
 
+void xreg::Intensity2D3DRegi::add_ray_cast_stage(RayCasterPtr ray_caster,
+                                                 const SimMetricList& sim_metrics,
+                                                 const Scalar weight,
+                                                 const bool need_to_alloc)
+{
+  xregASSERT(ray_caster);
+
+  RayCastStage stage;
+  stage.ray_caster  = ray_caster;
+  stage.sim_metrics = sim_metrics;
+  stage.weight      = weight;
+
+  stage.need_to_alloc_ray_caster  = need_to_alloc;
+  stage.need_to_alloc_sim_metrics = need_to_alloc;
+
+  ray_cast_stages_.push_back(stage);
+}
+
+void xreg::Intensity2D3DRegi::clear_ray_cast_stages()
+{
+  ray_cast_stages_.clear();
+}
+
+xreg::size_type xreg::Intensity2D3DRegi::num_ray_cast_stages() const
+{
+  return ray_cast_stages_.size();
+}
+
 void xreg::Intensity2D3DRegi::set_opt_vars(SE3OptVarsPtr opt_vars)
 {
   opt_vars_ = opt_vars;
@@ -368,6 +515,12 @@ void xreg::Intensity2D3DRegi::debug_compute_drrs_single_proj_per_view(
 
   projs->resize(num_views);
 
+  if (use_sim_metric_active_pixels_)
+  {
+    // these DRRs should be complete
+    ray_caster_->clear_active_pixels();
+  }
+
   // save off some state from the ray caster
   auto cam_assocs = ray_caster_->camera_model_proj_associations();
   CamModelList orig_cams;
@@ -528,6 +681,16 @@ xreg::Intensity2D3DRegi::regi_xform_guesses() const
   return regi_xform_guesses_;
 }
 
+void xreg::Intensity2D3DRegi::add_begin_of_run_callback(CallbackFn& fn)
+{
+  begin_of_run_fns_.push_back(fn);
+}
+
+void xreg::Intensity2D3DRegi::reset_begin_of_run_callbacks()
+{
+  begin_of_run_fns_.clear();
+}
+
 void xreg::Intensity2D3DRegi::add_begin_of_iter_callback(CallbackFn& fn)
 {
   begin_of_iter_fns_.push_back(fn);
@@ -558,6 +721,32 @@ void xreg::Intensity2D3DRegi::set_max_num_iters(const size_type max_iters)
   max_num_iters_ = max_iters;
 }
 
+void xreg::Intensity2D3DRegi::request_stop(const std::string& reason)
+{
+  stop_requested_ = true;
+  stop_reason_    = reason;
+}
+
+bool xreg::Intensity2D3DRegi::stop_requested() const
+{
+  return stop_requested_;
+}
+
+const std::string& xreg::Intensity2D3DRegi::stop_reason() const
+{
+  return stop_reason_;
+}
+
+xreg::size_type xreg::Intensity2D3DRegi::num_obj_fn_evals() const
+{
+  return num_obj_fn_evals_;
+}
+
+xreg::Intensity2D3DRegi::Scalar xreg::Intensity2D3DRegi::last_obj_fn_min_val() const
+{
+  return last_obj_fn_min_val_;
+}
+
 bool xreg::Intensity2D3DRegi::has_a_static_vol() const
 {
   return has_a_static_vol_;
@@ -568,21 +757,152 @@ void xreg::Intensity2D3DRegi::set_has_a_static_vol(const bool b)
   has_a_static_vol_ = b;
 }
 
+bool xreg::Intensity2D3DRegi::use_sim_metric_active_pixels() const
+{
+  return use_sim_metric_active_pixels_;
+}
+
+void xreg::Intensity2D3DRegi::set_use_sim_metric_active_pixels(const bool u)
+{
+  use_sim_metric_active_pixels_ = u;
+}
+
+bool xreg::Intensity2D3DRegi::use_ray_caster_multi_vols() const
+{
+  return use_ray_caster_multi_vols_;
+}
+
+void xreg::Intensity2D3DRegi::set_use_ray_caster_multi_vols(const bool u)
+{
+  use_ray_caster_multi_vols_ = u;
+}
+
+bool xreg::Intensity2D3DRegi::compute_sim_metrics_concurrently() const
+{
+  return compute_sim_metrics_concurrently_;
+}
+
+void xreg::Intensity2D3DRegi::set_compute_sim_metrics_concurrently(const bool c)
+{
+  compute_sim_metrics_concurrently_ = c;
+
+  if (sim_metric_combiner_)
+  {
+    sim_metric_combiner_->set_compute_sim_metrics_concurrently(c);
+  }
+}
+
+bool xreg::Intensity2D3DRegi::combine_sim_vals_on_dev() const
+{
+  return combine_sim_vals_on_dev_;
+}
+
+void xreg::Intensity2D3DRegi::set_combine_sim_vals_on_dev(const bool c)
+{
+  combine_sim_vals_on_dev_ = c;
+
+  need_to_setup_sim_combiner_ = true;
+}
+
+bool xreg::Intensity2D3DRegi::pipeline_pop_obj_fn() const
+{
+  return pipeline_pop_obj_fn_;
+}
+
+void xreg::Intensity2D3DRegi::set_pipeline_pop_obj_fn(const bool p)
+{
+  pipeline_pop_obj_fn_ = p;
+}
+
+void xreg::Intensity2D3DRegi::set_exec_context(std::shared_ptr<ParallelExecContext> ctx)
+{
+  exec_ctx_ = ctx;
+}
+
+std::shared_ptr<xreg::ParallelExecContext> xreg::Intensity2D3DRegi::exec_context() const
+{
+  return exec_ctx_;
+}
+
+void xreg::Intensity2D3DRegi::set_screen_regi(std::shared_ptr<Intensity2D3DRegi> screen_regi,
+                                              const Scalar keep_frac)
+{
+  xregASSERT(screen_regi.get() != this);
+  xregASSERT((keep_frac > 0) && (keep_frac <= 1));
+
+  screen_regi_      = screen_regi;
+  screen_keep_frac_ = keep_frac;
+}
+
+std::shared_ptr<xreg::Intensity2D3DRegi> xreg::Intensity2D3DRegi::screen_regi() const
+{
+  return screen_regi_;
+}
+
+xreg::Intensity2D3DRegi::Scalar xreg::Intensity2D3DRegi::screen_keep_frac() const
+{
+  return screen_keep_frac_;
+}
+
+void xreg::Intensity2D3DRegi::set_surrogate(std::shared_ptr<LocalQuadSurrogate> surrogate,
+                                            const Scalar keep_frac)
+{
+  xregASSERT((keep_frac > 0) && (keep_frac <= 1));
+
+  surrogate_           = surrogate;
+  surrogate_keep_frac_ = keep_frac;
+}
+
+std::shared_ptr<xreg::LocalQuadSurrogate> xreg::Intensity2D3DRegi::surrogate() const
+{
+  return surrogate_;
+}
+
+void xreg::Intensity2D3DRegi::set_obj_fn_cache(std::shared_ptr<Intensity2D3DRegiObjFnCache> cache,
+                                               const std::string& config_desc)
+{
+  obj_fn_cache_             = cache;
+  obj_fn_cache_config_desc_ = config_desc;
+}
+
+std::shared_ptr<xreg::Intensity2D3DRegiObjFnCache> xreg::Intensity2D3DRegi::obj_fn_cache() const
+{
+  return obj_fn_cache_;
+}
+
 void xreg::Intensity2D3DRegi::obj_fn(
                     const ListOfFrameTransformLists& frame_xforms_per_object,
                     const CamModelList* cams_per_proj,
                     ScalarList* sim_vals_ptr)
 {
+  apply_inter_transforms_for_obj_fn(frame_xforms_per_object, &tmp_inter_frame_xforms_);
+
+  obj_fn_for_inter_xforms(frame_xforms_per_object, tmp_inter_frame_xforms_,
+                          cams_per_proj, sim_vals_ptr);
+}
+
+void xreg::Intensity2D3DRegi::obj_fn_for_inter_xforms(
+                    const ListOfFrameTransformLists& frame_xforms_per_object,
+                    const ListOfFrameTransformLists& inter_frame_xforms,
+                    const CamModelList* cams_per_proj,
+                    ScalarList* sim_vals_ptr)
+{
+  xregPROFILE_SCOPE("obj-fn");
+
   const bool compute_penalty = penalty_fn_.get();
 
   const size_type nv = num_vols();
 
-  const auto inter_frame_xforms = apply_inter_transforms_for_obj_fn(frame_xforms_per_object);
-
   if (cams_per_proj)
   {  
     ray_caster_->set_camera_models(*cams_per_proj);
   }
+  else if (use_sim_metric_active_pixels_)
+  {
+    // the camera model for each view is constant, so only the pixels used by
+    // the view's similarity metric need to be computed
+    update_ray_caster_active_pixels();
+  }
     
   const bool orig_ray_caster_use_bg_projs = ray_caster_->use_bg_projs();
 
@@ -596,9 +916,100 @@ void xreg::Intensity2D3DRegi::obj_fn(
     ray_caster_->set_use_bg_projs(true);
   }
   ray_caster_->use_proj_store_replace_method();
-  
+
+  // The OpenCL ray casters of other stages use their own command queues, so
+  // their kernels are enqueued first and execute alongside the primary ray
+  // casting
+  enqueue_ray_cast_stages(inter_frame_xforms);
+
+  // OpenCL ray casters enqueue each volume without waiting for the kernels to
+  // finish, so that the host work below overlaps with the final ray casting.
+  RayCasterOCL* ray_caster_ocl = dynamic_cast<RayCasterOCL*>(ray_caster_.get());
+
+  // The penalty function only depends on the poses and camera models, so it
+  // is evaluated on the host while the ray casting is performed, either
+  // asynchronously on a device or concurrently on other threads.
+  const auto compute_penalty_fn = [&] ()
+  {
+    if (compute_penalty)
+    {
+      compute_penalty_for_batch(frame_xforms_per_object, inter_frame_xforms,
+                                cams_per_proj != nullptr);
+    }
+  };
+
+  if (use_ray_caster_multi_vols_ && !cams_per_proj && (nv > 1))
+  {
+    const auto ray_cast_fn = [&] ()
+    {
+      xregPROFILE_SCOPE("ray-cast");
+
+      // collect the poses of every volume and ray cast them together, the
+      // copies re-use the storage of the previous evaluation
+      tmp_xforms_for_each_vol_.resize(nv);
+
+      for (size_type vol_idx = 0; vol_idx < nv; ++vol_idx)
+      {
+        ray_caster_->distribute_xforms_among_cam_models(inter_frame_xforms[vol_idx]);
+
+        tmp_xforms_for_each_vol_[vol_idx] = ray_caster_->xforms_cam_to_itk_phys();
+      }
+
+      ray_caster_->compute_multi_vols(vol_inds_in_ray_caster_, tmp_xforms_for_each_vol_);
+    };
+
+    ParallelInvoke(ray_cast_fn, compute_penalty_fn);
+  }
+  else
+  {
+    const auto ray_cast_fn = [&] ()
+    {
+      ray_cast_vols(inter_frame_xforms, cams_per_proj, ray_caster_ocl, 0);
+    };
+
+    if (ray_caster_ocl)
+    {
+      // the kernels are enqueued without waiting, compute the penalty while
+      // they execute
+      ray_cast_fn();
+
+      compute_penalty_fn();
+
+      xregPROFILE_SCOPE("ray-cast-sync");
+
+      ray_caster_ocl->wait_for_compute();
+    }
+    else
+    {
+      ParallelInvoke(ray_cast_fn, compute_penalty_fn);
+    }
+  }
+
+  ScalarList& sim_vals = *sim_vals_ptr;
+
+  compute_sim_vals_with_penalty(inter_frame_xforms, &sim_vals);
+
+  if (has_a_static_vol_)
+  {
+    ray_caster_->set_use_bg_projs(orig_ray_caster_use_bg_projs);
+  }
+
+  last_obj_fn_min_val_ = *std::min_element(sim_vals.begin(), sim_vals.end());
+
+  ++num_obj_fn_evals_;
+}
+
+void xreg::Intensity2D3DRegi::ray_cast_vols(const ListOfFrameTransformLists& inter_frame_xforms,
+                                            const CamModelList* cams_per_proj,
+                                            RayCasterOCL* ray_caster_ocl,
+                                            const size_type slot_idx)
+{
+  const size_type nv = num_vols();
+
   for (size_type vol_idx = 0; vol_idx < nv; ++vol_idx)
   {
+    xregPROFILE_SCOPE("ray-cast");
+
     if (!cams_per_proj)
     {
       // camera models are constant (1 per view), distribute transforms amongst cameras
@@ -618,109 +1029,316 @@ void xreg::Intensity2D3DRegi::obj_fn(
       }
     }
 
-    ray_caster_->compute(vol_inds_in_ray_caster_[vol_idx]);
-      
+    if (ray_caster_ocl)
+    {
+      ray_caster_ocl->compute_async(vol_inds_in_ray_caster_[vol_idx], slot_idx);
+    }
+    else
+    {
+      ray_caster_->compute(vol_inds_in_ray_caster_[vol_idx]);
+    }
+  
     if (has_a_static_vol_)
     {
       ray_caster_->set_use_bg_projs(false);
     }
-    
+
     ray_caster_->use_proj_store_accum_method();
   }
+}
 
-  // this is equivalent to the number of views
-  const size_type num_sim_metrics = sim_metrics_.size();
+void xreg::Intensity2D3DRegi::compute_penalty_for_batch(
+                    const ListOfFrameTransformLists& frame_xforms_per_object,
+                    const ListOfFrameTransformLists& inter_frame_xforms,
+                    const bool cams_per_proj)
+{
+  xregPROFILE_SCOPE("penalty");
 
-  // e.g. for each view, compute the similarity scores for each candidate projection
-  for (size_type sim_idx = 0; sim_idx < num_sim_metrics; ++sim_idx)
+  // The ray caster updates its projection to camera associations as the poses
+  // of each volume are set, which may be concurrent with this, so the penalty
+  // uses a copy of the associations that will be set.
+  const size_type num_ray_caster_projs = ray_caster_->num_projs();
+
+  pen_cam_assocs_.resize(num_ray_caster_projs);
+
+  for (size_type proj_idx = 0; proj_idx < num_ray_caster_projs; ++proj_idx)
   {
-    sim_metrics_[sim_idx]->compute();
+    pen_cam_assocs_[proj_idx] = cams_per_proj ? proj_idx : (proj_idx / num_projs_per_view_);
   }
 
-  // combine the similarity scores for each candidate projection over all of
-  // the views
+  penalty_fn_->compute(inter_frame_xforms, num_projs_per_view_,
+                       ray_caster_->camera_models(),
+                       pen_cam_assocs_,
+                       intermediate_frames_wrt_vol_,
+                       intermediate_frames_,
+                       regi_xform_guesses_,
+                       &frame_xforms_per_object);
+}
+
+void xreg::Intensity2D3DRegi::compute_sim_vals_with_penalty(
+                    const ListOfFrameTransformLists& inter_frame_xforms,
+                    ScalarList* sim_vals_ptr)
+{
   ScalarList& sim_vals = *sim_vals_ptr;
-  xregASSERT(sim_vals.size() == num_projs_per_view_);
 
-  sim_metric_combiner_->compute();
+  // The penalty terms are applied by a device combiner along with the mean of
+  // the views, unless the scores of additional stages need to be added first
+  ImgSimMetric2DCombineMeanOCL* dev_combiner = ray_cast_stages_.empty() ?
+        dynamic_cast<ImgSimMetric2DCombineMeanOCL*>(sim_metric_combiner_.get()) : nullptr;
 
-  for (size_type proj_idx = 0; proj_idx < num_projs_per_view_; ++proj_idx)
+  const bool apply_penalty = penalty_fn_ && include_penalty_in_obj_fn_;
+
+  if (apply_penalty && dev_combiner)
   {
-    sim_vals[proj_idx] = sim_metric_combiner_->sim_val(proj_idx);
+    dev_combiner->set_penalty(penalty_fn_->reg_vals(), coeffs_img_sim_, coeffs_penalty_fns_);
   }
 
-  // Handle regularization if it has been specified
-  if (compute_penalty)
+  compute_sim_vals_of_projs_and_stages(inter_frame_xforms, &sim_vals);
+
+  // Handle regularization if it has been specified, the penalty values were
+  // computed along with the DRRs
+  if (apply_penalty && !dev_combiner)
   {
-    penalty_fn_->compute(inter_frame_xforms, num_projs_per_view_,
-                         ray_caster_->camera_models(),
-                         ray_caster_->camera_model_proj_associations(),
-                         intermediate_frames_wrt_vol_,
-                         intermediate_frames_,
-                         regi_xform_guesses_,
-                         &frame_xforms_per_object);
-    
-    if (include_penalty_in_obj_fn_)
-    {
-      auto penalty_vals = penalty_fn_->reg_vals();
+    const auto& penalty_vals = penalty_fn_->reg_vals();
 
-      if (!coeffs_img_sim_.empty())
-      {
-        for (size_type proj_idx = 0; proj_idx < num_projs_per_view_; ++proj_idx)
-        {
-          sim_vals[proj_idx] *= coeffs_img_sim_[proj_idx];
-        }
-      }
-      
-      if (!coeffs_penalty_fns_.empty())
-      {
-        for (size_type proj_idx = 0; proj_idx < num_projs_per_view_; ++proj_idx)
-        {
-          penalty_vals[proj_idx] *= coeffs_penalty_fns_[proj_idx];
-        }
-      }
-      
+    if (!coeffs_img_sim_.empty())
+    {
       for (size_type proj_idx = 0; proj_idx < num_projs_per_view_; ++proj_idx)
       {
-        sim_vals[proj_idx] += penalty_vals[proj_idx];
+        sim_vals[proj_idx] *= coeffs_img_sim_[proj_idx];
       }
     }
-  }
+    
+    const bool use_pen_coeffs = !coeffs_penalty_fns_.empty();
 
-  if (has_a_static_vol_)
-  {
+    for (size_type proj_idx = 0; proj_idx < num_projs_per_view_; ++proj_idx)
+    {
+      sim_vals[proj_idx] += use_pen_coeffs ?
+                              (coeffs_penalty_fns_[proj_idx] * penalty_vals[proj_idx]) :
+                              penalty_vals[proj_idx];
+    }
+  }
+}
+
+void xreg::Intensity2D3DRegi::obj_fn_for_ray_caster_dev_xforms(ScalarList* sim_vals_ptr)
+{
+  xregPROFILE_SCOPE("obj-fn");
+
+  RayCasterOCL* ray_caster_ocl = dynamic_cast<RayCasterOCL*>(ray_caster_.get());
+
+  xregASSERT(ray_caster_ocl && ray_caster_ocl->supports_dev_xforms_cam_to_itk_phys());
+  xregASSERT((num_vols() == 1) && !penalty_fn_ && !src_and_obj_pose_opt_vars_);
+
+  if (use_sim_metric_active_pixels_)
+  {
+    update_ray_caster_active_pixels();
+  }
+
+  const bool orig_ray_caster_use_bg_projs = ray_caster_->use_bg_projs();
+
+  if (has_a_static_vol_)
+  {
+    ray_caster_->set_use_bg_projs(true);
+  }
+  ray_caster_->use_proj_store_replace_method();
+
+  {
+    xregPROFILE_SCOPE("ray-cast");
+
+    // the camera model for each view is constant, these are only transferred
+    // when changed
+    const size_type num_ray_caster_projs = ray_caster_->num_projs();
+
+    for (size_type proj_idx = 0; proj_idx < num_ray_caster_projs; ++proj_idx)
+    {
+      ray_caster_->set_proj_cam_model(proj_idx, proj_idx / num_projs_per_view_);
+    }
+
+    ray_caster_ocl->set_use_dev_xforms_cam_to_itk_phys(true);
+
+    ray_caster_ocl->compute(vol_inds_in_ray_caster_[0]);
+
+    ray_caster_ocl->set_use_dev_xforms_cam_to_itk_phys(false);
+  }
+
+  compute_sim_vals_of_projs(sim_vals_ptr);
+
+  if (has_a_static_vol_)
+  {
     ray_caster_->set_use_bg_projs(orig_ray_caster_use_bg_projs);
   }
 
+  last_obj_fn_min_val_ = *std::min_element(sim_vals_ptr->begin(), sim_vals_ptr->end());
+
   ++num_obj_fn_evals_;
 }
 
-void xreg::Intensity2D3DRegi::obj_fn(
-                    const ListOfListsOfScalarLists& opt_vec_space_vals,
-                    ScalarList* sim_vals_ptr)
+void xreg::Intensity2D3DRegi::compute_sim_vals_of_projs(ScalarList* sim_vals_ptr)
 {
-  const SE3OptVars& opt_vars = *opt_vars_;
+  ScalarList& sim_vals = *sim_vals_ptr;
+  xregASSERT(sim_vals.size() == num_projs_per_view_);
 
-  const size_type num_params_per_xform = opt_vars.num_params();
+  {
+    xregPROFILE_SCOPE("sim-metric");
 
-  const size_type nv = num_vols();
+    // e.g. for each view, compute the similarity scores for each candidate
+    // projection, the views may be computed concurrently
+    sim_metric_combiner_->compute_sim_metrics();
+
+    // combine the similarity scores for each candidate projection over all of
+    // the views
+    sim_metric_combiner_->compute();
+  }
+
+  for (size_type proj_idx = 0; proj_idx < num_projs_per_view_; ++proj_idx)
+  {
+    sim_vals[proj_idx] = sim_metric_combiner_->sim_val(proj_idx);
+  }
+}
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+// The OpenCL ray caster of a stage which may be enqueued without waiting,
+// null otherwise.
+RayCasterOCL* StageRayCasterOCLForAsync(RayCaster* ray_caster)
+{
+  return dynamic_cast<RayCasterOCL*>(ray_caster);
+}
+
+// Ray casts the candidate poses of every volume, the projections of the first
+// volume replace the previous projections and the others are accumulated.
+void RayCastStageVols(RayCaster* ray_caster, RayCasterOCL* ray_caster_ocl,
+                      const IndexList& vol_inds,
+                      const ListOfFrameTransformLists& inter_frame_xforms)
+{
+  const size_type nv = vol_inds.size();
+
+  ray_caster->use_proj_store_replace_method();
 
-  // Map from optimization vector space to rigid transformation parameterizations and
-  // camera models
   for (size_type vol_idx = 0; vol_idx < nv; ++vol_idx)
   {
-    tmp_frame_xforms_[vol_idx].resize(num_projs_per_view_);
+    ray_caster->distribute_xforms_among_cam_models(inter_frame_xforms[vol_idx]);
 
-    // compute frame transformations 
+    if (ray_caster_ocl)
+    {
+      ray_caster_ocl->compute_async(vol_inds[vol_idx]);
+    }
+    else
+    {
+      ray_caster->compute(vol_inds[vol_idx]);
+    }
+
+    ray_caster->use_proj_store_accum_method();
+  }
+}
+
+}  // un-named
+
+void xreg::Intensity2D3DRegi::enqueue_ray_cast_stages(const ListOfFrameTransformLists& inter_frame_xforms)
+{
+  for (auto& stage : ray_cast_stages_)
+  {
+    RayCasterOCL* ray_caster_ocl = StageRayCasterOCLForAsync(stage.ray_caster.get());
+
+    if (ray_caster_ocl)
+    {
+      xregPROFILE_SCOPE("ray-cast-stage-enqueue");
+
+      RayCastStageVols(ray_caster_ocl, ray_caster_ocl, vol_inds_in_ray_caster_, inter_frame_xforms);
+    }
+  }
+}
+
+void xreg::Intensity2D3DRegi::compute_sim_vals_of_projs_and_stages(
+                                  const ListOfFrameTransformLists& inter_frame_xforms,
+                                  ScalarList* sim_vals_ptr)
+{
+  const size_type num_stages = ray_cast_stages_.size();
+
+  if (!num_stages)
+  {
+    compute_sim_vals_of_projs(sim_vals_ptr);
+    return;
+  }
+
+  // node 0 is the primary similarity computation, node i > 0 waits for, or
+  // computes, the ray casting of stage i - 1 and then computes its
+  // similarity values; the nodes have no dependencies amongst each other
+  auto node_fn = [&] (const RangeType& r)
+  {
+    for (size_type node_idx = r.begin(); node_idx < r.end(); ++node_idx)
+    {
+      if (!node_idx)
+      {
+        compute_sim_vals_of_projs(sim_vals_ptr);
+      }
+      else
+      {
+        auto& stage = ray_cast_stages_[node_idx - 1];
+
+        RayCasterOCL* ray_caster_ocl = StageRayCasterOCLForAsync(stage.ray_caster.get());
+
+        {
+          xregPROFILE_SCOPE("ray-cast-stage");
+
+          if (ray_caster_ocl)
+          {
+            ray_caster_ocl->wait_for_compute();
+          }
+          else
+          {
+            RayCastStageVols(stage.ray_caster.get(), nullptr,
+                             vol_inds_in_ray_caster_, inter_frame_xforms);
+          }
+        }
+
+        xregPROFILE_SCOPE("sim-metric-stage");
+
+        stage.sim_metric_combiner->compute_sim_metrics();
+        stage.sim_metric_combiner->compute();
+      }
+    }
+  };
+
+  ParallelFor(node_fn, RangeType(0, num_stages + 1));
+
+  ScalarList& sim_vals = *sim_vals_ptr;
+
+  for (const auto& stage : ray_cast_stages_)
+  {
     for (size_type proj_idx = 0; proj_idx < num_projs_per_view_; ++proj_idx)
     {
-      tmp_frame_xforms_[vol_idx][proj_idx] =
-        opt_vars(Eigen::Map<PtN>(const_cast<Scalar*>(&opt_vec_space_vals[vol_idx][proj_idx][0]),
-                                         num_params_per_xform));
+      sim_vals[proj_idx] += stage.weight * stage.sim_metric_combiner->sim_val(proj_idx);
     }
   }
-  
-  if (!src_and_obj_pose_opt_vars_)
+}
+
+void xreg::Intensity2D3DRegi::obj_fn(
+                    const ListOfListsOfScalarLists& opt_vec_space_vals,
+                    ScalarList* sim_vals_ptr)
+{
+  if (obj_fn_cache_active_ && !obj_fn_cache_bypass_)
+  {
+    cached_obj_fn(opt_vec_space_vals, sim_vals_ptr);
+    return;
+  }
+
+  const size_type num_params_per_xform = opt_vars_->num_params();
+
+  const size_type nv = num_vols();
+
+  const bool compose_inter_frames = compose_obj_fn_xforms(opt_vec_space_vals, 0, num_projs_per_view_,
+                                                          &tmp_frame_xforms_,
+                                                          &tmp_inter_frame_xforms_);
+
+  if (compose_inter_frames)
+  {
+    obj_fn_for_inter_xforms(tmp_frame_xforms_, tmp_inter_frame_xforms_, nullptr, sim_vals_ptr);
+  }
+  else if (!src_and_obj_pose_opt_vars_)
   {
     obj_fn(tmp_frame_xforms_, nullptr, sim_vals_ptr);
   }
@@ -741,9 +1359,553 @@ void xreg::Intensity2D3DRegi::obj_fn(
   }
 }
   
+bool xreg::Intensity2D3DRegi::compose_obj_fn_xforms(
+                    const ListOfListsOfScalarLists& opt_vec_space_vals,
+                    const size_type first_cand,
+                    const size_type num_cands,
+                    ListOfFrameTransformLists* frame_xforms,
+                    ListOfFrameTransformLists* inter_frame_xforms)
+{
+  const SE3OptVars& opt_vars = *opt_vars_;
+
+  const size_type num_params_per_xform = opt_vars.num_params();
+
+  const size_type nv = num_vols();
+
+  // When every volume uses static intermediate frames, the poses used for ray
+  // casting are composed directly from the entire population of parameters.
+  // The delta transforms are only needed by a penalty function.
+  bool compose_inter_frames = !src_and_obj_pose_opt_vars_;
+
+  for (size_type vol_idx = 0; compose_inter_frames && (vol_idx < nv); ++vol_idx)
+  {
+    compose_inter_frames = !dyn_ref_frame_fns_[vol_idx];
+  }
+
+  const bool need_delta_xforms = !compose_inter_frames || penalty_fn_;
+
+  if (need_delta_xforms)
+  {
+    frame_xforms->resize(nv);
+  }
+
+  if (compose_inter_frames)
+  {
+    inter_frame_xforms->resize(nv);
+  }
+
+  // Map from optimization vector space to rigid transformation parameterizations and
+  // camera models
+  xregPROFILE_SCOPE("pose-composition");
+
+  tmp_opt_params_.resize(num_params_per_xform, num_cands);
+
+  for (size_type vol_idx = 0; vol_idx < nv; ++vol_idx)
+  {
+    for (size_type proj_idx = 0; proj_idx < num_cands; ++proj_idx)
+    {
+      tmp_opt_params_.col(proj_idx) =
+        Eigen::Map<const PtN>(&opt_vec_space_vals[vol_idx][first_cand + proj_idx][0],
+                              num_params_per_xform);
+    }
+
+    if (need_delta_xforms)
+    {
+      (*frame_xforms)[vol_idx].resize(num_cands);
+
+      opt_vars.batch_xforms(tmp_opt_params_, &(*frame_xforms)[vol_idx][0]);
+    }
+
+    if (compose_inter_frames)
+    {
+      (*inter_frame_xforms)[vol_idx].resize(num_cands);
+
+      const auto pre_post = inter_frame_pre_post_xforms(vol_idx);
+
+      opt_vars.batch_composed_xforms(tmp_opt_params_, std::get<0>(pre_post), std::get<1>(pre_post),
+                                     &(*inter_frame_xforms)[vol_idx][0]);
+    }
+  }
+
+  return compose_inter_frames;
+}
+
+void xreg::Intensity2D3DRegi::cached_obj_fn(
+                    const ListOfListsOfScalarLists& opt_vec_space_vals,
+                    ScalarList* sim_vals_ptr)
+{
+  xregPROFILE_SCOPE("obj-fn-cache");
+
+  const size_type num_cands = num_projs_per_view_;
+
+  ScalarList& sim_vals = *sim_vals_ptr;
+  xregASSERT(sim_vals.size() == num_cands);
+
+  // a batch is a subset of the candidates being evaluated by a caller, e.g.
+  // pop_obj_fn(), so the temporaries cannot be shared
+  IndexList miss_inds;
+  std::vector<Intensity2D3DRegiObjFnCache::Key> miss_keys;
+
+  for (size_type cand_idx = 0; cand_idx < num_cands; ++cand_idx)
+  {
+    auto key = obj_fn_cache_->make_key(obj_fn_cache_config_key_, opt_vec_space_vals, cand_idx);
+
+    if (obj_fn_cache_->find(key, &sim_vals[cand_idx]))
+    {
+      // the number of calls to this region is the number of cache hits
+      xregPROFILE_SCOPE("obj-fn-cache-hit");
+    }
+    else
+    {
+      xregPROFILE_SCOPE("obj-fn-cache-miss");
+
+      miss_inds.push_back(cand_idx);
+      miss_keys.push_back(std::move(key));
+    }
+  }
+
+  const size_type num_misses = miss_inds.size();
+
+  obj_fn_cache_bypass_ = true;
+
+  if (num_misses == num_cands)
+  {
+    obj_fn(opt_vec_space_vals, sim_vals_ptr);
+  }
+  else if (num_misses)
+  {
+    ListOfListsOfScalarLists miss_params;
+    ScalarList miss_sim_vals;
+
+    obj_fn_for_subset(opt_vec_space_vals, miss_inds, num_misses, &miss_params, &miss_sim_vals);
+
+    for (size_type k = 0; k < num_misses; ++k)
+    {
+      sim_vals[miss_inds[k]] = miss_sim_vals[k];
+    }
+  }
+  else
+  {
+    // every value was cached, no projections were computed
+    last_obj_fn_min_val_ = *std::min_element(sim_vals.begin(), sim_vals.end());
+
+    ++num_obj_fn_evals_;
+  }
+
+  obj_fn_cache_bypass_ = false;
+
+  for (size_type k = 0; k < num_misses; ++k)
+  {
+    obj_fn_cache_->insert(miss_keys[k], sim_vals[miss_inds[k]]);
+  }
+}
+
+void xreg::Intensity2D3DRegi::pop_obj_fn(
+                    const ListOfListsOfScalarLists& opt_vec_space_vals,
+                    ScalarList* sim_vals_ptr)
+{
+  const size_type num_cands = num_projs_per_view_;
+
+  const size_type nv = num_vols();
+
+  if (surrogate_)
+  {
+    // the surrogate model is over the parameters of every volume
+    const size_type num_params_per_xform = opt_vars_->num_params();
+
+    surrogate_cand_pts_.resize(num_cands);
+
+    for (size_type cand_idx = 0; cand_idx < num_cands; ++cand_idx)
+    {
+      PtN& x = surrogate_cand_pts_[cand_idx];
+      x.resize(num_params_per_xform * nv);
+
+      for (size_type vol_idx = 0; vol_idx < nv; ++vol_idx)
+      {
+        x.segment(vol_idx * num_params_per_xform, num_params_per_xform) =
+          Eigen::Map<const PtN>(&opt_vec_space_vals[vol_idx][cand_idx][0], num_params_per_xform);
+      }
+    }
+  }
+
+  bool use_surrogate = false;
+
+  if (surrogate_)
+  {
+    xregPROFILE_SCOPE("surrogate-fit");
+
+    use_surrogate = surrogate_->fit_about_best();
+  }
+
+  // the model is preferred for screening, the screening object is used until
+  // enough evaluations have been archived to fit the model
+  const Scalar keep_frac = use_surrogate ? surrogate_keep_frac_ :
+                                           (screen_regi_ ? screen_keep_frac_ : Scalar(1));
+
+  const size_type num_keep = std::min(num_cands, std::max(size_type(1),
+                                        static_cast<size_type>(std::ceil(keep_frac * num_cands))));
+
+  if (num_keep == num_cands)
+  {
+    if (can_pipeline_pop_obj_fn())
+    {
+      pipelined_pop_obj_fn(opt_vec_space_vals, sim_vals_ptr);
+    }
+    else
+    {
+      obj_fn(opt_vec_space_vals, sim_vals_ptr);
+    }
+
+    for (size_type cand_idx = 0; surrogate_ && (cand_idx < num_cands); ++cand_idx)
+    {
+      surrogate_->add(surrogate_cand_pts_[cand_idx], (*sim_vals_ptr)[cand_idx]);
+    }
+
+    return;
+  }
+
+  xregPROFILE_SCOPE("screened-obj-fn");
+
+  ScalarList& sim_vals = *sim_vals_ptr;
+  xregASSERT(sim_vals.size() == num_cands);
+
+  screen_sim_vals_.resize(num_cands);
+
+  if (use_surrogate)
+  {
+    xregPROFILE_SCOPE("surrogate-screen");
+
+    for (size_type cand_idx = 0; cand_idx < num_cands; ++cand_idx)
+    {
+      screen_sim_vals_[cand_idx] = (*surrogate_)(surrogate_cand_pts_[cand_idx]);
+    }
+  }
+  else
+  {
+    xregPROFILE_SCOPE("screen");
+
+    screen_regi_->obj_fn(opt_vec_space_vals, &screen_sim_vals_);
+  }
+
+  // order the candidates by their screening values, only the best need to be sorted
+  screen_inds_.resize(num_cands);
+  std::iota(screen_inds_.begin(), screen_inds_.end(), size_type(0));
+
+  std::partial_sort(screen_inds_.begin(), screen_inds_.begin() + num_keep, screen_inds_.end(),
+                    [this] (const size_type i, const size_type j)
+                    {
+                      return screen_sim_vals_[i] < screen_sim_vals_[j];
+                    });
+
+  obj_fn_for_subset(opt_vec_space_vals, screen_inds_, num_keep,
+                    &screen_params_, &screen_fine_sim_vals_);
+
+  // candidates that were not re-scored are worse than every re-scored candidate
+  // and keep the ordering of the screening values
+  const Scalar max_fine_sim_val = *std::max_element(screen_fine_sim_vals_.begin(),
+                                                    screen_fine_sim_vals_.end());
+
+  const Scalar screen_thresh = screen_sim_vals_[screen_inds_[num_keep - 1]];
+
+  for (size_type k = num_keep; k < num_cands; ++k)
+  {
+    const size_type cand_idx = screen_inds_[k];
+
+    sim_vals[cand_idx] = max_fine_sim_val + (screen_sim_vals_[cand_idx] - screen_thresh);
+  }
+
+  for (size_type k = 0; k < num_keep; ++k)
+  {
+    sim_vals[screen_inds_[k]] = screen_fine_sim_vals_[k];
+
+    if (surrogate_)
+    {
+      surrogate_->add(surrogate_cand_pts_[screen_inds_[k]], screen_fine_sim_vals_[k]);
+    }
+  }
+}
+
+bool xreg::Intensity2D3DRegi::can_pipeline_pop_obj_fn() const
+{
+  const RayCasterOCL* ray_caster_ocl = dynamic_cast<const RayCasterOCL*>(ray_caster_.get());
+
+  return pipeline_pop_obj_fn_ && ray_caster_ocl &&
+         (ray_caster_ocl->num_compute_slots() > 1) &&
+         ray_caster_ocl->supports_compute_slots() &&
+         !ray_caster_ocl->use_dev_xforms_cam_to_itk_phys() &&
+         (num_projs_per_view_ > 1) &&
+         !src_and_obj_pose_opt_vars_ &&
+         ray_cast_stages_.empty() &&
+         !(use_ray_caster_multi_vols_ && (num_vols() > 1)) &&
+         !obj_fn_cache_active_ &&
+         !write_debug_requires_drr() &&
+         !(sim_metric_debug_save_info_ && debug_save_iter_debug_info_);
+}
+
+void xreg::Intensity2D3DRegi::pipelined_pop_obj_fn(
+                    const ListOfListsOfScalarLists& opt_vec_space_vals,
+                    ScalarList* sim_vals_ptr)
+{
+  xregPROFILE_SCOPE("obj-fn");
+
+  RayCasterOCL* ray_caster_ocl = dynamic_cast<RayCasterOCL*>(ray_caster_.get());
+
+  const size_type num_cands = num_projs_per_view_;
+
+  ScalarList& sim_vals = *sim_vals_ptr;
+  xregASSERT(sim_vals.size() == num_cands);
+
+  // the first half is ray cast using compute slot 0 and the second half using
+  // compute slot 1
+  const size_type half_offs[2]  = { 0, (num_cands + 1) / 2 };
+  const size_type half_sizes[2] = { half_offs[1], num_cands - half_offs[1] };
+
+  ListOfFrameTransformLists* frame_xforms[2]       = { &tmp_frame_xforms_, &pipe_frame_xforms_ };
+  ListOfFrameTransformLists* inter_frame_xforms[2] = { &tmp_inter_frame_xforms_,
+                                                       &pipe_inter_frame_xforms_ };
+
+  for (size_type half_idx = 0; half_idx < 2; ++half_idx)
+  {
+    if (!compose_obj_fn_xforms(opt_vec_space_vals, half_offs[half_idx], half_sizes[half_idx],
+                               frame_xforms[half_idx], inter_frame_xforms[half_idx]))
+    {
+      apply_inter_transforms_for_obj_fn(*frame_xforms[half_idx], inter_frame_xforms[half_idx]);
+    }
+  }
+
+  if (use_sim_metric_active_pixels_)
+  {
+    update_ray_caster_active_pixels();
+  }
+
+  const bool orig_ray_caster_use_bg_projs = ray_caster_->use_bg_projs();
+
+  // enqueue both halves, the kernels of the second half execute while the
+  // first half is consumed below
+  for (size_type half_idx = 0; half_idx < 2; ++half_idx)
+  {
+    set_num_projs_per_view_for_batch(half_sizes[half_idx]);
+
+    if (has_a_static_vol_)
+    {
+      ray_caster_->set_use_bg_projs(true);
+    }
+    ray_caster_->use_proj_store_replace_method();
+
+    ray_cast_vols(*inter_frame_xforms[half_idx], nullptr, ray_caster_ocl, half_idx);
+  }
+
+  // the coefficients are stored per candidate
+  ScalarList all_coeffs_img_sim;
+  ScalarList all_coeffs_penalty_fns;
+
+  all_coeffs_img_sim.swap(coeffs_img_sim_);
+  all_coeffs_penalty_fns.swap(coeffs_penalty_fns_);
+
+  for (size_type half_idx = 0; half_idx < 2; ++half_idx)
+  {
+    const size_type off = half_offs[half_idx];
+    const size_type num_half_cands = half_sizes[half_idx];
+
+    set_num_projs_per_view_for_batch(num_half_cands);
+
+    if (!all_coeffs_img_sim.empty())
+    {
+      coeffs_img_sim_.assign(all_coeffs_img_sim.begin() + off,
+                             all_coeffs_img_sim.begin() + off + num_half_cands);
+      coeffs_penalty_fns_.assign(all_coeffs_penalty_fns.begin() + off,
+                                 all_coeffs_penalty_fns.begin() + off + num_half_cands);
+    }
+
+    if (penalty_fn_)
+    {
+      compute_penalty_for_batch(*frame_xforms[half_idx], *inter_frame_xforms[half_idx], false);
+    }
+
+    {
+      xregPROFILE_SCOPE("ray-cast-sync");
+
+      if (!half_idx)
+      {
+        ray_caster_ocl->wait_for_compute(0);
+      }
+      else
+      {
+        // the similarity metrics read the primary projection buffer
+        ray_caster_ocl->copy_compute_slot_projs(1);
+      }
+    }
+
+    pipe_sim_vals_.resize(num_half_cands);
+
+    compute_sim_vals_with_penalty(*inter_frame_xforms[half_idx], &pipe_sim_vals_);
+
+    std::copy(pipe_sim_vals_.begin(), pipe_sim_vals_.end(), sim_vals.begin() + off);
+  }
+
+  coeffs_img_sim_.swap(all_coeffs_img_sim);
+  coeffs_penalty_fns_.swap(all_coeffs_penalty_fns);
+
+  set_num_projs_per_view_for_batch(num_cands);
+
+  if (has_a_static_vol_)
+  {
+    ray_caster_->set_use_bg_projs(orig_ray_caster_use_bg_projs);
+  }
+
+  last_obj_fn_min_val_ = *std::min_element(sim_vals.begin(), sim_vals.end());
+
+  ++num_obj_fn_evals_;
+}
+
+void xreg::Intensity2D3DRegi::obj_fn_for_subset(const ListOfListsOfScalarLists& opt_vec_space_vals,
+                                                const IndexList& cand_inds,
+                                                const size_type num_inds,
+                                                ListOfListsOfScalarLists* subset_params_ptr,
+                                                ScalarList* subset_sim_vals_ptr)
+{
+  const size_type nv = num_vols();
+
+  const size_type num_cands = num_projs_per_view_;
+
+  ListOfListsOfScalarLists& subset_params = *subset_params_ptr;
+
+  subset_params.resize(nv);
+
+  for (size_type vol_idx = 0; vol_idx < nv; ++vol_idx)
+  {
+    subset_params[vol_idx].resize(num_inds);
+
+    for (size_type k = 0; k < num_inds; ++k)
+    {
+      subset_params[vol_idx][k] = opt_vec_space_vals[vol_idx][cand_inds[k]];
+    }
+  }
+
+  // the coefficients are stored per candidate
+  ScalarList all_coeffs_img_sim;
+  ScalarList all_coeffs_penalty_fns;
+
+  if (!coeffs_img_sim_.empty())
+  {
+    all_coeffs_img_sim.swap(coeffs_img_sim_);
+    all_coeffs_penalty_fns.swap(coeffs_penalty_fns_);
+
+    coeffs_img_sim_.resize(num_inds);
+    coeffs_penalty_fns_.resize(num_inds);
+
+    for (size_type k = 0; k < num_inds; ++k)
+    {
+      coeffs_img_sim_[k]     = all_coeffs_img_sim[cand_inds[k]];
+      coeffs_penalty_fns_[k] = all_coeffs_penalty_fns[cand_inds[k]];
+    }
+  }
+
+  subset_sim_vals_ptr->resize(num_inds);
+
+  set_num_projs_per_view_for_batch(num_inds);
+
+  obj_fn(subset_params, subset_sim_vals_ptr);
+
+  set_num_projs_per_view_for_batch(num_cands);
+
+  if (!all_coeffs_img_sim.empty())
+  {
+    coeffs_img_sim_.swap(all_coeffs_img_sim);
+    coeffs_penalty_fns_.swap(all_coeffs_penalty_fns);
+  }
+}
+
+void xreg::Intensity2D3DRegi::set_num_projs_per_view_for_batch(const size_type num_projs_per_view)
+{
+  const size_type num_views = sim_metrics_.size();
+
+  num_projs_per_view_ = num_projs_per_view;
+
+  ray_caster_->set_num_projs(num_projs_per_view * num_views);
+
+  for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
+  {
+    sim_metrics_[view_idx]->set_num_moving_images(num_projs_per_view);
+
+    // This assumes a view-major ordering of projections in memory
+    sim_metrics_[view_idx]->set_mov_imgs_buf_from_ray_caster(ray_caster_.get(),
+                                                             num_projs_per_view * view_idx);
+  }
+
+  sim_metric_combiner_->set_num_projs_per_sim_metric(num_projs_per_view);
+
+  for (auto& stage : ray_cast_stages_)
+  {
+    stage.ray_caster->set_num_projs(num_projs_per_view * num_views);
+
+    for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
+    {
+      stage.sim_metrics[view_idx]->set_num_moving_images(num_projs_per_view);
+
+      stage.sim_metrics[view_idx]->set_mov_imgs_buf_from_ray_caster(stage.ray_caster.get(),
+                                                                    num_projs_per_view * view_idx);
+    }
+
+    stage.sim_metric_combiner->set_num_projs_per_sim_metric(num_projs_per_view);
+  }
+}
+
 void xreg::Intensity2D3DRegi::before_first_iteration()
 {
   num_obj_fn_evals_ = 0;
+
+  if (screen_regi_)
+  {
+    screen_regi_->regi_xform_guesses_          = regi_xform_guesses_;
+    screen_regi_->intermediate_frames_         = intermediate_frames_;
+    screen_regi_->intermediate_frames_wrt_vol_ = intermediate_frames_wrt_vol_;
+    screen_regi_->dyn_ref_frame_fns_           = dyn_ref_frame_fns_;
+  }
+
+  if (surrogate_)
+  {
+    // the parameters are relative to the initial guesses of this run
+    surrogate_->clear();
+  }
+
+  // the cached values depend on the initial guesses and intermediate frames,
+  // which are only known at the start of the run
+  obj_fn_cache_active_ = obj_fn_cache_ && !src_and_obj_pose_opt_vars_ &&
+                         (std::find_if(dyn_ref_frame_fns_.begin(), dyn_ref_frame_fns_.end(),
+                                       [] (const DynRefFrameFn& f) { return bool(f); }) ==
+                                                                        dyn_ref_frame_fns_.end());
+
+  if (obj_fn_cache_active_)
+  {
+    Hasher64 k;
+
+    k.add_str(obj_fn_cache_config_desc_);
+
+    const size_type nv = num_vols();
+
+    for (size_type vol_idx = 0; vol_idx < nv; ++vol_idx)
+    {
+      const auto& guess = regi_xform_guesses_[vol_idx].matrix();
+      const auto& inter = intermediate_frames_[vol_idx].matrix();
+
+      k.add(vol_inds_in_ray_caster_[vol_idx]);
+      k.add_bytes(guess.data(), sizeof(CoordScalar) * guess.size());
+      k.add_bytes(inter.data(), sizeof(CoordScalar) * inter.size());
+      k.add(bool(intermediate_frames_wrt_vol_[vol_idx]));
+    }
+
+    obj_fn_cache_config_key_ = k.value();
+  }
+
+  last_obj_fn_min_val_ = std::numeric_limits<Scalar>::max();
+
+  stop_requested_ = false;
+  stop_reason_.clear();
+
+  trace_iter_start_us_ = TraceTimestampMicros();
+  trace_iter_idx_      = 0;
+
   write_debug();
 
   if (debug_save_iter_debug_info_)
@@ -770,10 +1932,21 @@ void xreg::Intensity2D3DRegi::before_first_iteration()
     penalty_fn_->set_save_debug_info(debug_save_iter_debug_info_);
     penalty_fn_->setup();
   }
+
+  for (auto& f : begin_of_run_fns_)
+  {
+    f(this);
+  }
 }
 
 void xreg::Intensity2D3DRegi::after_last_iteration()
 {
+  if (use_sim_metric_active_pixels_)
+  {
+    // subsequent users of the ray caster should get complete DRRs
+    ray_caster_->clear_active_pixels();
+  }
+
   if (debug_save_iter_debug_info_)
   {
     debug_info_->sims_aux.clear();
@@ -787,12 +1960,16 @@ void xreg::Intensity2D3DRegi::after_last_iteration()
     {
       debug_info_->pen_fn_debug = penalty_fn_->debug_info();
     }
+
+    debug_info_->stop_reason = stop_reason_;
   }
 }
 
 void xreg::Intensity2D3DRegi::begin_of_iteration(const ScalarList& x)
 {
-  begin_of_iteration(opt_vec_to_frame_transforms(x));
+  opt_vec_to_frame_transforms(x, &tmp_delta_xforms_);
+
+  begin_of_iteration(tmp_delta_xforms_);
 }
 
 void xreg::Intensity2D3DRegi::begin_of_iteration(const FrameTransformList& delta_xforms)
@@ -807,6 +1984,17 @@ void xreg::Intensity2D3DRegi::begin_of_iteration(const FrameTransformList& delta
 
 void xreg::Intensity2D3DRegi::end_of_iteration()
 {
+  if (TracingEnabled())
+  {
+    const double cur_us = TraceTimestampMicros();
+
+    RecordTraceEvent("regi-iteration", "regi", trace_iter_start_us_, cur_us - trace_iter_start_us_,
+                     "iteration", trace_iter_idx_, "num-obj-fn-evals", num_obj_fn_evals_);
+
+    trace_iter_start_us_ = cur_us;
+    ++trace_iter_idx_;
+  }
+
   write_debug();
 
   for (auto& f : end_of_iter_fns_)
@@ -815,6 +2003,11 @@ void xreg::Intensity2D3DRegi::end_of_iteration()
   }
 }
 
+bool xreg::Intensity2D3DRegi::supports_smaller_batches() const
+{
+  return false;
+}
+
 bool xreg::Intensity2D3DRegi::write_debug_requires_drr() const
 {
   return write_remapped_drrs_ || write_raw_drrs_ || write_fixed_img_edge_overlays_;
@@ -857,12 +2050,15 @@ void xreg::Intensity2D3DRegi::debug_write_remapped_drrs()
 {
   const size_type num_sim_metrics = sim_metrics_.size();
 
+  // re-pointed at each projection, avoiding an image allocation per projection
+  auto drr_img = ray_caster_->make_proj_view(0);
+
   for (size_type view_idx = 0; view_idx < num_sim_metrics; ++view_idx)
   {
     const size_type off = view_idx * num_projs_per_view_;
     for (size_type proj_idx = 0; proj_idx < num_projs_per_view_; ++proj_idx)
     {
-      auto drr_img = ray_caster_->proj(off + proj_idx);
+      ray_caster_->proj_view(off + proj_idx, drr_img.GetPointer());
 
       Path dst_path = debug_output_dir_path_;
       dst_path += fmt::format("drr_remap_{:03d}_{:03d}_{:03d}.png", num_obj_fn_evals_, view_idx, proj_idx);
@@ -876,12 +2072,15 @@ void xreg::Intensity2D3DRegi::debug_write_raw_drrs()
 {
   const size_type num_sim_metrics = sim_metrics_.size();
 
+  // re-pointed at each projection, avoiding an image allocation per projection
+  auto drr_img = ray_caster_->make_proj_view(0);
+
   for (size_type view_idx = 0; view_idx < num_sim_metrics; ++view_idx)
   {
     const size_type off = view_idx * num_projs_per_view_;
     for (size_type proj_idx = 0; proj_idx < num_projs_per_view_; ++proj_idx)
     {
-      auto drr_img = ray_caster_->proj(off + proj_idx);
+      ray_caster_->proj_view(off + proj_idx, drr_img.GetPointer());
 
       Path dst_path = debug_output_dir_path_;
       dst_path += fmt::format("drr_raw_{:03d}_{:03d}_{:03d}.nii.gz", num_obj_fn_evals_, view_idx, proj_idx);
@@ -895,12 +2094,15 @@ void xreg::Intensity2D3DRegi::debug_write_fixed_img_edge_overlays()
 {
   const size_type num_sim_metrics = sim_metrics_.size();
 
+  // re-pointed at each projection, avoiding an image allocation per projection
+  auto drr_img = ray_caster_->make_proj_view(0);
+
   for (size_type view_idx = 0; view_idx < num_sim_metrics; ++view_idx)
   {
     const size_type off = view_idx * num_projs_per_view_;
     for (size_type proj_idx = 0; proj_idx < num_projs_per_view_; ++proj_idx)
     {
-      auto drr_img = ray_caster_->proj(off + proj_idx);
+      ray_caster_->proj_view(off + proj_idx, drr_img.GetPointer());
 
       const auto img_2d_size = drr_img->GetLargestPossibleRegion().GetSize();
 
@@ -923,7 +2125,7 @@ void xreg::Intensity2D3DRegi::update_regi_xforms(const FrameTransformList& delta
 {
   const size_type nv = num_vols();
 
-  regi_xforms_ = inter_transforms_to_regi(delta_xforms);
+  inter_transforms_to_regi(delta_xforms, &regi_xforms_);
 
   if (debug_save_iter_debug_info_)
   {
@@ -931,6 +2133,31 @@ void xreg::Intensity2D3DRegi::update_regi_xforms(const FrameTransformList& delta
   }
 }
   
+void xreg::Intensity2D3DRegi::update_ray_caster_active_pixels()
+{
+  const size_type num_views = sim_metrics_.size();
+
+  ImgSimMetric2D::PixelIndexList pix_inds;
+
+  for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
+  {
+    if (sim_metrics_[view_idx]->mov_img_pixels_used(&pix_inds))
+    {
+      // avoid updating the ray caster when the pixels have not changed, e.g.
+      // a constant mask
+      if (!ray_caster_->has_active_pixels(view_idx) ||
+          (ray_caster_->active_pixels(view_idx) != pix_inds))
+      {
+        ray_caster_->set_active_pixels(view_idx, pix_inds);
+      }
+    }
+    else
+    {
+      ray_caster_->clear_active_pixels(view_idx);
+    }
+  }
+}
+
 void xreg::Intensity2D3DRegi::debug_write_comb_sim_score()
 {
   throw UnsupportedOperationException();
@@ -943,34 +2170,54 @@ void xreg::Intensity2D3DRegi::debug_write_opt_pose_vars()
 
 xreg::FrameTransformList
 xreg::Intensity2D3DRegi::opt_vec_to_frame_transforms(const ScalarList& x) const
+{
+  FrameTransformList xforms;
+
+  opt_vec_to_frame_transforms(x, &xforms);
+
+  return xforms;
+}
+
+void xreg::Intensity2D3DRegi::opt_vec_to_frame_transforms(const ScalarList& x,
+                                                          FrameTransformList* xforms) const
 {
   const size_type nv = num_vols();
   const size_type np = opt_vars_->num_params();
 
   xregASSERT((np * nv) == x.size());
 
-  FrameTransformList xforms;
-  xforms.reserve(nv);
+  xforms->resize(nv);
 
   for (size_type v = 0; v < nv; ++v)
   {
-    xforms.push_back(opt_vars_->operator()(
-        Eigen::Map<PtN>(const_cast<Scalar*>(&x[np * v]), np)));
+    (*xforms)[v] = opt_vars_->operator()(
+        Eigen::Map<PtN>(const_cast<Scalar*>(&x[np * v]), np));
   }
-
-  return xforms;
 }
 
 xreg::FrameTransformList
 xreg::Intensity2D3DRegi::inter_transforms_to_regi(const FrameTransformList& delta_xforms) const
+{
+  FrameTransformList regi_xforms;
+
+  inter_transforms_to_regi(delta_xforms, &regi_xforms);
+
+  return regi_xforms;
+}
+
+void xreg::Intensity2D3DRegi::inter_transforms_to_regi(const FrameTransformList& delta_xforms,
+                                                       FrameTransformList* regi_xforms_ptr) const
 {
   const size_type nv = num_vols();
   xregASSERT(delta_xforms.size() == nv);
+  xregASSERT(&delta_xforms != regi_xforms_ptr);
 
   FrameTransform pre_mult;
   FrameTransform post_mult;
 
-  FrameTransformList regi_xforms(nv);
+  FrameTransformList& regi_xforms = *regi_xforms_ptr;
+
+  regi_xforms.resize(nv);
 
   bool need_dyn_ref_frame = false;
 
@@ -978,16 +2225,7 @@ xreg::Intensity2D3DRegi::inter_transforms_to_regi(const FrameTransformList& delt
   {
     if (!dyn_ref_frame_fns_[vol_idx])
     {
-      if (intermediate_frames_wrt_vol_[vol_idx])
-      {
-        pre_mult  = intermediate_frames_[vol_idx];
-        post_mult = intermediate_frames_[vol_idx].inverse() * regi_xform_guesses_[vol_idx];
-      }
-      else
-      {
-        pre_mult  = regi_xform_guesses_[vol_idx] * intermediate_frames_[vol_idx];
-        post_mult = intermediate_frames_[vol_idx].inverse();
-      }
+      std::tie(pre_mult, post_mult) = inter_frame_pre_post_xforms(vol_idx);
 
       regi_xforms[vol_idx] = pre_mult * delta_xforms[vol_idx] * post_mult;
     }
@@ -1020,22 +2258,41 @@ xreg::Intensity2D3DRegi::inter_transforms_to_regi(const FrameTransformList& delt
       }
     }
   }
-  
-  return regi_xforms;
 }
 
 xreg::Intensity2D3DRegi::ListOfFrameTransformLists
 xreg::Intensity2D3DRegi::apply_inter_transforms_for_obj_fn(
                             const ListOfFrameTransformLists& src_frame_xforms_per_object) const
 {
+  ListOfFrameTransformLists dst_xforms;
+
+  apply_inter_transforms_for_obj_fn(src_frame_xforms_per_object, &dst_xforms);
+
+  return dst_xforms;
+}
+
+void xreg::Intensity2D3DRegi::apply_inter_transforms_for_obj_fn(
+                            const ListOfFrameTransformLists& src_frame_xforms_per_object,
+                            ListOfFrameTransformLists* dst_frame_xforms_per_object) const
+{
+  xregPROFILE_SCOPE("pose-composition");
+
   const size_type nv = num_vols();
   
   xregASSERT(nv > 0);
   xregASSERT(src_frame_xforms_per_object.size() == nv);
+  xregASSERT(&src_frame_xforms_per_object != dst_frame_xforms_per_object);
   
   const size_type num_xforms_per_vol = src_frame_xforms_per_object[0].size();
 
-  ListOfFrameTransformLists dst_xforms(nv, FrameTransformList(num_xforms_per_vol));
+  ListOfFrameTransformLists& dst_xforms = *dst_frame_xforms_per_object;
+
+  dst_xforms.resize(nv);
+
+  for (auto& cur_dst_xforms : dst_xforms)
+  {
+    cur_dst_xforms.resize(num_xforms_per_vol);
+  }
 
   FrameTransform pre_mult;
   FrameTransform post_mult;
@@ -1046,16 +2303,7 @@ xreg::Intensity2D3DRegi::apply_inter_transforms_for_obj_fn(
   {
     if (!dyn_ref_frame_fns_[vol_idx])
     {
-      if (intermediate_frames_wrt_vol_[vol_idx])
-      {
-        pre_mult  = intermediate_frames_[vol_idx];
-        post_mult = intermediate_frames_[vol_idx].inverse() * regi_xform_guesses_[vol_idx];
-      }
-      else
-      {
-        pre_mult  = regi_xform_guesses_[vol_idx] * intermediate_frames_[vol_idx];
-        post_mult = intermediate_frames_[vol_idx].inverse();
-      }
+      std::tie(pre_mult, post_mult) = inter_frame_pre_post_xforms(vol_idx);
      
       const auto& cur_src_xforms = src_frame_xforms_per_object[vol_idx];
       xregASSERT(num_xforms_per_vol == cur_src_xforms.size()); 
@@ -1094,8 +2342,26 @@ xreg::Intensity2D3DRegi::apply_inter_transforms_for_obj_fn(
       }
     }
   }
+}
 
-  return dst_xforms;
+std::tuple<xreg::FrameTransform,xreg::FrameTransform>
+xreg::Intensity2D3DRegi::inter_frame_pre_post_xforms(const size_type vol_idx) const
+{
+  FrameTransform pre_mult;
+  FrameTransform post_mult;
+
+  if (intermediate_frames_wrt_vol_[vol_idx])
+  {
+    pre_mult  = intermediate_frames_[vol_idx];
+    post_mult = intermediate_frames_[vol_idx].inverse() * regi_xform_guesses_[vol_idx];
+  }
+  else
+  {
+    pre_mult  = regi_xform_guesses_[vol_idx] * intermediate_frames_[vol_idx];
+    post_mult = intermediate_frames_[vol_idx].inverse();
+  }
+
+  return std::make_tuple(pre_mult, post_mult);
 }
 
 void xreg::Intensity2D3DRegi::num_vols_updated()
@@ -25,6 +25,9 @@
 #ifndef XREGINTENSITY2D3DREGI_H_
 #define XREGINTENSITY2D3DREGI_H_
 
+#include <cstdint>
+#include <tuple>
+
 #include "xregCommon.h"
 #include "xregObjWithOStream.h"
 #include "xregRayCastInterface.h"
@@ -38,6 +41,10 @@ class SE3OptVars;
 class CamSourceObjPoseOptVars;
 class ImgSimMetric2DCombineMean;
 class Regi2D3DPenaltyFn;
+class ParallelExecContext;
+class RayCasterOCL;
+struct LocalQuadSurrogate;
+class Intensity2D3DRegiObjFnCache;
 struct SingleRegiDebugResults;
 
 /// \brief General class for intensity-based 2D/3D registration.
@@ -204,6 +211,34 @@ public:
   ///        another registration object.
   void use_ray_caster_and_sim_metrics_from_other_regi(Intensity2D3DRegi* other_regi);
 
+  /// \brief Adds a stage which renders the candidate poses with another ray
+  ///        caster and scores the renders with its own similarity metrics.
+  ///
+  /// This is used by objectives combining several types of renders, e.g. NCC
+  /// of line integral DRRs with the boundary edges of occluding contour or
+  /// depth renders. The ray caster of the stage must have the same camera
+  /// models and volume ordering as the primary ray caster, and there must be
+  /// one similarity metric for each view. The objective function value of a
+  /// candidate is the primary similarity value plus weight multiplied by the
+  /// mean similarity value of the stage over all views.
+  ///
+  /// Each objective function evaluation is scheduled as a graph: the ray
+  /// casting of every stage is enqueued before waiting on any of them, and
+  /// the similarity metrics of a stage are computed as soon as its ray
+  /// casting has finished. OpenCL ray casters use their own command queues,
+  /// so the ray casting of independent stages overlaps on the device, along
+  /// with the similarity metrics of stages that have already finished.
+  ///
+  /// Stages are not supported when optimizing over camera models.
+  /// This should be called prior to setup().
+  void add_ray_cast_stage(RayCasterPtr ray_caster, const SimMetricList& sim_metrics,
+                          const Scalar weight = 1, const bool need_to_alloc = true);
+
+  /// \brief Removes all stages added by add_ray_cast_stage().
+  void clear_ray_cast_stages();
+
+  size_type num_ray_cast_stages() const;
+
   /// \brief Sets the SE3 parameterization to use.
   ///
   /// This should be called prior to calling setup().
@@ -290,6 +325,14 @@ public:
   /// have been set on this object, but before calling setup().
   virtual size_type max_num_projs_per_view_per_iter() const = 0;
 
+  /// \brief Indicates that the optimizer may evaluate fewer projections per
+  ///        view at a time than max_num_projs_per_view_per_iter().
+  ///
+  /// When true, setup() reduces the number of projections per view to fit
+  /// the ray caster (e.g. when limited by a device memory budget) instead of
+  /// throwing an exception. Defaults to false.
+  virtual bool supports_smaller_batches() const;
+
   void set_penalty_fn(PenaltyFnPtr penalty_fn);
 
   PenaltyFnPtr penalty_fn();
@@ -311,6 +354,12 @@ public:
   
   const FrameTransformList& regi_xform_guesses() const;
   
+  /// \brief Adds a callback called at the start of each registration run,
+  ///        after the run's state (e.g. a stop request) has been reset.
+  void add_begin_of_run_callback(CallbackFn& fn);
+
+  void reset_begin_of_run_callbacks();
+
   void add_begin_of_iter_callback(CallbackFn& fn);
 
   void reset_begin_of_iter_callbacks();
@@ -323,10 +372,164 @@ public:
 
   void set_max_num_iters(const size_type max_iters);
 
+  /// \brief Requests that the optimization stops after the current iteration.
+  ///
+  /// This is typically called by an end of iteration callback, e.g. to stop
+  /// once the estimates have stopped improving. The request is cleared at the
+  /// start of each registration and the reason is recorded in the debug
+  /// results. This is honored by the NLOpt, CMA-ES, differential evolution,
+  /// PSO and hill climbing registrations.
+  void request_stop(const std::string& reason);
+
+  bool stop_requested() const;
+
+  /// \brief The reason passed to request_stop(), empty when no stop was requested.
+  const std::string& stop_reason() const;
+
+  /// \brief The number of objective function evaluations performed by the
+  ///        current (or most recent) registration.
+  size_type num_obj_fn_evals() const;
+
+  /// \brief The smallest objective function value computed by the most recent
+  ///        objective function evaluation (over all of its projections).
+  Scalar last_obj_fn_min_val() const;
+
   bool has_a_static_vol() const;
 
   void set_has_a_static_vol(const bool b);
 
+  /// \brief Only ray cast the pixels that are used by the similarity metrics.
+  ///
+  /// Prior to ray casting for each objective function evaluation, the pixels
+  /// used by each view's similarity metric (e.g. the mask or the randomly
+  /// sampled patches) are set as the active pixels of the corresponding
+  /// camera model in the ray caster. This is not performed when optimizing
+  /// over camera models. Default is false.
+  bool use_sim_metric_active_pixels() const;
+
+  void set_use_sim_metric_active_pixels(const bool u);
+
+  /// \brief Ray cast all volumes with a single call to the ray caster.
+  ///
+  /// When multiple volumes are registered, the poses of every volume are passed
+  /// to RayCaster::compute_multi_vols(), allowing ray casters to compute all
+  /// volumes in a single pass over the rays. This is not performed when
+  /// optimizing over camera models. Default is false.
+  bool use_ray_caster_multi_vols() const;
+
+  void set_use_ray_caster_multi_vols(const bool u);
+
+  /// \brief Compute the similarity metrics of each view concurrently.
+  ///
+  /// See ImgSimMetric2DCombine::set_compute_sim_metrics_concurrently().
+  /// Default is true.
+  bool compute_sim_metrics_concurrently() const;
+
+  void set_compute_sim_metrics_concurrently(const bool c);
+
+  /// \brief Combine the similarity scores of the views on the device.
+  ///
+  /// When every view uses an OpenCL similarity metric which keeps its scores
+  /// on the device, the mean over the views, and the penalty terms when there
+  /// are no additional ray casting stages, are computed on the device and the
+  /// combined scores are read back once per objective function evaluation,
+  /// instead of once per view. Otherwise the scores are combined on the host.
+  /// See ImgSimMetric2DCombineMeanOCL. Default is false.
+  bool combine_sim_vals_on_dev() const;
+
+  void set_combine_sim_vals_on_dev(const bool c);
+
+  /// \brief Evaluate each population in two halves, so that the similarity
+  ///        metrics of the first half are computed while the second half is
+  ///        ray cast.
+  ///
+  /// This requires an OpenCL ray caster supporting compute slots, which is
+  /// given a second slot when setup(), or MultiLevelMultiObjRegi, allocates
+  /// it (see RayCasterOCL::set_num_compute_slots()); the second slot doubles
+  /// the device memory used for each projection. A population is evaluated as a
+  /// single batch when optimizing over camera models, with additional ray
+  /// casting stages, with an objective function cache, when the volumes are
+  /// ray cast together (see set_use_ray_caster_multi_vols()), when debug
+  /// DRRs or similarity metric information are saved, and when the
+  /// population is screened. The similarity values are identical to those of
+  /// a single batch. Default is false, the CMA-ES and PSO registrations
+  /// enable this.
+  bool pipeline_pop_obj_fn() const;
+
+  void set_pipeline_pop_obj_fn(const bool p);
+
+  /// \brief Set the parallel execution context used by run().
+  ///
+  /// All parallel work performed during run(), including ray casting, similarity
+  /// and penalty computations, is executed within this context, unless the ray
+  /// caster or similarity metrics have been assigned contexts of their own.
+  /// A null context (the default) uses the context current on the calling
+  /// thread, see ParallelExecContextScope.
+  void set_exec_context(std::shared_ptr<ParallelExecContext> ctx);
+
+  std::shared_ptr<ParallelExecContext> exec_context() const;
+
+  /// \brief Screen each population of candidates with a lower fidelity
+  ///        objective function before computing the full fidelity values.
+  ///
+  /// Every candidate is first scored by screen_regi, which should be configured
+  /// with cheaper resources than this object, e.g. a ray caster with a
+  /// downsampled detector and a coarse step size, and similarity metrics
+  /// computed over a stochastic subset of pixels (see
+  /// set_use_sim_metric_active_pixels()). Only the best fraction, keep_frac,
+  /// of the candidates is then scored by this object. The remaining
+  /// candidates are assigned values worse than every re-scored candidate,
+  /// ordered by their screening scores.
+  /// screen_regi must register the same volumes; only its objective function
+  /// is used (it is never run) and it is setup by setup() with the pose
+  /// parameterization and population size of this object. The initial guesses
+  /// and intermediate frames are copied to it at the start of each run.
+  /// Screening is not performed when optimizing over camera models. A null
+  /// object disables screening (the default). This is used by the CMA-ES and
+  /// PSO registrations.
+  void set_screen_regi(std::shared_ptr<Intensity2D3DRegi> screen_regi,
+                       const Scalar keep_frac = 0.25);
+
+  std::shared_ptr<Intensity2D3DRegi> screen_regi() const;
+
+  Scalar screen_keep_frac() const;
+
+  /// \brief Screen each population of candidates with a local quadratic
+  ///        model of the objective function.
+  ///
+  /// Every candidate evaluated by this object is added to the surrogate's
+  /// archive. Once enough candidates have been archived, a model is fit about
+  /// the best archived candidate at each population evaluation and only the
+  /// best fraction, keep_frac, of the candidates according to the model are
+  /// evaluated. Each of these evaluations refreshes the model, the remaining
+  /// candidates are treated as in set_screen_regi(). The model takes
+  /// precedence over a screening object, which is only used until the model
+  /// can be fit. The archive is cleared at the start of each run, since the
+  /// parameters are relative to the initial guesses.
+  /// This is most useful for the final, polishing, level of a registration.
+  /// A null surrogate disables this (the default).
+  void set_surrogate(std::shared_ptr<LocalQuadSurrogate> surrogate,
+                     const Scalar keep_frac = 0.25);
+
+  std::shared_ptr<LocalQuadSurrogate> surrogate() const;
+
+  /// \brief Cache objective function values, so that candidates which have
+  ///        already been evaluated are not ray cast again.
+  ///
+  /// The values are keyed by the quantized pose parameters and a
+  /// configuration key. The configuration key is computed at the start of
+  /// each run from config_desc, which should describe the similarity metrics,
+  /// ray caster and images (e.g. the level of a multi-level registration),
+  /// the volumes, initial guesses and intermediate frames. Hits and misses
+  /// are recorded as the "obj-fn-cache-hit" and "obj-fn-cache-miss" regions
+  /// of the profiler. The cache is not used when optimizing over camera
+  /// models or with dynamic reference frames. A null cache disables caching
+  /// (the default).
+  void set_obj_fn_cache(std::shared_ptr<Intensity2D3DRegiObjFnCache> cache,
+                        const std::string& config_desc = "");
+
+  std::shared_ptr<Intensity2D3DRegiObjFnCache> obj_fn_cache() const;
+
 protected:
 
   /// \brief Initialization of the optimization algorithm.
@@ -339,6 +542,27 @@ protected:
                       const CamModelList* cams_per_proj,
                       ScalarList* sim_vals_ptr); 
 
+  /// \brief Computes DRRs and similarity metrics for poses which have already
+  ///        been composed with the intermediate frames.
+  ///
+  /// inter_frame_xforms must be equal to
+  /// apply_inter_transforms_for_obj_fn(frame_xforms_per_object), which is only
+  /// used here when computing a penalty function.
+  void obj_fn_for_inter_xforms(const ListOfFrameTransformLists& frame_xforms_per_object,
+                               const ListOfFrameTransformLists& inter_frame_xforms,
+                               const CamModelList* cams_per_proj,
+                               ScalarList* sim_vals_ptr);
+
+  /// \brief Computes DRRs and similarity metrics for poses which have already
+  ///        been written into the device buffer of an OpenCL ray caster.
+  ///
+  /// The poses of every projection must be stored in
+  /// RayCasterOCL::xforms_cam_to_itk_phys_dev(), using the same ordering as
+  /// distribute_xforms_among_cam_models(), and must include the intermediate
+  /// frames. This is limited to a single volume, without a penalty function and
+  /// with constant camera models.
+  void obj_fn_for_ray_caster_dev_xforms(ScalarList* sim_vals_ptr);
+
   /// \brief Objective function that computes DRRs and similarity metrics.
   ///
   /// This should be called by the optimizer in some way, maybe not directly,
@@ -348,6 +572,25 @@ protected:
   virtual void obj_fn(const ListOfListsOfScalarLists& opt_vec_space_vals,
                       ScalarList* sim_vals_ptr);
 
+  /// \brief Objective function for an entire population of candidates.
+  ///
+  /// Same as obj_fn(), except the candidates are screened when a screening
+  /// object or surrogate has been set, see set_screen_regi() and
+  /// set_surrogate().
+  void pop_obj_fn(const ListOfListsOfScalarLists& opt_vec_space_vals,
+                  ScalarList* sim_vals_ptr);
+
+  /// \brief Objective function for the subset of candidates given by the
+  ///        first num_inds elements of cand_inds.
+  ///
+  /// The parameters of the subset are written into subset_params and the
+  /// projections are computed as a smaller batch.
+  void obj_fn_for_subset(const ListOfListsOfScalarLists& opt_vec_space_vals,
+                         const IndexList& cand_inds,
+                         const size_type num_inds,
+                         ListOfListsOfScalarLists* subset_params,
+                         ScalarList* subset_sim_vals);
+
   /// \brief This should be called by the derived class before entering the main
   ///        loop of the algorithm.
   virtual void before_first_iteration();
@@ -413,6 +656,10 @@ protected:
   ///        volumes.
   void update_regi_xforms(const FrameTransformList& delta_xforms);
 
+  /// \brief Sets the active pixels of the ray caster, for each view, to the
+  ///        pixels used by the similarity metric.
+  void update_ray_caster_active_pixels();
+
   /// \brief Write the similarity score for the current pose estimate to a stream.
   ///
   /// This must be implemented by a derived class, if it is used at all, since
@@ -429,11 +676,37 @@ protected:
   ///        frame transforms for each object/volume
   FrameTransformList opt_vec_to_frame_transforms(const ScalarList& x) const;
 
+  /// \brief Same as above, but writes into an existing list, which avoids
+  ///        heap allocations once the list has been sized.
+  void opt_vec_to_frame_transforms(const ScalarList& x, FrameTransformList* xforms) const;
+
   FrameTransformList inter_transforms_to_regi(const FrameTransformList& delta_xforms) const;
 
+  /// \brief Same as above, but writes into an existing list.
+  ///
+  /// No heap allocations are performed once regi_xforms has been sized,
+  /// unless a volume uses a dynamic reference frame.
+  void inter_transforms_to_regi(const FrameTransformList& delta_xforms,
+                                FrameTransformList* regi_xforms) const;
+
   ListOfFrameTransformLists apply_inter_transforms_for_obj_fn(
                               const ListOfFrameTransformLists& src_frame_xforms_per_object) const;
 
+  /// \brief Same as above, but writes into existing lists.
+  ///
+  /// No heap allocations are performed when dst_frame_xforms_per_object
+  /// already has the sizes of src_frame_xforms_per_object, unless a volume
+  /// uses a dynamic reference frame. dst must not alias src.
+  void apply_inter_transforms_for_obj_fn(
+                  const ListOfFrameTransformLists& src_frame_xforms_per_object,
+                  ListOfFrameTransformLists* dst_frame_xforms_per_object) const;
+
+  /// \brief The transforms applied before and after a delta transform of a
+  ///        volume without a dynamic reference frame.
+  ///
+  /// The pose used for ray casting is pre * delta * post.
+  std::tuple<FrameTransform,FrameTransform> inter_frame_pre_post_xforms(const size_type vol_idx) const;
+
   bool need_to_alloc_ray_caster_ = true;
 
   bool need_to_alloc_sim_metrics_ = true;
@@ -470,8 +743,42 @@ protected:
 
   size_type num_obj_fn_evals_ = 0;
 
+  Scalar last_obj_fn_min_val_ = std::numeric_limits<Scalar>::max();
+
+  bool stop_requested_ = false;
+
+  std::string stop_reason_;
+
+  // trace timestamp of the end of the previous iteration (or the start of the
+  // first iteration) and the number of iterations traced, iterations are only
+  // recorded when tracing is enabled
+  double trace_iter_start_us_ = 0;
+
+  size_type trace_iter_idx_ = 0;
+
   ListOfFrameTransformLists tmp_frame_xforms_;
 
+  // poses of each volume composed with the intermediate frames, and the
+  // parameters of a volume's population, re-used across objective function
+  // evaluations
+  ListOfFrameTransformLists tmp_inter_frame_xforms_;
+
+  MatMxN tmp_opt_params_;
+
+  // The following are also re-used across iterations and objective function
+  // evaluations, so that the steady state of a registration performs no heap
+  // allocations for pose temporaries. They are sized on first use.
+
+  // delta transforms for each volume computed from an optimization vector
+  FrameTransformList tmp_delta_xforms_;
+
+  // ray casting poses of each volume when all volumes are cast together
+  ListOfFrameTransformLists tmp_xforms_for_each_vol_;
+
+  // camera model associations of each projection passed to the penalty
+  // function, which is computed while the ray caster updates its own
+  RayCaster::CamModelAssocList pen_cam_assocs_;
+
   size_type max_num_iters_ = std::numeric_limits<size_type>::max();
 
   // Debug information/actions:
@@ -491,6 +798,24 @@ protected:
 
   std::shared_ptr<ImgSimMetric2DCombineMean> sim_metric_combiner_;
 
+  /// \brief An additional ray caster, and similarity metrics, evaluated for
+  ///        the same poses as the primary ray caster.
+  struct RayCastStage
+  {
+    RayCasterPtr ray_caster;
+
+    SimMetricList sim_metrics;
+
+    Scalar weight = 1;
+
+    bool need_to_alloc_ray_caster  = true;
+    bool need_to_alloc_sim_metrics = true;
+
+    std::shared_ptr<ImgSimMetric2DCombineMean> sim_metric_combiner;
+  };
+
+  std::vector<RayCastStage> ray_cast_stages_;
+
   IndexList vol_inds_in_ray_caster_;
 
   bool debug_save_iter_debug_info_ = false;
@@ -521,6 +846,53 @@ protected:
   // values in the energy term of the boltzmann distribution for the similarity metric.
   bool include_penalty_in_obj_fn_ = true;
 
+  std::shared_ptr<ParallelExecContext> exec_ctx_;
+
+  bool use_sim_metric_active_pixels_ = false;
+
+  bool use_ray_caster_multi_vols_ = false;
+
+  bool compute_sim_metrics_concurrently_ = true;
+
+  bool combine_sim_vals_on_dev_ = false;
+
+  bool pipeline_pop_obj_fn_ = false;
+
+  // poses and similarity values of the second half of a population, the first
+  // half uses tmp_frame_xforms_ and tmp_inter_frame_xforms_
+  ListOfFrameTransformLists pipe_frame_xforms_;
+  ListOfFrameTransformLists pipe_inter_frame_xforms_;
+  ScalarList                pipe_sim_vals_;
+
+  std::shared_ptr<Intensity2D3DRegi> screen_regi_;
+
+  Scalar screen_keep_frac_ = 0.25;
+
+  std::shared_ptr<LocalQuadSurrogate> surrogate_;
+
+  Scalar surrogate_keep_frac_ = 0.25;
+
+  std::shared_ptr<Intensity2D3DRegiObjFnCache> obj_fn_cache_;
+
+  std::string obj_fn_cache_config_desc_;
+
+  std::uint64_t obj_fn_cache_config_key_ = 0;
+
+  bool obj_fn_cache_active_ = false;
+
+  // set while evaluating the candidates missing from the cache
+  bool obj_fn_cache_bypass_ = false;
+
+  // temporaries re-used by each screened population evaluation
+  PtNList                   surrogate_cand_pts_;
+  ScalarList                screen_sim_vals_;
+  IndexList                 screen_inds_;
+  ListOfListsOfScalarLists  screen_params_;
+  ScalarList                screen_fine_sim_vals_;
+
+  // each of these are called by before_first_iteration()
+  std::vector<CallbackFn> begin_of_run_fns_;
+
   // each of these are called by begin_of_iteration()
   std::vector<CallbackFn> begin_of_iter_fns_;
   
@@ -530,6 +902,89 @@ protected:
 private:
   enum { kDEFAULT_INTER_FRAMES_WRT_VOL = 0 };
 
+  /// \brief Computes the similarity metrics of the current projections and
+  ///        combines them over the views into the similarity value of each
+  ///        candidate.
+  void compute_sim_vals_of_projs(ScalarList* sim_vals_ptr);
+
+  /// \brief Maps the parameters of the candidates in
+  ///        [first_cand, first_cand + num_cands) to the delta transforms of
+  ///        each volume and, when every volume uses static intermediate
+  ///        frames, to the poses used for ray casting.
+  ///
+  /// Returns true when inter_frame_xforms was composed, otherwise the caller
+  /// applies the intermediate frames to frame_xforms. frame_xforms is only
+  /// written when it is needed, i.e. for dynamic reference frames or a
+  /// penalty function.
+  bool compose_obj_fn_xforms(const ListOfListsOfScalarLists& opt_vec_space_vals,
+                             const size_type first_cand,
+                             const size_type num_cands,
+                             ListOfFrameTransformLists* frame_xforms,
+                             ListOfFrameTransformLists* inter_frame_xforms);
+
+  /// \brief Ray casts each volume, the projections of the first volume are
+  ///        stored using the ray caster's current method and the others are
+  ///        accumulated.
+  ///
+  /// When an OpenCL ray caster is provided, the volumes are enqueued using
+  /// the compute slot without waiting for the kernels.
+  void ray_cast_vols(const ListOfFrameTransformLists& inter_frame_xforms,
+                     const CamModelList* cams_per_proj,
+                     RayCasterOCL* ray_caster_ocl,
+                     const size_type slot_idx);
+
+  /// \brief Computes the penalty function for the current batch of
+  ///        candidates.
+  void compute_penalty_for_batch(const ListOfFrameTransformLists& frame_xforms_per_object,
+                                 const ListOfFrameTransformLists& inter_frame_xforms,
+                                 const bool cams_per_proj);
+
+  /// \brief Computes the similarity values of the current projections and
+  ///        of every stage, and adds the penalty terms computed by
+  ///        compute_penalty_for_batch() when they are included.
+  void compute_sim_vals_with_penalty(const ListOfFrameTransformLists& inter_frame_xforms,
+                                     ScalarList* sim_vals_ptr);
+
+  /// \brief Indicates that pop_obj_fn() may evaluate a population in two
+  ///        halves, see set_pipeline_pop_obj_fn().
+  bool can_pipeline_pop_obj_fn() const;
+
+  /// \brief Objective function for an entire population, which is evaluated
+  ///        in two halves using two compute slots of the OpenCL ray caster.
+  ///
+  /// Both halves are enqueued for ray casting, then the penalty function and
+  /// similarity metrics of the first half are computed while the second half
+  /// is ray cast.
+  void pipelined_pop_obj_fn(const ListOfListsOfScalarLists& opt_vec_space_vals,
+                            ScalarList* sim_vals_ptr);
+
+  /// \brief Enqueues the ray casting of the candidate poses for each stage
+  ///        using an OpenCL ray caster, without waiting for the kernels.
+  ///
+  /// The remaining stages are ray cast by
+  /// compute_sim_vals_of_projs_and_stages().
+  void enqueue_ray_cast_stages(const ListOfFrameTransformLists& inter_frame_xforms);
+
+  /// \brief Computes the similarity values of the primary projections and of
+  ///        every stage, concurrently, and adds the weighted stage values to
+  ///        the primary values.
+  ///
+  /// Stages which were not enqueued by enqueue_ray_cast_stages() are ray cast
+  /// here, concurrently with the similarity computations of the others.
+  void compute_sim_vals_of_projs_and_stages(const ListOfFrameTransformLists& inter_frame_xforms,
+                                            ScalarList* sim_vals_ptr);
+
+  /// \brief Sets the number of projections per view in the ray caster,
+  ///        similarity metrics and combiner, without re-allocating resources.
+  ///
+  /// This may not exceed the number of projections per view used by setup().
+  void set_num_projs_per_view_for_batch(const size_type num_projs_per_view);
+
+  /// \brief Looks up each candidate in the objective function cache and
+  ///        evaluates the remainder.
+  void cached_obj_fn(const ListOfListsOfScalarLists& opt_vec_space_vals,
+                     ScalarList* sim_vals_ptr);
+
   /// \brief Should be called whenever the size of vol_inds_in_ray_caster_ is
   ///        updated, so that other lists may be resized.
   void num_vols_updated();
@@ -24,12 +24,15 @@
 
 #include "xregIntensity2D3DRegiCMAES.h"
 
+#include <random>
+
 #include <fmt/format.h>
 
 #include <opencv2/imgcodecs.hpp>
 
 #include <cmaes_interface.h>
 
+#include "xregCMAESPopSamplerOCL.h"
 #include "xregIntensity2D3DRegiDebug.h"
 #include "xregSE3OptVars.h"
 #include "xregHDF5.h"
@@ -38,10 +41,15 @@
 #include "xregITKIOUtils.h"
 #include "xregITKOpenCVUtils.h"
 #include "xregOpenCVUtils.h"
+#include "xregRayCastBaseOCL.h"
+#include "xregSampleUtils.h"
+#include "xregTBBUtils.h"
 
 xreg::Intensity2D3DRegiCMAES::Intensity2D3DRegiCMAES()
 {
-  this->num_projs_per_view_ = kDEFAULT_LAMBDA;
+  this->num_projs_per_view_ = pop_size_ * num_concurrent_runs_;
+
+  this->set_pipeline_pop_obj_fn(true);
 
   set_opt_obj_fn_tol(1.0e-3);
   set_opt_x_tol(1.0e-6);
@@ -49,7 +57,30 @@ xreg::Intensity2D3DRegiCMAES::Intensity2D3DRegiCMAES()
 
 void xreg::Intensity2D3DRegiCMAES::set_pop_size(const size_type pop_size)
 {
-  this->num_projs_per_view_ = pop_size;
+  xregASSERT(pop_size > 0);
+
+  pop_size_ = pop_size;
+  
+  this->num_projs_per_view_ = pop_size_ * num_concurrent_runs_;
+}
+
+void xreg::Intensity2D3DRegiCMAES::set_num_concurrent_runs(const size_type num_runs)
+{
+  xregASSERT(num_runs > 0);
+
+  num_concurrent_runs_ = num_runs;
+  
+  this->num_projs_per_view_ = pop_size_ * num_concurrent_runs_;
+}
+
+xreg::size_type xreg::Intensity2D3DRegiCMAES::num_concurrent_runs() const
+{
+  return num_concurrent_runs_;
+}
+
+xreg::size_type xreg::Intensity2D3DRegiCMAES::run_used_for_solution() const
+{
+  return run_used_for_sol_;
 }
 
 void xreg::Intensity2D3DRegiCMAES::set_bounds(const ScalarList& bounds)
@@ -62,6 +93,16 @@ void xreg::Intensity2D3DRegiCMAES::remove_bounds()
   bounds_.clear();
 }
 
+void xreg::Intensity2D3DRegiCMAES::set_sample_pop_on_device(const bool sample_on_dev)
+{
+  sample_pop_on_device_ = sample_on_dev;
+}
+
+bool xreg::Intensity2D3DRegiCMAES::sample_pop_on_device() const
+{
+  return sample_pop_on_device_;
+}
+
 void xreg::Intensity2D3DRegiCMAES::set_sigma(const ScalarList& sigma)
 {
   sigma_ = sigma;
@@ -74,6 +115,8 @@ void xreg::Intensity2D3DRegiCMAES::reset_sigma()
 
 void xreg::Intensity2D3DRegiCMAES::run()
 {
+  ParallelExecContextScope exec_scope(this->exec_ctx_.get());
+
   // TODO: support optimizing over multiple sources
 
   constexpr Scalar kDEFAULT_SIGMA = 0.3;  ///< Default sigma value to be used in all directions
@@ -87,7 +130,13 @@ void xreg::Intensity2D3DRegiCMAES::run()
 
   const size_type tot_num_params = nv * num_params_per_xform;
 
-  const size_type pop_size = this->num_projs_per_view_;
+  const size_type pop_size = pop_size_;
+
+  const size_type num_runs = num_concurrent_runs_;
+
+  // the populations of every run are packed into a single batch of projections
+  const size_type tot_pop_size = pop_size * num_runs;
+  xregASSERT(tot_pop_size == this->num_projs_per_view_);
 
   xregASSERT(sigma_.empty() || (sigma_.size() == tot_num_params));
   xregASSERT(bounds_.empty() || (bounds_.size() == tot_num_params));
@@ -101,30 +150,67 @@ void xreg::Intensity2D3DRegiCMAES::run()
 
   // setup the intermediate structure to store projection parameterizations:
   // pop_params[i][j][k] is the kth parameter of the jth SE(3) (projection) element for the ith object/volume
-  ListOfListsOfScalarLists pop_params(nv, ListOfScalarLists(pop_size, ScalarList(num_params_per_xform, 0)));
+  ListOfListsOfScalarLists pop_params(nv, ListOfScalarLists(tot_pop_size, ScalarList(num_params_per_xform, 0)));
 
   // intermediate structure to store the similarity values
-  ScalarList sim_vals(pop_size, 0);
+  ScalarList sim_vals(tot_pop_size, 0);
 
   std::vector<double> init_delta_guess(tot_num_params, 0);
   std::vector<double> tmp_sigma_double(sigma_.begin(), sigma_.end());
 
-  evo_ = std::make_shared<cmaes_t>();
+  std::mt19937 rng_eng;
+  SeedRNGEngWithRandDev(&rng_eng);
+
+  // the CMA-ES library requires seeds in [1, 2e9]
+  std::uniform_int_distribution<long> seed_dist(1, 2000000000);
+
+  std::normal_distribution<double> std_norm_dist(0, 1);
+
+  std::vector<std::shared_ptr<cmaes_t>> evos(num_runs);
 
-  auto* evo = evo_.get();
+  // obj_fn_vals[r] is the buffer of objective function values at each of the
+  // lambda search points of run r
+  std::vector<double*> obj_fn_vals(num_runs, nullptr);
 
-  memset(evo, 0, sizeof(cmaes_t));
+  for (size_type run_idx = 0; run_idx < num_runs; ++run_idx)
+  {
+    evos[run_idx] = std::make_shared<cmaes_t>();
+  
+    auto* evo = evos[run_idx].get();
+
+    memset(evo, 0, sizeof(cmaes_t));
+
+    if (run_idx > 0)
+    {
+      // subsequent runs start from an initial estimate perturbed by the initial
+      // sigma, which is kept within any bounds
+      for (size_type param_idx = 0; param_idx < tot_num_params; ++param_idx)
+      {
+        double& x = init_delta_guess[param_idx];
+        
+        x = sigma_[param_idx] * std_norm_dist(rng_eng);
+   
+        if (!run_unc)
+        {
+          x = std::max(-0.99 * bounds_[param_idx], std::min(0.99 * bounds_[param_idx], x));
+        }
+      }
+    }
 
-  // The return value will store the objective function values at each of the
-  // lambda search points
-  // The "non" string parameter indicates that no parameter file should be read
-  // or written to.
-  double* obj_fn_vals = cmaes_init(evo, static_cast<int>(tot_num_params), &init_delta_guess[0],
-                                   &tmp_sigma_double[0], 0, static_cast<int>(pop_size), "non");
+    // The "non" string parameter indicates that no parameter file should be read
+    // or written to.
+    obj_fn_vals[run_idx] = cmaes_init(evo, static_cast<int>(tot_num_params), &init_delta_guess[0],
+                                      &tmp_sigma_double[0], (run_idx > 0) ? seed_dist(rng_eng) : 0,
+                                      static_cast<int>(pop_size), "non");
 
-  evo->sp.stopTolFun = obj_fn_tol_;
+    evo->sp.stopTolFun = obj_fn_tol_;
 
-  evo->sp.stopTolX = x_tol_;
+    evo->sp.stopTolX = x_tol_;
+  }
+
+  // The first run is reported until a run has found a better objective value
+  run_used_for_sol_ = 0;
+  evo_ = evos[0];
 
   this->before_first_iteration();
   
@@ -138,7 +224,7 @@ void xreg::Intensity2D3DRegiCMAES::run()
     opt_aux = static_cast<OptAux*>(this->debug_info_->opt_aux.get());
 
     opt_aux->se3_param_dim = num_params_per_xform;
-    opt_aux->pop_size = pop_size;
+    opt_aux->pop_size = tot_pop_size;
 
     const size_type init_capacity = this->debug_info_->sims.capacity();
     opt_aux->cov_mats.reserve(init_capacity);
@@ -149,70 +235,167 @@ void xreg::Intensity2D3DRegiCMAES::run()
 
   debug_sim_val_ = std::numeric_limits<Scalar>::max();
 
+  // When sampling on the device, the candidates are computed by the device
+  // and written into the ray caster's poses. The host replays the sampling
+  // of each candidate for the CMA-ES update.
+  std::unique_ptr<CMAESSE3PopSamplerOCL> dev_pop_sampler;
+
+  RayCasterOCL* ray_caster_ocl = nullptr;
+
+  std::vector<double> cov_factor;
+
+  if (sample_pop_on_device_ && can_sample_pop_on_device())
+  {
+    ray_caster_ocl = dynamic_cast<RayCasterOCL*>(this->ray_caster().get());
+
+    dev_pop_sampler.reset(new CMAESSE3PopSamplerOCL(ray_caster_ocl->cmd_queue()));
+
+    dev_pop_sampler->set_num_runs_and_pop_size(num_runs, pop_size);
+
+    dev_pop_sampler->set_seed(static_cast<std::uint32_t>(seed_dist(rng_eng)));
+
+    const auto pre_post = this->inter_frame_pre_post_xforms(0);
+    
+    dev_pop_sampler->set_pre_post_xforms(std::get<0>(pre_post), std::get<1>(pre_post));
+
+    cov_factor.resize(tot_num_params * tot_num_params);
+  }
+
   size_type iter = 0;
 
-  while (!cmaes_TestForTermination(evo) && (iter < this->max_num_iters_))
+  while ((iter < this->max_num_iters_) && !this->stop_requested())
   {
+    // the first run to converge provides the solution and cancels the others
+    {
+      size_type run_idx = 0;
+      for (; (run_idx < num_runs) && !cmaes_TestForTermination(evos[run_idx].get()); ++run_idx)
+      { }
+
+      if (run_idx < num_runs)
+      {
+        run_used_for_sol_ = run_idx;
+        evo_ = evos[run_idx];
+        break;
+      }
+    }
+
     this->begin_of_iteration(get_cmaes_cur_params_list());
 
-    // generate lambda new search points, sample population
-    // This is an array of double arrays, e.g. pop[i] has tot_num_params doubles.
-    double* const* pop = cmaes_SamplePopulation(evo);  // do not change content of pop
+    size_type num_rejects = 0;
 
-    if (!run_unc)
+    for (size_type run_idx = 0, pop_off = 0; dev_pop_sampler && (run_idx < num_runs); ++run_idx, pop_off += pop_size)
     {
-      size_type num_rejects = 0;
+      auto* evo = evos[run_idx].get();
 
-      // enforce constraints
-      for (size_type pop_ind = 0; pop_ind < pop_size; ++pop_ind)
+      // this is the test made by cmaes_SamplePopulation() before the generation
+      // counter is incremented
+      const bool diag_cov = (evo->sp.diagonalCov == 1) || (evo->sp.diagonalCov >= evo->gen);
+
+      // updates the eigensystem, step size and state of the run, the sampled
+      // candidates are replaced below
+      cmaes_SamplePopulation(evo);
+
+      // C = (B * D) * (B * D)^T
+      for (size_type r = 0; r < tot_num_params; ++r)
       {
-        bool cur_params_in_bounds = true;
+        for (size_type c = 0; c < tot_num_params; ++c)
+        {
+          cov_factor[(r * tot_num_params) + c] = diag_cov ? ((r == c) ? evo->rgD[c] : 0.0) :
+                                                            (evo->B[r][c] * evo->rgD[c]);
+        }
+      }
 
-        do
+      dev_pop_sampler->set_run_dist(run_idx, evo->rgxmean, &cov_factor[0], evo->sigma);
+    }
+
+    if (dev_pop_sampler)
+    {
+      dev_pop_sampler->sample_poses(iter, this->ray_caster()->num_camera_models(),
+                                    &ray_caster_ocl->xforms_cam_to_itk_phys_dev());
+
+      // replay the candidates on the host while the device samples
+      for (size_type run_idx = 0, pop_off = 0; run_idx < num_runs; ++run_idx, pop_off += pop_size)
+      {
+        auto* evo = evos[run_idx].get();
+
+        for (size_type pop_ind = 0; pop_ind < pop_size; ++pop_ind)
         {
-          cur_params_in_bounds = true;
+          dev_pop_sampler->host_candidate(run_idx, pop_ind, evo->rgrgx[pop_ind]);
 
-          const double* cur_params = pop[pop_ind];
+          if (opt_aux)
+          {
+            pop_params[0][pop_off + pop_ind].assign(evo->rgrgx[pop_ind],
+                                                    evo->rgrgx[pop_ind] + num_params_per_xform);
+          }
+        }
+      }
+    }
+
+    for (size_type run_idx = 0, pop_off = 0; !dev_pop_sampler && (run_idx < num_runs); ++run_idx, pop_off += pop_size)
+    {
+      auto* evo = evos[run_idx].get();
+
+      // generate lambda new search points, sample population
+      // This is an array of double arrays, e.g. pop[i] has tot_num_params doubles.
+      double* const* pop = cmaes_SamplePopulation(evo);  // do not change content of pop
+
+      if (!run_unc)
+      {
+        // enforce constraints
+        for (size_type pop_ind = 0; pop_ind < pop_size; ++pop_ind)
+        {
+          bool cur_params_in_bounds = true;
 
-          for (size_type param_idx = 0; param_idx < tot_num_params; ++param_idx)
+          do
           {
-            const double cur_bound = bounds_[param_idx];
+            cur_params_in_bounds = true;
+
+            const double* cur_params = pop[pop_ind];
 
-            // if out of bounds, then resample and re-check the newly sampled version
-            if ((cur_params[param_idx] < -cur_bound) || (cur_params[param_idx] > cur_bound))
+            for (size_type param_idx = 0; param_idx < tot_num_params; ++param_idx)
             {
-              cmaes_ReSampleSingle(evo, pop_ind);
-              cur_params_in_bounds = false;
-              ++num_rejects;
-              break;
+              const double cur_bound = bounds_[param_idx];
+
+              // if out of bounds, then resample and re-check the newly sampled version
+              if ((cur_params[param_idx] < -cur_bound) || (cur_params[param_idx] > cur_bound))
+              {
+                cmaes_ReSampleSingle(evo, pop_ind);
+                cur_params_in_bounds = false;
+                ++num_rejects;
+                break;
+              }
             }
           }
+          while (!cur_params_in_bounds);
         }
-        while (!cur_params_in_bounds);
       }
 
-      if (opt_aux)
+      // transfer to intermediate storage:
+      for (size_type pop_ind = 0; pop_ind < pop_size; ++pop_ind)
       {
-        opt_aux->num_rejects.push_back(num_rejects);
+        size_type param_off = 0;
+        for (size_type vol_idx = 0; vol_idx < nv; ++vol_idx, param_off += num_params_per_xform)
+        {
+          pop_params[vol_idx][pop_off + pop_ind].assign(pop[pop_ind] + param_off,
+                                                        pop[pop_ind] + param_off + num_params_per_xform);
+        }
       }
     }
 
-    // transfer to intermediate storage:
-    for (size_type pop_ind = 0; pop_ind < pop_size; ++pop_ind)
+    if (opt_aux && !run_unc)
     {
-      size_type param_off = 0;
-      for (size_type vol_idx = 0; vol_idx < nv; ++vol_idx, param_off += num_params_per_xform)
-      {
-        pop_params[vol_idx][pop_ind].assign(pop[pop_ind] + param_off,
-                                            pop[pop_ind] + param_off + num_params_per_xform);
-      }
+      opt_aux->num_rejects.push_back(num_rejects);
     }
 
-    // compute the DRRs and similarities
-    this->obj_fn(pop_params, &sim_vals);
-
-    // copy similarities from intermediate storage
-    std::copy(sim_vals.begin(), sim_vals.end(), obj_fn_vals);
+    // compute the DRRs and similarities of every run in a single batch
+    if (dev_pop_sampler)
+    {
+      this->obj_fn_for_ray_caster_dev_xforms(&sim_vals);
+    }
+    else
+    {
+      this->pop_obj_fn(pop_params, &sim_vals);
+    }
 
     if (this->write_combined_sim_scores_to_stream_ || this->debug_save_iter_debug_info_)
     {
@@ -220,11 +403,26 @@ void xreg::Intensity2D3DRegiCMAES::run()
                                       *std::min_element(sim_vals.begin(), sim_vals.end()));
     }
 
-    // update the search distribution used for cmaes_SamplePopulation()
-    cmaes_UpdateDistribution(evo, obj_fn_vals);
-    
+    for (size_type run_idx = 0, pop_off = 0; run_idx < num_runs; ++run_idx, pop_off += pop_size)
+    {
+      // copy similarities from intermediate storage
+      std::copy(sim_vals.begin() + pop_off, sim_vals.begin() + pop_off + pop_size,
+                obj_fn_vals[run_idx]);
+
+      // update the search distribution used for cmaes_SamplePopulation()
+      cmaes_UpdateDistribution(evos[run_idx].get(), obj_fn_vals[run_idx]);
+
+      if (cmaes_Get(evos[run_idx].get(), "fbestever") < cmaes_Get(evo_.get(), "fbestever"))
+      {
+        run_used_for_sol_ = run_idx;
+        evo_ = evos[run_idx];
+      }
+    }
+
     if (opt_aux)
     {
+      auto* evo = evo_.get();
+
       MatMxN cur_cov(tot_num_params,tot_num_params);
 
       for (size_type r = 0; r < tot_num_params; ++r)
@@ -257,7 +455,21 @@ void xreg::Intensity2D3DRegiCMAES::run()
   }
 
   // clean up any memory allocated interally to CMAES
-  cmaes_exit(evo);
+  for (auto& evo : evos)
+  {
+    cmaes_exit(evo.get());
+  }
+}
+
+bool xreg::Intensity2D3DRegiCMAES::can_sample_pop_on_device()
+{
+  const RayCasterOCL* ray_caster_ocl = dynamic_cast<const RayCasterOCL*>(this->ray_caster().get());
+
+  return ray_caster_ocl && ray_caster_ocl->supports_dev_xforms_cam_to_itk_phys() &&
+         bounds_.empty() && (this->num_vols() == 1) && !this->penalty_fn_ &&
+         !this->src_and_obj_pose_opt_vars_ && !this->dyn_ref_frame_fns_[0] &&
+         !this->screen_regi_ && !this->surrogate_ && !this->num_ray_cast_stages() &&
+         dynamic_cast<const SE3OptVarsLieAlg*>(this->opt_vars_.get());
 }
 
 void xreg::Intensity2D3DRegiCMAES::set_opt_obj_fn_tol(const Scalar& tol)
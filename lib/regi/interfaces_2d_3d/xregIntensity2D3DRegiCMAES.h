@@ -50,6 +50,24 @@ public:
   /// This effects the number of DRRs computed.
   void set_pop_size(const size_type pop_size);
 
+  /// \brief Sets the number of independent CMA-ES runs executed concurrently.
+  ///
+  /// The first run starts from the initial pose estimate and the remaining
+  /// runs start from initial estimates perturbed using the initial sigma. The
+  /// populations of every run are packed into the same batch of DRRs, so the
+  /// number of projections per camera is the population size multiplied by
+  /// the number of runs. The first run to satisfy the termination criteria
+  /// provides the solution and stops the remaining runs. When the maximum
+  /// number of iterations is reached, the run with the best objective function
+  /// value is used. Defaults to 1.
+  void set_num_concurrent_runs(const size_type num_runs);
+
+  size_type num_concurrent_runs() const;
+
+  /// \brief The index of the concurrent run that provided the solution of the
+  ///        most recent registration.
+  size_type run_used_for_solution() const;
+
   /// \brief Set custom values of bounds; triggers constrained optimization.
   ///
   /// These are box constraints with the valid range in component k equal to
@@ -60,6 +78,21 @@ public:
   ///        unconstrained.
   void remove_bounds();
 
+  /// \brief Sample the populations and compose their poses on the ray
+  ///        casting device when possible.
+  ///
+  /// Only the mean, covariance factor and step size of each run are uploaded
+  /// each generation and the poses are written directly into the OpenCL ray
+  /// caster's device buffer. This requires an unconstrained optimization of a
+  /// single volume's pose using SE3OptVarsLieAlg, an OpenCL ray caster with
+  /// support for device poses, no regularization, no dynamic reference
+  /// frame, no candidate screening and no additional ray casting stages;
+  /// otherwise the populations are sampled on the host.
+  /// Defaults to false.
+  void set_sample_pop_on_device(const bool sample_on_dev);
+
+  bool sample_pop_on_device() const;
+
   /// \brief Sets custom values of sigma
   void set_sigma(const ScalarList& sigma);
 
@@ -124,6 +157,10 @@ private:
 
   CameraModel cam_model_at_cur_mean();
 
+  /// \brief Indicates if the current configuration supports sampling the
+  ///        populations on the ray casting device.
+  bool can_sample_pop_on_device();
+
   /// \brief Computes DRRs for each camera model using the frame transform represented
   ///        by the CMA-ES mean.
   void compute_drrs_at_mean();
@@ -161,6 +198,8 @@ private:
   ScalarList sigma_;
 
   // a unique_ptr cannot use a forwarded type, so we use shared_ptr
+  // When multiple concurrent runs are used, this is the run currently
+  // providing the estimate
   std::shared_ptr<cmaes_struct> evo_;
 
   Scalar debug_sim_val_;
@@ -170,6 +209,14 @@ private:
 
   /// \brief Default population size to use.
   enum { kDEFAULT_LAMBDA = 50 };
+
+  size_type pop_size_ = kDEFAULT_LAMBDA;
+
+  size_type num_concurrent_runs_ = 1;
+
+  size_type run_used_for_sol_ = 0;
+
+  bool sample_pop_on_device_ = false;
 };
 
 }  // xreg
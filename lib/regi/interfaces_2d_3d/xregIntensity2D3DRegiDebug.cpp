@@ -154,6 +154,11 @@ void xreg::WriteSingleRegiDebugResultsH5(const SingleRegiDebugResults& results,
       WriteSingleScalarH5("regi-elapsed-seconds", *results.regi_time_secs, h5);
     }
 
+    if (!results.stop_reason.empty())
+    {
+      WriteStringH5("stop-reason", results.stop_reason, h5, false);
+    }
+
     if (num_its)
     {
       WriteVectorH5("sim-vals", results.sims, h5);
@@ -306,6 +311,11 @@ xreg::SingleRegiDebugResults xreg::ReadSingleRegiDebugResultsH5(const H5::Group&
   {
     regi_results.regi_time_secs = ReadSingleScalarH5Double("regi-elapsed-seconds", h5);
   }
+
+  if (ObjectInGroupH5("stop-reason", h5))
+  {
+    regi_results.stop_reason = ReadStringH5("stop-reason", h5);
+  }
  
   if (num_its)
   {
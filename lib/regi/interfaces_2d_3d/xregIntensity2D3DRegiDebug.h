@@ -123,6 +123,13 @@ struct SingleRegiDebugResults
   /// This does not include pre-processing, etc.
   boost::optional<double> regi_time_secs;
 
+  /// \brief The reason the registration was stopped early, see
+  ///        Intensity2D3DRegi::request_stop().
+  ///
+  /// This is empty when the optimizer stopped using its own criteria, e.g.
+  /// tolerances or the maximum number of iterations.
+  std::string stop_reason;
+
   /// \brief Auxiliary info saved by the optimizer
   std::shared_ptr<H5ReadWriteInterface> opt_aux;
 
@@ -28,6 +28,7 @@
 
 #include "xregSE3OptVars.h"
 #include "xregIntensity2D3DRegiDebug.h"
+#include "xregTBBUtils.h"
 
 xreg::Intensity2D3DRegiDiffEvo::Intensity2D3DRegiDiffEvo()
 {
@@ -56,6 +57,11 @@ void xreg::Intensity2D3DRegiDiffEvo::set_cross_over_prob(const CoordScalar cr)
   diff_evo_.cross_over_prob = cr;
 }
 
+void xreg::Intensity2D3DRegiDiffEvo::set_parallel_mutation(const bool par_mut)
+{
+  diff_evo_.parallel_mutation = par_mut;
+}
+
 void xreg::Intensity2D3DRegiDiffEvo::set_pop_size(const size_type ps)
 {
   this->num_projs_per_view_ = ps;
@@ -79,6 +85,8 @@ void xreg::Intensity2D3DRegiDiffEvo::set_box_contraint(const ScalarList& bounds)
 
 void xreg::Intensity2D3DRegiDiffEvo::run()
 {
+  ParallelExecContextScope exec_scope(this->exec_ctx_.get());
+
   const auto& opt_vars = *this->opt_vars_;
 
   const size_type nv = this->num_vols();
@@ -147,6 +155,11 @@ void xreg::Intensity2D3DRegiDiffEvo::run()
     }
   };
 
+  diff_evo_.stop_callback = [&] (DifferentialEvolution*, const size_type)
+  {
+    return this->stop_requested();
+  };
+
   diff_evo_.run();
 
   this->after_last_iteration();
@@ -43,6 +43,10 @@ public:
 
   void set_cross_over_prob(const CoordScalar cr);
 
+  /// \brief Compute the mutation and cross over of the population elements
+  ///        in parallel; useful for registering the poses of many objects.
+  void set_parallel_mutation(const bool par_mut);
+
   void set_pop_size(const size_type ps);
 
   void set_max_num_iters(const size_type max_iters);
@@ -24,10 +24,19 @@
 
 #include "xregIntensity2D3DRegiExhaustive.h"
 
+#include <algorithm>
+#include <numeric>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
 #include <fmt/format.h>
 
 #include "xregAssert.h"
 #include "xregExceptionUtils.h"
+#include "xregTBBUtils.h"
 #include "xregSE3OptVars.h"
 #include "xregIntensity2D3DRegiDebug.h"
 #include "xregHDF5.h"
@@ -74,8 +83,288 @@ void xreg::Intensity2D3DRegiExhaustive::set_cam_wrt_vols(const ConstSpacedMeshGr
   this->num_projs_per_view_ = batch_size ? batch_size : tot_num_xforms_;
 }
 
+struct xreg::Intensity2D3DRegiExhaustive::H5StreamWriter
+{
+  struct Batch
+  {
+    std::vector<float> sim_vals;
+
+    std::vector<float> pen_vals;
+
+    std::vector<float> pen_log_probs;
+
+    // cam_wrt_vols[i] stores the row-major 4x4 transforms of volume i
+    std::vector<std::vector<float>> cam_wrt_vols;
+
+    std::vector<unsigned long> grid_inds;
+  };
+
+  H5StreamWriter(const std::string& path, const size_type num_vols,
+                 const bool write_sim_vals, const bool write_pen_vals,
+                 const bool write_pen_log_probs, const bool write_cam_wrt_vols,
+                 const bool write_grid_inds)
+  {
+    h5_ = H5::H5File(path, H5F_ACC_TRUNC);
+
+    // ~1 MB chunks of floats
+    constexpr unsigned long kCHUNK_LEN = 256 * 1024;
+
+    if (write_sim_vals)
+    {
+      sim_vals_ds_.reset(new H5::DataSet(
+          CreateExtendibleMatrixH5Float("sim-vals", 1, kCHUNK_LEN, &h5_)));
+    }
+
+    if (write_pen_vals)
+    {
+      pen_vals_ds_.reset(new H5::DataSet(
+          CreateExtendibleMatrixH5Float("penalty-vals", 1, kCHUNK_LEN, &h5_)));
+    }
+
+    if (write_pen_log_probs)
+    {
+      pen_log_probs_ds_.reset(new H5::DataSet(
+          CreateExtendibleMatrixH5Float("penalty-log-probs", 1, kCHUNK_LEN, &h5_)));
+    }
+
+    if (write_cam_wrt_vols)
+    {
+      H5::Group cam_wrt_vols_g = h5_.createGroup("cam-wrt-vols");
+
+      for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
+      {
+        cam_wrt_vols_ds_.emplace_back(CreateExtendibleMatrixH5Float(
+                                  fmt::format("vol-{:02d}", vol_idx), 16, kCHUNK_LEN / 16,
+                                  &cam_wrt_vols_g));
+      }
+    }
+
+    if (write_grid_inds)
+    {
+      grid_inds_ds_.reset(new H5::DataSet(
+          CreateExtendibleMatrixH5ULong("mesh-grid-inds", 1, kCHUNK_LEN / 2, &h5_)));
+    }
+
+    writer_thread_ = std::thread([this] () { this->write_loop(); });
+  }
+
+  ~H5StreamWriter()
+  {
+    if (writer_thread_.joinable())
+    {
+      stop_and_join();
+    }
+  }
+
+  // no copying
+  H5StreamWriter(const H5StreamWriter&) = delete;
+  H5StreamWriter& operator=(const H5StreamWriter&) = delete;
+
+  /// \brief Queue a batch for writing, blocks when too many batches are queued.
+  void add(Batch&& batch)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    queue_not_full_cv_.wait(lock, [this] () { return batches_.size() < kMAX_NUM_QUEUED; });
+
+    batches_.push_back(std::move(batch));
+
+    queue_not_empty_cv_.notify_one();
+  }
+
+  /// \brief Writes any remaining batches, closes the file and propagates an
+  ///        exception encountered while writing.
+  void finish()
+  {
+    stop_and_join();
+
+    h5_.flush(H5F_SCOPE_GLOBAL);
+    h5_.close();
+
+    if (write_err_)
+    {
+      std::rethrow_exception(write_err_);
+    }
+  }
+
+private:
+  void stop_and_join()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    queue_not_empty_cv_.notify_one();
+
+    writer_thread_.join();
+  }
+
+  void write_loop()
+  {
+    while (true)
+    {
+      Batch batch;
+
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        queue_not_empty_cv_.wait(lock, [this] () { return stop_ || !batches_.empty(); });
+
+        if (batches_.empty())
+        {
+          // stop was requested and all batches have been written
+          break;
+        }
+
+        batch = std::move(batches_.front());
+        batches_.pop_front();
+      }
+
+      queue_not_full_cv_.notify_one();
+
+      // keep consuming batches after an error, so that add() does not block
+      if (!write_err_)
+      {
+        try
+        {
+          write_batch(batch);
+        }
+        catch (...)
+        {
+          write_err_ = std::current_exception();
+        }
+      }
+    }
+  }
+
+  void write_batch(const Batch& batch)
+  {
+    if (sim_vals_ds_)
+    {
+      AppendMatrixRowsH5(batch.sim_vals.data(), batch.sim_vals.size(), sim_vals_ds_.get());
+    }
+
+    if (pen_vals_ds_)
+    {
+      AppendMatrixRowsH5(batch.pen_vals.data(), batch.pen_vals.size(), pen_vals_ds_.get());
+    }
+
+    if (pen_log_probs_ds_)
+    {
+      AppendMatrixRowsH5(batch.pen_log_probs.data(), batch.pen_log_probs.size(),
+                         pen_log_probs_ds_.get());
+    }
+
+    const size_type num_vols = cam_wrt_vols_ds_.size();
+
+    for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
+    {
+      AppendMatrixRowsH5(batch.cam_wrt_vols[vol_idx].data(),
+                         batch.cam_wrt_vols[vol_idx].size() / 16,
+                         &cam_wrt_vols_ds_[vol_idx]);
+    }
+
+    if (grid_inds_ds_)
+    {
+      AppendMatrixRowsH5(batch.grid_inds.data(), batch.grid_inds.size(), grid_inds_ds_.get());
+    }
+  }
+
+  static constexpr size_type kMAX_NUM_QUEUED = 4;
+
+  H5::H5File h5_;
+
+  std::unique_ptr<H5::DataSet> sim_vals_ds_;
+  std::unique_ptr<H5::DataSet> pen_vals_ds_;
+  std::unique_ptr<H5::DataSet> pen_log_probs_ds_;
+  std::unique_ptr<H5::DataSet> grid_inds_ds_;
+
+  std::vector<H5::DataSet> cam_wrt_vols_ds_;
+
+  std::thread writer_thread_;
+
+  std::mutex mutex_;
+
+  std::condition_variable queue_not_empty_cv_;
+  std::condition_variable queue_not_full_cv_;
+
+  std::deque<Batch> batches_;
+
+  bool stop_ = false;
+
+  std::exception_ptr write_err_;
+};
+
+constexpr xreg::size_type xreg::Intensity2D3DRegiExhaustive::H5StreamWriter::kMAX_NUM_QUEUED;
+
+bool xreg::Intensity2D3DRegiExhaustive::BestCandidate::operator<(const BestCandidate& other) const
+{
+  return sim_val < other.sim_val;
+}
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+using GridIndex = ConstSpacedMeshGrid::Index;
+
+size_type GridIndexToLinear(const GridIndex& ind, const GridIndex& strides)
+{
+  size_type lin_ind = 0;
+
+  for (size_type d = 0; d < ind.size(); ++d)
+  {
+    lin_ind += ind[d] * strides[d];
+  }
+
+  return lin_ind;
+}
+
+/// \brief Calls a function with the linear index of every grid point contained
+///        in a box, using a constant step in each dimension.
+///
+/// The box bounds (lo, hi) are inclusive.
+template <class tFn>
+void ForEachGridIndexInBox(const GridIndex& lo, const GridIndex& hi, const size_type step,
+                           const GridIndex& strides, tFn& fn)
+{
+  const size_type num_dims = lo.size();
+
+  GridIndex cur = lo;
+
+  while (true)
+  {
+    fn(GridIndexToLinear(cur, strides));
+
+    // odometer style increment
+    size_type d = 0;
+    for (; d < num_dims; ++d)
+    {
+      if ((cur[d] + step) <= hi[d])
+      {
+        cur[d] += step;
+        break;
+      }
+      else
+      {
+        cur[d] = lo[d];
+      }
+    }
+
+    if (d == num_dims)
+    {
+      break;
+    }
+  }
+}
+
+}  // un-named
+
 void xreg::Intensity2D3DRegiExhaustive::run()
 {
+  ParallelExecContextScope exec_scope(this->exec_ctx_.get());
+
   const size_type num_vols = this->num_vols();
   xregASSERT(use_mesh_grid_ || (num_vols == cam_wrt_vols_.size()));
   xregASSERT(num_vols);
@@ -88,10 +377,6 @@ void xreg::Intensity2D3DRegiExhaustive::run()
   const size_type num_views = this->sim_metrics_.size();
   xregASSERT(num_views);
 
-  const auto& opt_map = *this->opt_vars_;
-
-  const size_type num_opt_params_per_vol = opt_map.num_params();
-
   this->before_first_iteration();
 
   OptAux* opt_aux = nullptr;
@@ -117,63 +402,87 @@ void xreg::Intensity2D3DRegiExhaustive::run()
   
   FrameTransformList delta_xforms(num_vols, FrameTransform::Identity());
 
-  cur_start_xform_idx_ = 0;
+  const bool use_coarse_to_fine = use_mesh_grid_ && (coarse_to_fine_stride_ > 1);
+
+  if (use_coarse_to_fine && (num_shards_ > 1))
+  {
+    xregThrow("a coarse-to-fine exhaustive search cannot be sharded!");
+  }
+
+  const size_type shard_begin = shard_begin_xform_idx();
+
+  const size_type num_xforms_in_shard = shard_end_xform_idx() - shard_begin;
+
+  cur_start_xform_idx_ = shard_begin;
   
-  size_type num_xforms_left = tot_num_xforms_;
+  size_type num_xforms_left = num_xforms_in_shard;
 
-  ListOfFrameTransformLists cur_cam_wrt_vols(num_vols);
+  min_xform_idx_ = shard_begin;
 
-  MeshGridIt mg_it;
+  ListOfFrameTransformLists cur_cam_wrt_vols(num_vols);
 
-  if (use_mesh_grid_)
-  {
-    mg_it = mesh_grid_.begin();
-  }
+  // grid points of the current batch, computed directly from their flat
+  // indices, so the grid is never stored in memory
+  MatMxN cur_grid_pts;
 
   all_sim_vals_.clear();
   all_pen_vals_.clear();
   all_pen_log_prob_vals_.clear();
 
+  all_mesh_grid_inds_.clear();
+
+  num_evaluated_ = 0;
+
+  best_heap_.clear();
+  best_heap_.reserve(num_best_to_keep_);
+
+  if (!stream_results_h5_path_.empty())
+  {
+    const bool stream_pen_log_probs = save_all_penalty_vals_ && penalty_fn_->compute_probs();
+
+    h5_writer_ = std::make_shared<H5StreamWriter>(stream_results_h5_path_, num_vols,
+                                                  save_all_sim_vals_, save_all_penalty_vals_,
+                                                  stream_pen_log_probs,
+                                                  save_all_cam_wrt_vols_in_aux_,
+                                                  use_coarse_to_fine);
+  }
+
   double next_print_percent = print_status_inc_;
 
+  if (use_coarse_to_fine)
+  {
+    run_coarse_to_fine(orig_num_projs_per_view, &delta_xforms, opt_aux);
+
+    // the entire grid is not traversed
+    num_xforms_left = 0;
+  }
+
   while (num_xforms_left)
   {
     this->begin_of_iteration(delta_xforms);
     
     cur_num_xforms_ = std::min(num_xforms_left, this->num_projs_per_view_);
-    
-    sim_vals_.resize(cur_num_xforms_);
    
     if (use_mesh_grid_)
     {
-      cur_mesh_grid_start_it_ = mg_it;
-      
-      // reset transforms list  
-      for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
-      {
-        cur_cam_wrt_vols[vol_idx].clear();
-        cur_cam_wrt_vols[vol_idx].reserve(cur_num_xforms_);
-      }
-      
-      for (size_type i = 0; i < cur_num_xforms_; ++i, ++mg_it)
-      {
-        auto cur_pt = *mg_it;
+      cur_mesh_grid_start_it_ = mesh_grid_.iterator_at(cur_start_xform_idx_);
+      cur_mesh_grid_stop_it_  = mesh_grid_.iterator_at(cur_start_xform_idx_ + cur_num_xforms_ - 1);
 
-        const Scalar* cur_vol_params_buf = &cur_pt[0];
+      cur_grid_pts.resize(mesh_grid_.num_dims(), cur_num_xforms_);
 
-        // split across volumes, create a transform for each volume
-        for (size_type vol_idx = 0; vol_idx < num_vols;
-             ++vol_idx, cur_vol_params_buf += num_opt_params_per_vol)
-        {
-          cur_cam_wrt_vols[vol_idx].push_back(opt_map(
-                Eigen::Map<PtN>(const_cast<Scalar*>(cur_vol_params_buf), num_opt_params_per_vol)));
-        }
+      const size_type batch_start_idx = cur_start_xform_idx_;
 
-        if (i == (cur_num_xforms_ - 1))
+      auto fill_grid_pts = [&] (const RangeType& r)
+      {
+        for (size_type i = r.begin(); i < r.end(); ++i)
         {
-          cur_mesh_grid_stop_it_ = mg_it;
+          mesh_grid_.flat_index_to_pt(batch_start_idx + i, &cur_grid_pts(0,i));
         }
-      }
+      };
+
+      ParallelFor(fill_grid_pts, RangeType(0, cur_num_xforms_));
+
+      grid_pts_to_cam_wrt_vols(cur_grid_pts, &cur_cam_wrt_vols);
     }
     else 
     { 
@@ -186,105 +495,14 @@ void xreg::Intensity2D3DRegiExhaustive::run()
       }
     }
 
-    // set num projs for the objects that matter, optimizer, ray caster, sim metrics
-    this->num_projs_per_view_ = cur_num_xforms_;
-    this->ray_caster_->set_num_projs(num_views * cur_num_xforms_);
-    for (auto& sm : this->sim_metrics_)
-    {
-      sm->set_num_moving_images(cur_num_xforms_);
-    }
-    this->sim_metric_combiner_->set_num_projs_per_sim_metric(cur_num_xforms_);
-
-    this->obj_fn(cur_cam_wrt_vols, nullptr, &sim_vals_);
-
-    if (opt_aux && save_all_cam_wrt_vols_in_aux_)
-    {
-      for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
-      {
-        opt_aux->cam_wrt_vols[vol_idx].insert(opt_aux->cam_wrt_vols[vol_idx].end(),
-                                              cur_cam_wrt_vols[vol_idx].begin(),
-                                              cur_cam_wrt_vols[vol_idx].begin() + cur_num_xforms_);
-      }
-    }
-
-    if (save_all_sim_vals_)
-    {
-      all_sim_vals_.insert(all_sim_vals_.end(), sim_vals_.begin(), sim_vals_.begin() + cur_num_xforms_);
-    }
-
-    if (save_all_penalty_vals_)
-    {
-      const auto& pen_vals = penalty_fn_->reg_vals();
-
-      all_pen_vals_.insert(all_pen_vals_.end(), pen_vals.begin(), pen_vals.begin() + cur_num_xforms_);
-
-      if (penalty_fn_->compute_probs())
-      {
-        const auto& log_probs = penalty_fn_->log_probs();
-
-        all_pen_log_prob_vals_.insert(all_pen_log_prob_vals_.end(), log_probs.begin(), log_probs.begin() + cur_num_xforms_);
-      }
-    }
-
-#ifdef XREG_TBME_MOVIE_HACK
-    // hacking for the tbme movie
-    {
-      static size_type pd_idx = 1;
-
-      ProjDataF32List pd(cur_num_xforms_);
-
-      const auto cam = this->ray_caster_->camera_model();
-
-      for (size_type ii = 0; ii < cur_num_xforms_; ++ii)
-      {
-        pd[ii].img = this->ray_caster_->proj(ii);
-        pd[ii].cam = cam;
-        pd[ii].cam.extrins = pd[ii].cam.extrins * cur_cam_wrt_vols[0][ii];
-      }
-
-      WriteProjDataH5ToDisk(pd, fmt::format("hack_pd_{:02d}.h5", pd_idx));
-
-      ++pd_idx;
-    }
-#endif
-   
-    // reset num projs for the other objects 
-    this->num_projs_per_view_ = orig_num_projs_per_view;
-    this->ray_caster_->set_num_projs(num_views * orig_num_projs_per_view);
-    for (auto& sm : this->sim_metrics_)
-    {
-      sm->set_num_moving_images(orig_num_projs_per_view);
-    }
-    this->sim_metric_combiner_->set_num_projs_per_sim_metric(orig_num_projs_per_view);
-
-    if (compute_min_)
-    {
-      // Find the minimum similarity score and the associated transforms
-      for (size_type proj_idx = 0; proj_idx < cur_num_xforms_; ++proj_idx)
-      {
-        if (min_sim_val_ > sim_vals_[proj_idx])
-        {
-          min_sim_val_ = sim_vals_[proj_idx];
-
-          for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
-          {
-            delta_xforms[vol_idx] = cur_cam_wrt_vols[vol_idx][proj_idx];
-          }
-        
-          if (save_all_sim_vals_)
-          {
-            best_all_sim_vals_idx_ = all_sim_vals_.size() - cur_num_xforms_ + proj_idx;
-          }
-        }
-      }
-    }
+    eval_batch(cur_cam_wrt_vols, orig_num_projs_per_view, &delta_xforms, opt_aux);
 
     cur_start_xform_idx_ += cur_num_xforms_;
     num_xforms_left     -= cur_num_xforms_;
 
     this->end_of_iteration();
    
-    const double cur_comp_percent = 1.0 - (static_cast<double>(num_xforms_left) / tot_num_xforms_);
+    const double cur_comp_percent = 1.0 - (static_cast<double>(num_xforms_left) / num_xforms_in_shard);
     if ((cur_comp_percent + 1.0e-6) > next_print_percent)
     {
       std::cout << fmt::format("  ex. regi: {:4.2f}% ({} remaining)",
@@ -293,8 +511,32 @@ void xreg::Intensity2D3DRegiExhaustive::run()
     }
   }
 
+  if (h5_writer_)
+  {
+    // wait for all batches to be written and close the file
+    h5_writer_->finish();
+    h5_writer_ = nullptr;
+  }
+
+  // order the best candidates from lowest to highest similarity value
+  std::sort_heap(best_heap_.begin(), best_heap_.end());
+
+  best_sim_vals_.clear();
+  best_cam_wrt_vols_.clear();
+
+  for (const auto& cand : best_heap_)
+  {
+    best_sim_vals_.push_back(cand.sim_val);
+    best_cam_wrt_vols_.push_back(cand.cam_wrt_vols);
+  }
+
+  best_heap_.clear();
+
   if (opt_aux)
   {
+    opt_aux->best_sim_vals     = best_sim_vals_;
+    opt_aux->best_cam_wrt_vols = best_cam_wrt_vols_;
+
     opt_aux->has_min = compute_min_;
 
     if (compute_min_)
@@ -320,20 +562,415 @@ void xreg::Intensity2D3DRegiExhaustive::run()
   this->update_regi_xforms(delta_xforms);
 }
 
-xreg::size_type xreg::Intensity2D3DRegiExhaustive::max_num_projs_per_view_per_iter() const
+void xreg::Intensity2D3DRegiExhaustive::run_coarse_to_fine(const size_type orig_num_projs_per_view,
+                                                           FrameTransformList* delta_xforms,
+                                                           OptAux* opt_aux)
 {
-  return this->num_projs_per_view_;
-}
+  const size_type num_dims = mesh_grid_.num_dims();
 
-bool xreg::Intensity2D3DRegiExhaustive::save_all_sim_vals() const
-{
-  return save_all_sim_vals_;
-}
+  const GridIndex strides = mesh_grid_.basic_strides();
 
-void xreg::Intensity2D3DRegiExhaustive::set_save_all_sim_vals(const bool s)
-{
-  save_all_sim_vals_ = s;
-}
+  GridIndex dim_lens(num_dims);
+  for (size_type d = 0; d < num_dims; ++d)
+  {
+    dim_lens[d] = mesh_grid_.range(d).size();
+    xregASSERT(dim_lens[d] > 0);
+  }
+
+  // points are marked when they are queued for evaluation, so that no point
+  // is evaluated multiple times
+  std::vector<bool> queued(tot_num_xforms_, false);
+
+  // similarity value and linear grid index of every evaluated point
+  std::vector<std::pair<Scalar,size_type>> evaluated;
+
+  std::vector<size_type> inds_to_eval;
+
+  const auto queue_ind = [&queued,&inds_to_eval] (const size_type lin_ind)
+  {
+    if (!queued[lin_ind])
+    {
+      queued[lin_ind] = true;
+      inds_to_eval.push_back(lin_ind);
+    }
+  };
+
+  size_type cur_stride = coarse_to_fine_stride_;
+
+  // the coarsest level is a subgrid with an index spacing equal to the stride,
+  // the final index in each dimension is appended when it is not a multiple of
+  // the stride
+  {
+    const GridIndex lo(num_dims, 0);
+    
+    GridIndex hi(num_dims);
+    for (size_type d = 0; d < num_dims; ++d)
+    {
+      hi[d] = dim_lens[d] - 1;
+    }
+
+    ForEachGridIndexInBox(lo, hi, cur_stride, strides, queue_ind);
+
+    for (size_type d = 0; d < num_dims; ++d)
+    {
+      if (hi[d] % cur_stride)
+      {
+        GridIndex last_lo = lo;
+        last_lo[d] = hi[d];
+
+        ForEachGridIndexInBox(last_lo, hi, cur_stride, strides, queue_ind);
+      }
+    }
+  }
+
+  while (true)
+  {
+    this->dout() << fmt::format("  ex. regi coarse-to-fine: stride {}, evaluating {} points",
+                                cur_stride, inds_to_eval.size()) << std::endl;
+
+    eval_mesh_grid_inds(inds_to_eval, orig_num_projs_per_view, delta_xforms, opt_aux, &evaluated);
+
+    if (cur_stride == 1)
+    {
+      break;
+    }
+
+    const size_type prev_stride = cur_stride;
+    cur_stride = std::max(size_type(1), cur_stride / 2);
+
+    // refine about the best points found so far
+    const size_type num_top = std::min(coarse_to_fine_num_top_, evaluated.size());
+
+    std::partial_sort(evaluated.begin(), evaluated.begin() + num_top, evaluated.end());
+
+    inds_to_eval.clear();
+
+    for (size_type top_idx = 0; top_idx < num_top; ++top_idx)
+    {
+      const GridIndex center = mesh_grid_.flat_index_to_index(evaluated[top_idx].second);
+
+      // the neighborhood extends to, but does not include, the adjacent points
+      // of the previous level
+      const size_type rad = ((prev_stride - 1) / cur_stride) * cur_stride;
+
+      GridIndex lo(num_dims);
+      GridIndex hi(num_dims);
+
+      for (size_type d = 0; d < num_dims; ++d)
+      {
+        // keep the lower bound on the same sub-lattice as the center point
+        const size_type cur_rad = std::min(rad, (center[d] / cur_stride) * cur_stride);
+
+        lo[d] = center[d] - cur_rad;
+        hi[d] = std::min(center[d] + rad, dim_lens[d] - 1);
+      }
+
+      ForEachGridIndexInBox(lo, hi, cur_stride, strides, queue_ind);
+    }
+  }
+
+  this->dout() << fmt::format("  ex. regi coarse-to-fine: evaluated {} of {} points",
+                              evaluated.size(), tot_num_xforms_) << std::endl;
+}
+
+void xreg::Intensity2D3DRegiExhaustive::grid_pts_to_cam_wrt_vols(
+                                  const MatMxN& grid_pts,
+                                  ListOfFrameTransformLists* cam_wrt_vols) const
+{
+  const size_type num_vols = this->num_vols();
+
+  const auto& opt_map = *this->opt_vars_;
+
+  const size_type num_opt_params_per_vol = opt_map.num_params();
+
+  const size_type num_pts = grid_pts.cols();
+
+  xregASSERT(static_cast<size_type>(grid_pts.rows()) == (num_vols * num_opt_params_per_vol));
+  xregASSERT(cam_wrt_vols->size() == num_vols);
+
+  for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
+  {
+    auto& cur_xforms = (*cam_wrt_vols)[vol_idx];
+
+    cur_xforms.resize(num_pts);
+
+    if (num_pts)
+    {
+      opt_map.batch_xforms(grid_pts.middleRows(vol_idx * num_opt_params_per_vol,
+                                               num_opt_params_per_vol),
+                           &cur_xforms[0]);
+    }
+  }
+}
+
+void xreg::Intensity2D3DRegiExhaustive::eval_mesh_grid_inds(
+                                  const std::vector<size_type>& lin_inds,
+                                  const size_type orig_num_projs_per_view,
+                                  FrameTransformList* delta_xforms,
+                                  OptAux* opt_aux,
+                                  std::vector<std::pair<Scalar,size_type>>* evaluated)
+{
+  const size_type num_vols = this->num_vols();
+
+  const size_type num_inds = lin_inds.size();
+
+  ListOfFrameTransformLists cur_cam_wrt_vols(num_vols);
+
+  MatMxN cur_grid_pts;
+
+  for (size_type start_idx = 0; start_idx < num_inds; start_idx += orig_num_projs_per_view)
+  {
+    this->begin_of_iteration(*delta_xforms);
+    
+    const size_type cur_num = std::min(orig_num_projs_per_view, num_inds - start_idx);
+
+    cur_grid_pts.resize(mesh_grid_.num_dims(), cur_num);
+
+    const size_type* cur_lin_inds = &lin_inds[start_idx];
+
+    auto fill_grid_pts = [&] (const RangeType& r)
+    {
+      for (size_type i = r.begin(); i < r.end(); ++i)
+      {
+        mesh_grid_.flat_index_to_pt(cur_lin_inds[i], &cur_grid_pts(0,i));
+      }
+    };
+
+    ParallelFor(fill_grid_pts, RangeType(0, cur_num));
+
+    grid_pts_to_cam_wrt_vols(cur_grid_pts, &cur_cam_wrt_vols);
+
+    eval_batch(cur_cam_wrt_vols, orig_num_projs_per_view, delta_xforms, opt_aux,
+               &lin_inds[start_idx]);
+
+    for (size_type i = 0; i < cur_num; ++i)
+    {
+      evaluated->emplace_back(sim_vals_[i], lin_inds[start_idx + i]);
+    }
+
+    if (save_all_sim_vals_ && !h5_writer_)
+    {
+      all_mesh_grid_inds_.insert(all_mesh_grid_inds_.end(), lin_inds.begin() + start_idx,
+                                 lin_inds.begin() + start_idx + cur_num);
+    }
+
+    this->end_of_iteration();
+  }
+}
+
+void xreg::Intensity2D3DRegiExhaustive::eval_batch(const ListOfFrameTransformLists& cur_cam_wrt_vols,
+                                                   const size_type orig_num_projs_per_view,
+                                                   FrameTransformList* delta_xforms,
+                                                   OptAux* opt_aux,
+                                                   const size_type* grid_inds)
+{
+  const size_type num_vols  = this->num_vols();
+  const size_type num_views = this->sim_metrics_.size();
+
+  cur_num_xforms_ = cur_cam_wrt_vols[0].size();
+
+  sim_vals_.resize(cur_num_xforms_);
+
+  // set num projs for the objects that matter, optimizer, ray caster, sim metrics
+  this->num_projs_per_view_ = cur_num_xforms_;
+  this->ray_caster_->set_num_projs(num_views * cur_num_xforms_);
+  for (auto& sm : this->sim_metrics_)
+  {
+    sm->set_num_moving_images(cur_num_xforms_);
+  }
+  this->sim_metric_combiner_->set_num_projs_per_sim_metric(cur_num_xforms_);
+
+  this->obj_fn(cur_cam_wrt_vols, nullptr, &sim_vals_);
+
+  if (h5_writer_)
+  {
+    H5StreamWriter::Batch batch;
+
+    if (save_all_sim_vals_)
+    {
+      batch.sim_vals.assign(sim_vals_.begin(), sim_vals_.begin() + cur_num_xforms_);
+    }
+
+    if (save_all_penalty_vals_)
+    {
+      const auto& pen_vals = penalty_fn_->reg_vals();
+
+      batch.pen_vals.assign(pen_vals.begin(), pen_vals.begin() + cur_num_xforms_);
+
+      if (penalty_fn_->compute_probs())
+      {
+        const auto& log_probs = penalty_fn_->log_probs();
+
+        batch.pen_log_probs.assign(log_probs.begin(), log_probs.begin() + cur_num_xforms_);
+      }
+    }
+
+    if (save_all_cam_wrt_vols_in_aux_)
+    {
+      batch.cam_wrt_vols.resize(num_vols);
+
+      for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
+      {
+        auto& dst_xforms = batch.cam_wrt_vols[vol_idx];
+        dst_xforms.resize(16 * cur_num_xforms_);
+
+        for (size_type i = 0; i < cur_num_xforms_; ++i)
+        {
+          // row-major 4x4
+          Eigen::Map<Eigen::Matrix<float,4,4,Eigen::RowMajor>> dst_mat(&dst_xforms[16 * i]);
+
+          dst_mat = cur_cam_wrt_vols[vol_idx][i].matrix().cast<float>();
+        }
+      }
+    }
+
+    if (grid_inds)
+    {
+      batch.grid_inds.assign(grid_inds, grid_inds + cur_num_xforms_);
+    }
+
+    h5_writer_->add(std::move(batch));
+  }
+  else
+  {
+    if (opt_aux && save_all_cam_wrt_vols_in_aux_)
+    {
+      for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
+      {
+        opt_aux->cam_wrt_vols[vol_idx].insert(opt_aux->cam_wrt_vols[vol_idx].end(),
+                                              cur_cam_wrt_vols[vol_idx].begin(),
+                                              cur_cam_wrt_vols[vol_idx].begin() + cur_num_xforms_);
+      }
+    }
+
+    if (save_all_sim_vals_)
+    {
+      all_sim_vals_.insert(all_sim_vals_.end(), sim_vals_.begin(), sim_vals_.begin() + cur_num_xforms_);
+    }
+
+    if (save_all_penalty_vals_)
+    {
+      const auto& pen_vals = penalty_fn_->reg_vals();
+
+      all_pen_vals_.insert(all_pen_vals_.end(), pen_vals.begin(), pen_vals.begin() + cur_num_xforms_);
+
+      if (penalty_fn_->compute_probs())
+      {
+        const auto& log_probs = penalty_fn_->log_probs();
+
+        all_pen_log_prob_vals_.insert(all_pen_log_prob_vals_.end(), log_probs.begin(), log_probs.begin() + cur_num_xforms_);
+      }
+    }
+  }
+
+  if (num_best_to_keep_)
+  {
+    for (size_type proj_idx = 0; proj_idx < cur_num_xforms_; ++proj_idx)
+    {
+      const Scalar cur_val = sim_vals_[proj_idx];
+
+      const bool heap_full = best_heap_.size() == num_best_to_keep_;
+
+      if (!heap_full || (cur_val < best_heap_.front().sim_val))
+      {
+        if (heap_full)
+        {
+          std::pop_heap(best_heap_.begin(), best_heap_.end());
+          best_heap_.pop_back();
+        }
+
+        BestCandidate cand;
+        cand.sim_val = cur_val;
+        cand.cam_wrt_vols.resize(num_vols);
+
+        for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
+        {
+          cand.cam_wrt_vols[vol_idx] = cur_cam_wrt_vols[vol_idx][proj_idx];
+        }
+
+        best_heap_.push_back(cand);
+        std::push_heap(best_heap_.begin(), best_heap_.end());
+      }
+    }
+  }
+
+#ifdef XREG_TBME_MOVIE_HACK
+  // hacking for the tbme movie
+  {
+    static size_type pd_idx = 1;
+
+    ProjDataF32List pd(cur_num_xforms_);
+
+    const auto cam = this->ray_caster_->camera_model();
+
+    for (size_type ii = 0; ii < cur_num_xforms_; ++ii)
+    {
+      pd[ii].img = this->ray_caster_->proj(ii);
+      pd[ii].cam = cam;
+      pd[ii].cam.extrins = pd[ii].cam.extrins * cur_cam_wrt_vols[0][ii];
+    }
+
+    WriteProjDataH5ToDisk(pd, fmt::format("hack_pd_{:02d}.h5", pd_idx));
+
+    ++pd_idx;
+  }
+#endif
+ 
+  // reset num projs for the other objects 
+  this->num_projs_per_view_ = orig_num_projs_per_view;
+  this->ray_caster_->set_num_projs(num_views * orig_num_projs_per_view);
+  for (auto& sm : this->sim_metrics_)
+  {
+    sm->set_num_moving_images(orig_num_projs_per_view);
+  }
+  this->sim_metric_combiner_->set_num_projs_per_sim_metric(orig_num_projs_per_view);
+
+  if (compute_min_)
+  {
+    // Find the minimum similarity score and the associated transforms
+    for (size_type proj_idx = 0; proj_idx < cur_num_xforms_; ++proj_idx)
+    {
+      if (min_sim_val_ > sim_vals_[proj_idx])
+      {
+        min_sim_val_ = sim_vals_[proj_idx];
+
+        for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
+        {
+          (*delta_xforms)[vol_idx] = cur_cam_wrt_vols[vol_idx][proj_idx];
+        }
+
+        min_xform_idx_ = grid_inds ? grid_inds[proj_idx] : (cur_start_xform_idx_ + proj_idx);
+      
+        if (save_all_sim_vals_)
+        {
+          best_all_sim_vals_idx_ = num_evaluated_ + proj_idx;
+        }
+      }
+    }
+  }
+
+  num_evaluated_ += cur_num_xforms_;
+}
+
+xreg::size_type xreg::Intensity2D3DRegiExhaustive::max_num_projs_per_view_per_iter() const
+{
+  return this->num_projs_per_view_;
+}
+
+bool xreg::Intensity2D3DRegiExhaustive::supports_smaller_batches() const
+{
+  return true;
+}
+
+bool xreg::Intensity2D3DRegiExhaustive::save_all_sim_vals() const
+{
+  return save_all_sim_vals_;
+}
+
+void xreg::Intensity2D3DRegiExhaustive::set_save_all_sim_vals(const bool s)
+{
+  save_all_sim_vals_ = s;
+}
 
 bool xreg::Intensity2D3DRegiExhaustive::save_all_penalty_vals() const
 {
@@ -383,6 +1020,148 @@ void xreg::Intensity2D3DRegiExhaustive::set_print_status_inc(const double inc)
   print_status_inc_ = inc;
 }
 
+void xreg::Intensity2D3DRegiExhaustive::set_coarse_to_fine(const size_type stride,
+                                                           const size_type num_top)
+{
+  xregASSERT(stride > 0);
+  xregASSERT(num_top > 0);
+
+  coarse_to_fine_stride_  = stride;
+  coarse_to_fine_num_top_ = num_top;
+}
+
+const std::vector<xreg::size_type>&
+xreg::Intensity2D3DRegiExhaustive::all_mesh_grid_inds() const
+{
+  return all_mesh_grid_inds_;
+}
+
+void xreg::Intensity2D3DRegiExhaustive::set_stream_results_h5_path(const std::string& path)
+{
+  stream_results_h5_path_ = path;
+}
+
+void xreg::Intensity2D3DRegiExhaustive::set_num_best_to_keep(const size_type num_best)
+{
+  num_best_to_keep_ = num_best;
+}
+
+const xreg::Intensity2D3DRegiExhaustive::ScalarList&
+xreg::Intensity2D3DRegiExhaustive::best_sim_vals() const
+{
+  return best_sim_vals_;
+}
+
+const xreg::Intensity2D3DRegiExhaustive::ListOfFrameTransformLists&
+xreg::Intensity2D3DRegiExhaustive::best_cam_wrt_vols() const
+{
+  return best_cam_wrt_vols_;
+}
+
+void xreg::Intensity2D3DRegiExhaustive::set_shard(const size_type shard_idx,
+                                                  const size_type num_shards)
+{
+  xregASSERT(num_shards > 0);
+  xregASSERT(shard_idx < num_shards);
+
+  shard_idx_  = shard_idx;
+  num_shards_ = num_shards;
+}
+
+xreg::size_type xreg::Intensity2D3DRegiExhaustive::shard_idx() const
+{
+  return shard_idx_;
+}
+
+xreg::size_type xreg::Intensity2D3DRegiExhaustive::num_shards() const
+{
+  return num_shards_;
+}
+
+xreg::size_type xreg::Intensity2D3DRegiExhaustive::shard_begin_xform_idx() const
+{
+  // the first (tot % num_shards) shards get one extra candidate
+  const size_type num_per_shard = tot_num_xforms_ / num_shards_;
+  const size_type num_extra     = tot_num_xforms_ % num_shards_;
+
+  return (shard_idx_ * num_per_shard) + std::min(shard_idx_, num_extra);
+}
+
+xreg::size_type xreg::Intensity2D3DRegiExhaustive::shard_end_xform_idx() const
+{
+  const size_type num_per_shard = tot_num_xforms_ / num_shards_;
+  const size_type num_extra     = tot_num_xforms_ % num_shards_;
+
+  return shard_begin_xform_idx() + num_per_shard + ((shard_idx_ < num_extra) ? 1 : 0);
+}
+
+void xreg::Intensity2D3DRegiExhaustive::write_shard_results(const std::string& path) const
+{
+  H5::H5File h5(path, H5F_ACC_TRUNC);
+
+  WriteStringH5("name", "Exhaustive-Shard", &h5, false);
+
+  WriteSingleScalarH5("shard-idx", shard_idx_, &h5);
+  WriteSingleScalarH5("num-shards", num_shards_, &h5);
+  WriteSingleScalarH5("tot-num-xforms", tot_num_xforms_, &h5);
+  WriteSingleScalarH5("shard-begin", shard_begin_xform_idx(), &h5);
+  WriteSingleScalarH5("shard-end", shard_end_xform_idx(), &h5);
+
+  const size_type num_vols = this->num_vols();
+
+  WriteSingleScalarH5("num-vols", num_vols, &h5);
+
+  if (compute_min_)
+  {
+    WriteSingleScalarH5("min-sim-val", min_sim_val_, &h5);
+    WriteSingleScalarH5("min-xform-idx", min_xform_idx_, &h5);
+
+    H5::Group min_g = h5.createGroup("min-cam-wrt-vols");
+
+    for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
+    {
+      WriteAffineTransform4x4(fmt::format("vol-{:02d}", vol_idx), this->regi_xform(vol_idx), &min_g);
+    }
+  }
+
+  if (save_all_sim_vals_ && stream_results_h5_path_.empty())
+  {
+    WriteVectorH5("all-sim-vals", all_sim_vals_, &h5);
+  }
+
+  if (save_all_penalty_vals_ && stream_results_h5_path_.empty())
+  {
+    WriteVectorH5("all-penalty-vals", all_pen_vals_, &h5);
+
+    if (!all_pen_log_prob_vals_.empty())
+    {
+      WriteVectorH5("all-penalty-log-probs", all_pen_log_prob_vals_, &h5);
+    }
+  }
+
+  const size_type num_best = best_sim_vals_.size();
+
+  if (num_best)
+  {
+    WriteVectorH5("best-sim-vals", best_sim_vals_, &h5);
+
+    H5::Group best_g = h5.createGroup("best-cam-wrt-vols");
+
+    for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
+    {
+      H5::Group vol_g = best_g.createGroup(fmt::format("vol-{:02d}", vol_idx));
+
+      for (size_type i = 0; i < num_best; ++i)
+      {
+        WriteAffineTransform4x4(fmt::format("{:06d}", i), best_cam_wrt_vols_[i][vol_idx], &vol_g);
+      }
+    }
+  }
+
+  h5.flush(H5F_SCOPE_GLOBAL);
+  h5.close();
+}
+
 void xreg::Intensity2D3DRegiExhaustive::write_debug()
 { }
 
@@ -438,9 +1217,275 @@ void xreg::Intensity2D3DRegiExhaustive::OptAux::write(H5::Group* h5)
   {
     WriteVectorH5("all-sim-vals", all_sim_vals, &aux_g);
   }
+
+  const size_type num_best = best_sim_vals.size();
+
+  if (num_best)
+  {
+    WriteVectorH5("best-sim-vals", best_sim_vals, &aux_g);
+
+    H5::Group best_g = aux_g.createGroup("best-cam-wrt-vols");
+
+    const size_type num_best_vols = best_cam_wrt_vols[0].size();
+
+    for (size_type vol_idx = 0; vol_idx < num_best_vols; ++vol_idx)
+    {
+      H5::Group vol_g = best_g.createGroup(fmt::format("vol-{:02d}", vol_idx));
+
+      for (size_type i = 0; i < num_best; ++i)
+      {
+        WriteAffineTransform4x4(fmt::format("{:06d}", i), best_cam_wrt_vols[i][vol_idx], &vol_g);
+      }
+    }
+  }
+}
+
+void xreg::MergeExhaustiveShardResults(const std::vector<std::string>& shard_paths, H5::Group* h5)
+{
+  using Scalar = Intensity2D3DRegiExhaustive::Scalar;
+
+  struct ShardInfo
+  {
+    size_type shard_idx;
+    size_type shard_begin;
+    size_type shard_end;
+
+    bool has_min;
+    Scalar min_sim_val;
+    size_type min_xform_idx;
+
+    std::string path;
+  };
+
+  const size_type num_shards_in = shard_paths.size();
+
+  if (!num_shards_in)
+  {
+    xregThrow("no shard result files provided!");
+  }
+
+  std::vector<ShardInfo> shards;
+  shards.reserve(num_shards_in);
+
+  size_type num_shards     = 0;
+  size_type tot_num_xforms = 0;
+  size_type num_vols       = 0;
+
+  for (size_type i = 0; i < num_shards_in; ++i)
+  {
+    const H5::H5File shard_h5(shard_paths[i], H5F_ACC_RDONLY);
+
+    const size_type cur_num_shards = ReadSingleScalarH5ULong("num-shards", shard_h5);
+    const size_type cur_tot        = ReadSingleScalarH5ULong("tot-num-xforms", shard_h5);
+    const size_type cur_num_vols   = ReadSingleScalarH5ULong("num-vols", shard_h5);
+
+    if (!i)
+    {
+      num_shards     = cur_num_shards;
+      tot_num_xforms = cur_tot;
+      num_vols       = cur_num_vols;
+    }
+    else if ((cur_num_shards != num_shards) || (cur_tot != tot_num_xforms) ||
+             (cur_num_vols != num_vols))
+    {
+      xregThrow("shard file %s is not from the same search as %s!",
+                shard_paths[i].c_str(), shard_paths[0].c_str());
+    }
+
+    ShardInfo info;
+
+    info.path = shard_paths[i];
+
+    info.shard_idx   = ReadSingleScalarH5ULong("shard-idx", shard_h5);
+    info.shard_begin = ReadSingleScalarH5ULong("shard-begin", shard_h5);
+    info.shard_end   = ReadSingleScalarH5ULong("shard-end", shard_h5);
+
+    info.has_min = ObjectInGroupH5("min-sim-val", shard_h5);
+
+    if (info.has_min)
+    {
+      info.min_sim_val   = ReadSingleScalarH5CoordScalar("min-sim-val", shard_h5);
+      info.min_xform_idx = ReadSingleScalarH5ULong("min-xform-idx", shard_h5);
+    }
+
+    shards.push_back(info);
+  }
+
+  if (num_shards != num_shards_in)
+  {
+    xregThrow("expected %lu shard files, got %lu!", num_shards, num_shards_in);
+  }
+
+  std::sort(shards.begin(), shards.end(),
+            [] (const ShardInfo& s1, const ShardInfo& s2)
+            {
+              return s1.shard_idx < s2.shard_idx;
+            });
+
+  // check that every candidate was evaluated exactly once
+  size_type next_begin = 0;
+
+  for (const auto& info : shards)
+  {
+    if (info.shard_begin != next_begin)
+    {
+      xregThrow("shards do not partition the candidates (shard %lu begins at %lu, expected %lu)!",
+                info.shard_idx, info.shard_begin, next_begin);
+    }
+
+    next_begin = info.shard_end;
+  }
+
+  if (next_begin != tot_num_xforms)
+  {
+    xregThrow("shards only cover %lu of %lu candidates!", next_begin, tot_num_xforms);
+  }
+
+  bool has_min = true;
+  bool has_all_sim_vals = true;
+
+  for (const auto& info : shards)
+  {
+    has_min = has_min && info.has_min;
+  }
+
+  Scalar min_sim_val = std::numeric_limits<Scalar>::max();
+  size_type min_xform_idx = 0;
+  size_type min_shard = 0;
+
+  if (has_min)
+  {
+    for (size_type i = 0; i < num_shards; ++i)
+    {
+      // ties go to the candidate with the lower index, matching an unsharded search
+      if (shards[i].min_sim_val < min_sim_val)
+      {
+        min_sim_val   = shards[i].min_sim_val;
+        min_xform_idx = shards[i].min_xform_idx;
+        min_shard     = i;
+      }
+    }
+  }
+
+  Intensity2D3DRegiExhaustive::ScalarList all_sim_vals;
+
+  // (sim. value, transforms for each vol.) of the best candidates across all shards
+  std::vector<std::pair<Scalar,FrameTransformList>> best;
+
+  size_type num_best_to_keep = 0;
+
+  FrameTransformList min_cam_wrt_vols;
+
+  for (size_type i = 0; i < num_shards; ++i)
+  {
+    const H5::H5File shard_h5(shards[i].path, H5F_ACC_RDONLY);
+
+    if (has_all_sim_vals && ObjectInGroupH5("all-sim-vals", shard_h5))
+    {
+      const auto cur_sim_vals = ReadVectorH5CoordScalar("all-sim-vals", shard_h5);
+
+      xregASSERT(cur_sim_vals.size() == (shards[i].shard_end - shards[i].shard_begin));
+
+      all_sim_vals.insert(all_sim_vals.end(), cur_sim_vals.begin(), cur_sim_vals.end());
+    }
+    else
+    {
+      has_all_sim_vals = false;
+      all_sim_vals.clear();
+    }
+
+    if (has_min && (i == min_shard))
+    {
+      const H5::Group min_g = shard_h5.openGroup("min-cam-wrt-vols");
+
+      for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
+      {
+        min_cam_wrt_vols.push_back(ReadAffineTransform4x4H5(fmt::format("vol-{:02d}", vol_idx), min_g));
+      }
+    }
+
+    if (ObjectInGroupH5("best-sim-vals", shard_h5))
+    {
+      const auto cur_best_vals = ReadVectorH5CoordScalar("best-sim-vals", shard_h5);
+
+      const size_type cur_num_best = cur_best_vals.size();
+
+      num_best_to_keep = std::max(num_best_to_keep, cur_num_best);
+
+      const H5::Group best_g = shard_h5.openGroup("best-cam-wrt-vols");
+
+      std::vector<H5::Group> vol_gs;
+
+      for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
+      {
+        vol_gs.push_back(best_g.openGroup(fmt::format("vol-{:02d}", vol_idx)));
+      }
+
+      for (size_type j = 0; j < cur_num_best; ++j)
+      {
+        FrameTransformList cur_xforms;
+
+        for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
+        {
+          cur_xforms.push_back(ReadAffineTransform4x4H5(fmt::format("{:06d}", j), vol_gs[vol_idx]));
+        }
+
+        best.emplace_back(cur_best_vals[j], cur_xforms);
+      }
+    }
+  }
+
+  // keep the overall best candidates, stable so that earlier shards win ties
+  std::stable_sort(best.begin(), best.end(),
+                   [] (const std::pair<Scalar,FrameTransformList>& b1,
+                       const std::pair<Scalar,FrameTransformList>& b2)
+                   {
+                     return b1.first < b2.first;
+                   });
+
+  if (best.size() > num_best_to_keep)
+  {
+    best.resize(num_best_to_keep);
+  }
+
+  Intensity2D3DRegiExhaustive::OptAux opt_aux;
+
+  opt_aux.has_min = has_min;
+
+  if (has_min)
+  {
+    opt_aux.min_sim_val = min_sim_val;
+  }
+
+  opt_aux.has_all_sim_vals = has_all_sim_vals;
+
+  if (has_all_sim_vals)
+  {
+    opt_aux.all_sim_vals = all_sim_vals;
+
+    // the shards are contiguous, so the global index is also the index into all_sim_vals
+    opt_aux.best_all_sim_vals_idx = min_xform_idx;
+  }
+
+  for (const auto& b : best)
+  {
+    opt_aux.best_sim_vals.push_back(b.first);
+    opt_aux.best_cam_wrt_vols.push_back(b.second);
+  }
+
+  opt_aux.write(h5);
+
+  if (has_min)
+  {
+    H5::Group min_g = h5->createGroup("min-cam-wrt-vols");
+
+    for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
+    {
+      WriteAffineTransform4x4(fmt::format("vol-{:02d}", vol_idx), min_cam_wrt_vols[vol_idx], &min_g);
+    }
+  }
 }
 
 #ifdef XREG_TBME_MOVIE_HACK
 #undef XREG_TBME_MOVIE_HACK
 #endif
-
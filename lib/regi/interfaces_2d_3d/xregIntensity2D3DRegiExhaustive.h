@@ -53,6 +53,10 @@ public:
 
   size_type max_num_projs_per_view_per_iter() const override;
 
+  /// \brief Returns true - the poses are evaluated in batches of the number
+  ///        of projections per view.
+  bool supports_smaller_batches() const override;
+
   bool save_all_sim_vals() const;
 
   void set_save_all_sim_vals(const bool s);
@@ -75,6 +79,86 @@ public:
 
   void set_print_status_inc(const double inc);
 
+  /// \brief Evaluate a mesh grid hierarchically instead of at every point.
+  ///
+  /// A subgrid using every stride'th index in each dimension is evaluated first.
+  /// The stride is then halved and only the points neighboring the num_top
+  /// best points found so far are evaluated, which is repeated until the full
+  /// resolution of the grid is reached. A stride of 1 (the default) evaluates
+  /// every grid point. This is only used when the candidate transforms are
+  /// specified with a mesh grid.
+  ///
+  /// When saving all similarity values, the values are stored in the order of
+  /// evaluation and all_mesh_grid_inds() provides the linear grid index of each
+  /// value.
+  void set_coarse_to_fine(const size_type stride, const size_type num_top);
+
+  /// \brief The linear mesh grid indices corresponding to all_sim_vals() when
+  ///        performing a coarse-to-fine search.
+  const std::vector<size_type>& all_mesh_grid_inds() const;
+
+  /// \brief Stream the values requested by set_save_all_sim_vals(),
+  ///        set_save_all_penalty_vals() and set_save_all_cam_wrt_vols_in_aux()
+  ///        to an HDF5 file instead of keeping them in memory.
+  ///
+  /// Each batch is appended to chunked, compressed datasets by a background
+  /// thread while the next batch is evaluated. The file contains "sim-vals",
+  /// "penalty-vals" and "penalty-log-probs" vectors (N x 1 matrices) and a
+  /// "cam-wrt-vols/vol-XX" N x 16 matrix of row-major 4x4 transforms for each
+  /// volume. A coarse-to-fine search also writes the linear grid index of each
+  /// evaluation to "mesh-grid-inds". The in-memory lists returned by
+  /// all_sim_vals(), etc. are left empty when streaming. An empty path (the
+  /// default) disables streaming.
+  void set_stream_results_h5_path(const std::string& path);
+
+  /// \brief Keep the num_best lowest similarity values and their transforms in
+  ///        memory; 0 (the default) disables.
+  ///
+  /// This may be used to obtain a collection of the best candidates without
+  /// saving the values at every candidate.
+  void set_num_best_to_keep(const size_type num_best);
+
+  /// \brief The lowest similarity values kept by set_num_best_to_keep(), in
+  ///        ascending order.
+  const ScalarList& best_sim_vals() const;
+
+  /// \brief The transforms corresponding to best_sim_vals();
+  ///        best_cam_wrt_vols()[i][j] is the transform of volume j for the
+  ///        i'th best value.
+  const ListOfFrameTransformLists& best_cam_wrt_vols() const;
+
+  /// \brief Only evaluate a deterministic slice of the candidate transforms.
+  ///
+  /// The candidates (mesh grid points in linear index order, or the list of
+  /// transforms) are split into num_shards contiguous ranges of nearly equal
+  /// size, and only range shard_idx is evaluated by run(). This allows a single
+  /// search to be distributed across several processes or machines, e.g. by
+  /// passing an MPI rank/size or indices from the command line. Each process
+  /// should call write_shard_results() after run() and the partial results may
+  /// be combined with MergeExhaustiveShardResults().
+  /// Sharding may not be combined with a coarse-to-fine search.
+  /// The default is a single shard, e.g. evaluate every candidate.
+  void set_shard(const size_type shard_idx, const size_type num_shards);
+
+  size_type shard_idx() const;
+
+  size_type num_shards() const;
+
+  /// \brief The index of the first candidate evaluated by this shard.
+  size_type shard_begin_xform_idx() const;
+
+  /// \brief One past the index of the last candidate evaluated by this shard.
+  size_type shard_end_xform_idx() const;
+
+  /// \brief Write the results of the most recent call to run() to an HDF5
+  ///        file which may be merged with the results of the other shards.
+  ///
+  /// The minimum similarity value and its transforms are written when the
+  /// minimum was computed, the similarity and penalty values are written when
+  /// saved in memory and the best candidates are written when
+  /// set_num_best_to_keep() was used.
+  void write_shard_results(const std::string& path) const;
+
 protected:
   void write_debug() override;
 
@@ -114,6 +198,79 @@ protected:
   ScalarList all_pen_log_prob_vals_;
 
 private:
+  struct OptAux;
+
+  friend void MergeExhaustiveShardResults(const std::vector<std::string>& shard_paths,
+                                          H5::Group* h5);
+
+  /// \brief Evaluates a batch of candidate transforms and records the results.
+  ///
+  /// grid_inds optionally points to the linear mesh grid index of each transform
+  void eval_batch(const ListOfFrameTransformLists& cur_cam_wrt_vols,
+                  const size_type orig_num_projs_per_view,
+                  FrameTransformList* delta_xforms,
+                  OptAux* opt_aux,
+                  const size_type* grid_inds = nullptr);
+
+  void run_coarse_to_fine(const size_type orig_num_projs_per_view,
+                          FrameTransformList* delta_xforms,
+                          OptAux* opt_aux);
+
+  /// \brief Maps mesh grid points to the camera to volume transforms of each
+  ///        volume.
+  ///
+  /// Each column of grid_pts is a mesh grid point, the parameters of the first
+  /// volume are stored in the first rows. Each list is resized to the number
+  /// of columns and the transforms of each volume are computed in one batch.
+  void grid_pts_to_cam_wrt_vols(const MatMxN& grid_pts,
+                                ListOfFrameTransformLists* cam_wrt_vols) const;
+
+  void eval_mesh_grid_inds(const std::vector<size_type>& lin_inds,
+                           const size_type orig_num_projs_per_view,
+                           FrameTransformList* delta_xforms,
+                           OptAux* opt_aux,
+                           std::vector<std::pair<Scalar,size_type>>* evaluated);
+
+  size_type coarse_to_fine_stride_ = 1;
+
+  size_type coarse_to_fine_num_top_ = 10;
+
+  std::vector<size_type> all_mesh_grid_inds_;
+
+  // the number of transforms evaluated during the current call to run()
+  size_type num_evaluated_ = 0;
+
+  struct H5StreamWriter;
+
+  std::string stream_results_h5_path_;
+
+  // only valid during run()
+  std::shared_ptr<H5StreamWriter> h5_writer_;
+
+  struct BestCandidate
+  {
+    Scalar sim_val;
+
+    FrameTransformList cam_wrt_vols;
+
+    bool operator<(const BestCandidate& other) const;
+  };
+
+  size_type num_best_to_keep_ = 0;
+
+  // max-heap, the worst of the best candidates is at the front
+  std::vector<BestCandidate> best_heap_;
+
+  ScalarList best_sim_vals_;
+
+  ListOfFrameTransformLists best_cam_wrt_vols_;
+
+  size_type shard_idx_  = 0;
+  size_type num_shards_ = 1;
+
+  // global index of the candidate with the minimum similarity value
+  size_type min_xform_idx_ = 0;
+
   // Interval to print the percentage of transforms evaluated.
   // 0.1 --> print in approximately 10% intervals
   // 1.1 --> do not print (e.g. print in 110% intervals)
@@ -134,12 +291,27 @@ private:
 
     ScalarList all_sim_vals;
 
+    ScalarList best_sim_vals;
+
+    ListOfFrameTransformLists best_cam_wrt_vols;
+
     void read(const H5::Group& h5) override;
 
     void write(H5::Group* h5) override;
   };
 };
 
+/// \brief Combines the partial results written by each shard of an exhaustive
+///        search into the standard exhaustive search optimization aux. output.
+///
+/// The file of every shard must be provided, in any order. The "opt-aux" group
+/// is created in h5 with the same layout written by the debug info of a
+/// single, unsharded, search: the minimum similarity value and its index, all
+/// similarity values (when every shard saved them) and the best candidates
+/// across all shards. The transforms with the minimum similarity value are
+/// also written to "min-cam-wrt-vols".
+void MergeExhaustiveShardResults(const std::vector<std::string>& shard_paths, H5::Group* h5);
+
 }  // xreg
 
 #endif
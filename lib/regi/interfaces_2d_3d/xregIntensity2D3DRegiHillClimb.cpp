@@ -35,6 +35,7 @@
 #include "xregITKIOUtils.h"
 #include "xregITKOpenCVUtils.h"
 #include "xregOpenCVUtils.h"
+#include "xregTBBUtils.h"
 
 xreg::Intensity2D3DRegiHillClimb::Intensity2D3DRegiHillClimb()
 {
@@ -58,10 +59,38 @@ void xreg::Intensity2D3DRegiHillClimb::set_init_steps(const ScalarList& init_ste
   init_steps_ = init_steps;
 }
 
+void xreg::Intensity2D3DRegiHillClimb::set_use_pattern_search(const bool use_pattern_search)
+{
+  use_pattern_search_ = use_pattern_search;
+}
+
+void xreg::Intensity2D3DRegiHillClimb::set_num_pattern_search_levels(const size_type num_levels)
+{
+  num_pattern_search_levels_ = num_levels;
+}
+
+void xreg::Intensity2D3DRegiHillClimb::set_pattern_search_diagonals(const bool use_diags)
+{
+  pattern_search_diags_ = use_diags;
+}
+
+void xreg::Intensity2D3DRegiHillClimb::set_pattern_search_momentum(const bool use_momentum)
+{
+  pattern_search_momentum_ = use_momentum;
+}
+
 void xreg::Intensity2D3DRegiHillClimb::run()
 {
+  ParallelExecContextScope exec_scope(this->exec_ctx_.get());
+
   xregASSERT(num_step_levels_);
 
+  if (use_pattern_search_)
+  {
+    run_pattern_search();
+    return;
+  }
+
   constexpr Scalar kDEFAULT_STEP_LEN = 1;
 
   const size_type nv = this->num_vols();
@@ -101,7 +130,8 @@ void xreg::Intensity2D3DRegiHillClimb::run()
 
   this->before_first_iteration();
 
-  for (size_type cur_step_level = 0; (cur_step_level < num_step_levels_) && (iter < this->max_num_iters_);
+  for (size_type cur_step_level = 0;
+       (cur_step_level < num_step_levels_) && (iter < this->max_num_iters_) && !this->stop_requested();
        /* see bottom of loop for increment*/)
   {
     this->begin_of_iteration(cur_param_vec_);
@@ -186,6 +216,15 @@ void xreg::Intensity2D3DRegiHillClimb::run()
 
   this->after_last_iteration();
 
+  update_regi_xforms_from_cur_params();
+}
+
+void xreg::Intensity2D3DRegiHillClimb::update_regi_xforms_from_cur_params()
+{
+  const size_type nv = this->num_vols();
+
+  const size_type num_params_per_xform = this->opt_vars_->num_params();
+
   FrameTransformList delta_xforms(nv);
   for (size_type vol_idx = 0; vol_idx < nv; ++vol_idx)
   {
@@ -204,9 +243,207 @@ void xreg::Intensity2D3DRegiHillClimb::run()
   }
 }
 
+void xreg::Intensity2D3DRegiHillClimb::run_pattern_search()
+{
+  xregASSERT(num_pattern_search_levels_);
+
+  constexpr Scalar kDEFAULT_STEP_LEN = 1;
+
+  const size_type nv = this->num_vols();
+
+  const size_type num_params_per_xform = this->opt_vars_->num_params();
+
+  const size_type tot_num_params = num_params_per_xform * nv;
+
+  ScalarList cur_steps = init_steps_;
+  if (cur_steps.empty())
+  {
+    cur_steps.assign(tot_num_params, kDEFAULT_STEP_LEN);
+  }
+
+  xregASSERT(cur_steps.size() == tot_num_params);
+
+  const size_type num_cands = this->num_projs_per_view_;
+  xregASSERT(num_cands == max_num_projs_per_view_per_iter());
+
+  // cands[j] is the jth candidate over the parameters of every volume, the
+  // first candidate is always the current estimate
+  ListOfScalarLists cands(num_cands, ScalarList(tot_num_params));
+
+  // the step level, relative to the current steps, of each candidate
+  std::vector<size_type> cand_levels(num_cands, 0);
+
+  ScalarList tmp_sim_vals(num_cands, 0);
+
+  ListOfListsOfScalarLists cur_params_to_eval(nv,
+                                ListOfScalarLists(num_cands, ScalarList(num_params_per_xform)));
+
+  cur_param_vec_.assign(tot_num_params, 0);
+
+  // the estimate before the last accepted move, used by the momentum candidate
+  ScalarList prev_param_vec = cur_param_vec_;
+
+  cur_param_sim_val_ = 0;
+
+  size_type iter = 0;
+
+  this->before_first_iteration();
+
+  for (size_type cur_step_level = 0;
+       (cur_step_level < num_step_levels_) && (iter < this->max_num_iters_) && !this->stop_requested();
+       ++iter)
+  {
+    this->begin_of_iteration(cur_param_vec_);
+
+    // populate the candidates
+
+    size_type cand_idx = 0;
+
+    cands[cand_idx] = cur_param_vec_;
+    cand_levels[cand_idx] = 0;
+    ++cand_idx;
+
+    Scalar level_scale = 1;
+
+    for (size_type level = 0; level < num_pattern_search_levels_; ++level, level_scale *= 0.5)
+    {
+      for (size_type param_idx = 0; param_idx < tot_num_params; ++param_idx)
+      {
+        const Scalar s = level_scale * cur_steps[param_idx];
+
+        cands[cand_idx] = cur_param_vec_;
+        cands[cand_idx][param_idx] -= s;
+        cand_levels[cand_idx] = level;
+        ++cand_idx;
+
+        cands[cand_idx] = cur_param_vec_;
+        cands[cand_idx][param_idx] += s;
+        cand_levels[cand_idx] = level;
+        ++cand_idx;
+      }
+
+      if (pattern_search_diags_)
+      {
+        for (size_type i = 0; i < tot_num_params; ++i)
+        {
+          const Scalar s_i = level_scale * cur_steps[i];
+
+          for (size_type j = i + 1; j < tot_num_params; ++j)
+          {
+            const Scalar s_j = level_scale * cur_steps[j];
+
+            for (const Scalar sign_i : { Scalar(-1), Scalar(1) })
+            {
+              for (const Scalar sign_j : { Scalar(-1), Scalar(1) })
+              {
+                cands[cand_idx] = cur_param_vec_;
+                cands[cand_idx][i] += sign_i * s_i;
+                cands[cand_idx][j] += sign_j * s_j;
+                cand_levels[cand_idx] = level;
+                ++cand_idx;
+              }
+            }
+          }
+        }
+      }
+    }
+
+    if (pattern_search_momentum_)
+    {
+      // repeat the previous move, this is a duplicate of the current estimate
+      // when no move has been made yet
+      cands[cand_idx] = cur_param_vec_;
+      for (size_type param_idx = 0; param_idx < tot_num_params; ++param_idx)
+      {
+        cands[cand_idx][param_idx] += cur_param_vec_[param_idx] - prev_param_vec[param_idx];
+      }
+      cand_levels[cand_idx] = 0;
+      ++cand_idx;
+    }
+
+    xregASSERT(cand_idx == num_cands);
+
+    // split the candidates into the parameters of each volume
+    for (size_type vol_idx = 0; vol_idx < nv; ++vol_idx)
+    {
+      const size_type param_off = vol_idx * num_params_per_xform;
+
+      for (cand_idx = 0; cand_idx < num_cands; ++cand_idx)
+      {
+        cur_params_to_eval[vol_idx][cand_idx].assign(cands[cand_idx].begin() + param_off,
+                                                     cands[cand_idx].begin() + param_off + num_params_per_xform);
+      }
+    }
+
+    // compute DRRs and similarity metrics for every candidate in one batch
+    this->obj_fn(cur_params_to_eval, &tmp_sim_vals);
+
+    // similarity value for the current guess
+    cur_param_sim_val_ = tmp_sim_vals[0];
+
+    const size_type best_cand_idx = std::distance(tmp_sim_vals.begin(),
+                                        std::min_element(tmp_sim_vals.begin() + 1, tmp_sim_vals.end()));
+
+    // we are minimizing, so the best candidate must decrease the similarity value
+    if ((cur_param_sim_val_ - tmp_sim_vals[best_cand_idx]) > 1.0e-6)
+    {
+      prev_param_vec = cur_param_vec_;
+      cur_param_vec_ = cands[best_cand_idx];
+
+      // continue from the step level that found the improvement
+      const size_type best_level = cand_levels[best_cand_idx];
+
+      for (size_type l = 0; l < best_level; ++l)
+      {
+        for (size_type param_idx = 0; param_idx < tot_num_params; ++param_idx)
+        {
+          cur_steps[param_idx] *= 0.5;
+        }
+      }
+
+      cur_step_level += best_level;
+    }
+    else
+    {
+      // no improvement at any of the levels, start past the last level
+      // evaluated and reset the momentum
+      for (size_type l = 0; l < num_pattern_search_levels_; ++l)
+      {
+        for (size_type param_idx = 0; param_idx < tot_num_params; ++param_idx)
+        {
+          cur_steps[param_idx] *= 0.5;
+        }
+      }
+
+      cur_step_level += num_pattern_search_levels_;
+
+      prev_param_vec = cur_param_vec_;
+    }
+
+    this->end_of_iteration();
+  }
+
+  this->after_last_iteration();
+
+  update_regi_xforms_from_cur_params();
+}
+
 xreg::size_type xreg::Intensity2D3DRegiHillClimb::max_num_projs_per_view_per_iter() const
 {
-  return (this->opt_vars_->num_params() * this->num_vols() * 2) + 1;
+  const size_type tot_num_params = this->opt_vars_->num_params() * this->num_vols();
+
+  if (use_pattern_search_)
+  {
+    // the current estimate, the axis (and diagonal) neighbors at each level
+    // and the momentum candidate
+    const size_type num_cands_per_level = (tot_num_params * 2) +
+                        (pattern_search_diags_ ? (2 * tot_num_params * (tot_num_params - 1)) : 0);
+
+    return 1 + (num_pattern_search_levels_ * num_cands_per_level) +
+                  (pattern_search_momentum_ ? 1 : 0);
+  }
+
+  return (tot_num_params * 2) + 1;
 }
 
 void xreg::Intensity2D3DRegiHillClimb::init_opt()
@@ -223,7 +460,7 @@ void xreg::Intensity2D3DRegiHillClimb::debug_write_remapped_drrs()
     Path dst_path = this->debug_output_dir_path_;
     dst_path += fmt::format("drr_remap_{:03d}_{:03d}.png", this->num_obj_fn_evals_, view_idx);
 
-    WriteITKImageRemap8bpp(this->ray_caster_->proj(view_idx * this->num_projs_per_view_).GetPointer(),
+    WriteITKImageRemap8bpp(this->ray_caster_->make_proj_view(view_idx * this->num_projs_per_view_).GetPointer(),
                            dst_path.string());
   }
 }
@@ -237,7 +474,7 @@ void xreg::Intensity2D3DRegiHillClimb::debug_write_raw_drrs()
     Path dst_path = this->debug_output_dir_path_;
     dst_path += fmt::format("drr_raw_{:03d}_{:03d}.nii.gz", this->num_obj_fn_evals_, view_idx);
 
-    WriteITKImageToDisk(this->ray_caster_->proj(view_idx * this->num_projs_per_view_).GetPointer(),
+    WriteITKImageToDisk(this->ray_caster_->make_proj_view(view_idx * this->num_projs_per_view_).GetPointer(),
                         dst_path.string());
   }
 }
@@ -248,7 +485,7 @@ void xreg::Intensity2D3DRegiHillClimb::debug_write_fixed_img_edge_overlays()
 
   for (size_type view_idx = 0; view_idx < num_sim_metrics; ++view_idx)
   {
-    auto cur_proj = this->ray_caster_->proj(view_idx * this->num_projs_per_view_);
+    auto cur_proj = this->ray_caster_->make_proj_view(view_idx * this->num_projs_per_view_);
 
     const auto img_2d_size = cur_proj->GetLargestPossibleRegion().GetSize();
 
@@ -44,6 +44,35 @@ public:
 
   void set_init_steps(const ScalarList& init_steps);
 
+  /// \brief Use an opportunistic, fully batched, pattern search instead of
+  ///        the coordinate-wise hill climbing update.
+  ///
+  /// Each iteration evaluates every candidate in a single objective function
+  /// call: the 2N axis neighbors (N is the total number of parameters) at
+  /// several step levels, optionally the diagonal neighbors of each pair of
+  /// parameters and a momentum candidate. The current estimate moves to the
+  /// best candidate that improves the similarity value. Defaults to false.
+  void set_use_pattern_search(const bool use_pattern_search);
+
+  /// \brief The number of step levels evaluated speculatively by each
+  ///        pattern search iteration.
+  ///
+  /// Level l uses the current steps scaled by 0.5^l. When the best candidate
+  /// was found at level l, the current steps are scaled to that level; when
+  /// no candidate improves, the steps are scaled past the last level
+  /// evaluated. Defaults to 1.
+  void set_num_pattern_search_levels(const size_type num_levels);
+
+  /// \brief Include the 4 diagonal neighbors of every pair of parameters in
+  ///        the pattern search candidates, at each step level.
+  ///
+  /// This adds 2N(N-1) candidates per level. Defaults to false.
+  void set_pattern_search_diagonals(const bool use_diags);
+
+  /// \brief Include a momentum candidate that repeats the previous pattern
+  ///        search move. Defaults to true.
+  void set_pattern_search_momentum(const bool use_momentum);
+
   /// \brief Performs the registration; blocks until completion.
   void run() override;
 
@@ -82,10 +111,22 @@ protected:
 
 private:
 
+  void run_pattern_search();
+
+  void update_regi_xforms_from_cur_params();
+
   ScalarList init_steps_;
 
   size_type num_step_levels_;
 
+  bool use_pattern_search_ = false;
+
+  size_type num_pattern_search_levels_ = 1;
+
+  bool pattern_search_diags_ = false;
+
+  bool pattern_search_momentum_ = true;
+
   ScalarList cur_param_vec_;
 
   Scalar cur_param_sim_val_;
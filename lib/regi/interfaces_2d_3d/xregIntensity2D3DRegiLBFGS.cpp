@@ -0,0 +1,171 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregIntensity2D3DRegiLBFGS.h"
+
+#include "xregExceptionUtils.h"
+#include "xregSE3OptVars.h"
+#include "xregRayCastLineIntGradCPU.h"
+#include "xregImgSimMetric2D.h"
+
+xreg::Intensity2D3DRegiLBFGS::Intensity2D3DRegiLBFGS()
+  : Intensity2D3DRegiNLOptInterface(nlopt::LD_LBFGS, false, false)
+{ }
+
+xreg::CoordScalar xreg::Intensity2D3DRegiLBFGS::xform_deriv_step() const
+{
+  return xform_deriv_step_;
+}
+
+void xreg::Intensity2D3DRegiLBFGS::set_xform_deriv_step(const CoordScalar h)
+{
+  xregASSERT(h > 0);
+  xform_deriv_step_ = h;
+}
+
+void xreg::Intensity2D3DRegiLBFGS::set_nl_opt_max_num_fn_evals_for_max_iters(nlopt::opt* opt_obj)
+{
+  // each evaluation also computes the gradient, line searches may require
+  // more than one evaluation per iteration
+  opt_obj->set_maxeval(this->max_num_iters_);
+}
+
+void xreg::Intensity2D3DRegiLBFGS::obj_fn_with_grad(
+                                  const ListOfListsOfScalarLists& opt_vec_space_vals,
+                                  ScalarList* sim_vals, std::vector<double>* grad)
+{
+  if (this->num_vols() != 1)
+  {
+    xregThrow("L-BFGS registration only supports a single volume!");
+  }
+
+  if (this->num_projs_per_view_ != 1)
+  {
+    xregThrow("L-BFGS registration only supports one projection per view!");
+  }
+
+  if (this->src_and_obj_pose_opt_vars_)
+  {
+    xregThrow("L-BFGS registration does not support source/object pose opt. vars!");
+  }
+
+  if (this->penalty_fn_ && this->include_penalty_in_obj_fn_)
+  {
+    xregThrow("L-BFGS registration does not support penalty functions in the objective!");
+  }
+
+  auto* ray_caster = dynamic_cast<RayCasterLineIntGradCPU*>(this->ray_caster_.get());
+  if (!ray_caster)
+  {
+    xregThrow("L-BFGS registration requires a RayCasterLineIntGradCPU ray caster!");
+  }
+
+  const size_type num_views = this->sim_metrics_.size();
+
+  std::vector<ImgSimMetric2DMovImgGradInterface*> sim_grad_ifaces(num_views);
+
+  for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
+  {
+    sim_grad_ifaces[view_idx] = dynamic_cast<ImgSimMetric2DMovImgGradInterface*>(
+                                              this->sim_metrics_[view_idx].get());
+    if (!sim_grad_ifaces[view_idx])
+    {
+      xregThrow("L-BFGS registration requires similarity metrics implementing "
+                "ImgSimMetric2DMovImgGradInterface (view: %lu)!", view_idx);
+    }
+  }
+
+  const SE3OptVars& opt_vars = *this->opt_vars_;
+
+  const size_type np = opt_vars.num_params();
+
+  xregASSERT(grad->size() == np);
+
+  PtN x = Eigen::Map<PtN>(const_cast<Scalar*>(&opt_vec_space_vals[0][0][0]), np);
+
+  // Derivatives of the transformation passed to the ray caster, with respect
+  // to each parameter, by central differences of the full chain of transforms
+  // (e.g. including the intermediate frames)
+  ListOfFrameTransformLists fd_xforms(1, FrameTransformList(2 * np));
+
+  const Scalar h = xform_deriv_step_;
+
+  for (size_type k = 0; k < np; ++k)
+  {
+    PtN x_off = x;
+    
+    x_off(k) = x(k) + h;
+    fd_xforms[0][2 * k] = opt_vars(x_off);
+    
+    x_off(k) = x(k) - h;
+    fd_xforms[0][(2 * k) + 1] = opt_vars(x_off);
+  }
+  
+  const auto fd_inter_xforms = this->apply_inter_transforms_for_obj_fn(fd_xforms);
+
+  Mat4x4List xform_derivs(np);
+
+  for (size_type k = 0; k < np; ++k)
+  {
+    xform_derivs[k] = (fd_inter_xforms[0][2 * k].matrix() -
+                          fd_inter_xforms[0][(2 * k) + 1].matrix()) / (2 * h);
+  }
+
+  // every view uses the same transformation
+  ray_caster->set_xform_derivs(std::vector<Mat4x4List>(num_views, xform_derivs));
+
+  this->obj_fn(opt_vec_space_vals, sim_vals);
+
+  // The objective is the mean of the similarity values of each view
+  const double view_coeff = 1.0 / num_views;
+
+  std::fill(grad->begin(), grad->end(), 0.0);
+
+  for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
+  {
+    const auto& cam = ray_caster->camera_model(view_idx);
+
+    const size_type num_pix = cam.num_det_rows * cam.num_det_cols;
+
+    tmp_sim_grad_.resize(num_pix);
+
+    sim_grad_ifaces[view_idx]->compute_sim_val_grad_wrt_mov_img(0, &tmp_sim_grad_[0]);
+
+    for (size_type k = 0; k < np; ++k)
+    {
+      const RayCaster::PixelScalar2D* d_img = ray_caster->deriv_img_buf(view_idx, k);
+
+      double g = 0;
+
+      for (size_type pix_idx = 0; pix_idx < num_pix; ++pix_idx)
+      {
+        g += static_cast<double>(tmp_sim_grad_[pix_idx]) * d_img[pix_idx];
+      }
+
+      (*grad)[k] += view_coeff * g;
+    }
+  }
+
+  ray_caster->clear_xform_derivs();
+}
@@ -0,0 +1,76 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGINTENSITY2D3DREGILBFGS_H_
+#define XREGINTENSITY2D3DREGILBFGS_H_
+
+#include "xregIntensity2D3DRegiNLOptInterface.h"
+#include "xregImgSimMetric2DMovImgGradInterface.h"
+
+namespace xreg
+{
+
+/// \brief 2D/3D Intensity-Based Registration object using the L-BFGS
+///        optimization method with analytic gradients.
+///
+/// The gradient of the objective function is computed from the derivatives of
+/// the DRR pixels with respect to the pose parameters (see RayCasterLineIntGradCPU)
+/// and the derivatives of the similarity metrics with respect to the DRR pixels
+/// (see ImgSimMetric2DMovImgGradInterface). The derivatives of the pose
+/// transformations with respect to the optimization parameters are estimated by
+/// central differences, since this only requires evaluations of the
+/// optimization variables mapping (and no additional DRRs).
+///
+/// Current limitations: a single volume, a single projection per view, no
+/// penalty function included in the objective and no camera source/object
+/// pose optimization variables.
+///
+/// Finite difference gradients (see set_use_fd_grad()) may be used instead,
+/// which do not have these limitations or require a specific ray caster.
+class Intensity2D3DRegiLBFGS : public Intensity2D3DRegiNLOptInterface
+{
+public:
+  Intensity2D3DRegiLBFGS();
+
+  /// \brief The step size used to estimate the derivatives of the pose
+  ///        transformations by central differences.
+  CoordScalar xform_deriv_step() const;
+
+  void set_xform_deriv_step(const CoordScalar h);
+
+protected:
+  void set_nl_opt_max_num_fn_evals_for_max_iters(nlopt::opt* opt_obj) override;
+
+  void obj_fn_with_grad(const ListOfListsOfScalarLists& opt_vec_space_vals,
+                        ScalarList* sim_vals, std::vector<double>* grad) override;
+
+private:
+  CoordScalar xform_deriv_step_ = 1.0e-3;
+
+  std::vector<ImgSimMetric2DMovImgGradInterface::GradScalar> tmp_sim_grad_;
+};
+
+}  // xreg
+
+#endif
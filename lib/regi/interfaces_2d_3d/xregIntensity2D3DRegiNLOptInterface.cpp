@@ -30,6 +30,7 @@
 #include "xregSE3OptVars.h"
 #include "xregAssert.h"
 #include "xregExceptionUtils.h"
+#include "xregTBBUtils.h"
   
 xreg::Intensity2D3DRegiNLOptInterface::Intensity2D3DRegiNLOptInterface(
                                 const nlopt::algorithm nlopt_alg_id,
@@ -74,14 +75,45 @@ void xreg::Intensity2D3DRegiNLOptInterface::reset_stochastic_pop_size()
   stoch_pop_size_ = 0;
 }
 
+void xreg::Intensity2D3DRegiNLOptInterface::set_use_fd_grad(const bool use_fd_grad)
+{
+  use_fd_grad_ = use_fd_grad;
+}
+
+bool xreg::Intensity2D3DRegiNLOptInterface::use_fd_grad() const
+{
+  return use_fd_grad_;
+}
+
+void xreg::Intensity2D3DRegiNLOptInterface::set_fd_grad_steps(const ScalarList& fd_grad_steps)
+{
+  fd_grad_steps_ = fd_grad_steps;
+}
+
+const xreg::Intensity2D3DRegiNLOptInterface::ScalarList&
+xreg::Intensity2D3DRegiNLOptInterface::fd_grad_steps() const
+{
+  return fd_grad_steps_;
+}
+
+void xreg::Intensity2D3DRegiNLOptInterface::setup()
+{
+  this->num_projs_per_view_ = max_num_projs_per_view_per_iter();
+
+  Intensity2D3DRegi::setup();
+}
+
 xreg::size_type
 xreg::Intensity2D3DRegiNLOptInterface::max_num_projs_per_view_per_iter() const
 {
-  return this->num_projs_per_view_;
+  // the current estimate and +/- offsets in each dim
+  return use_fd_grad_ ? ((this->opt_vars_->num_params() * this->num_vols() * 2) + 1) : 1;
 }
 
 void xreg::Intensity2D3DRegiNLOptInterface::run()
 {
+  ParallelExecContextScope exec_scope(this->exec_ctx_.get());
+
   const auto& opt_vars = *this->opt_vars_;
 
   const size_type nv = this->num_vols();
@@ -93,9 +125,14 @@ void xreg::Intensity2D3DRegiNLOptInterface::run()
   // BOBYQA requires more than one parameter ... TODO should this be here?
   xregASSERT(tot_num_params > 1);
 
-  opt_vec_space_vals_.assign(nv, ListOfScalarLists(1, ScalarList(num_params_per_xform, 0)));
+  xregASSERT(this->num_projs_per_view_ == max_num_projs_per_view_per_iter());
+
+  opt_vec_space_vals_.assign(nv, ListOfScalarLists(this->num_projs_per_view_,
+                                                   ScalarList(num_params_per_xform, 0)));
+
+  s_.resize(this->num_projs_per_view_);
 
-  s_.resize(1);
+  xregASSERT(fd_grad_steps_.empty() || (fd_grad_steps_.size() == tot_num_params));
 
   nlopt::opt opt_obj(nlopt_alg_id_, tot_num_params);
 
@@ -156,6 +193,8 @@ void xreg::Intensity2D3DRegiNLOptInterface::run()
 
   this->before_first_iteration();
 
+  cur_opt_obj_ = &opt_obj;
+
   try
   {
     nlopt::result opt_result = opt_obj.optimize(regi_x, regi_sim_val);
@@ -167,6 +206,13 @@ void xreg::Intensity2D3DRegiNLOptInterface::run()
   }
   catch (const nlopt::roundoff_limited&)
   { }
+  catch (const nlopt::forced_stop&)
+  {
+    // a stop was requested, NLOpt provides the best estimate found so far
+    xregASSERT(this->stop_requested());
+  }
+
+  cur_opt_obj_ = nullptr;
 
   this->after_last_iteration();
 
@@ -252,13 +298,57 @@ void xreg::Intensity2D3DRegiNLOptInterface::set_nl_opt_max_num_fn_evals_for_max_
   xregThrow("max num iters unsupported by default for NL opt interface!");
 }
 
+void xreg::Intensity2D3DRegiNLOptInterface::obj_fn_with_grad(
+                                          const ListOfListsOfScalarLists& /*opt_vec_space_vals*/,
+                                          ScalarList* /*sim_vals*/, std::vector<double>* /*grad*/)
+{
+  xregThrow("objective function gradients unsupported by default for NL opt interface! "
+            "(finite difference gradients may be enabled with set_use_fd_grad())");
+}
+
+void xreg::Intensity2D3DRegiNLOptInterface::fd_grad_obj_fn(std::vector<double>* grad)
+{
+  const size_type nv = this->num_vols();
+
+  const size_type num_params_per_xform = this->opt_vars_->num_params();
+
+  // projection 0 is the current estimate, projections 1 + 2*i and 2 + 2*i
+  // are the +/- perturbations of the ith parameter
+  for (size_type vol_idx = 0; vol_idx < nv; ++vol_idx)
+  {
+    for (size_type param_idx = 0; param_idx < num_params_per_xform; ++param_idx)
+    {
+      const size_type i = (vol_idx * num_params_per_xform) + param_idx;
+
+      const Scalar h = fd_grad_steps_.empty() ? Scalar(1.0e-3) : fd_grad_steps_[i];
+
+      opt_vec_space_vals_[vol_idx][1 + (2 * i)][param_idx] += h;
+      opt_vec_space_vals_[vol_idx][2 + (2 * i)][param_idx] -= h;
+    }
+  }
+
+  this->obj_fn(opt_vec_space_vals_, &s_);
+
+  if (grad)
+  {
+    const size_type tot_num_params = nv * num_params_per_xform;
+
+    xregASSERT(grad->size() == tot_num_params);
+
+    for (size_type i = 0; i < tot_num_params; ++i)
+    {
+      const double h = fd_grad_steps_.empty() ? 1.0e-3 : fd_grad_steps_[i];
+
+      (*grad)[i] = (static_cast<double>(s_[1 + (2 * i)]) - s_[2 + (2 * i)]) / (2 * h);
+    }
+  }
+}
+
 double xreg::Intensity2D3DRegiNLOptInterface::NLOptObjFn(
                          const std::vector<double>& x,
-                         std::vector<double>& XREG_NO_ASSERTS_UNUSED(grad),
+                         std::vector<double>& grad,
                          void* regi_obj_void)
 {
-  xregASSERT(grad.empty());
-
   auto& regi = *static_cast<Intensity2D3DRegiNLOptInterface*>(regi_obj_void);
 
   regi.begin_of_iteration(ScalarList(x.begin(), x.end()));
@@ -273,16 +363,35 @@ double xreg::Intensity2D3DRegiNLOptInterface::NLOptObjFn(
   for (size_type v = 0; v < nv; ++v, start_x_idx += num_params_per_xform)
   {
     tmp_vol_xform.assign(x.begin() + start_x_idx, x.begin() + start_x_idx + num_params_per_xform);
-    regi.opt_vec_space_vals_[v].assign(1, tmp_vol_xform);
+    regi.opt_vec_space_vals_[v].assign(regi.num_projs_per_view_, tmp_vol_xform);
   }
   // regi.opt_vec_space_vals[i][0][k] refers to the kth parameter of the ith volume's transform.
 
   regi.s_[0] = 0;
-  regi.obj_fn(regi.opt_vec_space_vals_, &regi.s_);
+
+  if (regi.use_fd_grad_)
+  {
+    // the perturbations are always evaluated, since they are part of the
+    // same batch of projections as the current estimate
+    regi.fd_grad_obj_fn(grad.empty() ? nullptr : &grad);
+  }
+  else if (grad.empty())
+  {
+    regi.obj_fn(regi.opt_vec_space_vals_, &regi.s_);
+  }
+  else
+  {
+    regi.obj_fn_with_grad(regi.opt_vec_space_vals_, &regi.s_, &grad);
+  }
 
   // With NLOpt this is the best we can do for end of iteration
   regi.end_of_iteration();
 
+  if (regi.stop_requested())
+  {
+    regi.cur_opt_obj_->force_stop();
+  }
+
   return regi.s_[0];
 }
 
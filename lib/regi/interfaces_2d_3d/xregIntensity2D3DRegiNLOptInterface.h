@@ -75,6 +75,28 @@ public:
   /// The NLopt implementation will choose the size.
   void reset_stochastic_pop_size();
 
+  /// \brief Enables, or disables, the estimation of the objective function
+  ///        gradient by central finite differences.
+  ///
+  /// This allows the use of gradient-based NLOpt algorithms with any ray
+  /// caster and similarity metric. The 2*N perturbations of the N parameters
+  /// are evaluated in the same batch of projections as the current estimate,
+  /// e.g. each objective function evaluation requires a single ray casting
+  /// call of 2*N+1 projections per view. This must be set before setup().
+  void set_use_fd_grad(const bool use_fd_grad);
+
+  bool use_fd_grad() const;
+
+  /// \brief Sets the finite difference step sizes for each parameter.
+  ///
+  /// An empty list (the default) uses a step size of 1.0e-3 for every
+  /// parameter.
+  void set_fd_grad_steps(const ScalarList& fd_grad_steps);
+
+  const ScalarList& fd_grad_steps() const;
+
+  void setup() override;
+
   size_type max_num_projs_per_view_per_iter() const override;
 
   /// \brief Performs the registration; blocks until completion.
@@ -93,8 +115,25 @@ protected:
 
   virtual void set_nl_opt_max_num_fn_evals_for_max_iters(nlopt::opt* opt_obj);
 
+  /// \brief Computes the objective function and its gradient with respect to
+  ///        the optimization parameters, used by gradient-based NLOpt methods.
+  ///
+  /// opt_vec_space_vals and sim_vals follow the conventions of obj_fn(), grad
+  /// has an entry for each parameter of each volume. The default implementation
+  /// throws, since gradients are not available in general. This is not called
+  /// when finite difference gradients are enabled.
+  virtual void obj_fn_with_grad(const ListOfListsOfScalarLists& opt_vec_space_vals,
+                                ScalarList* sim_vals, std::vector<double>* grad);
+
 private:
 
+  /// \brief Computes the objective function at the current estimate and,
+  ///        when grad is not null, its central finite difference gradient.
+  ///
+  /// opt_vec_space_vals_ must store the current estimate at every projection,
+  /// only the first projection is left unperturbed.
+  void fd_grad_obj_fn(std::vector<double>* grad);
+
   /// \brief C-style interface function implementing the objective function
   ///       passed to the NLOpt implementation.
   static double NLOptObjFn(const std::vector<double>& x,
@@ -118,10 +157,18 @@ private:
 
   size_type stoch_pop_size_;
 
+  bool use_fd_grad_ = false;
+
+  ScalarList fd_grad_steps_;
+
   ListOfListsOfScalarLists opt_vec_space_vals_;
 
   ScalarList s_;
 
+  /// \brief The NLOpt object used by the current call to run(), this allows
+  ///        a stop request to be forwarded to the optimizer.
+  nlopt::opt* cur_opt_obj_ = nullptr;
+
   Scalar obj_fn_tol_;
   Scalar x_tol_;
 };
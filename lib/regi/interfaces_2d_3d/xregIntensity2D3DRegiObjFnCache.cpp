@@ -0,0 +1,220 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregIntensity2D3DRegiObjFnCache.h"
+
+#include <cmath>
+
+#include "xregAssert.h"
+#include "xregHashUtils.h"
+#include "xregHDF5.h"
+
+xreg::Intensity2D3DRegiObjFnCache::Intensity2D3DRegiObjFnCache(const Scalar quant_step)
+  : quant_step_(quant_step)
+{
+  xregASSERT(quant_step_ > 0);
+}
+
+xreg::Intensity2D3DRegiObjFnCache::Scalar
+xreg::Intensity2D3DRegiObjFnCache::quant_step() const
+{
+  return quant_step_;
+}
+
+xreg::Intensity2D3DRegiObjFnCache::Key
+xreg::Intensity2D3DRegiObjFnCache::make_key(const std::uint64_t config_key,
+                                            const std::vector<std::vector<CoordScalarList>>& params,
+                                            const size_type cand_idx) const
+{
+  const size_type nv = params.size();
+
+  size_type num_params = 0;
+  for (size_type vol_idx = 0; vol_idx < nv; ++vol_idx)
+  {
+    num_params += params[vol_idx][cand_idx].size();
+  }
+
+  Key key;
+  key.reserve(1 + num_params);
+
+  key.push_back(static_cast<std::int64_t>(config_key));
+
+  for (size_type vol_idx = 0; vol_idx < nv; ++vol_idx)
+  {
+    for (const auto& p : params[vol_idx][cand_idx])
+    {
+      key.push_back(std::llround(p / quant_step_));
+    }
+  }
+
+  return key;
+}
+
+bool xreg::Intensity2D3DRegiObjFnCache::find(const Key& key, Scalar* val)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  auto it = vals_.find(key);
+
+  const bool found = it != vals_.end();
+
+  if (found)
+  {
+    *val = it->second;
+    ++num_hits_;
+  }
+  else
+  {
+    ++num_misses_;
+  }
+
+  return found;
+}
+
+void xreg::Intensity2D3DRegiObjFnCache::insert(const Key& key, const Scalar val)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  vals_[key] = val;
+}
+
+xreg::size_type xreg::Intensity2D3DRegiObjFnCache::size() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  return vals_.size();
+}
+
+void xreg::Intensity2D3DRegiObjFnCache::clear()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  vals_.clear();
+}
+
+xreg::size_type xreg::Intensity2D3DRegiObjFnCache::num_hits() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  return num_hits_;
+}
+
+xreg::size_type xreg::Intensity2D3DRegiObjFnCache::num_misses() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  return num_misses_;
+}
+
+xreg::Intensity2D3DRegiObjFnCache::Scalar
+xreg::Intensity2D3DRegiObjFnCache::hit_rate() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  const size_type num_lookups = num_hits_ + num_misses_;
+
+  return num_lookups ? (static_cast<Scalar>(num_hits_) / num_lookups) : Scalar(0);
+}
+
+void xreg::Intensity2D3DRegiObjFnCache::reset_stats()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  num_hits_   = 0;
+  num_misses_ = 0;
+}
+
+void xreg::Intensity2D3DRegiObjFnCache::read(const std::string& path)
+{
+  H5::H5File h5(path, H5F_ACC_RDONLY);
+
+  if (GetStringAttr("xreg-type", h5) != "regi-obj-fn-cache")
+  {
+    xregThrow("not an objective function cache: %s", path.c_str());
+  }
+
+  if (ReadSingleScalarH5CoordScalar("quant-step", h5) != quant_step_)
+  {
+    xregThrow("objective function cache has a different quantization step: %s", path.c_str());
+  }
+
+  const auto key_lens = ReadVectorH5ULong("key-lens", h5);
+  const auto keys     = ReadVectorH5LongLong("keys", h5);
+  const auto vals     = ReadVectorH5CoordScalar("vals", h5);
+
+  const size_type num_entries = key_lens.size();
+  xregASSERT(vals.size() == num_entries);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  size_type key_off = 0;
+
+  for (size_type i = 0; i < num_entries; ++i)
+  {
+    xregASSERT((key_off + key_lens[i]) <= keys.size());
+
+    vals_[Key(keys.begin() + key_off, keys.begin() + key_off + key_lens[i])] = vals[i];
+
+    key_off += key_lens[i];
+  }
+}
+
+void xreg::Intensity2D3DRegiObjFnCache::write(const std::string& path) const
+{
+  std::vector<unsigned long> key_lens;
+  std::vector<long long>     keys;
+  CoordScalarList            vals;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    key_lens.reserve(vals_.size());
+    vals.reserve(vals_.size());
+
+    for (const auto& kv : vals_)
+    {
+      key_lens.push_back(kv.first.size());
+      keys.insert(keys.end(), kv.first.begin(), kv.first.end());
+      vals.push_back(kv.second);
+    }
+  }
+
+  H5::H5File h5(path, H5F_ACC_TRUNC);
+
+  SetStringAttr("xreg-type", "regi-obj-fn-cache", &h5);
+
+  WriteSingleScalarH5("quant-step", quant_step_, &h5);
+
+  WriteVectorH5("key-lens", key_lens, &h5);
+  WriteVectorH5("keys", keys, &h5);
+  WriteVectorH5("vals", vals, &h5);
+
+  h5.flush(H5F_SCOPE_GLOBAL);
+  h5.close();
+}
+
+std::size_t xreg::Intensity2D3DRegiObjFnCache::KeyHash::operator()(const Key& k) const
+{
+  return static_cast<std::size_t>(HashBytes64(k.data(), sizeof(std::int64_t) * k.size()));
+}
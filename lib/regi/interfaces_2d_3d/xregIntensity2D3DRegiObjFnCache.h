@@ -0,0 +1,124 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGINTENSITY2D3DREGIOBJFNCACHE_H_
+#define XREGINTENSITY2D3DREGIOBJFNCACHE_H_
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+#include "xregCommon.h"
+
+namespace xreg
+{
+
+/// \brief Cache of 2D/3D registration objective function values, keyed by
+///        quantized pose parameters.
+///
+/// Derivative-free optimizers frequently evaluate identical, or nearly
+/// identical, poses (e.g. restarts and simplex re-evaluations). An
+/// Intensity2D3DRegi object with a cache only ray casts the candidates that
+/// are not already stored (see Intensity2D3DRegi::set_obj_fn_cache()).
+/// Each key is formed from a configuration key, which identifies everything
+/// other than the pose parameters that the objective value depends on (e.g.
+/// the level, similarity metric and initial pose), and the pose parameters
+/// rounded to a multiple of the quantization step. The stored values include
+/// any penalty/regularization terms.
+///
+/// A cache may be shared by registrations running concurrently; every
+/// operation is synchronized.
+class Intensity2D3DRegiObjFnCache
+{
+public:
+  using Scalar = CoordScalar;
+
+  using Key = std::vector<std::int64_t>;
+
+  /// \brief Constructor; the quantization step applies to every pose
+  ///        parameter.
+  explicit Intensity2D3DRegiObjFnCache(const Scalar quant_step = 1.0e-6);
+
+  Scalar quant_step() const;
+
+  /// \brief Creates the key of the pose parameters of every volume.
+  ///
+  /// params[i][j] is the jth parameter of the ith volume's pose for candidate
+  /// cand_idx, i.e. the layout of the parameters passed to
+  /// Intensity2D3DRegi::obj_fn().
+  Key make_key(const std::uint64_t config_key,
+               const std::vector<std::vector<CoordScalarList>>& params,
+               const size_type cand_idx) const;
+
+  /// \brief Retrieves a cached value; returns false when not stored.
+  ///
+  /// Hits and misses are counted.
+  bool find(const Key& key, Scalar* val);
+
+  void insert(const Key& key, const Scalar val);
+
+  size_type size() const;
+
+  void clear();
+
+  size_type num_hits() const;
+
+  size_type num_misses() const;
+
+  /// \brief The fraction of lookups which were hits, zero when no lookups
+  ///        have been performed.
+  Scalar hit_rate() const;
+
+  void reset_stats();
+
+  /// \brief Adds the entries stored in an HDF5 file, replacing any with the
+  ///        same keys.
+  ///
+  /// The file must have been written with the same quantization step.
+  void read(const std::string& path);
+
+  /// \brief Writes every entry to an HDF5 file, so that repeated runs on the
+  ///        same case may re-use the values.
+  void write(const std::string& path) const;
+
+private:
+  struct KeyHash
+  {
+    std::size_t operator()(const Key& k) const;
+  };
+
+  Scalar quant_step_;
+
+  std::unordered_map<Key,Scalar,KeyHash> vals_;
+
+  size_type num_hits_   = 0;
+  size_type num_misses_ = 0;
+
+  mutable std::mutex mutex_;
+};
+
+}  // xreg
+
+#endif
+
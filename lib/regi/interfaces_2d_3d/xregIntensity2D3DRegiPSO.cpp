@@ -28,11 +28,14 @@
 
 #include "xregSE3OptVars.h"
 #include "xregIntensity2D3DRegiDebug.h"
+#include "xregTBBUtils.h"
 
 xreg::Intensity2D3DRegiPSO::Intensity2D3DRegiPSO()
 {
   // number of particles default
   this->num_projs_per_view_ = 100;
+
+  this->set_pipeline_pop_obj_fn(true);
   
   pso_.regi_ = this;
 }
@@ -60,6 +63,8 @@ void xreg::Intensity2D3DRegiPSO::set_box_contraint(const ScalarList& bounds)
 
 void xreg::Intensity2D3DRegiPSO::run()
 {
+  ParallelExecContextScope exec_scope(this->exec_ctx_.get());
+
   const auto& opt_vars = *this->opt_vars_;
 
   const size_type nv = this->num_vols();
@@ -186,7 +191,7 @@ void xreg::Intensity2D3DRegiPSO::PSO::all_obj_fn(const VecList& params, ScalarLi
     }
   }
 
-  regi_->obj_fn(tmp_params, &obj_fn_vals);
+  regi_->pop_obj_fn(tmp_params, &obj_fn_vals);
 }
 
 void xreg::Intensity2D3DRegiPSO::PSO::start_iter()
@@ -225,6 +230,11 @@ void xreg::Intensity2D3DRegiPSO::PSO::end_iter()
   }
 }
 
+bool xreg::Intensity2D3DRegiPSO::PSO::stop_early()
+{
+  return regi_->stop_requested();
+}
+
 void xreg::Intensity2D3DRegiPSO::PSO::after_init_vals()
 {
   iter_ = 0;
@@ -78,6 +78,8 @@ private:
 
     void end_iter() override;
 
+    bool stop_early() override;
+
     void after_init_vals() override;
  
     static constexpr bool kSCALE_PHI_G = false;
@@ -0,0 +1,251 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregIntensity2D3DRegiParallelDIRECT.h"
+
+#include <numeric>
+
+#include <fmt/format.h>
+
+#include "xregSE3OptVars.h"
+#include "xregIntensity2D3DRegiDebug.h"
+
+xreg::Intensity2D3DRegiParallelDIRECT::Intensity2D3DRegiParallelDIRECT()
+{
+  this->num_projs_per_view_ = kDEFAULT_BATCH_SIZE;
+}
+
+xreg::size_type
+xreg::Intensity2D3DRegiParallelDIRECT::max_num_projs_per_view_per_iter() const
+{
+  return this->num_projs_per_view_;
+}
+
+bool xreg::Intensity2D3DRegiParallelDIRECT::supports_smaller_batches() const
+{
+  return true;
+}
+
+void xreg::Intensity2D3DRegiParallelDIRECT::set_batch_size(const size_type batch_size)
+{
+  xregASSERT(batch_size > 0);
+
+  this->num_projs_per_view_ = batch_size;
+}
+
+void xreg::Intensity2D3DRegiParallelDIRECT::set_max_num_iters(const size_type max_iters)
+{
+  direct_.max_num_its = max_iters;
+}
+
+void xreg::Intensity2D3DRegiParallelDIRECT::set_max_num_fn_evals(const size_type max_evals)
+{
+  direct_.max_num_fn_evals = max_evals;
+}
+
+void xreg::Intensity2D3DRegiParallelDIRECT::set_eps(const CoordScalar eps)
+{
+  direct_.eps = eps;
+}
+
+void xreg::Intensity2D3DRegiParallelDIRECT::set_bounds(const ScalarList& bounds)
+{
+  const size_type dim = bounds.size();
+
+  direct_.lower_bounds.resize(dim);
+  direct_.upper_bounds.resize(dim);
+
+  for (size_type i = 0; i < dim; ++i)
+  {
+    direct_.lower_bounds(i) = -bounds[i];
+    direct_.upper_bounds(i) =  bounds[i];
+  }
+}
+
+void xreg::Intensity2D3DRegiParallelDIRECT::run()
+{
+  ParallelExecContextScope exec_scope(this->exec_ctx_.get());
+
+  const auto& opt_vars = *this->opt_vars_;
+
+  const size_type nv = this->num_vols();
+
+  const size_type num_params_per_xform = opt_vars.num_params();
+
+  const size_type tot_num_params = nv * num_params_per_xform;
+
+  xregASSERT(static_cast<size_type>(direct_.lower_bounds.size()) == tot_num_params);
+
+  this->before_first_iteration();
+
+  const size_type batch_size = this->num_projs_per_view_;
+  
+  ListOfListsOfScalarLists tmp_params_per_iter(nv,
+             ListOfScalarLists(batch_size, ScalarList(num_params_per_xform, 0)));
+
+  ScalarList tmp_obj_fn_vals(batch_size);
+
+  IndexList subset_inds(batch_size);
+  std::iota(subset_inds.begin(), subset_inds.end(), size_type(0));
+
+  ListOfListsOfScalarLists subset_params;
+
+  direct_.cost_fn = [&] (const PtNList& pts_to_eval)
+  {
+    const size_type num_pts = pts_to_eval.size();
+
+    PtN sim_vals(num_pts);
+
+    for (size_type batch_start = 0; batch_start < num_pts; batch_start += batch_size)
+    {
+      const size_type cur_batch_size = std::min(batch_size, num_pts - batch_start);
+
+      for (size_type j = 0; j < cur_batch_size; ++j)
+      {
+        const PtN& x = pts_to_eval[batch_start + j];
+
+        size_type x_idx = 0;
+        for (size_type v = 0; v < nv; ++v)
+        {
+          for (size_type i = 0; i < num_params_per_xform; ++i, ++x_idx)
+          {
+            tmp_params_per_iter[v][j][i] = x[x_idx];
+          }
+        }
+      }
+
+      if (cur_batch_size == batch_size)
+      {
+        this->pop_obj_fn(tmp_params_per_iter, &tmp_obj_fn_vals);
+      }
+      else
+      {
+        // the final batch of a round, only compute the required projections
+        this->obj_fn_for_subset(tmp_params_per_iter, subset_inds, cur_batch_size,
+                                &subset_params, &tmp_obj_fn_vals);
+      }
+    
+      for (size_type j = 0; j < cur_batch_size; ++j)
+      {
+        sim_vals[batch_start + j] = tmp_obj_fn_vals[j];
+      }
+
+      tmp_obj_fn_vals.resize(batch_size);
+    }
+
+    return sim_vals;
+  };
+
+  direct_.begin_of_iter_callback = [&] (ParallelDIRECT*, const size_type)
+  {
+    const auto& cur_best_param = direct_.best_param();
+    
+    this->begin_of_iteration(ScalarList(&cur_best_param(0),
+                                        &cur_best_param(0) + cur_best_param.size()));
+  };
+  
+  double next_print_percent = print_status_inc_;
+
+  direct_.end_of_iter_callback = [&] (ParallelDIRECT*, const size_type iter)
+  {
+    this->end_of_iteration();
+    
+    const double cur_comp_percent = static_cast<double>(iter) / direct_.max_num_its;
+    if ((cur_comp_percent + 1.0e-6) > next_print_percent)
+    {
+      std::cout << fmt::format("  Par. DIRECT regi: {:4.2f}% ({} / {} iters, {} rects, {} divided)",
+                               100 * cur_comp_percent, iter, direct_.max_num_its,
+                               direct_.rects.size(), direct_.pot_opt_rect_inds.size())
+                << std::endl;
+      next_print_percent += this->print_status_inc_;
+    }
+  };
+
+  direct_.stop_callback = [&] (ParallelDIRECT*, const size_type)
+  {
+    return this->stop_requested();
+  };
+
+  direct_.run();
+
+  this->after_last_iteration();
+
+  const auto& regi_param = direct_.best_param();
+  
+  this->update_regi_xforms(this->opt_vec_to_frame_transforms(
+                            ScalarList(&regi_param(0), &regi_param(0) + tot_num_params)));
+}
+
+void xreg::Intensity2D3DRegiParallelDIRECT::set_print_status_inc(const double inc)
+{
+  print_status_inc_ = inc;
+}
+
+void xreg::Intensity2D3DRegiParallelDIRECT::init_opt()
+{ }
+
+void xreg::Intensity2D3DRegiParallelDIRECT::debug_write_comb_sim_score()
+{
+  if (this->write_combined_sim_scores_to_stream_)
+  {
+    this->dout() << fmt::format("{:+20.6f}\n", direct_.best_fn_val);
+  }
+
+  if (this->debug_save_iter_debug_info_ && this->num_obj_fn_evals_)
+  {
+    this->debug_info_->sims.push_back(direct_.best_fn_val);
+  }
+}
+
+void xreg::Intensity2D3DRegiParallelDIRECT::debug_write_opt_pose_vars()
+{
+  const size_type nv = this->num_vols();
+  const size_type num_params_per_xform = this->opt_vars_->num_params();
+
+  const PtN x = direct_.best_param();
+
+  if (this->write_opt_vars_to_stream_)
+  {
+    size_type x_idx = 0;
+
+    for (size_type v = 0; v < nv; ++v)
+    {
+      for (size_type i = 0; i < num_params_per_xform; ++i, ++x_idx)
+      {
+        this->dout() << fmt::format("{:+14.6f}, ", x(x_idx));
+      }
+      this->dout() << "| ";
+    }
+    this->dout() << '\n';
+  }
+  
+  if (this->debug_save_iter_debug_info_ && this->num_obj_fn_evals_)
+  {
+    for (size_type v = 0; v < nv; ++v)
+    {
+      this->debug_info_->iter_vars[v].push_back(
+          x.block(num_params_per_xform * v, 0, num_params_per_xform, 1));
+    }
+  }
+}
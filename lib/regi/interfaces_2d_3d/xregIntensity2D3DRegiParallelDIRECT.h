@@ -0,0 +1,96 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGINTENSITY2D3DREGIPARALLELDIRECT_H_
+#define XREGINTENSITY2D3DREGIPARALLELDIRECT_H_
+
+#include "xregParallelDIRECT.h"
+#include "xregIntensity2D3DRegi.h"
+
+namespace xreg
+{
+
+/// \brief 2D/3D Intensity-Based Registration object using a DIRECT optimizer
+///        which divides every potentially optimal rectangle of a round at once.
+///
+/// This is a constrained, global, optimization algorithm. Unlike
+/// Intensity2D3DRegiDIRECT, which evaluates one rectangle center at a time
+/// using NLOpt, the new centers of a round are computed in batches of DRRs.
+/// Rounds with more centers than the batch size are split into several
+/// batches and the final batch of a round is computed with fewer projections.
+class Intensity2D3DRegiParallelDIRECT : public Intensity2D3DRegi
+{
+public:
+
+  Intensity2D3DRegiParallelDIRECT();
+
+  size_type max_num_projs_per_view_per_iter() const override;
+
+  bool supports_smaller_batches() const override;
+
+  /// \brief Sets the maximum number of projections per view computed at once.
+  void set_batch_size(const size_type batch_size);
+
+  void set_max_num_iters(const size_type max_iters);
+
+  /// \brief Sets the maximum number of objective function evaluations;
+  ///        0 indicates no limit, which is the default.
+  void set_max_num_fn_evals(const size_type max_evals);
+
+  /// \brief Sets the epsilon parameter used to determine the potentially
+  ///        optimal rectangles.
+  void set_eps(const CoordScalar eps);
+
+  /// \brief Sets the box constraints
+  ///
+  /// The valid range in component k is [-bounds[k], bounds[k]]
+  void set_bounds(const ScalarList& bounds);
+
+  void run() override;
+  
+  void set_print_status_inc(const double inc);
+
+protected:
+  
+  void init_opt() override;
+  
+  void debug_write_comb_sim_score() override;
+
+  void debug_write_opt_pose_vars() override;
+
+private:
+
+  ParallelDIRECT direct_;
+  
+  // Interval to print the percentage of iterations completed.
+  // 0.1 --> print in approximately 10% intervals
+  // 1.1 --> do not print (e.g. print in 110% intervals)
+  double print_status_inc_ = 0.1;
+
+  enum { kDEFAULT_BATCH_SIZE = 100 };
+};
+
+}  // xreg
+
+#endif
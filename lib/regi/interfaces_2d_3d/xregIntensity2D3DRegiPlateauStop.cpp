@@ -0,0 +1,136 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregIntensity2D3DRegiPlateauStop.h"
+
+#include <fmt/format.h>
+
+#include "xregRigidUtils.h"
+
+void xreg::Intensity2D3DRegiPlateauStop::attach(Intensity2D3DRegi* regi)
+{
+  Intensity2D3DRegi::CallbackFn begin_fn = [this] (Intensity2D3DRegi*)
+  {
+    this->reset();
+  };
+
+  regi->add_begin_of_run_callback(begin_fn);
+
+  Intensity2D3DRegi::CallbackFn end_fn = [this] (Intensity2D3DRegi* r)
+  {
+    this->end_of_iter(r);
+  };
+
+  regi->add_end_of_iter_callback(end_fn);
+
+  attached_regi_ = regi;
+}
+
+const xreg::Intensity2D3DRegi* xreg::Intensity2D3DRegiPlateauStop::attached_regi() const
+{
+  return attached_regi_;
+}
+
+void xreg::Intensity2D3DRegiPlateauStop::reset()
+{
+  window_.clear();
+
+  best_obj_fn_val_ = std::numeric_limits<CoordScalar>::max();
+
+  num_iters_ = 0;
+}
+
+void xreg::Intensity2D3DRegiPlateauStop::end_of_iter(Intensity2D3DRegi* regi)
+{
+  const size_type window_len = criteria.window_len;
+
+  if (!regi->num_obj_fn_evals())
+  {
+    // no objective function has been evaluated yet
+    return;
+  }
+
+  ++num_iters_;
+
+  best_obj_fn_val_ = std::min(best_obj_fn_val_, regi->last_obj_fn_min_val());
+
+  const size_type nv = regi->num_vols();
+
+  IterState cur_state;
+  cur_state.best_obj_fn_val = best_obj_fn_val_;
+  cur_state.poses.resize(nv);
+
+  for (size_type vol_idx = 0; vol_idx < nv; ++vol_idx)
+  {
+    cur_state.poses[vol_idx] = regi->regi_xform(vol_idx);
+  }
+
+  window_.push_back(cur_state);
+
+  // the window includes the state prior to its iterations
+  while (window_.size() > (window_len + 1))
+  {
+    window_.pop_front();
+  }
+
+  if ((window_.size() < (window_len + 1)) || (num_iters_ < criteria.min_num_iters) || regi->stop_requested())
+  {
+    return;
+  }
+
+  const CoordScalar obj_fn_improvement = window_.front().best_obj_fn_val - best_obj_fn_val_;
+
+  if (obj_fn_improvement >= criteria.min_obj_fn_improvement)
+  {
+    return;
+  }
+
+  const CoordScalar max_rot_change_rad = criteria.max_rot_change_deg * kDEG2RAD;
+
+  CoordScalar max_rot_change   = 0;
+  CoordScalar max_trans_change = 0;
+
+  for (const auto& s : window_)
+  {
+    for (size_type vol_idx = 0; vol_idx < nv; ++vol_idx)
+    {
+      CoordScalar rot_change   = 0;
+      CoordScalar trans_change = 0;
+
+      std::tie(rot_change,trans_change) = FrameDiffRotAngTransMag(cur_state.poses[vol_idx],
+                                                                  s.poses[vol_idx]);
+
+      max_rot_change   = std::max(max_rot_change, rot_change);
+      max_trans_change = std::max(max_trans_change, trans_change);
+    }
+  }
+
+  if ((max_rot_change < max_rot_change_rad) && (max_trans_change < criteria.max_trans_change))
+  {
+    regi->request_stop(fmt::format("plateau: {} iters, obj. fn. improvement {:.3e}, "
+                                   "max rot. change {:.3f} deg, max trans. change {:.3f} mm",
+                                   window_len, obj_fn_improvement,
+                                   max_rot_change * kRAD2DEG, max_trans_change));
+  }
+}
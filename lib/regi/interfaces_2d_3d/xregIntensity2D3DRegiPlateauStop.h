@@ -0,0 +1,107 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGINTENSITY2D3DREGIPLATEAUSTOP_H_
+#define XREGINTENSITY2D3DREGIPLATEAUSTOP_H_
+
+#include <deque>
+
+#include "xregIntensity2D3DRegi.h"
+
+namespace xreg
+{
+
+/// \brief Stops a 2D/3D registration once it has reached a plateau.
+///
+/// At the end of each iteration, the best objective function value found so
+/// far and the current pose estimates of each volume are recorded. The
+/// registration is stopped (see Intensity2D3DRegi::request_stop()) when, over
+/// the most recent window_len iterations, the best objective function value
+/// has decreased by less than min_obj_fn_improvement and each pose estimate has
+/// changed by less than the rotation and translation thresholds (see Criteria).
+///
+/// The state is reset at the start of each registration run by a begin of run
+/// callback.
+struct Intensity2D3DRegiPlateauStop
+{
+  struct Criteria
+  {
+    /// The number of iterations in the sliding window
+    size_type window_len = 20;
+
+    /// The minimum number of iterations to run before stopping
+    size_type min_num_iters = 0;
+
+    /// The minimum decrease of the best objective function value required
+    /// within the window to continue
+    CoordScalar min_obj_fn_improvement = 1.0e-4;
+
+    /// The maximum rotation change (degrees) of a pose estimate within the
+    /// window to be considered a plateau
+    CoordScalar max_rot_change_deg = 0.1;
+
+    /// The maximum translation change (mm) of a pose estimate within the
+    /// window to be considered a plateau
+    CoordScalar max_trans_change = 0.1;
+  };
+
+  Criteria criteria;
+
+  /// \brief Adds begin of run and end of iteration callbacks to a registration
+  ///        object.
+  ///
+  /// This object must outlive the registration object, or its use of the
+  /// callback.
+  void attach(Intensity2D3DRegi* regi);
+
+  /// \brief The registration object most recently passed to attach().
+  const Intensity2D3DRegi* attached_regi() const;
+
+  /// \brief Clears the recorded history.
+  void reset();
+
+  /// \brief Records the current iteration and requests a stop when a plateau
+  ///        has been reached, this is called by the callback added with attach().
+  void end_of_iter(Intensity2D3DRegi* regi);
+
+private:
+  struct IterState
+  {
+    CoordScalar best_obj_fn_val;
+
+    FrameTransformList poses;
+  };
+
+  std::deque<IterState> window_;
+
+  CoordScalar best_obj_fn_val_ = std::numeric_limits<CoordScalar>::max();
+
+  size_type num_iters_ = 0;
+
+  const Intensity2D3DRegi* attached_regi_ = nullptr;
+};
+
+}  // xreg
+
+#endif
@@ -24,12 +24,23 @@
 
 #include "xregMultiObjMultiLevel2D3DRegi.h"
 
+#include <algorithm>
+#include <numeric>
+#include <unordered_map>
+
 #include "xregTBBUtils.h"
 #include "xregITKBasicImageUtils.h"
 #include "xregITKResampleUtils.h"
 #include "xregExceptionUtils.h"
 #include "xregMultiObjMultiLevel2D3DRegiDebug.h"
 #include "xregTimer.h"
+#include "xregProfiler.h"
+#include "xregRayCastBaseOCL.h"
+#include "xregIntensity2D3DRegiObjFnCache.h"
+#include "xregMultiObjMultiLevel2D3DRegiResultCache.h"
+
+// needs a definition, as it is bound to const references
+const xreg::size_type xreg::MultiLevelMultiObjRegi::kDEPENDS_ON_ALL_VOLS;
 
 xreg::MultiLevelMultiObjRegi::RefFrameInfo
 xreg::MultiLevelMultiObjRegi::StaticRefFrame::get(const MultiLevelMultiObjRegi*) const
@@ -109,101 +120,868 @@ xreg::MultiLevelMultiObjRegi::MakeStaticRefFrame(const FrameTransform& ref_frame
   return srf;
 }
 
-std::shared_ptr<xreg::MultiLevelMultiObjRegi::StaticRefFrame>
-xreg::MultiLevelMultiObjRegi::MakeIdRefFrame()
-{
-  return MakeStaticRefFrame(FrameTransform::Identity(), true);
-}
+std::shared_ptr<xreg::MultiLevelMultiObjRegi::StaticRefFrame>
+xreg::MultiLevelMultiObjRegi::MakeIdRefFrame()
+{
+  return MakeStaticRefFrame(FrameTransform::Identity(), true);
+}
+
+std::future<void>
+xreg::MultiLevelMultiObjRegi::PrebuildProgsAsync(const std::vector<Level>& levels)
+{
+  // collect each object once, the levels, and registrations, may share them
+  std::vector<Intensity2D3DRegi::RayCasterPtr> ray_casters;
+  Intensity2D3DRegi::SimMetricList sim_metrics;
+
+  auto add_ray_caster = [&ray_casters] (const Intensity2D3DRegi::RayCasterPtr& rc)
+  {
+    if (rc && (std::find(ray_casters.begin(), ray_casters.end(), rc) == ray_casters.end()))
+    {
+      ray_casters.push_back(rc);
+    }
+  };
+
+  auto add_sim_metrics = [&sim_metrics] (const Intensity2D3DRegi::SimMetricList& sms)
+  {
+    for (const auto& sm : sms)
+    {
+      if (sm && (std::find(sim_metrics.begin(), sim_metrics.end(), sm) == sim_metrics.end()))
+      {
+        sim_metrics.push_back(sm);
+      }
+    }
+  };
+
+  for (const auto& lvl : levels)
+  {
+    add_ray_caster(lvl.ray_caster);
+    add_sim_metrics(lvl.sim_metrics);
+
+    for (const auto& regi : lvl.regis)
+    {
+      add_ray_caster(regi.ray_caster);
+      add_sim_metrics(regi.sim_metrics);
+    }
+  }
+
+  auto builds = std::make_shared<std::vector<std::future<void>>>();
+
+  // the objects are captured by value, so they remain valid until the builds complete
+  for (const auto& rc : ray_casters)
+  {
+    builds->push_back(std::async(std::launch::async, [rc] () { rc->prebuild_progs(); }));
+  }
+
+  for (const auto& sm : sim_metrics)
+  {
+    builds->push_back(std::async(std::launch::async, [sm] () { sm->prebuild_progs(); }));
+  }
+
+  return std::async(std::launch::async,
+                    [builds] ()
+                    {
+                      for (auto& b : *builds)
+                      {
+                        b.get();
+                      }
+                    });
+}
+
+xreg::FrameTransform
+xreg::MultiLevelMultiObjRegi::Level::SingleRegi::InitPoseId::get(
+                                              const MultiLevelMultiObjRegi*) const
+{
+  return FrameTransform::Identity();
+}
+
+xreg::FrameTransform
+xreg::MultiLevelMultiObjRegi::Level::SingleRegi::InitPosePrevPoseEst::get(
+                    const MultiLevelMultiObjRegi* multi_level_multi_obj_regi) const
+{
+  return multi_level_multi_obj_regi->cur_cam_to_vols[vol_idx];
+}
+
+xreg::FrameTransform
+xreg::MultiLevelMultiObjRegi::Level::SingleRegi::InitPosePrevPoseEstTransOnly::get(
+                    const MultiLevelMultiObjRegi* multi_level_multi_obj_regi) const
+{
+  FrameTransform xform = multi_level_multi_obj_regi->cur_cam_to_vols[vol_idx];
+  xform.matrix().block(0,0,3,3).setIdentity();
+
+  return xform;
+}
+
+xreg::FrameTransform
+xreg::MultiLevelMultiObjRegi::Level::SingleRegi::InitPosePrevPoseEstRotOnly::get(
+                    const MultiLevelMultiObjRegi* multi_level_multi_obj_regi) const
+{
+  FrameTransform xform = multi_level_multi_obj_regi->cur_cam_to_vols[vol_idx];
+  xform.matrix().block(0,3,3,1).setZero();
+
+  return xform;
+}
+  
+void xreg::MultiLevelMultiObjRegi::set_save_debug_info(const bool save_debug_info)
+{
+  if (save_debug_info)
+  {
+    debug_info = std::make_shared<DebugRegiResultsMultiLevel>();
+  }
+  else
+  {
+    debug_info = nullptr;
+  }
+
+  debug_info_stream = nullptr;
+}
+
+void xreg::MultiLevelMultiObjRegi::set_stream_debug_info(const std::string& path,
+                                                         const size_type max_num_queued_regis)
+{
+  set_save_debug_info(true);
+
+  debug_info_stream = std::make_shared<MultiLevel2D3DRegiDebugH5Stream>(path, max_num_queued_regis);
+}
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+using FixedImgPyramid = MultiLevelMultiObjRegi::FixedImgPyramid;
+
+struct DownsampleFixedImgsFn
+{
+  std::vector<FixedImgPyramid::Entry*> entries_to_build;
+
+  void operator()(const RangeType& r) const
+  {
+    for (size_type i = r.begin(); i < r.end(); ++i)
+    {
+      FixedImgPyramid::Entry& e = *entries_to_build[i];
+
+      e.img = DownsampleImage(e.src_img, e.ds_factor);
+
+      if (e.src_mask)
+      {
+        e.mask = DownsampleBinaryImage(e.src_mask, e.ds_factor);
+      }
+      else
+      {
+        e.mask = nullptr;
+      }
+    }
+  }
+};
+
+using VolPyramid = MultiLevelMultiObjRegi::VolPyramid;
+
+struct DownsampleVolsFn
+{
+  std::vector<VolPyramid::Entry*> entries_to_build;
+
+  void operator()(const RangeType& r) const
+  {
+    for (size_type i = r.begin(); i < r.end(); ++i)
+    {
+      VolPyramid::Entry& e = *entries_to_build[i];
+
+      e.vol = DownsampleImage(e.src_vol, e.ds_factor);
+    }
+  }
+};
+
+/// \brief Computes the volume pyramid downsampling factor of each volume
+///        at a level.
+///
+/// The detector spacing of each view used by the level is projected to the
+/// center of each volume, the volume is halved while its smallest voxel spacing
+/// remains no larger than max_spacing_wrt_det times the finest projected spacing.
+std::vector<double>
+ComputeVolPyramidDsFactors(const RayCaster::VolList& vols,
+                           const FrameTransformList& cam_to_vols,
+                           const ProjDataF32List& fixed_proj_data,
+                           const MultiLevelMultiObjRegi::Level& lvl,
+                           const double max_spacing_wrt_det,
+                           const size_type max_num_halvings)
+{
+  const size_type num_vols = vols.size();
+
+  std::vector<double> ds_factors(num_vols, 1.0);
+
+  for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
+  {
+    const Pt3 vol_center = ITKVol3DCenterAsPhysPt(vols[vol_idx].GetPointer());
+
+    double min_proj_spacing = std::numeric_limits<double>::max();
+
+    for (const size_type fixed_idx : lvl.fixed_imgs_to_use)
+    {
+      const auto& cam = fixed_proj_data[fixed_idx].cam;
+
+      // the spacing of the downsampled detector
+      const double det_spacing = std::min(cam.det_row_spacing, cam.det_col_spacing) /
+                                                                         lvl.ds_factor;
+
+      const Pt3 src_wrt_vol = cam_to_vols[vol_idx] * cam.pinhole_pt;
+
+      min_proj_spacing = std::min(min_proj_spacing,
+                                  det_spacing * (vol_center - src_wrt_vol).norm() / cam.focal_len);
+    }
+
+    const auto vol_spacing = vols[vol_idx]->GetSpacing();
+
+    double cur_spacing = std::min(vol_spacing[0], std::min(vol_spacing[1], vol_spacing[2]));
+
+    const double max_spacing = max_spacing_wrt_det * min_proj_spacing;
+
+    for (size_type i = 0; (i < max_num_halvings) && ((2 * cur_spacing) <= max_spacing); ++i)
+    {
+      cur_spacing *= 2;
+      ds_factors[vol_idx] *= 0.5;
+    }
+  }
+
+  return ds_factors;
+}
+
+using RayCasterPtr  = Intensity2D3DRegi::RayCasterPtr;
+using SimMetricList = Intensity2D3DRegi::SimMetricList;
+
+using IndexList = MultiLevelMultiObjRegi::IndexList;
+
+using SingleRegi = MultiLevelMultiObjRegi::Level::SingleRegi;
+
+bool IndexListsIntersect(const IndexList& reads, const IndexList& writes)
+{
+  if (writes.empty())
+  {
+    return false;
+  }
+
+  for (const size_type i : reads)
+  {
+    if ((i == MultiLevelMultiObjRegi::kDEPENDS_ON_ALL_VOLS) ||
+        (std::find(writes.begin(), writes.end(), i) != writes.end()))
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/// \brief The volumes whose current pose estimates are used to setup a regi.
+IndexList CurPoseVolDeps(const SingleRegi& single_regi,
+                         const std::vector<std::shared_ptr<MultiLevelMultiObjRegi::RefFrame>>& ref_frames)
+{
+  IndexList deps;
+
+  const auto append_deps = [&deps] (const IndexList& cur_deps)
+  {
+    deps.insert(deps.end(), cur_deps.begin(), cur_deps.end());
+  };
+
+  for (const auto& p : single_regi.init_mov_vol_poses)
+  {
+    append_deps(p->cur_pose_vol_deps());
+  }
+
+  for (const auto& p : single_regi.static_vol_poses)
+  {
+    append_deps(p->cur_pose_vol_deps());
+  }
+
+  for (const size_type ref_frame_idx : single_regi.ref_frames)
+  {
+    if (ref_frame_idx != SingleRegi::kNO_REF_FRAME_USED)
+    {
+      append_deps(ref_frames[ref_frame_idx]->cur_pose_vol_deps());
+    }
+  }
+
+  return deps;
+}
+
+/// \brief Assigns each regi of a level to a stage, so that the regis of a
+///        stage are independent of each other.
+///
+/// A regi is placed in the stage following the latest stage of any earlier
+/// regi it depends on, so dependent regis keep their relative order.
+IndexList ScheduleIndependentRegis(const MultiLevelMultiObjRegi::Level& lvl,
+                                   const std::vector<std::shared_ptr<MultiLevelMultiObjRegi::RefFrame>>& ref_frames,
+                                   const std::vector<RayCasterPtr>& regi_ray_casters,
+                                   const std::vector<const SimMetricList*>& regi_sim_metrics)
+{
+  const size_type num_regis = lvl.regis.size();
+
+  std::vector<IndexList> reads(num_regis);
+
+  for (size_type regi_idx = 0; regi_idx < num_regis; ++regi_idx)
+  {
+    reads[regi_idx] = CurPoseVolDeps(lvl.regis[regi_idx], ref_frames);
+  }
+
+  const auto share_sim_metrics = [&regi_sim_metrics] (const size_type i, const size_type j)
+  {
+    for (const auto& sm : *regi_sim_metrics[i])
+    {
+      if (std::find(regi_sim_metrics[j]->begin(), regi_sim_metrics[j]->end(), sm) !=
+                                                          regi_sim_metrics[j]->end())
+      {
+        return true;
+      }
+    }
+
+    return false;
+  };
+
+  IndexList stages(num_regis, 0);
+
+  for (size_type i = 0; i < num_regis; ++i)
+  {
+    const IndexList& writes_i = lvl.regis[i].mov_vols;
+
+    for (size_type j = 0; j < i; ++j)
+    {
+      const IndexList& writes_j = lvl.regis[j].mov_vols;
+
+      const bool dep = (regi_ray_casters[i] == regi_ray_casters[j]) ||
+                       share_sim_metrics(i, j) ||
+                       IndexListsIntersect(reads[i], writes_j) ||
+                       IndexListsIntersect(reads[j], writes_i) ||
+                       IndexListsIntersect(writes_i, writes_j);
+
+      if (dep)
+      {
+        stages[i] = std::max(stages[i], stages[j] + 1);
+      }
+    }
+  }
+
+  return stages;
+}
+
+}  // un-named
+
+void xreg::MultiLevelMultiObjRegi::FixedImgPyramid::update(const ProjDataF32List& fixed_proj_data,
+                                                           const Mask2DList& masks_2d,
+                                                           const std::vector<Level>& levels)
+{
+  const bool masks_provided = !masks_2d.empty();
+
+  std::vector<Entry> new_entries;
+
+  for (const auto& lvl : levels)
+  {
+    for (const size_type fixed_idx : lvl.fixed_imgs_to_use)
+    {
+      xregASSERT(fixed_idx < fixed_proj_data.size());
+
+      const auto* src_img = fixed_proj_data[fixed_idx].img.GetPointer();
+      xregASSERT(src_img);
+
+      const ImgSimMetric2D::ImageMask* src_mask = masks_provided ?
+                                                    masks_2d[fixed_idx].GetPointer() : nullptr;
+
+      const itk::ModifiedTimeType src_img_mtime  = src_img->GetMTime();
+      const itk::ModifiedTimeType src_mask_mtime = src_mask ? src_mask->GetMTime() : 0;
+
+      const auto same_src = [&] (const Entry& e)
+      {
+        return (e.fixed_idx == fixed_idx) && (e.ds_factor == lvl.ds_factor) &&
+               (e.src_img == src_img) && (e.src_img_mtime == src_img_mtime) &&
+               (e.src_mask == src_mask) && (e.src_mask_mtime == src_mask_mtime);
+      };
+
+      // another level has already requested this entry
+      if (std::any_of(new_entries.begin(), new_entries.end(), same_src))
+      {
+        continue;
+      }
+
+      auto existing_it = std::find_if(entries.begin(), entries.end(), same_src);
+
+      if (existing_it != entries.end())
+      {
+        new_entries.push_back(*existing_it);
+      }
+      else
+      {
+        new_entries.push_back(Entry{ fixed_idx, lvl.ds_factor,
+                                     src_img, src_img_mtime,
+                                     src_mask, src_mask_mtime,
+                                     nullptr, nullptr });
+      }
+    }
+  }
+
+  entries.swap(new_entries);
+
+  DownsampleFixedImgsFn ds_fn;
+
+  // pointers to the entries may be safely used now, as no more entries
+  // will be created
+  for (auto& e : entries)
+  {
+    if (!e.img)
+    {
+      ds_fn.entries_to_build.push_back(&e);
+    }
+  }
+
+  ParallelFor(ds_fn, RangeType(0, ds_fn.entries_to_build.size()));
+}
+
+const xreg::MultiLevelMultiObjRegi::FixedImgPyramid::Entry&
+xreg::MultiLevelMultiObjRegi::FixedImgPyramid::find_entry(const size_type fixed_idx,
+                                                          const double ds_factor) const
+{
+  auto it = std::find_if(entries.begin(), entries.end(),
+                         [fixed_idx,ds_factor] (const Entry& e)
+                         {
+                           return (e.fixed_idx == fixed_idx) && (e.ds_factor == ds_factor);
+                         });
+
+  if (it == entries.end())
+  {
+    xregThrow("fixed image pyramid has no entry for image %lu at downsample factor %.3f!",
+              fixed_idx, ds_factor);
+  }
+
+  return *it;
+}
+
+xreg::ProjDataF32
+xreg::MultiLevelMultiObjRegi::FixedImgPyramid::proj_data(const ProjDataF32& src_proj,
+                                                         const size_type fixed_idx,
+                                                         const double ds_factor) const
+{
+  const Entry& e = find_entry(fixed_idx, ds_factor);
+
+  xregASSERT(e.src_img == src_proj.img.GetPointer());
+
+  // Downsample everything but the image (this is cheap), then use the
+  // cached pixel data
+  ProjDataF32 src_proj_no_img = src_proj;
+  src_proj_no_img.img = nullptr;
+
+  ProjDataF32 dst_proj = DownsampleProjData(src_proj_no_img, ds_factor);
+
+  dst_proj.img = e.img;
+
+  return dst_proj;
+}
+
+xreg::ImgSimMetric2D::ImageMaskPtr
+xreg::MultiLevelMultiObjRegi::FixedImgPyramid::mask(const size_type fixed_idx,
+                                                    const double ds_factor) const
+{
+  return find_entry(fixed_idx, ds_factor).mask;
+}
+
+void xreg::MultiLevelMultiObjRegi::FixedImgPyramid::clear()
+{
+  entries.clear();
+}
+
+void xreg::MultiLevelMultiObjRegi::VolPyramid::update(const RayCaster::VolList& src_vols,
+                                                      const std::vector<Level>& levels)
+{
+  const size_type num_vols = src_vols.size();
+
+  std::vector<Entry> new_entries;
+
+  for (const auto& lvl : levels)
+  {
+    if (lvl.vol_ds_factors.empty())
+    {
+      continue;
+    }
+
+    xregASSERT(lvl.vol_ds_factors.size() == num_vols);
+
+    for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
+    {
+      const double ds_factor = lvl.vol_ds_factors[vol_idx];
+
+      // full resolution volumes are used directly
+      if (ds_factor == 1.0)
+      {
+        continue;
+      }
+
+      const RayCaster::Vol* src_vol = src_vols[vol_idx].GetPointer();
+      xregASSERT(src_vol);
+
+      const itk::ModifiedTimeType src_vol_mtime = src_vol->GetMTime();
+
+      const auto same_src = [&] (const Entry& e)
+      {
+        return (e.vol_idx == vol_idx) && (e.ds_factor == ds_factor) &&
+               (e.src_vol == src_vol) && (e.src_vol_mtime == src_vol_mtime);
+      };
+
+      // another level has already requested this entry
+      if (std::any_of(new_entries.begin(), new_entries.end(), same_src))
+      {
+        continue;
+      }
+
+      auto existing_it = std::find_if(entries.begin(), entries.end(), same_src);
+
+      if (existing_it != entries.end())
+      {
+        new_entries.push_back(*existing_it);
+      }
+      else
+      {
+        new_entries.push_back(Entry{ vol_idx, ds_factor, src_vol, src_vol_mtime, nullptr });
+      }
+    }
+  }
+
+  entries.swap(new_entries);
+
+  DownsampleVolsFn ds_fn;
+
+  // pointers to the entries may be safely used now, as no more entries
+  // will be created
+  for (auto& e : entries)
+  {
+    if (!e.vol)
+    {
+      ds_fn.entries_to_build.push_back(&e);
+    }
+  }
+
+  ParallelFor(ds_fn, RangeType(0, ds_fn.entries_to_build.size()));
+}
+
+xreg::RayCaster::VolList
+xreg::MultiLevelMultiObjRegi::VolPyramid::vols(const RayCaster::VolList& src_vols,
+                                               const Level& lvl) const
+{
+  if (lvl.vol_ds_factors.empty())
+  {
+    return src_vols;
+  }
+
+  const size_type num_vols = src_vols.size();
+  xregASSERT(lvl.vol_ds_factors.size() == num_vols);
+
+  RayCaster::VolList dst_vols(num_vols);
+
+  for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
+  {
+    const double ds_factor = lvl.vol_ds_factors[vol_idx];
+
+    if (ds_factor == 1.0)
+    {
+      dst_vols[vol_idx] = src_vols[vol_idx];
+    }
+    else
+    {
+      auto it = std::find_if(entries.begin(), entries.end(),
+                             [vol_idx,ds_factor] (const Entry& e)
+                             {
+                               return (e.vol_idx == vol_idx) && (e.ds_factor == ds_factor);
+                             });
+
+      if (it == entries.end())
+      {
+        xregThrow("volume pyramid has no entry for volume %lu at downsample factor %.3f!",
+                  vol_idx, ds_factor);
+      }
+
+      dst_vols[vol_idx] = it->vol;
+    }
+  }
+
+  return dst_vols;
+}
+
+void xreg::MultiLevelMultiObjRegi::VolPyramid::clear()
+{
+  entries.clear();
+}
+
+void xreg::MultiLevelMultiObjRegi::run()
+{
+  Timer tmr;
+  tmr.start();
+
+  bool save_debug_info = debug_info.get();
+
+  dout() << "Saving debug info: " << (save_debug_info ? "YES" : "NO") << std::endl;
+
+  const size_type num_levels = levels.size();
+  
+  dout() << "Num Levels: " << num_levels << std::endl;
+
+  if (save_debug_info)
+  {
+    debug_info->multi_res_levels.resize(num_levels);
+    debug_info->regi_results.resize(num_levels);
+    debug_info->level_profiles.clear();
+
+    if (profile_levels)
+    {
+      debug_info->level_profiles.resize(num_levels);
+    }
+  }
+
+  const bool prev_profiling_enabled = ProfilingEnabled();
+
+  if (profile_levels)
+  {
+    SetProfilingEnabled(true);
+  }
+
+  const size_type num_fixed_imgs = fixed_proj_data.size();
+
+  dout() << "Num Fixed Images: " << num_fixed_imgs << std::endl;
+
+  const bool masks_provided = !masks_2d.empty();
+
+  xregASSERT(!masks_provided || (masks_2d.size() == num_fixed_imgs));
+
+  xregASSERT(init_cam_to_vols.size() == vols.size());
+
+  cur_cam_to_vols = init_cam_to_vols;
+
+  // Verify that the metadata in each projection matches that of the camera model
+  for (const auto& lvl : levels)
+  {
+    for (const size_type global_fixed_idx : lvl.fixed_imgs_to_use)
+    {
+      const auto& cam = fixed_proj_data[global_fixed_idx].cam;
+
+      const auto img_spacings = fixed_proj_data[global_fixed_idx].img->GetSpacing();
+
+      if (std::abs(img_spacings[0] - cam.det_col_spacing) > 1.0e-6)
+      {
+        xregThrow("ERROR: mismatch between image object and camera model column spacings! Image: %.4f, Cam: %.4f", img_spacings[0], cam.det_col_spacing);
+      }
+      
+      if (std::abs(img_spacings[1] - cam.det_row_spacing) > 1.0e-6)
+      {
+        xregThrow("ERROR: mismatch between image object and camera model row spacings! Image: %.4f, Cam: %.4f", img_spacings[1], cam.det_row_spacing);
+      }
+
+      const auto img_size = fixed_proj_data[global_fixed_idx].img->GetLargestPossibleRegion().GetSize();
+
+      if (img_size[0] != cam.num_det_cols)
+      {
+        xregThrow("ERROR: mismatch between image object and camera model number of rows! Image: %lu, Cam: %lu", img_size[0], cam.num_det_cols);
+      }
+      
+      if (img_size[1] != cam.num_det_rows)
+      {
+        xregThrow("ERROR: mismatch between image object and camera model number of rows! Image: %lu, Cam: %lu", img_size[1], cam.num_det_rows);
+      }
+    }
+  }
+
+  if (use_vol_pyramid)
+  {
+    dout() << "computing volume pyramid downsampling factors..." << std::endl;
+
+    for (size_type lvl_idx = 0; lvl_idx < num_levels; ++lvl_idx)
+    {
+      Level& lvl = levels[lvl_idx];
+
+      lvl.vol_ds_factors = ComputeVolPyramidDsFactors(vols, init_cam_to_vols, fixed_proj_data, lvl,
+                                                      vol_pyramid_max_spacing_wrt_det,
+                                                      vol_pyramid_max_num_halvings);
+
+      dout() << "  level " << lvl_idx << " vol ds factors: [ ";
+      for (const double f : lvl.vol_ds_factors)
+      {
+        dout() << f << ' ';
+      }
+      dout() << "]" << std::endl;
+    }
+  }
+
+  auto finish_run = [&] ()
+  {
+    if (profile_levels)
+    {
+      SetProfilingEnabled(prev_profiling_enabled);
+    }
+    
+    tmr.stop();
+    
+    const double multi_level_run_time_secs = tmr.elapsed_seconds();
+
+    dout() << "multi-level run time (seconds): " << multi_level_run_time_secs << std::endl;
+
+    if (save_debug_info)
+    {
+      debug_info->multi_level_run_time_secs = multi_level_run_time_secs;
+    }
+  };
+
+  num_levels_from_result_cache = 0;
+
+  // result_cache_keys[l] is the key of the entry storing the results of level l
+  StrList result_cache_keys;
+
+  if (result_cache)
+  {
+    dout() << "computing result cache keys..." << std::endl;
+
+    result_cache_keys.resize(num_levels);
+
+    std::string prev_key = MakeMultiLevelRegiInputsKey(*this);
+
+    for (size_type lvl_idx = 0; lvl_idx < num_levels; ++lvl_idx)
+    {
+      result_cache_keys[lvl_idx] = MakeMultiLevelRegiLevelKey(prev_key, levels[lvl_idx]);
+      
+      prev_key = result_cache_keys[lvl_idx];
+    }
+
+    // use the stored results of each level until the first level without an
+    // entry, the registrations resume from that level
+    for (size_type lvl_idx = 0; lvl_idx < num_levels; ++lvl_idx)
+    {
+      Level& lvl = levels[lvl_idx];
+
+      const size_type num_regis = lvl.regis.size();
+
+      MultiLevelRegiResultCache::LevelResults lvl_results;
+
+      if (!result_cache->read(result_cache_keys[lvl_idx], &lvl_results) ||
+          (lvl_results.cam_to_vols.size() != cur_cam_to_vols.size()) ||
+          (save_debug_info && (!lvl_results.has_debug_info ||
+                               (lvl_results.regi_debug_info.size() != num_regis))))
+      {
+        break;
+      }
+
+      dout() << "using result cache entry of level " << lvl_idx << ": "
+             << result_cache_keys[lvl_idx] << std::endl;
+
+      cur_cam_to_vols = lvl_results.cam_to_vols;
+
+      if (save_debug_info)
+      {
+        debug_info->multi_res_levels[lvl_idx] = lvl.ds_factor;
+        debug_info->regi_results[lvl_idx] = lvl_results.regi_debug_info;
+
+        if (debug_info_stream)
+        {
+          for (size_type regi_idx = 0; regi_idx < num_regis; ++regi_idx)
+          {
+            auto& dst_debug_info = debug_info->regi_results[lvl_idx][regi_idx];
+
+            debug_info_stream->add_regi_results(lvl_idx, regi_idx, dst_debug_info);
 
-xreg::FrameTransform
-xreg::MultiLevelMultiObjRegi::Level::SingleRegi::InitPoseId::get(
-                                              const MultiLevelMultiObjRegi*) const
-{
-  return FrameTransform::Identity();
-}
+            dst_debug_info = nullptr;
+          }
+        }
+      }
 
-xreg::FrameTransform
-xreg::MultiLevelMultiObjRegi::Level::SingleRegi::InitPosePrevPoseEst::get(
-                    const MultiLevelMultiObjRegi* multi_level_multi_obj_regi) const
-{
-  return multi_level_multi_obj_regi->cur_cam_to_vols[vol_idx];
-}
+      if (dealloc_resources)
+      {
+        for (auto& single_regi : lvl.regis)
+        {
+          single_regi.regi = nullptr;
+          single_regi.ray_caster = nullptr;
+          single_regi.sim_metrics.clear();
+        }
 
-xreg::FrameTransform
-xreg::MultiLevelMultiObjRegi::Level::SingleRegi::InitPosePrevPoseEstTransOnly::get(
-                    const MultiLevelMultiObjRegi* multi_level_multi_obj_regi) const
-{
-  FrameTransform xform = multi_level_multi_obj_regi->cur_cam_to_vols[vol_idx];
-  xform.matrix().block(0,0,3,3).setIdentity();
+        lvl.ray_caster = nullptr;
+        lvl.sim_metrics.clear();
+      }
 
-  return xform;
-}
+      ++num_levels_from_result_cache;
+    }
 
-xreg::FrameTransform
-xreg::MultiLevelMultiObjRegi::Level::SingleRegi::InitPosePrevPoseEstRotOnly::get(
-                    const MultiLevelMultiObjRegi* multi_level_multi_obj_regi) const
-{
-  FrameTransform xform = multi_level_multi_obj_regi->cur_cam_to_vols[vol_idx];
-  xform.matrix().block(0,3,3,1).setZero();
+    dout() << "levels retrieved from result cache: " << num_levels_from_result_cache << std::endl;
 
-  return xform;
-}
-  
-void xreg::MultiLevelMultiObjRegi::set_save_debug_info(const bool save_debug_info)
-{
-  if (save_debug_info)
-  {
-    debug_info = std::make_shared<DebugRegiResultsMultiLevel>();
+    if (num_levels_from_result_cache == num_levels)
+    {
+      finish_run();
+      return;
+    }
   }
-  else
+
+  dout() << "updating downsampled fixed images and masks..." << std::endl;
+  fixed_img_pyramid.update(fixed_proj_data, masks_2d, levels);
+  dout() << "  pyramid entries: " << fixed_img_pyramid.entries.size() << std::endl;
+
+  if (std::any_of(levels.begin(), levels.end(),
+                  [] (const Level& lvl) { return !lvl.vol_ds_factors.empty(); }))
   {
-    debug_info = nullptr;
+    dout() << "updating downsampled volumes..." << std::endl;
+    vol_pyramid.update(vols, levels);
+    dout() << "  volume pyramid entries: " << vol_pyramid.entries.size() << std::endl;
   }
-}
 
-void xreg::MultiLevelMultiObjRegi::run()
-{
-  Timer tmr;
-  tmr.start();
-
-  bool save_debug_info = debug_info.get();
+  // Size the projection buffers of each ray caster for the largest level
+  // that uses it, so that a ray caster reconfigured for a later level (e.g.
+  // fewer, larger fixed images) only changes its logical size and does not
+  // reallocate host or device memory.
+  {
+    std::unordered_map<RayCaster*,size_type> max_num_pix_per_ray_caster;
 
-  dout() << "Saving debug info: " << (save_debug_info ? "YES" : "NO") << std::endl;
+    for (size_type lvl_idx = 0; lvl_idx < num_levels; ++lvl_idx)
+    {
+      const Level& lvl = levels[lvl_idx];
 
-  const size_type num_levels = levels.size();
-  
-  dout() << "Num Levels: " << num_levels << std::endl;
+      const size_type num_fixed_imgs_this_level = lvl.fixed_imgs_to_use.size();
 
-  if (save_debug_info)
-  {
-    debug_info->multi_res_levels.resize(num_levels);
-    debug_info->regi_results.resize(num_levels);
-  }
+      size_type max_num_pix_per_img = 0;
 
-  const size_type num_fixed_imgs = fixed_proj_data.size();
+      for (const size_type global_fixed_idx : lvl.fixed_imgs_to_use)
+      {
+        const CameraModel ds_cam = fixed_img_pyramid.proj_data(fixed_proj_data[global_fixed_idx],
+                                                               global_fixed_idx, lvl.ds_factor).cam;
 
-  dout() << "Num Fixed Images: " << num_fixed_imgs << std::endl;
+        max_num_pix_per_img = std::max(max_num_pix_per_img,
+                                       static_cast<size_type>(ds_cam.num_det_rows * ds_cam.num_det_cols));
+      }
 
-  const bool masks_provided = !masks_2d.empty();
+      for (const auto& single_regi : lvl.regis)
+      {
+        RayCaster* rc = single_regi.ray_caster ? single_regi.ray_caster.get()
+                                                     : lvl.ray_caster.get();
 
-  xregASSERT(!masks_provided || (masks_2d.size() == num_fixed_imgs));
+        if (rc)
+        {
+          size_type& max_num_pix = max_num_pix_per_ray_caster[rc];
 
-  xregASSERT(init_cam_to_vols.size() == vols.size());
+          max_num_pix = std::max(max_num_pix, single_regi.regi->max_num_projs_per_view_per_iter() *
+                                                num_fixed_imgs_this_level * max_num_pix_per_img);
+        }
+      }
+    }
 
-  cur_cam_to_vols = init_cam_to_vols;
+    for (auto& rc_and_num_pix : max_num_pix_per_ray_caster)
+    {
+      rc_and_num_pix.first->set_reserved_num_pixels(rc_and_num_pix.second);
+    }
+  }
 
-  for (size_type lvl_idx = 0; lvl_idx < num_levels; ++lvl_idx)
+  for (size_type lvl_idx = num_levels_from_result_cache; lvl_idx < num_levels; ++lvl_idx)
   {
     dout() << "Starting level: " << lvl_idx << std::endl;
 
+    if (profile_levels)
+    {
+      ResetProfiling();
+      ResetPeakMemUsage();
+    }
+
     Level& lvl = levels[lvl_idx];
     
     const size_type num_regis = lvl.regis.size();
 
     dout() << "number of regis at this level: " << num_regis << std::endl;
 
-    // TODO: pre-compute the downsampling prior to looping through the levels
-    
     const size_type num_fixed_imgs_this_level = lvl.fixed_imgs_to_use.size();
    
     dout() << "number of fixed images at this level: " << num_fixed_imgs_this_level << std::endl;
@@ -220,131 +998,220 @@ void xreg::MultiLevelMultiObjRegi::run()
     for (size_type fixed_idx = 0; fixed_idx < num_fixed_imgs_this_level; ++fixed_idx)
     {
       const size_type global_fixed_idx = lvl.fixed_imgs_to_use[fixed_idx];
-      dout() << "downsampling global fixed image: " << global_fixed_idx << std::endl;
+      dout() << "retrieving downsampled global fixed image: " << global_fixed_idx << std::endl;
+
+      ds_proj_data[fixed_idx] = fixed_img_pyramid.proj_data(fixed_proj_data[global_fixed_idx],
+                                                            global_fixed_idx, lvl.ds_factor);
+
+      ds_masks_2d[fixed_idx] = fixed_img_pyramid.mask(global_fixed_idx, lvl.ds_factor);
+    }
+    
+    // Each regi uses either its own ray caster and sim metrics, or those of
+    // the level. Each ray caster, and its sim metrics, is setup once for all
+    // of the regis that use it.
+    std::vector<RayCasterPtr> regi_ray_casters(num_regis);
+    std::vector<const SimMetricList*> regi_sim_metrics(num_regis);
+
+    std::vector<RayCasterPtr> ray_casters_to_setup;
+
+    for (size_type regi_idx = 0; regi_idx < num_regis; ++regi_idx)
+    {
+      const Level::SingleRegi& single_regi = lvl.regis[regi_idx];
+
+      regi_ray_casters[regi_idx] = single_regi.ray_caster ? single_regi.ray_caster : lvl.ray_caster;
+      xregASSERT(bool(regi_ray_casters[regi_idx]));
 
-      // Verify that the metadata in the projection matches that of the camera model
+      regi_sim_metrics[regi_idx] = single_regi.sim_metrics.empty() ? &lvl.sim_metrics
+                                                                   : &single_regi.sim_metrics;
+      xregASSERT(regi_sim_metrics[regi_idx]->size() >= num_fixed_imgs_this_level);
+
+      if (std::find(ray_casters_to_setup.begin(), ray_casters_to_setup.end(),
+                    regi_ray_casters[regi_idx]) == ray_casters_to_setup.end())
       {
-        const auto& cam = fixed_proj_data[global_fixed_idx].cam;
+        ray_casters_to_setup.push_back(regi_ray_casters[regi_idx]);
+      }
+    }
+
+    std::vector<const SimMetricList*> sim_metrics_already_setup;
+
+    for (const auto& cur_ray_caster : ray_casters_to_setup)
+    {
+      const SimMetricList* sim_metrics_ptr = nullptr;
 
-        const auto img_spacings = fixed_proj_data[global_fixed_idx].img->GetSpacing();
+      // determine the maximum number of moving images
+      size_type max_num_mov_imgs = 0;
+    
+      // determine if bg projs are needed.
+      bool need_bg_projs = false;
+
+      // determine if a regi evaluates populations in two halves, which are
+      // ray cast using separate compute slots
+      bool need_compute_slots = false;
 
-        if (std::abs(img_spacings[0] - cam.det_col_spacing) > 1.0e-6)
+      for (size_type regi_idx = 0; regi_idx < num_regis; ++regi_idx)
+      {
+        if (regi_ray_casters[regi_idx] != cur_ray_caster)
         {
-          xregThrow("ERROR: mismatch between image object and camera model column spacings! Image: %.4f, Cam: %.4f", img_spacings[0], cam.det_col_spacing);
+          continue;
         }
-        
-        if (std::abs(img_spacings[1] - cam.det_row_spacing) > 1.0e-6)
+
+        if (!sim_metrics_ptr)
+        {
+          sim_metrics_ptr = regi_sim_metrics[regi_idx];
+        }
+        else if (*sim_metrics_ptr != *regi_sim_metrics[regi_idx])
         {
-          xregThrow("ERROR: mismatch between image object and camera model row spacings! Image: %.4f, Cam: %.4f", img_spacings[1], cam.det_row_spacing);
+          xregThrow("regis sharing a ray caster must also share sim metrics!");
         }
 
-        const auto img_size = fixed_proj_data[global_fixed_idx].img->GetLargestPossibleRegion().GetSize();
+        Level::SingleRegi& single_regi = lvl.regis[regi_idx];
 
-        if (img_size[0] != cam.num_det_cols)
+        if (!single_regi.static_vols.empty())
         {
-          xregThrow("ERROR: mismatch between image object and camera model number of rows! Image: %lu, Cam: %lu", img_size[0], cam.num_det_cols);
+          need_bg_projs = true;
+          dout() << "Regi " << regi_idx << " uses " << single_regi.static_vols.size()
+                 << " static vols..." << std::endl;
         }
-        
-        if (img_size[1] != cam.num_det_rows)
+
+        if (single_regi.regi->pipeline_pop_obj_fn())
+        {
+          need_compute_slots = true;
+        }
+
+        const size_type max_num_projs_for_this_regi = lvl.regis[regi_idx].regi->max_num_projs_per_view_per_iter() *
+                                                        num_fixed_imgs_this_level;
+        dout() << "max num projs needed by this regi: " << max_num_projs_for_this_regi << std::endl;
+
+        max_num_mov_imgs = std::max(max_num_mov_imgs, max_num_projs_for_this_regi);
+      }
+
+      // a sim metric is connected to the buffer of a single ray caster
+      for (const auto* other_sim_metrics_ptr : sim_metrics_already_setup)
+      {
+        for (const auto& sm : *sim_metrics_ptr)
         {
-          xregThrow("ERROR: mismatch between image object and camera model number of rows! Image: %lu, Cam: %lu", img_size[1], cam.num_det_rows);
+          if (std::find(other_sim_metrics_ptr->begin(), other_sim_metrics_ptr->end(), sm) !=
+                                                            other_sim_metrics_ptr->end())
+          {
+            xregThrow("sim metrics may not be shared by regis using different ray casters!");
+          }
         }
       }
 
-      ds_proj_data[fixed_idx] = DownsampleProjData(fixed_proj_data[global_fixed_idx], lvl.ds_factor);
+      sim_metrics_already_setup.push_back(sim_metrics_ptr);
+
+      const SimMetricList& sim_metrics = *sim_metrics_ptr;
+
+      dout() << "max num projs needed to alloc ray caster: " << max_num_mov_imgs << std::endl;
 
-      if (masks_provided)
+      RayCaster& ray_caster = *cur_ray_caster;
+
+      ray_caster.set_num_projs(max_num_mov_imgs);
+      ray_caster.set_use_bg_projs(need_bg_projs);
+      
+      if (ray_caster_needs_resources_alloc)
       {
-        auto& cur_mask_to_ds = masks_2d[global_fixed_idx];
+        // TODO: create a subset of the volumes that are required at this level
+        ray_caster.set_volumes(vol_pyramid.vols(vols, lvl));
+        
+        ray_caster.set_camera_models(ExtractCamModels(ds_proj_data));
+
+        RayCasterOCL* ray_caster_ocl = dynamic_cast<RayCasterOCL*>(&ray_caster);
+
+        if (need_compute_slots && ray_caster_ocl && ray_caster_ocl->supports_compute_slots())
+        {
+          ray_caster_ocl->set_num_compute_slots(2);
+        }
+        
+        dout() << "ray caster allocating resources..." << std::endl; 
+        xregPROFILE_SCOPE("ray-caster-alloc");
+        ray_caster.allocate_resources();
 
-        if (cur_mask_to_ds)
+        // fewer projections may have been allocated to fit within a device
+        // memory budget, each regi will need to adapt during its setup
+        if (ray_caster.num_projs() < max_num_mov_imgs)
         {
-          dout() << "downsampling global fixed mask: " << global_fixed_idx << std::endl;
+          dout() << "ray caster allocated for only " << ray_caster.num_projs()
+                 << " projections" << std::endl;
 
-          ds_masks_2d[fixed_idx] = DownsampleBinaryImage(cur_mask_to_ds.GetPointer(),
-                                                         lvl.ds_factor);
+          max_num_mov_imgs = ray_caster.num_projs();
         }
       }
-    }
-    
-    // determine the maximum number of moving images
-    size_type max_num_mov_imgs = 0;
-    
-    // determine if bg projs are needed.
-    bool need_bg_projs = false;
-
-    for (size_type regi_idx = 0; regi_idx < num_regis; ++regi_idx)
-    {
-      Level::SingleRegi& single_regi = lvl.regis[regi_idx];
 
-      if (!single_regi.static_vols.empty())
+      dout() << "setting up sim metrics for each view..." << std::endl;
+      for (size_type fixed_idx = 0; fixed_idx < num_fixed_imgs_this_level; ++fixed_idx)
       {
-        need_bg_projs = true;
-        dout() << "Regi " << regi_idx << " uses " << single_regi.static_vols.size()
-               << " static vols..." << std::endl;
-      }
+        dout() << "view " << fixed_idx << std::endl;
 
-      const size_type max_num_projs_for_this_regi = lvl.regis[regi_idx].regi->max_num_projs_per_view_per_iter() *
-                                                      num_fixed_imgs_this_level;
-      dout() << "max num projs needed by this regi: " << max_num_projs_for_this_regi << std::endl;
+        sim_metrics[fixed_idx]->set_num_moving_images(max_num_mov_imgs);
 
-      max_num_mov_imgs = std::max(max_num_mov_imgs, max_num_projs_for_this_regi);
-    }
+        if (sim_metrics_need_resources_alloc)
+        {
+          sim_metrics[fixed_idx]->set_fixed_image(ds_proj_data[fixed_idx].img);
+        }
+        
+        dout() << "connecting ray caster buffer to sim metric..." << std::endl;
+        sim_metrics[fixed_idx]->set_mov_imgs_buf_from_ray_caster(&ray_caster,
+                                                                 max_num_mov_imgs * fixed_idx);
 
-    dout() << "max num projs needed to alloc ray caster: " << max_num_mov_imgs << std::endl;
+        if (sim_metrics_need_resources_alloc)
+        {
+          if (masks_provided && ds_masks_2d[fixed_idx])
+          {
+            dout() << "setting mask for sim metric..." << std::endl;
+            sim_metrics[fixed_idx]->set_mask(ds_masks_2d[fixed_idx]);
+          }
 
-    RayCaster& ray_caster = *lvl.ray_caster;
+          dout() << "allocating resources..." << std::endl;
+          xregPROFILE_SCOPE("sim-metric-alloc");
+          sim_metrics[fixed_idx]->allocate_resources();
+        }
+      }
+    }
 
-    ray_caster.set_num_projs(max_num_mov_imgs);
-    ray_caster.set_use_bg_projs(need_bg_projs);
+    // Assign each regi to a stage, the stages are run in order and the regis
+    // of a stage are run concurrently. By default each regi has its own stage.
+    IndexList regi_stages(num_regis);
     
-    if (ray_caster_needs_resources_alloc)
+    if (lvl.run_independent_regis_concurrently)
     {
-      // TODO: create a subset of the volumes that are required at this level
-      ray_caster.set_volumes(vols);
-      
-      ray_caster.set_camera_models(ExtractCamModels(ds_proj_data));
-      
-      dout() << "ray caster allocating resources..." << std::endl; 
-      ray_caster.allocate_resources();
+      regi_stages = ScheduleIndependentRegis(lvl, ref_frames, regi_ray_casters, regi_sim_metrics);
     }
-
-    dout() << "setting up sim metrics for each view..." << std::endl;
-    for (size_type fixed_idx = 0; fixed_idx < num_fixed_imgs_this_level; ++fixed_idx)
+    else
     {
-      dout() << "view " << fixed_idx << std::endl;
+      std::iota(regi_stages.begin(), regi_stages.end(), size_type(0));
+    }
 
-      lvl.sim_metrics[fixed_idx]->set_num_moving_images(max_num_mov_imgs);
+    const size_type num_stages = num_regis ?
+                      (*std::max_element(regi_stages.begin(), regi_stages.end()) + 1) : 0;
 
-      if (sim_metrics_need_resources_alloc)
-      {
-        lvl.sim_metrics[fixed_idx]->set_fixed_image(ds_proj_data[fixed_idx].img);
-      }
-      
-      dout() << "connecting ray caster buffer to sim metric..." << std::endl;
-      lvl.sim_metrics[fixed_idx]->set_mov_imgs_buf_from_ray_caster(&ray_caster,
-                                                                   max_num_mov_imgs * fixed_idx);
+    if (lvl.run_independent_regis_concurrently)
+    {
+      dout() << "number of stages of independent regis: " << num_stages << std::endl;
+    }
 
-      if (sim_metrics_need_resources_alloc)
-      {
-        if (masks_provided && ds_masks_2d[fixed_idx])
-        {
-          dout() << "setting mask for sim metric..." << std::endl;
-          lvl.sim_metrics[fixed_idx]->set_mask(ds_masks_2d[fixed_idx]);
-        }
+    std::vector<FrameTransformList> static_vol_poses_used(num_regis);
 
-        dout() << "allocating resources..." << std::endl;
-        lvl.sim_metrics[fixed_idx]->allocate_resources();
-      }
+    // the debug info is retained here for the result cache, since streaming
+    // releases it from debug_info
+    MultiLevelRegiResultCache::LevelResults lvl_cache_results;
+    lvl_cache_results.has_debug_info = save_debug_info;
+
+    if (result_cache && save_debug_info)
+    {
+      lvl_cache_results.regi_debug_info.resize(num_regis);
     }
 
-    // run each regi
-    for (size_type regi_idx = 0; regi_idx < num_regis; ++regi_idx)
+    auto setup_regi = [&] (const size_type regi_idx)
     {
+      xregPROFILE_SCOPE("regi-setup");
+
       dout() << "regi: " << regi_idx << std::endl;
 
       Level::SingleRegi& single_regi = lvl.regis[regi_idx];
      
+      RayCaster& ray_caster = *regi_ray_casters[regi_idx];
+
       const size_type num_mov_vols = single_regi.mov_vols.size();
       dout() << "num moving vols: " << num_mov_vols << std::endl;
       dout() << "  [ ";
@@ -357,8 +1224,6 @@ void xreg::MultiLevelMultiObjRegi::run()
       const size_type num_static_vols = single_regi.static_vols.size();
       dout() << "num static vols: " << num_static_vols << std::endl;
 
-      FrameTransformList static_vol_poses_used;
-
       // setup background images (if needed)
       if (num_static_vols > 0)
       {
@@ -368,51 +1233,29 @@ void xreg::MultiLevelMultiObjRegi::run()
         xregASSERT(static_vol_poses.size() == num_static_vols);
 
         dout() << "computing the poses used for each static object..." << std::endl;
-        static_vol_poses_used.resize(num_static_vols);
+        static_vol_poses_used[regi_idx].resize(num_static_vols);
         for (size_type static_idx = 0; static_idx < num_static_vols; ++static_idx)
         {
-          static_vol_poses_used[static_idx] = static_vol_poses[static_idx]->get(this);
+          static_vol_poses_used[regi_idx][static_idx] = static_vol_poses[static_idx]->get(this);
         }
 
-        dout() << "first static vol... global index: " << single_regi.static_vols[0] << std::endl;
-        ray_caster.set_use_bg_projs(false);
-        ray_caster.use_proj_store_replace_method();
-        ray_caster.set_num_projs(num_fixed_imgs_this_level);
-        ray_caster.distribute_xform_among_cam_models(static_vol_poses_used[0]);
-
-        dout() << "computing..." << std::endl;
-        ray_caster.compute(single_regi.static_vols[0]);
+        // the static vols are only ray cast when their poses (or the ray caster
+        // settings) differ from the previous registration that used them
+        ray_caster.set_static_vols(single_regi.static_vols, static_vol_poses_used[regi_idx]);
 
-        for (size_type static_idx = 1; static_idx < num_static_vols; ++static_idx)
+        if (ray_caster.update_static_vols_bg_projs())
         {
-          dout() << "static vol " << static_idx << " global index: "
-                 << single_regi.static_vols[static_idx] << std::endl;
-
-          ray_caster.use_proj_store_accum_method();
-          ray_caster.distribute_xform_among_cam_models(static_vol_poses_used[static_idx]);
-       
-          dout() << "computing..." << std::endl; 
-          ray_caster.compute(single_regi.static_vols[static_idx]);
+          dout() << "computed bg projs of static vols..." << std::endl;
         }
-
-        // need to copy the bg images out of the ray caster's buffer, so they will not be
-        // overwritten
-        
-        dout() << "deep copying bg projs from ray caster..." << std::endl;
-
-        RayCaster::ProjList bg_imgs(num_fixed_imgs_this_level);
-        for (size_type fixed_idx = 0; fixed_idx < num_fixed_imgs_this_level; ++fixed_idx)
+        else
         {
-          bg_imgs[fixed_idx] = ITKImageDeepCopy(ray_caster.proj(fixed_idx).GetPointer());
+          dout() << "reusing cached bg projs of static vols..." << std::endl;
         }
-
-        dout() << "setting bg projs into ray caster..." << std::endl;
-        ray_caster.set_use_bg_projs(true);
-        ray_caster.set_bg_projs(bg_imgs);
       }
       else
       {
         dout() << "not using bg projs..." << std::endl;
+        ray_caster.clear_static_vols();
         ray_caster.set_use_bg_projs(false);
         ray_caster.use_proj_store_replace_method();
       }
@@ -423,15 +1266,46 @@ void xreg::MultiLevelMultiObjRegi::run()
 
       regi.set_debug_save_iter_debug_info(save_debug_info);
 
+      if (obj_fn_cache)
+      {
+        // the level and index identify the metrics, images and ray caster of
+        // this registration, the static volume poses change the background
+        std::string cache_config_desc = "level-" + std::to_string(lvl_idx) +
+                                        "/regi-" + std::to_string(regi_idx);
+
+        for (const auto& static_pose : static_vol_poses_used[regi_idx])
+        {
+          cache_config_desc.append(reinterpret_cast<const char*>(static_pose.matrix().data()),
+                                   sizeof(CoordScalar) * static_pose.matrix().size());
+        }
+
+        regi.set_obj_fn_cache(obj_fn_cache, cache_config_desc);
+      }
+
       dout() << "setting ray caster in regi obj" << std::endl;
-      regi.set_ray_caster(lvl.ray_caster, single_regi.mov_vols, false);
+      regi.set_ray_caster(regi_ray_casters[regi_idx], single_regi.mov_vols, false);
       
       dout() << "setting sim metrics in regi obj" << std::endl;
-      regi.set_sim_metrics(lvl.sim_metrics, false);
+      regi.set_sim_metrics(*regi_sim_metrics[regi_idx], false);
    
       dout() << "calling regi setup()..." << std::endl; 
       regi.setup();
 
+      if (lvl.use_plateau_stop)
+      {
+        // each regi has its own monitor state, since regis may run concurrently
+        if (!single_regi.plateau_stop_monitor ||
+            (single_regi.plateau_stop_monitor->attached_regi() != &regi))
+        {
+          dout() << "attaching plateau stop monitor..." << std::endl;
+          single_regi.plateau_stop_monitor = std::make_shared<Intensity2D3DRegiPlateauStop>();
+          single_regi.plateau_stop_monitor->attach(&regi);
+        }
+
+        // the monitor state is reset when the regi starts running
+        single_regi.plateau_stop_monitor->criteria = lvl.plateau_stop;
+      }
+
       // set initial pose estimates and reference frames
       dout() << "setting initial pose estimates..." << std::endl;
       for (size_type mov_vol_idx = 0; mov_vol_idx < num_mov_vols; ++mov_vol_idx)
@@ -484,12 +1358,25 @@ void xreg::MultiLevelMultiObjRegi::run()
       {
         f();
       }
+    };
+
+    auto finish_regi = [&] (const size_type regi_idx)
+    {
+      xregPROFILE_SCOPE("regi-finish");
+
+      Level::SingleRegi& single_regi = lvl.regis[regi_idx];
+
+      auto& regi = *single_regi.regi;
+
+      const size_type num_mov_vols = single_regi.mov_vols.size();
 
-      dout() << "running regi..." << std::endl; 
-      regi.run();
+      if (regi.stop_requested())
+      {
+        dout() << "regi " << regi_idx << " stopped early: " << regi.stop_reason() << std::endl;
+      }
 
       // retrieve registration params
-      dout() << "retrieving registration transforms..." << std::endl;
+      dout() << "retrieving registration transforms of regi " << regi_idx << "..." << std::endl;
       for (size_type mov_vol_idx = 0; mov_vol_idx < num_mov_vols; ++mov_vol_idx)
       {
         cur_cam_to_vols[single_regi.mov_vols[mov_vol_idx]] = regi.regi_xform(mov_vol_idx);
@@ -506,35 +1393,114 @@ void xreg::MultiLevelMultiObjRegi::run()
 
         dst_debug_info->do_not_use_static_vol_heuristic = true;
 
-        if (num_static_vols > 0)
+        if (!single_regi.static_vols.empty())
         {
           dst_debug_info->static_vols      = single_regi.static_vols;
-          dst_debug_info->static_vol_poses = static_vol_poses_used;
+          dst_debug_info->static_vol_poses = static_vol_poses_used[regi_idx];
+        }
+
+        if (result_cache)
+        {
+          lvl_cache_results.regi_debug_info[regi_idx] = dst_debug_info;
+        }
+
+        if (debug_info_stream)
+        {
+          dout() << "queueing debug info of regi " << regi_idx << " for writing..." << std::endl;
+          debug_info_stream->add_regi_results(lvl_idx, regi_idx, dst_debug_info);
+          
+          // the in-memory copy is released once written
+          dst_debug_info = nullptr;
         }
       }
 
       if (dealloc_resources)
       {
         single_regi.regi = nullptr;
+        single_regi.ray_caster = nullptr;
+        single_regi.sim_metrics.clear();
+      }
+    };
+
+    // run each stage of regis
+    for (size_type stage_idx = 0; stage_idx < num_stages; ++stage_idx)
+    {
+      IndexList stage_regi_inds;
+      for (size_type regi_idx = 0; regi_idx < num_regis; ++regi_idx)
+      {
+        if (regi_stages[regi_idx] == stage_idx)
+        {
+          stage_regi_inds.push_back(regi_idx);
+        }
+      }
+
+      const size_type num_regis_this_stage = stage_regi_inds.size();
+
+      for (const size_type regi_idx : stage_regi_inds)
+      {
+        setup_regi(regi_idx);
+      }
+
+      if (num_regis_this_stage == 1)
+      {
+        dout() << "running regi..." << std::endl; 
+        
+        // time spent directly within this region is the optimizer overhead
+        xregPROFILE_SCOPE("optimizer");
+        lvl.regis[stage_regi_inds[0]].regi->run();
+      }
+      else
+      {
+        dout() << "running " << num_regis_this_stage << " regis concurrently..." << std::endl;
+
+        auto run_regis = [&lvl,&stage_regi_inds] (const RangeType& r)
+        {
+          for (size_type i = r.begin(); i < r.end(); ++i)
+          {
+            xregPROFILE_SCOPE("optimizer");
+            lvl.regis[stage_regi_inds[i]].regi->run();
+          }
+        };
+
+        ParallelFor(run_regis, RangeType(0, num_regis_this_stage));
+      }
+
+      for (const size_type regi_idx : stage_regi_inds)
+      {
+        finish_regi(regi_idx);
       }
-    }  // end for each regi
+    }  // end for each stage
+
+    if (result_cache)
+    {
+      dout() << "writing result cache entry of level " << lvl_idx << ": "
+             << result_cache_keys[lvl_idx] << std::endl;
+
+      lvl_cache_results.cam_to_vols = cur_cam_to_vols;
+
+      result_cache->write(result_cache_keys[lvl_idx], lvl_cache_results);
+    }
    
     if (dealloc_resources)
     {
       lvl.ray_caster = nullptr;
       lvl.sim_metrics.clear();
     }
-  }  // end for each level
-  
-  tmr.stop();
-  
-  const double multi_level_run_time_secs = tmr.elapsed_seconds();
 
-  dout() << "multi-level run time (seconds): " << multi_level_run_time_secs << std::endl;
+    if (profile_levels)
+    {
+      ProfileResults lvl_prof = CollectProfileResults();
 
-  if (save_debug_info)
-  {
-    debug_info->multi_level_run_time_secs = multi_level_run_time_secs;
-  }
+      dout() << "profile of level " << lvl_idx << ":" << std::endl;
+      lvl_prof.print(dout(), "  ");
+
+      if (save_debug_info)
+      {
+        debug_info->level_profiles[lvl_idx] = std::move(lvl_prof);
+      }
+    }
+  }  // end for each level
+
+  finish_run();
 }
 
@@ -25,16 +25,21 @@
 #ifndef XREGMULTIOBJMULTILEVEL2D3DREGI_H_
 #define XREGMULTIOBJMULTILEVEL2D3DREGI_H_
 
+#include <future>
+
 #include "xregProjData.h"
 #include "xregRayCastInterface.h"
 #include "xregImgSimMetric2D.h"
 #include "xregIntensity2D3DRegi.h"
+#include "xregIntensity2D3DRegiPlateauStop.h"
 
 namespace xreg
 {
 
 // Forward declarations
 struct DebugRegiResultsMultiLevel;
+class MultiLevel2D3DRegiDebugH5Stream;
+class MultiLevelRegiResultCache;
 
 // General rule: this struct assumes the user creates the instance for the
 // appropriate objects: ray casters, sim metrics, regi, vol list, and sets 
@@ -47,6 +52,10 @@ struct MultiLevelMultiObjRegi : ObjWithOStream
 
   using IndexList = Intensity2D3DRegi::IndexList;
   
+  /// \brief Entry of a dependency list indicating that the current pose
+  ///        estimates of any volume may be used.
+  static const size_type kDEPENDS_ON_ALL_VOLS = ~size_type(0);
+
   struct RefFrameInfo
   {
     FrameTransform ref_frame;
@@ -60,6 +69,12 @@ struct MultiLevelMultiObjRegi : ObjWithOStream
     virtual bool standard() const { return true; }
 
     virtual RefFrameInfo get(const MultiLevelMultiObjRegi* multi_level_multi_obj_regi) const = 0;
+
+    /// \brief The volumes whose current pose estimates are used by get().
+    ///
+    /// This is used to determine which registrations of a level are independent.
+    /// The default conservatively indicates a dependency on every volume.
+    virtual IndexList cur_pose_vol_deps() const { return IndexList(1, kDEPENDS_ON_ALL_VOLS); }
   };
 
   struct StaticRefFrame : RefFrame
@@ -67,6 +82,8 @@ struct MultiLevelMultiObjRegi : ObjWithOStream
     RefFrameInfo info;
 
     RefFrameInfo get(const MultiLevelMultiObjRegi* multi_level_multi_obj_regi) const override;
+
+    IndexList cur_pose_vol_deps() const override { return IndexList(); }
   };
 
   struct CamAlignRefFrameWithCurPose : RefFrame
@@ -79,6 +96,8 @@ struct MultiLevelMultiObjRegi : ObjWithOStream
 
     RefFrameInfo get(const MultiLevelMultiObjRegi* multi_level_multi_obj_regi) const override;
 
+    IndexList cur_pose_vol_deps() const override { return IndexList(1, vol_idx); }
+
     FrameTransform compute_inter(const FrameTransform& cam_to_vol) const;
   };
 
@@ -94,6 +113,10 @@ struct MultiLevelMultiObjRegi : ObjWithOStream
     FrameTransform inter_to_vol = FrameTransform::Identity();
     
     RefFrameInfo get(const MultiLevelMultiObjRegi*) const override;
+
+    // dyn_vol_idx is the index of a volume within the registration, so only
+    // the current estimates of the registration are used
+    IndexList cur_pose_vol_deps() const override { return IndexList(); }
   };
 
   struct Level
@@ -110,16 +133,28 @@ struct MultiLevelMultiObjRegi : ObjWithOStream
     /// This must be set prior to registration
     IndexList fixed_imgs_to_use;
 
+    /// The downsampling factor of each volume used at this level, when empty
+    /// the full resolution volumes are used. This is computed by run() when
+    /// use_vol_pyramid is true, otherwise it may be set prior to registration.
+    std::vector<double> vol_ds_factors;
+
     struct SingleRegi
     {
       struct InitPose
       {
         virtual FrameTransform get(const MultiLevelMultiObjRegi* multi_level_multi_obj_regi) const = 0;
+
+        /// \brief The volumes whose current pose estimates are used by get().
+        ///
+        /// The default conservatively indicates a dependency on every volume.
+        virtual IndexList cur_pose_vol_deps() const { return IndexList(1, kDEPENDS_ON_ALL_VOLS); }
       };
 
       struct InitPoseId : InitPose
       {
         FrameTransform get(const MultiLevelMultiObjRegi* multi_level_multi_obj_regi) const;
+
+        IndexList cur_pose_vol_deps() const override { return IndexList(); }
       };
 
       struct InitPosePrevPoseEst : InitPose
@@ -127,6 +162,8 @@ struct MultiLevelMultiObjRegi : ObjWithOStream
         size_type vol_idx;
         
         FrameTransform get(const MultiLevelMultiObjRegi* multi_level_multi_obj_regi) const;
+
+        IndexList cur_pose_vol_deps() const override { return IndexList(1, vol_idx); }
       };
 
       struct InitPosePrevPoseEstTransOnly : InitPose
@@ -134,6 +171,8 @@ struct MultiLevelMultiObjRegi : ObjWithOStream
         size_type vol_idx;
         
         FrameTransform get(const MultiLevelMultiObjRegi* multi_level_multi_obj_regi) const;
+
+        IndexList cur_pose_vol_deps() const override { return IndexList(1, vol_idx); }
       };
 
       struct InitPosePrevPoseEstRotOnly : InitPose
@@ -141,6 +180,8 @@ struct MultiLevelMultiObjRegi : ObjWithOStream
         size_type vol_idx;
         
         FrameTransform get(const MultiLevelMultiObjRegi* multi_level_multi_obj_regi) const;
+
+        IndexList cur_pose_vol_deps() const override { return IndexList(1, vol_idx); }
       };
 
       using InitPoseList = std::vector<std::shared_ptr<InitPose>>;
@@ -166,9 +207,135 @@ struct MultiLevelMultiObjRegi : ObjWithOStream
       std::shared_ptr<Intensity2D3DRegi> regi;
 
       std::vector<std::function<void()>> fns_to_call_right_before_regi_run;
+
+      /// Optional ray caster used only by this registration, when null the
+      /// ray caster of the level is used. A separate ray caster is required
+      /// for this registration to run concurrently with others.
+      Intensity2D3DRegi::RayCasterPtr ray_caster;
+
+      /// Optional similarity metrics (one per view) used only by this
+      /// registration, when empty the metrics of the level are used. These
+      /// should be provided along with a separate ray caster.
+      Intensity2D3DRegi::SimMetricList sim_metrics;
+
+      /// The plateau stop monitor attached to regi by run(), when the level
+      /// uses plateau stopping.
+      std::shared_ptr<Intensity2D3DRegiPlateauStop> plateau_stop_monitor;
     };
 
     std::vector<SingleRegi> regis;
+
+    /// When true, registrations of this level which are independent are run
+    /// concurrently. Two registrations are independent when neither uses the
+    /// pose estimates (through initial poses, static volume poses or reference
+    /// frames) of volumes moved by the other, they do not move the same
+    /// volumes and they do not share a ray caster or similarity metrics.
+    /// Dependent registrations are run in the order they are listed. The
+    /// callbacks in fns_to_call_right_before_regi_run are always called
+    /// serially, but may be called before an independent registration listed
+    /// earlier has finished.
+    bool run_independent_regis_concurrently = false;
+
+    /// When true, each registration of this level is stopped once its
+    /// estimates reach a plateau, as defined by plateau_stop. The stop reasons
+    /// are recorded in the debug results.
+    bool use_plateau_stop = false;
+
+    Intensity2D3DRegiPlateauStop::Criteria plateau_stop;
+
+    /// Description of the settings of this level which are not exposed by the
+    /// base registration interfaces (e.g. optimizer and similarity metric
+    /// parameters, regularization, random seeds), used in the key of the
+    /// level's entry in result_cache. Required when result_cache is used, run()
+    /// throws when it is empty.
+    std::string result_cache_desc;
+  };
+
+  /// \brief Downsampled fixed images and masks required by the levels.
+  ///
+  /// An entry is built once for each (fixed image, downsampling factor) pair
+  /// that appears in the levels. Entries are shared by levels using the same
+  /// factor and are reused by subsequent calls to run() while the source image
+  /// and mask objects are unmodified. Passing the same downsampled objects to
+  /// the similarity metrics also allows their mask dependent state to be reused.
+  struct FixedImgPyramid
+  {
+    struct Entry
+    {
+      size_type fixed_idx;
+      
+      double ds_factor;
+
+      // Identify the source objects and the state they were downsampled from
+      const ProjDataF32::Proj* src_img;
+      itk::ModifiedTimeType src_img_mtime;
+      
+      const ImgSimMetric2D::ImageMask* src_mask;
+      itk::ModifiedTimeType src_mask_mtime;
+
+      ProjDataF32::ProjPtr img;
+
+      ImgSimMetric2D::ImageMaskPtr mask;
+    };
+
+    std::vector<Entry> entries;
+
+    /// \brief Builds any missing or out of date entries needed by the levels.
+    ///
+    /// Out of date entries are replaced and entries no longer required are
+    /// discarded. The new entries are downsampled in parallel.
+    void update(const ProjDataF32List& fixed_proj_data, const Mask2DList& masks_2d,
+                const std::vector<Level>& levels);
+
+    /// \brief Retrieve the downsampled projection data for a fixed image.
+    ///
+    /// The projection metadata (e.g. camera model) is always recomputed from
+    /// the source projection, only the downsampled pixel data is cached.
+    ProjDataF32 proj_data(const ProjDataF32& src_proj, const size_type fixed_idx,
+                          const double ds_factor) const;
+
+    /// \brief Retrieve the downsampled mask for a fixed image, this is null
+    ///        when no mask is used with the fixed image.
+    ImgSimMetric2D::ImageMaskPtr mask(const size_type fixed_idx, const double ds_factor) const;
+    
+    void clear();
+
+  private:
+    const Entry& find_entry(const size_type fixed_idx, const double ds_factor) const;
+  };
+
+  /// \brief Downsampled volumes required by the levels.
+  ///
+  /// An entry is built once for each (volume, downsampling factor) pair that
+  /// appears in the levels' vol_ds_factors and is reused by subsequent calls
+  /// to run() while the source volume is unmodified.
+  struct VolPyramid
+  {
+    struct Entry
+    {
+      size_type vol_idx;
+
+      double ds_factor;
+
+      // Identify the source object and the state it was downsampled from
+      const RayCaster::Vol* src_vol;
+      itk::ModifiedTimeType src_vol_mtime;
+
+      RayCaster::VolPtr vol;
+    };
+
+    std::vector<Entry> entries;
+
+    /// \brief Builds any missing or out of date entries needed by the levels.
+    ///
+    /// Out of date entries are replaced and entries no longer required are
+    /// discarded. The new entries are downsampled in parallel.
+    void update(const RayCaster::VolList& src_vols, const std::vector<Level>& levels);
+
+    /// \brief Retrieve the volumes to use at a level.
+    RayCaster::VolList vols(const RayCaster::VolList& src_vols, const Level& lvl) const;
+
+    void clear();
   };
 
   /// This must be set prior to registration
@@ -189,6 +356,24 @@ struct MultiLevelMultiObjRegi : ObjWithOStream
   /// This must be set prior to registration
   FrameTransformList init_cam_to_vols;
 
+  /// When true, run() computes the vol_ds_factors of each level so that the
+  /// voxel spacings of each volume roughly match the spacings of the level's
+  /// (downsampled) detector pixels, projected to the volume's center using the
+  /// initial pose estimates. The factors are powers of two, so that levels may
+  /// share downsampled volumes.
+  bool use_vol_pyramid = false;
+
+  /// The largest voxel spacing allowed by the volume pyramid, relative to the
+  /// finest projected detector spacing of a level.
+  double vol_pyramid_max_spacing_wrt_det = 1.0;
+
+  /// The maximum number of times a volume is halved by the volume pyramid.
+  size_type vol_pyramid_max_num_halvings = 3;
+
+  /// Downsampled volumes, which are populated by run() when any level uses
+  /// downsampled volumes. This persists between calls to run().
+  VolPyramid vol_pyramid;
+
   FrameTransformList cur_cam_to_vols;
 
   /// This must be set prior to registration
@@ -201,9 +386,21 @@ struct MultiLevelMultiObjRegi : ObjWithOStream
 
   std::vector<Level> levels;
 
+  /// Downsampled fixed images and masks, which are populated by run().
+  /// This persists between calls to run() so that the downsampling is only
+  /// performed again when the fixed images, masks or downsampling factors change.
+  FixedImgPyramid fixed_img_pyramid;
+
   // This will be allocated by calling set_save_debug_info()
   std::shared_ptr<DebugRegiResultsMultiLevel> debug_info;
 
+  // This will be allocated by calling set_stream_debug_info()
+  // When allocated, the debug info of each registration is written to disk in the
+  // background as soon as the registration finishes and the corresponding entry of
+  // debug_info->regi_results is left null. The remaining debug info is written by
+  // calling debug_info_stream->finish(*debug_info) after run().
+  std::shared_ptr<MultiLevel2D3DRegiDebugH5Stream> debug_info_stream;
+
   // (Advanced Feature)
   // Whether or not certain objects (ray casters, sim metrics, 2D/3D regi objects) should
   // be deallocated when they are no longer necessary. This behavior is useful when a
@@ -229,10 +426,50 @@ struct MultiLevelMultiObjRegi : ObjWithOStream
   // this flag is set to false.
   bool sim_metrics_need_resources_alloc = true;
 
+  // Whether or not to profile the time spent in each stage of the registration
+  // pipeline (e.g. resource allocation, ray casting, similarity metric
+  // computation, optimizer overhead). When set, profiling is enabled during
+  // run(), the profiler counters are reset at the start of each level and a
+  // breakdown is printed to the debug stream at the end of each level. The
+  // breakdowns are also stored in debug_info->level_profiles when debug info
+  // is saved.
+  bool profile_levels = false;
+
+  // Optional cache of objective function values shared by every registration
+  // of every level, see Intensity2D3DRegi::set_obj_fn_cache(). The level and
+  // registration indices are part of each registration's configuration key,
+  // so values are only re-used by the same registration of the same level,
+  // e.g. when run() is called again on the same case. The cache may be
+  // persisted between processes with its read() and write() methods.
+  std::shared_ptr<Intensity2D3DRegiObjFnCache> obj_fn_cache;
+
+  // Optional store of the results of each level, keyed by a fingerprint of
+  // the contents of the inputs (volumes, fixed images, cameras, masks, initial
+  // poses) and of the configurations of the level and every preceding level,
+  // see MakeMultiLevelRegiLevelKey(). run() starts at the first level without
+  // a stored entry, so repeating a registration returns the previous final
+  // poses (and debug info) immediately and a change to only the last level
+  // only runs the last level. An entry written without debug info is not used
+  // when debug info is saved.
+  std::shared_ptr<MultiLevelRegiResultCache> result_cache;
+
+  // The number of levels whose results were retrieved from result_cache by the
+  // most recent call to run().
+  size_type num_levels_from_result_cache = 0;
+
   /// This must be set prior to registration if debug info is to be saved
   /// The debug_info member is valid after this
   void set_save_debug_info(const bool save_debug_info);
 
+  /// \brief Saves debug info, streaming it to an HDF5 file at path during
+  ///        registration instead of accumulating it in memory.
+  ///
+  /// max_num_queued_regis bounds the number of registration results waiting to
+  /// be written; 0 -> no limit.
+  /// This must be set prior to registration, the debug_info and
+  /// debug_info_stream members are valid after this.
+  void set_stream_debug_info(const std::string& path, const size_type max_num_queued_regis = 2);
+
   void run();
 
   std::shared_ptr<StaticRefFrame>
@@ -240,6 +477,18 @@ struct MultiLevelMultiObjRegi : ObjWithOStream
   
   std::shared_ptr<StaticRefFrame>
   static MakeIdRefFrame();
+
+  /// \brief Starts building the device programs of the ray casters and
+  ///        similarity metrics of several levels on background threads.
+  ///
+  /// Each object builds its programs on a separate thread (see
+  /// RayCaster::prebuild_progs() and ImgSimMetric2D::prebuild_progs()), so
+  /// that compilation overlaps with other work, such as reading volumes and
+  /// projections. The programs are reused when resources are allocated by
+  /// run(). The ray casters and similarity metrics of the levels must not be
+  /// used until the returned future is ready; calling get() on it waits for
+  /// every build and rethrows any build error.
+  static std::future<void> PrebuildProgsAsync(const std::vector<Level>& levels);
 };
 
 }  // xreg
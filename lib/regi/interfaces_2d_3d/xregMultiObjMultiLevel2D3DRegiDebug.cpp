@@ -24,6 +24,8 @@
 
 #include "xregMultiObjMultiLevel2D3DRegiDebug.h"
 
+#include "xregBackgroundTaskQueue.h"
+#include "xregExceptionUtils.h"
 #include "xregHDF5.h"
 #include "xregH5ProjDataIO.h"
 #include "xregHUToLinAtt.h"
@@ -107,9 +109,77 @@ struct WriteDebugProjDataInfo : boost::static_visitor<void>
   }
 };
 
-}  // un-named
+H5::Group OpenOrCreateGroupH5(const std::string& name, H5::Group* h5)
+{
+  return ObjectInGroupH5(name, *h5) ? h5->openGroup(name) : h5->createGroup(name);
+}
 
-void xreg::WriteMultiLevel2D3DRegiDebugH5(const DebugRegiResultsMultiLevel& results, H5::Group* h5)
+void WriteProfileResultsH5(const ProfileResults& prof, H5::Group* h5)
+{
+  const size_type num_regions = prof.regions.size();
+
+  WriteSingleScalarH5("num-regions", num_regions, h5);
+
+  for (size_type region_idx = 0; region_idx < num_regions; ++region_idx)
+  {
+    const auto& r = prof.regions[region_idx];
+
+    H5::Group region_g = h5->createGroup(fmt::format("{:03d}", region_idx));
+
+    WriteStringH5("name", r.name, &region_g, false);
+    WriteStringH5("path", r.path, &region_g, false);
+    
+    WriteSingleScalarH5("depth", r.depth, &region_g);
+    WriteSingleScalarH5("num-calls", r.num_calls, &region_g);
+    WriteSingleScalarH5("total-secs", r.total_secs, &region_g);
+    WriteSingleScalarH5("self-secs", r.self_secs, &region_g);
+  }
+
+  WriteSingleScalarH5("host-mem-cur-bytes", prof.host_mem.cur_bytes, h5);
+  WriteSingleScalarH5("host-mem-peak-bytes", prof.host_mem.peak_bytes, h5);
+  WriteSingleScalarH5("device-mem-cur-bytes", prof.device_mem.cur_bytes, h5);
+  WriteSingleScalarH5("device-mem-peak-bytes", prof.device_mem.peak_bytes, h5);
+}
+
+ProfileResults ReadProfileResultsH5(const H5::Group& h5)
+{
+  ProfileResults prof;
+
+  const size_type num_regions = ReadSingleScalarH5ULong("num-regions", h5);
+
+  prof.regions.resize(num_regions);
+
+  for (size_type region_idx = 0; region_idx < num_regions; ++region_idx)
+  {
+    auto& r = prof.regions[region_idx];
+
+    const H5::Group region_g = h5.openGroup(fmt::format("{:03d}", region_idx));
+
+    r.name = ReadStringH5("name", region_g);
+    r.path = ReadStringH5("path", region_g);
+
+    r.depth      = ReadSingleScalarH5ULong("depth", region_g);
+    r.num_calls  = ReadSingleScalarH5ULong("num-calls", region_g);
+    r.total_secs = ReadSingleScalarH5Double("total-secs", region_g);
+    r.self_secs  = ReadSingleScalarH5Double("self-secs", region_g);
+  }
+
+  // memory usage was not recorded by older versions
+  if (ObjectInGroupH5("host-mem-cur-bytes", h5))
+  {
+    prof.host_mem.cur_bytes    = ReadSingleScalarH5ULong("host-mem-cur-bytes", h5);
+    prof.host_mem.peak_bytes   = ReadSingleScalarH5ULong("host-mem-peak-bytes", h5);
+    prof.device_mem.cur_bytes  = ReadSingleScalarH5ULong("device-mem-cur-bytes", h5);
+    prof.device_mem.peak_bytes = ReadSingleScalarH5ULong("device-mem-peak-bytes", h5);
+  }
+
+  return prof;
+}
+
+// regis_already_written is optional, when provided, the results of any
+// registrations flagged as already written are skipped.
+void WriteMultiLevel2D3DRegiDebugH5Helper(const DebugRegiResultsMultiLevel& results, H5::Group* h5,
+                                          const std::vector<std::vector<bool>>* regis_already_written)
 {
   if (!results.vols.empty())
   {
@@ -157,11 +227,11 @@ void xreg::WriteMultiLevel2D3DRegiDebugH5(const DebugRegiResultsMultiLevel& resu
 
   WriteSingleScalarH5("num-levels", num_levels, h5);
 
-  H5::Group levels_g = h5->createGroup("multi-res-levels");
+  H5::Group levels_g = OpenOrCreateGroupH5("multi-res-levels", h5);
 
   for (size_type level_idx = 0; level_idx < num_levels; ++level_idx)
   {
-    H5::Group lvl_g = levels_g.createGroup(fmt::format("{:03d}", level_idx));
+    H5::Group lvl_g = OpenOrCreateGroupH5(fmt::format("{:03d}", level_idx), &levels_g);
   
     WriteSingleScalarH5("ds-factor", results.multi_res_levels[level_idx], &lvl_g);
 
@@ -169,14 +239,31 @@ void xreg::WriteMultiLevel2D3DRegiDebugH5(const DebugRegiResultsMultiLevel& resu
     xregASSERT(results.regi_names[level_idx].size() == num_regis_this_level);
     
     WriteSingleScalarH5("num-regi", num_regis_this_level, &lvl_g); 
+
+    if (level_idx < results.level_profiles.size())
+    {
+      H5::Group prof_g = lvl_g.createGroup("profile");
+      
+      WriteProfileResultsH5(results.level_profiles[level_idx], &prof_g);
+    }
     
     for (size_type regi_idx = 0; regi_idx < num_regis_this_level; ++regi_idx)
     {
-      H5::Group regi_g = lvl_g.createGroup(fmt::format("regi-{:03d}", regi_idx));
+      H5::Group regi_g = OpenOrCreateGroupH5(fmt::format("regi-{:03d}", regi_idx), &lvl_g);
 
       WriteStringH5("name", results.regi_names[level_idx][regi_idx], &regi_g, false);
 
-      WriteSingleRegiDebugResultsH5(*results.regi_results[level_idx][regi_idx], &regi_g);
+      const bool already_written = regis_already_written &&
+                                   (level_idx < regis_already_written->size()) &&
+                                   (regi_idx < (*regis_already_written)[level_idx].size()) &&
+                                   (*regis_already_written)[level_idx][regi_idx];
+
+      if (!already_written)
+      {
+        xregASSERT(bool(results.regi_results[level_idx][regi_idx]));
+        
+        WriteSingleRegiDebugResultsH5(*results.regi_results[level_idx][regi_idx], &regi_g);
+      }
     }
   }
 
@@ -203,6 +290,13 @@ void xreg::WriteMultiLevel2D3DRegiDebugH5(const DebugRegiResultsMultiLevel& resu
   }
 }
 
+}  // un-named
+
+void xreg::WriteMultiLevel2D3DRegiDebugH5(const DebugRegiResultsMultiLevel& results, H5::Group* h5)
+{
+  WriteMultiLevel2D3DRegiDebugH5Helper(results, h5, nullptr);
+}
+
 void xreg::WriteMultiLevel2D3DRegiDebugToDisk(const DebugRegiResultsMultiLevel& results, const std::string& path)
 {
   H5::H5File h5(path, H5F_ACC_TRUNC);
@@ -213,6 +307,91 @@ void xreg::WriteMultiLevel2D3DRegiDebugToDisk(const DebugRegiResultsMultiLevel&
   h5.close();
 }
 
+xreg::MultiLevel2D3DRegiDebugH5Stream::MultiLevel2D3DRegiDebugH5Stream(const std::string& path,
+                                                                       const size_type max_num_queued_regis)
+  : path_(path),
+    h5_(new H5::H5File(path, H5F_ACC_TRUNC)),
+    writer_(new BackgroundTaskQueue(1))  // HDF5 calls must not be made concurrently
+{
+  writer_->set_max_num_queued_tasks(max_num_queued_regis);
+}
+
+xreg::MultiLevel2D3DRegiDebugH5Stream::~MultiLevel2D3DRegiDebugH5Stream()
+{
+  // BackgroundTaskQueue's destructor waits for the pending writes (discarding
+  // any errors), the file is closed once h5_ is destroyed
+  writer_.reset();
+}
+
+void xreg::MultiLevel2D3DRegiDebugH5Stream::add_regi_results(const size_type level_idx,
+                                                             const size_type regi_idx,
+                                                             SingleRegiDebugResultsPtr regi_results)
+{
+  xregASSERT(!finished());
+  xregASSERT(bool(regi_results));
+
+  if (regis_written_.size() <= level_idx)
+  {
+    regis_written_.resize(level_idx + 1);
+  }
+
+  auto& lvl_regis_written = regis_written_[level_idx];
+
+  if (lvl_regis_written.size() <= regi_idx)
+  {
+    lvl_regis_written.resize(regi_idx + 1, false);
+  }
+
+  if (lvl_regis_written[regi_idx])
+  {
+    xregThrow("debug results for level %lu, regi %lu already added to stream!",
+              static_cast<unsigned long>(level_idx), static_cast<unsigned long>(regi_idx));
+  }
+
+  lvl_regis_written[regi_idx] = true;
+
+  H5::H5File* h5 = h5_.get();
+
+  // the task holds the only remaining reference to the results in the typical
+  // case and they are freed once written
+  writer_->add([h5,level_idx,regi_idx,regi_results] ()
+               {
+                 H5::Group levels_g = OpenOrCreateGroupH5("multi-res-levels", h5);
+                 
+                 H5::Group lvl_g = OpenOrCreateGroupH5(fmt::format("{:03d}", level_idx), &levels_g);
+                 
+                 H5::Group regi_g = OpenOrCreateGroupH5(fmt::format("regi-{:03d}", regi_idx), &lvl_g);
+
+                 WriteSingleRegiDebugResultsH5(*regi_results, &regi_g);
+
+                 h5->flush(H5F_SCOPE_GLOBAL);
+               });
+}
+
+void xreg::MultiLevel2D3DRegiDebugH5Stream::finish(const DebugRegiResultsMultiLevel& results)
+{
+  xregASSERT(!finished());
+
+  writer_->wait();
+
+  WriteMultiLevel2D3DRegiDebugH5Helper(results, h5_.get(), &regis_written_);
+
+  h5_->flush(H5F_SCOPE_GLOBAL);
+  h5_->close();
+
+  h5_.reset();
+}
+
+bool xreg::MultiLevel2D3DRegiDebugH5Stream::finished() const
+{
+  return !h5_;
+}
+
+const std::string& xreg::MultiLevel2D3DRegiDebugH5Stream::path() const
+{
+  return path_;
+}
+
 xreg::DebugRegiResultsMultiLevel xreg::ReadMultiLevel2D3DRegiDebugH5(const H5::Group& h5)
 {
   DebugRegiResultsMultiLevel results;
@@ -328,6 +507,13 @@ xreg::DebugRegiResultsMultiLevel xreg::ReadMultiLevel2D3DRegiDebugH5(const H5::G
 
       cur_level_results[regi_idx] = regi_results;
     }
+
+    if (ObjectInGroupH5("profile", lvl_g))
+    {
+      results.level_profiles.resize(level_idx + 1);
+      
+      results.level_profiles[level_idx] = ReadProfileResultsH5(lvl_g.openGroup("profile"));
+    }
   }
   
   if (ObjectInGroupH5("proj-pre-proc-info", h5))
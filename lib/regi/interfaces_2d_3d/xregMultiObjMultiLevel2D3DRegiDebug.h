@@ -25,15 +25,29 @@
 #ifndef XREGMULTIOBJMULTILEVEL2D3DREGIDEBUG_H_
 #define XREGMULTIOBJMULTILEVEL2D3DREGIDEBUG_H_
 
+#include <memory>
+
 #include <boost/variant.hpp>
 
+#include "xregProfiler.h"
 #include "xregProjData.h"
 #include "xregProjPreProc.h"
 #include "xregIntensity2D3DRegiDebug.h"
 
+// Forward Declarations
+namespace H5
+{
+
+class H5File;
+
+}  // H5
+
 namespace xreg
 {
 
+// Forward Declarations
+class BackgroundTaskQueue;
+
 struct DebugRegiResultsMultiLevel
 {
   using ScalarList     = SingleRegiDebugResults::ScalarList;
@@ -94,6 +108,12 @@ struct DebugRegiResultsMultiLevel
   /// multi-resolution level.
   ListOfStrLists regi_names;
 
+  /// level_profiles[i] is the breakdown of time spent in the profiled regions
+  /// of the ith multi-resolution level, e.g. ray casting, similarity metric
+  /// computation, optimizer overhead. This is empty when profiling was not
+  /// enabled.
+  std::vector<ProfileResults> level_profiles;
+
   boost::optional<ProjPreProcParams> proj_pre_proc_info;
 
   /// \brief Computes the total number of projections (per view) that would
@@ -108,6 +128,71 @@ void WriteMultiLevel2D3DRegiDebugToDisk(const DebugRegiResultsMultiLevel& result
 
 DebugRegiResultsMultiLevel ReadMultiLevel2D3DRegiDebugH5(const H5::Group& h5);
 
+/// \brief Writes multi-level debug results to an HDF5 file while a registration
+///        is running.
+///
+/// The results of each single registration are written by a background thread
+/// as soon as they are added, after which they are released from memory. The
+/// remaining fields (volumes, projections, timings, names, etc.) are written
+/// by finish(). The resulting file has the same layout as one written by
+/// WriteMultiLevel2D3DRegiDebugH5() and may be read with the existing readers.
+class MultiLevel2D3DRegiDebugH5Stream
+{
+public:
+  using SingleRegiDebugResultsPtr = DebugRegiResultsMultiLevel::SingleRegiDebugResultsPtr;
+
+  /// \brief Constructor - creates (truncates) the file at path and starts the
+  ///        writer thread.
+  ///
+  /// Calls to add_regi_results() block once max_num_queued_regis results are
+  /// waiting to be written, bounding the memory consumed by the queue.
+  /// 0 -> no limit.
+  explicit MultiLevel2D3DRegiDebugH5Stream(const std::string& path,
+                                           const size_type max_num_queued_regis = 2);
+
+  /// \brief Destructor - waits for any queued results to be written.
+  ///
+  /// Unless finish() was called, the file will only contain the results of
+  /// the individual registrations.
+  ~MultiLevel2D3DRegiDebugH5Stream();
+
+  // no copying
+  MultiLevel2D3DRegiDebugH5Stream(const MultiLevel2D3DRegiDebugH5Stream&) = delete;
+  MultiLevel2D3DRegiDebugH5Stream& operator=(const MultiLevel2D3DRegiDebugH5Stream&) = delete;
+
+  /// \brief Queues the results of a single registration to be written.
+  ///
+  /// Each (level, regi) pair may only be added once.
+  void add_regi_results(const size_type level_idx, const size_type regi_idx,
+                        SingleRegiDebugResultsPtr regi_results);
+
+  /// \brief Waits for all queued results to be written, writes the remaining
+  ///        fields of results and closes the file.
+  ///
+  /// Entries of results.regi_results are not written when they have already
+  /// been added to the stream; they may be null.
+  void finish(const DebugRegiResultsMultiLevel& results);
+
+  bool finished() const;
+
+  const std::string& path() const;
+
+private:
+  std::string path_;
+
+  std::unique_ptr<H5::H5File> h5_;
+
+  // regis_written_[i][j] indicates that the jth registration of the ith level
+  // has been added to the stream.
+  std::vector<std::vector<bool>> regis_written_;
+
+  // declared after the file so that it is destroyed (waiting for all writes)
+  // before the file is closed
+  std::unique_ptr<BackgroundTaskQueue> writer_;
+};
+
+
+
 DebugRegiResultsMultiLevel ReadMultiLevel2D3DRegiDebugFromDisk(const std::string& path);
 
 std::tuple<xreg::RayCaster::VolList,
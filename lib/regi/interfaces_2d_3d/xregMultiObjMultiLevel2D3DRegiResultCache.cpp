@@ -0,0 +1,480 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "xregMultiObjMultiLevel2D3DRegiResultCache.h"
+
+#include <typeinfo>
+
+#include <fmt/format.h>
+
+#include "xregAssert.h"
+#include "xregHDF5.h"
+#include "xregIntensity2D3DRegiDebug.h"
+#include "xregRegi2D3DPenaltyFn.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+// increment when the fingerprints or the layout of cache entries change, so
+// that old entries are not used
+constexpr unsigned long kREGI_RESULT_CACHE_VERSION = 2;
+
+template <class tImg>
+void AddImgToFingerprint(const tImg* img, RegiInputFingerprint* fp)
+{
+  constexpr unsigned int kDIM = tImg::ImageDimension;
+
+  if (!img)
+  {
+    fp->add_str("null-img");
+    return;
+  }
+
+  fp->add_str("img");
+
+  const auto reg = img->GetBufferedRegion();
+
+  xregASSERT(reg == img->GetLargestPossibleRegion());
+
+  const auto& spacing = img->GetSpacing();
+  const auto& origin  = img->GetOrigin();
+  const auto& dir     = img->GetDirection();
+
+  for (unsigned int i = 0; i < kDIM; ++i)
+  {
+    fp->add_index(reg.GetSize()[i]);
+    fp->add_scalar(spacing[i]);
+    fp->add_scalar(origin[i]);
+
+    for (unsigned int j = 0; j < kDIM; ++j)
+    {
+      fp->add_scalar(dir(i,j));
+    }
+  }
+
+  const size_type num_bytes = sizeof(typename tImg::PixelType) * reg.GetNumberOfPixels();
+
+  fp->add_bytes_parallel(img->GetBufferPointer(), num_bytes);
+}
+
+void AddInitPoseToFingerprint(const MultiLevelMultiObjRegi::Level::SingleRegi::InitPose* init_pose,
+                              RegiInputFingerprint* fp)
+{
+  using SingleRegi = MultiLevelMultiObjRegi::Level::SingleRegi;
+
+  if (!init_pose)
+  {
+    fp->add_str("null-init-pose");
+    return;
+  }
+
+  fp->add_str(typeid(*init_pose).name());
+
+  if (auto* prev_est = dynamic_cast<const SingleRegi::InitPosePrevPoseEst*>(init_pose))
+  {
+    fp->add_index(prev_est->vol_idx);
+  }
+  else if (auto* trans_only = dynamic_cast<const SingleRegi::InitPosePrevPoseEstTransOnly*>(init_pose))
+  {
+    fp->add_index(trans_only->vol_idx);
+  }
+  else if (auto* rot_only = dynamic_cast<const SingleRegi::InitPosePrevPoseEstRotOnly*>(init_pose))
+  {
+    fp->add_index(rot_only->vol_idx);
+  }
+}
+
+void AddSimMetricsToFingerprint(const Intensity2D3DRegi::SimMetricList& sim_metrics,
+                                RegiInputFingerprint* fp)
+{
+  fp->add_index(sim_metrics.size());
+
+  for (const auto& sm : sim_metrics)
+  {
+    if (sm)
+    {
+      fp->add_str(typeid(*sm).name());
+
+      fp->add_scalar(sm->pixel_subsample_frac());
+
+      if (sm->pixel_subsample_frac() < 1)
+      {
+        fp->add_index(sm->pixel_subsample_seed());
+      }
+    }
+    else
+    {
+      fp->add_str("null-sim-metric");
+    }
+  }
+}
+
+}  // un-named
+
+void xreg::RegiInputFingerprint::add_bytes(const void* buf, const size_type num_bytes)
+{
+  h_.add_bytes(buf, num_bytes);
+}
+
+void xreg::RegiInputFingerprint::add_bytes_parallel(const void* buf, const size_type num_bytes)
+{
+  h_.add_bytes_parallel(buf, num_bytes);
+}
+
+void xreg::RegiInputFingerprint::add_str(const std::string& s)
+{
+  h_.add_str(s);
+}
+
+void xreg::RegiInputFingerprint::add_scalar(const double x)
+{
+  h_.add(x);
+}
+
+void xreg::RegiInputFingerprint::add_index(const size_type i)
+{
+  h_.add(i);
+}
+
+void xreg::RegiInputFingerprint::add_indices(const std::vector<size_type>& inds)
+{
+  add_index(inds.size());
+
+  for (const size_type i : inds)
+  {
+    add_index(i);
+  }
+}
+
+void xreg::RegiInputFingerprint::add_scalars(const std::vector<double>& xs)
+{
+  add_index(xs.size());
+  add_bytes(xs.data(), sizeof(double) * xs.size());
+}
+
+void xreg::RegiInputFingerprint::add_xform(const FrameTransform& xform)
+{
+  const auto& m = xform.matrix();
+
+  add_bytes(m.data(), sizeof(CoordScalar) * m.size());
+}
+
+void xreg::RegiInputFingerprint::add_cam(const CameraModel& cam)
+{
+  add_bytes(cam.intrins.data(), sizeof(CoordScalar) * cam.intrins.size());
+  add_xform(cam.extrins);
+
+  add_index(cam.num_det_rows);
+  add_index(cam.num_det_cols);
+  add_scalar(cam.det_row_spacing);
+  add_scalar(cam.det_col_spacing);
+  add_scalar(cam.focal_len);
+  add_index(static_cast<size_type>(cam.coord_frame_type));
+}
+
+void xreg::RegiInputFingerprint::add_img(const Vol* img)
+{
+  AddImgToFingerprint(img, this);
+}
+
+void xreg::RegiInputFingerprint::add_img(const Img* img)
+{
+  AddImgToFingerprint(img, this);
+}
+
+void xreg::RegiInputFingerprint::add_img(const Mask* img)
+{
+  AddImgToFingerprint(img, this);
+}
+
+void xreg::RegiInputFingerprint::add_proj_data(const ProjDataF32& pd)
+{
+  add_img(pd.img.GetPointer());
+  add_cam(pd.cam);
+}
+
+xreg::RegiInputFingerprint::HashType xreg::RegiInputFingerprint::value() const
+{
+  return h_.value();
+}
+
+std::string xreg::RegiInputFingerprint::str() const
+{
+  return h_.str();
+}
+
+std::string xreg::MakeMultiLevelRegiInputsKey(const MultiLevelMultiObjRegi& ml_regi)
+{
+  RegiInputFingerprint fp;
+
+  fp.add_index(kREGI_RESULT_CACHE_VERSION);
+
+  fp.add_index(ml_regi.vols.size());
+
+  for (const auto& v : ml_regi.vols)
+  {
+    fp.add_img(v.GetPointer());
+  }
+
+  fp.add_index(ml_regi.fixed_proj_data.size());
+
+  for (const auto& pd : ml_regi.fixed_proj_data)
+  {
+    fp.add_proj_data(pd);
+  }
+
+  // no masks and a list of null masks are equivalent
+  fp.add_index(ml_regi.fixed_proj_data.size());
+  
+  for (size_type i = 0; i < ml_regi.fixed_proj_data.size(); ++i)
+  {
+    fp.add_img(ml_regi.masks_2d.empty() ? nullptr : ml_regi.masks_2d[i].GetPointer());
+  }
+
+  fp.add_index(ml_regi.init_cam_to_vols.size());
+
+  for (const auto& xform : ml_regi.init_cam_to_vols)
+  {
+    fp.add_xform(xform);
+  }
+
+  fp.add_index(ml_regi.use_vol_pyramid);
+
+  if (ml_regi.use_vol_pyramid)
+  {
+    fp.add_scalar(ml_regi.vol_pyramid_max_spacing_wrt_det);
+    fp.add_index(ml_regi.vol_pyramid_max_num_halvings);
+  }
+
+  fp.add_index(ml_regi.ref_frames.size());
+
+  for (const auto& rf : ml_regi.ref_frames)
+  {
+    if (!rf)
+    {
+      fp.add_str("null-ref-frame");
+      continue;
+    }
+
+    fp.add_str(typeid(*rf).name());
+
+    if (auto* static_rf = dynamic_cast<const MultiLevelMultiObjRegi::StaticRefFrame*>(rf.get()))
+    {
+      fp.add_xform(static_rf->info.ref_frame);
+      fp.add_index(static_rf->info.maps_vol_to_ref);
+      fp.add_index(bool(static_rf->info.dyn_ref_frame_fn));
+    }
+    else if (auto* cam_align_rf = dynamic_cast<const MultiLevelMultiObjRegi::CamAlignRefFrameWithCurPose*>(rf.get()))
+    {
+      fp.add_index(cam_align_rf->vol_idx);
+      fp.add_xform(cam_align_rf->cam_extrins);
+      fp.add_bytes(cam_align_rf->center_of_rot_wrt_vol.data(), sizeof(CoordScalar) * 3);
+    }
+    else if (auto* dyn_vol_rf = dynamic_cast<const MultiLevelMultiObjRegi::DynVolRefFrame*>(rf.get()))
+    {
+      fp.add_index(dyn_vol_rf->dyn_vol_idx);
+      fp.add_xform(dyn_vol_rf->inter_to_vol);
+    }
+  }
+
+  return fp.str();
+}
+
+std::string xreg::MakeMultiLevelRegiLevelKey(const std::string& prev_key,
+                                             const MultiLevelMultiObjRegi::Level& lvl)
+{
+  if (lvl.result_cache_desc.empty())
+  {
+    xregThrow("Level::result_cache_desc must describe the optimizer, similarity "
+              "metric, regularization and random seed settings of a level when "
+              "a result cache is used!");
+  }
+
+  RegiInputFingerprint fp;
+
+  fp.add_str(prev_key);
+
+  fp.add_scalar(lvl.ds_factor);
+  fp.add_indices(lvl.fixed_imgs_to_use);
+  fp.add_scalars(lvl.vol_ds_factors);
+
+  fp.add_index(lvl.use_plateau_stop);
+
+  if (lvl.use_plateau_stop)
+  {
+    fp.add_index(lvl.plateau_stop.window_len);
+    fp.add_index(lvl.plateau_stop.min_num_iters);
+    fp.add_scalar(lvl.plateau_stop.min_obj_fn_improvement);
+    fp.add_scalar(lvl.plateau_stop.max_rot_change_deg);
+    fp.add_scalar(lvl.plateau_stop.max_trans_change);
+  }
+
+  fp.add_str(lvl.result_cache_desc);
+
+  fp.add_str(lvl.ray_caster ? typeid(*lvl.ray_caster).name() : "null-ray-caster");
+
+  AddSimMetricsToFingerprint(lvl.sim_metrics, &fp);
+
+  fp.add_index(lvl.regis.size());
+
+  for (const auto& single_regi : lvl.regis)
+  {
+    fp.add_indices(single_regi.mov_vols);
+    fp.add_indices(single_regi.static_vols);
+    fp.add_indices(single_regi.ref_frames);
+
+    fp.add_index(single_regi.init_mov_vol_poses.size());
+
+    for (const auto& init_pose : single_regi.init_mov_vol_poses)
+    {
+      AddInitPoseToFingerprint(init_pose.get(), &fp);
+    }
+
+    fp.add_index(single_regi.static_vol_poses.size());
+
+    for (const auto& static_pose : single_regi.static_vol_poses)
+    {
+      AddInitPoseToFingerprint(static_pose.get(), &fp);
+    }
+
+    fp.add_str(single_regi.ray_caster ? typeid(*single_regi.ray_caster).name() : "level-ray-caster");
+
+    AddSimMetricsToFingerprint(single_regi.sim_metrics, &fp);
+
+    fp.add_index(single_regi.fns_to_call_right_before_regi_run.size());
+
+    const auto* regi = single_regi.regi.get();
+
+    if (regi)
+    {
+      fp.add_str(typeid(*regi).name());
+      fp.add_index(regi->max_num_iters());
+      fp.add_index(regi->include_penalty_in_obj_fn());
+      fp.add_index(regi->use_sim_metric_active_pixels());
+      fp.add_index(regi->num_ray_cast_stages());
+
+      const auto penalty_fn = single_regi.regi->penalty_fn();
+      fp.add_str(penalty_fn ? typeid(*penalty_fn).name() : "null-penalty-fn");
+
+      const auto screen_regi = regi->screen_regi();
+
+      if (screen_regi)
+      {
+        fp.add_str(typeid(*screen_regi).name());
+        fp.add_index(screen_regi->max_num_iters());
+        fp.add_scalar(regi->screen_keep_frac());
+      }
+      else
+      {
+        fp.add_str("null-screen-regi");
+      }
+    }
+    else
+    {
+      fp.add_str("null-regi");
+    }
+  }
+
+  return fp.str();
+}
+
+xreg::MultiLevelRegiResultCache::MultiLevelRegiResultCache(const std::string& cache_dir)
+  : files_(cache_dir, "regi-result-cache", ".regi-result.h5")
+{ }
+
+std::string xreg::MultiLevelRegiResultCache::entry_path(const std::string& key) const
+{
+  return files_.entry_path(key);
+}
+
+bool xreg::MultiLevelRegiResultCache::read(const std::string& key, LevelResults* results) const
+{
+  return files_.read(key, [results] (const H5::Group& h5)
+  {
+    LevelResults tmp_results;
+
+    const size_type num_vols = ReadSingleScalarH5ULong("num-vols", h5);
+
+    tmp_results.cam_to_vols.resize(num_vols);
+
+    for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
+    {
+      tmp_results.cam_to_vols[vol_idx] = ReadAffineTransform4x4H5(fmt::format("cam-to-vol-{:03d}", vol_idx), h5);
+    }
+
+    tmp_results.has_debug_info = ReadSingleScalarH5Bool("has-debug-info", h5);
+
+    if (tmp_results.has_debug_info)
+    {
+      const size_type num_regis = ReadSingleScalarH5ULong("num-regis", h5);
+
+      tmp_results.regi_debug_info.resize(num_regis);
+
+      for (size_type regi_idx = 0; regi_idx < num_regis; ++regi_idx)
+      {
+        tmp_results.regi_debug_info[regi_idx] = std::make_shared<SingleRegiDebugResults>(
+            ReadSingleRegiDebugResultsH5(h5.openGroup(fmt::format("regi-{:03d}", regi_idx))));
+      }
+    }
+
+    *results = std::move(tmp_results);
+  });
+}
+
+void xreg::MultiLevelRegiResultCache::write(const std::string& key, const LevelResults& results) const
+{
+  files_.write(key, [&results] (H5::Group* h5)
+  {
+    const size_type num_vols = results.cam_to_vols.size();
+
+    WriteSingleScalarH5("num-vols", static_cast<unsigned long>(num_vols), h5);
+
+    for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
+    {
+      WriteAffineTransform4x4(fmt::format("cam-to-vol-{:03d}", vol_idx),
+                              results.cam_to_vols[vol_idx], h5, false);
+    }
+
+    WriteSingleScalarH5("has-debug-info", results.has_debug_info, h5);
+
+    if (results.has_debug_info)
+    {
+      const size_type num_regis = results.regi_debug_info.size();
+
+      WriteSingleScalarH5("num-regis", static_cast<unsigned long>(num_regis), h5);
+
+      for (size_type regi_idx = 0; regi_idx < num_regis; ++regi_idx)
+      {
+        xregASSERT(bool(results.regi_debug_info[regi_idx]));
+
+        H5::Group regi_g = h5->createGroup(fmt::format("regi-{:03d}", regi_idx));
+
+        WriteSingleRegiDebugResultsH5(*results.regi_debug_info[regi_idx], &regi_g);
+      }
+    }
+  });
+}
@@ -0,0 +1,173 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef XREGMULTIOBJMULTILEVEL2D3DREGIRESULTCACHE_H_
+#define XREGMULTIOBJMULTILEVEL2D3DREGIRESULTCACHE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "xregHashUtils.h"
+#include "xregHDF5KeyedFileCache.h"
+#include "xregMultiObjMultiLevel2D3DRegi.h"
+
+namespace xreg
+{
+
+/// \brief Incrementally computes a fingerprint of the contents of
+///        registration inputs and settings.
+///
+/// The fingerprint is computed with Hasher64, so it is identical between runs
+/// and processes. Image pixels are hashed in parallel using fixed size blocks,
+/// so the fingerprint does not depend on the number of threads. Variable
+/// length values (strings, lists, pixel buffers) are prefixed with their
+/// lengths, so that adjacent values cannot alias each other.
+class RegiInputFingerprint
+{
+public:
+  using HashType = std::uint64_t;
+
+  using Vol  = RayCaster::Vol;
+  using Img  = ProjDataF32::Proj;
+  using Mask = ImgSimMetric2D::ImageMask;
+
+  void add_bytes(const void* buf, const size_type num_bytes);
+
+  /// \brief Adds a large buffer (e.g. pixels), which is hashed in parallel.
+  void add_bytes_parallel(const void* buf, const size_type num_bytes);
+
+  void add_str(const std::string& s);
+
+  void add_scalar(const double x);
+
+  void add_index(const size_type i);
+
+  void add_indices(const std::vector<size_type>& inds);
+
+  void add_scalars(const std::vector<double>& xs);
+
+  void add_xform(const FrameTransform& xform);
+
+  /// \brief Adds the intrinsics, extrinsics, detector geometry and coordinate
+  ///        frame convention of a camera.
+  void add_cam(const CameraModel& cam);
+
+  /// \brief Adds the pixels and geometry (size, spacing, origin, direction)
+  ///        of an image; a null image is distinguished from every image.
+  void add_img(const Vol* img);
+
+  void add_img(const Img* img);
+
+  void add_img(const Mask* img);
+
+  /// \brief Adds the pixels and camera of a projection; other metadata (e.g.
+  ///        patient orientation) does not affect registration and is skipped.
+  void add_proj_data(const ProjDataF32& pd);
+
+  HashType value() const;
+
+  /// \brief The fingerprint as 16 hexadecimal characters, suitable for a
+  ///        cache key.
+  std::string str() const;
+
+private:
+  Hasher64 h_;
+};
+
+/// \brief Fingerprint of the inputs of a multi-level registration which are
+///        shared by every level.
+///
+/// This covers the volumes, the fixed images and their cameras, the masks, the
+/// initial pose estimates, the volume pyramid settings and the reference frames.
+std::string MakeMultiLevelRegiInputsKey(const MultiLevelMultiObjRegi& ml_regi);
+
+/// \brief Fingerprint of the results of a level of a multi-level registration.
+///
+/// prev_key is the key of the previous level, or the key created by
+/// MakeMultiLevelRegiInputsKey() for the first level, so that the key of a level
+/// changes whenever an input or any level up to, and including, this level
+/// changes.
+///
+/// The level fingerprint covers its downsampling factors, fixed images used,
+/// plateau stopping criteria, ray caster and similarity metric types, pixel
+/// subsampling settings, and the volumes, reference frames, initial poses,
+/// optimizer type, iteration limits and screening of each registration.
+/// Settings which are not exposed through the base interfaces (e.g. CMA-ES
+/// population size and sigma, similarity metric parameters, regularizers,
+/// callbacks or an explicit random seed) must be described by the caller in
+/// Level::result_cache_desc. An exception is thrown when it is empty, so that
+/// a level is never silently keyed without these settings.
+std::string MakeMultiLevelRegiLevelKey(const std::string& prev_key,
+                                       const MultiLevelMultiObjRegi::Level& lvl);
+
+/// \brief Directory of multi-level registration results, indexed by keys
+///        created with MakeMultiLevelRegiLevelKey().
+///
+/// Each entry stores the pose estimates of every volume after a level and,
+/// optionally, the debug results of each registration of the level, so that
+/// repeating a registration (e.g. for QA or re-processing) returns the
+/// previous results without running the optimizers again.
+class MultiLevelRegiResultCache
+{
+public:
+  using SingleRegiDebugResultsPtr = std::shared_ptr<SingleRegiDebugResults>;
+
+  struct LevelResults
+  {
+    /// The pose estimates of every volume after the level
+    FrameTransformList cam_to_vols;
+
+    bool has_debug_info = false;
+
+    /// The debug results of each registration of the level, valid when
+    /// has_debug_info is true
+    std::vector<SingleRegiDebugResultsPtr> regi_debug_info;
+  };
+
+  /// \brief Constructor, cache_dir is created if it does not exist.
+  explicit MultiLevelRegiResultCache(const std::string& cache_dir);
+
+  /// \brief Reads the results of a level.
+  ///
+  /// Returns false, and leaves results unmodified, when no entry exists for key.
+  bool read(const std::string& key, LevelResults* results) const;
+
+  /// \brief Writes the results of a level, replacing any existing entry.
+  ///
+  /// The entry is written to a uniquely named temporary file and then moved
+  /// into place, so that other processes never read a partially written entry.
+  void write(const std::string& key, const LevelResults& results) const;
+
+  /// \brief The path to the file storing the entry for key.
+  std::string entry_path(const std::string& key) const;
+
+private:
+  H5KeyedFileCache files_;
+};
+
+}  // xreg
+
+#endif
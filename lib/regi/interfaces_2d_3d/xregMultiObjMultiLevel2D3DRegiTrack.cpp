@@ -0,0 +1,168 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregMultiObjMultiLevel2D3DRegiTrack.h"
+
+#include "xregExceptionUtils.h"
+#include "xregAssert.h"
+
+xreg::MultiLevelMultiObjRegiTracker::MultiLevelMultiObjRegiTracker(MultiLevelMultiObjRegi* regi)
+  : regi_(regi)
+{
+  xregASSERT(regi_);
+
+  // the resources of each level are reused by every frame
+  regi_->dealloc_resources = false;
+}
+
+const xreg::FrameTransformList&
+xreg::MultiLevelMultiObjRegiTracker::register_frame(const ProjDataF32List& frame_views)
+{
+  if (init_levels.empty())
+  {
+    xregThrow("at least one level is required to register the first frame!");
+  }
+
+  regi_->dealloc_resources = false;
+
+  regi_->fixed_proj_data = frame_views;
+
+  // The ray casters must allocate resources again when the camera models
+  // change, e.g. a different detector binning
+  std::vector<CameraModel> cams;
+  cams.reserve(frame_views.size());
+
+  for (const auto& pd : frame_views)
+  {
+    cams.push_back(pd.cam);
+  }
+
+  if (cams != alloc_cams_)
+  {
+    alloc_cams_ = cams;
+
+    init_levels_allocated_  = false;
+    track_levels_allocated_ = false;
+  }
+
+  if (!num_frames_registered_)
+  {
+    first_frame_init_cam_to_vols_ = regi_->init_cam_to_vols;
+
+    pred_cam_to_vols_ = regi_->init_cam_to_vols;
+
+    regi_->dout() << "tracking: registering first frame..." << std::endl;
+
+    run_levels(init_levels, &init_levels_allocated_);
+  }
+  else
+  {
+    pred_cam_to_vols_ = cur_cam_to_vols_;
+
+    if ((motion_model == kTRACK_MOTION_CONST_VEL) && (num_frames_registered_ > 1))
+    {
+      const size_type num_vols = cur_cam_to_vols_.size();
+
+      for (size_type vol_idx = 0; vol_idx < num_vols; ++vol_idx)
+      {
+        // the motion between the previous two frames, applied in the camera
+        // frame: cur = prev * delta
+        const FrameTransform delta = prev_cam_to_vols_[vol_idx].inverse() * cur_cam_to_vols_[vol_idx];
+
+        pred_cam_to_vols_[vol_idx] = cur_cam_to_vols_[vol_idx] * delta;
+      }
+    }
+
+    regi_->init_cam_to_vols = pred_cam_to_vols_;
+
+    regi_->dout() << "tracking: registering frame " << num_frames_registered_ << "..." << std::endl;
+
+    if (track_levels.empty())
+    {
+      // the last init level shares its ray caster with the first frame
+      run_levels({ init_levels.back() }, &init_levels_allocated_);
+    }
+    else
+    {
+      run_levels(track_levels, &track_levels_allocated_);
+    }
+  }
+
+  prev_cam_to_vols_ = cur_cam_to_vols_;
+  cur_cam_to_vols_  = regi_->cur_cam_to_vols;
+
+  ++num_frames_registered_;
+
+  return cur_cam_to_vols_;
+}
+
+void xreg::MultiLevelMultiObjRegiTracker::reset()
+{
+  num_frames_registered_ = 0;
+
+  prev_cam_to_vols_.clear();
+  cur_cam_to_vols_.clear();
+
+  // the initial poses were overwritten by the predictions of each frame
+  if (!first_frame_init_cam_to_vols_.empty())
+  {
+    regi_->init_cam_to_vols = first_frame_init_cam_to_vols_;
+  }
+}
+
+xreg::size_type xreg::MultiLevelMultiObjRegiTracker::num_frames_registered() const
+{
+  return num_frames_registered_;
+}
+
+const xreg::FrameTransformList&
+xreg::MultiLevelMultiObjRegiTracker::cur_cam_to_vols() const
+{
+  return cur_cam_to_vols_;
+}
+
+const xreg::FrameTransformList&
+xreg::MultiLevelMultiObjRegiTracker::predicted_cam_to_vols() const
+{
+  return pred_cam_to_vols_;
+}
+
+void xreg::MultiLevelMultiObjRegiTracker::run_levels(const LevelList& levels,
+                                                     bool* levels_allocated)
+{
+  // the levels share the ray casters, sim metrics and regi objects
+  regi_->levels = levels;
+
+  regi_->ray_caster_needs_resources_alloc = !*levels_allocated;
+
+  // the fixed images change with every frame
+  regi_->sim_metrics_need_resources_alloc = true;
+
+  // a failure part way through leaves the resources of the ray casters unknown
+  *levels_allocated = false;
+
+  regi_->run();
+
+  *levels_allocated = true;
+}
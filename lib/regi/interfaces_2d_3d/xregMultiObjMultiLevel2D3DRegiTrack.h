@@ -0,0 +1,139 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGMULTIOBJMULTILEVEL2D3DREGITRACK_H_
+#define XREGMULTIOBJMULTILEVEL2D3DREGITRACK_H_
+
+#include "xregMultiObjMultiLevel2D3DRegi.h"
+
+namespace xreg
+{
+
+/// \brief Registers each frame of a fluoroscopy sequence using a single
+///        multiple-level registration setup.
+///
+/// The first frame is registered with init_levels, starting from the
+/// init_cam_to_vols of the regi object. Each subsequent frame is registered with
+/// track_levels, which typically consist of only the finest level with a
+/// reduced search space, starting from the estimate of the previous frame or a
+/// constant velocity prediction.
+///
+/// The ray casters, similarity metrics and regi objects of every level remain
+/// allocated for the entire sequence. A ray caster is only allocated the first
+/// time its levels are run, or when the camera models of the frames change, so
+/// the buffers of projections are reused across frames. The similarity metrics
+/// are set up again for every frame, since the fixed images change. Ray casters
+/// and similarity metrics must not be shared between init_levels and
+/// track_levels.
+///
+/// The user should set the volumes, reference frames and initial poses of the
+/// regi object (its levels are assigned by this object) along with init_levels
+/// and track_levels prior to registering the first frame.
+class MultiLevelMultiObjRegiTracker
+{
+public:
+  using Level     = MultiLevelMultiObjRegi::Level;
+  using LevelList = std::vector<Level>;
+
+  /// \brief Predictions of the poses of a frame, used to initialize its registration.
+  enum MotionModel
+  {
+    /// \brief The estimates of the previous frame
+    kTRACK_MOTION_PREV_POSE = 0,
+
+    /// \brief The motion between the previous two frames is applied to the
+    ///        estimates of the previous frame, assuming a constant frame rate.
+    kTRACK_MOTION_CONST_VEL
+  };
+
+  /// \brief Tracks using a registration setup shared by every frame.
+  ///
+  /// The regi object must outlive this object. dealloc_resources is disabled
+  /// and the levels are overwritten for each frame.
+  explicit MultiLevelMultiObjRegiTracker(MultiLevelMultiObjRegi* regi);
+
+  /// \brief Registers the next frame of the sequence, consisting of one or
+  ///        more views, and returns the pose estimates of the volumes.
+  const FrameTransformList& register_frame(const ProjDataF32List& frame_views);
+
+  /// \brief The next frame is registered as if it were the first frame.
+  ///
+  /// This is useful when tracking has been lost or a new sequence begins.
+  /// The init_cam_to_vols of the regi object are restored to the values used
+  /// for the first frame, and may be set again prior to registering the next
+  /// frame. Resources remain allocated.
+  void reset();
+
+  /// \brief Number of frames registered since construction or the last reset
+  size_type num_frames_registered() const;
+
+  /// \brief The pose estimates of the most recently registered frame
+  const FrameTransformList& cur_cam_to_vols() const;
+
+  /// \brief The predicted poses used to initialize the most recently
+  ///        registered frame.
+  const FrameTransformList& predicted_cam_to_vols() const;
+
+  /// \brief Levels used to register the first frame.
+  LevelList init_levels;
+
+  /// \brief Levels used to register each subsequent frame.
+  ///
+  /// When empty, the last level of init_levels is used.
+  LevelList track_levels;
+
+  MotionModel motion_model = kTRACK_MOTION_PREV_POSE;
+
+private:
+  /// \brief Runs the registration for a frame using a set of levels.
+  ///
+  /// levels_allocated indicates whether the ray casters of the levels have
+  /// resources allocated for the current camera models, and is updated.
+  void run_levels(const LevelList& levels, bool* levels_allocated);
+
+  MultiLevelMultiObjRegi* regi_;
+
+  size_type num_frames_registered_ = 0;
+
+  FrameTransformList prev_cam_to_vols_;
+
+  FrameTransformList cur_cam_to_vols_;
+
+  FrameTransformList pred_cam_to_vols_;
+
+  /// \brief The initial poses of the first frame, provided by the user
+  FrameTransformList first_frame_init_cam_to_vols_;
+
+  /// \brief The camera models the ray casters have allocated resources for
+  std::vector<CameraModel> alloc_cams_;
+
+  bool init_levels_allocated_ = false;
+
+  bool track_levels_allocated_ = false;
+};
+
+}  // xreg
+
+#endif
+
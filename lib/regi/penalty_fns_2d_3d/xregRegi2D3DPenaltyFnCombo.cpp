@@ -26,6 +26,7 @@
 
 #include "xregHDF5.h"
 #include "xregRegi2D3DPenaltyFnDebugH5.h"
+#include "xregTBBUtils.h"
 
 void xreg::Regi2D3DPenaltyFnCombo::setup()
 {
@@ -73,14 +74,24 @@ void xreg::Regi2D3DPenaltyFnCombo::compute(
     this->log_probs_.assign(num_projs, 0);
   }
 
-  for (auto& p : pen_fns)
+  // the component penalties are independent, so compute them concurrently
+  // and accumulate in order afterwards
+  auto compute_pen_fns_fn = [&] (const RangeType& r)
   {
-    p->compute(cams_wrt_objs, num_projs, cams, cam_assocs,
-               intermediate_frames_wrt_vol,
-               intermediate_frames,
-               regi_xform_guesses,
-               xforms_from_opt);
+    for (size_type pen_idx = r.begin(); pen_idx < r.end(); ++pen_idx)
+    {
+      pen_fns[pen_idx]->compute(cams_wrt_objs, num_projs, cams, cam_assocs,
+                                intermediate_frames_wrt_vol,
+                                intermediate_frames,
+                                regi_xform_guesses,
+                                xforms_from_opt);
+    }
+  };
 
+  ParallelFor(compute_pen_fns_fn, RangeType(0, pen_fns.size()));
+
+  for (auto& p : pen_fns)
+  {
     const auto& other_reg_vals = p->reg_vals();
 
     for (size_type i = 0; i < num_projs; ++i)
@@ -86,12 +86,41 @@ void xreg::Regi2D3DPenaltyFnLandReproj::compute(
     }
   }
 
+  const Pt3ListSoA lands_3d_soa = Pt3ListToSoA(lands_3d);
+
+  Eigen::Matrix<CoordScalar,1,Eigen::Dynamic> lands_2d_cols(num_lands);
+  Eigen::Matrix<CoordScalar,1,Eigen::Dynamic> lands_2d_rows(num_lands);
+
+  for (size_type land_idx = 0; land_idx < num_lands; ++land_idx)
+  {
+    lands_2d_cols(land_idx) = lands_2d[land_idx](0);
+    lands_2d_rows(land_idx) = lands_2d[land_idx](1);
+  }
+
   auto compute_reg_for_projs_fn = [&] (const RangeType& r)
   {
+    // project the landmarks for every projection in this range at once
+    Mat3x4List proj_mats(r.end() - r.begin());
+
     for (size_type i = r.begin(); i < r.end(); ++i)
     {
-      const FrameTransform cur_vol_wrt_cam = cam_wrt_vols[i].inverse();
-      
+      proj_mats[i - r.begin()] = cams[cam_assocs[i]].phys_to_ind_proj_mat() *
+                                    cam_wrt_vols[i].inverse().matrix();
+    }
+
+    MatMxN inds_cols;
+    MatMxN inds_rows;
+
+    ProjPtsForProjMats(proj_mats, lands_3d_soa, &inds_cols, &inds_rows);
+
+    // squared reprojection distances, one row for each projection
+    const MatMxN sq_dists = ((inds_cols.rowwise() - lands_2d_cols).array().square() +
+                             (inds_rows.rowwise() - lands_2d_rows).array().square()).matrix();
+
+    for (size_type i = r.begin(); i < r.end(); ++i)
+    {
+      const size_type range_idx = i - r.begin();
+
       CoordScalar sum_sq_dists = 0;
       
       if (use_outlier_det)
@@ -104,9 +133,7 @@ void xreg::Regi2D3DPenaltyFnLandReproj::compute(
 
         for (size_type land_idx = 0; land_idx < num_lands; ++land_idx)
         {
-          const CoordScalar cur_dist = (lands_2d[land_idx] -
-                               cams[cam_assocs[i]].phys_pt_to_ind_pt(
-                                   cur_vol_wrt_cam * lands_3d[land_idx]).head(2)).norm();
+          const CoordScalar cur_dist = std::sqrt(sq_dists(range_idx,land_idx));
           
           cur_proj_reproj_dists[land_idx] = cur_dist;
 
@@ -152,13 +179,7 @@ void xreg::Regi2D3DPenaltyFnLandReproj::compute(
       }
       else
       {
-        for (size_type land_idx = 0; land_idx < num_lands; ++land_idx)
-        {
-          sum_sq_dists += (lands_2d[land_idx] -
-                           cams[cam_assocs[i]].phys_pt_to_ind_pt(
-                               cur_vol_wrt_cam * lands_3d[land_idx]).head(2)
-                          ).squaredNorm();
-        }
+        sum_sq_dists = sq_dists.row(range_idx).sum();
       }
 
       this->reg_vals_[i] = sum_sq_dists / std_dev_div;
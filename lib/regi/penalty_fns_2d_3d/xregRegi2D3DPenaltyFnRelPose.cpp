@@ -63,30 +63,34 @@ void xreg::Regi2D3DPenaltyFnSE3RelPose::compute(
   xregASSERT(num_projs <= xforms_from_opt_vol_1.size());
   xregASSERT(num_projs <= xforms_from_opt_vol_2.size());
 
-  FrameTransform delta_xform;
-  CoordScalar tmp_rot_err   = 0;
-  CoordScalar tmp_trans_err = 0;
-  
-  const CoordScalar rot_pdf_log_norm_const   = rot_pdf->log_norm_const();
-  const CoordScalar trans_pdf_log_norm_const = trans_pdf->log_norm_const();
- 
-  PtN tmp_dist_in(1);
+  // rotation and translation magnitudes of each relative pose, the densities
+  // are evaluated for all projections together
+  MatMxN rot_errs(1, num_projs);
+  MatMxN trans_errs(1, num_projs);
 
-  for (size_type proj_idx = 0; proj_idx < num_projs; ++proj_idx)
+  auto compute_errs_for_projs_fn = [&] (const RangeType& r)
   {
-    std::tie(tmp_rot_err,tmp_trans_err) = ComputeRotAngTransMag(
+    for (size_type proj_idx = r.begin(); proj_idx < r.end(); ++proj_idx)
+    {
+      std::tie(rot_errs(0,proj_idx),trans_errs(0,proj_idx)) = ComputeRotAngTransMag(
                           xforms_from_opt_vol_1[proj_idx].inverse() * xforms_from_opt_vol_2[proj_idx]);
-   
-    tmp_dist_in[0] = tmp_rot_err;
-    const CoordScalar cur_rot_log_prob = rot_pdf->log_density(tmp_dist_in);
-    
-    tmp_dist_in[0] = tmp_trans_err;
-    const CoordScalar cur_trans_log_prob = trans_pdf->log_density(tmp_dist_in);
+    }
+  };
+
+  ParallelFor(compute_errs_for_projs_fn, RangeType(0, num_projs));
+
+  const PtN rot_log_probs   = rot_pdf->log_densities(rot_errs);
+  const PtN trans_log_probs = trans_pdf->log_densities(trans_errs);
+
+  const CoordScalar log_norm_consts = rot_pdf->log_norm_const() + trans_pdf->log_norm_const();
+ 
+  for (size_type proj_idx = 0; proj_idx < num_projs; ++proj_idx)
+  {
+    const CoordScalar cur_log_prob = rot_log_probs(proj_idx) + trans_log_probs(proj_idx);
 
-    this->log_probs_[proj_idx] += cur_rot_log_prob + cur_trans_log_prob;
+    this->log_probs_[proj_idx] += cur_log_prob;
     
-    this->reg_vals_[proj_idx] += (rot_pdf_log_norm_const - cur_rot_log_prob +
-                                  trans_pdf_log_norm_const - cur_trans_log_prob);
+    this->reg_vals_[proj_idx] += log_norm_consts - cur_log_prob;
   }
 }
 
@@ -53,14 +53,6 @@ void xreg::Regi2D3DPenaltyFnSE3EulerDecomp::compute(
   // using this for intermediate storage even when the user does not need log probs
   this->log_probs_.assign(num_projs, 0);
   
-  const CoordScalar rot_x_pdf_log_norm_const = rot_x_pdf->log_norm_const();
-  const CoordScalar rot_y_pdf_log_norm_const = rot_y_pdf->log_norm_const();
-  const CoordScalar rot_z_pdf_log_norm_const = rot_z_pdf->log_norm_const();
-  
-  const CoordScalar trans_x_pdf_log_norm_const = trans_x_pdf->log_norm_const();
-  const CoordScalar trans_y_pdf_log_norm_const = trans_y_pdf->log_norm_const();
-  const CoordScalar trans_z_pdf_log_norm_const = trans_z_pdf->log_norm_const();
-  
   {
     const auto& cur_cams_wrt_obj = use_xforms_from_opt ? xforms_from_opt->operator[](obj_idx)
                                                        : cams_wrt_objs[obj_idx];
@@ -74,17 +66,13 @@ void xreg::Regi2D3DPenaltyFnSE3EulerDecomp::compute(
 
     const FrameTransform init_X_to_inter = inter_frame_inv * (inter_wrt_vol ? init_cam_to_vol : init_vol_to_cam);
 
-    auto compute_reg_for_projs_fn = [&] (const RangeType& r)
-    {
-      CoordScalar tmp_rot_x   = 0;
-      CoordScalar tmp_rot_y   = 0;
-      CoordScalar tmp_rot_z   = 0;
-      CoordScalar tmp_trans_x = 0;
-      CoordScalar tmp_trans_y = 0;
-      CoordScalar tmp_trans_z = 0;
-
-      PtN tmp_dist_in(1);
+    // Euler angles and translations of each projection (rows x, y, z), the
+    // densities are evaluated for all projections together
+    MatMxN rot_angs(3, num_projs);
+    MatMxN trans(3, num_projs);
 
+    auto compute_decomps_for_projs_fn = [&] (const RangeType& r)
+    {
       FrameTransform xform_to_decomp;
       
       for (size_type proj_idx = r.begin(); proj_idx < r.end(); ++proj_idx)
@@ -103,39 +91,33 @@ void xreg::Regi2D3DPenaltyFnSE3EulerDecomp::compute(
           xform_to_decomp = init_X_to_inter * cur_inter_to_X;
         }
         
-        std::tie(tmp_rot_x,tmp_rot_y,tmp_rot_z,tmp_trans_x,tmp_trans_y,tmp_trans_z) =
+        std::tie(rot_angs(0,proj_idx),rot_angs(1,proj_idx),rot_angs(2,proj_idx),
+                 trans(0,proj_idx),trans(1,proj_idx),trans(2,proj_idx)) =
                                                       RigidXformToEulerXYZAndTrans(xform_to_decomp);
-      
-        tmp_dist_in[0] = tmp_rot_x; 
-        const CoordScalar cur_rot_x_log_prob = rot_x_pdf->log_density(tmp_dist_in);
-        
-        tmp_dist_in[0] = tmp_rot_y; 
-        const CoordScalar cur_rot_y_log_prob = rot_y_pdf->log_density(tmp_dist_in);
-        
-        tmp_dist_in[0] = tmp_rot_z; 
-        const CoordScalar cur_rot_z_log_prob = rot_z_pdf->log_density(tmp_dist_in);
-        
-        tmp_dist_in[0] = tmp_trans_x; 
-        const CoordScalar cur_trans_x_log_prob = trans_x_pdf->log_density(tmp_dist_in);
-        
-        tmp_dist_in[0] = tmp_trans_y; 
-        const CoordScalar cur_trans_y_log_prob = trans_y_pdf->log_density(tmp_dist_in);
-        
-        tmp_dist_in[0] = tmp_trans_z; 
-        const CoordScalar cur_trans_z_log_prob = trans_z_pdf->log_density(tmp_dist_in);
-
-        this->log_probs_[proj_idx] += cur_rot_x_log_prob   + cur_rot_y_log_prob   + cur_rot_z_log_prob +
-                                      cur_trans_x_log_prob + cur_trans_y_log_prob + cur_trans_z_log_prob;
-        
-        this->reg_vals_[proj_idx] += (rot_x_pdf_log_norm_const   - cur_rot_x_log_prob +
-                                      rot_y_pdf_log_norm_const   - cur_rot_y_log_prob +
-                                      rot_z_pdf_log_norm_const   - cur_rot_z_log_prob +
-                                      trans_x_pdf_log_norm_const - cur_trans_x_log_prob +
-                                      trans_y_pdf_log_norm_const - cur_trans_y_log_prob +
-                                      trans_z_pdf_log_norm_const - cur_trans_z_log_prob);
       }
     };
 
-    ParallelFor(compute_reg_for_projs_fn, RangeType(0, num_projs));
+    ParallelFor(compute_decomps_for_projs_fn, RangeType(0, num_projs));
+
+    const PtN log_probs = rot_x_pdf->log_densities(MatMxN(rot_angs.row(0))) +
+                          rot_y_pdf->log_densities(MatMxN(rot_angs.row(1))) +
+                          rot_z_pdf->log_densities(MatMxN(rot_angs.row(2))) +
+                          trans_x_pdf->log_densities(MatMxN(trans.row(0))) +
+                          trans_y_pdf->log_densities(MatMxN(trans.row(1))) +
+                          trans_z_pdf->log_densities(MatMxN(trans.row(2)));
+
+    const CoordScalar log_norm_consts = rot_x_pdf->log_norm_const() +
+                                        rot_y_pdf->log_norm_const() +
+                                        rot_z_pdf->log_norm_const() +
+                                        trans_x_pdf->log_norm_const() +
+                                        trans_y_pdf->log_norm_const() +
+                                        trans_z_pdf->log_norm_const();
+
+    for (size_type proj_idx = 0; proj_idx < num_projs; ++proj_idx)
+    {
+      this->log_probs_[proj_idx] += log_probs(proj_idx);
+      
+      this->reg_vals_[proj_idx] += log_norm_consts - log_probs(proj_idx);
+    }
   }
 }
@@ -75,13 +75,13 @@ void xreg::Regi2D3DPenaltyFnSE3Mag::compute(
 
       const FrameTransform init_X_to_inter = inter_frame_inv * (inter_wrt_vol ? init_cam_to_vol : init_vol_to_cam);
 
-      auto compute_reg_for_projs_fn = [&] (const RangeType& r)
-      {
-        CoordScalar tmp_rot_err   = 0;
-        CoordScalar tmp_trans_err = 0;
-        
-        PtN tmp_dist_in(1);
+      // rotation and translation magnitudes of each projection, the densities
+      // are evaluated for all projections together
+      MatMxN rot_errs(1, num_projs);
+      MatMxN trans_errs(1, num_projs);
 
+      auto compute_errs_for_projs_fn = [&] (const RangeType& r)
+      {
         for (size_type proj_idx = r.begin(); proj_idx < r.end(); ++proj_idx)
         {
           const auto& cur_cam_wrt_obj = cur_cams_wrt_obj[proj_idx];
@@ -89,22 +89,26 @@ void xreg::Regi2D3DPenaltyFnSE3Mag::compute(
           const FrameTransform cur_inter_to_X = (inter_wrt_vol ? FrameTransform(cur_cam_wrt_obj.inverse())
                                                                : cur_cam_wrt_obj) * inter_frame;
 
-          std::tie(tmp_rot_err,tmp_trans_err) = ComputeRotAngTransMag(init_X_to_inter * cur_inter_to_X);
-         
-          tmp_dist_in[0] = tmp_rot_err;
-          const CoordScalar cur_rot_log_prob = rot_pdf.log_density(tmp_dist_in);
-         
-          tmp_dist_in[0] = tmp_trans_err;
-          const CoordScalar cur_trans_log_prob = trans_pdf.log_density(tmp_dist_in);
-
-          this->log_probs_[proj_idx] += cur_rot_log_prob + cur_trans_log_prob;
-          
-          this->reg_vals_[proj_idx] += (rot_pdf.log_norm_const() - cur_rot_log_prob +
-                                        trans_pdf.log_norm_const() - cur_trans_log_prob);
+          std::tie(rot_errs(0,proj_idx),trans_errs(0,proj_idx)) =
+                              ComputeRotAngTransMag(init_X_to_inter * cur_inter_to_X);
         }
       };
       
-      ParallelFor(compute_reg_for_projs_fn, RangeType(0, num_projs));
+      ParallelFor(compute_errs_for_projs_fn, RangeType(0, num_projs));
+
+      const PtN rot_log_probs   = rot_pdf.log_densities(rot_errs);
+      const PtN trans_log_probs = trans_pdf.log_densities(trans_errs);
+
+      const CoordScalar log_norm_consts = rot_pdf.log_norm_const() + trans_pdf.log_norm_const();
+
+      for (size_type proj_idx = 0; proj_idx < num_projs; ++proj_idx)
+      {
+        const CoordScalar cur_log_prob = rot_log_probs(proj_idx) + trans_log_probs(proj_idx);
+
+        this->log_probs_[proj_idx] += cur_log_prob;
+        
+        this->reg_vals_[proj_idx] += log_norm_consts - cur_log_prob;
+      }
     }
   }
 }
@@ -94,6 +94,56 @@ xreg::CoordScalar xreg::Landmark2D3DRegiReprojDist::reproj_cost(const FrameTrans
   return tot_err;
 }
 
+xreg::PtN xreg::Landmark2D3DRegiReprojDist::reproj_costs(
+                                    const FrameTransformList& world_to_cam_xforms) const
+{
+  const size_type num_views = this->cams_.size();
+  xregASSERT(this->inds_2d_.size() == num_views); 
+
+  const size_type num_xforms = world_to_cam_xforms.size();
+
+  const size_type num_pts = this->world_pts_3d_.size();
+
+  const Pt3ListSoA pts_soa = Pt3ListToSoA(this->world_pts_3d_);
+
+  PtN tot_errs = PtN::Zero(num_xforms);
+
+  MatMxN inds_cols;
+  MatMxN inds_rows;
+
+  Eigen::Matrix<CoordScalar,1,Eigen::Dynamic> inds_2d_cols(num_pts);
+  Eigen::Matrix<CoordScalar,1,Eigen::Dynamic> inds_2d_rows(num_pts);
+
+  for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
+  {
+    const auto& cur_inds_2d = this->inds_2d_[view_idx];
+    xregASSERT(cur_inds_2d.size() == num_pts);
+
+    for (size_type pt_idx = 0; pt_idx < num_pts; ++pt_idx)
+    {
+      inds_2d_cols(pt_idx) = cur_inds_2d[pt_idx](0);
+      inds_2d_rows(pt_idx) = cur_inds_2d[pt_idx](1);
+    }
+
+    ProjPtsForPoses(this->cams_[view_idx], world_to_cam_xforms, pts_soa, &inds_cols, &inds_rows);
+
+    inds_cols.rowwise() -= inds_2d_cols;
+    inds_rows.rowwise() -= inds_2d_rows;
+
+    tot_errs += inds_cols.rowwise().squaredNorm() + inds_rows.rowwise().squaredNorm();
+  }
+
+  if (reg_fn_)
+  {
+    for (size_type i = 0; i < num_xforms; ++i)
+    {
+      tot_errs(i) += reg_coeff_ * reg_fn_(world_to_cam_xforms[i]);
+    }
+  }
+
+  return tot_errs;
+}
+
 bool xreg::Landmark2D3DRegiReprojDist::uses_ref_frame() const
 {
   return true;
@@ -55,6 +55,13 @@ protected:
 
   CoordScalar reproj_cost(const FrameTransform& cur_world_to_cam) const;
 
+  /// \brief Computes the reprojection cost of many candidate poses at once.
+  ///
+  /// The ith element of the returned vector is equal to
+  /// reproj_cost(world_to_cam_xforms[i]), however the landmarks are
+  /// projected for every candidate using a few matrix products per view.
+  PtN reproj_costs(const FrameTransformList& world_to_cam_xforms) const;
+
   SE3OptVarsPtr se3_vars_;
  
   CoordScalar reg_coeff_ = 0.1;
@@ -82,20 +82,30 @@ void xreg::Landmark2D3DRegiReprojDistCMAES::run_impl()
   evo.sp.stopTolFun = 1.0e-3;
   evo.sp.stopTolX   = 1.0e-6;
 
+  FrameTransformList pop_world_to_cam(pop_size_);
+
   while (!cmaes_TestForTermination(&evo))
   {
     double* const* pop = cmaes_SamplePopulation(&evo);
  
-    auto obj_fn_helper = [&] (const RangeType& r)
+    auto pose_helper = [&] (const RangeType& r)
     {
       for (size_type p = r.begin(); p < r.end(); ++p)
       {
-        obj_fn_vals[p] = this->reproj_cost(this->world_to_cam(
-            Eigen::Map<PtN_d>(const_cast<double*>(pop[p]), dim, 1).cast<CoordScalar>()));
+        pop_world_to_cam[p] = this->world_to_cam(
+            Eigen::Map<PtN_d>(const_cast<double*>(pop[p]), dim, 1).cast<CoordScalar>());
       }
     };
 
-    ParallelFor(obj_fn_helper, RangeType(0, pop_size_));
+    ParallelFor(pose_helper, RangeType(0, pop_size_));
+
+    // the reprojection errors of the entire population are computed together
+    const PtN pop_costs = this->reproj_costs(pop_world_to_cam);
+
+    for (size_type p = 0; p < pop_size_; ++p)
+    {
+      obj_fn_vals[p] = pop_costs(p);
+    }
     
     cmaes_UpdateDistribution(&evo, obj_fn_vals);
   }
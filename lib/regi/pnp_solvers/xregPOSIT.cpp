@@ -24,8 +24,11 @@
 
 #include "xregPOSIT.h"
 
+#include <limits>
+
 #include "xregAssert.h"
 #include "xregLinAlgUtils.h"
+#include "xregTBBUtils.h"
 
 void xreg::POSIT::run_impl()
 {
@@ -40,100 +43,108 @@ void xreg::POSIT::run_impl()
 
   // investigate this case later
   xregASSERT(cams_[0].coord_frame_type != CameraModel::kORIGIN_ON_DETECTOR);
+
+  xregASSERT(num_depth_hyps_ > 0);
   
-  if (ref_pt_idx_ < 0)
+  if ((ref_pt_idx_ >= 0) && (num_depth_hyps_ == 1))
   {
-    // recursively run posit with every point as the reference point and choose the
-    // pose with minimum reprojection error; optionally enforce that the points should
-    // lie between the origin and detector (nice for X-Ray)
+    this->regi_cam_to_world_ = run_for_single_ref_pt(static_cast<size_type>(ref_pt_idx_), 0);
+    return;
+  }
+
+  // run posit with every point as the reference point (unless a reference
+  // point was specified) and every depth hypothesis, then choose the pose with
+  // minimum reprojection error; optionally enforce that the points should lie
+  // between the origin and detector (nice for X-Ray)
+
+  const auto& cam    = this->cams_[0];
+  const auto& pts_2d = this->inds_2d_[0];
+  const auto& pts_3d = this->world_pts_3d_;
+
+  const size_type num_ref_pts = (ref_pt_idx_ < 0) ? num_pts : size_type(1);
+
+  const size_type num_starts = num_ref_pts * num_depth_hyps_;
 
-    const auto& cam    = this->cams_[0];
-    const auto& pts_2d = this->inds_2d_[0];
-    const auto& pts_3d = this->world_pts_3d_;
+  std::vector<CoordScalar> reproj_errors(num_starts);
+  std::vector<size_type> num_pts_between_origin_and_det(num_starts, 0);
+  FrameTransformList xforms(num_starts);
 
-    for (size_type new_ref_pt_idx = 0; new_ref_pt_idx < num_pts; ++new_ref_pt_idx)
+  auto run_starts = [&] (const RangeType& r)
+  {
+    for (size_type start_idx = r.begin(); start_idx < r.end(); ++start_idx)
     {
-      std::vector<CoordScalar> reproj_errors(num_pts);
-      std::vector<size_type> num_pts_between_origin_and_det(num_pts, 0);
-      std::vector<FrameTransform> xforms(num_pts);
+      const size_type ref_pt_idx = (ref_pt_idx_ < 0) ? (start_idx / num_depth_hyps_) :
+                                                       static_cast<size_type>(ref_pt_idx_);
 
-      for (new_ref_pt_idx = 0; new_ref_pt_idx < num_pts; ++new_ref_pt_idx)
-      {
-        const FrameTransform cur_xform = run_for_single_ref_pt(new_ref_pt_idx);
-        const FrameTransform xform_world_to_cam_extrins = cur_xform.inverse();
+      const FrameTransform cur_xform = run_for_single_ref_pt(ref_pt_idx, start_idx % num_depth_hyps_);
+      const FrameTransform xform_world_to_cam_extrins = cur_xform.inverse();
 
-        xforms[new_ref_pt_idx] = cur_xform;
+      xforms[start_idx] = cur_xform;
 
-        CoordScalar cur_reproj_error = 0;
-        for (size_type i = 0; i < num_pts; ++i)
+      CoordScalar cur_reproj_error = 0;
+      for (size_type i = 0; i < num_pts; ++i)
+      {
+        const Pt3 cur_pt_wrt_cam_extrins = xform_world_to_cam_extrins * pts_3d[i];
+        
+        cur_reproj_error += (pts_2d[i] - cam.phys_pt_to_ind_pt(cur_pt_wrt_cam_extrins).head(2)).norm();
+        
+        if (prefer_points_between_origin_and_det_)
         {
-          const Pt3 cur_pt_wrt_cam_extrins = xform_world_to_cam_extrins * pts_3d[i];
-          
-          cur_reproj_error += (pts_2d[i] - cam.phys_pt_to_ind_pt(cur_pt_wrt_cam_extrins).head(2)).norm();
-          
-          if (prefer_points_between_origin_and_det_)
-          {
-            const Pt3 cur_pt_wrt_cam = cam.extrins * cur_pt_wrt_cam_extrins;
+          const Pt3 cur_pt_wrt_cam = cam.extrins * cur_pt_wrt_cam_extrins;
 
-            if (cam.coord_frame_type == CameraModel::kORIGIN_AT_FOCAL_PT_DET_NEG_Z)
-            {
-              if ((cur_pt_wrt_cam(2) < 0) && (cur_pt_wrt_cam(2) > -cam.focal_len))
-              {
-                ++num_pts_between_origin_and_det[new_ref_pt_idx];
-              }
-            }
-            else if ((cur_pt_wrt_cam(2) > 0) && (cur_pt_wrt_cam(2) < cam.focal_len))
+          if (cam.coord_frame_type == CameraModel::kORIGIN_AT_FOCAL_PT_DET_NEG_Z)
+          {
+            if ((cur_pt_wrt_cam(2) < 0) && (cur_pt_wrt_cam(2) > -cam.focal_len))
             {
-              ++num_pts_between_origin_and_det[new_ref_pt_idx];
+              ++num_pts_between_origin_and_det[start_idx];
             }
           }
+          else if ((cur_pt_wrt_cam(2) > 0) && (cur_pt_wrt_cam(2) < cam.focal_len))
+          {
+            ++num_pts_between_origin_and_det[start_idx];
+          }
         }
       }
-        
-      const FrameTransform best_xform_min_reproj = xforms[std::min_element(reproj_errors.begin(), reproj_errors.end())
-                                                      - reproj_errors.begin()];
-      
-      FrameTransform best_xform = best_xform_min_reproj;
 
-      if (prefer_points_between_origin_and_det_)
-      {
-        using TmpInfo = std::tuple<CoordScalar,size_type,FrameTransform>;
+      // a degenerate start should never be selected
+      reproj_errors[start_idx] = std::isfinite(cur_reproj_error) ?
+                                    cur_reproj_error : std::numeric_limits<CoordScalar>::max();
+    }
+  };
 
-        std::vector<TmpInfo> zipped_infos(num_pts);
-        
-        for (size_type i = 0; i < num_pts; ++i)
-        {
-          zipped_infos[i] = std::make_tuple(reproj_errors[i], num_pts_between_origin_and_det[i], xforms[i]);
-        }
+  ParallelFor(run_starts, RangeType(0, num_starts));
+    
+  FrameTransform best_xform = xforms[std::min_element(reproj_errors.begin(), reproj_errors.end())
+                                        - reproj_errors.begin()];
 
-        std::sort(zipped_infos.begin(), zipped_infos.end(),
-                  [] (const TmpInfo& l, const TmpInfo& r)
-                  {
-                    return std::get<0>(l) < std::get<0>(r);
-                  });
-        
-        bool all_points_in_front = false;
-        for (const auto& info : zipped_infos)
-        {
-          if (std::get<1>(info) == num_pts)
-          {
-            best_xform = std::get<2>(info);
-            all_points_in_front = true;
-            break;
-          }
-        }
+  if (prefer_points_between_origin_and_det_)
+  {
+    using TmpInfo = std::tuple<CoordScalar,size_type,FrameTransform>;
 
-        // this was for testing...
-        //xregASSERT(all_points_in_front);
-      }
+    std::vector<TmpInfo> zipped_infos(num_starts);
+    
+    for (size_type i = 0; i < num_starts; ++i)
+    {
+      zipped_infos[i] = std::make_tuple(reproj_errors[i], num_pts_between_origin_and_det[i], xforms[i]);
+    }
 
-      this->regi_cam_to_world_ = best_xform;
+    std::sort(zipped_infos.begin(), zipped_infos.end(),
+              [] (const TmpInfo& l, const TmpInfo& r)
+              {
+                return std::get<0>(l) < std::get<0>(r);
+              });
+    
+    for (const auto& info : zipped_infos)
+    {
+      if (std::get<1>(info) == num_pts)
+      {
+        best_xform = std::get<2>(info);
+        break;
+      }
     }
   }
-  else
-  {
-    this->regi_cam_to_world_ = run_for_single_ref_pt(static_cast<size_type>(ref_pt_idx_));
-  }
+
+  this->regi_cam_to_world_ = best_xform;
 }
 
 bool xreg::POSIT::uses_ref_frame() const
@@ -141,7 +152,8 @@ bool xreg::POSIT::uses_ref_frame() const
   return false;
 }
 
-xreg::FrameTransform xreg::POSIT::run_for_single_ref_pt(const size_type ref_pt_idx) const
+xreg::FrameTransform xreg::POSIT::run_for_single_ref_pt(const size_type ref_pt_idx,
+                                                       const size_type depth_hyp_idx) const
 {
   using MatRowMaj = Eigen::Matrix<CoordScalar,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor>;
   
@@ -211,6 +223,48 @@ xreg::FrameTransform xreg::POSIT::run_for_single_ref_pt(const size_type ref_pt_i
 
   size_type num_its = 0;
 
+  if (depth_hyp_idx > 0)
+  {
+    // Initialize the relative depths of the landmarks using an optical axis
+    // tilted away from the axis estimated by a scaled orthographic projection.
+    // The hypotheses are spread over a spherical cap using a golden angle
+    // spiral.
+    for (size_type i = 0; i < num_pts_minus_one; ++i)
+    {
+      x_prime(i) = pruned_2d_pts[i](0) - ref_pt_2d(0);
+      y_prime(i) = pruned_2d_pts[i](1) - ref_pt_2d(1);
+    }
+
+    I = B * x_prime;
+    J = B * y_prime;
+
+    const CoordScalar s_1 = I.norm();
+    const CoordScalar s_2 = J.norm();
+    s = (s_1 + s_2) / 2;
+
+    i_vec = I / s_1;
+    j_vec = (J / s_2).normalized();
+    k_vec = i_vec.cross(j_vec).normalized();
+    j_vec = k_vec.cross(i_vec);
+
+    const CoordScalar Z_0 = (cam.focal_len / s) * ((cam.coord_frame_type == CameraModel::kORIGIN_AT_FOCAL_PT_DET_NEG_Z)
+                                               ? CoordScalar(-1) : CoordScalar(1));
+
+    constexpr CoordScalar kGOLDEN_ANGLE = 2.399963229728653;
+
+    const CoordScalar tilt = depth_hyp_max_tilt_ *
+                                std::sqrt(static_cast<CoordScalar>(depth_hyp_idx) / (num_depth_hyps_ - 1));
+    const CoordScalar azimuth = kGOLDEN_ANGLE * depth_hyp_idx;
+
+    const Pt3 hyp_k_vec = (std::cos(tilt) * k_vec) +
+                          (std::sin(tilt) * ((std::cos(azimuth) * i_vec) + (std::sin(azimuth) * j_vec)));
+
+    for (size_type i = 0; i < num_pts_minus_one; ++i)
+    {
+      eps(i) = A.row(i).dot(hyp_k_vec) / Z_0;
+    }
+  }
+
   while (!should_stop)
   {
     ++num_its;
@@ -293,3 +347,12 @@ int xreg::POSIT::num_pts_required()
   return 4;
 }
 
+void xreg::POSIT::set_num_depth_hyps(const size_type num_hyps)
+{
+  num_depth_hyps_ = num_hyps;
+}
+
+void xreg::POSIT::set_depth_hyp_max_tilt(const CoordScalar max_tilt)
+{
+  depth_hyp_max_tilt_ = max_tilt;
+}
@@ -38,6 +38,22 @@ public:
   void set_ref_pt_idx(const int ref_pt_idx);
 
   void set_prefer_points_between_origin_and_det(const bool p);
+
+  /// \brief Sets the number of initial depth hypotheses used for each
+  ///        reference point.
+  ///
+  /// The first hypothesis is the standard initialization of POSIT, a scaled
+  /// orthographic projection with every landmark at the depth of the reference
+  /// point. The remaining hypotheses initialize the relative depths of the
+  /// landmarks using optical axes tilted away from the one estimated by the
+  /// scaled orthographic projection, by up to the maximum tilt angle. Every
+  /// reference point and hypothesis is run in parallel and the pose with the
+  /// smallest reprojection error is selected. Defaults to 1.
+  void set_num_depth_hyps(const size_type num_hyps);
+
+  /// \brief Sets the maximum tilt (radians) of the optical axes used by the
+  ///        depth hypotheses. Defaults to 45 degrees.
+  void set_depth_hyp_max_tilt(const CoordScalar max_tilt);
   
   int num_pts_required() override;
   
@@ -48,12 +64,16 @@ protected:
 
 private:
 
-  FrameTransform run_for_single_ref_pt(const size_type ref_pt_idx) const;
+  FrameTransform run_for_single_ref_pt(const size_type ref_pt_idx,
+                                       const size_type depth_hyp_idx) const;
 
   int ref_pt_idx_ = -1;
 
   bool prefer_points_between_origin_and_det_ = false;
 
+  size_type num_depth_hyps_ = 1;
+
+  CoordScalar depth_hyp_max_tilt_ = 45 * kDEG2RAD;
 };
 
 }  // xreg
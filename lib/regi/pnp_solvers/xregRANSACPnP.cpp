@@ -24,11 +24,92 @@
 
 #include "xregRANSACPnP.h"
 
+#include <random>
+
 #include "xregAssert.h"
 #include "xregSampleUtils.h"
+#include "xregTBBUtils.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+using DistsMat = Eigen::Matrix<CoordScalar,Eigen::Dynamic,Eigen::Dynamic>;
+
+// Number of hypotheses which are generated and scored together
+constexpr size_type kHYP_BATCH_SIZE = 64;
+
+// n choose k
+size_type NumCombos(const size_type n, const size_type k)
+{
+  size_type c = 0;
+
+  if (n >= k)
+  {
+    c = 1;
+
+    for (size_type i = 0; i < k; ++i)
+    {
+      c = (c * (n - i)) / (i + 1);
+    }
+  }
+
+  return c;
+}
+
+// Computes the reprojection distance of every landmark (rows) for the first
+// num_poses camera to world poses (columns) in a single batch.
+void ReprojDistsForPoses(const CameraModel& cam, const FrameTransformList& cam_to_world_poses,
+                         const size_type num_poses, const Pt3ListSoA& pts_3d,
+                         const Pt2List& inds_2d, DistsMat* dists)
+{
+  Mat3x4List proj_mats(num_poses);
+
+  const Mat3x4 cam_proj_mat = cam.phys_to_ind_proj_mat();
+
+  for (size_type j = 0; j < num_poses; ++j)
+  {
+    // pose maps camera to world, we want world to cam
+    proj_mats[j] = cam_proj_mat * cam_to_world_poses[j].inverse().matrix();
+  }
+
+  MatMxN inds_cols;
+  MatMxN inds_rows;
+
+  ProjPtsForProjMats(proj_mats, pts_3d, &inds_cols, &inds_rows);
+
+  const size_type num_pts = inds_2d.size();
+
+  dists->resize(num_pts, num_poses);
+
+  for (size_type i = 0; i < num_pts; ++i)
+  {
+    dists->row(i) = ((inds_cols.col(i).array() - inds_2d[i](0)).square() +
+                     (inds_rows.col(i).array() - inds_2d[i](1)).square()).sqrt().matrix().transpose();
+  }
+}
+
+}  // un-named
 
 void xreg::RANSACPnP::run_impl()
 {
+  // solvers are only created per-thread when both factories are available
+  const bool use_factories = pnp_prop_factory_ && pnp_factory_;
+
+  if (use_factories)
+  {
+    if (!pnp_prop_)
+    {
+      pnp_prop_ = pnp_prop_factory_();
+    }
+
+    if (!pnp_)
+    {
+      pnp_ = pnp_factory_();
+    }
+  }
+
   xregASSERT(pnp_prop_ && pnp_);
   
   const int min_num_pts_for_prop = pnp_prop_->num_pts_required();
@@ -44,14 +125,23 @@ void xreg::RANSACPnP::run_impl()
   const auto& pts_3d  = this->world_pts_3d_;
   const auto& inds_2d = this->inds_2d_[0];
 
-  pnp_prop_->set_cam(cam);
-  pnp_prop_->set_init_cam_to_world(this->init_cam_to_world_);
-  pnp_prop_->set_ref_frame(this->ref_frame_, this->ref_frame_maps_world_to_ref_);
+  auto setup_prop = [this,&cam] (Landmark2D3DRegi* prop)
+  {
+    prop->set_cam(cam);
+    prop->set_init_cam_to_world(this->init_cam_to_world_);
+    prop->set_ref_frame(this->ref_frame_, this->ref_frame_maps_world_to_ref_);
+  };
+
+  auto setup_refine = [this,&cam] (Landmark2D3DRegi* refine)
+  {
+    refine->set_cam(cam);
+    refine->set_ref_frame(this->ref_frame_, this->ref_frame_maps_world_to_ref_);
+  };
 
-  pnp_->set_cam(cam);
-  pnp_->set_ref_frame(this->ref_frame_, this->ref_frame_maps_world_to_ref_);
+  setup_prop(pnp_prop_.get());
+  setup_refine(pnp_.get());
 
-  FrameTransform cur_best_pose;
+  FrameTransform cur_best_pose = this->init_cam_to_world_;
 
   cur_best_mean_reproj_ = std::numeric_limits<CoordScalar>::max();
   
@@ -60,100 +150,217 @@ void xreg::RANSACPnP::run_impl()
   const size_type num_pts = pts_3d.size();
   xregASSERT(num_pts == inds_2d.size());
 
-  Pt3List tmp_pts_3d;
-  Pt2List tmp_inds_2d;
-  
-  tmp_pts_3d.reserve(num_pts);
-  tmp_inds_2d.reserve(num_pts);
+  const Pt3ListSoA pts_3d_soa = Pt3ListToSoA(pts_3d);
 
-  std::vector<std::vector<size_type>> combos = (min_num_pts_for_prop == 3) ?
-                                                  BruteForce3Combos(num_pts) : BruteForce4Combos(num_pts);
-  
-  if ((num_proposals_ > 0) && (static_cast<size_type>(num_proposals_) < combos.size()))
+  // Determine the minimal set of points used by each hypothesis; when only a
+  // subset of all possible combinations is used, each hypothesis samples its
+  // own combination from an independent random stream.
+
+  const size_type num_combos = NumCombos(num_pts, min_num_pts_for_prop);
+
+  const bool sample_combos = (num_proposals_ > 0) && (static_cast<size_type>(num_proposals_) < num_combos);
+
+  std::vector<std::vector<size_type>> combos;
+
+  if (!sample_combos)
+  {
+    combos = (min_num_pts_for_prop == 3) ? BruteForce3Combos(num_pts) : BruteForce4Combos(num_pts);
+  }
+
+  const size_type num_hyps = sample_combos ? static_cast<size_type>(num_proposals_) : combos.size();
+
+  std::uint32_t seed = seed_;
+
+  if (sample_combos && !has_seed_)
   {
     std::mt19937 rng_eng;
     SeedRNGEngWithRandDev(&rng_eng);
 
-    std::shuffle(combos.begin(), combos.end(), rng_eng);
-    
-    combos.resize(num_proposals_);
+    seed = rng_eng();
   }
 
-  for (const auto& cur_combo : combos)
+  const PhiloxKey philox_key = MakePhiloxKey(seed);
+
+  auto get_combo = [&combos,sample_combos,num_pts,min_num_pts_for_prop,&philox_key] (const size_type hyp_idx)
   {
-    tmp_pts_3d.clear();
-    tmp_inds_2d.clear();
+    std::vector<size_type> combo;
 
-    for (const size_type prop_idx : cur_combo)
+    if (sample_combos)
     {
-      tmp_pts_3d.push_back(pts_3d[prop_idx]);
-      tmp_inds_2d.push_back(inds_2d[prop_idx]);
+      const PhiloxCtr ctr = { static_cast<std::uint32_t>(hyp_idx), 0, 0, 0 };
+
+      std::mt19937 hyp_rng_eng(Philox4x32(ctr, philox_key)[0]);
+
+      combo = SampleSortedSubset(num_pts, min_num_pts_for_prop, hyp_rng_eng);
+    }
+    else
+    {
+      combo = combos[hyp_idx];
     }
 
-    pnp_prop_->set_inds_2d(tmp_inds_2d);
-    pnp_prop_->set_world_pts_3d(tmp_pts_3d);
-    pnp_prop_->run();
-    FrameTransform cur_pose = pnp_prop_->regi_cam_to_world();
- 
-    // pose maps camera to world, we want world to cam
-    FrameTransform cur_pose_inv = cur_pose.inverse();
+    return combo;
+  };
+
+  FrameTransformList hyp_poses(kHYP_BATCH_SIZE);
+
+  std::vector<size_type> hyp_num_inliers(kHYP_BATCH_SIZE);
 
-    tmp_pts_3d.clear();
-    tmp_inds_2d.clear();
+  CoordScalarList hyp_mean_reprojs(kHYP_BATCH_SIZE);
 
-    CoordScalar tot_reproj = 0;
+  DistsMat reproj_dists;
 
-    for (size_type i = 0; i < num_pts; ++i)
+  size_type batch_start = 0;
+  size_type batch_len   = 0;
+
+  // Proposes a pose for each hypothesis in a sub-range of the current batch
+  auto propose_fn = [&] (const RangeType& r)
+  {
+    SolverPtr prop = this->pnp_prop_;
+
+    if (use_factories)
+    {
+      prop = this->pnp_prop_factory_();
+      setup_prop(prop.get());
+    }
+
+    Pt3List tmp_pts_3d;
+    Pt2List tmp_inds_2d;
+
+    for (size_type j = r.begin(); j != r.end(); ++j)
     {
-      const CoordScalar cur_reproj = (cam.phys_pt_to_ind_pt(cur_pose_inv * pts_3d[i]).head(2) - inds_2d[i]).norm();
+      tmp_pts_3d.clear();
+      tmp_inds_2d.clear();
 
-      if (cur_reproj < inlier_reproj_thresh_pixels_)
+      for (const size_type prop_idx : get_combo(batch_start + j))
       {
-        tmp_pts_3d.push_back(pts_3d[i]);
-        tmp_inds_2d.push_back(inds_2d[i]);
-        
-        tot_reproj += cur_reproj;
+        tmp_pts_3d.push_back(pts_3d[prop_idx]);
+        tmp_inds_2d.push_back(inds_2d[prop_idx]);
       }
+
+      prop->set_inds_2d(tmp_inds_2d);
+      prop->set_world_pts_3d(tmp_pts_3d);
+      prop->run();
+
+      hyp_poses[j] = prop->regi_cam_to_world();
+    }
+  };
+
+  // Refines the proposals with sufficient inliers in a sub-range of the
+  // current batch, using the reprojection distances of the proposals
+  auto refine_fn = [&] (const RangeType& r)
+  {
+    SolverPtr refine = this->pnp_;
+
+    if (use_factories)
+    {
+      refine = this->pnp_factory_();
+      setup_refine(refine.get());
     }
 
-    const size_type cur_num_inliers = tmp_pts_3d.size();
-    
-    if (cur_num_inliers >= min_num_inliers_)
+    Pt3List tmp_pts_3d;
+    Pt2List tmp_inds_2d;
+
+    tmp_pts_3d.reserve(num_pts);
+    tmp_inds_2d.reserve(num_pts);
+
+    for (size_type j = r.begin(); j != r.end(); ++j)
     {
-      // solve the pnp prob with the inliers
-      
-      pnp_->set_inds_2d(tmp_inds_2d);
-      pnp_->set_world_pts_3d(tmp_pts_3d);
-      pnp_->set_init_cam_to_world(cur_pose);
-      pnp_->run();
-      cur_pose = pnp_->regi_cam_to_world();
-      cur_pose_inv = cur_pose.inverse();
-    
-      tot_reproj = 0;
-
-      for (size_type i = 0; i < cur_num_inliers; ++i)
+      tmp_pts_3d.clear();
+      tmp_inds_2d.clear();
+
+      CoordScalar tot_reproj = 0;
+
+      for (size_type i = 0; i < num_pts; ++i)
+      {
+        const CoordScalar cur_reproj = reproj_dists(i,j);
+
+        if (cur_reproj < this->inlier_reproj_thresh_pixels_)
+        {
+          tmp_pts_3d.push_back(pts_3d[i]);
+          tmp_inds_2d.push_back(inds_2d[i]);
+
+          tot_reproj += cur_reproj;
+        }
+      }
+
+      const size_type cur_num_inliers = tmp_pts_3d.size();
+
+      if (cur_num_inliers >= this->min_num_inliers_)
       {
-        tot_reproj += (cam.phys_pt_to_ind_pt(cur_pose_inv * tmp_pts_3d[i]).head(2) - tmp_inds_2d[i]).norm();
+        // solve the pnp prob with the inliers
+
+        refine->set_inds_2d(tmp_inds_2d);
+        refine->set_world_pts_3d(tmp_pts_3d);
+        refine->set_init_cam_to_world(hyp_poses[j]);
+        refine->run();
+
+        hyp_poses[j] = refine->regi_cam_to_world();
+
+        const FrameTransform cur_pose_inv = hyp_poses[j].inverse();
+
+        tot_reproj = 0;
+
+        for (size_type i = 0; i < cur_num_inliers; ++i)
+        {
+          tot_reproj += (cam.phys_pt_to_ind_pt(cur_pose_inv * tmp_pts_3d[i]).head(2) - tmp_inds_2d[i]).norm();
+        }
       }
+
+      hyp_num_inliers[j]  = cur_num_inliers;
+      hyp_mean_reprojs[j] = cur_num_inliers ? (tot_reproj / cur_num_inliers) :
+                                              std::numeric_limits<CoordScalar>::max();
     }
+  };
+
+  for (batch_start = 0; batch_start < num_hyps; batch_start += kHYP_BATCH_SIZE)
+  {
+    batch_len = std::min(kHYP_BATCH_SIZE, num_hyps - batch_start);
 
-    tot_reproj /= cur_num_inliers;
+    const RangeType batch_range(0, batch_len);
 
-    if ((cur_num_inliers > cur_best_num_inliers_) ||
-        ((cur_num_inliers == cur_best_num_inliers_) && (tot_reproj < cur_best_mean_reproj_)))
+    if (use_factories)
     {
-      // We have more inliers the previous best, or we have equal number with lower reproj. error.
-      // Replace the previous best with current solution
-      cur_best_num_inliers_ = cur_num_inliers;
-      cur_best_mean_reproj_ = tot_reproj;
-      cur_best_pose = cur_pose;
-      
-      //if ((cur_num_inliers == num_pts) || (cur_num_inliers >= 6))
-      //{
-      //  // we've got enough inliers to trust this result
-      //  break;
-      //}
-    }  
+      ParallelFor(propose_fn, batch_range);
+    }
+    else
+    {
+      propose_fn(batch_range);
+    }
+
+    ReprojDistsForPoses(cam, hyp_poses, batch_len, pts_3d_soa, inds_2d, &reproj_dists);
+
+    if (use_factories)
+    {
+      ParallelFor(refine_fn, batch_range);
+    }
+    else
+    {
+      refine_fn(batch_range);
+    }
+
+    // hypotheses are compared in order, so that ties are resolved in the same
+    // way regardless of the number of threads
+    for (size_type j = 0; j < batch_len; ++j)
+    {
+      const size_type   cur_num_inliers = hyp_num_inliers[j];
+      const CoordScalar cur_mean_reproj = hyp_mean_reprojs[j];
+
+      if ((cur_num_inliers > cur_best_num_inliers_) ||
+          ((cur_num_inliers == cur_best_num_inliers_) && (cur_mean_reproj < cur_best_mean_reproj_)))
+      {
+        // We have more inliers the previous best, or we have equal number with lower reproj. error.
+        // Replace the previous best with current solution
+        cur_best_num_inliers_ = cur_num_inliers;
+        cur_best_mean_reproj_ = cur_mean_reproj;
+        cur_best_pose = hyp_poses[j];
+      }
+    }
+
+    if (cur_best_num_inliers_ >= (stop_inlier_ratio_ * num_pts))
+    {
+      // we've got enough inliers to trust this result
+      break;
+    }
   }
 
   this->regi_cam_to_world_ = cur_best_pose;
@@ -161,7 +368,10 @@ void xreg::RANSACPnP::run_impl()
 
 bool xreg::RANSACPnP::uses_ref_frame() const
 {
-  return pnp_prop_->uses_ref_frame() || pnp_->uses_ref_frame();
+  const SolverPtr prop   = pnp_prop_ ? pnp_prop_ : pnp_prop_factory_();
+  const SolverPtr refine = pnp_ ? pnp_ : pnp_factory_();
+
+  return prop->uses_ref_frame() || refine->uses_ref_frame();
 }
 
 void xreg::RANSACPnP::set_pnp_prop(std::shared_ptr<Landmark2D3DRegi> pnp_prop)
@@ -174,6 +384,27 @@ void xreg::RANSACPnP::set_pnp(std::shared_ptr<Landmark2D3DRegi> pnp)
   pnp_ = pnp;
 }
 
+void xreg::RANSACPnP::set_pnp_prop_factory(const SolverFactory& pnp_prop_factory)
+{
+  pnp_prop_factory_ = pnp_prop_factory;
+}
+
+void xreg::RANSACPnP::set_pnp_factory(const SolverFactory& pnp_factory)
+{
+  pnp_factory_ = pnp_factory;
+}
+
+void xreg::RANSACPnP::set_seed(const std::uint32_t seed)
+{
+  seed_     = seed;
+  has_seed_ = true;
+}
+
+void xreg::RANSACPnP::set_stop_inlier_ratio(const CoordScalar stop_inlier_ratio)
+{
+  stop_inlier_ratio_ = stop_inlier_ratio;
+}
+
 void xreg::RANSACPnP::set_num_proposals(const int num_proposals)
 {
   num_proposals_ = num_proposals;
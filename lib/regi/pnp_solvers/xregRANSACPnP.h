@@ -25,6 +25,8 @@
 #ifndef XREGRANSACPNP_H
 #define XREGRANSACPNP_H
 
+#include <functional>
+
 #include "xregLandmark2D3DRegi.h"
 
 namespace xreg
@@ -33,6 +35,9 @@ namespace xreg
 class RANSACPnP : public Landmark2D3DRegi
 {
 public:
+  using SolverPtr = std::shared_ptr<Landmark2D3DRegi>;
+
+  using SolverFactory = std::function<SolverPtr()>;
 
   RANSACPnP() = default;
 
@@ -40,6 +45,33 @@ public:
 
   void set_pnp(std::shared_ptr<Landmark2D3DRegi> pnp);
 
+  /// \brief Sets factories used to create proposal and refinement solvers
+  ///        for each thread.
+  ///
+  /// Solvers are stateful, so hypotheses are only generated and refined
+  /// concurrently when both factories are set; otherwise the solvers passed
+  /// to set_pnp_prop() and set_pnp() are used serially. When factories are
+  /// set, set_pnp_prop() and set_pnp() do not need to be called.
+  void set_pnp_prop_factory(const SolverFactory& pnp_prop_factory);
+
+  void set_pnp_factory(const SolverFactory& pnp_factory);
+
+  /// \brief Seed used to sample the minimal sets of points for each
+  ///        hypothesis.
+  ///
+  /// Each hypothesis uses its own random stream derived from this seed, so
+  /// the results do not depend on the number of threads. When not set, a
+  /// random seed is used for each run.
+  void set_seed(const std::uint32_t seed);
+
+  /// \brief Stops evaluating hypotheses once the best hypothesis has at least
+  ///        this fraction of the landmarks as inliers.
+  ///
+  /// Hypotheses are evaluated in batches, so the batch containing the
+  /// satisfying hypothesis is completed. Values greater than 1 (the default)
+  /// indicate that all proposals are evaluated.
+  void set_stop_inlier_ratio(const CoordScalar stop_inlier_ratio);
+
   void set_num_proposals(const int num_proposals);
 
   void set_inlier_reproj_thresh_pixels(const CoordScalar thresh);
@@ -68,6 +100,16 @@ private:
   // re-projection distances.
   std::shared_ptr<Landmark2D3DRegi> pnp_;
 
+  SolverFactory pnp_prop_factory_;
+
+  SolverFactory pnp_factory_;
+
+  bool has_seed_ = false;
+
+  std::uint32_t seed_ = 0;
+
+  CoordScalar stop_inlier_ratio_ = 2;
+
   // <= 0 --> do all possible
   int num_proposals_ = 50;
 
@@ -23,6 +23,10 @@
  */
 
 #include "xregImgSimMetric2D.h"
+
+#include "xregAssert.h"
+#include "xregSampleUtils.h"
+#include "xregTBBUtils.h"
   
 void xreg::ImgSimMetric2D::set_fixed_image(ImagePtr fixed_img)
 {
@@ -39,6 +43,9 @@ void xreg::ImgSimMetric2D::allocate_resources()
   sim_vals_.resize(num_mov_imgs_);
 }
   
+void xreg::ImgSimMetric2D::prebuild_progs()
+{ }
+
 void xreg::ImgSimMetric2D::set_num_moving_images(const size_type n)
 {
   num_mov_imgs_ = n;
@@ -91,6 +98,147 @@ xreg::ImgSimMetric2D::ImageMaskPtr xreg::ImgSimMetric2D::mask()
   return mask_;
 }
 
+bool xreg::ImgSimMetric2D::mov_img_pixels_used(PixelIndexList* pix_inds)
+{
+  return false;
+}
+
+bool xreg::ImgSimMetric2D::mask_pixels_used(PixelIndexList* pix_inds)
+{
+  if (!mask_)
+  {
+    return false;
+  }
+
+  *pix_inds = mask_pix_inds();
+
+  return true;
+}
+
+const xreg::ImgSimMetric2D::PixelIndexList& xreg::ImgSimMetric2D::mask_pix_inds()
+{
+  update_mask_pix_inds();
+
+  return mask_pix_inds_;
+}
+
+void xreg::ImgSimMetric2D::update_mask_pix_inds()
+{
+  if (mask_.GetPointer() != mask_for_pix_inds_)
+  {
+    mask_pix_inds_.clear();
+
+    if (mask_)
+    {
+      const auto mask_size = mask_->GetLargestPossibleRegion().GetSize();
+
+      const size_type num_pix = mask_size[0] * mask_size[1];
+
+      const MaskScalar* mask_buf = mask_->GetBufferPointer();
+
+      for (size_type i = 0; i < num_pix; ++i)
+      {
+        if (mask_buf[i])
+        {
+          mask_pix_inds_.push_back(i);
+        }
+      }
+    }
+
+    mask_for_pix_inds_ = mask_.GetPointer();
+  }
+}
+
+void xreg::ImgSimMetric2D::set_pixel_subsample_frac(const double frac)
+{
+  xregASSERT(frac > 0);
+
+  pixel_subsample_frac_ = frac;
+}
+
+double xreg::ImgSimMetric2D::pixel_subsample_frac() const
+{
+  return pixel_subsample_frac_;
+}
+
+void xreg::ImgSimMetric2D::set_pixel_subsample_seed(const std::uint32_t seed)
+{
+  pixel_subsample_seed_ = seed;
+
+  pixel_subsample_rng_.seed(seed);
+}
+
+std::uint32_t xreg::ImgSimMetric2D::pixel_subsample_seed() const
+{
+  return pixel_subsample_seed_;
+}
+
+bool xreg::ImgSimMetric2D::use_pixel_subsample() const
+{
+  return pixel_subsample_frac_ < 1;
+}
+
+bool xreg::ImgSimMetric2D::subsample_pixels_used(PixelIndexList* pix_inds)
+{
+  if (!use_pixel_subsample())
+  {
+    return mask_pixels_used(pix_inds);
+  }
+
+  draw_pixel_subsample();
+  subsample_pix_inds_pre_chosen_ = true;
+
+  *pix_inds = subsample_pix_inds_;
+
+  return true;
+}
+
+const xreg::ImgSimMetric2D::PixelIndexList* xreg::ImgSimMetric2D::pix_inds_to_use()
+{
+  if (use_pixel_subsample())
+  {
+    if (!subsample_pix_inds_pre_chosen_)
+    {
+      draw_pixel_subsample();
+    }
+
+    // the next computation draws a new subset
+    subsample_pix_inds_pre_chosen_ = false;
+
+    return &subsample_pix_inds_;
+  }
+  
+  return mask_ ? &mask_pix_inds() : nullptr;
+}
+
+xreg::size_type xreg::ImgSimMetric2D::num_pix_available_for_subsample()
+{
+  return mask_ ? mask_pix_inds().size() : num_pix_per_proj();
+}
+
+void xreg::ImgSimMetric2D::draw_pixel_subsample()
+{
+  const size_type num_avail = num_pix_available_for_subsample();
+
+  // at least two pixels are required for a sample variance
+  const size_type num_to_sample = std::min(num_avail,
+              std::max(size_type(2),
+                       static_cast<size_type>((pixel_subsample_frac_ * num_avail) + 0.5)));
+
+  subsample_pix_inds_ = SampleSortedSubset(num_avail, num_to_sample, pixel_subsample_rng_);
+
+  if (mask_)
+  {
+    // map the sampled positions into the list of unmasked pixels
+    const PixelIndexList& mask_inds = mask_pix_inds();
+
+    for (auto& i : subsample_pix_inds_)
+    {
+      i = mask_inds[i];
+    }
+  }
+}
+
 void xreg::ImgSimMetric2D::set_save_aux_info(const bool save_aux)
 {
   save_aux_info_ = save_aux;
@@ -100,6 +248,16 @@ std::shared_ptr<xreg::H5ReadWriteInterface> xreg::ImgSimMetric2D::aux_info()
 {
   return nullptr;
 }
+
+void xreg::ImgSimMetric2D::set_exec_context(std::shared_ptr<ParallelExecContext> ctx)
+{
+  exec_ctx_ = ctx;
+}
+
+std::shared_ptr<xreg::ParallelExecContext> xreg::ImgSimMetric2D::exec_context() const
+{
+  return exec_ctx_;
+}
   
 xreg::size_type xreg::ImgSimMetric2D::num_pix_per_proj()
 {
@@ -111,6 +269,11 @@ void xreg::ImgSimMetric2D::process_updated_mask()
 {
   if (this->mask_updated_)
   {
+    // force the compact pixel list to be rebuilt, the mask buffer may have
+    // been modified in place
+    mask_pix_inds_.clear();
+    mask_for_pix_inds_ = nullptr;
+
     process_mask();
 
     mask_updated_ = false;
@@ -118,5 +281,7 @@ void xreg::ImgSimMetric2D::process_updated_mask()
 }
 
 void xreg::ImgSimMetric2D::process_mask()
-{ }
+{
+  update_mask_pix_inds();
+}
 
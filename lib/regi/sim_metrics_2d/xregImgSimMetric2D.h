@@ -25,6 +25,8 @@
 #ifndef XREGIMGSIMMETRIC2D_H_
 #define XREGIMGSIMMETRIC2D_H_
 
+#include <random>
+
 #include "xregCommon.h"
 
 namespace xreg
@@ -32,6 +34,7 @@ namespace xreg
 
 // Forward Declarations
 class  RayCaster;
+class  ParallelExecContext;
 struct H5ReadWriteInterface;
 
 /// \brief Base class for computing a similarity metric between a fixed (static)
@@ -50,6 +53,9 @@ public:
   using ImageMask    = itk::Image<MaskScalar,2>;
   using ImageMaskPtr = ImageMask::Pointer;
 
+  /// \brief Pixel offsets into a (row-major) moving image
+  using PixelIndexList = std::vector<size_type>;
+
   class UnsupportedOperationException { };
 
   /// \brief Constructor - trivial does not perform any work.
@@ -80,6 +86,16 @@ public:
   /// of their implementation of allocate_resources().
   virtual void allocate_resources();
 
+  /// \brief Builds any device programs used by this metric ahead of
+  ///        allocating resources.
+  ///
+  /// The programs are then reused by allocate_resources(), so this may be
+  /// called on a background thread to hide the time spent compiling. Only
+  /// settings which determine the programs need to be set; no other method of
+  /// this object may be called concurrently.
+  /// The default implementation does nothing.
+  virtual void prebuild_progs();
+
   /// \brief Perform the similarity computations between each moving image and
   ///        the fixed image.
   ///
@@ -131,10 +147,55 @@ public:
 
   ImageMaskPtr mask();
 
+  /// \brief Retrieves the pixels of the moving images that are used by the
+  ///        next similarity computation.
+  ///
+  /// Returns false when every pixel may be used, otherwise the (ascending)
+  /// pixel offsets are populated and true is returned. The remaining pixels of
+  /// the moving images do not influence the similarity values, so they do not
+  /// need to be computed (e.g. by RayCaster::set_active_pixels()). This may
+  /// choose state used by the next call to compute(), such as random patches,
+  /// so it should be called prior to compute().
+  /// The default implementation returns false.
+  virtual bool mov_img_pixels_used(PixelIndexList* pix_inds);
+
+  /// \brief Sets the fraction of pixels randomly sampled for each similarity
+  ///        computation.
+  ///
+  /// When less than one, each computation only evaluates the similarity over
+  /// a random subset of the (unmasked) pixels, which is redrawn for every
+  /// computation. This yields a noisy objective that is considerably cheaper
+  /// to compute, in particular when the subset is reported to the ray caster
+  /// through mov_img_pixels_used(), and is suitable for stochastic optimizers
+  /// such as CMA-ES or PSO. The subset is only honored by metrics that do not
+  /// require neighboring pixels, currently NCC, SSD and MI on the CPU.
+  /// Values greater than or equal to one (the default) use every pixel.
+  void set_pixel_subsample_frac(const double frac);
+
+  double pixel_subsample_frac() const;
+
+  /// \brief Seeds the random number generator used to draw pixel subsets.
+  ///
+  /// The sequence of subsets drawn is reproducible for a given seed.
+  void set_pixel_subsample_seed(const std::uint32_t seed);
+
+  /// \brief The seed most recently passed to set_pixel_subsample_seed(), or
+  ///        the default seed of the random number generator.
+  std::uint32_t pixel_subsample_seed() const;
+
   void set_save_aux_info(const bool save_aux);
 
   virtual std::shared_ptr<H5ReadWriteInterface> aux_info();
 
+  /// \brief Set the parallel execution context used by the CPU similarity computations.
+  ///
+  /// e.g. the maximum number of threads used by compute().
+  /// A null context (the default) uses the context current on the calling
+  /// thread, see ParallelExecContextScope.
+  void set_exec_context(std::shared_ptr<ParallelExecContext> ctx);
+
+  std::shared_ptr<ParallelExecContext> exec_context() const;
+
 protected:
   size_type num_pix_per_proj();
 
@@ -142,6 +203,44 @@ protected:
   
   virtual void process_mask();
 
+  /// \brief Retrieves the pixels that are not masked out, for use by
+  ///         mov_img_pixels_used() implementations.
+  ///
+  /// Returns false when no mask is set.
+  bool mask_pixels_used(PixelIndexList* pix_inds);
+
+  /// \brief The (ascending) offsets of the pixels that are not masked out.
+  ///
+  /// This compact list is rebuilt by process_mask() whenever the mask is
+  /// updated, so that masked computations may iterate over only the used
+  /// pixels instead of testing the mask at every pixel.
+  /// Empty when no mask is set.
+  const PixelIndexList& mask_pix_inds();
+
+  /// \brief Indicates that pixel subsets are drawn for each computation.
+  bool use_pixel_subsample() const;
+
+  /// \brief Draws the random pixel subset used by the next similarity
+  ///        computation and retrieves it, for use by mov_img_pixels_used()
+  ///        implementations.
+  ///
+  /// When subsampling is disabled, this is equivalent to mask_pixels_used().
+  bool subsample_pixels_used(PixelIndexList* pix_inds);
+
+  /// \brief The pixels used by the current similarity computation.
+  ///
+  /// This is the compact list of unmasked pixels, or a random subset of them
+  /// when pixel subsampling is enabled. A new subset is drawn, unless one was
+  /// chosen ahead of time by subsample_pixels_used(). Returns null when no mask
+  /// is set and subsampling is disabled, e.g. every pixel is used.
+  /// This should be called once per computation, prior to any multi-threaded
+  /// work.
+  const PixelIndexList* pix_inds_to_use();
+
+  /// \brief The number of pixels that a pixel subset is drawn from, e.g. the
+  ///        number of unmasked pixels.
+  size_type num_pix_available_for_subsample();
+
   ImagePtr fixed_img_;
 
   size_type num_mov_imgs_ = 0;
@@ -153,6 +252,29 @@ protected:
   bool mask_updated_ = true;
 
   bool save_aux_info_ = false;
+
+  std::shared_ptr<ParallelExecContext> exec_ctx_;
+
+private:
+  void update_mask_pix_inds();
+
+  void draw_pixel_subsample();
+
+  // cached pixels of the mask used to compute them
+  PixelIndexList mask_pix_inds_;
+  
+  const ImageMask* mask_for_pix_inds_ = nullptr;
+
+  double pixel_subsample_frac_ = 1;
+
+  std::mt19937 pixel_subsample_rng_;
+
+  std::uint32_t pixel_subsample_seed_ = std::mt19937::default_seed;
+
+  PixelIndexList subsample_pix_inds_;
+
+  // true when subsample_pix_inds_ has been drawn ahead of the next computation
+  bool subsample_pix_inds_pre_chosen_ = false;
 };
 
 }  // xreg
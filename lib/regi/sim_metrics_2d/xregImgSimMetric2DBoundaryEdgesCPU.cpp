@@ -28,6 +28,8 @@
 #include "xregITKOpenCVUtils.h"
 #include "xregTBBUtils.h"
 #include "xregRayCastInterface.h"
+#include "xregRayCastOccContourOCL.h"
+#include "xregAssert.h"
 
 void xreg::ImgSimMetric2DBoundaryEdgesCPU::allocate_resources()
 {
@@ -64,12 +66,60 @@ void xreg::ImgSimMetric2DBoundaryEdgesCPU::allocate_resources()
 #if CV_MAJOR_VERSION <= 3
   constexpr auto XREG_CV_DIST_L2 = CV_DIST_L2;
   constexpr auto XREG_CV_DIST_MASK_PRECISE = CV_DIST_MASK_PRECISE;
+  constexpr auto XREG_CV_DIST_MASK_5 = CV_DIST_MASK_5;
+  constexpr auto XREG_CV_DIST_LABEL_PIXEL = CV_DIST_LABEL_PIXEL;
 #else
   constexpr auto XREG_CV_DIST_L2 = cv::DIST_L2;
   constexpr auto XREG_CV_DIST_MASK_PRECISE = cv::DIST_MASK_PRECISE;
+  constexpr auto XREG_CV_DIST_MASK_5 = cv::DIST_MASK_5;
+  constexpr auto XREG_CV_DIST_LABEL_PIXEL = cv::DIST_LABEL_PIXEL;
 #endif
 
   cv::distanceTransform(fixed_edges, fixed_edge_dist_map_, XREG_CV_DIST_L2, XREG_CV_DIST_MASK_PRECISE);
+
+  fixed_nearest_edge_inds_ = cv::Mat(fixed_img.size(), CV_32S, cv::Scalar(-1));
+
+  if (num_fixed_edges_)
+  {
+    // The precise mask is not supported when computing labels, so the nearest
+    // edges come from a separate transform using the 5x5 mask. Each edge pixel
+    // is given a unique label, which is also assigned to the pixels closest to
+    // it.
+    cv::Mat approx_dists;
+    cv::Mat labels;
+
+    cv::distanceTransform(fixed_edges, approx_dists, labels, XREG_CV_DIST_L2,
+                          XREG_CV_DIST_MASK_5, XREG_CV_DIST_LABEL_PIXEL);
+
+    // map each label to the offset of its edge pixel
+    std::vector<int> label_to_edge_ind(num_fixed_edges_ + 1, -1);
+
+    for (size_type r = 0; r < img_num_rows_; ++r)
+    {
+      const auto* edge_row  = &fixed_edges.at<EdgePixelScalar>(r,0);
+      const auto* label_row = &labels.at<int>(r,0);
+
+      for (size_type c = 0; c < img_num_cols_; ++c)
+      {
+        if (!edge_row[c])
+        {
+          label_to_edge_ind[label_row[c]] = static_cast<int>((r * img_num_cols_) + c);
+        }
+      }
+    }
+
+    for (size_type r = 0; r < img_num_rows_; ++r)
+    {
+      const auto* label_row = &labels.at<int>(r,0);
+
+      auto* ind_row = &fixed_nearest_edge_inds_.at<int>(r,0);
+
+      for (size_type c = 0; c < img_num_cols_; ++c)
+      {
+        ind_row[c] = label_to_edge_ind[label_row[c]];
+      }
+    }
+  }
  
   // create storage for moving image edges 
   move_edge_imgs_ = AllocContiguousBufferForOpenCVImages<EdgePixelScalar>(img_num_rows_, img_num_cols_,
@@ -79,7 +129,25 @@ void xreg::ImgSimMetric2DBoundaryEdgesCPU::allocate_resources()
 
 void xreg::ImgSimMetric2DBoundaryEdgesCPU::compute()
 {
-  this->pre_compute();
+  ParallelExecContextScope exec_scope(this->exec_ctx_.get());
+
+  using EdgePixelListList = RayCasterOccludingContoursOCL::EdgePixelListList;
+
+  const EdgePixelListList* mov_edge_lists = nullptr;
+
+  if (contour_ray_caster_)
+  {
+    // the moving image buffer is not used, so it does not need to be synced
+    this->process_updated_mask();
+
+    // retrieve the lists prior to threading, since this transfers the edges
+    // from the device on the first call 
+    mov_edge_lists = &contour_ray_caster_->edge_pixel_lists();
+  }
+  else
+  {
+    this->pre_compute();
+  }
 
   auto compute_dists_fn = [&] (const RangeType& r)
   {
@@ -95,31 +163,43 @@ void xreg::ImgSimMetric2DBoundaryEdgesCPU::compute()
 
     for (size_type mov_idx = r.begin(); mov_idx < r.end(); ++mov_idx)
     {
-      // compute the moving image edges
-      cv::Mat& cur_mov_edges = this->move_edge_imgs_[mov_idx];
-      
-      cv::Mat cur_mov_depth(nr, nc, cv::DataType<Scalar>::type,
-                            this->mov_imgs_buf_ + (mov_idx * num_pix_per_proj)); 
-
-     
-      FindPixelsWithAdjacentIntensity(cur_mov_depth, &cur_mov_edges, kRAY_CAST_MAX_DEPTH, true);
-
-      // Now compute the mean distance
       Scalar d = 0;
       size_type num_pts = 0;
-     
-      for (size_type r = 0; r < nr; ++r)
+
+      if (mov_edge_lists)
       {
-        const auto* cur_edge_row = &cur_mov_edges.at<EdgePixelScalar>(r,0);
-        const auto* cur_dist_row = &fixed_dist_map.at<Scalar>(r,0);
+        // only visit the edges of the current projection
+        for (const auto& e : (*mov_edge_lists)[this->proj_off_ + mov_idx])
+        {
+          d += fixed_dist_map.at<Scalar>(e.row, e.col);
+        }
+
+        num_pts = (*mov_edge_lists)[this->proj_off_ + mov_idx].size();
+      }
+      else
+      {
+        // compute the moving image edges
+        cv::Mat& cur_mov_edges = this->move_edge_imgs_[mov_idx];
+
+        cv::Mat cur_mov_depth(nr, nc, cv::DataType<Scalar>::type,
+                              this->mov_imgs_buf_ + (mov_idx * num_pix_per_proj));
+
+        FindPixelsWithAdjacentIntensity(cur_mov_depth, &cur_mov_edges, kRAY_CAST_MAX_DEPTH, true);
 
-        for (size_type c = 0; c < nc; ++c)
+        // Now compute the mean distance
+        for (size_type r = 0; r < nr; ++r)
         {
-          if (cur_edge_row[c])
+          const auto* cur_edge_row = &cur_mov_edges.at<EdgePixelScalar>(r,0);
+          const auto* cur_dist_row = &fixed_dist_map.at<Scalar>(r,0);
+
+          for (size_type c = 0; c < nc; ++c)
           {
-            ++num_pts;
-            
-            d += cur_dist_row[c];
+            if (cur_edge_row[c])
+            {
+              ++num_pts;
+
+              d += cur_dist_row[c];
+            }
           }
         }
       }
@@ -151,3 +231,27 @@ void xreg::ImgSimMetric2DBoundaryEdgesCPU::set_regularize(const bool r)
 {
   regularize_ = r;
 }
+
+void xreg::ImgSimMetric2DBoundaryEdgesCPU::set_mov_edge_pixel_lists_from_ray_caster(
+                                        RayCasterOccludingContoursOCL* contour_ray_caster)
+{
+  xregASSERT(!contour_ray_caster || contour_ray_caster->compute_edge_pixel_lists());
+
+  contour_ray_caster_ = contour_ray_caster;
+}
+
+xreg::ImgSimMetric2DBoundaryEdgesCPU::Scalar
+xreg::ImgSimMetric2DBoundaryEdgesCPU::fixed_edge_dist(const size_type row, const size_type col) const
+{
+  return fixed_edge_dist_map_.at<Scalar>(row, col);
+}
+
+xreg::size_type
+xreg::ImgSimMetric2DBoundaryEdgesCPU::nearest_fixed_edge_pix_ind(const size_type row,
+                                                                 const size_type col) const
+{
+  const int ind = fixed_nearest_edge_inds_.at<int>(row, col);
+  xregASSERT(ind >= 0);
+
+  return static_cast<size_type>(ind);
+}
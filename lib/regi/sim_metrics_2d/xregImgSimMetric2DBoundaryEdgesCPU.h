@@ -32,10 +32,14 @@
 namespace xreg
 {
 
+// Forward Declarations
+class RayCasterOccludingContoursOCL;
+
 /// \brief Edge based similarity metric on 2D images with hand-drawn boundary edges on the fixed images.
 ///
 /// The moving image inputs should actually be depth images, from which this similarity metric will compute
-/// the boundary edges.
+/// the boundary edges. Alternatively, the edges may be obtained directly from the compacted edge lists of
+/// an occluding contour ray caster, see set_mov_edge_pixel_lists_from_ray_caster().
 class ImgSimMetric2DBoundaryEdgesCPU : public ImgSimMetric2DCPU
 {
 public:
@@ -51,7 +55,9 @@ public:
   /// This allocates,
   /// the fixed image edge distance map, a buffer for storing every moving image's
   /// edge image.
-  /// This computes the fixed image distance map.
+  /// This computes the fixed image distance map and the map of nearest fixed
+  /// edges, so that the distance to, and location of, the closest edge are
+  /// O(1) lookups for any pixel.
   void allocate_resources();
 
   /// \brief Computes the edge distance similarity values.
@@ -67,6 +73,28 @@ public:
 
   void set_regularize(const bool r);
 
+  /// \brief Use the edge pixel lists of an occluding contour ray caster as
+  ///        the moving image edges.
+  ///
+  /// The ray caster must have been configured to compute edge pixel lists.
+  /// When set, only the edge pixels are transferred from the device and the
+  /// moving image buffer is not read, e.g. depth images do not need to be
+  /// computed. The moving images correspond to the ray caster projections
+  /// starting at the projection offset of this metric.
+  /// Passing null reverts to computing edges from moving depth images.
+  void set_mov_edge_pixel_lists_from_ray_caster(RayCasterOccludingContoursOCL* contour_ray_caster);
+
+  /// \brief Distance from a pixel to the closest fixed image edge.
+  ///
+  /// Only valid after calling allocate_resources().
+  Scalar fixed_edge_dist(const size_type row, const size_type col) const;
+
+  /// \brief The (row-major) offset of the closest fixed image edge pixel.
+  ///
+  /// Only valid after calling allocate_resources() and when the fixed image
+  /// has at least one edge.
+  size_type nearest_fixed_edge_pix_ind(const size_type row, const size_type col) const;
+
 private:
   using EdgeBuffer = std::vector<EdgePixelScalar>;
   using MatList    = std::vector<cv::Mat>;
@@ -78,6 +106,11 @@ private:
 
   cv::Mat fixed_edge_dist_map_;
 
+  // offset of the closest fixed edge pixel, stored as CV_32S
+  cv::Mat fixed_nearest_edge_inds_;
+
+  RayCasterOccludingContoursOCL* contour_ray_caster_ = nullptr;
+
   EdgeBuffer move_edges_buf_;
 
   MatList move_edge_imgs_;
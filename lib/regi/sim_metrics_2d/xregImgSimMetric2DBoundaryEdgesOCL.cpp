@@ -0,0 +1,248 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregImgSimMetric2DBoundaryEdgesOCL.h"
+
+#include <boost/compute/memory/local_buffer.hpp>
+#include <boost/compute/utility/source.hpp>
+
+#include "xregOpenCLProgCache.h"
+#include "xregOpenCVUtils.h"
+#include "xregITKOpenCVUtils.h"
+#include "xregRayCastInterface.h"
+
+namespace
+{
+
+const char* kBOUNDARY_EDGES_OPENCL_SRC = BOOST_COMPUTE_STRINGIZE_SOURCE(
+
+bool IsBackgroundDepth(const float x, const float bg_depth)
+{
+  return fabs(x - bg_depth) < 1.0e-8f;
+}
+
+// One work-group per moving depth image. A pixel is an edge when it is not
+// background and at least one of its 8 neighbors is background. The
+// work-group size must be a power of two.
+__kernel void BoundaryEdgeDistKernel(__global const float* mov_depth_imgs,
+                                     __global const float* fixed_edge_dist_map,
+                                     const uint num_rows,
+                                     const uint num_cols,
+                                     const uint proj_off,
+                                     const float bg_depth,
+                                     const uint regularize,
+                                     const float num_edge_pts_low,
+                                     __global float* sim_vals,
+                                     __local float* dist_scratch,
+                                     __local uint* count_scratch)
+{
+  const uint img_idx = get_group_id(1);
+  const uint lid     = get_local_id(0);
+  const uint lsize   = get_local_size(0);
+
+  const uint img_len = num_rows * num_cols;
+
+  __global const float* cur_depth = mov_depth_imgs + ((proj_off + img_idx) * img_len);
+
+  float d = 0;
+  uint num_pts = 0;
+
+  for (uint pix_idx = lid; pix_idx < img_len; pix_idx += lsize)
+  {
+    if (!IsBackgroundDepth(cur_depth[pix_idx], bg_depth))
+    {
+      const int r = pix_idx / num_cols;
+      const int c = pix_idx - (r * num_cols);
+
+      bool is_edge = false;
+
+      for (int dr = -1; !is_edge && (dr <= 1); ++dr)
+      {
+        const int nr = r + dr;
+
+        if ((nr >= 0) && (nr < (int) num_rows))
+        {
+          for (int dc = -1; !is_edge && (dc <= 1); ++dc)
+          {
+            const int nc = c + dc;
+
+            if ((dr || dc) && (nc >= 0) && (nc < (int) num_cols))
+            {
+              is_edge = IsBackgroundDepth(cur_depth[(nr * num_cols) + nc], bg_depth);
+            }
+          }
+        }
+      }
+
+      if (is_edge)
+      {
+        d += fixed_edge_dist_map[pix_idx];
+        ++num_pts;
+      }
+    }
+  }
+
+  dist_scratch[lid]  = d;
+  count_scratch[lid] = num_pts;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for (uint s = lsize / 2; s > 0; s >>= 1)
+  {
+    if (lid < s)
+    {
+      dist_scratch[lid]  += dist_scratch[lid + s];
+      count_scratch[lid] += count_scratch[lid + s];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  if (lid == 0)
+  {
+    float sim_val = dist_scratch[0] / count_scratch[0];
+
+    if (regularize && (count_scratch[0] < num_edge_pts_low))
+    {
+      sim_val += 1000;
+    }
+
+    sim_vals[img_idx] = sim_val;
+  }
+}
+
+);
+
+/// \brief Preferred work-group size; reductions require a power of two
+constexpr std::size_t kBOUNDARY_EDGES_WORK_GROUP_SIZE = 256;
+
+}  // un-named
+
+xreg::ImgSimMetric2DBoundaryEdgesOCL::ImgSimMetric2DBoundaryEdgesOCL(const boost::compute::device& dev)
+  : ImgSimMetric2DOCL(dev)
+{ }
+
+xreg::ImgSimMetric2DBoundaryEdgesOCL::ImgSimMetric2DBoundaryEdgesOCL(const boost::compute::context& ctx,
+                                                                     const boost::compute::command_queue& queue)
+  : ImgSimMetric2DOCL(ctx, queue)
+{ }
+
+void xreg::ImgSimMetric2DBoundaryEdgesOCL::allocate_resources()
+{
+  namespace bc = boost::compute;
+
+  ImgSimMetric2DOCL::allocate_resources();
+
+  cv::Mat fixed_img = ShallowCopyItkToOpenCV(this->fixed_img_.GetPointer());
+
+  const size_type num_rows = fixed_img.rows;
+  const size_type num_cols = fixed_img.cols;
+
+  num_fixed_edges_ = 0;
+
+  cv::Mat fixed_edges = ShallowCopyItkToOpenCV(fixed_img_edges_.GetPointer()).clone();
+
+  // Invert, 0 -> edge, 1 -> no edge
+  for (size_type r = 0; r < num_rows; ++r)
+  {
+    auto* edge_row = &fixed_edges.at<EdgePixelScalar>(r,0);
+
+    for (size_type c = 0; c < num_cols; ++c)
+    {
+      if (edge_row[c])
+      {
+        ++num_fixed_edges_;
+      }
+
+      edge_row[c] = !edge_row[c];
+    }
+  }
+
+  cv::Mat fixed_edge_dist_map = cv::Mat::zeros(fixed_img.size(), cv::DataType<Scalar>::type);
+
+#if CV_MAJOR_VERSION <= 3
+  constexpr auto XREG_CV_DIST_L2 = CV_DIST_L2;
+  constexpr auto XREG_CV_DIST_MASK_PRECISE = CV_DIST_MASK_PRECISE;
+#else
+  constexpr auto XREG_CV_DIST_L2 = cv::DIST_L2;
+  constexpr auto XREG_CV_DIST_MASK_PRECISE = cv::DIST_MASK_PRECISE;
+#endif
+
+  cv::distanceTransform(fixed_edges, fixed_edge_dist_map, XREG_CV_DIST_L2, XREG_CV_DIST_MASK_PRECISE);
+
+  const Scalar* dist_map_buf = &fixed_edge_dist_map.at<Scalar>(0,0);
+
+  fixed_edge_dist_map_dev_.reset(new DevBuf(this->ctx_));
+  fixed_edge_dist_map_dev_->assign(dist_map_buf, dist_map_buf + (num_rows * num_cols), this->queue_);
+
+  sim_vals_dev_.reset(new DevBuf(this->num_mov_imgs_, this->ctx_));
+
+  bc::program prog = BuildOpenCLProg(kBOUNDARY_EDGES_OPENCL_SRC, this->ctx_);
+
+  edge_dist_krnl_ = prog.create_kernel("BoundaryEdgeDistKernel");
+
+  edge_dist_wg_size_ = this->pow2_work_group_size(edge_dist_krnl_, kBOUNDARY_EDGES_WORK_GROUP_SIZE);
+
+  edge_dist_krnl_.set_arg(1, *fixed_edge_dist_map_dev_);
+  edge_dist_krnl_.set_arg(2, bc::uint_(num_rows));
+  edge_dist_krnl_.set_arg(3, bc::uint_(num_cols));
+  edge_dist_krnl_.set_arg(5, static_cast<float>(kRAY_CAST_MAX_DEPTH));
+  edge_dist_krnl_.set_arg(7, static_cast<float>(0.5 * num_fixed_edges_));
+  edge_dist_krnl_.set_arg(8, *sim_vals_dev_);
+  edge_dist_krnl_.set_arg(9, bc::local_buffer<float>(edge_dist_wg_size_));
+  edge_dist_krnl_.set_arg(10, bc::local_buffer<bc::uint_>(edge_dist_wg_size_));
+
+  this->sim_vals_.assign(this->num_mov_imgs_, 0);
+}
+
+void xreg::ImgSimMetric2DBoundaryEdgesOCL::compute()
+{
+  namespace bc = boost::compute;
+
+  this->pre_compute();
+
+  edge_dist_krnl_.set_arg(0, *this->mov_imgs_buf_);
+  edge_dist_krnl_.set_arg(4, bc::uint_(this->proj_off_));
+  edge_dist_krnl_.set_arg(6, bc::uint_(regularize_ ? 1 : 0));
+
+  const std::size_t global_size[2] = { edge_dist_wg_size_, this->num_mov_imgs_ };
+  const std::size_t local_size[2]  = { edge_dist_wg_size_, 1 };
+
+  this->enqueue_kernel(edge_dist_krnl_, 2, global_size, local_size);
+
+  this->read_sim_vals_from_dev(*sim_vals_dev_);
+}
+
+xreg::ImgSimMetric2DBoundaryEdgesOCL::DevBuf* xreg::ImgSimMetric2DBoundaryEdgesOCL::sim_vals_dev_buf()
+{
+  return sim_vals_dev_.get();
+}
+
+void xreg::ImgSimMetric2DBoundaryEdgesOCL::set_fixed_image_edges(FixedEdgeImagePtr fixed_edges)
+{
+  fixed_img_edges_ = fixed_edges;
+}
+
+void xreg::ImgSimMetric2DBoundaryEdgesOCL::set_regularize(const bool r)
+{
+  regularize_ = r;
+}
@@ -0,0 +1,89 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGIMGSIMMETRIC2DBOUNDARYEDGESOCL_H_
+#define XREGIMGSIMMETRIC2DBOUNDARYEDGESOCL_H_
+
+#include "xregImgSimMetric2DOCL.h"
+
+namespace xreg
+{
+
+/// \brief OpenCL implementation of the boundary edge similarity metric.
+///
+/// \see ImgSimMetric2DBoundaryEdgesCPU for a description of the metric.
+/// The moving inputs are depth images, which are expected to already reside
+/// on the device, e.g. from a depth ray caster. The moving edges and the mean
+/// distances to the fixed edges are computed on the device, with a
+/// work-group computing each moving image, so only the similarity values are
+/// read back. The fixed image distance map is computed on the host once.
+class ImgSimMetric2DBoundaryEdgesOCL : public ImgSimMetric2DOCL
+{
+public:
+  using EdgePixelScalar   = unsigned char;
+  using FixedEdgeImage    = itk::Image<EdgePixelScalar,2>;
+  using FixedEdgeImagePtr = FixedEdgeImage::Pointer;
+
+  ImgSimMetric2DBoundaryEdgesOCL() = default;
+
+  explicit ImgSimMetric2DBoundaryEdgesOCL(const boost::compute::device& dev);
+
+  ImgSimMetric2DBoundaryEdgesOCL(const boost::compute::context& ctx,
+                                 const boost::compute::command_queue& queue);
+
+  /// \brief Allocates resources and computes the fixed image edge
+  ///        distance map.
+  void allocate_resources() override;
+
+  /// \brief Computes the edge distance similarity values.
+  void compute() override;
+
+  DevBuf* sim_vals_dev_buf() override;
+
+  /// \brief Sets the fixed image edge map.
+  ///
+  /// Sets the fixed image edges used to compute the distance map.
+  void set_fixed_image_edges(FixedEdgeImagePtr fixed_edges);
+
+  void set_regularize(const bool r);
+
+private:
+  FixedEdgeImagePtr fixed_img_edges_;
+
+  std::unique_ptr<DevBuf> fixed_edge_dist_map_dev_;
+
+  std::unique_ptr<DevBuf> sim_vals_dev_;
+
+  size_type num_fixed_edges_ = 0;
+
+  bool regularize_ = true;
+
+  boost::compute::kernel edge_dist_krnl_;
+
+  std::size_t edge_dist_wg_size_ = 0;
+};
+
+}  // xreg
+
+#endif
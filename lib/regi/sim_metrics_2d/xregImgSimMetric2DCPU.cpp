@@ -91,7 +91,11 @@ void xreg::ImgSimMetric2DCPU::pre_compute()
 {
   if (sync_host_buf_)
   {
-    sync_host_buf_->sync();
+    // only the moving images used by this metric are needed
+    const size_type num_pix_per_proj = this->num_pix_per_proj();
+
+    sync_host_buf_->sync_range(proj_off_ * num_pix_per_proj,
+                               (proj_off_ + this->num_mov_imgs_) * num_pix_per_proj);
   }
   
   this->process_updated_mask();
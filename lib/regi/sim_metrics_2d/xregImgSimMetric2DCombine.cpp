@@ -25,6 +25,8 @@
 #include "xregImgSimMetric2DCombine.h"
 
 #include "xregAssert.h"
+#include "xregTBBUtils.h"
+#include "xregImgSimMetric2DCPU.h"
 
 void xreg::ImgSimMetric2DCombine::allocate_resources()
 {
@@ -61,6 +63,73 @@ xreg::ImgSimMetric2DCombine::sim_val(const size_type proj_idx) const
   return sim_vals_[proj_idx];
 }
   
+void xreg::ImgSimMetric2DCombine::compute_sim_metrics()
+{
+  if (!compute_sim_metrics_concurrently_ || (num_sim_metrics_ < 2))
+  {
+    for (auto* sim : sim_objs_)
+    {
+      sim->compute();
+    }
+  }
+  else
+  {
+    // each task is a list of metrics computed one after another; the first
+    // task holds every metric that is not safe to compute concurrently
+    auto& tasks = sim_tasks_;
+
+    if (tasks.empty())
+    {
+      tasks.resize(1);
+    }
+
+    tasks[0].clear();
+
+    size_type num_tasks = 1;
+    
+    for (auto* sim : sim_objs_)
+    {
+      if (dynamic_cast<ImgSimMetric2DCPU*>(sim))
+      {
+        if (tasks.size() == num_tasks)
+        {
+          tasks.emplace_back();
+        }
+
+        tasks[num_tasks].assign(1, sim);
+        ++num_tasks;
+      }
+      else
+      {
+        tasks[0].push_back(sim);
+      }
+    }
+
+    auto sim_task_fn = [&tasks] (const RangeType& r)
+    {
+      for (size_type task_idx = r.begin(); task_idx < r.end(); ++task_idx)
+      {
+        for (auto* sim : tasks[task_idx])
+        {
+          sim->compute();
+        }
+      }
+    };
+
+    ParallelFor(sim_task_fn, RangeType(0, num_tasks));
+  }
+}
+
+void xreg::ImgSimMetric2DCombine::set_compute_sim_metrics_concurrently(const bool concurrent)
+{
+  compute_sim_metrics_concurrently_ = concurrent;
+}
+
+bool xreg::ImgSimMetric2DCombine::compute_sim_metrics_concurrently() const
+{
+  return compute_sim_metrics_concurrently_;
+}
+
 void xreg::ImgSimMetric2DCombineAddition::compute()
 {
   this->sim_vals_.assign(this->num_projs_per_sim_metric_, 0);
@@ -79,6 +79,26 @@ public:
   /// \brief Retrieve the combine similarity score for a specific projection index.
   const Scalar sim_val(const size_type proj_idx) const;
 
+  /// \brief Computes the similarity scores of each component metric, e.g.
+  ///        each view.
+  ///
+  /// This should be called prior to compute() when the component metrics
+  /// have not been computed by other means.
+  virtual void compute_sim_metrics();
+
+  /// \brief Sets whether compute_sim_metrics() evaluates the component metrics
+  ///        concurrently.
+  ///
+  /// When true, each CPU metric is computed as a separate task and all other
+  /// (e.g. OpenCL) metrics are computed, one after another, in a single task
+  /// that runs alongside the CPU tasks. The OpenCL metrics are not run
+  /// concurrently with each other, since they share the ray caster's command
+  /// queue and ViennaCL maintains process-wide context state.
+  /// The default is true.
+  void set_compute_sim_metrics_concurrently(const bool concurrent);
+
+  bool compute_sim_metrics_concurrently() const;
+
   /// \brief Perform the similarity combination computation - must be implemented
   ///        by a child class.
   virtual void compute() = 0;
@@ -91,6 +111,12 @@ protected:
   ScalarList sim_vals_;
 
   std::vector<ImgSimMetric2D*> sim_objs_;
+
+  bool compute_sim_metrics_concurrently_ = true;
+
+private:
+  // tasks used by compute_sim_metrics(), re-used across calls
+  std::vector<std::vector<ImgSimMetric2D*>> sim_tasks_;
 };
 
 /// \brief Combine similarity metrics with addition.
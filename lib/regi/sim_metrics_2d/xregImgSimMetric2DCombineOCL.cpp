@@ -0,0 +1,258 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "xregImgSimMetric2DCombineOCL.h"
+
+#include <algorithm>
+
+#include <boost/compute/utility/source.hpp>
+
+#include "xregAssert.h"
+#include "xregOpenCLProfiling.h"
+#include "xregOpenCLProgCache.h"
+#include "xregTrace.h"
+
+namespace
+{
+
+const char* kCOMBINE_OPENCL_SRC = BOOST_COMPUTE_STRINGIZE_SOURCE(
+
+// One work item per candidate. The scores of view v are stored at
+// view_sim_vals + (v * num_cands). The penalty terms are stored as the image
+// similarity coefficients, followed by the penalty coefficients, followed by
+// the penalty values.
+__kernel void CombineViewsMeanKernel(__global const float* view_sim_vals,
+                                     const uint num_views,
+                                     const uint num_cands,
+                                     __global const float* penalty_terms,
+                                     const uint apply_penalty,
+                                     __global float* sim_vals)
+{
+  const uint cand_idx = get_global_id(0);
+
+  if (cand_idx < num_cands)
+  {
+    float s = 0;
+
+    for (uint view_idx = 0; view_idx < num_views; ++view_idx)
+    {
+      s += view_sim_vals[(view_idx * num_cands) + cand_idx];
+    }
+
+    s /= num_views;
+
+    if (apply_penalty)
+    {
+      s = (penalty_terms[cand_idx] * s) +
+          (penalty_terms[num_cands + cand_idx] * penalty_terms[(2 * num_cands) + cand_idx]);
+    }
+
+    sim_vals[cand_idx] = s;
+  }
+}
+
+);
+
+}  // un-named
+
+void xreg::ImgSimMetric2DCombineMeanOCL::compute_sim_metrics()
+{
+  use_dev_ = can_combine_on_dev();
+
+  for (auto* sim : this->sim_objs_)
+  {
+    ImgSimMetric2DOCL* sim_ocl = dynamic_cast<ImgSimMetric2DOCL*>(sim);
+
+    if (sim_ocl)
+    {
+      sim_ocl->set_read_sim_vals_to_host(!use_dev_);
+    }
+  }
+
+  ImgSimMetric2DCombine::compute_sim_metrics();
+}
+
+void xreg::ImgSimMetric2DCombineMeanOCL::compute()
+{
+  if (use_dev_)
+  {
+    compute_on_dev();
+  }
+  else
+  {
+    ImgSimMetric2DCombineMean::compute();
+
+    if (apply_penalty_)
+    {
+      const size_type n = this->num_projs_per_sim_metric_;
+
+      for (size_type proj_idx = 0; proj_idx < n; ++proj_idx)
+      {
+        this->sim_vals_[proj_idx] = (penalty_terms_host_[proj_idx] * this->sim_vals_[proj_idx]) +
+                                    (penalty_terms_host_[n + proj_idx] *
+                                     penalty_terms_host_[(2 * n) + proj_idx]);
+      }
+    }
+  }
+
+  apply_penalty_ = false;
+}
+
+void xreg::ImgSimMetric2DCombineMeanOCL::set_penalty(const CoordScalarList& penalty_vals,
+                                                    const CoordScalarList& img_sim_coeffs,
+                                                    const CoordScalarList& penalty_coeffs)
+{
+  const size_type n = this->num_projs_per_sim_metric_;
+
+  xregASSERT(penalty_vals.size() == n);
+  xregASSERT(img_sim_coeffs.empty() || (img_sim_coeffs.size() == n));
+  xregASSERT(penalty_coeffs.empty() || (penalty_coeffs.size() == n));
+
+  penalty_terms_host_.assign(3 * n, Scalar(1));
+
+  if (!img_sim_coeffs.empty())
+  {
+    std::copy(img_sim_coeffs.begin(), img_sim_coeffs.end(), penalty_terms_host_.begin());
+  }
+
+  if (!penalty_coeffs.empty())
+  {
+    std::copy(penalty_coeffs.begin(), penalty_coeffs.end(), penalty_terms_host_.begin() + n);
+  }
+
+  std::copy(penalty_vals.begin(), penalty_vals.end(), penalty_terms_host_.begin() + (2 * n));
+
+  apply_penalty_ = true;
+}
+
+bool xreg::ImgSimMetric2DCombineMeanOCL::combined_on_dev() const
+{
+  return use_dev_;
+}
+
+bool xreg::ImgSimMetric2DCombineMeanOCL::can_combine_on_dev() const
+{
+  if (this->sim_objs_.empty())
+  {
+    return false;
+  }
+
+  const ImgSimMetric2DOCL* first_sim = dynamic_cast<const ImgSimMetric2DOCL*>(this->sim_objs_[0]);
+
+  if (!first_sim)
+  {
+    return false;
+  }
+
+  for (auto* sim : this->sim_objs_)
+  {
+    ImgSimMetric2DOCL* sim_ocl = dynamic_cast<ImgSimMetric2DOCL*>(sim);
+
+    // the metrics must share a queue, so that the combination kernel is
+    // ordered after every metric's kernels
+    if (!sim_ocl || !sim_ocl->sim_vals_dev_buf() ||
+        (sim_ocl->queue().get() != first_sim->queue().get()))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void xreg::ImgSimMetric2DCombineMeanOCL::compute_on_dev()
+{
+  namespace bc = boost::compute;
+
+  const size_type num_views = this->num_sim_metrics_;
+  const size_type num_cands = this->num_projs_per_sim_metric_;
+
+  const bc::command_queue& sim_queue =
+                      dynamic_cast<ImgSimMetric2DOCL*>(this->sim_objs_[0])->queue();
+
+  if (!view_sim_vals_dev_ || (queue_.get() != sim_queue.get()))
+  {
+    queue_ = sim_queue;
+
+    const bc::context ctx = queue_.get_context();
+
+    combine_krnl_ = BuildOpenCLProg(kCOMBINE_OPENCL_SRC, ctx).create_kernel("CombineViewsMeanKernel");
+
+    view_sim_vals_dev_.reset(new DevBuf(ctx));
+    penalty_terms_dev_.reset(new DevBuf(ctx));
+    sim_vals_dev_.reset(new DevBuf(ctx));
+  }
+
+  // the number of candidates may change between calls
+  if (sim_vals_dev_->size() < num_cands)
+  {
+    view_sim_vals_dev_->resize(num_views * num_cands, queue_);
+    penalty_terms_dev_->resize(3 * num_cands, queue_);
+    sim_vals_dev_->resize(num_cands, queue_);
+  }
+
+  const std::size_t num_bytes_per_view = num_cands * sizeof(float);
+
+  // gather the scores of each view into a single buffer, without leaving the device
+  for (size_type view_idx = 0; view_idx < num_views; ++view_idx)
+  {
+    const DevBuf* view_sim_vals =
+                    dynamic_cast<ImgSimMetric2DOCL*>(this->sim_objs_[view_idx])->sim_vals_dev_buf();
+
+    queue_.enqueue_copy_buffer(view_sim_vals->get_buffer(), view_sim_vals_dev_->get_buffer(),
+                               0, view_idx * num_bytes_per_view, num_bytes_per_view);
+  }
+
+  if (apply_penalty_)
+  {
+    // the host buffer is not modified until this call has read back the scores,
+    // which completes the write
+    queue_.enqueue_write_buffer_async(penalty_terms_dev_->get_buffer(), 0,
+                                      3 * num_bytes_per_view, penalty_terms_host_.data());
+  }
+
+  combine_krnl_.set_arg(0, *view_sim_vals_dev_);
+  combine_krnl_.set_arg(1, bc::uint_(num_views));
+  combine_krnl_.set_arg(2, bc::uint_(num_cands));
+  combine_krnl_.set_arg(3, *penalty_terms_dev_);
+  combine_krnl_.set_arg(4, bc::uint_(apply_penalty_ ? 1 : 0));
+  combine_krnl_.set_arg(5, *sim_vals_dev_);
+
+  const std::size_t global_size = num_cands;
+
+  const bc::event e = queue_.enqueue_nd_range_kernel(combine_krnl_, 1, nullptr,
+                                                     &global_size, nullptr);
+
+  if (OpenCLProfilingEnabled() || TracingEnabled())
+  {
+    RecordOpenCLKernelEvent("CombineViewsMeanKernel", e);
+  }
+
+  // the only synchronization with the host for this set of candidates
+  this->sim_vals_.resize(num_cands);
+
+  bc::copy(sim_vals_dev_->begin(), sim_vals_dev_->begin() + num_cands,
+           this->sim_vals_.begin(), queue_);
+}
@@ -0,0 +1,95 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef XREGIMGSIMMETRIC2DCOMBINEOCL_H_
+#define XREGIMGSIMMETRIC2DCOMBINEOCL_H_
+
+#include "xregImgSimMetric2DCombine.h"
+#include "xregImgSimMetric2DOCL.h"
+
+namespace xreg
+{
+
+/// \brief Combines similarity metrics as the mean of the values, computed on
+///        the device when possible.
+///
+/// When every similarity metric is an OpenCL metric which keeps its scores in
+/// a device buffer (see ImgSimMetric2DOCL::sim_vals_dev_buf()), and all of
+/// the metrics share a command queue, the metrics do not read their scores
+/// back to the host. A single kernel computes the mean over the views, along
+/// with the optional per-candidate penalty terms, and the combined scores are
+/// read back with one transfer, instead of one transfer per view. Otherwise,
+/// the scores are combined on the host, as in ImgSimMetric2DCombineMean.
+class ImgSimMetric2DCombineMeanOCL : public ImgSimMetric2DCombineMean
+{
+public:
+  ImgSimMetric2DCombineMeanOCL() = default;
+
+  void compute_sim_metrics() override;
+
+  void compute() override;
+
+  /// \brief Sets the penalty terms applied to the combined scores by the next
+  ///        call to compute().
+  ///
+  /// The combined score of candidate i becomes:
+  ///   img_sim_coeffs[i] * mean_sim_val[i] + penalty_coeffs[i] * penalty_vals[i].
+  /// Empty coefficient lists are treated as lists of ones. The penalty terms
+  /// are cleared by compute().
+  void set_penalty(const CoordScalarList& penalty_vals,
+                   const CoordScalarList& img_sim_coeffs,
+                   const CoordScalarList& penalty_coeffs);
+
+  /// \brief Indicates that the most recent scores were combined on the device.
+  bool combined_on_dev() const;
+
+private:
+  using DevBuf = ImgSimMetric2DOCL::DevBuf;
+
+  bool can_combine_on_dev() const;
+
+  void compute_on_dev();
+
+  bool use_dev_ = false;
+
+  bool apply_penalty_ = false;
+
+  // penalty terms packed as: image similarity coefficients, penalty
+  // coefficients, penalty values
+  ScalarList penalty_terms_host_;
+
+  boost::compute::command_queue queue_;
+
+  boost::compute::kernel combine_krnl_;
+
+  std::unique_ptr<DevBuf> view_sim_vals_dev_;
+  std::unique_ptr<DevBuf> penalty_terms_dev_;
+  std::unique_ptr<DevBuf> sim_vals_dev_;
+};
+
+}  // xreg
+
+#endif
+
@@ -61,13 +61,31 @@ void xreg::ImgSimMetric2DGradDiffCPU::allocate_resources()
 
 void xreg::ImgSimMetric2DGradDiffCPU::compute()
 {
+  ParallelExecContextScope exec_scope(this->exec_ctx_.get());
+
   this->pre_compute();
   
-  this->compute_sobel_grads();
+  this->compute_sobel_grads(this->use_edge_band_ ? this->edge_band_rows_.data() : nullptr);
+
+  if (used_pix_inds_)
+  {
+    mov_grad_masked_vecs_.resize(this->num_mov_imgs_);
+  }
+
+  const size_type* masked_pix_inds = used_pix_inds_ ? used_pix_inds_->data() : nullptr;
 
   auto grad_diff_fn = [&] (const RangeType& r)
   {
-    const bool apply_mask = this->mask_;
+    const bool apply_mask = masked_pix_inds;
+
+    const size_type* pix_inds = masked_pix_inds;
+    
+    const size_type num_used_pix = this->fixed_grad_img_x_vec_.size();
+
+    // Each masked out pixel has zero gradient in the fixed and moving images,
+    // and therefore adds a constant of -1 to the objective, which is not explicitly
+    // computed when only iterating over the used pixels.
+    const Scalar masked_obj_off = -static_cast<Scalar>(this->num_pix_ - num_used_pix);
 
     const ImageArray* fixed_grads[2] = { &this->fixed_grad_img_x_vec_,
                                          &this->fixed_grad_img_y_vec_ };
@@ -85,13 +103,24 @@ void xreg::ImgSimMetric2DGradDiffCPU::compute()
       {
         cv::Mat& mov_grad_ocv_img = mov_grad_imgs[grad_dir_idx]->at(mov_idx);
 
+        Scalar* mov_grad_buf = &mov_grad_ocv_img.at<Scalar>(0,0);
+
         if (apply_mask)
         {
-          ApplyMaskToSelf(&mov_grad_ocv_img, this->mask_ocv_);
+          // gather the used gradients, so the sub-problem is only evaluated
+          // over the pixels in the mask
+          ImageArray& mov_grad_masked = this->mov_grad_masked_vecs_[mov_idx];
+          mov_grad_masked.resize(num_used_pix);
+
+          for (size_type i = 0; i < num_used_pix; ++i)
+          {
+            mov_grad_masked(i) = mov_grad_buf[pix_inds[i]];
+          }
+
+          mov_grad_buf = mov_grad_masked.data();
         }
 
-        const ImageArrayMap mov_grad_vec(&mov_grad_ocv_img.at<Scalar>(0,0),
-                                         this->num_pix_);
+        const ImageArrayMap mov_grad_vec(mov_grad_buf, num_used_pix);
 
         using OptScalar  = LineSearchOptimization::Scalar;
         using OptParamPt = LineSearchOptimization::Pt;
@@ -126,6 +155,11 @@ void xreg::ImgSimMetric2DGradDiffCPU::compute()
 
             F = -1 * (fixed_grad_minus_s_times_mov_grad_sq_plus_var.inverse() * fixed_grad_var).sum();
 
+            if (apply_mask)
+            {
+              F += masked_obj_off;
+            }
+
             Scalar two_times_fixed_grad_var = 0;
 
             if (compute_grad || compute_hessian)
@@ -262,21 +296,46 @@ void xreg::ImgSimMetric2DGradDiffCPU::set_track_sub_prob_inits(const bool track_
   track_sub_prob_inits_ = track_inits;
 }
 
+bool xreg::ImgSimMetric2DGradDiffCPU::mov_img_pixels_used(PixelIndexList* pix_inds)
+{
+  if (this->use_edge_band_)
+  {
+    *pix_inds = this->edge_band_mov_pix_inds_;
+    return true;
+  }
+
+  return false;
+}
+
 void xreg::ImgSimMetric2DGradDiffCPU::process_mask()
 {
   ImgSimMetric2DGradImgCPU::process_mask();
 
-  if (this->mask_)
+  // the edge band is applied as a mask, and already excludes masked out pixels
+  ImageMask* mask_to_use = this->mask_.GetPointer();
+
+  used_pix_inds_ = this->mask_ ? &this->mask_pix_inds() : nullptr;
+
+  if (this->use_edge_band_)
+  {
+    this->compute_edge_band(this->fixed_grad_img_x_, this->fixed_grad_img_y_,
+                            this->mask_.GetPointer(), this->sobel_grads_support_radius());
+
+    mask_to_use    = this->edge_band_mask_.GetPointer();
+    used_pix_inds_ = &this->edge_band_pix_inds_;
+  }
+
+  if (mask_to_use)
   {
-    mask_ocv_ = ShallowCopyItkToOpenCV(this->mask_.GetPointer());
+    mask_ocv_ = ShallowCopyItkToOpenCV(mask_to_use);
    
     // deep copy the fixed image gradients, since we'll modify the buffers
     // with the mask 
     fixed_grad_img_x_to_use_ = this->fixed_grad_img_x_.clone();
     fixed_grad_img_y_to_use_ = this->fixed_grad_img_y_.clone();
 
-    // By setting gradient values to zero at masked out locations in the
-    // fixed AND moving images, we can still use optimized array computations
+    // The variances are computed with gradient values of zero at masked out
+    // locations
     ApplyMaskToSelf(&this->fixed_grad_img_x_to_use_, mask_ocv_);
     ApplyMaskToSelf(&this->fixed_grad_img_y_to_use_, mask_ocv_);
   }
@@ -301,4 +360,21 @@ void xreg::ImgSimMetric2DGradDiffCPU::process_mask()
 
   const auto y_std_dev = SampleStdDev(fixed_grad_img_y_vec_);
   fixed_grad_y_var_ = y_std_dev * y_std_dev;
+
+  if (used_pix_inds_)
+  {
+    // keep only the used gradients in a compact array
+    const PixelIndexList& pix_inds = *used_pix_inds_;
+
+    const size_type num_used_pix = pix_inds.size();
+
+    for (size_type i = 0; i < num_used_pix; ++i)
+    {
+      fixed_grad_img_x_vec_(i) = fixed_grad_img_x_vec_(pix_inds[i]);
+      fixed_grad_img_y_vec_(i) = fixed_grad_img_y_vec_(pix_inds[i]);
+    }
+
+    fixed_grad_img_x_vec_.conservativeResize(num_used_pix);
+    fixed_grad_img_y_vec_.conservativeResize(num_used_pix);
+  }
 }
@@ -27,6 +27,7 @@
 
 #include <array>
 
+#include "xregImgSimMetric2DGradEdgeBand.h"
 #include "xregImgSimMetric2DGradImgCPU.h"
 
 namespace xreg
@@ -36,7 +37,11 @@ namespace xreg
 ///
 /// As described by Penney 2001
 /// This currently optimizes the subproblem with a backtracking Armijo line search with modified Newton step directions..
-class ImgSimMetric2DGradDiffCPU : public ImgSimMetric2DGradImgCPU
+/// The metric may be restricted to a band about the fixed image edges, see
+/// ImgSimMetric2DGradEdgeBand.
+class ImgSimMetric2DGradDiffCPU
+  : public ImgSimMetric2DGradImgCPU,
+    public ImgSimMetric2DGradEdgeBand
 {
 public:
   /// \brief Constructor - trivial, no work performed.
@@ -74,6 +79,10 @@ public:
 
   void set_track_sub_prob_inits(const bool track_inits);
 
+  /// \brief When the edge band is used, these are the moving image pixels
+  ///        needed to compute the gradients in the band.
+  bool mov_img_pixels_used(PixelIndexList* pix_inds) override;
+
 protected:
   void process_mask() override;
 
@@ -86,6 +95,8 @@ private:
   cv::Mat fixed_grad_img_x_to_use_;
   cv::Mat fixed_grad_img_y_to_use_;
 
+  // When a mask or edge band is used, these only store the gradients of the
+  // pixels that are used, in the order of used_pix_inds_
   ImageArray fixed_grad_img_x_vec_;
   ImageArray fixed_grad_img_y_vec_;
 
@@ -107,6 +118,9 @@ private:
   ImageArrayList tmp_imgs_vec2_;
   ImageArrayList tmp_imgs_vec3_;
 
+  // moving image gradients gathered at the pixels used by the mask
+  ImageArrayList mov_grad_masked_vecs_;
+
   // sub-problem configuration:
   size_type num_sub_prob_its_ = 5;
   
@@ -119,6 +133,10 @@ private:
   std::vector<std::array<double,2>> sub_prob_vals_;
 
   cv::Mat mask_ocv_;
+
+  // The pixels used, either those of the mask or the edge band, null when
+  // every pixel is used
+  const PixelIndexList* used_pix_inds_ = nullptr;
 };
 
 }  // xreg
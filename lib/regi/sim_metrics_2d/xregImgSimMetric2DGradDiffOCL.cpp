@@ -0,0 +1,458 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregImgSimMetric2DGradDiffOCL.h"
+
+#include <boost/compute/memory/local_buffer.hpp>
+#include <boost/compute/utility/source.hpp>
+
+#include <fmt/format.h>
+
+#include "xregBasicStats.h"
+#include "xregOpenCLProgCache.h"
+
+namespace
+{
+
+// The maximum number of times a step is halved by the line search is passed
+// with the define XREG_GRAD_DIFF_MAX_BACKTRACKS
+
+const char* kGRAD_DIFF_OPENCL_SRC = BOOST_COMPUTE_STRINGIZE_SOURCE(
+
+// Computes the objective value, first and second derivatives of a sub-problem
+// for the gradient scale factor s. Must be called by every work item of the
+// work-group, each of which receives the same result.
+float4 GradDiffObjFn(__global const float* fixed_grad,
+                     __global const XREG_MOV_GRAD_T* mov_grad,
+                     __global const float* mask,
+                     const uint use_mask,
+                     const uint img_len,
+                     const float fixed_grad_var,
+                     const float masked_obj_off,
+                     const float s,
+                     __local float4* scratch)
+{
+  if (fixed_grad_var <= 1.0e-8f)
+  {
+    // same for every work item, so the barriers below are not skipped by only some
+    return (float4) (0, 0, 0, 0);
+  }
+
+  const uint lid   = get_local_id(0);
+  const uint lsize = get_local_size(0);
+
+  float4 acc = (float4) (0, 0, 0, 0);
+
+  for (uint pix_idx = lid; pix_idx < img_len; pix_idx += lsize)
+  {
+    if (!use_mask || (mask[pix_idx] > 0.5f))
+    {
+      const float gm = XREG_LOAD_MOV_GRAD(pix_idx, mov_grad);
+
+      const float d = fixed_grad[pix_idx] - (s * gm);
+
+      const float inv_q    = 1.0f / ((d * d) + fixed_grad_var);
+      const float inv_q_sq = inv_q * inv_q;
+
+      acc.x += inv_q;
+      acc.y += gm * d * inv_q_sq;
+      acc.z += gm * gm * ((4.0f * d * d * inv_q_sq * inv_q) - inv_q_sq);
+    }
+  }
+
+  scratch[lid] = acc;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for (uint r = lsize / 2; r > 0; r >>= 1)
+  {
+    if (lid < r)
+    {
+      scratch[lid] += scratch[lid + r];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  const float4 sums = scratch[0];
+
+  // the scratch buffer is overwritten by the next evaluation
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  const float two_times_var = 2.0f * fixed_grad_var;
+
+  return (float4) ((-fixed_grad_var * sums.x) + masked_obj_off,
+                   -two_times_var * sums.y,
+                   -two_times_var * sums.z,
+                   0);
+}
+
+// Minimizes a sub-problem with modified Newton steps and a backtracking
+// Armijo line search, returns the (objective, s) at termination.
+float2 GradDiffSolve(__global const float* fixed_grad,
+                     __global const XREG_MOV_GRAD_T* mov_grad,
+                     __global const float* mask,
+                     const uint use_mask,
+                     const uint img_len,
+                     const float fixed_grad_var,
+                     const float masked_obj_off,
+                     const float init_s,
+                     const uint max_its,
+                     __local float4* scratch)
+{
+  float s = init_s;
+
+  float4 fgh = GradDiffObjFn(fixed_grad, mov_grad, mask, use_mask, img_len,
+                             fixed_grad_var, masked_obj_off, s, scratch);
+
+  const float grad_term_tol = fmax(1.0f, fabs(fgh.y)) * 1.0e-6f;
+
+  float prev_s = s;
+
+  for (uint it = 0; ; ++it)
+  {
+    if (fabs(fgh.y) <= grad_term_tol)
+    {
+      break;
+    }
+    else if ((it > 0) && (fabs(prev_s - s) < 1.0e-8f))
+    {
+      break;
+    }
+    else if (max_its && (it >= max_its))
+    {
+      break;
+    }
+
+    // modify the hessian to be sufficiently positive
+    const float abs_H = fabs(fgh.z);
+
+    const float eps = (abs_H > 1.0e-6f) ? (abs_H / 1.0e6f) : 1.0f;
+
+    const float H = (fgh.z >= eps) ? fgh.z : ((fgh.z <= -eps) ? -fgh.z : eps);
+
+    const float p = -fgh.y / H;
+
+    const float eta_grad_dot_p = 0.001f * fgh.y * p;
+
+    prev_s = s;
+
+    float alpha = 1;
+
+    float next_s = prev_s + p;
+
+    float next_F = GradDiffObjFn(fixed_grad, mov_grad, mask, use_mask, img_len,
+                                 fixed_grad_var, masked_obj_off, next_s, scratch).x;
+
+    for (uint bt = 0; (next_F > (fgh.x + (alpha * eta_grad_dot_p))) &&
+                      (bt < XREG_GRAD_DIFF_MAX_BACKTRACKS); ++bt)
+    {
+      alpha *= 0.5f;
+
+      next_s = prev_s + (alpha * p);
+
+      next_F = GradDiffObjFn(fixed_grad, mov_grad, mask, use_mask, img_len,
+                             fixed_grad_var, masked_obj_off, next_s, scratch).x;
+    }
+
+    s = next_s;
+
+    fgh = GradDiffObjFn(fixed_grad, mov_grad, mask, use_mask, img_len,
+                        fixed_grad_var, masked_obj_off, s, scratch);
+  }
+
+  return (float2) (fgh.x, s);
+}
+
+// One work-group per (moving image, gradient direction) pair, e.g. global
+// size of (work-group size, 2 * number of moving images). The work-group size
+// must be a power of two.
+__kernel void GradDiffKernel(__global const float* fixed_grad_x,
+                             __global const float* fixed_grad_y,
+                             __global const XREG_MOV_GRAD_T* mov_grad_x_imgs,
+                             __global const XREG_MOV_GRAD_T* mov_grad_y_imgs,
+                             __global const float* mask,
+                             const uint use_mask,
+                             const uint img_len,
+                             const float fixed_grad_x_var,
+                             const float fixed_grad_y_var,
+                             const float masked_obj_off,
+                             const float init_s_x,
+                             const float init_s_y,
+                             const uint max_its,
+                             const uint do_two_guess_sym,
+                             __global float* dir_sim_vals,
+                             __global float* dir_final_s,
+                             __local float4* scratch)
+{
+  const uint out_idx = get_group_id(1);
+
+  const uint img_idx = out_idx / 2;
+
+  const bool is_x = (out_idx % 2) == 0;
+
+  __global const float* fixed_grad = is_x ? fixed_grad_x : fixed_grad_y;
+
+  // these buffers are local to this sim metric; no need to worry about projection offset
+  __global const XREG_MOV_GRAD_T* mov_grad = (is_x ? mov_grad_x_imgs : mov_grad_y_imgs) + (img_idx * img_len);
+
+  const float fixed_grad_var = is_x ? fixed_grad_x_var : fixed_grad_y_var;
+
+  const float init_s = is_x ? init_s_x : init_s_y;
+
+  float2 sol = GradDiffSolve(fixed_grad, mov_grad, mask, use_mask, img_len,
+                             fixed_grad_var, masked_obj_off, init_s, max_its, scratch);
+
+  // see if we should run another solve with the opposite sign for the initial guess
+  if (do_two_guess_sym && (fabs(init_s) > 1.0e-6f))
+  {
+    const float2 sol_neg = GradDiffSolve(fixed_grad, mov_grad, mask, use_mask, img_len,
+                                         fixed_grad_var, masked_obj_off, -init_s, max_its,
+                                         scratch);
+
+    if (sol_neg.x < sol.x)
+    {
+      sol = sol_neg;
+    }
+  }
+
+  if (get_local_id(0) == 0)
+  {
+    dir_sim_vals[out_idx] = sol.x;
+    dir_final_s[out_idx]  = sol.y;
+  }
+}
+
+);
+
+/// \brief Preferred work-group size; reductions require a power of two
+constexpr std::size_t kGRAD_DIFF_WORK_GROUP_SIZE = 256;
+
+/// \brief Bound on the step halvings of a line search, so that a flat
+///        objective cannot cause a work-group to loop forever
+constexpr std::size_t kGRAD_DIFF_MAX_BACKTRACKS = 50;
+
+}  // un-named
+
+xreg::ImgSimMetric2DGradDiffOCL::ImgSimMetric2DGradDiffOCL(const boost::compute::device& dev)
+  : ImgSimMetric2DGradImgOCL(dev)
+{ }
+
+xreg::ImgSimMetric2DGradDiffOCL::ImgSimMetric2DGradDiffOCL(const boost::compute::context& ctx,
+                                                           const boost::compute::command_queue& queue)
+  : ImgSimMetric2DGradImgOCL(ctx, queue)
+{ }
+
+void xreg::ImgSimMetric2DGradDiffOCL::allocate_resources()
+{
+  namespace bc = boost::compute;
+
+  // computes the fixed image gradients on the device
+  ImgSimMetric2DGradImgOCL::allocate_resources();
+
+  // the parent call to allocate resources triggers a call to process_mask
+  // before the fixed image gradients are available, so compute the
+  // variances now
+  compute_fixed_grad_vars();
+
+  const size_type num_outs = 2 * this->num_mov_imgs_;
+
+  dir_sim_vals_dev_.reset(new DevBuf(num_outs, this->ctx_));
+  dir_final_s_dev_.reset(new DevBuf(num_outs, this->ctx_));
+
+  dir_sim_vals_host_.assign(num_outs, 0);
+  dir_final_s_host_.assign(num_outs, 0);
+
+  bc::program prog = BuildOpenCLProg(fmt::format("#define XREG_GRAD_DIFF_MAX_BACKTRACKS {}\n",
+                                                 kGRAD_DIFF_MAX_BACKTRACKS) +
+                                     this->mov_grad_load_ocl_src() + kGRAD_DIFF_OPENCL_SRC,
+                                     this->ctx_);
+
+  grad_diff_krnl_ = prog.create_kernel("GradDiffKernel");
+
+  grad_diff_wg_size_ = this->pow2_work_group_size(grad_diff_krnl_, kGRAD_DIFF_WORK_GROUP_SIZE);
+
+  grad_diff_krnl_.set_arg(0, *this->fixed_grad_x_dev_buf_);
+  grad_diff_krnl_.set_arg(1, *this->fixed_grad_y_dev_buf_);
+  grad_diff_krnl_.set_arg(2, *this->mov_grad_x_dev_buf_);
+  grad_diff_krnl_.set_arg(3, *this->mov_grad_y_dev_buf_);
+  grad_diff_krnl_.set_arg(6, bc::uint_(this->num_pix_per_proj()));
+  grad_diff_krnl_.set_arg(14, *dir_sim_vals_dev_);
+  grad_diff_krnl_.set_arg(15, *dir_final_s_dev_);
+  grad_diff_krnl_.set_arg(16, bc::local_buffer<bc::float4_>(grad_diff_wg_size_));
+
+  this->sim_vals_.assign(this->num_mov_imgs_, 0);
+}
+
+void xreg::ImgSimMetric2DGradDiffOCL::compute()
+{
+  namespace bc = boost::compute;
+
+  this->pre_compute();
+
+  this->compute_sobel_grads();
+
+  const bool apply_mask = this->mask_;
+
+  // Each masked out pixel has zero gradient in the fixed and moving images,
+  // and therefore adds a constant of -1 to the objective, which is not explicitly
+  // computed when skipping the masked out pixels.
+  const Scalar masked_obj_off = apply_mask ?
+      -static_cast<Scalar>(this->num_pix_per_proj() - this->num_pix_per_proj_after_mask_) : Scalar(0);
+
+  // the fixed gradient buffer is passed as a dummy argument when there is no mask
+  grad_diff_krnl_.set_arg(4, apply_mask ? *this->mask_ocl_buf_ : *this->fixed_grad_x_dev_buf_);
+  grad_diff_krnl_.set_arg(5, bc::uint_(apply_mask ? 1 : 0));
+  grad_diff_krnl_.set_arg(7, static_cast<float>(fixed_grad_x_var_));
+  grad_diff_krnl_.set_arg(8, static_cast<float>(fixed_grad_y_var_));
+  grad_diff_krnl_.set_arg(9, static_cast<float>(masked_obj_off));
+  grad_diff_krnl_.set_arg(10, static_cast<float>(sub_prob_init_guess_[0]));
+  grad_diff_krnl_.set_arg(11, static_cast<float>(sub_prob_init_guess_[1]));
+  grad_diff_krnl_.set_arg(12, bc::uint_(num_sub_prob_its_));
+  grad_diff_krnl_.set_arg(13, bc::uint_(do_two_guess_symmetric_ ? 1 : 0));
+
+  const size_type num_outs = 2 * this->num_mov_imgs_;
+
+  const std::size_t global_size[2] = { grad_diff_wg_size_, num_outs };
+  const std::size_t local_size[2]  = { grad_diff_wg_size_, 1 };
+
+  this->enqueue_kernel(grad_diff_krnl_, 2, global_size, local_size);
+
+  bc::copy(dir_sim_vals_dev_->begin(), dir_sim_vals_dev_->begin() + num_outs,
+           dir_sim_vals_host_.begin(), this->queue_);
+
+  for (size_type mov_idx = 0; mov_idx < this->num_mov_imgs_; ++mov_idx)
+  {
+    this->sim_vals_[mov_idx] = dir_sim_vals_host_[2 * mov_idx] +
+                               dir_sim_vals_host_[(2 * mov_idx) + 1];
+  }
+
+  if (track_sub_prob_inits_)
+  {
+    bc::copy(dir_final_s_dev_->begin(), dir_final_s_dev_->begin() + num_outs,
+             dir_final_s_host_.begin(), this->queue_);
+
+    const size_type min_idx = std::min_element(this->sim_vals_.begin(), this->sim_vals_.end())
+                                - this->sim_vals_.begin();
+
+    sub_prob_init_guess_ = { dir_final_s_host_[2 * min_idx],
+                             dir_final_s_host_[(2 * min_idx) + 1] };
+  }
+}
+
+xreg::size_type xreg::ImgSimMetric2DGradDiffOCL::num_sub_prob_its() const
+{
+  return num_sub_prob_its_;
+}
+
+void xreg::ImgSimMetric2DGradDiffOCL::set_num_sub_prob_its(const size_type num_its)
+{
+  num_sub_prob_its_ = num_its;
+}
+
+std::array<double,2> xreg::ImgSimMetric2DGradDiffOCL::sub_prob_init_guess() const
+{
+  return sub_prob_init_guess_;
+}
+
+void xreg::ImgSimMetric2DGradDiffOCL::set_sub_prob_init_guess(const double init_guess)
+{
+  sub_prob_init_guess_ = { init_guess, init_guess };
+}
+
+void xreg::ImgSimMetric2DGradDiffOCL::set_sub_prob_init_guess(const std::array<double,2>& init_guess)
+{
+  sub_prob_init_guess_ = init_guess;
+}
+
+bool xreg::ImgSimMetric2DGradDiffOCL::do_two_guess_symmetric() const
+{
+  return do_two_guess_symmetric_;
+}
+
+void xreg::ImgSimMetric2DGradDiffOCL::set_do_two_guess_symmetric(const bool do_sym)
+{
+  do_two_guess_symmetric_ = do_sym;
+}
+
+bool xreg::ImgSimMetric2DGradDiffOCL::track_sub_prob_inits() const
+{
+  return track_sub_prob_inits_;
+}
+
+void xreg::ImgSimMetric2DGradDiffOCL::set_track_sub_prob_inits(const bool track_inits)
+{
+  track_sub_prob_inits_ = track_inits;
+}
+
+void xreg::ImgSimMetric2DGradDiffOCL::process_mask()
+{
+  ImgSimMetric2DGradImgOCL::process_mask();
+
+  // the fixed image gradients do not exist yet when this is called while
+  // allocating resources
+  if (this->fixed_grad_x_dev_buf_)
+  {
+    compute_fixed_grad_vars();
+  }
+}
+
+void xreg::ImgSimMetric2DGradDiffOCL::compute_fixed_grad_vars()
+{
+  using ImageArray    = Eigen::Array<Scalar,Eigen::Dynamic,1>;
+  using ImageArrayMap = Eigen::Map<ImageArray>;
+
+  const size_type num_pix_per_img = this->num_pix_per_proj();
+
+  ScalarList fixed_grad_host(num_pix_per_img);
+
+  const unsigned char* mask_buf_host = this->mask_ ? this->mask_->GetBufferPointer() : nullptr;
+
+  DevBuf* fixed_grads[2] = { this->fixed_grad_x_dev_buf_.get(),
+                             this->fixed_grad_y_dev_buf_.get() };
+
+  Scalar* fixed_grad_vars[2] = { &fixed_grad_x_var_, &fixed_grad_y_var_ };
+
+  for (size_type grad_dir_idx = 0; grad_dir_idx < 2; ++grad_dir_idx)
+  {
+    boost::compute::copy(fixed_grads[grad_dir_idx]->begin(),
+                         fixed_grads[grad_dir_idx]->begin() + num_pix_per_img,
+                         fixed_grad_host.begin(), this->queue_);
+
+    if (mask_buf_host)
+    {
+      // The variances are computed with gradient values of zero at masked out
+      // locations
+      for (size_type i = 0; i < num_pix_per_img; ++i)
+      {
+        if (!mask_buf_host[i])
+        {
+          fixed_grad_host[i] = 0;
+        }
+      }
+    }
+
+    const Scalar std_dev = SampleStdDev(ImageArrayMap(fixed_grad_host.data(), num_pix_per_img));
+
+    *fixed_grad_vars[grad_dir_idx] = std_dev * std_dev;
+  }
+}
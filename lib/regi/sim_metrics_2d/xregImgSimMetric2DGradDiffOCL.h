@@ -0,0 +1,106 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGIMGSIMMETRIC2DGRADDIFFOCL_H_
+#define XREGIMGSIMMETRIC2DGRADDIFFOCL_H_
+
+#include "xregImgSimMetric2DGradImgOCL.h"
+
+namespace xreg
+{
+
+/// \brief OpenCL implementation of the gradient difference similarity metric.
+///
+/// \see ImgSimMetric2DGradDiffCPU for a description of the metric.
+/// Each one dimensional sub-problem over the gradient scale factor is solved
+/// on the device by a work-group, using the same modified Newton iterations
+/// and backtracking line search as the CPU implementation. Only the
+/// similarity values and final scale factors are read back.
+class ImgSimMetric2DGradDiffOCL : public ImgSimMetric2DGradImgOCL
+{
+public:
+  ImgSimMetric2DGradDiffOCL() = default;
+
+  explicit ImgSimMetric2DGradDiffOCL(const boost::compute::device& dev);
+
+  ImgSimMetric2DGradDiffOCL(const boost::compute::context& ctx,
+                            const boost::compute::command_queue& queue);
+
+  /// \brief Allocation of other resources required and computation of
+  ///        the fixed image gradients and their variances.
+  void allocate_resources() override;
+
+  void compute() override;
+
+  size_type num_sub_prob_its() const;
+
+  void set_num_sub_prob_its(const size_type num_its);
+
+  std::array<double,2> sub_prob_init_guess() const;
+
+  void set_sub_prob_init_guess(const double init_guess);
+
+  void set_sub_prob_init_guess(const std::array<double,2>& init_guess);
+
+  bool do_two_guess_symmetric() const;
+
+  void set_do_two_guess_symmetric(const bool do_sym);
+
+  bool track_sub_prob_inits() const;
+
+  void set_track_sub_prob_inits(const bool track_inits);
+
+protected:
+  void process_mask() override;
+
+private:
+  void compute_fixed_grad_vars();
+
+  Scalar fixed_grad_x_var_ = 0;
+  Scalar fixed_grad_y_var_ = 0;
+
+  // sub-problem configuration:
+  size_type num_sub_prob_its_ = 5;
+
+  std::array<double,2> sub_prob_init_guess_ = std::array<double,2>{ 1.0, 1.0 };
+
+  bool do_two_guess_symmetric_ = false;
+
+  bool track_sub_prob_inits_ = false;
+
+  // similarity values and final scale factors of each (moving image, direction) pair
+  std::unique_ptr<DevBuf> dir_sim_vals_dev_;
+  std::unique_ptr<DevBuf> dir_final_s_dev_;
+
+  ScalarList dir_sim_vals_host_;
+  ScalarList dir_final_s_host_;
+
+  boost::compute::kernel grad_diff_krnl_;
+
+  std::size_t grad_diff_wg_size_ = 0;
+};
+
+}  // xreg
+
+#endif
@@ -0,0 +1,198 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "xregImgSimMetric2DGradEdgeBand.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "xregAssert.h"
+#include "xregITKOpenCVUtils.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+/// \brief Offsets of the non-zero pixels of a (row-major) 8-bit mask
+ImgSimMetric2D::PixelIndexList NonZeroPixInds(const cv::Mat& m)
+{
+  ImgSimMetric2D::PixelIndexList inds;
+
+  const size_type num_pix = m.rows * m.cols;
+
+  const unsigned char* buf = m.ptr<unsigned char>(0);
+
+  for (size_type i = 0; i < num_pix; ++i)
+  {
+    if (buf[i])
+    {
+      inds.push_back(i);
+    }
+  }
+
+  return inds;
+}
+
+void DilateSquare(const cv::Mat& src, const size_type r, cv::Mat* dst)
+{
+  if (r)
+  {
+    const int w = static_cast<int>((2 * r) + 1);
+
+    cv::dilate(src, *dst, cv::getStructuringElement(cv::MORPH_RECT, cv::Size(w,w)));
+  }
+  else
+  {
+    *dst = src.clone();
+  }
+}
+
+}  // un-named
+
+void xreg::ImgSimMetric2DGradEdgeBand::set_use_edge_band(const bool use_band)
+{
+  use_edge_band_ = use_band;
+}
+
+bool xreg::ImgSimMetric2DGradEdgeBand::use_edge_band() const
+{
+  return use_edge_band_;
+}
+
+void xreg::ImgSimMetric2DGradEdgeBand::set_edge_band_grad_mag_percentile(const double p)
+{
+  xregASSERT((p >= 0) && (p < 1));
+
+  edge_band_grad_mag_percentile_ = p;
+}
+
+double xreg::ImgSimMetric2DGradEdgeBand::edge_band_grad_mag_percentile() const
+{
+  return edge_band_grad_mag_percentile_;
+}
+
+void xreg::ImgSimMetric2DGradEdgeBand::set_edge_band_dilate_radius(const size_type r)
+{
+  edge_band_dilate_rad_ = r;
+}
+
+xreg::size_type xreg::ImgSimMetric2DGradEdgeBand::edge_band_dilate_radius() const
+{
+  return edge_band_dilate_rad_;
+}
+
+void xreg::ImgSimMetric2DGradEdgeBand::compute_edge_band(const cv::Mat& fixed_grad_x,
+                                                         const cv::Mat& fixed_grad_y,
+                                                         const ImageMask* mask,
+                                                         const size_type grad_support_radius)
+{
+  using Scalar = ImgSimMetric2D::Scalar;
+
+  xregASSERT(fixed_grad_x.size() == fixed_grad_y.size());
+
+  const int num_rows = fixed_grad_x.rows;
+  const int num_cols = fixed_grad_x.cols;
+
+  const size_type num_pix = num_rows * num_cols;
+
+  const Scalar* gx = fixed_grad_x.ptr<Scalar>(0);
+  const Scalar* gy = fixed_grad_y.ptr<Scalar>(0);
+
+  const unsigned char* mask_buf = mask ? mask->GetBufferPointer() : nullptr;
+
+  std::vector<Scalar> grad_mags(num_pix);
+
+  for (size_type i = 0; i < num_pix; ++i)
+  {
+    grad_mags[i] = std::sqrt((gx[i] * gx[i]) + (gy[i] * gy[i]));
+  }
+
+  // find the gradient magnitude at the percentile of the unmasked pixels
+  std::vector<Scalar> sorted_mags;
+  sorted_mags.reserve(num_pix);
+
+  for (size_type i = 0; i < num_pix; ++i)
+  {
+    if (!mask_buf || mask_buf[i])
+    {
+      sorted_mags.push_back(grad_mags[i]);
+    }
+  }
+
+  Scalar thresh = 0;
+
+  if (!sorted_mags.empty())
+  {
+    const size_type k = std::min(sorted_mags.size() - 1,
+                                 static_cast<size_type>(edge_band_grad_mag_percentile_ *
+                                                        sorted_mags.size()));
+
+    std::nth_element(sorted_mags.begin(), sorted_mags.begin() + k, sorted_mags.end());
+
+    thresh = sorted_mags[k];
+  }
+
+  cv::Mat edges(num_rows, num_cols, CV_8UC1);
+
+  unsigned char* edges_buf = edges.ptr<unsigned char>(0);
+
+  for (size_type i = 0; i < num_pix; ++i)
+  {
+    edges_buf[i] = ((!mask_buf || mask_buf[i]) && (grad_mags[i] >= thresh)) ? 1 : 0;
+  }
+
+  cv::Mat band;
+  DilateSquare(edges, edge_band_dilate_rad_, &band);
+
+  if (mask_buf)
+  {
+    unsigned char* band_buf = band.ptr<unsigned char>(0);
+
+    for (size_type i = 0; i < num_pix; ++i)
+    {
+      band_buf[i] = mask_buf[i] ? band_buf[i] : 0;
+    }
+  }
+
+  // the moving image pixels are not masked, as the gradients in the band
+  // depend on neighboring pixels outside of the mask
+  cv::Mat mov_band;
+  DilateSquare(band, grad_support_radius, &mov_band);
+
+  edge_band_mask_ = CopyAndCastOpenCVToITK<unsigned char>(band);
+
+  edge_band_pix_inds_     = NonZeroPixInds(band);
+  edge_band_mov_pix_inds_ = NonZeroPixInds(mov_band);
+
+  edge_band_rows_.assign(num_rows, 0);
+
+  for (const auto& i : edge_band_pix_inds_)
+  {
+    edge_band_rows_[i / num_cols] = 1;
+  }
+}
@@ -0,0 +1,109 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef XREGIMGSIMMETRIC2DGRADEDGEBAND_H_
+#define XREGIMGSIMMETRIC2DGRADEDGEBAND_H_
+
+#include <opencv2/core/core.hpp>
+
+#include "xregImgSimMetric2D.h"
+
+namespace xreg
+{
+
+/// \brief Restricts a gradient similarity metric to a band about the
+///        strongest edges of the fixed image.
+///
+/// Most of the information used by gradient metrics is located near edges
+/// (e.g. of bones), so evaluating the metric over only the fixed image pixels
+/// with the largest gradient magnitudes, dilated into a band, is considerably
+/// cheaper and changes the similarity values very little. The pixels of the
+/// moving images required to compute the gradients in the band are reported
+/// through mov_img_pixels_used(), so that a ray caster may only compute those
+/// pixels of the DRRs.
+/// Derived similarity metrics hold this state and apply the band as if it was
+/// (an additional) mask.
+class ImgSimMetric2DGradEdgeBand
+{
+public:
+  using PixelIndexList = ImgSimMetric2D::PixelIndexList;
+  using ImageMask      = ImgSimMetric2D::ImageMask;
+  using ImageMaskPtr   = ImgSimMetric2D::ImageMaskPtr;
+
+  /// \brief Only evaluate the metric in a band about the fixed image edges.
+  ///
+  /// This must be set before calling allocate_resources(). Defaults to false.
+  void set_use_edge_band(const bool use_band);
+
+  bool use_edge_band() const;
+
+  /// \brief Sets the percentile of the fixed image gradient magnitudes used
+  ///        to select the edge pixels, in [0,1).
+  ///
+  /// e.g. 0.9 selects the 10% of (unmasked) pixels with the largest gradient
+  /// magnitudes. Defaults to 0.9.
+  void set_edge_band_grad_mag_percentile(const double p);
+
+  double edge_band_grad_mag_percentile() const;
+
+  /// \brief Sets the radius, in pixels, used to dilate the edge pixels into
+  ///        a band. Defaults to 3.
+  void set_edge_band_dilate_radius(const size_type r);
+
+  size_type edge_band_dilate_radius() const;
+
+protected:
+  /// \brief Computes the edge band from the fixed image gradients.
+  ///
+  /// The band is intersected with the mask, when one is provided. The pixels
+  /// required from the moving images are the band dilated by the radius of
+  /// the smoothing and Sobel operators used to compute the gradients.
+  void compute_edge_band(const cv::Mat& fixed_grad_x, const cv::Mat& fixed_grad_y,
+                         const ImageMask* mask, const size_type grad_support_radius);
+
+  /// \brief The band as a mask image, suitable for passing to metrics which
+  ///        operate on gradient images.
+  ImageMaskPtr edge_band_mask_;
+
+  /// \brief The (ascending) offsets of the pixels in the band
+  PixelIndexList edge_band_pix_inds_;
+
+  /// \brief The (ascending) offsets of the moving image pixels required to
+  ///        compute the gradients in the band
+  PixelIndexList edge_band_mov_pix_inds_;
+
+  /// \brief edge_band_rows_[r] is non-zero when row r intersects the band
+  std::vector<unsigned char> edge_band_rows_;
+
+  bool use_edge_band_ = false;
+
+  double edge_band_grad_mag_percentile_ = 0.9;
+
+  size_type edge_band_dilate_rad_ = 3;
+};
+
+}  // xreg
+
+#endif
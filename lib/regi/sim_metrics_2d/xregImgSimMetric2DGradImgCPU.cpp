@@ -24,10 +24,234 @@
 
 #include "xregImgSimMetric2DGradImgCPU.h"
 
+#include <algorithm>
+
 #include <opencv2/imgproc/imgproc.hpp>
 
 #include "xregOpenCVUtils.h"
 #include "xregITKOpenCVUtils.h"
+#include "xregAssert.h"
+#include "xregTBBUtils.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+using Scalar = ImgSimMetric2D::Scalar;
+
+/// \brief Index of a pixel mirrored about the image border, excluding the
+///        border pixel, e.g. gfedcb|abcdefgh|gfedcba
+///
+/// This is consistent with the default OpenCV border mode (BORDER_REFLECT_101).
+int Reflect101(int i, const int n)
+{
+  if (n == 1)
+  {
+    return 0;
+  }
+
+  while ((i < 0) || (i >= n))
+  {
+    i = (i < 0) ? -i : ((2 * n) - 2 - i);
+  }
+
+  return i;
+}
+
+/// \brief Computes the Sobel derivatives of Gaussian smoothed images in a
+///        single pass over each image.
+///
+/// This is equivalent to calling cv::GaussianBlur and then cv::Sobel for each
+/// direction (with default border modes), but avoids writing the smoothed
+/// image and reading it twice. The unit of work is a band of rows from an
+/// image; the smoothed rows of a band (plus one row above and below for the
+/// Sobel) are computed with separable filters into a small scratch buffer that
+/// stays in cache. All of the inner loops are over contiguous columns so they
+/// may be vectorized by the compiler.
+struct SmoothSobelGradsFn
+{
+  const Scalar* src_imgs;
+
+  Scalar* grad_x_imgs;
+  Scalar* grad_y_imgs;
+
+  int num_rows;
+  int num_cols;
+
+  /// \brief Normalized 1D Gaussian kernel, a single element of one when
+  ///        not smoothing
+  std::vector<Scalar> smooth_kernel;
+
+  int band_num_rows;
+  int num_bands_per_img;
+
+  /// \brief When not null, rows_used[r] is zero when the gradients of row r
+  ///        are not needed; bands of rows which are not needed are skipped
+  const unsigned char* rows_used = nullptr;
+
+  void smooth_row(const Scalar* src_img, const int row_idx,
+                  Scalar* vert_row, Scalar* pad_row, Scalar* dst_row) const
+  {
+    const int rad = static_cast<int>(smooth_kernel.size()) / 2;
+
+    if (!rad)
+    {
+      std::copy(src_img + (row_idx * num_cols), src_img + ((row_idx + 1) * num_cols), dst_row);
+      return;
+    }
+
+    // vertical pass
+    std::fill(vert_row, vert_row + num_cols, Scalar(0));
+
+    for (int k = -rad; k <= rad; ++k)
+    {
+      const Scalar w = smooth_kernel[k + rad];
+
+      const Scalar* src_row = src_img + (Reflect101(row_idx + k, num_rows) * num_cols);
+
+      for (int c = 0; c < num_cols; ++c)
+      {
+        vert_row[c] += w * src_row[c];
+      }
+    }
+
+    // horizontal pass, use a padded row to avoid boundary checks
+    std::copy(vert_row, vert_row + num_cols, pad_row + rad);
+
+    for (int j = 1; j <= rad; ++j)
+    {
+      pad_row[rad - j]                = vert_row[Reflect101(-j, num_cols)];
+      pad_row[rad + num_cols - 1 + j] = vert_row[Reflect101(num_cols - 1 + j, num_cols)];
+    }
+
+    std::fill(dst_row, dst_row + num_cols, Scalar(0));
+
+    for (int k = 0; k <= (2 * rad); ++k)
+    {
+      const Scalar w = smooth_kernel[k];
+
+      const Scalar* shifted_pad_row = pad_row + k;
+
+      for (int c = 0; c < num_cols; ++c)
+      {
+        dst_row[c] += w * shifted_pad_row[c];
+      }
+    }
+  }
+
+  void operator()(const RangeType& r) const
+  {
+    const int rad = static_cast<int>(smooth_kernel.size()) / 2;
+
+    std::vector<Scalar> vert_row(num_cols);
+    std::vector<Scalar> pad_row(num_cols + (2 * rad));
+
+    std::vector<Scalar> smooth_rows((band_num_rows + 2) * num_cols);
+
+    const size_type img_len = num_rows * num_cols;
+
+    const int last_col = num_cols - 1;
+    const int prev_of_first_col = Reflect101(-1, num_cols);
+    const int next_of_last_col  = Reflect101(num_cols, num_cols);
+
+    for (size_type work_idx = r.begin(); work_idx < r.end(); ++work_idx)
+    {
+      const size_type img_idx = work_idx / num_bands_per_img;
+
+      const int start_row = static_cast<int>(work_idx % num_bands_per_img) * band_num_rows;
+      const int stop_row  = std::min(start_row + band_num_rows, num_rows);
+
+      if (rows_used && std::none_of(rows_used + start_row, rows_used + stop_row,
+                                    [] (const unsigned char u) { return u != 0; }))
+      {
+        continue;
+      }
+
+      const Scalar* src_img = src_imgs + (img_idx * img_len);
+
+      // smoothed rows [start_row - 1, stop_row], with the out of bounds rows
+      // reflected about the smoothed image border
+      for (int sr = start_row - 1; sr <= stop_row; ++sr)
+      {
+        smooth_row(src_img, Reflect101(sr, num_rows), &vert_row[0], &pad_row[0],
+                   &smooth_rows[(sr - start_row + 1) * num_cols]);
+      }
+
+      for (int row_idx = start_row; row_idx < stop_row; ++row_idx)
+      {
+        const Scalar* p = &smooth_rows[(row_idx - start_row) * num_cols];
+        const Scalar* m = p + num_cols;
+        const Scalar* n = m + num_cols;
+
+        Scalar* gx = grad_x_imgs + (img_idx * img_len) + (row_idx * num_cols);
+        Scalar* gy = grad_y_imgs + (img_idx * img_len) + (row_idx * num_cols);
+
+        for (int c = 1; c < last_col; ++c)
+        {
+          gx[c] = (p[c + 1] - p[c - 1]) + (2 * (m[c + 1] - m[c - 1])) + (n[c + 1] - n[c - 1]);
+          gy[c] = (n[c - 1] - p[c - 1]) + (2 * (n[c] - p[c])) + (n[c + 1] - p[c + 1]);
+        }
+
+        // border columns
+        for (const int c : { 0, last_col })
+        {
+          const int cp = c ? (c - 1) : prev_of_first_col;
+          const int cn = (c < last_col) ? (c + 1) : next_of_last_col;
+
+          gx[c] = (p[cn] - p[cp]) + (2 * (m[cn] - m[cp])) + (n[cn] - n[cp]);
+          gy[c] = (n[cp] - p[cp]) + (2 * (n[c] - p[c])) + (n[cn] - p[cn]);
+        }
+      }
+    }
+  }
+};
+
+/// \brief Computes the Sobel derivatives of contiguous images, optionally
+///        smoothing with a Gaussian kernel of the specified width first.
+///
+/// When rows_used is provided, the gradients are only guaranteed to be
+/// computed in the rows flagged as used.
+void ComputeSmoothSobelGrads(const Scalar* src_imgs, const size_type num_imgs,
+                             const size_type num_rows, const size_type num_cols,
+                             const size_type smooth_kernel_width,
+                             Scalar* grad_x_imgs, Scalar* grad_y_imgs,
+                             const unsigned char* rows_used = nullptr)
+{
+  SmoothSobelGradsFn grads_fn;
+
+  grads_fn.src_imgs    = src_imgs;
+  grads_fn.grad_x_imgs = grad_x_imgs;
+  grads_fn.grad_y_imgs = grad_y_imgs;
+  grads_fn.num_rows    = static_cast<int>(num_rows);
+  grads_fn.num_cols    = static_cast<int>(num_cols);
+  grads_fn.rows_used   = rows_used;
+
+  if (smooth_kernel_width)
+  {
+    // width must be odd, as required by cv::GaussianBlur
+    xregASSERT(smooth_kernel_width & 1);
+
+    // sigma of zero uses the same default as cv::GaussianBlur
+    cv::Mat k = cv::getGaussianKernel(static_cast<int>(smooth_kernel_width), 0,
+                                      cv::DataType<Scalar>::type);
+
+    grads_fn.smooth_kernel.assign(k.ptr<Scalar>(0), k.ptr<Scalar>(0) + smooth_kernel_width);
+  }
+  else
+  {
+    grads_fn.smooth_kernel.assign(1, Scalar(1));
+  }
+
+  // small bands keep the smoothed rows in cache, but each band recomputes
+  // two extra smoothed rows
+  grads_fn.band_num_rows     = std::min(32, grads_fn.num_rows);
+  grads_fn.num_bands_per_img = (grads_fn.num_rows + grads_fn.band_num_rows - 1) / grads_fn.band_num_rows;
+
+  ParallelFor(grads_fn, RangeType(0, num_imgs * grads_fn.num_bands_per_img));
+}
+
+}  // un-named
 
 void xreg::ImgSimMetric2DGradImgCPU::allocate_resources()
 {
@@ -45,24 +269,16 @@ void xreg::ImgSimMetric2DGradImgCPU::allocate_resources()
                                                                   this->num_mov_imgs_,
                                                                   &grad_y_mov_imgs_buf_);
 
-  if (smooth_img_kernel_rad_)
-  {
-    // temporary image buffer to store a smoothed image prior to grad. computation
-    tmp_smooth_img_ = cv::Mat::zeros(fixed_ocv_img.size(), fixed_ocv_img.type());
-    
-    // smooth the fixed image
-    cv::GaussianBlur(fixed_ocv_img, tmp_smooth_img_,
-                     cv::Size(smooth_img_kernel_rad_,smooth_img_kernel_rad_), 0, 0);
-  }
+  grad_mov_imgs_mem_.set_bytes((grad_x_mov_imgs_buf_.size() + grad_y_mov_imgs_buf_.size()) *
+                                 sizeof(Scalar));
 
   // compute gradients of the fixed image
   fixed_grad_img_x_ = cv::Mat::zeros(fixed_ocv_img.size(), fixed_ocv_img.type());
   fixed_grad_img_y_ = cv::Mat::zeros(fixed_ocv_img.size(), fixed_ocv_img.type());
 
-  cv::Sobel(smooth_img_kernel_rad_ ? tmp_smooth_img_ : fixed_ocv_img,
-            fixed_grad_img_x_, -1, 1, 0);
-  cv::Sobel(smooth_img_kernel_rad_ ? tmp_smooth_img_ : fixed_ocv_img,
-            fixed_grad_img_y_, -1, 0, 1);
+  ComputeSmoothSobelGrads(&fixed_ocv_img.at<Scalar>(0,0), 1, fixed_ocv_img.rows, fixed_ocv_img.cols,
+                          smooth_img_kernel_rad_,
+                          &fixed_grad_img_x_.at<Scalar>(0,0), &fixed_grad_img_y_.at<Scalar>(0,0));
 }
 
 xreg::size_type
@@ -76,27 +292,45 @@ void xreg::ImgSimMetric2DGradImgCPU::set_smooth_img_before_sobel_kernel_radius(c
   smooth_img_kernel_rad_ = r;
 }
 
-void xreg::ImgSimMetric2DGradImgCPU::compute_sobel_grads()
+xreg::size_type xreg::ImgSimMetric2DGradImgCPU::sobel_grads_support_radius() const
+{
+  // the smoothing kernel width is stored as the "radius"
+  return (smooth_img_kernel_rad_ / 2) + 1;
+}
+
+void xreg::ImgSimMetric2DGradImgCPU::compute_sobel_grads(const unsigned char* rows_used)
+{
+  if (this->num_mov_imgs_)
+  {
+    ComputeSmoothSobelGrads(this->mov_imgs_buf_, this->num_mov_imgs_,
+                            fixed_grad_img_x_.rows, fixed_grad_img_x_.cols,
+                            smooth_img_kernel_rad_,
+                            &grad_x_mov_imgs_buf_[0], &grad_y_mov_imgs_buf_[0],
+                            rows_used);
+  }
+}
+
+void xreg::ImgSimMetric2DGradImgCPU::backprop_sobel_grads(const Scalar* d_grad_x,
+                                                         const Scalar* d_grad_y,
+                                                         Scalar* d_img) const
 {
   const size_type num_rows = fixed_grad_img_x_.rows;
   const size_type num_cols = fixed_grad_img_x_.cols;
+  const size_type num_pix  = num_rows * num_cols;
 
-  const size_type num_pix = num_rows * num_cols;
+  PixelBuffer x_of_d_grad_x(num_pix);
+  PixelBuffer y_of_d_grad_x(num_pix);
+  PixelBuffer x_of_d_grad_y(num_pix);
+  PixelBuffer y_of_d_grad_y(num_pix);
 
-  for (size_type mov_idx = 0; mov_idx < this->num_mov_imgs_; ++mov_idx)
-  {
-    cv::Mat mov_ocv_img(num_rows, num_cols, fixed_grad_img_x_.type(),
-                        this->mov_imgs_buf_ + (mov_idx * num_pix));
-  
-    if (smooth_img_kernel_rad_)
-    {
-      cv::GaussianBlur(mov_ocv_img, tmp_smooth_img_,
-                       cv::Size(smooth_img_kernel_rad_,smooth_img_kernel_rad_), 0, 0);
-    }
+  ComputeSmoothSobelGrads(d_grad_x, 1, num_rows, num_cols, smooth_img_kernel_rad_,
+                          &x_of_d_grad_x[0], &y_of_d_grad_x[0]);
 
-    cv::Sobel(smooth_img_kernel_rad_ ? tmp_smooth_img_ : mov_ocv_img,
-              mov_grad_imgs_x_[mov_idx], -1, 1, 0);
-    cv::Sobel(smooth_img_kernel_rad_ ? tmp_smooth_img_ : mov_ocv_img,
-              mov_grad_imgs_y_[mov_idx], -1, 0, 1);
+  ComputeSmoothSobelGrads(d_grad_y, 1, num_rows, num_cols, smooth_img_kernel_rad_,
+                          &x_of_d_grad_y[0], &y_of_d_grad_y[0]);
+
+  for (size_type pix_idx = 0; pix_idx < num_pix; ++pix_idx)
+  {
+    d_img[pix_idx] = -(x_of_d_grad_x[pix_idx] + y_of_d_grad_y[pix_idx]);
   }
 }
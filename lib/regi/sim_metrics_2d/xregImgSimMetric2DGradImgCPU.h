@@ -29,6 +29,7 @@
 
 #include "xregImgSimMetric2DCPU.h"
 #include "xregImgSimMetric2DGradImgParamInterface.h"
+#include "xregMemTracking.h"
 
 namespace xreg
 {
@@ -62,12 +63,30 @@ protected:
   using PixelBuffer = std::vector<Scalar>;
   using cvMatList   = std::vector<cv::Mat>;
   
-  /// \brief Computation of the fixed image gradients. Should be called by
+  /// \brief Computation of the moving image gradients. Should be called by
   ///        the derived class in compute()
   ///
-  /// For each gradient direction, this makes serial calls to cv::Sobel
-  /// (which may be threaded) for each moving image.
-  void compute_sobel_grads();
+  /// The smoothing and both gradient directions are computed in a single,
+  /// separable, pass over each moving image, threaded over bands of rows
+  /// from every moving image. The results are consistent with calling
+  /// cv::GaussianBlur followed by cv::Sobel.
+  /// When rows_used is provided, bands of rows without any used rows are
+  /// skipped, so the gradients are only valid in the rows flagged as used.
+  void compute_sobel_grads(const unsigned char* rows_used = nullptr);
+
+  /// \brief The radius of the neighborhood of moving image pixels used to
+  ///        compute the gradients at a pixel.
+  size_type sobel_grads_support_radius() const;
+
+  /// \brief Maps derivatives with respect to the pixels of a moving image's
+  ///        gradients into derivatives with respect to the pixels of the
+  ///        moving image.
+  ///
+  /// This applies the adjoint (transpose) of the smoothing and Sobel operators
+  /// used by compute_sobel_grads(). The Sobel kernels are anti-symmetric in
+  /// the direction of differentiation, so the adjoint is the negation of the
+  /// same operator; this is exact away from the image borders.
+  void backprop_sobel_grads(const Scalar* d_grad_x, const Scalar* d_grad_y, Scalar* d_img) const;
 
   cv::Mat fixed_grad_img_x_;
   cv::Mat fixed_grad_img_y_;
@@ -75,11 +94,12 @@ protected:
   PixelBuffer grad_x_mov_imgs_buf_;
   PixelBuffer grad_y_mov_imgs_buf_;
 
+  TrackedMemAlloc grad_mov_imgs_mem_ = TrackedMemAlloc(MemLocation::kHOST, "sim-metric-grad-imgs");
+
   cvMatList mov_grad_imgs_x_;
   cvMatList mov_grad_imgs_y_; 
 
   size_type smooth_img_kernel_rad_ = 5;
-  cv::Mat tmp_smooth_img_;
 };
 
 }  // xreg
@@ -24,10 +24,16 @@
 
 #include "xregImgSimMetric2DGradImgOCL.h"
 
+#include <boost/compute/memory/local_buffer.hpp>
 #include <boost/compute/utility/source.hpp>
 
+#include <numeric>
+
+#include <fmt/format.h>
+
 #include "xregAssert.h"
 #include "xregNormDist.h"
+#include "xregOpenCLProgCache.h"
 
 namespace
 {
@@ -105,8 +111,8 @@ __kernel void GaussianKernel(__global float* src_imgs,
 }
 
 __kernel void SobelKernel(__global float* src_imgs,
-                          __global float* grad_x_imgs,
-                          __global float* grad_y_imgs,
+                          __global XREG_GRAD_T* grad_x_imgs,
+                          __global XREG_GRAD_T* grad_y_imgs,
                           const uint num_imgs,
                           const uint img_nr,
                           const uint img_nc,
@@ -128,8 +134,8 @@ __kernel void SobelKernel(__global float* src_imgs,
    
     // this buffer is local to this sim metric and we can just use the beginning section; no need
     // to worry about projection offset
-    __global float* cur_grad_x_img = grad_x_imgs + (img_idx * img_len);
-    __global float* cur_grad_y_img = grad_y_imgs + (img_idx * img_len);
+    __global XREG_GRAD_T* cur_grad_x_img = grad_x_imgs + (img_idx * img_len);
+    __global XREG_GRAD_T* cur_grad_y_img = grad_y_imgs + (img_idx * img_len);
 
     for (uint row_idx = get_global_id(0); row_idx < img_nr; row_idx += row_inc)
     {
@@ -141,8 +147,8 @@ __kernel void SobelKernel(__global float* src_imgs,
       __global float* prev_src_row = cur_src_img + prev_row_off;
       __global float* next_src_row = cur_src_img + next_row_off;
 
-      __global float* grad_x_row = cur_grad_x_img + cur_row_off;
-      __global float* grad_y_row = cur_grad_y_img + cur_row_off;
+      __global XREG_GRAD_T* grad_x_row = cur_grad_x_img + cur_row_off;
+      __global XREG_GRAD_T* grad_y_row = cur_grad_y_img + cur_row_off;
 
       for (uint col_idx = get_global_id(1); col_idx < img_nc; col_idx += col_inc)
       {
@@ -150,20 +156,162 @@ __kernel void SobelKernel(__global float* src_imgs,
         const uint next_col = (col_idx < img_nc_minus_1) ? (col_idx + 1) : col_idx;
 
         // x-direction
-        grad_x_row[col_idx] = -prev_src_row[prev_col] + prev_src_row[next_col] +
-                              -(2.0f * cur_src_row[prev_col]) + (2.0f * cur_src_row[next_col]) +
-                              -next_src_row[prev_col] + next_src_row[next_col];
+        XREG_STORE_GRAD(-prev_src_row[prev_col] + prev_src_row[next_col] +
+                        -(2.0f * cur_src_row[prev_col]) + (2.0f * cur_src_row[next_col]) +
+                        -next_src_row[prev_col] + next_src_row[next_col],
+                        col_idx, grad_x_row);
 
         // y-direction
-        grad_y_row[col_idx] = -prev_src_row[prev_col] - (2.0f * prev_src_row[col_idx]) - prev_src_row[next_col]
-                              + next_src_row[prev_col] + (2.0f * next_src_row[col_idx]) + next_src_row[next_col];
+        XREG_STORE_GRAD(-prev_src_row[prev_col] - (2.0f * prev_src_row[col_idx]) - prev_src_row[next_col]
+                        + next_src_row[prev_col] + (2.0f * next_src_row[col_idx]) + next_src_row[next_col],
+                        col_idx, grad_y_row);
       }
     }
   }
 }
 
+// Smooths with a separable Gaussian kernel and computes both Sobel derivatives
+// in a single pass. Each work group computes a square tile of the gradient
+// images; the source tile (with a halo for the smoothing and Sobel) is loaded
+// into local memory once, then smoothed vertically and horizontally in local
+// memory. Borders are clamped, consistent with GaussianKernel and SobelKernel.
+// The global size of the first two dimensions must be a multiple of the tile
+// dimension, with work groups of XREG_GRAD_TILE_DIM x XREG_GRAD_TILE_DIM x 1.
+__kernel void SmoothSobelKernel(__global const float* src_imgs,
+                                __global XREG_GRAD_T* grad_x_imgs,
+                                __global XREG_GRAD_T* grad_y_imgs,
+                                __global const float* smooth_kernel,
+                                const int kernel_half_width,
+                                const uint img_nr,
+                                const uint img_nc,
+                                const uint proj_off,
+                                __local float* src_tile,
+                                __local float* vert_tile,
+                                __local float* smooth_tile)
+{
+  const int tile_dim = XREG_GRAD_TILE_DIM;
+
+  const int local_col = get_local_id(0);
+  const int local_row = get_local_id(1);
+
+  const int local_idx = (local_row * tile_dim) + local_col;
+  const int local_len = tile_dim * tile_dim;
+
+  const uint img_idx = get_global_id(2);
+  const uint img_len = img_nr * img_nc;
+
+  const int max_row = ((int) img_nr) - 1;
+  const int max_col = ((int) img_nc) - 1;
+
+  const int tile_start_row = get_group_id(1) * tile_dim;
+  const int tile_start_col = get_group_id(0) * tile_dim;
+
+  // halo for the smoothing and the Sobel
+  const int halo = kernel_half_width + 1;
+
+  const int src_tile_dim    = tile_dim + (2 * halo);
+  const int smooth_tile_dim = tile_dim + 2;
+
+  const int src_tile_start_row = tile_start_row - halo;
+  const int src_tile_start_col = tile_start_col - halo;
+
+  // this is typically from the ray caster buffer, which can be split up amongst different sim
+  // metrics and thus why we need projection offset.
+  __global const float* cur_src_img = src_imgs + ((proj_off + img_idx) * img_len);
+
+  for (int i = local_idx; i < (src_tile_dim * src_tile_dim); i += local_len)
+  {
+    const int r = clamp(src_tile_start_row + (i / src_tile_dim), 0, max_row);
+    const int c = clamp(src_tile_start_col + (i % src_tile_dim), 0, max_col);
+
+    src_tile[i] = cur_src_img[(r * img_nc) + c];
+  }
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  // vertical smoothing of the rows used by the Sobel; out of bounds rows are
+  // clamped to the smoothed image
+  for (int i = local_idx; i < (smooth_tile_dim * src_tile_dim); i += local_len)
+  {
+    const int vr = i / src_tile_dim;
+    const int vc = i % src_tile_dim;
+
+    const int center_row = clamp(tile_start_row - 1 + vr, 0, max_row) - src_tile_start_row;
+
+    float s = 0;
+
+    for (int k = -kernel_half_width; k <= kernel_half_width; ++k)
+    {
+      s += smooth_kernel[k + kernel_half_width] * src_tile[((center_row + k) * src_tile_dim) + vc];
+    }
+
+    vert_tile[i] = s;
+  }
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  // horizontal smoothing
+  for (int i = local_idx; i < (smooth_tile_dim * smooth_tile_dim); i += local_len)
+  {
+    const int sr = i / smooth_tile_dim;
+    const int sc = i % smooth_tile_dim;
+
+    const int center_col = clamp(tile_start_col - 1 + sc, 0, max_col) - src_tile_start_col;
+
+    __global const float* k_ptr = smooth_kernel;
+
+    __local const float* vert_row = vert_tile + (sr * src_tile_dim) + center_col - kernel_half_width;
+
+    float s = 0;
+
+    for (int k = 0; k <= (2 * kernel_half_width); ++k)
+    {
+      s += k_ptr[k] * vert_row[k];
+    }
+
+    smooth_tile[i] = s;
+  }
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  const int row_idx = tile_start_row + local_row;
+  const int col_idx = tile_start_col + local_col;
+
+  if ((row_idx <= max_row) && (col_idx <= max_col))
+  {
+    __local const float* prev_row = smooth_tile + (local_row * smooth_tile_dim) + local_col;
+    __local const float* cur_row  = prev_row + smooth_tile_dim;
+    __local const float* next_row = cur_row + smooth_tile_dim;
+
+    // this buffer is local to this sim metric and we can just use the beginning section; no need
+    // to worry about projection offset
+    const uint dst_idx = (img_idx * img_len) + (row_idx * img_nc) + col_idx;
+
+    XREG_STORE_GRAD(-prev_row[0] + prev_row[2] +
+                    -(2.0f * cur_row[0]) + (2.0f * cur_row[2]) +
+                    -next_row[0] + next_row[2],
+                    dst_idx, grad_x_imgs);
+
+    XREG_STORE_GRAD(-prev_row[0] - (2.0f * prev_row[1]) - prev_row[2]
+                    + next_row[0] + (2.0f * next_row[1]) + next_row[2],
+                    dst_idx, grad_y_imgs);
+  }
+}
+
 );
 
+// Dimension of the square tiles computed by each work group of the fused
+// smoothing and Sobel kernel
+const std::size_t kGRAD_TILE_DIM = 16;
+
+// Storage of the gradient images written by the Sobel kernels; the gradients
+// are always computed in single precision
+const char* kGRAD_FLOAT_STORE_SRC = "#define XREG_GRAD_T float\n"
+                                    "#define XREG_STORE_GRAD(v,i,p) ((p)[(i)] = (v))\n";
+
+const char* kGRAD_HALF_STORE_SRC = "#define XREG_GRAD_T half\n"
+                                   "#define XREG_STORE_GRAD(v,i,p) vstore_half((v),(i),(p))\n";
+
 }  // un-named
 
 xreg::ImgSimMetric2DGradImgOCL::ImgSimMetric2DGradImgOCL(const boost::compute::device& dev)
@@ -175,6 +323,22 @@ xreg::ImgSimMetric2DGradImgOCL::ImgSimMetric2DGradImgOCL(const boost::compute::c
   : ImgSimMetric2DOCL(ctx, queue)
 { }
 
+std::string xreg::ImgSimMetric2DGradImgOCL::grad_prog_src(const bool half_store)
+{
+  return fmt::format("#define XREG_GRAD_TILE_DIM {}\n", kGRAD_TILE_DIM) +
+         (half_store ? kGRAD_HALF_STORE_SRC : kGRAD_FLOAT_STORE_SRC) + kGRAD_NCC_OPENCL_SRC;
+}
+
+void xreg::ImgSimMetric2DGradImgOCL::prebuild_progs()
+{
+  BuildOpenCLProg(grad_prog_src(false), this->ctx_);
+
+  if (use_half_mov_grads_)
+  {
+    BuildOpenCLProg(grad_prog_src(true), this->ctx_);
+  }
+}
+
 void xreg::ImgSimMetric2DGradImgOCL::allocate_resources()
 {
   namespace bc = boost::compute;
@@ -185,24 +349,118 @@ void xreg::ImgSimMetric2DGradImgOCL::allocate_resources()
   const size_type img_num_rows = itk_size[1];
   const size_type img_num_cols = itk_size[0];
 
-  // compile kernels
+  // compile kernels; the fixed image gradients are always stored in single precision, so a
+  // separate program is needed for the moving images when they are stored as half values
   
-  bc::program prog = bc::program::create_with_source(kGRAD_NCC_OPENCL_SRC, this->ctx_);
+  bc::program prog = BuildOpenCLProg(grad_prog_src(false), this->ctx_);
 
-  try
-  {
-    prog.build();
-  }
-  catch (bc::opencl_error &)
-  {
-    std::cerr << "OpenCL Kernel Compile Error (ImgSimMetric2DGradImgOCL):\n"
-              << prog.build_log() << std::endl;
-    throw;
-  }
+  bc::program mov_prog = use_half_mov_grads_ ? BuildOpenCLProg(grad_prog_src(true), this->ctx_) :
+                                               prog;
 
   const size_type num_pix_per_img = this->num_pix_per_proj();
   const size_type max_buf_size    = num_pix_per_img * this->num_mov_imgs_;
 
+  fixed_grad_x_dev_buf_ = std::make_shared<DevBuf>(this->ctx_);
+  fixed_grad_y_dev_buf_ = std::make_shared<DevBuf>(this->ctx_);
+
+  mov_grad_x_dev_buf_ = std::make_shared<DevBuf>(this->ctx_);
+  mov_grad_y_dev_buf_ = std::make_shared<DevBuf>(this->ctx_);
+
+  fixed_grad_x_dev_buf_->resize(num_pix_per_img, this->queue_);
+  fixed_grad_y_dev_buf_->resize(num_pix_per_img, this->queue_);
+
+  // two half values are packed into each float element
+  const size_type mov_grad_buf_size = use_half_mov_grads_ ? ((max_buf_size + 1) / 2) : max_buf_size;
+
+  mov_grad_x_dev_buf_->resize(mov_grad_buf_size, this->queue_);
+  mov_grad_y_dev_buf_->resize(mov_grad_buf_size, this->queue_);
+
+  // the fused smoothing and Sobel kernel is used when its tiles fit into local memory
+  const int kernel_half_width = static_cast<int>(smooth_img_kernel_rad_) / 2;
+
+  const std::size_t src_tile_dim    = kGRAD_TILE_DIM + (2 * (kernel_half_width + 1));
+  const std::size_t smooth_tile_dim = kGRAD_TILE_DIM + 2;
+
+  const std::size_t local_mem_bytes = ((src_tile_dim * src_tile_dim) +
+                                       (smooth_tile_dim * src_tile_dim) +
+                                       (smooth_tile_dim * smooth_tile_dim)) * sizeof(float);
+
+  use_fused_smooth_sobel_krnl_ = (!smooth_img_kernel_rad_ || (smooth_img_kernel_rad_ & 1)) &&
+                                 (local_mem_bytes <= this->queue_.get_device().local_memory_size());
+
+  if (use_fused_smooth_sobel_krnl_)
+  {
+    // 1D kernel, with the same sigma as the full 2D kernel below and cv::GaussianBlur
+    std::vector<float> tmp_host_kern;
+
+    if (smooth_img_kernel_rad_)
+    {
+      const float sigma = ((((smooth_img_kernel_rad_ - 1) * 0.5f) - 1.0f) * 0.3f) + 0.8f;
+
+      for (int k = -kernel_half_width; k <= kernel_half_width; ++k)
+      {
+        tmp_host_kern.push_back(std::exp(-(k * k) / (2 * sigma * sigma)));
+      }
+
+      const float kern_sum = std::accumulate(tmp_host_kern.begin(), tmp_host_kern.end(), 0.0f);
+    
+      for (auto& w : tmp_host_kern)
+      {
+        w /= kern_sum;
+      }
+    }
+    else
+    {
+      tmp_host_kern.assign(1, 1.0f);
+    }
+    
+    smooth_kernel_dev_buf_.reset(new DevBuf(this->ctx_));
+    smooth_kernel_dev_buf_->assign(tmp_host_kern.begin(), tmp_host_kern.end(), this->queue_);
+
+    auto set_const_smooth_sobel_args = [&] ()
+    {
+      smooth_sobel_krnl_.set_arg(3, *smooth_kernel_dev_buf_);
+      smooth_sobel_krnl_.set_arg(4, bc::int_(kernel_half_width));
+      smooth_sobel_krnl_.set_arg(5, bc::uint_(img_num_rows));
+      smooth_sobel_krnl_.set_arg(6, bc::uint_(img_num_cols));
+      smooth_sobel_krnl_.set_arg(8, bc::local_buffer<float>(src_tile_dim * src_tile_dim));
+      smooth_sobel_krnl_.set_arg(9, bc::local_buffer<float>(smooth_tile_dim * src_tile_dim));
+      smooth_sobel_krnl_.set_arg(10, bc::local_buffer<float>(smooth_tile_dim * smooth_tile_dim));
+    };
+
+    smooth_sobel_krnl_ = prog.create_kernel("SmoothSobelKernel");
+    set_const_smooth_sobel_args();
+
+    // round up to whole tiles
+    smooth_sobel_krnl_global_size_[0] = ((img_num_cols + kGRAD_TILE_DIM - 1) / kGRAD_TILE_DIM) * kGRAD_TILE_DIM;
+    smooth_sobel_krnl_global_size_[1] = ((img_num_rows + kGRAD_TILE_DIM - 1) / kGRAD_TILE_DIM) * kGRAD_TILE_DIM;
+    smooth_sobel_krnl_global_size_[2] = 1;
+
+    // compute fixed image grads
+    smooth_sobel_krnl_.set_arg(0, *this->fixed_img_ocl_buf_);
+    smooth_sobel_krnl_.set_arg(1, *fixed_grad_x_dev_buf_);
+    smooth_sobel_krnl_.set_arg(2, *fixed_grad_y_dev_buf_);
+    smooth_sobel_krnl_.set_arg(7, bc::uint_(0));
+
+    const std::array<std::size_t,3> local_size = { kGRAD_TILE_DIM, kGRAD_TILE_DIM, 1 };
+
+    this->enqueue_kernel(smooth_sobel_krnl_, 3, smooth_sobel_krnl_global_size_.data(),
+                         local_size.data()).wait();
+
+    if (use_half_mov_grads_)
+    {
+      smooth_sobel_krnl_ = mov_prog.create_kernel("SmoothSobelKernel");
+      set_const_smooth_sobel_args();
+    }
+
+    // setup some kernel arguments that will not change
+    smooth_sobel_krnl_.set_arg(0, *this->mov_imgs_buf_);
+    smooth_sobel_krnl_.set_arg(1, *mov_grad_x_dev_buf_);
+    smooth_sobel_krnl_.set_arg(2, *mov_grad_y_dev_buf_);
+
+    return;
+  }
+
   if (smooth_img_kernel_rad_)
   {
     // width must be odd
@@ -265,23 +523,11 @@ void xreg::ImgSimMetric2DGradImgOCL::allocate_resources()
     smooth_ocl_kernel_global_size_[0] = img_num_rows / kSMOOTH_PROJ_DIMS_WORK_UNIT_DIV;
     smooth_ocl_kernel_global_size_[1] = img_num_cols / kSMOOTH_PROJ_DIMS_WORK_UNIT_DIV;
     smooth_ocl_kernel_global_size_[2] = 1 ;
-    this->queue_.enqueue_nd_range_kernel(smooth_krnl_, 3, 0, smooth_ocl_kernel_global_size_.data(), 0).wait();
+    this->enqueue_kernel(smooth_krnl_, 3, smooth_ocl_kernel_global_size_.data(), 0).wait();
   }
 
   sobel_krnl_ = prog.create_kernel("SobelKernel");
 
-  fixed_grad_x_dev_buf_ = std::make_shared<DevBuf>(this->ctx_);
-  fixed_grad_y_dev_buf_ = std::make_shared<DevBuf>(this->ctx_);
-
-  mov_grad_x_dev_buf_ = std::make_shared<DevBuf>(this->ctx_);
-  mov_grad_y_dev_buf_ = std::make_shared<DevBuf>(this->ctx_);
-
-  fixed_grad_x_dev_buf_->resize(num_pix_per_img, this->queue_);
-  fixed_grad_y_dev_buf_->resize(num_pix_per_img, this->queue_);
-
-  mov_grad_x_dev_buf_->resize(max_buf_size, this->queue_);
-  mov_grad_y_dev_buf_->resize(max_buf_size, this->queue_);
-
   // compute fixed image sobel grads
   sobel_krnl_.set_arg(0, smooth_img_kernel_rad_ ? *mov_smooth_dev_buf_ :
                                                   *this->fixed_img_ocl_buf_);
@@ -295,7 +541,14 @@ void xreg::ImgSimMetric2DGradImgOCL::allocate_resources()
   sobel_ocl_kernel_global_size_[0] = img_num_rows / kSOBEL_PROJ_DIMS_WORK_UNIT_DIV;
   sobel_ocl_kernel_global_size_[1] = img_num_cols / kSOBEL_PROJ_DIMS_WORK_UNIT_DIV;
   sobel_ocl_kernel_global_size_[2] = 1 ;
-  this->queue_.enqueue_nd_range_kernel(sobel_krnl_, 3, 0, sobel_ocl_kernel_global_size_.data(), 0).wait();
+  this->enqueue_kernel(sobel_krnl_, 3, sobel_ocl_kernel_global_size_.data(), 0).wait();
+
+  if (use_half_mov_grads_)
+  {
+    sobel_krnl_ = mov_prog.create_kernel("SobelKernel");
+    sobel_krnl_.set_arg(4, bc::uint_(img_num_rows));
+    sobel_krnl_.set_arg(5, bc::uint_(img_num_cols));
+  }
 
   // setup some kernel arguments that will not change
   sobel_krnl_.set_arg(1, *mov_grad_x_dev_buf_);
@@ -322,6 +575,23 @@ void xreg::ImgSimMetric2DGradImgOCL::set_smooth_img_before_sobel_kernel_radius(c
   smooth_img_kernel_rad_ = r;
 }
 
+bool xreg::ImgSimMetric2DGradImgOCL::use_half_mov_grads() const
+{
+  return use_half_mov_grads_;
+}
+
+void xreg::ImgSimMetric2DGradImgOCL::set_use_half_mov_grads(const bool use_half)
+{
+  use_half_mov_grads_ = use_half;
+}
+
+std::string xreg::ImgSimMetric2DGradImgOCL::mov_grad_load_ocl_src() const
+{
+  return use_half_mov_grads_ ?
+            "#define XREG_MOV_GRAD_T half\n#define XREG_LOAD_MOV_GRAD(i,p) vload_half((i),(p))\n" :
+            "#define XREG_MOV_GRAD_T float\n#define XREG_LOAD_MOV_GRAD(i,p) ((p)[(i)])\n";
+}
+
 void xreg::ImgSimMetric2DGradImgOCL::compute_sobel_grads()
 {
   namespace bc = boost::compute;
@@ -329,6 +599,19 @@ void xreg::ImgSimMetric2DGradImgOCL::compute_sobel_grads()
   // this should be called by the compute method of the sub-class
   //this->pre_compute();
   
+  if (use_fused_smooth_sobel_krnl_)
+  {
+    smooth_sobel_krnl_.set_arg(7, bc::uint_(this->proj_off_));
+
+    smooth_sobel_krnl_global_size_[2] = this->num_mov_imgs_;
+
+    const std::array<std::size_t,3> local_size = { kGRAD_TILE_DIM, kGRAD_TILE_DIM, 1 };
+
+    this->enqueue_kernel(smooth_sobel_krnl_, 3, smooth_sobel_krnl_global_size_.data(),
+                         local_size.data()).wait();
+    return;
+  }
+
   sobel_ocl_kernel_global_size_[2]  = this->num_mov_imgs_;
   smooth_ocl_kernel_global_size_[2] = this->num_mov_imgs_;
   
@@ -338,7 +621,8 @@ void xreg::ImgSimMetric2DGradImgOCL::compute_sobel_grads()
     smooth_krnl_.set_arg(4, bc::uint_(this->num_mov_imgs_));
     smooth_krnl_.set_arg(7, bc::uint_(this->proj_off_));
   
-    this->queue_.enqueue_nd_range_kernel(smooth_krnl_, 3, 0, smooth_ocl_kernel_global_size_.data(), 0).wait();
+    this->enqueue_kernel_tuned(smooth_krnl_, "GaussianKernel", 3,
+                               smooth_ocl_kernel_global_size_.data()).wait();
     
     sobel_krnl_.set_arg(6, bc::uint_(0));
   }
@@ -350,6 +634,7 @@ void xreg::ImgSimMetric2DGradImgOCL::compute_sobel_grads()
   // compute the sobel of moving images
   sobel_krnl_.set_arg(3, bc::uint_(this->num_mov_imgs_));
 
-  this->queue_.enqueue_nd_range_kernel(sobel_krnl_, 3, 0, sobel_ocl_kernel_global_size_.data(), 0).wait();
+  this->enqueue_kernel_tuned(sobel_krnl_, "SobelKernel", 3,
+                             sobel_ocl_kernel_global_size_.data()).wait();
 }
 
@@ -47,13 +47,34 @@ public:
   
   void allocate_resources() override;
 
+  void prebuild_progs() override;
+
   size_type smooth_img_before_sobel_kernel_radius() const override;
 
   void set_smooth_img_before_sobel_kernel_radius(const size_type r) override;
 
+  /// \brief Store the moving image gradients in half precision.
+  ///
+  /// The gradients are computed, and consumed by the similarity kernels, in
+  /// single precision, but are stored as packed half values. This halves the
+  /// device memory and bandwidth used by the moving gradient images, at the
+  /// expense of roughly three significant digits of precision. The fixed image
+  /// gradients are always stored in single precision. This must be set before
+  /// calling allocate_resources(). Defaults to false.
+  void set_use_half_mov_grads(const bool use_half);
+
+  bool use_half_mov_grads() const;
+
 protected:
   
   void compute_sobel_grads();
+
+  /// \brief OpenCL source defining XREG_MOV_GRAD_T, the element type of the
+  ///        moving gradient buffers, and XREG_LOAD_MOV_GRAD(idx, ptr), which
+  ///        loads a single precision value from a moving gradient buffer.
+  ///
+  /// This should prefix the source of kernels reading the moving gradients.
+  std::string mov_grad_load_ocl_src() const;
   
   std::shared_ptr<DevBuf> fixed_grad_x_dev_buf_;
   std::shared_ptr<DevBuf> fixed_grad_y_dev_buf_;
@@ -64,10 +85,29 @@ protected:
   boost::compute::kernel sobel_krnl_;
   boost::compute::kernel smooth_krnl_;
 
+  /// \brief Smooths and computes both gradient directions in a single pass,
+  ///        using local memory tiles.
+  boost::compute::kernel smooth_sobel_krnl_;
+
+  /// \brief When true, the moving gradient buffers hold packed half values.
+  bool use_half_mov_grads_ = false;
+
+  /// \brief Indicates the fused kernel is used instead of the separate
+  ///        smoothing and Sobel kernels.
+  ///
+  /// The separate kernels are only used when the tiles of the fused kernel
+  /// do not fit into the local memory of the device.
+  bool use_fused_smooth_sobel_krnl_ = false;
+
 private:
 
+  /// \brief Source of the gradient program, storing gradients as half values
+  ///        or in single precision
+  static std::string grad_prog_src(const bool half_store);
+
   std::array<std::size_t,3> sobel_ocl_kernel_global_size_;
   std::array<std::size_t,3> smooth_ocl_kernel_global_size_;
+  std::array<std::size_t,3> smooth_sobel_krnl_global_size_;
 
   std::unique_ptr<DevBuf> mov_smooth_dev_buf_;
   std::unique_ptr<DevBuf> smooth_kernel_dev_buf_;
@@ -25,6 +25,7 @@
 #include "xregImgSimMetric2DGradNCCCPU.h"
 
 #include "xregITKOpenCVUtils.h"
+#include "xregTBBUtils.h"
 
 void xreg::ImgSimMetric2DGradNCCCPU::allocate_resources()
 {
@@ -50,9 +51,11 @@ void xreg::ImgSimMetric2DGradNCCCPU::allocate_resources()
 
 void xreg::ImgSimMetric2DGradNCCCPU::compute()
 {
+  ParallelExecContextScope exec_scope(this->exec_ctx_.get());
+
   this->pre_compute();
 
-  this->compute_sobel_grads();
+  this->compute_sobel_grads(this->use_edge_band_ ? this->edge_band_rows_.data() : nullptr);
 
   ncc_sim_x_.compute();
   ncc_sim_y_.compute();
@@ -64,6 +67,27 @@ void xreg::ImgSimMetric2DGradNCCCPU::compute()
   }
 }
 
+void xreg::ImgSimMetric2DGradNCCCPU::compute_sim_val_grad_wrt_mov_img(const size_type mov_idx,
+                                                                    GradScalar* dst)
+{
+  const size_type num_pix = this->fixed_grad_img_x_.rows * this->fixed_grad_img_x_.cols;
+
+  PixelBuffer d_grad_x(num_pix);
+  PixelBuffer d_grad_y(num_pix);
+
+  ncc_sim_x_.compute_sim_val_grad_wrt_mov_img(mov_idx, &d_grad_x[0]);
+  ncc_sim_y_.compute_sim_val_grad_wrt_mov_img(mov_idx, &d_grad_y[0]);
+
+  // the similarity value is the average of the two NCC values
+  for (size_type pix_idx = 0; pix_idx < num_pix; ++pix_idx)
+  {
+    d_grad_x[pix_idx] *= 0.5;
+    d_grad_y[pix_idx] *= 0.5;
+  }
+
+  this->backprop_sobel_grads(&d_grad_x[0], &d_grad_y[0], dst);
+}
+
 const xreg::ImgSimMetric2DNCCCPU& xreg::ImgSimMetric2DGradNCCCPU::ncc_sim_x() const
 {
   return ncc_sim_x_;
@@ -74,9 +98,32 @@ const xreg::ImgSimMetric2DNCCCPU& xreg::ImgSimMetric2DGradNCCCPU::ncc_sim_y() co
   return ncc_sim_y_;
 }
 
+bool xreg::ImgSimMetric2DGradNCCCPU::mov_img_pixels_used(PixelIndexList* pix_inds)
+{
+  if (this->use_edge_band_)
+  {
+    *pix_inds = this->edge_band_mov_pix_inds_;
+    return true;
+  }
+
+  return false;
+}
+
 void xreg::ImgSimMetric2DGradNCCCPU::process_mask()
 {
-  ncc_sim_x_.set_mask(this->mask_);
-  ncc_sim_y_.set_mask(this->mask_);
+  if (this->use_edge_band_)
+  {
+    // the band is used as the mask of each NCC computation
+    this->compute_edge_band(this->fixed_grad_img_x_, this->fixed_grad_img_y_,
+                            this->mask_.GetPointer(), this->sobel_grads_support_radius());
+
+    ncc_sim_x_.set_mask(this->edge_band_mask_);
+    ncc_sim_y_.set_mask(this->edge_band_mask_);
+  }
+  else
+  {
+    ncc_sim_x_.set_mask(this->mask_);
+    ncc_sim_y_.set_mask(this->mask_);
+  }
 }
 
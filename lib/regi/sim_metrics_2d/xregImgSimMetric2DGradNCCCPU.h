@@ -25,6 +25,7 @@
 #ifndef XREGIMGSIMMETRIC2DGRADNCCCPU_H_
 #define XREGIMGSIMMETRIC2DGRADNCCCPU_H_
 
+#include "xregImgSimMetric2DGradEdgeBand.h"
 #include "xregImgSimMetric2DGradImgCPU.h"
 #include "xregImgSimMetric2DNCCCPU.h"
 
@@ -35,7 +36,12 @@ namespace xreg
 ///
 /// This computes NCC between the horizontal and vertical derivative (Sobel)
 /// fixed and moving images and returns the average as the similarity value.
-class ImgSimMetric2DGradNCCCPU : public ImgSimMetric2DGradImgCPU
+/// The NCC values may be restricted to a band about the fixed image edges,
+/// see ImgSimMetric2DGradEdgeBand.
+class ImgSimMetric2DGradNCCCPU
+  : public ImgSimMetric2DGradImgCPU,
+    public ImgSimMetric2DMovImgGradInterface,
+    public ImgSimMetric2DGradEdgeBand
 {
 public:
   /// \brief Constructor - trivial, no work performed.
@@ -54,6 +60,17 @@ public:
   ///
   void compute() override;
 
+  /// \brief Computes the derivative of the similarity value with respect to
+  ///        each moving image pixel.
+  ///
+  /// The derivatives of the two NCC values with respect to the gradient
+  /// images are mapped back through the Sobel operators.
+  void compute_sim_val_grad_wrt_mov_img(const size_type mov_idx, GradScalar* dst) override;
+
+  /// \brief When the edge band is used, these are the moving image pixels
+  ///        needed to compute the gradients in the band.
+  bool mov_img_pixels_used(PixelIndexList* pix_inds) override;
+
   const ImgSimMetric2DNCCCPU& ncc_sim_x() const;
 
   const ImgSimMetric2DNCCCPU& ncc_sim_y() const;
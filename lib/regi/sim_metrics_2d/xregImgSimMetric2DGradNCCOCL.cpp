@@ -24,6 +24,8 @@
 
 #include "xregImgSimMetric2DGradNCCOCL.h"
 
+#include <boost/compute/algorithm/copy.hpp>
+
 xreg::ImgSimMetric2DGradNCCOCL::ImgSimMetric2DGradNCCOCL()
   : grad_x_sim_(this->ctx_, this->queue_),
     grad_y_sim_(this->ctx_, this->queue_)
@@ -44,6 +46,17 @@ xreg::ImgSimMetric2DGradNCCOCL::ImgSimMetric2DGradNCCOCL(
     grad_y_sim_(this->ctx_, this->queue_)
 { }
 
+void xreg::ImgSimMetric2DGradNCCOCL::prebuild_progs()
+{
+  ImgSimMetric2DGradImgOCL::prebuild_progs();
+
+  grad_x_sim_.set_mov_imgs_half(this->use_half_mov_grads_);
+  grad_y_sim_.set_mov_imgs_half(this->use_half_mov_grads_);
+
+  // both directions use the same program
+  grad_x_sim_.prebuild_progs();
+}
+
 void xreg::ImgSimMetric2DGradNCCOCL::allocate_resources()
 {
   ImgSimMetric2DGradImgOCL::allocate_resources();
@@ -51,10 +64,17 @@ void xreg::ImgSimMetric2DGradNCCOCL::allocate_resources()
   // masks are set to grad_x_sim_ and grad_y_sim_ via the parent call to allocate resources, which
   // will make the initial call to process_updated_mask() and in turn call process_mask()
 
+  if (this->use_edge_band_)
+  {
+    // the fixed image gradients were not available when the parent processed the mask
+    set_sub_sim_masks();
+  }
+
   grad_x_sim_.set_num_moving_images(this->num_mov_imgs_);
   grad_x_sim_.set_fixed_image(this->fixed_img_);  // still needs to be set for metadata
   grad_x_sim_.set_fixed_image_dev(fixed_grad_x_dev_buf_);
   grad_x_sim_.set_mov_imgs_ocl_buf(mov_grad_x_dev_buf_.get());
+  grad_x_sim_.set_mov_imgs_half(this->use_half_mov_grads_);
   grad_x_sim_.set_setup_vienna_cl_ctx(false);
   grad_x_sim_.set_vienna_cl_ctx_idx(this->vienna_cl_ctx_idx());
   grad_x_sim_.allocate_resources();
@@ -63,6 +83,7 @@ void xreg::ImgSimMetric2DGradNCCOCL::allocate_resources()
   grad_y_sim_.set_fixed_image(this->fixed_img_);  // still needs to be set for metadata
   grad_y_sim_.set_fixed_image_dev(fixed_grad_y_dev_buf_);
   grad_y_sim_.set_mov_imgs_ocl_buf(mov_grad_y_dev_buf_.get());
+  grad_y_sim_.set_mov_imgs_half(this->use_half_mov_grads_);
   grad_y_sim_.set_setup_vienna_cl_ctx(false);
   grad_y_sim_.set_vienna_cl_ctx_idx(this->vienna_cl_ctx_idx());
   grad_y_sim_.allocate_resources();
@@ -73,9 +94,46 @@ void xreg::ImgSimMetric2DGradNCCOCL::allocate_resources()
 void xreg::ImgSimMetric2DGradNCCOCL::process_mask()
 {
   ImgSimMetric2DGradImgOCL::process_mask();
-  
-  grad_x_sim_.set_mask(this->mask_);
-  grad_y_sim_.set_mask(this->mask_);
+
+  set_sub_sim_masks();
+}
+
+void xreg::ImgSimMetric2DGradNCCOCL::set_sub_sim_masks()
+{
+  if (this->use_edge_band_ && fixed_grad_x_dev_buf_)
+  {
+    const auto itk_size = this->fixed_img_->GetLargestPossibleRegion().GetSize();
+
+    cv::Mat fixed_grad_x(itk_size[1], itk_size[0], cv::DataType<Scalar>::type);
+    cv::Mat fixed_grad_y(itk_size[1], itk_size[0], cv::DataType<Scalar>::type);
+
+    boost::compute::copy(fixed_grad_x_dev_buf_->begin(), fixed_grad_x_dev_buf_->end(),
+                         fixed_grad_x.ptr<Scalar>(0), this->queue_);
+    boost::compute::copy(fixed_grad_y_dev_buf_->begin(), fixed_grad_y_dev_buf_->end(),
+                         fixed_grad_y.ptr<Scalar>(0), this->queue_);
+
+    this->compute_edge_band(fixed_grad_x, fixed_grad_y, this->mask_.GetPointer(),
+                            (this->smooth_img_before_sobel_kernel_radius() / 2) + 1);
+
+    grad_x_sim_.set_mask(this->edge_band_mask_);
+    grad_y_sim_.set_mask(this->edge_band_mask_);
+  }
+  else
+  {
+    grad_x_sim_.set_mask(this->mask_);
+    grad_y_sim_.set_mask(this->mask_);
+  }
+}
+
+bool xreg::ImgSimMetric2DGradNCCOCL::mov_img_pixels_used(PixelIndexList* pix_inds)
+{
+  if (this->use_edge_band_)
+  {
+    *pix_inds = this->edge_band_mov_pix_inds_;
+    return true;
+  }
+
+  return false;
 }
 
 void xreg::ImgSimMetric2DGradNCCOCL::compute()
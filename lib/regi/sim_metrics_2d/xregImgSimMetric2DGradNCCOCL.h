@@ -25,13 +25,21 @@
 #ifndef XREGIMGSIMMETRIC2DGRADNCCOCL_H_
 #define XREGIMGSIMMETRIC2DGRADNCCOCL_H_
 
+#include "xregImgSimMetric2DGradEdgeBand.h"
 #include "xregImgSimMetric2DGradImgOCL.h"
 #include "xregImgSimMetric2DNCCOCL.h"
 
 namespace xreg
 {
 
-class ImgSimMetric2DGradNCCOCL : public ImgSimMetric2DGradImgOCL
+/// \brief Normalized Cross Correlation on Gradient Images using OpenCL
+///
+/// The NCC values may be restricted to a band about the fixed image edges,
+/// see ImgSimMetric2DGradEdgeBand; the band is computed on the host from the
+/// fixed image gradients.
+class ImgSimMetric2DGradNCCOCL
+  : public ImgSimMetric2DGradImgOCL,
+    public ImgSimMetric2DGradEdgeBand
 {
 public:
   ImgSimMetric2DGradNCCOCL();
@@ -43,12 +51,22 @@ public:
 
   void allocate_resources() override;
 
+  void prebuild_progs() override;
+
   void compute() override;
 
+  /// \brief When the edge band is used, these are the moving image pixels
+  ///        needed to compute the gradients in the band.
+  bool mov_img_pixels_used(PixelIndexList* pix_inds) override;
+
 protected:
   void process_mask() override;
 
 private:
+  /// \brief Sets the masks of the NCC computations, computing the edge band
+  ///        when it is used and the fixed image gradients are available.
+  void set_sub_sim_masks();
+
   ImgSimMetric2DNCCOCL grad_x_sim_;
   ImgSimMetric2DNCCOCL grad_y_sim_;
 };
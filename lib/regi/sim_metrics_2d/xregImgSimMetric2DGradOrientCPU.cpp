@@ -102,6 +102,8 @@ void xreg::ImgSimMetric2DGradOrientCPU::allocate_resources()
 
 void xreg::ImgSimMetric2DGradOrientCPU::compute()
 {
+  ParallelExecContextScope exec_scope(this->exec_ctx_.get());
+
   this->pre_compute();
 
   this->compute_sobel_grads();
@@ -0,0 +1,360 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregImgSimMetric2DGradOrientOCL.h"
+
+#include <boost/compute/memory/local_buffer.hpp>
+#include <boost/compute/utility/source.hpp>
+
+#include <fmt/format.h>
+
+#include "xregOpenCLProgCache.h"
+#include "xregOpenCVUtils.h"
+
+namespace
+{
+
+// The number of bins of each histogram level is passed with the define
+// XREG_GRAD_ORIENT_NUM_BINS
+
+const char* kGRAD_ORIENT_OPENCL_SRC = BOOST_COMPUTE_STRINGIZE_SOURCE(
+
+// One work-group per moving image. The work-group size must be a power of two.
+__kernel void GradOrientKernel(__global const XREG_MOV_GRAD_T* mov_grad_x_imgs,
+                               __global const XREG_MOV_GRAD_T* mov_grad_y_imgs,
+                               __global const float* fixed_grad_x,
+                               __global const float* fixed_grad_y,
+                               __global const float* fixed_grad_mag,
+                               __global const uchar* use_fixed_mag,
+                               const uint img_len,
+                               const uint use_med,
+                               const float mov_thresh,
+                               const uint min_num,
+                               __global float* sim_vals,
+                               __local float* scratch,
+                               __local uint* count_scratch,
+                               __local uint* hist)
+{
+  const uint img_idx = get_group_id(1);
+  const uint lid     = get_local_id(0);
+  const uint lsize   = get_local_size(0);
+
+  // these buffers are local to this sim metric; no need to worry about projection offset
+  __global const XREG_MOV_GRAD_T* cur_grad_x = mov_grad_x_imgs + (img_idx * img_len);
+  __global const XREG_MOV_GRAD_T* cur_grad_y = mov_grad_y_imgs + (img_idx * img_len);
+
+  float thresh = mov_thresh;
+
+  if (use_med)
+  {
+    // largest magnitude
+    float hi = 0;
+
+    for (uint pix_idx = lid; pix_idx < img_len; pix_idx += lsize)
+    {
+      hi = fmax(hi, hypot(XREG_LOAD_MOV_GRAD(pix_idx, cur_grad_x),
+                          XREG_LOAD_MOV_GRAD(pix_idx, cur_grad_y)));
+    }
+
+    scratch[lid] = hi;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (uint s = lsize / 2; s > 0; s >>= 1)
+    {
+      if (lid < s)
+      {
+        scratch[lid] = fmax(scratch[lid], scratch[lid + s]);
+      }
+      barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    const float coarse_width = scratch[0] / XREG_GRAD_ORIENT_NUM_BINS;
+    const float fine_width   = coarse_width / XREG_GRAD_ORIENT_NUM_BINS;
+
+    // rank of the median
+    uint rank = img_len / 2;
+
+    uint coarse_bin = 0;
+    uint fine_bin   = 0;
+
+    if (coarse_width > 0)
+    {
+      // coarse histogram over all magnitudes, then a fine histogram of the
+      // coarse bin containing the median
+      for (uint level = 0; level < 2; ++level)
+      {
+        for (uint b = lid; b < XREG_GRAD_ORIENT_NUM_BINS; b += lsize)
+        {
+          hist[b] = 0;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for (uint pix_idx = lid; pix_idx < img_len; pix_idx += lsize)
+        {
+          const float m = hypot(XREG_LOAD_MOV_GRAD(pix_idx, cur_grad_x),
+                                XREG_LOAD_MOV_GRAD(pix_idx, cur_grad_y));
+
+          const uint cb = min((uint) (m / coarse_width), (uint) (XREG_GRAD_ORIENT_NUM_BINS - 1));
+
+          if (level == 0)
+          {
+            atomic_inc(hist + cb);
+          }
+          else if (cb == coarse_bin)
+          {
+            const float off = m - (coarse_bin * coarse_width);
+
+            atomic_inc(hist + min((uint) (fmax(off, 0.0f) / fine_width),
+                                  (uint) (XREG_GRAD_ORIENT_NUM_BINS - 1)));
+          }
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        if (lid == 0)
+        {
+          uint cum = 0;
+          uint b   = 0;
+
+          for (; b < (XREG_GRAD_ORIENT_NUM_BINS - 1); ++b)
+          {
+            if ((cum + hist[b]) > rank)
+            {
+              break;
+            }
+
+            cum += hist[b];
+          }
+
+          count_scratch[0] = b;
+          count_scratch[1] = rank - cum;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        if (level == 0)
+        {
+          coarse_bin = count_scratch[0];
+        }
+        else
+        {
+          fine_bin = count_scratch[0];
+        }
+
+        rank = count_scratch[1];
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+      }
+    }
+
+    // center of the fine bin
+    thresh = (coarse_bin * coarse_width) + ((fine_bin + 0.5f) * fine_width);
+  }
+
+  float s = 0;
+  uint num_pix_used = 0;
+
+  for (uint pix_idx = lid; pix_idx < img_len; pix_idx += lsize)
+  {
+    if (use_fixed_mag[pix_idx])
+    {
+      const float gx = XREG_LOAD_MOV_GRAD(pix_idx, cur_grad_x);
+      const float gy = XREG_LOAD_MOV_GRAD(pix_idx, cur_grad_y);
+
+      const float mov_mag = hypot(gx, gy);
+
+      if (mov_mag > thresh)
+      {
+        const float mag_prod = fixed_grad_mag[pix_idx] * mov_mag;
+
+        if (mag_prod > 1.0e-6f)
+        {
+          const float cos_theta = ((fixed_grad_x[pix_idx] * gx) + (fixed_grad_y[pix_idx] * gy)) / mag_prod;
+
+          s += 1.0f - cos_theta;
+
+          ++num_pix_used;
+        }
+      }
+    }
+  }
+
+  scratch[lid]       = s;
+  count_scratch[lid] = num_pix_used;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for (uint r = lsize / 2; r > 0; r >>= 1)
+  {
+    if (lid < r)
+    {
+      scratch[lid]       += scratch[lid + r];
+      count_scratch[lid] += count_scratch[lid + r];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  if (lid == 0)
+  {
+    sim_vals[img_idx] = scratch[0] / max(min_num, count_scratch[0]);
+  }
+}
+
+);
+
+/// \brief Number of bins at each level of the median histograms
+constexpr std::size_t kGRAD_ORIENT_NUM_BINS = 256;
+
+/// \brief Preferred work-group size; reductions require a power of two
+constexpr std::size_t kGRAD_ORIENT_WORK_GROUP_SIZE = 256;
+
+}  // un-named
+
+xreg::ImgSimMetric2DGradOrientOCL::ImgSimMetric2DGradOrientOCL(const boost::compute::device& dev)
+  : ImgSimMetric2DGradImgOCL(dev)
+{ }
+
+xreg::ImgSimMetric2DGradOrientOCL::ImgSimMetric2DGradOrientOCL(const boost::compute::context& ctx,
+                                                               const boost::compute::command_queue& queue)
+  : ImgSimMetric2DGradImgOCL(ctx, queue)
+{ }
+
+bool xreg::ImgSimMetric2DGradOrientOCL::use_median_as_thresh() const
+{
+  return use_median_as_thresh_;
+}
+
+void xreg::ImgSimMetric2DGradOrientOCL::set_use_median_as_thresh(const bool use_med)
+{
+  use_median_as_thresh_ = use_med;
+}
+
+void xreg::ImgSimMetric2DGradOrientOCL::set_fixed_grad_mag_thresh(const Scalar thresh)
+{
+  fixed_grad_mag_thresh_ = thresh;
+}
+
+void xreg::ImgSimMetric2DGradOrientOCL::set_mov_grad_mag_thresh(const Scalar thresh)
+{
+  mov_grad_mag_thresh_ = thresh;
+}
+
+void xreg::ImgSimMetric2DGradOrientOCL::allocate_resources()
+{
+  namespace bc = boost::compute;
+
+  // computes the fixed image gradients on the device
+  ImgSimMetric2DGradImgOCL::allocate_resources();
+
+  const size_type num_pix_per_img = this->num_pix_per_proj();
+
+  const auto itk_size = this->fixed_img_->GetLargestPossibleRegion().GetSize();
+  const int num_rows = static_cast<int>(itk_size[1]);
+  const int num_cols = static_cast<int>(itk_size[0]);
+
+  // the fixed image magnitudes and pixels used are only computed once, so
+  // read the fixed gradients back and compute in the same way as the CPU
+  cv::Mat fixed_grad_x(num_rows, num_cols, cv::DataType<Scalar>::type);
+  cv::Mat fixed_grad_y(num_rows, num_cols, cv::DataType<Scalar>::type);
+
+  bc::copy(this->fixed_grad_x_dev_buf_->begin(), this->fixed_grad_x_dev_buf_->begin() + num_pix_per_img,
+           &fixed_grad_x.at<Scalar>(0,0), this->queue_);
+  bc::copy(this->fixed_grad_y_dev_buf_->begin(), this->fixed_grad_y_dev_buf_->begin() + num_pix_per_img,
+           &fixed_grad_y.at<Scalar>(0,0), this->queue_);
+
+  cv::Mat fixed_grad_mag;
+  cv::magnitude(fixed_grad_x, fixed_grad_y, fixed_grad_mag);
+
+  const Scalar thresh_to_use = use_median_as_thresh_ ?
+                                  static_cast<Scalar>(FindMedian(fixed_grad_mag)) :
+                                  fixed_grad_mag_thresh_;
+
+  std::vector<unsigned char> use_fixed_mag(num_pix_per_img);
+
+  const Scalar* fixed_grad_mag_buf = &fixed_grad_mag.at<Scalar>(0,0);
+
+  for (size_type i = 0; i < num_pix_per_img; ++i)
+  {
+    use_fixed_mag[i] = (fixed_grad_mag_buf[i] > thresh_to_use) ? 1 : 0;
+  }
+
+  fixed_grad_mag_dev_.reset(new DevBuf(this->ctx_));
+  fixed_grad_mag_dev_->assign(fixed_grad_mag_buf, fixed_grad_mag_buf + num_pix_per_img, this->queue_);
+
+  use_fixed_mag_dev_.reset(new UCharDevBuf(this->ctx_));
+  use_fixed_mag_dev_->assign(use_fixed_mag.begin(), use_fixed_mag.end(), this->queue_);
+
+  sim_vals_dev_.reset(new DevBuf(this->num_mov_imgs_, this->ctx_));
+
+  bc::program prog = BuildOpenCLProg(fmt::format("#define XREG_GRAD_ORIENT_NUM_BINS {}\n",
+                                                 kGRAD_ORIENT_NUM_BINS) +
+                                     this->mov_grad_load_ocl_src() + kGRAD_ORIENT_OPENCL_SRC,
+                                     this->ctx_);
+
+  grad_orient_krnl_ = prog.create_kernel("GradOrientKernel");
+
+  grad_orient_wg_size_ = this->pow2_work_group_size(grad_orient_krnl_, kGRAD_ORIENT_WORK_GROUP_SIZE);
+
+  // count_scratch also passes the selected bin and remaining rank
+  const std::size_t count_scratch_len = std::max(grad_orient_wg_size_, std::size_t(2));
+
+  grad_orient_krnl_.set_arg(0, *this->mov_grad_x_dev_buf_);
+  grad_orient_krnl_.set_arg(1, *this->mov_grad_y_dev_buf_);
+  grad_orient_krnl_.set_arg(2, *this->fixed_grad_x_dev_buf_);
+  grad_orient_krnl_.set_arg(3, *this->fixed_grad_y_dev_buf_);
+  grad_orient_krnl_.set_arg(4, *fixed_grad_mag_dev_);
+  grad_orient_krnl_.set_arg(5, *use_fixed_mag_dev_);
+  grad_orient_krnl_.set_arg(6, bc::uint_(num_pix_per_img));
+  grad_orient_krnl_.set_arg(7, bc::uint_(use_median_as_thresh_ ? 1 : 0));
+  grad_orient_krnl_.set_arg(8, static_cast<float>(mov_grad_mag_thresh_));
+  grad_orient_krnl_.set_arg(9, bc::uint_(0.1 * num_pix_per_img));
+  grad_orient_krnl_.set_arg(10, *sim_vals_dev_);
+  grad_orient_krnl_.set_arg(11, bc::local_buffer<float>(grad_orient_wg_size_));
+  grad_orient_krnl_.set_arg(12, bc::local_buffer<bc::uint_>(count_scratch_len));
+  grad_orient_krnl_.set_arg(13, bc::local_buffer<bc::uint_>(kGRAD_ORIENT_NUM_BINS));
+
+  this->sim_vals_.assign(this->num_mov_imgs_, 0);
+}
+
+void xreg::ImgSimMetric2DGradOrientOCL::compute()
+{
+  namespace bc = boost::compute;
+
+  this->pre_compute();
+
+  this->compute_sobel_grads();
+
+  // the thresholds may have changed since allocating resources
+  grad_orient_krnl_.set_arg(7, bc::uint_(use_median_as_thresh_ ? 1 : 0));
+  grad_orient_krnl_.set_arg(8, static_cast<float>(mov_grad_mag_thresh_));
+
+  const std::size_t global_size[2] = { grad_orient_wg_size_, this->num_mov_imgs_ };
+  const std::size_t local_size[2]  = { grad_orient_wg_size_, 1 };
+
+  this->enqueue_kernel(grad_orient_krnl_, 2, global_size, local_size);
+
+  this->read_sim_vals_from_dev(*sim_vals_dev_);
+}
+
+xreg::ImgSimMetric2DGradOrientOCL::DevBuf* xreg::ImgSimMetric2DGradOrientOCL::sim_vals_dev_buf()
+{
+  return sim_vals_dev_.get();
+}
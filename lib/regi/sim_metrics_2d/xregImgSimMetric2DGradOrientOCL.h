@@ -0,0 +1,94 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGIMGSIMMETRIC2DGRADORIENTOCL_H_
+#define XREGIMGSIMMETRIC2DGRADORIENTOCL_H_
+
+#include "xregImgSimMetric2DGradImgOCL.h"
+
+namespace xreg
+{
+
+/// \brief OpenCL implementation of the gradient orientation similarity metric.
+///
+/// \see ImgSimMetric2DGradOrientCPU for a description of the metric.
+/// The moving image gradients, magnitudes, thresholds and sums are computed
+/// on the device, with a work-group computing each moving image, so only the
+/// similarity values are read back. The median moving gradient magnitude is
+/// found with two levels of histograms, so it is accurate to within 1/65536
+/// of the largest magnitude.
+class ImgSimMetric2DGradOrientOCL : public ImgSimMetric2DGradImgOCL
+{
+public:
+  ImgSimMetric2DGradOrientOCL() = default;
+
+  explicit ImgSimMetric2DGradOrientOCL(const boost::compute::device& dev);
+
+  ImgSimMetric2DGradOrientOCL(const boost::compute::context& ctx,
+                              const boost::compute::command_queue& queue);
+
+  bool use_median_as_thresh() const;
+
+  void set_use_median_as_thresh(const bool use_med);
+
+  /// \brief Sets the minimum gradient magnitude threshold in the
+  ///        fixed image.
+  /// Default is 0.1.
+  void set_fixed_grad_mag_thresh(const Scalar thresh);
+
+  /// \brief Sets the minimum gradient magnitude threshold in the
+  ///        moving images.
+  /// Default is 0.1.
+  void set_mov_grad_mag_thresh(const Scalar thresh);
+
+  /// \brief Allocation of other resources required and computation of
+  ///        fixed image gradient magnitudes and the fixed pixels used.
+  void allocate_resources() override;
+
+  void compute() override;
+
+  DevBuf* sim_vals_dev_buf() override;
+
+private:
+  using UCharDevBuf = boost::compute::vector<unsigned char>;
+
+  Scalar fixed_grad_mag_thresh_ = 0.1;
+  Scalar mov_grad_mag_thresh_   = 0.1;
+
+  bool use_median_as_thresh_ = true;
+
+  std::unique_ptr<DevBuf> fixed_grad_mag_dev_;
+
+  std::unique_ptr<UCharDevBuf> use_fixed_mag_dev_;
+
+  std::unique_ptr<DevBuf> sim_vals_dev_;
+
+  boost::compute::kernel grad_orient_krnl_;
+
+  std::size_t grad_orient_wg_size_ = 0;
+};
+
+}  // xreg
+
+#endif
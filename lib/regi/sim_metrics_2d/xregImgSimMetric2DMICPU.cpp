@@ -0,0 +1,276 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregImgSimMetric2DMICPU.h"
+
+#include <cmath>
+#include <limits>
+
+#include "xregTBBUtils.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+using Scalar        = ImgSimMetric2DMICPU::Scalar;
+using BinIndex      = ImgSimMetric2DMICPU::BinIndex;
+using HistCount     = ImgSimMetric2DMICPU::HistCount;
+using HistCountList = ImgSimMetric2DMICPU::HistCountList;
+
+/// \brief Parallel reduction of the intensity range of a moving image over the
+///        pixels used.
+///
+/// When pix_inds is null, the first num_pix pixels are used, otherwise the
+/// num_pix offsets listed in pix_inds are used.
+struct MovMinMaxFn
+{
+  const Scalar* mov;
+  const size_type* pix_inds;
+
+  Scalar min_val = std::numeric_limits<Scalar>::max();
+  Scalar max_val = std::numeric_limits<Scalar>::lowest();
+
+  MovMinMaxFn(const Scalar* m, const size_type* inds)
+    : mov(m), pix_inds(inds)
+  { }
+
+  MovMinMaxFn(MovMinMaxFn& other, xregSplitMarker)
+    : mov(other.mov), pix_inds(other.pix_inds)
+  { }
+
+  void operator()(const RangeType& r)
+  {
+    for (size_type k = r.begin(); k < r.end(); ++k)
+    {
+      const Scalar v = mov[pix_inds ? pix_inds[k] : k];
+
+      min_val = std::min(min_val, v);
+      max_val = std::max(max_val, v);
+    }
+  }
+
+  void join(MovMinMaxFn& rhs)
+  {
+    min_val = std::min(min_val, rhs.min_val);
+    max_val = std::max(max_val, rhs.max_val);
+  }
+};
+
+/// \brief Parallel reduction of the joint histogram of a moving image and the
+///        fixed image bins.
+///
+/// Each thread accumulates a private histogram, which are summed by join().
+/// Moving bins index the rows of the histogram and fixed bins the columns.
+struct JointHistFn
+{
+  const Scalar* mov;
+  const BinIndex* fixed_bins;
+  const size_type* pix_inds;
+
+  size_type num_bins;
+
+  Scalar mov_min;
+  Scalar mov_scale;
+
+  HistCountList hist;
+
+  JointHistFn(const Scalar* m, const BinIndex* f, const size_type* inds,
+              const size_type nb, const Scalar m_min, const Scalar m_scale)
+    : mov(m), fixed_bins(f), pix_inds(inds), num_bins(nb),
+      mov_min(m_min), mov_scale(m_scale), hist(nb * nb, 0)
+  { }
+
+  JointHistFn(JointHistFn& other, xregSplitMarker)
+    : mov(other.mov), fixed_bins(other.fixed_bins), pix_inds(other.pix_inds),
+      num_bins(other.num_bins), mov_min(other.mov_min), mov_scale(other.mov_scale),
+      hist(other.num_bins * other.num_bins, 0)
+  { }
+
+  void operator()(const RangeType& r)
+  {
+    const size_type max_bin = num_bins - 1;
+
+    for (size_type k = r.begin(); k < r.end(); ++k)
+    {
+      const size_type pix_idx = pix_inds ? pix_inds[k] : k;
+
+      const size_type mov_bin = std::min(max_bin,
+                        static_cast<size_type>((mov[pix_idx] - mov_min) * mov_scale));
+
+      ++hist[(mov_bin * num_bins) + fixed_bins[pix_idx]];
+    }
+  }
+
+  void join(JointHistFn& rhs)
+  {
+    const size_type len = hist.size();
+
+    for (size_type i = 0; i < len; ++i)
+    {
+      hist[i] += rhs.hist[i];
+    }
+  }
+};
+
+/// \brief c * log(c), or zero when the count is zero.
+double SumCountLogCount(const double c)
+{
+  return (c > 0) ? (c * std::log(c)) : 0.0;
+}
+
+/// \brief The negated mutual information of a joint histogram.
+///
+/// Uses MI = H(F) + H(M) - H(F,M), with each entropy written in terms of the
+/// counts, e.g. H(X) = log(n) - (sum_x c_x log(c_x)) / n.
+Scalar NegMIFromJointHist(const HistCountList& hist, const size_type num_bins)
+{
+  double n = 0;
+
+  double joint_c_log_c = 0;
+  double mov_c_log_c   = 0;
+  double fixed_c_log_c = 0;
+
+  for (size_type r = 0; r < num_bins; ++r)
+  {
+    double row_sum = 0;
+    double col_sum = 0;
+
+    for (size_type c = 0; c < num_bins; ++c)
+    {
+      const double cur_count = hist[(r * num_bins) + c];
+
+      row_sum += cur_count;
+      col_sum += hist[(c * num_bins) + r];
+
+      joint_c_log_c += SumCountLogCount(cur_count);
+    }
+
+    n += row_sum;
+
+    mov_c_log_c   += SumCountLogCount(row_sum);
+    fixed_c_log_c += SumCountLogCount(col_sum);
+  }
+
+  return (n > 0) ? static_cast<Scalar>(((fixed_c_log_c + mov_c_log_c - joint_c_log_c) / n) - std::log(n))
+                 : Scalar(0);
+}
+
+}  // un-named
+
+void xreg::ImgSimMetric2DMICPU::allocate_resources()
+{
+  ImgSimMetric2DCPU::allocate_resources();
+
+  img_num_pix_ = this->num_pix_per_proj();
+
+  // the fixed image bins depend on the pixels in the mask
+  this->process_updated_mask();
+}
+
+void xreg::ImgSimMetric2DMICPU::compute()
+{
+  ParallelExecContextScope exec_scope(this->exec_ctx_.get());
+
+  this->pre_compute();
+
+  const PixelIndexList* pix_inds_list = this->pix_inds_to_use();
+
+  const size_type* pix_inds = pix_inds_list ? pix_inds_list->data() : nullptr;
+
+  const size_type len = pix_inds_list ? pix_inds_list->size() : img_num_pix_;
+
+  const size_type nb = this->num_bins_;
+
+  // When there are fewer moving images than threads (e.g. a single view
+  // registration evaluating one image at a time), threading over images leaves
+  // most threads idle, so thread over the pixels of each image instead.
+  const bool parallel_over_pix = this->num_mov_imgs_ < static_cast<size_type>(CurParallelMaxConcurrency());
+
+  const RangeType pix_range(0, len);
+
+  auto mi_helper_fn = [&] (const RangeType& r)
+  {
+    for (size_type mov_idx = r.begin(); mov_idx < r.end(); ++mov_idx)
+    {
+      const Scalar* cur_mov = this->mov_imgs_buf_ + (mov_idx * img_num_pix_);
+
+      MovMinMaxFn min_max_fn(cur_mov, pix_inds);
+      
+      if (parallel_over_pix)
+      {
+        ParallelReduce(min_max_fn, pix_range);
+      }
+      else
+      {
+        min_max_fn(pix_range);
+      }
+
+      const Scalar mov_range = min_max_fn.max_val - min_max_fn.min_val;
+
+      // a constant image places every pixel into the first bin
+      const Scalar mov_scale = (mov_range > Scalar(1.0e-6)) ? (nb / mov_range) : Scalar(0);
+
+      JointHistFn hist_fn(cur_mov, fixed_bins_.data(), pix_inds, nb,
+                          min_max_fn.min_val, mov_scale);
+
+      if (parallel_over_pix)
+      {
+        ParallelReduce(hist_fn, pix_range);
+      }
+      else
+      {
+        hist_fn(pix_range);
+      }
+
+      this->sim_vals_[mov_idx] = NegMIFromJointHist(hist_fn.hist, nb);
+    }
+  };
+
+  const RangeType mov_range(0, this->num_mov_imgs_);
+
+  if (parallel_over_pix)
+  {
+    mi_helper_fn(mov_range);
+  }
+  else
+  {
+    ParallelFor(mi_helper_fn, mov_range);
+  }
+}
+
+bool xreg::ImgSimMetric2DMICPU::mov_img_pixels_used(PixelIndexList* pix_inds)
+{
+  return this->subsample_pixels_used(pix_inds);
+}
+
+void xreg::ImgSimMetric2DMICPU::process_mask()
+{
+  ImgSimMetric2DCPU::process_mask();
+
+  // masked out pixels are never visited, since only the pixels in
+  // pix_inds_to_use() are binned
+  fixed_bins_ = this->compute_fixed_img_bins(this->fixed_img_.GetPointer(),
+                                             this->mask_.GetPointer());
+}
@@ -0,0 +1,81 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGIMGSIMMETRIC2DMICPU_H_
+#define XREGIMGSIMMETRIC2DMICPU_H_
+
+#include "xregImgSimMetric2DCPU.h"
+#include "xregImgSimMetric2DMICommon.h"
+
+namespace xreg
+{
+
+/// \brief Mutual Information similarity metric, computed from a joint
+///        histogram of the fixed and moving image intensities.
+///
+/// The similarity value is the negated mutual information (in nats), so that
+/// better alignments have lower values.
+/// This similarity metric does not modify the fixed image or moving images
+/// passed to it.
+class ImgSimMetric2DMICPU
+  : public ImgSimMetric2DCPU, public ImgSimMetric2DMICommon
+{
+public:
+  using Scalar     = ImgSimMetric2DCPU::Scalar;
+  using MaskScalar = ImgSimMetric2DCPU::MaskScalar;
+
+  /// \brief Constructor - trivial, no computation
+  ImgSimMetric2DMICPU() = default;
+
+  /// \brief Computes the histogram bins of the fixed image.
+  void allocate_resources() override;
+
+  /// \brief Perform the similarity metric computations
+  ///
+  /// This will thread/execute concurrently using the computation of a moving
+  /// image's similarity metric as the unit of execution, unless there are
+  /// fewer moving images than cores, in which case the pixels of each image
+  /// are split among threads, each accumulating a private joint histogram
+  /// that is merged by a reduction.
+  void compute() override;
+
+  /// \brief The pixels that are not masked out, or the random subset of them
+  ///        used by the next computation when pixel subsampling is enabled.
+  ///
+  /// Returns false when no mask is set and subsampling is disabled.
+  bool mov_img_pixels_used(PixelIndexList* pix_inds) override;
+
+protected:
+  void process_mask() override;
+
+private:
+  size_type img_num_pix_ = 0;
+
+  /// \brief The histogram bin of each fixed image pixel
+  BinIndexList fixed_bins_;
+};
+
+}  // xreg
+
+#endif
@@ -0,0 +1,89 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregImgSimMetric2DMICommon.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "xregAssert.h"
+
+xreg::size_type xreg::ImgSimMetric2DMICommon::num_bins() const
+{
+  return num_bins_;
+}
+
+void xreg::ImgSimMetric2DMICommon::set_num_bins(const size_type num_bins)
+{
+  // the largest bin index is reserved for masked out pixels
+  xregASSERT((num_bins > 1) && (num_bins < std::numeric_limits<BinIndex>::max()));
+
+  num_bins_ = num_bins;
+}
+
+xreg::ImgSimMetric2DMICommon::BinIndexList
+xreg::ImgSimMetric2DMICommon::compute_fixed_img_bins(const ImgSimMetric2D::Image* fixed_img,
+                                                     const ImgSimMetric2D::ImageMask* mask) const
+{
+  const auto img_size = fixed_img->GetLargestPossibleRegion().GetSize();
+
+  const size_type num_pix = img_size[0] * img_size[1];
+
+  const Scalar* fixed_buf = fixed_img->GetBufferPointer();
+
+  const MaskScalar* mask_buf = mask ? mask->GetBufferPointer() : nullptr;
+
+  // intensity range over the pixels used
+  Scalar min_val = std::numeric_limits<Scalar>::max();
+  Scalar max_val = std::numeric_limits<Scalar>::lowest();
+
+  for (size_type i = 0; i < num_pix; ++i)
+  {
+    if (!mask_buf || mask_buf[i])
+    {
+      min_val = std::min(min_val, fixed_buf[i]);
+      max_val = std::max(max_val, fixed_buf[i]);
+    }
+  }
+
+  const Scalar range = max_val - min_val;
+
+  // a constant image places every pixel into the first bin
+  const Scalar scale = (range > Scalar(1.0e-6)) ? (num_bins_ / range) : Scalar(0);
+
+  const size_type max_bin = num_bins_ - 1;
+
+  BinIndexList bins(num_pix, static_cast<BinIndex>(num_bins_));
+
+  for (size_type i = 0; i < num_pix; ++i)
+  {
+    if (!mask_buf || mask_buf[i])
+    {
+      bins[i] = static_cast<BinIndex>(std::min(max_bin,
+                              static_cast<size_type>((fixed_buf[i] - min_val) * scale)));
+    }
+  }
+
+  return bins;
+}
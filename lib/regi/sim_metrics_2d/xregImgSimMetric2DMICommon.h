@@ -0,0 +1,74 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGIMGSIMMETRIC2DMICOMMON_H_
+#define XREGIMGSIMMETRIC2DMICOMMON_H_
+
+#include <cstdint>
+
+#include "xregImgSimMetric2D.h"
+
+namespace xreg
+{
+
+/// \brief Settings and fixed image processing shared by the CPU and OpenCL
+///        mutual information similarity metrics.
+///
+/// The joint histogram of the fixed and moving intensities uses num_bins()
+/// bins along each dimension. The fixed image bins span the range of the
+/// fixed intensities over the pixels in the mask, and the moving image bins
+/// span the range of each moving image over the same pixels.
+class ImgSimMetric2DMICommon
+{
+public:
+  using Scalar     = ImgSimMetric2D::Scalar;
+  using MaskScalar = ImgSimMetric2D::MaskScalar;
+
+  using BinIndex     = std::uint16_t;
+  using BinIndexList = std::vector<BinIndex>;
+
+  using HistCount     = std::uint32_t;
+  using HistCountList = std::vector<HistCount>;
+
+  size_type num_bins() const;
+
+  /// \brief Sets the number of histogram bins used for each image.
+  ///
+  /// Must be called prior to allocate_resources(). The default is 64.
+  void set_num_bins(const size_type num_bins);
+
+protected:
+  /// \brief Computes the histogram bin of each fixed image pixel.
+  ///
+  /// Pixels that are masked out are assigned the invalid bin num_bins().
+  /// mask may be null, in which case every pixel is used.
+  BinIndexList compute_fixed_img_bins(const ImgSimMetric2D::Image* fixed_img,
+                                      const ImgSimMetric2D::ImageMask* mask) const;
+
+  size_type num_bins_ = 64;
+};
+
+}  // xreg
+
+#endif
@@ -0,0 +1,377 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "xregImgSimMetric2DMIOCL.h"
+
+#include <boost/compute/algorithm/fill.hpp>
+#include <boost/compute/memory/local_buffer.hpp>
+#include <boost/compute/utility/source.hpp>
+
+#include <fmt/format.h>
+
+#include "xregAssert.h"
+#include "xregOpenCLProgCache.h"
+
+namespace
+{
+
+using namespace xreg;
+
+// The number of bins is passed with the define XREG_MI_NUM_BINS and the
+// privatized local memory histograms are enabled with XREG_MI_USE_LOCAL_HIST
+
+const char* kMI_OPENCL_SRC = BOOST_COMPUTE_STRINGIZE_SOURCE(
+
+// One work-group per moving image, computes the range of intensities over
+// the pixels with a valid fixed image bin (e.g. not masked out)
+__kernel void MIMovMinMaxKernel(__global const float* mov_imgs,
+                                __global const ushort* fixed_bins,
+                                const uint img_len,
+                                const uint proj_off,
+                                __global float2* min_max,
+                                __local float2* scratch)
+{
+  const uint img_idx = get_group_id(1);
+  const uint lid     = get_local_id(0);
+  const uint lsize   = get_local_size(0);
+
+  __global const float* cur_mov_img = mov_imgs + ((proj_off + img_idx) * img_len);
+
+  float lo = INFINITY;
+  float hi = -INFINITY;
+
+  for (uint pix_idx = lid; pix_idx < img_len; pix_idx += lsize)
+  {
+    if (fixed_bins[pix_idx] < XREG_MI_NUM_BINS)
+    {
+      const float v = cur_mov_img[pix_idx];
+
+      lo = fmin(lo, v);
+      hi = fmax(hi, v);
+    }
+  }
+
+  scratch[lid] = (float2) (lo, hi);
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for (uint s = lsize / 2; s > 0; s >>= 1)
+  {
+    if (lid < s)
+    {
+      scratch[lid] = (float2) (fmin(scratch[lid].x, scratch[lid + s].x),
+                               fmax(scratch[lid].y, scratch[lid + s].y));
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  if (lid == 0)
+  {
+    min_max[img_idx] = scratch[0];
+  }
+}
+
+// The second global dimension indexes the moving images, several work-groups
+// may process each image. Moving bins index the histogram rows.
+__kernel void MIJointHistKernel(__global const float* mov_imgs,
+                                __global const ushort* fixed_bins,
+                                const uint img_len,
+                                const uint proj_off,
+                                __global const float2* min_max,
+                                __global uint* joint_hists,
+                                __local uint* local_hist)
+{
+  const uint img_idx = get_global_id(1);
+  const uint lid     = get_local_id(0);
+  const uint lsize   = get_local_size(0);
+
+  const uint hist_len = XREG_MI_NUM_BINS * XREG_MI_NUM_BINS;
+
+  __global const float* cur_mov_img = mov_imgs + ((proj_off + img_idx) * img_len);
+
+  __global uint* cur_hist = joint_hists + (img_idx * hist_len);
+
+  const float2 mm = min_max[img_idx];
+
+  const float mov_range = mm.y - mm.x;
+
+  // a constant image places every pixel into the first bin
+  const float mov_scale = (mov_range > 1.0e-6f) ? (XREG_MI_NUM_BINS / mov_range) : 0.0f;
+
+  // XREG_MI_USE_LOCAL_HIST is a compile time constant, so the barriers below
+  // are reached by every work item or none
+  if (XREG_MI_USE_LOCAL_HIST)
+  {
+    for (uint b = lid; b < hist_len; b += lsize)
+    {
+      local_hist[b] = 0;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  for (uint pix_idx = get_global_id(0); pix_idx < img_len; pix_idx += get_global_size(0))
+  {
+    const uint fixed_bin = fixed_bins[pix_idx];
+
+    if (fixed_bin < XREG_MI_NUM_BINS)
+    {
+      const uint mov_bin = min((uint) ((cur_mov_img[pix_idx] - mm.x) * mov_scale),
+                               (uint) (XREG_MI_NUM_BINS - 1));
+
+      if (XREG_MI_USE_LOCAL_HIST)
+      {
+        atomic_inc(local_hist + (mov_bin * XREG_MI_NUM_BINS) + fixed_bin);
+      }
+      else
+      {
+        atomic_inc(cur_hist + (mov_bin * XREG_MI_NUM_BINS) + fixed_bin);
+      }
+    }
+  }
+
+  if (XREG_MI_USE_LOCAL_HIST)
+  {
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (uint b = lid; b < hist_len; b += lsize)
+    {
+      const uint c = local_hist[b];
+
+      if (c)
+      {
+        atomic_add(cur_hist + b, c);
+      }
+    }
+  }
+}
+
+float CountLogCount(const float c)
+{
+  return (c > 0) ? (c * log(c)) : 0.0f;
+}
+
+// One work-group per moving image, computes the negated mutual information
+// from the joint histogram, using MI = H(F) + H(M) - H(F,M) and
+// H(X) = log(n) - (sum_x c_x log(c_x)) / n
+__kernel void MIFromJointHistKernel(__global const uint* joint_hists,
+                                    __global float* sim_vals,
+                                    __local float4* scratch)
+{
+  const uint img_idx = get_group_id(1);
+  const uint lid     = get_local_id(0);
+  const uint lsize   = get_local_size(0);
+
+  __global const uint* cur_hist = joint_hists + (img_idx * XREG_MI_NUM_BINS * XREG_MI_NUM_BINS);
+
+  // (n, sum c log c for joint, moving, fixed)
+  float4 sums = (float4) (0.0f, 0.0f, 0.0f, 0.0f);
+
+  for (uint r = lid; r < XREG_MI_NUM_BINS; r += lsize)
+  {
+    uint row_sum = 0;
+    uint col_sum = 0;
+
+    for (uint c = 0; c < XREG_MI_NUM_BINS; ++c)
+    {
+      const uint cur_count = cur_hist[(r * XREG_MI_NUM_BINS) + c];
+
+      row_sum += cur_count;
+      col_sum += cur_hist[(c * XREG_MI_NUM_BINS) + r];
+
+      sums.y += CountLogCount(cur_count);
+    }
+
+    sums.x += row_sum;
+    sums.z += CountLogCount(row_sum);
+    sums.w += CountLogCount(col_sum);
+  }
+
+  scratch[lid] = sums;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for (uint s = lsize / 2; s > 0; s >>= 1)
+  {
+    if (lid < s)
+    {
+      scratch[lid] += scratch[lid + s];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  if (lid == 0)
+  {
+    const float4 tot = scratch[0];
+
+    sim_vals[img_idx] = (tot.x > 0) ? (((tot.w + tot.z - tot.y) / tot.x) - log(tot.x)) : 0.0f;
+  }
+}
+
+);
+
+/// \brief Preferred work-group size; reductions require a power of two
+constexpr std::size_t kMI_WORK_GROUP_SIZE = 256;
+
+/// \brief Approximate number of pixels processed by each work item of the
+///        histogram kernel, amortizing the merge of the local histograms.
+constexpr std::size_t kMI_PIX_PER_WORK_ITEM = 32;
+
+}  // un-named
+
+xreg::ImgSimMetric2DMIOCL::ImgSimMetric2DMIOCL(const boost::compute::device& dev)
+  : ImgSimMetric2DOCL(dev)
+{ }
+
+xreg::ImgSimMetric2DMIOCL::ImgSimMetric2DMIOCL(const boost::compute::context& ctx,
+                                               const boost::compute::command_queue& queue)
+  : ImgSimMetric2DOCL(ctx, queue)
+{ }
+
+void xreg::ImgSimMetric2DMIOCL::allocate_resources()
+{
+  namespace bc = boost::compute;
+ 
+  const size_type nb       = this->num_bins_;
+  const size_type hist_len = nb * nb;
+
+  const bc::device dev = this->queue_.get_device();
+
+  // privatize the histograms of each work-group when they fit into local
+  // memory, otherwise every pixel is atomically added into global memory
+  const bool use_local_hist = (hist_len * sizeof(bc::uint_)) <= dev.local_memory_size();
+
+  bc::program prog = BuildOpenCLProg(fmt::format("#define XREG_MI_NUM_BINS {}\n"
+                                                 "#define XREG_MI_USE_LOCAL_HIST {}\n",
+                                                 nb, use_local_hist ? 1 : 0) +
+                                     kMI_OPENCL_SRC, this->ctx_);
+
+  min_max_krnl_    = prog.create_kernel("MIMovMinMaxKernel");
+  joint_hist_krnl_ = prog.create_kernel("MIJointHistKernel");
+  mi_krnl_         = prog.create_kernel("MIFromJointHistKernel");
+
+  min_max_wg_size_    = this->pow2_work_group_size(min_max_krnl_, kMI_WORK_GROUP_SIZE);
+  joint_hist_wg_size_ = this->pow2_work_group_size(joint_hist_krnl_, kMI_WORK_GROUP_SIZE);
+  mi_wg_size_         = this->pow2_work_group_size(mi_krnl_, std::min(nb, kMI_WORK_GROUP_SIZE));
+
+  min_max_krnl_.set_arg(5, bc::local_buffer<bc::float2_>(min_max_wg_size_));
+  joint_hist_krnl_.set_arg(6, bc::local_buffer<bc::uint_>(use_local_hist ? hist_len : 1));
+  mi_krnl_.set_arg(2, bc::local_buffer<bc::float4_>(mi_wg_size_));
+
+  // the parent call to allocate resources can trigger a call to process_mask,
+  // so the fixed bins buffer needs to be allocated ahead of time
+  fixed_bins_dev_.reset(new BinIndexDevBuf(this->ctx_));
+
+  mov_min_max_dev_.reset(new MinMaxDevBuf(this->num_mov_imgs_, this->ctx_));
+  
+  joint_hists_dev_.reset(new HistCountDevBuf(this->num_mov_imgs_ * hist_len, this->ctx_));
+  
+  sim_vals_dev_.reset(new DevBuf(this->num_mov_imgs_, this->ctx_));
+
+  ImgSimMetric2DOCL::allocate_resources();
+}
+
+void xreg::ImgSimMetric2DMIOCL::compute()
+{
+  namespace bc = boost::compute;
+  
+  this->pre_compute();
+
+  const size_type num_pix_per_img = this->num_pix_per_proj();
+
+  const size_type hist_len = this->num_bins_ * this->num_bins_;
+
+  // moving image intensity ranges
+  min_max_krnl_.set_arg(0, *this->mov_imgs_buf_);
+  min_max_krnl_.set_arg(1, *fixed_bins_dev_);
+  min_max_krnl_.set_arg(2, bc::uint_(num_pix_per_img));
+  min_max_krnl_.set_arg(3, bc::uint_(this->proj_off_));
+  min_max_krnl_.set_arg(4, *mov_min_max_dev_);
+
+  {
+    const std::size_t global_size[2] = { min_max_wg_size_, this->num_mov_imgs_ };
+    const std::size_t local_size[2]  = { min_max_wg_size_, 1 };
+  
+    this->enqueue_kernel(min_max_krnl_, 2, global_size, local_size);
+  }
+
+  // joint histograms of all moving images
+  bc::fill(joint_hists_dev_->begin(), joint_hists_dev_->begin() + (this->num_mov_imgs_ * hist_len),
+           bc::uint_(0), this->queue_);
+
+  joint_hist_krnl_.set_arg(0, *this->mov_imgs_buf_);
+  joint_hist_krnl_.set_arg(1, *fixed_bins_dev_);
+  joint_hist_krnl_.set_arg(2, bc::uint_(num_pix_per_img));
+  joint_hist_krnl_.set_arg(3, bc::uint_(this->proj_off_));
+  joint_hist_krnl_.set_arg(4, *mov_min_max_dev_);
+  joint_hist_krnl_.set_arg(5, *joint_hists_dev_);
+
+  {
+    // enough work-groups to occupy the device, without so many that merging
+    // the local histograms dominates
+    const size_type num_cus = this->queue_.get_device().compute_units();
+
+    const size_type max_wgs_per_img = std::max(size_type(1),
+                  num_pix_per_img / (joint_hist_wg_size_ * kMI_PIX_PER_WORK_ITEM));
+
+    const size_type wgs_per_img = std::min(max_wgs_per_img,
+                  std::max(size_type(1), (4 * num_cus) / this->num_mov_imgs_));
+
+    const std::size_t global_size[2] = { wgs_per_img * joint_hist_wg_size_, this->num_mov_imgs_ };
+    const std::size_t local_size[2]  = { joint_hist_wg_size_, 1 };
+  
+    this->enqueue_kernel(joint_hist_krnl_, 2, global_size, local_size);
+  }
+
+  // mutual information of each histogram
+  mi_krnl_.set_arg(0, *joint_hists_dev_);
+  mi_krnl_.set_arg(1, *sim_vals_dev_);
+
+  {
+    const std::size_t global_size[2] = { mi_wg_size_, this->num_mov_imgs_ };
+    const std::size_t local_size[2]  = { mi_wg_size_, 1 };
+  
+    this->enqueue_kernel(mi_krnl_, 2, global_size, local_size);
+  }
+
+  this->read_sim_vals_from_dev(*sim_vals_dev_);
+}
+
+xreg::ImgSimMetric2DMIOCL::DevBuf* xreg::ImgSimMetric2DMIOCL::sim_vals_dev_buf()
+{
+  return sim_vals_dev_.get();
+}
+
+bool xreg::ImgSimMetric2DMIOCL::mov_img_pixels_used(PixelIndexList* pix_inds)
+{
+  return this->mask_pixels_used(pix_inds);
+}
+
+void xreg::ImgSimMetric2DMIOCL::process_mask()
+{
+  ImgSimMetric2DOCL::process_mask();
+
+  // masked out pixels are assigned an invalid bin and are skipped by the kernels
+  const BinIndexList fixed_bins = this->compute_fixed_img_bins(this->fixed_img_.GetPointer(),
+                                                               this->mask_.GetPointer());
+
+  fixed_bins_dev_->assign(fixed_bins.begin(), fixed_bins.end(), this->queue_);
+}
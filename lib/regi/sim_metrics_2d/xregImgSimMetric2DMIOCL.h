@@ -0,0 +1,101 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGIMGSIMMETRIC2DMIOCL_H_
+#define XREGIMGSIMMETRIC2DMIOCL_H_
+
+#include <boost/compute/container/vector.hpp>
+
+#include "xregImgSimMetric2DOCL.h"
+#include "xregImgSimMetric2DMICommon.h"
+
+namespace xreg
+{
+
+/// \brief OpenCL version of the Mutual Information similarity metric.
+///
+/// The joint histograms of every moving image are computed in a single
+/// kernel launch, using histograms privatized to each work-group in local
+/// memory (when it is large enough) which are then atomically added into the
+/// histogram of the moving image. The mutual information is computed from the
+/// histograms on the device, so only the similarity values are read back.
+/// The similarity value is the negated mutual information (in nats).
+/// This does not modify the fixed image or moving images buffers, so the
+/// ray caster's buffer may be used directly.
+class ImgSimMetric2DMIOCL
+  : public ImgSimMetric2DOCL, public ImgSimMetric2DMICommon
+{
+public:
+  using Scalar     = ImgSimMetric2DOCL::Scalar;
+  using MaskScalar = ImgSimMetric2DOCL::MaskScalar;
+  
+  /// \brief Default constructor, chooses a default device, creates a new
+  ///        context and command queue.
+  ImgSimMetric2DMIOCL() = default;
+
+  /// \brief Constructor specifying a device to use, but creates a new context
+  ///        and command queue.
+  explicit ImgSimMetric2DMIOCL(const boost::compute::device& dev);
+
+  /// \brief Constructor specifying a specific context and command queue to use
+  ImgSimMetric2DMIOCL(const boost::compute::context& ctx,
+                      const boost::compute::command_queue& queue);
+
+  void allocate_resources() override;
+
+  void compute() override;
+
+  DevBuf* sim_vals_dev_buf() override;
+
+  /// \brief The pixels that are not masked out, or false when no mask is set
+  bool mov_img_pixels_used(PixelIndexList* pix_inds) override;
+
+protected:
+  void process_mask() override;
+
+private:
+  using BinIndexDevBuf  = boost::compute::vector<boost::compute::ushort_>;
+  using HistCountDevBuf = boost::compute::vector<boost::compute::uint_>;
+  using MinMaxDevBuf    = boost::compute::vector<boost::compute::float2_>;
+
+  std::unique_ptr<BinIndexDevBuf> fixed_bins_dev_;
+  
+  std::unique_ptr<MinMaxDevBuf> mov_min_max_dev_;
+
+  std::unique_ptr<HistCountDevBuf> joint_hists_dev_;
+
+  std::unique_ptr<DevBuf> sim_vals_dev_;
+
+  boost::compute::kernel min_max_krnl_;
+  boost::compute::kernel joint_hist_krnl_;
+  boost::compute::kernel mi_krnl_;
+
+  std::size_t min_max_wg_size_ = 0;
+  std::size_t joint_hist_wg_size_ = 0;
+  std::size_t mi_wg_size_ = 0;
+};
+
+}  // xreg
+
+#endif
@@ -0,0 +1,57 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef XREGIMGSIMMETRIC2DMOVIMGGRADINTERFACE_H_
+#define XREGIMGSIMMETRIC2DMOVIMGGRADINTERFACE_H_
+
+#include "xregCommon.h"
+
+namespace xreg
+{
+
+/// \brief Interface for similarity metrics which are able to compute the
+///        derivative of a similarity value with respect to each pixel of the
+///        moving image.
+///
+/// Combined with the derivatives of the moving image pixels with respect to
+/// pose parameters (see RayCasterLineIntGradCPU), this yields the gradient of
+/// the similarity value with respect to the pose parameters.
+class ImgSimMetric2DMovImgGradInterface
+{
+public:
+  using GradScalar = CoordScalar;
+
+  /// \brief Computes the derivative of the similarity value of a moving image
+  ///        with respect to each of its pixels.
+  ///
+  /// This must be called after compute() and uses the same moving image and
+  /// pixels used by compute(). dst must have storage for every pixel of the
+  /// moving image (row-major), pixels not used by the similarity metric (e.g.
+  /// masked out) have derivatives of zero.
+  virtual void compute_sim_val_grad_wrt_mov_img(const size_type mov_idx, GradScalar* dst) = 0;
+};
+
+}  // xreg
+
+#endif
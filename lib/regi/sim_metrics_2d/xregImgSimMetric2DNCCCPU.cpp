@@ -24,6 +24,9 @@
 
 #include "xregImgSimMetric2DNCCCPU.h"
 
+#include <array>
+
+#include "xregAssert.h"
 #include "xregTBBUtils.h"
 
 namespace  // un-named
@@ -31,102 +34,166 @@ namespace  // un-named
 
 using namespace xreg;
 
-template <class tMaskMatDerived>
-size_type ComputeLenFromMask(const Eigen::MatrixBase<tMaskMatDerived>& mask)
+using Scalar = ImgSimMetric2D::Scalar;
+
+/// \brief Running statistics required to compute the NCC of a moving image.
+///
+/// Everything is accumulated in double precision. The variance is not derived
+/// from the sum of squares, which cancels catastrophically when the mean is
+/// large relative to the standard deviation; instead, the mean and the sum of
+/// squared deviations from the mean are computed for each block and merged
+/// (Chan et al.'s pairwise update).
+struct NCCSums
 {
-  const size_type non_mask_len = mask.size();
-  
-  size_type len = 0;
-  
-  for (size_type i = 0; i < non_mask_len; ++i)
+  double num_m  = 0;  ///< number of moving image pixels
+  double mean_m = 0;  ///< mean of moving image pixels
+  double m2_m   = 0;  ///< sum of squared deviations of moving pixels from mean_m
+  double sum_fm = 0;  ///< sum of zero-mean fixed pixels multiplied by moving pixels
+
+  void merge(const double num, const double mean, const double m2)
   {
-    if (mask(i))
-    {
-      ++len;
-    }
+    const double tot_num = num_m + num;
+    const double delta   = mean - mean_m;
+
+    mean_m += delta * (num / tot_num);
+    m2_m   += m2 + ((delta * delta) * ((num_m * num) / tot_num));
+    num_m   = tot_num;
   }
+};
+
+/// \brief Number of pixels of a block, for which the mean and squared
+///        deviations are computed from contiguous (cached) memory before
+///        being merged into the totals.
+constexpr size_type kNCC_BLOCK_LEN = 1024;
 
-  return len; 
+size_type NumNCCBlocks(const size_type num_pix)
+{
+  return (num_pix + kNCC_BLOCK_LEN - 1) / kNCC_BLOCK_LEN;
 }
 
-template <class tMatDerived>
-std::tuple<typename tMatDerived::Scalar, typename tMatDerived::Scalar>
-ComputeImage2DMeanStdDev(const Eigen::MatrixBase<tMatDerived>& pixel_buf)
+/// \brief Accumulates the NCC sums over a range of blocks in a single pass
+///        over the image.
+///
+/// When tGATHER is true, the moving pixels are read at the offsets in
+/// pix_inds, which has num_pix entries, otherwise the first num_pix pixels are
+/// read contiguously and pix_inds is ignored (may be null). The fixed image
+/// should be zero-mean and compact, e.g. have an entry for each used pixel.
+/// When the fixed image is null, the cross-sum is not computed.
+template <bool tGATHER>
+void AccumNCCSums(const Scalar* mov, const Scalar* zero_mean_fixed, const size_type* pix_inds,
+                  const size_type num_pix, const size_type block_begin, const size_type block_end,
+                  NCCSums* sums)
 {
-  using PixelScalar = typename tMatDerived::Scalar;
+  using ConstMappedArr = Eigen::Map<const Eigen::Array<Scalar,Eigen::Dynamic,1>>;
+  using DoubleArr      = Eigen::Array<double,Eigen::Dynamic,1,0,kNCC_BLOCK_LEN,1>;
 
-  const PixelScalar mean = pixel_buf.array().mean();
+  // gathered moving pixels, so the sums below are always computed over
+  // contiguous memory
+  std::array<Scalar,kNCC_BLOCK_LEN> gathered_mov;
 
-  const PixelScalar std_dev = std::max(static_cast<PixelScalar>(1.0e-6),
-                          std::sqrt((pixel_buf.array() - mean).square().sum() / (pixel_buf.size() - 1)));
-  
-  return std::make_tuple(mean,std_dev);
-}
+  for (size_type block_idx = block_begin; block_idx < block_end; ++block_idx)
+  {
+    const size_type off = block_idx * kNCC_BLOCK_LEN;
+    const size_type len = std::min(kNCC_BLOCK_LEN, num_pix - off);
 
-template <class tMatDerived>
-std::tuple<typename tMatDerived::Scalar, typename tMatDerived::Scalar>
-ComputeZeroMeanImageAndStats(Eigen::MatrixBase<tMatDerived>* pixel_buf)
-{
-  const auto mean_and_std = ComputeImage2DMeanStdDev(*pixel_buf);
+    const Scalar* cur_mov = mov + off;
 
-  pixel_buf->array() -= std::get<0>(mean_and_std);
+    if (tGATHER)
+    {
+      const size_type* cur_inds = pix_inds + off;
 
-  return mean_and_std;
-}
+      for (size_type i = 0; i < len; ++i)
+      {
+        gathered_mov[i] = mov[cur_inds[i]];
+      }
 
-template <class tMatDerived, class tMaskMatDerived>
-std::tuple<typename tMatDerived::Scalar, typename tMatDerived::Scalar>
-ComputeImage2DMeanStdDevWithMask(const Eigen::MatrixBase<tMatDerived>& pixel_buf,
-                                 const Eigen::MatrixBase<tMaskMatDerived>& mask,
-                                 const size_type len)
-{
-  using PixelScalar = typename tMatDerived::Scalar;
+      cur_mov = gathered_mov.data();
+    }
 
-  const size_type non_mask_len = pixel_buf.size();
+    const DoubleArr m = ConstMappedArr(cur_mov, len).cast<double>();
 
-  PixelScalar mean = 0;
-  
-  for (size_type i = 0; i < non_mask_len; ++i)
-  {
-    if (mask(i))
+    const double block_mean = m.mean();
+
+    sums->merge(static_cast<double>(len), block_mean, (m - block_mean).square().sum());
+
+    if (zero_mean_fixed)
     {
-      mean += pixel_buf(i);
+      sums->sum_fm += (ConstMappedArr(zero_mean_fixed + off, len).cast<double>() * m).sum();
     }
   }
+}
+
+/// \brief Parallel reduction of the NCC sums over the blocks of a single image.
+struct NCCSumsAccFn
+{
+  const Scalar* mov;
+  const Scalar* zero_mean_fixed;
+  const size_type* pix_inds;
+
+  size_type num_pix;
 
-  mean /= len;
+  NCCSums sums;
 
-  PixelScalar std_dev = 0;
-  PixelScalar tmp = 0;
+  NCCSumsAccFn(const Scalar* m, const Scalar* f, const size_type* inds, const size_type n)
+    : mov(m), zero_mean_fixed(f), pix_inds(inds), num_pix(n)
+  { }
 
-  for (size_type i = 0; i < non_mask_len; ++i)
+  NCCSumsAccFn(NCCSumsAccFn& other, xregSplitMarker)
+    : mov(other.mov), zero_mean_fixed(other.zero_mean_fixed),
+      pix_inds(other.pix_inds), num_pix(other.num_pix)
+  { }
+
+  void operator()(const RangeType& r)
   {
-    if (mask(i))
+    if (pix_inds)
+    {
+      AccumNCCSums<true>(mov, zero_mean_fixed, pix_inds, num_pix, r.begin(), r.end(), &sums);
+    }
+    else
     {
-      tmp = pixel_buf(i) - mean;
+      AccumNCCSums<false>(mov, zero_mean_fixed, pix_inds, num_pix, r.begin(), r.end(), &sums);
+    }
+  }
 
-      std_dev += tmp * tmp;
+  void join(NCCSumsAccFn& rhs)
+  {
+    if (rhs.sums.num_m > 0)
+    {
+      sums.merge(rhs.sums.num_m, rhs.sums.mean_m, rhs.sums.m2_m);
     }
+
+    sums.sum_fm += rhs.sums.sum_fm;
   }
+};
 
-  std_dev = std::max(static_cast<PixelScalar>(1.0e-6), std::sqrt(std_dev / (len - 1)));
+/// \brief Computes the NCC sums of an image.
+///
+/// When pix_inds is non-null, only the num_pix pixels it lists are used.
+NCCSums ComputeNCCSums(const Scalar* mov, const Scalar* zero_mean_fixed, const size_type* pix_inds,
+                       const size_type num_pix, const bool parallel)
+{
+  NCCSumsAccFn acc_fn(mov, zero_mean_fixed, pix_inds, num_pix);
+  
+  const RangeType blocks(0, NumNCCBlocks(num_pix));
 
-  return std::make_tuple(mean,std_dev);
+  if (parallel)
+  {
+    ParallelReduce(acc_fn, blocks);
+  }
+  else
+  {
+    acc_fn(blocks);
+  }
+
+  return acc_fn.sums;
 }
 
-template <class tMatDerived, class tMaskMatDerived>
-std::tuple<typename tMatDerived::Scalar, typename tMatDerived::Scalar>
-ComputeZeroMeanImageAndStatsWithMask(Eigen::MatrixBase<tMatDerived>* pixel_buf,
-                                     const Eigen::MatrixBase<tMaskMatDerived>& mask,
-                                     const size_type len)
+std::tuple<Scalar,Scalar> MeanStdDevFromSums(const NCCSums& sums, const size_type len)
 {
-  const auto mean_and_std = ComputeImage2DMeanStdDevWithMask(*pixel_buf, mask, len);
+  const double var = sums.m2_m / (len - 1);
 
-  // we don't care about subtracting from masked pixels... the optimizations
-  // in eigen probably out-weight putting in extra branches?
-  pixel_buf->array() -= std::get<0>(mean_and_std);
-  
-  return mean_and_std;
+  return std::make_tuple(static_cast<Scalar>(sums.mean_m),
+                         std::max(static_cast<Scalar>(1.0e-6), static_cast<Scalar>(std::sqrt(var))));
 }
 
 }  // un-named
@@ -144,18 +211,6 @@ void xreg::ImgSimMetric2DNCCCPU::allocate_resources()
   // allocate the zero-mean fixed image buffer
   zero_mean_fixed_vec_.resize(img_num_pix_);
 
-  // for now, I am going to over-write the input moving image buffers with
-  // zero-mean versions
-#if 0
-  // allocate the zero-mean moving image buffers
-  zero_mean_mov_vecs_.resize(this->num_mov_imgs_);
-
-  for (size_type mov_idx = 0; mov_idx < this->num_mov_imgs_; ++mov_idx)
-  {
-    zero_mean_mov_vecs_[mov_idx].resize(img_num_pix_);
-  }
-#endif
-
   // mask processing also includes transforming the fixed image into a zero mean
   // vector
   this->process_updated_mask();
@@ -163,40 +218,46 @@ void xreg::ImgSimMetric2DNCCCPU::allocate_resources()
 
 void xreg::ImgSimMetric2DNCCCPU::compute()
 {
+  ParallelExecContextScope exec_scope(this->exec_ctx_.get());
+
   this->pre_compute();
-  
+
+  // masked pixels are never visited, only the compact list of used pixels
+  const PixelIndexList* pix_inds_list = this->pix_inds_to_use();
+
+  last_pix_inds_ = pix_inds_list;
+
+  if (this->use_pixel_subsample())
+  {
+    // the fixed image statistics are computed over the new random subset
+    update_fixed_for_pix_inds(pix_inds_list);
+  }
+
+  const size_type* pix_inds = pix_inds_list ? pix_inds_list->data() : nullptr;
+
+  const size_type len = zero_mean_fixed_vec_.size();
+
+  // When there are fewer moving images than threads (e.g. a single view
+  // registration evaluating one image at a time), threading over images leaves
+  // most threads idle, so thread over the pixels of each image instead.
+  const bool parallel_over_pix = this->num_mov_imgs_ < static_cast<size_type>(CurParallelMaxConcurrency());
+
   auto ncc_helper_fn = [&] (const RangeType& r)
   {
     Scalar mov_mean   = 0;
     Scalar mov_stddev = 0;
-    Scalar sim_val    = 0;
 
     for (size_type range_idx = r.begin(); range_idx < r.end(); ++range_idx)
     {
-      Eigen::Map<ImageVec> cur_mov_vec(this->mov_imgs_buf_ + (range_idx * img_num_pix_), img_num_pix_);
+      const NCCSums sums = ComputeNCCSums(this->mov_imgs_buf_ + (range_idx * img_num_pix_),
+                                          zero_mean_fixed_vec_.data(), pix_inds,
+                                          len, parallel_over_pix);
 
-      if (!this->mask_)
-      {
-        std::tie(mov_mean,mov_stddev) = ComputeZeroMeanImageAndStats(&cur_mov_vec);
-        
-        sim_val = zero_mean_fixed_vec_.dot(cur_mov_vec) / (img_num_pix_ * fixed_img_stddev_ * mov_stddev);
-      }
-      else
-      {
-        std::tie(mov_mean,mov_stddev) = ComputeZeroMeanImageAndStatsWithMask(&cur_mov_vec,
-                                                                             mask_vec_, mask_len_);
-    
-        sim_val = 0;
-        for (size_type i = 0; i < img_num_pix_; ++i)
-        {
-          if (mask_vec_(i))
-          {
-            sim_val += zero_mean_fixed_vec_(i) * cur_mov_vec(i);
-          }
-        }
-
-        sim_val /= mask_len_ * fixed_img_stddev_ * mov_stddev;
-      }
+      std::tie(mov_mean,mov_stddev) = MeanStdDevFromSums(sums, len);
+
+      // the fixed image is zero-mean over the used pixels, so the moving
+      // mean does not need to be subtracted for the cross-sum
+      const Scalar sim_val = static_cast<Scalar>(sums.sum_fm / (len * fixed_img_stddev_ * mov_stddev));
 
       // remap the NCC score from [-1,1] for our purposes of minimization
       //   * Since we are minimizing, the NCC score is negated (good correlations have larger NCC values)
@@ -205,33 +266,105 @@ void xreg::ImgSimMetric2DNCCCPU::compute()
     }
   };
 
-  ParallelFor(ncc_helper_fn, RangeType(0, this->num_mov_imgs_));
+  const RangeType mov_range(0, this->num_mov_imgs_);
+
+  if (parallel_over_pix)
+  {
+    ncc_helper_fn(mov_range);
+  }
+  else
+  {
+    ParallelFor(ncc_helper_fn, mov_range);
+  }
 }
 
 void xreg::ImgSimMetric2DNCCCPU::process_mask()
 {
   ImgSimMetric2DCPU::process_mask();
 
-  // copy the fixed image
-  zero_mean_fixed_vec_ = Eigen::Map<ImageVec>(this->fixed_img_->GetBufferPointer(),
-                                              img_num_pix_);
-  
-  if (!this->mask_)
+  update_fixed_for_pix_inds(this->mask_ ? &this->mask_pix_inds() : nullptr);
+}
+
+void xreg::ImgSimMetric2DNCCCPU::update_fixed_for_pix_inds(const PixelIndexList* pix_inds)
+{
+  const Scalar* fixed_buf = this->fixed_img_->GetBufferPointer();
+
+  if (!pix_inds)
   {
-    // compute mean, stddev, and zero-mean fixed image
-    std::tie(fixed_img_mean_,fixed_img_stddev_) = ComputeZeroMeanImageAndStats(&zero_mean_fixed_vec_);
-    
-    mask_len_ = 0;
+    // copy the fixed image
+    zero_mean_fixed_vec_ = Eigen::Map<const ImageVec>(fixed_buf, img_num_pix_);
   }
   else
   {
-    mask_vec_ = MappedImageMaskVec(this->mask_->GetBufferPointer(), img_num_pix_);
+    const size_type num_used = pix_inds->size();
 
-    mask_len_ = ComputeLenFromMask(mask_vec_);
+    // gather the fixed pixels used into a compact vector
+    zero_mean_fixed_vec_.resize(num_used);
 
-    // compute mean, stddev, and zero-mean fixed image using MASK
-    std::tie(fixed_img_mean_,fixed_img_stddev_) = ComputeZeroMeanImageAndStatsWithMask(&zero_mean_fixed_vec_,
-                                                                                       mask_vec_, mask_len_);
+    for (size_type i = 0; i < num_used; ++i)
+    {
+      zero_mean_fixed_vec_(i) = fixed_buf[(*pix_inds)[i]];
+    }
   }
+
+  const size_type len = zero_mean_fixed_vec_.size();
+
+  // compute mean, stddev, and zero-mean fixed image
+  std::tie(fixed_img_mean_,fixed_img_stddev_) = MeanStdDevFromSums(
+            ComputeNCCSums(zero_mean_fixed_vec_.data(), nullptr, nullptr, len, true), len);
+    
+  zero_mean_fixed_vec_.array() -= fixed_img_mean_;
+}
+
+bool xreg::ImgSimMetric2DNCCCPU::mov_img_pixels_used(PixelIndexList* pix_inds)
+{
+  return this->subsample_pixels_used(pix_inds);
 }
 
+void xreg::ImgSimMetric2DNCCCPU::compute_sim_val_grad_wrt_mov_img(const size_type mov_idx,
+                                                                GradScalar* dst)
+{
+  xregASSERT(mov_idx < this->num_mov_imgs_);
+
+  const Scalar* mov = this->mov_imgs_buf_ + (mov_idx * img_num_pix_);
+
+  const size_type* pix_inds = last_pix_inds_ ? last_pix_inds_->data() : nullptr;
+
+  const size_type len = zero_mean_fixed_vec_.size();
+
+  const NCCSums sums = ComputeNCCSums(mov, zero_mean_fixed_vec_.data(), pix_inds, len, true);
+
+  Scalar mov_mean   = 0;
+  Scalar mov_stddev = 0;
+
+  std::tie(mov_mean,mov_stddev) = MeanStdDevFromSums(sums, len);
+
+  const double ncc_denom = len * fixed_img_stddev_ * mov_stddev;
+
+  const double ncc = sums.sum_fm / ncc_denom;
+
+  // coefficients of the zero-mean fixed and moving pixels
+  const GradScalar fixed_coeff = static_cast<GradScalar>(-0.5 / ncc_denom);
+  const GradScalar mov_coeff   = static_cast<GradScalar>((0.5 * ncc) /
+                                                         ((len - 1) * mov_stddev * mov_stddev));
+
+  if (pix_inds)
+  {
+    std::fill(dst, dst + img_num_pix_, GradScalar(0));
+
+    for (size_type i = 0; i < len; ++i)
+    {
+      const size_type pix_idx = pix_inds[i];
+
+      dst[pix_idx] = (fixed_coeff * zero_mean_fixed_vec_(i)) + (mov_coeff * (mov[pix_idx] - mov_mean));
+    }
+  }
+  else
+  {
+    for (size_type pix_idx = 0; pix_idx < len; ++pix_idx)
+    {
+      dst[pix_idx] = (fixed_coeff * zero_mean_fixed_vec_(pix_idx)) +
+                                                  (mov_coeff * (mov[pix_idx] - mov_mean));
+    }
+  }
+}
@@ -26,17 +26,20 @@
 #define XREGIMGSIMMETRIC2DNCCCPU_H_
 
 #include "xregImgSimMetric2DCPU.h"
+#include "xregImgSimMetric2DMovImgGradInterface.h"
 
 namespace xreg
 {
 
 /// \brief Normalized Cross Correlation similarity metric
 ///
-/// This similarity metric does not modify the fixed image passed to it.
-/// THE CONTENTS OF THE MOVING IMAGES BUFFER WILL BE MODIFIED ON CALLS TO compute().
-/// This buffer must store all data in a contiguous, row-major, format.
+/// This similarity metric does not modify the fixed image or moving images
+/// passed to it.
+/// The moving images buffer must store all data in a contiguous, row-major, format.
 /// For example, images first, then rows, then columns.
-class ImgSimMetric2DNCCCPU : public ImgSimMetric2DCPU
+class ImgSimMetric2DNCCCPU
+  : public ImgSimMetric2DCPU,
+    public ImgSimMetric2DMovImgGradInterface
 {
 public:
   /// \brief Constructor - trivial, no computation
@@ -50,32 +53,53 @@ public:
 
   /// \brief Perform the similarity metric computations
   ///
-  /// This will thread/execute concurrently using the computation of a moving
-  /// image's similarity metric as the unit of execution.
+  /// The sums required by each moving image are accumulated in a single pass
+  /// over its pixels. This will thread/execute concurrently using the
+  /// computation of a moving image's similarity metric as the unit of
+  /// execution, unless there are fewer moving images than cores, in which case
+  /// the pixels of each image are split among threads.
   void compute() override;
 
+  /// \brief The pixels that are not masked out, or the random subset of them
+  ///        used by the next computation when pixel subsampling is enabled.
+  ///
+  /// Returns false when no mask is set and subsampling is disabled.
+  bool mov_img_pixels_used(PixelIndexList* pix_inds) override;
+
+  /// \brief Computes the derivative of the (remapped) NCC similarity value
+  ///        with respect to each moving image pixel.
+  ///
+  /// With NCC = sum_i zf_i m_i / (N sf sm), where zf is the zero-mean fixed
+  /// image and sf, sm are the standard deviations, this is:
+  ///   -0.5 * ((zf_i / (N sf sm)) - (NCC (m_i - mean m) / ((N - 1) sm^2)))
+  void compute_sim_val_grad_wrt_mov_img(const size_type mov_idx, GradScalar* dst) override;
+
 protected:
   void process_mask() override;
 
 private:
-  using ImageVec           = Eigen::Matrix<Scalar,1,Eigen::Dynamic>;
-  using ImageMaskVec       = Eigen::Matrix<MaskScalar,1,Eigen::Dynamic>;
-  using MappedImageMaskVec = Eigen::Map<ImageMaskVec>;
+  /// \brief Gathers the fixed image pixels used (all pixels when null) and
+  ///        computes the fixed image statistics over them.
+  void update_fixed_for_pix_inds(const PixelIndexList* pix_inds);
+
+  using ImageVec = Eigen::Matrix<Scalar,1,Eigen::Dynamic>;
 
   size_type img_num_rows_ = 0;
   size_type img_num_cols_ = 0;
   size_type img_num_pix_  = 0;
 
+  /// \brief The fixed image with its mean subtracted.
+  ///
+  /// When a mask is set, or pixels are subsampled, this only stores the
+  /// pixels that are used, in the order of pix_inds_to_use().
   ImageVec zero_mean_fixed_vec_;
 
-  //ImageVecList zero_mean_mov_vecs_;
-
   Scalar fixed_img_mean_   = 0;
   Scalar fixed_img_stddev_ = 0;
 
-  ImageMaskVec mask_vec_;
-
-  size_type mask_len_ = 0;
+  /// \brief The pixels used by the most recent call to compute(), null when
+  ///        every pixel was used.
+  const PixelIndexList* last_pix_inds_ = nullptr;
 };
 
 }  // xreg
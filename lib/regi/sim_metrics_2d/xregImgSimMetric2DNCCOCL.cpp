@@ -24,6 +24,7 @@
 
 #include "xregImgSimMetric2DNCCOCL.h"
 
+#include <boost/compute/memory/local_buffer.hpp>
 #include <boost/compute/utility/source.hpp>
 
 // ITK pollutes the global namespace with a macro, and causes
@@ -40,12 +41,16 @@
 #include <viennacl/linalg/prod.hpp>
 
 #include "xregOpenCLMiscKernels.h"
+#include "xregOpenCLProgCache.h"
 
 namespace
 {
 
 const std::size_t kWORK_GROUP_DIV_FACTOR = 1;
 
+/// \brief Preferred work-group size of the NCC kernel; the reductions require a power of two
+constexpr std::size_t kNCC_WORK_GROUP_SIZE = 256;
+
 const char* kNCC_OPENCL_SRC = BOOST_COMPUTE_STRINGIZE_SOURCE(
 
 __kernel void SubMeanAndSquareKernel(__global float* sub_from_mean_imgs,
@@ -80,27 +85,54 @@ __kernel void SubMeanAndSquareKernel(__global float* sub_from_mean_imgs,
   }
 }
 
-__kernel void NCCElemsKernel(__global float* sub_from_mean_mov_imgs,
-                             __global const float* mov_std_devs,
-                             __global const float* fixed_minus_mean_over_std_dev,
-                             const uint num_imgs,
-                             const uint img_len,
-                             const uint proj_off)
+// One work-group per moving image, e.g. global size of (work-group size, number of moving images).
+// The fixed image has already been normalized to zero mean and unit std. dev. The weights are
+// one over n and one over n - 1, where n is the number of pixels used, and are zero for masked
+// out pixels.
+__kernel void NCCKernel(__global const XREG_MOV_IMG_T* mov_imgs,
+                        __global const float* fixed_minus_mean_over_std_dev,
+                        __global const float* one_over_n,
+                        __global const float* one_over_n_minus_1,
+                        const uint img_len,
+                        const uint proj_off,
+                        __global float* nccs,
+                        __local float* scratch)
 {
-  const uint global_inc = get_global_size(0);
-  const uint img_idx    = get_global_id(1);
+  const uint img_idx = get_group_id(1);
+  const uint lsize   = get_local_size(0);
 
-  if (img_idx < num_imgs)
+  // this is typically from the ray caster buffer, which can be split up amongst different sim
+  // metrics and thus why we need projection offset.
+  __global const XREG_MOV_IMG_T* cur_mov_img = mov_imgs + ((proj_off + img_idx) * img_len);
+
+  float mean = 0;
+
+  for (uint pixel_idx = get_local_id(0); pixel_idx < img_len; pixel_idx += lsize)
   {
-    __global float* cur_sub_from_mean_mov_img = sub_from_mean_mov_imgs + ((proj_off + img_idx) * img_len);
+    mean += XREG_LOAD_MOV_IMG(pixel_idx, cur_mov_img) * one_over_n[pixel_idx];
+  }
 
-    const float cur_mov_std_dev = max(1.0e-6f, sqrt(mov_std_devs[img_idx]));
+  mean = WorkGroupSum(mean, scratch);
 
-    for (uint pixel_idx = get_global_id(0); pixel_idx < img_len;
-         pixel_idx += global_inc)
-    {
-      cur_sub_from_mean_mov_img[pixel_idx] *= fixed_minus_mean_over_std_dev[pixel_idx] / cur_mov_std_dev;
-    }
+  // second pass over the image for the std. dev. and correlation, which avoids the
+  // cancellation of computing the variance from sums of squares
+  float var = 0;
+  float corr = 0;
+
+  for (uint pixel_idx = get_local_id(0); pixel_idx < img_len; pixel_idx += lsize)
+  {
+    const float pix_minus_mean = XREG_LOAD_MOV_IMG(pixel_idx, cur_mov_img) - mean;
+
+    var  += pix_minus_mean * pix_minus_mean * one_over_n_minus_1[pixel_idx];
+    corr += pix_minus_mean * fixed_minus_mean_over_std_dev[pixel_idx] * one_over_n[pixel_idx];
+  }
+
+  var  = WorkGroupSum(var, scratch);
+  corr = WorkGroupSum(corr, scratch);
+
+  if (get_local_id(0) == 0)
+  {
+    nccs[img_idx] = 0.5f * (1.0f - (corr / max(1.0e-6f, sqrt(var))));
   }
 }
 
@@ -117,6 +149,24 @@ xreg::ImgSimMetric2DNCCOCL::ImgSimMetric2DNCCOCL(const boost::compute::context&
   : ImgSimMetric2DOCL(ctx, queue)
 { }
 
+std::string xreg::ImgSimMetric2DNCCOCL::prog_src() const
+{
+  std::stringstream ss;
+  ss << (mov_imgs_half_ ?
+          "#define XREG_MOV_IMG_T half\n#define XREG_LOAD_MOV_IMG(i,p) vload_half((i),(p))\n" :
+          "#define XREG_MOV_IMG_T float\n#define XREG_LOAD_MOV_IMG(i,p) ((p)[(i)])\n")
+     << DivideBufElemsOutOfPlaceKernelSrc
+     << WorkGroupSumFnSrc
+     << kNCC_OPENCL_SRC;
+
+  return ss.str();
+}
+
+void xreg::ImgSimMetric2DNCCOCL::prebuild_progs()
+{
+  BuildOpenCLProg(prog_src(), this->ctx_);
+}
+
 void xreg::ImgSimMetric2DNCCOCL::allocate_resources()
 {
   namespace bc = boost::compute;
@@ -125,35 +175,19 @@ void xreg::ImgSimMetric2DNCCOCL::allocate_resources()
   // so we need to make sure we have these buffers allocated ahead of time
   
   // compile, and create custom kernels 
-  std::stringstream ss;
-  ss << DivideBufElemsOutOfPlaceKernelSrc
-     << kNCC_OPENCL_SRC;
-  
-  bc::program prog = bc::program::create_with_source(ss.str(), this->ctx_);
-  
-  try
-  {
-    prog.build();
-  }
-  catch (bc::opencl_error &)
-  {
-    std::cerr << "OpenCL Kernel Compile Error (ImgSimMetric2DNCCOCL):\n"
-              << prog.build_log() << std::endl;
-    throw;
-  }
+  bc::program prog = BuildOpenCLProg(prog_src(), this->ctx_);
 
   div_elems_krnl_   = prog.create_kernel("DivideBufElemsOutOfPlace");
   sub_mean_sq_krnl_ = prog.create_kernel("SubMeanAndSquareKernel");
-  ncc_elem_krnl_    = prog.create_kernel("NCCElemsKernel");
+  ncc_krnl_         = prog.create_kernel("NCCKernel");
   
   const size_type num_pix_per_img = this->num_pix_per_proj();
   
   // Populate and compute the appropriate fixed image buffers
   
-  // we'll use this now to store temp calculations on the fixed image
-  // and later use it on the moving images
-  tmp_mov_imgs_dev_.reset(new DevBuf(this->ctx_));
-  tmp_mov_imgs_dev_->resize(num_pix_per_img * this->num_mov_imgs_, this->queue_);
+  // we'll use this to store temp calculations on the fixed image
+  tmp_fixed_img_dev_.reset(new DevBuf(this->ctx_));
+  tmp_fixed_img_dev_->resize(num_pix_per_img, this->queue_);
   
   fixed_img_mean_dev_.reset(new DevPixelScalarBuf(this->ctx_));
   fixed_img_stddev_dev_.reset(new DevPixelScalarBuf(this->ctx_));
@@ -164,22 +198,18 @@ void xreg::ImgSimMetric2DNCCOCL::allocate_resources()
   
   // MOVING IMAGE Buffer creation 
 
-  mov_img_means_dev_.reset(new DevBuf(ctx_));
-  mov_img_means_dev_->resize(this->num_mov_imgs_, queue_);
-
-  mov_img_std_devs_dev_.reset(new DevBuf(ctx_));
-  mov_img_std_devs_dev_->resize(this->num_mov_imgs_, queue_);
-
   nccs_dev_.reset(new DevBuf(ctx_));
   nccs_dev_->resize(this->num_mov_imgs_, queue_);
 
   ImgSimMetric2DOCL::allocate_resources();
  
   // setup static kernel parameters
-  ncc_elem_krnl_.set_arg(0, *this->mov_imgs_buf_);
-  ncc_elem_krnl_.set_arg(1, *mov_img_std_devs_dev_);
-  ncc_elem_krnl_.set_arg(2, *this->fixed_img_ocl_buf_);
-  ncc_elem_krnl_.set_arg(4, bc::uint_(num_pix_per_img));
+  ncc_krnl_wg_size_ = this->pow2_work_group_size(ncc_krnl_, kNCC_WORK_GROUP_SIZE);
+
+  ncc_krnl_.set_arg(1, *this->fixed_img_ocl_buf_);
+  ncc_krnl_.set_arg(4, bc::uint_(num_pix_per_img));
+  ncc_krnl_.set_arg(6, *nccs_dev_);
+  ncc_krnl_.set_arg(7, bc::local_buffer<float>(ncc_krnl_wg_size_));
 
   // allocate similarity score buffer
   this->sim_vals_.assign(this->num_mov_imgs_, 0);
@@ -187,68 +217,39 @@ void xreg::ImgSimMetric2DNCCOCL::allocate_resources()
 
 void xreg::ImgSimMetric2DNCCOCL::compute()
 {
-  namespace bc  = boost::compute;
-  namespace vcl = viennacl;
+  namespace bc = boost::compute;
   
   this->pre_compute();
 
-  const size_type num_pix_per_img = this->num_pix_per_proj();
-  
-  // wrap the existing GPU buffers with vienna CL objects; this first matrix represents
-  // the maximal allocation; we'll take a sub-block of this.
-  vcl::matrix<float> imgs_mat(this->mov_imgs_buf_->get_buffer().get(),
-                              this->sim_vals_.size(),  // maximum allocated number of moving images
-                              num_pix_per_img); 
-  
-  // this is a sub-matrix of the entire buffer for the projections represented by
-  // not the maximal allocation, but the current offset and number of moving images 
-  vcl::matrix_range<vcl::matrix<float>> imgs_mat2(imgs_mat,
-                                                  vcl::range(this->proj_off_,
-                                                             this->proj_off_ + this->num_mov_imgs_),
-                                                  vcl::range(0, num_pix_per_img)); 
-  
-  vcl::vector<float> avg_vec(one_over_n_dev_->get_buffer().get(), num_pix_per_img);
-  vcl::vector<float> n_minus_one_vec(one_over_n_minus_1_dev_->get_buffer().get(), num_pix_per_img);
-  
-  vcl::vector<float> means_vec(mov_img_means_dev_->get_buffer().get(), this->num_mov_imgs_);
-  
-  vcl::matrix<float> tmp_imgs_mat(this->tmp_mov_imgs_dev_->get_buffer().get(),
-                                  this->num_mov_imgs_, num_pix_per_img);
-
-  vcl::vector<float> std_devs_vec(mov_img_std_devs_dev_->get_buffer().get(), this->num_mov_imgs_);
-  
-  vcl::vector<float> nccs_vec(nccs_dev_->get_buffer().get(), this->num_mov_imgs_);
+  // the moving images and the weights buffers may change between calls
+  ncc_krnl_.set_arg(0, *this->mov_imgs_buf_);
+  ncc_krnl_.set_arg(2, *one_over_n_dev_);
+  ncc_krnl_.set_arg(3, *one_over_n_minus_1_dev_);
+  ncc_krnl_.set_arg(5, bc::uint_(this->proj_off_));
 
-  // compute means
-  vcl::linalg::prod_impl(imgs_mat2, avg_vec, means_vec);
+  // a single launch computes the mean, std. dev. and NCC score of every moving image;
+  // the moving images are not modified
+  const std::size_t global_size[2] = { ncc_krnl_wg_size_, this->num_mov_imgs_ };
+  const std::size_t local_size[2]  = { ncc_krnl_wg_size_, 1 };
 
-  // compute std devs
-  // first subtract mean from each element and square
-  sub_mean_sq_krnl_.set_arg(3, bc::uint_(this->num_mov_imgs_));
-  sub_mean_sq_krnl_.set_arg(5, bc::uint_(this->proj_off_));
+  this->enqueue_kernel(ncc_krnl_, 2, global_size, local_size);
 
-  std::size_t global_size[2] = { num_pix_per_img / kWORK_GROUP_DIV_FACTOR, this->num_mov_imgs_ };
-  this->queue_.enqueue_nd_range_kernel(sub_mean_sq_krnl_, 2, 0, global_size, 0).wait();
-  
-  // now compute std dev.
-  vcl::linalg::prod_impl(tmp_imgs_mat, n_minus_one_vec, std_devs_vec);
-  // the sqrt is computed in the next kernel
+  this->read_sim_vals_from_dev(*nccs_dev_);
+}
 
-  // compute ncc elems
-  ncc_elem_krnl_.set_arg(3, bc::uint_(this->num_mov_imgs_));
-  ncc_elem_krnl_.set_arg(5, bc::uint_(this->proj_off_));
-  this->queue_.enqueue_nd_range_kernel(ncc_elem_krnl_, 2, 0, global_size, 0).wait();
+xreg::ImgSimMetric2DNCCOCL::DevBuf* xreg::ImgSimMetric2DNCCOCL::sim_vals_dev_buf()
+{
+  return nccs_dev_.get();
+}
 
-  // reduce into NCC scores
-  vcl::linalg::prod_impl(imgs_mat2, avg_vec, nccs_vec);
+void xreg::ImgSimMetric2DNCCOCL::set_mov_imgs_half(const bool mov_half)
+{
+  mov_imgs_half_ = mov_half;
+}
 
-  bc::copy(nccs_dev_->begin(), nccs_dev_->begin() + this->num_mov_imgs_,
-           this->sim_vals_.begin(), this->queue_);
-  
-  // TODO: parallel transform?
-  std::transform(this->sim_vals_.begin(), this->sim_vals_.begin() + this->num_mov_imgs_,
-                 this->sim_vals_.begin(),
-                 [] (const Scalar& x) { return 0.5 * (1 - x); });
+bool xreg::ImgSimMetric2DNCCOCL::mov_imgs_half() const
+{
+  return mov_imgs_half_;
 }
 
 void xreg::ImgSimMetric2DNCCOCL::process_mask()
@@ -274,11 +275,11 @@ void xreg::ImgSimMetric2DNCCOCL::process_mask()
 
     div_elems_krnl_.set_arg(1, *one_over_n_dev_);
     div_elems_krnl_.set_arg(2, num_pix_float);
-    this->queue_.enqueue_nd_range_kernel(div_elems_krnl_, 1, nullptr, &global_size, nullptr).wait();
+    this->enqueue_kernel(div_elems_krnl_, 1, &global_size, nullptr).wait();
     
     div_elems_krnl_.set_arg(1, *one_over_n_minus_1_dev_);
     div_elems_krnl_.set_arg(2, num_pix_float - Scalar(1));
-    this->queue_.enqueue_nd_range_kernel(div_elems_krnl_, 1, nullptr, &global_size, nullptr).wait();
+    this->enqueue_kernel(div_elems_krnl_, 1, &global_size, nullptr).wait();
   }
   else
   {
@@ -292,7 +293,7 @@ void xreg::ImgSimMetric2DNCCOCL::process_mask()
   vcl::matrix<float> fixed_img_mat(this->fixed_img_ocl_buf_->get_buffer().get(),
                                    1, num_pix_per_img); 
   
-  vcl::matrix<float> tmp_fixed_img_mat(tmp_mov_imgs_dev_->get_buffer().get(),
+  vcl::matrix<float> tmp_fixed_img_mat(tmp_fixed_img_dev_->get_buffer().get(),
                                        1, num_pix_per_img); 
   
   vcl::vector<float> fixed_img_mean_vec(fixed_img_mean_dev_->get_buffer().get(), 1);
@@ -307,14 +308,14 @@ void xreg::ImgSimMetric2DNCCOCL::process_mask()
 
   // setup and exec kernel to subtract mean from fixed image, and compute squares
   sub_mean_sq_krnl_.set_arg(0, *this->fixed_img_ocl_buf_);
-  sub_mean_sq_krnl_.set_arg(1, *tmp_mov_imgs_dev_);
+  sub_mean_sq_krnl_.set_arg(1, *tmp_fixed_img_dev_);
   sub_mean_sq_krnl_.set_arg(2, fixed_img_mean_dev_->get_buffer());
   sub_mean_sq_krnl_.set_arg(3, bc::uint_(1));  // num_mov_imgs_
   sub_mean_sq_krnl_.set_arg(4, bc::uint_(num_pix_per_img));
   sub_mean_sq_krnl_.set_arg(5, bc::uint_(0));  // proj_off_
 
   std::size_t global_size[2] = { num_pix_per_img / kWORK_GROUP_DIV_FACTOR, 1 };
-  this->queue_.enqueue_nd_range_kernel(sub_mean_sq_krnl_, 2, 0, global_size, 0).wait();
+  this->enqueue_kernel(sub_mean_sq_krnl_, 2, global_size, 0).wait();
     
   // compute std dev
   vcl::linalg::prod_impl(tmp_fixed_img_mat, n_minus_one_vec, fixed_img_stddev_vec);
@@ -322,10 +323,9 @@ void xreg::ImgSimMetric2DNCCOCL::process_mask()
 
   // divide by std dev
   fixed_img_mat /= fixed_std_dev_host;
-  
-  // Set parameters for the kernel that are specific for the moving images
+}
 
-  sub_mean_sq_krnl_.set_arg(0, *this->mov_imgs_buf_);
-  sub_mean_sq_krnl_.set_arg(1, *tmp_mov_imgs_dev_);
-  sub_mean_sq_krnl_.set_arg(2, *mov_img_means_dev_);
+bool xreg::ImgSimMetric2DNCCOCL::mov_img_pixels_used(PixelIndexList* pix_inds)
+{
+  return this->mask_pixels_used(pix_inds);
 }
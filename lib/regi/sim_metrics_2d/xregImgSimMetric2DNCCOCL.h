@@ -48,14 +48,34 @@ public:
 
   void allocate_resources() override;
 
+  void prebuild_progs() override;
+
   void compute() override;
 
+  DevBuf* sim_vals_dev_buf() override;
+
+  /// \brief The pixels that are not masked out, or false when no mask is set
+  bool mov_img_pixels_used(PixelIndexList* pix_inds) override;
+
+  /// \brief Indicates that the moving images buffer holds packed half
+  ///        precision values, e.g. the moving gradients of
+  ///        ImgSimMetric2DGradImgOCL::set_use_half_mov_grads().
+  ///
+  /// The NCC is still accumulated in single precision. This must be set
+  /// before calling allocate_resources(). Defaults to false.
+  void set_mov_imgs_half(const bool mov_half);
+
+  bool mov_imgs_half() const;
+
 protected:
   void process_mask() override;
 
 private:
   using DevPixelScalarBuf = boost::compute::detail::scalar<Scalar>;
 
+  /// \brief Source of the NCC program for the current settings
+  std::string prog_src() const;
+
   std::unique_ptr<DevPixelScalarBuf> fixed_img_mean_dev_;
   std::unique_ptr<DevPixelScalarBuf> fixed_img_stddev_dev_;
 
@@ -63,17 +83,19 @@ private:
   std::unique_ptr<DevBuf> one_over_n_dev_;
   std::unique_ptr<DevBuf> one_over_n_minus_1_dev_;
 
-  std::unique_ptr<DevBuf> tmp_mov_imgs_dev_;
-
-  std::unique_ptr<DevBuf> mov_img_means_dev_;
-
-  std::unique_ptr<DevBuf> mov_img_std_devs_dev_;
+  std::unique_ptr<DevBuf> tmp_fixed_img_dev_;
 
   std::unique_ptr<DevBuf> nccs_dev_;
   
   boost::compute::kernel div_elems_krnl_;
   boost::compute::kernel sub_mean_sq_krnl_;
-  boost::compute::kernel ncc_elem_krnl_;
+
+  /// \brief Computes the NCC of every moving image with work-group reductions per image
+  boost::compute::kernel ncc_krnl_;
+
+  std::size_t ncc_krnl_wg_size_ = 0;
+
+  bool mov_imgs_half_ = false;
 };
 
 }  // xreg
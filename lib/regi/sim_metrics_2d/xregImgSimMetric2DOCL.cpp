@@ -37,17 +37,21 @@
 #include "xregRayCastInterface.h"
 #include "xregAssert.h"
 #include "xregExceptionUtils.h"
+#include "xregOpenCLAutoTune.h"
+#include "xregOpenCLProfiling.h"
+#include "xregOpenCLSys.h"
+#include "xregTrace.h"
 #include "xregViennaCLManager.h"
 
 namespace vcl = viennacl;
 
 xreg::ImgSimMetric2DOCL::ImgSimMetric2DOCL()
-  : ctx_(boost::compute::system::default_device()),
-    queue_(ctx_, ctx_.get_device())
+  : ctx_(SharedOpenCLContext()),
+    queue_(MakeOpenCLCmdQueue(ctx_, ctx_.get_device()))
 { }
 
 xreg::ImgSimMetric2DOCL::ImgSimMetric2DOCL(const boost::compute::device& dev)
-  : ctx_(dev), queue_(ctx_, dev)
+  : ctx_(SharedOpenCLContext(dev)), queue_(MakeOpenCLCmdQueue(ctx_, dev))
 { }
 
 xreg::ImgSimMetric2DOCL::ImgSimMetric2DOCL(const boost::compute::context& ctx,
@@ -68,6 +72,8 @@ void xreg::ImgSimMetric2DOCL::allocate_resources()
     fixed_img_ocl_buf_ = std::make_shared<DevBuf>(ctx_);
     fixed_img_ocl_buf_->assign(host_fixed_buf, host_fixed_buf + this->num_pix_per_proj(),
                                queue_);
+
+    fixed_img_dev_mem_.set_bytes(this->num_pix_per_proj() * sizeof(Scalar));
   }
 
   if (sync_ocl_buf_)
@@ -77,7 +83,15 @@ void xreg::ImgSimMetric2DOCL::allocate_resources()
 
   if (setup_vienna_cl_ctx_)
   {
-    setup_vcl_ctx_if_needed(vienna_cl_ctx_idx_, ctx_, queue_);
+    if (use_shared_vienna_cl_ctx_idx_)
+    {
+      // the context may have been replaced by that of a ray caster
+      vienna_cl_ctx_idx_ = ViennaCLCtxIdx(ctx_, queue_);
+    }
+    else
+    {
+      setup_vcl_ctx_if_needed(vienna_cl_ctx_idx_, ctx_, queue_);
+    }
   }
   
   vcl::ocl::switch_context(vienna_cl_ctx_idx_); 
@@ -162,6 +176,8 @@ long xreg::ImgSimMetric2DOCL::vienna_cl_ctx_idx() const
 void xreg::ImgSimMetric2DOCL::set_vienna_cl_ctx_idx(const long ctx_idx)
 {
   vienna_cl_ctx_idx_ = ctx_idx;
+
+  use_shared_vienna_cl_ctx_idx_ = false;
 }
 
 void xreg::ImgSimMetric2DOCL::set_setup_vienna_cl_ctx(const bool ctx)
@@ -172,6 +188,38 @@ void xreg::ImgSimMetric2DOCL::set_setup_vienna_cl_ctx(const bool ctx)
 void xreg::ImgSimMetric2DOCL::set_fixed_image_dev(std::shared_ptr<DevBuf>& fixed_dev)
 {
   fixed_img_ocl_buf_ = fixed_dev;
+
+  // the buffer is tracked by its owner
+  fixed_img_dev_mem_.set_bytes(0);
+}
+
+xreg::ImgSimMetric2DOCL::DevBuf* xreg::ImgSimMetric2DOCL::sim_vals_dev_buf()
+{
+  return nullptr;
+}
+
+void xreg::ImgSimMetric2DOCL::set_read_sim_vals_to_host(const bool read)
+{
+  read_sim_vals_to_host_ = read;
+}
+
+bool xreg::ImgSimMetric2DOCL::read_sim_vals_to_host() const
+{
+  return read_sim_vals_to_host_;
+}
+
+const boost::compute::command_queue& xreg::ImgSimMetric2DOCL::queue() const
+{
+  return queue_;
+}
+
+void xreg::ImgSimMetric2DOCL::read_sim_vals_from_dev(const DevBuf& sim_vals_dev)
+{
+  if (read_sim_vals_to_host_)
+  {
+    boost::compute::copy(sim_vals_dev.begin(), sim_vals_dev.begin() + this->num_mov_imgs_,
+                         this->sim_vals_.begin(), queue_);
+  }
 }
 
 void xreg::ImgSimMetric2DOCL::pre_compute()
@@ -218,5 +266,48 @@ void xreg::ImgSimMetric2DOCL::process_mask()
     mask_ocl_buf_.reset(new DevBuf(ctx_));
     mask_ocl_buf_->assign(mask_float_host.begin(), mask_float_host.end(),
                           queue_);
+
+    mask_dev_mem_.set_bytes(num_pix_per_img * sizeof(Scalar));
+  }
+}
+
+boost::compute::event
+xreg::ImgSimMetric2DOCL::enqueue_kernel_tuned(boost::compute::kernel& k, const std::string& key,
+                                              const std::size_t dim,
+                                              const std::size_t* global_size)
+{
+  return EnqueueOpenCLKernelTuned(queue_, k, key, dim, global_size);
+}
+
+boost::compute::event
+xreg::ImgSimMetric2DOCL::enqueue_kernel(boost::compute::kernel& k, const std::size_t dim,
+                                        const std::size_t* global_size,
+                                        const std::size_t* local_size)
+{
+  const boost::compute::event e = queue_.enqueue_nd_range_kernel(k, dim, nullptr,
+                                                                 global_size, local_size);
+
+  // avoid querying the kernel name when nothing is recorded
+  if (OpenCLProfilingEnabled() || TracingEnabled())
+  {
+    RecordOpenCLKernelEvent(k.name(), e);
   }
+
+  return e;
+}
+
+std::size_t xreg::ImgSimMetric2DOCL::pow2_work_group_size(const boost::compute::kernel& k,
+                                                        const std::size_t max_size) const
+{
+  const std::size_t krnl_max = std::min(max_size,
+                  k.get_work_group_info<std::size_t>(queue_.get_device(), CL_KERNEL_WORK_GROUP_SIZE));
+
+  std::size_t wg_size = 1;
+
+  while ((wg_size * 2) <= krnl_max)
+  {
+    wg_size *= 2;
+  }
+
+  return wg_size;
 }
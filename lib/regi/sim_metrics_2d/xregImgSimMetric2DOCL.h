@@ -27,6 +27,7 @@
 
 #include "xregImgSimMetric2D.h"
 #include "xregRayCastSyncBuf.h"
+#include "xregMemTracking.h"
 
 namespace xreg
 {
@@ -37,12 +38,15 @@ class ImgSimMetric2DOCL : public ImgSimMetric2D
 public:
   using DevBuf = RayCastSyncBuf::OCLBuf;
 
-  /// \brief Default constructor, chooses a default device, creates a new
-  ///        context and command queue.
+  /// \brief Default constructor, chooses a default device, uses the context
+  ///        shared by all objects using the device and creates a new command
+  ///        queue.
+  ///
+  /// \see SharedOpenCLContext
   ImgSimMetric2DOCL();
 
-  /// \brief Constructor specifying a device to use, but creates a new context
-  ///        and command queue.
+  /// \brief Constructor specifying a device to use; uses the context shared
+  ///        by all objects using the device and creates a new command queue.
   explicit ImgSimMetric2DOCL(const boost::compute::device& dev);
 
   /// \brief Constructor specifying a specific context and command queue to use
@@ -69,19 +73,79 @@ public:
   ///       contents of the host are modified!
   void set_mov_imgs_host_buf(Scalar* mov_imgs_buf, const size_type proj_offset = 0) override;
 
+  /// \brief The ViennaCL context index used for linear algebra on the
+  ///        device buffers.
+  ///
+  /// Unless set explicitly, this is the index associated with this object's
+  /// OpenCL context and command queue (see ViennaCLCtxIdx()), and is valid
+  /// after calling allocate_resources().
   long vienna_cl_ctx_idx() const;
 
+  /// \brief Explicitly sets the ViennaCL context index to use.
+  ///
+  /// The index is no longer determined from the OpenCL context and queue.
   void set_vienna_cl_ctx_idx(const long ctx_idx);
 
   void set_setup_vienna_cl_ctx(const bool ctx);
 
   void set_fixed_image_dev(std::shared_ptr<DevBuf>& fixed_dev);
 
+  /// \brief Device buffer holding the similarity score of each moving image
+  ///        after compute(), or null when the scores are only available on
+  ///        the host.
+  ///
+  /// The scores are valid once the commands enqueued on queue() by compute()
+  /// have completed.
+  virtual DevBuf* sim_vals_dev_buf();
+
+  /// \brief Sets whether compute() reads the similarity scores back to the
+  ///        host.
+  ///
+  /// When false, and sim_vals_dev_buf() is non-null, compute() does not wait
+  /// for the scores and sim_val() is not updated; e.g. the scores of several
+  /// views may then be combined on the device. Metrics that do not keep their
+  /// scores on the device always read them back. Default is true.
+  void set_read_sim_vals_to_host(const bool read);
+
+  bool read_sim_vals_to_host() const;
+
+  /// \brief The command queue used by this object.
+  const boost::compute::command_queue& queue() const;
+
 protected:
   void pre_compute();
+
+  /// \brief Reads the similarity scores from a device buffer into sim_vals_,
+  ///        unless reading to the host has been disabled.
+  void read_sim_vals_from_dev(const DevBuf& sim_vals_dev);
   
   void process_mask() override;
 
+  /// \brief Launches a kernel on the queue using a work-group size tuned for
+  ///        the device, see EnqueueOpenCLKernelTuned().
+  ///
+  /// The kernel must ignore work items beyond the global size and must write
+  /// the same outputs when launched repeatedly.
+  boost::compute::event enqueue_kernel_tuned(boost::compute::kernel& k, const std::string& key,
+                                             const std::size_t dim,
+                                             const std::size_t* global_size);
+
+  /// \brief Launches a kernel on the queue with explicit work sizes and records
+  ///        the launch for profiling and tracing, see RecordOpenCLKernelEvent().
+  ///
+  /// The kernel's function name is used to identify recorded launches.
+  /// A null local size lets the OpenCL implementation choose one.
+  boost::compute::event enqueue_kernel(boost::compute::kernel& k, const std::size_t dim,
+                                       const std::size_t* global_size,
+                                       const std::size_t* local_size);
+
+  /// \brief Largest power of two work-group size that may be used to launch
+  ///        a kernel on the device of the queue, limited to at most max_size.
+  ///
+  /// e.g. for kernels performing tree reductions in local memory.
+  std::size_t pow2_work_group_size(const boost::compute::kernel& k,
+                                   const std::size_t max_size) const;
+
   boost::compute::context ctx_;
   boost::compute::command_queue queue_;
 
@@ -89,6 +153,11 @@ protected:
 
   std::unique_ptr<DevBuf> mask_ocl_buf_;
 
+  /// \brief Device memory of the fixed image, when copied by this object,
+  ///        and of the mask.
+  TrackedMemAlloc fixed_img_dev_mem_ = TrackedMemAlloc(MemLocation::kDEVICE, "sim-metric-fixed-img");
+  TrackedMemAlloc mask_dev_mem_      = TrackedMemAlloc(MemLocation::kDEVICE, "sim-metric-mask");
+
   RayCastSyncOCLBuf* sync_ocl_buf_ = nullptr;
 
   DevBuf* mov_imgs_buf_ = nullptr;
@@ -100,8 +169,12 @@ protected:
   size_type num_pix_per_proj_after_mask_ = 0;
 
   long vienna_cl_ctx_idx_ = 0;
-  
+
+  bool use_shared_vienna_cl_ctx_idx_ = true;
+
   bool setup_vienna_cl_ctx_ = true;
+
+  bool read_sim_vals_to_host_ = true;
 };
 
 }  // xreg
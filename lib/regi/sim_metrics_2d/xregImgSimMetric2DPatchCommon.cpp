@@ -171,6 +171,27 @@ double xreg::ImgSimMetric2DPatchCommon::rand_patch_min_pixels_sep() const
   return rand_patch_min_pixels_sep_;
 }
 
+void xreg::ImgSimMetric2DPatchCommon::set_use_integral_imgs(const bool use_int_imgs)
+{
+  use_integral_imgs_ = use_int_imgs;
+}
+
+bool xreg::ImgSimMetric2DPatchCommon::use_integral_imgs() const
+{
+  return use_integral_imgs_;
+}
+
+bool xreg::ImgSimMetric2DPatchCommon::integral_imgs_cheaper(const size_type num_patches,
+                                                            const size_type img_num_pix) const
+{
+  // Building the tables requires a few passes over every pixel of the image,
+  // while each patch may be summed directly in a single pass over its pixels
+  constexpr size_type kINTEGRAL_IMG_COST_FACTOR = 4;
+
+  return use_integral_imgs_ &&
+         ((num_patches * patch_diam_ * patch_diam_) > (kINTEGRAL_IMG_COST_FACTOR * img_num_pix));
+}
+
 const xreg::ImgSimMetric2DPatchCommon::PatchInfoList&
 xreg::ImgSimMetric2DPatchCommon::patch_infos() const
 {
@@ -205,6 +226,8 @@ void xreg::ImgSimMetric2DPatchCommon::set_from_other(const ImgSimMetric2DPatchCo
   num_rand_patches_          = other.num_rand_patches_;
   rand_patch_min_pixels_sep_ = other.rand_patch_min_pixels_sep_;
 
+  use_integral_imgs_ = other.use_integral_imgs_;
+
   need_to_recompute_weights_ = other.need_to_recompute_weights_;
   patch_idx_dist_            = other.patch_idx_dist_;
 
@@ -212,6 +235,8 @@ void xreg::ImgSimMetric2DPatchCommon::set_from_other(const ImgSimMetric2DPatchCo
   // included in the patch_infos_
   //wgt_img_ = other.wgt_img_;
 
+  ++patch_wgts_update_count_;
+
   patches_setup_ = true;
 }
 
@@ -226,6 +251,8 @@ void xreg::ImgSimMetric2DPatchCommon::set_weights_from_other(const ImgSimMetric2
   }
 
   patch_idx_dist_ = other.patch_idx_dist_;
+
+  ++patch_wgts_update_count_;
 }
 
 void xreg::ImgSimMetric2DPatchCommon::set_patches_to_use(const PatchIndexList& patch_inds)
@@ -404,6 +431,8 @@ bool xreg::ImgSimMetric2DPatchCommon::compute_weights(cv::Mat* mask)
 
     need_to_recompute_weights_ = false;
     wgts_updated = true;
+
+    ++patch_wgts_update_count_;
   }
 
   return wgts_updated;
@@ -491,3 +520,64 @@ xreg::ImgSimMetric2DPatchCommon::patch_indices_to_use()
   xregASSERT(inds.size() == num_patches());
   return inds;
 }
+
+void xreg::ImgSimMetric2DPatchCommon::update_patch_inds_to_use()
+{
+  if (!do_not_update_patch_inds_to_use_ && !patch_inds_to_use_pre_chosen_)
+  {
+    patch_inds_to_use_ = patch_indices_to_use();
+  }
+
+  patch_inds_to_use_pre_chosen_ = false;
+}
+
+bool xreg::ImgSimMetric2DPatchCommon::patch_pixels_used(cv::Mat* mask,
+                                                        const size_type img_num_rows,
+                                                        const size_type img_num_cols,
+                                                        ImgSimMetric2D::PixelIndexList* pix_inds)
+{
+  xregASSERT(patches_setup_);
+
+  if (!do_not_update_patch_inds_to_use_)
+  {
+    if (!choose_rand_patches_)
+    {
+      return false;
+    }
+
+    // the random sampling distribution depends on the weights
+    compute_weights(mask);
+
+    patch_inds_to_use_ = patch_indices_to_use();
+    
+    patch_inds_to_use_pre_chosen_ = true;
+  }
+
+  // flag the pixels in each patch, patches may overlap
+  std::vector<unsigned char> pix_used(img_num_rows * img_num_cols, 0);
+
+  for (const size_type patch_idx : patch_inds_to_use_)
+  {
+    const PatchInfo& p = patch_infos_[patch_idx];
+
+    for (size_type r = p.start_row; r <= p.stop_row; ++r)
+    {
+      std::fill(pix_used.begin() + (r * img_num_cols) + p.start_col,
+                pix_used.begin() + (r * img_num_cols) + p.stop_col + 1, 1);
+    }
+  }
+
+  pix_inds->clear();
+
+  const size_type num_pix = pix_used.size();
+
+  for (size_type i = 0; i < num_pix; ++i)
+  {
+    if (pix_used[i])
+    {
+      pix_inds->push_back(i);
+    }
+  }
+
+  return true;
+}
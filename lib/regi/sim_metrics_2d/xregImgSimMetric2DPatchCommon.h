@@ -110,6 +110,17 @@ public:
 
   double rand_patch_min_pixels_sep() const;
 
+  /// \brief Allows the patch sums to be computed from summed area tables
+  ///        (integral images) of the moving images.
+  ///
+  /// When enabled, the tables are only used when the patches overlap enough
+  /// that computing tables over the entire image is expected to be cheaper
+  /// than summing over each patch, e.g. with a small patch stride.
+  /// Defaults to true.
+  void set_use_integral_imgs(const bool use_int_imgs);
+
+  bool use_integral_imgs() const;
+
   const PatchInfoList& patch_infos() const;
 
   size_type num_patches() const;
@@ -136,6 +147,29 @@ protected:
 
   PatchIndexList patch_indices_to_use();
 
+  /// \brief Indicates that the patch sums of a moving image should be
+  ///        computed using summed area tables.
+  ///
+  /// This is true when integral images are enabled and the total number of
+  /// pixels covered by the patches, counting overlaps, is a sufficient
+  /// multiple of the number of pixels in the image.
+  bool integral_imgs_cheaper(const size_type num_patches, const size_type img_num_pix) const;
+
+  /// \brief Updates the patches used by the current similarity computation.
+  ///
+  /// Random patches are chosen, unless they were chosen ahead of time by
+  /// patch_pixels_used() or the patches were explicitly set.
+  void update_patch_inds_to_use();
+
+  /// \brief Chooses the random patches used by the next similarity
+  ///        computation and retrieves the pixels covered by them.
+  ///
+  /// This allows the pixels outside of the patches to be skipped when
+  /// computing the moving images. Returns false when every patch is used,
+  /// since the patches then cover (nearly) the entire image.
+  bool patch_pixels_used(cv::Mat* mask, const size_type img_num_rows, const size_type img_num_cols,
+                         ImgSimMetric2D::PixelIndexList* pix_inds);
+
   PatchInfoList patch_infos_;
 
   size_type patch_radius_ = 5;
@@ -165,6 +199,8 @@ protected:
   //  > 0 --> use this distance
   double rand_patch_min_pixels_sep_ = -1;
 
+  bool use_integral_imgs_ = true;
+
   bool patches_setup_ = false;
 
   ListOfSimScalarLists sim_vals_for_each_patch_;
@@ -175,9 +211,17 @@ protected:
   bool do_not_update_patch_inds_to_use_ = false;
   PatchIndexList patch_inds_to_use_;
 
+  // true when patch_inds_to_use_ has been chosen ahead of the next computation 
+  bool patch_inds_to_use_pre_chosen_ = false;
+
   WgtImgPtr wgt_img_;
     
   bool need_to_recompute_weights_ = true;
+
+  /// \brief Incremented whenever the weights of patch_infos_ change, e.g.
+  ///        allows copies of the weights on a device to be updated only
+  ///        when needed.
+  size_type patch_wgts_update_count_ = 0;
 };
 
 }  // xreg
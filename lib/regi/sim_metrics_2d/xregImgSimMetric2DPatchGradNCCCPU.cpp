@@ -103,6 +103,8 @@ void xreg::ImgSimMetric2DPatchGradNCCCPU::allocate_resources()
 
 void xreg::ImgSimMetric2DPatchGradNCCCPU::compute()
 {
+  ParallelExecContextScope exec_scope(this->exec_ctx_.get());
+
   this->pre_compute();
   this->compute_sobel_grads();
   
@@ -125,10 +127,7 @@ void xreg::ImgSimMetric2DPatchGradNCCCPU::compute()
   
   if (enforce_same_patches_in_both_x_and_y_)
   {
-    if (!this->do_not_update_patch_inds_to_use_)
-    {
-      this->patch_inds_to_use_ = this->patch_indices_to_use();
-    }
+    this->update_patch_inds_to_use();
 
     patch_ncc_x_.set_patches_to_use(this->patch_inds_to_use_);
     patch_ncc_y_.set_patches_to_use(this->patch_inds_to_use_);
@@ -25,6 +25,7 @@
 #include "xregImgSimMetric2DPatchGradNCCOCL.h"
 
 #include "xregAssert.h"
+#include "xregExceptionUtils.h"
 #include "xregITKOpenCVUtils.h"
 
 xreg::ImgSimMetric2DPatchGradNCCOCL::ImgSimMetric2DPatchGradNCCOCL()
@@ -47,10 +48,24 @@ xreg::ImgSimMetric2DPatchGradNCCOCL::ImgSimMetric2DPatchGradNCCOCL(
     grad_y_sim_(this->ctx_, this->queue_)
 { }
 
+void xreg::ImgSimMetric2DPatchGradNCCOCL::prebuild_progs()
+{
+  ImgSimMetric2DGradImgOCL::prebuild_progs();
+
+  // both directions use the same programs
+  grad_x_sim_.set_use_integral_imgs(this->use_integral_imgs_);
+  grad_x_sim_.prebuild_progs();
+}
+
 void xreg::ImgSimMetric2DPatchGradNCCOCL::allocate_resources()
 {
   // unsupported options when running on the GPU:
   xregASSERT(!this->use_mask_for_patch_stats_);
+
+  if (this->use_half_mov_grads_)
+  {
+    xregThrow("half precision moving gradients are not supported by the patch NCC kernels!");
+  }
   
   ImgSimMetric2DGradImgOCL::allocate_resources();
   
@@ -79,6 +94,7 @@ void xreg::ImgSimMetric2DPatchGradNCCOCL::allocate_resources()
   grad_x_sim_.set_setup_vienna_cl_ctx(false);
   grad_x_sim_.set_vienna_cl_ctx_idx(this->vienna_cl_ctx_idx());
   grad_x_sim_.set_from_other(*this);
+  grad_x_sim_.set_sample_rand_patches_on_dev(sample_rand_patches_on_dev_);
   grad_x_sim_.allocate_resources();
 
   grad_y_sim_.set_num_moving_images(this->num_mov_imgs_);
@@ -88,6 +104,8 @@ void xreg::ImgSimMetric2DPatchGradNCCOCL::allocate_resources()
   grad_y_sim_.set_setup_vienna_cl_ctx(false);
   grad_y_sim_.set_vienna_cl_ctx_idx(this->vienna_cl_ctx_idx());
   grad_y_sim_.set_from_other(*this);
+  // the y direction uses the patches sampled by the x direction
+  grad_y_sim_.set_dev_patches_src(sample_rand_patches_on_dev_ ? &grad_x_sim_ : nullptr);
   grad_y_sim_.allocate_resources();
 
   this->sim_vals_.assign(this->num_mov_imgs_, 0);
@@ -119,13 +137,17 @@ void xreg::ImgSimMetric2DPatchGradNCCOCL::compute()
   }
   
   // TODO: add member variable for this option
-  if (true)
+  if (sample_rand_patches_on_dev_ && this->choose_rand_patches_ &&
+      !this->do_not_update_patch_inds_to_use_ && !this->patch_inds_to_use_pre_chosen_)
+  {
+    // the x direction samples new patches on the device, which the y direction copies
+    grad_x_sim_.reset_patches_to_use();
+    grad_y_sim_.reset_patches_to_use();
+  }
+  else if (true)
   //if (enforce_same_patches_in_both_x_and_y_)
   {
-    if (!this->do_not_update_patch_inds_to_use_)
-    {
-      this->patch_inds_to_use_ = this->patch_indices_to_use();
-    }
+    this->update_patch_inds_to_use();
 
     grad_x_sim_.set_patches_to_use(this->patch_inds_to_use_);
     grad_y_sim_.set_patches_to_use(this->patch_inds_to_use_);
@@ -139,6 +161,16 @@ void xreg::ImgSimMetric2DPatchGradNCCOCL::compute()
     this->sim_vals_[mov_idx] = 0.5 * (grad_x_sim_.sim_val(mov_idx) + grad_y_sim_.sim_val(mov_idx));
   }
 }
+void xreg::ImgSimMetric2DPatchGradNCCOCL::set_sample_rand_patches_on_dev(const bool on_dev)
+{
+  sample_rand_patches_on_dev_ = on_dev;
+}
+
+bool xreg::ImgSimMetric2DPatchGradNCCOCL::sample_rand_patches_on_dev() const
+{
+  return sample_rand_patches_on_dev_;
+}
+
 void xreg::ImgSimMetric2DPatchGradNCCOCL::process_mask()
 {
   ImgSimMetric2DGradImgOCL::process_mask();
@@ -45,14 +45,27 @@ public:
   
   void allocate_resources() override;
 
+  void prebuild_progs() override;
+
   void compute() override;
 
+  /// \brief Sample the random patches, and normalize their weights, on the
+  ///        device; the same patches are used for each gradient direction.
+  ///
+  /// See ImgSimMetric2DPatchNCCOCL::set_sample_rand_patches_on_dev().
+  /// Must be set before allocating resources. Defaults to false.
+  void set_sample_rand_patches_on_dev(const bool on_dev);
+
+  bool sample_rand_patches_on_dev() const;
+
 protected:
   void process_mask() override;
 
 private:
   ImgSimMetric2DPatchNCCOCL grad_x_sim_;
   ImgSimMetric2DPatchNCCOCL grad_y_sim_;
+
+  bool sample_rand_patches_on_dev_ = false;
 };
 
 }
@@ -24,6 +24,8 @@
 
 #include "xregImgSimMetric2DPatchNCCCPU.h"
 
+#include <opencv2/imgproc/imgproc.hpp>
+
 #include "xregITKBasicImageUtils.h"
 #include "xregITKOpenCVUtils.h"
 #include "xregOpenCVUtils.h"
@@ -31,6 +33,51 @@
 #include "xregTBBUtils.h"
 #include "xregHDF5Internal.h"
 
+namespace  // un-named
+{
+
+using namespace xreg;
+
+using PatchInfo = ImgSimMetric2DPatchCommon::PatchInfo;
+using Scalar    = ImgSimMetric2DPatchNCCCPU::Scalar;
+
+/// \brief Sums the pixels of a patch using an integral image (summed area table).
+double IntegralImgPatchSum(const cv::Mat& int_img, const PatchInfo& p)
+{
+  return int_img.at<double>(p.stop_row + 1, p.stop_col + 1) -
+         int_img.at<double>(p.start_row, p.stop_col + 1) -
+         int_img.at<double>(p.stop_row + 1, p.start_col) +
+         int_img.at<double>(p.start_row, p.start_col);
+}
+
+size_type PatchNumPix(const PatchInfo& p)
+{
+  return (p.stop_row - p.start_row + 1) * (p.stop_col - p.start_col + 1);
+}
+
+/// \brief Computes a patch mean and standard deviation from the sum and
+///        sum of squares of the pixels.
+///
+/// This is consistent with detail::ComputePatchMeanStdDev().
+std::tuple<Scalar,Scalar> PatchMeanStdDevFromSums(const double sum, const double sq_sum,
+                                                  const size_type num_pix)
+{
+  double mean = sum;
+  double var  = 0;
+
+  if (num_pix > 1)
+  {
+    mean /= num_pix;
+
+    var = std::max(0.0, (sq_sum - (sum * mean)) / (num_pix - 1));
+  }
+
+  return std::make_tuple(static_cast<Scalar>(mean),
+                         std::max(Scalar(1.0e-6), static_cast<Scalar>(std::sqrt(var))));
+}
+
+}  // un-named
+
 void xreg::ImgSimMetric2DPatchNCCCPU::allocate_resources()
 {
   ImgSimMetric2DCPU::allocate_resources();
@@ -71,8 +118,22 @@ void xreg::ImgSimMetric2DPatchNCCCPU::allocate_resources()
   this->process_updated_mask();
 }
   
+bool xreg::ImgSimMetric2DPatchNCCCPU::mov_img_pixels_used(PixelIndexList* pix_inds)
+{
+  cv::Mat ocv_mask;
+  if (this->mask_)
+  {
+    ocv_mask = ShallowCopyItkToOpenCV(this->mask_.GetPointer());
+  }
+
+  return this->patch_pixels_used(this->mask_ ? &ocv_mask : nullptr,
+                                 img_num_rows_, img_num_cols_, pix_inds);
+}
+
 void xreg::ImgSimMetric2DPatchNCCCPU::compute()
 {
+  ParallelExecContextScope exec_scope(this->exec_ctx_.get());
+
   this->pre_compute();
 
   const size_type img_num_pix = img_num_cols_ * img_num_rows_;
@@ -94,13 +155,20 @@ void xreg::ImgSimMetric2DPatchNCCCPU::compute()
 
   // NOTE: this can be moved into the loop below over moving images to
   //       sample different random patches for each moving image
-  if (!this->do_not_update_patch_inds_to_use_)
-  { 
-    this->patch_inds_to_use_ = this->patch_indices_to_use();
-  }
+  this->update_patch_inds_to_use();
   xregASSERT(num_patches == this->patch_inds_to_use_.size());
+
+  // use summed area tables when the patches overlap heavily, so each patch
+  // sum is O(1) instead of O(patch area)
+  const bool use_int_imgs = this->integral_imgs_cheaper(num_patches, img_num_pix);
+
+  // when the moving image statistics do not use the mask, the patch
+  // variances used as weights may be computed from the same tables
+  const bool int_img_stats_unmasked = !use_mask || !this->use_mask_for_patch_stats_;
    
-  ScalarList mov_img_patch_vars;
+  // points to the variances computed by this object or the variances
+  // provided by another object, the latter are not copied
+  const ScalarList* mov_img_patch_vars_to_use = nullptr;
 
   for (size_type mov_idx = 0; mov_idx < this->num_mov_imgs_; ++mov_idx)
   {
@@ -108,16 +176,25 @@ void xreg::ImgSimMetric2DPatchNCCCPU::compute()
                     this->mov_imgs_buf_ + (mov_idx * img_num_pix));
   
     cur_mov_img_patch_ncc_vals_.assign(num_patches, 0);
+
+    if (use_int_imgs)
+    {
+      compute_mov_img_integral_imgs(mov_img);
+    }
       
     if (use_mov_img_patch_variances_as_wgts_)
     {
       if (other_mov_img_patch_vars_)
       {
-        mov_img_patch_vars = other_mov_img_patch_vars_->at(mov_idx);
-        xregASSERT(mov_img_patch_vars.size() == num_patches);
+        mov_img_patch_vars_to_use = &other_mov_img_patch_vars_->at(mov_idx);
+        xregASSERT(mov_img_patch_vars_to_use->size() == num_patches);
       }
       else
       {
+        ScalarList& mov_img_patch_vars = mov_img_patch_vars_;
+
+        mov_img_patch_vars_to_use = &mov_img_patch_vars;
+
         mov_img_patch_vars.resize(num_patches);
         
         auto mov_patch_vars_fn = [&] (const RangeType& r)
@@ -132,10 +209,20 @@ void xreg::ImgSimMetric2DPatchNCCCPU::compute()
             
             if (!use_mask || ocv_mask.at<MaskScalar>(patch_row_col[0], patch_row_col[1]))
             {
-              cv::Mat mov_roi = mov_img(patch_info.ocv_roi());
+              if (use_int_imgs && int_img_stats_unmasked)
+              {
+                std::tie(std::ignore, tmp_std_dev) = PatchMeanStdDevFromSums(
+                                          IntegralImgPatchSum(mov_sum_int_img_, patch_info),
+                                          IntegralImgPatchSum(mov_sq_sum_int_img_, patch_info),
+                                          PatchNumPix(patch_info));
+              }
+              else
+              {
+                cv::Mat mov_roi = mov_img(patch_info.ocv_roi());
               
-              std::tie(std::ignore, tmp_std_dev, std::ignore) =
+                std::tie(std::ignore, tmp_std_dev, std::ignore) =
                                               detail::ComputePatchMeanStdDev(mov_roi, nullptr, false);
+              }
             
               mov_img_patch_vars[local_patch_idx] = tmp_std_dev * tmp_std_dev;
             }
@@ -207,9 +294,40 @@ void xreg::ImgSimMetric2DPatchNCCCPU::compute()
 
         const Scalar cur_wgt = !use_mov_img_patch_variances_as_wgts_ ?
                                             patch_info.weight :
-                                            mov_img_patch_vars[local_patch_idx - local_patch_idx_begin];
+                                            (*mov_img_patch_vars_to_use)[local_patch_idx];
         
-        if (!this->weight_patch_sims_in_combine_ || (std::abs(cur_wgt) > 1.0e-6))
+        if (use_int_imgs && (!this->weight_patch_sims_in_combine_ || (std::abs(cur_wgt) > 1.0e-6)))
+        {
+          const size_type num_pix_for_stats = (use_mask && this->use_mask_for_patch_stats_) ?
+                      static_cast<size_type>(IntegralImgPatchSum(mask_count_int_img_, patch_info) + 0.5) :
+                      PatchNumPix(patch_info);
+
+          std::tie(tmp_mean, tmp_std_dev) = PatchMeanStdDevFromSums(
+                                                IntegralImgPatchSum(mov_sum_int_img_, patch_info),
+                                                IntegralImgPatchSum(mov_sq_sum_int_img_, patch_info),
+                                                num_pix_for_stats);
+
+          // sum over the masked pixels of the normalized fixed patch multiplied
+          // by the moving patch
+          const double fixed_mov_sum = fixed_patch_scales_[global_patch_idx] *
+                 (IntegralImgPatchSum(fixed_mov_prod_int_img_, patch_info) -
+                  (fixed_patch_means_[global_patch_idx] *
+                   IntegralImgPatchSum(use_mask ? mov_masked_sum_int_img_ : mov_sum_int_img_, patch_info)));
+
+          const Scalar tmp_accum = static_cast<Scalar>(
+                  (fixed_mov_sum - (tmp_mean * fixed_patch_masked_sums_[global_patch_idx])) / tmp_std_dev);
+
+          const Scalar cur_sim_val = 1 - tmp_accum;
+
+          if (this->save_all_per_patch_scores_)
+          {
+            this->sim_vals_for_each_patch_[local_patch_idx][mov_idx] = cur_sim_val;
+          }
+
+          cur_mov_img_patch_ncc_vals_[local_patch_idx] =
+            (this->weight_patch_sims_in_combine_ ? cur_wgt : Scalar(1)) * cur_sim_val;
+        }
+        else if (!this->weight_patch_sims_in_combine_ || (std::abs(cur_wgt) > 1.0e-6))
         {
           const cv::Mat& fixed_patch = fixed_scaled_patches_[global_patch_idx];
       
@@ -367,6 +485,9 @@ void xreg::ImgSimMetric2DPatchNCCCPU::process_mask()
     //       we will eventually choose random patches, e.g. we'll still
     //       precompute all information we need from the fixed image
     const size_type num_patches = this->patch_infos_.size();
+
+    fixed_patch_means_.resize(num_patches);
+    fixed_patch_scales_.resize(num_patches);
     
     auto patch_preproc_fn = [&] (const RangeType& r)
     {
@@ -395,6 +516,9 @@ void xreg::ImgSimMetric2DPatchNCCCPU::process_mask()
                                                       use_mask ? &mask_roi : nullptr,
                                                       this->use_mask_for_patch_stats_);
 
+        fixed_patch_means_[patch_idx]  = tmp_mean;
+        fixed_patch_scales_[patch_idx] = Scalar(1) / (tmp_std_dev * tmp_num_patch_elems_for_stats);
+
         for (size_type pr = 0; pr < this->patch_diam_; ++pr)
         {
           Scalar* dst_roi_row = &dst_roi.at<Scalar>(pr,0);
@@ -438,6 +562,78 @@ void xreg::ImgSimMetric2DPatchNCCCPU::process_mask()
     
     init_fixed_img_stats_computed_ = true;
   }
+
+  // the masked sums need to be recomputed whenever the mask changes
+  process_fixed_img_for_integral_imgs(use_mask ? &ocv_mask : nullptr);
+}
+
+void xreg::ImgSimMetric2DPatchNCCCPU::process_fixed_img_for_integral_imgs(cv::Mat* mask)
+{
+  if (mask)
+  {
+    cv::Mat not_masked = *mask != 0;
+    not_masked.convertTo(mask_wgts_img_, cv::DataType<Scalar>::type, 1.0 / 255.0);
+
+    fixed_masked_img_ = fixed_ocv_img_.mul(mask_wgts_img_);
+
+    cv::integral(mask_wgts_img_, mask_count_int_img_, CV_64F);
+  }
+  else
+  {
+    mask_wgts_img_.release();
+    mask_count_int_img_.release();
+
+    fixed_masked_img_ = fixed_ocv_img_;
+  }
+
+  cv::Mat fixed_masked_int_img;
+  cv::integral(fixed_masked_img_, fixed_masked_int_img, CV_64F);
+
+  const size_type num_patches = this->patch_infos_.size();
+
+  fixed_patch_masked_sums_.resize(num_patches);
+
+  for (size_type patch_idx = 0; patch_idx < num_patches; ++patch_idx)
+  {
+    const PatchInfo& patch_info = this->patch_infos_[patch_idx];
+
+    const double num_masked_pix = mask ? IntegralImgPatchSum(mask_count_int_img_, patch_info) :
+                                         static_cast<double>(PatchNumPix(patch_info));
+
+    fixed_patch_masked_sums_[patch_idx] = static_cast<Scalar>(fixed_patch_scales_[patch_idx] *
+                               (IntegralImgPatchSum(fixed_masked_int_img, patch_info) -
+                                (fixed_patch_means_[patch_idx] * num_masked_pix)));
+  }
+}
+
+void xreg::ImgSimMetric2DPatchNCCCPU::compute_mov_img_integral_imgs(const cv::Mat& mov_img)
+{
+  const bool use_mask = !mask_wgts_img_.empty();
+
+  if (use_mask)
+  {
+    cv::multiply(mov_img, mask_wgts_img_, mov_masked_img_);
+  }
+
+  // tables used for the moving patch statistics
+  cv::integral((use_mask && this->use_mask_for_patch_stats_) ? mov_masked_img_ : mov_img,
+               mov_sum_int_img_, mov_sq_sum_int_img_, CV_64F);
+
+  // the masked sums are also needed for the cross term
+  if (use_mask)
+  {
+    if (this->use_mask_for_patch_stats_)
+    {
+      mov_masked_sum_int_img_ = mov_sum_int_img_;
+    }
+    else
+    {
+      cv::integral(mov_masked_img_, mov_masked_sum_int_img_, CV_64F);
+    }
+  }
+
+  cv::multiply(mov_img, fixed_masked_img_, fixed_mov_prod_img_);
+  cv::integral(fixed_mov_prod_img_, fixed_mov_prod_int_img_, CV_64F);
 }
     
 void xreg::ImgSimMetric2DPatchNCCCPU::SimAux::write(H5::Group* h5)
@@ -51,6 +51,10 @@ public:
 
   /// \brief Computation of the similarity metric
   void compute() override;
+
+  /// \brief When randomly sampling patches, this chooses the patches for the
+  ///        next call to compute() and retrieves the pixels covered by them.
+  bool mov_img_pixels_used(PixelIndexList* pix_inds) override;
   
   std::shared_ptr<H5ReadWriteInterface> aux_info() override;
   
@@ -95,11 +99,52 @@ private:
   
   const std::vector<ScalarList>* other_mov_img_patch_vars_ = nullptr;
 
+  /// \brief Variances of the moving image patches, when computed by this
+  ///        object; re-used across calls to compute().
+  ScalarList mov_img_patch_vars_;
+
   std::shared_ptr<SimAux> sim_aux_;
     
   bool init_fixed_img_stats_computed_ = false;
     
   cv::Mat fixed_ocv_img_;
+
+  // The following are used when computing patch sums with integral images
+
+  /// \brief Mean of each fixed image patch
+  ScalarList fixed_patch_means_;
+
+  /// \brief Normalization applied to each zero-mean fixed image patch, e.g.
+  ///        1 / (std. dev. * num. pixels)
+  ScalarList fixed_patch_scales_;
+
+  /// \brief Sum of each normalized fixed image patch over the masked pixels
+  ScalarList fixed_patch_masked_sums_;
+
+  /// \brief One for pixels that are not masked out, zero otherwise; empty when
+  ///        no mask is used
+  cv::Mat mask_wgts_img_;
+
+  /// \brief The fixed image with masked out pixels set to zero
+  cv::Mat fixed_masked_img_;
+
+  /// \brief Integral image of mask_wgts_img_
+  cv::Mat mask_count_int_img_;
+
+  cv::Mat mov_masked_img_;
+  cv::Mat fixed_mov_prod_img_;
+
+  cv::Mat mov_sum_int_img_;
+  cv::Mat mov_sq_sum_int_img_;
+  cv::Mat mov_masked_sum_int_img_;
+  cv::Mat fixed_mov_prod_int_img_;
+
+  /// \brief Computes the fixed image quantities needed for computing patch
+  ///        sums with integral images.
+  void process_fixed_img_for_integral_imgs(cv::Mat* mask);
+
+  /// \brief Computes the integral images of a moving image
+  void compute_mov_img_integral_imgs(const cv::Mat& mov_img);
 };
 
 namespace detail
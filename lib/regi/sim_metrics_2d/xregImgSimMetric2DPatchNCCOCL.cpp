@@ -33,6 +33,8 @@
 #undef vcl_ptrdiff_t
 #endif
 
+#include <boost/compute/algorithm/inclusive_scan.hpp>
+#include <boost/compute/memory/local_buffer.hpp>
 #include <boost/compute/utility/source.hpp>
 
 #include <viennacl/matrix.hpp>
@@ -41,6 +43,8 @@
 
 #include "xregAssert.h"
 #include "xregITKOpenCVUtils.h"
+#include "xregOpenCLMiscKernels.h"
+#include "xregOpenCLProgCache.h"
 
 namespace
 {
@@ -210,6 +214,335 @@ __kernel void ProcMovImagePatches(__global const  float* proc_fixed_img_patches,
 
 );
 
+// Summed area tables are accumulated in double precision, single precision
+// loses too many digits when summing squared intensities over an image.
+const char* kPATCH_NCC_INT_IMG_OPENCL_SRC = BOOST_COMPUTE_STRINGIZE_SOURCE(
+
+// Each integral image has a leading row and column of zeros and stores the
+// sums of the moving image, the squared moving image and the fixed image
+// multiplied by the moving image in x, y, and z, respectively.
+__kernel void IntegralImgRows(__global const float* fixed_img,
+                              __global const float* mov_imgs,
+                              const uint mov_img_off,
+                              const uint num_imgs,
+                              const ulong img_num_cols,
+                              const ulong img_num_rows,
+                              __global double4* int_imgs)
+{
+  const uint row_idx = get_global_id(0);
+  const uint img_idx = get_global_id(1);
+
+  if ((row_idx < img_num_rows) && (img_idx < num_imgs))
+  {
+    const ulong int_img_num_cols = img_num_cols + 1;
+
+    __global double4* cur_int_img = int_imgs + (img_idx * (img_num_rows + 1) * int_img_num_cols);
+
+    const double4 zero = (double4) (0, 0, 0, 0);
+
+    if (!row_idx)
+    {
+      for (ulong c = 0; c < int_img_num_cols; ++c)
+      {
+        cur_int_img[c] = zero;
+      }
+    }
+
+    __global double4* dst_row = cur_int_img + ((row_idx + 1) * int_img_num_cols);
+
+    __global const float* mov_row = mov_imgs + ((mov_img_off + img_idx) * img_num_rows * img_num_cols) +
+                                      (row_idx * img_num_cols);
+
+    __global const float* fixed_row = fixed_img + (row_idx * img_num_cols);
+
+    double4 row_sums = zero;
+    dst_row[0] = row_sums;
+
+    for (ulong c = 0; c < img_num_cols; ++c)
+    {
+      const double m = mov_row[c];
+
+      row_sums += (double4) (m, m * m, fixed_row[c] * m, 0);
+
+      dst_row[c + 1] = row_sums;
+    }
+  }
+}
+
+// Adjacent work items process adjacent columns, so the reads/writes of each
+// row are coalesced
+__kernel void IntegralImgCols(const uint num_imgs,
+                              const ulong img_num_cols,
+                              const ulong img_num_rows,
+                              __global double4* int_imgs)
+{
+  const uint col_idx = get_global_id(0);
+  const uint img_idx = get_global_id(1);
+
+  const ulong int_img_num_cols = img_num_cols + 1;
+
+  if ((col_idx < int_img_num_cols) && (img_idx < num_imgs))
+  {
+    __global double4* cur_int_col = int_imgs + (img_idx * (img_num_rows + 1) * int_img_num_cols) + col_idx;
+
+    for (ulong r = 1; r <= img_num_rows; ++r)
+    {
+      cur_int_col[r * int_img_num_cols] += cur_int_col[(r - 1) * int_img_num_cols];
+    }
+  }
+}
+
+__kernel void ProcMovImagePatchesIntegral(const ulong num_patches,
+                                          const uint num_imgs,
+                                          const uint out_img_off,
+                                          const ulong img_num_cols,
+                                          const ulong img_num_rows,
+                                          __global const uint4* patch_start_stop_infos,
+                                          __global const float2* fixed_img_patch_means_and_std_devs,
+                                          __global const double4* int_imgs,
+                                          __global float* patch_nccs,
+                                          __global const ulong* global_patch_idx_lut)
+{
+  const uint patch_idx_inc = get_global_size(0);
+  const uint img_idx       = get_global_id(1);
+
+  if (img_idx < num_imgs)
+  {
+    const ulong int_img_num_cols = img_num_cols + 1;
+
+    __global const double4* cur_int_img = int_imgs + (img_idx * (img_num_rows + 1) * int_img_num_cols);
+
+    __global float* cur_img_nccs = patch_nccs + ((out_img_off + img_idx) * num_patches);
+
+    for (uint local_patch_idx = get_global_id(0); local_patch_idx < num_patches; local_patch_idx += patch_idx_inc)
+    {
+      const ulong global_patch_idx = global_patch_idx_lut[local_patch_idx];
+
+      const uint4 cur_patch_info = patch_start_stop_infos[global_patch_idx];
+    
+      const uint patch_start_row = cur_patch_info.x;
+      const uint patch_start_col = cur_patch_info.y;
+      const uint patch_stop_row  = cur_patch_info.z;
+      const uint patch_stop_col  = cur_patch_info.w;
+
+      const double4 sums = cur_int_img[((patch_stop_row + 1) * int_img_num_cols) + patch_stop_col + 1] -
+                           cur_int_img[(patch_start_row * int_img_num_cols) + patch_stop_col + 1] -
+                           cur_int_img[((patch_stop_row + 1) * int_img_num_cols) + patch_start_col] +
+                           cur_int_img[(patch_start_row * int_img_num_cols) + patch_start_col];
+
+      const double n = (patch_stop_row - patch_start_row + 1) * (patch_stop_col - patch_start_col + 1);
+
+      const double mov_mean = sums.x / n;
+
+      const double mov_std_dev = max(sqrt(max((sums.y - (sums.x * mov_mean)) / (n - 1), 0.0)), 1.0e-6);
+
+      const float2 fixed_mean_std_dev = fixed_img_patch_means_and_std_devs[global_patch_idx];
+
+      // sum of (f - mean_f) * (m - mean_m) reduces to sum(f * m) - mean_f * sum(m)
+      const double ncc = (sums.z - (fixed_mean_std_dev.x * sums.x)) /
+                            (fixed_mean_std_dev.y * n * mov_std_dev);
+
+      cur_img_nccs[local_patch_idx] = 1 - ((float) ncc);
+    }
+  }
+}
+
+);
+
+const char* kPATCH_SAMPLE_OPENCL_SRC = BOOST_COMPUTE_STRINGIZE_SOURCE(
+
+uint xregPatchSampleHash(uint x)
+{
+  x = (x ^ 61u) ^ (x >> 16);
+  x *= 9u;
+  x = x ^ (x >> 4);
+  x *= 0x27d4eb2du;
+  x = x ^ (x >> 15);
+
+  return x;
+}
+
+// uniform sample in [0,1) determined by a seed and a counter
+float xregPatchSampleUniform(const uint seed, const uint ctr)
+{
+  return (xregPatchSampleHash(seed ^ xregPatchSampleHash(ctr)) >> 8) * (1.0f / 16777216.0f);
+}
+
+// (row, col) of a patch center, consistent with PatchInfo::center_row_col()
+float2 xregPatchCenter(const uint4 p)
+{
+  return (float2) (p.x + ((p.z - p.x + 1) / 2), p.y + ((p.w - p.y + 1) / 2));
+}
+
+// Chooses patches with probabilities proportional to their weights, rejecting
+// candidates closer than the minimum separation to chosen patches, and writes
+// the weights of the chosen patches. A single work-group is launched, with a
+// power of two size. Candidates are drawn in rounds, one per work item; each
+// work item tests its candidate against the patches chosen in previous rounds,
+// then the first work item accepts the remaining candidates in order, testing
+// each against the patches accepted earlier in the same round.
+__kernel void SampleRandPatches(__global const float* patch_wgts,
+                                __global const float* patch_wgts_cdf,
+                                __global const uint4* patch_start_stop_infos,
+                                const uint num_all_patches,
+                                const uint num_to_choose,
+                                const float min_sep_dist_sq,
+                                const uint max_sep_rounds,
+                                const uint seed,
+                                const uint use_patch_wgts,
+                                const uint normalize_wgts,
+                                __global ulong* patch_inds_to_use,
+                                __global float* wgts_to_use,
+                                __global float2* chosen_centers,
+                                __local uint* cand_inds,
+                                __local float* scratch)
+{
+  const uint lid   = get_local_id(0);
+  const uint lsize = get_local_size(0);
+
+  const float tot_wgt = patch_wgts_cdf[num_all_patches - 1];
+
+  __local uint num_chosen;
+
+  if (lid == 0)
+  {
+    num_chosen = 0;
+  }
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for (uint round = 0; num_chosen < num_to_choose; ++round)
+  {
+    // the separation is no longer enforced once the rounds are exhausted,
+    // e.g. when it cannot be satisfied by the requested number of patches
+    const bool enforce_sep = (min_sep_dist_sq > 0) && (round < max_sep_rounds);
+
+    // find the first patch with a prefix sum greater than the sample
+    const float u = xregPatchSampleUniform(seed, (round * lsize) + lid) * tot_wgt;
+
+    uint lo = 0;
+    uint hi = num_all_patches - 1;
+
+    while (lo < hi)
+    {
+      const uint mid = (lo + hi) / 2;
+
+      if (patch_wgts_cdf[mid] > u)
+      {
+        hi = mid;
+      }
+      else
+      {
+        lo = mid + 1;
+      }
+    }
+
+    bool accept = true;
+
+    if (enforce_sep)
+    {
+      const float2 cand_center = xregPatchCenter(patch_start_stop_infos[lo]);
+
+      for (uint i = 0; accept && (i < num_chosen); ++i)
+      {
+        const float2 d = chosen_centers[i] - cand_center;
+
+        accept = dot(d, d) >= min_sep_dist_sq;
+      }
+    }
+
+    cand_inds[lid] = accept ? lo : UINT_MAX;
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if (lid == 0)
+    {
+      const uint round_start = num_chosen;
+
+      uint n = num_chosen;
+
+      for (uint k = 0; (k < lsize) && (n < num_to_choose); ++k)
+      {
+        const uint cand_idx = cand_inds[k];
+
+        if (cand_idx != UINT_MAX)
+        {
+          const float2 cand_center = xregPatchCenter(patch_start_stop_infos[cand_idx]);
+
+          bool ok = true;
+
+          if (enforce_sep)
+          {
+            for (uint i = round_start; ok && (i < n); ++i)
+            {
+              const float2 d = chosen_centers[i] - cand_center;
+
+              ok = dot(d, d) >= min_sep_dist_sq;
+            }
+          }
+
+          if (ok)
+          {
+            patch_inds_to_use[n] = cand_idx;
+            chosen_centers[n]    = cand_center;
+            ++n;
+          }
+        }
+      }
+
+      num_chosen = n;
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE | CLK_GLOBAL_MEM_FENCE);
+  }
+
+  float wgt_sum = 0;
+
+  for (uint i = lid; i < num_to_choose; i += lsize)
+  {
+    const float w = use_patch_wgts ? patch_wgts[patch_inds_to_use[i]] : 1.0f;
+
+    wgts_to_use[i] = w;
+
+    wgt_sum += w;
+  }
+
+  wgt_sum = WorkGroupSum(wgt_sum, scratch);
+
+  if (normalize_wgts)
+  {
+    for (uint i = lid; i < num_to_choose; i += lsize)
+    {
+      wgts_to_use[i] /= wgt_sum;
+    }
+  }
+}
+
+);
+
+std::string PatchSampleProgSrc()
+{
+  return std::string(WorkGroupSumFnSrc) + kPATCH_SAMPLE_OPENCL_SRC;
+}
+
+std::string PatchNCCIntImgProgSrc()
+{
+  return std::string("#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n") + kPATCH_NCC_INT_IMG_OPENCL_SRC;
+}
+
+/// \brief Preferred work-group size of the patch sampling kernel, e.g. the
+///        number of candidates drawn in each round
+constexpr std::size_t kPATCH_SAMPLE_WORK_GROUP_SIZE = 256;
+
+/// \brief Number of sampling rounds after which the minimum separation of the
+///        random patches is no longer enforced
+constexpr unsigned int kPATCH_SAMPLE_MAX_SEP_ROUNDS = 64;
+
+// Upper bound on the memory used for the integral images, the moving images
+// are processed in batches when the integral images of all moving images
+// exceed this.
+constexpr std::size_t kMAX_INT_IMGS_BYTES = 256 * 1024 * 1024;
+
 }  // un-named
 
 xreg::ImgSimMetric2DPatchNCCOCL::ImgSimMetric2DPatchNCCOCL(const boost::compute::device& dev)
@@ -221,6 +554,18 @@ xreg::ImgSimMetric2DPatchNCCOCL::ImgSimMetric2DPatchNCCOCL(const boost::compute:
   : ImgSimMetric2DOCL(ctx, queue)
 { }
 
+void xreg::ImgSimMetric2DPatchNCCOCL::prebuild_progs()
+{
+  BuildOpenCLProg(kPATCH_NCC_OPENCL_SRC, this->ctx_);
+
+  BuildOpenCLProg(PatchSampleProgSrc(), this->ctx_);
+
+  if (this->use_integral_imgs_ && this->queue_.get_device().supports_extension("cl_khr_fp64"))
+  {
+    BuildOpenCLProg(PatchNCCIntImgProgSrc(), this->ctx_);
+  }
+}
+
 void xreg::ImgSimMetric2DPatchNCCOCL::allocate_resources()
 {
   namespace bc = boost::compute;
@@ -280,22 +625,49 @@ void xreg::ImgSimMetric2DPatchNCCOCL::allocate_resources()
   }
 
   // compile, and create custom kernels
-  bc::program prog = bc::program::create_with_source(kPATCH_NCC_OPENCL_SRC, this->ctx_);
+  bc::program prog = BuildOpenCLProg(kPATCH_NCC_OPENCL_SRC, this->ctx_);
   
-  try
+  fixed_img_stats_krnl_        = prog.create_kernel("FixedImagePatchStats");
+  fixed_img_proc_patches_krnl_ = prog.create_kernel("ProcFixedImagePatches");
+  proc_mov_img_patches_krnl_   = prog.create_kernel("ProcMovImagePatches");
+
+  sample_patches_krnl_ = BuildOpenCLProg(PatchSampleProgSrc(), this->ctx_).create_kernel("SampleRandPatches");
+
+  sample_patches_wg_size_ = this->pow2_work_group_size(sample_patches_krnl_,
+                                                       kPATCH_SAMPLE_WORK_GROUP_SIZE);
+
+  patch_wgts_dev_.reset(new DevBuf(num_patches, this->ctx_));
+  patch_wgts_cdf_dev_.reset(new DevBuf(num_patches, this->ctx_));
+  chosen_patch_centers_dev_.reset(new DevBufFloat2(this->ctx_));
+
+  // forces the upload of the weights before the first sampling
+  patch_wgts_dev_update_count_ = this->patch_wgts_update_count_ - 1;
+
+  // integral images require double precision support
+  int_imgs_supported_ = this->use_integral_imgs_ &&
+                        this->queue_.get_device().supports_extension("cl_khr_fp64");
+
+  if (int_imgs_supported_)
   {
-    prog.build();
+    bc::program int_img_prog = BuildOpenCLProg(PatchNCCIntImgProgSrc(), this->ctx_);
+
+    int_img_rows_krnl_             = int_img_prog.create_kernel("IntegralImgRows");
+    int_img_cols_krnl_             = int_img_prog.create_kernel("IntegralImgCols");
+    proc_mov_img_patches_int_krnl_ = int_img_prog.create_kernel("ProcMovImagePatchesIntegral");
+
+    const size_type int_img_num_bytes = (img_num_rows_ + 1) * (img_num_cols_ + 1) * sizeof(bc::double4_);
+
+    max_num_int_imgs_ = std::max(size_type(1), std::min(size_type(this->num_mov_imgs_),
+                                                        size_type(kMAX_INT_IMGS_BYTES / int_img_num_bytes)));
+
+    int_imgs_dev_.reset(new DevBufDouble4(this->ctx_));
+    int_imgs_dev_->resize(max_num_int_imgs_ * (img_num_rows_ + 1) * (img_num_cols_ + 1), this->queue_);
   }
-  catch (bc::opencl_error &)
+  else
   {
-    std::cerr << "OpenCL Kernel Compile Error (ImgSimMetric2DPatchNCCOCL):\n"
-              << prog.build_log() << std::endl;
-    throw;
+    int_imgs_dev_.reset();
+    max_num_int_imgs_ = 0;
   }
-  
-  fixed_img_stats_krnl_        = prog.create_kernel("FixedImagePatchStats");
-  fixed_img_proc_patches_krnl_ = prog.create_kernel("ProcFixedImagePatches");
-  proc_mov_img_patches_krnl_   = prog.create_kernel("ProcMovImagePatches");
 
   fixed_img_stats_proc_done_ = false;
   
@@ -304,6 +676,18 @@ void xreg::ImgSimMetric2DPatchNCCOCL::allocate_resources()
   ImgSimMetric2DOCL::allocate_resources();
 }
 
+bool xreg::ImgSimMetric2DPatchNCCOCL::mov_img_pixels_used(PixelIndexList* pix_inds)
+{
+  cv::Mat ocv_mask;
+  if (this->mask_)
+  {
+    ocv_mask = ShallowCopyItkToOpenCV(this->mask_.GetPointer());
+  }
+
+  return this->patch_pixels_used(this->mask_ ? &ocv_mask : nullptr,
+                                 img_num_rows_, img_num_cols_, pix_inds);
+}
+
 void xreg::ImgSimMetric2DPatchNCCOCL::compute()
 {
   namespace bc  = boost::compute;
@@ -326,71 +710,98 @@ void xreg::ImgSimMetric2DPatchNCCOCL::compute()
   // This uses some state to determine if the weights actually need to be recomputed
   this->compute_weights(this->mask_ ? &ocv_mask : nullptr);
 
-  if (!this->do_not_update_patch_inds_to_use_)
+  if (dev_patches_src_)
   {
-    // this is where random patches are sampled
-    this->patch_inds_to_use_ = this->patch_indices_to_use();
-  }
- 
-  // copy the patch indices and weights to use onto the GPU
-  patch_inds_to_use_host_.clear();
+    // the patches were chosen by another metric, copy them without leaving the device
+    xregASSERT(dev_patches_src_->queue_.get() == this->queue_.get());
+
+    this->queue_.enqueue_copy_buffer(dev_patches_src_->patch_inds_to_use_dev_->get_buffer(),
+                                     patch_inds_to_use_dev_->get_buffer(), 0, 0,
+                                     num_patches * sizeof(bc::ulong_));
 
-  for (const auto& p : this->patch_inds_to_use_)
+    this->queue_.enqueue_copy_buffer(dev_patches_src_->wgts_to_use_dev_->get_buffer(),
+                                     wgts_to_use_dev_->get_buffer(), 0, 0,
+                                     num_patches * sizeof(float));
+  }
+  else if (sample_rand_patches_on_dev_ && this->choose_rand_patches_ &&
+           !this->do_not_update_patch_inds_to_use_ && !this->patch_inds_to_use_pre_chosen_)
   {
-    patch_inds_to_use_host_.push_back(p);
+    sample_rand_patches_on_dev_impl(num_patches);
   }
+  else
+  {
+    // this is where random patches are sampled, unless they were sampled ahead
+    // of time by mov_img_pixels_used()
+    this->update_patch_inds_to_use();
+ 
+    // copy the patch indices and weights to use onto the GPU
+    patch_inds_to_use_host_.clear();
+
+    for (const auto& p : this->patch_inds_to_use_)
+    {
+      patch_inds_to_use_host_.push_back(p);
+    }
 
-  bc::copy(patch_inds_to_use_host_.begin(), patch_inds_to_use_host_.end(),
-           patch_inds_to_use_dev_->begin(), this->queue_);
+    bc::copy(patch_inds_to_use_host_.begin(), patch_inds_to_use_host_.end(),
+             patch_inds_to_use_dev_->begin(), this->queue_);
   
-  wgts_to_use_host_.clear();
+    wgts_to_use_host_.clear();
  
-  Scalar tot_wgt = 0;
-  if (this->weight_patch_sims_in_combine_)
-  {
-    for (const auto& p : this->patch_inds_to_use_)
+    Scalar tot_wgt = 0;
+    if (this->weight_patch_sims_in_combine_)
     {
-      const auto& w = this->patch_infos_[p].weight;
+      for (const auto& p : this->patch_inds_to_use_)
+      {
+        const auto& w = this->patch_infos_[p].weight;
 
-      tot_wgt += w;
+        tot_wgt += w;
 
-      wgts_to_use_host_.push_back(w);
+        wgts_to_use_host_.push_back(w);
+      }
+    }
+    else
+    {
+      wgts_to_use_host_.assign(num_patches, 1);
+      tot_wgt = num_patches;
     }
-  }
-  else
-  {
-    wgts_to_use_host_.assign(num_patches, 1);
-    tot_wgt = num_patches;
-  }
 
-  if (this->compute_mean_of_patch_sims_ || this->weight_patch_sims_in_combine_)
-  {
-    for (auto& w : wgts_to_use_host_)
+    if (this->compute_mean_of_patch_sims_ || this->weight_patch_sims_in_combine_)
     {
-      w /= tot_wgt;
+      for (auto& w : wgts_to_use_host_)
+      {
+        w /= tot_wgt;
+      }
     }
-  }
 
-  bc::copy(wgts_to_use_host_.begin(), wgts_to_use_host_.end(),
-           wgts_to_use_dev_->begin(), this->queue_);
+    bc::copy(wgts_to_use_host_.begin(), wgts_to_use_host_.end(),
+             wgts_to_use_dev_->begin(), this->queue_);
+  }
 
   // TODO: it would be really nice to have to some state that avoids transferring the 
   //       patches used and/or weights when they are unchanged.
 
-  proc_mov_img_patches_krnl_.set_arg(0, *proc_fixed_img_patches_dev_);
-  proc_mov_img_patches_krnl_.set_arg(1, bc::ulong_(fixed_img_proc_patches_max_len_));
-  proc_mov_img_patches_krnl_.set_arg(2, bc::ulong_(num_patches));
-  proc_mov_img_patches_krnl_.set_arg(3, bc::uint_(this->num_mov_imgs_));
-  proc_mov_img_patches_krnl_.set_arg(4, bc::uint_(this->proj_off_));
-  proc_mov_img_patches_krnl_.set_arg(5, bc::ulong_(img_num_cols_));
-  proc_mov_img_patches_krnl_.set_arg(6, bc::ulong_(img_num_rows_));
-  proc_mov_img_patches_krnl_.set_arg(7, *patch_start_stops_dev_);
-  proc_mov_img_patches_krnl_.set_arg(8, *this->mov_imgs_buf_);
-  proc_mov_img_patches_krnl_.set_arg(9, *patch_nccs_dev_);
-  proc_mov_img_patches_krnl_.set_arg(10, *patch_inds_to_use_dev_);
-
-  std::array<std::size_t,2> global_size = { num_patches, this->num_mov_imgs_ };
-  this->queue_.enqueue_nd_range_kernel(proc_mov_img_patches_krnl_, 2, nullptr, global_size.data(), nullptr).wait();
+  if (int_imgs_supported_ && this->integral_imgs_cheaper(num_patches, img_num_rows_ * img_num_cols_))
+  {
+    compute_patch_nccs_with_int_imgs(num_patches);
+  }
+  else
+  {
+    proc_mov_img_patches_krnl_.set_arg(0, *proc_fixed_img_patches_dev_);
+    proc_mov_img_patches_krnl_.set_arg(1, bc::ulong_(fixed_img_proc_patches_max_len_));
+    proc_mov_img_patches_krnl_.set_arg(2, bc::ulong_(num_patches));
+    proc_mov_img_patches_krnl_.set_arg(3, bc::uint_(this->num_mov_imgs_));
+    proc_mov_img_patches_krnl_.set_arg(4, bc::uint_(this->proj_off_));
+    proc_mov_img_patches_krnl_.set_arg(5, bc::ulong_(img_num_cols_));
+    proc_mov_img_patches_krnl_.set_arg(6, bc::ulong_(img_num_rows_));
+    proc_mov_img_patches_krnl_.set_arg(7, *patch_start_stops_dev_);
+    proc_mov_img_patches_krnl_.set_arg(8, *this->mov_imgs_buf_);
+    proc_mov_img_patches_krnl_.set_arg(9, *patch_nccs_dev_);
+    proc_mov_img_patches_krnl_.set_arg(10, *patch_inds_to_use_dev_);
+
+    std::array<std::size_t,2> global_size = { num_patches, this->num_mov_imgs_ };
+    this->enqueue_kernel_tuned(proc_mov_img_patches_krnl_, "ProcMovImagePatches",
+                               2, global_size.data()).wait();
+  }
 
   // compute weighted sums, averages, whichever
 
@@ -406,6 +817,131 @@ void xreg::ImgSimMetric2DPatchNCCOCL::compute()
   bc::copy(sim_vals_dev_->begin(), sim_vals_dev_->end(), this->sim_vals_.begin(), this->queue_);
 }
 
+void xreg::ImgSimMetric2DPatchNCCOCL::set_sample_rand_patches_on_dev(const bool on_dev)
+{
+  sample_rand_patches_on_dev_ = on_dev;
+}
+
+bool xreg::ImgSimMetric2DPatchNCCOCL::sample_rand_patches_on_dev() const
+{
+  return sample_rand_patches_on_dev_;
+}
+
+void xreg::ImgSimMetric2DPatchNCCOCL::set_dev_patches_src(const ImgSimMetric2DPatchNCCOCL* src)
+{
+  dev_patches_src_ = src;
+}
+
+void xreg::ImgSimMetric2DPatchNCCOCL::sample_rand_patches_on_dev_impl(const size_type num_patches)
+{
+  namespace bc = boost::compute;
+
+  const size_type num_all_patches = this->patch_infos_.size();
+
+  xregASSERT(num_patches < num_all_patches);
+
+  if (patch_wgts_dev_update_count_ != this->patch_wgts_update_count_)
+  {
+    // the weights have changed, upload them and compute the distribution used for sampling
+    std::vector<float> patch_wgts_host(num_all_patches);
+
+    for (size_type patch_idx = 0; patch_idx < num_all_patches; ++patch_idx)
+    {
+      patch_wgts_host[patch_idx] = this->patch_infos_[patch_idx].weight;
+    }
+
+    bc::copy(patch_wgts_host.begin(), patch_wgts_host.end(), patch_wgts_dev_->begin(), this->queue_);
+
+    bc::inclusive_scan(patch_wgts_dev_->begin(), patch_wgts_dev_->end(),
+                       patch_wgts_cdf_dev_->begin(), this->queue_);
+
+    patch_wgts_dev_update_count_ = this->patch_wgts_update_count_;
+  }
+
+  if (chosen_patch_centers_dev_->size() < num_patches)
+  {
+    chosen_patch_centers_dev_->resize(num_patches, this->queue_);
+  }
+
+  const double min_sep_dist = (this->rand_patch_min_pixels_sep_ < 0) ?
+                                std::sqrt(2.0 * this->patch_radius_ * this->patch_radius_) :
+                                this->rand_patch_min_pixels_sep_;
+
+  // same as the host, a separation that is effectively zero is not checked
+  const float min_sep_dist_sq = (min_sep_dist > 1.0e-8) ?
+                                  static_cast<float>(min_sep_dist * min_sep_dist) : 0.0f;
+
+  sample_patches_krnl_.set_arg(0, *patch_wgts_dev_);
+  sample_patches_krnl_.set_arg(1, *patch_wgts_cdf_dev_);
+  sample_patches_krnl_.set_arg(2, *patch_start_stops_dev_);
+  sample_patches_krnl_.set_arg(3, bc::uint_(num_all_patches));
+  sample_patches_krnl_.set_arg(4, bc::uint_(num_patches));
+  sample_patches_krnl_.set_arg(5, min_sep_dist_sq);
+  sample_patches_krnl_.set_arg(6, bc::uint_(kPATCH_SAMPLE_MAX_SEP_ROUNDS));
+  sample_patches_krnl_.set_arg(7, bc::uint_(this->rng_eng_()));
+  sample_patches_krnl_.set_arg(8, bc::uint_(this->weight_patch_sims_in_combine_ ? 1 : 0));
+  sample_patches_krnl_.set_arg(9, bc::uint_((this->compute_mean_of_patch_sims_ ||
+                                             this->weight_patch_sims_in_combine_) ? 1 : 0));
+  sample_patches_krnl_.set_arg(10, *patch_inds_to_use_dev_);
+  sample_patches_krnl_.set_arg(11, *wgts_to_use_dev_);
+  sample_patches_krnl_.set_arg(12, *chosen_patch_centers_dev_);
+  sample_patches_krnl_.set_arg(13, bc::local_buffer<bc::uint_>(sample_patches_wg_size_));
+  sample_patches_krnl_.set_arg(14, bc::local_buffer<float>(sample_patches_wg_size_));
+
+  const std::size_t global_size = sample_patches_wg_size_;
+
+  this->enqueue_kernel(sample_patches_krnl_, 1, &global_size, &global_size);
+}
+
+void xreg::ImgSimMetric2DPatchNCCOCL::compute_patch_nccs_with_int_imgs(const size_type num_patches)
+{
+  namespace bc = boost::compute;
+
+  int_img_rows_krnl_.set_arg(0, *this->fixed_img_ocl_buf_);
+  int_img_rows_krnl_.set_arg(1, *this->mov_imgs_buf_);
+  int_img_rows_krnl_.set_arg(4, bc::ulong_(img_num_cols_));
+  int_img_rows_krnl_.set_arg(5, bc::ulong_(img_num_rows_));
+  int_img_rows_krnl_.set_arg(6, *int_imgs_dev_);
+
+  int_img_cols_krnl_.set_arg(1, bc::ulong_(img_num_cols_));
+  int_img_cols_krnl_.set_arg(2, bc::ulong_(img_num_rows_));
+  int_img_cols_krnl_.set_arg(3, *int_imgs_dev_);
+
+  proc_mov_img_patches_int_krnl_.set_arg(0, bc::ulong_(num_patches));
+  proc_mov_img_patches_int_krnl_.set_arg(3, bc::ulong_(img_num_cols_));
+  proc_mov_img_patches_int_krnl_.set_arg(4, bc::ulong_(img_num_rows_));
+  proc_mov_img_patches_int_krnl_.set_arg(5, *patch_start_stops_dev_);
+  proc_mov_img_patches_int_krnl_.set_arg(6, *fixed_img_patch_stats_dev_);
+  proc_mov_img_patches_int_krnl_.set_arg(7, *int_imgs_dev_);
+  proc_mov_img_patches_int_krnl_.set_arg(8, *patch_nccs_dev_);
+  proc_mov_img_patches_int_krnl_.set_arg(9, *patch_inds_to_use_dev_);
+
+  // process the moving images in batches that fit into the integral images buffer
+  for (size_type batch_start = 0; batch_start < this->num_mov_imgs_; batch_start += max_num_int_imgs_)
+  {
+    const size_type num_imgs = std::min(max_num_int_imgs_, this->num_mov_imgs_ - batch_start);
+
+    int_img_rows_krnl_.set_arg(2, bc::uint_(this->proj_off_ + batch_start));
+    int_img_rows_krnl_.set_arg(3, bc::uint_(num_imgs));
+
+    // the column pass accumulates in-place, so these are not launched with
+    // enqueue_kernel_tuned() which may launch a kernel repeatedly
+    std::array<std::size_t,2> global_size = { img_num_rows_, num_imgs };
+    this->enqueue_kernel(int_img_rows_krnl_, 2, global_size.data(), nullptr);
+
+    int_img_cols_krnl_.set_arg(0, bc::uint_(num_imgs));
+
+    global_size = { img_num_cols_ + 1, num_imgs };
+    this->enqueue_kernel(int_img_cols_krnl_, 2, global_size.data(), nullptr);
+
+    proc_mov_img_patches_int_krnl_.set_arg(1, bc::uint_(num_imgs));
+    proc_mov_img_patches_int_krnl_.set_arg(2, bc::uint_(batch_start));
+
+    global_size = { num_patches, num_imgs };
+    this->enqueue_kernel(proc_mov_img_patches_int_krnl_, 2, global_size.data(), nullptr).wait();
+  }
+}
+
 void xreg::ImgSimMetric2DPatchNCCOCL::process_mask()
 {
   namespace bc = boost::compute;
@@ -430,7 +966,7 @@ void xreg::ImgSimMetric2DPatchNCCOCL::process_mask()
 
     std::size_t global_size = num_patches;
 
-    this->queue_.enqueue_nd_range_kernel(fixed_img_stats_krnl_, 1, nullptr, &global_size, nullptr).wait();
+    this->enqueue_kernel(fixed_img_stats_krnl_, 1, &global_size, nullptr).wait();
 
     // pre-process the fixed image patches using the mean and std. devs.
     proc_fixed_img_patches_dev_.reset(new DevBuf(this->ctx_));
@@ -445,7 +981,7 @@ void xreg::ImgSimMetric2DPatchNCCOCL::process_mask()
     fixed_img_proc_patches_krnl_.set_arg(5, *fixed_img_patch_stats_dev_);
     fixed_img_proc_patches_krnl_.set_arg(6, *patch_start_stops_dev_);
 
-    this->queue_.enqueue_nd_range_kernel(fixed_img_proc_patches_krnl_, 1, nullptr, &global_size, nullptr).wait();
+    this->enqueue_kernel(fixed_img_proc_patches_krnl_, 1, &global_size, nullptr).wait();
 
     // allocate maximum capacity buffers for storing which patches to use
     // and the patch weights
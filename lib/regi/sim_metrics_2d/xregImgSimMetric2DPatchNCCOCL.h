@@ -51,8 +51,42 @@ public:
 
   void allocate_resources() override;
 
+  void prebuild_progs() override;
+
   void compute() override;
 
+  /// \brief When randomly sampling patches, this chooses the patches for the
+  ///        next call to compute() and retrieves the pixels covered by them.
+  bool mov_img_pixels_used(PixelIndexList* pix_inds) override;
+
+  /// \brief Sample the random patches, and normalize their weights, on the
+  ///        device.
+  ///
+  /// When random patches are chosen (see set_choose_rand_patches()), the
+  /// patches are drawn with probabilities proportional to their weights and
+  /// candidates closer than the minimum separation to a chosen patch are
+  /// rejected, as on the host, but by a kernel which also writes the
+  /// normalized weights of the chosen patches. The patch weights are only
+  /// uploaded when they change, so resampling the patches for every
+  /// computation adds no host work or transfers. When the separation cannot be
+  /// satisfied after a bounded number of sampling rounds, the remaining
+  /// patches are chosen without enforcing it.
+  /// The patches are still chosen on the host when they need to be known
+  /// ahead of time, e.g. by mov_img_pixels_used() or set_patches_to_use().
+  /// Defaults to false.
+  void set_sample_rand_patches_on_dev(const bool on_dev);
+
+  bool sample_rand_patches_on_dev() const;
+
+  /// \brief Use the patches, and weights, most recently used by another
+  ///        metric.
+  ///
+  /// The other metric must share this object's command queue and must be
+  /// computed before this object. This allows a pair of metrics to use the
+  /// same patches sampled on the device, e.g. for each gradient direction.
+  /// Set to null to choose the patches using this object's settings.
+  void set_dev_patches_src(const ImgSimMetric2DPatchNCCOCL* src);
+
 protected:
   void process_mask() override;
 
@@ -66,6 +100,7 @@ private:
   using DevBufUInt4  = boost::compute::vector<boost::compute::uint4_>;
   using DevBufFloat2 = boost::compute::vector<boost::compute::float2_>;
   using DevBufULong  = boost::compute::vector<boost::compute::ulong_>;
+  using DevBufDouble4 = boost::compute::vector<boost::compute::double4_>;
 
   std::unique_ptr<DevBufUInt4> patch_start_stops_dev_;
   std::unique_ptr<DevBufFloat2> fixed_img_patch_stats_dev_;
@@ -85,7 +120,48 @@ private:
   boost::compute::kernel fixed_img_stats_krnl_;
   boost::compute::kernel proc_mov_img_patches_krnl_;
 
+  bool sample_rand_patches_on_dev_ = false;
+
+  const ImgSimMetric2DPatchNCCOCL* dev_patches_src_ = nullptr;
+
+  /// \brief The weights of every patch and their inclusive prefix sums, used
+  ///        for sampling patches on the device.
+  std::unique_ptr<DevBuf> patch_wgts_dev_;
+  std::unique_ptr<DevBuf> patch_wgts_cdf_dev_;
+
+  /// \brief The value of patch_wgts_update_count_ when patch_wgts_dev_ was
+  ///        last updated.
+  size_type patch_wgts_dev_update_count_ = 0;
+
+  std::unique_ptr<DevBufFloat2> chosen_patch_centers_dev_;
+
+  boost::compute::kernel sample_patches_krnl_;
+
+  std::size_t sample_patches_wg_size_ = 0;
+
+  /// \brief Chooses random patches, and computes their normalized weights,
+  ///        on the device.
+  void sample_rand_patches_on_dev_impl(const size_type num_patches);
+
   bool fixed_img_stats_proc_done_ = false;
+
+  /// \brief Indicates that the device supports the (double precision)
+  ///        integral images and that they are enabled.
+  bool int_imgs_supported_ = false;
+
+  /// \brief The maximum number of moving images with integral images stored
+  ///        on the device at once.
+  size_type max_num_int_imgs_ = 0;
+
+  std::unique_ptr<DevBufDouble4> int_imgs_dev_;
+
+  boost::compute::kernel int_img_rows_krnl_;
+  boost::compute::kernel int_img_cols_krnl_;
+  boost::compute::kernel proc_mov_img_patches_int_krnl_;
+
+  /// \brief Computes the NCC of each patch using integral images of the
+  ///        moving images.
+  void compute_patch_nccs_with_int_imgs(const size_type num_patches);
 };
 
 }  // xreg
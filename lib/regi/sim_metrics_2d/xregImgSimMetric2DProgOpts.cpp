@@ -36,6 +36,8 @@
 #include "xregImgSimMetric2DPatchNCCOCL.h"
 #include "xregImgSimMetric2DPatchGradNCCCPU.h"
 #include "xregImgSimMetric2DPatchGradNCCOCL.h"
+#include "xregImgSimMetric2DMICPU.h"
+#include "xregImgSimMetric2DMIOCL.h"
 
 namespace  // un-named
 {
@@ -92,3 +94,8 @@ std::shared_ptr<xreg::ImgSimMetric2D> xreg::PatchGradNCCSimMetricFromProgOpts(Pr
 {
   return SimMetricFromProgOptsHelper<ImgSimMetric2DPatchGradNCCCPU,ImgSimMetric2DPatchGradNCCOCL>(po);
 }
+
+std::shared_ptr<xreg::ImgSimMetric2D> xreg::MISimMetricFromProgOpts(ProgOpts& po)
+{
+  return SimMetricFromProgOptsHelper<ImgSimMetric2DMICPU,ImgSimMetric2DMIOCL>(po);
+}
@@ -44,6 +44,8 @@ std::shared_ptr<ImgSimMetric2D> PatchNCCSimMetricFromProgOpts(ProgOpts& po);
 
 std::shared_ptr<ImgSimMetric2D> PatchGradNCCSimMetricFromProgOpts(ProgOpts& po);
 
+std::shared_ptr<ImgSimMetric2D> MISimMetricFromProgOpts(ProgOpts& po);
+
 }  // xreg
 
 #endif
@@ -26,32 +26,6 @@
 
 #include "xregTBBUtils.h"
 
-namespace  // un-named
-{
-
-template <class tDataMat, class tMaskMat>
-void ApplyMaskToEigenMatInPlace(tDataMat* mat, const tMaskMat& mask, const typename tDataMat::Scalar masked_val)
-{
-  tDataMat& m = *mat;
-
-  const unsigned long nr = m.rows();
-  const unsigned long nc = m.cols();
-
-  // cols first, since most eigen objects will be col-major by default
-  for (unsigned long c = 0; c < nc; ++c)
-  {
-    for (unsigned long r = 0; r < nr; ++r)
-    {
-      if (!mask(r,c))
-      {
-        m(r,c) = masked_val;
-      }
-    }
-  }
-}
-
-}  // un-named
-
 void xreg::ImgSimMetric2DSSDCPU::allocate_resources()
 {
   ImgSimMetric2DCPU::allocate_resources();
@@ -61,6 +35,8 @@ void xreg::ImgSimMetric2DSSDCPU::allocate_resources()
 
 void xreg::ImgSimMetric2DSSDCPU::compute()
 {
+  ParallelExecContextScope exec_scope(this->exec_ctx_.get());
+
   this->pre_compute();
 
   const auto itk_size = this->fixed_img_->GetLargestPossibleRegion().GetSize();
@@ -68,19 +44,52 @@ void xreg::ImgSimMetric2DSSDCPU::compute()
   const size_type img_num_cols = itk_size[0];
   const size_type img_num_rows = itk_size[1];
   const size_type img_num_pix  = img_num_cols * img_num_rows;
+
+  const PixelIndexList* pix_inds_list = this->pix_inds_to_use();
+
+  // a random subset of the used pixels is scaled so that its sum estimates the
+  // sum over all of the used pixels
+  double subsample_scale = 1;
+
+  if (this->use_pixel_subsample())
+  {
+    update_fixed_for_pix_inds(pix_inds_list);
+
+    subsample_scale = static_cast<double>(this->num_pix_available_for_subsample()) /
+                                                                pix_inds_list->size();
+  }
+
+  const size_type* pix_inds = pix_inds_list ? pix_inds_list->data() : nullptr;
   
   auto ssd_fn = [&] (const RangeType& r)
   {
     for (size_type range_idx = r.begin(); range_idx < r.end(); ++range_idx)
     {
-      MappedImageVec cur_mov_vec(this->mov_imgs_buf_ + (range_idx * img_num_pix), img_num_pix);
+      const Scalar* cur_mov_buf = this->mov_imgs_buf_ + (range_idx * img_num_pix);
 
-      if (this->mask_)
+      if (pix_inds)
       {
-        ApplyMaskToEigenMatInPlace(&cur_mov_vec, mask_vec_, Scalar(0));
+        // only visit the used pixels, masked out pixels have zero difference
+        const size_type num_used  = fixed_img_vec_.size();
+
+        const Scalar* fixed_buf = fixed_img_vec_.data();
+
+        double ssd = 0;
+
+        for (size_type i = 0; i < num_used; ++i)
+        {
+          const Scalar d = fixed_buf[i] - cur_mov_buf[pix_inds[i]];
+          ssd += d * d;
+        }
+
+        this->sim_vals_[range_idx] = static_cast<Scalar>((ssd * subsample_scale) / img_num_pix);
       }
+      else
+      {
+        const ConstMappedImageVec cur_mov_vec(cur_mov_buf, img_num_pix);
 
-      this->sim_vals_[range_idx] = (fixed_img_vec_ - cur_mov_vec).array().square().sum() / img_num_pix;
+        this->sim_vals_[range_idx] = (fixed_img_vec_ - cur_mov_vec).array().square().sum() / img_num_pix;
+      }
     }
   };
 
@@ -92,19 +101,32 @@ void xreg::ImgSimMetric2DSSDCPU::process_mask()
 {
   ImgSimMetric2DCPU::process_mask();
   
-  auto itk_size = this->fixed_img_->GetLargestPossibleRegion().GetSize();
-
-  const size_type img_num_cols = itk_size[0];
-  const size_type img_num_rows = itk_size[1];
-  const size_type img_num_pix  = img_num_cols * img_num_rows;
+  update_fixed_for_pix_inds(this->mask_ ? &this->mask_pix_inds() : nullptr);
+}
 
-  fixed_img_vec_ = MappedImageVec(this->fixed_img_->GetBufferPointer(), img_num_pix);
+void xreg::ImgSimMetric2DSSDCPU::update_fixed_for_pix_inds(const PixelIndexList* pix_inds)
+{
+  const Scalar* fixed_buf = this->fixed_img_->GetBufferPointer();
 
-  if (this->mask_)
+  if (pix_inds)
   {
-    mask_vec_ = MappedImageMaskVec(this->mask_->GetBufferPointer(), img_num_pix);
+    // gather the fixed pixels used into a compact vector
+    const size_type num_used = pix_inds->size();
+
+    fixed_img_vec_.resize(num_used);
 
-    ApplyMaskToEigenMatInPlace(&fixed_img_vec_, mask_vec_, Scalar(0));
+    for (size_type i = 0; i < num_used; ++i)
+    {
+      fixed_img_vec_(i) = fixed_buf[(*pix_inds)[i]];
+    }
   }
+  else
+  {
+    fixed_img_vec_ = ConstMappedImageVec(fixed_buf, this->num_pix_per_proj());
+  }
+}
+
+bool xreg::ImgSimMetric2DSSDCPU::mov_img_pixels_used(PixelIndexList* pix_inds)
+{
+  return this->subsample_pixels_used(pix_inds);
 }
- 
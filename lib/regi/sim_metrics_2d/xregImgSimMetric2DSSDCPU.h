@@ -40,7 +40,7 @@ public:
   
   /// \brief No additional resources are needed.
   ///
-  /// Will apply a mask, if set, to the fixed image.
+  /// Will gather the fixed image pixels used by a mask, if set.
   void allocate_resources() override;
 
   /// \brief Perform the similarity metric computations
@@ -49,17 +49,24 @@ public:
   /// image's similarity metric as the unit of execution.
   void compute() override;
 
+  /// \brief The pixels that are not masked out, or the random subset of them
+  ///        used by the next computation when pixel subsampling is enabled.
+  ///
+  /// Returns false when no mask is set and subsampling is disabled.
+  bool mov_img_pixels_used(PixelIndexList* pix_inds) override;
+
   void process_mask() override;
 
 private:
-  using ImageVec           = Eigen::Matrix<Scalar, 1, Eigen::Dynamic>;
-  using ImageMaskVec       = Eigen::Matrix<MaskScalar, 1, Eigen::Dynamic>;
-  using MappedImageVec     = Eigen::Map<ImageVec>;
-  using MappedImageMaskVec = Eigen::Map<ImageMaskVec>;
+  /// \brief Gathers the fixed image pixels used, or all pixels when null.
+  void update_fixed_for_pix_inds(const PixelIndexList* pix_inds);
+
+  using ImageVec            = Eigen::Matrix<Scalar, 1, Eigen::Dynamic>;
+  using ConstMappedImageVec = Eigen::Map<const ImageVec>;
   
+  /// \brief The fixed image, or only the pixels used (in the order of
+  ///        pix_inds_to_use()) when a mask is set or pixels are subsampled.
   ImageVec fixed_img_vec_;
-
-  ImageMaskVec mask_vec_;
 };
 
 }  // xreg
@@ -24,52 +24,54 @@
 
 #include "xregImgSimMetric2DSSDOCL.h"
 
+#include <boost/compute/memory/local_buffer.hpp>
 #include <boost/compute/utility/source.hpp>
 
-// ITK pollutes the global namespace with a macro, and causes
-// a compile failure with vienna cl
-#ifdef vcl_size_t
-#undef vcl_size_t
-#endif
-#ifdef vcl_ptrdiff_t
-#undef vcl_ptrdiff_t
-#endif
-
-#include <viennacl/matrix.hpp>
-#include <viennacl/vector.hpp>
-#include <viennacl/linalg/prod.hpp>
-
 #include "xregOpenCLMiscKernels.h"
+#include "xregOpenCLProgCache.h"
 
 namespace
 {
 
-const char* kSQUARE_DIST_OPENCL_SRC = BOOST_COMPUTE_STRINGIZE_SOURCE(
-
-__kernel void SquareDistKernel(__global float* mov_imgs,
-                               __global const float* fixed_img,
-                               const uint num_imgs,
-                               const uint img_len,
-                               const uint proj_off)
+const char* kSSD_OPENCL_SRC = BOOST_COMPUTE_STRINGIZE_SOURCE(
+
+// One work-group per moving image, e.g. global size of (work-group size, number of moving images).
+// Each pixel's squared distance is weighted by one over the number of pixels used, which is
+// zero for masked out pixels.
+__kernel void SSDKernel(__global const float* mov_imgs,
+                        __global const float* fixed_img,
+                        __global const float* one_over_n,
+                        const uint img_len,
+                        const uint proj_off,
+                        __global float* ssds,
+                        __local float* scratch)
 {
-  const uint global_inc = get_global_size(0);
-  const uint img_idx    = get_global_id(1);
+  const uint img_idx = get_group_id(1);
+  const uint lsize   = get_local_size(0);
+
+  __global const float* cur_mov_img = mov_imgs + ((proj_off + img_idx) * img_len);
 
-  if (img_idx < num_imgs)
+  float s = 0;
+
+  for (uint pixel_idx = get_local_id(0); pixel_idx < img_len; pixel_idx += lsize)
   {
-    __global float* cur_mov_img = mov_imgs + ((proj_off + img_idx) * img_len);
-
-    for (uint pixel_idx = get_global_id(0); pixel_idx < img_len;
-         pixel_idx += global_inc)
-    {
-      const float d = cur_mov_img[pixel_idx] - fixed_img[pixel_idx];
-      cur_mov_img[pixel_idx] = d * d;
-    }
+    const float d = cur_mov_img[pixel_idx] - fixed_img[pixel_idx];
+    s += d * d * one_over_n[pixel_idx];
+  }
+
+  s = WorkGroupSum(s, scratch);
+
+  if (get_local_id(0) == 0)
+  {
+    ssds[img_idx] = s;
   }
 }
 
 );
 
+/// \brief Preferred work-group size; the reductions require a power of two
+constexpr std::size_t kSSD_WORK_GROUP_SIZE = 256;
+
 }  // un-named
 
 xreg::ImgSimMetric2DSSDOCL::ImgSimMetric2DSSDOCL(const boost::compute::device& dev)
@@ -94,70 +96,49 @@ void xreg::ImgSimMetric2DSSDOCL::allocate_resources()
   
   std::stringstream ss;
   ss << DivideBufElemsOutOfPlaceKernelSrc
-     << kSQUARE_DIST_OPENCL_SRC;
+     << WorkGroupSumFnSrc
+     << kSSD_OPENCL_SRC;
 
-  bc::program prog = bc::program::create_with_source(ss.str(), this->ctx_);
-  
-  try
-  {
-    prog.build();
-  }
-  catch (bc::opencl_error &)
-  {
-    std::cerr << "OpenCL Kernel Compile Error (ImgSimMetric2DSSDOCL):\n"
-              << prog.build_log() << std::endl;
-    throw;
-  }
+  bc::program prog = BuildOpenCLProg(ss.str(), this->ctx_);
 
   div_elems_krnl_ = prog.create_kernel("DivideBufElemsOutOfPlace");
 
-  sq_dist_krnl_ = prog.create_kernel("SquareDistKernel");
-  sq_dist_krnl_.set_arg(0, *this->mov_imgs_buf_);
-  sq_dist_krnl_.set_arg(1, *this->fixed_img_ocl_buf_);  
-  sq_dist_krnl_.set_arg(3, bc::uint_(one_over_n_dev_->size()));
-  // arguments 2,4 are set in compute(), since they may differ from the values
-  // used for the maximally allocated buffer.
+  ssd_krnl_ = prog.create_kernel("SSDKernel");
+
+  ssd_wg_size_ = this->pow2_work_group_size(ssd_krnl_, kSSD_WORK_GROUP_SIZE);
+
+  ssd_krnl_.set_arg(5, *ssds_dev_);
+  ssd_krnl_.set_arg(6, bc::local_buffer<float>(ssd_wg_size_));
   
   ImgSimMetric2DOCL::allocate_resources();
+
+  ssd_krnl_.set_arg(1, *this->fixed_img_ocl_buf_);
+  ssd_krnl_.set_arg(3, bc::uint_(this->num_pix_per_proj()));
 }
 
 void xreg::ImgSimMetric2DSSDOCL::compute()
 {
-  namespace bc  = boost::compute;
-  namespace vcl = viennacl;
+  namespace bc = boost::compute;
   
   this->pre_compute();
   
-  const size_type num_pix_per_img = this->num_pix_per_proj();
-
-  sq_dist_krnl_.set_arg(2, bc::uint_(this->num_mov_imgs_));
-  sq_dist_krnl_.set_arg(4, bc::uint_(this->proj_off_));
-
-  // perform the squared distance calcuations
-  std::size_t global_size[2] = { num_pix_per_img / 8, this->num_mov_imgs_ };
-  this->queue_.enqueue_nd_range_kernel(sq_dist_krnl_, 2, 0, global_size, 0).wait();
-
-  // wrap the existing device buffers with vienna CL objects; this first matrix represents
-  // the maximal allocation; we'll take a sub-block of this.
-  vcl::matrix<float> imgs_mat(this->mov_imgs_buf_->get_buffer().get(),
-                              this->sim_vals_.size(),  // maximum number of moving images
-                              num_pix_per_img);
- 
-  // this is a sub-matrix of the entire buffer for the projections represented by
-  // not the maximal allocation, but the current offset and number of moving images 
-  vcl::matrix_range<vcl::matrix<float>> imgs_mat2(imgs_mat,
-                                                  vcl::range(this->proj_off_,
-                                                             this->proj_off_ + this->num_mov_imgs_),
-                                                  vcl::range(0, num_pix_per_img)); 
-  
-  vcl::vector<float> avg_vec(one_over_n_dev_->get_buffer().get(), num_pix_per_img);
-  vcl::vector<float> ssds_vec(ssds_dev_->get_buffer().get(), this->num_mov_imgs_);
+  // the moving images and the weights buffer may change between calls
+  ssd_krnl_.set_arg(0, *this->mov_imgs_buf_);
+  ssd_krnl_.set_arg(2, *one_over_n_dev_);
+  ssd_krnl_.set_arg(4, bc::uint_(this->proj_off_));
 
-  // sum the squared distances
-  vcl::linalg::prod_impl(imgs_mat2, avg_vec, ssds_vec);
+  // a single launch computes every moving image's SSD
+  const std::size_t global_size[2] = { ssd_wg_size_, this->num_mov_imgs_ };
+  const std::size_t local_size[2]  = { ssd_wg_size_, 1 };
 
-  bc::copy(ssds_dev_->begin(), ssds_dev_->begin() + this->num_mov_imgs_,
-           this->sim_vals_.begin(), this->queue_);
+  this->enqueue_kernel(ssd_krnl_, 2, global_size, local_size);
+
+  this->read_sim_vals_from_dev(*ssds_dev_);
+}
+
+xreg::ImgSimMetric2DSSDOCL::DevBuf* xreg::ImgSimMetric2DSSDOCL::sim_vals_dev_buf()
+{
+  return ssds_dev_.get();
 }
 
 void xreg::ImgSimMetric2DSSDOCL::process_mask()
@@ -176,7 +157,7 @@ void xreg::ImgSimMetric2DSSDOCL::process_mask()
     div_elems_krnl_.set_arg(3, bc::ulong_(this->mask_ocl_buf_->size()));
 
     std::size_t global_size = this->mask_ocl_buf_->size();
-    this->queue_.enqueue_nd_range_kernel(div_elems_krnl_, 1, nullptr, &global_size, nullptr).wait();
+    this->enqueue_kernel(div_elems_krnl_, 1, &global_size, nullptr).wait();
   }
   else
   {
@@ -185,3 +166,7 @@ void xreg::ImgSimMetric2DSSDOCL::process_mask()
   }
 }
 
+bool xreg::ImgSimMetric2DSSDOCL::mov_img_pixels_used(PixelIndexList* pix_inds)
+{
+  return this->mask_pixels_used(pix_inds);
+}
@@ -49,6 +49,11 @@ public:
 
   void compute() override;
 
+  DevBuf* sim_vals_dev_buf() override;
+
+  /// \brief The pixels that are not masked out, or false when no mask is set
+  bool mov_img_pixels_used(PixelIndexList* pix_inds) override;
+
 protected:
   void process_mask() override;
 
@@ -57,7 +62,11 @@ private:
   std::unique_ptr<DevBuf> one_over_n_dev_;
 
   boost::compute::kernel div_elems_krnl_;
-  boost::compute::kernel sq_dist_krnl_;
+
+  /// \brief Computes the SSD of every moving image with a work-group reduction per image
+  boost::compute::kernel ssd_krnl_;
+
+  std::size_t ssd_wg_size_ = 0;
 };
 
 }  // xreg
@@ -24,11 +24,17 @@
 
 #include "xregICP3D3D.h"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
 #include "xregPointCloudUtils.h"
 #include "xregMesh.h"
 #include "xregPairedPointRegi3D3D.h"
 #include "xregBasicStats.h"
 #include "xregStringUtils.h"
+#include "xregTBBUtils.h"
 
 void xreg::PointToSurRegiICP::init()
 {
@@ -37,6 +43,8 @@ void xreg::PointToSurRegiICP::init()
   xregASSERT(pts);
   xregASSERT(sur);
 
+  xregASSERT((0 < trim_frac) && (trim_frac <= 1));
+
   if (!kd_tree)
   {
     dout() << "  Creating KD-Tree for target surface..." << std::endl;
@@ -53,12 +61,22 @@ void xreg::PointToSurRegiICP::init()
 
   const size_type num_pts = pts->size();
 
-  match_dists.resize(num_pts);
-  match_pts.resize(num_pts);
-  reg_pts.resize(num_pts);
+  work_bufs.resize(1 + multi_start_xforms.size());
+
+  for (auto& bufs : work_bufs)
+  {
+    bufs.match_dists.resize(num_pts);
+    bufs.match_pts.resize(num_pts);
+    bufs.reg_pts.resize(num_pts);
+
+    bufs.src_inliers.reserve(num_pts);
+    bufs.match_inliers.reserve(num_pts);
 
-  src_inliers.reserve(num_pts);
-  match_inliers.reserve(num_pts);
+    if (trim_frac < 1)
+    {
+      bufs.trim_dists.resize(num_pts);
+    }
+  }
   
   dout() << "ICP init complete!" << std::endl;
 }
@@ -70,6 +88,85 @@ xreg::PointToSurRegiICP::run()
 
   const size_type num_pts = pts->size();
 
+  const size_type num_starts = 1 + multi_start_xforms.size();
+
+  dout() << "Starting Point to Surface ICP: Num Pts " << num_pts
+         << "\n   Surface Num Verts " << sur->vertices.size()
+         << ", Num Tri Faces " << sur->faces.size() << std::endl;
+  dout() << "  Initial Xform:\n" << init_pts_to_sur_xform.matrix() << std::endl;
+  dout() << "    Stop Thresh: " << stop_ratio << std::endl;
+  dout() << "  Compute Scale: " << BoolToYesNo(allow_similarity) << std::endl;
+  dout() << "   Outlier Det.: " << BoolToYesNo(std_dev_outlier_coeff > 1.0e-8) << std::endl;
+  dout() << "      Trim Frac: " << trim_frac << std::endl;
+  dout() << "     Num Starts: " << num_starts << std::endl;
+
+  if (start_of_processing_callback_fn)
+  {
+    start_of_processing_callback_fn(this);
+  }
+
+  FrameTransform best_xform = init_pts_to_sur_xform;
+
+  if (num_starts == 1)
+  {
+    std::tie(best_xform, final_mean_dist) = run_from(init_pts_to_sur_xform, &work_bufs[0], true);
+
+    best_start_idx = 0;
+  }
+  else
+  {
+    FrameTransformList final_xforms(num_starts);
+    CoordScalarList final_dists(num_starts);
+
+    // each start uses its own buffers, the KD-Tree is shared and only read
+    auto run_starts_fn = [&] (const RangeType& r)
+    {
+      for (size_type i = r.begin(); i != r.end(); ++i)
+      {
+        std::tie(final_xforms[i], final_dists[i]) =
+                  this->run_from(i ? this->multi_start_xforms[i - 1] : this->init_pts_to_sur_xform,
+                                 &this->work_bufs[i], false);
+      }
+    };
+
+    ParallelFor(run_starts_fn, RangeType(0, num_starts));
+
+    best_start_idx = std::distance(final_dists.begin(),
+                                   std::min_element(final_dists.begin(), final_dists.end()));
+
+    best_xform      = final_xforms[best_start_idx];
+    final_mean_dist = final_dists[best_start_idx];
+
+    for (size_type i = 0; i < num_starts; ++i)
+    {
+      dout() << "  Start " << i << " final mean dist: " << final_dists[i] << std::endl;
+    }
+
+    dout() << "  Best start: " << best_start_idx << std::endl;
+  }
+  
+  if (end_of_processing_callback_fn)
+  {
+    end_of_processing_callback_fn(this);
+  }
+
+  return best_xform;
+}
+
+std::tuple<xreg::FrameTransform,xreg::CoordScalar>
+xreg::PointToSurRegiICP::run_from(const FrameTransform& init_xform, WorkBufs* bufs,
+                                  const bool single_start)
+{
+  const size_type num_pts = pts->size();
+
+  CoordScalarList& match_dists = bufs->match_dists;
+
+  Pt3List& match_pts = bufs->match_pts;
+  Pt3List& reg_pts   = bufs->reg_pts;
+
+  Pt3List& src_inliers   = bufs->src_inliers;
+  Pt3List& match_inliers = bufs->match_inliers;
+
   CoordScalar prev_mean_dist = -1.0;
   CoordScalar cur_mean_dist  = -1.0;
   CoordScalar ratio          =  2.0;
@@ -78,31 +175,29 @@ xreg::PointToSurRegiICP::run()
 
   const bool filter_outliers = std_dev_outlier_coeff > 1.0e-8; 
 
-  FrameTransform cur_xform = init_pts_to_sur_xform;
+  const bool trim = trim_frac < 1;
 
-  dout() << "Starting Point to Surface ICP: Num Pts " << num_pts
-         << "\n   Surface Num Verts " << sur->vertices.size()
-         << ", Num Tri Faces " << sur->faces.size() << std::endl;
-  dout() << "  Initial Xform:\n" << cur_xform.matrix() << std::endl;
-  dout() << "    Stop Thresh: " << stop_ratio << std::endl;
-  dout() << "  Compute Scale: " << BoolToYesNo(allow_similarity) << std::endl;
-  dout() << "   Outlier Det.: " << BoolToYesNo(filter_outliers) << std::endl;
+  // number of points kept by trimming
+  const size_type num_trim_pts = std::max(size_type(1),
+          std::min(num_pts, static_cast<size_type>(std::ceil(trim_frac * num_pts))));
+
+  // concurrent runs do not print each iteration, since the output would be interleaved
+  std::ostream null_out(nullptr);
+
+  std::ostream& iout = single_start ? dout() : null_out;
+
+  FrameTransform cur_xform = init_xform;
 
   size_type iter = 0;
 
   bool should_stop = max_its == 0;
 
-  if (start_of_processing_callback_fn)
-  {
-    start_of_processing_callback_fn(this);
-  }
-
   while (!should_stop)
   {
-    dout() << "  Iteration " << iter << std::endl;
-    dout() << "    Xform:\n" << cur_xform.matrix() << std::endl;
+    iout << "  Iteration " << iter << std::endl;
+    iout << "    Xform:\n" << cur_xform.matrix() << std::endl;
 
-    if (start_of_iteration_callback_fn)
+    if (single_start && start_of_iteration_callback_fn)
     {
       start_of_iteration_callback_fn(this, iter, cur_xform);
     }
@@ -113,19 +208,50 @@ xreg::PointToSurRegiICP::run()
 
     kd_tree->find_closest_points(reg_pts, &match_pts, &match_dists);
 
-    // Calculate the termination criteria
-    cur_mean_dist = SampleMean(match_dists);
+    // Determine the points used for the termination criteria and the next estimate
 
-    dout() << "    Mean Dist: " << cur_mean_dist << std::endl;
+    CoordScalar dist_thresh = std::numeric_limits<CoordScalar>::max();
+
+    if (trim)
+    {
+      // the distance of the last point kept is found with a partial sort
+      CoordScalarList& trim_dists = bufs->trim_dists;
+
+      std::copy(match_dists.begin(), match_dists.end(), trim_dists.begin());
+
+      std::nth_element(trim_dists.begin(), trim_dists.begin() + (num_trim_pts - 1), trim_dists.end());
+
+      dist_thresh = trim_dists[num_trim_pts - 1];
+
+      cur_mean_dist = std::accumulate(trim_dists.begin(), trim_dists.begin() + num_trim_pts,
+                                      CoordScalar(0)) / num_trim_pts;
+    }
+    else
+    {
+      cur_mean_dist = SampleMean(match_dists);
+    }
+
+    if (filter_outliers)
+    {
+      // Identify outlier points that have a transformed distance from the surface
+      // greater than a number of standard deviations from the mean distance
+      const CoordScalar all_mean_dist = trim ? SampleMean(match_dists) : cur_mean_dist;
+
+      dist_thresh = std::min(dist_thresh,
+                             static_cast<CoordScalar>(all_mean_dist + (std_dev_outlier_coeff *
+                                                        SampleStdDev(match_dists, all_mean_dist))));
+    }
+
+    iout << "    Mean Dist: " << cur_mean_dist << std::endl;
 
     if ((max_its >= 0) && ((iter + 1) == static_cast<size_type>(max_its)))
     {
-      dout() << "    termination criteria met: maximum number of iterations reached" << std::endl;
+      iout << "    termination criteria met: maximum number of iterations reached" << std::endl;
       should_stop = true;
     }
     else if (cur_mean_dist < 1.0e-12)
     {
-      dout() << "    termination criteria met: mean distance below very small threshold" << std::endl;
+      iout << "    termination criteria met: mean distance below very small threshold" << std::endl;
       should_stop = true;
     }
     else if (prev_mean_dist >= 0.0)
@@ -136,10 +262,10 @@ xreg::PointToSurRegiICP::run()
       ratio = cur_mean_dist / prev_mean_dist;
       should_stop = (stop_ratio <= ratio) && (ratio <= 1.0);
 
-      dout() << "    Delta Mean Dist. Ratio: " << ratio << std::endl;
+      iout << "    Delta Mean Dist. Ratio: " << ratio << std::endl;
       if (should_stop)
       {
-        dout() << "    termination criteria met: mean distance has stopped decreasing" << std::endl;
+        iout << "    termination criteria met: mean distance has stopped decreasing" << std::endl;
       }
     }
 
@@ -147,15 +273,11 @@ xreg::PointToSurRegiICP::run()
 
     if (!should_stop)
     {
-      if (filter_outliers)
+      if (filter_outliers || trim)
       {
         src_inliers.clear();
         match_inliers.clear();
 
-        // Identify outlier points that have a transformed distance from the surface
-        // greater than a number of standard deviations from the mean distance
-        const double dist_thresh = cur_mean_dist + (std_dev_outlier_coeff * SampleStdDev(match_dists, cur_mean_dist));
-
         for (size_type i = 0; i < num_pts; ++i)
         {
           if (match_dists[i] <= dist_thresh)
@@ -175,19 +297,13 @@ xreg::PointToSurRegiICP::run()
       prev_mean_dist = cur_mean_dist;
     }
 
-    if (end_of_iteration_callback_fn)
+    if (single_start && end_of_iteration_callback_fn)
     {
       end_of_iteration_callback_fn(this, iter, cur_xform);
     }
 
     ++iter;
   }
-  
-  if (end_of_processing_callback_fn)
-  {
-    end_of_processing_callback_fn(this);
-  }
 
-  return cur_xform;
+  return std::make_tuple(cur_xform, cur_mean_dist);
 }
-
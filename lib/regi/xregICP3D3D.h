@@ -27,7 +27,7 @@
 
 #include "xregCommon.h"
 #include "xregObjWithOStream.h"
-#include "xregKDTree.h"
+#include "xregFlatKDTree.h"
 
 namespace xreg
 {
@@ -73,10 +73,42 @@ struct PointToSurRegiICP : ObjWithOStream
    * should be performed.
    **/
 	double std_dev_outlier_coeff = 0.0;
+
+  /**
+   * @brief Fraction of points used at each iteration (trimmed ICP).
+   *
+   * At each iteration, only this fraction of the points with the smallest
+   * surface distances are used to compute the next registration estimate and
+   * the mean surface distance used by the stopping criteria. A value of 1
+   * indicates that no trimming should be performed. This may be combined with
+   * the standard deviation based outlier detection.
+   **/
+  double trim_frac = 1.0;
  
   // Boolean flag indicating that a scaling factor is allowed in the registration transform
   bool allow_similarity = false;
 
+  /**
+   * @brief Additional initial estimates of the transformation.
+   *
+   * When non-empty, ICP is run from init_pts_to_sur_xform and each of these
+   * estimates concurrently, sharing a single KD-Tree of the surface. The
+   * result with the smallest final (trimmed) mean surface distance is returned.
+   * The iteration callbacks are only called when there are no additional
+   * initial estimates, since the runs are executed concurrently.
+   **/
+  FrameTransformList multi_start_xforms;
+
+  /// \brief The final (trimmed) mean surface distance of the estimate
+  ///        returned by run().
+  CoordScalar final_mean_dist = -1;
+
+  /// \brief The initial estimate which produced the result returned by run().
+  ///
+  /// 0 indicates init_pts_to_sur_xform and i > 0 indicates
+  /// multi_start_xforms[i - 1].
+  size_type best_start_idx = 0;
+
   FrameTransform run();
 
   std::function<void(PointToSurRegiICP*)> start_of_processing_callback_fn;
@@ -87,26 +119,41 @@ struct PointToSurRegiICP : ObjWithOStream
   std::function<void(PointToSurRegiICP*, const size_type, const FrameTransform&)> end_of_iteration_callback_fn;
 
 private:
- 
+
+  // Buffers used by a single run of ICP from an initial estimate
+  struct WorkBufs
+  {
+    CoordScalarList match_dists;
+
+    Pt3List match_pts;
+    Pt3List reg_pts;
+
+    Pt3List src_inliers;
+    Pt3List match_inliers;
+
+    // copy of the distances used to select the trimming threshold
+    CoordScalarList trim_dists;
+  };
+
   // Initializes or allocates working data structures
   void init();
 
+  // Runs ICP from a single initial estimate, returns the final estimate and
+  // (trimmed) mean surface distance
+  std::tuple<FrameTransform,CoordScalar>
+  run_from(const FrameTransform& init_xform, WorkBufs* bufs, const bool single_start);
+
   // Working variables with allocated buffers that may be handy to keep around
   
   // KD-Tree data structures for the target surface
-  using KDTree = KDTreeNode<KDTreeTri>;
+  using KDTree = FlatKDTree<KDTreeTri>;
 
   std::vector<KDTreeTri> kd_tree_tris;
 
   std::unique_ptr<KDTree> kd_tree;
 
-  CoordScalarList match_dists;
-  
-  Pt3List match_pts;
-  Pt3List reg_pts;
-
-  Pt3List src_inliers;
-  Pt3List match_inliers;
+  // one set of buffers for each initial estimate
+  std::vector<WorkBufs> work_bufs;
 };
 
 }  // xreg
@@ -30,6 +30,128 @@
 #include "xregRotUtils.h"
 #include "xregPointCloudUtils.h"
 #include "xregLandmarkMapUtils.h"
+#include "xregTBBUtils.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+// Horn's quaternion method given the cross-covariance, S(i,j) is the inner
+// product of the ith component of the centered points of cloud 1 and the jth
+// component of the centered points of cloud 2
+FrameTransform PairedPointRegiFromCrossCov(const Mat3x3& S, const Pt3& cent1, const Pt3& cent2,
+                                           const CoordScalar s)
+{
+  const CoordScalar S_xx = S(0,0);
+  const CoordScalar S_xy = S(0,1);
+  const CoordScalar S_xz = S(0,2);
+  const CoordScalar S_yx = S(1,0);
+  const CoordScalar S_yy = S(1,1);
+  const CoordScalar S_yz = S(1,2);
+  const CoordScalar S_zx = S(2,0);
+  const CoordScalar S_zy = S(2,1);
+  const CoordScalar S_zz = S(2,2);
+
+  Mat4x4 N_matrix;
+  N_matrix(0,0) = S_xx + S_yy + S_zz;
+  N_matrix(0,1) = S_yz - S_zy;
+  N_matrix(0,2) = S_zx - S_xz;
+  N_matrix(0,3) = S_xy - S_yx;
+  N_matrix(1,0) = N_matrix(0,1);
+  N_matrix(1,1) = S_xx - S_yy - S_zz;
+  N_matrix(1,2) = S_xy + S_yx;
+  N_matrix(1,3) = S_zx + S_xz;
+  N_matrix(2,0) = N_matrix(0,2);
+  N_matrix(2,1) = N_matrix(1,2);
+  N_matrix(2,2) = -S_xx + S_yy - S_zz;
+  N_matrix(2,3) = S_yz + S_zy;
+  N_matrix(3,0) = N_matrix(0,3);
+  N_matrix(3,1) = N_matrix(1,3);
+  N_matrix(3,2) = N_matrix(2,3);
+  N_matrix(3,3) = -S_xx - S_yy + S_zz;
+
+  // N is symmetric and of fixed size, so this decomposition does not allocate
+  // and the eigenvalues are sorted in increasing order
+  Eigen::SelfAdjointEigenSolver<Mat4x4> eig_dec(N_matrix);
+
+  FrameTransform xform = FrameTransform::Identity();
+
+  xform.linear().matrix() = QuatToRotMat(Pt4(eig_dec.eigenvectors().col(3)));
+
+  xform.linear().matrix() *= s;
+
+  xform.matrix().block(0,3,3,1) = cent2 - (xform.linear() * cent1);
+  
+  return xform;
+}
+
+// Registers the correspondences given by inds (or every point when inds is
+// null) with optional weights, without any allocations
+FrameTransform PairedPointRegiSmall(const Pt3List& pts1, const Pt3List& pts2,
+                                    const size_type* inds, const size_type num_corrs,
+                                    const CoordScalar* weights, const CoordScalar scale)
+{
+  auto pt_idx = [inds] (const size_type k)
+  {
+    return inds ? inds[k] : k;
+  };
+
+  auto pt_wgt = [weights] (const size_type k)
+  {
+    return weights ? weights[k] : CoordScalar(1);
+  };
+
+  Pt3 cent1 = Pt3::Zero();
+  Pt3 cent2 = Pt3::Zero();
+
+  CoordScalar wgt_sum = 0;
+
+  for (size_type k = 0; k < num_corrs; ++k)
+  {
+    const size_type i = pt_idx(k);
+    const CoordScalar w = pt_wgt(k);
+
+    cent1 += w * pts1[i];
+    cent2 += w * pts2[i];
+
+    wgt_sum += w;
+  }
+
+  xregASSERT(wgt_sum > 0);
+
+  cent1 /= wgt_sum;
+  cent2 /= wgt_sum;
+
+  Mat3x3 S = Mat3x3::Zero();
+
+  CoordScalar s1 = 0;
+  CoordScalar s2 = 0;
+
+  for (size_type k = 0; k < num_corrs; ++k)
+  {
+    const size_type i = pt_idx(k);
+    const CoordScalar w = pt_wgt(k);
+
+    const Pt3 p1 = pts1[i] - cent1;
+    const Pt3 p2 = pts2[i] - cent2;
+
+    S += (w * p1) * p2.transpose();
+
+    s1 += w * p1.squaredNorm();
+    s2 += w * p2.squaredNorm();
+  }
+
+  CoordScalar s = scale;
+  if (s <= 0)
+  {
+    s = (std::abs(s1) > 1.0e-6) ? std::sqrt(s2 / s1) : CoordScalar(0);
+  }
+
+  return PairedPointRegiFromCrossCov(S, cent1, cent2, s);
+}
+
+}  // un-named
 
 xreg::FrameTransform
 xreg::PairedPointRegi3D3D(const Pt3List& pts1, const Pt3List& pts2, const CoordScalar scale)
@@ -37,8 +159,6 @@ xreg::PairedPointRegi3D3D(const Pt3List& pts1, const Pt3List& pts2, const CoordS
   const size_type num_pts = pts1.size();
   xregASSERT(num_pts == pts2.size());
 
-  FrameTransform xform = FrameTransform::Identity();
-
   // These calls are threaded
   const Pt3 cent1 = ComputeCentroid(pts1);
   const Pt3 cent2 = ComputeCentroid(pts2);
@@ -62,64 +182,94 @@ xreg::PairedPointRegi3D3D(const Pt3List& pts1, const Pt3List& pts2, const CoordS
     }
   }
 
-  CoordScalar S[9];
+  Mat3x3 S;
 
-  CoordScalar* S_dst = S;
   for (size_type i = 0; i < 3; ++i)
   {
-    for (size_type j = 0; j < 3; ++j, ++S_dst)
+    for (size_type j = 0; j < 3; ++j)
     {
       // This call is threaded
-      *S_dst = InnerProductAboutDimsOfPts(pts1_prime, pts2_prime, i, j);
+      S(i,j) = InnerProductAboutDimsOfPts(pts1_prime, pts2_prime, i, j);
     }
   }
 
-  const CoordScalar S_xx = S[0];
-  const CoordScalar S_xy = S[1];
-  const CoordScalar S_xz = S[2];
-  const CoordScalar S_yx = S[3];
-  const CoordScalar S_yy = S[4];
-  const CoordScalar S_yz = S[5];
-  const CoordScalar S_zx = S[6];
-  const CoordScalar S_zy = S[7];
-  const CoordScalar S_zz = S[8];
+  return PairedPointRegiFromCrossCov(S, cent1, cent2, s);
+}
 
-  Mat4x4 N_matrix;
-  N_matrix(0,0) = S_xx + S_yy + S_zz;
-  N_matrix(0,1) = S_yz - S_zy;
-  N_matrix(0,2) = S_zx - S_xz;
-  N_matrix(0,3) = S_xy - S_yx;
-  N_matrix(1,0) = N_matrix(0,1);
-  N_matrix(1,1) = S_xx - S_yy - S_zz;
-  N_matrix(1,2) = S_xy + S_yx;
-  N_matrix(1,3) = S_zx + S_xz;
-  N_matrix(2,0) = N_matrix(0,2);
-  N_matrix(2,1) = N_matrix(1,2);
-  N_matrix(2,2) = -S_xx + S_yy - S_zz;
-  N_matrix(2,3) = S_yz + S_zy;
-  N_matrix(3,0) = N_matrix(0,3);
-  N_matrix(3,1) = N_matrix(1,3);
-  N_matrix(3,2) = N_matrix(2,3);
-  N_matrix(3,3) = -S_xx - S_yy + S_zz;
+xreg::FrameTransform
+xreg::PairedPointRegi3D3D(const LandMap3& pts1, const LandMap3& pts2, const CoordScalar scale)
+{
+  const auto corr_lists = CreateCorrespondencePointLists(pts1, pts2);
 
-  Eigen::EigenSolver<Mat4x4> eig_dec(N_matrix, true);
+  return PairedPointRegi3D3D(std::get<0>(corr_lists), std::get<1>(corr_lists), scale);
+}
 
-  size_type max_index = 0;
-  eig_dec.eigenvalues().real().maxCoeff(&max_index);
-  xform.linear().matrix() = QuatToRotMat(eig_dec.eigenvectors().col(max_index).real());
 
-  xform.linear().matrix() *= s;
+xreg::FrameTransform
+xreg::PairedPointRegi3D3DWeighted(const Pt3List& pts1, const Pt3List& pts2,
+                                  const CoordScalarList& weights, const CoordScalar scale)
+{
+  const size_type num_pts = pts1.size();
+  xregASSERT(num_pts == pts2.size());
+  xregASSERT(num_pts == weights.size());
 
-  xform.matrix().block(0,3,3,1) = cent2 - (xform.linear() * cent1);
-  
-  return xform;
+  return PairedPointRegiSmall(pts1, pts2, nullptr, num_pts, weights.data(), scale);
 }
 
-xreg::FrameTransform
-xreg::PairedPointRegi3D3D(const LandMap3& pts1, const LandMap3& pts2, const CoordScalar scale)
+xreg::FrameTransformList
+xreg::PairedPointRegi3D3DBatch(const Pt3List& pts1, const Pt3List& pts2,
+                               const std::vector<std::vector<size_type>>& corr_inds,
+                               const CoordScalar scale)
 {
-  const auto corr_lists = CreateCorrespondencePointLists(pts1, pts2);
+  xregASSERT(pts1.size() == pts2.size());
 
-  return PairedPointRegi3D3D(std::get<0>(corr_lists), std::get<1>(corr_lists), scale);
+  const size_type num_probs = corr_inds.size();
+
+  FrameTransformList xforms(num_probs);
+
+  auto regi_fn = [&] (const RangeType& r)
+  {
+    for (size_type prob_idx = r.begin(); prob_idx < r.end(); ++prob_idx)
+    {
+      const auto& cur_inds = corr_inds[prob_idx];
+
+      xforms[prob_idx] = PairedPointRegiSmall(pts1, pts2, cur_inds.data(), cur_inds.size(),
+                                              nullptr, scale);
+    }
+  };
+
+  ParallelFor(regi_fn, RangeType(0, num_probs));
+
+  return xforms;
 }
 
+xreg::FrameTransformList
+xreg::PairedPointRegi3D3DWeightedBatch(const Pt3List& pts1, const Pt3List& pts2,
+                                       const std::vector<std::vector<size_type>>& corr_inds,
+                                       const std::vector<CoordScalarList>& weights,
+                                       const CoordScalar scale)
+{
+  xregASSERT(pts1.size() == pts2.size());
+
+  const size_type num_probs = corr_inds.size();
+  xregASSERT(num_probs == weights.size());
+
+  FrameTransformList xforms(num_probs);
+
+  auto regi_fn = [&] (const RangeType& r)
+  {
+    for (size_type prob_idx = r.begin(); prob_idx < r.end(); ++prob_idx)
+    {
+      const auto& cur_inds = corr_inds[prob_idx];
+
+      xregASSERT(cur_inds.size() == weights[prob_idx].size());
+
+      xforms[prob_idx] = PairedPointRegiSmall(pts1, pts2, cur_inds.data(), cur_inds.size(),
+                                              weights[prob_idx].data(), scale);
+    }
+  };
+
+  ParallelFor(regi_fn, RangeType(0, num_probs));
+
+  return xforms;
+}
@@ -46,6 +46,56 @@ FrameTransform PairedPointRegi3D3D(const Pt3List& pts1, const Pt3List& pts2, con
 
 FrameTransform PairedPointRegi3D3D(const LandMap3& pts1, const LandMap3& pts2, const CoordScalar scale = CoordScalar(1));
 
+/**
+ * @brief Computes the "optimal" rigid/similarity transformation between two
+ * point clouds with correspondence, where each correspondence is weighted.
+ *
+ * Weights must be non-negative, and at least one must be positive. The
+ * weighted centroids and cross-covariance are accumulated on the stack, so
+ * this does not allocate and is suitable for calling from inner loops.
+ * @param pts1 Point cloud 1
+ * @param pts2 Point cloud 2
+ * @param weights The weight of each correspondence
+ * @param scale (optional) Scale factor to force, if less than,
+ *              or equal to, zero then the scale factor is computed automatically
+ **/
+FrameTransform PairedPointRegi3D3DWeighted(const Pt3List& pts1, const Pt3List& pts2,
+                                           const CoordScalarList& weights,
+                                           const CoordScalar scale = CoordScalar(1));
+
+/**
+ * @brief Solves many small paired point registration problems with one call.
+ *
+ * Each element of corr_inds is a collection of indices into both pts1 and pts2
+ * which identifies a set of correspondences, e.g. a RANSAC minimal set or the
+ * matches of one ICP start. The problems are solved in parallel and the
+ * fixed-size eigendecomposition of Horn's method is used, so no memory is
+ * allocated per problem. Element i of the returned list maps the points of
+ * corr_inds[i] from pts1 into pts2.
+ * @param pts1 Point cloud 1
+ * @param pts2 Point cloud 2
+ * @param corr_inds The correspondences of each problem
+ * @param scale (optional) Scale factor to force, if less than,
+ *              or equal to, zero then the scale factor is computed automatically
+ **/
+FrameTransformList
+PairedPointRegi3D3DBatch(const Pt3List& pts1, const Pt3List& pts2,
+                         const std::vector<std::vector<size_type>>& corr_inds,
+                         const CoordScalar scale = CoordScalar(1));
+
+/**
+ * @brief Solves many small weighted paired point registration problems with
+ *        one call.
+ *
+ * weights[i][k] is the weight of correspondence corr_inds[i][k].
+ * @see PairedPointRegi3D3DBatch
+ **/
+FrameTransformList
+PairedPointRegi3D3DWeightedBatch(const Pt3List& pts1, const Pt3List& pts2,
+                                 const std::vector<std::vector<size_type>>& corr_inds,
+                                 const std::vector<CoordScalarList>& weights,
+                                 const CoordScalar scale = CoordScalar(1));
+
 }  // xreg
 
 #endif
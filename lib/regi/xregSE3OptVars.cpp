@@ -27,6 +27,121 @@
 #include "xregAssert.h"
 #include "xregRigidUtils.h"
 #include "xregRotUtils.h"
+#include "xregTBBUtils.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+using RowArray = Eigen::Array<CoordScalar,1,Eigen::Dynamic>;
+
+// consistent with ExpSO3 and ExpSE3, rotations with smaller angles are
+// treated as the identity
+constexpr CoordScalar kSMALL_ROT_ANG = 1.0e-14;
+
+// Coefficients of the closed form so(3) exponential, R = I + a W + b W^2,
+// for each column of the rotation parameters
+struct ExpSO3Coeffs
+{
+  RowArray inv_theta_sq;
+  RowArray a;  // sin(theta) / theta
+  RowArray b;  // (1 - cos(theta)) / theta^2
+};
+
+ExpSO3Coeffs ComputeExpSO3Coeffs(const MatMxN& x)
+{
+  const RowArray theta = x.topRows<3>().colwise().norm().array();
+
+  const RowArray inv_theta = (theta > kSMALL_ROT_ANG).select(theta.inverse(), CoordScalar(0));
+
+  ExpSO3Coeffs c;
+
+  c.inv_theta_sq = inv_theta.square();
+  c.a = theta.sin() * inv_theta;
+  c.b = (1 - theta.cos()) * c.inv_theta_sq;
+
+  return c;
+}
+
+// Sets the rotation blocks of each transform using the exponential of the
+// so(3) parameters in the first three rows of x, the translations are zeroed
+void SetRotsFromExpSO3(const MatMxN& x, const ExpSO3Coeffs& c, FrameTransform* xforms)
+{
+  const size_type n = x.cols();
+
+  for (size_type i = 0; i < n; ++i)
+  {
+    const CoordScalar wx = x(0,i);
+    const CoordScalar wy = x(1,i);
+    const CoordScalar wz = x(2,i);
+
+    const CoordScalar a = c.a(i);
+    const CoordScalar b = c.b(i);
+
+    // W^2 = w w^T - theta^2 I
+    const CoordScalar theta_sq = (wx * wx) + (wy * wy) + (wz * wz);
+
+    auto& M = xforms[i].matrix();
+
+    M(0,0) = 1 + (b * ((wx * wx) - theta_sq));
+    M(0,1) = (b * wx * wy) - (a * wz);
+    M(0,2) = (b * wx * wz) + (a * wy);
+    M(1,0) = (b * wx * wy) + (a * wz);
+    M(1,1) = 1 + (b * ((wy * wy) - theta_sq));
+    M(1,2) = (b * wy * wz) - (a * wx);
+    M(2,0) = (b * wx * wz) - (a * wy);
+    M(2,1) = (b * wy * wz) + (a * wx);
+    M(2,2) = 1 + (b * ((wz * wz) - theta_sq));
+
+    M.block(0,3,3,1).setZero();
+    M.row(3) << 0, 0, 0, 1;
+  }
+}
+
+// Left multiplies the upper 3x4 block of a rigid transform by a rotation in
+// the plane of rows r1 and r2:
+// row r1 <- c * row r1 - s * row r2, row r2 <- s * row r1 + c * row r2
+void LeftMultPlaneRot(Mat3x4* M, const int r1, const int r2,
+                      const CoordScalar c, const CoordScalar s)
+{
+  const Eigen::Matrix<CoordScalar,1,4> row1 = M->row(r1);
+  const Eigen::Matrix<CoordScalar,1,4> row2 = M->row(r2);
+
+  M->row(r1) = (c * row1) - (s * row2);
+  M->row(r2) = (s * row1) + (c * row2);
+}
+
+}  // un-named
+
+void xreg::SE3OptVars::batch_xforms(const MatMxN& x, FrameTransform* xforms) const
+{
+  xregASSERT(static_cast<unsigned long>(x.rows()) == num_params());
+
+  const size_type n = x.cols();
+
+  for (size_type i = 0; i < n; ++i)
+  {
+    xforms[i] = this->operator()(x.col(i));
+  }
+}
+
+void xreg::SE3OptVars::batch_composed_xforms(const MatMxN& x, const FrameTransform& pre_xform,
+                                             const FrameTransform& post_xform,
+                                             FrameTransform* xforms) const
+{
+  batch_xforms(x, xforms);
+
+  auto compose_fn = [&pre_xform,&post_xform,xforms] (const RangeType& r)
+  {
+    for (size_type i = r.begin(); i < r.end(); ++i)
+    {
+      xforms[i] = pre_xform * xforms[i] * post_xform;
+    }
+  };
+
+  ParallelFor(compose_fn, RangeType(0, x.cols()));
+}
 
 xreg::SE3OptVarsEuler::SE3OptVarsEuler(const unsigned long rot_x_idx,
                                        const unsigned long rot_y_idx,
@@ -81,6 +196,53 @@ xreg::SE3OptVarsEuler::operator()(const PtN& x) const
   return T;
 }
   
+void xreg::SE3OptVarsEuler::batch_xforms(const MatMxN& x, FrameTransform* xforms) const
+{
+  xregASSERT(x.rows() == 6);
+
+  const size_type n = x.cols();
+
+  // the first three parameters are always the rotation angles
+  const Eigen::Array<CoordScalar,3,Eigen::Dynamic> cos_angs = x.topRows<3>().array().cos();
+  const Eigen::Array<CoordScalar,3,Eigen::Dynamic> sin_angs = x.topRows<3>().array().sin();
+
+  Mat3x4 M;
+
+  for (size_type i = 0; i < n; ++i)
+  {
+    M.setIdentity();
+
+    // T = F_0 * F_1 * ... * F_5, so apply each component on the left starting
+    // with the last
+    for (int k = 5; k >= 0; --k)
+    {
+      const unsigned long p = param_idx_[k];
+
+      switch (p)
+      {
+      case 0:
+        LeftMultPlaneRot(&M, 1, 2, cos_angs(0,i), sin_angs(0,i));
+        break;
+      case 1:
+        LeftMultPlaneRot(&M, 2, 0, cos_angs(1,i), sin_angs(1,i));
+        break;
+      case 2:
+        LeftMultPlaneRot(&M, 0, 1, cos_angs(2,i), sin_angs(2,i));
+        break;
+      default:
+        // translation, the last row of the transform is [0 0 0 1]
+        M(p - 3, 3) += x(p,i);
+        break;
+      }
+    }
+
+    auto& T = xforms[i].matrix();
+
+    T.topRows<3>() = M;
+    T.row(3) << 0, 0, 0, 1;
+  }
+}
+
 unsigned long xreg::SE3OptVarsEuler::num_params() const
 {
   return 6;
@@ -136,6 +298,30 @@ xreg::SE3OptVarsLieAlg::operator()(const PtN& x) const
   return T;
 }
   
+void xreg::SE3OptVarsLieAlg::batch_xforms(const MatMxN& x, FrameTransform* xforms) const
+{
+  xregASSERT(x.rows() == 6);
+
+  const ExpSO3Coeffs c = ComputeExpSO3Coeffs(x);
+
+  SetRotsFromExpSO3(x, c, xforms);
+
+  // translation = (I + b W + d W^2) v, d = (theta - sin(theta)) / theta^3
+  const RowArray d = (1 - c.a) * c.inv_theta_sq;
+
+  const size_type n = x.cols();
+
+  for (size_type i = 0; i < n; ++i)
+  {
+    const Pt3 w = x.block(0,i,3,1);
+    const Pt3 v = x.block(3,i,3,1);
+
+    const Pt3 w_cross_v = w.cross(v);
+
+    xforms[i].matrix().block(0,3,3,1) = v + (c.b(i) * w_cross_v) + (d(i) * w.cross(w_cross_v));
+  }
+}
+
 unsigned long xreg::SE3OptVarsLieAlg::num_params() const
 {
   return 6;
@@ -223,6 +409,13 @@ xreg::SO3OptVarsLieAlg::operator()(const PtN& x) const
   return H;
 }
   
+void xreg::SO3OptVarsLieAlg::batch_xforms(const MatMxN& x, FrameTransform* xforms) const
+{
+  xregASSERT(x.rows() == 3);
+
+  SetRotsFromExpSO3(x, ComputeExpSO3Coeffs(x), xforms);
+}
+
 unsigned long xreg::SO3OptVarsLieAlg::num_params() const
 {
   return 3;
@@ -54,6 +54,23 @@ public:
   /// Must be implemented by the derived class.
   virtual FrameTransform operator()(const PtN& x) const = 0;
 
+  /// \brief Map each column of a parameter matrix to an SE(3) element
+  ///
+  /// x must have num_params() rows, e.g. each column is a member of a
+  /// population, and xforms must point to at least x.cols() transforms. The
+  /// default implementation calls operator() on each column; derived classes
+  /// may override this to map all columns in a single vectorized pass.
+  virtual void batch_xforms(const MatMxN& x, FrameTransform* xforms) const;
+
+  /// \brief Map each column of a parameter matrix to an SE(3) element and
+  ///        compose with constant transforms.
+  ///
+  /// xforms[i] = pre_xform * T(x.col(i)) * post_xform. This avoids storing
+  /// the intermediate transforms, so that the final poses may be written to
+  /// their destination (e.g. the pose buffer of a ray caster) directly.
+  void batch_composed_xforms(const MatMxN& x, const FrameTransform& pre_xform,
+                             const FrameTransform& post_xform, FrameTransform* xforms) const;
+
   /// \brief The dimensionality of the parameterization.
   ///
   /// For example, for a parameterization over se(3) (Lie Algebra) this will be
@@ -83,6 +100,13 @@ public:
   /// multiply them in the user-specified order.
   FrameTransform operator()(const PtN& x) const override;
 
+  /// \brief Map each column to an SE(3) element.
+  ///
+  /// The sines and cosines of all columns are computed together, and each
+  /// component is applied to the upper 3x4 block in-place, rather than
+  /// multiplying six 4x4 matrices per column.
+  void batch_xforms(const MatMxN& x, FrameTransform* xforms) const override;
+
   /// \brief Parameterization dimensionality: 6
   unsigned long num_params() const override;
 
@@ -126,6 +150,10 @@ public:
   /// SE(3) element = exp([W, q; 0 0])
   FrameTransform operator()(const PtN& x) const override;
 
+  /// \brief Map each column to an SE(3) element, using closed form
+  ///        exponentials evaluated for all columns at once.
+  void batch_xforms(const MatMxN& x, FrameTransform* xforms) const override;
+
   /// \brief Parameterization dimensionality: 6
   unsigned long num_params() const override;
 };
@@ -198,6 +226,10 @@ public:
   /// SE(3) element = [R 0; 0 1])
   FrameTransform operator()(const PtN& x) const override;
 
+  /// \brief Map each column to an SE(3) element, using the closed form
+  ///        exponential evaluated for all columns at once.
+  void batch_xforms(const MatMxN& x, FrameTransform* xforms) const override;
+
   /// \brief Parameterization dimensionality: 3
   unsigned long num_params() const override;
 };
@@ -24,10 +24,86 @@
 
 #include "xregFitCylinder.h"
 
+#include <algorithm>
+#include <numeric>
+#include <random>
+
 #include <Eigen/Dense>
 
 #include "xregAssert.h"
+#include "xregExceptionUtils.h"
 #include "xregFitCircle.h"
+#include "xregSampleUtils.h"
+#include "xregTBBUtils.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+// Row k holds the kth component of each point, so that the distances of many
+// points to a circle are computed using vectorized operations.
+using PtsSoA = Eigen::Matrix<CoordScalar,3,Eigen::Dynamic,Eigen::RowMajor>;
+
+struct OrbitHyp
+{
+  bool valid = false;
+
+  Pt3 center;
+
+  // unit normal of the plane containing the circle
+  Pt3 normal;
+
+  CoordScalar radius;
+};
+
+// The circle passing through three points
+OrbitHyp OrbitThroughPts(const Pt3& a, const Pt3& b, const Pt3& c)
+{
+  OrbitHyp hyp;
+
+  const Pt3 u = b - a;
+  const Pt3 v = c - a;
+  const Pt3 w = u.cross(v);
+
+  const CoordScalar w_sq_norm = w.squaredNorm();
+
+  if (w_sq_norm > (1.0e-12 * u.squaredNorm() * v.squaredNorm()))
+  {
+    hyp.valid  = true;
+    hyp.center = a + (((u.squaredNorm() * v.cross(w)) + (v.squaredNorm() * w.cross(u))) /
+                                                                            (2 * w_sq_norm));
+    hyp.normal = w / std::sqrt(w_sq_norm);
+    hyp.radius = (hyp.center - a).norm();
+  }
+
+  return hyp;
+}
+
+// Squared distances of the points in columns [start_col, start_col + num_cols)
+// to the circle
+Eigen::Array<CoordScalar,1,Eigen::Dynamic>
+SqDistsToOrbit(const OrbitHyp& hyp, const PtsSoA& pts,
+               const size_type start_col, const size_type num_cols)
+{
+  using Arr = Eigen::Array<CoordScalar,1,Eigen::Dynamic>;
+
+  const Arr qx = pts.row(0).segment(start_col, num_cols).array() - hyp.center(0);
+  const Arr qy = pts.row(1).segment(start_col, num_cols).array() - hyp.center(1);
+  const Arr qz = pts.row(2).segment(start_col, num_cols).array() - hyp.center(2);
+
+  // signed distance to the plane of the circle
+  const Arr h = (hyp.normal(0) * qx) + (hyp.normal(1) * qy) + (hyp.normal(2) * qz);
+
+  const Arr h_sq = h.square();
+
+  // distance to the axis of the circle
+  const Arr rad = ((qx.square() + qy.square() + qz.square()) - h_sq).max(CoordScalar(0)).sqrt();
+
+  return h_sq + (rad - hyp.radius).square();
+}
+
+}  // un-named
 
 std::tuple<xreg::Pt3,xreg::CoordScalar> xreg::FitOrbitToPts(const Pt3List& pts)
 {
@@ -83,3 +159,151 @@ std::tuple<xreg::Pt3,xreg::CoordScalar> xreg::FitOrbitToPts(const Pt3List& pts)
   return std::make_tuple(mean_pt + (u1 * center_pt_2d(0)) + (u2 * center_pt_2d(1)), radius);
 }
 
+
+std::tuple<xreg::Pt3,xreg::CoordScalar,std::vector<xreg::size_type>>
+xreg::FitOrbitToPtsRANSAC(const Pt3List& pts, const CoordScalar inlier_thresh,
+                          const size_type num_hyps, const bool use_preemptive_scoring)
+{
+  const size_type num_pts = pts.size();
+
+  xregASSERT(num_pts > 2);
+  xregASSERT(num_hyps > 0);
+
+  const CoordScalar inlier_thresh_sq = inlier_thresh * inlier_thresh;
+
+  std::mt19937 rng_eng;
+  SeedRNGEngWithRandDev(&rng_eng);
+
+  const PhiloxKey rng_key = MakePhiloxKey((static_cast<std::uint64_t>(rng_eng()) << 32) | rng_eng());
+
+  std::vector<OrbitHyp> hyps(num_hyps);
+
+  auto make_hyps = [&] (const RangeType& r)
+  {
+    for (size_type hyp_idx = r.begin(); hyp_idx < r.end(); ++hyp_idx)
+    {
+      const auto inds = SampleComboPhilox(num_pts, 3, hyp_idx, rng_key);
+
+      hyps[hyp_idx] = OrbitThroughPts(pts[inds[0]], pts[inds[1]], pts[inds[2]]);
+    }
+  };
+
+  ParallelFor(make_hyps, RangeType(0, num_hyps));
+
+  std::vector<size_type> cand_hyp_inds;
+  cand_hyp_inds.reserve(num_hyps);
+
+  for (size_type hyp_idx = 0; hyp_idx < num_hyps; ++hyp_idx)
+  {
+    if (hyps[hyp_idx].valid)
+    {
+      cand_hyp_inds.push_back(hyp_idx);
+    }
+  }
+
+  if (cand_hyp_inds.empty())
+  {
+    xregThrow("All orbit hypotheses were created from colinear points!");
+  }
+
+  // when preemptive scoring is used, the points are visited in a random order
+  std::vector<size_type> pt_order(num_pts);
+  std::iota(pt_order.begin(), pt_order.end(), size_type(0));
+
+  if (use_preemptive_scoring)
+  {
+    std::shuffle(pt_order.begin(), pt_order.end(), rng_eng);
+  }
+
+  PtsSoA pts_soa(3, num_pts);
+  for (size_type i = 0; i < num_pts; ++i)
+  {
+    pts_soa.col(i) = pts[pt_order[i]];
+  }
+
+  const size_type block_size = use_preemptive_scoring ? size_type(100) : num_pts;
+
+  std::vector<size_type> num_inliers(num_hyps, 0);
+
+  for (size_type block_start = 0, block_idx = 1;
+       (block_start < num_pts) && (!use_preemptive_scoring || (cand_hyp_inds.size() > 1));
+       block_start += block_size, ++block_idx)
+  {
+    const size_type cur_block_size = std::min(block_size, num_pts - block_start);
+
+    auto score_block = [&] (const RangeType& r)
+    {
+      for (size_type k = r.begin(); k < r.end(); ++k)
+      {
+        const size_type hyp_idx = cand_hyp_inds[k];
+
+        num_inliers[hyp_idx] += (SqDistsToOrbit(hyps[hyp_idx], pts_soa, block_start, cur_block_size)
+                                                                  < inlier_thresh_sq).count();
+      }
+    };
+
+    ParallelFor(score_block, RangeType(0, cand_hyp_inds.size()));
+
+    if (use_preemptive_scoring)
+    {
+      // keep the best num_hyps * 2^(-block_idx) hypotheses
+      const size_type num_to_keep = std::max(size_type(1), num_hyps >> std::min(block_idx, size_type(63)));
+
+      if (cand_hyp_inds.size() > num_to_keep)
+      {
+        std::partial_sort(cand_hyp_inds.begin(), cand_hyp_inds.begin() + num_to_keep, cand_hyp_inds.end(),
+                          [&num_inliers] (const size_type i, const size_type j)
+                          {
+                            return (num_inliers[i] > num_inliers[j]) ||
+                                   ((num_inliers[i] == num_inliers[j]) && (i < j));
+                          });
+
+        cand_hyp_inds.resize(num_to_keep);
+      }
+    }
+  }
+
+  const size_type best_hyp_idx = *std::min_element(cand_hyp_inds.begin(), cand_hyp_inds.end(),
+                          [&num_inliers] (const size_type i, const size_type j)
+                          {
+                            return (num_inliers[i] > num_inliers[j]) ||
+                                   ((num_inliers[i] == num_inliers[j]) && (i < j));
+                          });
+
+  // the inliers of the best hypothesis using every point
+  const Eigen::Array<CoordScalar,1,Eigen::Dynamic> best_sq_dists =
+                              SqDistsToOrbit(hyps[best_hyp_idx], pts_soa, 0, num_pts);
+
+  std::vector<size_type> inlier_inds;
+  inlier_inds.reserve(num_pts);
+
+  for (size_type i = 0; i < num_pts; ++i)
+  {
+    if (best_sq_dists(i) < inlier_thresh_sq)
+    {
+      inlier_inds.push_back(pt_order[i]);
+    }
+  }
+
+  std::sort(inlier_inds.begin(), inlier_inds.end());
+
+  if (inlier_inds.size() < 3)
+  {
+    xregThrow("Insufficient number of orbit inliers: %lu",
+              static_cast<unsigned long>(inlier_inds.size()));
+  }
+
+  Pt3List inlier_pts;
+  inlier_pts.reserve(inlier_inds.size());
+
+  for (const auto& i : inlier_inds)
+  {
+    inlier_pts.push_back(pts[i]);
+  }
+
+  Pt3 center_of_rot;
+  CoordScalar radius = 0;
+  std::tie(center_of_rot,radius) = FitOrbitToPts(inlier_pts);
+
+  return std::make_tuple(center_of_rot, radius, inlier_inds);
+}
@@ -37,6 +37,22 @@ namespace xreg
 // value returned is the estimated radius. 
 std::tuple<Pt3,CoordScalar> FitOrbitToPts(const Pt3List& pts);
 
+// Fits a 3D circular orbit to a collection of points which may contain outliers.
+// Each RANSAC hypothesis is the circle passing through three points, sampled
+// using an independent random stream, and points with a distance to the circle
+// less than inlier_thresh are counted as inliers. The hypotheses are scored in
+// parallel. When preemptive scoring is used, every hypothesis is scored on
+// blocks of points in a random order and only the best half of the hypotheses
+// are kept after each block (Nister's preemptive RANSAC), so that the full
+// collection of points is only visited by a few hypotheses.
+// The orbit is then estimated from the inliers of the best hypothesis using
+// FitOrbitToPts(). The values returned are the estimated 3D center of rotation,
+// the estimated radius and the indices of the inliers.
+std::tuple<Pt3,CoordScalar,std::vector<size_type>>
+FitOrbitToPtsRANSAC(const Pt3List& pts, const CoordScalar inlier_thresh,
+                    const size_type num_hyps = 500,
+                    const bool use_preemptive_scoring = true);
+
 }  // xreg
 
 #endif
@@ -28,6 +28,7 @@
 #include "xregSampleUtils.h"
 #include "xregAssert.h"
 #include "xregCMAESInterface.h"
+#include "xregTBBUtils.h"
 
 std::tuple<xreg::Plane3,xreg::Pt3>
 xreg::FitPlaneToPoints(const Pt3List& pts)
@@ -77,174 +78,270 @@ xreg::Plane3 xreg::FitPlaneToPoints(const Pt3& x1, const Pt3& x2, const Pt3& x3,
   return Plane3{n, n.dot(x1)};
 }
 
+namespace  // un-named
+{
+
+using namespace xreg;
+
+// Row k holds the kth component of each point, so that the distances of all
+// points to a plane are computed using vectorized operations.
+using PtsSoA = Eigen::Matrix<CoordScalar,3,Eigen::Dynamic,Eigen::RowMajor>;
+
+struct PlaneRANSACHyp
+{
+  bool consensus_found = false;
+
+  Plane3 plane;
+
+  Pt3 pt_on_plane;
+
+  CoordScalar avg_dist;
+
+  std::vector<size_type> model_inds;
+};
+
+// Mean and standard deviation of the distances of points to a plane, and the
+// number of points closer than the mean plus one standard deviation. The
+// points used to create the plane are excluded.
+std::tuple<CoordScalar,CoordScalar,size_type>
+PlaneRANSACDistStats(const Eigen::Array<CoordScalar,1,Eigen::Dynamic>& dists,
+                     const std::vector<size_type>& sample_inds)
+{
+  const size_type num_pts = dists.size();
+
+  CoordScalar sample_sum = 0;
+  for (const auto& i : sample_inds)
+  {
+    sample_sum += dists(i);
+  }
+
+  const CoordScalar mean = (dists.sum() - sample_sum) / (num_pts - 3);
+
+  CoordScalar sample_sq_sum = 0;
+  for (const auto& i : sample_inds)
+  {
+    const CoordScalar a = dists(i) - mean;
+    sample_sq_sum += a * a;
+  }
+
+  const CoordScalar std_dev = std::sqrt((((dists - mean).square().sum()) - sample_sq_sum) /
+                                        (num_pts - 4));
+
+  const CoordScalar poss_inlier_thresh = mean + (1 * std_dev);
+
+  size_type num_poss_inliers = (dists < poss_inlier_thresh).count();
+
+  for (const auto& i : sample_inds)
+  {
+    if (dists(i) < poss_inlier_thresh)
+    {
+      --num_poss_inliers;
+    }
+  }
+
+  return std::make_tuple(mean, std_dev, num_poss_inliers);
+}
+
+}  // un-named
+
 std::tuple<xreg::Plane3,xreg::Pt3,xreg::Pt3List>
 xreg::FitPlaneToPointsRANSAC(const Pt3List& pts,
                              const double consensus_ratio_min_thresh,
-                             const size_type max_num_its)
+                             const size_type max_num_its,
+                             const bool use_preemptive_scoring)
 {
   const size_type num_pts = pts.size();
   xregASSERT(num_pts > 4);
 
   const size_type consensus_num_pts_min = std::lround(num_pts * consensus_ratio_min_thresh);
 
-  std::mt19937 rng_eng;
-  SeedRNGEngWithRandDev(&rng_eng);
+  PtsSoA pts_soa(3, num_pts);
+  for (size_type i = 0; i < num_pts; ++i)
+  {
+    pts_soa.col(i) = pts[i];
+  }
 
-  std::uniform_int_distribution<size_type> uni_dist(0, num_pts - 1);
+  PhiloxKey rng_key;
+  PtsSoA preview_pts_soa;
 
-  auto sample_inlier_inds = [&rng_eng,&uni_dist]()
   {
-    std::array<size_type,3> inds;
-    inds[0] = uni_dist(rng_eng);
-    
-    inds[1] = uni_dist(rng_eng);
-    while (inds[1] == inds[0])
+    std::mt19937 rng_eng;
+    SeedRNGEngWithRandDev(&rng_eng);
+
+    rng_key = MakePhiloxKey((static_cast<std::uint64_t>(rng_eng()) << 32) | rng_eng());
+  
+    if (use_preemptive_scoring)
     {
-      inds[1] = uni_dist(rng_eng);
+      constexpr size_type kNUM_PREVIEW_PTS = 256;
+
+      if (num_pts > (2 * kNUM_PREVIEW_PTS))
+      {
+        const auto preview_inds = SampleSortedSubset(num_pts, kNUM_PREVIEW_PTS, rng_eng);
+
+        preview_pts_soa.resize(3, kNUM_PREVIEW_PTS);
+
+        for (size_type i = 0; i < kNUM_PREVIEW_PTS; ++i)
+        {
+          preview_pts_soa.col(i) = pts_soa.col(preview_inds[i]);
+        }
+      }
     }
-    
-    inds[2] = uni_dist(rng_eng);
-    while ((inds[2] == inds[0]) || (inds[2] == inds[1]))
+  }
+
+  const size_type num_preview_pts = preview_pts_soa.cols();
+  
+  // a hypothesis is discarded when the fraction of possible inliers in the
+  // preview subset is more than three standard deviations below the required
+  // consensus ratio
+  const CoordScalar preview_min_num_poss_inliers = num_preview_pts *
+      (consensus_ratio_min_thresh - (3 * std::sqrt(consensus_ratio_min_thresh *
+                                                   (1 - consensus_ratio_min_thresh) /
+                                                   std::max(num_preview_pts, size_type(1)))));
+
+  auto score_hyp = [&] (const size_type hyp_idx, PlaneRANSACHyp* hyp)
+  {
+    hyp->consensus_found = false;
+
+    const auto sample_inds = SampleComboPhilox(num_pts, 3, hyp_idx, rng_key);
+
+    const Plane3 cur_plane = FitPlaneToPoints(pts[sample_inds[0]], pts[sample_inds[1]],
+                                              pts[sample_inds[2]]);
+
+    if (!(cur_plane.normal.norm() > 1.0e-8))
     {
-      inds[2] = uni_dist(rng_eng);
+      return;
     }
 
-    return inds;
-  };
+    if (num_preview_pts)
+    {
+      const Eigen::Array<CoordScalar,1,Eigen::Dynamic> preview_dists =
+          ((cur_plane.normal.transpose() * preview_pts_soa).array() - cur_plane.scalar).abs();
 
-  std::vector<CoordScalar> all_dists(num_pts);
+      const CoordScalar mean = preview_dists.mean();
+      const CoordScalar std_dev = std::sqrt((preview_dists - mean).square().sum() / (num_preview_pts - 1));
 
-  std::vector<size_type> poss_inlier_inds;
-  poss_inlier_inds.reserve(num_pts);
+      if ((preview_dists < (mean + std_dev)).count() < preview_min_num_poss_inliers)
+      {
+        return;
+      }
+    }
 
-  Pt3List cur_model_pts;
-  cur_model_pts.reserve(num_pts);
+    // compute the standard deviation of non-inlier distances to the current plane
+    // we'll ignore points more than some number of standard deviations away from
+    // the mean
+    const Eigen::Array<CoordScalar,1,Eigen::Dynamic> dists =
+          ((cur_plane.normal.transpose() * pts_soa).array() - cur_plane.scalar).abs();
 
-  Pt3List best_model_pts;
-  best_model_pts.reserve(num_pts);
+    CoordScalar mean = 0;
+    CoordScalar std_dev = 0;
+    size_type num_poss_inliers = 0;
 
-  std::array<size_type,3> cur_inliers;
-  auto is_not_inlier = [&cur_inliers] (const size_type i)
-  {
-    return (i != cur_inliers[0]) && (i != cur_inliers[1]) && (i != cur_inliers[2]);
+    std::tie(mean,std_dev,num_poss_inliers) = PlaneRANSACDistStats(dists, sample_inds);
+
+    // see if we have a sufficient number of possible inliers
+    if (num_poss_inliers < consensus_num_pts_min)
+    {
+      return;
+    }
+
+    hyp->consensus_found = true;
+
+    // we have a consensus, now fit a plane using the consensus set union
+    // the current inliers
+
+    const CoordScalar poss_inlier_thresh = mean + (1 * std_dev);
+
+    auto& model_inds = hyp->model_inds;
+    model_inds.clear();
+    model_inds.reserve(num_poss_inliers + 3);
+
+    for (size_type i = 0; i < num_pts; ++i)
+    {
+      if ((dists(i) < poss_inlier_thresh) &&
+          (std::find(sample_inds.begin(), sample_inds.end(), i) == sample_inds.end()))
+      {
+        model_inds.push_back(i);
+      }
+    }
+
+    model_inds.insert(model_inds.end(), sample_inds.begin(), sample_inds.end());
+
+    const size_type num_model_pts = model_inds.size();
+
+    PtsSoA model_pts_soa(3, num_model_pts);
+    Pt3List model_pts(num_model_pts);
+
+    for (size_type k = 0; k < num_model_pts; ++k)
+    {
+      model_pts[k] = pts[model_inds[k]];
+      model_pts_soa.col(k) = model_pts[k];
+    }
+
+    std::tie(hyp->plane,hyp->pt_on_plane) = FitPlaneToPoints(model_pts);
+
+    // compute the average error of this new model
+    hyp->avg_dist = ((hyp->plane.normal.transpose() * model_pts_soa).array() -
+                                                          hyp->plane.scalar).abs().mean();
   };
 
+  // the hypotheses of a block are scored concurrently, the search stops after a
+  // block once a model has been found with a small enough error
+  constexpr size_type kHYP_BLOCK_SIZE = 16;
+
+  std::vector<PlaneRANSACHyp> block_hyps(kHYP_BLOCK_SIZE);
+
   Plane3 best_plane = { Pt3::Zero(), 0 };
   CoordScalar best_avg_dist = std::numeric_limits<CoordScalar>::max();
   Pt3         best_pt_on_plane;
 
-  bool at_least_one_consensus_found = false;
+  std::vector<size_type> best_model_inds;
 
   bool should_stop = false;
 
-  size_type iter = 0;
-
-  while (!should_stop)
+  for (size_type block_start = 0; !should_stop && (block_start < max_num_its);
+       block_start += kHYP_BLOCK_SIZE)
   {
-    cur_inliers = sample_inlier_inds();
-
-    auto cur_plane = FitPlaneToPoints(pts[cur_inliers[0]], pts[cur_inliers[1]],
-                                      pts[cur_inliers[2]]);
+    const size_type num_block_hyps = std::min(kHYP_BLOCK_SIZE, max_num_its - block_start);
 
-    if (cur_plane.normal.norm() > 1.0e-8)
+    auto score_block = [&] (const RangeType& r)
     {
-      // compute the standard deviation of non-inlier distances to the current plane
-      // we'll ignore points more than some number of standard deviations away from
-      // the mean
-
-      CoordScalar sum = 0;
-
-      for (size_type i = 0; i < num_pts; ++i)
+      for (size_type k = r.begin(); k < r.end(); ++k)
       {
-        if (is_not_inlier(i))
-        {
-          all_dists[i] = DistToPlane(pts[i], cur_plane);
-          
-          sum += all_dists[i];
-        }
+        score_hyp(block_start + k, &block_hyps[k]);
       }
+    };
 
-      const CoordScalar mean = sum / (num_pts - 3);
-    
-      sum = 0; 
-      
-      for (size_type i = 0; i < num_pts; ++i)
-      {
-        if (is_not_inlier(i))
-        {
-          const CoordScalar a = all_dists[i] - mean;
-          
-          sum += a * a;
-        }
-      }
+    ParallelFor(score_block, RangeType(0, num_block_hyps));
 
-      const CoordScalar std_dev = std::sqrt(sum / (num_pts - 4));
-      
-      const CoordScalar poss_inlier_thresh = mean + (1 * std_dev);
+    // visit the hypotheses in order, so the result matches a serial search
+    for (size_type k = 0; !should_stop && (k < num_block_hyps); ++k)
+    {
+      auto& hyp = block_hyps[k];
 
-      // threshold to get the possible inliers
-      poss_inlier_inds.clear(); 
-      for (size_type i = 0; i < num_pts; ++i)
-      {
-        if (is_not_inlier(i) && (all_dists[i] < poss_inlier_thresh))
-        {
-          poss_inlier_inds.push_back(i);
-        }
-      }
-      
-      // see if we have a sufficient number of possible inliers
-      if (poss_inlier_inds.size() >= consensus_num_pts_min)
+      if (hyp.consensus_found && (hyp.avg_dist < best_avg_dist))
       {
-        at_least_one_consensus_found = true;
+        // the current model is a better bit to inliers/consensus than
+        // the previous best model, update the best
+        best_plane       = hyp.plane;
+        best_pt_on_plane = hyp.pt_on_plane;
+        best_avg_dist    = hyp.avg_dist;
 
-        // we have a consensus, now fit a plane using the consensus set union
-        // the current inliers
+        best_model_inds.swap(hyp.model_inds);
 
-        poss_inlier_inds.push_back(cur_inliers[0]);
-        poss_inlier_inds.push_back(cur_inliers[1]);
-        poss_inlier_inds.push_back(cur_inliers[2]);
-      
-        cur_model_pts.clear();
-
-        for (const auto& i : poss_inlier_inds)
-        {
-          cur_model_pts.push_back(pts[i]);
-        }
-
-        Pt3 pt_on_plane;        
-        std::tie(cur_plane,pt_on_plane) = FitPlaneToPoints(cur_model_pts);
-        
-        // compute the average error of this new model
-        sum = 0;
-        for (const auto& p : cur_model_pts)
+        if (best_avg_dist < 1.0e-3)
         {
-          sum += DistToPlane(p, cur_plane);
-        }
-        sum /= cur_model_pts.size();
-        
-        if (sum < best_avg_dist)
-        {
-          // the current model is a better bit to inliers/consensus than
-          // the previous best model, update the best
-          best_plane = cur_plane;
-          best_pt_on_plane = pt_on_plane;
-          best_avg_dist = sum;
-        
-          best_model_pts = cur_model_pts;
-
-          if (sum < 1.0e-3)
-          {
-            should_stop = true;
-          }
+          should_stop = true;
         }
       }
     }
-    
-    ++iter;
-    if (!should_stop && (iter == max_num_its))
-    {
-      should_stop = true;
-    }
+  }
+
+  Pt3List best_model_pts;
+  best_model_pts.reserve(best_model_inds.size());
+
+  for (const auto& i : best_model_inds)
+  {
+    best_model_pts.push_back(pts[i]);
   }
 
   return std::make_tuple(best_plane, best_pt_on_plane, best_model_pts);
@@ -41,10 +41,19 @@ Plane3 FitPlaneToPoints(const Pt3& x1, const Pt3& x2, const Pt3& x3,
                         const bool checked = false);
 
 // returns (plane, closest point to plane, list of points used to estimate the plane)
+//
+// The hypotheses are scored in parallel, in blocks, and the search stops after
+// the block containing a hypothesis with a sufficiently small fitting error.
+// The points used to create each hypothesis are sampled using an independent
+// random stream, so the result does not depend on the number of threads.
+// When preemptive scoring is enabled, each hypothesis is first scored using a
+// random subset of the points and is discarded without scoring the remaining
+// points when the subset indicates that a consensus is very unlikely.
 std::tuple<Plane3,Pt3,Pt3List>
 FitPlaneToPointsRANSAC(const Pt3List& pts,
                        const double consensus_ratio_min_thresh = 0.5,
-                       const size_type max_num_its = 50);
+                       const size_type max_num_its = 50,
+                       const bool use_preemptive_scoring = false);
 
 // returns (plane, refernce point on plane)
 std::tuple<Plane3,Pt3>
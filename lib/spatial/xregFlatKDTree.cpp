@@ -0,0 +1,95 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "xregFlatKDTree.h"
+
+void xreg::detail::FlatKDTreeLeafPackets<xreg::KDTreeTri>::init(const std::vector<KDTreeTri>& tris)
+{
+  const size_type num_tris = tris.size();
+
+  plane_len = num_tris + 3;
+
+  soa.assign(9 * plane_len, CoordScalar(0));
+
+  for (size_type i = 0; i < num_tris; ++i)
+  {
+    for (size_type v = 0; v < 3; ++v)
+    {
+      const Pt3& vert = *tris[i].verts[v];
+
+      for (size_type d = 0; d < 3; ++d)
+      {
+        soa[((v * 3) + d) * plane_len + i] = vert[d];
+      }
+    }
+  }
+}
+
+void xreg::detail::FlatKDTreeLeafPackets<xreg::KDTreeTri>::clear()
+{
+  soa.clear();
+  plane_len = 0;
+}
+
+xreg::CoordScalar
+xreg::detail::FlatKDTreeLeafPackets<xreg::KDTreeTri>::closest(const Pt3& x,
+                                                              const size_type b,
+                                                              const size_type n,
+                                                              size_type* min_idx) const
+{
+  using ConstArray4Map = Eigen::Map<const CoordArray4>;
+
+  CoordScalar min_dist_sq = std::numeric_limits<CoordScalar>::max();
+
+  TriPacket4 packet;
+
+  for (size_type off = 0; off < n; off += 4)
+  {
+    const CoordScalar* cur_soa = &soa[b + off];
+
+    for (size_type d = 0; d < 3; ++d)
+    {
+      packet.p[d] = ConstArray4Map(cur_soa + (d * plane_len));
+      packet.q[d] = ConstArray4Map(cur_soa + ((3 + d) * plane_len));
+      packet.r[d] = ConstArray4Map(cur_soa + ((6 + d) * plane_len));
+    }
+
+    const CoordArray4 dist_sq = PtToTrisDistSq(x, packet);
+
+    // lanes past the end of the leaf hold the next leaf's triangles, or padding
+    const size_type num_valid = std::min(size_type(4), n - off);
+
+    for (size_type k = 0; k < num_valid; ++k)
+    {
+      if (dist_sq[k] < min_dist_sq)
+      {
+        min_dist_sq = dist_sq[k];
+        *min_idx = b + off + k;
+      }
+    }
+  }
+
+  return min_dist_sq;
+}
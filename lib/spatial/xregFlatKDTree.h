@@ -0,0 +1,1218 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file
+ * @brief Flat, array-backed, KD-Tree for points and shapes.
+ *
+ * The nodes are stored contiguously in depth-first order and each leaf
+ * references a contiguous range of primitives, so that queries walk through
+ * memory in a predictable pattern instead of chasing heap pointers. Every
+ * node stores an axis-aligned box about the primitives it contains, which are
+ * used for pruning during queries (making this closer to a bounding volume
+ * hierarchy than a classical KD-Tree). Trees may be written to and restored
+ * from disk, see xregH5KDTreeIO.h.
+ **/
+
+#ifndef XREGFLATKDTREE_H_
+#define XREGFLATKDTREE_H_
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#include "xregExceptionUtils.h"
+#include "xregKDTree.h"
+#include "xregSpatialPrimitives.h"
+
+namespace xreg
+{
+
+namespace detail
+{
+
+// Leaf primitives are tested one at a time by default; shape types with a
+// SIMD distance routine specialize this to test several primitives at once.
+template <class T>
+struct FlatKDTreeLeafPackets
+{
+  constexpr static bool kENABLED = false;
+
+  void init(const std::vector<T>&) { }
+
+  void clear() { }
+
+  CoordScalar closest(const typename KDTreePointType<T>::type&, const size_type,
+                      const size_type, size_type*) const
+  {
+    return 0;
+  }
+};
+
+// Stores the vertices of the leaf triangles in structure-of-arrays form, so
+// that PtToTrisDistSq() may be used to test four triangles at a time.
+template <>
+struct FlatKDTreeLeafPackets<KDTreeTri>
+{
+  constexpr static bool kENABLED = true;
+
+  // nine planes of vertex components (p_x, p_y, p_z, q_x, ..., r_z), each
+  // padded so that four elements may always be loaded
+  std::vector<CoordScalar> soa;
+
+  size_type plane_len = 0;
+
+  void init(const std::vector<KDTreeTri>& tris);
+
+  void clear();
+
+  // Returns the smallest squared distance between x and the triangles
+  // [b, b + n) and the index of the closest triangle.
+  CoordScalar closest(const Pt3& x, const size_type b, const size_type n,
+                      size_type* min_idx) const;
+};
+
+}  // detail
+
+/**
+ * @brief A KD-Tree stored as a flat list of nodes.
+ *
+ * This has the same query interface as KDTreeNode, and accepts the same point
+ * and shape types (e.g. Pt3 and KDTreeTri). Unlike KDTreeNode, the input
+ * collection is not re-ordered; an internal copy of the primitives is stored
+ * in the order that they are referenced by the leaves.
+ *
+ * Nodes are split about the dimension of largest centroid extent, either at
+ * the median or at the position minimizing a binned surface area heuristic
+ * (SAH). Sufficiently large sub-trees are built concurrently.
+ *
+ * Triangles in a leaf are tested against a query point four at a time with
+ * SIMD arithmetic, and large batches of queries are processed in Morton
+ * order, so that consecutive queries on a thread traverse similar paths.
+ **/
+template <class T>
+class FlatKDTree
+{
+public:
+  class UninitializedException { };
+
+  using value_type = T;
+
+  using Pt = typename KDTreePointType<value_type>::type;
+
+  using Scalar = typename Pt::Scalar;
+
+  using PtList       = std::vector<Pt>;
+  using DistList     = std::vector<CoordScalar>;
+  using ShapePtrList = std::vector<const value_type*>;
+  using PrimList     = std::vector<value_type>;
+
+  using IndexList = std::vector<std::uint32_t>;
+
+  static_assert(Pt::RowsAtCompileTime > 0, "point type must have a fixed size.");
+
+  constexpr static size_type kDIM = Pt::RowsAtCompileTime;
+
+  enum SplitMethod
+  {
+    kMEDIAN_SPLIT = 0,
+    kSAH_SPLIT
+  };
+
+  /// \brief A node of the tree.
+  ///
+  /// The left child of an interior node immediately follows the node, and the
+  /// right child is located link nodes after it. Relative offsets allow
+  /// separately built sub-trees to be concatenated without modification.
+  struct Node
+  {
+    // Bounding box about all primitives in this node
+    Pt lower;
+    Pt upper;
+
+    // Interior nodes: offset from this node to the right child.
+    // Leaf nodes: index of the first primitive in this leaf.
+    std::uint32_t link = 0;
+
+    // Number of primitives in this leaf, zero for interior nodes.
+    std::uint32_t num_prims = 0;
+
+    bool is_leaf() const
+    {
+      return num_prims != 0;
+    }
+  };
+
+  using NodeList = std::vector<Node, Eigen::aligned_allocator<Node>>;
+
+  /// \brief Maximum number of primitives stored in a leaf; set before init()
+  size_type max_leaf_size = 4;
+
+  /// \brief Method used to split nodes; set before init()
+  SplitMethod split_method = kSAH_SPLIT;
+
+  /// \brief Number of bins, per dimension, evaluated by the SAH; set before init()
+  size_type num_sah_bins = 16;
+
+  FlatKDTree() = default;
+
+  /// \brief Constructs a tree using the default build settings.
+  ///
+  /// This is a drop-in replacement for the equivalent KDTreeNode constructor.
+  template <class Itr>
+  FlatKDTree(Itr begin_it, Itr end_it)
+  {
+    init(begin_it, end_it);
+  }
+
+  /// \brief Builds the tree from a collection of points or shapes.
+  ///
+  /// The input collection is copied and not modified.
+  template <class Itr>
+  void init(Itr begin_it, Itr end_it)
+  {
+    static_assert(std::is_same<value_type, typename std::iterator_traits<Itr>::value_type>::value,
+                  "Tree shape type differs from input shape type.");
+
+    xregASSERT(max_leaf_size > 0);
+    xregASSERT(num_sah_bins > 1);
+
+    clear();
+
+    PrimList src_prims(begin_it, end_it);
+
+    const size_type num_prims = src_prims.size();
+
+    if (num_prims)
+    {
+      xregASSERT(num_prims < std::numeric_limits<std::uint32_t>::max());
+
+      BuildData bd;
+      bd.prims = &src_prims;
+      bd.lowers.resize(num_prims);
+      bd.uppers.resize(num_prims);
+      bd.centroids.resize(num_prims);
+
+      prim_inds_.resize(num_prims);
+
+      auto prim_info_fn = [&bd,&src_prims,this] (const RangeType& r)
+      {
+        for (size_type i = r.begin(); i != r.end(); ++i)
+        {
+          std::tie(bd.lowers[i], bd.uppers[i]) = PrimBoundsHelper(src_prims[i]);
+
+          bd.centroids[i] = CentroidHelper(src_prims[i]);
+
+          this->prim_inds_[i] = static_cast<std::uint32_t>(i);
+        }
+      };
+
+      ParallelFor(prim_info_fn, RangeType(0, num_prims));
+
+      build_node(&bd, 0, num_prims, 0, &nodes_);
+
+      prims_.resize(num_prims);
+
+      auto reorder_fn = [&src_prims,this] (const RangeType& r)
+      {
+        for (size_type i = r.begin(); i != r.end(); ++i)
+        {
+          this->prims_[i] = src_prims[this->prim_inds_[i]];
+        }
+      };
+
+      ParallelFor(reorder_fn, RangeType(0, num_prims));
+
+      leaf_packets_.init(prims_);
+    }
+  }
+
+  /// \brief Restores a tree from a previously computed node list and
+  ///        primitive permutation.
+  ///
+  /// prims must be the collection originally passed to init(); the
+  /// permutation maps each leaf primitive slot to an index into prims.
+  /// This is used when reading a cached tree from disk.
+  template <class Itr>
+  void restore(const NodeList& nodes, const IndexList& prim_inds, Itr begin_it, Itr end_it)
+  {
+    static_assert(std::is_same<value_type, typename std::iterator_traits<Itr>::value_type>::value,
+                  "Tree shape type differs from input shape type.");
+
+    clear();
+
+    const size_type num_prims = std::distance(begin_it, end_it);
+
+    if (prim_inds.size() != num_prims)
+    {
+      xregThrow("number of primitives (%lu) does not match tree permutation (%lu)!",
+                static_cast<unsigned long>(num_prims),
+                static_cast<unsigned long>(prim_inds.size()));
+    }
+
+    if (nodes.empty() != (num_prims == 0))
+    {
+      xregThrow("nodes are inconsistent with number of primitives!");
+    }
+
+    const size_type num_nodes = nodes.size();
+
+    for (size_type i = 0; i < num_nodes; ++i)
+    {
+      const Node& n = nodes[i];
+
+      if (n.is_leaf() ? ((size_type(n.link) + n.num_prims) > num_prims) :
+                        ((n.link < 2) || ((i + n.link) >= num_nodes)))
+      {
+        xregThrow("invalid tree node: %lu", static_cast<unsigned long>(i));
+      }
+    }
+
+    prims_.resize(num_prims);
+
+    for (size_type i = 0; i < num_prims; ++i)
+    {
+      if (prim_inds[i] >= num_prims)
+      {
+        xregThrow("invalid primitive index in tree permutation!");
+      }
+
+      prims_[i] = *(begin_it + prim_inds[i]);
+    }
+
+    nodes_     = nodes;
+    prim_inds_ = prim_inds;
+
+    leaf_packets_.init(prims_);
+  }
+
+  /// \brief Clears the tree of any contents.
+  void clear()
+  {
+    nodes_.clear();
+    prims_.clear();
+    prim_inds_.clear();
+
+    leaf_packets_.clear();
+  }
+
+  bool empty() const
+  {
+    return nodes_.empty();
+  }
+
+  /// \brief The nodes of the tree, in depth-first order.
+  const NodeList& nodes() const
+  {
+    return nodes_;
+  }
+
+  /// \brief The primitives stored in the tree, in leaf order.
+  const PrimList& prims() const
+  {
+    return prims_;
+  }
+
+  /// \brief The index into the original input collection of each primitive
+  ///        stored in the tree.
+  const IndexList& prim_inds() const
+  {
+    return prim_inds_;
+  }
+
+  /// \brief Find the closest point represented by this tree to a given query point.
+  ///
+  /// See KDTreeNode::find_closest_point() for the details. When shp is
+  /// non-null, it will point to a primitive stored in this tree.
+  std::tuple<Pt,CoordScalar> find_closest_point(const Pt& x, const value_type** shp = nullptr) const
+  {
+    if (nodes_.empty())
+    {
+      throw UninitializedException();
+    }
+
+    Pt best_pt = Pt::Zero();
+
+    CoordScalar best_dist = std::numeric_limits<CoordScalar>::max();
+    Scalar      best_dist_sq = std::numeric_limits<Scalar>::max();
+
+    const value_type* best_shp = nullptr;
+
+    Pt          cur_pt;
+    CoordScalar cur_dist = 0;
+
+    StackEntry stack[kMAX_STACK_SIZE];
+    size_type stack_size = 0;
+
+    stack[stack_size++] = StackEntry{ 0, BoxDistSq(nodes_[0], x) };
+
+    while (stack_size)
+    {
+      const StackEntry cur = stack[--stack_size];
+
+      if (cur.dist_sq >= best_dist_sq)
+      {
+        continue;
+      }
+
+      const Node& n = nodes_[cur.node_idx];
+
+      if (n.is_leaf())
+      {
+        if (LeafPackets::kENABLED)
+        {
+          // the packet distances are only used to select a candidate, the
+          // closest point is computed the same way as a single primitive
+          size_type leaf_min_idx = 0;
+
+          if (leaf_packets_.closest(x, n.link, n.num_prims, &leaf_min_idx) < best_dist_sq)
+          {
+            std::tie(cur_pt, cur_dist) = FindClosestPtHelper(x, prims_[leaf_min_idx]);
+
+            if (cur_dist < best_dist)
+            {
+              best_pt      = cur_pt;
+              best_dist    = cur_dist;
+              best_dist_sq = cur_dist * cur_dist;
+              best_shp     = &prims_[leaf_min_idx];
+            }
+          }
+        }
+        else
+        {
+          const size_type prim_end = n.link + n.num_prims;
+
+          for (size_type i = n.link; i < prim_end; ++i)
+          {
+            std::tie(cur_pt, cur_dist) = FindClosestPtHelper(x, prims_[i]);
+
+            if (cur_dist < best_dist)
+            {
+              best_pt      = cur_pt;
+              best_dist    = cur_dist;
+              best_dist_sq = cur_dist * cur_dist;
+              best_shp     = &prims_[i];
+            }
+          }
+        }
+      }
+      else
+      {
+        const std::uint32_t left_idx  = cur.node_idx + 1;
+        const std::uint32_t right_idx = cur.node_idx + n.link;
+
+        const Scalar left_dist_sq  = BoxDistSq(nodes_[left_idx], x);
+        const Scalar right_dist_sq = BoxDistSq(nodes_[right_idx], x);
+
+        xregASSERT((stack_size + 2) <= kMAX_STACK_SIZE);
+
+        // push the farther child first, so that the nearer child is visited next
+        if (left_dist_sq < right_dist_sq)
+        {
+          if (right_dist_sq < best_dist_sq)
+          {
+            stack[stack_size++] = StackEntry{ right_idx, right_dist_sq };
+          }
+
+          stack[stack_size++] = StackEntry{ left_idx, left_dist_sq };
+        }
+        else
+        {
+          if (left_dist_sq < best_dist_sq)
+          {
+            stack[stack_size++] = StackEntry{ left_idx, left_dist_sq };
+          }
+
+          stack[stack_size++] = StackEntry{ right_idx, right_dist_sq };
+        }
+      }
+    }
+
+    if (shp)
+    {
+      *shp = best_shp;
+    }
+
+    return std::make_tuple(best_pt, best_dist);
+  }
+
+  void find_closest_points(const PtList& in_pts, PtList* out_pts) const
+  {
+    find_closest_points(in_pts, out_pts, nullptr, nullptr);
+  }
+
+  void find_closest_points(const PtList& in_pts, PtList* out_pts, DistList* dists) const
+  {
+    find_closest_points(in_pts, out_pts, dists, nullptr);
+  }
+
+  /// \brief Find the closest points, represented by this tree, to a list of
+  ///        input query points.
+  ///
+  /// The searches are executed in parallel when TBB is available. Large
+  /// batches of queries are processed in Morton order, so that each thread
+  /// processes spatially coherent queries; the outputs are always stored in
+  /// the same order as the inputs.
+  void find_closest_points(const PtList& in_pts, PtList* out_pts,
+                           DistList* dists, ShapePtrList* shps) const
+  {
+    const size_type num_pts = in_pts.size();
+
+    xregASSERT(num_pts == out_pts->size());
+    xregASSERT(!dists || (num_pts == dists->size()));
+    xregASSERT(!shps  || (num_pts == shps->size()));
+
+    const bool use_morton = num_pts >= kMORTON_SORT_THRESH;
+
+    const IndexList order = use_morton ? MortonOrder(in_pts) : IndexList();
+
+    auto find_closest_pts_helper = [this,&in_pts,out_pts,dists,shps,&order,use_morton] (const RangeType& r)
+    {
+      CoordScalar tmp_dist = 0;
+
+      for (size_type k = r.begin(); k != r.end(); ++k)
+      {
+        const size_type i = use_morton ? order[k] : k;
+
+        std::tie(out_pts->operator[](i), tmp_dist) = this->find_closest_point(in_pts[i], shps ? &shps->operator[](i) : nullptr);
+
+        if (dists)
+        {
+          dists->operator[](i) = tmp_dist;
+        }
+      }
+    };
+
+    ParallelFor(find_closest_pts_helper, RangeType(0, num_pts));
+  }
+
+  /// \brief Updates the node bounding boxes after shape vertices have moved.
+  ///
+  /// The tree topology is unchanged, so query performance degrades as the
+  /// shapes move further from their original positions.
+  void update_bounds()
+  {
+    xregASSERT(KDTreeIsShape<value_type>::value);  // this should only be called when shapes are used
+
+    // children always follow their parents, so a reverse traversal visits
+    // every child before its parent
+    for (size_type i = nodes_.size(); i > 0; --i)
+    {
+      Node& n = nodes_[i - 1];
+
+      if (n.is_leaf())
+      {
+        std::tie(n.lower, n.upper) = PrimBoundsHelper(prims_[n.link]);
+
+        Pt tmp_lower;
+        Pt tmp_upper;
+
+        for (size_type j = 1; j < n.num_prims; ++j)
+        {
+          std::tie(tmp_lower, tmp_upper) = PrimBoundsHelper(prims_[n.link + j]);
+
+          n.lower = n.lower.cwiseMin(tmp_lower);
+          n.upper = n.upper.cwiseMax(tmp_upper);
+        }
+      }
+      else
+      {
+        const Node& left  = nodes_[i];
+        const Node& right = nodes_[i - 1 + n.link];
+
+        n.lower = left.lower.cwiseMin(right.lower);
+        n.upper = left.upper.cwiseMax(right.upper);
+      }
+    }
+
+    leaf_packets_.init(prims_);
+  }
+
+  /// \brief Returns the depth of the tree.
+  ///
+  /// This is re-computed on each call (the result is not stored).
+  size_type depth() const
+  {
+    size_type max_depth = 0;
+
+    if (!nodes_.empty())
+    {
+      std::vector<std::tuple<size_type,size_type>> stack;
+      stack.emplace_back(0, 1);
+
+      size_type cur_node_idx  = 0;
+      size_type cur_depth = 0;
+
+      while (!stack.empty())
+      {
+        std::tie(cur_node_idx, cur_depth) = stack.back();
+        stack.pop_back();
+
+        max_depth = std::max(max_depth, cur_depth);
+
+        const Node& n = nodes_[cur_node_idx];
+
+        if (!n.is_leaf())
+        {
+          stack.emplace_back(cur_node_idx + 1, cur_depth + 1);
+          stack.emplace_back(cur_node_idx + n.link, cur_depth + 1);
+        }
+      }
+    }
+
+    return max_depth;
+  }
+
+  /// \brief Finds all points within a radius to the query point.
+  void find_pts_in_radius(const Pt& x, const CoordScalar radius, PtList* pts, DistList* dists) const
+  {
+    xregASSERT(!KDTreeIsShape<value_type>::value);  // this should only be called when points are used
+
+    pts->clear();
+    dists->clear();
+
+    if (!nodes_.empty())
+    {
+      const Scalar radius_sq = radius * radius;
+
+      Pt          cur_pt;
+      CoordScalar cur_dist = 0;
+
+      std::uint32_t stack[kMAX_STACK_SIZE];
+      size_type stack_size = 0;
+
+      stack[stack_size++] = 0;
+
+      while (stack_size)
+      {
+        const std::uint32_t cur_node_idx = stack[--stack_size];
+
+        const Node& n = nodes_[cur_node_idx];
+
+        if (BoxDistSq(n, x) <= radius_sq)
+        {
+          if (n.is_leaf())
+          {
+            const size_type prim_end = n.link + n.num_prims;
+
+            for (size_type i = n.link; i < prim_end; ++i)
+            {
+              std::tie(cur_pt, cur_dist) = FindClosestPtHelper(x, prims_[i]);
+
+              if (cur_dist <= radius)
+              {
+                pts->push_back(cur_pt);
+                dists->push_back(cur_dist);
+              }
+            }
+          }
+          else
+          {
+            xregASSERT((stack_size + 2) <= kMAX_STACK_SIZE);
+
+            stack[stack_size++] = cur_node_idx + n.link;
+            stack[stack_size++] = cur_node_idx + 1;
+          }
+        }
+      }
+    }
+  }
+
+  /// \brief Finds the k closest points to a query point.
+  ///
+  /// The points are sorted by increasing distance; fewer than k points are
+  /// returned when the tree stores fewer than k points. When inds is
+  /// non-null, it stores the index of each point in the collection used to
+  /// build the tree.
+  void find_k_closest_pts(const Pt& x, const size_type k, PtList* pts, DistList* dists,
+                          IndexList* inds = nullptr) const
+  {
+    xregASSERT(!KDTreeIsShape<value_type>::value);  // this should only be called when points are used
+
+    using HeapEntry = std::tuple<Scalar,std::uint32_t>;
+
+    // max-heap of the closest points found so far, ordered by squared distance
+    std::vector<HeapEntry> heap;
+
+    if (k && !nodes_.empty())
+    {
+      heap.reserve(k);
+
+      auto heap_cmp = [] (const HeapEntry& lhs, const HeapEntry& rhs)
+      {
+        return std::get<0>(lhs) < std::get<0>(rhs);
+      };
+
+      StackEntry stack[kMAX_STACK_SIZE];
+      size_type stack_size = 0;
+
+      stack[stack_size++] = StackEntry{ 0, BoxDistSq(nodes_[0], x) };
+
+      while (stack_size)
+      {
+        const StackEntry cur = stack[--stack_size];
+
+        const Scalar bound_dist_sq = (heap.size() < k) ? std::numeric_limits<Scalar>::max() :
+                                                         std::get<0>(heap.front());
+
+        if (cur.dist_sq >= bound_dist_sq)
+        {
+          continue;
+        }
+
+        const Node& n = nodes_[cur.node_idx];
+
+        if (n.is_leaf())
+        {
+          const size_type prim_end = n.link + n.num_prims;
+
+          for (size_type i = n.link; i < prim_end; ++i)
+          {
+            const Scalar d_sq = (CentroidHelper(prims_[i]) - x).squaredNorm();
+
+            if (heap.size() < k)
+            {
+              heap.emplace_back(d_sq, static_cast<std::uint32_t>(i));
+              std::push_heap(heap.begin(), heap.end(), heap_cmp);
+            }
+            else if (d_sq < std::get<0>(heap.front()))
+            {
+              std::pop_heap(heap.begin(), heap.end(), heap_cmp);
+              heap.back() = HeapEntry(d_sq, static_cast<std::uint32_t>(i));
+              std::push_heap(heap.begin(), heap.end(), heap_cmp);
+            }
+          }
+        }
+        else
+        {
+          const std::uint32_t left_idx  = cur.node_idx + 1;
+          const std::uint32_t right_idx = cur.node_idx + n.link;
+
+          const Scalar left_dist_sq  = BoxDistSq(nodes_[left_idx], x);
+          const Scalar right_dist_sq = BoxDistSq(nodes_[right_idx], x);
+
+          xregASSERT((stack_size + 2) <= kMAX_STACK_SIZE);
+
+          // push the farther child first, so that the nearer child is visited next
+          if (left_dist_sq < right_dist_sq)
+          {
+            stack[stack_size++] = StackEntry{ right_idx, right_dist_sq };
+            stack[stack_size++] = StackEntry{ left_idx, left_dist_sq };
+          }
+          else
+          {
+            stack[stack_size++] = StackEntry{ left_idx, left_dist_sq };
+            stack[stack_size++] = StackEntry{ right_idx, right_dist_sq };
+          }
+        }
+      }
+
+      std::sort_heap(heap.begin(), heap.end(), heap_cmp);
+    }
+
+    const size_type num_found = heap.size();
+
+    pts->resize(num_found);
+    dists->resize(num_found);
+
+    if (inds)
+    {
+      inds->resize(num_found);
+    }
+
+    for (size_type i = 0; i < num_found; ++i)
+    {
+      const std::uint32_t prim_idx = std::get<1>(heap[i]);
+
+      (*pts)[i]   = prims_[prim_idx];
+      (*dists)[i] = std::sqrt(std::get<0>(heap[i]));
+
+      if (inds)
+      {
+        (*inds)[i] = prim_inds_[prim_idx];
+      }
+    }
+  }
+
+  /// \brief Finds the k closest points to each query point in a collection.
+  ///
+  /// This is threaded with TBB when available.
+  void find_k_closest_pts_for_pts(const PtList& query_pts, const size_type k,
+                                  std::vector<PtList>* closest_pts,
+                                  std::vector<DistList>* dists,
+                                  std::vector<IndexList>* inds = nullptr) const
+  {
+    const size_type num_query_pts = query_pts.size();
+
+    xregASSERT(num_query_pts == closest_pts->size());
+    xregASSERT(num_query_pts == dists->size());
+    xregASSERT(!inds || (num_query_pts == inds->size()));
+
+    auto find_k_closest_pts_for_pts_helper = [this,&query_pts,k,closest_pts,dists,inds] (const RangeType& r)
+    {
+      for (size_type i = r.begin(); i != r.end(); ++i)
+      {
+        this->find_k_closest_pts(query_pts[i], k, &closest_pts->operator[](i), &dists->operator[](i),
+                                 inds ? &inds->operator[](i) : nullptr);
+      }
+    };
+
+    ParallelFor(find_k_closest_pts_for_pts_helper, RangeType(0, num_query_pts));
+  }
+
+  /// \brief Finds all points within a radius each query point in a collection.
+  ///
+  /// This is threaded with TBB when available.
+  void find_pts_in_radius_for_pts(const PtList& query_pts, const CoordScalar radius,
+                                  std::vector<PtList>* closest_pts,
+                                  std::vector<DistList>* dists) const
+  {
+    const size_type num_query_pts = query_pts.size();
+
+    xregASSERT(num_query_pts == closest_pts->size());
+    xregASSERT(num_query_pts == dists->size());
+
+    auto find_pts_in_radius_for_pts_helper = [this,&query_pts,radius,closest_pts,dists] (const RangeType& r)
+    {
+      for (size_type i = r.begin(); i != r.end(); ++i)
+      {
+        this->find_pts_in_radius(query_pts[i], radius, &closest_pts->operator[](i), &dists->operator[](i));
+      }
+    };
+
+    ParallelFor(find_pts_in_radius_for_pts_helper, RangeType(0, num_query_pts));
+  }
+
+private:
+  // Sub-trees with at least this many primitives are built concurrently
+  enum { kPAR_BUILD_THRESH = 4096 };
+
+  // Beyond this depth, nodes are always split at the median, which bounds the
+  // tree depth (and traversal stack size) regardless of the SAH decisions.
+  enum { kMAX_SAH_DEPTH = 48 };
+
+  enum { kMAX_STACK_SIZE = 128 };
+
+  // Batches of queries with at least this many points are sorted spatially
+  enum { kMORTON_SORT_THRESH = 1024 };
+
+  using LeafPackets = detail::FlatKDTreeLeafPackets<value_type>;
+
+  struct StackEntry
+  {
+    std::uint32_t node_idx;
+    Scalar dist_sq;
+  };
+
+  struct BuildData
+  {
+    const PrimList* prims;
+
+    // per-primitive bounds and centroids, indexed by the original index
+    PtList lowers;
+    PtList uppers;
+    PtList centroids;
+  };
+
+  struct SAHBin
+  {
+    size_type count = 0;
+
+    Pt lower = Pt::Constant(std::numeric_limits<Scalar>::max());
+    Pt upper = Pt::Constant(std::numeric_limits<Scalar>::lowest());
+  };
+
+  // Builds the sub-tree of primitives referenced by prim_inds_[b,e), appending
+  // its nodes to the end of nodes.
+  void build_node(const BuildData* bd, const size_type b, const size_type e,
+                  const size_type depth, NodeList* nodes)
+  {
+    const size_type node_idx = nodes->size();
+
+    nodes->push_back(Node());
+
+    Pt lower = bd->lowers[prim_inds_[b]];
+    Pt upper = bd->uppers[prim_inds_[b]];
+
+    Pt cent_lower = bd->centroids[prim_inds_[b]];
+    Pt cent_upper = cent_lower;
+
+    for (size_type i = b + 1; i < e; ++i)
+    {
+      const std::uint32_t pi = prim_inds_[i];
+
+      lower = lower.cwiseMin(bd->lowers[pi]);
+      upper = upper.cwiseMax(bd->uppers[pi]);
+
+      cent_lower = cent_lower.cwiseMin(bd->centroids[pi]);
+      cent_upper = cent_upper.cwiseMax(bd->centroids[pi]);
+    }
+
+    (*nodes)[node_idx].lower = lower;
+    (*nodes)[node_idx].upper = upper;
+
+    const size_type num_prims = e - b;
+
+    if (num_prims <= max_leaf_size)
+    {
+      (*nodes)[node_idx].link      = static_cast<std::uint32_t>(b);
+      (*nodes)[node_idx].num_prims = static_cast<std::uint32_t>(num_prims);
+    }
+    else
+    {
+      const size_type mid = partition(bd, b, e, depth, cent_lower, cent_upper);
+
+      if (num_prims >= kPAR_BUILD_THRESH)
+      {
+        NodeList right_nodes;
+
+        ParallelInvoke([&] () { this->build_node(bd, b, mid, depth + 1, nodes); },
+                       [&] () { this->build_node(bd, mid, e, depth + 1, &right_nodes); });
+
+        (*nodes)[node_idx].link = static_cast<std::uint32_t>(nodes->size() - node_idx);
+
+        nodes->insert(nodes->end(), right_nodes.begin(), right_nodes.end());
+      }
+      else
+      {
+        build_node(bd, b, mid, depth + 1, nodes);
+
+        (*nodes)[node_idx].link = static_cast<std::uint32_t>(nodes->size() - node_idx);
+
+        build_node(bd, mid, e, depth + 1, nodes);
+      }
+    }
+  }
+
+  // Re-orders prim_inds_[b,e) about a split and returns the index of the
+  // first primitive in the right child; always in (b,e).
+  size_type partition(const BuildData* bd, const size_type b, const size_type e,
+                      const size_type depth, const Pt& cent_lower, const Pt& cent_upper)
+  {
+    const Pt cent_ext = cent_upper - cent_lower;
+
+    size_type split_dim = 0;
+    const Scalar max_ext = cent_ext.maxCoeff(&split_dim);
+
+    if (!(max_ext > 0))
+    {
+      // all centroids are coincident, any split is as good as another
+      return b + ((e - b) / 2);
+    }
+
+    if ((split_method == kSAH_SPLIT) && (depth < kMAX_SAH_DEPTH))
+    {
+      size_type sah_dim = 0;
+      size_type sah_bin = 0;
+
+      if (FindSAHSplit(bd, b, e, cent_lower, cent_ext, &sah_dim, &sah_bin))
+      {
+        const Scalar bin_scale = num_sah_bins / cent_ext[sah_dim];
+        const Scalar cent_min  = cent_lower[sah_dim];
+        const size_type num_bins = num_sah_bins;
+
+        auto mid_it = std::partition(prim_inds_.begin() + b, prim_inds_.begin() + e,
+                                     [bd,sah_dim,sah_bin,bin_scale,cent_min,num_bins] (const std::uint32_t pi)
+                                     {
+                                       return BinIndex(bd->centroids[pi][sah_dim], cent_min,
+                                                       bin_scale, num_bins) <= sah_bin;
+                                     });
+
+        const size_type mid = std::distance(prim_inds_.begin(), mid_it);
+
+        if ((mid > b) && (mid < e))
+        {
+          return mid;
+        }
+      }
+    }
+
+    // median split
+    const size_type mid = b + ((e - b) / 2);
+
+    std::nth_element(prim_inds_.begin() + b, prim_inds_.begin() + mid, prim_inds_.begin() + e,
+                     [bd,split_dim] (const std::uint32_t i, const std::uint32_t j)
+                     {
+                       return bd->centroids[i][split_dim] < bd->centroids[j][split_dim];
+                     });
+
+    return mid;
+  }
+
+  // Finds the binned split with the lowest SAH cost over all dimensions;
+  // returns false when no split separates the centroids.
+  bool FindSAHSplit(const BuildData* bd, const size_type b, const size_type e,
+                    const Pt& cent_lower, const Pt& cent_ext,
+                    size_type* best_dim, size_type* best_bin) const
+  {
+    const size_type num_bins = num_sah_bins;
+
+    std::vector<SAHBin> bins(num_bins);
+
+    std::vector<Scalar> right_costs(num_bins);
+
+    Scalar best_cost = std::numeric_limits<Scalar>::max();
+    bool found = false;
+
+    for (size_type d = 0; d < kDIM; ++d)
+    {
+      if (!(cent_ext[d] > 0))
+      {
+        continue;
+      }
+
+      std::fill(bins.begin(), bins.end(), SAHBin());
+
+      const Scalar bin_scale = num_bins / cent_ext[d];
+
+      for (size_type i = b; i < e; ++i)
+      {
+        const std::uint32_t pi = prim_inds_[i];
+
+        SAHBin& bin = bins[BinIndex(bd->centroids[pi][d], cent_lower[d], bin_scale, num_bins)];
+
+        ++bin.count;
+        bin.lower = bin.lower.cwiseMin(bd->lowers[pi]);
+        bin.upper = bin.upper.cwiseMax(bd->uppers[pi]);
+      }
+
+      // sweep from the right, right_costs[k] is the cost of bins (k,num_bins)
+      {
+        SAHBin acc;
+
+        for (size_type k = num_bins - 1; k > 0; --k)
+        {
+          acc.count += bins[k].count;
+          acc.lower = acc.lower.cwiseMin(bins[k].lower);
+          acc.upper = acc.upper.cwiseMax(bins[k].upper);
+
+          right_costs[k - 1] = acc.count ? (acc.count * HalfSurfaceArea(acc.lower, acc.upper)) : Scalar(-1);
+        }
+      }
+
+      // sweep from the left, splitting after bin k
+      {
+        SAHBin acc;
+
+        for (size_type k = 0; (k + 1) < num_bins; ++k)
+        {
+          acc.count += bins[k].count;
+          acc.lower = acc.lower.cwiseMin(bins[k].lower);
+          acc.upper = acc.upper.cwiseMax(bins[k].upper);
+
+          if (acc.count && (right_costs[k] >= 0))
+          {
+            const Scalar cost = (acc.count * HalfSurfaceArea(acc.lower, acc.upper)) + right_costs[k];
+
+            if (cost < best_cost)
+            {
+              best_cost = cost;
+              *best_dim = d;
+              *best_bin = k;
+              found = true;
+            }
+          }
+        }
+      }
+    }
+
+    return found;
+  }
+
+  static size_type BinIndex(const Scalar c, const Scalar cent_min, const Scalar bin_scale,
+                            const size_type num_bins)
+  {
+    return std::min(static_cast<size_type>(std::max(Scalar(0), (c - cent_min) * bin_scale)),
+                    num_bins - 1);
+  }
+
+  // Half of the box surface area in 3D, generalized to the sum of all pairwise
+  // extent products for other dimensions.
+  static Scalar HalfSurfaceArea(const Pt& lower, const Pt& upper)
+  {
+    const Pt ext = (upper - lower).cwiseMax(Pt::Zero());
+
+    Scalar a = 0;
+
+    if (kDIM == 1)
+    {
+      a = ext[0];
+    }
+    else
+    {
+      for (size_type i = 0; i < kDIM; ++i)
+      {
+        for (size_type j = i + 1; j < kDIM; ++j)
+        {
+          a += ext[i] * ext[j];
+        }
+      }
+    }
+
+    return a;
+  }
+
+  // Returns the indices of the query points sorted by their Morton codes,
+  // using 10 bits for each of the first three dimensions.
+  static IndexList MortonOrder(const PtList& pts)
+  {
+    const size_type num_pts = pts.size();
+
+    constexpr size_type kNUM_MORTON_DIMS = (kDIM < 3) ? kDIM : 3;
+
+    Pt lower = pts[0];
+    Pt upper = pts[0];
+
+    for (size_type i = 1; i < num_pts; ++i)
+    {
+      lower = lower.cwiseMin(pts[i]);
+      upper = upper.cwiseMax(pts[i]);
+    }
+
+    const Pt scale = (upper - lower).unaryExpr([] (const Scalar& e)
+                                               {
+                                                 return (e > 0) ? (Scalar(1023) / e) : Scalar(0);
+                                               });
+
+    std::vector<std::tuple<std::uint32_t,std::uint32_t>> codes(num_pts);
+
+    auto morton_code_fn = [&pts,&codes,&lower,&scale] (const RangeType& r)
+    {
+      for (size_type i = r.begin(); i != r.end(); ++i)
+      {
+        std::uint32_t code = 0;
+
+        for (size_type d = 0; d < kNUM_MORTON_DIMS; ++d)
+        {
+          const std::uint32_t q = static_cast<std::uint32_t>(
+                std::min(Scalar(1023), std::max(Scalar(0), (pts[i][d] - lower[d]) * scale[d])));
+
+          for (size_type bit = 0; bit < 10; ++bit)
+          {
+            code |= ((q >> bit) & 1u) << ((bit * kNUM_MORTON_DIMS) + d);
+          }
+        }
+
+        codes[i] = std::make_tuple(code, static_cast<std::uint32_t>(i));
+      }
+    };
+
+    ParallelFor(morton_code_fn, RangeType(0, num_pts));
+
+    ParallelSort(codes.begin(), codes.end(),
+                 [] (const std::tuple<std::uint32_t,std::uint32_t>& x,
+                     const std::tuple<std::uint32_t,std::uint32_t>& y)
+                 {
+                   return std::get<0>(x) < std::get<0>(y);
+                 });
+
+    IndexList order(num_pts);
+
+    for (size_type i = 0; i < num_pts; ++i)
+    {
+      order[i] = std::get<1>(codes[i]);
+    }
+
+    return order;
+  }
+
+  static Scalar BoxDistSq(const Node& n, const Pt& x)
+  {
+    return ((n.lower - x).cwiseMax(x - n.upper)).cwiseMax(Pt::Zero()).squaredNorm();
+  }
+
+  // PrimBoundsHelper for shape data
+  template <class S>
+  static
+  typename std::enable_if<KDTreeIsShape<S>::value, std::tuple<Pt,Pt>>::type
+  PrimBoundsHelper(const S& s)
+  {
+    Pt lower;
+    Pt upper;
+
+    for (size_type d = 0; d < kDIM; ++d)
+    {
+      std::tie(lower[d], upper[d]) = s.bounds(d);
+    }
+
+    return std::make_tuple(lower, upper);
+  }
+
+  // PrimBoundsHelper for point data
+  template <class S>
+  static
+  typename std::enable_if<!KDTreeIsShape<S>::value, std::tuple<Pt,Pt>>::type
+  PrimBoundsHelper(const S& p)
+  {
+    return std::make_tuple(p, p);
+  }
+
+  template <class S>
+  static Pt CentroidHelper(const S& s)
+  {
+    Pt c;
+
+    for (size_type d = 0; d < kDIM; ++d)
+    {
+      c[d] = s[d];
+    }
+
+    return c;
+  }
+
+  // FindClosestPtHelper for shape data
+  template <class S>
+  static
+  typename std::enable_if<KDTreeIsShape<S>::value,
+                          std::tuple<Pt,CoordScalar>>::type
+  FindClosestPtHelper(const Pt& query_pt, const S& leaf_data_shape)
+  {
+    return leaf_data_shape.closest_point(query_pt);
+  }
+
+  // FindClosestPtHelper for point data
+  template <class S>
+  static
+  typename std::enable_if<!KDTreeIsShape<S>::value,
+                          std::tuple<Pt,CoordScalar>>::type
+  FindClosestPtHelper(const Pt& query_pt, const S& leaf_data_pt)
+  {
+    return std::make_tuple(leaf_data_pt, (query_pt - leaf_data_pt).norm());
+  }
+
+  NodeList nodes_;
+
+  PrimList prims_;
+
+  IndexList prim_inds_;
+
+  LeafPackets leaf_packets_;
+};
+
+}  // xreg
+
+#endif
+
@@ -0,0 +1,299 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "xregNearestNeighbors.h"
+
+#include <algorithm>
+#include <numeric>
+
+#include "xregMesh.h"
+
+constexpr xreg::size_type xreg::PointCloudNNIndex::kDEFAULT_MAX_EXHAUSTIVE_SIZE;
+
+xreg::PointCloudNNIndex::PointCloudNNIndex(const Pt3List& cloud_pts,
+                                           const size_type max_exhaustive_size)
+{
+  xregASSERT(!cloud_pts.empty());
+
+  const size_type num_pts = cloud_pts.size();
+
+  if (num_pts <= max_exhaustive_size)
+  {
+    cloud_mat_.resize(3, num_pts);
+
+    for (size_type i = 0; i < num_pts; ++i)
+    {
+      cloud_mat_.col(i) = cloud_pts[i];
+    }
+  }
+  else
+  {
+    kd_tree_.reset(new KDTree(cloud_pts.begin(), cloud_pts.end()));
+  }
+}
+
+xreg::size_type xreg::PointCloudNNIndex::size() const
+{
+  return kd_tree_ ? kd_tree_->prims().size() : static_cast<size_type>(cloud_mat_.cols());
+}
+
+std::tuple<xreg::Pt3,xreg::CoordScalar,xreg::size_type>
+xreg::PointCloudNNIndex::closest(const Pt3& x) const
+{
+  Pt3 closest_pt;
+  CoordScalar dist = 0;
+  size_type idx = 0;
+
+  if (kd_tree_)
+  {
+    const Pt3* closest_pt_in_tree = nullptr;
+
+    std::tie(closest_pt, dist) = kd_tree_->find_closest_point(x, &closest_pt_in_tree);
+
+    idx = kd_tree_->prim_inds()[closest_pt_in_tree - &kd_tree_->prims()[0]];
+  }
+  else
+  {
+    Eigen::Index min_idx = 0;
+
+    dist = std::sqrt((cloud_mat_.colwise() - x).colwise().squaredNorm().minCoeff(&min_idx));
+
+    idx = min_idx;
+
+    closest_pt = cloud_mat_.col(min_idx);
+  }
+
+  return std::make_tuple(closest_pt, dist, idx);
+}
+
+void xreg::PointCloudNNIndex::closest(const Pt3List& query_pts, Pt3List* closest_pts,
+                                      CoordScalarList* dists, IndexList* inds) const
+{
+  xregASSERT(closest_pts);
+
+  const size_type num_query_pts = query_pts.size();
+
+  closest_pts->resize(num_query_pts);
+
+  if (dists)
+  {
+    dists->resize(num_query_pts);
+  }
+
+  if (inds)
+  {
+    inds->resize(num_query_pts);
+  }
+
+  if (kd_tree_ && !inds)
+  {
+    // the tree orders the queries spatially
+    kd_tree_->find_closest_points(query_pts, closest_pts, dists);
+  }
+  else
+  {
+    auto closest_fn = [this,&query_pts,closest_pts,dists,inds] (const RangeType& r)
+    {
+      CoordScalar tmp_dist = 0;
+      size_type   tmp_idx  = 0;
+
+      for (size_type i = r.begin(); i != r.end(); ++i)
+      {
+        std::tie(closest_pts->operator[](i), tmp_dist, tmp_idx) = this->closest(query_pts[i]);
+
+        if (dists)
+        {
+          dists->operator[](i) = tmp_dist;
+        }
+
+        if (inds)
+        {
+          inds->operator[](i) = tmp_idx;
+        }
+      }
+    };
+
+    ParallelFor(closest_fn, RangeType(0, num_query_pts));
+  }
+}
+
+void xreg::PointCloudNNIndex::k_closest(const Pt3List& query_pts, const size_type k,
+                                        std::vector<Pt3List>* closest_pts,
+                                        std::vector<CoordScalarList>* dists,
+                                        std::vector<IndexList>* inds) const
+{
+  const size_type num_query_pts = query_pts.size();
+
+  closest_pts->resize(num_query_pts);
+  dists->resize(num_query_pts);
+
+  if (inds)
+  {
+    inds->resize(num_query_pts);
+  }
+
+  auto k_closest_fn = [this,&query_pts,k,closest_pts,dists,inds] (const RangeType& r)
+  {
+    for (size_type i = r.begin(); i != r.end(); ++i)
+    {
+      this->k_closest(query_pts[i], k, &closest_pts->operator[](i), &dists->operator[](i),
+                      inds ? &inds->operator[](i) : nullptr);
+    }
+  };
+
+  ParallelFor(k_closest_fn, RangeType(0, num_query_pts));
+}
+
+void xreg::PointCloudNNIndex::in_radius(const Pt3List& query_pts, const CoordScalar radius,
+                                        std::vector<Pt3List>* closest_pts,
+                                        std::vector<CoordScalarList>* dists) const
+{
+  const size_type num_query_pts = query_pts.size();
+
+  closest_pts->resize(num_query_pts);
+  dists->resize(num_query_pts);
+
+  auto in_radius_fn = [this,&query_pts,radius,closest_pts,dists] (const RangeType& r)
+  {
+    for (size_type i = r.begin(); i != r.end(); ++i)
+    {
+      this->in_radius(query_pts[i], radius, &closest_pts->operator[](i), &dists->operator[](i));
+    }
+  };
+
+  ParallelFor(in_radius_fn, RangeType(0, num_query_pts));
+}
+
+void xreg::PointCloudNNIndex::k_closest(const Pt3& x, const size_type k, Pt3List* closest_pts,
+                                        CoordScalarList* dists, IndexList* inds) const
+{
+  if (kd_tree_)
+  {
+    KDTree::IndexList tree_inds;
+
+    kd_tree_->find_k_closest_pts(x, k, closest_pts, dists, inds ? &tree_inds : nullptr);
+
+    if (inds)
+    {
+      inds->assign(tree_inds.begin(), tree_inds.end());
+    }
+  }
+  else
+  {
+    const size_type num_pts = cloud_mat_.cols();
+
+    const Eigen::Matrix<CoordScalar,1,Eigen::Dynamic> dists_sq =
+                                          (cloud_mat_.colwise() - x).colwise().squaredNorm();
+
+    const size_type num_found = std::min(k, num_pts);
+
+    IndexList sorted_inds(num_pts);
+    std::iota(sorted_inds.begin(), sorted_inds.end(), size_type(0));
+
+    std::partial_sort(sorted_inds.begin(), sorted_inds.begin() + num_found, sorted_inds.end(),
+                      [&dists_sq] (const size_type i, const size_type j)
+                      {
+                        return dists_sq(i) < dists_sq(j);
+                      });
+
+    closest_pts->resize(num_found);
+    dists->resize(num_found);
+
+    for (size_type i = 0; i < num_found; ++i)
+    {
+      (*closest_pts)[i] = cloud_mat_.col(sorted_inds[i]);
+      (*dists)[i]       = std::sqrt(dists_sq(sorted_inds[i]));
+    }
+
+    if (inds)
+    {
+      inds->assign(sorted_inds.begin(), sorted_inds.begin() + num_found);
+    }
+  }
+}
+
+void xreg::PointCloudNNIndex::in_radius(const Pt3& x, const CoordScalar radius, Pt3List* closest_pts,
+                                        CoordScalarList* dists) const
+{
+  if (kd_tree_)
+  {
+    kd_tree_->find_pts_in_radius(x, radius, closest_pts, dists);
+  }
+  else
+  {
+    closest_pts->clear();
+    dists->clear();
+
+    const size_type num_pts = cloud_mat_.cols();
+
+    const Eigen::Matrix<CoordScalar,1,Eigen::Dynamic> dists_sq =
+                                          (cloud_mat_.colwise() - x).colwise().squaredNorm();
+
+    const CoordScalar radius_sq = radius * radius;
+
+    for (size_type i = 0; i < num_pts; ++i)
+    {
+      if (dists_sq(i) <= radius_sq)
+      {
+        closest_pts->push_back(cloud_mat_.col(i));
+        dists->push_back(std::sqrt(dists_sq(i)));
+      }
+    }
+  }
+}
+
+void xreg::FindClosestPointsAndDistsToPointCloud(const Pt3List& cloud_pts, const Pt3List& query_pts,
+                                                 Pt3List* closest_pts, CoordScalarList* dists)
+{
+  PointCloudNNIndex(cloud_pts).closest(query_pts, closest_pts, dists);
+}
+
+xreg::Pt3List xreg::FindClosestPointsToPointCloud(const Pt3List& cloud_pts, const Pt3List& query_pts)
+{
+  Pt3List closest_pts;
+
+  FindClosestPointsAndDistsToPointCloud(cloud_pts, query_pts, &closest_pts, nullptr);
+
+  return closest_pts;
+}
+
+void xreg::FindClosestPtsToMesh(const TriMesh& mesh, const Pt3List& query_pts,
+                                Pt3List* closest_pts, CoordScalarList* dists)
+{
+  const auto kd_tris = CreateTrisForKDTree(mesh);
+
+  const FlatKDTree<KDTreeTri> kd_tree(kd_tris.begin(), kd_tris.end());
+
+  const size_type num_query_pts = query_pts.size();
+
+  closest_pts->resize(num_query_pts);
+
+  if (dists)
+  {
+    dists->resize(num_query_pts);
+  }
+
+  kd_tree.find_closest_points(query_pts, closest_pts, dists);
+}
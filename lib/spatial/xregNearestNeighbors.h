@@ -0,0 +1,130 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file
+ * @brief Indexed nearest neighbor queries against point clouds and meshes.
+ *
+ * These are the indexed equivalents of FindClosestPtToPtCloudExhaustive(),
+ * FindClosestPointsAndDistsToPointCloudExhaustive(),
+ * FindClosestPointsToPointCloudExhaustive() and
+ * FindClosestPtToMeshExhaustive().
+ **/
+
+#ifndef XREGNEARESTNEIGHBORS_H_
+#define XREGNEARESTNEIGHBORS_H_
+
+#include <memory>
+
+#include "xregFlatKDTree.h"
+
+namespace xreg
+{
+
+/**
+ * @brief Index of a point cloud for repeated nearest neighbor queries.
+ *
+ * A KD-Tree is built once for large clouds. Small clouds are searched
+ * exhaustively, using vectorized distance computations, since building and
+ * traversing a tree would be slower. Batched queries are executed in
+ * parallel when TBB is available; all distances are Euclidean.
+ **/
+class PointCloudNNIndex
+{
+public:
+  using IndexList = std::vector<size_type>;
+
+  /// \brief Clouds with at most this many points are searched exhaustively.
+  static constexpr size_type kDEFAULT_MAX_EXHAUSTIVE_SIZE = 64;
+
+  /// \brief Builds an index about a point cloud.
+  ///
+  /// The cloud is copied, it does not need to remain valid.
+  explicit PointCloudNNIndex(const Pt3List& cloud_pts,
+                             const size_type max_exhaustive_size = kDEFAULT_MAX_EXHAUSTIVE_SIZE);
+
+  size_type size() const;
+
+  /// \brief The closest cloud point to a query point, its distance and index
+  ///        in the cloud.
+  std::tuple<Pt3,CoordScalar,size_type> closest(const Pt3& x) const;
+
+  /// \brief The closest cloud point to each query point.
+  ///
+  /// Outputs are resized; dists and inds may be null.
+  void closest(const Pt3List& query_pts, Pt3List* closest_pts,
+               CoordScalarList* dists = nullptr, IndexList* inds = nullptr) const;
+
+  /// \brief The k closest cloud points to each query point, sorted by
+  ///        increasing distance.
+  ///
+  /// Outputs are resized; inds may be null.
+  void k_closest(const Pt3List& query_pts, const size_type k,
+                 std::vector<Pt3List>* closest_pts,
+                 std::vector<CoordScalarList>* dists,
+                 std::vector<IndexList>* inds = nullptr) const;
+
+  /// \brief All cloud points within a radius of each query point.
+  ///
+  /// The points are not sorted. Outputs are resized.
+  void in_radius(const Pt3List& query_pts, const CoordScalar radius,
+                 std::vector<Pt3List>* closest_pts,
+                 std::vector<CoordScalarList>* dists) const;
+
+private:
+  using KDTree = FlatKDTree<Pt3>;
+
+  using CloudMat = Eigen::Matrix<CoordScalar,3,Eigen::Dynamic>;
+
+  void k_closest(const Pt3& x, const size_type k, Pt3List* closest_pts,
+                 CoordScalarList* dists, IndexList* inds) const;
+
+  void in_radius(const Pt3& x, const CoordScalar radius, Pt3List* closest_pts,
+                 CoordScalarList* dists) const;
+
+  // only one of these is populated
+  std::unique_ptr<KDTree> kd_tree_;
+
+  CloudMat cloud_mat_;
+};
+
+/// \brief Indexed equivalent of FindClosestPointsAndDistsToPointCloudExhaustive().
+void FindClosestPointsAndDistsToPointCloud(const Pt3List& cloud_pts, const Pt3List& query_pts,
+                                           Pt3List* closest_pts, CoordScalarList* dists = nullptr);
+
+/// \brief Indexed equivalent of FindClosestPointsToPointCloudExhaustive().
+Pt3List FindClosestPointsToPointCloud(const Pt3List& cloud_pts, const Pt3List& query_pts);
+
+/// \brief Closest points on a mesh surface to each query point.
+///
+/// Indexed, and parallel, equivalent of calling FindClosestPtToMeshExhaustive()
+/// for each query point. Outputs are resized; dists may be null.
+void FindClosestPtsToMesh(const TriMesh& mesh, const Pt3List& query_pts,
+                          Pt3List* closest_pts, CoordScalarList* dists = nullptr);
+
+}  // xreg
+
+#endif
+
@@ -24,6 +24,8 @@
 
 #include "xregSpatialPrimitives.h"
 
+#include <limits>
+
 #include "xregAssert.h"
 #include "xregPolyFindZeros.h"
 
@@ -886,6 +888,204 @@ namespace
 
 using namespace xreg;
 
+// Finds the parameter interval, [t0,t1], of a line, y(t) = a + t * d, inside
+// the slab y_lower <= y <= y_upper. Returns false when the line misses the slab.
+bool LineSlabInterval(const CoordScalar a, const CoordScalar d,
+                      const CoordScalar y_lower, const CoordScalar y_upper,
+                      CoordScalar* t0, CoordScalar* t1)
+{
+  constexpr CoordScalar kEPS = 1.0e-12;
+
+  if (std::abs(d) < kEPS)
+  {
+    *t0 = -std::numeric_limits<CoordScalar>::infinity();
+    *t1 =  std::numeric_limits<CoordScalar>::infinity();
+
+    return (y_lower <= a) && (a <= y_upper);
+  }
+
+  *t0 = (y_lower - a) / d;
+  *t1 = (y_upper - a) / d;
+
+  if (*t0 > *t1)
+  {
+    std::swap(*t0, *t1);
+  }
+
+  return true;
+}
+
+// Length of the intersection of [t0,t1] with [s0,s1], zero if empty
+CoordScalar IntervalOverlapLen(const CoordScalar t0, const CoordScalar t1,
+                               const CoordScalar s0, const CoordScalar s1)
+{
+  return std::max(std::min(t1, s1) - std::max(t0, s0), CoordScalar(0));
+}
+
+}  // un-named
+
+xreg::CoordScalar xreg::LineSegCylIntersectLen(const Pt3& start_pt,
+                                               const Pt3& end_pt,
+                                               const CylinderModel& cyl)
+{
+  constexpr CoordScalar kEPS = 1.0e-12;
+
+  const Pt3 d = end_pt - start_pt;
+
+  // restrict the segment parameters to the height of the cylinder
+  const CoordScalar half_height = cyl.height / 2;
+
+  CoordScalar s0 = 0;
+  CoordScalar s1 = 1;
+  
+  {
+    CoordScalar t0 = 0;
+    CoordScalar t1 = 0;
+
+    if (!LineSlabInterval(start_pt(1), d(1), -half_height, half_height, &t0, &t1))
+    {
+      return 0;
+    }
+
+    s0 = std::max(s0, t0);
+    s1 = std::min(s1, t1);
+  }
+
+  // now restrict to the infinite cylinder: x^2 + z^2 <= r^2
+  const CoordScalar A = (d(0) * d(0)) + (d(2) * d(2));
+  const CoordScalar B = 2 * ((start_pt(0) * d(0)) + (start_pt(2) * d(2)));
+  const CoordScalar C = (start_pt(0) * start_pt(0)) + (start_pt(2) * start_pt(2)) -
+                          (cyl.radius * cyl.radius);
+
+  CoordScalar len_t = 0;
+
+  if (A < kEPS)
+  {
+    // parallel to the axis, either entirely inside or outside
+    len_t = (C <= 0) ? std::max(s1 - s0, CoordScalar(0)) : CoordScalar(0);
+  }
+  else
+  {
+    const CoordScalar disc = (B * B) - (4 * A * C);
+
+    if (disc > 0)
+    {
+      const CoordScalar sqrt_disc = std::sqrt(disc);
+
+      len_t = IntervalOverlapLen((-B - sqrt_disc) / (2 * A), (-B + sqrt_disc) / (2 * A), s0, s1);
+    }
+  }
+
+  return len_t * d.norm();
+}
+
+xreg::CoordScalar xreg::LineSegConeIntersectLen(const Pt3& start_pt,
+                                                const Pt3& end_pt,
+                                                const ConeModel& cone)
+{
+  constexpr CoordScalar kEPS = 1.0e-12;
+
+  if ((cone.height <= 0) || (cone.radius <= 0))
+  {
+    return 0;
+  }
+
+  const Pt3 d = end_pt - start_pt;
+
+  CoordScalar s0 = 0;
+  CoordScalar s1 = 1;
+  
+  {
+    CoordScalar t0 = 0;
+    CoordScalar t1 = 0;
+
+    if (!LineSlabInterval(start_pt(1), d(1), 0, cone.height, &t0, &t1))
+    {
+      return 0;
+    }
+
+    s0 = std::max(s0, t0);
+    s1 = std::min(s1, t1);
+  }
+
+  if (s1 <= s0)
+  {
+    return 0;
+  }
+
+  // The radius at height y is w(t) = R - k * y(t), with k = R / H; the points
+  // inside the double cone satisfy: x^2 + z^2 - w^2 <= 0
+  const CoordScalar k = cone.radius / cone.height;
+
+  const CoordScalar w  = cone.radius - (k * start_pt(1));
+  const CoordScalar wd = -k * d(1);
+
+  const CoordScalar A = (d(0) * d(0)) + (d(2) * d(2)) - (wd * wd);
+  const CoordScalar B = 2 * ((start_pt(0) * d(0)) + (start_pt(2) * d(2)) - (w * wd));
+  const CoordScalar C = (start_pt(0) * start_pt(0)) + (start_pt(2) * start_pt(2)) - (w * w);
+
+  const CoordScalar kInf = std::numeric_limits<CoordScalar>::infinity();
+
+  CoordScalar len_t = 0;
+
+  if (std::abs(A) < kEPS)
+  {
+    // linear: B * t + C <= 0
+    if (std::abs(B) < kEPS)
+    {
+      len_t = (C <= 0) ? (s1 - s0) : CoordScalar(0);
+    }
+    else if (B > 0)
+    {
+      len_t = IntervalOverlapLen(-kInf, -C / B, s0, s1);
+    }
+    else
+    {
+      len_t = IntervalOverlapLen(-C / B, kInf, s0, s1);
+    }
+  }
+  else
+  {
+    const CoordScalar disc = (B * B) - (4 * A * C);
+
+    if (disc < 0)
+    {
+      // no real roots, the quadratic has the sign of A everywhere
+      len_t = (A < 0) ? (s1 - s0) : CoordScalar(0);
+    }
+    else
+    {
+      const CoordScalar sqrt_disc = std::sqrt(disc);
+
+      CoordScalar r0 = (-B - sqrt_disc) / (2 * A);
+      CoordScalar r1 = (-B + sqrt_disc) / (2 * A);
+
+      if (r0 > r1)
+      {
+        std::swap(r0, r1);
+      }
+
+      if (A > 0)
+      {
+        len_t = IntervalOverlapLen(r0, r1, s0, s1);
+      }
+      else
+      {
+        // the line passes through both nappes of the double cone, the piece
+        // in the nappe past the tip is removed by the clipping to the height
+        len_t = IntervalOverlapLen(-kInf, r0, s0, s1) + IntervalOverlapLen(r1, kInf, s0, s1);
+      }
+    }
+  }
+
+  return len_t * d.norm();
+}
+
+namespace
+{
+
+using namespace xreg;
+
 CoordScalar Clamp01(const CoordScalar& x)
 {
   return std::max(std::min(x, CoordScalar(1)), CoordScalar(0));
@@ -1016,6 +1216,81 @@ xreg::Pt3 xreg::FindClosestPtInTri(const Pt3& x, const Pt3& p, const Pt3& q, con
   return tri_pt;
 }
 
+namespace  // un-named
+{
+
+using namespace xreg;
+
+// Squared distances from the query point to four line segments, each with an
+// end point offset from the query point, a_minus_x, and direction, dir.
+CoordArray4 PtToSegsDistSq(const CoordArray4 a_minus_x[3], const CoordArray4 dir[3])
+{
+  const CoordArray4 len_sq = (dir[0] * dir[0]) + (dir[1] * dir[1]) + (dir[2] * dir[2]);
+
+  const CoordArray4 neg_proj = (a_minus_x[0] * dir[0]) + (a_minus_x[1] * dir[1]) + (a_minus_x[2] * dir[2]);
+
+  const CoordArray4 u = (-neg_proj / len_sq.max(CoordScalar(1.0e-12))).max(CoordScalar(0)).min(CoordScalar(1));
+
+  const CoordArray4 dx = a_minus_x[0] + (u * dir[0]);
+  const CoordArray4 dy = a_minus_x[1] + (u * dir[1]);
+  const CoordArray4 dz = a_minus_x[2] + (u * dir[2]);
+
+  return (dx * dx) + (dy * dy) + (dz * dz);
+}
+
+}  // un-named
+
+xreg::CoordArray4 xreg::PtToTrisDistSq(const Pt3& x, const TriPacket4& tris)
+{
+  CoordArray4 E0[3];
+  CoordArray4 E1[3];
+  CoordArray4 E2[3];
+  CoordArray4 p_minus_x[3];
+  CoordArray4 q_minus_x[3];
+
+  for (int i = 0; i < 3; ++i)
+  {
+    E0[i] = tris.q[i] - tris.p[i];
+    E1[i] = tris.r[i] - tris.p[i];
+    E2[i] = tris.r[i] - tris.q[i];
+
+    p_minus_x[i] = tris.p[i] - x[i];
+    q_minus_x[i] = tris.q[i] - x[i];
+  }
+
+  const CoordArray4 a = (E0[0] * E0[0]) + (E0[1] * E0[1]) + (E0[2] * E0[2]);
+  const CoordArray4 b = (E0[0] * E1[0]) + (E0[1] * E1[1]) + (E0[2] * E1[2]);
+  const CoordArray4 c = (E1[0] * E1[0]) + (E1[1] * E1[1]) + (E1[2] * E1[2]);
+  const CoordArray4 d = (E0[0] * p_minus_x[0]) + (E0[1] * p_minus_x[1]) + (E0[2] * p_minus_x[2]);
+  const CoordArray4 e = (E1[0] * p_minus_x[0]) + (E1[1] * p_minus_x[1]) + (E1[2] * p_minus_x[2]);
+
+  const CoordArray4 det = (a * c) - (b * b);
+  const CoordArray4 s   = (b * e) - (c * d);
+  const CoordArray4 t   = (b * d) - (a * e);
+
+  // the projection onto the plane of the triangle lies inside (region 0)
+  const auto inside = (s >= CoordScalar(0)) && (t >= CoordScalar(0)) && ((s + t) <= det) &&
+                      (det > CoordScalar(1.0e-12));
+
+  const CoordArray4 det_scale = CoordScalar(1) / det.max(CoordScalar(1.0e-12));
+
+  const CoordArray4 s_scaled = s * det_scale;
+  const CoordArray4 t_scaled = t * det_scale;
+
+  const CoordArray4 fx = p_minus_x[0] + (s_scaled * E0[0]) + (t_scaled * E1[0]);
+  const CoordArray4 fy = p_minus_x[1] + (s_scaled * E0[1]) + (t_scaled * E1[1]);
+  const CoordArray4 fz = p_minus_x[2] + (s_scaled * E0[2]) + (t_scaled * E1[2]);
+
+  const CoordArray4 face_dist_sq = (fx * fx) + (fy * fy) + (fz * fz);
+
+  // otherwise the closest point lies on one of the edges
+  const CoordArray4 edge_dist_sq = PtToSegsDistSq(p_minus_x, E0).min(
+                                     PtToSegsDistSq(p_minus_x, E1)).min(
+                                       PtToSegsDistSq(q_minus_x, E2));
+
+  return inside.select(face_dist_sq, edge_dist_sq);
+}
+
 xreg::Pt3 xreg::FindClosestPtOnLineSegment(const Pt3& line_pt1, const Pt3& line_pt2, const Pt3& pt)
 {
   Pt3 closest_pt = line_pt1;
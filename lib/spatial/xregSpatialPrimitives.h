@@ -233,6 +233,21 @@ LineSegPlaneIntersect(const Pt3& start_pt,
                       const Plane3& plane,
                       const CoordScalar max_dist_thresh = -1);
 
+/// \brief Length of the portion of a line segment lying inside a solid cylinder.
+///
+/// The segment end points are expressed in the cylinder's frame. This is the
+/// chord length needed for analytic line integrals through the cylinder.
+CoordScalar LineSegCylIntersectLen(const Pt3& start_pt,
+                                   const Pt3& end_pt,
+                                   const CylinderModel& cyl);
+
+/// \brief Length of the portion of a line segment lying inside a solid cone.
+///
+/// The segment end points are expressed in the cone's frame.
+CoordScalar LineSegConeIntersectLen(const Pt3& start_pt,
+                                    const Pt3& end_pt,
+                                    const ConeModel& cone);
+
 /**
  * Finds the closest point between a query point and a triangle. The point type
  * assumes an interface that overloads the +,-,() operators and provides an
@@ -247,6 +262,28 @@ Pt3 FindClosestPtInTri(const Pt3& x, const Pt3& p, const Pt3& q, const Pt3& r);
 
 Pt3 FindClosestPtOnLineSegment(const Pt3& line_pt1, const Pt3& line_pt2, const Pt3& pt);
 
+using CoordArray4 = Eigen::Array<CoordScalar,4,1>;
+
+/// \brief Four triangles stored in structure-of-arrays form.
+///
+/// e.g. p[0] holds the x components of the first vertex of each triangle.
+struct TriPacket4
+{
+  CoordArray4 p[3];
+  CoordArray4 q[3];
+  CoordArray4 r[3];
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+/// \brief Squared distances between a query point and four triangles.
+///
+/// This computes the same distances as FindClosestPtInTri() for each triangle,
+/// but processes all four triangles at once using SIMD arithmetic and without
+/// branching on the Voronoi region of the query point. Degenerate triangles
+/// are treated as their edges.
+CoordArray4 PtToTrisDistSq(const Pt3& x, const TriPacket4& tris);
+
 /// \brief Find the closest point to two line segments.
 ///
 /// The two line segments are defined by their endpoints.
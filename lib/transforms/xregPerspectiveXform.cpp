@@ -388,6 +388,21 @@ xreg::Pt3List xreg::CameraModel::phys_pts_to_ind_pts(const Pt3List& phys_pts) co
   return idx_pts;
 }
   
+xreg::Mat3x4 xreg::CameraModel::phys_to_ind_proj_mat() const
+{
+  Mat3x4 E = extrins.matrix().topRows<3>();
+
+  if ((coord_frame_type != kORIGIN_AT_FOCAL_PT_DET_POS_Z) &&
+      (coord_frame_type != kORIGIN_AT_FOCAL_PT_DET_NEG_Z))
+  {
+    // z -> focal_len - z
+    E.row(2) *= -1;
+    E(2,3) += focal_len;
+  }
+
+  return intrins * E;
+}
+
 xreg::Pt3 xreg::CameraModel::ind_pt_to_phys_det_pt(const Pt2& ind_pt) const
 {
   Pt3 ind_pt3D;
@@ -502,35 +517,90 @@ xreg::CameraModel xreg::UpdateCameraModelFor2DROI(const CameraModel& src_cam,
   return dst_cam;
 }
 
+xreg::Pt3ListSoA xreg::Pt3ListToSoA(const Pt3List& pts)
+{
+  const size_type num_pts = pts.size();
+
+  Pt3ListSoA pts_soa(3, num_pts);
+
+  for (size_type pt_idx = 0; pt_idx < num_pts; ++pt_idx)
+  {
+    pts_soa.col(pt_idx) = pts[pt_idx];
+  }
+
+  return pts_soa;
+}
+
+void xreg::ProjPtsForProjMats(const Mat3x4List& proj_mats, const Pt3ListSoA& pts,
+                              MatMxN* inds_cols, MatMxN* inds_rows)
+{
+  const size_type num_mats = proj_mats.size();
+
+  // Stack each row of the projection matrices, so that each homogeneous
+  // component of every projected point is computed with a single product
+  Eigen::Matrix<CoordScalar,Eigen::Dynamic,4> P_cols(num_mats, 4);
+  Eigen::Matrix<CoordScalar,Eigen::Dynamic,4> P_rows(num_mats, 4);
+  Eigen::Matrix<CoordScalar,Eigen::Dynamic,4> P_w(num_mats, 4);
+
+  for (size_type i = 0; i < num_mats; ++i)
+  {
+    P_cols.row(i) = proj_mats[i].row(0);
+    P_rows.row(i) = proj_mats[i].row(1);
+    P_w.row(i)    = proj_mats[i].row(2);
+  }
+
+  MatMxN w = P_w.leftCols<3>() * pts;
+  w.colwise() += P_w.col(3);
+
+  *inds_cols = P_cols.leftCols<3>() * pts;
+  inds_cols->colwise() += P_cols.col(3);
+  inds_cols->array() /= w.array();
+
+  *inds_rows = P_rows.leftCols<3>() * pts;
+  inds_rows->colwise() += P_rows.col(3);
+  inds_rows->array() /= w.array();
+}
+
+void xreg::ProjPtsForPoses(const CameraModel& cam, const FrameTransformList& obj_to_cam_world_xforms,
+                           const Pt3ListSoA& pts, MatMxN* inds_cols, MatMxN* inds_rows)
+{
+  const Mat3x4 cam_proj_mat = cam.phys_to_ind_proj_mat();
+
+  const size_type num_poses = obj_to_cam_world_xforms.size();
+
+  Mat3x4List proj_mats(num_poses);
+
+  for (size_type i = 0; i < num_poses; ++i)
+  {
+    proj_mats[i] = cam_proj_mat * obj_to_cam_world_xforms[i].matrix();
+  }
+
+  ProjPtsForProjMats(proj_mats, pts, inds_cols, inds_rows);
+}
+
 std::tuple<xreg::Pt2,xreg::Pt2>
 xreg::GetBoundingBox2DProjPts(const CameraModel& cam, const Pt3List& pts_3d)
 {
   Pt2 top_left;
   Pt2 bot_right;
-  
-  const size_type num_pts = pts_3d.size();
-
-  CoordScalar& min_c = top_left[0];
-  CoordScalar& min_r = top_left[1];
-  CoordScalar& max_c = bot_right[0];
-  CoordScalar& max_r = bot_right[1];
 
-  min_c = std::numeric_limits<CoordScalar>::max();
-  min_r = std::numeric_limits<CoordScalar>::max();
-  max_c = std::numeric_limits<CoordScalar>::lowest();
-  max_r = std::numeric_limits<CoordScalar>::lowest();
+  if (pts_3d.empty())
+  {
+    top_left.setConstant(std::numeric_limits<CoordScalar>::max());
+    bot_right.setConstant(std::numeric_limits<CoordScalar>::lowest());
+  }
+  else
+  {
+    MatMxN inds_cols;
+    MatMxN inds_rows;
 
-  Pt3 proj_pt;
+    ProjPtsForProjMats(Mat3x4List(1, cam.phys_to_ind_proj_mat()), Pt3ListToSoA(pts_3d),
+                       &inds_cols, &inds_rows);
 
-  for (size_type pt_idx = 0; pt_idx < num_pts; ++pt_idx)
-  {
-    proj_pt = cam.phys_pt_to_ind_pt(pts_3d[pt_idx]);
-  
-    min_c = std::min(min_c, proj_pt[0]);
-    max_c = std::max(max_c, proj_pt[0]);
-    
-    min_r = std::min(min_r, proj_pt[1]);
-    max_r = std::max(max_r, proj_pt[1]);
+    top_left[0]  = inds_cols.minCoeff();
+    top_left[1]  = inds_rows.minCoeff();
+    bot_right[0] = inds_cols.maxCoeff();
+    bot_right[1] = inds_rows.maxCoeff();
   }
 
   return std::make_tuple(top_left, bot_right);
@@ -556,7 +626,7 @@ xreg::CameraModel xreg::UpdateCameraModelTightBoundsForProjPts(const CameraModel
   min_r = std::max(CoordScalar(0), std::floor(min_r));
   
   max_c = std::min(CoordScalar(cam.num_det_cols - 1), std::ceil(max_c));
-  min_r = std::min(CoordScalar(cam.num_det_rows - 1), std::ceil(max_r));
+  max_r = std::min(CoordScalar(cam.num_det_rows - 1), std::ceil(max_r));
 
   return UpdateCameraModelFor2DROI(cam,
                                    static_cast<size_type>(min_c),
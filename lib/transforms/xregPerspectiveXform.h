@@ -227,6 +227,15 @@ struct CameraModel
   /// \see phys_pt_to_ind_pt
   Pt3List phys_pts_to_ind_pts(const Pt3List& phys_pts) const;
 
+  /// \brief The 3x4 matrix mapping homogeneous physical points to homogeneous
+  ///        continuous indices.
+  ///
+  /// The physical points are in "world" coordinates. Normalizing the output
+  /// by its third component is equivalent to phys_pt_to_ind_pt(), but this
+  /// may be composed with object poses and applied to many points at once.
+  /// \see ProjPtsForProjMats
+  Mat3x4 phys_to_ind_proj_mat() const;
+
   /// \brief Convert a continuous index point to a physical point (on the detector)
   ///
   /// The physical point will be in "world" coordinates.
@@ -286,6 +295,34 @@ CameraModel UpdateCameraModelFor2DROI(const CameraModel& src_cam,
                                       const int roi_end_col,
                                       const int roi_end_row);
 
+/// \brief A collection of 3D points stored as a structure of arrays
+///
+/// Row k holds the kth component of each point, so that each component is
+/// contiguous in memory.
+using Pt3ListSoA = Eigen::Matrix<CoordScalar,3,Eigen::Dynamic,Eigen::RowMajor>;
+
+/// \brief Copies a list of 3D points into a structure of arrays
+Pt3ListSoA Pt3ListToSoA(const Pt3List& pts);
+
+/// \brief Projects a collection of 3D points using many 3x4 projection matrices
+///
+/// Typically, each projection matrix is a camera's phys_to_ind_proj_mat()
+/// multiplied by the transform from an object to camera "world" coordinates,
+/// e.g. one for each member of a population of poses.
+/// The outputs have one row per projection matrix and one column per point;
+/// (*inds_cols)(i,j) and (*inds_rows)(i,j) are the continuous column and row
+/// indices of point j projected with matrix i. All points are projected by a
+/// few matrix products, rather than one at a time.
+void ProjPtsForProjMats(const Mat3x4List& proj_mats, const Pt3ListSoA& pts,
+                        MatMxN* inds_cols, MatMxN* inds_rows);
+
+/// \brief Projects a collection of 3D points for many poses of an object
+///
+/// Each pose maps points from the object frame to camera "world" coordinates.
+/// \see ProjPtsForProjMats
+void ProjPtsForPoses(const CameraModel& cam, const FrameTransformList& obj_to_cam_world_xforms,
+                     const Pt3ListSoA& pts, MatMxN* inds_cols, MatMxN* inds_rows);
+
 /// \brief Given a set of 3D points in camera world coordinates, compute a
 ///        a bounding box about their projections in the 2D detector plane.
 ///
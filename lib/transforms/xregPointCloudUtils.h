@@ -135,6 +135,8 @@ void ComputeL2Norms(const Pt3List& pts, CoordScalarList* norms);
  **/
 void ScalePts(const CoordScalar& s, const Pt3List& src_pts, Pt3List* dst_pts);
 
+/// \brief Exhaustive closest point searches; see xregNearestNeighbors.h for
+///        indexed equivalents suitable for large clouds.
 std::tuple<Pt3,CoordScalar>
 FindClosestPtToPtCloudExhaustive(const Pt3& x, const Pt3List& pt_cloud);
 
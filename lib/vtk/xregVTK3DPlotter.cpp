@@ -24,7 +24,10 @@
 
 #include "xregVTK3DPlotter.h"
 
+#include <cstdint>
 #include <ctime>
+#include <list>
+#include <mutex>
 
 #include <vtkSphereSource.h>
 #include <vtkLineSource.h>
@@ -38,6 +41,7 @@
 #include <vtkLight.h>
 #include <vtkObjectFactory.h>  // vtkStandardNewMacro
 #include <vtkActor.h>
+#include <vtkLODActor.h>
 #include <vtkCommand.h>
 #include <vtkTextActor.h>
 #include <vtkCubeAxesActor.h>
@@ -63,6 +67,7 @@
 
 #include "xregObjWithOStream.h"
 #include "xregFilesystemUtils.h"
+#include "xregHashUtils.h"
 #include "xregRigidUtils.h"
 #include "xregVTKBasicUtils.h"
 #include "xregVTKITKUtils.h"
@@ -853,6 +858,9 @@ void Add2DImageHelper(itk::Image<T,2>* img, const CameraModel& cam, VTK3DPlotter
   // lower right pixel 
   const Pt3 det_rn_cm = cam.ind_pt_to_phys_det_pt(Pt2{cam.num_det_cols - 1, cam.num_det_rows - 1}); 
 
+  // top right pixel
+  const Pt3 det_r0_cm = cam.ind_pt_to_phys_det_pt(Pt2{cam.num_det_cols - 1, 0});
+
   plane_src->SetOrigin(det_rn_c0(0), det_rn_c0(1), det_rn_c0(2));
   plane_src->SetPoint1(det_rn_cm(0), det_rn_cm(1), det_rn_cm(2));
   plane_src->SetPoint2(det_r0_c0(0), det_r0_c0(1), det_r0_c0(2));
@@ -866,9 +874,11 @@ void Add2DImageHelper(itk::Image<T,2>* img, const CameraModel& cam, VTK3DPlotter
   vtkNew<vtkTextureMapToPlane> tex_map_to_plane;
   tex_map_to_plane->SetInputData(plane_src->GetOutput());
 
-  tex_map_to_plane->SetOrigin(det_rn_c0(0), det_rn_c0(1), det_rn_c0(2));
-  tex_map_to_plane->SetPoint1(det_rn_cm(0), det_rn_cm(1), det_rn_cm(2));
-  tex_map_to_plane->SetPoint2(det_r0_c0(0), det_r0_c0(1), det_r0_c0(2));
+  // The texture uses the ITK pixel buffer directly, without an up/down flip,
+  // so the texture origin is the top left pixel
+  tex_map_to_plane->SetOrigin(det_r0_c0(0), det_r0_c0(1), det_r0_c0(2));
+  tex_map_to_plane->SetPoint1(det_r0_cm(0), det_r0_cm(1), det_r0_cm(2));
+  tex_map_to_plane->SetPoint2(det_rn_c0(0), det_rn_c0(1), det_rn_c0(2));
   tex_map_to_plane->Update();
 
   plane_mapper->SetInputConnection(tex_map_to_plane->GetOutputPort());
@@ -879,7 +889,7 @@ void Add2DImageHelper(itk::Image<T,2>* img, const CameraModel& cam, VTK3DPlotter
   plane_actor->SetMapper(plane_mapper.GetPointer());
 
   vtkNew<vtkTexture> texture;
-  texture->SetInputData(ConvertITKImageToVTK(img, true, false));  // true -> flip up/down, false -> do not copy physical measurements
+  texture->SetInputData(ConvertITKImageToVTKNoCopy(img, false));  // false -> do not copy physical measurements
 
   plane_actor->SetTexture(texture.GetPointer());
 
@@ -903,18 +913,165 @@ void xreg::VTK3DPlotter::add_2D_image(itk::Image<float,2>* img, const CameraMode
   Add2DImageHelper(img, cam, *this);
 }
 
+namespace  // un-named
+{
+
+using namespace xreg;
+
+using vtkPolyDataPtr = vtkSmartPointer<vtkPolyData>;
+
+// VTK conversions of a mesh, ordered from the full resolution mesh to the
+// coarsest level of detail
+struct CachedVTKMesh
+{
+  std::uint64_t hash;
+
+  size_type num_verts;
+  size_type num_tris;
+
+  size_type lod_num_tris_thresh;
+
+  std::vector<vtkPolyDataPtr> polydata_lods;
+};
+
+std::uint64_t HashMeshContents(const TriMesh& mesh)
+{
+  Hasher64 h;
+
+  h.add_bytes_parallel(mesh.vertices.data(), mesh.vertices.size() * sizeof(TriMesh::Vertex));
+  
+  h.add_bytes_parallel(mesh.faces.data(), mesh.faces.size() * sizeof(TriMesh::Triangle));
+
+  h.add(mesh.normals_valid);
+
+  if (mesh.normals_valid)
+  {
+    h.add_bytes_parallel(mesh.normals.data(), mesh.normals.size() * sizeof(TriMesh::Vertex));
+  }
+
+  return h.value();
+}
+
+// Conversions, and decimations, are shared among plotter instances so that
+// tools drawing the same meshes several times only pay for them once. The
+// least recently used entries are dropped when the cache is full.
+const CachedVTKMesh& GetCachedVTKMesh(const TriMesh& mesh, const size_type lod_num_tris_thresh)
+{
+  constexpr size_type kMAX_NUM_CACHED_MESHES = 16;
+
+  // each level of detail keeps this fraction of the triangles of the previous level
+  constexpr double kLOD_KEEP_FRAC = 0.2;
+
+  // no further levels are created once this number of triangles is reached
+  constexpr size_type kLOD_MIN_NUM_TRIS = 5000;
+
+  static std::mutex cache_mutex;
+  static std::list<CachedVTKMesh> cache;
+
+  const std::uint64_t h = HashMeshContents(mesh);
+
+  const size_type num_verts = mesh.vertices.size();
+  const size_type num_tris  = mesh.faces.size();
+
+  std::lock_guard<std::mutex> lock(cache_mutex);
+
+  for (auto it = cache.begin(); it != cache.end(); ++it)
+  {
+    if ((it->hash == h) && (it->num_verts == num_verts) && (it->num_tris == num_tris) &&
+        (it->lod_num_tris_thresh == lod_num_tris_thresh))
+    {
+      cache.splice(cache.begin(), cache, it);
+      return cache.front();
+    }
+  }
+
+  CachedVTKMesh m;
+  m.hash = h;
+  m.num_verts = num_verts;
+  m.num_tris  = num_tris;
+  m.lod_num_tris_thresh = lod_num_tris_thresh;
+
+  vtkPolyDataPtr full_res = vtkPolyDataPtr::New();
+  ConvertTriMeshToVTKPolyData(mesh, full_res.GetPointer());
+
+  m.polydata_lods.push_back(full_res);
+
+  if (lod_num_tris_thresh && (num_tris > lod_num_tris_thresh))
+  {
+    size_type cur_num_tris = num_tris;
+
+    while ((cur_num_tris * kLOD_KEEP_FRAC) >= kLOD_MIN_NUM_TRIS)
+    {
+      vtkPolyDataPtr lod = vtkPolyDataPtr::New();
+
+      DecimateVTKPolyData(m.polydata_lods.back().GetPointer(), 1.0 - kLOD_KEEP_FRAC,
+                          lod.GetPointer());
+
+      const size_type lod_num_tris = static_cast<size_type>(lod->GetNumberOfPolys());
+
+      if (lod_num_tris >= cur_num_tris)
+      {
+        // no further reduction is possible
+        break;
+      }
+
+      m.polydata_lods.push_back(lod);
+
+      cur_num_tris = lod_num_tris;
+    }
+  }
+
+  cache.push_front(m);
+
+  if (cache.size() > kMAX_NUM_CACHED_MESHES)
+  {
+    cache.pop_back();
+  }
+
+  return cache.front();
+}
+
+}  // un-named
+
+void xreg::VTK3DPlotter::set_mesh_lod_num_tris_thresh(const size_type num_tris)
+{
+  mesh_lod_num_tris_thresh_ = num_tris;
+}
+
 void xreg::VTK3DPlotter::add_mesh(const TriMesh& mesh,
                                   const Scalar r, const Scalar g,
                                   const Scalar b, const Scalar a)
 {
-  vtkNew<vtkPolyData> polydata;
-
-  ConvertTriMeshToVTKPolyData(mesh, polydata.GetPointer());
+  // copy the smart pointers, the cache entry may be dropped by other plots
+  const std::vector<vtkPolyDataPtr> polydata_lods =
+                      GetCachedVTKMesh(mesh, mesh_lod_num_tris_thresh_).polydata_lods;
 
   vtkNew<vtkPolyDataMapper> polydata_mapper;
-  polydata_mapper->SetInputData(polydata.GetPointer());
+  polydata_mapper->SetInputData(polydata_lods[0].GetPointer());
+
+  vtkSmartPointer<vtkActor> polydata_actor;
+
+  if (polydata_lods.size() > 1)
+  {
+    vtkSmartPointer<vtkLODActor> lod_actor = vtkSmartPointer<vtkLODActor>::New();
+
+    // VTK selects the finest level of detail which renders within the time
+    // allocated by the interactor, and the full resolution mapper when still
+    for (size_type lod_idx = 1; lod_idx < polydata_lods.size(); ++lod_idx)
+    {
+      vtkNew<vtkPolyDataMapper> lod_mapper;
+      lod_mapper->SetInputData(polydata_lods[lod_idx].GetPointer());
+
+      lod_actor->AddLODMapper(lod_mapper.GetPointer());
+    }
+
+    polydata_actor = lod_actor.GetPointer();
+  }
+  else
+  {
+    polydata_actor = vtkSmartPointer<vtkActor>::New();
+  }
 
-  vtkNew<vtkActor> polydata_actor;
   polydata_actor->SetMapper(polydata_mapper.GetPointer());
 
   polydata_actor->GetProperty()->SetColor(r, g, b);
@@ -220,6 +220,15 @@ public:
   /// Uses default color.
   void add_mesh(const TriMesh& mesh);
 
+  /// \brief Sets the number of triangles above which meshes are plotted with
+  ///        additional, decimated, levels of detail.
+  ///
+  /// The decimated meshes are computed when a mesh is added and VTK switches to
+  /// them while interacting when the full resolution mesh cannot be rendered at
+  /// the interactive frame rate. Zero disables the additional levels of detail.
+  /// Only affects meshes added after this call.
+  void set_mesh_lod_num_tris_thresh(const size_type num_tris);
+
   void add_mesh_w_scalar_map(const TriMesh& mesh, const CoordScalarList& scalars,
                              const AnyParamMap& scalar_map_params = AnyParamMap());
 
@@ -325,6 +334,8 @@ private:
 
   bool do_full_screen_ = false;
 
+  size_type mesh_lod_num_tris_thresh_ = 500000;
+
   vtkNew<vtkRenderWindowInteractor> iren_;
   vtkNew<vtkRenderer> ren_;
   vtkNew<vtkRenderWindow> ren_win_;
@@ -27,6 +27,10 @@
 #include <vtkNew.h>
 #include <vtkImageImport.h>
 #include <vtkImageFlip.h>
+#include <vtkCallbackCommand.h>
+#include <vtkCommand.h>
+#include <vtkDataArray.h>
+#include <vtkPointData.h>
 #include <itkImage.h>
 
 #include "xregVTKBasicUtils.h"
@@ -96,6 +100,58 @@ vtkSmartPointer<vtkImageData> ConvertITKImageToVTKHelper(itk::Image<T,N>* itk_im
   return vtk_img;
 }
 
+// Releases the reference to an ITK image held by a VTK array using its buffer
+template <class T, unsigned int N>
+void ReleaseITKImageRef(vtkObject*, unsigned long, void* client_data, void*)
+{
+  delete static_cast<typename itk::Image<T,N>::Pointer*>(client_data);
+}
+
+template <class T, unsigned int N>
+vtkSmartPointer<vtkImageData> ConvertITKImageToVTKNoCopyHelper(itk::Image<T,N>* itk_img,
+                                                               const bool copy_phys_meta)
+{
+  static_assert((N == 2) || (N == 3), "only supports 2D and 3D images currently");
+
+  const auto img_size = itk_img->GetLargestPossibleRegion().GetSize();
+
+  const int z_len = (N == 2) ? 1 : static_cast<int>(img_size[2]);
+
+  const vtkIdType num_pix = static_cast<vtkIdType>(img_size[0]) * img_size[1] * z_len;
+
+  vtkSmartPointer<vtkDataArray> pix_arr = vtkSmartPointer<vtkDataArray>::Take(
+                      vtkDataArray::CreateDataArray(xreg::LookupVTKDataTypeID<T>::value));
+
+  pix_arr->SetNumberOfComponents(1);
+  pix_arr->SetVoidArray(itk_img->GetBufferPointer(), num_pix, 1);  // 1 -> VTK will not delete the buffer
+
+  // The array keeps a reference to the ITK image, which owns the buffer, until
+  // the array is deleted
+  vtkNew<vtkCallbackCommand> release_cmd;
+  release_cmd->SetClientData(new typename itk::Image<T,N>::Pointer(itk_img));
+  release_cmd->SetCallback(&ReleaseITKImageRef<T,N>);
+
+  pix_arr->AddObserver(vtkCommand::DeleteEvent, release_cmd.GetPointer());
+
+  vtkSmartPointer<vtkImageData> vtk_img = vtkSmartPointer<vtkImageData>::New();
+
+  vtk_img->SetDimensions(static_cast<int>(img_size[0]), static_cast<int>(img_size[1]), z_len);
+
+  if (copy_phys_meta)
+  {
+    const auto img_spacing = itk_img->GetSpacing();
+
+    vtk_img->SetSpacing(img_spacing[0], img_spacing[1], (N == 2) ? 0.0 : img_spacing[2]);  // 0 spacing in z dim for 2D
+
+    const auto img_orig = itk_img->GetOrigin();
+    vtk_img->SetOrigin(img_orig[0], img_orig[1], (N == 2) ? 0.0 : img_orig[2]);  // physical location of the voxel 0,0,0
+  }
+
+  vtk_img->GetPointData()->SetScalars(pix_arr);
+
+  return vtk_img;
+}
+
 }  // un-named
 
 #define XREG_MAKE_ConvertITKImageToVTK(T,N)                                          \
@@ -116,3 +172,19 @@ XREG_MAKE_ConvertITKImageToVTK(float,3)
 
 #undef XREG_MAKE_ConvertITKImageToVTK
 
+#define XREG_MAKE_ConvertITKImageToVTKNoCopy(T,N)                                         \
+vtkSmartPointer<vtkImageData> xreg::ConvertITKImageToVTKNoCopy(itk::Image<T,N>* itk_img,   \
+                                                               const bool copy_phys_meta)  \
+{                                                                                          \
+  return ConvertITKImageToVTKNoCopyHelper(itk_img, copy_phys_meta);                        \
+}
+
+XREG_MAKE_ConvertITKImageToVTKNoCopy(unsigned char,2)
+XREG_MAKE_ConvertITKImageToVTKNoCopy(unsigned short,2)
+XREG_MAKE_ConvertITKImageToVTKNoCopy(float,2)
+
+XREG_MAKE_ConvertITKImageToVTKNoCopy(unsigned char,3)
+XREG_MAKE_ConvertITKImageToVTKNoCopy(unsigned short,3)
+XREG_MAKE_ConvertITKImageToVTKNoCopy(float,3)
+
+#undef XREG_MAKE_ConvertITKImageToVTKNoCopy
@@ -70,6 +70,35 @@ vtkSmartPointer<vtkImageData> ConvertITKImageToVTK(itk::Image<float,3>* itk_img,
                                                    const bool flip_ud = true,
                                                    const bool copy_phys_meta = false);
 
+/// \brief Creates a VTK image which uses the pixel buffer of an ITK image,
+///        without copying.
+///
+/// The VTK image holds a reference to the ITK image, which is released when
+/// the VTK pixel array is deleted, so the ITK image may be released by the
+/// caller. Modifications to the pixels of either image are visible through
+/// the other.
+/// No up/down flip is performed, so index zero of the VTK image is the
+/// upper-left ITK pixel; e.g. texture coordinates should place the origin at
+/// the first row of the image. Physical measurements are handled as in
+/// ConvertITKImageToVTK().
+vtkSmartPointer<vtkImageData> ConvertITKImageToVTKNoCopy(itk::Image<unsigned char,2>* itk_img,
+                                                         const bool copy_phys_meta = false);
+
+vtkSmartPointer<vtkImageData> ConvertITKImageToVTKNoCopy(itk::Image<unsigned short,2>* itk_img,
+                                                         const bool copy_phys_meta = false);
+
+vtkSmartPointer<vtkImageData> ConvertITKImageToVTKNoCopy(itk::Image<float,2>* itk_img,
+                                                         const bool copy_phys_meta = false);
+
+vtkSmartPointer<vtkImageData> ConvertITKImageToVTKNoCopy(itk::Image<unsigned char,3>* itk_img,
+                                                         const bool copy_phys_meta = false);
+
+vtkSmartPointer<vtkImageData> ConvertITKImageToVTKNoCopy(itk::Image<unsigned short,3>* itk_img,
+                                                         const bool copy_phys_meta = false);
+
+vtkSmartPointer<vtkImageData> ConvertITKImageToVTKNoCopy(itk::Image<float,3>* itk_img,
+                                                         const bool copy_phys_meta = false);
+
 }  // xreg
 
 #endif
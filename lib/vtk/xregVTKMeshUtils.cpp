@@ -37,6 +37,7 @@
 #include <vtkTriangleFilter.h>
 #include <vtkImageData.h>
 #include <vtkDiscreteMarchingCubes.h>
+#include <vtkPolyDataAlgorithm.h>
 #include <vtkWindowedSincPolyDataFilter.h>
 #include <vtkQuadricDecimation.h>
 #include <vtkPolyDataNormals.h>
@@ -46,9 +47,17 @@
 
 #include <vtkVersionMacros.h>
 
+#if VTK_MAJOR_VERSION >= 9
+#include <vtkDiscreteFlyingEdges3D.h>
+#endif
+
+#include <itkRegionOfInterestImageFilter.h>
+
 #include "xregVTKBasicUtils.h"
 #include "xregVTKITKUtils.h"
 #include "xregITKBasicImageUtils.h"
+#include "xregITKLabelStats.h"
+#include "xregTBBUtils.h"
 
 xreg::TriMesh xreg::ConvertVTKPolyDataToTriMesh(vtkPolyData* poly_data)
 {
@@ -252,6 +261,17 @@ xreg::TriMesh xreg::ReadVTKMesh(const std::string& path)
   return ConvertVTKPolyDataToTriMesh(reader->GetOutput());
 }
 
+void xreg::DecimateVTKPolyData(vtkPolyData* src_poly_data, const double reduction_amount,
+                               vtkPolyData* dst_poly_data)
+{
+  vtkNew<vtkQuadricDecimation> reduce;
+  reduce->SetInputData(src_poly_data);
+  reduce->SetTargetReduction(reduction_amount);
+  reduce->Update();
+
+  dst_poly_data->ShallowCopy(reduce->GetOutput());
+}
+
 xreg::TriMesh xreg::ReadPLYMesh(const std::string& path)
 {
   vtkNew<vtkPLYReader> reader;
@@ -262,8 +282,132 @@ xreg::TriMesh xreg::ReadPLYMesh(const std::string& path)
   return ConvertVTKPolyDataToTriMesh(reader->GetOutput());
 }
 
+namespace  // un-named
+{
+
+using namespace xreg;
+
+template <class tFilter>
+vtkSmartPointer<vtkPolyDataAlgorithm>
+RunDiscreteIsosurfaceFilter(vtkImageData* img, const VTKCreateMesh::LabelList& labels)
+{
+  vtkSmartPointer<tFilter> cubes = vtkSmartPointer<tFilter>::New();
+  cubes->SetInputData(img);
+
+  const size_type num_labels = labels.size();
+  cubes->SetNumberOfContours(num_labels);
+  for (size_type label_idx = 0; label_idx < num_labels; ++label_idx)
+  {
+    cubes->SetValue(label_idx, labels[label_idx]);
+  }
+
+  cubes->Update();
+
+  return cubes.GetPointer();
+}
+
+}  // un-named
+
 xreg::TriMesh xreg::VTKCreateMesh::operator()(itk::Image<unsigned char,3>* label_img)
 {
+  if (crop_to_labels)
+  {
+    const ITKLabelStatsList label_stats = ComputeITKLabelStats(label_img);
+
+    return create_mesh_for_labels(label_img, labels, &label_stats);
+  }
+  else
+  {
+    return create_mesh_for_labels(label_img, labels, nullptr);
+  }
+}
+
+std::vector<xreg::TriMesh>
+xreg::VTKCreateMesh::create_mesh_per_label(itk::Image<unsigned char,3>* label_img) const
+{
+  const size_type num_labels = labels.size();
+
+  ITKLabelStatsList label_stats;
+
+  if (crop_to_labels)
+  {
+    label_stats = ComputeITKLabelStats(label_img);
+  }
+
+  std::vector<TriMesh> meshes(num_labels);
+
+  auto create_meshes_fn = [&] (const RangeType& r)
+  {
+    for (size_type label_idx = r.begin(); label_idx < r.end(); ++label_idx)
+    {
+      meshes[label_idx] = create_mesh_for_labels(label_img, LabelList(1, labels[label_idx]),
+                                                 crop_to_labels ? &label_stats : nullptr);
+    }
+  };
+
+  ParallelFor(create_meshes_fn, RangeType(0, num_labels));
+
+  return meshes;
+}
+
+xreg::TriMesh
+xreg::VTKCreateMesh::create_mesh_for_labels(itk::Image<unsigned char,3>* label_img,
+                                            const LabelList& labels_to_mesh,
+                                            const std::vector<ITKLabelStats>* label_stats) const
+{
+  using LabelImage = itk::Image<unsigned char,3>;
+  using ROIFilter  = itk::RegionOfInterestImageFilter<LabelImage,LabelImage>;
+
+  const auto full_region = label_img->GetLargestPossibleRegion();
+
+  LabelImage::Pointer cropped_label_img;
+
+  // offset of the cropped region in the indices of the original label map
+  Pt3 crop_start_idx = Pt3::Zero();
+
+  if (label_stats)
+  {
+    ITKLabelStats labels_to_mesh_stats;
+
+    for (const auto& l : labels_to_mesh)
+    {
+      const size_type l_idx = static_cast<size_type>(l);
+
+      if (l_idx < label_stats->size())
+      {
+        labels_to_mesh_stats.merge((*label_stats)[l_idx]);
+      }
+    }
+
+    if (!labels_to_mesh_stats.num_vox)
+    {
+      // no voxels to create a surface from
+      return TriMesh();
+    }
+
+    // a voxel of padding keeps every marching cubes cell that touches a label
+    auto crop_region = labels_to_mesh_stats.bound_box();
+    crop_region.PadByRadius(1);
+    crop_region.Crop(full_region);
+
+    if (crop_region != full_region)
+    {
+      auto roi_filt = ROIFilter::New();
+      roi_filt->SetInput(label_img);
+      roi_filt->SetRegionOfInterest(crop_region);
+      roi_filt->Update();
+
+      cropped_label_img = roi_filt->GetOutput();
+
+      for (size_type d = 0; d < 3; ++d)
+      {
+        crop_start_idx[d] = static_cast<CoordScalar>(crop_region.GetIndex()[d] - full_region.GetIndex()[d]);
+      }
+
+      label_img = cropped_label_img.GetPointer();
+    }
+  }
+
   // convert from the ITK image container to VTK, so we can use the VTK routines for meshes
   // flip up/down to get correct origin index - ignore spacing and origin physical points,
   // so VTK produces a mesh in image index coordinates first - afterwards we'll convert the
@@ -276,17 +420,20 @@ xreg::TriMesh xreg::VTKCreateMesh::operator()(itk::Image<unsigned char,3>* label
   vtkNew<vtkPolyDataNormals> normals;
 
   // Create the initial isosurface from the label image with marching cubes
-  vtkNew<vtkDiscreteMarchingCubes> cubes;
-  cubes->SetInputData(vtk_img.GetPointer());
+  vtkSmartPointer<vtkPolyDataAlgorithm> cubes;
 
-  const size_type num_labels = labels.size();
-  cubes->SetNumberOfContours(num_labels);
-  for (size_type label_idx = 0; label_idx < num_labels; ++label_idx)
+#if VTK_MAJOR_VERSION >= 9
+  if (use_flying_edges)
   {
-    cubes->SetValue(label_idx, labels[label_idx]);
+    cubes = RunDiscreteIsosurfaceFilter<vtkDiscreteFlyingEdges3D>(vtk_img.GetPointer(),
+                                                                  labels_to_mesh);
+  }
+  else
+#endif
+  {
+    cubes = RunDiscreteIsosurfaceFilter<vtkDiscreteMarchingCubes>(vtk_img.GetPointer(),
+                                                                  labels_to_mesh);
   }
-
-  cubes->Update();
 
   vtkSmartPointer<vtkAlgorithmOutput> cur_output_port = cubes->GetOutputPort();
   vtkSmartPointer<vtkPolyData>        cur_output      = cubes->GetOutput();
@@ -377,6 +524,11 @@ xreg::TriMesh xreg::VTKCreateMesh::operator()(itk::Image<unsigned char,3>* label
   {
     vertex_xform = ITKImagePhysicalPointTransformsAsEigen(label_img) * vertex_xform;
   }
+  else
+  {
+    // report indices of the original label map when it was cropped
+    vertex_xform.pretranslate(crop_start_idx);
+  }
 
   mesh.transform(vertex_xform);
 
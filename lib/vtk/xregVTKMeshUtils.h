@@ -36,6 +36,9 @@ class vtkPolyData;
 namespace xreg
 {
 
+// Forward declaration
+struct ITKLabelStats;
+
 /**
  * @brief Converts a VTK mesh into a TriMesh.
  * @param poly_data The VTK mesh to convert; assumed to contain only triangular faces
@@ -51,6 +54,16 @@ TriMesh ConvertVTKPolyDataToTriMesh(vtkPolyData* poly_data);
  **/
 void ConvertTriMeshToVTKPolyData(const TriMesh& src_mesh, vtkPolyData* poly_data);
 
+/**
+ * @brief Decimates a VTK mesh using quadric error metrics.
+ *
+ * @param src_poly_data The VTK mesh to decimate; assumed to contain only triangular faces
+ * @param reduction_amount The fraction of triangles to remove, e.g. 0.9 keeps approximately 10%
+ * @param dst_poly_data The destination VTK mesh
+ **/
+void DecimateVTKPolyData(vtkPolyData* src_poly_data, const double reduction_amount,
+                         vtkPolyData* dst_poly_data);
+
 /**
  * @brief Writes a mesh to disk using a vtkPolyDataWriter.
  *
@@ -122,8 +135,32 @@ struct VTKCreateMesh
   /// \brief Reverse the vertex ordering and flip normals of the VTK output
   bool reverse_vertex_order = false;
 
+  /// \brief Only run marching cubes over the bounding box of the labels, padded by
+  ///        a voxel; the output mesh is unchanged.
+  bool crop_to_labels = true;
+
+  /// \brief Use the VTK discrete flying edges filter, which is multi-threaded,
+  ///        instead of discrete marching cubes.
+  ///
+  /// Requires VTK 9 or later; marching cubes is used with older versions.
+  /// The resulting surfaces are equivalent, but the ordering of vertices and
+  /// triangles may differ from marching cubes.
+  bool use_flying_edges = false;
+
   /// \brief Creates, and refines, a surface mesh from a label map volume using VTK routines.
   TriMesh operator()(itk::Image<unsigned char,3>* label_img);
+
+  /// \brief Creates a separate surface mesh for each label.
+  ///
+  /// The bounding boxes of all labels are found in a single pass over the
+  /// label map and the meshes are created concurrently. Labels that are not
+  /// present in the label map yield empty meshes.
+  std::vector<TriMesh> create_mesh_per_label(itk::Image<unsigned char,3>* label_img) const;
+
+private:
+  TriMesh create_mesh_for_labels(itk::Image<unsigned char,3>* label_img,
+                                 const LabelList& labels_to_mesh,
+                                 const std::vector<ITKLabelStats>* label_stats) const;
 };
 
 }  // xreg
@@ -0,0 +1,160 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file
+ * @brief Compares the direct CPU linear interpolators of the ray casters with
+ *        itk::LinearInterpolateImageFunction, including points slightly
+ *        outside of the volume as reached by ray stepping.
+ **/
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include <itkLinearInterpolateImageFunction.h>
+
+#include "xregITKBasicImageUtils.h"
+#include "xregRayCastInterpCPU.h"
+#include "xregRayCastGradVol.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+using Vol = RayCaster::Vol;
+
+// the difference between ITK, which extrapolates slightly, and the clamped
+// interpolators is at most 1e-3 times the largest difference between
+// neighboring voxels
+constexpr double kTOL = 0.05;
+
+bool CheckVal(const char* name, const Pt3& idx, const double v, const double expected)
+{
+  const bool ok = std::abs(v - expected) <= kTOL;
+
+  if (!ok)
+  {
+    std::cerr << name << " mismatch at (" << idx[0] << ", " << idx[1] << ", " << idx[2]
+              << "): " << v << " expected: " << expected << std::endl;
+  }
+
+  return ok;
+}
+
+}  // un-named
+
+int main()
+{
+  const int nx = 5;
+  const int ny = 4;
+  const int nz = 3;
+
+  auto vol = MakeITK3DVol<Vol::PixelType>(nx, ny, nz);
+
+  // values which are not linear in the indices, so that interpolating between
+  // the wrong neighbors is detected
+  RayCastGradVol gv;
+  gv.size_x = nx;
+  gv.size_y = ny;
+  gv.size_z = nz;
+  gv.buf.assign(RayCastGradVol::kNUM_COMPS * nx * ny * nz, 0);
+
+  for (int k = 0; k < nz; ++k)
+  {
+    for (int j = 0; j < ny; ++j)
+    {
+      for (int i = 0; i < nx; ++i)
+      {
+        Vol::IndexType vol_idx;
+        vol_idx[0] = i;
+        vol_idx[1] = j;
+        vol_idx[2] = k;
+
+        const float v = static_cast<float>(((i * i) % 7) + (2 * ((j * 3) % 5)) + (4 * k));
+
+        vol->SetPixel(vol_idx, v);
+
+        // each gradient component holds the same value, so that it may be
+        // compared with the volume interpolation
+        for (int c = 0; c < 3; ++c)
+        {
+          gv.buf[gv.offset(i,j,k) + c] = v;
+        }
+      }
+    }
+  }
+
+  auto itk_interp = itk::LinearInterpolateImageFunction<Vol,CoordScalar>::New();
+  itk_interp->SetInputImage(vol);
+
+  const RayCastVolLinearInterpCPU<RayCastVolBufCPU> interp = { MakeRayCastVolBufCPU(vol.GetPointer()) };
+
+  const CoordScalar eps = 1.0e-3;
+
+  const CoordScalar xs[] = { -eps, 0, 0.25, 1.5, nx - 1 - eps, nx - 1, nx - 1 + eps };
+  const CoordScalar ys[] = { -eps, 0, 1.75, ny - 1, ny - 1 + eps };
+  const CoordScalar zs[] = { -eps, 0.5, nz - 1 + eps };
+
+  bool ok = true;
+
+  for (const CoordScalar z : zs)
+  {
+    for (const CoordScalar y : ys)
+    {
+      for (const CoordScalar x : xs)
+      {
+        itk::ContinuousIndex<CoordScalar,3> cont_idx;
+        cont_idx[0] = x;
+        cont_idx[1] = y;
+        cont_idx[2] = z;
+
+        // ITK does not interpolate outside of the buffer, so use the nearest
+        // point inside of the volume
+        itk::ContinuousIndex<CoordScalar,3> inside_idx;
+        inside_idx[0] = std::min(std::max(x, CoordScalar(0)), CoordScalar(nx - 1));
+        inside_idx[1] = std::min(std::max(y, CoordScalar(0)), CoordScalar(ny - 1));
+        inside_idx[2] = std::min(std::max(z, CoordScalar(0)), CoordScalar(nz - 1));
+
+        const double expected = itk_interp->IsInsideBuffer(cont_idx) ?
+                                  itk_interp->EvaluateAtContinuousIndex(cont_idx) :
+                                  itk_interp->EvaluateAtContinuousIndex(inside_idx);
+
+        const Pt3 idx(x, y, z);
+
+        ok = CheckVal("vol", idx, interp(x, y, z), expected) && ok;
+
+        const Pt3 g = RayCastGradVolLinearInterpCPU(gv, idx);
+
+        for (int c = 0; c < 3; ++c)
+        {
+          ok = CheckVal("grad vol", idx, g[c], expected) && ok;
+        }
+      }
+    }
+  }
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
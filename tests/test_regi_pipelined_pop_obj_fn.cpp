@@ -0,0 +1,240 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2020 Robert Grupp
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file
+ * @brief Checks that evaluating a population in two pipelined halves, using
+ *        two compute slots of an OpenCL ray caster, yields exactly the same
+ *        objective function values as evaluating it as a single batch.
+ *
+ * The test is skipped when no OpenCL device is available.
+ **/
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+#include <boost/compute/exception/no_device_found.hpp>
+
+#include "xregITKBasicImageUtils.h"
+#include "xregRayCastLineIntOCL.h"
+#include "xregImgSimMetric2DNCCOCL.h"
+#include "xregSE3OptVars.h"
+#include "xregIntensity2D3DRegiCMAES.h"
+#include "xregRegi2D3DPenaltyFnSE3Mag.h"
+#include "xregFoldNormDist.h"
+
+namespace  // un-named
+{
+
+using namespace xreg;
+
+// an odd population size, so that the halves have different sizes
+constexpr size_type kPOP_SIZE = 9;
+
+constexpr size_type kVOL_SIZE = 32;
+
+constexpr size_type kDET_SIZE = 64;
+
+// exit code indicating a skipped test to ctest
+constexpr int kSKIP_TEST = 77;
+
+// Exposes the population objective function
+class PopObjFnTestRegi : public Intensity2D3DRegiCMAES
+{
+public:
+  using Intensity2D3DRegi::pop_obj_fn;
+};
+
+// A cube of 2 mm voxels holding a sphere with a denser, off-center, core
+RayCaster::VolPtr MakeVol()
+{
+  auto vol = MakeITK3DVol<RayCaster::PixelScalar3D>(kVOL_SIZE, kVOL_SIZE, kVOL_SIZE);
+
+  RayCaster::Vol::SpacingType spacing;
+  spacing.Fill(2);
+  vol->SetSpacing(spacing);
+
+  RayCaster::PixelScalar3D* buf = vol->GetBufferPointer();
+
+  const Pt3 center = Pt3::Constant(kVOL_SIZE / 2.0f);
+  const Pt3 core_center(kVOL_SIZE / 3.0f, kVOL_SIZE / 2.0f, kVOL_SIZE / 1.5f);
+
+  for (size_type z = 0; z < kVOL_SIZE; ++z)
+  {
+    for (size_type y = 0; y < kVOL_SIZE; ++y)
+    {
+      for (size_type x = 0; x < kVOL_SIZE; ++x, ++buf)
+      {
+        const Pt3 p(x, y, z);
+
+        *buf = (((p - center).norm() < (kVOL_SIZE / 2.5f)) ? 0.5f : 0.0f) +
+               (((p - core_center).norm() < (kVOL_SIZE / 6.0f)) ? 1.0f : 0.0f);
+      }
+    }
+  }
+
+  return vol;
+}
+
+// A smooth pattern, the similarity values only need to vary with the poses
+ImgSimMetric2D::ImagePtr MakeFixedImg()
+{
+  auto img = MakeITK2DVol<ImgSimMetric2D::Scalar>(kDET_SIZE, kDET_SIZE);
+
+  ImgSimMetric2D::Image::SpacingType spacing;
+  spacing.Fill(2);
+  img->SetSpacing(spacing);
+
+  ImgSimMetric2D::Scalar* buf = img->GetBufferPointer();
+
+  for (size_type r = 0; r < kDET_SIZE; ++r)
+  {
+    for (size_type c = 0; c < kDET_SIZE; ++c, ++buf)
+    {
+      *buf = std::exp(-(std::pow((r - 28.0f) / 12.0f, 2) + std::pow((c - 36.0f) / 9.0f, 2)));
+    }
+  }
+
+  return img;
+}
+
+bool CheckSimVals(const char* desc,
+                  const Intensity2D3DRegi::ScalarList& serial_vals,
+                  const Intensity2D3DRegi::ScalarList& pipelined_vals)
+{
+  bool ok = true;
+
+  for (size_type cand_idx = 0; cand_idx < kPOP_SIZE; ++cand_idx)
+  {
+    if (serial_vals[cand_idx] != pipelined_vals[cand_idx])
+    {
+      std::cerr << desc << ": candidate " << cand_idx << " serial value: "
+                << serial_vals[cand_idx] << " pipelined value: "
+                << pipelined_vals[cand_idx] << std::endl;
+
+      ok = false;
+    }
+  }
+
+  return ok;
+}
+
+int RunTest()
+{
+  CameraModel cam;
+  cam.setup(1000, kDET_SIZE, kDET_SIZE, 2, 2);
+
+  auto ray_caster = std::make_shared<RayCasterLineIntOCL>();
+  ray_caster->set_volume(MakeVol());
+  ray_caster->set_camera_model(cam);
+
+  auto sim_metric = std::make_shared<ImgSimMetric2DNCCOCL>();
+  sim_metric->set_fixed_image(MakeFixedImg());
+
+  // the penalty and coefficients are also evaluated for each half
+  auto pen_fn = std::make_shared<Regi2D3DPenaltyFnSE3Mag>();
+  pen_fn->rot_pdfs_per_obj   = { std::make_shared<FoldNormDist>(0, 0.1) };
+  pen_fn->trans_pdfs_per_obj = { std::make_shared<FoldNormDist>(0, 10) };
+
+  PopObjFnTestRegi regi;
+  regi.set_opt_vars(std::make_shared<SE3OptVarsLieAlg>());
+  regi.set_pop_size(kPOP_SIZE);
+  regi.set_ray_caster(ray_caster);
+  regi.set_sim_metric(sim_metric);
+  regi.set_penalty_fn(pen_fn);
+  regi.set_img_sim_penalty_coefs(0.9, 0.1);
+  regi.set_pipeline_pop_obj_fn(true);
+  regi.setup();
+
+  if (ray_caster->num_compute_slots() != 2)
+  {
+    std::cerr << "the ray caster was not allocated with two compute slots" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // the focal point is 500 mm above the center of the volume, along the principal ray
+  FrameTransform cam_to_vol = FrameTransform::Identity();
+  cam_to_vol.translation() = Pt3(kVOL_SIZE, kVOL_SIZE, kVOL_SIZE + 500);
+
+  regi.set_regi_xform_guess(cam_to_vol);
+
+  std::mt19937 rng_eng(1234);
+  std::uniform_real_distribution<CoordScalar> rot_dist(-0.1, 0.1);
+  std::uniform_real_distribution<CoordScalar> trans_dist(-10, 10);
+
+  Intensity2D3DRegi::ListOfListsOfScalarLists params(1,
+                          Intensity2D3DRegi::ListOfScalarLists(kPOP_SIZE, Intensity2D3DRegi::ScalarList(6)));
+
+  Intensity2D3DRegi::ScalarList serial_vals(kPOP_SIZE);
+  Intensity2D3DRegi::ScalarList pipelined_vals(kPOP_SIZE);
+
+  bool ok = true;
+
+  // the second population re-uses most of the first, so that only the changed
+  // poses are transferred to each compute slot
+  for (int pop_idx = 0; pop_idx < 2; ++pop_idx)
+  {
+    for (size_type cand_idx = 0; cand_idx < kPOP_SIZE; ++cand_idx)
+    {
+      if (!pop_idx || (cand_idx % 3))
+      {
+        auto& x = params[0][cand_idx];
+
+        for (size_type i = 0; i < 3; ++i)
+        {
+          x[i]     = rot_dist(rng_eng);
+          x[i + 3] = trans_dist(rng_eng);
+        }
+      }
+    }
+
+    regi.set_pipeline_pop_obj_fn(false);
+    regi.pop_obj_fn(params, &serial_vals);
+
+    regi.set_pipeline_pop_obj_fn(true);
+    regi.pop_obj_fn(params, &pipelined_vals);
+
+    ok = CheckSimVals(pop_idx ? "second population" : "first population",
+                      serial_vals, pipelined_vals) && ok;
+  }
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+}  // un-named
+
+int main()
+{
+  try
+  {
+    return RunTest();
+  }
+  catch (const boost::compute::no_device_found&)
+  {
+    std::cerr << "no OpenCL device is available, skipping" << std::endl;
+    return kSKIP_TEST;
+  }
+}